@@ -14,6 +14,8 @@ BuildRequires: libmicrohttpd-devel >= 0.9.33
 BuildRequires: libseccomp-devel >= 2.3
 BuildRequires: help2man >= 1.41
 BuildRequires: libsecret-devel >= 0.18.4
+BuildRequires: systemtap-sdt-devel
+BuildRequires: tpm2-tss-devel
 
 Requires: libsodium >= 1.0.11
 Requires: libcurl >= 7.29
@@ -70,6 +72,8 @@ make install BIN_PATH=${RPM_BUILD_ROOT}/usr BIN_AFTER_INST_PATH=/usr MAN_PATH=${
 %config /etc/oidc-agent/pubclients.config
 %config /etc/oidc-agent/oidc-agent-service.options
 %config /etc/X11/Xsession.d/91oidc-agent
+/usr/lib/systemd/user/oidc-agent.socket
+/usr/lib/systemd/user/oidc-agent.service
 %doc /usr/share/man/man1/oidc-add.1.gz
 %doc /usr/share/man/man1/oidc-agent.1.gz
 %doc /usr/share/man/man1/oidc-gen.1.gz
@@ -3,8 +3,10 @@
 #include "defines/oidc_values.h"
 #include "defines/settings.h"
 #include "issuer_helper.h"
+#include "tokenCache.h"
 #include "utils/file_io/fileUtils.h"
 #include "utils/file_io/file_io.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
@@ -91,14 +93,19 @@ struct oidc_account* getAccountFromJSON(const char* json) {
                  OIDC_KEY_PASSWORD, OIDC_KEY_REFRESHTOKEN, AGENT_KEY_CERTPATH,
                  OIDC_KEY_REDIRECTURIS, OIDC_KEY_SCOPE,
                  OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT, OIDC_KEY_CLIENTNAME,
-                 AGENT_KEY_DAESETBYUSER, OIDC_KEY_AUDIENCE);
+                 AGENT_KEY_DAESETBYUSER, OIDC_KEY_AUDIENCE,
+                 AGENT_KEY_REFRESHTOKENPOOL, AGENT_KEY_REFRESHTOKENPOOLSIZE,
+                 AGENT_KEY_REFRESHTOKENSLOT);
   GET_JSON_VALUES_RETURN_NULL_ONERROR(json);
   KEY_VALUE_VARS(issuer_url, issuer, shortname, client_id, client_secret,
                  username, password, refresh_token, cert_path, redirect_uris,
                  scope, device_authorization_endpoint, clientname, daeSetByUser,
-                 audience);
-  struct oidc_account* p   = secAlloc(sizeof(struct oidc_account));
-  struct oidc_issuer*  iss = secAlloc(sizeof(struct oidc_issuer));
+                 audience, refresh_token_pool, refresh_token_pool_size,
+                 refresh_token_slot);
+  struct oidc_account* p =
+      secAllocTagged(sizeof(struct oidc_account), MEMTAG_ACCOUNT);
+  struct oidc_issuer* iss =
+      secAllocTagged(sizeof(struct oidc_issuer), MEMTAG_ACCOUNT);
   if (_issuer_url) {
     issuer_setIssuerUrl(iss, _issuer_url);
     secFree(_issuer);
@@ -108,7 +115,7 @@ struct oidc_account* getAccountFromJSON(const char* json) {
   issuer_setDeviceAuthorizationEndpoint(iss, _device_authorization_endpoint,
                                         strToInt(_daeSetByUser));
   secFree(_daeSetByUser);
-  account_setIssuer(p, iss);
+  account_setIssuer(p, issuer_intern(iss));
   account_setName(p, _shortname, NULL);
   account_setClientName(p, _clientname);
   account_setClientId(p, _client_id);
@@ -123,6 +130,21 @@ struct oidc_account* getAccountFromJSON(const char* json) {
   checkRedirectUrisForErrors(redirect_uris);
   account_setRedirectUris(p, redirect_uris);
   secFree(_redirect_uris);
+  list_t* pool = _refresh_token_pool
+                     ? JSONArrayStringToList(_refresh_token_pool)
+                     : NULL;
+  if (pool && pool->len == 0) {
+    secFreeList(pool);
+    pool = NULL;
+  }
+  account_setRefreshTokenPool(p, pool);
+  secFree(_refresh_token_pool);
+  account_setRefreshTokenPoolSize(
+      p, _refresh_token_pool_size ? strToULong(_refresh_token_pool_size) : 0);
+  secFree(_refresh_token_pool_size);
+  account_setRefreshTokenSlot(
+      p, _refresh_token_slot ? strToULong(_refresh_token_slot) : 0);
+  secFree(_refresh_token_slot);
   return p;
 }
 
@@ -133,9 +155,19 @@ char* accountToJSONString(const struct oidc_account* p) {
   return str;
 }
 
+/**
+ * @brief like @c accountToJSONString, but without formatting; used for ipc
+ */
+char* accountToJSONStringUnformatted(const struct oidc_account* p) {
+  cJSON* json = accountToJSON(p);
+  char*  str  = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return str;
+}
+
 char* accountToJSONStringWithoutCredentials(const struct oidc_account* p) {
   cJSON* json = accountToJSONWithoutCredentials(p);
-  char*  str  = jsonToString(json);
+  char*  str  = jsonToStringUnformatted(json);
   secFreeJson(json);
   return str;
 }
@@ -171,6 +203,19 @@ cJSON* _accountToJSON(const struct oidc_account* p, int useCredentials) {
       OIDC_KEY_AUDIENCE, cJSON_String,
       strValid(account_getAudience(p)) ? account_getAudience(p) : "", NULL);
   jsonAddJSON(json, OIDC_KEY_REDIRECTURIS, redirect_uris);
+  // only set if used, so that other configs do not change
+  if (account_getRefreshTokenPool(p)) {
+    jsonAddJSON(json, AGENT_KEY_REFRESHTOKENPOOL,
+                listToJSONArray(account_getRefreshTokenPool(p)));
+  }
+  if (account_getRefreshTokenPoolSize(p)) {
+    jsonAddNumberValue(json, AGENT_KEY_REFRESHTOKENPOOLSIZE,
+                       account_getRefreshTokenPoolSize(p));
+  }
+  if (account_getRefreshTokenSlot(p)) {
+    jsonAddNumberValue(json, AGENT_KEY_REFRESHTOKENSLOT,
+                       account_getRefreshTokenSlot(p));
+  }
   if (useCredentials) {
     jsonAddStringValue(
         json, OIDC_KEY_USERNAME,
@@ -226,7 +271,10 @@ void secFreeAccountContent(struct oidc_account* p) {
   account_setUsername(p, NULL);
   account_setPassword(p, NULL);
   account_setRefreshToken(p, NULL);
+  account_setRefreshTokenPool(p, NULL);
+  account_setRefreshTemplate(p, NULL);
   account_setAccessToken(p, NULL);
+  account_clearTokenCache(p);
   account_setCertPath(p, NULL);
   account_setRedirectUris(p, NULL);
   account_setUsedState(p, NULL);
@@ -235,10 +283,11 @@ void secFreeAccountContent(struct oidc_account* p) {
 /** int accountconfigExists(const char* accountname)
  * @brief checks if a configuration for a given account exists
  * @param accountname the short name that should be checked
- * @return 1 if the configuration exists, 0 if not
+ * @return 1 if the configuration exists or there is a keystore that might hold
+ * it, 0 if not; the index of the keystore can only be read with its password
  */
 int accountConfigExists(const char* accountname) {
-  return oidcFileDoesExist(accountname);
+  return oidcFileDoesExist(accountname) || keystore_exists();
 }
 
 /** @fn char* getAccountNameList(struct oidc_account* p, size_t size)
@@ -7,11 +7,13 @@
 #include "wrapper/list.h"
 
 #include <stdlib.h>
+#include <sys/types.h>
 #include <time.h>
 
 struct token {
   char*         access_token;
   unsigned long token_expires_at;
+  unsigned long token_issued_at;
 };
 
 struct oidc_account {
@@ -25,7 +27,13 @@ struct oidc_account {
   char*               username;
   char*               password;
   char*               refresh_token;
+  list_t*             refresh_token_pool;  // further refresh tokens
+  size_t              refresh_token_pool_size;
+  size_t              refresh_token_slot;  // 0: refresh_token, i: pool[i-1]
+  char*               refresh_template;  // memory encrypted, refreshTemplate.h
   struct token        token;
+  list_t*             token_cache;
+  list_t*             id_token_cache;
   char*               cert_path;
   list_t*             redirect_uris;
   char*               usedState;
@@ -33,6 +41,7 @@ struct oidc_account {
   time_t              death;
   char*               code_challenge_method;
   unsigned char       mode;
+  uid_t               owner;  // the user who loaded the account (--multi-user)
 };
 
 #define ACCOUNT_MODE_CONFIRM 0x01
@@ -44,6 +53,7 @@ char*                defineUsableScopes(const struct oidc_account* account);
 struct oidc_account* getAccountFromJSON(const char* json);
 cJSON*               accountToJSON(const struct oidc_account* p);
 char*                accountToJSONString(const struct oidc_account* p);
+char* accountToJSONStringUnformatted(const struct oidc_account* p);
 cJSON* accountToJSONWithoutCredentials(const struct oidc_account* p);
 char*  accountToJSONStringWithoutCredentials(const struct oidc_account* p);
 void   _secFreeAccount(struct oidc_account* p);
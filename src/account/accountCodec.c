@@ -0,0 +1,232 @@
+#include "accountCodec.h"
+#include "utils/crypt/base64.h"
+
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * A compact encoding of the account configuration for transfers between
+ * oidcp and oidcd; files and external clients keep using json. The encoding
+ * carries the same values as @c accountToJSON: a version byte followed by the
+ * values in a fixed order, each as a 32 bit little endian length and its
+ * bytes, where @c NULL values have the length @c ACCOUNT_CODEC_NULL. The
+ * redirect uris are a count followed by the uris; so are the tokens of the
+ * refresh token pool, which follow the pool size and the slot of the account
+ * as 32 bit values. The issuer is referenced by its url and shared through
+ * @c issuer_intern when decoding. The bytes are base64 encoded, so that they
+ * can be embedded into an ipc message.
+ */
+
+#define ACCOUNT_CODEC_NULL UINT32_MAX
+
+static oidc_error_t _putU32(struct string* s, uint32_t v) {
+  unsigned char b[4] = {v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF,
+                        (v >> 24) & 0xFF};
+  return string_append(s, (const char*)b, sizeof(b));
+}
+
+static oidc_error_t _putString(struct string* s, const char* v) {
+  if (!strValid(v)) {  // like in json, empty values are not set
+    return _putU32(s, ACCOUNT_CODEC_NULL);
+  }
+  size_t len = strlen(v);
+  if (_putU32(s, len) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  return string_append(s, v, len);
+}
+
+static oidc_error_t _putList(struct string* s, list_t* l) {
+  if (_putU32(s, l ? l->len : 0) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  if (l == NULL) {
+    return OIDC_SUCCESS;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(l, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (_putString(s, node->val) != OIDC_SUCCESS) {
+      list_iterator_destroy(it);
+      return oidc_errno;
+    }
+  }
+  list_iterator_destroy(it);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief encodes the configuration of an account
+ * @return a pointer to the base64 encoded string; has to be freed after usage
+ */
+char* accountToCompactString(const struct oidc_account* p) {
+  if (p == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct string s;
+  if (init_string(&s) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  const char version = ACCOUNT_CODEC_VERSION;
+  const char daeSetByUser =
+      issuer_getDeviceAuthorizationEndpointIsSetByUser(account_getIssuer(p));
+  if (string_append(&s, &version, 1) != OIDC_SUCCESS ||
+      _putString(&s, account_getName(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getClientName(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getIssuerUrl(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getDeviceAuthorizationEndpoint(p)) !=
+          OIDC_SUCCESS ||
+      string_append(&s, &daeSetByUser, 1) != OIDC_SUCCESS ||
+      _putString(&s, account_getClientId(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getClientSecret(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getRefreshToken(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getCertPath(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getScope(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getAudience(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getUsername(p)) != OIDC_SUCCESS ||
+      _putString(&s, account_getPassword(p)) != OIDC_SUCCESS ||
+      _putList(&s, account_getRedirectUris(p)) != OIDC_SUCCESS ||
+      _putU32(&s, account_getRefreshTokenPoolSize(p)) != OIDC_SUCCESS ||
+      _putU32(&s, account_getRefreshTokenSlot(p)) != OIDC_SUCCESS ||
+      _putList(&s, account_getRefreshTokenPool(p)) != OIDC_SUCCESS) {
+    secFree(s.ptr);
+    return NULL;
+  }
+  size_t b64len =
+      sodium_base64_ENCODED_LEN(s.len, sodium_base64_VARIANT_ORIGINAL);
+  char* b64 = secAlloc(b64len);
+  if (b64 != NULL) {
+    base64_encode(b64, b64len, (const unsigned char*)s.ptr, s.len,
+                  sodium_base64_VARIANT_ORIGINAL);
+  }
+  secFree(s.ptr);
+  return b64;
+}
+
+struct reader {
+  const unsigned char* pos;
+  const unsigned char* end;
+  int                  failed;
+};
+
+static uint32_t _getU32(struct reader* r) {
+  if (r->failed || r->end - r->pos < 4) {
+    r->failed = 1;
+    return 0;
+  }
+  uint32_t v = r->pos[0] | (uint32_t)r->pos[1] << 8 |
+               (uint32_t)r->pos[2] << 16 | (uint32_t)r->pos[3] << 24;
+  r->pos += 4;
+  return v;
+}
+
+static unsigned char _getByte(struct reader* r) {
+  if (r->failed || r->pos >= r->end) {
+    r->failed = 1;
+    return 0;
+  }
+  return *r->pos++;
+}
+
+static char* _getString(struct reader* r) {
+  uint32_t len = _getU32(r);
+  if (r->failed || len == ACCOUNT_CODEC_NULL) {
+    return NULL;
+  }
+  if ((size_t)(r->end - r->pos) < len) {
+    r->failed = 1;
+    return NULL;
+  }
+  char* v = secAlloc(len + 1);
+  if (v == NULL) {
+    r->failed = 1;
+    return NULL;
+  }
+  memcpy(v, r->pos, len);
+  r->pos += len;
+  return v;
+}
+
+static list_t* _getList(struct reader* r) {
+  uint32_t count = _getU32(r);
+  if (r->failed || count == 0) {
+    return NULL;
+  }
+  list_t* l = list_new();
+  l->free   = _secFree;
+  l->match  = (matchFunction)strequal;
+  for (uint32_t i = 0; i < count && !r->failed; i++) {
+    char* v = _getString(r);
+    if (v) {
+      list_rpush(l, list_node_new(v));
+    }
+  }
+  return l;
+}
+
+/**
+ * @brief decodes an account encoded with @c accountToCompactString
+ * @return a pointer to the account; has to be freed after usage. On failure
+ * @c NULL is returned.
+ */
+struct oidc_account* getAccountFromCompactString(const char* str) {
+  if (str == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t         b64len = strlen(str);
+  size_t         maxlen = b64len / 4 * 3 + 3;
+  unsigned char* bin    = secAlloc(maxlen);
+  size_t         binlen = 0;
+  if (bin == NULL) {
+    return NULL;
+  }
+  if (base64_decode(bin, maxlen, str, b64len, &binlen, NULL,
+                    sodium_base64_VARIANT_ORIGINAL) != 0 ||
+      binlen == 0 || bin[0] != ACCOUNT_CODEC_VERSION) {
+    secFree(bin);
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  struct reader        r = {.pos = bin + 1, .end = bin + binlen};
+  struct oidc_account* p =
+      secAllocTagged(sizeof(struct oidc_account), MEMTAG_ACCOUNT);
+  struct oidc_issuer* iss =
+      secAllocTagged(sizeof(struct oidc_issuer), MEMTAG_ACCOUNT);
+  char* shortname  = _getString(&r);
+  char* clientname = _getString(&r);
+  issuer_setIssuerUrl(iss, _getString(&r));
+  char*         dae          = _getString(&r);
+  unsigned char daeSetByUser = _getByte(&r);
+  issuer_setDeviceAuthorizationEndpoint(iss, dae, daeSetByUser);
+  account_setIssuer(p, issuer_intern(iss));
+  account_setName(p, shortname, NULL);
+  account_setClientName(p, clientname);
+  account_setClientId(p, _getString(&r));
+  account_setClientSecret(p, _getString(&r));
+  account_setRefreshToken(p, _getString(&r));
+  account_setCertPath(p, _getString(&r));
+  account_setScopeExact(p, _getString(&r));
+  account_setAudience(p, _getString(&r));
+  account_setUsername(p, _getString(&r));
+  account_setPassword(p, _getString(&r));
+  account_setRedirectUris(p, _getList(&r));
+  account_setRefreshTokenPoolSize(p, _getU32(&r));
+  account_setRefreshTokenSlot(p, _getU32(&r));
+  account_setRefreshTokenPool(p, _getList(&r));
+  secFree(bin);
+  if (r.failed) {
+    secFreeAccount(p);
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  return p;
+}
@@ -0,0 +1,11 @@
+#ifndef ACCOUNT_CODEC_H
+#define ACCOUNT_CODEC_H
+
+#include "account/account.h"
+
+#define ACCOUNT_CODEC_VERSION 2
+
+char*                accountToCompactString(const struct oidc_account* p);
+struct oidc_account* getAccountFromCompactString(const char* str);
+
+#endif  // ACCOUNT_CODEC_H
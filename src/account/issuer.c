@@ -1,19 +1,108 @@
 #include "issuer.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+/**
+ * The issuer registry holds the issuers that are shared between accounts. It
+ * is only used if interning was enabled, i.e. in oidcd, where many accounts of
+ * the same issuer can be loaded and all get the same openid configuration.
+ */
+static unsigned char interning = 0;
+static list_t*       registry  = NULL;
+
+/**
+ * @brief makes @c issuer_intern share issuer structs between accounts
+ */
+void issuer_enableInterning() { interning = 1; }
+
+static int _issuer_isInternable(const struct oidc_issuer* iss) {
+  // A user set device authorization endpoint belongs to a single account
+  return iss->refs == 0 && iss->issuer_url != NULL &&
+         !iss->device_authorization_endpoint.setByUser;
+}
+
+/**
+ * @brief returns the shared issuer for the issuer url of @p iss
+ * If an issuer with the same issuer url is already registered, its reference
+ * count is increased, @p iss is freed, and the registered issuer is returned.
+ * Otherwise @p iss is registered. References are released with
+ * @c secFreeIssuer.
+ * @param iss the issuer; ownership is taken
+ * @return the issuer to be used instead of @p iss
+ */
+struct oidc_issuer* issuer_intern(struct oidc_issuer* iss) {
+  if (!interning || iss == NULL || !_issuer_isInternable(iss)) {
+    return iss;
+  }
+  if (registry == NULL) {
+    registry = list_new();
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(registry, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct oidc_issuer* shared = node->val;
+    if (strequal(shared->issuer_url, iss->issuer_url)) {
+      break;
+    }
+  }
+  list_iterator_destroy(it);
+  if (node == NULL) {
+    iss->refs = 1;
+    list_rpush(registry, list_node_new(iss));
+    return iss;
+  }
+  struct oidc_issuer* shared = node->val;
+  shared->refs++;
+  if (issuer_getDeviceAuthorizationEndpoint(shared) == NULL) {
+    issuer_setDeviceAuthorizationEndpoint(
+        shared, iss->device_authorization_endpoint.url, 0);
+    iss->device_authorization_endpoint.url = NULL;
+  }
+  secFreeIssuer(iss);
+  return shared;
+}
+
+/**
+ * @brief returns the scope dictionary of @p iss, creating it from the supported
+ * scopes on first use
+ */
+struct scopeDict* issuer_getScopeDict(struct oidc_issuer* iss) {
+  if (iss == NULL) {
+    return NULL;
+  }
+  if (iss->scope_dict == NULL) {
+    iss->scope_dict = scopeDict_new(iss->scopes_supported);
+  }
+  return iss->scope_dict;
+}
 
 void _secFreeIssuer(struct oidc_issuer* iss) {
   if (!iss) {
     return;
   }
+  if (iss->refs > 1) {
+    iss->refs--;
+    return;
+  }
+  if (iss->refs == 1 && registry) {
+    list_node_t* node = list_find(registry, iss);
+    if (node) {
+      list_remove(registry, node);
+    }
+  }
   issuer_setIssuerUrl(iss, NULL);
   issuer_setConfigurationEndpoint(iss, NULL);
   issuer_setTokenEndpoint(iss, NULL);
   issuer_setAuthorizationEndpoint(iss, NULL);
   issuer_setRevocationEndpoint(iss, NULL);
+  issuer_setUserinfoEndpoint(iss, NULL);
+  issuer_setJwksUri(iss, NULL);
   issuer_setRegistrationEndpoint(iss, NULL);
   issuer_setDeviceAuthorizationEndpoint(iss, NULL, 0);
   issuer_setScopesSupported(iss, NULL);
   issuer_setGrantTypesSupported(iss, NULL);
   issuer_setResponseTypesSupported(iss, NULL);
+  secFreeScopeDict(iss->scope_dict);
   secFree(iss);
   iss = NULL;
 }
@@ -1,6 +1,7 @@
 #ifndef ISSUER_H
 #define ISSUER_H
 
+#include "account/scopeSet.h"
 #include "utils/memory.h"
 
 struct device_authorization_endpoint {
@@ -15,15 +16,23 @@ struct oidc_issuer {
   char*                                token_endpoint;
   char*                                authorization_endpoint;
   char*                                revocation_endpoint;
+  char*                                userinfo_endpoint;
+  char*                                jwks_uri;
   char*                                registration_endpoint;
   struct device_authorization_endpoint device_authorization_endpoint;
 
-  char* scopes_supported;          // space delimited
-  char* grant_types_supported;     // as json array
-  char* response_types_supported;  // as json array
+  char*             scopes_supported;          // space delimited
+  struct scopeDict* scope_dict;                // created on first use
+  char*             grant_types_supported;     // as json array
+  char*             response_types_supported;  // as json array
+
+  unsigned int refs;  // 0 if not shared through the issuer registry
 };
 
 void                _secFreeIssuer(struct oidc_issuer* iss);
+void                issuer_enableInterning();
+struct oidc_issuer* issuer_intern(struct oidc_issuer* iss);
+struct scopeDict*   issuer_getScopeDict(struct oidc_issuer* iss);
 inline static char* issuer_getIssuerUrl(struct oidc_issuer* iss) {
   return iss ? iss->issuer_url : NULL;
 };
@@ -39,6 +48,12 @@ inline static char* issuer_getAuthorizationEndpoint(struct oidc_issuer* iss) {
 inline static char* issuer_getRevocationEndpoint(struct oidc_issuer* iss) {
   return iss ? iss->revocation_endpoint : NULL;
 };
+inline static char* issuer_getUserinfoEndpoint(struct oidc_issuer* iss) {
+  return iss ? iss->userinfo_endpoint : NULL;
+};
+inline static char* issuer_getJwksUri(struct oidc_issuer* iss) {
+  return iss ? iss->jwks_uri : NULL;
+};
 inline static char* issuer_getRegistrationEndpoint(struct oidc_issuer* iss) {
   return iss ? iss->registration_endpoint : NULL;
 };
@@ -100,6 +115,21 @@ inline static void issuer_setRevocationEndpoint(struct oidc_issuer* iss,
   secFree(iss->revocation_endpoint);
   iss->revocation_endpoint = revocation_endpoint;
 }
+inline static void issuer_setUserinfoEndpoint(struct oidc_issuer* iss,
+                                              char* userinfo_endpoint) {
+  if (iss->userinfo_endpoint == userinfo_endpoint) {
+    return;
+  }
+  secFree(iss->userinfo_endpoint);
+  iss->userinfo_endpoint = userinfo_endpoint;
+}
+inline static void issuer_setJwksUri(struct oidc_issuer* iss, char* jwks_uri) {
+  if (iss->jwks_uri == jwks_uri) {
+    return;
+  }
+  secFree(iss->jwks_uri);
+  iss->jwks_uri = jwks_uri;
+}
 inline static void issuer_setRegistrationEndpoint(struct oidc_issuer* iss,
                                                   char* registration_endpoint) {
   if (iss->registration_endpoint == registration_endpoint) {
@@ -125,6 +155,7 @@ inline static void issuer_setScopesSupported(struct oidc_issuer* iss,
   }
   secFree(iss->scopes_supported);
   iss->scopes_supported = scopes_supported;
+  scopeDict_addAll(iss->scope_dict, scopes_supported);
 }
 inline static void issuer_setGrantTypesSupported(struct oidc_issuer* iss,
                                                  char* grant_types_supported) {
@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include "issuer_helper.h"
+#include "account/issuer_index.h"
 
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
@@ -188,45 +189,7 @@ void printIssuerHelp(const char* url) {
   secFree(fileContent);
 }
 
-list_t* getSuggestableIssuers() {
-  list_t* issuers = list_new();
-  issuers->free   = (void (*)(void*)) & _secFree;
-  issuers->match  = (matchFunction)compIssuerUrls;
-
-  char* fileContent = readOidcFile(ISSUER_CONFIG_FILENAME);
-  if (fileContent) {
-    char* elem = strtok(fileContent, "\n");
-    while (elem != NULL) {
-      char* space = strchr(elem, ' ');
-      if (space) {
-        *space = '\0';
-      }
-      if (findInList(issuers, elem) == NULL) {
-        list_rpush(issuers, list_node_new(oidc_sprintf(elem)));
-      }
-      elem = strtok(NULL, "\n");
-    }
-    secFree(fileContent);
-  }
-
-  fileContent = readFile(ETC_ISSUER_CONFIG_FILE);
-  if (fileContent) {
-    char* elem = strtok(fileContent, "\n");
-    while (elem != NULL) {
-      char* space = strchr(elem, ' ');
-      if (space) {
-        *space = '\0';
-      }
-      if (findInList(issuers, elem) == NULL) {
-        list_rpush(issuers, list_node_new(oidc_sprintf(elem)));
-      }
-      elem = strtok(NULL, "\n");
-    }
-    secFree(fileContent);
-  }
-
-  return issuers;
-}
+list_t* getSuggestableIssuers() { return issuerIndex_getIssuers(); }
 
 size_t getFavIssuer(const struct oidc_account* account, list_t* suggestable) {
   if (strValid(account_getIssuerUrl(
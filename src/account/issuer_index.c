@@ -0,0 +1,322 @@
+#include "issuer_index.h"
+#include "account/issuer_helper.h"
+#include "defines/settings.h"
+#include "utils/db/db_index.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * An in-memory index of the issuer.config files. A file is parsed once and
+ * only parsed again if it changed on disk (inode, size or mtime), so lookups
+ * only cost a @c stat. Issuer urls are indexed with @c compIssuerUrls
+ * semantics, i.e. a missing trailing slash does not matter. If an issuer is
+ * listed multiple times, the first line wins.
+ *
+ * The user's issuer.config maps an issuer to its default account config; in
+ * the system wide file the second column is a registration url. In the user's
+ * file a line can also contain @c key=value pairs with the limits for https
+ * requests to that issuer, e.g. @c timeout=10, and further options for it.
+ */
+
+#define ISSUER_OPTION_CONNECT_TIMEOUT "connect_timeout"
+#define ISSUER_OPTION_TIMEOUT "timeout"
+#define ISSUER_OPTION_HEDGE "hedge"
+#define ISSUER_OPTION_TOKEN_EXCHANGE "token_exchange"
+
+struct issuerIndex_entry {
+  char*               issuer_url;
+  char*               value;  // the second column; might be NULL
+  struct http_options http;
+  unsigned char       token_exchange;
+};
+
+struct issuerIndex_file {
+  char*            path;
+  unsigned char    loaded;
+  unsigned char    endsWithNewline;
+  ino_t            ino;
+  off_t            size;
+  time_t           mtime;
+  list_t*          entries;  // in file order; owns the entries
+  struct db_index* index;
+};
+
+static struct issuerIndex_file userFile = {0};
+static struct issuerIndex_file etcFile  = {0};
+
+static void _secFreeIssuerIndexEntry(struct issuerIndex_entry* e) {
+  secFree(e->issuer_url);
+  secFree(e->value);
+  secFree(e);
+}
+
+static const char* _getIssuerUrl(const struct issuerIndex_entry* e) {
+  return e->issuer_url;
+}
+
+static void _clear(struct issuerIndex_file* file) {
+  if (file->index) {
+    dbIndex_clear(file->index);
+  } else {
+    file->index = dbIndex_new((indexKeyFunction)_getIssuerUrl,
+                              (indexMatchFunction)compIssuerUrls);
+  }
+  secFreeList(file->entries);
+  file->entries         = list_new();
+  file->entries->free   = (void (*)(void*))_secFreeIssuerIndexEntry;
+  file->endsWithNewline = 1;
+}
+
+static struct issuerIndex_entry* _addEntry(struct issuerIndex_file* file,
+                                           const char* issuer_url,
+                                           size_t url_len, const char* value,
+                                           size_t value_len) {
+  struct issuerIndex_entry* e = secAlloc(sizeof(struct issuerIndex_entry));
+  e->issuer_url               = oidc_strncopy(issuer_url, url_len);
+  if (dbIndex_find(file->index, e->issuer_url)) {
+    _secFreeIssuerIndexEntry(e);
+    return NULL;
+  }
+  e->value = value_len ? oidc_strncopy(value, value_len) : NULL;
+  list_rpush(file->entries, list_node_new(e));
+  dbIndex_add(file->index, e);
+  return e;
+}
+
+/**
+ * @brief parses a @c key=value option into @p options
+ * Unknown keys are ignored.
+ */
+static void _parseOption(struct issuerIndex_entry* options, const char* option,
+                         size_t len) {
+  const char* eq = memchr(option, '=', len);
+  if (eq == NULL) {
+    return;
+  }
+  size_t key_len = eq - option;
+  long   v       = strtol(eq + 1, NULL, 10);
+  if (v < 0) {
+    return;
+  }
+  if (key_len == strlen(ISSUER_OPTION_CONNECT_TIMEOUT) &&
+      strncmp(option, ISSUER_OPTION_CONNECT_TIMEOUT, key_len) == 0) {
+    options->http.connect_timeout = v;
+  } else if (key_len == strlen(ISSUER_OPTION_TIMEOUT) &&
+             strncmp(option, ISSUER_OPTION_TIMEOUT, key_len) == 0) {
+    options->http.timeout = v;
+  } else if (key_len == strlen(ISSUER_OPTION_HEDGE) &&
+             strncmp(option, ISSUER_OPTION_HEDGE, key_len) == 0) {
+    options->http.hedge = v > 0;
+  } else if (key_len == strlen(ISSUER_OPTION_TOKEN_EXCHANGE) &&
+             strncmp(option, ISSUER_OPTION_TOKEN_EXCHANGE, key_len) == 0) {
+    options->token_exchange = v > 0;
+  }
+}
+
+static void _parse(struct issuerIndex_file* file, const char* content) {
+  const char* line = content;
+  while (line && *line) {
+    size_t line_len = strcspn(line, "\n");
+    size_t url_len  = strcspn(line, " \r\n");
+    if (url_len > 0) {
+      const char*              end       = line + line_len;
+      const char*              value     = NULL;
+      size_t                   value_len = 0;
+      struct issuerIndex_entry options   = {0};
+      const char*              token     = line + url_len;
+      while (token < end) {
+        token += strspn(token, " \r");
+        size_t token_len = token < end ? strcspn(token, " \r\n") : 0;
+        if (token_len == 0) {
+          break;
+        }
+        if (memchr(token, '=', token_len)) {
+          _parseOption(&options, token, token_len);
+        } else if (value == NULL) {
+          value     = token;
+          value_len = token_len;
+        }
+        token += token_len;
+      }
+      struct issuerIndex_entry* e =
+          _addEntry(file, line, url_len, value, value_len);
+      if (e) {
+        e->http           = options.http;
+        e->token_exchange = options.token_exchange;
+      }
+    }
+    line = line[line_len] ? line + line_len + 1 : NULL;
+  }
+  size_t len            = strlen(content);
+  file->endsWithNewline = len == 0 || content[len - 1] == '\n';
+}
+
+static void _storeStat(struct issuerIndex_file* file, const struct stat* st) {
+  file->ino   = st ? st->st_ino : 0;
+  file->size  = st ? st->st_size : 0;
+  file->mtime = st ? st->st_mtime : 0;
+}
+
+/**
+ * @brief makes sure the index of @p file is up to date with the file on disk
+ */
+static struct issuerIndex_file* _refresh(struct issuerIndex_file* file,
+                                         unsigned char userSpace) {
+  if (file->path == NULL) {
+    file->path = userSpace ? concatToOidcDir(ISSUER_CONFIG_FILENAME)
+                           : oidc_strcopy(ETC_ISSUER_CONFIG_FILE);
+  }
+  struct stat st;
+  int         exists = file->path && stat(file->path, &st) == 0;
+  if (file->loaded && (exists ? file->ino == st.st_ino &&
+                                    file->size == st.st_size &&
+                                    file->mtime == st.st_mtime
+                              : file->size == 0 && file->ino == 0)) {
+    return file;
+  }
+  _clear(file);
+  file->loaded = 1;
+  _storeStat(file, exists ? &st : NULL);
+  if (!exists) {
+    if (userSpace) {
+      secFree(file->path);  // the oidc dir might be created later
+    }
+    return file;
+  }
+  char* content = readFile(file->path);
+  if (content) {
+    _parse(file, content);
+    secFree(content);
+  }
+  return file;
+}
+
+/**
+ * @brief returns the default account config for an issuer
+ * @return a pointer to the short name or @c NULL if there is no default
+ * account config; it has to be freed after usage
+ */
+char* issuerIndex_getDefaultAccount(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct issuerIndex_file*        file = _refresh(&userFile, 1);
+  const struct issuerIndex_entry* e    = dbIndex_find(file->index, issuer_url);
+  return e && e->value ? oidc_strcopy(e->value) : NULL;
+}
+
+/**
+ * @brief returns the limits for https requests to an issuer as set in the
+ * user's issuer.config
+ * @return the limits; values that are not set are @c 0
+ */
+struct http_options issuerIndex_getHttpOptions(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    return (struct http_options){0};
+  }
+  struct issuerIndex_file*        file = _refresh(&userFile, 1);
+  const struct issuerIndex_entry* e    = dbIndex_find(file->index, issuer_url);
+  return e ? e->http : (struct http_options){0};
+}
+
+/**
+ * @brief checks if scoped access tokens for an issuer should be obtained by
+ * exchanging the account's access token (@c token_exchange=1 in the user's
+ * issuer.config)
+ */
+int issuerIndex_useTokenExchange(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    return 0;
+  }
+  struct issuerIndex_file*        file = _refresh(&userFile, 1);
+  const struct issuerIndex_entry* e    = dbIndex_find(file->index, issuer_url);
+  return e ? e->token_exchange : 0;
+}
+
+/**
+ * @brief returns all issuers from the user's and the system wide issuer.config
+ * Issuers from the user's file come first; every issuer is only listed once.
+ * @return a list of issuer urls; it has to be freed after usage
+ */
+list_t* issuerIndex_getIssuers() {
+  list_t* issuers = list_new();
+  issuers->free   = (void (*)(void*)) & _secFree;
+  issuers->match  = (matchFunction)compIssuerUrls;
+  struct issuerIndex_file* user = _refresh(&userFile, 1);
+  struct issuerIndex_file* etc  = _refresh(&etcFile, 0);
+  list_node_t*             node;
+  list_iterator_t*         it = list_iterator_new(user->entries, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct issuerIndex_entry* e = node->val;
+    list_rpush(issuers, list_node_new(oidc_strcopy(e->issuer_url)));
+  }
+  list_iterator_destroy(it);
+  it = list_iterator_new(etc->entries, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct issuerIndex_entry* e = node->val;
+    if (dbIndex_find(user->index, e->issuer_url) == NULL) {
+      list_rpush(issuers, list_node_new(oidc_strcopy(e->issuer_url)));
+    }
+  }
+  list_iterator_destroy(it);
+  return issuers;
+}
+
+/**
+ * @brief adds an issuer to the user's issuer.config
+ * If the issuer is already listed, nothing is changed. Otherwise a line is
+ * appended to the file; the file is not rewritten.
+ * @param issuer_url the issuer url to be added
+ * @param shortname will be used as the default account config for this issuer
+ */
+oidc_error_t issuerIndex_addIssuer(const char* issuer_url,
+                                   const char* shortname) {
+  if (issuer_url == NULL || shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct issuerIndex_file* file = _refresh(&userFile, 1);
+  if (dbIndex_find(file->index, issuer_url)) {
+    return OIDC_SUCCESS;
+  }
+  char* line = oidc_sprintf("%s%s %s", file->endsWithNewline ? "" : "\n",
+                            issuer_url, shortname);
+  off_t expectedSize = file->size + strlen(line) + 1;  // appendFile adds \n
+  oidc_error_t e     = appendOidcFile(ISSUER_CONFIG_FILENAME, line);
+  secFree(line);
+  if (e != OIDC_SUCCESS) {
+    return e;
+  }
+  struct stat st;
+  if (file->path && stat(file->path, &st) == 0 && st.st_ino == file->ino &&
+      st.st_size == expectedSize) {
+    _addEntry(file, issuer_url, strlen(issuer_url), shortname,
+              strlen(shortname));
+    _storeStat(file, &st);
+    file->endsWithNewline = 1;
+  }  // otherwise the file is parsed again on the next lookup
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief drops the index, so that the files are parsed again on the next
+ * lookup
+ */
+void issuerIndex_reset() {
+  struct issuerIndex_file* files[] = {&userFile, &etcFile};
+  for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+    secFreeList(files[i]->entries);
+    dbIndex_free(files[i]->index);
+    secFree(files[i]->path);
+    *files[i] = (struct issuerIndex_file){0};
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef OIDC_ISSUER_INDEX_H
+#define OIDC_ISSUER_INDEX_H
+
+#include "utils/httpOptions.h"
+#include "utils/oidc_error.h"
+#include "wrapper/list.h"
+
+char*               issuerIndex_getDefaultAccount(const char* issuer_url);
+list_t*             issuerIndex_getIssuers();
+struct http_options issuerIndex_getHttpOptions(const char* issuer_url);
+int                 issuerIndex_useTokenExchange(const char* issuer_url);
+oidc_error_t        issuerIndex_addIssuer(const char* issuer_url,
+                                          const char* shortname);
+void                issuerIndex_reset();
+
+#endif  // OIDC_ISSUER_INDEX_H
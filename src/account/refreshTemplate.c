@@ -0,0 +1,157 @@
+#include "refreshTemplate.h"
+
+#include "defines/oidc_values.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/uriUtils.h"
+
+#include <string.h>
+
+/**
+ * A refresh request only differs from the previous one of the same account in
+ * the refresh token and an explicitly requested scope or audience. The other
+ * parts are prepared once, when the account is loaded, and kept memory
+ * encrypted on the account:
+ *   the Authorization header with the Basic credentials of the client
+ *   the encoded scope parameter with the default scope of the account
+ * separated by a newline. A refresh request then only decrypts the template
+ * and encodes the refresh token into the form body.
+ */
+
+#define REFRESH_FORM_PREFIX                                      \
+  OIDC_KEY_GRANTTYPE "=" OIDC_GRANTTYPE_REFRESH "&" OIDC_KEY_REFRESHTOKEN "="
+
+/**
+ * @brief appends the encoded form parameter @p key to @p dst
+ * @return a pointer after the last written character
+ */
+static char* _putParameter(char* dst, const char* key, const char* value) {
+  *dst++ = '&';
+  dst    = urlencodeInto(dst, key);
+  *dst++ = '=';
+  return urlencodeInto(dst, value);
+}
+
+static size_t _parameterLength(const char* key, const char* value) {
+  return 2 + urlencodedLength(key) + urlencodedLength(value);
+}
+
+static char* _buildAuthHeader(const struct oidc_account* account) {
+  const char* client_id = account_getClientId(account);
+  if (!strValid(client_id)) {
+    return oidc_strcopy("");
+  }
+  // the same credentials curl would send for the client id and secret
+  char* credentials =
+      oidc_sprintf("%s:%s", client_id, account_getClientSecret(account) ?: "");
+  char* base64 = toBase64(credentials, strlen(credentials));
+  secFree(credentials);
+  if (base64 == NULL) {
+    return NULL;
+  }
+  char* header = oidc_sprintf("Authorization: Basic %s", base64);
+  secFree(base64);
+  return header;
+}
+
+/**
+ * @brief prepares the refresh requests of @p account and stores the template
+ * memory encrypted on the account
+ * @param account the account; its client credentials have to be decrypted
+ * @return an oidc_error code
+ */
+oidc_error_t refreshTemplate_prepare(struct oidc_account* account) {
+  if (account == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  char* header = _buildAuthHeader(account);
+  if (header == NULL) {
+    return oidc_errno;
+  }
+  const char* scope        = account_getScope(account);
+  size_t      header_len   = strlen(header);
+  size_t      template_len = header_len + 1 +
+                        (strValid(scope)
+                             ? _parameterLength(OIDC_KEY_SCOPE, scope)
+                             : 0);
+  char* plain = secAlloc(template_len + 1);
+  memcpy(plain, header, header_len);
+  secFree(header);
+  char* p = plain + header_len;
+  *p++    = '\n';
+  if (strValid(scope)) {
+    p = _putParameter(p, OIDC_KEY_SCOPE, scope);
+  }
+  *p = '\0';
+  account_setRefreshTemplate(account, memoryEncrypt(plain));
+  secFree(plain);
+  return account_getRefreshTemplate(account) ? OIDC_SUCCESS : oidc_errno;
+}
+
+/**
+ * @brief builds the refresh request of @p account from its template; the
+ * template is prepared first if the account does not have one yet
+ * @param account the account; its refresh token and client credentials have
+ * to be decrypted
+ * @param scope the scope to request instead of the default scope; might be
+ * @c NULL
+ * @param audience the audience to request; might be @c NULL
+ * @return the request; its fields are @c NULL on failure. Has to be freed
+ * with @c secFreeRefreshRequest after usage.
+ */
+struct refreshRequest refreshTemplate_request(struct oidc_account* account,
+                                              const char*          scope,
+                                              const char*          audience) {
+  struct refreshRequest request = {NULL, NULL};
+  if (account == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return request;
+  }
+  if (account_getRefreshTemplate(account) == NULL &&
+      refreshTemplate_prepare(account) != OIDC_SUCCESS) {
+    return request;
+  }
+  char* plain = memoryDecrypt(account_getRefreshTemplate(account));
+  char* nl    = plain ? strchr(plain, '\n') : NULL;
+  if (nl == NULL) {
+    secFree(plain);
+    oidc_setInternalError("malformed refresh template");
+    return request;
+  }
+  *nl                       = '\0';
+  const char* scope_param   = nl + 1;
+  const char* refresh_token = account_getRefreshToken(account);
+  size_t      len           = strlen(REFRESH_FORM_PREFIX) +
+                   urlencodedLength(refresh_token) +
+                   (strValid(scope) ? _parameterLength(OIDC_KEY_SCOPE, scope)
+                                    : strlen(scope_param)) +
+                   (strValid(audience)
+                        ? _parameterLength(OIDC_KEY_AUDIENCE, audience)
+                        : 0);
+  char* data = secAlloc(len + 1);
+  char* p    = data;
+  memcpy(p, REFRESH_FORM_PREFIX, strlen(REFRESH_FORM_PREFIX));
+  p = urlencodeInto(p + strlen(REFRESH_FORM_PREFIX), refresh_token);
+  if (strValid(scope)) {
+    p = _putParameter(p, OIDC_KEY_SCOPE, scope);
+  } else {
+    memcpy(p, scope_param, strlen(scope_param));
+    p += strlen(scope_param);
+  }
+  if (strValid(audience)) {
+    p = _putParameter(p, OIDC_KEY_AUDIENCE, audience);
+  }
+  *p                  = '\0';
+  request.data        = data;
+  request.auth_header = strValid(plain) ? oidc_strcopy(plain) : NULL;
+  secFree(plain);
+  return request;
+}
+
+void secFreeRefreshRequest(struct refreshRequest* request) {
+  secFree(request->auth_header);
+  secFree(request->data);
+}
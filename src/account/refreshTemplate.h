@@ -0,0 +1,21 @@
+#ifndef ACCOUNT_REFRESH_TEMPLATE_H
+#define ACCOUNT_REFRESH_TEMPLATE_H
+
+#include "account/account.h"
+#include "utils/oidc_error.h"
+
+/**
+ * The parts of a refresh request that only depend on the account
+ */
+struct refreshRequest {
+  char* auth_header;  // @c NULL if the client has no id
+  char* data;
+};
+
+oidc_error_t          refreshTemplate_prepare(struct oidc_account* account);
+struct refreshRequest refreshTemplate_request(struct oidc_account* account,
+                                              const char*          scope,
+                                              const char*          audience);
+void secFreeRefreshRequest(struct refreshRequest* request);
+
+#endif  // ACCOUNT_REFRESH_TEMPLATE_H
@@ -0,0 +1,199 @@
+#include "scopeSet.h"
+
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+/**
+ * Scope values are interned into a per-issuer dictionary, seeded with the
+ * issuer's @c scopes_supported, so that a set of scopes is a fixed-size bitset:
+ * normalizing a requested scope string is one pass over it, and comparing,
+ * intersecting or subtracting sets are a few word operations. The dictionary
+ * is an open addressing hash table over the interned values.
+ */
+
+#define SCOPEDICT_SLOTS (2 * SCOPESET_MAX_SCOPES)
+
+static size_t _hash(const char* s, size_t len) {
+  size_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)s[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+/**
+ * @brief returns the slot of the scope value @p s of length @p len; the slot
+ * is empty if the value is not in the dictionary
+ */
+static size_t _slot(const struct scopeDict* dict, const char* s, size_t len) {
+  size_t slot = _hash(s, len) % SCOPEDICT_SLOTS;
+  while (dict->slots[slot]) {
+    const char* name = dict->names[dict->slots[slot] - 1];
+    if (strncmp(name, s, len) == 0 && name[len] == '\0') {
+      break;
+    }
+    slot = (slot + 1) % SCOPEDICT_SLOTS;
+  }
+  return slot;
+}
+
+/**
+ * @brief returns the index of the scope value @p s of length @p len, adding it
+ * to the dictionary if needed
+ * @return the index or @c -1 if the dictionary is full
+ */
+static int _intern(struct scopeDict* dict, const char* s, size_t len) {
+  size_t slot = _slot(dict, s, len);
+  if (dict->slots[slot]) {
+    return dict->slots[slot] - 1;
+  }
+  if (dict->count >= SCOPESET_MAX_SCOPES) {
+    return -1;
+  }
+  char* name = oidc_strncopy(s, len);
+  if (name == NULL) {
+    return -1;
+  }
+  secMemTag(name, MEMTAG_ACCOUNT);
+  dict->names[dict->count] = name;
+  dict->slots[slot]        = ++dict->count;
+  return dict->count - 1;
+}
+
+static int _find(const struct scopeDict* dict, const char* s, size_t len) {
+  size_t slot = _slot(dict, s, len);
+  return dict->slots[slot] ? dict->slots[slot] - 1 : -1;
+}
+
+/**
+ * @brief calls @p f for every space delimited value of @p scope
+ * @return @c 0 on success, @c -1 as soon as @p f fails
+ */
+static int _forEachValue(const char* scope, int (*f)(void*, const char*, size_t),
+                         void* arg) {
+  if (scope == NULL) {
+    return 0;
+  }
+  while (*scope) {
+    size_t len = strcspn(scope, " ");
+    if (len && f(arg, scope, len) != 0) {
+      return -1;
+    }
+    scope += len;
+    scope += strspn(scope, " ");
+  }
+  return 0;
+}
+
+static int _internValue(void* dict, const char* s, size_t len) {
+  return _intern(dict, s, len) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief creates a dictionary that contains the space delimited
+ * @p scopes_supported
+ */
+struct scopeDict* scopeDict_new(const char* scopes_supported) {
+  struct scopeDict* dict =
+      secAllocTagged(sizeof(struct scopeDict), MEMTAG_ACCOUNT);
+  if (dict) {
+    scopeDict_addAll(dict, scopes_supported);
+  }
+  return dict;
+}
+
+/**
+ * @brief adds the space delimited @p scopes to the dictionary; values that do
+ * not fit anymore are skipped
+ */
+void scopeDict_addAll(struct scopeDict* dict, const char* scopes) {
+  if (dict) {
+    _forEachValue(scopes, _internValue, dict);
+  }
+}
+
+void secFreeScopeDict(struct scopeDict* dict) {
+  if (dict == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < dict->count; i++) { secFree(dict->names[i]); }
+  secFree(dict);
+}
+
+struct _setArg {
+  struct scopeDict* dict;
+  struct scopeSet*  set;
+};
+
+static int _addInterned(void* arg, const char* s, size_t len) {
+  struct _setArg* a     = arg;
+  int             index = _intern(a->dict, s, len);
+  if (index < 0) {
+    return -1;
+  }
+  a->set->bits[index / 64] |= (uint64_t)1 << (index % 64);
+  return 0;
+}
+
+static int _addFound(void* arg, const char* s, size_t len) {
+  struct _setArg* a     = arg;
+  int             index = _find(a->dict, s, len);
+  if (index < 0) {
+    return -1;
+  }
+  a->set->bits[index / 64] |= (uint64_t)1 << (index % 64);
+  return 0;
+}
+
+/**
+ * @brief converts the space delimited @p scope to a set, adding unknown values
+ * to the dictionary; duplicates and the order of the values do not matter
+ * @return @c 0 on success, @c -1 if the dictionary is full
+ */
+int scopeSet_fromString(struct scopeDict* dict, const char* scope,
+                        struct scopeSet* set) {
+  memset(set, 0, sizeof(*set));
+  struct _setArg arg = {.dict = dict, .set = set};
+  return dict ? _forEachValue(scope, _addInterned, &arg) : -1;
+}
+
+/**
+ * @brief like @c scopeSet_fromString, but does not change the dictionary
+ * @return @c 0 on success, @c -1 if a value is not in the dictionary; then no
+ * set that was created from the dictionary can be equal to it
+ */
+int scopeSet_lookup(const struct scopeDict* dict, const char* scope,
+                    struct scopeSet* set) {
+  memset(set, 0, sizeof(*set));
+  struct _setArg arg = {.dict = (struct scopeDict*)dict, .set = set};
+  return dict ? _forEachValue(scope, _addFound, &arg) : -1;
+}
+
+/**
+ * @brief returns the space delimited scope values of @p set in dictionary
+ * order
+ * @return a pointer to the string; has to be freed after usage
+ */
+char* scopeSet_toString(const struct scopeDict* dict,
+                        const struct scopeSet*  set) {
+  struct string s;
+  if (init_string(&s) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  for (size_t i = 0; dict && i < dict->count; i++) {
+    if (!scopeSet_contains(set, i)) {
+      continue;
+    }
+    if ((s.len && string_append(&s, " ", 1) != OIDC_SUCCESS) ||
+        string_append(&s, dict->names[i], strlen(dict->names[i])) !=
+            OIDC_SUCCESS) {
+      secFree(s.ptr);
+      return NULL;
+    }
+  }
+  return s.ptr;
+}
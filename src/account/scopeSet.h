@@ -0,0 +1,73 @@
+#ifndef ACCOUNT_SCOPE_SET_H
+#define ACCOUNT_SCOPE_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * maximum number of distinct scope values per dictionary
+ */
+#define SCOPESET_WORDS 4
+#define SCOPESET_MAX_SCOPES (SCOPESET_WORDS * 64)
+
+/**
+ * A set of scope values; bit @c i is set if the scope with index @c i in the
+ * dictionary of the issuer is contained.
+ */
+struct scopeSet {
+  uint64_t bits[SCOPESET_WORDS];
+};
+
+/**
+ * Interned scope values of an issuer; the dictionary only grows, so the index
+ * of a scope value never changes.
+ */
+struct scopeDict {
+  char*          names[SCOPESET_MAX_SCOPES];
+  size_t         count;
+  unsigned short slots[2 * SCOPESET_MAX_SCOPES];  // index + 1; 0 if empty
+};
+
+struct scopeDict* scopeDict_new(const char* scopes_supported);
+void              scopeDict_addAll(struct scopeDict* dict, const char* scopes);
+void              secFreeScopeDict(struct scopeDict* dict);
+int               scopeSet_fromString(struct scopeDict* dict, const char* scope,
+                                      struct scopeSet* set);
+int               scopeSet_lookup(const struct scopeDict* dict,
+                                  const char* scope, struct scopeSet* set);
+char*             scopeSet_toString(const struct scopeDict* dict,
+                                    const struct scopeSet*  set);
+
+inline static int scopeSet_equal(const struct scopeSet* a,
+                                 const struct scopeSet* b) {
+  uint64_t diff = 0;
+  for (int i = 0; i < SCOPESET_WORDS; i++) { diff |= a->bits[i] ^ b->bits[i]; }
+  return diff == 0;
+}
+
+inline static int scopeSet_isEmpty(const struct scopeSet* s) {
+  uint64_t bits = 0;
+  for (int i = 0; i < SCOPESET_WORDS; i++) { bits |= s->bits[i]; }
+  return bits == 0;
+}
+
+inline static int scopeSet_contains(const struct scopeSet* s, size_t index) {
+  return (s->bits[index / 64] >> (index % 64)) & 1;
+}
+
+inline static void scopeSet_intersect(struct scopeSet*       a,
+                                      const struct scopeSet* b) {
+  for (int i = 0; i < SCOPESET_WORDS; i++) { a->bits[i] &= b->bits[i]; }
+}
+
+inline static void scopeSet_subtract(struct scopeSet*       a,
+                                     const struct scopeSet* b) {
+  for (int i = 0; i < SCOPESET_WORDS; i++) { a->bits[i] &= ~b->bits[i]; }
+}
+
+inline static void scopeSet_union(struct scopeSet*       a,
+                                  const struct scopeSet* b) {
+  for (int i = 0; i < SCOPESET_WORDS; i++) { a->bits[i] |= b->bits[i]; }
+}
+
+#endif  // ACCOUNT_SCOPE_SET_H
@@ -1,4 +1,7 @@
 #include "setandget.h"
+#include "tokenCache.h"
+#include "tokenIndex.h"
+#include "utils/memory.h"
 #include "utils/stringUtils.h"
 
 #include "utils/hostname.h"
@@ -28,6 +31,14 @@ char* account_getRevocationEndpoint(const struct oidc_account* p) {
   return p ? p->issuer ? issuer_getRevocationEndpoint(p->issuer) : NULL : NULL;
 }
 
+char* account_getUserinfoEndpoint(const struct oidc_account* p) {
+  return p ? p->issuer ? issuer_getUserinfoEndpoint(p->issuer) : NULL : NULL;
+}
+
+char* account_getJwksUri(const struct oidc_account* p) {
+  return p ? p->issuer ? issuer_getJwksUri(p->issuer) : NULL : NULL;
+}
+
 char* account_getRegistrationEndpoint(const struct oidc_account* p) {
   return p ? p->issuer ? issuer_getRegistrationEndpoint(p->issuer) : NULL
            : NULL;
@@ -87,6 +98,22 @@ char* account_getRefreshToken(const struct oidc_account* p) {
   return p ? p->refresh_token : NULL;
 }
 
+list_t* account_getRefreshTokenPool(const struct oidc_account* p) {
+  return p ? p->refresh_token_pool : NULL;
+}
+
+size_t account_getRefreshTokenPoolSize(const struct oidc_account* p) {
+  return p ? p->refresh_token_pool_size : 0;
+}
+
+size_t account_getRefreshTokenSlot(const struct oidc_account* p) {
+  return p ? p->refresh_token_slot : 0;
+}
+
+char* account_getRefreshTemplate(const struct oidc_account* p) {
+  return p ? p->refresh_template : NULL;
+}
+
 char* account_getAccessToken(const struct oidc_account* p) {
   return p ? p->token.access_token : NULL;
 }
@@ -95,6 +122,10 @@ unsigned long account_getTokenExpiresAt(const struct oidc_account* p) {
   return p ? p->token.token_expires_at : 0;
 }
 
+unsigned long account_getTokenIssuedAt(const struct oidc_account* p) {
+  return p ? p->token.token_issued_at : 0;
+}
+
 char* account_getCertPath(const struct oidc_account* p) {
   return p ? p->cert_path : NULL;
 }
@@ -135,8 +166,13 @@ unsigned char account_getAlwaysAllowId(const struct oidc_account* p) {
   return p ? p->mode & ACCOUNT_MODE_ALWAYSALLOWID : 0;
 }
 
+uid_t account_getOwner(const struct oidc_account* p) {
+  return p ? p->owner : 0;
+}
+
 void account_setIssuerUrl(struct oidc_account* p, char* issuer_url) {
   if (!p->issuer) {
+    account_clearTokenCache(p);
     p->issuer = secAlloc(sizeof(struct oidc_issuer));
   }
   issuer_setIssuerUrl(p->issuer, issuer_url);
@@ -190,6 +226,8 @@ void account_setScopeExact(struct oidc_account* p, char* scope) {
   }
   secFree(p->scope);
   p->scope = scope;
+  // the refresh template holds the default scope
+  account_setRefreshTemplate(p, NULL);
 }
 
 void account_setScope(struct oidc_account* p, char* scope) {
@@ -204,6 +242,8 @@ void account_setIssuer(struct oidc_account* p, struct oidc_issuer* issuer) {
   if (p->issuer == issuer) {
     return;
   }
+  // cached tokens are keyed by the scope dictionary of the issuer
+  account_clearTokenCache(p);
   secFreeIssuer(p->issuer);
   p->issuer = issuer;
   if (issuer && strValid(account_getScope(p))) {
@@ -214,6 +254,7 @@ void account_setIssuer(struct oidc_account* p, struct oidc_issuer* issuer) {
 void account_setScopesSupported(struct oidc_account* p,
                                 char*                scopes_supported) {
   if (!p->issuer) {
+    account_clearTokenCache(p);
     p->issuer = secAlloc(sizeof(struct oidc_issuer));
   }
   if (p->issuer->scopes_supported == scopes_supported) {
@@ -248,20 +289,86 @@ void account_setPassword(struct oidc_account* p, char* password) {
   p->password = password;
 }
 
+/**
+ * @brief sets the (usually memory encrypted) refresh token of @p p; it is
+ * moved into the token pool, so @p refresh_token must not be used afterwards
+ */
 void account_setRefreshToken(struct oidc_account* p, char* refresh_token) {
   if (p->refresh_token == refresh_token) {
     return;
   }
   secFree(p->refresh_token);
-  p->refresh_token = refresh_token;
+  p->refresh_token = secMemTokenPool_move(refresh_token);
 }
 
+/**
+ * @brief sets the further refresh tokens of @p p, each obtained by exchanging
+ * its refresh token; see oidcd/refreshTokenPool.c
+ */
+void account_setRefreshTokenPool(struct oidc_account* p, list_t* pool) {
+  if (p->refresh_token_pool == pool) {
+    return;
+  }
+  if (p->refresh_token_pool) {
+    list_destroy(p->refresh_token_pool);
+  }
+  p->refresh_token_pool = pool;
+}
+
+/**
+ * @brief sets the number of refresh tokens the agent keeps for @p p,
+ * including the refresh token itself
+ */
+void account_setRefreshTokenPoolSize(struct oidc_account* p, size_t size) {
+  p->refresh_token_pool_size = size;
+}
+
+/**
+ * @brief sets which refresh token of the pool a loaded copy of @p p uses;
+ * @c 0 is the refresh token itself
+ */
+void account_setRefreshTokenSlot(struct oidc_account* p, size_t slot) {
+  p->refresh_token_slot = slot;
+}
+
+void account_setRefreshTemplate(struct oidc_account* p,
+                                char*                refresh_template) {
+  if (p->refresh_template == refresh_template) {
+    return;
+  }
+  secFree(p->refresh_template);
+  p->refresh_template = refresh_template;
+}
+
+/**
+ * @brief keeps the default access token of @p p in the token index; it is
+ * only indexed while it is set
+ */
+static void _indexDefaultToken(struct oidc_account* p) {
+  if (strValid(p->token.access_token)) {
+    tokenIndex_update(p, TOKEN_INDEX_DEFAULT_KEY, &p->token);
+  } else {
+    tokenIndex_remove(&p->token);
+  }
+}
+
+/**
+ * @brief sets the default access token of @p p; it is moved into the token
+ * pool, so @p access_token must not be used afterwards
+ */
 void account_setAccessToken(struct oidc_account* p, char* access_token) {
   if (p->token.access_token == access_token) {
     return;
   }
   secFree(p->token.access_token);
-  p->token.access_token = access_token;
+  p->token.access_token = secMemTokenPool_move(access_token);
+  _indexDefaultToken(p);
+}
+
+void account_setTokenIssuedAt(struct oidc_account* p,
+                              unsigned long        token_issued_at) {
+  p->token.token_issued_at = token_issued_at;
+  _indexDefaultToken(p);
 }
 
 void account_setTokenExpiresAt(struct oidc_account* p,
@@ -270,6 +377,7 @@ void account_setTokenExpiresAt(struct oidc_account* p,
     return;
   }
   p->token.token_expires_at = token_expires_at;
+  _indexDefaultToken(p);
 }
 
 void account_setCertPath(struct oidc_account* p, char* cert_path) {
@@ -332,6 +440,8 @@ void account_setAlwaysAllowId(struct oidc_account* p) {
   p->mode |= ACCOUNT_MODE_ALWAYSALLOWID;
 }
 
+void account_setOwner(struct oidc_account* p, uid_t owner) { p->owner = owner; }
+
 int account_refreshTokenIsValid(const struct oidc_account* p) {
   char* refresh_token = account_getRefreshToken(p);
   int   ret           = strValid(refresh_token);
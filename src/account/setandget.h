@@ -9,6 +9,8 @@ char*               account_getConfigEndpoint(const struct oidc_account* p);
 char*               account_getTokenEndpoint(const struct oidc_account* p);
 char* account_getAuthorizationEndpoint(const struct oidc_account* p);
 char* account_getRevocationEndpoint(const struct oidc_account* p);
+char* account_getUserinfoEndpoint(const struct oidc_account* p);
+char* account_getJwksUri(const struct oidc_account* p);
 char* account_getRegistrationEndpoint(const struct oidc_account* p);
 char* account_getDeviceAuthorizationEndpoint(const struct oidc_account* p);
 char* account_getScopesSupported(const struct oidc_account* p);
@@ -23,8 +25,13 @@ char* account_getAudience(const struct oidc_account* p);
 char* account_getUsername(const struct oidc_account* p);
 char* account_getPassword(const struct oidc_account* p);
 char* account_getRefreshToken(const struct oidc_account* p);
+list_t* account_getRefreshTokenPool(const struct oidc_account* p);
+size_t  account_getRefreshTokenPoolSize(const struct oidc_account* p);
+size_t  account_getRefreshTokenSlot(const struct oidc_account* p);
+char* account_getRefreshTemplate(const struct oidc_account* p);
 char* account_getAccessToken(const struct oidc_account* p);
 unsigned long account_getTokenExpiresAt(const struct oidc_account* p);
+unsigned long account_getTokenIssuedAt(const struct oidc_account* p);
 char*         account_getCertPath(const struct oidc_account* p);
 list_t*       account_getRedirectUris(const struct oidc_account* p);
 size_t        account_getRedirectUrisCount(const struct oidc_account* p);
@@ -35,6 +42,7 @@ unsigned char account_getConfirmationRequired(const struct oidc_account* p);
 unsigned char account_getNoWebServer(const struct oidc_account* p);
 unsigned char account_getNoScheme(const struct oidc_account* p);
 unsigned char account_getAlwaysAllowId(const struct oidc_account* p);
+uid_t         account_getOwner(const struct oidc_account* p);
 
 void account_setIssuerUrl(struct oidc_account* p, char* issuer_url);
 void account_setClientName(struct oidc_account* p, char* clientname);
@@ -50,7 +58,13 @@ void account_setAudience(struct oidc_account* p, char* audience);
 void account_setUsername(struct oidc_account* p, char* username);
 void account_setPassword(struct oidc_account* p, char* password);
 void account_setRefreshToken(struct oidc_account* p, char* refresh_token);
+void account_setRefreshTokenPool(struct oidc_account* p, list_t* pool);
+void account_setRefreshTokenPoolSize(struct oidc_account* p, size_t size);
+void account_setRefreshTokenSlot(struct oidc_account* p, size_t slot);
+void account_setRefreshTemplate(struct oidc_account* p, char* refresh_template);
 void account_setAccessToken(struct oidc_account* p, char* access_token);
+void account_setTokenIssuedAt(struct oidc_account* p,
+                              unsigned long        token_issued_at);
 void account_setTokenExpiresAt(struct oidc_account* p,
                                unsigned long        token_expires_at);
 void account_setCertPath(struct oidc_account* p, char* cert_path);
@@ -64,6 +78,7 @@ void account_setConfirmationRequired(struct oidc_account* p);
 void account_setNoWebServer(struct oidc_account* p);
 void account_setNoScheme(struct oidc_account* p);
 void account_setAlwaysAllowId(struct oidc_account* p);
+void account_setOwner(struct oidc_account* p, uid_t owner);
 int  account_refreshTokenIsValid(const struct oidc_account* p);
 
 #endif  // ACCOUNT_SETANDGET_H
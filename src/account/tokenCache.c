@@ -0,0 +1,385 @@
+#include "tokenCache.h"
+#include "tokenIndex.h"
+
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Cached tokens are keyed by the set of their scope values in the scope
+ * dictionary of the issuer, so that the same set of scopes always matches
+ * regardless of order and duplicates. Accounts without an issuer share a
+ * dictionary.
+ */
+static struct scopeDict* fallbackDict = NULL;
+static unsigned long     useClock     = 0;
+
+static struct scopeDict* _scopeDict(const struct oidc_account* p) {
+  if (p->issuer) {
+    return issuer_getScopeDict(p->issuer);
+  }
+  if (fallbackDict == NULL) {
+    fallbackDict = scopeDict_new(NULL);
+  }
+  return fallbackDict;
+}
+
+struct cache_key {
+  struct scopeSet scopes;
+  const char*     audience;
+};
+
+/**
+ * @brief returns the key of a cached access token in the token index, a FNV-1a
+ * hash of its scope set and audience; never @c TOKEN_INDEX_DEFAULT_KEY
+ */
+static uint64_t _indexKey(const struct cache_key* key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < SCOPESET_WORDS; i++) {
+    hash ^= key->scopes.bits[i];
+    hash *= 1099511628211ULL;
+  }
+  for (const char* c = key->audience; c && *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash == TOKEN_INDEX_DEFAULT_KEY ? 1 : hash;
+}
+
+static void _secFreeCachedToken(struct cached_token* t) {
+  if (t == NULL) {
+    return;
+  }
+  tokenIndex_remove(&t->token);
+  secFree(t->audience);
+  secFree(t->token.access_token);
+  secFree(t);
+}
+
+static int _matchCachedTokenByKey(const struct cache_key*    key,
+                                  const struct cached_token* t) {
+  return !t->unmatchable && scopeSet_equal(&t->scopes, &key->scopes) &&
+         strequal(t->audience, key->audience);
+}
+
+static list_t* _getOrCreateCache(list_t** cache) {
+  if (*cache == NULL) {
+    *cache          = list_new();
+    (*cache)->free  = (void (*)(void*)) & _secFreeCachedToken;
+    (*cache)->match = (matchFunction)_matchCachedTokenByKey;
+  }
+  return *cache;
+}
+
+static struct token* _findCachedToken(const struct oidc_account* p,
+                                      list_t* cache, const char* scope,
+                                      const char* audience) {
+  if (cache == NULL) {
+    return NULL;
+  }
+  struct cache_key key = {.audience = strValid(audience) ? audience : NULL};
+  if (scopeSet_lookup(_scopeDict(p), scope, &key.scopes) != 0) {
+    return NULL;  // a scope value that was never cached
+  }
+  list_node_t* node = findInList(cache, &key);
+  if (node == NULL) {
+    return NULL;
+  }
+  struct cached_token* t = node->val;
+  t->last_used           = ++useClock;
+  return &t->token;
+}
+
+/**
+ * @brief finds the cached access token for a scope / audience combination
+ * The token is looked up in the token index; the cache itself is only searched
+ * if the indexed token does not match the key.
+ * @return a pointer to the cached token or @c NULL if none is cached; the token
+ * is still owned by the cache and MUST NOT be freed
+ */
+struct token* account_findCachedToken(const struct oidc_account* p,
+                                      const char* scope, const char* audience) {
+  if (p == NULL || p->token_cache == NULL) {
+    return NULL;
+  }
+  struct cache_key key = {.audience = strValid(audience) ? audience : NULL};
+  if (scopeSet_lookup(_scopeDict(p), scope, &key.scopes) != 0) {
+    return NULL;  // a scope value that was never cached
+  }
+  struct token* t = tokenIndex_find(p, _indexKey(&key));
+  if (t == NULL) {
+    return NULL;
+  }
+  struct cached_token* cached =
+      (struct cached_token*)((char*)t - offsetof(struct cached_token, token));
+  if (_matchCachedTokenByKey(&key, cached)) {
+    cached->last_used = ++useClock;
+    return t;
+  }
+  list_node_t* node = findInList(p->token_cache, &key);  // hash collision
+  if (node == NULL) {
+    return NULL;
+  }
+  cached            = node->val;
+  cached->last_used = ++useClock;
+  return &cached->token;
+}
+
+static size_t _removeExpiredCachedTokens(list_t* cache) {
+  if (cache == NULL) {
+    return 0;
+  }
+  unsigned long    now     = time(NULL);
+  size_t           removed = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct cached_token* t = node->val;
+    if (t->token.token_expires_at <= now) {
+      list_remove(cache, node);
+      removed++;
+    }
+  }
+  list_iterator_destroy(it);
+  return removed;
+}
+
+static void _removeSoonestExpiringCachedToken(list_t* cache) {
+  list_node_t*     min = NULL;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (min == NULL ||
+        ((struct cached_token*)node->val)->token.token_expires_at <
+            ((struct cached_token*)min->val)->token.token_expires_at) {
+      min = node;
+    }
+  }
+  list_iterator_destroy(it);
+  if (min) {
+    list_remove(cache, min);
+  }
+}
+
+/**
+ * @brief removes the least recently used token from @p cache, except @p keep
+ * @return @c 1 if a token was removed, @c 0 if there is none
+ */
+static int _removeLeastRecentlyUsedCachedToken(
+    list_t* cache, const struct cached_token* keep) {
+  list_node_t*     lru = NULL;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (node->val != keep &&
+        (lru == NULL || ((struct cached_token*)node->val)->last_used <
+                            ((struct cached_token*)lru->val)->last_used)) {
+      lru = node;
+    }
+  }
+  list_iterator_destroy(it);
+  if (lru == NULL) {
+    return 0;
+  }
+  list_remove(cache, lru);
+  return 1;
+}
+
+/**
+ * @brief moves @p token into the token pool; while the pool is full, the
+ * least recently used tokens of @p cache (but not @p keep) are evicted to make
+ * room for it
+ * @return a pointer to the (possibly moved) token
+ */
+static char* _storeToken(list_t* cache, char* token,
+                         const struct cached_token* keep) {
+  token = secMemTokenPool_move(token);
+  while (!secMemTokenPool_contains(token) &&
+         _removeLeastRecentlyUsedCachedToken(cache, keep)) {
+    token = secMemTokenPool_move(token);
+  }
+  return token;
+}
+
+static void _indexCachedToken(const struct oidc_account* p, list_t** cache_ptr,
+                              const struct cache_key* key,
+                              struct cached_token*    t) {
+  if (cache_ptr == &p->token_cache && !t->unmatchable) {  // not for id tokens
+    tokenIndex_update(p, _indexKey(key), &t->token);
+  }
+}
+
+static char* _cacheToken(struct oidc_account* p, list_t** cache_ptr,
+                         const char* scope, const char* audience, char* token,
+                         unsigned long expires_at) {
+  struct cache_key key = {.audience = strValid(audience) ? audience : NULL};
+  // if the dictionary is full, the token is kept but never found
+  unsigned char unmatchable =
+      scopeSet_fromString(_scopeDict(p), scope, &key.scopes) != 0;
+  if (unmatchable) {
+    logger(NOTICE, "Too many distinct scope values, token cannot be reused");
+  }
+  list_t*      cache = _getOrCreateCache(cache_ptr);
+  list_node_t* node  = unmatchable ? NULL : findInList(cache, &key);
+  if (node) {
+    struct cached_token* t = node->val;
+    if (t->token.access_token != token) {
+      secFree(t->token.access_token);
+      t->token.access_token = _storeToken(cache, token, t);
+    }
+    t->token.token_expires_at = expires_at;
+    t->last_used              = ++useClock;
+    _indexCachedToken(p, cache_ptr, &key, t);
+    return t->token.access_token;
+  }
+  _removeExpiredCachedTokens(cache);
+  while (cache->len >= TOKEN_CACHE_MAX_ENTRIES) {
+    _removeSoonestExpiringCachedToken(cache);
+  }
+  token = _storeToken(cache, token, NULL);
+  struct cached_token* t =
+      secAllocTagged(sizeof(struct cached_token), MEMTAG_TOKEN);
+  t->scopes                 = key.scopes;
+  t->audience               = key.audience ? oidc_strcopy(key.audience) : NULL;
+  t->unmatchable            = unmatchable;
+  t->token.access_token     = token;
+  t->token.token_expires_at = expires_at;
+  t->last_used              = ++useClock;
+  list_rpush(cache, list_node_new(t));
+  _indexCachedToken(p, cache_ptr, &key, t);
+  return token;
+}
+
+/**
+ * @brief stores an access token for a scope / audience combination in the
+ * account's token cache, replacing a previously cached token for the same key
+ * @param access_token the access token; the cache takes ownership of it
+ * @return a pointer to the cached access token; it is owned by the cache
+ */
+char* account_cacheToken(struct oidc_account* p, const char* scope,
+                         const char* audience, char* access_token,
+                         unsigned long token_expires_at) {
+  if (p == NULL || access_token == NULL) {
+    return access_token;
+  }
+  return _cacheToken(p, &p->token_cache, scope, audience, access_token,
+                     token_expires_at);
+}
+
+/**
+ * @brief returns the cached id token for a scope, if it is valid long enough
+ * @param scope the requested scope; @c NULL for the account's default scope
+ * @return a pointer to the id token or @c NULL if there is no such token; it is
+ * owned by the cache and MUST NOT be freed
+ */
+char* account_getValidCachedIdToken(const struct oidc_account* p,
+                                    const char*                scope,
+                                    time_t min_valid_period) {
+  if (p == NULL) {
+    return NULL;
+  }
+  struct token* t   = _findCachedToken(p, p->id_token_cache, scope, NULL);
+  time_t        now = time(NULL);
+  if (t == NULL || !strValid(t->access_token) ||
+      (time_t)t->token_expires_at - now <= min_valid_period) {
+    return NULL;
+  }
+  return t->access_token;
+}
+
+/**
+ * @brief stores an id token for a scope in the account's id token cache
+ * @param id_token the id token; the cache takes ownership of it
+ * @param expires_at the value of the @c exp claim
+ */
+void account_cacheIdToken(struct oidc_account* p, const char* scope,
+                          char* id_token, unsigned long expires_at) {
+  if (p == NULL || id_token == NULL) {
+    secFree(id_token);
+    return;
+  }
+  _cacheToken(p, &p->id_token_cache, scope, NULL, id_token, expires_at);
+}
+
+/**
+ * @brief returns the expiration time of the access token that is used for a
+ * scope / audience combination, i.e. the default token if neither is given
+ */
+unsigned long account_getTokenExpiresAtFor(const struct oidc_account* p,
+                                           const char* scope,
+                                           const char* audience) {
+  if (!strValid(scope) && !strValid(audience)) {
+    return account_getTokenExpiresAt(p);
+  }
+  struct token* t = account_findCachedToken(p, scope, audience);
+  return t ? t->token_expires_at : 0;
+}
+
+/**
+ * @brief drops the access token that is used for a scope / audience
+ * combination, i.e. the default token if neither is given, e.g. because a
+ * resource server rejected it
+ * @return @c 1 if a token was dropped; @c 0 if there was none
+ */
+int account_dropToken(struct oidc_account* p, const char* scope,
+                      const char* audience) {
+  if (p == NULL) {
+    return 0;
+  }
+  if (!strValid(scope) && !strValid(audience)) {
+    if (!strValid(account_getAccessToken(p))) {
+      return 0;
+    }
+    account_setAccessToken(p, NULL);
+    account_setTokenExpiresAt(p, 0);
+    return 1;
+  }
+  if (p->token_cache == NULL) {
+    return 0;
+  }
+  struct cache_key key = {.audience = strValid(audience) ? audience : NULL};
+  if (scopeSet_lookup(_scopeDict(p), scope, &key.scopes) != 0) {
+    return 0;
+  }
+  list_node_t* node = findInList(p->token_cache, &key);
+  if (node == NULL) {
+    return 0;
+  }
+  list_remove(p->token_cache, node);
+  return 1;
+}
+
+/**
+ * @brief removes tokens from the account's access token and id token caches,
+ * e.g. to free memory; the default access token is kept
+ * @param expired_only if set, only expired tokens are removed; otherwise all
+ * @return the number of removed tokens
+ */
+size_t account_trimTokenCache(struct oidc_account* p,
+                              unsigned char        expired_only) {
+  if (p == NULL) {
+    return 0;
+  }
+  if (expired_only) {
+    return _removeExpiredCachedTokens(p->token_cache) +
+           _removeExpiredCachedTokens(p->id_token_cache);
+  }
+  size_t removed = (p->token_cache ? p->token_cache->len : 0) +
+                   (p->id_token_cache ? p->id_token_cache->len : 0);
+  account_clearTokenCache(p);
+  return removed;
+}
+
+void account_clearTokenCache(struct oidc_account* p) {
+  if (p == NULL) {
+    return;
+  }
+  secFreeList(p->token_cache);
+  p->token_cache = NULL;
+  secFreeList(p->id_token_cache);
+  p->id_token_cache = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef ACCOUNT_TOKEN_CACHE_H
+#define ACCOUNT_TOKEN_CACHE_H
+
+#include "account/account.h"
+#include "account/scopeSet.h"
+
+#include <time.h>
+
+/**
+ * maximum number of access tokens with non-default scope / audience (and of id
+ * tokens) that are cached per account
+ */
+#define TOKEN_CACHE_MAX_ENTRIES 16
+
+struct cached_token {
+  struct scopeSet scopes;
+  char*           audience;
+  unsigned char   unmatchable;  // scopes could not be interned
+  unsigned long   last_used;    // value of a use counter, for LRU eviction
+  struct token    token;
+};
+
+struct token* account_findCachedToken(const struct oidc_account* p,
+                                      const char* scope, const char* audience);
+char*         account_cacheToken(struct oidc_account* p, const char* scope,
+                                 const char* audience, char* access_token,
+                                 unsigned long token_expires_at);
+unsigned long account_getTokenExpiresAtFor(const struct oidc_account* p,
+                                           const char* scope,
+                                           const char* audience);
+int           account_dropToken(struct oidc_account* p, const char* scope,
+                                const char* audience);
+char*         account_getValidCachedIdToken(const struct oidc_account* p,
+                                            const char*                scope,
+                                            time_t min_valid_period);
+void          account_cacheIdToken(struct oidc_account* p, const char* scope,
+                                   char* id_token, unsigned long expires_at);
+void          account_clearTokenCache(struct oidc_account* p);
+size_t        account_trimTokenCache(struct oidc_account* p,
+                                     unsigned char        expired_only);
+
+#endif  // ACCOUNT_TOKEN_CACHE_H
@@ -0,0 +1,136 @@
+#include "tokenIndex.h"
+
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#define TOKEN_INDEX_MIN_CAP 16
+
+static struct tokenIndex idx = {};
+
+const struct tokenIndex* tokenIndex_get() { return &idx; }
+
+static int _grow() {
+  size_t cap = idx.cap ? 2 * idx.cap : TOKEN_INDEX_MIN_CAP;
+  void*  accounts =
+      secRealloc(idx.accounts, cap * sizeof(const struct oidc_account*));
+  if (accounts == NULL) {
+    return -1;
+  }
+  idx.accounts = accounts;
+  uint64_t* keys = secRealloc(idx.keys, cap * sizeof(uint64_t));
+  if (keys == NULL) {
+    return -1;
+  }
+  idx.keys = keys;
+  unsigned long* issued_at =
+      secRealloc(idx.issued_at, cap * sizeof(unsigned long));
+  if (issued_at == NULL) {
+    return -1;
+  }
+  idx.issued_at = issued_at;
+  unsigned long* expires_at =
+      secRealloc(idx.expires_at, cap * sizeof(unsigned long));
+  if (expires_at == NULL) {
+    return -1;
+  }
+  idx.expires_at       = expires_at;
+  struct token** slots = secRealloc(idx.slots, cap * sizeof(struct token*));
+  if (slots == NULL) {
+    return -1;
+  }
+  idx.slots = slots;
+  idx.cap   = cap;
+  return 0;
+}
+
+static size_t _indexOfSlot(const struct token* slot) {
+  for (size_t i = 0; i < idx.len; i++) {
+    if (idx.slots[i] == slot) {
+      return i;
+    }
+  }
+  return idx.len;
+}
+
+/**
+ * @brief adds the token @p slot of @p account to the index or updates its
+ * times if it is already indexed
+ * Has to be called whenever the times of an indexed token change.
+ */
+void tokenIndex_update(const struct oidc_account* account, uint64_t key,
+                       struct token* slot) {
+  size_t i = _indexOfSlot(slot);
+  if (i == idx.len) {
+    if (idx.len == idx.cap && _grow() != 0) {
+      logger(NOTICE, "Could not index access token: %s", oidc_serror());
+      return;
+    }
+    idx.len++;
+  }
+  idx.accounts[i]   = account;
+  idx.keys[i]       = key;
+  idx.issued_at[i]  = slot->token_issued_at;
+  idx.expires_at[i] = slot->token_expires_at;
+  idx.slots[i]      = slot;
+}
+
+/**
+ * @brief removes the token @p slot from the index; the last entry takes its
+ * place
+ */
+void tokenIndex_remove(const struct token* slot) {
+  size_t i = _indexOfSlot(slot);
+  if (i == idx.len) {
+    return;
+  }
+  size_t last       = --idx.len;
+  idx.accounts[i]   = idx.accounts[last];
+  idx.keys[i]       = idx.keys[last];
+  idx.issued_at[i]  = idx.issued_at[last];
+  idx.expires_at[i] = idx.expires_at[last];
+  idx.slots[i]      = idx.slots[last];
+  if (idx.len == 0) {
+    secFree(idx.accounts);
+    secFree(idx.keys);
+    secFree(idx.issued_at);
+    secFree(idx.expires_at);
+    secFree(idx.slots);
+    idx = (struct tokenIndex){};
+  }
+}
+
+/**
+ * @brief moves the times of all indexed tokens by @p delta seconds, because the
+ * wall clock was set by that much; their expiry was computed from the
+ * @c expires_in of the token response
+ */
+void tokenIndex_shift(time_t delta) {
+  for (size_t i = 0; i < idx.len; i++) {
+    struct token* slot = idx.slots[i];
+    if (slot->token_issued_at) {
+      slot->token_issued_at = (unsigned long)(slot->token_issued_at + delta);
+    }
+    if (slot->token_expires_at) {
+      slot->token_expires_at = (unsigned long)(slot->token_expires_at + delta);
+    }
+    idx.issued_at[i]  = slot->token_issued_at;
+    idx.expires_at[i] = slot->token_expires_at;
+  }
+}
+
+/**
+ * @brief finds the indexed token of @p account with the given @p key
+ * @return a pointer to the token or @c NULL if none is indexed; a cached token
+ * found by its key still has to be compared with the requested scopes and
+ * audience
+ */
+struct token* tokenIndex_find(const struct oidc_account* account,
+                              uint64_t                   key) {
+  for (size_t i = 0; i < idx.len; i++) {
+    if (idx.keys[i] == key && idx.accounts[i] == account) {
+      return idx.slots[i];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef ACCOUNT_TOKEN_INDEX_H
+#define ACCOUNT_TOKEN_INDEX_H
+
+#include "account/account.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * key of the default access token of an account
+ */
+#define TOKEN_INDEX_DEFAULT_KEY 0
+
+/**
+ * The access tokens of all loaded accounts with their expiration times, kept
+ * in parallel arrays, so that validity checks and the expiry sweeps of the
+ * prefetch scheduler only read these arrays and not the accounts.
+ * Entry @c i belongs to the token @c slots[i] of account @c accounts[i];
+ * @c keys[i] is @c TOKEN_INDEX_DEFAULT_KEY for the default access token and a
+ * hash of scopes and audience for a cached one.
+ */
+struct tokenIndex {
+  size_t                      len;
+  size_t                      cap;
+  const struct oidc_account** accounts;
+  uint64_t*                   keys;
+  unsigned long*              issued_at;
+  unsigned long*              expires_at;
+  struct token**              slots;
+};
+
+const struct tokenIndex* tokenIndex_get();
+void          tokenIndex_update(const struct oidc_account* account, uint64_t key,
+                                struct token* slot);
+void          tokenIndex_remove(const struct token* slot);
+void          tokenIndex_shift(time_t delta);
+struct token* tokenIndex_find(const struct oidc_account* account, uint64_t key);
+
+#endif  // ACCOUNT_TOKEN_INDEX_H
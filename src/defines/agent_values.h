@@ -7,6 +7,9 @@
 #define AGENT_KEY_SHORTNAME "name"
 #define AGENT_KEY_CERTPATH "cert_path"
 #define AGENT_KEY_EXPIRESAT "expires_at"
+#define AGENT_KEY_REFRESHTOKENPOOL "refresh_token_pool"
+#define AGENT_KEY_REFRESHTOKENPOOLSIZE "refresh_token_pool_size"
+#define AGENT_KEY_REFRESHTOKENSLOT "refresh_token_slot"
 
 // INTERNAL / CLI FLOW VALUES
 #define FLOW_VALUE_CODE "code"
@@ -18,4 +21,13 @@
 
 #define FORCE_NEW_TOKEN -1
 
+// seconds a started auth code flow waits for the redirect before it is removed
+#define CODEEXCHANGE_LIFETIME 900
+
+// seconds a cached id token must still be valid to be returned again
+#define IDTOKEN_MIN_VALID_PERIOD 10
+
+// maximum number of oidcd worker processes
+#define AGENT_MAX_WORKERS 64
+
 #endif  // AGENT_MAGIC_VALUES_H
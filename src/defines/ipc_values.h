@@ -3,6 +3,12 @@
 
 #include "oidc_values.h"
 
+// FRAMING
+// framed messages that are longer are rejected by the reader
+#define IPC_MAX_FRAME_LEN (16 * 1024 * 1024)
+// seconds a peer has to send the rest of a frame once it started it
+#define IPC_FRAME_TIMEOUT 10
+
 // IPC KEYS
 #define IPC_KEY_REQUEST "request"
 #define IPC_KEY_STATUS "status"
@@ -32,6 +38,25 @@
 #define IPC_KEY_FILENAME "filename"
 #define IPC_KEY_DATA "data"
 #define IPC_KEY_ONLYAT "only_at"
+#define IPC_KEY_REQUESTS "requests"
+#define IPC_KEY_RESPONSES "responses"
+#define IPC_KEY_METRICS "metrics"
+#define IPC_KEY_TRACE "trace"
+#define IPC_KEY_QUEUEDAT "queued_at"
+#define IPC_KEY_STALEOK "stale_ok"
+#define IPC_KEY_REVOKE "revoke"
+#define IPC_KEY_DURATION "duration"
+#define IPC_KEY_HEAP "heap"
+#define IPC_KEY_TIMEOUT "timeout"
+#define IPC_KEY_DEADLINE "deadline"
+#define IPC_KEY_RETRYAFTER "retry_after"
+#define IPC_KEY_BACKGROUND "background"
+#define IPC_KEY_TENANT "tenant"
+#define IPC_KEY_LEASE "lease"
+#define IPC_KEY_WHEN "when"
+#define IPC_KEY_TOKENREQUEST "token_request"
+#define IPC_KEY_TOKENRESPONSE "token_response"
+#define IPC_KEY_TOKENHASH "token_hash"
 
 // STATUS
 #define STATUS_SUCCESS "success"
@@ -39,18 +64,24 @@
 #define STATUS_ACCEPTED "accepted"
 #define STATUS_NOTFOUND "NotFound"
 #define STATUS_FOUNDBUTDONE "FoundButReceived"
+#define STATUS_ENCRYPTIONREQUIRED "EncryptionRequired"
+#define STATUS_BUSY "busy"
 
 // REQUEST VALUES
 #define REQUEST_VALUE_ADD "add"
+#define REQUEST_VALUE_ADD_BATCH "add_batch"
 #define REQUEST_VALUE_GEN "gen"
 #define REQUEST_VALUE_REGISTER "register"
+#define REQUEST_VALUE_REGISTER_BATCH "register_batch"
 #define REQUEST_VALUE_REMOVE "remove"
 #define REQUEST_VALUE_REMOVEALL "remove_all"
 #define REQUEST_VALUE_DELETE "delete"
 #define REQUEST_VALUE_CODEEXCHANGE "code_exchange"
 #define REQUEST_VALUE_STATELOOKUP "state_lookup"
 #define REQUEST_VALUE_DEVICELOOKUP "device"
+#define REQUEST_VALUE_DEVICEPOLL "device_poll"
 #define REQUEST_VALUE_ACCESSTOKEN "access_token"
+#define REQUEST_VALUE_ACCESSTOKEN_BATCH "access_token_batch"
 #define REQUEST_VALUE_TERMHTTP "term_http_server"
 #define REQUEST_VALUE_LOCK "lock"
 #define REQUEST_VALUE_UNLOCK "unlock"
@@ -64,9 +95,24 @@
 #define REQUEST_VALUE_FILEREAD "file_read"
 #define REQUEST_VALUE_FILEREMOVE "file_remove"
 #define REQUEST_VALUE_DELETECLIENT "delete_client"
+#define REQUEST_VALUE_SESSION "session"
+#define REQUEST_VALUE_METRICS "metrics"
+#define REQUEST_VALUE_SUBSCRIBE "subscribe"
+#define REQUEST_VALUE_STATS "stats"
+#define REQUEST_VALUE_PROFILE "profile"
+#define REQUEST_VALUE_HEALTH "health"
+#define REQUEST_VALUE_REPLICATE "replicate"
+#define REQUEST_VALUE_PREFETCH "prefetch"
+#define REQUEST_VALUE_STAGE "stage"
+#define REQUEST_VALUE_UPGRADE "upgrade"
+#define REQUEST_VALUE_USERINFO "userinfo"
+#define REQUEST_VALUE_VALIDATE "validate_token"
+#define REQUEST_VALUE_TOKENREJECTED "token_rejected"
 
 // RESPONSE TEMPLATES
 #define RESPONSE_SUCCESS "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\"}"
+#define RESPONSE_ENCRYPTION_REQUIRED \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_ENCRYPTIONREQUIRED "\"}"
 #define RESPONSE_SUCCESS_CLIENT_MAXSCOPES                            \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_CLIENT \
   "\":%s,\"" IPC_KEY_MAXSCOPES "\":\"%s\"}"
@@ -85,10 +131,17 @@
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\"}"
 #define RESPONSE_STATUS_CONFIG \
   "{\"" IPC_KEY_STATUS "\":\"%s\",\"" IPC_KEY_CONFIG "\":%s}"
-#define RESPONSE_STATUS_ACCESS                             \
-  "{\"" IPC_KEY_STATUS "\":\"%s\",\"" OIDC_KEY_ACCESSTOKEN \
-  "\":\"%s\",\"" OIDC_KEY_ISSUER "\":\"%s\","              \
-  "\"" AGENT_KEY_EXPIRESAT "\":%lu}"
+// The fragments of RESPONSE_STATUS_ACCESS between its values, so that the
+// response can also be written in parts without formatting it
+#define RESPONSE_ACCESS_PART_STATUS "{\"" IPC_KEY_STATUS "\":\""
+#define RESPONSE_ACCESS_PART_ACCESSTOKEN "\",\"" OIDC_KEY_ACCESSTOKEN "\":\""
+#define RESPONSE_ACCESS_PART_ISSUER "\",\"" OIDC_KEY_ISSUER "\":\""
+#define RESPONSE_ACCESS_PART_EXPIRESAT "\",\"" AGENT_KEY_EXPIRESAT "\":"
+#define RESPONSE_ACCESS_PART_END "}"
+#define RESPONSE_STATUS_ACCESS                                           \
+  RESPONSE_ACCESS_PART_STATUS "%s" RESPONSE_ACCESS_PART_ACCESSTOKEN "%s" \
+  RESPONSE_ACCESS_PART_ISSUER "%s" RESPONSE_ACCESS_PART_EXPIRESAT        \
+  "%lu" RESPONSE_ACCESS_PART_END
 #define RESPONSE_STATUS_IDTOKEN                        \
   "{\"" IPC_KEY_STATUS "\":\"%s\",\"" OIDC_KEY_IDTOKEN \
   "\":\"%s\",\"" OIDC_KEY_ISSUER "\":\"%s\"}"
@@ -121,12 +174,27 @@
 #define RESPONSE_SUCCESS_FILE                                               \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_DATA "\":\"%" \
   "s\"}"
+#define RESPONSE_BATCH                                                \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_RESPONSES \
+  "\":%s}"
+#define RESPONSE_BUSY                                             \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_BUSY "\",\"" OIDC_KEY_ERROR \
+  "\":\"%s\",\"" IPC_KEY_RETRYAFTER "\":%d}"
 
 // REQUEST TEMPLATES
 #define REQUEST "{\"" IPC_KEY_REQUEST "\":\"%s\",%s}"
 #define REQUEST_STATUS "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_STATUS "\"}"
 #define REQUEST_STATUS_JSON \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_STATUS_JSON "\"}"
+#define REQUEST_METRICS \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_METRICS "\"}"
+#define REQUEST_STATS "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_STATS "\"}"
+#define REQUEST_PROFILE                                       \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_PROFILE "\",\"" \
+  IPC_KEY_DURATION "\":%lu,\"" IPC_KEY_HEAP "\":%d}"
+#define REQUEST_HEALTH "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_HEALTH "\"}"
+#define REQUEST_UPGRADE \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_UPGRADE "\"}"
 #define REQUEST_ADD_LIFETIME                                             \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ADD "\",\"" IPC_KEY_CONFIG \
   "\":%s,\"" IPC_KEY_LIFETIME "\":%lu,\"" IPC_KEY_PASSWORDENTRY          \
@@ -135,11 +203,17 @@
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ADD "\",\"" IPC_KEY_CONFIG \
   "\":%s,\"" IPC_KEY_PASSWORDENTRY "\":%s,\"" IPC_KEY_CONFIRM            \
   "\":%d,\"" IPC_KEY_ALWAYSALLOWID "\":%d}"
+#define REQUEST_ADD_BATCH                                       \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ADD_BATCH "\",\"" \
+  IPC_KEY_REQUESTS "\":[%s]}"
 #define REQUEST_REMOVE                                                         \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_REMOVE "\",\"" IPC_KEY_SHORTNAME \
   "\":\"%s\"}"
 #define REQUEST_REMOVEALL \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_REMOVEALL "\"}"
+#define REQUEST_REMOVEALL_REVOKE                                               \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_REMOVEALL "\",\"" IPC_KEY_REVOKE \
+  "\":1}"
 #define REQUEST_DELETE                                                      \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_DELETE "\",\"" IPC_KEY_CONFIG \
   "\":%s}"
@@ -159,6 +233,10 @@
 #define REQUEST_REGISTER_AUTH                                                 \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_REGISTER "\",\"" IPC_KEY_CONFIG \
   "\":%s,\"" IPC_KEY_FLOW "\":%s,\"" IPC_KEY_AUTHORIZATION "\":\"%s\"}"
+#define REQUEST_REGISTER_BATCH                                            \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_REGISTER_BATCH "\",\""      \
+  IPC_KEY_CONFIG "\":%s,\"" IPC_KEY_FLOW "\":%s,\"" IPC_KEY_AUTHORIZATION \
+  "\":\"%s\"}"
 #define REQUEST_CODEEXCHANGE                               \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_CODEEXCHANGE \
   "\",\"" IPC_KEY_REDIRECTEDURI "\":\"%s\"}"
@@ -172,12 +250,18 @@
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_DEVICELOOKUP                   \
   "\",\"" IPC_KEY_DEVICE "\":%s,\"" IPC_KEY_CONFIG "\":%s,\"" IPC_KEY_ONLYAT \
   "\":%d}"
+#define REQUEST_DEVICE_POLL                                                  \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_DEVICEPOLL                     \
+  "\",\"" IPC_KEY_DEVICE "\":%s,\"" IPC_KEY_CONFIG "\":%s,\"" IPC_KEY_ONLYAT \
+  "\":%d}"
 #define REQUEST_TERMHTTP                                                      \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_TERMHTTP "\",\"" OIDC_KEY_STATE \
   "\":\"%s\"}"
 #define REQUEST_LOCK \
   "{\"" IPC_KEY_REQUEST "\":\"%s\",\"" IPC_KEY_PASSWORD "\":\"%s\"}"
 #define REQUEST_CHECK "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_CHECK "\"}"
+#define REQUEST_SESSION \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_SESSION "\"}"
 #define REQUEST_LOADEDACCOUNTS \
   "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_LOADEDACCOUNTS "\"}"
 #define REQUEST_SCOPES                                                         \
@@ -209,12 +293,28 @@
 #define INT_REQUEST_VALUE_CONFIRM "confirm"
 #define INT_REQUEST_VALUE_CONFIRMIDTOKEN "confirm_id"
 #define INT_REQUEST_VALUE_QUERY_ACCDEFAULT "query_account_default"
+#define INT_NOTIFY_VALUE_TOKEN "token_refreshed"
+#define INT_NOTIFY_VALUE_ACCOUNT_CHANGED "account_changed"
+#define INT_NOTIFY_VALUE_CONFIG_CHANGED "config_changed"
+#define INT_NOTIFY_VALUE_ACCOUNTS "accounts_changed"
+#define INT_NOTIFY_VALUE_HOTTOKEN "hot_token"
+#define INT_NOTIFY_VALUE_HOTTOKEN_DROP "hot_token_dropped"
+#define INT_NOTIFY_VALUE_RTPOOL "rt_pool"
+#define INT_NOTIFY_VALUE_RTPOOL_LANE "rt_pool_lane"
+#define INT_NOTIFY_VALUE_RTPOOL_DROP "rt_pool_dropped"
+#define INT_REQUEST_VALUE_RELOAD "reload"
+#define INT_REQUEST_VALUE_LEASE "refresh_lease"
 
 #define INT_IPC_KEY_OIDCERRNO "oidc_errno"
+#define INT_IPC_KEY_ACCOUNT "account_data"
+#define INT_IPC_KEY_ACCOUNTS "accounts"
+#define INT_IPC_KEY_RESPONSE "response"
+#define INT_IPC_KEY_DEATH "death"
 
-#define INT_REQUEST_UPD_REFRESH                               \
-  "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_UPD_REFRESH \
-  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" OIDC_KEY_REFRESHTOKEN "\":\"%s\"}"
+#define INT_REQUEST_UPD_REFRESH                                       \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_UPD_REFRESH         \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" AGENT_KEY_REFRESHTOKENSLOT \
+  "\":%lu,\"" OIDC_KEY_REFRESHTOKEN "\":\"%s\"}"
 #define INT_REQUEST_AUTOLOAD                                       \
   "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_AUTOLOAD         \
   "\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" IPC_KEY_APPLICATIONHINT \
@@ -223,21 +323,46 @@
   "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_AUTOLOAD   \
   "\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" IPC_KEY_ISSUERURL \
   "\":\"%s\",\"" IPC_KEY_APPLICATIONHINT "\":\"%s\"}"
-#define INT_REQUEST_CONFIRM                              \
-  "{\"" IPC_KEY_REQUEST "\":\"%s\",\"" IPC_KEY_SHORTNAME \
-  "\":\"%s\",\"" IPC_KEY_APPLICATIONHINT "\":\"%s\"}"
+#define INT_REQUEST_CONFIRM                                           \
+  "{\"" IPC_KEY_REQUEST "\":\"%s\",\"" IPC_KEY_SHORTNAME              \
+  "\":\"%s\",\"" IPC_KEY_APPLICATIONHINT "\":\"%s\",\"" OIDC_KEY_SCOPE \
+  "\":\"%s\"}"
 #define INT_REQUEST_CONFIRM_WITH_ISSUER                                   \
   "{\"" IPC_KEY_REQUEST "\":\"%s\",\"" IPC_KEY_ISSUERURL                  \
   "\":\"%s\",\"" IPC_KEY_SHORTNAME "\":\"%s\",\"" IPC_KEY_APPLICATIONHINT \
-  "\":\"%s\"}"
+  "\":\"%s\",\"" OIDC_KEY_SCOPE "\":\"%s\"}"
 #define INT_REQUEST_QUERY_ACCDEFAULT_ISSUER                        \
   "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_QUERY_ACCDEFAULT \
   "\",\"" IPC_KEY_ISSUERURL "\":\"%s\"}"
 #define INT_REQUEST_QUERY_ACCDEFAULT \
   "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_QUERY_ACCDEFAULT "\"}"
+#define INT_REQUEST_RELOAD                               \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_RELOAD \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\"}"
+#define INT_REQUEST_LEASE                               \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_REQUEST_VALUE_LEASE \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\"}"
+#define INT_NOTIFY_TOKEN                                                \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_NOTIFY_VALUE_TOKEN "\",\""            \
+  IPC_KEY_SHORTNAME "\":\"%s\",\"" OIDC_KEY_ACCESSTOKEN "\":\"%s\",\""   \
+  OIDC_KEY_ISSUER "\":\"%s\",\"" AGENT_KEY_EXPIRESAT "\":%lu}"
+#define INT_NOTIFY_ACCOUNT_CHANGED                               \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_NOTIFY_VALUE_ACCOUNT_CHANGED \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\"}"
+#define INT_NOTIFY_CONFIG_CHANGED \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_NOTIFY_VALUE_CONFIG_CHANGED "\"}"
+#define INT_NOTIFY_ACCOUNTS                                       \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_NOTIFY_VALUE_ACCOUNTS "\",\"" \
+  INT_IPC_KEY_ACCOUNTS "\":%s}"
+#define INT_NOTIFY_RTPOOL_DROP                               \
+  "{\"" IPC_KEY_REQUEST "\":\"" INT_NOTIFY_VALUE_RTPOOL_DROP \
+  "\",\"" IPC_KEY_SHORTNAME "\":\"%s\"}"
 #define INT_RESPONSE_ACCDEFAULT                                         \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" IPC_KEY_SHORTNAME \
   "\":\"%s\"}"
+#define INT_RESPONSE_ACCOUNT                                              \
+  "{\"" IPC_KEY_STATUS "\":\"" STATUS_SUCCESS "\",\"" INT_IPC_KEY_ACCOUNT \
+  "\":\"%s\"}"
 #define INT_RESPONSE_ERROR                                                  \
   "{\"" IPC_KEY_STATUS "\":\"" STATUS_FAILURE "\",\"" INT_IPC_KEY_OIDCERRNO \
   "\":%d}"
@@ -11,6 +11,8 @@
 #define OIDC_KEY_TOKEN_ENDPOINT "token_endpoint"
 #define OIDC_KEY_AUTHORIZATION_ENDPOINT "authorization_endpoint"
 #define OIDC_KEY_REVOCATION_ENDPOINT "revocation_endpoint"
+#define OIDC_KEY_USERINFO_ENDPOINT "userinfo_endpoint"
+#define OIDC_KEY_JWKS_URI "jwks_uri"
 #define OIDC_KEY_REGISTRATION_ENDPOINT "registration_endpoint"
 #define OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT "device_authorization_endpoint"
 #define OIDC_KEY_ISSUER "issuer"
@@ -47,6 +49,11 @@
 // REVOCATION
 #define OIDC_KEY_TOKENTYPE_HINT "token_type_hint"
 #define OIDC_KEY_TOKEN "token"
+// TOKEN EXCHANGE
+#define OIDC_KEY_SUBJECTTOKEN "subject_token"
+#define OIDC_KEY_SUBJECTTOKENTYPE "subject_token_type"
+#define OIDC_KEY_REQUESTEDTOKENTYPE "requested_token_type"
+#define OIDC_KEY_ISSUEDTOKENTYPE "issued_token_type"
 // CLIENT REGISTRATION
 #define OIDC_KEY_APPLICATIONTYPE "application_type"
 #define OIDC_KEY_CLIENTNAME "client_name"
@@ -74,6 +81,8 @@
 #define OIDC_GRANTTYPE_AUTHCODE "authorization_code"
 #define OIDC_GRANTTYPE_IMPLICIT "implicit"
 #define OIDC_GRANTTYPE_DEVICE "urn:ietf:params:oauth:grant-type:device_code"
+#define OIDC_GRANTTYPE_TOKENEXCHANGE \
+  "urn:ietf:params:oauth:grant-type:token-exchange"
 #define OIDC_PROVIDER_DEFAULT_GRANTTYPES \
   "[\"" OIDC_GRANTTYPE_AUTHCODE "\", \"" OIDC_GRANTTYPE_IMPLICIT "\"]"
 
@@ -91,6 +100,10 @@
 
 // TOKENTYPES
 #define OIDC_TOKENTYPE_REFRESH "refresh_token"
+#define OIDC_TOKENTYPE_URN_ACCESSTOKEN \
+  "urn:ietf:params:oauth:token-type:access_token"
+#define OIDC_TOKENTYPE_URN_REFRESHTOKEN \
+  "urn:ietf:params:oauth:token-type:refresh_token"
 
 // PROVIDER FIXES
 #define GOOGLE_ISSUER_URL "https://accounts.google.com/"
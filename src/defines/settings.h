@@ -27,6 +27,7 @@
 // Default env var names for arguments
 #define OIDC_REFRESHTOKEN_ENV_NAME "OIDC_REFRESH_TOKEN"
 #define OIDC_PASSWORD_ENV_NAME "OIDC_ENCRYPTION_PW"
+#define OIDC_NEW_PASSWORD_ENV_NAME "OIDC_NEW_ENCRYPTION_PW"
 
 // file names
 /**
@@ -41,6 +42,10 @@
 #define PUBCLIENTS_FILENAME "pubclients.config"
 #define ETC_PUBCLIENTS_CONFIG_FILE \
   CONFIG_PATH "/oidc-agent/" PUBCLIENTS_FILENAME
+#define KDF_CONFIG_FILENAME "kdf.config"
+#define KEYSTORE_FILENAME "keystore.config"
+// the time a key derivation should take if calibrated without an explicit value
+#define DEFAULT_KDF_CALIBRATION_MS 500
 
 #define MAX_PASS_TRIES 3
 /**
@@ -56,6 +61,166 @@
 #define HTTP_FALLBACK_PORT 8080
 
 #define CONF_ENDPOINT_SUFFIX ".well-known/openid-configuration"
+/**
+ * how long a cached openid configuration is used without revalidation, if the
+ * issuer does not specify a max-age
+ */
+#define ISSUER_CONFIG_DEFAULT_MAX_AGE 3600  // seconds
+
+/**
+ * default limits for https requests; can be set per issuer in the user's
+ * issuer.config
+ */
+#define HTTP_DEFAULT_CONNECT_TIMEOUT 10  // seconds
+#define HTTP_DEFAULT_TIMEOUT 30          // seconds
+/**
+ * a transfer that is slower than HTTP_LOW_SPEED_LIMIT bytes per second for
+ * HTTP_LOW_SPEED_TIME seconds is aborted
+ */
+#define HTTP_LOW_SPEED_LIMIT 1
+#define HTTP_LOW_SPEED_TIME 10  // seconds
+/**
+ * A hedged request is sent after the 95th percentile of the latencies of the
+ * last HTTP_HEDGE_SAMPLES requests to a host, once at least
+ * HTTP_HEDGE_MIN_SAMPLES are known.
+ */
+#define HTTP_HEDGE_SAMPLES 64
+#define HTTP_HEDGE_MIN_SAMPLES 16
+#define HTTP_HEDGE_MIN_DELAY 50  // milliseconds
+/**
+ * how much longer than the request timeout oidcd waits for the http worker
+ */
+#define HTTP_WORKER_GRACE 5  // seconds
+
+/**
+ * after that many consecutive failed requests to an issuer, no requests are
+ * sent to it for a backoff between ISSUER_HEALTH_MIN_BACKOFF and
+ * ISSUER_HEALTH_MAX_BACKOFF
+ */
+#define ISSUER_HEALTH_FAILURE_THRESHOLD 3
+#define ISSUER_HEALTH_MIN_BACKOFF 5    // seconds
+#define ISSUER_HEALTH_MAX_BACKOFF 300  // seconds
+
+// Seconds an urgent refresh waits for the rate limit of --issuer-rate; see
+// oidc-agent/oidc/issuerRateLimit.c
+#define ISSUER_RATE_MAX_WAIT 5
+// Maximum seconds a Retry-After or RateLimit header of a provider is honoured
+#define ISSUER_RETRY_AFTER_MAX 3600
+
+/**
+ * refresh tokens revoked in the background: at most that many revocations run
+ * in parallel per issuer; failed ones are retried that many times
+ */
+#define REVOCATION_MAX_PER_ISSUER 4
+#define REVOCATION_RETRIES 3
+
+/**
+ * the clients of a registration batch are registered by that many processes
+ * in parallel
+ */
+#define REGISTRATION_BATCH_CONCURRENCY 8
+
+/**
+ * interval for refreshing warmed up connections; below the time after which
+ * idle connections are closed by curl (118 s) and by common web servers
+ */
+#define WARMUP_INTERVAL 60  // seconds
+
+/**
+ * forced token refreshes a client (a user and application) may request from
+ * oidcp: a burst and the rate at which the allowance is refilled
+ */
+#define SCHEDULER_FORCED_BURST 5
+#define SCHEDULER_FORCED_PER_MINUTE 6
+
+/**
+ * forced token refreshes that oidcp lets a worker handle at the same time;
+ * further ones are queued per client and sent in round robin
+ */
+#define SCHEDULER_MAX_FORCED_INFLIGHT 2
+
+/**
+ * requests oidcp forwards to oidcd at most before it answers token requests
+ * with a busy response; the response asks clients to retry after
+ * AGENT_BUSY_RETRY_AFTER
+ */
+#define AGENT_MAX_PENDING_REQUESTS 1024
+#define AGENT_BUSY_RETRY_AFTER 1  // seconds
+
+/**
+ * threads oidcp uses at most for CPU-heavy crypto, e.g. the key derivation
+ * for an encrypted account config; one less than the number of CPUs
+ */
+#define WORKPOOL_MAX_THREADS 4
+
+/**
+ * key pairs oidcp keeps ready for the key exchange with clients, and how many
+ * of them are generated on the work pool at once
+ */
+#define KEYPAIR_POOL_SIZE 64
+#define KEYPAIR_POOL_BATCH 16
+
+/**
+ * seconds for which a declined or failed autoload of an account is answered
+ * with the same error instead of prompting the user again
+ */
+#define AUTOLOAD_NEGATIVE_CACHE_TIME 5
+
+/**
+ * seconds for which unknown short names and issuers are remembered, and the
+ * number of them that are remembered at most; see utils/negativeCache.c
+ */
+#define NEGATIVE_CACHE_TIME 10
+#define NEGATIVE_CACHE_MAX 256
+
+/**
+ * settings of the prediction of recurring token requests with --prefetch; see
+ * oidcd/tokenPredictor.c
+ */
+#define PREDICTOR_MAX_PATTERNS 256
+#define PREDICTOR_MIN_OBSERVATIONS 3  // regular intervals before predicting
+#define PREDICTOR_MIN_INTERVAL 60     // seconds; closer requests are a burst
+#define PREDICTOR_LEAD_TIME 60        // seconds before the predicted request
+#define PREDICTOR_BUDGET_PER_HOUR 60  // prefetched tokens per hour at most
+
+/**
+ * settings of the prefetch hints sent by clients; see oidcd/prefetchHints.c
+ */
+#define PREFETCH_HINTS_MAX 256
+#define PREFETCH_HINT_MIN_VALID 300       // seconds a hinted token is valid
+#define PREFETCH_HINT_LEAD_TIME 60        // seconds before the window
+#define PREFETCH_HINT_RETRY 60            // seconds between refreshes
+#define PREFETCH_HINT_MAX_DURATION 86400  // seconds
+#define PREFETCH_HINT_MAX_AHEAD 604800    // seconds until the window starts
+
+/**
+ * settings of the refresh token keepalive with --refresh-keepalive; see
+ * oidcd/refreshKeepalive.c
+ */
+#define KEEPALIVE_SWEEP_INTERVAL 60  // seconds between checks for due accounts
+#define KEEPALIVE_JITTER_PERCENT 10  // of the interval a refresh is moved
+#define KEEPALIVE_RETRY 300          // seconds after a failed refresh
+
+/**
+ * settings of the detection of wall clock steps and suspends; see
+ * utils/clockWatch.c
+ */
+#define CLOCK_JUMP_THRESHOLD 2    // seconds; smaller differences are ignored
+#define RESUME_STAGGER_WINDOW 30  // seconds over which refreshes are spread
+
+/**
+ * seconds oidcp waits for pending requests to finish before it replaces
+ * itself with a new binary; the upgrade is cancelled afterwards
+ */
+#define UPGRADE_DRAIN_TIMEOUT 10
+
+/**
+ * settings of the restart of a crashed oidcd worker; see
+ * oidc-agent/oidcp/recovery.c
+ */
+#define RECOVERY_PUSH_DELAY 1       // seconds changes are collected by oidcd
+#define RECOVERY_MAX_RESTARTS 5     // restarts of a worker within the window
+#define RECOVERY_RESTART_WINDOW 60  // seconds
 
 extern char* possibleCertFiles[4];
 
@@ -30,6 +30,8 @@ void _secFreeConnection(struct connection* con) {
   con->server = NULL;
   secFree(con->tcp_server);
   con->tcp_server = NULL;
+  secFree(con->tcp_addrs);
+  con->tcp_addrs = NULL;
   secFree(con->sock);
   con->sock = NULL;
   if (con->msgsock) {
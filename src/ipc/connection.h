@@ -1,15 +1,26 @@
 #ifndef IPC_CONNECTION_H
 #define IPC_CONNECTION_H
 
+#include "utils/ipUtils.h"
+
 #include <stddef.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * listen backlog of the server sockets; bursts of clients connecting at the
+ * same time are queued by the kernel instead of being refused
+ */
+#define IPC_LISTEN_BACKLOG SOMAXCONN
 
 struct connection {
-  int*                sock;
-  int*                msgsock;
-  struct sockaddr_un* server;
-  struct sockaddr_in* tcp_server;
+  int*                     sock;
+  int*                     msgsock;
+  struct sockaddr_un*      server;
+  struct sockaddr_in*      tcp_server;
+  struct resolved_address* tcp_addrs;  // client side: addresses to try
+  size_t                   tcp_addrs_count;
 };
 
 int  connection_comparator(const struct connection* c1,
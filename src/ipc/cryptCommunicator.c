@@ -1,47 +1,127 @@
 #include "cryptCommunicator.h"
 #include "cryptIpc.h"
+#include "defines/ipc_values.h"
 #include "defines/settings.h"
 #include "ipc.h"
 #include "utils/crypt/ipcCryptUtils.h"
 #include "utils/json.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/requestTrace.h"
+#include "utils/stringUtils.h"
 
+#include <poll.h>
 #include <sodium.h>
+#include <string.h>
 
-char* _ipc_vcryptCommunicateWithConnection(struct connection con,
+static time_t responseTimeout = 0;
+
+/**
+ * @brief limits how long a request waits for the response of the agent
+ * Only requests on their own connection give up; in a session a late response
+ * would be taken as the response to the next request.
+ * @param seconds the timeout; @c 0 to wait as long as it takes
+ */
+void ipc_setResponseTimeout(time_t seconds) { responseTimeout = seconds; }
+
+static time_t _defaultDeath() {
+  return responseTimeout ? time(NULL) + responseTimeout : 0;
+}
+
+/**
+ * @brief sends a request unencrypted over a UNIX domain socket
+ * The agent only answers unencrypted requests if the peer credentials of the
+ * client are trusted; otherwise it asks for encryption and the key exchange
+ * can be done on the same connection.
+ * @param response is set to the response or @c NULL if encryption is required
+ * @return @c OIDC_SUCCESS or an error code if the communication failed
+ */
+static oidc_error_t _ipc_vplainCommunicate(int sock, const char* fmt,
+                                           va_list args, time_t death,
+                                           char** response) {
+  logger(DEBUG, "Doing unencrypted local ipc communication");
+  *response = NULL;
+  va_list plain_args;
+  va_copy(plain_args, args);
+  oidc_error_t e = ipc_vwrite(sock, fmt, plain_args);
+  va_end(plain_args);
+  if (e != OIDC_SUCCESS) {
+    return e;
+  }
+  requestTrace_mark("client_sent");
+  char* res = ipc_readWithTimeout(sock, death);
+  if (res == NULL) {
+    return oidc_errno;
+  }
+  char* status = getJSONValueFromString(res, IPC_KEY_STATUS);
+  if (strequal(status, STATUS_ENCRYPTIONREQUIRED)) {
+    logger(DEBUG, "Agent requires encryption");
+    secFree(res);
+  } else {
+    requestTrace_mark("client_received");
+    *response = res;
+  }
+  secFree(status);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief sends a request on its own connection and returns the response
+ * @param death the time at which connecting, the key exchange, or waiting for
+ * the response fails with @c OIDC_ETIMEOUT; @c 0 to wait as long as it takes
+ */
+char* _ipc_vcryptCommunicateWithConnection(struct connection con, time_t death,
                                            const char* fmt, va_list args) {
   logger(DEBUG, "Doing encrypted ipc communication");
-  if (ipc_connect(con) < 0) {
+  requestTrace_mark("client_start");
+  if (ipc_connect(con, death) < 0) {
     return NULL;
   }
-  unsigned char* ipc_key = client_keyExchange(*(con.sock));
+  requestTrace_mark("client_connected");
+  if (con.server->sun_path[0] != '\0') {  // the kernel authenticates us
+    char* res = NULL;
+    if (_ipc_vplainCommunicate(*(con.sock), fmt, args, death, &res) !=
+            OIDC_SUCCESS ||
+        res != NULL) {
+      ipc_closeConnection(&con);
+      return res;
+    }
+  }
+  unsigned char* ipc_key = client_keyExchange(*(con.sock), death);
   if (ipc_key == NULL) {
     ipc_closeConnection(&con);
     return NULL;
   }
+  requestTrace_mark("client_key_exchanged");
   oidc_error_t e = ipc_vcryptWrite(*(con.sock), ipc_key, fmt, args);
   if (e != OIDC_SUCCESS) {
     secFree(ipc_key);
     ipc_closeConnection(&con);
     return NULL;
   }
+  requestTrace_mark("client_sent");
 
-  char* encryptedResponse = ipc_read(*(con.sock));
+  size_t len               = 0;
+  char*  encryptedResponse =
+      ipc_readWithLengthAndTimeout(*(con.sock), death, &len);
   ipc_closeConnection(&con);
   if (encryptedResponse == NULL) {
     secFree(ipc_key);
     return NULL;
   }
+  requestTrace_mark("client_received");
 
-  if (isJSONObject(encryptedResponse)) {
+  if (!isBinaryIpcMessage(encryptedResponse, len) &&
+      isJSONObject(encryptedResponse)) {
     // Response not encrypted
     secFree(ipc_key);
     return encryptedResponse;
   }
-  char* decryptedResponse = decryptForIpc(encryptedResponse, ipc_key);
-  secFree(encryptedResponse);
+  char* decryptedResponse =
+      decryptForIpcInPlace(encryptedResponse, len, ipc_key);
   secFree(ipc_key);
+  requestTrace_mark("client_decrypted");
   return decryptedResponse;
 }
 
@@ -55,20 +135,40 @@ char* ipc_cryptCommunicate(unsigned char remote, const char* fmt, ...) {
 
 char* ipc_vcryptCommunicate(unsigned char remote, const char* fmt,
                             va_list args) {
-  static struct connection con;
+  return ipc_vcryptCommunicateUntil(remote, _defaultDeath(), fmt, args);
+}
+
+/**
+ * @brief like @c ipc_vcryptCommunicate, but gives up at @p death instead of
+ * after the timeout set with @c ipc_setResponseTimeout
+ * @param death the time at which connecting, the key exchange, or waiting for
+ * the response fails with @c OIDC_ETIMEOUT; @c 0 to wait as long as it takes
+ */
+char* ipc_vcryptCommunicateUntil(unsigned char remote, time_t death,
+                                 const char* fmt, va_list args) {
+  struct connection con = {0};
   if (ipc_client_init(&con, remote) != OIDC_SUCCESS) {
     return NULL;
   }
-  return _ipc_vcryptCommunicateWithConnection(con, fmt, args);
+  return _ipc_vcryptCommunicateWithConnection(con, death, fmt, args);
+}
+
+char* ipc_cryptCommunicateUntil(unsigned char remote, time_t death,
+                                const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  char* ret = ipc_vcryptCommunicateUntil(remote, death, fmt, args);
+  va_end(args);
+  return ret;
 }
 
 char* ipc_vcryptCommunicateWithPath(const char* socket_path, const char* fmt,
                                     va_list args) {
-  static struct connection con;
+  struct connection con = {0};
   if (initConnectionWithPath(&con, socket_path) != OIDC_SUCCESS) {
     return NULL;
   }
-  return _ipc_vcryptCommunicateWithConnection(con, fmt, args);
+  return _ipc_vcryptCommunicateWithConnection(con, _defaultDeath(), fmt, args);
 }
 
 char* ipc_cryptCommunicateWithPath(const char* socket_path, const char* fmt,
@@ -77,3 +177,298 @@ char* ipc_cryptCommunicateWithPath(const char* socket_path, const char* fmt,
   va_start(args, fmt);
   return ipc_vcryptCommunicateWithPath(socket_path, fmt, args);
 }
+
+/**
+ * @brief opens a session with the agent
+ * A session keeps the connection and the ipc key, so that multiple requests can
+ * be sent with @c ipc_cryptCommunicateInSession without connecting and doing a
+ * key exchange for each of them.
+ * @return a pointer to the session or @c NULL on failure; has to be closed
+ * with @c ipc_cryptCloseSession
+ */
+struct ipc_session* ipc_cryptOpenSession(unsigned char remote) {
+  logger(DEBUG, "Opening ipc session");
+  struct ipc_session* session = secAlloc(sizeof(struct ipc_session));
+  if (ipc_client_init(&session->con, remote) != OIDC_SUCCESS ||
+      ipc_connect(session->con, 0) < 0) {
+    ipc_cryptCloseSession(session);
+    return NULL;
+  }
+  session->key = client_keyExchange(*(session->con.sock), 0);
+  if (session->key == NULL) {
+    ipc_cryptCloseSession(session);
+    return NULL;
+  }
+  char* res = ipc_cryptCommunicateInSession(session, REQUEST_SESSION);
+  if (res == NULL) {
+    ipc_cryptCloseSession(session);
+    return NULL;
+  }
+  char* status = getJSONValueFromString(res, IPC_KEY_STATUS);
+  secFree(res);
+  if (!strequal(status, STATUS_SUCCESS)) {
+    secFree(status);
+    ipc_cryptCloseSession(session);
+    oidc_errno = OIDC_ESESSION;
+    return NULL;
+  }
+  secFree(status);
+  // An agent that supports sessions also supports framed messages
+  ipc_setFramed(*(session->con.sock), 1);
+  return session;
+}
+
+char* ipc_cryptCommunicateInSession(struct ipc_session* session,
+                                    const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  char* ret = ipc_vcryptCommunicateInSession(session, fmt, args);
+  va_end(args);
+  return ret;
+}
+
+char* ipc_vcryptCommunicateInSession(struct ipc_session* session,
+                                     const char* fmt, va_list args) {
+  if (session == NULL || session->key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  logger(DEBUG, "Doing encrypted ipc communication in session");
+  if (ipc_vcryptWrite(*(session->con.sock), session->key, fmt, args) !=
+      OIDC_SUCCESS) {
+    return NULL;
+  }
+  return ipc_cryptReadInSession(session);
+}
+
+/**
+ * @brief reads the next message from the agent in a session, e.g. an access
+ * token pushed for a subscription
+ * Blocks until a message arrives.
+ * @return the decrypted message or @c NULL on failure; has to be freed after
+ * usage
+ */
+char* ipc_cryptReadInSession(struct ipc_session* session) {
+  if (session == NULL || session->key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t len               = 0;
+  char*  encryptedResponse = ipc_readWithLength(*(session->con.sock), &len);
+  if (encryptedResponse == NULL) {
+    return NULL;
+  }
+  if (!isBinaryIpcMessage(encryptedResponse, len) &&
+      isJSONObject(encryptedResponse)) {
+    // Response not encrypted
+    return encryptedResponse;
+  }
+  return decryptForIpcInPlace(encryptedResponse, len, session->key);
+}
+
+void ipc_cryptCloseSession(struct ipc_session* session) {
+  if (session == NULL) {
+    return;
+  }
+  logger(DEBUG, "Closing ipc session");
+  ipc_closeConnection(&session->con);
+  secFree(session->key);
+  secFree(session);
+}
+
+enum ipc_requestState {
+  IPC_REQUEST_PLAIN_SENT,
+  IPC_REQUEST_KEY_SENT,
+  IPC_REQUEST_SENT,
+  IPC_REQUEST_DONE,
+  IPC_REQUEST_FAILED,
+};
+
+struct ipc_request {
+  struct connection        con;
+  int                      sock;
+  enum ipc_requestState    state;
+  char*                    request;
+  struct pubsec_keySet*    keys;
+  unsigned char*           key;
+  char*                    response;
+  struct oidc_error_state* error;
+};
+
+/**
+ * @brief returns if data can be read from @p fd, waiting at most @p timeout
+ * milliseconds; @c -1 waits until data arrives
+ */
+static int _isReadable(int fd, int timeout) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout) > 0;
+}
+
+static void _failRequest(struct ipc_request* request) {
+  secFreeErrorState(request->error);
+  request->error = saveErrorState();
+  request->state = IPC_REQUEST_FAILED;
+}
+
+static void _sendEncryptedRequest(struct ipc_request* request) {
+  if (ipc_cryptWriteMessage(request->sock, request->key, request->request) !=
+      OIDC_SUCCESS) {
+    _failRequest(request);
+    return;
+  }
+  request->state = IPC_REQUEST_SENT;
+}
+
+static void _startKeyExchange(struct ipc_request* request) {
+  request->keys = client_keyExchangeStart(request->sock);
+  if (request->keys == NULL) {
+    _failRequest(request);
+    return;
+  }
+  request->state = IPC_REQUEST_KEY_SENT;
+}
+
+/**
+ * @brief starts a request to the agent that can be completed without blocking
+ * The connection is made and the request is sent; all further steps are done
+ * by @c ipc_cryptAdvanceRequest when the socket of the request is readable.
+ * The local agent first gets the request unencrypted, the key exchange is only
+ * done if it requires encryption.
+ * @param death the time at which connecting fails; @c 0 to wait as long as
+ * it takes
+ * @return a pointer to the request or @c NULL if the agent could not be
+ * reached; has to be freed with @c ipc_cryptFinishRequest
+ */
+struct ipc_request* ipc_cryptStartRequest(unsigned char remote,
+                                          const char* request, time_t death) {
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct ipc_request* r = secAlloc(sizeof(struct ipc_request));
+  if (ipc_client_init(&r->con, remote) != OIDC_SUCCESS ||
+      (r->sock = ipc_connect(r->con, death)) < 0) {
+    ipc_closeConnection(&r->con);
+    secFree(r);
+    return NULL;
+  }
+  r->request = oidc_strcopy(request);
+  if (r->con.server->sun_path[0] == '\0') {
+    _startKeyExchange(r);
+  } else if (ipc_writeMessage(r->sock, request, strlen(request)) !=
+             OIDC_SUCCESS) {
+    _failRequest(r);
+  } else {
+    r->state = IPC_REQUEST_PLAIN_SENT;
+  }
+  return r;
+}
+
+/**
+ * @brief returns the socket of a request, that becomes readable when the
+ * request can be advanced with @c ipc_cryptAdvanceRequest
+ */
+int ipc_requestFd(const struct ipc_request* request) {
+  return request ? request->sock : -1;
+}
+
+/**
+ * @brief does the next step of a request if its socket is readable
+ * Never blocks; the steps only read what has arrived and write small
+ * messages.
+ * @return @c 1 if the request is done, i.e. it got its response or failed;
+ * @c 0 if it still waits for the agent
+ */
+int ipc_cryptAdvanceRequest(struct ipc_request* request) {
+  if (request == NULL || request->state == IPC_REQUEST_DONE ||
+      request->state == IPC_REQUEST_FAILED) {
+    return 1;
+  }
+  if (!_isReadable(request->sock, 0)) {
+    return 0;
+  }
+  size_t len = 0;
+  char*  res = ipc_readWithLength(request->sock, &len);
+  if (res == NULL) {
+    _failRequest(request);
+    return 1;
+  }
+  switch (request->state) {
+    case IPC_REQUEST_PLAIN_SENT: {
+      char* status = getJSONValueFromString(res, IPC_KEY_STATUS);
+      if (strequal(status, STATUS_ENCRYPTIONREQUIRED)) {
+        logger(DEBUG, "Agent requires encryption");
+        secFree(res);
+        _startKeyExchange(request);
+      } else {
+        request->response = res;
+        request->state    = IPC_REQUEST_DONE;
+      }
+      secFree(status);
+      break;
+    }
+    case IPC_REQUEST_KEY_SENT:
+      request->key  = client_keyExchangeFinish(request->sock, request->keys, res);
+      request->keys = NULL;
+      if (request->key == NULL) {
+        _failRequest(request);
+      } else {
+        _sendEncryptedRequest(request);
+      }
+      break;
+    default:
+      if (!isBinaryIpcMessage(res, len) && isJSONObject(res)) {
+        // Response not encrypted
+        request->response = res;
+      } else {
+        request->response = decryptForIpcInPlace(res, len, request->key);
+      }
+      if (request->response == NULL) {
+        _failRequest(request);
+      } else {
+        request->state = IPC_REQUEST_DONE;
+      }
+  }
+  return request->state == IPC_REQUEST_DONE ||
+         request->state == IPC_REQUEST_FAILED;
+}
+
+/**
+ * @brief waits until a request is done, returns its response and frees the
+ * request
+ * @return the response or @c NULL if the request failed; then @c oidc_errno
+ * is set
+ */
+char* ipc_cryptFinishRequest(struct ipc_request* request) {
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  while (!ipc_cryptAdvanceRequest(request)) {
+    _isReadable(request->sock, -1);
+  }
+  char* response     = request->response;
+  request->response  = NULL;
+  if (response == NULL) {
+    restoreErrorState(request->error);
+  }
+  ipc_cryptCancelRequest(request);
+  return response;
+}
+
+/**
+ * @brief closes the connection of a request and frees it without waiting for
+ * the response
+ */
+void ipc_cryptCancelRequest(struct ipc_request* request) {
+  if (request == NULL) {
+    return;
+  }
+  ipc_closeConnection(&request->con);
+  secFreePubSecKeySet(request->keys);
+  secFree(request->key);
+  secFree(request->request);
+  secFree(request->response);
+  secFreeErrorState(request->error);
+  secFree(request);
+}
@@ -1,11 +1,46 @@
 #ifndef CRYPT_COMMUNICATOR_H
 #define CRYPT_COMMUNICATOR_H
 
+#include "connection.h"
+
 #include <stdarg.h>
+#include <time.h>
+
+/**
+ * A connection to the agent that stays open for multiple requests. The key
+ * exchange is only done once when the session is opened.
+ */
+struct ipc_session {
+  struct connection con;
+  unsigned char*    key;
+};
 
 char* ipc_cryptCommunicate(unsigned char, const char*, ...);
 char* ipc_vcryptCommunicate(unsigned char, const char*, va_list);
 char* ipc_vcryptCommunicateWithPath(const char*, const char*, va_list);
 char* ipc_cryptCommunicateWithPath(const char*, const char*, ...);
+char* ipc_cryptCommunicateUntil(unsigned char, time_t, const char*, ...);
+char* ipc_vcryptCommunicateUntil(unsigned char, time_t, const char*, va_list);
+void  ipc_setResponseTimeout(time_t seconds);
+
+struct ipc_session* ipc_cryptOpenSession(unsigned char remote);
+char* ipc_cryptCommunicateInSession(struct ipc_session*, const char*, ...);
+char* ipc_vcryptCommunicateInSession(struct ipc_session*, const char*,
+                                     va_list);
+char* ipc_cryptReadInSession(struct ipc_session*);
+void  ipc_cryptCloseSession(struct ipc_session*);
+
+/**
+ * A request to the agent that is done step by step whenever its socket is
+ * readable, so that many requests can wait for the agent on one thread.
+ */
+struct ipc_request;
+
+struct ipc_request* ipc_cryptStartRequest(unsigned char remote,
+                                          const char* request, time_t death);
+int                 ipc_requestFd(const struct ipc_request*);
+int                 ipc_cryptAdvanceRequest(struct ipc_request*);
+char*               ipc_cryptFinishRequest(struct ipc_request*);
+void                ipc_cryptCancelRequest(struct ipc_request*);
 
 #endif  // CRYPT_COMMUNICATOR_H
@@ -3,10 +3,12 @@
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/ipcCryptUtils.h"
 #include "utils/json.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/memzero.h"
 #include "utils/oidc_error.h"
+#include "utils/probes.h"
 #include "utils/stringUtils.h"
 
 #include <sodium.h>
@@ -35,14 +37,41 @@ oidc_error_t ipc_vcryptWrite(const int sock, const unsigned char* key,
   if (msg == NULL) {
     return oidc_errno;
   }
+  oidc_error_t e = ipc_cryptWriteMessage(sock, key, msg);
+  secFree(msg);
+  return e;
+}
+
+/**
+ * @brief encrypts an already formatted message and writes it to a socket
+ * Unlike @c ipc_cryptWrite the message is not formatted, so it is not copied
+ * before it is encrypted.
+ */
+oidc_error_t ipc_cryptWriteMessage(const int sock, const unsigned char* key,
+                                   const char* msg) {
+  if (msg == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
   logger(DEBUG, "Doing encrypted ipc write of %lu bytes: '%s'", strlen(msg),
          msg);
+  if (ipc_isBinary(sock)) {
+    size_t len              = 0;
+    char*  encryptedMessage =
+        encryptForIpcBinary(msg, key, ipc_getAead(sock), &len);
+    if (encryptedMessage == NULL) {
+      return oidc_errno;
+    }
+    oidc_error_t e = ipc_writeFrame(sock, encryptedMessage, len);
+    secFree(encryptedMessage);
+    return e;
+  }
   char* encryptedMessage = encryptForIpc(msg, key);
-  secFree(msg);
   if (encryptedMessage == NULL) {
     return oidc_errno;
   }
-  oidc_error_t e = ipc_write(sock, encryptedMessage);
+  oidc_error_t e =
+      ipc_writeMessage(sock, encryptedMessage, strlen(encryptedMessage));
   secFree(encryptedMessage);
   return e;
 }
@@ -56,16 +85,90 @@ struct pubsec_keySet* generatePubSecKeys() {
   return keys;
 }
 
-char* communicatePublicKey(const int _sock, const char* publicKey) {
+/**
+ * Appended to the public key during the key exchange by parties that support
+ * the binary format for encrypted messages. Older versions only decode the
+ * base64 key and ignore it.
+ */
+#define IPC_BINARY_CAPABILITY ":bin1"
+/**
+ * Appended instead by parties that also support other ciphers than secretbox
+ * for the binary format, followed by the ids of the offered ciphers in the
+ * order of preference; the server answers with the id of the chosen one.
+ * Older versions do not know it and use the base64 format.
+ */
+#define IPC_AEAD_CAPABILITY ":bin2:"
+
+static unsigned char clientBinary = 1;
+
+/**
+ * @brief sets if the client offers the binary format during the key exchange
+ * Clients offer it by default; disabling it is only useful to compare both
+ * formats.
+ */
+void client_ipc_setBinary(unsigned char binary) { clientBinary = binary; }
+
+/**
+ * @brief returns the ciphers offered for the binary format with a public key
+ * @return the ids of the ciphers as digits, @c "0" for parties that only
+ * support secretbox, or @c NULL if the binary format is not supported
+ */
+static const char* _binaryCiphers(const char* pk_base64) {
+  const char* sep = pk_base64 ? strchr(pk_base64, ':') : NULL;
+  if (sep == NULL) {
+    return NULL;
+  }
+  if (strequal(sep, IPC_BINARY_CAPABILITY)) {
+    return "0";
+  }
+  const char* ciphers = sep + strlen(IPC_AEAD_CAPABILITY);
+  return strstarts(sep, IPC_AEAD_CAPABILITY) && *ciphers ? ciphers : NULL;
+}
+
+/**
+ * @brief chooses the cipher for the binary format from the offered ones
+ * @param ciphers the offered ciphers as returned by @c _binaryCiphers
+ */
+static int _chooseAead(const char* ciphers) {
+  const int preferred[] = {crypt_defaultAead(), CRYPT_AEAD_XCHACHA20POLY1305};
+  for (size_t i = 0; i < sizeof(preferred) / sizeof(*preferred); i++) {
+    if (strchr(ciphers, '0' + preferred[i])) {
+      return preferred[i];
+    }
+  }
+  return CRYPT_AEAD_SECRETBOX;
+}
+
+static oidc_error_t _sendPublicKey(const int _sock, const char* publicKey,
+                                   const char* ciphers) {
   if (publicKey == NULL) {
     oidc_setArgNullFuncError(__func__);
-    return NULL;
+    return oidc_errno;
   }
   char* pk_base64 = toBase64(publicKey, crypto_kx_PUBLICKEYBYTES);
   logger(DEBUG, "Communicating pub key");
-  char* res = ipc_communicateWithSock(_sock, pk_base64);
+  oidc_error_t e;
+  if (ciphers == NULL) {
+    e = ipc_write(_sock, "%s", pk_base64);
+  } else if (strequal(ciphers, "0")) {
+    e = ipc_write(_sock, "%s%s", pk_base64, IPC_BINARY_CAPABILITY);
+  } else {
+    e = ipc_write(_sock, "%s%s%s", pk_base64, IPC_AEAD_CAPABILITY, ciphers);
+  }
   secFree(pk_base64);
-  return res;
+  return e;
+}
+
+static char* _communicatePublicKey(const int _sock, const char* publicKey,
+                                   const char* ciphers, size_t* res_len) {
+  if (_sendPublicKey(_sock, publicKey, ciphers) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  return ipc_readWithLength(_sock, res_len);
+}
+
+char* communicatePublicKey(const int _sock, const char* publicKey) {
+  return _communicatePublicKey(_sock, publicKey, NULL, NULL);
 }
 
 unsigned char* generateIpcKey(const unsigned char* publicKey,
@@ -83,54 +186,235 @@ unsigned char* generateIpcKey(const unsigned char* publicKey,
   return sharedKey;
 }
 
+/**
+ * the ipc keys of the currently served client connections; there can be
+ * multiple connections waiting for a response at the same time, therefore the
+ * keys are stored together with their socket
+ */
 list_t* encryptionKeys = NULL;
 
+static int _matchKeyEntryBySock(const int* sock,
+                                const struct ipc_keyEntry* entry) {
+  return *sock == entry->sock;
+}
+
+static void _secFreeKeyEntry(struct ipc_keyEntry* entry) {
+  secFree(entry->key);
+  secFree(entry);
+}
+
+static void _storeKeyForSock(int sock, unsigned char* key) {
+  if (encryptionKeys == NULL) {
+    encryptionKeys        = list_new();
+    encryptionKeys->match = (matchFunction)_matchKeyEntryBySock;
+    encryptionKeys->free  = (void (*)(void*))_secFreeKeyEntry;
+  }
+  server_ipc_freeKeyFor(sock);  // in case there is an unused old key
+  struct ipc_keyEntry* entry = secAlloc(sizeof(struct ipc_keyEntry));
+  entry->sock                = sock;
+  entry->key                 = key;
+  list_rpush(encryptionKeys, list_node_new(entry));
+}
+
+static list_node_t* _findKeyNodeForSock(int sock) {
+  if (encryptionKeys == NULL) {
+    return NULL;
+  }
+  return findInList(encryptionKeys, &sock);
+}
+
+static struct ipc_keyEntry* _findKeyEntryForSock(int sock) {
+  list_node_t* node = _findKeyNodeForSock(sock);
+  return node ? node->val : NULL;
+}
+
+/**
+ * @brief removes the ipc key for a client socket from the list of keys
+ * If the socket belongs to a session the key is kept and a copy is returned.
+ * @return the key or @c NULL if there is none for this socket; has to be freed
+ * after usage
+ */
+unsigned char* server_ipc_takeKeyFor(int sock) {
+  list_node_t* node = _findKeyNodeForSock(sock);
+  if (node == NULL) {
+    return NULL;
+  }
+  struct ipc_keyEntry* entry = node->val;
+  if (entry->session) {
+    unsigned char* key = secAlloc(crypto_box_BEFORENMBYTES);
+    memcpy(key, entry->key, crypto_box_BEFORENMBYTES);
+    return key;
+  }
+  unsigned char* key = entry->key;
+  entry->key         = NULL;
+  list_remove(encryptionKeys, node);
+  return key;
+}
+
+/**
+ * @brief frees the ipc key for a client socket; also ends a session on this
+ * socket
+ */
+void server_ipc_freeKeyFor(int sock) {
+  struct ipc_keyEntry* entry = _findKeyEntryForSock(sock);
+  if (entry == NULL) {
+    return;
+  }
+  entry->session     = 0;
+  unsigned char* key = server_ipc_takeKeyFor(sock);
+  secFree(key);
+}
+
+/**
+ * @brief keeps the ipc key of a client socket for further messages
+ * All following messages on this socket are encrypted with this key without
+ * doing another key exchange. The session ends with
+ * @c server_ipc_freeKeyFor.
+ * @return @c OIDC_SUCCESS or @c OIDC_ESESSION if there was no key exchange on
+ * this socket
+ */
+oidc_error_t server_ipc_startSessionFor(int sock) {
+  struct ipc_keyEntry* entry = _findKeyEntryForSock(sock);
+  if (entry == NULL) {
+    oidc_errno = OIDC_ESESSION;
+    return oidc_errno;
+  }
+  entry->session = 1;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the session key of a client socket
+ * @return the key or @c NULL if the socket does not belong to a session; MUST
+ * NOT be freed
+ */
+const unsigned char* server_ipc_getSessionKeyFor(int sock) {
+  struct ipc_keyEntry* entry = _findKeyEntryForSock(sock);
+  return entry && entry->session ? entry->key : NULL;
+}
+
+static keySetSource serverKeySetSource = generatePubSecKeys;
+
+/**
+ * @brief sets where the server takes its key pair for a key exchange from
+ * By default a new key pair is generated for every client; oidcp takes them
+ * from a pool that is filled in the background, see keyPairPool.c. Every key
+ * pair is used for a single key exchange.
+ * @param source returns a new key pair that is freed after the key exchange;
+ * @c NULL to generate them again
+ */
+void server_ipc_setKeySetSource(keySetSource source) {
+  serverKeySetSource = source ? source : generatePubSecKeys;
+}
+
 char* server_ipc_cryptRead(const int sock, const char* client_pk_base64) {
   logger(DEBUG, "Doing encrypted ipc read");
+  OIDC_PROBE1(key_exchange_start, sock);
   unsigned char client_pk[crypto_kx_PUBLICKEYBYTES];
   fromBase64(client_pk_base64, crypto_kx_PUBLICKEYBYTES, client_pk);
-  struct pubsec_keySet* pubsec_keys = generatePubSecKeys();
+  struct pubsec_keySet* pubsec_keys = serverKeySetSource();
   unsigned char*        ipc_key = generateIpcKey(client_pk, pubsec_keys->sk);
   if (ipc_key == NULL) {
     secFree(ipc_key);
+    OIDC_PROBE2(key_exchange_end, sock, 0);
     return NULL;
   }
-  char* encrypted_request = communicatePublicKey(sock, (char*)pubsec_keys->pk);
+  const char* ciphers = _binaryCiphers(client_pk_base64);
+  int         aead = ciphers ? _chooseAead(ciphers) : CRYPT_AEAD_SECRETBOX;
+  char        chosen[]          = {'0' + aead, '\0'};
+  size_t      len               = 0;
+  char*       encrypted_request = _communicatePublicKey(
+      sock, (char*)pubsec_keys->pk, ciphers ? chosen : NULL, &len);
   secFreePubSecKeySet(pubsec_keys);
   if (encrypted_request == NULL) {
     secFree(ipc_key);
+    OIDC_PROBE2(key_exchange_end, sock, 0);
     return NULL;
   }
   logger(DEBUG, "Received encrypted request");
-  char* decryptedRequest = decryptForIpc(encrypted_request, ipc_key);
-  secFree(encrypted_request);
+  char* decryptedRequest =
+      decryptForIpcInPlace(encrypted_request, len, ipc_key);
   logger(DEBUG, "Decrypted request is '%s'", decryptedRequest);
   if (decryptedRequest != NULL) {
-    if (encryptionKeys == NULL) {
-      encryptionKeys = list_new();
-    }
-    list_rpush(encryptionKeys, list_node_new(ipc_key));
+    ipc_setBinary(sock, ciphers != NULL);
+    ipc_setAead(sock, aead);
+    _storeKeyForSock(sock, ipc_key);
   } else {
     secFree(ipc_key);
   }
+  OIDC_PROBE2(key_exchange_end, sock, decryptedRequest != NULL);
   return decryptedRequest;
 }
 
-unsigned char* client_keyExchange(const int sock) {
+/**
+ * @brief does the key exchange on the client side
+ * @param death the time at which waiting for the public key of the server
+ * fails with @c OIDC_ETIMEOUT; @c 0 to wait as long as it takes
+ * @return the ipc key or @c NULL on failure
+ */
+unsigned char* client_keyExchange(const int sock, time_t death) {
+  struct pubsec_keySet* pubsec_keys = client_keyExchangeStart(sock);
+  if (pubsec_keys == NULL) {
+    return NULL;
+  }
+  char* server_pk_base64 = ipc_readWithTimeout(sock, death);
+  return client_keyExchangeFinish(sock, pubsec_keys, server_pk_base64);
+}
+
+/**
+ * @brief starts the key exchange on the client side by sending the public key
+ * Together with @c client_keyExchangeFinish this allows to wait for the
+ * public key of the server without blocking.
+ * @return the key pair of the client or @c NULL on failure; has to be passed
+ * to @c client_keyExchangeFinish
+ */
+struct pubsec_keySet* client_keyExchangeStart(const int sock) {
   struct pubsec_keySet* pubsec_keys = generatePubSecKeys();
-  char* server_pk_base64 = communicatePublicKey(sock, (char*)pubsec_keys->pk);
+  // the preferred cipher of this host and the portable one
+  int  aead      = crypt_defaultAead();
+  char offered[] = {'0' + aead,
+                    aead == CRYPT_AEAD_XCHACHA20POLY1305
+                        ? '\0'
+                        : '0' + CRYPT_AEAD_XCHACHA20POLY1305,
+                    '\0'};
+  if (_sendPublicKey(sock, (char*)pubsec_keys->pk,
+                     clientBinary ? offered : NULL) != OIDC_SUCCESS) {
+    secFreePubSecKeySet(pubsec_keys);
+    return NULL;
+  }
+  return pubsec_keys;
+}
+
+/**
+ * @brief finishes the key exchange on the client side with the public key
+ * received from the server
+ * @param pubsec_keys the key pair returned by @c client_keyExchangeStart; it
+ * is freed
+ * @param server_pk_base64 the received message; it is freed
+ * @return the ipc key or @c NULL on failure
+ */
+unsigned char* client_keyExchangeFinish(const int             sock,
+                                        struct pubsec_keySet* pubsec_keys,
+                                        char*                 server_pk_base64) {
   if (server_pk_base64 == NULL) {
     secFreePubSecKeySet(pubsec_keys);
     return NULL;
   }
   logger(DEBUG, "Received server public key");
+  const char* ciphers = _binaryCiphers(server_pk_base64);
+  int         aead    = ciphers ? ciphers[0] - '0' : CRYPT_AEAD_SECRETBOX;
+  if (ciphers && (strlen(ciphers) != 1 || !crypt_isAeadAvailable(aead))) {
+    secFree(server_pk_base64);
+    secFreePubSecKeySet(pubsec_keys);
+    oidc_errno = OIDC_ENOAEAD;
+    return NULL;
+  }
+  ipc_setBinary(sock, ciphers != NULL);
+  ipc_setAead(sock, aead);
   unsigned char server_pk[crypto_kx_PUBLICKEYBYTES];
   fromBase64(server_pk_base64, crypto_kx_PUBLICKEYBYTES, server_pk);
   secFree(server_pk_base64);
   unsigned char* ipc_key = generateIpcKey(server_pk, pubsec_keys->sk);
   secFreePubSecKeySet(pubsec_keys);
-  if (ipc_key == NULL) {
-    return NULL;
-  }
   return ipc_key;
 }
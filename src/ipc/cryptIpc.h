@@ -5,12 +5,21 @@
 
 #include <sodium.h>
 #include <stdarg.h>
+#include <time.h>
+
+struct ipc_keyEntry {
+  int            sock;
+  unsigned char* key;
+  unsigned char  session;
+};
 
 struct pubsec_keySet {
   unsigned char pk[crypto_kx_PUBLICKEYBYTES];
   unsigned char sk[crypto_kx_SECRETKEYBYTES];
 };
 
+typedef struct pubsec_keySet* (*keySetSource)();
+
 char*          communicatePublicKey(const int _sock, const char* publicKey);
 unsigned char* generateIpcKey(const unsigned char* publicKey,
                               const unsigned char* privateKey);
@@ -18,8 +27,20 @@ struct pubsec_keySet* generatePubSecKeys();
 oidc_error_t ipc_cryptWrite(const int, const unsigned char*, const char*, ...);
 oidc_error_t ipc_vcryptWrite(const int, const unsigned char*, const char*,
                              va_list);
+oidc_error_t ipc_cryptWriteMessage(const int, const unsigned char*,
+                                   const char*);
 void         secFreePubSecKeySet(struct pubsec_keySet*);
 char*        server_ipc_cryptRead(const int, const char*);
-unsigned char* client_keyExchange(const int sock);
+void         server_ipc_setKeySetSource(keySetSource source);
+unsigned char* client_keyExchange(const int sock, time_t death);
+void           client_ipc_setBinary(unsigned char binary);
+struct pubsec_keySet* client_keyExchangeStart(const int sock);
+unsigned char*        client_keyExchangeFinish(const int sock,
+                                               struct pubsec_keySet*,
+                                               char* server_pk_base64);
+unsigned char* server_ipc_takeKeyFor(int sock);
+void           server_ipc_freeKeyFor(int sock);
+oidc_error_t   server_ipc_startSessionFor(int sock);
+const unsigned char* server_ipc_getSessionKeyFor(int sock);
 
 #endif  // IPC_CRYPT_H
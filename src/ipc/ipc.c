@@ -9,6 +9,10 @@
 #include "utils/stringUtils.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,9 +20,116 @@
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+/**
+ * In framed mode every message starts with a fixed size header containing the
+ * length of the message, so that messages can be read completely even if they
+ * arrive in pieces, and multiple messages can be sent on the same socket. The
+ * marker byte cannot be the first byte of an unframed message (json, base64,
+ * or encrypted message), so both modes can be distinguished by the reader.
+ * A header with a length of @c 0 is a keepalive and is skipped by the reader.
+ */
+#define IPC_FRAME_MARKER '\x02'
+#define IPC_FRAME_HEADER_FMT "\x02%020lu:"
+#define IPC_FRAME_HEADER_LEN 22
+
+/**
+ * The state of each socket is kept in one byte: whether framed messages are
+ * written on it, whether encrypted messages are sent in the binary format and
+ * the cipher of these messages. The bytes are kept in chunks that are
+ * allocated when a socket of their range is used first, because sockets are
+ * not limited to @c FD_SETSIZE; the reactor accepts as many connections as
+ * @c RLIMIT_NOFILE allows. The state is changed atomically, because threads
+ * of an application using the library might change the state of different
+ * sockets at the same time.
+ */
+#define SOCK_STATE_CHUNK 1024
+#define SOCK_STATE_CHUNKS 1024  // sockets up to the default of fs.nr_open
+#define SOCK_STATE_FRAMED 0x01
+#define SOCK_STATE_BINARY 0x02
+#define SOCK_STATE_AEAD_SHIFT 2
+#define SOCK_STATE_AEAD_MASK ((unsigned char)~0x03)
+
+static unsigned char* sockStates[SOCK_STATE_CHUNKS];
+
+/**
+ * @brief returns the state byte of @p sock
+ * @param create if not set, @c NULL is returned if the chunk of @p sock was
+ * not allocated yet
+ */
+static unsigned char* _sockState(int sock, int create) {
+  if (sock < 0 || sock >= SOCK_STATE_CHUNK * SOCK_STATE_CHUNKS) {
+    return NULL;
+  }
+  unsigned char** slot  = &sockStates[sock / SOCK_STATE_CHUNK];
+  unsigned char*  chunk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (chunk == NULL && create) {
+    unsigned char* fresh = secAlloc(SOCK_STATE_CHUNK);
+    if (fresh == NULL) {
+      return NULL;
+    }
+    if (__atomic_compare_exchange_n(slot, &chunk, fresh, 0, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+      chunk = fresh;
+    } else {  // another thread was faster; chunk is its chunk now
+      secFree(fresh);
+    }
+  }
+  return chunk ? chunk + sock % SOCK_STATE_CHUNK : NULL;
+}
+
+static void _setSockState(int sock, unsigned char mask, unsigned char bits) {
+  unsigned char* state = _sockState(sock, bits != 0);
+  if (state == NULL) {  // nothing to clear
+    return;
+  }
+  unsigned char old = __atomic_load_n(state, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(state, &old, (old & ~mask) | bits, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static unsigned char _getSockState(int sock, unsigned char mask) {
+  const unsigned char* state = _sockState(sock, 0);
+  return state ? __atomic_load_n(state, __ATOMIC_RELAXED) & mask : 0;
+}
+
+/**
+ * framed messages are written on a socket once a framed message was read from
+ * it, so that the response is also framed
+ */
+void ipc_setFramed(int sock, int framed) {
+  _setSockState(sock, SOCK_STATE_FRAMED, framed ? SOCK_STATE_FRAMED : 0);
+}
+
+int ipc_isFramed(int sock) {
+  return _getSockState(sock, SOCK_STATE_FRAMED) != 0;
+}
+
+/**
+ * the binary format and the cipher of encrypted messages are set for each
+ * connection during the key exchange
+ */
+void ipc_setBinary(int sock, int binary) {
+  _setSockState(sock, SOCK_STATE_BINARY, binary ? SOCK_STATE_BINARY : 0);
+}
+
+int ipc_isBinary(int sock) {
+  return _getSockState(sock, SOCK_STATE_BINARY) != 0;
+}
+
+void ipc_setAead(int sock, int aead) {
+  _setSockState(sock, SOCK_STATE_AEAD_MASK,
+                (unsigned char)(aead << SOCK_STATE_AEAD_SHIFT) &
+                    SOCK_STATE_AEAD_MASK);
+}
+
+int ipc_getAead(int sock) {
+  return _getSockState(sock, SOCK_STATE_AEAD_MASK) >> SOCK_STATE_AEAD_SHIFT;
+}
+
 oidc_error_t initConnectionWithoutPath(struct connection* con, int isServer,
                                        int tcp) {
   con->server     = secAlloc(sizeof(struct sockaddr_un));
@@ -59,6 +170,40 @@ oidc_error_t initConnectionWithPath(struct connection* con,
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief resolves the address of a remote agent
+ * @param path the address in the form @c host, @c host:port, @c [ipv6] or
+ * @c [ipv6]:port
+ */
+static oidc_error_t _initRemoteAddresses(struct connection* con,
+                                         const char*        path) {
+  char* host     = oidc_strcopy(path);
+  char* port_str = NULL;
+  if (host[0] == '[' && strchr(host, ']')) {
+    char* end = strchr(host, ']');
+    *end      = '\0';
+    memmove(host, host + 1, strlen(host));
+    port_str = end[1] == ':' ? end + 2 : NULL;
+  } else {
+    port_str = strchr(host, ':');
+    if (port_str) {
+      *port_str = '\0';
+      port_str++;
+    }
+  }
+  unsigned short port = port_str == NULL ? 0 : strToUShort(port_str);
+  con->tcp_addrs = secAlloc(sizeof(struct resolved_address) *
+                            RESOLVER_MAX_ADDRESSES);
+  con->tcp_addrs_count =
+      resolveHost(host, port ?: 42424, con->tcp_addrs, RESOLVER_MAX_ADDRESSES);
+  secFree(host);
+  if (con->tcp_addrs_count == 0) {
+    oidc_errno = OIDC_ECONSOCK;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
 /**
  * @brief initializes a client unix domain or tcp socket
  * @param con, a pointer to the connection struct. The relevant fields will be
@@ -88,14 +233,7 @@ oidc_error_t ipc_client_init(struct connection* con, unsigned char remote) {
 
   if (remote) {
     logger(DEBUG, "Using TCP socket");
-    char*          tmp_path   = oidc_strcopy(path);
-    char*          ip         = strtok(tmp_path, ":");
-    char*          port_str   = strtok(NULL, ":");
-    unsigned short port       = port_str == NULL ? 0 : strToUShort(port_str);
-    con->tcp_server->sin_port = htons(port ?: 42424);
-    con->tcp_server->sin_addr.s_addr =
-        inet_addr(isValidIP(ip) ? ip : hostnameToIP(ip));
-    secFree(tmp_path);
+    return _initRemoteAddresses(con, path);
   } else {
     logger(DEBUG, "Using UNIX domain socket");
     strcpy(con->server->sun_path, path);
@@ -103,12 +241,93 @@ oidc_error_t ipc_client_init(struct connection* con, unsigned char remote) {
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief connects @p sock, but gives up at @p death
+ * The connect is done non-blocking and waited for with @c poll; if the backlog
+ * of a UNIX socket is full, it is retried until @p death.
+ * @param death the time at which the connect fails; @c 0 to wait as long as
+ * it takes
+ * @return @c 0 on success; @c -1 on failure and errno is set
+ */
+static int _connectUntil(int sock, const struct sockaddr* addr, socklen_t len,
+                         time_t death) {
+  if (death == 0) {
+    return connect(sock, addr, len);
+  }
+  const int flags = fcntl(sock, F_GETFL);
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+  int rc = connect(sock, addr, len);
+  while (rc < 0 &&
+         (errno == EINPROGRESS || errno == EINTR || errno == EAGAIN)) {
+    const time_t now = time(NULL);
+    if (now >= death) {
+      errno = ETIMEDOUT;
+      break;
+    }
+    if (errno == EAGAIN) {  // the backlog is full
+      poll(NULL, 0, 10);
+      rc = connect(sock, addr, len);
+      continue;
+    }
+    struct pollfd pfd = {sock, POLLOUT, 0};
+    if (poll(&pfd, 1, (death - now) * 1000) <= 0) {
+      errno = ETIMEDOUT;
+      break;
+    }
+    int       err    = 0;
+    socklen_t errlen = sizeof(err);
+    getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errlen);
+    rc    = err ? -1 : 0;
+    errno = err;
+  }
+  fcntl(sock, F_SETFL, flags);
+  return rc;
+}
+
+static void _setConnectError() {
+  oidc_errno = errno == ETIMEDOUT ? OIDC_ETIMEOUT : OIDC_ECONSOCK;
+}
+
+/**
+ * @brief connects to the first reachable of the resolved remote addresses
+ * The socket is recreated if the address family changes.
+ */
+static int _connectTcp(struct connection con, time_t death) {
+  for (size_t i = 0; i < con.tcp_addrs_count; i++) {
+    const struct resolved_address* a = &con.tcp_addrs[i];
+    if (i > 0 || a->addr.ss_family != AF_INET) {
+      close(*(con.sock));
+      *(con.sock) = socket(a->addr.ss_family, SOCK_STREAM, 0);
+      if (*(con.sock) < 0) {
+        continue;
+      }
+    }
+    if (_connectUntil(*(con.sock), (const struct sockaddr*)&a->addr, a->len,
+                      death) == 0) {
+      return *(con.sock);
+    }
+    logger(DEBUG, "connecting tcp ipc to address %lu failed: %m", i);
+    if (errno == ETIMEDOUT) {
+      break;
+    }
+  }
+  close(*(con.sock));
+  logger(ERROR, "connecting stream socket: %m");
+  _setConnectError();
+  return oidc_errno;
+}
+
 /**
  * @brief connects to a UNIX Domain or TCP socket
  * @param con, the connection struct
- * @return the socket or @c OIDC_ECONSOCK on failure
+ * @param death the time at which the connect fails with @c OIDC_ETIMEOUT;
+ * @c 0 to wait as long as it takes
+ * @return the socket or @c OIDC_ECONSOCK or @c OIDC_ETIMEOUT on failure
  */
-int ipc_connect(struct connection con) {
+int ipc_connect(struct connection con, time_t death) {
+  if (con.tcp_addrs_count > 0) {
+    return _connectTcp(con, death);
+  }
   struct sockaddr* server      = (struct sockaddr*)con.server;
   size_t           server_size = sizeof(struct sockaddr_un);
   if (con.server->sun_path[0] == '\0') {
@@ -119,11 +338,11 @@ int ipc_connect(struct connection con) {
   } else {
     logger(DEBUG, "connecting ipc '%s'\n", con.server->sun_path);
   }
-  if (connect(*(con.sock), server, server_size) < 0) {
+  if (_connectUntil(*(con.sock), server, server_size, death) < 0) {
     close(*(con.sock));
     logger(ERROR, "connecting stream socket: %m");
-    oidc_errno = OIDC_ECONSOCK;
-    return OIDC_ECONSOCK;
+    _setConnectError();
+    return oidc_errno;
   }
   return *(con.sock);
 }
@@ -155,38 +374,140 @@ struct timeval* initTimeout(time_t death) {
 }
 
 /**
- * @brief reads from a socket until a timeout is reached
- * @param _sock the socket to read from
- * @param timeout the timeout in seconds, if @c 0 no timeout is used.
- * @return a pointer to the readed content. Has to be freed after usage. If an
- * error occurs or the timeout is reached @c NULL is returned and @c oidc_errno
- * is set.
+ * @brief waits until @p fd is readable
+ * Uses @c poll, so that it also works for descriptors beyond @c FD_SETSIZE.
+ * @param death the point in time when to give up; if @c 0 no timeout is used
+ * @return @c OIDC_SUCCESS or an error code, e.g. @c OIDC_ETIMEOUT
  */
-char* ipc_readWithTimeout(const int _sock, time_t death) {
+oidc_error_t ipc_waitReadable(int fd, time_t death) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (1) {
+    int timeout = -1;
+    if (death != 0) {
+      time_t now = time(NULL);
+      if (death < now) {
+        logger(NOTICE, "death was before now");
+        oidc_errno = OIDC_ETIMEOUT;
+        return oidc_errno;
+      }
+      timeout = death - now > INT_MAX / 1000 ? INT_MAX
+                                             : (int)(death - now) * 1000;
+    }
+    int rv = poll(&pfd, 1, timeout);
+    if (rv > 0) {
+      return OIDC_SUCCESS;
+    }
+    if (rv < 0) {
+      logger(ALERT, "error poll in %s: %m", __func__);
+      oidc_errno = OIDC_ESELECT;
+      return oidc_errno;
+    }
+    if (time(NULL) >= death) {
+      oidc_errno = OIDC_ETIMEOUT;
+      return oidc_errno;
+    }  // the timeout was capped
+  }
+}
+
+static oidc_error_t _readExactly(const int _sock, char* buf, size_t len,
+                                 time_t death) {
+  size_t read_bytes = 0;
+  while (read_bytes < len) {
+    if (ipc_waitReadable(_sock, death) != OIDC_SUCCESS) {
+      return oidc_errno;
+    }
+    ssize_t read_ret = read(_sock, buf + read_bytes, len - read_bytes);
+    if (read_ret < 0) {
+      oidc_setErrnoError();
+      return oidc_errno;
+    }
+    if (read_ret == 0) {
+      logger(DEBUG, "Client disconnected");
+      oidc_errno = OIDC_EIPCDIS;
+      return oidc_errno;
+    }
+    read_bytes += read_ret;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the time until which the rest of a frame has to arrive once
+ * its first byte was received, so that a peer that stops in the middle of a
+ * frame cannot block the reader forever
+ */
+static time_t _frameDeath(time_t death) {
+  time_t frameDeath = time(NULL) + IPC_FRAME_TIMEOUT;
+  return death != 0 && death < frameDeath ? death : frameDeath;
+}
+
+/**
+ * @brief reads a framed message; keepalives are skipped
+ * Frames longer than @c IPC_MAX_FRAME_LEN are rejected with
+ * @c OIDC_EIPCTAG.
+ */
+static char* _readFrame(const int _sock, time_t death, size_t* len_out) {
+  while (1) {
+    char header[IPC_FRAME_HEADER_LEN + 1] = {0};
+    if (ipc_waitReadable(_sock, death) != OIDC_SUCCESS) {
+      return NULL;
+    }
+    time_t frameDeath = _frameDeath(death);
+    if (_readExactly(_sock, header, IPC_FRAME_HEADER_LEN, frameDeath) !=
+        OIDC_SUCCESS) {
+      return NULL;
+    }
+    char*         end = NULL;
+    unsigned long len = strtoul(header + 1, &end, 10);
+    if (header[0] != IPC_FRAME_MARKER || end == NULL || *end != ':') {
+      logger(ERROR, "Received malformed frame header on socket %d", _sock);
+      oidc_errno = OIDC_EIPCTAG;
+      return NULL;
+    }
+    if (len == 0) {
+      logger(DEBUG, "Received keepalive on socket %d", _sock);
+      continue;
+    }
+    if (len > IPC_MAX_FRAME_LEN) {
+      logger(ERROR, "Received frame of %lu bytes on socket %d; limit is %d",
+             len, _sock, IPC_MAX_FRAME_LEN);
+      oidc_errno = OIDC_EIPCTAG;
+      return NULL;
+    }
+    logger(DEBUG, "ipc want to read framed message of %lu bytes", len);
+    char* buf = secAlloc(sizeof(char) * (len + 1));
+    if (buf == NULL) {
+      return NULL;
+    }
+    if (_readExactly(_sock, buf, len, frameDeath) != OIDC_SUCCESS) {
+      secFree(buf);
+      return NULL;
+    }
+    logger(DEBUG, "ipc read framed message");
+    if (len_out) {
+      *len_out = len;
+    }
+    return buf;
+  }
+}
+
+static char* _readWithTimeout(const int _sock, time_t death, size_t* len_out) {
   logger(DEBUG, "ipc reading from socket %d\n", _sock);
   if (_sock < 0) {
     logger(ERROR, "invalid socket in ipc_read");
     oidc_errno = OIDC_ESOCKINV;
     return NULL;
   }
-  int    len = 0;
-  int    rv;
-  fd_set set;
-  FD_ZERO(&set);
-  FD_SET(_sock, &set);
-  struct timeval* timeout = initTimeout(death);
-  if (oidc_errno != OIDC_SUCCESS) {  // death before now
+  int len = 0;
+  if (ipc_waitReadable(_sock, death) != OIDC_SUCCESS) {
     return NULL;
   }
-  rv = select(_sock + 1, &set, NULL, NULL, timeout);
-  if (rv == -1) {
-    logger(ALERT, "error select in %s: %m", __func__);
-    oidc_errno = OIDC_ESELECT;
-    return NULL;
-  }
-  if (rv == 0) {
-    oidc_errno = OIDC_ETIMEOUT;
-    return NULL;
+  char first;
+  if (recv(_sock, &first, 1, MSG_PEEK) == 1) {  // fails for pipes
+    ipc_setFramed(_sock, first == IPC_FRAME_MARKER);
+    if (first == IPC_FRAME_MARKER) {
+      return _readFrame(_sock, death, len_out);
+    }
   }
   if (ioctl(_sock, FIONREAD, &len) != 0) {
     logger(ERROR, "ioctl: %m");
@@ -212,9 +533,39 @@ char* ipc_readWithTimeout(const int _sock, time_t death) {
     logger(DEBUG, "ipc did read %d bytes in total", read_bytes);
   }
   logger(DEBUG, "ipc read '%s'", buf);
+  if (len_out) {
+    *len_out = read_bytes;
+  }
   return buf;
 }
 
+char* ipc_readWithTimeout(const int _sock, time_t death) {
+  return _readWithTimeout(_sock, death, NULL);
+}
+
+/**
+ * @brief reads a message from a socket and also returns its length
+ * Unlike the plain read functions this can be used for binary messages, that
+ * might contain @c 0 bytes.
+ * @param len is set to the number of bytes read
+ * @return a pointer to the message; @c 0 terminated, but the length must be
+ * taken from @p len. Has to be freed after usage.
+ */
+char* ipc_readWithLength(const int _sock, size_t* len) {
+  return _readWithTimeout(_sock, 0, len);
+}
+
+/**
+ * @brief reads a message like @c ipc_readWithLength, but gives up at @p death
+ * @param death the point in time when to give up; if @c 0 no timeout is used
+ * @return a pointer to the message or @c NULL if an error occurred or the
+ * timeout was reached
+ */
+char* ipc_readWithLengthAndTimeout(const int _sock, time_t death,
+                                   size_t* len) {
+  return _readWithTimeout(_sock, death, len);
+}
+
 /**
  * @brief writes a message to a socket
  * @param _sock the socket to write to
@@ -229,28 +580,128 @@ oidc_error_t ipc_write(int _sock, const char* fmt, ...) {
   return ret;
 }
 
+/**
+ * @brief writes all @p count buffers of @p iov with as few writes as possible
+ * @p iov is modified if a write is only done partially
+ */
+static oidc_error_t _writevAll(int _sock, struct iovec* iov, int count) {
+  while (count > 0) {
+    ssize_t ret = writev(_sock, iov, count);
+    if (ret < 0) {
+      logger(ALERT, "writing on stream socket: %m");
+      oidc_errno = OIDC_EWRITE;
+      return oidc_errno;
+    }
+    while (count > 0 && (size_t)ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief writes the parts of a message as a single frame
+ * The header is written together with the parts, so the message is not copied.
+ */
+static oidc_error_t _writeFrameParts(int _sock, const struct iovec* parts,
+                                     int count, size_t len) {
+  char header[IPC_FRAME_HEADER_LEN + 1];
+  snprintf(header, sizeof(header), IPC_FRAME_HEADER_FMT, len);
+  struct iovec iov[IPC_MAX_PARTS + 1];
+  iov[0] = (struct iovec){header, IPC_FRAME_HEADER_LEN};
+  memcpy(iov + 1, parts, count * sizeof(struct iovec));
+  logger(DEBUG, "ipc writing framed message of %lu bytes to socket %d", len,
+         _sock);
+  return _writevAll(_sock, iov, count + 1);
+}
+
+static oidc_error_t _writeFrame(int _sock, const char* msg, size_t len) {
+  struct iovec part = {(void*)msg, len};
+  return _writeFrameParts(_sock, &part, 1, len);
+}
+
+/**
+ * @brief writes a keepalive to a socket in framed mode
+ * The keepalive is skipped by the reader, it can be used to check that the
+ * other party is still connected while it is waiting for a response.
+ */
+oidc_error_t ipc_writeKeepalive(int _sock) {
+  return _writeFrame(_sock, "", 0);
+}
+
+/**
+ * @brief writes a binary message to a socket as a frame
+ * @param msg the message; might contain @c 0 bytes
+ * @param len the length of @p msg
+ */
+oidc_error_t ipc_writeFrame(int _sock, const char* msg, size_t len) {
+  if (msg == NULL || len == 0) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  return _writeFrame(_sock, msg, len);
+}
+
 oidc_error_t ipc_vwrite(int _sock, const char* fmt, va_list args) {
   char* msg = oidc_vsprintf(fmt, args);
   if (msg == NULL) {
     return oidc_errno;
   }
-  size_t msg_len = strlen(msg);
-  if (msg_len == 0) {  // Don't send an empty message. This will be read as
-                       // client disconnected
-    msg_len = 1;
-    secFree(msg);
-    msg = oidc_strcopy(" ");
-  }
-  logger(DEBUG, "ipc writing %lu bytes to socket %d", msg_len, _sock);
   logger(DEBUG, "ipc write message '%s'", msg);
-  ssize_t written_bytes = write(_sock, msg, msg_len);
+  oidc_error_t ret = ipc_writeMessage(_sock, msg, strlen(msg));
   secFree(msg);
+  return ret;
+}
+
+/**
+ * @brief writes an already formatted message to a socket
+ * Unlike @c ipc_write the message is not copied.
+ * @param msg the message
+ * @param len the length of @p msg
+ */
+oidc_error_t ipc_writeMessage(int _sock, const char* msg, size_t len) {
+  struct iovec part = {(void*)msg, len};
+  return ipc_writeParts(_sock, &part, 1);
+}
+
+/**
+ * @brief writes a message given in multiple parts to a socket
+ * The parts are written with a single @c writev and are not copied into one
+ * buffer, so a response can be put together from constant fragments and the
+ * values that belong in between.
+ * @param parts the parts of the message; at most @c IPC_MAX_PARTS
+ * @param count the number of @p parts
+ */
+oidc_error_t ipc_writeParts(int _sock, const struct iovec* parts, int count) {
+  if (parts == NULL || count < 1 || count > IPC_MAX_PARTS) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  size_t len = 0;
+  for (int i = 0; i < count; i++) { len += parts[i].iov_len; }
+  if (ipc_isFramed(_sock)) {
+    return _writeFrameParts(_sock, parts, count, len);
+  }
+  if (len == 0) {  // Don't send an empty message. This will be read as
+                   // client disconnected
+    parts = &(struct iovec){" ", 1};
+    count = 1;
+    len   = 1;
+  }
+  logger(DEBUG, "ipc writing %lu bytes to socket %d", len, _sock);
+  ssize_t written_bytes = writev(_sock, parts, count);
   if (written_bytes < 0) {
     logger(ALERT, "writing on stream socket: %m");
     oidc_errno = OIDC_EWRITE;
     return oidc_errno;
   }
-  if ((size_t)written_bytes < msg_len) {
+  if ((size_t)written_bytes < len) {
     oidc_errno = OIDC_EMSGSIZE;
     return oidc_errno;
   }
@@ -265,7 +716,12 @@ oidc_error_t ipc_writeOidcErrno(int sock) {
  * @brief closes a FD
  * @param _sock the FD to be closed
  */
-int ipc_close(int _sock) { return close(_sock); }
+int ipc_close(int _sock) {
+  ipc_setFramed(_sock, 0);
+  ipc_setBinary(_sock, 0);
+  ipc_setAead(_sock, 0);
+  return close(_sock);
+}
 
 /**
  * @brief closes an ipc connection
@@ -284,6 +740,9 @@ oidc_error_t ipc_closeConnection(struct connection* con) {
   con->server = NULL;
   secFree(con->tcp_server);
   con->tcp_server = NULL;
+  secFree(con->tcp_addrs);
+  con->tcp_addrs       = NULL;
+  con->tcp_addrs_count = 0;
   secFree(con->sock);
   con->sock = NULL;
   secFree(con->msgsock);
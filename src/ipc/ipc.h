@@ -5,20 +5,40 @@
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <sys/uio.h>
 #include <time.h>
 
+/**
+ * maximum number of parts of a message written with @c ipc_writeParts
+ */
+#define IPC_MAX_PARTS 16
+
 oidc_error_t initConnectionWithoutPath(struct connection*, int, int);
 oidc_error_t initConnectionWithPath(struct connection*, const char*);
 oidc_error_t ipc_client_init(struct connection*, unsigned char);
 
-int ipc_connect(struct connection con);
+int ipc_connect(struct connection con, time_t death);
 
 char* ipc_read(const int _sock);
 char* ipc_readWithTimeout(const int _sock, time_t timeout);
+char* ipc_readWithLength(const int _sock, size_t* len);
+char* ipc_readWithLengthAndTimeout(const int _sock, time_t death, size_t* len);
 
 oidc_error_t ipc_write(int _sock, const char* msg, ...);
 oidc_error_t ipc_vwrite(int _sock, const char* msg, va_list args);
 oidc_error_t ipc_writeOidcErrno(int sock);
+oidc_error_t ipc_writeKeepalive(int sock);
+oidc_error_t ipc_writeFrame(int _sock, const char* msg, size_t len);
+oidc_error_t ipc_writeMessage(int _sock, const char* msg, size_t len);
+oidc_error_t ipc_writeParts(int _sock, const struct iovec* parts, int count);
+
+void ipc_setFramed(int sock, int framed);
+int  ipc_isFramed(int sock);
+void ipc_setBinary(int sock, int binary);
+int  ipc_isBinary(int sock);
+void ipc_setAead(int sock, int aead);
+int  ipc_getAead(int sock);
 
 int          ipc_close(int _sock);
 oidc_error_t ipc_closeConnection(struct connection* con);
@@ -28,5 +48,6 @@ char* ipc_communicateWithSock(int sock, const char* fmt, ...);
 char* ipc_vcommunicateWithSock(int sock, const char* fmt, va_list args);
 
 struct timeval* initTimeout(time_t death);
+oidc_error_t    ipc_waitReadable(int fd, time_t death);
 
 #endif  // IPC_H
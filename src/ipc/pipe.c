@@ -2,15 +2,28 @@
 #include "pipe.h"
 #include "defines/ipc_values.h"
 #include "ipc/ipc.h"
+#include "ipc/shmRing.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#define TAG_HEADER_FMT "%020lu:%020lu:"  // tag and message length
+#define TAG_HEADER_LEN 42
+
+static taggedMessageHandler foreignTaggedMessageHandler = NULL;
+
 void ipc_closePipes(struct ipcPipe p) {
   close(p.rx);
   close(p.tx);
+  shmRing_unmap(p.rx_ring);
+  shmRing_unmap(p.tx_ring);
 }
 
 struct pipeSet ipc_pipe_init() {
@@ -22,7 +35,7 @@ struct pipeSet ipc_pipe_init() {
   if (pipe2(fd1, O_DIRECT) != 0) {
 #endif
     oidc_setErrnoError();
-    return (struct pipeSet){{-1, -1}, {-1, -1}};
+    return (struct pipeSet){{.rx = -1, .tx = -1}, {.rx = -1, .tx = -1}};
   }
 #ifdef __APPLE__
   if (pipe(fd2) != 0) {
@@ -30,28 +43,49 @@ struct pipeSet ipc_pipe_init() {
   if (pipe2(fd2, O_DIRECT) != 0) {
 #endif
     oidc_setErrnoError();
-    return (struct pipeSet){{-1, -1}, {-1, -1}};
+    return (struct pipeSet){{.rx = -1, .tx = -1}, {.rx = -1, .tx = -1}};
   }
-  struct ipcPipe pipe1 = {fd1[0], fd1[1]};
-  struct ipcPipe pipe2 = {fd2[0], fd2[1]};
+  struct ipcPipe pipe1 = {.rx = fd1[0], .tx = fd1[1]};
+  struct ipcPipe pipe2 = {.rx = fd2[0], .tx = fd2[1]};
   return (struct pipeSet){pipe1, pipe2};
 }
 
+/**
+ * @brief adds a shared memory ring to both pipes of a pipe set, so that the
+ * messages are passed through shared memory instead of the pipes; has to be
+ * called before forking
+ */
+oidc_error_t ipc_pipe_addRings(struct pipeSet* pipes) {
+  struct shmRing* ring1 = shmRing_new();
+  struct shmRing* ring2 = ring1 ? shmRing_new() : NULL;
+  if (ring2 == NULL) {
+    shmRing_unmap(ring1);
+    return oidc_errno;
+  }
+  pipes->pipe1.rx_ring = pipes->pipe1.tx_ring = ring1;
+  pipes->pipe2.rx_ring = pipes->pipe2.tx_ring = ring2;
+  return OIDC_SUCCESS;
+}
+
 struct ipcPipe toServerPipes(struct pipeSet pipes) {
-  struct ipcPipe server;
+  struct ipcPipe server = {.rx = -1, .tx = -1};
   close(pipes.pipe1.tx);
-  server.rx = pipes.pipe1.rx;
+  server.rx      = pipes.pipe1.rx;
+  server.rx_ring = pipes.pipe1.rx_ring;
   close(pipes.pipe2.rx);
-  server.tx = pipes.pipe2.tx;
+  server.tx      = pipes.pipe2.tx;
+  server.tx_ring = pipes.pipe2.tx_ring;
   return server;
 }
 
 struct ipcPipe toClientPipes(struct pipeSet pipes) {
-  struct ipcPipe client;
+  struct ipcPipe client = {.rx = -1, .tx = -1};
   close(pipes.pipe1.rx);
-  client.tx = pipes.pipe1.tx;
+  client.tx      = pipes.pipe1.tx;
+  client.tx_ring = pipes.pipe1.tx_ring;
   close(pipes.pipe2.tx);
-  client.rx = pipes.pipe2.rx;
+  client.rx      = pipes.pipe2.rx;
+  client.rx_ring = pipes.pipe2.rx_ring;
   return client;
 }
 
@@ -65,16 +99,235 @@ oidc_error_t ipc_writeToPipe(struct ipcPipe pipes, const char* fmt, ...) {
 
 oidc_error_t ipc_vwriteToPipe(struct ipcPipe pipes, const char* fmt,
                               va_list args) {
-  return ipc_vwrite(pipes.tx, fmt, args);
+  if (pipes.tag == 0 && pipes.tx_ring == NULL) {
+    return ipc_vwrite(pipes.tx, fmt, args);
+  }
+  char* msg = oidc_vsprintf(fmt, args);
+  if (msg == NULL) {
+    return oidc_errno;
+  }
+  struct iovec part = {msg, strlen(msg)};
+  oidc_error_t ret  = ipc_writePartsToPipe(pipes, &part, 1);
+  secFree(msg);
+  return ret;
+}
+
+/**
+ * @brief writes a message given in multiple parts to a pipe
+ * @see ipc_writeParts
+ */
+oidc_error_t ipc_writePartsToPipe(struct ipcPipe      pipes,
+                                  const struct iovec* parts, int count) {
+  if (pipes.tag == 0) {
+    return pipes.tx_ring ? shmRing_write(pipes.tx_ring, pipes.tx, parts, count)
+                         : ipc_writeParts(pipes.tx, parts, count);
+  }
+  size_t len = 0;
+  for (int i = 0; i < count; i++) { len += parts[i].iov_len; }
+  char header[TAG_HEADER_LEN + 1];
+  snprintf(header, sizeof(header), TAG_HEADER_FMT, pipes.tag, len);
+  if (pipes.tx_ring) {  // header and message are one message in the ring
+    if (count < 1 || count > IPC_MAX_PARTS) {
+      oidc_setArgNullFuncError(__func__);
+      return oidc_errno;
+    }
+    struct iovec iov[IPC_MAX_PARTS + 1] = {{header, TAG_HEADER_LEN}};
+    memcpy(iov + 1, parts, sizeof(struct iovec) * count);
+    return shmRing_write(pipes.tx_ring, pipes.tx, iov, count + 1);
+  }
+  // The header is written separately with a fixed size, so it can be read
+  // exactly, even if the pipe is in packet mode
+  oidc_error_t ret = ipc_writeMessage(pipes.tx, header, TAG_HEADER_LEN);
+  if (ret == OIDC_SUCCESS && len > 0) {
+    ret = ipc_writeParts(pipes.tx, parts, count);
+  }
+  return ret;
 }
 
 oidc_error_t ipc_writeOidcErrnoToPipe(struct ipcPipe pipes) {
   return ipc_writeToPipe(pipes, RESPONSE_ERROR, oidc_serror());
 }
 
-char* ipc_readFromPipe(struct ipcPipe pipes) { return ipc_read(pipes.rx); }
+/**
+ * @brief reads exactly @p len bytes from @p fd
+ * @return @c OIDC_SUCCESS on success; an error code otherwise
+ */
+static oidc_error_t _readExactly(int fd, char* buf, size_t len) {
+  size_t read_bytes = 0;
+  while (read_bytes < len) {
+    ssize_t read_ret = read(fd, buf + read_bytes, len - read_bytes);
+    if (read_ret < 0) {
+      oidc_setErrnoError();
+      return oidc_errno;
+    }
+    if (read_ret == 0) {
+      logger(DEBUG, "Pipe closed");
+      oidc_errno = OIDC_EIPCDIS;
+      return oidc_errno;
+    }
+    read_bytes += read_ret;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief waits until @p fd is readable
+ * @param death the point in time until @p fd has to become readable; @c 0 for
+ * no timeout
+ * @return @c OIDC_SUCCESS or an error code, e.g. @c OIDC_ETIMEOUT
+ */
+static oidc_error_t _waitReadable(int fd, time_t death) {
+  if (fd < 0) {
+    oidc_errno = OIDC_ESOCKINV;
+    return oidc_errno;
+  }
+  return ipc_waitReadable(fd, death);
+}
+
+/**
+ * @brief parses the header of a tagged message
+ * @return @c OIDC_SUCCESS or @c OIDC_EIPCTAG if the header is malformed
+ */
+static oidc_error_t _parseTagHeader(const char* header, unsigned long* tag,
+                                    unsigned long* len) {
+  char* end = NULL;
+  *tag      = strtoul(header, &end, 10);
+  if (end == header || *end != ':') {
+    logger(ERROR, "Received malformed message on tagged pipe");
+    oidc_errno = OIDC_EIPCTAG;
+    return oidc_errno;
+  }
+  const char* len_str = end + 1;
+  *len                = strtoul(len_str, &end, 10);
+  if (end == len_str || *end != ':') {
+    logger(ERROR, "Received malformed message on tagged pipe");
+    oidc_errno = OIDC_EIPCTAG;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief reads a single tagged message from the shared memory ring of a pipe
+ * The header and the message are a single message in the ring.
+ */
+static char* _readTaggedMessageFromRing(struct ipcPipe pipes,
+                                        unsigned long* tag,
+                                        unsigned long* len) {
+  size_t msg_len = 0;
+  char*  msg     = shmRing_read(pipes.rx_ring, pipes.rx, &msg_len);
+  if (msg == NULL) {
+    return NULL;
+  }
+  if (_parseTagHeader(msg, tag, len) != OIDC_SUCCESS) {
+    secFree(msg);
+    return NULL;
+  }
+  if (msg_len < TAG_HEADER_LEN || *len != msg_len - TAG_HEADER_LEN) {
+    logger(ERROR, "Received malformed message on tagged pipe");
+    secFree(msg);
+    oidc_errno = OIDC_EIPCTAG;
+    return NULL;
+  }
+  memmove(msg, msg + TAG_HEADER_LEN, *len + 1);
+  return msg;
+}
+
+/**
+ * @brief reads a single tagged message from a pipe
+ * Tagged messages consist of a fixed size header @c <tag>:<length>: followed
+ * by the message, so that multiple messages that are written in quick
+ * succession are not merged on reading.
+ * @param pipes the pipes to read from
+ * @param death the point in time until a message has to arrive; @c 0 for no
+ * timeout
+ * @param tag a pointer where the tag is stored
+ * @return a pointer to the untagged message. Has to be freed after usage. On
+ * failure @c NULL is returned and @c oidc_errno is set.
+ */
+static char* _readTaggedMessage(struct ipcPipe pipes, time_t death,
+                                unsigned long* tag) {
+  const int fd = pipes.rx;
+  if (_waitReadable(fd, death) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  unsigned long t   = 0;
+  unsigned long len = 0;
+  char*         msg = NULL;
+  if (pipes.rx_ring) {
+    msg = _readTaggedMessageFromRing(pipes, &t, &len);
+    if (msg == NULL) {
+      return NULL;
+    }
+  } else {
+    char header[TAG_HEADER_LEN + 1] = {0};
+    if (_readExactly(fd, header, TAG_HEADER_LEN) != OIDC_SUCCESS ||
+        _parseTagHeader(header, &t, &len) != OIDC_SUCCESS) {
+      return NULL;
+    }
+    msg = secAlloc(sizeof(char) * (len + 1));
+    if (_readExactly(fd, msg, len) != OIDC_SUCCESS) {
+      secFree(msg);
+      return NULL;
+    }
+  }
+  logger(DEBUG, "ipc read tagged message %lu: '%s'", t, msg);
+  if (tag) {
+    *tag = t;
+  }
+  oidc_errno = OIDC_SUCCESS;
+  return msg;
+}
+
+/**
+ * @brief sets the function that is called if a message with a different tag
+ * arrives while waiting for a message on a tagged pipe
+ * @return the previously set handler
+ */
+taggedMessageHandler ipc_setForeignTaggedMessageHandler(
+    taggedMessageHandler handler) {
+  taggedMessageHandler old    = foreignTaggedMessageHandler;
+  foreignTaggedMessageHandler = handler;
+  return old;
+}
+
+struct ipcPipe ipc_tagPipe(struct ipcPipe pipes, unsigned long tag) {
+  pipes.tag = tag;
+  return pipes;
+}
+
+char* ipc_readTaggedFromPipeWithTimeout(struct ipcPipe pipes, time_t timeout,
+                                        unsigned long* tag) {
+  return _readTaggedMessage(pipes, timeout, tag);
+}
+
+char* ipc_readFromPipe(struct ipcPipe pipes) {
+  if (pipes.tag == 0) {
+    return pipes.rx_ring ? shmRing_read(pipes.rx_ring, pipes.rx, NULL)
+                         : ipc_read(pipes.rx);
+  }
+  while (1) {
+    unsigned long tag = 0;
+    char*         msg = _readTaggedMessage(pipes, 0, &tag);
+    if (msg == NULL || tag == pipes.tag) {
+      return msg;
+    }
+    if (foreignTaggedMessageHandler) {
+      foreignTaggedMessageHandler(tag, msg);
+    } else {
+      logger(ERROR, "Dropping message with unexpected tag %lu", tag);
+      secFree(msg);
+    }
+  }
+}
 
 char* ipc_readFromPipeWithTimeout(struct ipcPipe pipes, time_t timeout) {
+  if (pipes.rx_ring) {
+    if (_waitReadable(pipes.rx, timeout) != OIDC_SUCCESS) {
+      return NULL;
+    }
+    return shmRing_read(pipes.rx_ring, pipes.rx, NULL);
+  }
   return ipc_readWithTimeout(pipes.rx, timeout);
 }
 
@@ -4,13 +4,39 @@
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
+#include <sys/uio.h>
 #include <time.h>
 
+struct shmRing;
+
+/**
+ * If @c tag is not @c 0 every message written to the pipe is prefixed with the
+ * tag and reading only returns messages with the same tag; this allows
+ * multiple requests to be in flight on the same pipe.
+ * If the rings are set, the messages are passed through shared memory and the
+ * pipes only carry the doorbells, see shmRing.c.
+ */
 struct ipcPipe {
-  int rx;
-  int tx;
+  int             rx;
+  int             tx;
+  unsigned long   tag;
+  struct shmRing* rx_ring;
+  struct shmRing* tx_ring;
 };
 
+/**
+ * Tag used by oidcd for requests it does on its own, i.e. that do not belong
+ * to a client request
+ */
+#define IPC_TAG_INTERNAL (~0UL)
+/**
+ * Tag used by oidcd for notifications, i.e. messages to oidcp that are not
+ * answered
+ */
+#define IPC_TAG_NOTIFY (~0UL - 1)
+
+typedef void (*taggedMessageHandler)(unsigned long tag, char* msg);
+
 struct pipeSet {
   struct ipcPipe pipe1;
   struct ipcPipe pipe2;
@@ -18,15 +44,21 @@ struct pipeSet {
 
 void           ipc_closePipes(struct ipcPipe);
 struct pipeSet ipc_pipe_init();
+oidc_error_t   ipc_pipe_addRings(struct pipeSet*);
 struct ipcPipe toServerPipes(struct pipeSet);
 struct ipcPipe toClientPipes(struct pipeSet);
 
 oidc_error_t ipc_writeToPipe(struct ipcPipe, const char*, ...);
 oidc_error_t ipc_vwriteToPipe(struct ipcPipe, const char*, va_list);
+oidc_error_t ipc_writePartsToPipe(struct ipcPipe, const struct iovec*, int);
 oidc_error_t ipc_writeOidcErrnoToPipe(struct ipcPipe);
 char*        ipc_readFromPipe(struct ipcPipe);
 char*        ipc_readFromPipeWithTimeout(struct ipcPipe, time_t);
 char*        ipc_communicateThroughPipe(struct ipcPipe, const char*, ...);
 char*        ipc_vcommunicateThroughPipe(struct ipcPipe, const char*, va_list);
 
+char* ipc_readTaggedFromPipeWithTimeout(struct ipcPipe, time_t, unsigned long*);
+taggedMessageHandler ipc_setForeignTaggedMessageHandler(taggedMessageHandler);
+struct ipcPipe       ipc_tagPipe(struct ipcPipe, unsigned long tag);
+
 #endif  // OIDC_IPC_PIPE_H
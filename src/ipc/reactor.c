@@ -0,0 +1,374 @@
+#include "reactor.h"
+#include "ipc.h"
+#include "serveripc.h"
+#include "utils/logger.h"
+#include "utils/loopLag.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/oidc_error.h"
+#include "wrapper/list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef IPC_REACTOR_EPOLL
+#include <sys/epoll.h>
+#endif
+#ifdef IPC_REACTOR_KQUEUE
+#include <sys/event.h>
+#include <sys/types.h>
+#endif
+
+/**
+ * The reactor watches the listen socket, the client connections in the
+ * connection db and additional file descriptors with epoll (Linux) or kqueue
+ * (macOS / FreeBSD). Connections are registered once when they are added to the
+ * connection db and unregistered when they are removed, so waiting does not
+ * depend on the number of connections.
+ *
+ * The descriptors are watched level-triggered: a ready connection is handed out
+ * once and the caller reads exactly one message from it; anything left is
+ * reported again by the next wait.
+ *
+ * Other file descriptors, e.g. the output of a running prompt, can be watched
+ * with a callback that is called from within the wait whenever the descriptor
+ * is readable. Those are also supported by the select fallback.
+ */
+
+struct reactor_watch {
+  int             fd;
+  reactorCallback callback;
+  void*           arg;
+};
+
+static list_t* watches = NULL;
+
+static struct reactor_watch* _findWatch(int fd, const void* ptr) {
+  if (watches == NULL) {
+    return NULL;
+  }
+  for (list_node_t* node = watches->head; node; node = node->next) {
+    struct reactor_watch* w = node->val;
+    if (ptr ? (const void*)w == ptr : w->fd == fd) {
+      return w;
+    }
+  }
+  return NULL;
+}
+
+static void _call(struct reactor_watch* w) {
+  if (w) {
+    const double start = metrics_now();
+    w->callback(w->fd, w->arg);
+    loopLag_recordWatched(start);
+  }
+}
+
+/**
+ * @brief adds the fds watched with a callback to @p set
+ * Only used by the select fallback.
+ * @return the new maximum fd
+ */
+int reactor_addWatchedFdsToSet(fd_set* set, int maxFd) {
+  if (watches == NULL) {
+    return maxFd;
+  }
+  for (list_node_t* node = watches->head; node; node = node->next) {
+    struct reactor_watch* w = node->val;
+    FD_SET(w->fd, set);
+    if (w->fd > maxFd) {
+      maxFd = w->fd;
+    }
+  }
+  return maxFd;
+}
+
+/**
+ * @brief calls the callbacks of all watched fds that are set in @p set
+ * Only used by the select fallback.
+ */
+void reactor_dispatchWatchedFds(const fd_set* set) {
+  if (watches == NULL || watches->len == 0) {
+    return;
+  }
+  // Callbacks might unwatch fds, so the fds are collected first
+  size_t len = watches->len;
+  int    fds[len];
+  size_t i = 0;
+  for (list_node_t* node = watches->head; node && i < len; node = node->next) {
+    fds[i++] = ((struct reactor_watch*)node->val)->fd;
+  }
+  for (i = 0; i < len; i++) {
+    if (FD_ISSET(fds[i], set)) {
+      _call(_findWatch(fds[i], NULL));
+    }
+  }
+}
+
+#ifdef IPC_HAVE_REACTOR
+
+#define REACTOR_MAX_EVENTS 32
+
+static int reactor     = -1;
+static int listen_sock = -1;
+static int extra_fds[REACTOR_MAX_FDS];
+static int extra_fds_len = 0;
+
+// Markers for the event data of the listen socket and the extra fds
+static char listen_marker;
+static char fd_markers[REACTOR_MAX_FDS];
+
+// Ready connections of the last wait that were not handed out yet
+static struct connection* ready[REACTOR_MAX_EVENTS];
+static size_t             ready_len = 0;
+static size_t             ready_pos = 0;
+
+static int _init() {
+  if (reactor >= 0) {
+    return 0;
+  }
+#ifdef IPC_REACTOR_EPOLL
+  reactor = epoll_create1(EPOLL_CLOEXEC);
+#else
+  reactor = kqueue();
+  if (reactor >= 0) {
+    fcntl(reactor, F_SETFD, FD_CLOEXEC);
+  }
+#endif
+  if (reactor < 0) {
+    logger(ERROR, "Could not create event queue: %m");
+    return -1;
+  }
+  return 0;
+}
+
+static void _add(int fd, void* data) {
+  if (_init() != 0) {
+    return;
+  }
+#ifdef IPC_REACTOR_EPOLL
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = data};
+  if (epoll_ctl(reactor, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    logger(ERROR, "Could not watch fd %d: %m", fd);
+  }
+#else
+  struct kevent ev;
+  EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, data);
+  if (kevent(reactor, &ev, 1, NULL, 0, NULL) != 0) {
+    logger(ERROR, "Could not watch fd %d: %m", fd);
+  }
+#endif
+}
+
+static void _remove(int fd) {
+  if (reactor < 0) {
+    return;
+  }
+#ifdef IPC_REACTOR_EPOLL
+  struct epoll_event ev = {0};  // non-NULL for kernels before 2.6.9
+  epoll_ctl(reactor, EPOLL_CTL_DEL, fd, &ev);
+#else
+  struct kevent ev;
+  EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  kevent(reactor, &ev, 1, NULL, 0, NULL);
+#endif
+}
+
+static void _watchFd(int* watched, int fd, void* marker) {
+  if (*watched == fd) {
+    return;
+  }
+  if (*watched >= 0) {
+    _remove(*watched);
+  }
+  _add(fd, marker);
+  *watched = fd;
+}
+
+/**
+ * @brief waits for events and stores the ready connections
+ * @param fd_ready is set to the index of a readable extra fd
+ * @return the number of events, @c 0 on timeout, or @c -1 on error
+ */
+static int _wait(time_t death, int* listen_ready, int* fd_ready) {
+  struct timeval* timeout = initTimeout(death);
+  if (oidc_errno != OIDC_SUCCESS) {  // death before now
+    return -1;
+  }
+  int n;
+#ifdef IPC_REACTOR_EPOLL
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  int                timeout_ms = -1;
+  if (timeout) {
+    // Longer timeouts just wake up early and are reported as timeout
+    timeout_ms = timeout->tv_sec < INT_MAX / 1000 ? timeout->tv_sec * 1000
+                                                  : INT_MAX / 1000 * 1000;
+  }
+  n = epoll_wait(reactor, events, REACTOR_MAX_EVENTS, timeout_ms);
+#else
+  struct kevent   events[REACTOR_MAX_EVENTS];
+  struct timespec ts = {timeout ? timeout->tv_sec : 0, 0};
+  n = kevent(reactor, NULL, 0, events, REACTOR_MAX_EVENTS,
+             timeout ? &ts : NULL);
+#endif
+  int err = errno;
+  secFree(timeout);
+  errno     = err;
+  ready_len = ready_pos = 0;
+  void*  called[REACTOR_MAX_EVENTS];
+  size_t called_len = 0;
+  for (int i = 0; i < n; i++) {
+#ifdef IPC_REACTOR_EPOLL
+    void* data = events[i].data.ptr;
+#else
+    void* data = events[i].udata;
+#endif
+    if (data == &listen_marker) {
+      *listen_ready = 1;
+    } else if ((char*)data >= fd_markers &&
+               (char*)data < fd_markers + REACTOR_MAX_FDS) {
+      *fd_ready = (char*)data - fd_markers;
+    } else if (_findWatch(-1, data)) {
+      called[called_len++] = data;
+    } else {
+      ready[ready_len++] = data;
+    }
+  }
+  for (size_t i = 0; i < called_len; i++) {
+    // A previous callback might have unwatched it
+    _call(_findWatch(-1, called[i]));
+  }
+  return n;
+}
+
+#endif  // IPC_HAVE_REACTOR
+
+/**
+ * @brief watches @p fd and calls @p callback whenever it is readable
+ * The callback is called from within
+ * @c ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout and has to read
+ * from @p fd, or unwatch it.
+ */
+void reactor_watchFd(int fd, reactorCallback callback, void* arg) {
+  if (watches == NULL) {
+    watches       = list_new();
+    watches->free = _secFree;
+  }
+  struct reactor_watch* w = secAlloc(sizeof(struct reactor_watch));
+  w->fd                   = fd;
+  w->callback             = callback;
+  w->arg                  = arg;
+  list_rpush(watches, list_node_new(w));
+#ifdef IPC_HAVE_REACTOR
+  _add(fd, w);
+#endif
+}
+
+/**
+ * @brief stops watching a fd watched with @c reactor_watchFd
+ */
+void reactor_unwatchFd(int fd) {
+  if (watches == NULL) {
+    return;
+  }
+#ifdef IPC_HAVE_REACTOR
+  _remove(fd);
+#endif
+  for (list_node_t* node = watches->head; node; node = node->next) {
+    if (((struct reactor_watch*)node->val)->fd == fd) {
+      list_remove(watches, node);
+      return;
+    }
+  }
+}
+
+#ifdef IPC_HAVE_REACTOR
+
+/**
+ * @brief registers a client connection with the reactor
+ * Has to be called when the connection is added to the connection db.
+ */
+void reactor_watchConnection(struct connection* con) {
+  _add(*(con->msgsock), con);
+}
+
+/**
+ * @brief unregisters a client connection from the reactor
+ * Has to be called before the connection is removed from the connection db or
+ * freed.
+ */
+void reactor_unwatchConnection(struct connection* con) {
+  _remove(*(con->msgsock));
+  for (size_t i = ready_pos; i < ready_len; i++) {
+    if (ready[i] == con) {
+      ready[i] = NULL;
+    }
+  }
+}
+
+/**
+ * @brief waits for a message on the client connections
+ * Works like @c ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout
+ */
+struct connection* reactor_waitForConnections(struct connection listencon,
+                                              time_t death, const int* fds,
+                                              size_t fds_len, int* fd_ready) {
+  if (_init() != 0) {
+    oidc_errno = OIDC_EERROR;
+    return NULL;
+  }
+  _watchFd(&listen_sock, *(listencon.sock), &listen_marker);
+  if (fds_len > REACTOR_MAX_FDS) {
+    fds_len = REACTOR_MAX_FDS;
+  }
+  for (; extra_fds_len < (int)fds_len; extra_fds_len++) {
+    extra_fds[extra_fds_len] = -1;
+  }
+  for (size_t i = 0; i < fds_len; i++) {
+    _watchFd(&extra_fds[i], fds[i], &fd_markers[i]);
+  }
+  while (1) {
+    while (ready_pos < ready_len) {
+      struct connection* con = ready[ready_pos++];
+      if (con) {
+        logger(DEBUG, "New message for read av");
+        return con;
+      }
+    }
+    int listen_ready = 0;
+    int extra_ready  = -1;
+    int ret          = _wait(death, &listen_ready, &extra_ready);
+    if (ret == 0) {
+      logger(DEBUG, "Reached reactor timeout");
+      oidc_errno = OIDC_ETIMEOUT;
+      return NULL;
+    }
+    if (ret < 0) {
+      if (oidc_errno != OIDC_SUCCESS) {
+        return NULL;
+      }
+      if (errno != EINTR) {
+        logger(ERROR, "%m");
+      }
+      continue;
+    }
+    if (listen_ready) {
+      ipc_acceptClient(listencon);
+    }
+    if (extra_ready >= 0) {
+      if (fd_ready) {
+        *fd_ready = extra_ready;
+      }
+      return NULL;
+    }
+  }
+}
+
+#else  // IPC_HAVE_REACTOR
+
+void reactor_watchConnection(struct connection* con) { (void)con; }
+void reactor_unwatchConnection(struct connection* con) { (void)con; }
+
+#endif  // IPC_HAVE_REACTOR
@@ -0,0 +1,37 @@
+#ifndef IPC_REACTOR_H
+#define IPC_REACTOR_H
+
+#include "connection.h"
+
+#include <stddef.h>
+#include <sys/select.h>
+#include <time.h>
+
+// IPC_NO_REACTOR forces the select loop, e.g. to compare both in benchmarks
+#if defined(IPC_NO_REACTOR)
+#elif defined(__linux__)
+#define IPC_REACTOR_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#define IPC_REACTOR_KQUEUE
+#endif
+
+#if defined(IPC_REACTOR_EPOLL) || defined(IPC_REACTOR_KQUEUE)
+#define IPC_HAVE_REACTOR
+#endif
+
+// maximum number of additional fds that are watched besides the connections
+#define REACTOR_MAX_FDS 64
+
+typedef void (*reactorCallback)(int fd, void* arg);
+
+void               reactor_watchFd(int fd, reactorCallback callback, void* arg);
+void               reactor_unwatchFd(int fd);
+int                reactor_addWatchedFdsToSet(fd_set* set, int maxFd);
+void               reactor_dispatchWatchedFds(const fd_set* set);
+void               reactor_watchConnection(struct connection* con);
+void               reactor_unwatchConnection(struct connection* con);
+struct connection* reactor_waitForConnections(struct connection listencon,
+                                              time_t death, const int* fds,
+                                              size_t fds_len, int* fd_ready);
+
+#endif  // IPC_REACTOR_H
@@ -1,4 +1,6 @@
-#ifndef __APPLE__
+#if defined(__linux__)
+#define _GNU_SOURCE  // struct ucred
+#elif !defined(__APPLE__)
 #define _XOPEN_SOURCE 700
 #endif
 #include "serveripc.h"
@@ -6,6 +8,9 @@
 #include "defines/ipc_values.h"
 #include "ipc.h"
 #include "ipc/cryptCommunicator.h"
+#include "reactor.h"
+#include "tcp_serveripc.h"
+#include "utils/crypt/ipcCryptUtils.h"
 #include "utils/db/connection_db.h"
 #include "utils/file_io/fileUtils.h"
 #include "utils/json.h"
@@ -15,6 +20,9 @@
 #include "utils/stringUtils.h"
 #include "wrapper/list.h"
 
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
 #include <string.h>
 #include <sys/fcntl.h>
 #include <sys/select.h>
@@ -29,6 +37,143 @@
 static char* oidc_ipc_dir       = NULL;
 static char* server_socket_path = NULL;
 
+/**
+ * With @c --trust-local-clients unencrypted requests are accepted from local
+ * clients whose peer credentials match the user running the agent or the group
+ * given with @c --with-group. The members of the group are resolved once when
+ * the socket is initialized, so that no user database lookup (possibly over
+ * the network) is done per request.
+ */
+static unsigned char trustLocalClients = 0;
+static unsigned char trustAllUsers     = 0;
+static unsigned char hasTrustedGroup   = 0;
+static gid_t         trustedGroup;
+static uid_t*        trustedMembers     = NULL;
+static size_t        trustedMembersSize = 0;
+
+void server_ipc_setTrustLocalClients(unsigned char trust) {
+  trustLocalClients = trust;
+}
+
+/**
+ * @brief accepts unencrypted requests from all local users, e.g. because every
+ * user only has access to their own accounts (--multi-user)
+ */
+void server_ipc_setTrustAllUsers(unsigned char trust) { trustAllUsers = trust; }
+
+/**
+ * @brief remembers the group given with @c --with-group and the user ids of its
+ * members
+ */
+static void _setTrustedGroup(const char* group_name) {
+  struct group* grp = group_name ? getgrnam(group_name) : NULL;
+  if (grp == NULL) {  // init_socket_path already failed if it does not exist
+    return;
+  }
+  trustedGroup    = grp->gr_gid;
+  hasTrustedGroup = 1;
+  size_t n        = 0;
+  while (grp->gr_mem && grp->gr_mem[n]) {
+    n++;
+  }
+  // getpwnam may overwrite the static group entry
+  char** names = secAlloc(sizeof(char*) * (n + 1));
+  for (size_t i = 0; i < n; i++) {
+    names[i] = oidc_strcopy(grp->gr_mem[i]);
+  }
+  secFree(trustedMembers);
+  trustedMembers     = secAlloc(sizeof(uid_t) * (n + 1));
+  trustedMembersSize = 0;
+  for (size_t i = 0; i < n; i++) {
+    struct passwd* pw = getpwnam(names[i]);
+    if (pw != NULL) {
+      trustedMembers[trustedMembersSize++] = pw->pw_uid;
+    }
+    secFree(names[i]);
+  }
+  secFree(names);
+}
+
+static int _isInTrustedGroup(uid_t uid, gid_t gid) {
+  if (!hasTrustedGroup) {
+    return 0;
+  }
+  if (gid == trustedGroup) {  // also the primary group
+    return 1;
+  }
+  for (size_t i = 0; i < trustedMembersSize; i++) {
+    if (trustedMembers[i] == uid) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int _isUnixSocket(int sock) {
+  struct sockaddr_storage addr;
+  socklen_t               addr_len = sizeof(addr);
+  return getsockname(sock, (struct sockaddr*)&addr, &addr_len) == 0 &&
+         addr.ss_family == AF_UNIX;
+}
+
+/**
+ * @brief gets the credentials of the peer of a UNIX domain socket
+ * @return @c 0 on success, @c -1 otherwise
+ */
+static int _getPeerCredentials(int sock, uid_t* uid, gid_t* gid) {
+  if (!_isUnixSocket(sock)) {
+    return -1;
+  }
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t    len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    logger(DEBUG, "Could not get peer credentials: %m");
+    return -1;
+  }
+  *uid = cred.uid;
+  *gid = cred.gid;
+#else
+  if (getpeereid(sock, uid, gid) != 0) {
+    logger(DEBUG, "Could not get peer credentials: %m");
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+/**
+ * @brief checks the peer credentials of a client socket
+ * @return @c 1 if the client may send unencrypted requests, @c 0 otherwise
+ */
+static int _peerIsTrusted(int sock) {
+  uid_t uid;
+  gid_t gid;
+  if (!trustLocalClients || _getPeerCredentials(sock, &uid, &gid) != 0) {
+    return 0;
+  }
+  return trustAllUsers || uid == geteuid() || _isInTrustedGroup(uid, gid);
+}
+
+/**
+ * @brief checks if a client is run by the user running the agent; members of
+ * the group given with @c --with-group are not included
+ */
+int server_ipc_peerIsOwner(int sock) {
+  uid_t uid;
+  gid_t gid;
+  return _getPeerCredentials(sock, &uid, &gid) == 0 && uid == geteuid();
+}
+
+/**
+ * @brief gets the user id of the peer of a client socket
+ * @return @c 0 on success, @c -1 otherwise, e.g. for tcp connections
+ */
+int server_ipc_getPeerUid(int sock, uid_t* uid) {
+  gid_t gid;
+  return _getPeerCredentials(sock, uid, &gid);
+}
+
 /**
  * @brief generates the socket path and prints commands for setting env vars
  * @param env_var_name the name of the environment variable which will be set.
@@ -78,12 +223,39 @@ oidc_error_t ipc_server_init(struct connection* con, const char* group_name) {
   if (path == NULL) {
     return oidc_errno;
   }
+  _setTrustedGroup(group_name);
   strcpy(con->server->sun_path, path);
   secFree(path);
   server_socket_path = con->server->sun_path;
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief initializes a server unix domain socket at a fixed path instead of
+ * one in a new temporary directory, e.g. the well-known socket of --attach
+ * @param con, a pointer to the connection struct. The relevant fields will be
+ * initialized.
+ * @param path the path of the socket; its directory has to exist
+ * @param group_name if not @c NULL, the members of the group are trusted like
+ * with @c ipc_server_init; the permissions of the directory are not changed
+ */
+oidc_error_t ipc_server_initAtPath(struct connection* con, const char* path,
+                                   const char* group_name) {
+  logger(DEBUG, "initializing server ipc at %s", path);
+  if (strlen(path) >= sizeof(con->server->sun_path)) {
+    oidc_seterror("the socket path is too long");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  if (initServerConnection(con) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  _setTrustedGroup(group_name);
+  strcpy(con->server->sun_path, path);
+  server_socket_path = con->server->sun_path;
+  return OIDC_SUCCESS;
+}
+
 /**
  * @brief initializes unix domain socket with the current server_socket_path
  * @param con, a pointer to the connection struct. The relevant fields will be
@@ -103,6 +275,45 @@ oidc_error_t ipc_initWithPath(struct connection* con) {
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief initializes a server connection with a socket that already listens,
+ * e.g. one passed by the service manager
+ * @param con, a pointer to the connection struct. The relevant fields will be
+ * initialized.
+ * @param sock the listening UNIX domain socket
+ * @param group_name if not @c NULL, the members of the group are trusted like
+ * with @c ipc_server_init; the permissions of the socket are not changed
+ */
+oidc_error_t ipc_server_initWithSocket(struct connection* con, int sock,
+                                       const char* group_name) {
+  logger(DEBUG, "initializing server ipc with inherited socket %d", sock);
+  struct sockaddr_un addr     = {0};
+  socklen_t          addr_len = sizeof(addr);
+  if (getsockname(sock, (struct sockaddr*)&addr, &addr_len) != 0 ||
+      addr.sun_family != AF_UNIX || addr.sun_path[0] == '\0') {
+    oidc_seterror("the inherited socket is not a named UNIX domain socket");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  con->server  = secAlloc(sizeof(struct sockaddr_un));
+  con->sock    = secAlloc(sizeof(int));
+  con->msgsock = secAlloc(sizeof(int));
+  memcpy(con->server, &addr, sizeof(addr));
+  *(con->sock) = sock;
+  struct group* grp = group_name ? getgrnam(group_name) : NULL;
+  if (grp) {
+    trustedGroup    = grp->gr_gid;
+    hasTrustedGroup = 1;
+  }
+  int flags;
+  if (-1 == (flags = fcntl(sock, F_GETFL, 0)))
+    flags = 0;
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+  server_socket_path = con->server->sun_path;
+  return OIDC_SUCCESS;
+}
+
 char* getServerSocketPath() { return server_socket_path; }
 
 /**
@@ -126,37 +337,57 @@ int ipc_bindAndListen(struct connection* con) {
   fcntl(*(con->sock), F_SETFL, flags | O_NONBLOCK);
 
   logger(DEBUG, "listen ipc\n");
-  return listen(*(con->sock), 5);
+  return listen(*(con->sock), IPC_LISTEN_BACKLOG);
+}
+
+/**
+ * @brief accepts a new client on @p listencon and adds it to the connection db
+ */
+void ipc_acceptClient(struct connection listencon) {
+  logger(DEBUG, "New incoming client");
+  int sock = accept(*(listencon.sock), 0, 0);
+  if (sock < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      logger(ERROR, "%m");
+    }
+    return;
+  }
+  if (!_isUnixSocket(sock)) {
+    ipc_tcp_configureClientSocket(sock);
+  }
+  struct connection* newClient =
+      secAllocTagged(sizeof(struct connection), MEMTAG_CONNECTION);
+  newClient->msgsock = secAllocTagged(sizeof(int), MEMTAG_CONNECTION);
+  *(newClient->msgsock)        = sock;
+  logger(DEBUG, "accepted new client sock: %d", sock);
+  connectionDB_addValue(newClient);
+  reactor_watchConnection(newClient);
+  logger(DEBUG, "updated client list");
 }
 
 int _determineMaxSockAndAddToReadSet(int sock_listencon, fd_set* readSet) {
-  int              maxSock = sock_listencon;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(connectionDB_getList(), LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    struct connection* con = node->val;
+  int             maxSock     = sock_listencon;
+  const vector_t* connections = connectionDB_getList();
+  for (size_t i = 0; connections && i < connections->len; i++) {
+    struct connection* con = vector_at(connections, i);
     FD_SET(*(con->msgsock), readSet);
     if (*(con->msgsock) > maxSock) {
       maxSock = *(con->msgsock);
     }
   }
-  list_iterator_destroy(it);
   return maxSock;
 }
 
 struct connection* _checkClientSocksForMsg(fd_set* readSet) {
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(connectionDB_getList(), LIST_TAIL);
-  while ((node = list_iterator_next(it))) {
-    struct connection* con = node->val;
+  const vector_t* connections = connectionDB_getList();
+  for (size_t i = connections ? connections->len : 0; i > 0; i--) {
+    struct connection* con = vector_at(connections, i - 1);
     logger(DEBUG, "Checking client %d", *(con->msgsock));
     if (FD_ISSET(*(con->msgsock), readSet)) {
       logger(DEBUG, "New message for read av");
-      list_iterator_destroy(it);
       return con;
     }
   }
-  list_iterator_destroy(it);
   return NULL;
 }
 
@@ -174,12 +405,67 @@ struct connection* _checkClientSocksForMsg(fd_set* readSet) {
  */
 struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
     struct connection listencon, time_t death) {
+  return ipc_readAsyncFromMultipleConnectionsAndFdWithTimeout(listencon, death,
+                                                              -1, NULL);
+}
+
+/**
+ * @brief handles asynchronous server read for multiple sockets and an
+ * additional file descriptor
+ *
+ * Works like @c ipc_readAsyncFromMultipleConnectionsWithTimeout but
+ * additionally watches @p fd.
+ * @param fd an additional file descriptor to watch, e.g. a pipe; @c -1 if not
+ * used
+ * @param fd_ready is set to @c 1 if @p fd is readable; in that case @c NULL is
+ * returned
+ */
+struct connection* ipc_readAsyncFromMultipleConnectionsAndFdWithTimeout(
+    struct connection listencon, time_t death, int fd, int* fd_ready) {
+  int                ready = -1;
+  struct connection* con =
+      ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout(
+          listencon, death, &fd, fd >= 0 ? 1 : 0, &ready);
+  if (fd_ready) {
+    *fd_ready = ready == 0;
+  }
+  return con;
+}
+
+/**
+ * @brief handles asynchronous server read for multiple sockets and additional
+ * file descriptors
+ *
+ * Works like @c ipc_readAsyncFromMultipleConnectionsWithTimeout but
+ * additionally watches @p fds. Uses the reactor where available and select
+ * otherwise.
+ * @param fds additional file descriptors to watch, e.g. pipes; at most
+ * @c REACTOR_MAX_FDS
+ * @param fd_ready is set to the index of a readable fd in @p fds; in that case
+ * @c NULL is returned. Otherwise it is set to @c -1
+ */
+struct connection* ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout(
+    struct connection listencon, time_t death, const int* fds, size_t fds_len,
+    int* fd_ready) {
+  if (fd_ready) {
+    *fd_ready = -1;
+  }
+#ifdef IPC_HAVE_REACTOR
+  return reactor_waitForConnections(listencon, death, fds, fds_len, fd_ready);
+#else
   while (1) {
     fd_set readSockSet;
     FD_ZERO(&readSockSet);
     FD_SET(*(listencon.sock), &readSockSet);
     int maxSock =
         _determineMaxSockAndAddToReadSet(*(listencon.sock), &readSockSet);
+    for (size_t i = 0; i < fds_len; i++) {
+      FD_SET(fds[i], &readSockSet);
+      if (fds[i] > maxSock) {
+        maxSock = fds[i];
+      }
+    }
+    maxSock = reactor_addWatchedFdsToSet(&readSockSet, maxSock);
 
     struct timeval* timeout = initTimeout(death);
     if (oidc_errno != OIDC_SUCCESS) {  // death before now
@@ -189,21 +475,21 @@ struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
            timeout ? timeout->tv_sec : 0);
     // Waiting for incoming connections and messages
     int ret = select(maxSock + 1, &readSockSet, NULL, NULL, timeout);
+    secFree(timeout);
     if (ret > 0) {
+      reactor_dispatchWatchedFds(&readSockSet);
+      for (size_t i = 0; i < fds_len; i++) {
+        if (FD_ISSET(fds[i], &readSockSet)) {
+          if (fd_ready) {
+            *fd_ready = i;
+          }
+          return NULL;
+        }
+      }
       if (FD_ISSET(*(listencon.sock),
                    &readSockSet)) {  // if listensock read something it means a
                                      // new client connected
-        logger(DEBUG, "New incoming client");
-        struct connection* newClient = secAlloc(sizeof(struct connection));
-        newClient->msgsock           = secAlloc(sizeof(int));
-        *(newClient->msgsock)        = accept(*(listencon.sock), 0, 0);
-        if (*(newClient->msgsock) >= 0) {
-          logger(DEBUG, "accepted new client sock: %d", *(newClient->msgsock));
-          connectionDB_addValue(newClient);
-          logger(DEBUG, "updated client list");
-        } else {
-          logger(ERROR, "%m");
-        }
+        ipc_acceptClient(listencon);
       }
       struct connection* con = _checkClientSocksForMsg(&readSockSet);
       if (con) {
@@ -218,6 +504,7 @@ struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
     }
   }
   return NULL;
+#endif
 }
 
 char* ipc_cryptCommunicateWithServerPath(const char* fmt, ...) {
@@ -232,22 +519,34 @@ char* ipc_vcryptCommunicateWithServerPath(const char* fmt, va_list args) {
   return ipc_vcryptCommunicateWithPath(server_socket_path, fmt, args);
 }
 
-extern list_t* encryptionKeys;
-
 oidc_error_t server_ipc_write(const int sock, const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  if (encryptionKeys == NULL || encryptionKeys->len <= 0) {
-    oidc_error_t ret = ipc_vwrite(sock, fmt, args);
-    va_end(args);
-    return ret;
+  char* msg = oidc_vsprintf(fmt, args);
+  va_end(args);
+  if (msg == NULL) {
+    return oidc_errno;
   }
-  list_node_t*   node    = list_rpop(encryptionKeys);
-  unsigned char* ipc_key = node->val;
-  LIST_FREE(node);
+  oidc_error_t ret = server_ipc_writeMessage(sock, msg);
+  secFree(msg);
+  return ret;
+}
 
-  oidc_error_t e = ipc_vcryptWrite(sock, ipc_key, fmt, args);
-  va_end(args);
+/**
+ * @brief writes an already formatted message to a client, encrypted if a key
+ * was exchanged with it
+ * Used to pass on responses without formatting them again.
+ */
+oidc_error_t server_ipc_writeMessage(const int sock, const char* msg) {
+  if (msg == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return server_ipc_writeOidcErrno(sock);
+  }
+  unsigned char* ipc_key = server_ipc_takeKeyFor(sock);
+  if (ipc_key == NULL) {
+    return ipc_writeMessage(sock, msg, strlen(msg));
+  }
+  oidc_error_t e = ipc_cryptWriteMessage(sock, ipc_key, msg);
   secFree(ipc_key);
   if (e == OIDC_SUCCESS) {
     return OIDC_SUCCESS;
@@ -255,25 +554,42 @@ oidc_error_t server_ipc_write(const int sock, const char* fmt, ...) {
   return ipc_writeOidcErrno(sock);
 }
 
+/**
+ * @brief reads a request from @p sock and decrypts it
+ * An unencrypted request of a client that is not trusted is answered with
+ * @c RESPONSE_ENCRYPTION_REQUIRED; then @c NULL is returned and @c oidc_errno
+ * is set to @c OIDC_EENCREQ. The connection stays usable, the client starts
+ * the key exchange with its next message.
+ * @return the request or @c NULL on failure; has to be freed after usage
+ */
 char* server_ipc_read(const int sock) {
-  char* msg = ipc_read(sock);
-  if (isJSONObject(msg)) {
-    return msg;
+  size_t len = 0;
+  char*  msg = ipc_readWithLength(sock, &len);
+  if (msg == NULL) {
+    return NULL;
+  }
+  if (!isBinaryIpcMessage(msg, len) && isJSONObject(msg)) {
+    if (server_ipc_getSessionKeyFor(sock) == NULL && _peerIsTrusted(sock)) {
+      return msg;
+    }
+    // the client can do the key exchange on the same connection
+    logger(DEBUG, "Rejecting unencrypted request on socket %d", sock);
+    secFree(msg);
+    if (ipc_write(sock, RESPONSE_ENCRYPTION_REQUIRED) != OIDC_SUCCESS) {
+      return NULL;
+    }
+    oidc_errno = OIDC_EENCREQ;
+    return NULL;
+  }
+  const unsigned char* sessionKey = server_ipc_getSessionKeyFor(sock);
+  if (sessionKey) {
+    return decryptForIpcInPlace(msg, len, sessionKey);
   }
   char* res = server_ipc_cryptRead(sock, msg);
   secFree(msg);
   return res;
 }
 
-void server_ipc_freeLastKey() {
-  if (encryptionKeys == NULL || encryptionKeys->len <= 0) {
-    return;
-  }
-  list_node_t*   node = list_rpop(encryptionKeys);
-  unsigned char* key  = node->val;
-  LIST_FREE(node);
-  secFree(key);
-}
 
 oidc_error_t server_ipc_writeOidcErrno(const int sock) {
   return server_ipc_write(sock, RESPONSE_ERROR, oidc_serror());
@@ -5,23 +5,38 @@
 #include "utils/oidc_error.h"
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <sys/types.h>
 #include <time.h>
 
 oidc_error_t       initServerConnection(struct connection* con);
 struct connection* ipc_readAsyncFromMultipleConnectionsWithTimeout(
     struct connection, time_t);
+struct connection* ipc_readAsyncFromMultipleConnectionsAndFdWithTimeout(
+    struct connection, time_t, int, int*);
+struct connection* ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout(
+    struct connection, time_t, const int*, size_t, int*);
+void  ipc_acceptClient(struct connection listencon);
 char* ipc_vcryptCommunicateWithServerPath(const char* fmt, va_list args);
 char* ipc_cryptCommunicateWithServerPath(const char* fmt, ...);
 char* getServerSocketPath();
 
 oidc_error_t ipc_server_init(struct connection* con, const char* group_name);
+oidc_error_t ipc_server_initAtPath(struct connection* con, const char* path,
+                                   const char* group_name);
+oidc_error_t ipc_server_initWithSocket(struct connection* con, int sock,
+                                       const char* group_name);
 oidc_error_t ipc_initWithPath(struct connection* con);
 int          ipc_bindAndListen(struct connection* con);
 
-void         server_ipc_freeLastKey();
 char*        server_ipc_read(const int);
 oidc_error_t server_ipc_write(const int, const char*, ...);
+oidc_error_t server_ipc_writeMessage(const int, const char*);
 oidc_error_t server_ipc_writeOidcErrno(const int);
 oidc_error_t server_ipc_writeOidcErrnoPlain(const int sock);
+void         server_ipc_setTrustLocalClients(unsigned char trust);
+void         server_ipc_setTrustAllUsers(unsigned char trust);
+int          server_ipc_peerIsOwner(int sock);
+int          server_ipc_getPeerUid(int sock, uid_t* uid);
 
 #endif  // IPC_SERVER_H
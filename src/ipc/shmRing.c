@@ -0,0 +1,248 @@
+#define _GNU_SOURCE  // MAP_ANONYMOUS, syscall and SYS_futex
+#include "shmRing.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Every message is its length (4 bytes) followed by the message. Besides the
+ * ring the processes share a pipe, the doorbell: for every message the writer
+ * writes one byte to it, so the reading end is readable exactly while a
+ * message is pending and can be used with @c select like before. The doorbell
+ * is rung as soon as the whole message is in the ring, or when the writer has
+ * to wait for space, so that messages larger than the ring are streamed. The
+ * pipe also tells if the other process is gone: its reading end reports
+ * @c POLLHUP and its writing end @c POLLERR, which eventfds would not do.
+ *
+ * Consumed bytes are zeroed, so that tokens do not stay in the shared memory.
+ */
+
+#define SHM_RING_MASK (SHM_RING_SIZE - 1)
+// nanoseconds a process sleeps before it checks if the other one is gone
+#define SHM_RING_WAIT_NS (100 * 1000 * 1000)
+
+/**
+ * @brief maps a new ring; it is shared with the processes forked afterwards
+ * @return the ring or @c NULL on failure
+ */
+struct shmRing* shmRing_new() {
+  struct shmRing* ring = mmap(NULL, sizeof(struct shmRing),
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  mlock(ring, sizeof(struct shmRing));  // best effort, as for the slab
+#ifdef MADV_DONTDUMP
+  madvise(ring, sizeof(struct shmRing), MADV_DONTDUMP);
+#endif
+  return ring;
+}
+
+void shmRing_unmap(struct shmRing* ring) {
+  if (ring) {
+    munmap(ring, sizeof(struct shmRing));
+  }
+}
+
+/**
+ * @brief sleeps until @p counter is not @p seen anymore, but at most
+ * @c SHM_RING_WAIT_NS
+ */
+static void _wait(uint32_t* counter, uint32_t seen, uint32_t* waiting) {
+  __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen) {
+    struct timespec timeout = {0, SHM_RING_WAIT_NS};
+#ifdef __linux__
+    syscall(SYS_futex, counter, FUTEX_WAIT, seen, &timeout, NULL, 0);
+#else
+    timeout.tv_nsec = 100 * 1000;
+    nanosleep(&timeout, NULL);
+#endif
+  }
+  __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+static void _wake(uint32_t* counter, uint32_t* waiting) {
+  if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+#ifdef __linux__
+    syscall(SYS_futex, counter, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+  }
+}
+
+/**
+ * @brief checks if the other process closed its end of the doorbell
+ * @return @c OIDC_SUCCESS or @c OIDC_EIPCDIS
+ */
+static oidc_error_t _checkPeer(int doorbell) {
+  struct pollfd p = {.fd = doorbell, .events = 0};
+  if (poll(&p, 1, 0) > 0 && p.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+    logger(DEBUG, "Pipe closed");
+    oidc_errno = OIDC_EIPCDIS;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+static oidc_error_t _ringDoorbell(int doorbell) {
+  const char b = 0;
+  ssize_t    w;
+  while ((w = write(doorbell, &b, 1)) < 0 && errno == EINTR) {}
+  if (w != 1) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief copies @p len bytes into the ring, waiting for space if needed
+ * @param rung set if the doorbell was rung; it is rung before waiting
+ */
+static oidc_error_t _put(struct shmRing* ring, int doorbell, const char* src,
+                         size_t len, unsigned char* rung) {
+  while (len > 0) {
+    const uint32_t head  = ring->head;  // only written by us
+    const uint32_t tail  = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    const size_t   space = SHM_RING_SIZE - (uint32_t)(head - tail);
+    if (space == 0) {
+      if (!*rung) {
+        if (_ringDoorbell(doorbell) != OIDC_SUCCESS) {
+          return oidc_errno;
+        }
+        *rung = 1;
+      }
+      _wait(&ring->tail, tail, &ring->writer_waiting);
+      if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == tail &&
+          _checkPeer(doorbell) != OIDC_SUCCESS) {
+        return oidc_errno;
+      }
+      continue;
+    }
+    const size_t off   = head & SHM_RING_MASK;
+    size_t       chunk = len < space ? len : space;
+    if (chunk > SHM_RING_SIZE - off) {
+      chunk = SHM_RING_SIZE - off;
+    }
+    memcpy(ring->data + off, src, chunk);
+    __atomic_store_n(&ring->head, head + (uint32_t)chunk, __ATOMIC_SEQ_CST);
+    _wake(&ring->head, &ring->reader_waiting);
+    src += chunk;
+    len -= chunk;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief copies @p len bytes out of the ring, waiting for them if needed
+ */
+static oidc_error_t _get(struct shmRing* ring, int doorbell, char* dst,
+                         size_t len) {
+  while (len > 0) {
+    const uint32_t tail = ring->tail;  // only written by us
+    const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const size_t   used = (uint32_t)(head - tail);
+    if (used == 0) {
+      _wait(&ring->head, head, &ring->reader_waiting);
+      if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == head &&
+          _checkPeer(doorbell) != OIDC_SUCCESS) {
+        return oidc_errno;
+      }
+      continue;
+    }
+    const size_t off   = tail & SHM_RING_MASK;
+    size_t       chunk = len < used ? len : used;
+    if (chunk > SHM_RING_SIZE - off) {
+      chunk = SHM_RING_SIZE - off;
+    }
+    memcpy(dst, ring->data + off, chunk);
+    memset(ring->data + off, 0, chunk);
+    __atomic_store_n(&ring->tail, tail + (uint32_t)chunk, __ATOMIC_SEQ_CST);
+    _wake(&ring->tail, &ring->writer_waiting);
+    dst += chunk;
+    len -= chunk;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief writes a message given in multiple parts to the ring
+ * @param doorbell the writing end of the doorbell pipe
+ * @return @c OIDC_SUCCESS or an error code; @c OIDC_EIPCDIS if the reader is
+ * gone
+ */
+oidc_error_t shmRing_write(struct shmRing* ring, int doorbell,
+                           const struct iovec* parts, int count) {
+  size_t len = 0;
+  for (int i = 0; i < count; i++) { len += parts[i].iov_len; }
+  if (len > UINT32_MAX) {
+    oidc_setInternalError("message too large for the shared memory ring");
+    return oidc_errno;
+  }
+  const uint32_t len32 = (uint32_t)len;
+  unsigned char  rung  = 0;
+  if (_put(ring, doorbell, (const char*)&len32, sizeof(len32), &rung) !=
+      OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  for (int i = 0; i < count; i++) {
+    if (_put(ring, doorbell, parts[i].iov_base, parts[i].iov_len, &rung) !=
+        OIDC_SUCCESS) {
+      return oidc_errno;
+    }
+  }
+  return rung ? OIDC_SUCCESS : _ringDoorbell(doorbell);
+}
+
+/**
+ * @brief reads the next message from the ring; blocks until its doorbell was
+ * rung
+ * @param doorbell the reading end of the doorbell pipe
+ * @param len if not @c NULL the length of the message is stored there
+ * @return a pointer to the message. Has to be freed after usage. On failure
+ * @c NULL is returned and @c oidc_errno is set; @c OIDC_EIPCDIS if the writer
+ * is gone.
+ */
+char* shmRing_read(struct shmRing* ring, int doorbell, size_t* len) {
+  char    b;
+  ssize_t r;
+  while ((r = read(doorbell, &b, 1)) < 0 && errno == EINTR) {}
+  if (r < 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  if (r == 0) {
+    logger(DEBUG, "Pipe closed");
+    oidc_errno = OIDC_EIPCDIS;
+    return NULL;
+  }
+  uint32_t len32 = 0;
+  if (_get(ring, doorbell, (char*)&len32, sizeof(len32)) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  char* msg = secAlloc(sizeof(char) * ((size_t)len32 + 1));
+  if (msg == NULL) {
+    return NULL;
+  }
+  if (_get(ring, doorbell, msg, len32) != OIDC_SUCCESS) {
+    secFree(msg);
+    return NULL;
+  }
+  if (len) {
+    *len = len32;
+  }
+  oidc_errno = OIDC_SUCCESS;
+  return msg;
+}
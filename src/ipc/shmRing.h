@@ -0,0 +1,35 @@
+#ifndef IPC_SHM_RING_H
+#define IPC_SHM_RING_H
+
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/**
+ * A shared memory ring buffer for messages from one process to another, i.e.
+ * a single producer and a single consumer. It is mapped before the processes
+ * are forked. @c head and @c tail count the bytes written and read; they wrap
+ * around at 2^32, so the used space is always @c head - @c tail. A process
+ * that has to wait for the other one sleeps on the futex of the counter that
+ * the other one advances.
+ */
+
+#define SHM_RING_SIZE (256 * 1024)  // has to be a power of 2
+
+struct shmRing {
+  uint32_t head;
+  uint32_t reader_waiting;
+  uint32_t tail __attribute__((aligned(64)));
+  uint32_t writer_waiting;
+  char     data[SHM_RING_SIZE] __attribute__((aligned(64)));
+};
+
+struct shmRing* shmRing_new();
+void            shmRing_unmap(struct shmRing* ring);
+oidc_error_t    shmRing_write(struct shmRing* ring, int doorbell,
+                              const struct iovec* parts, int count);
+char*           shmRing_read(struct shmRing* ring, int doorbell, size_t* len);
+
+#endif  // IPC_SHM_RING_H
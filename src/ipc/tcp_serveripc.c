@@ -4,7 +4,9 @@
 #include "utils/logger.h"
 
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/fcntl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 /**
@@ -32,6 +34,8 @@ oidc_error_t ipc_tcp_server_init(struct connection* con, unsigned short port) {
  */
 int ipc_tcp_bindAndListen(struct connection* con) {
   logger(DEBUG, "binding tcp ipc\n");
+  int on = 1;  // allows a restarted server to bind while old connections linger
+  setsockopt(*(con->sock), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
   if (bind(*(con->sock), (struct sockaddr*)con->tcp_server,
            sizeof(struct sockaddr_in))) {
     logger(ALERT, "binding stream socket: %m");
@@ -46,5 +50,19 @@ int ipc_tcp_bindAndListen(struct connection* con) {
   fcntl(*(con->sock), F_SETFL, flags | O_NONBLOCK);
 
   logger(DEBUG, "listen ipc\n");
-  return listen(*(con->sock), 5);
+  return listen(*(con->sock), IPC_LISTEN_BACKLOG);
+}
+
+/**
+ * @brief configures an accepted tcp client socket
+ * Nagle's algorithm is disabled, because requests and responses are single
+ * small writes, and keepalives are enabled, so that connections of vanished
+ * clients are eventually closed.
+ */
+void ipc_tcp_configureClientSocket(int sock) {
+  int on = 1;
+  if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0 ||
+      setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) != 0) {
+    logger(NOTICE, "could not configure tcp socket %d: %m", sock);
+  }
 }
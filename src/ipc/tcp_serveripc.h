@@ -9,5 +9,6 @@
 
 oidc_error_t ipc_tcp_server_init(struct connection* con, unsigned short port);
 int          ipc_tcp_bindAndListen(struct connection* con);
+void         ipc_tcp_configureClientSocket(int sock);
 
 #endif  // IPC_TCP_SERVER_H
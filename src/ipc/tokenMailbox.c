@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tokenMailbox.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TOKEN_MAILBOX_NAME_FMT "/oidc-agent-%016lx"
+// a reader gives up after this many attempts to get a consistent copy
+#define TOKEN_MAILBOX_READ_TRIES 1000
+
+static uint64_t _hash(uint64_t hash, const char* str) {
+  for (const char* c = str; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief returns the name of the shared memory object of the mailbox of an
+ * account of the agent listening on @p socket_path
+ * @return the name; has to be freed after usage
+ */
+char* tokenMailbox_name(const char* socket_path, const char* shortname) {
+  if (socket_path == NULL || shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  uint64_t hash = _hash(14695981039346656037ULL, socket_path);
+  hash          = _hash(hash, "\n");
+  hash          = _hash(hash, shortname);
+  return oidc_sprintf(TOKEN_MAILBOX_NAME_FMT, (unsigned long)hash);
+}
+
+/**
+ * @brief creates the mailbox @p name; an existing object with that name is
+ * replaced
+ * @param group if not @c -1 members of this group may read the mailbox;
+ * otherwise only the user
+ * @return the mapped mailbox or @c NULL on failure
+ */
+struct tokenMailbox* tokenMailbox_create(const char* name, gid_t group) {
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  if ((group != (gid_t)-1 &&
+       (fchown(fd, -1, group) != 0 || fchmod(fd, 0640) != 0)) ||
+      ftruncate(fd, TOKEN_MAILBOX_SIZE) != 0) {
+    oidc_setErrnoError();
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  struct tokenMailbox* mailbox =
+      mmap(NULL, TOKEN_MAILBOX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mailbox == MAP_FAILED) {
+    oidc_setErrnoError();
+    shm_unlink(name);
+    return NULL;
+  }
+  __atomic_store_n(&mailbox->magic, TOKEN_MAILBOX_MAGIC, __ATOMIC_RELEASE);
+  return mailbox;
+}
+
+/**
+ * @brief writes a new access token to the mailbox; a @c NULL token empties
+ * it
+ */
+void tokenMailbox_publish(struct tokenMailbox* mailbox, const char* token,
+                          const char* issuer, unsigned long expires_at) {
+  if (mailbox == NULL) {
+    return;
+  }
+  size_t token_len  = token ? strlen(token) : 0;
+  size_t issuer_len = issuer ? strlen(issuer) : 0;
+  if (token_len + issuer_len > TOKEN_MAILBOX_DATA_SIZE) {
+    // a token that does not fit is not published; readers ask the agent
+    token_len  = 0;
+    issuer_len = 0;
+  }
+  __atomic_add_fetch(&mailbox->seq, 1, __ATOMIC_ACQ_REL);  // odd: writing
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(mailbox->data, token ?: "", token_len);
+  memcpy(mailbox->data + token_len, issuer ?: "", issuer_len);
+  __atomic_store_n(&mailbox->token_len, token_len, __ATOMIC_RELAXED);
+  __atomic_store_n(&mailbox->issuer_len, issuer_len, __ATOMIC_RELAXED);
+  __atomic_store_n(&mailbox->expires_at, token_len ? expires_at : 0,
+                   __ATOMIC_RELAXED);
+  __atomic_add_fetch(&mailbox->generation, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&mailbox->seq, 1, __ATOMIC_RELEASE);  // even: done
+}
+
+/**
+ * @brief marks the mailbox as closed, so that readers map it again, and
+ * removes it
+ */
+void tokenMailbox_destroy(struct tokenMailbox* mailbox, const char* name) {
+  if (mailbox == NULL) {
+    return;
+  }
+  tokenMailbox_publish(mailbox, NULL, NULL, 0);
+  __atomic_store_n(&mailbox->closed, 1, __ATOMIC_RELEASE);
+  munmap(mailbox, TOKEN_MAILBOX_SIZE);
+  if (name) {
+    shm_unlink(name);
+  }
+}
+
+/**
+ * @brief maps the mailbox @p name read-only
+ * The mailbox is only used if it belongs to @p owner, the user running the
+ * agent, and cannot be written by anybody else.
+ * @return the mapped mailbox or @c NULL on failure
+ */
+const struct tokenMailbox* tokenMailbox_open(const char* name, uid_t owner) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_uid != owner ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+      st.st_size != TOKEN_MAILBOX_SIZE) {
+    close(fd);
+    oidc_errno = OIDC_EMAILBOX;
+    return NULL;
+  }
+  const struct tokenMailbox* mailbox =
+      mmap(NULL, TOKEN_MAILBOX_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mailbox == MAP_FAILED) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  if (__atomic_load_n(&mailbox->magic, __ATOMIC_ACQUIRE) !=
+      TOKEN_MAILBOX_MAGIC) {
+    tokenMailbox_close(mailbox);
+    oidc_errno = OIDC_EMAILBOX;
+    return NULL;
+  }
+  return mailbox;
+}
+
+/**
+ * @brief copies the access token from the mailbox if it is valid for at least
+ * @p min_valid_period seconds
+ * No system calls are made.
+ * @param token set to the token; has to be freed after usage
+ * @param issuer set to the issuer; has to be freed after usage
+ * @return @c OIDC_SUCCESS on success; @c OIDC_EMAILBOX if there is no such
+ * token or the mailbox is closed
+ */
+int tokenMailbox_read(const struct tokenMailbox* mailbox,
+                      time_t min_valid_period, char** token, char** issuer,
+                      unsigned long* expires_at) {
+  if (mailbox == NULL || token == NULL || issuer == NULL ||
+      expires_at == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  for (int i = 0; i < TOKEN_MAILBOX_READ_TRIES; i++) {
+    uint64_t seq = __atomic_load_n(&mailbox->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+      continue;
+    }
+    if (__atomic_load_n(&mailbox->closed, __ATOMIC_RELAXED)) {
+      break;
+    }
+    unsigned long exp =
+        __atomic_load_n(&mailbox->expires_at, __ATOMIC_RELAXED);
+    uint32_t token_len =
+        __atomic_load_n(&mailbox->token_len, __ATOMIC_RELAXED);
+    uint32_t issuer_len =
+        __atomic_load_n(&mailbox->issuer_len, __ATOMIC_RELAXED);
+    if (token_len == 0 || (size_t)token_len + issuer_len >
+                              TOKEN_MAILBOX_DATA_SIZE) {
+      if (__atomic_load_n(&mailbox->seq, __ATOMIC_ACQUIRE) == seq) {
+        break;  // consistently empty
+      }
+      continue;
+    }
+    if ((time_t)exp < time(NULL) + (min_valid_period > 0 ? min_valid_period
+                                                         : 0)) {
+      if (__atomic_load_n(&mailbox->seq, __ATOMIC_ACQUIRE) == seq) {
+        break;  // consistently too old
+      }
+      continue;
+    }
+    char* t = secAlloc(token_len + 1);
+    char* s = secAlloc(issuer_len + 1);
+    memcpy(t, mailbox->data, token_len);
+    memcpy(s, mailbox->data + token_len, issuer_len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&mailbox->seq, __ATOMIC_RELAXED) != seq) {
+      secFree(t);
+      secFree(s);
+      continue;
+    }
+    *token      = t;
+    *issuer     = s;
+    *expires_at = exp;
+    return OIDC_SUCCESS;
+  }
+  oidc_errno = OIDC_EMAILBOX;
+  return oidc_errno;
+}
+
+void tokenMailbox_close(const struct tokenMailbox* mailbox) {
+  if (mailbox == NULL) {
+    return;
+  }
+  munmap((void*)mailbox, TOKEN_MAILBOX_SIZE);
+}
@@ -0,0 +1,46 @@
+#ifndef IPC_TOKEN_MAILBOX_H
+#define IPC_TOKEN_MAILBOX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * A token mailbox is a shared memory object per account that only the agent
+ * writes; clients on the same host map it read-only and read the current
+ * access token without contacting the agent. The content is protected by a
+ * sequence lock: @c seq is odd while the agent writes, so readers retry if
+ * @c seq changed while they copied the token.
+ */
+
+#define TOKEN_MAILBOX_MAGIC 0x584d424f  // "OBMX"
+#define TOKEN_MAILBOX_SIZE (16 * 1024)
+
+struct tokenMailbox {
+  uint32_t magic;
+  uint32_t closed;  // set if the mailbox is not written anymore
+  uint64_t seq;
+  uint64_t generation;  // incremented for every published token
+  uint64_t expires_at;
+  uint32_t token_len;
+  uint32_t issuer_len;
+  char     data[];  // the token followed by the issuer
+};
+
+#define TOKEN_MAILBOX_DATA_SIZE \
+  (TOKEN_MAILBOX_SIZE - sizeof(struct tokenMailbox))
+
+char* tokenMailbox_name(const char* socket_path, const char* shortname);
+
+struct tokenMailbox* tokenMailbox_create(const char* name, gid_t group);
+void tokenMailbox_publish(struct tokenMailbox* mailbox, const char* token,
+                          const char* issuer, unsigned long expires_at);
+void tokenMailbox_destroy(struct tokenMailbox* mailbox, const char* name);
+
+const struct tokenMailbox* tokenMailbox_open(const char* name, uid_t owner);
+int  tokenMailbox_read(const struct tokenMailbox* mailbox,
+                       time_t min_valid_period, char** token, char** issuer,
+                       unsigned long* expires_at);
+void tokenMailbox_close(const struct tokenMailbox* mailbox);
+
+#endif  // IPC_TOKEN_MAILBOX_H
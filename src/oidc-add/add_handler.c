@@ -1,10 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
 #include "add_handler.h"
 #include "account/account.h"
 #include "defines/ipc_values.h"
+#include "defines/settings.h"
 #include "ipc/cryptCommunicator.h"
 #include "oidc-add/parse_ipc.h"
 #include "utils/accountUtils.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
 #include "utils/listUtils.h"
 #include "utils/password_entry.h"
 #include "utils/printer.h"
@@ -13,7 +19,11 @@
 #include "utils/stringUtils.h"
 #include "utils/system_runner.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 time_t getPWExpiresInDependingOn(struct arguments* arguments) {
   if (arguments->pw_lifetime.argProvided == ARG_PROVIDED_BUT_USES_DEFAULT &&
@@ -23,18 +33,13 @@ time_t getPWExpiresInDependingOn(struct arguments* arguments) {
   return arguments->pw_lifetime.lifetime;
 }
 
-void add_handleAdd(char* account, struct arguments* arguments) {
-  struct resultWithEncryptionPassword result =
-      getDecryptedAccountAsStringAndPasswordFromFilePrompt(
-          account, arguments->pw_cmd, arguments->pw_file, arguments->pw_env);
-  char* json_p = result.result;
-  if (json_p == NULL) {
-    secFree(result.password);
-    exit(EXIT_FAILURE);
-  }
-  char* password = result.password;
-
-  struct password_entry pw   = {.shortname = account};
+/**
+ * @brief returns the password entry that is sent with an add request
+ * @return a json string; has to be freed after usage
+ */
+static char* _passwordEntryFor(const char* account, char* password,
+                               const struct arguments* arguments) {
+  struct password_entry pw   = {.shortname = (char*)account};
   unsigned char         type = PW_TYPE_PRMT;
   if (arguments->pw_cmd) {
     pwe_setCommand(&pw, arguments->pw_cmd);
@@ -42,7 +47,8 @@ void add_handleAdd(char* account, struct arguments* arguments) {
   }
   if (arguments->pw_lifetime.argProvided) {
     pwe_setPassword(&pw, password);
-    pwe_setExpiresIn(&pw, getPWExpiresInDependingOn(arguments));
+    pwe_setExpiresIn(&pw, getPWExpiresInDependingOn(
+                              (struct arguments*)arguments));
     type |= PW_TYPE_MEM;
   }
   if (arguments->pw_keyring) {
@@ -53,32 +59,298 @@ void add_handleAdd(char* account, struct arguments* arguments) {
     type |= PW_TYPE_MNG;
   }
   pwe_setType(&pw, type);
-  char* pw_str = passwordEntryToJSONString(&pw);
-  secFree(password);
+  return passwordEntryToJSONString(&pw);
+}
 
-  char* res = NULL;
+/**
+ * @brief returns the add request for a decrypted account configuration
+ * @return the request; has to be freed after usage
+ */
+static char* _addRequestFor(const char* json_p, const char* pw_str,
+                            const struct arguments* arguments) {
   if (arguments->lifetime.argProvided) {
-    res = ipc_cryptCommunicate(arguments->remote, REQUEST_ADD_LIFETIME, json_p,
-                               arguments->lifetime.lifetime, pw_str,
-                               arguments->confirm,
-                               arguments->always_allow_idtoken);
-  } else {
-    res = ipc_cryptCommunicate(arguments->remote, REQUEST_ADD, json_p, pw_str,
-                               arguments->confirm,
-                               arguments->always_allow_idtoken);
+    return oidc_sprintf(REQUEST_ADD_LIFETIME, json_p,
+                        arguments->lifetime.lifetime, pw_str,
+                        arguments->confirm, arguments->always_allow_idtoken);
+  }
+  return oidc_sprintf(REQUEST_ADD, json_p, pw_str, arguments->confirm,
+                      arguments->always_allow_idtoken);
+}
+
+void add_handleAdd(char* account, struct arguments* arguments) {
+  struct resultWithEncryptionPassword result =
+      getDecryptedAccountAsStringAndPasswordFromFilePrompt(
+          account, arguments->pw_cmd, arguments->pw_file, arguments->pw_env);
+  char* json_p = result.result;
+  if (json_p == NULL) {
+    secFree(result.password);
+    exit(EXIT_FAILURE);
   }
+  char* password = result.password;
+  if (!arguments->seccomp) {  // no forking with seccomp
+    upgradeOidcFileInBackground(account, password);
+  }
+  char* pw_str = _passwordEntryFor(account, password, arguments);
+  secFree(password);
+  char* request = _addRequestFor(json_p, pw_str, arguments);
   secFree(pw_str);
   secFree(json_p);
+  char* res = ipc_cryptCommunicate(arguments->remote, "%s", request);
+  secFree(request);
   add_parseResponse(res);
 }
 
+/**
+ * An account configuration of a batch add
+ */
+struct batchAccount {
+  const char* shortname;
+  char*       config;  // decrypted configuration; NULL if not decrypted yet
+  char*       password;
+};
+
+/**
+ * @brief decrypts an account configuration with a known password
+ * @return the normalized configuration or @c NULL if the password is wrong.
+ * Has to be freed after usage.
+ */
+static char* _decryptWithPassword(const char* shortname, const char* password) {
+  char* content = decryptOidcFile(shortname, password);
+  if (content == NULL) {
+    return NULL;
+  }
+  struct oidc_account* account = getAccountFromJSON(content);
+  secFree(content);
+  if (account == NULL) {
+    return NULL;
+  }
+  char* json = accountToJSONString(account);
+  secFreeAccount(account);
+  return json;
+}
+
+/**
+ * @brief tries to decrypt the not yet decrypted accounts with @p password
+ * Every account is decrypted in its own process, so that the key derivations
+ * run in parallel, but at most one process per cpu at the same time.
+ */
+static void _decryptInParallel(struct batchAccount* accounts, size_t len,
+                               const char* password, unsigned char parallel) {
+  long max = parallel ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+  if (max < 1) {
+    max = 1;
+  }
+  size_t next = 0;
+  while (next < len) {
+    pid_t  pids[max];
+    int    fds[max];
+    size_t idx[max];
+    long   running = 0;
+    for (; next < len && running < max; next++) {
+      if (accounts[next].config) {
+        continue;
+      }
+      if (!parallel) {
+        accounts[next].config =
+            _decryptWithPassword(accounts[next].shortname, password);
+        running++;
+        continue;
+      }
+      int fd[2];
+      if (pipe(fd) != 0) {
+        break;
+      }
+      pid_t pid = fork();
+      if (pid == -1) {
+        close(fd[0]);
+        close(fd[1]);
+        break;
+      }
+      if (pid == 0) {
+        close(fd[0]);
+        char* json = _decryptWithPassword(accounts[next].shortname, password);
+        if (json) {
+          (void)!write(fd[1], json, strlen(json));
+        }
+        _exit(json ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
+      close(fd[1]);
+      pids[running] = pid;
+      fds[running]  = fd[0];
+      idx[running]  = next;
+      running++;
+    }
+    for (long i = 0; parallel && i < running; i++) {
+      FILE* f    = fdopen(fds[i], "r");
+      char* json = f ? readFILE(f) : NULL;
+      if (f) {
+        fclose(f);
+      } else {
+        close(fds[i]);
+      }
+      int status = 0;
+      waitpid(pids[i], &status, 0);
+      if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS &&
+          strValid(json)) {
+        accounts[idx[i]].config = json;
+      } else {
+        secFree(json);
+      }
+    }
+    if (running == 0) {  // could not start a process
+      break;
+    }
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (accounts[i].config && accounts[i].password == NULL) {
+      accounts[i].password = oidc_strcopy(password);
+    }
+  }
+}
+
+/**
+ * @brief opens the keystore for the accounts of @p accounts that have no
+ * account file
+ * The keystore stays open, so all of its accounts are decrypted with a single
+ * key derivation. With @c --all all accounts of the keystore are appended to
+ * @p accounts.
+ * @return the keystore password or @c NULL if the keystore is not needed or
+ * could not be opened; has to be freed after usage
+ */
+static char* _openKeystoreFor(list_t* accounts, struct arguments* arguments) {
+  if (!keystore_exists()) {
+    return NULL;
+  }
+  unsigned char needed = arguments->all;
+  for (list_node_t* node = accounts->head; node && !needed;
+       node              = node->next) {
+    needed = !oidcFileDoesExist(node->val);
+  }
+  if (!needed) {
+    return NULL;
+  }
+  keystore_keepOpen(1);
+  struct resultWithEncryptionPassword result =
+      _getDecryptedTextAndPasswordWithPromptFor(
+          KEYSTORE_FILENAME, "the keystore", keystore_decryptIndex, 0,
+          arguments->pw_cmd, arguments->pw_file, arguments->pw_env);
+  if (result.result == NULL) {
+    secFree(result.password);
+    return NULL;
+  }
+  if (arguments->all) {
+    cJSON* index = stringToJson(result.result);
+    cJSON* entry;
+    cJSON_ArrayForEach(entry, index) {
+      char* name = getJSONValue(entry, KEYSTORE_KEY_NAME);
+      if (name && findInList(accounts, name) == NULL) {
+        list_rpush(accounts, list_node_new(name));
+      } else {
+        secFree(name);
+      }
+    }
+    secFreeJson(index);
+  }
+  secFree(result.result);
+  return result.password;
+}
+
+/**
+ * @brief adds multiple account configurations with a single request
+ * Each password is only asked once: Once an account was decrypted, all
+ * remaining accounts are tried with the same password (in parallel) before the
+ * user is asked again.
+ */
+void add_handleAddBatch(list_t* accounts, struct arguments* arguments) {
+  char*                keystorePassword = _openKeystoreFor(accounts, arguments);
+  size_t               len              = accounts->len;
+  struct batchAccount* batch = secAlloc(sizeof(struct batchAccount) * len);
+  for (size_t i = 0; i < len; i++) {
+    batch[i].shortname = list_at(accounts, i)->val;
+    if (keystorePassword && !oidcFileDoesExist(batch[i].shortname) &&
+        (batch[i].config =
+             _decryptWithPassword(batch[i].shortname, keystorePassword))) {
+      batch[i].password = oidc_strcopy(keystorePassword);
+    } else if (batch[i].config == NULL) {
+      // files sealed to this host need neither a password nor a prompt
+      batch[i].config = getDecryptedAccountAsStringSealed(batch[i].shortname);
+    }
+  }
+  secFree(keystorePassword);
+  keystore_keepOpen(0);
+  // no forking with seccomp
+  const unsigned char parallel = !arguments->seccomp;
+  for (size_t i = 0; i < len; i++) {
+    if (batch[i].config) {
+      continue;
+    }
+    struct resultWithEncryptionPassword result =
+        getDecryptedAccountAsStringAndPasswordFromFilePrompt(
+            batch[i].shortname, arguments->pw_cmd, arguments->pw_file,
+            arguments->pw_env);
+    if (result.result == NULL) {
+      secFree(result.password);
+      oidc_perror();
+      continue;
+    }
+    batch[i].config   = result.result;
+    batch[i].password = result.password;
+    if (result.password) {
+      _decryptInParallel(batch + i + 1, len - i - 1, result.password,
+                         parallel);
+    }
+  }
+  list_t* requests = list_new();
+  requests->free   = (void (*)(void*))_secFree;
+  list_t* names    = list_new();
+  for (size_t i = 0; i < len; i++) {
+    if (batch[i].config == NULL) {
+      continue;
+    }
+    char* pw_str = _passwordEntryFor(batch[i].shortname, batch[i].password,
+                                     arguments);
+    list_rpush(requests,
+               list_node_new(_addRequestFor(batch[i].config, pw_str, arguments)));
+    list_rpush(names, list_node_new((char*)batch[i].shortname));
+    secFree(pw_str);
+  }
+  if (parallel && len > 0) {
+    const char* filenames[len];
+    const char* passwords[len];
+    for (size_t i = 0; i < len; i++) {
+      filenames[i] = batch[i].shortname;
+      passwords[i] = batch[i].config ? batch[i].password : NULL;
+    }
+    upgradeOidcFilesInBackground(filenames, passwords, len);
+  }
+  for (size_t i = 0; i < len; i++) {
+    secFree(batch[i].config);
+    secFree(batch[i].password);
+  }
+  secFree(batch);
+  if (requests->len == 0) {
+    secFreeList(requests);
+    list_destroy(names);
+    exit(EXIT_FAILURE);
+  }
+  char* requests_str = listToDelimitedString(requests, ",");
+  secFreeList(requests);
+  char* res = ipc_cryptCommunicate(arguments->remote, REQUEST_ADD_BATCH,
+                                   requests_str ?: "");
+  secFree(requests_str);
+  add_parseBatchResponse(res, names);
+  list_destroy(names);
+}
+
 void add_handleRemove(const char* account, struct arguments* arguments) {
   char* res = ipc_cryptCommunicate(arguments->remote, REQUEST_REMOVE, account);
   add_parseResponse(res);
 }
 
 void add_handleRemoveAll(struct arguments* arguments) {
-  char* res = ipc_cryptCommunicate(arguments->remote, REQUEST_REMOVEALL);
+  char* res = ipc_cryptCommunicate(
+      arguments->remote,
+      arguments->revoke ? REQUEST_REMOVEALL_REVOKE : REQUEST_REMOVEALL);
   add_parseResponse(res);
 }
 
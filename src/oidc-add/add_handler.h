@@ -4,6 +4,7 @@
 #include "oidc-add/oidc-add_options.h"
 
 void add_handleAdd(char* account, struct arguments* arguments);
+void add_handleAddBatch(list_t* accounts, struct arguments* arguments);
 void add_handleRemove(const char* account, struct arguments* arguments);
 void add_handleRemoveAll(struct arguments* arguments);
 void add_handlePrint(char* account, struct arguments* arguments);
@@ -9,8 +9,11 @@
 #include "utils/commonFeatures.h"
 #include "utils/disableTracing.h"
 #include "utils/file_io/fileUtils.h"
+#include "utils/file_io/keystore.h"
 #include "utils/ipUtils.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/printer.h"
 
 int main(int argc, char** argv) {
   platform_disable_tracing();
@@ -42,6 +45,10 @@ int main(int argc, char** argv) {
     add_handleRemoveAll(&arguments);
     return EXIT_SUCCESS;
   }
+  if (arguments.revoke) {
+    printError("--revoke can only be used with --remove-all\n");
+    return EXIT_FAILURE;
+  }
   common_assertAgent(arguments.remote);
   if (arguments.lock || arguments.unlock) {
     add_handleLock(arguments.lock, &arguments);
@@ -49,6 +56,37 @@ int main(int argc, char** argv) {
   }
   checkOidcDirExists();
 
+  if (arguments.all) {
+    if (arguments.accounts) {
+      list_destroy(arguments.accounts);  // holds argv, nothing to free
+    }
+    arguments.accounts = getAccountConfigFileList();
+    if (arguments.accounts == NULL ||
+        (arguments.accounts->len == 0 && !keystore_exists())) {
+      printError("No account configured\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (arguments.all || (arguments.accounts && arguments.accounts->len > 1)) {
+    if (arguments.remove || arguments.print) {
+      printError("Only a single account can be removed or printed\n");
+      exit(EXIT_FAILURE);
+    }
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(arguments.accounts, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      if (!accountConfigExists(node->val)) {
+        printError("%s: ", (char*)node->val);
+        oidc_errno = OIDC_ENOACCOUNT;
+        oidc_perror();
+        exit(EXIT_FAILURE);
+      }
+    }
+    list_iterator_destroy(it);
+    add_handleAddBatch(arguments.accounts, &arguments);
+    return EXIT_SUCCESS;
+  }
+
   char* account = arguments.args[0];
   if (!accountConfigExists(account)) {
     if (!(arguments.remove && arguments.remote)) {  // If connected with
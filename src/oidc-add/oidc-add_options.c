@@ -14,12 +14,22 @@
 #define OPT_PW_FILE 7
 #define OPT_REMOTE 8
 #define OPT_PW_ENV 9
+#define OPT_ALL 10
+#define OPT_REVOKE 11
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "General:", 1},
     {"remove", 'r', 0, 0, "The account configuration is removed, not added", 1},
     {"remove-all", 'R', 0, 0,
      "Removes all account configurations currently loaded", 1},
+    {"revoke", OPT_REVOKE, 0, 0,
+     "With --remove-all: Also revokes the refresh tokens of the removed "
+     "account configurations. The revocation is done in the background.",
+     1},
+    {"all", OPT_ALL, 0, 0,
+     "Adds all configured account configurations. Passwords are asked only "
+     "once if multiple configurations use the same one.",
+     1},
     {"list", 'l', 0, 0, "Lists all configured account configurations", 1},
     {"loaded", 'a', 0, 0, "Lists the currently loaded account configurations",
      1},
@@ -124,18 +134,24 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
       break;
     case OPT_SECCOMP: arguments->seccomp = 1; break;
     case OPT_REMOTE: arguments->remote = 1; break;
+    case OPT_ALL: arguments->all = 1; break;
+    case OPT_REVOKE: arguments->revoke = 1; break;
     case 'h':
       argp_state_help(state, state->out_stream, ARGP_HELP_STD_HELP);
       break;
     case ARGP_KEY_ARG:
-      if (state->arg_num >= 1) {
-        argp_usage(state);
+      if (state->arg_num == 0) {
+        arguments->args[0] = arg;
+      }
+      if (arguments->accounts == NULL) {
+        arguments->accounts = list_new();
       }
-      arguments->args[state->arg_num] = arg;
+      list_rpush(arguments->accounts, list_node_new(arg));
       break;
     case ARGP_KEY_END:
       if (arguments->listConfigured || arguments->listLoaded ||
-          arguments->lock || arguments->unlock || arguments->removeAll) {
+          arguments->lock || arguments->unlock || arguments->removeAll ||
+          arguments->all) {
         break;
       }
       if (state->arg_num < 1) {
@@ -147,16 +163,19 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
   return 0;
 }
 
-static char args_doc[] = "ACCOUNT_SHORTNAME | -a | -l | -x | -X | -R";
+static char args_doc[] =
+    "ACCOUNT_SHORTNAME | --all | -a | -l | -x | -X | -R";
 
 static char doc[] =
-    "oidc-add -- A client for adding and removing accounts to the oidc-agent";
+    "oidc-add -- A client for adding and removing accounts to the oidc-agent"
+    "\vMultiple ACCOUNT_SHORTNAMEs can be given to add them at once.";
 
 struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
 
 void initArguments(struct arguments* arguments) {
   arguments->remove                  = 0;
   arguments->removeAll               = 0;
+  arguments->revoke                  = 0;
   arguments->debug                   = 0;
   arguments->verbose                 = 0;
   arguments->listConfigured          = 0;
@@ -167,6 +186,8 @@ void initArguments(struct arguments* arguments) {
   arguments->lock                    = 0;
   arguments->unlock                  = 0;
   arguments->args[0]                 = NULL;
+  arguments->accounts                = NULL;
+  arguments->all                     = 0;
   arguments->seccomp                 = 0;
   arguments->pw_lifetime.argProvided = 0;
   arguments->pw_lifetime.lifetime    = 0;
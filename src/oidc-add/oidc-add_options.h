@@ -2,19 +2,22 @@
 #define OIDC_ADD_OPTIONS_H
 
 #include "utils/lifetimeArg.h"
+#include "wrapper/list.h"
 
 #include <argp.h>
 
 #define ARG_PROVIDED_BUT_USES_DEFAULT 2
 
 struct arguments {
-  char* args[1]; /* account */
+  char*   args[1];  /* account */
+  list_t* accounts; /* all given accounts; has at least one element */
   char* pw_cmd;
   char* pw_file;
   char* pw_env;
 
   unsigned char remove;
   unsigned char removeAll;
+  unsigned char revoke;
   unsigned char debug;
   unsigned char verbose;
   unsigned char listConfigured;
@@ -28,6 +31,7 @@ struct arguments {
   unsigned char always_allow_idtoken;
   unsigned char pw_prompt_mode;
   unsigned char remote;
+  unsigned char all;
 
   struct lifetimeArg pw_lifetime;
   struct lifetimeArg lifetime;
@@ -69,3 +69,53 @@ void add_parseLoadedAccountsResponse(char* res) {
       printable);
   secFree(printable);
 }
+
+/**
+ * @brief parses the response to a batch of add requests
+ * Prints the result for every account of @p accounts; exits with failure if
+ * any of them could not be loaded.
+ */
+void add_parseBatchResponse(char* res, const list_t* accounts) {
+  if (NULL == res) {
+    printError("Error: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  INIT_KEY_VALUE(OIDC_KEY_ERROR, IPC_KEY_RESPONSES);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    printError("Could not decode json: %s\n", res);
+    printError("This seems to be a bug. Please hand in a bug report.\n");
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  KEY_VALUE_VARS(error, responses);
+  if (_error != NULL) {
+    printError("Error: %s\n", _error);
+    SEC_FREE_KEY_VALUES();
+    exit(EXIT_FAILURE);
+  }
+  list_t* list = _responses ? JSONArrayStringToList(_responses) : NULL;
+  SEC_FREE_KEY_VALUES();
+  if (list == NULL || list->len != accounts->len) {
+    secFreeList(list);
+    printError("Error: Received wrong number of responses\n");
+    exit(EXIT_FAILURE);
+  }
+  int failed = 0;
+  for (size_t i = 0; i < list->len; i++) {
+    const char* shortname = list_at((list_t*)accounts, i)->val;
+    char* error = getJSONValueFromString(list_at(list, i)->val, OIDC_KEY_ERROR);
+    if (error) {
+      printError("%s: Error: %s\n", shortname, error);
+      secFree(error);
+      failed = 1;
+    } else {
+      printStdout("%s: Account loaded\n", shortname);
+    }
+  }
+  secFreeList(list);
+  if (failed) {
+    exit(EXIT_FAILURE);
+  }
+}
@@ -1,7 +1,10 @@
 #ifndef PARSE_IPC_ADD_H
 #define PARSE_IPC_ADD_H
 
+#include "wrapper/list.h"
+
 void add_parseResponse(char* res);
 void add_parseLoadedAccountsResponse(char* res);
+void add_parseBatchResponse(char* res, const list_t* accounts);
 
 #endif  // PARSE_IPC_ADD_H
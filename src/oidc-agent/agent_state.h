@@ -8,6 +8,10 @@
 struct agent_state {
   time_t            defaultTimeout;
   struct lock_state lock_state;
+  unsigned char     worker;  // index of this oidcd worker
+  unsigned char     peers;   // if refreshes are coordinated with peer agents
+  unsigned char     multi_user;  // if accounts are loaded by multiple users
+  const char*       handover;    // accounts handed over to a new oidcd
 };
 
 extern struct agent_state agent_state;
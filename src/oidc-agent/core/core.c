@@ -0,0 +1,298 @@
+#include "core.h"
+#include "account/issuer.h"
+#include "account/tokenCache.h"
+#include "oidc-agent/http/http_handler.h"
+#include "oidc-agent/http/http_transport.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
+#include "oidc-agent/oidcd/oidcd.h"
+#include "oidc-agent/oidcd/oidcd_handler.h"
+#include "oidc-agent/oidcp/proxy_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+
+/**
+ * liboidc-agent-core runs the token management of oidcd in the calling
+ * process, for services that do not want to talk to an agent. Accounts are
+ * kept in the account database of oidcd and tokens are obtained with its
+ * flows, so they are cached, refreshed, and rotated like in the agent; only
+ * the background work of the agent's event loop, e.g. prefetching, is not
+ * done. What oidcd passes to oidcp is handled here instead: rotated refresh
+ * tokens are written to the config file and new default access tokens are
+ * passed to the subscribers. All https requests use one persistent curl
+ * handle in this process, like the http worker of the agent does.
+ *
+ * oidcd is single threaded, so all calls are serialized with one lock.
+ * Subscribers are called after it was released.
+ */
+
+struct coreAccount {  // a loaded account config
+  char* shortname;
+  char* password;  // to write rotated refresh tokens
+};
+
+struct subscription {
+  char*                   shortname;
+  oidcagent_core_callback callback;
+  void*                   arg;
+};
+
+struct refreshedToken {
+  char*                       shortname;
+  struct oidcagent_core_token token;
+};
+
+static pthread_once_t  initialized   = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock          = PTHREAD_MUTEX_INITIALIZER;
+static list_t*         accounts      = NULL;  // of struct coreAccount
+static list_t*         subscriptions = NULL;  // of struct subscription
+static list_t*         refreshed     = NULL;  // not yet passed to subscribers
+
+// oidcd's flows pass these pipes to oidcp; there is no oidcp
+static const struct ipcPipe noPipes = {.rx = -1, .tx = -1};
+
+static void _secFreeCoreAccount(struct coreAccount* a) {
+  secFree(a->shortname);
+  secFree(a->password);
+  secFree(a);
+}
+
+static int _matchCoreAccount(const struct coreAccount* a,
+                             const char*               shortname) {
+  return strequal(a->shortname, shortname);
+}
+
+static void _secFreeSubscription(struct subscription* s) {
+  secFree(s->shortname);
+  secFree(s);
+}
+
+static void _secFreeRefreshedToken(struct refreshedToken* r) {
+  secFree(r->shortname);
+  oidcagent_core_freeToken(r->token);
+  secFree(r);
+}
+
+static void _updateRefreshToken(const char* shortname, size_t slot,
+                                const char* refresh_token) {
+  list_node_t* node = findInList(accounts, shortname);
+  if (node == NULL) {
+    return;
+  }
+  const struct coreAccount* a = node->val;
+  if (updateRefreshTokenUsingPassword(shortname, slot, refresh_token,
+                                      a->password) != OIDC_SUCCESS) {
+    agent_log(WARNING,
+              "Could not write the new refresh token of '%s' to the config "
+              "file: %s",
+              shortname, oidc_serror());
+  }
+}
+
+static void _tokenRefreshed(const struct oidc_account* account) {
+  if (subscriptions->len == 0) {
+    return;
+  }
+  struct refreshedToken* r = secAlloc(sizeof(struct refreshedToken));
+  r->shortname             = oidc_strcopy(account_getName(account));
+  r->token.token           = oidc_strcopy(account_getAccessToken(account));
+  r->token.issuer          = oidc_strcopy(account_getIssuerUrl(account));
+  r->token.expires_at      = account_getTokenExpiresAt(account);
+  list_rpush(refreshed, list_node_new(r));
+}
+
+static const struct oidcd_inProcessHandlers handlers = {
+    .updateRefreshToken = _updateRefreshToken,
+    .tokenRefreshed     = _tokenRefreshed};
+
+static void _init() {
+  logger_open("liboidc-agent-core");
+  initCrypt();
+  initMemoryCrypt();
+  issuer_enableInterning();
+  oidcd_initDBs();
+  enablePersistentCurlHandle();
+  httpTransport_use(&httpTransport_inProcess);
+  oidcd_setInProcessHandlers(&handlers);
+  accounts            = list_new();
+  accounts->free      = (void (*)(void*))_secFreeCoreAccount;
+  accounts->match     = (matchFunction)_matchCoreAccount;
+  subscriptions       = list_new();
+  subscriptions->free = (void (*)(void*))_secFreeSubscription;
+  refreshed           = list_new();
+  refreshed->free     = (void (*)(void*))_secFreeRefreshedToken;
+}
+
+static void _lock() {
+  pthread_once(&initialized, _init);
+  pthread_mutex_lock(&lock);
+}
+
+/**
+ * @brief releases the lock and passes the refreshed tokens to the subscribers
+ */
+static void _unlockAndNotify() {
+  if (refreshed->len == 0) {
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+  list_t* tokens  = refreshed;
+  refreshed       = list_new();
+  refreshed->free = (void (*)(void*))_secFreeRefreshedToken;
+  // the subscriptions might change while they are called
+  list_t* calls = list_new();
+  calls->free   = (void (*)(void*))_secFreeSubscription;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(subscriptions, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct subscription* s    = node->val;
+    struct subscription*       copy = secAlloc(sizeof(struct subscription));
+    copy->shortname                 = oidc_strcopy(s->shortname);
+    copy->callback                  = s->callback;
+    copy->arg                       = s->arg;
+    list_rpush(calls, list_node_new(copy));
+  }
+  list_iterator_destroy(it);
+  pthread_mutex_unlock(&lock);
+  it = list_iterator_new(tokens, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct refreshedToken* r = node->val;
+    for (list_node_t* c = calls->head; c; c = c->next) {
+      const struct subscription* s = c->val;
+      if (strequal(s->shortname, r->shortname)) {
+        s->callback(r->shortname, &r->token, s->arg);
+      }
+    }
+  }
+  list_iterator_destroy(it);
+  secFreeList(calls);
+  secFreeList(tokens);
+}
+
+static void _removeAccount(const char* shortname) {
+  struct oidc_account key = {.shortname = (char*)shortname};
+  accountDB_removeIfFound(&key);
+  accountStats_remove(shortname);
+  list_node_t* node = findInList(accounts, shortname);
+  if (node) {
+    list_remove(accounts, node);
+  }
+}
+
+int oidcagent_core_loadAccount(const char* accountname, const char* password) {
+  if (accountname == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  pthread_once(&initialized, _init);
+  // the key derivation is thread-safe and does not need the lock
+  struct oidc_account* account =
+      getDecryptedAccountFromFile(accountname, password);
+  if (account == NULL) {
+    return oidc_errno;
+  }
+  _lock();
+  _removeAccount(accountname);  // it is loaded again
+  struct coreAccount* a = secAlloc(sizeof(struct coreAccount));
+  a->shortname          = oidc_strcopy(accountname);
+  a->password           = oidc_strcopy(password);
+  list_rpush(accounts, list_node_new(a));
+  const oidc_error_t e = addAccount(noPipes, account);
+  if (e != OIDC_SUCCESS) {
+    secFreeAccount(account);
+    _removeAccount(accountname);
+    oidc_errno = e;
+  }
+  _unlockAndNotify();
+  return e;
+}
+
+void oidcagent_core_removeAccount(const char* accountname) {
+  if (accountname == NULL) {
+    return;
+  }
+  _lock();
+  _removeAccount(accountname);
+  _unlockAndNotify();
+}
+
+struct oidcagent_core_token oidcagent_core_getToken(const char* accountname,
+                                                    time_t min_valid_period,
+                                                    const char* scope,
+                                                    const char* audience) {
+  struct oidcagent_core_token token = {};
+  if (accountname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return token;
+  }
+  _lock();
+  struct oidc_account* account = db_findAccountByShortname(accountname);
+  if (account == NULL) {
+    oidc_errno = OIDC_ENOACCOUNT;
+    _unlockAndNotify();
+    return token;
+  }
+  // like oidcd, the account is only decrypted if a refresh is needed
+  char* access_token =
+      getValidCachedAccessToken(account, min_valid_period, scope, audience);
+  if (access_token == NULL) {
+    _db_decryptFoundAccount(account);
+    access_token = getAccessTokenUsingRefreshFlow(account, min_valid_period,
+                                                  scope, audience, noPipes);
+    db_addAccountEncrypted(account);  // reencrypting
+  }
+  if (access_token) {
+    token.token  = oidc_strcopy(access_token);
+    token.issuer = oidc_strcopy(account_getIssuerUrl(account));
+    token.expires_at = account_getTokenExpiresAtFor(account, scope, audience);
+  }
+  _unlockAndNotify();
+  return token;
+}
+
+int oidcagent_core_subscribe(const char*             accountname,
+                             oidcagent_core_callback callback, void* arg) {
+  if (accountname == NULL || callback == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct subscription* s = secAlloc(sizeof(struct subscription));
+  s->shortname           = oidc_strcopy(accountname);
+  s->callback            = callback;
+  s->arg                 = arg;
+  _lock();
+  list_rpush(subscriptions, list_node_new(s));
+  _unlockAndNotify();
+  return OIDC_SUCCESS;
+}
+
+void oidcagent_core_unsubscribe(const char*             accountname,
+                                oidcagent_core_callback callback, void* arg) {
+  _lock();
+  for (list_node_t* node = subscriptions->head; node; node = node->next) {
+    const struct subscription* s = node->val;
+    if (s->callback == callback && s->arg == arg &&
+        strequal(s->shortname, accountname)) {
+      list_remove(subscriptions, node);
+      break;
+    }
+  }
+  _unlockAndNotify();
+}
+
+const char* oidcagent_core_serror() { return oidc_serror(); }
+
+void oidcagent_core_freeToken(struct oidcagent_core_token token) {
+  secFree(token.token);
+  secFree(token.issuer);
+}
@@ -0,0 +1,96 @@
+#ifndef OIDC_AGENT_CORE_H
+#define OIDC_AGENT_CORE_H
+
+#include "oidc-token/export_symbols.h"
+
+#include <time.h>
+
+/**
+ * @struct oidcagent_core_token core.h
+ * @brief an access token, the associated issuer, and the expiration time of
+ * the token
+ */
+LIB_PUBLIC struct oidcagent_core_token {
+  char*  token;
+  char*  issuer;
+  time_t expires_at;
+};
+
+/**
+ * @brief loads an account config into this process
+ * The config is read from the oidc-agent directory and decrypted with
+ * @p password. Like @c oidc-add, an access token is obtained to check the
+ * config. Rotated refresh tokens are written back to the config file.
+ * @param accountname the short name of the account config
+ * @param password the encryption password of the account config
+ * @return @c 0 on success; otherwise an error code and @c oidcagent_core_serror
+ * describes the error
+ */
+LIB_PUBLIC int oidcagent_core_loadAccount(const char* accountname,
+                                          const char* password);
+
+/**
+ * @brief removes a loaded account config from this process
+ * @param accountname the short name of the account config
+ */
+LIB_PUBLIC void oidcagent_core_removeAccount(const char* accountname);
+
+/**
+ * @brief gets a valid access token for a loaded account config
+ * The token is obtained the same way the agent does it, but in this process:
+ * a cached token is returned if it is valid long enough, otherwise it is
+ * refreshed with the refresh token.
+ * @param accountname the short name of the account config
+ * @param min_valid_period the minimum period of time the access token has to
+ * be valid in seconds; @c -1 for a new token
+ * @param scope a space delimited list of scope values; @c NULL for the default
+ * scope of the account config
+ * @param audience the audience of the access token; might be @c NULL
+ * @return the token, issuer, and expiration time; has to be freed after usage
+ * using @c oidcagent_core_freeToken. On failure the token is @c NULL and
+ * @c oidcagent_core_serror describes the error.
+ */
+LIB_PUBLIC struct oidcagent_core_token oidcagent_core_getToken(
+    const char* accountname, time_t min_valid_period, const char* scope,
+    const char* audience);
+
+/**
+ * @brief called with every new default access token of an account config
+ * The token is only valid during the call.
+ */
+typedef void (*oidcagent_core_callback)(
+    const char* accountname, const struct oidcagent_core_token* token,
+    void* arg);
+
+/**
+ * @brief subscribes to the new default access tokens of an account config
+ * The callback is called from the thread whose request refreshed the token,
+ * after the library released its lock, so it might call the library again.
+ * @param accountname the short name of the account config
+ * @param callback the function to be called
+ * @param arg passed to @p callback
+ * @return @c 0 on success; otherwise an error code
+ */
+LIB_PUBLIC int oidcagent_core_subscribe(const char*             accountname,
+                                        oidcagent_core_callback callback,
+                                        void*                   arg);
+
+/**
+ * @brief ends a subscription of @c oidcagent_core_subscribe
+ */
+LIB_PUBLIC void oidcagent_core_unsubscribe(const char*             accountname,
+                                           oidcagent_core_callback callback,
+                                           void*                   arg);
+
+/**
+ * @brief gets an error string detailing the last error of this thread
+ * @return the error string. MUST NOT be freed.
+ */
+LIB_PUBLIC const char* oidcagent_core_serror();
+
+/**
+ * @brief clears and frees a token returned by @c oidcagent_core_getToken
+ */
+LIB_PUBLIC void oidcagent_core_freeToken(struct oidcagent_core_token token);
+
+#endif  // OIDC_AGENT_CORE_H
@@ -5,13 +5,150 @@
 #include "utils/agentLogger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
-#include "utils/pass.h"
+#include "utils/probes.h"
 #include "utils/stringUtils.h"
 
 #include <curl/curl.h>
 
 #include <stdlib.h>
 
+static void _cleanupTransfer(struct http_transfer* transfer) {
+  if (transfer->curl) {
+    cleanup(transfer->curl);
+  }
+  secFree(transfer->s.ptr);
+  jsonStreamFilter_free(&transfer->filter);
+  curl_slist_free_all(transfer->headers);
+  secFree(transfer->bearer_header);
+  *transfer = (struct http_transfer){0};
+}
+
+/**
+ * @brief prepares the curl handle for a request without performing it
+ * @param transfer the transfer that is initialized; has to be passed to
+ * @c _httpsFinish after the request was performed
+ * @param request the request; has to be valid until @c _httpsFinish returns
+ * @return an error code
+ */
+oidc_error_t _httpsPrepare(struct http_transfer*      transfer,
+                           const struct http_request* request) {
+  agent_log(DEBUG, "Https %s to: %s", request->method, request->url);
+  *transfer      = (struct http_transfer){0};
+  CURL* curl     = init();
+  transfer->curl = curl;
+  if (curl == NULL) {
+    return oidc_errno;
+  }
+  setUrl(curl, request->url);
+  setHttpOptions(curl, request->options);
+  struct curl_slist* headers = request->headers;
+  unsigned char hedged = strequal(request->method, HTTP_METHOD_POST) &&
+                         request->options && request->options->hedge;
+  if (strequal(request->method, HTTP_METHOD_HEAD)) {
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  } else if (request->fields && !hedged) {
+    if (jsonStreamFilter_init(&transfer->filter, request->fields) !=
+        OIDC_SUCCESS) {
+      _cleanupTransfer(transfer);
+      return oidc_errno;
+    }
+    transfer->filtered = 1;
+    setFilteredWriteFunction(curl, &transfer->filter);
+  } else if (setWriteFunction(curl, &transfer->s) != OIDC_SUCCESS) {
+    _cleanupTransfer(transfer);
+    return oidc_errno;
+  }
+  if (strequal(request->method, HTTP_METHOD_POST)) {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    setPostData(curl, request->data ?: "");
+    if (request->username) {
+      setBasicAuth(curl, request->username, request->password ?: "");
+    }
+  } else if (strequal(request->method, HTTP_METHOD_DELETE)) {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+    transfer->bearer_header =
+        oidc_sprintf("Authorization: Bearer %s", request->bearer_token);
+    headers = curl_slist_append(headers, transfer->bearer_header);
+    if (request->headers == NULL) {
+      transfer->headers = headers;
+    }
+  }
+  if (strequal(request->method, HTTP_METHOD_GET) && request->cache_info) {
+    setCacheInfoFunction(curl, request->cache_info);
+  } else {
+    setHeaderFunction(curl, NULL);
+  }
+  setSSLOpts(curl, request->cert_path);
+  setHeaders(curl, headers);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the response of a performed request and frees the transfer
+ * An error response with a body is returned like a success, so the caller can
+ * parse the error; except for a @c 429 or @c 503 response that asks to retry
+ * later, so the caller sees the status and can back off. For a GET with cache
+ * information only a success is returned, a @c 304 response as empty string.
+ * For a HEAD request every http status is a success and a string with the
+ * status code is returned. A filtered response only contains the requested
+ * fields.
+ * @param err the result of performing the request
+ * @return a pointer to the response. Has to be freed after usage. If the Https
+ * call failed, NULL is returned.
+ */
+char* _httpsFinish(struct http_transfer*      transfer,
+                   const struct http_request* request, oidc_error_t err) {
+  unsigned char is_status = err >= 200 && err < 600;
+  char*         res       = NULL;
+  if (transfer->filtered && (err == OIDC_SUCCESS || is_status)) {
+    transfer->s.ptr = jsonStreamFilter_finish(&transfer->filter);
+  }
+  if (strequal(request->method, HTTP_METHOD_HEAD)) {
+    if (err == OIDC_SUCCESS || is_status) {
+      res = oidc_sprintf("HTTP %ld", getResponseCode(transfer->curl));
+    }
+  } else if (request->cache_info) {
+    if (err == OIDC_SUCCESS && transfer->s.ptr) {
+      request->cache_info->status = getResponseCode(transfer->curl);
+      res                         = transfer->s.ptr;
+      transfer->s.ptr             = NULL;
+      agent_log(DEBUG, "Response (%ld): %s\n", request->cache_info->status,
+                res);
+    } else {
+      secFreeCacheInfoContent(request->cache_info);
+    }
+  } else if (err == OIDC_SUCCESS ||
+             (is_status && strValid(transfer->s.ptr) &&
+              !((err == 429 || err == 503) && getRetryAfter() >= 0))) {
+    res             = transfer->s.ptr;
+    transfer->s.ptr = NULL;
+    agent_log(DEBUG, "Response: %s\n", res ?: "(null)");
+  }
+  _cleanupTransfer(transfer);
+  return res;
+}
+
+/**
+ * @brief does a https request in this process
+ * Only POST requests are hedged, if enabled in the options.
+ * @return a pointer to the response. Has to be freed after usage. If the Https
+ * call failed, NULL is returned.
+ */
+char* _httpsPerform(const struct http_request* request) {
+  struct http_transfer transfer;
+  if (_httpsPrepare(&transfer, request) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  OIDC_PROBE2(http_start, request->method, request->url);
+  oidc_error_t err =
+      strequal(request->method, HTTP_METHOD_POST)
+          ? performWithOptions(transfer.curl, &transfer.s, request->url,
+                               request->options)
+          : perform(transfer.curl);
+  OIDC_PROBE3(http_end, request->url, getResponseCode(transfer.curl), err);
+  return _httpsFinish(&transfer, request, err);
+}
+
 /** @fn char* httpsGET(const char* url, const char* cert_path)
  * @brief does a https GET request
  * @param url the request url
@@ -20,28 +157,38 @@
  * call failed, NULL is returned.
  */
 char* _httpsGET(const char* url, struct curl_slist* headers,
-                const char* cert_path) {
-  agent_log(DEBUG, "Https GET to: %s", url);
-  CURL* curl = init();
-  setUrl(curl, url);
-  struct string s;
-  if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
-    return NULL;
-  }
-  setSSLOpts(curl, cert_path);
-  setHeaders(curl, headers);
-  oidc_error_t err = perform(curl);
-  if (err != OIDC_SUCCESS) {
-    if (err >= 200 && err < 600 && strValid(s.ptr)) {
-      pass;
-    } else {
-      secFree(s.ptr);
-      return NULL;
-    }
-  }
-  cleanup(curl);
-  agent_log(DEBUG, "Response: %s\n", s.ptr);
-  return s.ptr;
+                const char* cert_path, const struct http_options* options) {
+  return _httpsPerform(&(struct http_request){.method    = HTTP_METHOD_GET,
+                                              .url       = url,
+                                              .headers   = headers,
+                                              .cert_path = cert_path,
+                                              .options   = options});
+}
+
+/**
+ * @brief does a https GET request and collects caching information
+ * A @c 304 response is not an error; in that case an empty string is returned
+ * and @c info->status is set accordingly.
+ * @param url the request url
+ * @param headers additional request headers, e.g. @c If-None-Match
+ * @param cert_path the path to the SSL certs
+ * @param info the struct where the status code, @c ETag and @c max-age of the
+ * response are stored. Its content has to be freed after usage.
+ * @param options the limits for the request; might be @c NULL
+ * @return a pointer to the response body. Has to be freed after usage. If the
+ * Https call failed, NULL is returned.
+ */
+char* _httpsGETWithCacheInfo(const char* url, struct curl_slist* headers,
+                             const char*                cert_path,
+                             struct http_cacheInfo*     info,
+                             const struct http_options* options) {
+  *info = (struct http_cacheInfo){0, -1, NULL};
+  return _httpsPerform(&(struct http_request){.method     = HTTP_METHOD_GET,
+                                              .url        = url,
+                                              .headers    = headers,
+                                              .cert_path  = cert_path,
+                                              .cache_info = info,
+                                              .options    = options});
 }
 
 /** @fn char* httpsDELETE(const char* url, const char* cert_path)
@@ -52,35 +199,15 @@ char* _httpsGET(const char* url, struct curl_slist* headers,
  * call failed, NULL is returned.
  */
 char* _httpsDELETE(const char* url, struct curl_slist* headers,
-                   const char* cert_path, const char* bearer_token) {
-  agent_log(DEBUG, "Https GET to: %s", url);
-  CURL* curl = init();
-  setUrl(curl, url);
-  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-  struct string s;
-  if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
-    return NULL;
-  }
-  setSSLOpts(curl, cert_path);
-  char* bearer_header = oidc_sprintf("Authorization: Bearer %s", bearer_token);
-  headers             = curl_slist_append(headers, bearer_header);
-  setHeaders(curl, headers);
-  // if (bearer_token) {
-  //   setTokenAuth(curl, bearer_token);
-  // }
-  oidc_error_t err = perform(curl);
-  secFree(bearer_header);
-  if (err != OIDC_SUCCESS) {
-    if (err >= 200 && err < 600 && strValid(s.ptr)) {
-      pass;
-    } else {
-      secFree(s.ptr);
-      return NULL;
-    }
-  }
-  cleanup(curl);
-  agent_log(DEBUG, "Response: %s\n", s.ptr);
-  return s.ptr;
+                   const char* cert_path, const char* bearer_token,
+                   const struct http_options* options) {
+  return _httpsPerform(
+      &(struct http_request){.method       = HTTP_METHOD_DELETE,
+                             .url          = url,
+                             .headers      = headers,
+                             .cert_path    = cert_path,
+                             .bearer_token = bearer_token,
+                             .options      = options});
 }
 
 /** @fn char* httpsPOST(const char* url, const char* data, const char*
@@ -89,37 +216,38 @@ char* _httpsDELETE(const char* url, struct curl_slist* headers,
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @param data the data to be posted
+ * @param options the limits for the request; might be @c NULL. Hedging is
+ * only used for POST requests.
  * @return a pointer to the response. Has to be freed after usage. If the Https
  * call failed, NULL is returned.
  */
 char* _httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                  const char* cert_path, const char* username,
-                 const char* password) {
-  agent_log(DEBUG, "Https POST to: %s", url);
-  CURL* curl = init();
-  setUrl(curl, url);
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  struct string s;
-  if (setWriteFunction(curl, &s) != OIDC_SUCCESS) {
-    return NULL;
-  }
-  setPostData(curl, data);
-  setSSLOpts(curl, cert_path);
-  setHeaders(curl, headers);
-  if (username) {
-    setBasicAuth(curl, username, password ?: "");
-  }
-  oidc_error_t err = perform(curl);
-  if (err != OIDC_SUCCESS) {
-    if (err >= 200 && err < 600 && strValid(s.ptr)) {
-      pass;
-    } else {
-      secFree(s.ptr);
-      cleanup(curl);
-      return NULL;
-    }
-  }
-  cleanup(curl);
-  agent_log(DEBUG, "Response: %s\n", s.ptr ? s.ptr : "(null)");
-  return s.ptr;
+                 const char* password, const struct http_options* options) {
+  return _httpsPerform(&(struct http_request){.method    = HTTP_METHOD_POST,
+                                              .url       = url,
+                                              .data      = data,
+                                              .headers   = headers,
+                                              .cert_path = cert_path,
+                                              .username  = username,
+                                              .password  = password,
+                                              .options   = options});
+}
+
+/**
+ * @brief does a https HEAD request; used to open a connection to a host before
+ * it is needed
+ * @param url the request url
+ * @param cert_path the path to the SSL certs
+ * @param options the limits for the request; might be @c NULL
+ * @return a pointer to a string with the status code of the response. Has to
+ * be freed after usage. Every http status is a success; only if no connection
+ * could be established, NULL is returned.
+ */
+char* _httpsHEAD(const char* url, const char* cert_path,
+                 const struct http_options* options) {
+  return _httpsPerform(&(struct http_request){.method    = HTTP_METHOD_HEAD,
+                                              .url       = url,
+                                              .cert_path = cert_path,
+                                              .options   = options});
 }
@@ -1,13 +1,66 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include "http_handler.h"
+
 #include <curl/curl.h>
 
+#define HTTP_METHOD_GET "GET"
+#define HTTP_METHOD_POST "POST"
+#define HTTP_METHOD_DELETE "DELETE"
+#define HTTP_METHOD_HEAD "HEAD"
+
+/**
+ * A https request. Only the fields that apply to @c method are used: @c data,
+ * @c username and @c password for POST, @c bearer_token for DELETE and
+ * @c cache_info for GET. If @c fields is set, only these top-level fields of
+ * a json response are kept while it is received; it is terminated by @c NULL
+ * and ignored for hedged requests. All pointers stay owned by the caller.
+ */
+struct http_request {
+  const char*                method;
+  const char*                url;
+  const char*                data;
+  struct curl_slist*         headers;
+  const char*                cert_path;
+  const char*                username;
+  const char*                password;
+  const char*                bearer_token;
+  struct http_cacheInfo*     cache_info;
+  const struct http_options* options;
+  const char* const*         fields;
+};
+
+/**
+ * A request whose curl handle is prepared, but not yet performed
+ */
+struct http_transfer {
+  CURL*                   curl;
+  struct string           s;
+  struct jsonStreamFilter filter;
+  unsigned char           filtered;
+  struct curl_slist*      headers;  // only set if owned by the transfer
+  char*                   bearer_header;
+};
+
+oidc_error_t _httpsPrepare(struct http_transfer*      transfer,
+                           const struct http_request* request);
+char*        _httpsFinish(struct http_transfer*      transfer,
+                          const struct http_request* request, oidc_error_t err);
+char*        _httpsPerform(const struct http_request* request);
+
 char* _httpsGET(const char* url, struct curl_slist* list,
-                const char* cert_path);
+                const char* cert_path, const struct http_options* options);
+char* _httpsGETWithCacheInfo(const char* url, struct curl_slist* headers,
+                             const char*                cert_path,
+                             struct http_cacheInfo*     info,
+                             const struct http_options* options);
 char* _httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                  const char* cert_path, const char* username,
-                 const char* password);
+                 const char* password, const struct http_options* options);
 char* _httpsDELETE(const char* url, struct curl_slist* headers,
-                   const char* cert_path, const char* bearer_token);
+                   const char* cert_path, const char* bearer_token,
+                   const struct http_options* options);
+char* _httpsHEAD(const char* url, const char* cert_path,
+                 const struct http_options* options);
 #endif
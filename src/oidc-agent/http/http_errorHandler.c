@@ -14,22 +14,20 @@ oidc_error_t handleCURLE_OK(CURL* curl) {
   return oidc_errno;
 }
 
-oidc_error_t handleSSL(int res, CURL* curl) {
+oidc_error_t handleSSL(int res) {
   agent_log(ERROR,
             "%s (%s:%d) HTTPS Request failed: %s Please check the provided "
             "certh_path.\n",
             __func__, __FILE__, __LINE__, curl_easy_strerror(res));
-  curl_easy_cleanup(curl);
   oidc_errno = OIDC_ESSL;
   return oidc_errno;
 }
 
-oidc_error_t handleHost(int res, CURL* curl) {
+oidc_error_t handleHost(int res) {
   agent_log(
       ERROR,
       "%s (%s:%d) HTTPS Request failed: %s Please check the provided URLs.\n",
       __func__, __FILE__, __LINE__, curl_easy_strerror(res));
-  curl_easy_cleanup(curl);
   oidc_errno = OIDC_EURL;
   return oidc_errno;
 }
@@ -38,18 +36,17 @@ oidc_error_t CURLErrorHandling(int res, CURL* curl) {
   switch (res) {
     case CURLE_OK: return handleCURLE_OK(curl);
     case CURLE_URL_MALFORMAT:
-    case CURLE_COULDNT_RESOLVE_HOST: return handleHost(res, curl);
+    case CURLE_COULDNT_RESOLVE_HOST: return handleHost(res);
     case CURLE_SSL_CONNECT_ERROR:
     case CURLE_SSL_CERTPROBLEM:
     case CURLE_SSL_CIPHER:
     case CURLE_SSL_CACERT:
     case CURLE_SSL_CACERT_BADFILE:
     case CURLE_SSL_CRL_BADFILE:
-    case CURLE_SSL_ISSUER_ERROR: return handleSSL(res, curl);
+    case CURLE_SSL_ISSUER_ERROR: return handleSSL(res);
     default:
       agent_log(ERROR, "%s (%s:%d) curl_easy_perform() failed: %s\n", __func__,
                 __FILE__, __LINE__, curl_easy_strerror(res));
-      curl_easy_cleanup(curl);
       oidc_errno = OIDC_EERROR;
       return OIDC_EERROR;
   }
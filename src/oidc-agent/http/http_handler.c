@@ -1,35 +1,397 @@
+#define _POSIX_C_SOURCE 200112L
 #include "http_handler.h"
+#include "defines/settings.h"
 #include "http_errorHandler.h"
 #include "utils/agentLogger.h"
+#include "utils/file_io/file_io.h"
+#include "utils/listUtils.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/oidc_string.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
 
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netdb.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
 
 static size_t write_callback(void* ptr, size_t size, size_t nmemb,
                              struct string* s) {
-  size_t new_len = s->len + size * nmemb;
-  void*  tmp     = secRealloc(s->ptr, new_len + 1);
-  if (tmp == NULL) {
+  if (string_append(s, ptr, size * nmemb) != OIDC_SUCCESS) {
     exit(EXIT_FAILURE);
   }
-  s->ptr = tmp;
-  memcpy(s->ptr + s->len, ptr, size * nmemb);
-  // s->ptr[new_len] = '\0';
-  s->len = new_len;
+  return size * nmemb;
+}
 
+static size_t filter_callback(void* ptr, size_t size, size_t nmemb,
+                              struct jsonStreamFilter* f) {
+  if (jsonStreamFilter_feed(f, ptr, size * nmemb) != OIDC_SUCCESS) {
+    return 0;  // aborts the transfer
+  }
   return size * nmemb;
 }
 
+static void _parseCacheControl(const char* value, struct http_cacheInfo* info) {
+  const char* directive = value;
+  while (directive) {
+    while (isspace((unsigned char)*directive)) { directive++; }
+    if (strncasecmp(directive, "no-store", strlen("no-store")) == 0 ||
+        strncasecmp(directive, "no-cache", strlen("no-cache")) == 0) {
+      info->max_age = 0;
+      return;
+    }
+    if (strncasecmp(directive, "max-age=", strlen("max-age=")) == 0) {
+      info->max_age = strtol(directive + strlen("max-age="), NULL, 10);
+    }
+    directive = strchr(directive, ',');
+    if (directive) {
+      directive++;
+    }
+  }
+}
+
+/**
+ * How long the provider asked us to wait with the next request, as taken from
+ * the @c Retry-After and @c RateLimit headers of the last response; @c -1 if
+ * it did not ask.
+ */
+static long retryAfter         = -1;
+static long rateLimitRemaining = -1;
+static long rateLimitReset     = -1;
+
+static void _resetRateLimitHeaders() {
+  retryAfter         = -1;
+  rateLimitRemaining = -1;
+  rateLimitReset     = -1;
+}
+
+/**
+ * @brief converts a reset value to seconds from now; some providers send the
+ * epoch time instead of a delta
+ */
+static long _resetToSeconds(long reset) {
+  if (reset > 1000000000L) {
+    reset -= (long)time(NULL);
+  }
+  return reset < 0 ? 0 : reset;
+}
+
+/**
+ * @brief parses a @c Retry-After value, either delta seconds or a http date
+ */
+static void _parseRetryAfter(const char* value) {
+  if (isdigit((unsigned char)*value)) {
+    retryAfter = strtol(value, NULL, 10);
+    return;
+  }
+  time_t date = curl_getdate(value, NULL);
+  if (date != -1) {
+    retryAfter = date > time(NULL) ? (long)(date - time(NULL)) : 0;
+  }
+}
+
+/**
+ * @brief parses the structured @c RateLimit header, e.g.
+ * <tt>limit=100, remaining=0, reset=30</tt> or <tt>"default";r=0;t=30</tt>
+ */
+static void _parseRateLimit(const char* value) {
+  const char* param = value;
+  while (param) {
+    while (isspace((unsigned char)*param) || *param == ';' || *param == ',') {
+      param++;
+    }
+    if (strncasecmp(param, "remaining=", strlen("remaining=")) == 0) {
+      rateLimitRemaining = strtol(param + strlen("remaining="), NULL, 10);
+    } else if (strncasecmp(param, "r=", strlen("r=")) == 0) {
+      rateLimitRemaining = strtol(param + strlen("r="), NULL, 10);
+    } else if (strncasecmp(param, "reset=", strlen("reset=")) == 0) {
+      rateLimitReset = strtol(param + strlen("reset="), NULL, 10);
+    } else if (strncasecmp(param, "t=", strlen("t=")) == 0) {
+      rateLimitReset = strtol(param + strlen("t="), NULL, 10);
+    }
+    param = strpbrk(param, ";,");
+  }
+}
+
+static int _isHeader(const char* buffer, size_t name_len, const char* name) {
+  return name_len == strlen(name) && strncasecmp(buffer, name, name_len) == 0;
+}
+
+static void _parseRateLimitHeader(const char* buffer, size_t name_len,
+                                  const char* value) {
+  if (_isHeader(buffer, name_len, "Retry-After")) {
+    _parseRetryAfter(value);
+  } else if (_isHeader(buffer, name_len, "RateLimit")) {
+    _parseRateLimit(value);
+  } else if (_isHeader(buffer, name_len, "RateLimit-Remaining") ||
+             _isHeader(buffer, name_len, "X-RateLimit-Remaining")) {
+    rateLimitRemaining = strtol(value, NULL, 10);
+  } else if (_isHeader(buffer, name_len, "RateLimit-Reset") ||
+             _isHeader(buffer, name_len, "X-RateLimit-Reset")) {
+    rateLimitReset = strtol(value, NULL, 10);
+  }
+}
+
+/**
+ * @param info the struct for the caching related headers; might be @c NULL if
+ * only the rate limit headers are of interest
+ */
+static size_t header_callback(char* buffer, size_t size, size_t nitems,
+                              struct http_cacheInfo* info) {
+  size_t len   = size * nitems;
+  char*  colon = memchr(buffer, ':', len);
+  if (colon == NULL) {
+    if (len > 5 && strncasecmp(buffer, "HTTP/", 5) == 0) {
+      // A new response starts (e.g. after a redirect or 100 Continue)
+      _resetRateLimitHeaders();
+      if (info) {
+        secFreeCacheInfoContent(info);
+      }
+    }
+    return len;
+  }
+  size_t name_len  = colon - buffer;
+  char*  value     = colon + 1;
+  size_t value_len = len - name_len - 1;
+  while (value_len > 0 && isspace((unsigned char)*value)) {
+    value++;
+    value_len--;
+  }
+  while (value_len > 0 && isspace((unsigned char)value[value_len - 1])) {
+    value_len--;
+  }
+  if (info && name_len == strlen("ETag") &&
+      strncasecmp(buffer, "ETag", name_len) == 0) {
+    secFree(info->etag);
+    info->etag = oidc_strncopy(value, value_len);
+  } else if (info && name_len == strlen("Cache-Control") &&
+             strncasecmp(buffer, "Cache-Control", name_len) == 0) {
+    char* v = oidc_strncopy(value, value_len);
+    _parseCacheControl(v, info);
+    secFree(v);
+  } else if (name_len >= strlen("RateLimit") && value_len > 0) {
+    char* v = oidc_strncopy(value, value_len);
+    _parseRateLimitHeader(buffer, name_len, v);
+    secFree(v);
+  }
+  return len;
+}
+
+/**
+ * @brief returns how many seconds the provider asked to wait before the next
+ * request, as sent with the last response of this process
+ * A @c Retry-After header is used as is; the @c RateLimit headers only count
+ * if no requests remain.
+ * @return the seconds or @c -1 if the provider did not ask to wait
+ */
+long getRetryAfter() {
+  if (retryAfter >= 0) {
+    return retryAfter;
+  }
+  if (rateLimitRemaining == 0 && rateLimitReset >= 0) {
+    return _resetToSeconds(rateLimitReset);
+  }
+  return -1;
+}
+
+/**
+ * @brief sets the value returned by @c getRetryAfter, e.g. when the request
+ * was performed by the http worker
+ */
+void setRetryAfter(long seconds) {
+  _resetRateLimitHeaders();
+  retryAfter = seconds;
+}
+
+static unsigned char persistent             = 0;
+static unsigned char persistent_initialized = 0;
+static CURL*         persistent_curl        = NULL;
+static CURLSH*       persistent_share       = NULL;
+
+#if LIBCURL_VERSION_NUM >= 0x073100  // 7.49.0
+#define HTTP_HEDGING
+static list_t* latencies = NULL;  // of struct hostLatencies, per host
+#endif
+
+/**
+ * @brief makes @c init and @c cleanup keep the curl handle between requests.
+ * The easy handle and a share handle for DNS, connection, and TLS session
+ * caches are reused, so consecutive requests to the same host can reuse an
+ * existing connection. Used by the long-lived http worker.
+ */
+void enablePersistentCurlHandle() { persistent = 1; }
+
+#if LIBCURL_VERSION_NUM >= 0x074d00  // 7.77.0
+#define HTTP_CAINFO_BLOB
+/**
+ * CA bundles that were read into memory for the persistent handle, so a
+ * bundle is not read from disk for every request. A bundle is read again if
+ * the file changed.
+ */
+struct caBundle {
+  char*  path;
+  char*  data;
+  time_t mtime;
+  off_t  size;
+};
+
+static list_t* caBundles = NULL;
+
+static void _secFreeCaBundle(struct caBundle* b) {
+  secFree(b->path);
+  secFree(b->data);
+  secFree(b);
+}
+
+static int _matchCaBundle(const struct caBundle* b, const char* path) {
+  return strequal(b->path, path);
+}
+
+static const struct caBundle* _getCaBundle(const char* path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return NULL;
+  }
+  if (caBundles == NULL) {
+    caBundles        = list_new();
+    caBundles->free  = (void (*)(void*))_secFreeCaBundle;
+    caBundles->match = (matchFunction)_matchCaBundle;
+  }
+  list_node_t*     node = findInList(caBundles, path);
+  struct caBundle* b    = node ? node->val : NULL;
+  if (b && b->mtime == st.st_mtime && b->size == st.st_size) {
+    return b;
+  }
+  if (node) {
+    list_remove(caBundles, node);
+  }
+  char* data = readFile(path);
+  if (data == NULL) {
+    return NULL;
+  }
+  b        = secAlloc(sizeof(struct caBundle));
+  b->path  = oidc_strcopy(path);
+  b->data  = data;
+  b->mtime = st.st_mtime;
+  b->size  = st.st_size;
+  list_rpush(caBundles, list_node_new(b));
+  return b;
+}
+#endif
+
+/**
+ * @brief frees the persistent curl handles and does the global cleanup
+ */
+void cleanupPersistentCurlHandle() {
+#ifdef HTTP_CAINFO_BLOB
+  secFreeList(caBundles);
+  caBundles = NULL;
+#endif
+#ifdef HTTP_HEDGING
+  secFreeList(latencies);
+  latencies = NULL;
+#endif
+  if (persistent_curl) {
+    curl_easy_cleanup(persistent_curl);
+    persistent_curl = NULL;
+  }
+  if (persistent_share) {
+    curl_share_cleanup(persistent_share);
+    persistent_share = NULL;
+  }
+  if (persistent_initialized) {
+    curl_global_cleanup();
+    persistent_initialized = 0;
+  }
+}
+
+/**
+ * @brief sets the options of the persistent handle; has to be done again after
+ * every @c curl_easy_reset
+ * HTTP/2 is negotiated when both curl and the server support it, so all
+ * requests to an issuer can be multiplexed over one connection. With
+ * @c CURLOPT_PIPEWAIT a new request waits for a pending connection to the same
+ * host instead of opening a second one.
+ */
+static void _setPersistentOpts(CURL* curl) {
+  curl_easy_setopt(curl, CURLOPT_SHARE, persistent_share);
+#if LIBCURL_VERSION_NUM >= 0x072f00  // 7.47.0
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+                   (long)CURL_HTTP_VERSION_2TLS);  // falls back to HTTP/1.1
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+}
+
+static void* _secAllocHttp(size_t size) {
+  return secAllocTagged(size, MEMTAG_HTTP);
+}
+
+static void* _secCallocHttp(size_t nmemb, size_t size) {
+  return secAllocTagged(nmemb * size, MEMTAG_HTTP);
+}
+
+static char* _strcopyHttp(const char* str) {
+  char* copy = oidc_strcopy(str);
+  secMemTag(copy, MEMTAG_HTTP);
+  return copy;
+}
+
+/**
+ * @brief initializes curl with the secure memory functions; curl's
+ * allocations are counted under @c MEMTAG_HTTP
+ */
+static CURLcode _globalInit() {
+  return curl_global_init_mem(CURL_GLOBAL_ALL, _secAllocHttp, _secFree,
+                              secRealloc, _strcopyHttp, _secCallocHttp);
+}
+
+static CURL* _initPersistent() {
+  if (persistent_curl) {
+    curl_easy_reset(persistent_curl);  // keeps the connection and dns cache
+    _setPersistentOpts(persistent_curl);
+    return persistent_curl;
+  }
+  CURLcode res = _globalInit();
+  if (CURLErrorHandling(res, NULL) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  persistent_initialized = 1;
+  persistent_share       = curl_share_init();
+  if (persistent_share) {
+    curl_share_setopt(persistent_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(persistent_share, CURLSHOPT_SHARE,
+                      CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(persistent_share, CURLSHOPT_SHARE,
+                      CURL_LOCK_DATA_CONNECT);
+  }
+  persistent_curl = curl_easy_init();
+  if (!persistent_curl) {
+    cleanupPersistentCurlHandle();
+    agent_log(ALERT, "%s (%s:%d) Couldn't init curl.\n", __func__, __FILE__,
+              __LINE__);
+    oidc_errno = OIDC_ECURLI;
+    return NULL;
+  }
+  _setPersistentOpts(persistent_curl);
+  return persistent_curl;
+}
+
 /** @fn CURL* init()
  * @brief initializes curl
  * @return a CURL pointer
  */
 CURL* init() {
-  CURLcode res = curl_global_init_mem(CURL_GLOBAL_ALL, secAlloc, _secFree,
-                                      secRealloc, oidc_strcopy, secCalloc);
+  if (persistent) {
+    return _initPersistent();
+  }
+  CURLcode res = _globalInit();
   if (CURLErrorHandling(res, NULL) != OIDC_SUCCESS) {
     return NULL;
   }
@@ -52,9 +414,21 @@ CURL* init() {
 void setSSLOpts(CURL* curl, const char* cert_file) {
   curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
   curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 1L);
-  if (cert_file) {
-    curl_easy_setopt(curl, CURLOPT_CAINFO, cert_file);
+  if (cert_file == NULL) {
+    return;
+  }
+#ifdef HTTP_CAINFO_BLOB
+  if (persistent && curl == persistent_curl) {
+    const struct caBundle* b = _getCaBundle(cert_file);
+    // The blob stays valid until the handle is reset for the next request
+    struct curl_blob blob = {b ? b->data : NULL, b ? strlen(b->data) : 0,
+                             CURL_BLOB_NOCOPY};
+    if (b && curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &blob) == CURLE_OK) {
+      return;
+    }  // e.g. not supported by the TLS backend
   }
+#endif
+  curl_easy_setopt(curl, CURLOPT_CAINFO, cert_file);
 }
 
 /** @fn void setWritefunction(CURL* curl, struct string* s)
@@ -72,6 +446,60 @@ oidc_error_t setWriteFunction(CURL* curl, struct string* s) {
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief sets a filter that only keeps some fields of a json response, instead
+ * of buffering the whole response
+ * @param curl the curl instance
+ * @param f the initialized filter; the result is taken with
+ * @c jsonStreamFilter_finish
+ */
+void setFilteredWriteFunction(CURL* curl, struct jsonStreamFilter* f) {
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, filter_callback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+}
+
+/**
+ * @brief collects the rate limit related response headers, see
+ * @c getRetryAfter
+ * @param curl the curl instance
+ * @param info the struct where the caching related headers will be stored;
+ * might be @c NULL
+ */
+void setHeaderFunction(CURL* curl, struct http_cacheInfo* info) {
+  _resetRateLimitHeaders();
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, info);
+}
+
+/**
+ * @brief collects the caching related response headers into @p info
+ * @param curl the curl instance
+ * @param info the struct where the information will be stored
+ */
+void setCacheInfoFunction(CURL* curl, struct http_cacheInfo* info) {
+  *info = (struct http_cacheInfo){0, -1, NULL};
+  setHeaderFunction(curl, info);
+}
+
+/**
+ * @brief returns the http status code of the last response
+ * @param curl the curl instance
+ */
+long getResponseCode(CURL* curl) {
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  return http_code;
+}
+
+void secFreeCacheInfoContent(struct http_cacheInfo* info) {
+  if (info == NULL) {
+    return;
+  }
+  secFree(info->etag);
+  info->etag    = NULL;
+  info->max_age = -1;
+}
+
 /** @fn void setUrl(CURL* curl, const char* url)
  * @brief sets the url
  * @param curl the curl instance
@@ -112,6 +540,162 @@ void setBasicAuth(CURL* curl, const char* username, const char* password) {
 //   token);
 // }
 
+/**
+ * @brief sets the connect and total timeouts of a request
+ * Transfers that stall are aborted as well, so a request to an unresponsive
+ * issuer never blocks longer than the total timeout.
+ * @param options the limits for the issuer; might be @c NULL to use the
+ * defaults
+ */
+void setHttpOptions(CURL* curl, const struct http_options* options) {
+  long connect_timeout = options && options->connect_timeout
+                             ? options->connect_timeout
+                             : HTTP_DEFAULT_CONNECT_TIMEOUT;
+  long timeout =
+      options && options->timeout ? options->timeout : HTTP_DEFAULT_TIMEOUT;
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, connect_timeout);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long)HTTP_LOW_SPEED_LIMIT);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)HTTP_LOW_SPEED_TIME);
+}
+
+/**
+ * @brief extracts host and port from a https url
+ * @return the host; has to be freed after usage
+ */
+char* hostFromUrl(const char* url, long* port) {
+  const char* start = strstr(url, "://");
+  start             = start ? start + 3 : url;
+  size_t      len   = strcspn(start, "/?#");
+  const char* at    = memchr(start, '@', len);
+  if (at) {
+    len -= at + 1 - start;
+    start = at + 1;
+  }
+  const char* colon = NULL;
+  if (*start == '[') {  // ipv6 literal
+    const char* close = memchr(start, ']', len);
+    if (close == NULL) {
+      return NULL;
+    }
+    colon = close[1] == ':' ? close + 1 : NULL;
+  } else {
+    colon = memchr(start, ':', len);
+  }
+  *port = colon ? strtol(colon + 1, NULL, 10) : 443;
+  return oidc_strncopy(start, colon ? (size_t)(colon - start) : len);
+}
+
+/**
+ * @brief adds the stages of the last transfer as measured by curl to the
+ * request trace
+ * Stages that did not happen, e.g. the connect of a reused connection, are
+ * skipped.
+ */
+static void _traceTransferTimes(CURL* curl) {
+  if (!requestTrace_isActive()) {
+    return;
+  }
+  double end   = metrics_now();
+  double total = 0;
+  if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total) != CURLE_OK) {
+    return;
+  }
+  const struct {
+    CURLINFO    info;
+    const char* stage;
+  } stages[] = {{CURLINFO_CONNECT_TIME, "http_connected"},
+                {CURLINFO_APPCONNECT_TIME, "http_tls_done"},
+                {CURLINFO_STARTTRANSFER_TIME, "http_first_byte"}};
+  for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++) {
+    double t = 0;
+    if (curl_easy_getinfo(curl, stages[i].info, &t) == CURLE_OK && t > 0) {
+      requestTrace_markAt(stages[i].stage, end - total + t);
+    }
+  }
+}
+
+static double _getTime(CURL* curl, CURLINFO info) {
+  double t = 0;
+  return curl_easy_getinfo(curl, info, &t) == CURLE_OK ? t : 0;
+}
+
+static const char* _httpVersionLabel(CURL* curl) {
+#if LIBCURL_VERSION_NUM >= 0x073200  // 7.50.0
+  long version = 0;
+  curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+  switch (version) {
+    case CURL_HTTP_VERSION_1_0: return "1.0";
+    case CURL_HTTP_VERSION_1_1: return "1.1";
+    case CURL_HTTP_VERSION_2_0: return "2";
+#if LIBCURL_VERSION_NUM >= 0x074200  // 7.66.0
+    case CURL_HTTP_VERSION_3: return "3";
+#endif
+    default: return "unknown";
+  }
+#else
+  (void)curl;
+  return "unknown";
+#endif
+}
+
+/**
+ * @brief adds the timings of the last transfer to the http metrics of its
+ * host
+ * The time spent in DNS, connect, and TLS is only observed for transfers that
+ * opened a new connection, so the number of observations compared to
+ * @c METRIC_HTTP_DURATION shows how often connections were reused.
+ */
+static void _recordTransferMetrics(CURL* curl) {
+  char* url = NULL;
+  if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK ||
+      url == NULL) {
+    return;
+  }
+  long  port = 443;
+  char* host = hostFromUrl(url, &port);
+  if (host == NULL) {
+    return;
+  }
+  double lookup    = _getTime(curl, CURLINFO_NAMELOOKUP_TIME);
+  double connect   = _getTime(curl, CURLINFO_CONNECT_TIME);
+  double tls       = _getTime(curl, CURLINFO_APPCONNECT_TIME);
+  double firstByte = _getTime(curl, CURLINFO_STARTTRANSFER_TIME);
+  double total     = _getTime(curl, CURLINFO_TOTAL_TIME);
+  long   connects  = 0;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  double established = tls > connect ? tls : connect;
+  if (connects > 0) {
+    metrics_observe(METRIC_HTTP_NAMELOOKUP, host, lookup);
+    metrics_observe(METRIC_HTTP_CONNECT, host, connect - lookup);
+    if (tls > connect) {
+      metrics_observe(METRIC_HTTP_TLS, host, tls - connect);
+    }
+  }
+  if (firstByte > 0) {
+    metrics_observe(METRIC_HTTP_FIRST_BYTE, host, firstByte - established);
+  }
+  metrics_observe(METRIC_HTTP_DURATION, host, total);
+  for (long i = 0; i < connects; i++) {
+    metrics_inc(METRIC_HTTP_NEW_CONNECTIONS, host);
+  }
+  metrics_inc(METRIC_HTTP_VERSIONS, _httpVersionLabel(curl));
+  secFree(host);
+}
+
+/**
+ * @brief records what curl measured for the last transfer of @p curl in the
+ * metrics and, if a request is traced, in the request trace
+ */
+void recordTransferInfo(CURL* curl) {
+  if (curl == NULL) {
+    return;
+  }
+  _traceTransferTimes(curl);
+  _recordTransferMetrics(curl);
+}
+
 /** @fn int perform(CURL* curl)
  * @brief performs the https request and checks for errors
  * @param curl the curl instance
@@ -121,14 +705,274 @@ oidc_error_t perform(CURL* curl) {
   // curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
   // curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
   CURLcode res = curl_easy_perform(curl);
+  recordTransferInfo(curl);
   return CURLErrorHandling(res, curl);
 }
 
+#ifdef HTTP_HEDGING
+/**
+ * The latencies of the last requests to a host; used to decide when a request
+ * is slow enough to send a hedged request
+ */
+struct hostLatencies {
+  char*  host;
+  double samples[HTTP_HEDGE_SAMPLES];  // seconds
+  size_t count;
+  size_t next;
+};
+
+static void _secFreeHostLatencies(struct hostLatencies* l) {
+  secFree(l->host);
+  secFree(l);
+}
+
+static int _matchHostLatencies(const struct hostLatencies* l,
+                               const char*                 host) {
+  return strequal(l->host, host);
+}
+
+static struct hostLatencies* _getHostLatencies(const char* host) {
+  if (latencies == NULL) {
+    latencies        = list_new();
+    latencies->free  = (void (*)(void*))_secFreeHostLatencies;
+    latencies->match = (matchFunction)_matchHostLatencies;
+  }
+  list_node_t* node = findInList(latencies, host);
+  if (node) {
+    return node->val;
+  }
+  struct hostLatencies* l = secAlloc(sizeof(struct hostLatencies));
+  l->host                 = oidc_strcopy(host);
+  list_rpush(latencies, list_node_new(l));
+  return l;
+}
+
+static void _recordLatency(struct hostLatencies* l, double seconds) {
+  l->samples[l->next] = seconds;
+  l->next             = (l->next + 1) % HTTP_HEDGE_SAMPLES;
+  if (l->count < HTTP_HEDGE_SAMPLES) {
+    l->count++;
+  }
+}
+
+static int _compareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief returns after how many milliseconds a hedged request is sent
+ * @return the 95th percentile of the known latencies, or @c -1 if not enough
+ * latencies are known
+ */
+static long _hedgeDelay(const struct hostLatencies* l) {
+  if (l->count < HTTP_HEDGE_MIN_SAMPLES) {
+    return -1;
+  }
+  double sorted[HTTP_HEDGE_SAMPLES];
+  memcpy(sorted, l->samples, sizeof(double) * l->count);
+  qsort(sorted, l->count, sizeof(double), _compareDoubles);
+  long p95 = (long)(sorted[(l->count * 95 + 99) / 100 - 1] * 1000);
+  return p95 > HTTP_HEDGE_MIN_DELAY ? p95 : HTTP_HEDGE_MIN_DELAY;
+}
+
+/**
+ * @brief returns an address of @p host that is not @p used
+ * @return the numeric address, ipv6 addresses in brackets; has to be freed
+ * after usage. @c NULL if the host has no other address.
+ */
+static char* _alternateAddress(const char* host, const char* used) {
+  struct addrinfo  hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  struct addrinfo* res   = NULL;
+  if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+    return NULL;
+  }
+  char*  alternate = NULL;
+  size_t i         = 0;
+  for (struct addrinfo* ai = res; ai != NULL && alternate == NULL;
+       ai                  = ai->ai_next, i++) {
+    char        addr[INET6_ADDRSTRLEN];
+    const void* src = ai->ai_family == AF_INET6
+                          ? (void*)&((struct sockaddr_in6*)ai->ai_addr)->sin6_addr
+                          : (void*)&((struct sockaddr_in*)ai->ai_addr)->sin_addr;
+    if (inet_ntop(ai->ai_family, src, addr, sizeof(addr)) == NULL) {
+      continue;
+    }
+    // If the primary is not connected yet, it is trying the first address
+    if (strValid(used) ? strequal(addr, used) : i == 0) {
+      continue;
+    }
+    alternate = ai->ai_family == AF_INET6 ? oidc_sprintf("[%s]", addr)
+                                          : oidc_strcopy(addr);
+  }
+  freeaddrinfo(res);
+  return alternate;
+}
+
+/**
+ * A second request that is sent to another address of the same host
+ */
+struct hedgedRequest {
+  CURL*              curl;
+  struct string      s;
+  struct curl_slist* connect_to;
+};
+
+static void _cleanupHedgedRequest(struct hedgedRequest* h) {
+  if (h->curl) {
+    curl_easy_cleanup(h->curl);
+  }
+  curl_slist_free_all(h->connect_to);
+  secFree(h->s.ptr);
+  *h = (struct hedgedRequest){0};
+}
+
+static oidc_error_t _startHedgedRequest(struct hedgedRequest* h, CURL* curl,
+                                        const char* host, long port) {
+  char* used = NULL;
+  curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &used);
+  char* addr = _alternateAddress(host, used);
+  if (addr == NULL) {
+    return OIDC_EERROR;
+  }
+  char* connect_to = oidc_sprintf("%s:%ld:%s:%ld", host, port, addr, port);
+  secFree(addr);
+  h->connect_to = curl_slist_append(NULL, connect_to);
+  secFree(connect_to);
+  h->curl = curl_easy_duphandle(curl);
+  if (h->curl == NULL || setWriteFunction(h->curl, &h->s) != OIDC_SUCCESS) {
+    _cleanupHedgedRequest(h);
+    return OIDC_EERROR;
+  }
+  curl_easy_setopt(h->curl, CURLOPT_CONNECT_TO, h->connect_to);
+  curl_easy_setopt(h->curl, CURLOPT_FRESH_CONNECT, 1L);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief performs a request and sends the same request a second time to
+ * another address of the host if the first one is slow
+ * The response that completes first is used.
+ */
+static oidc_error_t _performHedged(CURL* curl, struct string* s,
+                                   const char* host, long port, long delay) {
+  CURLM* multi = curl_multi_init();
+  if (multi == NULL) {
+    return perform(curl);
+  }
+  curl_multi_add_handle(multi, curl);
+  struct hedgedRequest hedge    = {0};
+  unsigned char        hedged   = 0;
+  CURL*                winner   = NULL;
+  CURL*                answered = NULL;  // first response with an error status
+  CURLcode             result   = CURLE_OK;
+  int                  running  = 1;
+  double               start    = metrics_now();
+  while (winner == NULL && running > 0) {
+    curl_multi_perform(multi, &running);
+    CURLMsg* msg;
+    int      left;
+    while ((msg = curl_multi_info_read(multi, &left))) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      if (msg->easy_handle == curl) {
+        result = msg->data.result;
+      }
+      if (msg->data.result != CURLE_OK) {
+        continue;
+      }
+      // An error response might only come from the slow node; wait for the
+      // other request in that case
+      if (getResponseCode(msg->easy_handle) < 400) {
+        winner = msg->easy_handle;
+        break;
+      }
+      answered = answered ?: msg->easy_handle;
+    }
+    if (winner || running == 0) {
+      break;
+    }
+    long elapsed = (long)((metrics_now() - start) * 1000);
+    if (!hedged && elapsed >= delay) {
+      hedged = 1;
+      if (_startHedgedRequest(&hedge, curl, host, port) == OIDC_SUCCESS) {
+        agent_log(DEBUG, "Sending hedged request to %s after %ld ms", host,
+                  elapsed);
+        curl_multi_add_handle(multi, hedge.curl);
+        running++;
+      }
+    }
+    int timeout = hedged ? 1000 : (int)(delay - elapsed);
+    curl_multi_wait(multi, NULL, 0, timeout > 0 ? timeout : 1, NULL);
+  }
+  winner = winner ?: answered;
+  curl_multi_remove_handle(multi, curl);
+  if (hedge.curl) {
+    curl_multi_remove_handle(multi, hedge.curl);
+  }
+  curl_multi_cleanup(multi);
+  recordTransferInfo(winner);
+  oidc_error_t err;
+  if (winner && winner == hedge.curl) {
+    agent_log(DEBUG, "Hedged request to %s was faster", host);
+    secFree(s->ptr);
+    *s          = hedge.s;
+    hedge.s.ptr = NULL;
+    err         = CURLErrorHandling(CURLE_OK, hedge.curl);
+  } else {
+    err = CURLErrorHandling(winner ? CURLE_OK : result, curl);
+  }
+  _cleanupHedgedRequest(&hedge);
+  return err;
+}
+#endif
+
+/**
+ * @brief performs a request; if hedging is enabled for the issuer and the
+ * request takes longer than usual for this host, a second request is sent to
+ * another address of the host
+ * Should only be used for requests that can safely be sent twice.
+ * @param s the string the response is written to
+ */
+oidc_error_t performWithOptions(CURL* curl, struct string* s, const char* url,
+                                const struct http_options* options) {
+#ifdef HTTP_HEDGING
+  if (options == NULL || !options->hedge || url == NULL) {
+    return perform(curl);
+  }
+  long  port = 443;
+  char* host = hostFromUrl(url, &port);
+  if (host == NULL) {
+    return perform(curl);
+  }
+  struct hostLatencies* l     = _getHostLatencies(host);
+  long                  delay = _hedgeDelay(l);
+  double                start = metrics_now();
+  oidc_error_t          err   = delay < 0 ? perform(curl)
+                                          : _performHedged(curl, s, host, port, delay);
+  if (err == OIDC_SUCCESS) {
+    _recordLatency(l, metrics_now() - start);
+  }
+  secFree(host);
+  return err;
+#else
+  (void)s;
+  (void)url;
+  (void)options;
+  return perform(curl);
+#endif
+}
+
 /** @fn void cleanup(CURL* curl)
  * @brief does a easy and global cleanup
  * @param curl the curl instance
  */
 void cleanup(CURL* curl) {
+  if (persistent && curl == persistent_curl) {
+    return;
+  }
   curl_easy_cleanup(curl);
   curl_global_cleanup();
 }
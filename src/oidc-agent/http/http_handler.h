@@ -1,18 +1,44 @@
 #ifndef HTTP_HANDLER_H
 #define HTTP_HANDLER_H
 
+#include "utils/httpOptions.h"
+#include "utils/jsonStreamFilter.h"
 #include "utils/oidc_error.h"
 #include "utils/oidc_string.h"
 
 #include <curl/curl.h>
 
+/**
+ * Caching related information about a http response. @c max_age is @c -1 if
+ * the response did not specify a freshness lifetime.
+ */
+struct http_cacheInfo {
+  long  status;
+  long  max_age;
+  char* etag;
+};
+
 CURL*        init();
 void         setSSLOpts(CURL* curl, const char* cert_file);
 oidc_error_t setWriteFunction(CURL* curl, struct string* s);
+void         setFilteredWriteFunction(CURL* curl, struct jsonStreamFilter* f);
+void         setHeaderFunction(CURL* curl, struct http_cacheInfo* info);
+void         setCacheInfoFunction(CURL* curl, struct http_cacheInfo* info);
+long         getRetryAfter();
+void         setRetryAfter(long seconds);
+long         getResponseCode(CURL* curl);
+void         secFreeCacheInfoContent(struct http_cacheInfo* info);
 void         setUrl(CURL* curl, const char* url);
 void         setHeaders(CURL* curl, struct curl_slist* headers);
 void setBasicAuth(CURL* curl, const char* username, const char* password);
+void setHttpOptions(CURL* curl, const struct http_options* options);
 oidc_error_t perform(CURL* curl);
+void         recordTransferInfo(CURL* curl);
+char*        hostFromUrl(const char* url, long* port);
+oidc_error_t performWithOptions(CURL* curl, struct string* s, const char* url,
+                                const struct http_options* options);
 void         cleanup(CURL* curl);
+void         enablePersistentCurlHandle();
+void         cleanupPersistentCurlHandle();
 
 #endif  // HTTP_HANDLER_H
@@ -1,53 +1,8 @@
 #include "http_ipc.h"
-#include "ipc/pipe.h"
-#include "utils/agentLogger.h"
-#include "utils/memory.h"
-#include "utils/oidc_error.h"
-
-#include <fcntl.h>
-#include <signal.h>
-#include <stdlib.h>
-#include <sys/ioctl.h>
-#include <sys/select.h>
-#include <unistd.h>
-
-char* _handleParent(struct ipcPipe pipes) {
-  char* e = ipc_readFromPipe(pipes);
-  ipc_closePipes(pipes);
-  if (e == NULL) {
-    return NULL;
-  }
-  char*    end   = NULL;
-  long int error = strtol(e, &end, 10);
-  if (error) {
-    secFree(e);
-    oidc_errno = error;
-    agent_log(ERROR, "Error from http request: %s", oidc_serror());
-    return NULL;
-  }
-  if (*end != '\0') {
-    char* res = e;
-    agent_log(DEBUG, "Received response: %s", res);
-    return res;
-  }
-  secFree(e);
-  agent_log(ERROR, "Internal error: Http sent 0");
-  oidc_errno = OIDC_EHTTP0;
-  return NULL;
-}
-
-void handleChild(char* res, struct ipcPipe pipes) {
-  if (res == NULL) {
-    ipc_writeOidcErrnoToPipe(pipes);
-    exit(EXIT_FAILURE);
-  }
-  ipc_writeToPipe(pipes, res);
-  secFree(res);
-  exit(EXIT_SUCCESS);
-}
+#include "http_transport.h"
 
 /** @fn char* httpsGET(const char* url, const char* cert_path)
- * @brief forks and does a https GET request
+ * @brief does a https GET request through the current http transport
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @return a pointer to the response. Has to be freed after usage. If the Https
@@ -55,31 +10,45 @@ void handleChild(char* res, struct ipcPipe pipes) {
  */
 char* httpsGET(const char* url, struct curl_slist* headers,
                const char* cert_path) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    return NULL;
-  }
-  pid_t pid = fork();
-  if (pid == -1) {
-    agent_log(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return NULL;
-  }
-  if (pid == 0) {  // child
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    logger_open("oidc-agent.http");
-    char* res = _httpsGET(url, headers, cert_path);
-    handleChild(res, childPipes);
-    return NULL;
-  } else {  // parent
-    signal(SIGCHLD, SIG_IGN);
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return _handleParent(parentPipes);
-  }
+  return httpTransport_perform(
+      &(struct http_request){.method    = HTTP_METHOD_GET,
+                             .url       = url,
+                             .headers   = headers,
+                             .cert_path = cert_path});
+}
+
+/**
+ * @brief does a https GET request through the current http transport and also
+ * returns the caching information of the response
+ * @param url the request url
+ * @param headers additional request headers, e.g. @c If-None-Match
+ * @param cert_path the path to the SSL certs
+ * @param info the struct where the status code, @c ETag and @c max-age of the
+ * response are stored. Its content has to be freed after usage.
+ * @param options the limits for requests to the issuer; might be @c NULL
+ * @param fields the top-level fields of the json response that are kept,
+ * terminated by @c NULL; @c NULL keeps the whole response
+ * @return a pointer to the response body. Has to be freed after usage. If the
+ * Https call failed, NULL is returned.
+ */
+char* httpsGETWithCacheInfo(const char* url, struct curl_slist* headers,
+                            const char*                cert_path,
+                            struct http_cacheInfo*     info,
+                            const struct http_options* options,
+                            const char* const*         fields) {
+  *info = (struct http_cacheInfo){0, -1, NULL};
+  return httpTransport_perform(
+      &(struct http_request){.method     = HTTP_METHOD_GET,
+                             .url        = url,
+                             .headers    = headers,
+                             .cert_path  = cert_path,
+                             .cache_info = info,
+                             .options    = options,
+                             .fields     = fields});
 }
 
 /** @fn char* httpsDELETE(const char* url, const char* cert_path)
- * @brief forks and does a https DELETE request
+ * @brief does a https DELETE request through the current http transport
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @return a pointer to the response. Has to be freed after usage. If the Https
@@ -87,70 +56,66 @@ char* httpsGET(const char* url, struct curl_slist* headers,
  */
 char* httpsDELETE(const char* url, struct curl_slist* headers,
                   const char* cert_path, const char* bearer_token) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    return NULL;
-  }
-  pid_t pid = fork();
-  if (pid == -1) {
-    agent_log(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return NULL;
-  }
-  if (pid == 0) {  // child
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    logger_open("oidc-agent.http");
-    char* res = _httpsDELETE(url, headers, cert_path, bearer_token);
-    handleChild(res, childPipes);
-    return NULL;
-  } else {  // parent
-    signal(SIGCHLD, SIG_IGN);
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return _handleParent(parentPipes);
-  }
+  return httpTransport_perform(
+      &(struct http_request){.method       = HTTP_METHOD_DELETE,
+                             .url          = url,
+                             .headers      = headers,
+                             .cert_path    = cert_path,
+                             .bearer_token = bearer_token});
+}
+
+/**
+ * @brief does a https HEAD request through the current http transport
+ * Used to open a connection to a host before it is needed; the http worker
+ * keeps the connection for later requests.
+ * @param options the limits for requests to the issuer; might be @c NULL
+ * @return a pointer to a string with the status code of the response. Has to
+ * be freed after usage. If no connection could be established, NULL is
+ * returned.
+ */
+char* httpsHEAD(const char* url, const char* cert_path,
+                const struct http_options* options) {
+  return httpTransport_perform(
+      &(struct http_request){.method    = HTTP_METHOD_HEAD,
+                             .url       = url,
+                             .cert_path = cert_path,
+                             .options   = options});
 }
 
 /** @fn char* httpsPOST(const char* url, const char* data, const char*
  * cert_path)
- * @brief forks and does a https POST request
+ * @brief does a https POST request through the current http transport
  * @param url the request url
  * @param cert_path the path to the SSL certs
  * @param data the data to be posted
+ * @param options the limits for requests to the issuer; might be @c NULL
  * @return a pointer to the response. Has to be freed after usage. If the Https
  * call failed, NULL is returned.
  */
 char* httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                 const char* cert_path, const char* username,
-                const char* password) {
-  struct pipeSet pipes = ipc_pipe_init();
-  if (pipes.pipe1.rx == -1) {
-    return NULL;
-  }
-  pid_t pid = fork();
-  if (pid == -1) {
-    agent_log(ALERT, "fork %m");
-    oidc_setErrnoError();
-    return NULL;
-  }
-  if (pid == 0) {  // child
-    struct ipcPipe childPipes = toClientPipes(pipes);
-    logger_open("oidc-agent.http");
-    char* res = _httpsPOST(url, data, headers, cert_path, username, password);
-    handleChild(res, childPipes);
-    return NULL;
-  } else {  // parent
-    struct ipcPipe parentPipes = toServerPipes(pipes);
-    return _handleParent(parentPipes);
-  }
+                const char* password, const struct http_options* options) {
+  return httpTransport_perform(
+      &(struct http_request){.method    = HTTP_METHOD_POST,
+                             .url       = url,
+                             .data      = data,
+                             .headers   = headers,
+                             .cert_path = cert_path,
+                             .username  = username,
+                             .password  = password,
+                             .options   = options});
 }
 
 char* sendPostDataWithBasicAuth(const char* endpoint, const char* data,
                                 const char* cert_path, const char* username,
-                                const char* password) {
-  return httpsPOST(endpoint, data, NULL, cert_path, username, password);
+                                const char*                password,
+                                const struct http_options* options) {
+  return httpsPOST(endpoint, data, NULL, cert_path, username, password,
+                   options);
 }
 
 char* sendPostDataWithoutBasicAuth(const char* endpoint, const char* data,
-                                   const char* cert_path) {
-  return httpsPOST(endpoint, data, NULL, cert_path, NULL, NULL);
+                                   const char*                cert_path,
+                                   const struct http_options* options) {
+  return httpsPOST(endpoint, data, NULL, cert_path, NULL, NULL, options);
 }
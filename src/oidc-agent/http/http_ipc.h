@@ -5,18 +5,29 @@
 
 #define HTTP_HEADER_CONTENTTYPE_JSON "Content-Type: application/json"
 #define HTTP_HEADER_AUTHORIZATION_BEARER_FMT "Authorization: Bearer %s"
+#define HTTP_HEADER_IF_NONE_MATCH_FMT "If-None-Match: %s"
+
+#define HTTP_STATUS_NOT_MODIFIED 304
 
 char* httpsGET(const char* url, struct curl_slist* list, const char* cert_path);
+char* httpsGETWithCacheInfo(const char* url, struct curl_slist* headers,
+                            const char* cert_path, struct http_cacheInfo* info,
+                            const struct http_options* options,
+                            const char* const*         fields);
 char* httpsPOST(const char* url, const char* data, struct curl_slist* headers,
                 const char* cert_path, const char* username,
-                const char* password);
+                const char* password, const struct http_options* options);
 char* httpsDELETE(const char* url, struct curl_slist* headers,
                   const char* cert_path, const char* bearer_token);
+char* httpsHEAD(const char* url, const char* cert_path,
+                const struct http_options* options);
 
 char* sendPostDataWithBasicAuth(const char* endpoint, const char* data,
                                 const char* cert_path, const char* username,
-                                const char* password);
+                                const char*                password,
+                                const struct http_options* options);
 char* sendPostDataWithoutBasicAuth(const char* endpoint, const char* data,
-                                   const char* cert_path);
+                                   const char*                cert_path,
+                                   const struct http_options* options);
 
 #endif  // HTTP_IPC_H
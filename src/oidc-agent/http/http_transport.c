@@ -0,0 +1,338 @@
+#include "http_transport.h"
+#include "http_errorHandler.h"
+#include "http_handler.h"
+#include "http_worker.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+/**
+ * The flows send their requests through the functions of http_ipc, which
+ * pass them to the current transport. A transport either performs single
+ * requests or a batch of requests submitted with a callback each. The
+ * transports are:
+ * - forked: the http worker process with its persistent curl handle; used by
+ *   default
+ * - inProcess: a curl easy handle per request in the calling process
+ * - multi: like inProcess, but the requests of a batch are performed
+ *   concurrently with a curl multi handle
+ * - canned: returns configured responses without any network access; used in
+ *   tests
+ */
+
+static const struct http_transport* transport = &httpTransport_forked;
+
+/**
+ * @brief sets the transport for all following requests
+ * @param t the transport; @c NULL restores the default
+ */
+void httpTransport_use(const struct http_transport* t) {
+  transport = t ?: &httpTransport_forked;
+  agent_log(DEBUG, "Using http transport '%s'", transport->name);
+}
+
+const struct http_transport* httpTransport_current() { return transport; }
+
+/**
+ * The number of started requests that did not finish yet, per host. oidcd
+ * answers some requests while it waits for a response, e.g. the health
+ * request, which reports them.
+ */
+struct inFlightHost {
+  char*  host;
+  size_t count;
+};
+
+static list_t* inFlight = NULL;
+
+static void _secFreeInFlightHost(struct inFlightHost* h) {
+  secFree(h->host);
+  secFree(h);
+}
+
+static int _matchInFlightHost(const struct inFlightHost* h, const char* host) {
+  return strequal(h->host, host);
+}
+
+static void _addInFlight(const char* url) {
+  long  port = 0;
+  char* host = url ? hostFromUrl(url, &port) : NULL;
+  if (host == NULL) {
+    return;
+  }
+  if (inFlight == NULL) {
+    inFlight        = list_new();
+    inFlight->free  = (void (*)(void*))_secFreeInFlightHost;
+    inFlight->match = (matchFunction)_matchInFlightHost;
+  }
+  list_node_t* node = findInList(inFlight, host);
+  if (node) {
+    ((struct inFlightHost*)node->val)->count++;
+    secFree(host);
+    return;
+  }
+  struct inFlightHost* h = secAlloc(sizeof(struct inFlightHost));
+  h->host                = host;
+  h->count               = 1;
+  list_rpush(inFlight, list_node_new(h));
+}
+
+static void _removeInFlight(const char* url) {
+  long  port = 0;
+  char* host = url && inFlight ? hostFromUrl(url, &port) : NULL;
+  if (host == NULL) {
+    return;
+  }
+  list_node_t* node = findInList(inFlight, host);
+  secFree(host);
+  if (node && --((struct inFlightHost*)node->val)->count == 0) {
+    list_remove(inFlight, node);
+  }
+}
+
+/**
+ * @brief returns the number of unfinished requests per host
+ * @return a json object with the hosts as keys; has to be freed after usage
+ */
+cJSON* httpTransport_inFlightToJSON() {
+  cJSON* json = cJSON_CreateObject();
+  if (inFlight == NULL) {
+    return json;
+  }
+  for (list_node_t* node = inFlight->head; node; node = node->next) {
+    const struct inFlightHost* h = node->val;
+    jsonAddNumberValue(json, h->host, (double)h->count);
+  }
+  return json;
+}
+
+/**
+ * @brief performs a request with the current transport
+ * @return a pointer to the response. Has to be freed after usage. If the Https
+ * call failed, NULL is returned.
+ */
+char* httpTransport_perform(const struct http_request* request) {
+  _addInFlight(request->url);
+  char* response = transport->perform(request);
+  _removeInFlight(request->url);
+  return response;
+}
+
+struct pendingRequest {
+  struct http_request request;
+  http_callback       callback;
+  void*               arg;
+};
+
+static list_t* pending = NULL;
+
+/**
+ * @brief queues a request; it is performed by the next call of
+ * @c httpTransport_complete
+ * @param request the request; the values it points to have to stay valid until
+ * the callback was called
+ * @param callback called with the response
+ */
+void httpTransport_submit(const struct http_request* request,
+                          http_callback callback, void* arg) {
+  if (pending == NULL) {
+    pending       = list_new();
+    pending->free = (void (*)(void*))_secFree;
+  }
+  struct pendingRequest* p = secAlloc(sizeof(struct pendingRequest));
+  *p = (struct pendingRequest){.request = *request, .callback = callback,
+                               .arg = arg};
+  list_rpush(pending, list_node_new(p));
+}
+
+/**
+ * @brief performs all submitted requests and calls their callbacks
+ * The callbacks are called in the order the requests were submitted, after all
+ * requests of the batch are done. Requests submitted from a callback are
+ * performed in the next batch.
+ */
+void httpTransport_complete() {
+  if (pending == NULL || pending->len == 0) {
+    return;
+  }
+  size_t                 n = pending->len;
+  struct pendingRequest* batch = secCalloc(n, sizeof(struct pendingRequest));
+  struct http_request*   requests  = secCalloc(n, sizeof(struct http_request));
+  char**                 responses = secCalloc(n, sizeof(char*));
+  list_node_t*           node;
+  for (size_t i = 0; (node = list_lpop(pending)); i++) {
+    batch[i]    = *(struct pendingRequest*)node->val;
+    requests[i] = batch[i].request;
+    LIST_FREE(node);
+    _addInFlight(requests[i].url);
+  }
+  if (transport->performAll) {
+    transport->performAll(requests, responses, n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      responses[i] = transport->perform(&requests[i]);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    _removeInFlight(requests[i].url);
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (batch[i].callback) {
+      batch[i].callback(responses[i], batch[i].arg);
+    } else {
+      secFree(responses[i]);
+    }
+  }
+  secFree(responses);
+  secFree(requests);
+  secFree(batch);
+}
+
+const struct http_transport httpTransport_forked = {
+    .name = "forked", .perform = httpWorker_request};
+
+const struct http_transport httpTransport_inProcess = {
+    .name = "in-process", .perform = _httpsPerform};
+
+/**
+ * @brief performs the requests of a batch concurrently in this process
+ * Requests are not hedged. Must not be used in a process that enabled the
+ * persistent curl handle, i.e. the http worker.
+ */
+static void _multiPerformAll(const struct http_request* requests,
+                             char** responses, size_t n) {
+  CURLM* multi = curl_multi_init();
+  if (multi == NULL) {
+    for (size_t i = 0; i < n; i++) {
+      responses[i] = _httpsPerform(&requests[i]);
+    }
+    return;
+  }
+  struct http_transfer* transfers =
+      secCalloc(n, sizeof(struct http_transfer));
+  CURLcode* results = secCalloc(n, sizeof(CURLcode));
+  for (size_t i = 0; i < n; i++) {
+    results[i] = CURLE_FAILED_INIT;
+    if (_httpsPrepare(&transfers[i], &requests[i]) == OIDC_SUCCESS) {
+      curl_multi_add_handle(multi, transfers[i].curl);
+    }
+  }
+  int running = 1;
+  while (running > 0) {
+    curl_multi_perform(multi, &running);
+    CURLMsg* msg;
+    int      left;
+    while ((msg = curl_multi_info_read(multi, &left))) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      for (size_t i = 0; i < n; i++) {
+        if (transfers[i].curl == msg->easy_handle) {
+          results[i] = msg->data.result;
+          break;
+        }
+      }
+    }
+    if (running > 0) {
+      curl_multi_wait(multi, NULL, 0, 1000, NULL);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (transfers[i].curl) {
+      curl_multi_remove_handle(multi, transfers[i].curl);
+    }
+  }
+  curl_multi_cleanup(multi);
+  for (size_t i = 0; i < n; i++) {
+    if (transfers[i].curl == NULL) {
+      responses[i] = NULL;
+      continue;
+    }
+    recordTransferInfo(transfers[i].curl);
+    oidc_error_t err = CURLErrorHandling(results[i], transfers[i].curl);
+    responses[i]     = _httpsFinish(&transfers[i], &requests[i], err);
+  }
+  secFree(results);
+  secFree(transfers);
+}
+
+const struct http_transport httpTransport_multi = {
+    .name       = "curl-multi",
+    .perform    = _httpsPerform,
+    .performAll = _multiPerformAll};
+
+struct cannedResponse {
+  char* url;
+  char* response;
+};
+
+static list_t* cannedResponses = NULL;
+
+static void _secFreeCannedResponse(struct cannedResponse* c) {
+  secFree(c->url);
+  secFree(c->response);
+  secFree(c);
+}
+
+static int _matchCannedResponse(const struct cannedResponse* c,
+                                const char*                  url) {
+  return strequal(c->url, url);
+}
+
+/**
+ * @brief sets the response the canned transport returns for requests to
+ * @p url, regardless of the method
+ * @param response the response; @c NULL makes requests to @p url fail
+ */
+void httpTransport_setCannedResponse(const char* url, const char* response) {
+  if (cannedResponses == NULL) {
+    cannedResponses        = list_new();
+    cannedResponses->free  = (void (*)(void*))_secFreeCannedResponse;
+    cannedResponses->match = (matchFunction)_matchCannedResponse;
+  }
+  list_node_t* node = findInList(cannedResponses, url);
+  if (node) {
+    list_remove(cannedResponses, node);
+  }
+  struct cannedResponse* c = secAlloc(sizeof(struct cannedResponse));
+  c->url                   = oidc_strcopy(url);
+  c->response              = oidc_strcopy(response);
+  list_rpush(cannedResponses, list_node_new(c));
+}
+
+void httpTransport_clearCannedResponses() {
+  secFreeList(cannedResponses);
+  cannedResponses = NULL;
+}
+
+static char* _cannedPerform(const struct http_request* r) {
+  list_node_t* node =
+      cannedResponses ? findInList(cannedResponses, r->url) : NULL;
+  const struct cannedResponse* c = node ? node->val : NULL;
+  if (c == NULL || c->response == NULL) {
+    oidc_setInternalError("no canned response for this url");
+    return NULL;
+  }
+  if (r->cache_info) {
+    *r->cache_info = (struct http_cacheInfo){200, -1, NULL};
+  }
+  if (r->fields == NULL) {
+    return oidc_strcopy(c->response);
+  }
+  struct jsonStreamFilter f;
+  if (jsonStreamFilter_init(&f, r->fields) != OIDC_SUCCESS ||
+      jsonStreamFilter_feed(&f, c->response, strlen(c->response)) !=
+          OIDC_SUCCESS) {
+    jsonStreamFilter_free(&f);
+    return NULL;
+  }
+  return jsonStreamFilter_finish(&f);
+}
+
+const struct http_transport httpTransport_canned = {
+    .name = "canned", .perform = _cannedPerform};
@@ -0,0 +1,42 @@
+#ifndef HTTP_TRANSPORT_H
+#define HTTP_TRANSPORT_H
+
+#include "http.h"
+#include "wrapper/cjson.h"
+
+#include <stddef.h>
+
+/**
+ * Called with the response of a submitted request; the response has to be
+ * freed by the callback. It is @c NULL if the request failed, @c oidc_errno
+ * is set in that case.
+ */
+typedef void (*http_callback)(char* response, void* arg);
+
+/**
+ * A way to send https requests. @c performAll is optional; transports that do
+ * not set it perform the requests of a batch one after the other.
+ */
+struct http_transport {
+  const char* name;
+  char* (*perform)(const struct http_request* request);
+  void (*performAll)(const struct http_request* requests, char** responses,
+                     size_t n);
+};
+
+extern const struct http_transport httpTransport_forked;
+extern const struct http_transport httpTransport_inProcess;
+extern const struct http_transport httpTransport_multi;
+extern const struct http_transport httpTransport_canned;
+
+void                         httpTransport_use(const struct http_transport* t);
+const struct http_transport* httpTransport_current();
+char* httpTransport_perform(const struct http_request* request);
+void  httpTransport_submit(const struct http_request* request,
+                           http_callback callback, void* arg);
+void  httpTransport_complete();
+void  httpTransport_setCannedResponse(const char* url, const char* response);
+void  httpTransport_clearCannedResponses();
+cJSON* httpTransport_inFlightToJSON();
+
+#endif  // HTTP_TRANSPORT_H
@@ -0,0 +1,568 @@
+#define _POSIX_C_SOURCE 200809L
+#include "http_worker.h"
+#include "defines/settings.h"
+#include "http_handler.h"
+#include "ipc/pipe.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/oidc_error.h"
+#include "utils/requestTrace.h"
+#include "utils/stringUtils.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The http worker is a single long-lived child process of oidcd that performs
+ * all https requests. Because it keeps its curl handle (and the associated
+ * connection, DNS, and TLS session caches) between requests, subsequent
+ * requests to the same issuer can reuse the established connection instead of
+ * forking and doing a full TCP and TLS handshake every time.
+ */
+
+static pid_t          worker_pid   = 0;
+static struct ipcPipe worker_pipes = {.rx = -1, .tx = -1};
+static int            wait_fd      = -1;
+static void (*wait_callback)()     = NULL;
+
+static struct curl_slist* _headersFromJSONArray(const char* json) {
+  if (json == NULL) {
+    return NULL;
+  }
+  list_t* list = JSONArrayStringToList(json);
+  if (list == NULL) {
+    return NULL;
+  }
+  struct curl_slist* headers = NULL;
+  list_node_t*       node;
+  list_iterator_t*   it = list_iterator_new(list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    headers = curl_slist_append(headers, node->val);
+  }
+  list_iterator_destroy(it);
+  secFreeList(list);
+  return headers;
+}
+
+static char* _headersToJSONArray(const struct curl_slist* headers) {
+  if (headers == NULL) {
+    return NULL;
+  }
+  cJSON* array = generateJSONArray(NULL);
+  for (const struct curl_slist* h = headers; h != NULL; h = h->next) {
+    jsonArrayAddStringValue(array, h->data);
+  }
+  char* json = jsonToStringUnformatted(array);
+  secFreeJson(array);
+  return json;
+}
+
+/**
+ * @brief returns a @c NULL terminated array of the values of @p list; the
+ * values stay owned by the list
+ */
+static const char** _fieldsFromList(list_t* list) {
+  if (list == NULL) {
+    return NULL;
+  }
+  const char**     fields = secCalloc(list->len + 1, sizeof(char*));
+  size_t           i      = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(list, LIST_HEAD);
+  while ((node = list_iterator_next(it))) { fields[i++] = node->val; }
+  list_iterator_destroy(it);
+  return fields;
+}
+
+static char* _httpWorker_cacheInfoResponse(char*                  body,
+                                           struct http_cacheInfo* info) {
+  if (body == NULL) {
+    return NULL;
+  }
+  cJSON* json = generateJSONObject(HTTP_WORKER_KEY_BODY, cJSON_String, body,
+                                   HTTP_WORKER_KEY_ETAG, cJSON_String,
+                                   info->etag, NULL);
+  secFree(body);
+  if (json == NULL) {
+    return NULL;
+  }
+  jsonAddNumberValue(json, HTTP_WORKER_KEY_STATUS, info->status);
+  jsonAddNumberValue(json, HTTP_WORKER_KEY_MAXAGE, info->max_age);
+  char* res = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return res;
+}
+
+/**
+ * @brief adds the marks of the traced request to the response of the worker
+ * A plain response body is wrapped into a json object for this.
+ * @param wrapped if @p res already is a json object
+ */
+static char* _httpWorker_traceResponse(char* res, unsigned char wrapped) {
+  if (res == NULL) {
+    return NULL;
+  }
+  if (!wrapped) {
+    cJSON* json =
+        generateJSONObject(HTTP_WORKER_KEY_BODY, cJSON_String, res, NULL);
+    secFree(res);
+    if (json == NULL) {
+      return NULL;
+    }
+    res = jsonToStringUnformatted(json);
+    secFreeJson(json);
+  }
+  char* traced = requestTrace_attachToMessage(res);
+  if (traced == NULL) {
+    return res;
+  }
+  secFree(res);
+  return traced;
+}
+
+/**
+ * @brief answers a metrics request of oidcd with the http metrics of the
+ * worker
+ */
+static void _httpWorker_handleMetrics(struct ipcPipe pipes) {
+  char*  text = metrics_toText();
+  cJSON* json =
+      generateJSONObject(HTTP_WORKER_KEY_BODY, cJSON_String, text ?: "", NULL);
+  secFree(text);
+  char* res = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, "%s", res);
+  secFree(res);
+}
+
+static void _httpWorker_handleRequest(struct ipcPipe pipes,
+                                      const char*    request) {
+  INIT_KEY_VALUE(HTTP_WORKER_KEY_METHOD, HTTP_WORKER_KEY_URL,
+                 HTTP_WORKER_KEY_DATA, HTTP_WORKER_KEY_HEADERS,
+                 HTTP_WORKER_KEY_CERTPATH, HTTP_WORKER_KEY_USERNAME,
+                 HTTP_WORKER_KEY_PASSWORD, HTTP_WORKER_KEY_BEARER,
+                 HTTP_WORKER_KEY_CACHEINFO, HTTP_WORKER_KEY_CONNECTTIMEOUT,
+                 HTTP_WORKER_KEY_TIMEOUT, HTTP_WORKER_KEY_HEDGE,
+                 HTTP_WORKER_KEY_FIELDS, HTTP_WORKER_KEY_TRACE);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  KEY_VALUE_VARS(method, url, data, headers, cert_path, username, password,
+                 bearer, cache_info, connect_timeout, timeout, hedge, fields,
+                 trace);
+  if (strequal(_method, HTTP_WORKER_METHOD_METRICS)) {
+    SEC_FREE_KEY_VALUES();
+    _httpWorker_handleMetrics(pipes);
+    return;
+  }
+  struct http_options options = {
+      .connect_timeout = _connect_timeout ? strtol(_connect_timeout, NULL, 10)
+                                          : 0,
+      .timeout         = _timeout ? strtol(_timeout, NULL, 10) : 0,
+      .hedge           = _hedge ? strtol(_hedge, NULL, 10) > 0 : 0};
+  list_t* fields = _fields ? JSONArrayStringToList(_fields) : NULL;
+  const char**          field_values = _fieldsFromList(fields);
+  struct http_cacheInfo info         = {0, -1, NULL};
+  struct http_request   req          = {
+      .method       = _method,
+      .url          = _url,
+      .data         = _data,
+      .headers      = _headersFromJSONArray(_headers),
+      .cert_path    = _cert_path,
+      .username     = _username,
+      .password     = _password,
+      .bearer_token = _bearer,
+      .cache_info   = strValid(_cache_info) ? &info : NULL,
+      .options      = &options,
+      .fields       = field_values};
+  char* res = NULL;
+  if (strValid(_trace)) {
+    requestTrace_start(NULL);
+  }
+  if (!strequal(_method, HTTP_METHOD_GET) &&
+      !strequal(_method, HTTP_METHOD_POST) &&
+      !strequal(_method, HTTP_METHOD_DELETE) &&
+      !strequal(_method, HTTP_METHOD_HEAD)) {
+    oidc_setInternalError("unknown http method");
+  } else if (req.cache_info) {
+    res = _httpWorker_cacheInfoResponse(_httpsPerform(&req), &info);
+    secFreeCacheInfoContent(&info);
+  } else {
+    res = _httpsPerform(&req);
+  }
+  if (requestTrace_isActive()) {
+    res = _httpWorker_traceResponse(res, req.cache_info != NULL);
+    requestTrace_stop();
+  }
+  curl_slist_free_all(req.headers);
+  secFree(field_values);
+  secFreeList(fields);
+  SEC_FREE_KEY_VALUES();
+  if (res == NULL && (oidc_errno == 429 || oidc_errno == 503) &&
+      getRetryAfter() >= 0) {
+    // oidcd needs the wait time asked for by the provider as well
+    ipc_writeToPipe(pipes, "%d %ld", oidc_errno, getRetryAfter());
+    return;
+  }
+  if (res == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  ipc_writeToPipe(pipes, "%s", res);
+  secFree(res);
+}
+
+static void _httpWorker_main(struct ipcPipe pipes) {
+  logger_open("oidc-agent.http");
+  enablePersistentCurlHandle();
+  metrics_reset();  // the series of oidcd are reported by oidcd
+  metrics_setPrefix("oidcd_http_worker");
+  while (1) {
+    char* request = ipc_readFromPipe(pipes);
+    if (request == NULL) {
+      if (oidc_errno == OIDC_EIPCDIS) {
+        agent_log(DEBUG, "oidcd closed the http worker pipe");
+        cleanupPersistentCurlHandle();
+        exit(EXIT_SUCCESS);
+      }
+      ipc_writeOidcErrnoToPipe(pipes);
+      continue;
+    }
+    _httpWorker_handleRequest(pipes, request);
+    secFree(request);
+  }
+}
+
+static int _httpWorker_isAlive() {
+  return worker_pid > 0 && kill(worker_pid, 0) == 0;
+}
+
+void httpWorker_stop() {
+  if (worker_pid <= 0) {
+    return;
+  }
+  ipc_closePipes(worker_pipes);
+  worker_pipes = (struct ipcPipe){.rx = -1, .tx = -1};
+  kill(worker_pid, SIGTERM);
+  worker_pid = 0;
+}
+
+/**
+ * @brief detaches a forked child of oidcd from the http worker of its parent
+ * Only the inherited pipes are closed, the worker of the parent keeps running.
+ * The next request of the child starts a worker of its own. The wait callback
+ * is removed as well, it belongs to the parent.
+ */
+void httpWorker_detach() {
+  if (worker_pid > 0) {
+    ipc_closePipes(worker_pipes);
+  }
+  worker_pipes = (struct ipcPipe){.rx = -1, .tx = -1};
+  worker_pid   = 0;
+  httpWorker_setWaitCallback(-1, NULL);
+}
+
+/**
+ * @brief starts the http worker
+ * Should be called early, before any sensitive information is loaded, because
+ * the worker is a fork of the calling process.
+ * @return an oidc_error code
+ */
+oidc_error_t httpWorker_start() {
+  httpWorker_stop();
+  struct pipeSet pipes = ipc_pipe_init();
+  if (pipes.pipe1.rx == -1) {
+    return oidc_errno;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    agent_log(ALERT, "fork %m");
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  if (pid == 0) {  // child
+    _httpWorker_main(toClientPipes(pipes));
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGCHLD, SIG_IGN);
+  worker_pid   = pid;
+  worker_pipes = toServerPipes(pipes);
+  agent_log(DEBUG, "Started http worker with pid %d", pid);
+  return OIDC_SUCCESS;
+}
+
+static char* _httpWorker_handleResponse(char* e) {
+  if (e == NULL) {
+    return NULL;
+  }
+  char*    end   = NULL;
+  long int error = strtol(e, &end, 10);
+  if (error) {
+    setRetryAfter(*end == ' ' ? strtol(end + 1, NULL, 10) : -1);
+    secFree(e);
+    oidc_errno = error;
+    // http status codes are used as error codes; other errors come from curl
+    char code[12];
+    snprintf(code, sizeof(code), "%ld", error);
+    metrics_inc(METRIC_HTTP_ERRORS, error >= 400 ? code : "curl");
+    agent_log(ERROR, "Error from http request: %s", oidc_serror());
+    return NULL;
+  }
+  if (*end != '\0') {
+    agent_log(DEBUG, "Received response: %s", e);
+    return e;
+  }
+  secFree(e);
+  agent_log(ERROR, "Internal error: Http sent 0");
+  oidc_errno = OIDC_EHTTP0;
+  return NULL;
+}
+
+/**
+ * @brief registers a callback that is called while waiting for the worker
+ * While a request is pending, @p callback is called whenever @p fd becomes
+ * readable. This allows the caller to handle other work (e.g. answering
+ * requests from the cache) while the https request is in flight. The callback
+ * must not issue https requests itself.
+ * @param fd the file descriptor to watch; @c -1 to disable
+ * @param callback the function to call when @p fd is readable
+ */
+void httpWorker_setWaitCallback(int fd, void (*callback)()) {
+  wait_fd       = fd;
+  wait_callback = callback;
+}
+
+/**
+ * @brief waits for @p seconds, calling the wait callback whenever its file
+ * descriptor becomes readable, e.g. while a refresh is held back
+ */
+void httpWorker_pause(double seconds) {
+  const double until = metrics_now() + seconds;
+  double       left  = seconds;
+  while (left > 0) {
+    fd_set         readSet;
+    struct timeval timeout = {.tv_sec  = (time_t)left,
+                              .tv_usec = (long)((left - (time_t)left) * 1e6)};
+    FD_ZERO(&readSet);
+    if (wait_fd >= 0) {
+      FD_SET(wait_fd, &readSet);
+    }
+    int rv = select(wait_fd + 1, &readSet, NULL, NULL, &timeout);
+    if (rv < 0) {
+      agent_log(ERROR, "select: %m");
+      return;
+    }
+    if (rv > 0 && wait_callback != NULL) {
+      wait_callback();
+    }
+    left = until - metrics_now();
+  }
+}
+
+static void _httpWorker_waitForResponse(time_t death) {
+  static int waiting = 0;
+  if (wait_fd < 0 || wait_callback == NULL || waiting) {
+    return;
+  }
+  waiting = 1;
+  while (1) {
+    fd_set         readSet;
+    struct timeval timeout = {.tv_sec = death - time(NULL)};
+    if (timeout.tv_sec < 0) {
+      timeout.tv_sec = 0;
+    }
+    FD_ZERO(&readSet);
+    FD_SET(worker_pipes.rx, &readSet);
+    FD_SET(wait_fd, &readSet);
+    int maxFd = worker_pipes.rx > wait_fd ? worker_pipes.rx : wait_fd;
+    int rv    = select(maxFd + 1, &readSet, NULL, NULL, &timeout);
+    if (rv < 0) {
+      agent_log(ERROR, "select: %m");
+      break;
+    }
+    if (rv == 0) {  // deadline reached; the read below fails as well
+      break;
+    }
+    if (FD_ISSET(worker_pipes.rx, &readSet)) {
+      break;
+    }
+    if (FD_ISSET(wait_fd, &readSet)) {
+      wait_callback();
+    }
+  }
+  waiting = 0;
+}
+
+/**
+ * @brief adds the limits of a request to the request for the worker
+ * @return the time after which oidcd stops waiting for the worker; the worker
+ * aborts the request itself before that
+ */
+static time_t _httpWorker_addOptions(cJSON*                     json,
+                                     const struct http_options* options) {
+  long timeout = HTTP_DEFAULT_TIMEOUT;
+  if (options) {
+    jsonAddNumberValue(json, HTTP_WORKER_KEY_CONNECTTIMEOUT,
+                       options->connect_timeout);
+    jsonAddNumberValue(json, HTTP_WORKER_KEY_TIMEOUT, options->timeout);
+    jsonAddNumberValue(json, HTTP_WORKER_KEY_HEDGE, options->hedge);
+    timeout = options->timeout ?: timeout;
+    if (options->hedge) {  // a hedged request has its own timeout
+      timeout *= 2;
+    }
+  }
+  return time(NULL) + timeout + HTTP_WORKER_GRACE;
+}
+
+static char* _httpWorker_send(cJSON* json, time_t death) {
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  requestTrace_mark("http_request");
+  oidc_error_t e = ipc_writeToPipe(worker_pipes, "%s", request);
+  secFree(request);
+  char* res = NULL;
+  if (e == OIDC_SUCCESS) {
+    _httpWorker_waitForResponse(death);
+    res = ipc_readFromPipeWithTimeout(worker_pipes, death);
+  }
+  requestTrace_mark("http_response");
+  if (res == NULL) {
+    oidc_error_t error = oidc_errno;
+    if (error == OIDC_ETIMEOUT) {
+      agent_log(ERROR, "Http worker did not respond in time");
+      metrics_inc(METRIC_HTTP_ERRORS, "timeout");
+    }
+    // The worker is in an unknown state; the next request will start a new one
+    httpWorker_stop();
+    oidc_errno = error;
+    return NULL;
+  }
+  return _httpWorker_handleResponse(res);
+}
+
+static char* _httpWorker_cacheInfoFromResponse(char*                  res,
+                                               struct http_cacheInfo* info) {
+  if (res == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(HTTP_WORKER_KEY_STATUS, HTTP_WORKER_KEY_MAXAGE,
+                 HTTP_WORKER_KEY_ETAG, HTTP_WORKER_KEY_BODY,
+                 HTTP_WORKER_KEY_TRACE);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(status, max_age, etag, body, trace);
+  info->status  = _status ? strtol(_status, NULL, 10) : 0;
+  info->max_age = _max_age ? strtol(_max_age, NULL, 10) : -1;
+  info->etag    = _etag;
+  requestTrace_merge(_trace);
+  secFree(_status);
+  secFree(_max_age);
+  secFree(_trace);
+  return _body ?: oidc_strcopy("");
+}
+
+/**
+ * @brief unwraps the response body of a traced (or metrics) request and adds
+ * the marks of the worker, if any, to the request trace
+ */
+static char* _httpWorker_unwrapResponse(char* res) {
+  if (res == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(HTTP_WORKER_KEY_BODY, HTTP_WORKER_KEY_TRACE);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(body, trace);
+  requestTrace_merge(_trace);
+  secFree(_trace);
+  return _body ?: oidc_strcopy("");
+}
+
+/**
+ * @brief passes a https request to the http worker and returns its response
+ * The worker is started if it is not running. If the worker does not respond
+ * within the timeout of the request, it is restarted. For a GET request with
+ * @c cache_info the caching information of the response is returned as well;
+ * its content has to be freed after usage.
+ * @return a pointer to the response. Has to be freed after usage. If the Https
+ * call failed, NULL is returned.
+ */
+char* httpWorker_request(const struct http_request* request) {
+  setRetryAfter(-1);
+  if (request->cache_info) {
+    *request->cache_info = (struct http_cacheInfo){0, -1, NULL};
+  }
+  if (!_httpWorker_isAlive() && httpWorker_start() != OIDC_SUCCESS) {
+    return NULL;
+  }
+  char*  headers_json = _headersToJSONArray(request->headers);
+  cJSON* json         = generateJSONObject(
+      HTTP_WORKER_KEY_METHOD, cJSON_String, request->method,
+      HTTP_WORKER_KEY_URL, cJSON_String, request->url, HTTP_WORKER_KEY_DATA,
+      cJSON_String, request->data, HTTP_WORKER_KEY_CERTPATH, cJSON_String,
+      request->cert_path, HTTP_WORKER_KEY_USERNAME, cJSON_String,
+      request->username, HTTP_WORKER_KEY_PASSWORD, cJSON_String,
+      request->password, HTTP_WORKER_KEY_BEARER, cJSON_String,
+      request->bearer_token, HTTP_WORKER_KEY_CACHEINFO, cJSON_String,
+      request->cache_info ? "1" : NULL, HTTP_WORKER_KEY_TRACE, cJSON_String,
+      requestTrace_isActive() ? "1" : NULL, NULL);
+  if (json == NULL) {
+    secFree(headers_json);
+    return NULL;
+  }
+  if (headers_json) {
+    jsonAddArrayValue(json, HTTP_WORKER_KEY_HEADERS, headers_json);
+    secFree(headers_json);
+  }
+  if (request->fields) {
+    cJSON* fields = generateJSONArray(NULL);
+    for (const char* const* f = request->fields; *f; f++) {
+      jsonArrayAddStringValue(fields, *f);
+    }
+    jsonAddJSON(json, HTTP_WORKER_KEY_FIELDS, fields);
+  }
+  time_t death = _httpWorker_addOptions(json, request->options);
+  char*  res   = _httpWorker_send(json, death);
+  if (request->cache_info) {
+    return _httpWorker_cacheInfoFromResponse(res, request->cache_info);
+  }
+  return requestTrace_isActive() ? _httpWorker_unwrapResponse(res) : res;
+}
+
+/**
+ * @brief returns the http metrics of the worker in the Prometheus text format
+ * The worker is not started for this.
+ * @return a pointer to the text or @c NULL if the worker is not running. Has
+ * to be freed after usage.
+ */
+char* httpWorker_metrics() {
+  if (!_httpWorker_isAlive()) {
+    return NULL;
+  }
+  cJSON* json = generateJSONObject(HTTP_WORKER_KEY_METHOD, cJSON_String,
+                                   HTTP_WORKER_METHOD_METRICS, NULL);
+  if (json == NULL) {
+    return NULL;
+  }
+  time_t death = _httpWorker_addOptions(json, NULL);
+  return _httpWorker_unwrapResponse(_httpWorker_send(json, death));
+}
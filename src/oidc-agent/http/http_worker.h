@@ -0,0 +1,42 @@
+#ifndef HTTP_WORKER_H
+#define HTTP_WORKER_H
+
+#include "http.h"
+#include "utils/oidc_error.h"
+
+#include <curl/curl.h>
+
+#define HTTP_WORKER_KEY_METHOD "method"
+#define HTTP_WORKER_KEY_URL "url"
+#define HTTP_WORKER_KEY_DATA "data"
+#define HTTP_WORKER_KEY_HEADERS "headers"
+#define HTTP_WORKER_KEY_CERTPATH "cert_path"
+#define HTTP_WORKER_KEY_USERNAME "username"
+#define HTTP_WORKER_KEY_PASSWORD "password"
+#define HTTP_WORKER_KEY_BEARER "bearer"
+#define HTTP_WORKER_KEY_CACHEINFO "cache_info"
+#define HTTP_WORKER_KEY_STATUS "status"
+#define HTTP_WORKER_KEY_MAXAGE "max_age"
+#define HTTP_WORKER_KEY_ETAG "etag"
+#define HTTP_WORKER_KEY_BODY "body"
+#define HTTP_WORKER_KEY_CONNECTTIMEOUT "connect_timeout"
+#define HTTP_WORKER_KEY_TIMEOUT "timeout"
+#define HTTP_WORKER_KEY_HEDGE "hedge"
+#define HTTP_WORKER_KEY_FIELDS "fields"
+#define HTTP_WORKER_KEY_TRACE "trace"
+
+#define HTTP_WORKER_METHOD_GET HTTP_METHOD_GET
+#define HTTP_WORKER_METHOD_POST HTTP_METHOD_POST
+#define HTTP_WORKER_METHOD_DELETE HTTP_METHOD_DELETE
+#define HTTP_WORKER_METHOD_HEAD HTTP_METHOD_HEAD
+#define HTTP_WORKER_METHOD_METRICS "METRICS"
+
+char*        httpWorker_request(const struct http_request* request);
+oidc_error_t httpWorker_start();
+void         httpWorker_stop();
+void         httpWorker_detach();
+void         httpWorker_setWaitCallback(int fd, void (*callback)());
+void         httpWorker_pause(double seconds);
+char*        httpWorker_metrics();
+
+#endif  // HTTP_WORKER_H
@@ -0,0 +1,33 @@
+#include "mhd.h"
+#include "utils/lazyLib.h"
+
+/**
+ * libmicrohttpd is only needed for the redirect of the authorization code
+ * flow, so it is loaded when the first web server is started, see lazyLib.c
+ */
+
+struct mhdLib mhd = {};
+
+oidc_error_t mhd_load() {
+  static const char* const sonames[] = {
+#ifdef __APPLE__
+      "libmicrohttpd.12.dylib", "libmicrohttpd.dylib",
+#else
+      "libmicrohttpd.so.12", "libmicrohttpd.so",
+#endif
+      NULL};
+  const struct lazySymbol symbols[] = {
+      {"MHD_start_daemon", (void**)&mhd.start_daemon},
+      {"MHD_stop_daemon", (void**)&mhd.stop_daemon},
+      {"MHD_create_response_from_buffer",
+       (void**)&mhd.create_response_from_buffer},
+#if MHD_VERSION >= 0x00096100
+      {"MHD_create_response_from_buffer_with_free_callback",
+       (void**)&mhd.create_response_from_buffer_with_free_callback},
+#endif
+      {"MHD_destroy_response", (void**)&mhd.destroy_response},
+      {"MHD_queue_response", (void**)&mhd.queue_response},
+      {"MHD_lookup_connection_value", (void**)&mhd.lookup_connection_value},
+      {NULL, NULL}};
+  return lazyLib_load("libmicrohttpd", sonames, symbols);
+}
@@ -0,0 +1,34 @@
+#ifndef HTTPSERVER_MHD_H
+#define HTTPSERVER_MHD_H
+
+#include "utils/oidc_error.h"
+
+#include <microhttpd.h>
+
+/**
+ * The functions of libmicrohttpd used by the redirect web server; they are
+ * set by @c mhd_load
+ */
+struct mhdLib {
+  struct MHD_Daemon* (*start_daemon)(unsigned int, unsigned short,
+                                     MHD_AcceptPolicyCallback, void*,
+                                     MHD_AccessHandlerCallback, void*, ...);
+  void (*stop_daemon)(struct MHD_Daemon*);
+  struct MHD_Response* (*create_response_from_buffer)(
+      size_t, void*, enum MHD_ResponseMemoryMode);
+#if MHD_VERSION >= 0x00096100
+  struct MHD_Response* (*create_response_from_buffer_with_free_callback)(
+      size_t, void*, MHD_ContentReaderFreeCallback);
+#endif
+  void (*destroy_response)(struct MHD_Response*);
+  int (*queue_response)(struct MHD_Connection*, unsigned int,
+                        struct MHD_Response*);
+  const char* (*lookup_connection_value)(struct MHD_Connection*,
+                                         enum MHD_ValueKind, const char*);
+};
+
+extern struct mhdLib mhd;
+
+oidc_error_t mhd_load();
+
+#endif  // HTTPSERVER_MHD_H
@@ -1,6 +1,7 @@
 #define _XOPEN_SOURCE
 
 #include "requestHandler.h"
+#include "mhd.h"
 
 #include "defines/ipc_values.h"
 #include "ipc/serveripc.h"
@@ -13,6 +14,7 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 const char* const HTML_SUCCESS =
 #include "static/success.html"
@@ -33,15 +35,48 @@ const char* const HTML_ERROR =
 #include "static/error.html"
     ;
 
+/**
+ * The daemon handles all connections in a single thread, so the static
+ * responses are created once on first use and then only queued again.
+ */
+static struct MHD_Response* responseWrongState = NULL;
+static struct MHD_Response* responseNoCode     = NULL;
+
+static struct MHD_Response* staticResponse(struct MHD_Response** response,
+                                           const char*           html) {
+  if (*response == NULL) {
+    *response = mhd.create_response_from_buffer(strlen(html), (void*)html,
+                                                MHD_RESPMEM_PERSISTENT);
+  }
+  return *response;
+}
+
+/**
+ * @brief queues a response with a page that was formatted for this request
+ * @param html the page; ownership is taken. Where supported, MHD uses the
+ * buffer directly and it is wiped when the response is destroyed; the page
+ * might contain the authorization code.
+ */
+static int queueDynamicResponse(struct MHD_Connection* connection,
+                                unsigned int status_code, char* html) {
+#if MHD_VERSION >= 0x00096100
+  struct MHD_Response* response =
+      mhd.create_response_from_buffer_with_free_callback(
+          strlen(html), html, (MHD_ContentReaderFreeCallback)_secFree);
+#else
+  struct MHD_Response* response = mhd.create_response_from_buffer(
+      strlen(html), (void*)html, MHD_RESPMEM_MUST_COPY);
+  secFree(html);
+#endif
+  int ret = mhd.queue_response(connection, status_code, response);
+  mhd.destroy_response(response);
+  return ret;
+}
+
 static int makeResponseCodeExchangeFailed(struct MHD_Connection* connection,
                                           const char*            url) {
-  char*                res      = oidc_sprintf(HTML_CODE_EXCHANGE_FAILED, url);
-  struct MHD_Response* response = MHD_create_response_from_buffer(
-      strlen(res), (void*)res, MHD_RESPMEM_MUST_COPY);
-  secFree(res);
-  int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-  MHD_destroy_response(response);
-  return ret;
+  return queueDynamicResponse(connection, MHD_HTTP_OK,
+                              oidc_sprintf(HTML_CODE_EXCHANGE_FAILED, url));
 }
 
 static int makeResponseFromIPCResponse(struct MHD_Connection* connection,
@@ -54,52 +89,38 @@ static int makeResponseFromIPCResponse(struct MHD_Connection* connection,
   } else {
     res = oidc_sprintf(HTML_SUCCESS, state);
   }
-  struct MHD_Response* response = MHD_create_response_from_buffer(
-      strlen(res), (void*)res, MHD_RESPMEM_MUST_COPY);
-  secFree(res);
-  int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-  MHD_destroy_response(response);
-  return ret;
+  return queueDynamicResponse(connection, MHD_HTTP_OK, res);
 }
 
 static int makeResponseWrongState(struct MHD_Connection* connection) {
-  struct MHD_Response* response = MHD_create_response_from_buffer(
-      strlen(HTML_WRONG_STATE), (void*)HTML_WRONG_STATE,
-      MHD_RESPMEM_PERSISTENT);
-  int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-  MHD_destroy_response(response);
-  return ret;
+  return mhd.queue_response(
+      connection, MHD_HTTP_BAD_REQUEST,
+      staticResponse(&responseWrongState, HTML_WRONG_STATE));
 }
 
 static int makeResponseError(struct MHD_Connection* connection) {
   const char* error =
-      MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "error");
-  const char* error_description = MHD_lookup_connection_value(
+      mhd.lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "error");
+  const char* error_description = mhd.lookup_connection_value(
       connection, MHD_GET_ARGUMENT_KIND, "error_description");
-  struct MHD_Response* response;
-  if (error) {
-    char* err = combineError(error, error_description);
-    agent_log(ERROR, "HttpServer Error: %s", err);
-    char* res = oidc_sprintf(HTML_ERROR, err);
-    secFree(err);
-    response = MHD_create_response_from_buffer(strlen(res), (void*)res,
-                                               MHD_RESPMEM_MUST_COPY);
-    secFree(res);
-    kill(getpid(), SIGTERM);
-  } else {
-    response = MHD_create_response_from_buffer(
-        strlen(HTML_NO_CODE), (void*)HTML_NO_CODE, MHD_RESPMEM_PERSISTENT);
+  if (error == NULL) {
+    return mhd.queue_response(connection, MHD_HTTP_BAD_REQUEST,
+                              staticResponse(&responseNoCode, HTML_NO_CODE));
   }
-  int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-  MHD_destroy_response(response);
+  char* err = combineError(error, error_description);
+  agent_log(ERROR, "HttpServer Error: %s", err);
+  char* res = oidc_sprintf(HTML_ERROR, err);
+  secFree(err);
+  int ret = queueDynamicResponse(connection, MHD_HTTP_BAD_REQUEST, res);
+  kill(getpid(), SIGTERM);
   return ret;
 }
 
 static int handleRequest(void* cls, struct MHD_Connection* connection) {
   const char* code =
-      MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "code");
+      mhd.lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "code");
   const char* state =
-      MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "state");
+      mhd.lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "state");
 
   if (code == NULL) {
     return makeResponseError(connection);
@@ -119,7 +140,6 @@ static int handleRequest(void* cls, struct MHD_Connection* connection) {
     ret = makeResponseFromIPCResponse(connection, res, url, state);
   }
   secFree(url);
-  secFreeArray(cr, 2);
   return ret;
 }
 
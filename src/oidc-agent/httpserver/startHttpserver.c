@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include "startHttpserver.h"
 #include "ipc/ipc.h"
+#include "mhd.h"
 #include "requestHandler.h"
 #include "running_server.h"
 #include "termHttpserver.h"
@@ -23,6 +24,20 @@
 #endif
 #include <unistd.h>
 
+/**
+ * The redirect is a handful of requests from a single browser, so all
+ * connections are handled by one thread with the best polling function
+ * available (select, poll, or epoll) instead of a thread per connection.
+ */
+#ifndef MHD_USE_INTERNAL_POLLING_THREAD  // renamed in 0.9.53
+#define MHD_USE_INTERNAL_POLLING_THREAD MHD_USE_SELECT_INTERNALLY
+#endif
+#ifdef MHD_USE_AUTO
+#define HTTPSERVER_MHD_FLAGS (MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_AUTO)
+#else
+#define HTTPSERVER_MHD_FLAGS MHD_USE_INTERNAL_POLLING_THREAD
+#endif
+
 /**
  * @param config a pointer to a json account config.
  * */
@@ -39,7 +54,7 @@ struct MHD_Daemon** startHttpServer(const char* redirect_uri,
   char**              cls      = secAlloc(sizeof(char*) * cls_size);
   cls[0]                       = oidc_strcopy(redirect_uri);
   cls[1] = oidc_sprintf("%hhu:%s", strEnds(redirect_uri, "/"), state);
-  *d_ptr = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION, port, NULL, NULL,
+  *d_ptr = mhd.start_daemon(HTTPSERVER_MHD_FLAGS, port, NULL, NULL,
                             &request_echo, cls, MHD_OPTION_END);
 
   if (*d_ptr == NULL) {
@@ -101,6 +116,11 @@ void http_sig_handler(int signo) {
 
 oidc_error_t fireHttpServer(list_t* redirect_uris, size_t size,
                             char** state_ptr) {
+  // loaded before the fork, so it is loaded only once
+  if (mhd_load() != OIDC_SUCCESS) {
+    agent_log(ERROR, "%s", oidc_serror());
+    return oidc_errno;
+  }
   int fd[2];
 #ifdef __APPLE__
   if (pipe(fd) != 0) {
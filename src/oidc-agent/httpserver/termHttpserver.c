@@ -1,16 +1,16 @@
 #define _POSIX_C_SOURCE 200809L
 #include "termHttpserver.h"
+#include "mhd.h"
 #include "running_server.h"
 #include "utils/agentLogger.h"
 #include "utils/memory.h"
 
-#include <microhttpd.h>
 #include <signal.h>
 #include <sys/types.h>
 
 void stopHttpServer(struct MHD_Daemon** d_ptr) {
   agent_log(DEBUG, "HttpServer: Stopping HttpServer");
-  MHD_stop_daemon(*d_ptr);
+  mhd.stop_daemon(*d_ptr);
   secFree(d_ptr);
 }
 
@@ -6,24 +6,61 @@
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/dbCryptUtils.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/oidc_error.h"
-#include "utils/sleeper.h"
 #include "utils/stringUtils.h"
 
 #include <string.h>
 #include <unistd.h>
 
+/**
+ * Failed unlock attempts are throttled: after the n-th failure the next
+ * attempt is only allowed 0.1*n seconds later (at most 10 s). Earlier
+ * attempts are rejected right away with @c OIDC_ETHROTTLED, so oidcd keeps
+ * serving all other requests instead of sleeping. The throttle is global,
+ * because all clients reach oidcd through the same pipe.
+ */
+static unsigned char fail_count  = 0;
+static double        next_unlock = 0;  // monotonic time of the next attempt
+
+static void _unlockFailed() {
+  if (fail_count < 100) {
+    fail_count++;
+  }
+  double delay = 0.1 * fail_count;
+  next_unlock  = metrics_now() + delay;
+  agent_log(DEBUG, "unlock failed, next attempt in %0.1lf seconds", delay);
+}
+
+/**
+ * @brief returns the seconds until the next unlock attempt is allowed
+ * @return the seconds rounded up, @c 0 if an attempt is allowed now
+ */
+unsigned int unlock_getRetryAfter() {
+  double remaining = next_unlock - metrics_now();
+  if (remaining <= 0) {
+    return 0;
+  }
+  unsigned int seconds = (unsigned int)remaining;
+  return seconds < remaining ? seconds + 1 : seconds;
+}
+
 oidc_error_t unlock(const char* password) {
-  static unsigned char fail_count = 0;
   agent_log(DEBUG, "Unlocking agent");
   if (agent_state.lock_state.locked == 0) {
     agent_log(DEBUG, "Agent not locked");
     oidc_errno = OIDC_ENOTLOCKED;
     return oidc_errno;
   }
+  if (next_unlock > metrics_now()) {
+    agent_log(DEBUG, "Unlock attempt throttled");
+    oidc_errno = OIDC_ETHROTTLED;
+    return oidc_errno;
+  }
   char* hash = s256(password);
   if (!strequal(agent_state.lock_state.hash, hash)) {
     secFree(hash);
+    _unlockFailed();
     oidc_errno = OIDC_EPASS;
     return oidc_errno;
   }
@@ -32,18 +69,12 @@ oidc_error_t unlock(const char* password) {
   if (lockDecrypt(password) == OIDC_SUCCESS) {
     agent_state.lock_state.locked = 0;
     fail_count                    = 0;
+    next_unlock                   = 0;
     secFree(agent_state.lock_state.hash);
     agent_log(DEBUG, "Agent unlocked");
     return OIDC_SUCCESS;
   }
-  /* delay in 0.1s increments up to 10s */
-  if (fail_count < 100) {
-    fail_count++;
-  }
-  unsigned int delay = 100 * fail_count;
-  agent_log(DEBUG, "unlock failed, delaying %0.1lf seconds",
-            (double)delay / 1000);
-  msleep(delay);
+  _unlockFailed();
   return oidc_errno;
 }
 
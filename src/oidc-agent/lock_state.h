@@ -9,6 +9,7 @@ struct lock_state {
 };
 
 oidc_error_t unlock(const char* password);
+unsigned int unlock_getRetryAfter();
 oidc_error_t lock(const char* password);
 
 #endif  // LOCK_STATE_H
@@ -1,7 +1,14 @@
 #include "oidc-agent_options.h"
+#include "defines/agent_values.h"
+#include "oidc-agent/oidc/defaultTokenLifetime.h"
+#include "oidc-agent/oidcp/listeners.h"
+#include "oidc-agent/oidcp/mailboxes.h"
+#include "oidc-agent/oidcp/peers.h"
+#include "oidc-agent/oidcp/top.h"
 #include "utils/agentLogger.h"
 #include "utils/stringUtils.h"
 
+#include <stdio.h>
 #include <time.h>
 
 #define OPT_SECCOMP 1
@@ -15,6 +22,38 @@
 #define OPT_STATUS 9
 #define OPT_JSON 10
 #define OPT_QUIET 11
+#define OPT_PREFETCH 12
+#define OPT_METRICS 13
+#define OPT_DEFAULT_TOKEN_LIFETIME 14
+#define OPT_TRUST_LOCAL_CLIENTS 15
+#define OPT_UPSTREAM 16
+#define OPT_WORKERS 17
+#define OPT_SNAPSHOT 18
+#define OPT_WARMUP 19
+#define OPT_MEMORY_STATS 20
+#define OPT_MAILBOX 21
+#define OPT_STATS 22
+#define OPT_SLOW_REQUEST 23
+#define OPT_PROFILE 24
+#define OPT_PROFILE_HEAP 25
+#define OPT_HEALTH 26
+#define OPT_EVICT_IDLE 27
+#define OPT_LISTEN 28
+#define OPT_PEER 29
+#define OPT_EXIT_IDLE 30
+#define OPT_MULTI_USER 31
+#define OPT_CONFIRM_GRANT 32
+#define OPT_UPGRADE 33
+#define OPT_RECORD 34
+#define OPT_ISSUER_RATE 35
+#define OPT_TOP 36
+#define OPT_SHM_IPC 37
+#define OPT_REFRESH_KEEPALIVE 38
+#define OPT_ASYNC_VALIDATE 39
+#define OPT_ATTACH 40
+#define OPT_CONFIG_CACHE 41
+
+#define DEFAULT_PREFETCH_PERCENT 75
 
 void initArguments(struct arguments* arguments) {
   arguments->kill_flag               = 0;
@@ -32,14 +71,52 @@ void initArguments(struct arguments* arguments) {
   arguments->always_allow_idtoken    = 0;
   arguments->log_console             = 0;
   arguments->status                  = 0;
+  arguments->metrics                 = 0;
+  arguments->stats                   = 0;
+  arguments->health                  = 0;
+  arguments->upgrade                 = 0;
   arguments->json                    = 0;
   arguments->quiet                   = 0;
+  arguments->prefetch                = 0;
+  arguments->trust_local_clients     = 0;
+  arguments->upstream                = NULL;
+  arguments->record                  = NULL;
+  arguments->workers                 = 1;
+  arguments->shm_ipc                 = 0;
+  arguments->snapshot                = 0;
+  arguments->warmup                  = 0;
+  arguments->memory_stats            = 0;
+  arguments->slow_request_ms         = 0;
+  arguments->profile                 = 0;
+  arguments->profile_heap            = 0;
+  arguments->top                     = 0;
+  arguments->evict_idle              = 0;
+  arguments->refresh_keepalive       = 0;
+  arguments->async_validate          = 0;
+  arguments->attach                  = 0;
+  arguments->exit_idle               = 0;
+  arguments->multi_user              = 0;
+  arguments->confirm_grant           = 0;
+  arguments->issuer_qps              = 0;
+  arguments->issuer_burst            = 0;
+  arguments->config_cache            = 0;
 }
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "General:", 1},
     {"kill", 'k', 0, 0,
      "Kill the current agent (given by the OIDCD_PID environment variable)", 1},
+    {"attach", OPT_ATTACH, 0, 0,
+     "Reuses the agent listening on the well-known socket of the user instead "
+     "of starting another one and prints its environment variables and loaded "
+     "accounts. Only if none is running a new agent is started on that "
+     "socket. Concurrent calls start at most one agent.",
+     1},
+    {"upgrade", OPT_UPGRADE, 0, 0,
+     "Replaces the current agent with the installed oidc-agent binary. The "
+     "loaded accounts, their access tokens and the stored passwords are kept "
+     "and the socket stays open.",
+     1},
     {"lifetime", 't', "TIME", 0,
      "Sets a default value in seconds for the maximum lifetime of account "
      "configurations added to the agent. A lifetime specified for an account "
@@ -60,6 +137,11 @@ static struct argp_option options[] = {
      "Requires user confirmation when an application requests an access token "
      "for any loaded configuration",
      1},
+    {"confirm-grant", OPT_CONFIRM_GRANT, "TIME", 0,
+     "Remembers a confirmed token request for TIME seconds, so that further "
+     "requests of the same user and application for the same account and "
+     "scope are not confirmed again.",
+     1},
     {"no-webserver", OPT_NO_WEBSERVER, 0, 0,
      "This option applies only when the "
      "authorization code flow is used. oidc-agent will not start a webserver. "
@@ -82,8 +164,115 @@ static struct argp_option options[] = {
      "running the agent have to be in the specified group. If no GROUP_NAME is "
      "specified the default is 'oidc-agent'.",
      1},
+    {"trust-local-clients", OPT_TRUST_LOCAL_CLIENTS, 0, 0,
+     "Allows local clients running as the same user (or as a member of the "
+     "--with-group group) to skip the key exchange and send unencrypted "
+     "requests. Without this option all clients have to encrypt their "
+     "requests.",
+     1},
+    {"upstream", OPT_UPSTREAM, "ADDRESS", 0,
+     "Forwards access token requests for accounts and issuers that are not "
+     "available in this agent to the remote agent at ADDRESS (host[:port]). "
+     "Its tokens are cached until they expire.",
+     1},
+    {"workers", OPT_WORKERS, "N", 0,
+     "Runs N oidcd worker processes instead of one. Every account is owned by "
+     "one worker, chosen by its short name, so requests for different "
+     "accounts are handled in parallel. Default value for N: 1",
+     1},
+#ifdef __linux__
+    {"shm-ipc", OPT_SHM_IPC, 0, 0,
+     "Passes the messages between the agent's processes through shared "
+     "memory instead of pipes, which saves system calls and copies for every "
+     "request.",
+     1},
+#endif
+    {"mailbox", OPT_MAILBOX, "ACCOUNT", 0,
+     "Publishes the access tokens of ACCOUNT in a shared memory mailbox that "
+     "applications can read with oidcagent_mailbox_read without contacting "
+     "the agent. Can be given multiple times or with a comma separated list "
+     "of accounts.",
+     1},
+    {"listen", OPT_LISTEN, "PATH[,POLICY]", 0,
+     "Additionally listens on the UNIX socket PATH. Clients of this socket "
+     "share the loaded accounts, but are restricted by the comma separated "
+     "POLICY: 'confirm', 'tokens-only', 'background', 'forced-rate=N' and "
+     "'group=NAME'. Can be given multiple times.",
+     1},
+    {"multi-user", OPT_MULTI_USER, 0, 0,
+     "Serves all users of the host with a single agent. Every user only has "
+     "access to the accounts they loaded, while connections and caches are "
+     "shared. Cannot be combined with autoload, --pw-store, --snapshot, "
+     "--evict-idle, --prefetch, --config-cache, --mailbox, --peer or "
+     "--upstream.",
+     1},
+    {"peer", OPT_PEER, "SOCKET", 0,
+     "Replicates new access tokens and rotated refresh tokens to the agent "
+     "listening on the UNIX socket SOCKET and takes the tokens it replicates. "
+     "Can be given multiple times or with a comma separated list of sockets.",
+     1},
+#ifdef __linux__
+    {"snapshot", OPT_SNAPSHOT, 0, 0,
+     "Writes the loaded accounts and their access tokens to an encrypted "
+     "snapshot when the agent terminates and loads them again when it is "
+     "started the next time. The password of the snapshot is kept in the "
+     "kernel keyring.",
+     1},
+#endif
     {"always-allow-idtoken", OPT_ALWAYS_ALLOW_IDTOKEN, 0, 0,
      "Always allow id-token requests without manual approval by the user.", 1},
+    {"prefetch", OPT_PREFETCH, "PERCENT", OPTION_ARG_OPTIONAL,
+     "Refreshes access tokens in the background once PERCENT of their "
+     "lifetime has passed, so that token requests can be answered without "
+     "contacting the provider. Default value for PERCENT: 75",
+     1},
+    {"warm-up", OPT_WARMUP, 0, 0,
+     "Keeps connections to the token endpoints of the loaded accounts and to "
+     "the issuers in the issuer.config open, so that the first token request "
+     "for an issuer does not have to establish a new connection.",
+     1},
+    {"evict-idle", OPT_EVICT_IDLE, "TIME", 0,
+     "Drops accounts from memory that were not used for TIME seconds. Their "
+     "config files are decrypted again when they are used the next time; "
+     "without a password stored with --pw-store the user is prompted for it. "
+     "Only accounts with a config file are dropped.",
+     1},
+    {"config-cache", OPT_CONFIG_CACHE, "TIME", 0,
+     "Keeps the files of the oidc-agent directory in memory and validates "
+     "them with a single stat once they were used for TIME seconds, so that "
+     "a directory on a network file system, e.g. NFS, is not accessed on "
+     "every request. Changes by other processes are seen after at most TIME "
+     "seconds.",
+     1},
+    {"refresh-keepalive", OPT_REFRESH_KEEPALIVE, "TIME", 0,
+     "Refreshes the loaded accounts in the background whose refresh token "
+     "was not used for about TIME seconds, so that refresh tokens with a "
+     "sliding lifetime do not expire while an account is not used.",
+     1},
+    {"async-validate", OPT_ASYNC_VALIDATE, 0, 0,
+     "Loads added accounts without waiting for the provider. An account is "
+     "validated when the agent is idle or when it is used for the first time; "
+     "if that fails, it is removed and the error is returned to the next "
+     "request for it.",
+     1},
+    {"issuer-rate", OPT_ISSUER_RATE, "QPS[,BURST]", 0,
+     "Limits the token refreshes sent to each provider to QPS per second, "
+     "with up to BURST refreshes at once. Refreshes for waiting applications "
+     "wait for their turn; background refreshes, e.g. with --prefetch, are "
+     "skipped when the limit is reached.",
+     1},
+    {"exit-idle", OPT_EXIT_IDLE, "TIME", 0,
+     "Exits after TIME seconds without clients, if the agent was started "
+     "through socket activation by systemd or launchd. The service manager "
+     "starts it again when the next client connects. Loaded accounts are "
+     "lost, unless --snapshot is used.",
+     1},
+    {"default-token-lifetime", OPT_DEFAULT_TOKEN_LIFETIME, "[ISSUER=]SECONDS",
+     0,
+     "Assumes that access tokens are valid for SECONDS if the provider does "
+     "not tell their lifetime and they have no exp claim. If ISSUER is given, "
+     "the value only applies to that issuer; can be used multiple times.",
+     1},
     {"json", OPT_JSON, 0, 0,
      "Print agent socket and pid as JSON instead of bash.", 1},
     {"quiet", OPT_QUIET, 0, 0,
@@ -98,6 +287,47 @@ static struct argp_option options[] = {
      "Connects to the currently running agent and prints status information "
      "about it.",
      2},
+    {"memory-stats", OPT_MEMORY_STATS, 0, 0,
+     "Counts the memory allocated by the agent; the counters are included in "
+     "the output of --status --json.",
+     2},
+    {"slow-request-ms", OPT_SLOW_REQUEST, "MS", 0,
+     "Logs requests that take longer than MS milliseconds with the time spent "
+     "in each stage, e.g. waiting, decrypting, and the http request.",
+     2},
+    {"record", OPT_RECORD, "FILE", 0,
+     "Appends the type, size, timing and status of the requests to "
+     "FILE, so that the traffic can be replayed for performance testing. "
+     "Account names, issuers and scopes are only recorded as hashes.",
+     2},
+    {"metrics", OPT_METRICS, 0, 0,
+     "Connects to the currently running agent and prints its metrics in the "
+     "Prometheus text format.",
+     2},
+    {"stats", OPT_STATS, 0, 0,
+     "Connects to the currently running agent and prints usage statistics "
+     "for the loaded accounts.",
+     2},
+    {"health", OPT_HEALTH, 0, 0,
+     "Connects to the currently running agent and prints how saturated it is "
+     "as JSON. Exits with a non-zero status if the agent is not ready to "
+     "serve requests.",
+     2},
+    {"top", OPT_TOP, "SECONDS", OPTION_ARG_OPTIONAL,
+     "Connects to the currently running agent and shows its requests per "
+     "second, cache hit ratio, refresh latencies, queues, memory and hottest "
+     "accounts and applications live, updated every SECONDS seconds "
+     "(default: 2). Press q to quit.",
+     2},
+    {"profile", OPT_PROFILE, "SECONDS", 0,
+     "Connects to the currently running agent, samples where it spends cpu "
+     "time for SECONDS seconds and prints the stacks in the collapsed format "
+     "used by flame graph tools. Only allowed for the user running the agent.",
+     2},
+    {"profile-heap", OPT_PROFILE_HEAP, 0, 0,
+     "Used with --profile. Samples the memory allocations instead of the cpu "
+     "time; the stacks are weighted by the allocated bytes.",
+     2},
     {0, 0, 0, 0, "Help:", -1},
     {0, 'h', 0, OPTION_HIDDEN, 0, -1},
     {0, 0, 0, 0, 0, 0}};
@@ -105,6 +335,17 @@ static struct argp_option options[] = {
 static char args_doc[] = "";
 static char doc[]      = "oidc-agent -- An agent to manage oidc token";
 
+/**
+ * @brief parses the argument of --issuer-rate, i.e. QPS[,BURST]
+ * @return @c 0 on success
+ */
+static int _parseIssuerRate(const char* arg, struct arguments* arguments) {
+  int n = sscanf(arg, "%lf,%u", &arguments->issuer_qps,
+                 &arguments->issuer_burst);
+  return n < 1 || arguments->issuer_qps <= 0 ||
+         (n == 2 && arguments->issuer_burst == 0);
+}
+
 static error_t parse_opt(int key, char* arg __attribute__((unused)),
                          struct argp_state* state) {
   struct arguments* arguments = state->input;
@@ -124,6 +365,46 @@ static error_t parse_opt(int key, char* arg __attribute__((unused)),
       break;
     case OPT_ALWAYS_ALLOW_IDTOKEN: arguments->always_allow_idtoken = 1; break;
     case OPT_STATUS: arguments->status = 1; break;
+    case OPT_METRICS: arguments->metrics = 1; break;
+    case OPT_STATS: arguments->stats = 1; break;
+    case OPT_HEALTH: arguments->health = 1; break;
+    case OPT_UPGRADE: arguments->upgrade = 1; break;
+    case OPT_PROFILE:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->profile = strToULong(arg);
+      break;
+    case OPT_PROFILE_HEAP: arguments->profile_heap = 1; break;
+    case OPT_TOP:
+      if (arg == NULL) {
+        arguments->top = TOP_DEFAULT_INTERVAL;
+        break;
+      }
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->top = strToULong(arg);
+      break;
+    case OPT_SLOW_REQUEST:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->slow_request_ms = strToULong(arg);
+      break;
+    case OPT_TRUST_LOCAL_CLIENTS: arguments->trust_local_clients = 1; break;
+    case OPT_UPSTREAM: arguments->upstream = arg; break;
+    case OPT_RECORD: arguments->record = arg; break;
+    case OPT_SNAPSHOT: arguments->snapshot = 1; break;
+    case OPT_SHM_IPC: arguments->shm_ipc = 1; break;
+    case OPT_MULTI_USER: arguments->multi_user = 1; break;
+    case OPT_WORKERS:
+      if (!isdigit(*arg) || strToInt(arg) <= 0 ||
+          strToInt(arg) > AGENT_MAX_WORKERS) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->workers = strToInt(arg);
+      break;
     case 't':
       if (!isdigit(*arg)) {
         return ARGP_ERR_UNKNOWN;
@@ -136,6 +417,75 @@ static error_t parse_opt(int key, char* arg __attribute__((unused)),
       break;
     case OPT_JSON: arguments->json = 1; break;
     case OPT_QUIET: arguments->quiet = 1; break;
+    case OPT_WARMUP: arguments->warmup = 1; break;
+    case OPT_ASYNC_VALIDATE: arguments->async_validate = 1; break;
+    case OPT_ATTACH: arguments->attach = 1; break;
+    case OPT_CONFIG_CACHE:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->config_cache = strToULong(arg);
+      break;
+    case OPT_EVICT_IDLE:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->evict_idle = strToULong(arg);
+      break;
+    case OPT_REFRESH_KEEPALIVE:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->refresh_keepalive = strToULong(arg);
+      break;
+    case OPT_ISSUER_RATE:
+      if (_parseIssuerRate(arg, arguments) != 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_EXIT_IDLE:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->exit_idle = strToULong(arg);
+      break;
+    case OPT_CONFIRM_GRANT:
+      if (!isdigit(*arg) || strToULong(arg) == 0) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->confirm_grant = strToULong(arg);
+      break;
+    case OPT_MEMORY_STATS: arguments->memory_stats = 1; break;
+    case OPT_PREFETCH:
+      if (arg == NULL) {
+        arguments->prefetch = DEFAULT_PREFETCH_PERCENT;
+        break;
+      }
+      if (!isdigit(*arg) || strToInt(arg) <= 0 || strToInt(arg) >= 100) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->prefetch = strToInt(arg);
+      break;
+    case OPT_DEFAULT_TOKEN_LIFETIME:
+      if (defaultTokenLifetime_add(arg) != OIDC_SUCCESS) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_MAILBOX:
+      if (mailboxes_enable(arg) != OIDC_SUCCESS) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_LISTEN:
+      if (listeners_add(arg) != OIDC_SUCCESS) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
+    case OPT_PEER:
+      if (peers_add(arg) != OIDC_SUCCESS) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      break;
     case 'h':
       argp_state_help(state, state->out_stream, ARGP_HELP_STD_HELP);
       break;
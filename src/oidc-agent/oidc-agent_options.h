@@ -17,13 +17,49 @@ struct arguments {
   unsigned char always_allow_idtoken;
   unsigned char log_console;
   unsigned char status;
+  unsigned char metrics;
+  unsigned char stats;
+  unsigned char health;
+  unsigned char upgrade;
   unsigned char json;
   unsigned char quiet;
+  unsigned char trust_local_clients;
+  unsigned char snapshot;
+  unsigned char warmup;
+  unsigned char async_validate;
+  unsigned char attach;
+  unsigned char memory_stats;
+  unsigned char profile_heap;
+  unsigned char multi_user;
+  unsigned char shm_ipc;
+  unsigned char prefetch;  // percentage of the token lifetime after which a
+                           // token is refreshed in the background; 0 if
+                           // disabled
+  unsigned char workers;   // number of oidcd processes
+  unsigned long slow_request_ms;  // requests taking longer are logged; 0 if
+                                  // disabled
+  unsigned long profile;  // seconds to profile the running agent; 0 if not
+  unsigned long top;      // seconds between the updates of --top; 0 if not
+  time_t        evict_idle;  // seconds after which idle accounts are evicted;
+                             // 0 if disabled
+  time_t        refresh_keepalive;  // seconds after which an unused refresh
+                                    // token is used; 0 if disabled
+  time_t        exit_idle;   // seconds without clients after which a socket
+                             // activated agent exits; 0 if disabled
+  time_t        confirm_grant;  // seconds for which a confirmation is
+                                // remembered; 0 if disabled
+  double        issuer_qps;     // refreshes per second and issuer; 0 if
+                                // not limited
+  unsigned int  issuer_burst;   // 0 for the default
+  time_t        config_cache;   // seconds the files of the oidc dir are used
+                                // without validating them; 0 if disabled
 
   time_t             lifetime;
   struct lifetimeArg pw_lifetime;
 
   char* group;
+  char* upstream;
+  char* record;  // file requests are recorded to; NULL if disabled
 };
 
 void initArguments(struct arguments* arguments);
@@ -0,0 +1,82 @@
+#include "defaultTokenLifetime.h"
+#include "account/issuer_helper.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <ctype.h>
+#include <string.h>
+
+/**
+ * Lifetimes assumed for access tokens if the provider neither returns
+ * @c expires_in nor issues JWT access tokens with an @c exp claim. Without
+ * any lifetime such tokens are never considered valid and every token request
+ * results in a refresh.
+ */
+
+struct defaultTokenLifetime {
+  char*  issuer_url;  // NULL for the lifetime used for all other issuers
+  time_t lifetime;
+};
+
+static list_t* lifetimes = NULL;
+
+static void _secFreeDefaultTokenLifetime(struct defaultTokenLifetime* l) {
+  secFree(l->issuer_url);
+  secFree(l);
+}
+
+/**
+ * @brief adds a default access token lifetime
+ * @param spec @c SECONDS to set the lifetime for all issuers or
+ * @c ISSUER=SECONDS to set it for a single issuer
+ * @return @c OIDC_SUCCESS or @c OIDC_EFMT if @p spec is malformed
+ */
+oidc_error_t defaultTokenLifetime_add(const char* spec) {
+  if (spec == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  const char* eq      = strrchr(spec, '=');
+  const char* seconds = eq ? eq + 1 : spec;
+  if (!isdigit(*seconds) || strToULong(seconds) == 0 || (eq && eq == spec)) {
+    oidc_errno = OIDC_EFMT;
+    return oidc_errno;
+  }
+  if (lifetimes == NULL) {
+    lifetimes       = list_new();
+    lifetimes->free = (void (*)(void*))_secFreeDefaultTokenLifetime;
+  }
+  struct defaultTokenLifetime* l =
+      secAlloc(sizeof(struct defaultTokenLifetime));
+  l->issuer_url = eq ? oidc_strncopy(spec, eq - spec) : NULL;
+  l->lifetime   = strToULong(seconds);
+  list_rpush(lifetimes, list_node_new(l));
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the default access token lifetime for an issuer
+ * A lifetime set for the issuer takes precedence over one set for all issuers;
+ * if set multiple times, the last one wins.
+ * @return the lifetime in seconds or @c 0 if none was set
+ */
+time_t defaultTokenLifetime_get(const char* issuer_url) {
+  if (lifetimes == NULL) {
+    return 0;
+  }
+  time_t           forIssuer = 0;
+  time_t           forAll    = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(lifetimes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct defaultTokenLifetime* l = node->val;
+    if (l->issuer_url == NULL) {
+      forAll = l->lifetime;
+    } else if (issuer_url && compIssuerUrls(l->issuer_url, issuer_url)) {
+      forIssuer = l->lifetime;
+    }
+  }
+  list_iterator_destroy(it);
+  return forIssuer ? forIssuer : forAll;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDC_DEFAULT_TOKEN_LIFETIME_H
+#define OIDC_DEFAULT_TOKEN_LIFETIME_H
+
+#include "utils/oidc_error.h"
+
+#include <time.h>
+
+oidc_error_t defaultTokenLifetime_add(const char* spec);
+time_t       defaultTokenLifetime_get(const char* issuer_url);
+
+#endif  // OIDC_DEFAULT_TOKEN_LIFETIME_H
@@ -1,14 +1,20 @@
 #include "access_token_handler.h"
+#include "account/issuer_index.h"
+#include "account/tokenCache.h"
 #include "code.h"
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "device.h"
 #include "oidc-agent/oidc/flows/oidc.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
 #include "password.h"
 #include "refresh.h"
+#include "tokenExchange.h"
 #include "utils/agentLogger.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
+#include "utils/probes.h"
 #include "utils/stringUtils.h"
 
 char* tryRefreshFlow(struct oidc_account* p, const char* scope,
@@ -22,13 +28,29 @@ char* tryRefreshFlow(struct oidc_account* p, const char* scope,
   return refreshFlow(TOKENPARSEMODE_RETURN_AT, p, scope, audience, pipes);
 }
 
+/**
+ * @brief returns an id token for the given scope
+ * An id token from an earlier refresh is reused if it is still valid for at
+ * least @c IDTOKEN_MIN_VALID_PERIOD seconds.
+ * @return a pointer to the id token; it has to be freed after usage
+ */
 char* getIdToken(struct oidc_account* p, const char* scope,
                  struct ipcPipe pipes) {
+  char* cached =
+      account_getValidCachedIdToken(p, scope, IDTOKEN_MIN_VALID_PERIOD);
+  if (cached) {
+    agent_log(DEBUG, "Using cached id token");
+    return oidc_strcopy(cached);
+  }
   if (!account_refreshTokenIsValid(p)) {
     agent_log(ERROR, "No refresh token found");
     oidc_errno = OIDC_ENOREFRSH;
     return NULL;
   }
+  if (oidcd_waitForRefreshLease(pipes, p)) {
+    // id tokens are not replicated, but the refresh token of the peer is used
+    oidcd_waitForRefreshLease(pipes, p);
+  }
   return refreshFlow(TOKENPARSEMODE_RETURN_ID, p, scope, NULL, pipes);
 }
 
@@ -58,25 +80,128 @@ oidc_error_t tryPasswordFlow(struct oidc_account* p, struct ipcPipe pipes,
  * (at least)
  * @return 1 if the access_token is valid for the given time; 0 if not.
  */
+static int _expiresAtIsValidForSeconds(time_t expires_at,
+                                       time_t min_valid_period) {
+  time_t now = time(NULL);
+  return expires_at - now > 0 && expires_at - now > min_valid_period;
+}
+
 int tokenIsValidForSeconds(const struct oidc_account* p,
                            time_t                     min_valid_period) {
-  time_t now        = time(NULL);
-  time_t expires_at = account_getTokenExpiresAt(p);
-  return expires_at - now > 0 && expires_at - now > min_valid_period;
+  return _expiresAtIsValidForSeconds(account_getTokenExpiresAt(p),
+                                     min_valid_period);
+}
+
+/**
+ * @brief returns an already issued access token for the given scope and
+ * audience, if it is valid long enough
+ * The refresh token is not needed for this, so the account does not have to be
+ * decrypted.
+ * @return a pointer to the access token or @c NULL if there is no such token.
+ * The token MUST NOT be freed.
+ */
+char* getValidCachedAccessToken(struct oidc_account* account,
+                                time_t min_valid_period, const char* scope,
+                                const char* audience) {
+  if (min_valid_period == FORCE_NEW_TOKEN) {
+    return NULL;
+  }
+  if (!strValid(scope) && !strValid(audience)) {
+    if (strValid(account_getAccessToken(account)) &&
+        tokenIsValidForSeconds(account, min_valid_period)) {
+      return account_getAccessToken(account);
+    }
+    return NULL;
+  }
+  struct token* cached = account_findCachedToken(account, scope, audience);
+  if (cached && strValid(cached->access_token) &&
+      _expiresAtIsValidForSeconds(cached->token_expires_at, min_valid_period)) {
+    agent_log(DEBUG, "Using cached access token for requested scope / "
+                     "audience");
+    return cached->access_token;
+  }
+  return NULL;
+}
+
+/**
+ * @brief obtains a token for another scope or audience by exchanging the
+ * account's default access token, if enabled for the issuer
+ * @return the access token or @c NULL if it could not be obtained this way;
+ * then the refresh flow should be used
+ */
+static char* _tryTokenExchange(struct oidc_account* account,
+                               time_t min_valid_period, const char* scope,
+                               const char* audience) {
+  if ((!strValid(scope) && !strValid(audience)) ||
+      !issuerIndex_useTokenExchange(account_getIssuerUrl(account))) {
+    return NULL;
+  }
+  // the exchanged token is usually not valid longer than the exchanged one
+  time_t min_valid = min_valid_period > 0 ? min_valid_period : 0;
+  if (!strValid(account_getAccessToken(account)) ||
+      !tokenIsValidForSeconds(account, min_valid)) {
+    return NULL;
+  }
+  char* access_token = tokenExchangeFlow(account, scope, audience);
+  if (access_token == NULL) {
+    agent_log(NOTICE, "Token exchange failed, using the refresh token: %s",
+              oidc_serror());
+    return NULL;
+  }
+  unsigned long expires_at =
+      account_getTokenExpiresAtFor(account, scope, audience);
+  if (expires_at && !_expiresAtIsValidForSeconds(expires_at, min_valid)) {
+    return NULL;
+  }
+  return access_token;
 }
 
 char* getAccessTokenUsingRefreshFlow(struct oidc_account* account,
                                      time_t min_valid_period, const char* scope,
                                      const char*    audience,
                                      struct ipcPipe pipes) {
-  if (scope == NULL && audience == NULL &&
-      min_valid_period != FORCE_NEW_TOKEN &&
-      strValid(account_getAccessToken(account)) &&
-      tokenIsValidForSeconds(account, min_valid_period)) {
-    return account_getAccessToken(account);
+  char* cached =
+      getValidCachedAccessToken(account, min_valid_period, scope, audience);
+  if (cached) {
+    OIDC_PROBE1(refresh_hit, account_getName(account));
+    return cached;
   }
   agent_log(DEBUG, "No access token found that is valid long enough");
-  return tryRefreshFlow(account, scope, audience, pipes);
+  OIDC_PROBE1(refresh_miss, account_getName(account));
+  cached = _tryTokenExchange(account, min_valid_period, scope, audience);
+  if (cached) {
+    return cached;
+  }
+  if (oidcd_waitForRefreshLease(pipes, account)) {
+    // a peer agent refreshed the token in the meantime
+    cached =
+        getValidCachedAccessToken(account, min_valid_period, scope, audience);
+    if (cached) {
+      return cached;
+    }
+    oidcd_waitForRefreshLease(pipes, account);
+  }
+  char* token = tryRefreshFlow(account, scope, audience, pipes);
+  if (token != NULL) {
+    accountStats_recordRefresh(account_getName(account));
+  }
+  const oidc_error_t error = oidc_errno;
+  if (token == NULL &&
+      (error == OIDC_EUNAVAIL || error == OIDC_EISSUERRATE || error == 429 ||
+       error == 503) &&
+      min_valid_period != FORCE_NEW_TOKEN) {
+    // the provider is down or overloaded; a token that is still valid is
+    // better than none
+    cached = getValidCachedAccessToken(account, 0, scope, audience);
+    if (cached) {
+      agent_log(NOTICE, "Provider unavailable, returning an access token that "
+                        "is valid for less than the requested time");
+      oidc_errno = OIDC_SUCCESS;
+      return cached;
+    }
+    oidc_errno = error;
+  }
+  return token;
 }
 
 oidc_error_t getAccessTokenUsingPasswordFlow(struct oidc_account* account,
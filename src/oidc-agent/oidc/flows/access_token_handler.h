@@ -12,6 +12,9 @@ char*        getAccessTokenUsingRefreshFlow(struct oidc_account* account,
                                             time_t min_valid_period, const char* scope,
                                             const char*    audience,
                                             struct ipcPipe pipes);
+char*        getValidCachedAccessToken(struct oidc_account* account,
+                                       time_t               min_valid_period,
+                                       const char* scope, const char* audience);
 char*        getIdToken(struct oidc_account* p, const char* scope,
                         struct ipcPipe pipes);
 oidc_error_t getAccessTokenUsingPasswordFlow(struct oidc_account* account,
@@ -16,26 +16,26 @@ oidc_error_t codeExchange(struct oidc_account* account, const char* code,
                           const char* used_redirect_uri, char* code_verifier,
                           struct ipcPipe pipes) {
   agent_log(DEBUG, "Doing Authorization Code Flow\n");
-  list_t* postData =
-      createList(LIST_CREATE_DONT_COPY_VALUES,
-                 // OIDC_KEY_CLIENTID, account_getClientId(account),
-                 // OIDC_KEY_CLIENTSECRET, account_getClientSecret(account),
-                 OIDC_KEY_GRANTTYPE, OIDC_GRANTTYPE_AUTHCODE, OIDC_KEY_CODE,
-                 code, OIDC_KEY_REDIRECTURI, used_redirect_uri,
-                 OIDC_KEY_RESPONSETYPE, OIDC_RESPONSETYPE_TOKEN, NULL);
+  vector_t* postData = createVector(
+      // OIDC_KEY_CLIENTID, account_getClientId(account),
+      // OIDC_KEY_CLIENTSECRET, account_getClientSecret(account),
+      OIDC_KEY_GRANTTYPE, OIDC_GRANTTYPE_AUTHCODE, OIDC_KEY_CODE, code,
+      OIDC_KEY_REDIRECTURI, used_redirect_uri, OIDC_KEY_RESPONSETYPE,
+      OIDC_RESPONSETYPE_TOKEN, NULL);
   if (code_verifier) {
-    list_rpush(postData, list_node_new(OIDC_KEY_CODEVERIFIER));
-    list_rpush(postData, list_node_new(code_verifier));
+    vector_push(postData, OIDC_KEY_CODEVERIFIER);
+    vector_push(postData, code_verifier);
   }
-  char* data = generatePostDataFromList(postData);
-  list_destroy(postData);
+  char* data = generatePostDataFromVector(postData);
+  secFreeVector(postData);
   if (data == NULL) {
     return oidc_errno;
   }
   agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = sendPostDataWithBasicAuth(
       account_getTokenEndpoint(account), data, account_getCertPath(account),
-      account_getClientId(account), account_getClientSecret(account));
+      account_getClientId(account), account_getClientSecret(account), &options);
   secFree(data);
   if (res == NULL) {
     return oidc_errno;
@@ -95,31 +95,31 @@ char* buildCodeFlowUri(const struct oidc_account* account, char** state_ptr,
     secFree(*state_ptr);
     *state_ptr = tmp;
   }
-  list_t* postData = createList(
-      LIST_CREATE_DONT_COPY_VALUES, OIDC_KEY_RESPONSETYPE,
-      OIDC_RESPONSETYPE_CODE, OIDC_KEY_CLIENTID, account_getClientId(account),
-      OIDC_KEY_REDIRECTURI, redirect, OIDC_KEY_SCOPE, account_getScope(account),
-      GOOGLE_KEY_ACCESSTYPE, GOOGLE_ACCESSTYPE_OFFLINE, OIDC_KEY_PROMPT,
-      OIDC_PROMPT_CONSENT, OIDC_KEY_STATE, *state_ptr, NULL);
+  vector_t* postData = createVector(
+      OIDC_KEY_RESPONSETYPE, OIDC_RESPONSETYPE_CODE, OIDC_KEY_CLIENTID,
+      account_getClientId(account), OIDC_KEY_REDIRECTURI, redirect,
+      OIDC_KEY_SCOPE, account_getScope(account), GOOGLE_KEY_ACCESSTYPE,
+      GOOGLE_ACCESSTYPE_OFFLINE, OIDC_KEY_PROMPT, OIDC_PROMPT_CONSENT,
+      OIDC_KEY_STATE, *state_ptr, NULL);
   char* code_challenge_method = account_getCodeChallengeMethod(account);
   char* code_challenge =
       createCodeChallenge(*code_verifier_ptr, code_challenge_method);
   if (code_challenge) {
-    list_rpush(postData, list_node_new(OIDC_KEY_CODECHALLENGE_METHOD));
-    list_rpush(postData, list_node_new(code_challenge_method));
-    list_rpush(postData, list_node_new(OIDC_KEY_CODECHALLENGE));
-    list_rpush(postData, list_node_new(code_challenge));
+    vector_push(postData, OIDC_KEY_CODECHALLENGE_METHOD);
+    vector_push(postData, code_challenge_method);
+    vector_push(postData, OIDC_KEY_CODECHALLENGE);
+    vector_push(postData, code_challenge);
   } else {
     secFree(*code_verifier_ptr);
     code_verifier_ptr = NULL;
   }
   if (strValid(account_getAudience(account))) {
-    list_rpush(postData, list_node_new(OIDC_KEY_AUDIENCE));
-    list_rpush(postData, list_node_new(account_getAudience(account)));
+    vector_push(postData, OIDC_KEY_AUDIENCE);
+    vector_push(postData, account_getAudience(account));
   }
-  char* uri_parameters = generatePostDataFromList(postData);
+  char* uri_parameters = generatePostDataFromVector(postData);
   secFree(code_challenge);
-  list_destroy(postData);
+  secFreeVector(postData);
   char* uri = oidc_sprintf("%s?%s", auth_endpoint, uri_parameters);
   secFree(uri_parameters);
   return uri;
@@ -16,22 +16,22 @@ char* generateDeviceCodePostData(const struct oidc_account* a) {
 
 char* generateDeviceCodeLookupPostData(const struct oidc_account* a,
                                        const char*                device_code) {
-  char*   tmp_devicecode = oidc_strcopy(device_code);
-  list_t* postDataList   = list_new();
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTID));
-  // list_rpush(postDataList, list_node_new(account_getClientId(a)));
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTSECRET));
-  // list_rpush(postDataList, list_node_new(account_getClientSecret(a)));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_GRANTTYPE));
-  list_rpush(postDataList, list_node_new(OIDC_GRANTTYPE_DEVICE));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_DEVICECODE));
-  list_rpush(postDataList, list_node_new(tmp_devicecode));
+  char*     tmp_devicecode = oidc_strcopy(device_code);
+  vector_t* postDataList   = vector_new();
+  // vector_push(postDataList, OIDC_KEY_CLIENTID);
+  // vector_push(postDataList, account_getClientId(a));
+  // vector_push(postDataList, OIDC_KEY_CLIENTSECRET);
+  // vector_push(postDataList, account_getClientSecret(a));
+  vector_push(postDataList, OIDC_KEY_GRANTTYPE);
+  vector_push(postDataList, OIDC_GRANTTYPE_DEVICE);
+  vector_push(postDataList, OIDC_KEY_DEVICECODE);
+  vector_push(postDataList, tmp_devicecode);
   if (strValid(account_getAudience(a))) {
-    list_rpush(postDataList, list_node_new(OIDC_KEY_AUDIENCE));
-    list_rpush(postDataList, list_node_new(account_getAudience(a)));
+    vector_push(postDataList, OIDC_KEY_AUDIENCE);
+    vector_push(postDataList, account_getAudience(a));
   }
-  char* str = generatePostDataFromList(postDataList);
-  list_destroy(postDataList);
+  char* str = generatePostDataFromVector(postDataList);
+  secFreeVector(postDataList);
   secFree(tmp_devicecode);
   return str;
 }
@@ -49,9 +49,10 @@ struct oidc_device_code* initDeviceFlow(struct oidc_account* account) {
     return NULL;
   }
   agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = sendPostDataWithBasicAuth(
       device_authorization_endpoint, data, account_getCertPath(account),
-      account_getClientId(account), account_getClientSecret(account));
+      account_getClientId(account), account_getClientSecret(account), &options);
   secFree(data);
   if (res == NULL) {
     return NULL;
@@ -86,9 +87,10 @@ oidc_error_t lookUpDeviceCode(struct oidc_account* account,
     return oidc_errno;
   }
   agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = sendPostDataWithBasicAuth(
       account_getTokenEndpoint(account), data, account_getCertPath(account),
-      account_getClientId(account), account_getClientSecret(account));
+      account_getClientId(account), account_getClientSecret(account), &options);
   secFree(data);
   if (res == NULL) {
     return oidc_errno;
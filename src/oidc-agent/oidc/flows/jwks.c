@@ -0,0 +1,29 @@
+#include "jwks.h"
+
+#include "account/account.h"
+#include "oidc-agent/http/http_transport.h"
+#include "oidc.h"
+#include "utils/agentLogger.h"
+#include "utils/stringUtils.h"
+
+/**
+ * @brief fetches the signing keys of the issuer of an account from its
+ * @c jwks_uri
+ * @return a pointer to the key set as json string; has to be freed after
+ * usage. On failure @c NULL is returned and @c oidc_errno is set.
+ */
+char* fetchJwks(struct oidc_account* account) {
+  agent_log(DEBUG, "Fetching signing keys");
+  const char* jwks_uri = account_getJwksUri(account);
+  if (!strValid(jwks_uri)) {
+    oidc_errno = OIDC_ENOSUPJWKS;
+    agent_log(NOTICE, "%s", oidc_serror());
+    return NULL;
+  }
+  struct http_options options = getHttpOptions(account, 1);
+  return httpTransport_perform(
+      &(struct http_request){.method    = HTTP_METHOD_GET,
+                             .url       = jwks_uri,
+                             .cert_path = account_getCertPath(account),
+                             .options   = &options});
+}
@@ -0,0 +1,8 @@
+#ifndef OIDC_JWKS_FLOW_H
+#define OIDC_JWKS_FLOW_H
+
+#include "account/account.h"
+
+char* fetchJwks(struct oidc_account* account);
+
+#endif  // OIDC_JWKS_FLOW_H
@@ -1,54 +1,83 @@
 #include "oidc.h"
 #include "account/account.h"
+#include "account/issuer_index.h"
 #include "defines/oidc_values.h"
+#include "oidc-agent/oidc/defaultTokenLifetime.h"
 #include "oidc-agent/oidcd/internal_request_handler.h"
 #include "utils/agentLogger.h"
 #include "utils/errorUtils.h"
 #include "utils/json.h"
+#include "utils/jwt.h"
 #include "utils/key_value.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
+#include "utils/uriUtils.h"
 
 #include <stdarg.h>
 #include <stddef.h>
 #include <time.h>
 
+/**
+ * @brief returns the limits for https requests to the issuer of an account
+ * @param hedgeable if the request can safely be sent twice; a refresh request
+ * can, but e.g. an authorization code can only be used once
+ */
+struct http_options getHttpOptions(const struct oidc_account* account,
+                                   unsigned char              hedgeable) {
+  struct http_options options =
+      issuerIndex_getHttpOptions(account_getIssuerUrl(account));
+  if (!hedgeable) {
+    options.hedge = 0;
+  }
+  return options;
+}
+
 /**
  * last argument has to be NULL
  */
 char* generatePostData(char* k1, char* v1, ...) {
   va_list args;
   va_start(args, v1);
-  list_t* list = list_new();
-  list_rpush(list, list_node_new(k1));
-  list_rpush(list, list_node_new(v1));
+  vector_t* vector = vector_new();
+  vector_push(vector, k1);
+  vector_push(vector, v1);
   char* s;
-  while ((s = va_arg(args, char*)) != NULL) {
-    list_rpush(list, list_node_new(s));
-  }
+  while ((s = va_arg(args, char*)) != NULL) { vector_push(vector, s); }
   va_end(args);
-  char* data = generatePostDataFromList(list);
-  list_destroy(list);
+  char* data = generatePostDataFromVector(vector);
+  secFreeVector(vector);
   return data;
 }
 
-char* generatePostDataFromList(list_t* list) {
-  if (list == NULL || list->len < 2) {
+/**
+ * @brief builds an application/x-www-form-urlencoded string
+ * @param vector alternating keys and values; keys and values are
+ * percent-encoded, @c NULL values are encoded as empty values
+ * @return a pointer to the encoded string. Has to be freed after usage.
+ */
+char* generatePostDataFromVector(const vector_t* vector) {
+  if (vector == NULL || vector->len < 2) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  char* data = oidc_sprintf("%s=%s", (char*)list_at(list, 0)->val,
-                            (char*)list_at(list, 1)->val);
-  for (size_t i = 2; i < list->len - 1; i += 2) {
-    char* tmp = oidc_sprintf("%s&%s=%s", data, (char*)list_at(list, i)->val,
-                             (char*)list_at(list, i + 1)->val);
-    if (tmp == NULL) {
-      return NULL;
-    }
-    secFree(data);
-    data = tmp;
+  // A trailing key without value is ignored
+  const size_t n   = vector->len - vector->len % 2;
+  size_t       len = 0;
+  for (size_t i = 0; i < n; i++) {
+    // Each key is followed by '=', each value by '&' or the terminating zero
+    len += urlencodedLength(vector_at(vector, i)) + 1;
   }
+  char* data = secAlloc(len);
+  if (data == NULL) {
+    return NULL;
+  }
+  char* p = data;
+  for (size_t i = 0; i < n; i++) {
+    p    = urlencodeInto(p, vector_at(vector, i));
+    *p++ = i % 2 ? '&' : '=';
+  }
+  p[-1] = '\0';
   return data;
 }
 
@@ -64,6 +93,27 @@ void defaultErrorHandling(const char* error, const char* error_description) {
   (TOKENPARSEMODE_SAVE_AT | TOKENPARSEMODE_RETURN_AT)
 #define TOKENPARSEMODE_DONTFREE_ID TOKENPARSEMODE_RETURN_ID
 
+/**
+ * @brief determines when an access token expires if the token response did
+ * not include @c expires_in
+ * The @c exp claim is used for JWT access tokens; for opaque tokens the
+ * default lifetime configured for the issuer, if any.
+ * @return the point in time or @c 0 if it is unknown
+ */
+static time_t _getFallbackExpiresAt(const struct oidc_account* a,
+                                    const char* access_token, time_t now) {
+  if (access_token == NULL) {
+    return 0;
+  }
+  time_t exp = isJWT(access_token) ? jwt_getExpiresAt(access_token) : 0;
+  if (exp) {
+    agent_log(DEBUG, "No expires_in, using the exp claim of the token");
+    return exp;
+  }
+  time_t lifetime = defaultTokenLifetime_get(account_getIssuerUrl(a));
+  return lifetime ? now + lifetime : 0;
+}
+
 char* parseTokenResponseCallbacks(
     const unsigned char mode, const char* res, struct oidc_account* a,
     void (*errorHandling)(const char*, const char*), struct ipcPipe pipes,
@@ -88,13 +138,18 @@ char* parseTokenResponseCallbacks(
     return NULL;
   }
 
-  if (NULL != _expires_in) {
-    if (mode & TOKENPARSEMODE_SAVE_AT) {
-      account_setTokenExpiresAt(a, time(NULL) + strToInt(_expires_in));
+  if (mode & TOKENPARSEMODE_SAVE_AT) {
+    const time_t now        = time(NULL);
+    const time_t expires_at =
+        _expires_in ? now + strToInt(_expires_in)
+                    : _getFallbackExpiresAt(a, _access_token, now);
+    if (expires_at) {
+      account_setTokenIssuedAt(a, now);
+      account_setTokenExpiresAt(a, expires_at);
       agent_log(DEBUG, "expires_at is: %lu\n", account_getTokenExpiresAt(a));
     }
-    secFree(_expires_in);
   }
+  secFree(_expires_in);
 
   char* refresh_token = account_getRefreshToken(a);
   if (strValid(_refresh_token) && !strequal(refresh_token, _refresh_token)) {
@@ -112,7 +167,9 @@ char* parseTokenResponseCallbacks(
                         // but possible)
       agent_log(DEBUG, "Updating refreshtoken for %s from '%s' to '%s'",
                 account_getName(a), refresh_token, _refresh_token);
-      oidcd_handleUpdateRefreshToken(pipes, account_getName(a), _refresh_token);
+      oidcd_handleUpdateRefreshToken(pipes, account_getName(a),
+                                     account_getRefreshTokenSlot(a),
+                                     _refresh_token);
     }
     account_setRefreshToken(a, _refresh_token);
   } else {
@@ -121,6 +178,8 @@ char* parseTokenResponseCallbacks(
 
   if (mode & TOKENPARSEMODE_SAVE_AT) {
     account_setAccessToken(a, _access_token);
+    _access_token = account_getAccessToken(a);  // moved into the token pool
+    oidcd_notifyTokenRefreshed(pipes, a);
   }
 
   if (!(mode & TOKENPARSEMODE_DONTFREE_AT)) {
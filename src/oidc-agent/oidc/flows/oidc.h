@@ -3,14 +3,18 @@
 
 #include "account/account.h"
 #include "ipc/pipe.h"
+#include "utils/httpOptions.h"
+#include "utils/vector.h"
 
 #define TOKENPARSEMODE_SAVE_AT 0x01
 #define TOKENPARSEMODE_SAVE_AT_IF(X) ((X) ? 0x01 : 0)
 #define TOKENPARSEMODE_RETURN_AT 0x02
 #define TOKENPARSEMODE_RETURN_ID 0x04
 
+struct http_options getHttpOptions(const struct oidc_account* account,
+                                   unsigned char              hedgeable);
 char* generatePostData(char* k1, char* v1, ...);
-char* generatePostDataFromList(list_t* list);
+char* generatePostDataFromVector(const vector_t* vector);
 char* parseTokenResponse(const unsigned char mode, const char* res,
                          struct oidc_account* a, struct ipcPipe pipes,
                          const unsigned char refreshFlow);
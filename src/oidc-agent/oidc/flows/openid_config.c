@@ -1,13 +1,104 @@
 #include "openid_config.h"
 
 #include "account/account.h"
+#include "defines/oidc_values.h"
 #include "defines/settings.h"
 #include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/oidc/flows/oidc.h"
 #include "oidc-agent/oidc/parse_oidp.h"
 #include "utils/agentLogger.h"
+#include "utils/db/issuerConfig_db.h"
+#include "utils/json.h"
 #include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
 
+#include <time.h>
+
+/**
+ * The fields of the openid configuration that are used by
+ * @c parseOpenidConfiguration; only these are received and cached, so large
+ * documents are never held completely.
+ */
+static const char* const configurationFields[] = {
+    OIDC_KEY_TOKEN_ENDPOINT,
+    OIDC_KEY_AUTHORIZATION_ENDPOINT,
+    OIDC_KEY_REGISTRATION_ENDPOINT,
+    OIDC_KEY_REVOCATION_ENDPOINT,
+    OIDC_KEY_USERINFO_ENDPOINT,
+    OIDC_KEY_JWKS_URI,
+    OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT,
+    OIDC_KEY_SCOPES_SUPPORTED,
+    OIDC_KEY_GRANT_TYPES_SUPPORTED,
+    OIDC_KEY_RESPONSE_TYPES_SUPPORTED,
+    OIDC_KEY_CODE_CHALLENGE_METHODS_SUPPORTED,
+    NULL};
+
+static time_t _expiresAt(const struct http_cacheInfo* info, time_t now) {
+  return now +
+         (info->max_age >= 0 ? info->max_age : ISSUER_CONFIG_DEFAULT_MAX_AGE);
+}
+
+/**
+ * @brief returns the openid configuration document from the configuration
+ * endpoint
+ * The document is cached per configuration endpoint, so it is shared by all
+ * accounts of the same issuer. A fresh cached document is returned without a
+ * request; a stale one is revalidated with a conditional GET using its
+ * @c ETag.
+ * @return a pointer to the document. Has to be freed after usage. On failure
+ * NULL is returned.
+ */
+static char* _getConfigurationDocument(const char* configuration_endpoint,
+                                       const char* cert_path,
+                                       const struct http_options* options) {
+  time_t                     now = time(NULL);
+  struct issuerConfig_entry* cached =
+      issuerConfigDB_findValue(configuration_endpoint);
+  if (cached && cached->expires_at > now) {
+    agent_log(DEBUG, "Using cached openid configuration");
+    return oidc_strcopy(cached->document);
+  }
+  struct curl_slist* headers = NULL;
+  if (cached && cached->etag) {
+    char* header = oidc_sprintf(HTTP_HEADER_IF_NONE_MATCH_FMT, cached->etag);
+    headers      = curl_slist_append(headers, header);
+    secFree(header);
+  }
+  struct http_cacheInfo info;
+  char* res = httpsGETWithCacheInfo(configuration_endpoint, headers, cert_path,
+                                    &info, options, configurationFields);
+  curl_slist_free_all(headers);
+  // concurrent requests might have been handled while waiting
+  cached = issuerConfigDB_findValue(configuration_endpoint);
+  if (res == NULL) {
+    secFreeCacheInfoContent(&info);
+    if (cached == NULL) {
+      return NULL;
+    }
+    agent_log(NOTICE, "Could not revalidate openid configuration, using the "
+                      "cached one");
+    return oidc_strcopy(cached->document);
+  }
+  if (info.status == HTTP_STATUS_NOT_MODIFIED && cached) {
+    agent_log(DEBUG, "Cached openid configuration is still valid");
+    secFree(res);
+    cached->expires_at = _expiresAt(&info, now);
+    if (info.etag) {
+      secFree(cached->etag);
+      cached->etag = info.etag;
+      info.etag    = NULL;
+    }
+    secFreeCacheInfoContent(&info);
+    return oidc_strcopy(cached->document);
+  }
+  if (isJSONObject(res)) {
+    issuerConfigDB_addValue(configuration_endpoint, res, info.etag,
+                            _expiresAt(&info, now));
+  }
+  secFreeCacheInfoContent(&info);
+  return res;
+}
+
 /** @fn oidc_error_t getIssuerConfig(struct oidc_account* account)
  * @brief retrieves issuer config from the configuration_endpoint
  * @note the issuer url has to be set prior
@@ -22,8 +113,10 @@ oidc_error_t getIssuerConfig(struct oidc_account* account) {
                                   configuration_endpoint);
   agent_log(DEBUG, "Configuration endpoint is: %s",
             account_getConfigEndpoint(account));
-  char* res = httpsGET(account_getConfigEndpoint(account), NULL,
-                       account_getCertPath(account));
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = _getConfigurationDocument(
+      account_getConfigEndpoint(account), account_getCertPath(account),
+      &options);
   if (NULL == res) {
     return oidc_errno;
   }
@@ -12,28 +12,27 @@
 
 char* generatePasswordPostData(const struct oidc_account* a,
                                const char*                scope) {
-  list_t* postDataList = list_new();
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTID));
-  // list_rpush(postDataList, list_node_new(account_getClientId(a)));
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTSECRET));
-  // list_rpush(postDataList, list_node_new(account_getClientSecret(a)));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_GRANTTYPE));
-  list_rpush(postDataList, list_node_new(OIDC_GRANTTYPE_PASSWORD));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_USERNAME));
-  list_rpush(postDataList, list_node_new(account_getUsername(a)));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_PASSWORD));
-  list_rpush(postDataList, list_node_new(account_getPassword(a)));
+  vector_t* postDataList = vector_new();
+  // vector_push(postDataList, OIDC_KEY_CLIENTID);
+  // vector_push(postDataList, account_getClientId(a));
+  // vector_push(postDataList, OIDC_KEY_CLIENTSECRET);
+  // vector_push(postDataList, account_getClientSecret(a));
+  vector_push(postDataList, OIDC_KEY_GRANTTYPE);
+  vector_push(postDataList, OIDC_GRANTTYPE_PASSWORD);
+  vector_push(postDataList, OIDC_KEY_USERNAME);
+  vector_push(postDataList, account_getUsername(a));
+  vector_push(postDataList, OIDC_KEY_PASSWORD);
+  vector_push(postDataList, account_getPassword(a));
   if (scope || strValid(account_getScope(a))) {
-    list_rpush(postDataList, list_node_new(OIDC_KEY_SCOPE));
-    list_rpush(postDataList,
-               list_node_new((char*)scope ?: account_getScope(a)));
+    vector_push(postDataList, OIDC_KEY_SCOPE);
+    vector_push(postDataList, (char*)scope ?: account_getScope(a));
   }
   if (strValid(account_getAudience(a))) {
-    list_rpush(postDataList, list_node_new(OIDC_KEY_AUDIENCE));
-    list_rpush(postDataList, list_node_new(account_getAudience(a)));
+    vector_push(postDataList, OIDC_KEY_AUDIENCE);
+    vector_push(postDataList, account_getAudience(a));
   }
-  char* str = generatePostDataFromList(postDataList);
-  list_destroy(postDataList);
+  char* str = generatePostDataFromVector(postDataList);
+  secFreeVector(postDataList);
   return str;
 }
 
@@ -51,9 +50,10 @@ oidc_error_t passwordFlow(struct oidc_account* p, struct ipcPipe pipes,
     ;
   }
   agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(
+  struct http_options options = getHttpOptions(p, 0);
+  char*               res     = sendPostDataWithBasicAuth(
       account_getTokenEndpoint(p), data, account_getCertPath(p),
-      account_getClientId(p), account_getClientSecret(p));
+      account_getClientId(p), account_getClientSecret(p), &options);
   secFree(data);
   if (NULL == res) {
     return oidc_errno;
@@ -1,80 +1,105 @@
 #include "refresh.h"
 
 #include "account/account.h"
+#include "account/refreshTemplate.h"
+#include "account/tokenCache.h"
 #include "defines/oidc_values.h"
 #include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/oidc/issuerHealth.h"
+#include "oidc-agent/oidc/issuerRateLimit.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
 #include "oidc.h"
 #include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/jwt.h"
+#include "utils/metrics.h"
 #include "utils/stringUtils.h"
 
 #include <stddef.h>
-
-char* generateRefreshPostData(const struct oidc_account* a, const char* scope,
-                              const char* audience) {
-  char* refresh_token = account_getRefreshToken(a);
-  char* scope_tmp     = oidc_strcopy(
-      strValid(scope) ? scope
-                      : account_getScope(
-                            a));  // if scopes are explicitly set use these, if
-                                  // not we use the same as for the used refresh
-                                  // token. Usually this parameter can be
-                                  // omitted. For unity we have to include this.
-  char* aud_tmp =
-      oidc_strcopy(strValid(audience)
-                       ? audience
-                       : NULL);  // account_getAudience(a));  // if audience is
-                                 // explicitly set use it, if not we use the
-                                 // default audience for this account. This is
-                                 // only needed if including audience changes
-                                 // not only the audience of the new AT, but
-                                 // also of the RT and therefore of future ATs.
-  list_t* postDataList = list_new();
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTID));
-  // list_rpush(postDataList, list_node_new(account_getClientId(a)));
-  // list_rpush(postDataList, list_node_new(OIDC_KEY_CLIENTSECRET));
-  // list_rpush(postDataList, list_node_new(account_getClientSecret(a)));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_GRANTTYPE));
-  list_rpush(postDataList, list_node_new(OIDC_GRANTTYPE_REFRESH));
-  list_rpush(postDataList, list_node_new(OIDC_KEY_REFRESHTOKEN));
-  list_rpush(postDataList, list_node_new(refresh_token));
-  if (strValid(scope_tmp)) {
-    list_rpush(postDataList, list_node_new(OIDC_KEY_SCOPE));
-    list_rpush(postDataList, list_node_new(scope_tmp));
-  }
-  if (strValid(aud_tmp)) {
-    list_rpush(postDataList, list_node_new(OIDC_KEY_AUDIENCE));
-    list_rpush(postDataList, list_node_new(aud_tmp));
-  }
-  char* str = generatePostDataFromList(postDataList);
-  list_destroy(postDataList);
-  secFree(aud_tmp);
-  secFree(scope_tmp);
-  return str;
-}
+#include <time.h>
 
 char* refreshFlow(unsigned char return_mode, struct oidc_account* p,
                   const char* scope, const char* audience,
                   struct ipcPipe pipes) {
   agent_log(DEBUG, "Doing RefreshFlow\n");
-  char* data = generateRefreshPostData(p, scope, audience);
-  if (data == NULL) {
+  oidcd_reloadIfAccountChanged(pipes, p);
+  // only the refresh token and an explicit scope or audience are encoded;
+  // the rest of the request was prepared when the account was loaded
+  struct refreshRequest request = refreshTemplate_request(p, scope, audience);
+  if (request.data == NULL) {
+    return NULL;
+  }
+  if (!issuerHealth_allowRequest(account_getIssuerUrl(p))) {
+    secFreeRefreshRequest(&request);
+    oidc_errno = OIDC_EUNAVAIL;
+    return NULL;
+  }
+  // oidcd refreshes on its own, e.g. prefetches, with the internal tag
+  if (!issuerRateLimit_acquire(account_getIssuerUrl(p),
+                               pipes.tag != IPC_TAG_INTERNAL)) {
+    secFreeRefreshRequest(&request);
+    oidc_errno = OIDC_EISSUERRATE;
     return NULL;
-    ;
   }
-  agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(
-      account_getTokenEndpoint(p), data, account_getCertPath(p),
-      account_getClientId(p), account_getClientSecret(p));
-  secFree(data);
+  agent_log(DEBUG, "Data to send: %s", request.data);
+  // a list node on the stack, so the header is not copied by curl_slist_append
+  struct curl_slist   auth    = {.data = request.auth_header, .next = NULL};
+  struct http_options options = getHttpOptions(p, 1);
+  double              start   = metrics_now();
+  char*               res     = httpsPOST(
+      account_getTokenEndpoint(p), request.data,
+      request.auth_header ? &auth : NULL, account_getCertPath(p), NULL, NULL,
+      &options);
+  const long retry_after = getRetryAfter();
+  metrics_observe(METRIC_REFRESH_DURATION, account_getIssuerUrl(p),
+                  metrics_now() - start);
+  secFreeRefreshRequest(&request);
+  if (NULL == res && oidc_errno == 503 && retry_after >= 0) {
+    issuerHealth_recordRetryAfter(account_getIssuerUrl(p), retry_after);
+  } else if (NULL == res && (oidc_errno < 400 || oidc_errno >= 500)) {
+    // only errors of the provider or the network count, not rejected requests
+    issuerHealth_recordFailure(account_getIssuerUrl(p));
+  } else if (NULL == res && oidc_errno == 429) {
+    if (retry_after >= 0) {
+      issuerRateLimit_holdOff(account_getIssuerUrl(p), retry_after);
+    } else {
+      issuerRateLimit_recordThrottled(account_getIssuerUrl(p));
+    }
+    issuerHealth_recordSuccess(account_getIssuerUrl(p));
+  } else {
+    issuerHealth_recordSuccess(account_getIssuerUrl(p));
+  }
   if (NULL == res) {
     return NULL;
     ;
   }
 
-  char* access_token = parseTokenResponse(
-      return_mode |
-          TOKENPARSEMODE_SAVE_AT_IF(!strValid(scope) && !strValid(audience)),
-      res, p, pipes, 1);
+  const unsigned char scoped = strValid(scope) || strValid(audience);
+  char*               token  = parseTokenResponse(
+      return_mode | TOKENPARSEMODE_SAVE_AT_IF(!scoped), res, p, pipes, 1);
+  if (token != NULL && scoped) {
+    // the default access token was already saved while parsing; other ones
+    // go into the token cache, also if an id token was requested
+    char* access_token =
+        return_mode & TOKENPARSEMODE_RETURN_AT
+            ? token
+            : getJSONValueFromString(res, OIDC_KEY_ACCESSTOKEN);
+    char*         expires_in = getJSONValueFromString(res, OIDC_KEY_EXPIRESIN);
+    unsigned long expires_at =
+        expires_in ? time(NULL) + strToInt(expires_in) : 0;
+    secFree(expires_in);
+    access_token =
+        account_cacheToken(p, scope, audience, access_token, expires_at);
+    if (return_mode & TOKENPARSEMODE_RETURN_AT) {
+      token = access_token;
+    }
+  }
+  if (token != NULL && return_mode & TOKENPARSEMODE_RETURN_ID) {
+    time_t exp = jwt_getExpiresAt(token);
+    if (exp) {
+      account_cacheIdToken(p, scope, oidc_strcopy(token), exp);
+    }
+  }
   secFree(res);
-  return access_token;
+  return token;
 }
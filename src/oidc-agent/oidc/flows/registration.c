@@ -6,6 +6,7 @@
 #include "defines/oidc_values.h"
 #include "defines/settings.h"
 #include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/oidc/flows/oidc.h"
 #include "utils/agentLogger.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
@@ -73,10 +74,11 @@ char* _dynamicRegistration(struct oidc_account* account, list_t* flows,
     headers = curl_slist_append(headers, auth_header);
     secFree(auth_header);
   }
-  char* res =
-      httpsPOST(account_getRegistrationEndpoint(account), body, headers,
-                account_getCertPath(account), account_getClientId(account),
-                account_getClientSecret(account));
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = httpsPOST(
+      account_getRegistrationEndpoint(account), body, headers,
+      account_getCertPath(account), account_getClientId(account),
+      account_getClientSecret(account), &options);
   curl_slist_free_all(headers);
   secFree(body);
   if (res == NULL) {
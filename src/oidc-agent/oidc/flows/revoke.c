@@ -23,10 +23,11 @@ oidc_error_t revokeToken(struct oidc_account* account) {
     return oidc_errno;
   }
   agent_log(DEBUG, "Data to send: %s", data);
-  char* res = sendPostDataWithBasicAuth(account_getRevocationEndpoint(account),
-                                        data, account_getCertPath(account),
-                                        account_getClientId(account),
-                                        account_getClientSecret(account));
+  struct http_options options = getHttpOptions(account, 0);
+  char*               res     = sendPostDataWithBasicAuth(
+      account_getRevocationEndpoint(account), data,
+      account_getCertPath(account), account_getClientId(account),
+      account_getClientSecret(account), &options);
   secFree(data);
   if (res == NULL) {
     if (oidc_errno == OIDC_EHTTP0) {
@@ -0,0 +1,155 @@
+#include "tokenExchange.h"
+
+#include "account/account.h"
+#include "account/tokenCache.h"
+#include "defines/oidc_values.h"
+#include "oidc-agent/http/http_ipc.h"
+#include "oidc.h"
+#include "utils/agentLogger.h"
+#include "utils/errorUtils.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+/**
+ * @brief obtains an access token for @p scope and @p audience by exchanging
+ * the account's current access token (RFC 8693)
+ * The refresh token is not used. The obtained token is put into the token
+ * cache of the account.
+ * @return the access token, owned by the account, or @c NULL on failure
+ */
+char* tokenExchangeFlow(struct oidc_account* p, const char* scope,
+                        const char* audience) {
+  agent_log(DEBUG, "Doing Token Exchange");
+  const char* subject_token = account_getAccessToken(p);
+  if (!strValid(subject_token)) {
+    oidc_setInternalError("no access token to exchange");
+    return NULL;
+  }
+  vector_t* postDataList = vector_new();
+  vector_push(postDataList, OIDC_KEY_GRANTTYPE);
+  vector_push(postDataList, OIDC_GRANTTYPE_TOKENEXCHANGE);
+  vector_push(postDataList, OIDC_KEY_SUBJECTTOKEN);
+  vector_push(postDataList, (char*)subject_token);
+  vector_push(postDataList, OIDC_KEY_SUBJECTTOKENTYPE);
+  vector_push(postDataList, OIDC_TOKENTYPE_URN_ACCESSTOKEN);
+  vector_push(postDataList, OIDC_KEY_REQUESTEDTOKENTYPE);
+  vector_push(postDataList, OIDC_TOKENTYPE_URN_ACCESSTOKEN);
+  if (strValid(scope)) {
+    vector_push(postDataList, OIDC_KEY_SCOPE);
+    vector_push(postDataList, (char*)scope);
+  }
+  if (strValid(audience)) {
+    vector_push(postDataList, OIDC_KEY_AUDIENCE);
+    vector_push(postDataList, (char*)audience);
+  }
+  char* data = generatePostDataFromVector(postDataList);
+  secFreeVector(postDataList);
+  if (data == NULL) {
+    return NULL;
+  }
+  struct http_options options = getHttpOptions(p, 0);
+  char*               res     = sendPostDataWithBasicAuth(
+      account_getTokenEndpoint(p), data, account_getCertPath(p),
+      account_getClientId(p), account_getClientSecret(p), &options);
+  secFree(data);
+  if (res == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(OIDC_KEY_ACCESSTOKEN, OIDC_KEY_EXPIRESIN, OIDC_KEY_ERROR,
+                 OIDC_KEY_ERROR_DESCRIPTION);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(access_token, expires_in, error, error_description);
+  if (_error || !strValid(_access_token)) {
+    char* error = combineError(_error ?: "no access token in response",
+                               _error_description);
+    oidc_errno  = OIDC_EOIDC;
+    oidc_seterror(error);
+    secFree(error);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  unsigned long expires_at =
+      _expires_in ? time(NULL) + strToInt(_expires_in) : 0;
+  secFree(_expires_in);
+  secFree(_error_description);
+  // the token cache takes the access token
+  return account_cacheToken(p, scope, audience, _access_token, expires_at);
+}
+
+/**
+ * @brief obtains an additional refresh token for the account by exchanging
+ * its refresh token (RFC 8693)
+ * The account's refresh token stays valid, the obtained one is a separate
+ * grant with the same scopes.
+ * @return a pointer to the new refresh token; has to be freed after usage;
+ * @c NULL on failure
+ */
+char* tokenExchangeRefreshTokenFlow(const struct oidc_account* p) {
+  agent_log(DEBUG, "Doing Token Exchange for a refresh token");
+  const char* subject_token = account_getRefreshToken(p);
+  if (!strValid(subject_token)) {
+    oidc_errno = OIDC_ENOREFRSH;
+    return NULL;
+  }
+  vector_t* postDataList = vector_new();
+  vector_push(postDataList, OIDC_KEY_GRANTTYPE);
+  vector_push(postDataList, OIDC_GRANTTYPE_TOKENEXCHANGE);
+  vector_push(postDataList, OIDC_KEY_SUBJECTTOKEN);
+  vector_push(postDataList, (char*)subject_token);
+  vector_push(postDataList, OIDC_KEY_SUBJECTTOKENTYPE);
+  vector_push(postDataList, OIDC_TOKENTYPE_URN_REFRESHTOKEN);
+  vector_push(postDataList, OIDC_KEY_REQUESTEDTOKENTYPE);
+  vector_push(postDataList, OIDC_TOKENTYPE_URN_REFRESHTOKEN);
+  char* data = generatePostDataFromVector(postDataList);
+  secFreeVector(postDataList);
+  if (data == NULL) {
+    return NULL;
+  }
+  struct http_options options = getHttpOptions(p, 0);
+  char*               res     = sendPostDataWithBasicAuth(
+      account_getTokenEndpoint(p), data, account_getCertPath(p),
+      account_getClientId(p), account_getClientSecret(p), &options);
+  secFree(data);
+  if (res == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(OIDC_KEY_REFRESHTOKEN, OIDC_KEY_ACCESSTOKEN,
+                 OIDC_KEY_ISSUEDTOKENTYPE, OIDC_KEY_ERROR,
+                 OIDC_KEY_ERROR_DESCRIPTION);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(refresh_token, access_token, issued_token_type, error,
+                 error_description);
+  // the issued token is in the access_token field, but some providers put it
+  // into refresh_token
+  if (_refresh_token == NULL &&
+      strequal(_issued_token_type, OIDC_TOKENTYPE_URN_REFRESHTOKEN)) {
+    _refresh_token = _access_token;
+    _access_token  = NULL;
+  }
+  if (_error || !strValid(_refresh_token)) {
+    char* error = combineError(_error ?: "no refresh token in response",
+                               _error_description);
+    oidc_errno  = OIDC_EOIDC;
+    oidc_seterror(error);
+    secFree(error);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(_access_token);
+  secFree(_issued_token_type);
+  secFree(_error_description);
+  return _refresh_token;
+}
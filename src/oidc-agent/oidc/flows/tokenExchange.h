@@ -0,0 +1,10 @@
+#ifndef OIDC_TOKEN_EXCHANGE_H
+#define OIDC_TOKEN_EXCHANGE_H
+
+#include "account/account.h"
+
+char* tokenExchangeFlow(struct oidc_account* p, const char* scope,
+                        const char* audience);
+char* tokenExchangeRefreshTokenFlow(const struct oidc_account* p);
+
+#endif  // OIDC_TOKEN_EXCHANGE_H
@@ -0,0 +1,56 @@
+#include "userinfo.h"
+
+#include "account/account.h"
+#include "defines/oidc_values.h"
+#include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/http/http_transport.h"
+#include "oidc.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/parseJson.h"
+#include "utils/stringUtils.h"
+
+/**
+ * @brief fetches the claims about the user of an account from the userinfo
+ * endpoint of its issuer
+ * @param access_token a valid access token of the account
+ * @return a pointer to the response, i.e. a json object with the claims or,
+ * if the issuer signs or encrypts the claims, a JWT. Has to be freed after
+ * usage. On failure @c NULL is returned and @c oidc_errno is set.
+ */
+char* fetchUserinfo(struct oidc_account* account, const char* access_token) {
+  agent_log(DEBUG, "Fetching userinfo");
+  const char* endpoint = account_getUserinfoEndpoint(account);
+  if (!strValid(endpoint)) {
+    oidc_errno = OIDC_ENOSUPUSERINFO;
+    agent_log(NOTICE, "%s", oidc_serror());
+    return NULL;
+  }
+  char* auth_header =
+      oidc_sprintf(HTTP_HEADER_AUTHORIZATION_BEARER_FMT, access_token);
+  struct curl_slist* headers = curl_slist_append(NULL, auth_header);
+  secFree(auth_header);
+  struct http_options options = getHttpOptions(account, 1);
+  char*               res     = httpTransport_perform(
+      &(struct http_request){.method    = HTTP_METHOD_GET,
+                             .url       = endpoint,
+                             .headers   = headers,
+                             .cert_path = account_getCertPath(account),
+                             .options   = &options});
+  curl_slist_free_all(headers);
+  if (res == NULL) {
+    return NULL;
+  }
+  if (!isJSONObject(res)) {
+    return res;
+  }
+  char* error = parseForError(oidc_strcopy(res));
+  if (error) {
+    secFree(res);
+    oidc_errno = OIDC_EOIDC;
+    oidc_seterror(error);
+    secFree(error);
+    return NULL;
+  }
+  return res;
+}
@@ -0,0 +1,8 @@
+#ifndef OIDC_USERINFO_H
+#define OIDC_USERINFO_H
+
+#include "account/account.h"
+
+char* fetchUserinfo(struct oidc_account* account, const char* access_token);
+
+#endif  // OIDC_USERINFO_H
@@ -0,0 +1,190 @@
+#include "issuerHealth.h"
+#include "account/issuer_helper.h"
+#include "defines/settings.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * A circuit breaker per issuer. After @c ISSUER_HEALTH_FAILURE_THRESHOLD
+ * consecutive failed requests to an issuer, the breaker opens and requests to
+ * that issuer fail immediately instead of each one waiting for the network.
+ * After a backoff a single request is let through as a probe; if it succeeds
+ * the breaker closes again, otherwise the backoff is doubled. The backoff is
+ * jittered, so that multiple agents do not probe an issuer at the same time.
+ * If the issuer answers with 503 and says how long to wait (Retry-After), the
+ * breaker opens right away for exactly that long.
+ * The time of the last successful request is kept per issuer for the health
+ * request.
+ */
+
+struct issuerHealth {
+  char*        issuer_url;
+  unsigned int failures;  // consecutive
+  time_t       backoff;
+  time_t       retry_at;      // 0 if the breaker is closed
+  time_t       last_success;  // 0 if no request succeeded yet
+};
+
+static list_t* issuers = NULL;
+
+static void _secFreeIssuerHealth(struct issuerHealth* h) {
+  secFree(h->issuer_url);
+  secFree(h);
+}
+
+static int _matchIssuerHealth(const struct issuerHealth* h,
+                              const char*                issuer_url) {
+  return compIssuerUrls(h->issuer_url, issuer_url);
+}
+
+static struct issuerHealth* _find(const char* issuer_url) {
+  if (issuers == NULL || issuer_url == NULL) {
+    return NULL;
+  }
+  list_node_t* node = findInList(issuers, issuer_url);
+  return node ? node->val : NULL;
+}
+
+/**
+ * @brief returns @p backoff with a jitter of +-20%
+ */
+static time_t _jitter(time_t backoff) {
+  uint32_t range = (uint32_t)(backoff * 2 / 5) + 1;
+  return backoff - backoff / 5 + randombytes_uniform(range);
+}
+
+/**
+ * @brief checks if a request to the issuer should be done
+ * @return @c 0 if the breaker for the issuer is open; the request should fail
+ * immediately. Otherwise @c 1; if the backoff is over, this request is the
+ * probe and other requests are still rejected until its result is recorded.
+ */
+int issuerHealth_allowRequest(const char* issuer_url) {
+  struct issuerHealth* h = _find(issuer_url);
+  if (h == NULL || h->retry_at == 0) {
+    return 1;
+  }
+  time_t now = time(NULL);
+  if (now < h->retry_at) {
+    return 0;
+  }
+  // let this request through as probe; the next one not before the backoff
+  h->retry_at = now + _jitter(h->backoff);
+  agent_log(DEBUG, "Probing issuer %s", issuer_url);
+  return 1;
+}
+
+static struct issuerHealth* _findOrAdd(const char* issuer_url) {
+  struct issuerHealth* h = _find(issuer_url);
+  if (h != NULL) {
+    return h;
+  }
+  if (issuers == NULL) {
+    issuers        = list_new();
+    issuers->free  = (void (*)(void*))_secFreeIssuerHealth;
+    issuers->match = (matchFunction)_matchIssuerHealth;
+  }
+  h             = secAlloc(sizeof(struct issuerHealth));
+  h->issuer_url = oidc_strcopy(issuer_url);
+  list_rpush(issuers, list_node_new(h));
+  return h;
+}
+
+void issuerHealth_recordSuccess(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    return;
+  }
+  struct issuerHealth* h = _findOrAdd(issuer_url);
+  if (h->retry_at) {
+    agent_log(NOTICE, "Issuer %s is reachable again", issuer_url);
+  }
+  h->failures     = 0;
+  h->backoff      = 0;
+  h->retry_at     = 0;
+  h->last_success = time(NULL);
+}
+
+void issuerHealth_recordFailure(const char* issuer_url) {
+  if (issuer_url == NULL) {
+    return;
+  }
+  struct issuerHealth* h = _findOrAdd(issuer_url);
+  h->failures++;
+  if (h->failures < ISSUER_HEALTH_FAILURE_THRESHOLD) {
+    return;
+  }
+  if (h->retry_at == 0) {
+    h->backoff = ISSUER_HEALTH_MIN_BACKOFF;
+    agent_log(ERROR,
+              "Issuer %s failed %u times in a row, not sending requests for "
+              "%lu seconds",
+              issuer_url, h->failures, (unsigned long)h->backoff);
+  } else {  // a probe failed
+    h->backoff = h->backoff * 2 < ISSUER_HEALTH_MAX_BACKOFF
+                     ? h->backoff * 2
+                     : ISSUER_HEALTH_MAX_BACKOFF;
+  }
+  h->retry_at = time(NULL) + _jitter(h->backoff);
+}
+
+/**
+ * @brief opens the breaker of an issuer that is unavailable and asked to wait
+ * @param seconds the seconds from the Retry-After header; at most
+ * @c ISSUER_RETRY_AFTER_MAX are honoured
+ */
+void issuerHealth_recordRetryAfter(const char* issuer_url, long seconds) {
+  if (issuer_url == NULL || seconds < 0) {
+    return;
+  }
+  if (seconds > ISSUER_RETRY_AFTER_MAX) {
+    seconds = ISSUER_RETRY_AFTER_MAX;
+  }
+  struct issuerHealth* h = _findOrAdd(issuer_url);
+  h->failures++;
+  if (h->backoff == 0) {  // used while the probe is pending
+    h->backoff = ISSUER_HEALTH_MIN_BACKOFF;
+  }
+  h->retry_at = time(NULL) + seconds;
+  agent_log(ERROR,
+            "Issuer %s is unavailable, not sending requests for %ld seconds",
+            issuer_url, seconds);
+}
+
+/**
+ * @brief returns the state of the circuit breakers of all issuers a request
+ * was sent to
+ * The state of a breaker is @c closed, @c open while requests are rejected, or
+ * @c half-open once the next request is let through as probe.
+ * @return a json array with an object per issuer; has to be freed after usage
+ */
+cJSON* issuerHealth_toJSON() {
+  cJSON* json = cJSON_CreateArray();
+  if (issuers == NULL) {
+    return json;
+  }
+  time_t now = time(NULL);
+  for (list_node_t* node = issuers->head; node; node = node->next) {
+    const struct issuerHealth* h     = node->val;
+    const char*                state = h->retry_at == 0    ? "closed"
+                                       : now < h->retry_at ? "open"
+                                                           : "half-open";
+    cJSON* issuer = generateJSONObject("issuer", cJSON_String, h->issuer_url,
+                                       "breaker", cJSON_String, state, NULL);
+    jsonAddNumberValue(issuer, "consecutive_failures", h->failures);
+    if (h->last_success) {
+      jsonAddNumberValue(issuer, "seconds_since_success",
+                         difftime(now, h->last_success));
+    } else {
+      cJSON_AddNullToObject(issuer, "seconds_since_success");
+    }
+    cJSON_AddItemToArray(json, issuer);
+  }
+  return json;
+}
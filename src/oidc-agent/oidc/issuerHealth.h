@@ -0,0 +1,12 @@
+#ifndef OIDC_ISSUER_HEALTH_H
+#define OIDC_ISSUER_HEALTH_H
+
+#include "wrapper/cjson.h"
+
+int    issuerHealth_allowRequest(const char* issuer_url);
+void   issuerHealth_recordSuccess(const char* issuer_url);
+void   issuerHealth_recordFailure(const char* issuer_url);
+void   issuerHealth_recordRetryAfter(const char* issuer_url, long seconds);
+cJSON* issuerHealth_toJSON();
+
+#endif  // OIDC_ISSUER_HEALTH_H
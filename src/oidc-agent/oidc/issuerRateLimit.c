@@ -0,0 +1,206 @@
+#include "issuerRateLimit.h"
+#include "account/issuer_helper.h"
+#include "defines/settings.h"
+#include "oidc-agent/http/http_worker.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/stringUtils.h"
+
+/**
+ * With --issuer-rate the refreshes oidcd sends to an issuer are limited by a
+ * token bucket per issuer: the bucket holds at most @c burst tokens, is
+ * refilled with @c qps tokens per second and every refresh takes a token.
+ * Refreshes of a client waiting for a token are urgent: if the bucket is
+ * empty, they wait for the next token, but at most
+ * @c ISSUER_RATE_MAX_WAIT seconds; meanwhile other requests are still answered
+ * from the cache. Refreshes oidcd does on its own, e.g. prefetches, are not
+ * urgent: they are dropped unless the bucket is at least half full, so that
+ * tokens are left for the urgent ones. A token is then refreshed when a
+ * client requests it. When an issuer answers with 429 anyway, e.g. because
+ * other agents use the same client, the bucket is emptied.
+ *
+ * If the 429 response says how long to wait (Retry-After or RateLimit
+ * headers), no refreshes are sent to the issuer for that long, also without
+ * --issuer-rate. Urgent refreshes only wait if the hold-off ends within
+ * @c ISSUER_RATE_MAX_WAIT seconds, otherwise they fail and a cached token is
+ * returned if there is one.
+ */
+
+struct issuerBucket {
+  char*  issuer_url;
+  double tokens;
+  double updated;        // metrics_now() of the last refill
+  double blocked_until;  // metrics_now() until the issuer asked to wait
+};
+
+static list_t*      buckets   = NULL;
+static double       rateQps   = 0;
+static unsigned int rateBurst = 0;
+
+static void _secFreeIssuerBucket(struct issuerBucket* b) {
+  secFree(b->issuer_url);
+  secFree(b);
+}
+
+static int _matchIssuerBucket(const struct issuerBucket* b,
+                              const char*                issuer_url) {
+  return compIssuerUrls(b->issuer_url, issuer_url);
+}
+
+/**
+ * @brief sets the rate limit for each issuer
+ * @param qps the refreshes per second; @c 0 to disable the limit
+ * @param burst the refreshes that may be sent at once; @c 0 for the rounded
+ * up @p qps, but at least 1
+ */
+void issuerRateLimit_set(double qps, unsigned int burst) {
+  rateQps   = qps > 0 ? qps : 0;
+  rateBurst = burst ?: (unsigned int)(qps + 0.999);
+  if (rateBurst == 0) {
+    rateBurst = 1;
+  }
+}
+
+/**
+ * @brief returns the bucket of an issuer refilled up to now
+ */
+static struct issuerBucket* _bucket(const char* issuer_url) {
+  if (buckets == NULL) {
+    buckets        = list_new();
+    buckets->free  = (void (*)(void*))_secFreeIssuerBucket;
+    buckets->match = (matchFunction)_matchIssuerBucket;
+  }
+  const double         now  = metrics_now();
+  list_node_t*         node = findInList(buckets, issuer_url);
+  struct issuerBucket* b    = node ? node->val : NULL;
+  if (b == NULL) {
+    b             = secAlloc(sizeof(struct issuerBucket));
+    b->issuer_url = oidc_strcopy(issuer_url);
+    b->tokens     = rateBurst;
+    b->updated    = now;
+    list_rpush(buckets, list_node_new(b));
+    return b;
+  }
+  b->tokens += (now - b->updated) * rateQps;
+  if (b->tokens > rateBurst) {
+    b->tokens = rateBurst;
+  }
+  b->updated = now;
+  return b;
+}
+
+/**
+ * @brief checks if the issuer asked to wait; an urgent refresh waits for the
+ * end of a short hold-off
+ * @return @c 1 if the refresh may be sent, @c 0 if it should be dropped
+ */
+static int _waitForHoldOff(const char* issuer_url, unsigned char urgent) {
+  list_node_t* node = buckets ? findInList(buckets, issuer_url) : NULL;
+  if (node == NULL) {
+    return 1;
+  }
+  double wait = ((struct issuerBucket*)node->val)->blocked_until -
+                metrics_now();
+  if (wait <= 0) {
+    return 1;
+  }
+  if (!urgent || wait > ISSUER_RATE_MAX_WAIT) {
+    agent_log(DEBUG, "Issuer %s asked to wait %.0f more seconds, dropping "
+                     "refresh",
+              issuer_url, wait);
+    metrics_inc(METRIC_REFRESH_GOVERNED, "held_off");
+    return 0;
+  }
+  agent_log(DEBUG, "Delaying refresh for issuer %s by %.3f seconds",
+            issuer_url, wait);
+  metrics_inc(METRIC_REFRESH_GOVERNED, "delayed");
+  httpWorker_pause(wait);
+  return 1;
+}
+
+/**
+ * @brief takes a token for a refresh request to an issuer
+ * An urgent refresh waits for the next token if the bucket is empty; see
+ * above.
+ * @param urgent whether a client waits for the refresh
+ * @return @c 1 if the refresh may be sent, @c 0 if it should be dropped
+ */
+int issuerRateLimit_acquire(const char* issuer_url, unsigned char urgent) {
+  if (issuer_url == NULL) {
+    return 1;
+  }
+  if (!_waitForHoldOff(issuer_url, urgent)) {
+    return 0;
+  }
+  if (rateQps == 0) {
+    return 1;
+  }
+  struct issuerBucket* b = _bucket(issuer_url);
+  if (!urgent) {
+    if (b->tokens < 1 || b->tokens < rateBurst / 2.0) {
+      agent_log(DEBUG, "Dropping background refresh for issuer %s",
+                issuer_url);
+      metrics_inc(METRIC_REFRESH_GOVERNED, "dropped");
+      return 0;
+    }
+    b->tokens--;
+    return 1;
+  }
+  if (b->tokens < 1) {
+    double wait = (1 - b->tokens) / rateQps;
+    if (wait > ISSUER_RATE_MAX_WAIT) {
+      wait = ISSUER_RATE_MAX_WAIT;
+    }
+    agent_log(DEBUG, "Delaying refresh for issuer %s by %.3f seconds",
+              issuer_url, wait);
+    metrics_inc(METRIC_REFRESH_GOVERNED, "delayed");
+    httpWorker_pause(wait);
+    b = _bucket(issuer_url);  // the pause might have changed the list
+  }
+  // after the maximum wait the refresh is sent anyway; the debt delays the
+  // following ones
+  b->tokens--;
+  if (b->tokens < -(double)rateBurst) {
+    b->tokens = -(double)rateBurst;
+  }
+  return 1;
+}
+
+/**
+ * @brief empties the bucket of an issuer that rejected a request with 429
+ */
+void issuerRateLimit_recordThrottled(const char* issuer_url) {
+  if (rateQps == 0 || issuer_url == NULL) {
+    return;
+  }
+  struct issuerBucket* b = _bucket(issuer_url);
+  if (b->tokens > 0) {
+    b->tokens = 0;
+  }
+  agent_log(NOTICE, "Issuer %s limits the request rate, slowing down",
+            issuer_url);
+}
+
+/**
+ * @brief stops refreshes to an issuer that rejected a request with 429 and
+ * asked to wait
+ * @param seconds the seconds from the Retry-After or RateLimit headers; at
+ * most @c ISSUER_RETRY_AFTER_MAX are honoured
+ */
+void issuerRateLimit_holdOff(const char* issuer_url, long seconds) {
+  if (issuer_url == NULL || seconds < 0) {
+    return;
+  }
+  if (seconds > ISSUER_RETRY_AFTER_MAX) {
+    seconds = ISSUER_RETRY_AFTER_MAX;
+  }
+  struct issuerBucket* b = _bucket(issuer_url);
+  b->blocked_until       = metrics_now() + seconds;
+  if (b->tokens > 0) {
+    b->tokens = 0;
+  }
+  agent_log(NOTICE, "Issuer %s limits the request rate, waiting %ld seconds",
+            issuer_url, seconds);
+}
@@ -0,0 +1,9 @@
+#ifndef OIDC_ISSUER_RATE_LIMIT_H
+#define OIDC_ISSUER_RATE_LIMIT_H
+
+void issuerRateLimit_set(double qps, unsigned int burst);
+int  issuerRateLimit_acquire(const char* issuer_url, unsigned char urgent);
+void issuerRateLimit_recordThrottled(const char* issuer_url);
+void issuerRateLimit_holdOff(const char* issuer_url, long seconds);
+
+#endif  // OIDC_ISSUER_RATE_LIMIT_H
@@ -29,6 +29,7 @@ struct oidc_device_code* parseDeviceCode(const char* res) {
 oidc_error_t parseOpenidConfiguration(char* res, struct oidc_account* account) {
   INIT_KEY_VALUE(OIDC_KEY_TOKEN_ENDPOINT, OIDC_KEY_AUTHORIZATION_ENDPOINT,
                  OIDC_KEY_REGISTRATION_ENDPOINT, OIDC_KEY_REVOCATION_ENDPOINT,
+                 OIDC_KEY_USERINFO_ENDPOINT, OIDC_KEY_JWKS_URI,
                  OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT,
                  OIDC_KEY_SCOPES_SUPPORTED, OIDC_KEY_GRANT_TYPES_SUPPORTED,
                  OIDC_KEY_RESPONSE_TYPES_SUPPORTED,
@@ -39,9 +40,10 @@ oidc_error_t parseOpenidConfiguration(char* res, struct oidc_account* account) {
   }
   secFree(res);
   KEY_VALUE_VARS(token_endpoint, authorization_endpoint, registration_endpoint,
-                 revocation_endpoint, device_authorization_endpoint,
-                 scopes_supported, grant_types_supported,
-                 response_types_supported, code_challenge_method_supported);
+                 revocation_endpoint, userinfo_endpoint, jwks_uri,
+                 device_authorization_endpoint, scopes_supported,
+                 grant_types_supported, response_types_supported,
+                 code_challenge_method_supported);
   if (_token_endpoint == NULL) {
     agent_log(ERROR, "Could not get token endpoint");
     SEC_FREE_KEY_VALUES();
@@ -65,6 +67,12 @@ oidc_error_t parseOpenidConfiguration(char* res, struct oidc_account* account) {
   if (_revocation_endpoint) {
     issuer_setRevocationEndpoint(issuer, _revocation_endpoint);
   }
+  if (_userinfo_endpoint) {
+    issuer_setUserinfoEndpoint(issuer, _userinfo_endpoint);
+  }
+  if (_jwks_uri) {
+    issuer_setJwksUri(issuer, _jwks_uri);
+  }
   if (_device_authorization_endpoint) {
     issuer_setDeviceAuthorizationEndpoint(issuer,
                                           _device_authorization_endpoint, 0);
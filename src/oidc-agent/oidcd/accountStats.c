@@ -0,0 +1,246 @@
+#include "accountStats.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+/**
+ * Usage statistics of the loaded accounts: how many access token requests
+ * there were, how many of them were answered from the token cache, how many
+ * refresh flows were done, and when the account was loaded and used last.
+ * Requests are also counted per application hint; if an account is used by
+ * too many different applications, the rest is counted as @c other.
+ */
+
+#define ACCOUNTSTATS_MAX_APPLICATIONS 32
+#define ACCOUNTSTATS_UNKNOWN_APPLICATION "unknown"
+#define ACCOUNTSTATS_OTHER_APPLICATIONS "other"
+
+struct applicationStats {
+  char*         application_hint;
+  unsigned long requests;
+  unsigned long cache_hits;
+  time_t        last_used;
+};
+
+struct accountStats {
+  char*         shortname;
+  unsigned long requests;
+  unsigned long cache_hits;
+  unsigned long refreshes;
+  time_t        loaded;
+  time_t        last_used;
+  time_t        last_refresh;
+  list_t*       applications;
+};
+
+static list_t* stats = NULL;
+
+static void _secFreeApplicationStats(struct applicationStats* a) {
+  secFree(a->application_hint);
+  secFree(a);
+}
+
+static int _matchApplicationStats(const char*                    hint,
+                                  const struct applicationStats* a) {
+  return strequal(hint, a->application_hint);
+}
+
+static void _secFreeAccountStats(struct accountStats* s) {
+  secFree(s->shortname);
+  secFreeList(s->applications);
+  secFree(s);
+}
+
+static int _matchAccountStats(const char*                shortname,
+                              const struct accountStats* s) {
+  return strequal(shortname, s->shortname);
+}
+
+static struct accountStats* _findStats(const char* shortname) {
+  list_node_t* node =
+      stats && shortname ? findInList(stats, shortname) : NULL;
+  return node ? node->val : NULL;
+}
+
+static struct accountStats* _findOrAddStats(const char* shortname) {
+  struct accountStats* s = _findStats(shortname);
+  if (s) {
+    return s;
+  }
+  if (stats == NULL) {
+    stats        = list_new();
+    stats->free  = (void (*)(void*))_secFreeAccountStats;
+    stats->match = (matchFunction)_matchAccountStats;
+  }
+  s                      = secAlloc(sizeof(struct accountStats));
+  s->shortname           = oidc_strcopy(shortname);
+  s->applications        = list_new();
+  s->applications->free  = (void (*)(void*))_secFreeApplicationStats;
+  s->applications->match = (matchFunction)_matchApplicationStats;
+  list_rpush(stats, list_node_new(s));
+  return s;
+}
+
+static struct applicationStats* _findOrAddApplication(
+    struct accountStats* s, const char* application_hint) {
+  const char* hint =
+      strValid(application_hint) ? application_hint
+                                 : ACCOUNTSTATS_UNKNOWN_APPLICATION;
+  list_node_t* node = findInList(s->applications, hint);
+  if (node == NULL && s->applications->len >= ACCOUNTSTATS_MAX_APPLICATIONS) {
+    hint = ACCOUNTSTATS_OTHER_APPLICATIONS;
+    node = findInList(s->applications, hint);
+  }
+  if (node) {
+    return node->val;
+  }
+  struct applicationStats* a = secAlloc(sizeof(struct applicationStats));
+  a->application_hint        = oidc_strcopy(hint);
+  list_rpush(s->applications, list_node_new(a));
+  return a;
+}
+
+/**
+ * @brief counts an access token request for an account
+ * @param application_hint the application that sent the request; might be
+ * @c NULL
+ * @param cache_hit if the request was answered from the token cache
+ */
+void accountStats_recordRequest(const char* shortname,
+                                const char* application_hint,
+                                unsigned char cache_hit) {
+  if (shortname == NULL) {
+    return;
+  }
+  time_t                   now = time(NULL);
+  struct accountStats*     s   = _findOrAddStats(shortname);
+  struct applicationStats* a   = _findOrAddApplication(s, application_hint);
+  s->requests++;
+  a->requests++;
+  if (cache_hit) {
+    s->cache_hits++;
+    a->cache_hits++;
+  }
+  s->last_used = now;
+  a->last_used = now;
+}
+
+/**
+ * @brief counts a refresh flow done for an account
+ */
+void accountStats_recordRefresh(const char* shortname) {
+  if (shortname == NULL) {
+    return;
+  }
+  struct accountStats* s = _findOrAddStats(shortname);
+  s->refreshes++;
+  s->last_refresh = time(NULL);
+}
+
+/**
+ * @brief returns since when the refresh token of an account is unused, i.e.
+ * when a refresh flow was done or the account was loaded last
+ * @return the time or @c 0 if neither is known
+ */
+time_t accountStats_getRefreshIdleSince(const char* shortname) {
+  struct accountStats* s = _findStats(shortname);
+  if (s == NULL) {
+    return 0;
+  }
+  return s->last_refresh > s->loaded ? s->last_refresh : s->loaded;
+}
+
+/**
+ * @brief returns when an access token of an account was requested last
+ * @return the time or @c 0 if it was not requested since it was loaded
+ */
+time_t accountStats_getLastUsed(const char* shortname) {
+  struct accountStats* s = _findStats(shortname);
+  return s ? s->last_used : 0;
+}
+
+/**
+ * @brief records that an account was loaded (again)
+ */
+void accountStats_recordLoad(const char* shortname) {
+  if (shortname == NULL) {
+    return;
+  }
+  _findOrAddStats(shortname)->loaded = time(NULL);
+}
+
+/**
+ * @brief returns since when an account is idle, i.e. when it was used or
+ * loaded last
+ * @return the time or @c 0 if neither is known
+ */
+time_t accountStats_getIdleSince(const char* shortname) {
+  struct accountStats* s = _findStats(shortname);
+  if (s == NULL) {
+    return 0;
+  }
+  return s->last_used > s->loaded ? s->last_used : s->loaded;
+}
+
+size_t accountStats_count() { return stats ? stats->len : 0; }
+
+static cJSON* _applicationStatsToJSON(const struct applicationStats* a) {
+  return generateJSONObject(
+      "application_hint", cJSON_String, a->application_hint, "requests",
+      cJSON_Number, (long)a->requests, "cache_hits", cJSON_Number,
+      (long)a->cache_hits, "last_used", cJSON_Number, (long)a->last_used,
+      NULL);
+}
+
+static cJSON* _accountStatsToJSON(const struct accountStats* s) {
+  cJSON* json = generateJSONObject(
+      "account", cJSON_String, s->shortname, "requests", cJSON_Number,
+      (long)s->requests, "cache_hits", cJSON_Number, (long)s->cache_hits,
+      "refreshes", cJSON_Number, (long)s->refreshes, "last_used",
+      cJSON_Number, (long)s->last_used, NULL);
+  cJSON*           applications = cJSON_CreateArray();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(s->applications, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    cJSON_AddItemToArray(applications, _applicationStatsToJSON(node->val));
+  }
+  list_iterator_destroy(it);
+  jsonAddJSON(json, "applications", applications);
+  return json;
+}
+
+/**
+ * @brief returns the statistics of all accounts as a json array
+ * @return a pointer to the json array. Has to be freed after usage.
+ */
+cJSON* accountStats_toJSON() {
+  cJSON* json = cJSON_CreateArray();
+  if (stats == NULL) {
+    return json;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(stats, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    cJSON_AddItemToArray(json, _accountStatsToJSON(node->val));
+  }
+  list_iterator_destroy(it);
+  return json;
+}
+
+/**
+ * @brief removes the statistics of an account, e.g. because it was removed
+ */
+void accountStats_remove(const char* shortname) {
+  list_node_t* node =
+      stats && shortname ? findInList(stats, shortname) : NULL;
+  if (node) {
+    list_remove(stats, node);
+  }
+}
+
+void accountStats_clear() {
+  secFreeList(stats);
+  stats = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef OIDCD_ACCOUNT_STATS_H
+#define OIDCD_ACCOUNT_STATS_H
+
+#include "wrapper/cjson.h"
+
+#include <stddef.h>
+#include <time.h>
+
+void   accountStats_recordRequest(const char* shortname,
+                                  const char* application_hint,
+                                  unsigned char cache_hit);
+void   accountStats_recordRefresh(const char* shortname);
+void   accountStats_recordLoad(const char* shortname);
+time_t accountStats_getLastUsed(const char* shortname);
+time_t accountStats_getIdleSince(const char* shortname);
+time_t accountStats_getRefreshIdleSince(const char* shortname);
+size_t accountStats_count();
+cJSON* accountStats_toJSON();
+void   accountStats_remove(const char* shortname);
+void   accountStats_clear();
+
+#endif  // OIDCD_ACCOUNT_STATS_H
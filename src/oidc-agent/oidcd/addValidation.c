@@ -0,0 +1,271 @@
+#include "addValidation.h"
+#include "account/account.h"
+#include "account/issuer_helper.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/oidcd_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/db/account_db.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * With @c --async-validate an added account is put into the account db right
+ * away and @c oidc-add returns without waiting for the provider. The account is
+ * validated, i.e. its issuer configuration is fetched and its refresh token is
+ * used, when oidcd is idle or when a request needs the account, whatever comes
+ * first. An account that fails the validation is removed again; the error is
+ * returned to the next request for the account and shown in the status until
+ * then. Validations on idle are background requests; if the per-issuer rate
+ * limit skips one, it is tried again a second later.
+ */
+
+struct failedValidation {
+  char* shortname;
+  char* error;
+};
+
+static list_t*       pending    = NULL;
+static list_t*       failed     = NULL;
+static unsigned long generation = 0;
+static time_t        notBefore  = 0;
+
+static void _secFreeFailedValidation(struct failedValidation* f) {
+  secFree(f->shortname);
+  secFree(f->error);
+  secFree(f);
+}
+
+static int _matchFailedValidation(const char*                    shortname,
+                                  const struct failedValidation* f) {
+  return strequal(shortname, f->shortname);
+}
+
+static void _recordFailure(const char* shortname) {
+  if (failed == NULL) {
+    failed        = list_new();
+    failed->free  = (void (*)(void*))_secFreeFailedValidation;
+    failed->match = (matchFunction)_matchFailedValidation;
+  }
+  list_removeIfFound(failed, shortname);
+  struct failedValidation* f = secAlloc(sizeof(struct failedValidation));
+  f->shortname               = oidc_strcopy(shortname);
+  f->error                   = oidc_strcopy(oidc_serror());
+  list_rpush(failed, list_node_new(f));
+}
+
+/**
+ * @brief schedules the validation of an account that was just added to the
+ * account db; a failure recorded for an earlier account with the same short
+ * name is forgotten
+ */
+void addValidation_schedule(const char* shortname) {
+  if (pending == NULL) {
+    pending        = list_new();
+    pending->free  = (void (*)(void*))_secFree;
+    pending->match = (matchFunction)strequal;
+  }
+  if (failed) {
+    list_removeIfFound(failed, shortname);
+  }
+  list_addStringIfNotFound(pending, (char*)shortname);
+  generation++;
+}
+
+unsigned char addValidation_isPending(const char* shortname) {
+  return pending != NULL && findInList(pending, shortname) != NULL;
+}
+
+/**
+ * @brief returns when oidcd should validate the next account
+ * @return the current time if an account waits for validation, @c 0 otherwise
+ */
+time_t addValidation_getNextTime() {
+  if (pending == NULL || pending->len == 0) {
+    return 0;
+  }
+  time_t now = time(NULL);
+  return notBefore > now ? notBefore : now;
+}
+
+/**
+ * @brief validates a pending account
+ * @param node the node of the account in the pending list; it is removed
+ * @return @c OIDC_SUCCESS if the account is valid or not loaded anymore
+ */
+static oidc_error_t _validate(struct ipcPipe pipes, list_node_t* node) {
+  char* shortname = oidc_strcopy(node->val);
+  list_remove(pending, node);
+  generation++;
+  struct oidc_account* account = db_getAccountDecryptedByShortname(shortname);
+  if (account == NULL) {  // removed in the meantime
+    secFree(shortname);
+    return OIDC_SUCCESS;
+  }
+  agent_log(DEBUG, "Validating the added account '%s'", shortname);
+  oidc_error_t e = addAccount(pipes, account);
+  if (e == OIDC_EISSUERRATE) {
+    db_addAccountEncrypted(account);  // reencrypting
+    list_addStringIfNotFound(pending, shortname);
+    notBefore = time(NULL) + 1;
+  } else if (e != OIDC_SUCCESS) {
+    agent_log(NOTICE, "Validation of the added account '%s' failed: %s",
+              shortname, oidc_serror());
+    _recordFailure(shortname);
+    db_addAccountEncrypted(account);  // reencrypting before it is freed
+    accountDB_removeIfFound(account);
+    accountStats_remove(shortname);
+  }
+  secFree(shortname);
+  return e;
+}
+
+/**
+ * @brief validates the account that waits the longest; called when oidcd is
+ * idle
+ * @param pipes the pipes used for internal requests; they should be tagged
+ * with @c IPC_TAG_INTERNAL
+ */
+void addValidation_runNext(struct ipcPipe pipes) {
+  if (pending && pending->head && notBefore <= time(NULL)) {
+    _validate(pipes, pending->head);
+  }
+}
+
+/**
+ * @brief validates an account before it is used for a request, if it waits
+ * for validation
+ * @return @c OIDC_SUCCESS or the error of the failed validation; the account
+ * is removed then
+ */
+oidc_error_t addValidation_runFor(struct ipcPipe pipes, const char* shortname) {
+  list_node_t* node = pending ? findInList(pending, shortname) : NULL;
+  if (node == NULL) {
+    return OIDC_SUCCESS;
+  }
+  return _validate(pipes, node);
+}
+
+/**
+ * @brief validates the waiting accounts of an issuer before one of them is
+ * chosen for a request
+ * @return @c OIDC_SUCCESS or the error of the last failed validation
+ */
+oidc_error_t addValidation_runForIssuer(struct ipcPipe pipes,
+                                        const char*    issuer_url) {
+  if (pending == NULL || pending->len == 0) {
+    return OIDC_SUCCESS;
+  }
+  list_t* names = list_new();
+  names->free   = (void (*)(void*))_secFree;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(pending, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct oidc_account* account = db_findAccountByShortname(node->val);
+    if (account &&
+        compIssuerUrls(account_getIssuerUrl(account), issuer_url)) {
+      list_rpush(names, list_node_new(oidc_strcopy(node->val)));
+    }
+  }
+  list_iterator_destroy(it);
+  oidc_error_t ret = OIDC_SUCCESS;
+  while ((node = list_lpop(names))) {
+    oidc_error_t e = addValidation_runFor(pipes, node->val);
+    if (e != OIDC_SUCCESS) {
+      ret = e;
+    }
+    secFree(node->val);
+    LIST_FREE(node);
+  }
+  secFreeList(names);
+  return ret;
+}
+
+/**
+ * @brief reports a failed validation of an account once
+ * @return the error of the validation, which is also set as @c oidc_errno, or
+ * @c OIDC_SUCCESS if there is no failed validation for the account
+ */
+oidc_error_t addValidation_takeFailure(const char* shortname) {
+  list_node_t* node = failed ? findInList(failed, shortname) : NULL;
+  if (node == NULL) {
+    return OIDC_SUCCESS;
+  }
+  const struct failedValidation* f = node->val;
+  char* err = oidc_sprintf("Validation of account '%s' failed: %s", shortname,
+                           f->error);
+  oidc_seterror(err);
+  secFree(err);
+  oidc_errno = OIDC_EERROR;
+  list_remove(failed, node);
+  generation++;
+  return oidc_errno;
+}
+
+/**
+ * @brief returns a number that changes whenever the result of
+ * @c addValidation_toString changes
+ */
+unsigned long addValidation_getGeneration() { return generation; }
+
+/**
+ * @brief describes the pending and failed validations for the status
+ * @return a pointer to the text or @c NULL if there are none. Has to be freed
+ * after usage.
+ */
+char* addValidation_toString() {
+  char* text = NULL;
+  if (pending && pending->len) {
+    char* names = listToDelimitedString(pending, ", ");
+    text        = oidc_sprintf("Accounts waiting for validation: %s\n", names);
+    secFree(names);
+  }
+  if (failed && failed->len) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(failed, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      const struct failedValidation* f   = node->val;
+      char*                          tmp = oidc_sprintf(
+          "%sValidation of account '%s' failed: %s\n", text ?: "",
+          f->shortname, f->error);
+      secFree(text);
+      text = tmp;
+    }
+    list_iterator_destroy(it);
+  }
+  return text;
+}
+
+/**
+ * @brief returns the pending and failed validations as a json array
+ * @return a pointer to the json array. Has to be freed after usage.
+ */
+cJSON* addValidation_toJSON() {
+  cJSON*           json = cJSON_CreateArray();
+  list_node_t*     node;
+  list_iterator_t* it;
+  if (pending) {
+    it = list_iterator_new(pending, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      cJSON_AddItemToArray(
+          json, generateJSONObject("account", cJSON_String, node->val,
+                                   "state", cJSON_String, "pending", NULL));
+    }
+    list_iterator_destroy(it);
+  }
+  if (failed) {
+    it = list_iterator_new(failed, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      const struct failedValidation* f = node->val;
+      cJSON_AddItemToArray(
+          json, generateJSONObject("account", cJSON_String, f->shortname,
+                                   "state", cJSON_String, "failed", "error",
+                                   cJSON_String, f->error, NULL));
+    }
+    list_iterator_destroy(it);
+  }
+  return json;
+}
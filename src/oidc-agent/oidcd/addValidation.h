@@ -0,0 +1,22 @@
+#ifndef OIDCD_ADD_VALIDATION_H
+#define OIDCD_ADD_VALIDATION_H
+
+#include "ipc/pipe.h"
+#include "utils/oidc_error.h"
+#include "wrapper/cjson.h"
+
+#include <time.h>
+
+void          addValidation_schedule(const char* shortname);
+unsigned char addValidation_isPending(const char* shortname);
+time_t        addValidation_getNextTime();
+void          addValidation_runNext(struct ipcPipe pipes);
+oidc_error_t  addValidation_runFor(struct ipcPipe pipes, const char* shortname);
+oidc_error_t  addValidation_runForIssuer(struct ipcPipe pipes,
+                                         const char*    issuer_url);
+oidc_error_t  addValidation_takeFailure(const char* shortname);
+unsigned long addValidation_getGeneration();
+char*         addValidation_toString();
+cJSON*        addValidation_toJSON();
+
+#endif  // OIDCD_ADD_VALIDATION_H
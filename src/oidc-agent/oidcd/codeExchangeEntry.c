@@ -1,4 +1,5 @@
 #include "codeExchangeEntry.h"
+#include "defines/agent_values.h"
 #include "utils/matcher.h"
 
 void secFreeCodeExchangeContent(struct codeExchangeEntry* cee) {
@@ -18,9 +19,18 @@ struct codeExchangeEntry* createCodeExchangeEntry(char*                state,
   cee->account                  = account;
   cee->state                    = state;
   cee->code_verifier            = code_verifier;
+  cee->expires_at               = time(NULL) + CODEEXCHANGE_LIFETIME;
   return cee;
 }
 
 int cee_matchByState(struct codeExchangeEntry* a, struct codeExchangeEntry* b) {
   return matchStrings(a->state, b->state);
 }
+
+const char* cee_getState(const struct codeExchangeEntry* cee) {
+  return cee ? cee->state : NULL;
+}
+
+time_t cee_getDeath(const struct codeExchangeEntry* cee) {
+  return cee ? cee->expires_at : 0;
+}
@@ -3,13 +3,18 @@
 
 #include "account/account.h"
 
+#include <time.h>
+
 struct codeExchangeEntry {
   char*                state;
   struct oidc_account* account;
   char*                code_verifier;
+  time_t               expires_at;
 };
 
 int cee_matchByState(struct codeExchangeEntry* a, struct codeExchangeEntry* b);
+const char* cee_getState(const struct codeExchangeEntry* cee);
+time_t      cee_getDeath(const struct codeExchangeEntry* cee);
 struct codeExchangeEntry* createCodeExchangeEntry(char*                state,
                                                   struct oidc_account* account,
                                                   char* code_verifier);
@@ -0,0 +1,115 @@
+#include "devicePoll.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "oidc-agent/oidcd/oidcd_handler.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+/**
+ * Device codes that oidcd polls in the background. A job is answered on its
+ * tagged pipe once the user authorized the device, the provider returned an
+ * error, or the device code expired; until then oidcd keeps handling other
+ * requests and polls whenever the timer of a job is due.
+ */
+
+#define DEVICEPOLL_DEFAULT_INTERVAL 5  // RFC 8628 section 3.2
+#define DEVICEPOLL_SLOW_DOWN_STEP 5    // RFC 8628 section 3.5
+
+struct devicePoll_job {
+  struct ipcPipe       pipes;
+  struct oidc_account* account;
+  char*                device_code;
+  int                  only_at;
+  time_t               interval;
+  time_t               expires_at;  // 0 if the device code does not expire
+};
+
+static list_t* jobs = NULL;
+
+static void _pollJob(void* arg);
+
+static void _secFreeDevicePollJob(struct devicePoll_job* job) {
+  secFreeAccount(job->account);
+  secFree(job->device_code);
+  secFree(job);
+}
+
+/**
+ * @brief schedules polling for a device code
+ * @param pipes the tagged pipe on which the request is answered
+ * @param account the account the device code was issued for; ownership is
+ * taken
+ */
+void devicePoll_add(struct ipcPipe pipes, struct oidc_account* account,
+                    const struct oidc_device_code* dc, int only_at) {
+  if (jobs == NULL) {
+    jobs       = list_new();
+    jobs->free = (void (*)(void*))_secFreeDevicePollJob;
+  }
+  struct devicePoll_job* job = secAlloc(sizeof(struct devicePoll_job));
+  const time_t           now = time(NULL);
+  job->pipes                 = pipes;
+  job->account               = account;
+  job->device_code           = oidc_strcopy(oidc_device_getDeviceCode(*dc));
+  job->only_at               = only_at;
+  job->interval              = oidc_device_getInterval(*dc)
+                                   ? oidc_device_getInterval(*dc)
+                                   : DEVICEPOLL_DEFAULT_INTERVAL;
+  job->expires_at =
+      oidc_device_getExpiresIn(*dc) ? now + oidc_device_getExpiresIn(*dc) : 0;
+  list_rpush(jobs, list_node_new(job));
+  timerWheel_add(now + job->interval, _pollJob, job);
+  agent_log(DEBUG, "Polling device code every %lus",
+            (unsigned long)job->interval);
+}
+
+/**
+ * @brief polls a single device code
+ * @return @c 1 if the job is done and its request was answered, @c 0 if it
+ * has to be polled again
+ */
+static int _poll(struct devicePoll_job* job, time_t now) {
+  if (job->expires_at && job->expires_at <= now) {
+    ipc_writeToPipe(job->pipes, RESPONSE_ERROR,
+                    "Device code is not valid any more");
+    return 1;
+  }
+  if (getAccessTokenUsingDeviceFlow(job->account, job->device_code,
+                                    job->pipes) == OIDC_SUCCESS) {
+    oidcd_answerDeviceLookup(job->pipes, job->account, job->only_at);
+    job->account = NULL;
+    return 1;
+  }
+  if (oidc_errno == OIDC_EOIDC &&
+      strequal(oidc_serror(), OIDC_AUTHORIZATION_PENDING)) {
+    return 0;
+  }
+  if (oidc_errno == OIDC_EOIDC && strequal(oidc_serror(), OIDC_SLOW_DOWN)) {
+    job->interval += DEVICEPOLL_SLOW_DOWN_STEP;
+    agent_log(DEBUG, "Slowing down device polling to %lus",
+              (unsigned long)job->interval);
+    return 0;
+  }
+  ipc_writeOidcErrnoToPipe(job->pipes);
+  return 1;
+}
+
+/**
+ * @brief polls the device code of a job that is due and answers its request
+ * if it is done; called by the timer wheel
+ */
+static void _pollJob(void* arg) {
+  struct devicePoll_job* job = arg;
+  const time_t           now = time(NULL);
+  if (_poll(job, now)) {
+    list_remove(jobs, findInList(jobs, job));
+    return;
+  }
+  timerWheel_add(now + job->interval, _pollJob, job);
+}
@@ -0,0 +1,11 @@
+#ifndef OIDCD_DEVICE_POLL_H
+#define OIDCD_DEVICE_POLL_H
+
+#include "account/account.h"
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc/device_code.h"
+
+void devicePoll_add(struct ipcPipe pipes, struct oidc_account* account,
+                    const struct oidc_device_code* dc, int only_at);
+
+#endif  // OIDCD_DEVICE_POLL_H
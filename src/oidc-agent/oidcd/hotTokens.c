@@ -0,0 +1,168 @@
+#include "hotTokens.h"
+#include "account/tokenCache.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * Token requests that oidcd answers from its token cache are hot: the token
+ * was requested before and is requested again. oidcd publishes the response to
+ * such a request to oidcp, which answers further requests for the same
+ * account, scope, and audience itself as long as the token is valid for the
+ * requested minimum period (see oidcp/hotTokenCache.c). So the most common
+ * request does not cross the pipe to oidcd.
+ * oidcd remembers what it published and checks it after every request it
+ * handled and every background job: once the token is not the cached token
+ * anymore, e.g. because it was refreshed or dropped, or the account was
+ * removed or locked, oidcp is told to drop the response.
+ */
+
+struct publishedToken {
+  char*         shortname;
+  char*         scope;
+  char*         audience;
+  char*         access_token;
+  unsigned long valid_until;
+};
+
+static list_t* published = NULL;  // oldest first
+
+static void _secFreePublishedToken(struct publishedToken* t) {
+  secFree(t->shortname);
+  secFree(t->scope);
+  secFree(t->audience);
+  secFree(t->access_token);
+  secFree(t);
+}
+
+static int _matchPublishedToken(const struct publishedToken* key,
+                                const struct publishedToken* t) {
+  return strequal(key->shortname, t->shortname) &&
+         strequal(key->scope, t->scope) &&
+         strequal(key->audience, t->audience);
+}
+
+static void _notify(struct ipcPipe pipes, cJSON* json) {
+  char* msg = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  if (ipc_writeToPipe(ipc_tagPipe(pipes, IPC_TAG_NOTIFY), "%s", msg) !=
+      OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not notify oidcp about a hot token: %s",
+              oidc_serror());
+  }
+  secFree(msg);
+}
+
+static cJSON* _keyJSON(const char* request, const struct publishedToken* t) {
+  cJSON* json =
+      generateJSONObject(IPC_KEY_REQUEST, cJSON_String, request,
+                         IPC_KEY_SHORTNAME, cJSON_String, t->shortname, NULL);
+  if (t->scope) {
+    jsonAddStringValue(json, OIDC_KEY_SCOPE, t->scope);
+  }
+  if (t->audience) {
+    jsonAddStringValue(json, IPC_KEY_AUDIENCE, t->audience);
+  }
+  return json;
+}
+
+static void _drop(struct ipcPipe pipes, list_node_t* node) {
+  agent_log(DEBUG, "Dropping the hot token of '%s' in oidcp",
+            ((struct publishedToken*)node->val)->shortname);
+  _notify(pipes, _keyJSON(INT_NOTIFY_VALUE_HOTTOKEN_DROP, node->val));
+  list_remove(published, node);
+}
+
+/**
+ * @brief returns until when a published token may be used by oidcp; the
+ * token of an account with a lifetime is not used after the account expires
+ */
+static unsigned long _validUntil(const struct oidc_account* account,
+                                 unsigned long              expires_at) {
+  const time_t death = account_getDeath(account);
+  return death && (unsigned long)death < expires_at ? (unsigned long)death
+                                                    : expires_at;
+}
+
+/**
+ * @brief publishes the response to a token request that was answered from the
+ * token cache to oidcp
+ * Nothing is published in multi-user mode and for accounts that require
+ * confirmation.
+ */
+void hotTokens_publish(struct ipcPipe pipes, const struct oidc_account* account,
+                       const char* scope, const char* audience,
+                       const char* access_token, unsigned long expires_at) {
+  if (agent_state.multi_user || account == NULL || access_token == NULL ||
+      account_getConfirmationRequired(account)) {
+    return;
+  }
+  if (published == NULL) {
+    published        = list_new();
+    published->free  = (void (*)(void*))_secFreePublishedToken;
+    published->match = (matchFunction)_matchPublishedToken;
+  }
+  struct publishedToken* t = secAlloc(sizeof(struct publishedToken));
+  t->shortname             = oidc_strcopy(account_getName(account));
+  t->scope                 = strValid(scope) ? oidc_strcopy(scope) : NULL;
+  t->audience = strValid(audience) ? oidc_strcopy(audience) : NULL;
+  t->access_token = oidc_strcopy(access_token);
+  t->valid_until  = _validUntil(account, expires_at);
+  list_removeIfFound(published, t);
+  if (published->len >= HOTTOKENS_MAX) {
+    _drop(pipes, published->head);
+  }
+  list_rpush(published, list_node_new(t));
+  const char* issuer = account_getIssuerUrl(account);
+  char*       response =
+      oidc_sprintf(RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, access_token,
+                   issuer ?: "", expires_at);
+  cJSON* json = _keyJSON(INT_NOTIFY_VALUE_HOTTOKEN, t);
+  jsonAddStringValue(json, INT_IPC_KEY_RESPONSE, response);
+  jsonAddNumberValue(json, AGENT_KEY_EXPIRESAT, t->valid_until);
+  secFree(response);
+  _notify(pipes, json);
+}
+
+static int _isStillValid(const struct publishedToken* t) {
+  if (agent_state.lock_state.locked) {
+    return 0;
+  }
+  struct oidc_account* account = db_findAccountByShortname(t->shortname);
+  if (account == NULL || account_getConfirmationRequired(account)) {
+    return 0;
+  }
+  const char* current =
+      getValidCachedAccessToken(account, 0, t->scope, t->audience);
+  return strequal(current, t->access_token) &&
+         _validUntil(account, account_getTokenExpiresAtFor(
+                                  account, t->scope, t->audience)) ==
+             t->valid_until;
+}
+
+/**
+ * @brief tells oidcp to drop all published responses whose token is not the
+ * cached token anymore; called after oidcd handled a request or did
+ * background work
+ */
+void hotTokens_revalidate(struct ipcPipe pipes) {
+  if (published == NULL || published->len == 0) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(published, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (!_isStillValid(node->val)) {
+      _drop(pipes, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
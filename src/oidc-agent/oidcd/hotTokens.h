@@ -0,0 +1,15 @@
+#ifndef OIDCD_HOT_TOKENS_H
+#define OIDCD_HOT_TOKENS_H
+
+#include "account/account.h"
+#include "ipc/pipe.h"
+
+// Maximum number of token responses oidcd keeps published in oidcp
+#define HOTTOKENS_MAX 64
+
+void hotTokens_publish(struct ipcPipe pipes, const struct oidc_account* account,
+                       const char* scope, const char* audience,
+                       const char* access_token, unsigned long expires_at);
+void hotTokens_revalidate(struct ipcPipe pipes);
+
+#endif  // OIDCD_HOT_TOKENS_H
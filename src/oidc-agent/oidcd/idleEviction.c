@@ -0,0 +1,226 @@
+#include "idleEviction.h"
+#include "account/account.h"
+#include "account/issuer_helper.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "utils/agentLogger.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+/**
+ * With an idle timeout, accounts that were neither used nor loaded for that
+ * long are dropped from the account db, so that the memory of the agent scales
+ * with the accounts in use and not with all accounts ever loaded. Only accounts
+ * with a config file are evicted. They are remembered, still listed as loaded
+ * and restored from their config file when they are used again; see
+ * @c _restoreIdleAccount in oidcd_handler.c. Evicted accounts are forgotten
+ * when their lifetime ends or when they are removed. Under memory pressure
+ * idle accounts are evicted even without an idle timeout, see
+ * memoryPressure.c.
+ */
+
+#define IDLE_EVICTION_INTERVAL 60
+
+static list_t*       evicted     = NULL;
+static time_t        idleTimeout = 0;
+static unsigned long generation  = 0;  // changed when the list changes
+static unsigned char sweeping    = 0;  // the sweep is scheduled
+
+static void _sweep(void* arg);
+
+static void _secFreeEvictedAccount(struct evictedAccount* e) {
+  secFree(e->shortname);
+  secFree(e->issuer_url);
+  secFree(e);
+}
+
+static int _matchEvictedAccount(const char*                  shortname,
+                                const struct evictedAccount* e) {
+  return strequal(shortname, e->shortname);
+}
+
+static void _remember(const struct oidc_account* account) {
+  if (evicted == NULL) {
+    evicted        = list_new();
+    evicted->free  = (void (*)(void*))_secFreeEvictedAccount;
+    evicted->match = (matchFunction)_matchEvictedAccount;
+  }
+  struct evictedAccount* e = secAlloc(sizeof(struct evictedAccount));
+  e->shortname             = oidc_strcopy(account_getName(account));
+  e->issuer_url            = oidc_strcopy(account_getIssuerUrl(account));
+  e->death                 = account_getDeath(account);
+  e->confirm               = account_getConfirmationRequired(account);
+  e->always_allow_id       = account_getAlwaysAllowId(account);
+  list_rpush(evicted, list_node_new(e));
+  generation++;
+}
+
+/**
+ * @brief forgets evicted accounts whose lifetime ended
+ */
+static void _forgetDead(time_t now) {
+  if (evicted == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(evicted, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct evictedAccount* e = node->val;
+    if (e->death && e->death <= now) {
+      accountStats_remove(e->shortname);
+      list_remove(evicted, node);
+      generation++;
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief evicts the accounts that were neither used nor loaded for
+ * @p idle_for seconds
+ * Nothing is evicted while the agent is locked.
+ * @return the number of evicted accounts
+ */
+size_t idleEviction_evictIdle(time_t idle_for) {
+  if (agent_state.lock_state.locked) {
+    return 0;
+  }
+  time_t          now      = time(NULL);
+  const vector_t* accounts = accountDB_getList();
+  list_t*         idle     = list_new();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    struct oidc_account* account = vector_at(accounts, i);
+    const char*          name    = account_getName(account);
+    if (account_getRefreshTokenSlot(account)) {
+      continue;  // refresh token lanes are dropped with the account
+    }
+    time_t since = accountStats_getIdleSince(name);
+    if (since == 0) {  // e.g. restored from a snapshot
+      accountStats_recordLoad(name);
+      continue;
+    }
+    if (now - since >= idle_for && accountConfigExists(name)) {
+      list_rpush(idle, list_node_new(account));
+    }
+  }
+  size_t       evicted_count = 0;
+  list_node_t* node;
+  while ((node = list_lpop(idle))) {
+    struct oidc_account* account = node->val;
+    LIST_FREE(node);
+    agent_log(DEBUG, "Evicting idle account '%s'", account_getName(account));
+    _remember(account);
+    accountDB_removeIfFound(account);
+    evicted_count++;
+  }
+  list_destroy(idle);
+  if (evicted_count && !sweeping) {  // to forget them when they die
+    sweeping = 1;
+    timerWheel_add(now + IDLE_EVICTION_INTERVAL, _sweep, NULL);
+  }
+  return evicted_count;
+}
+
+/**
+ * @brief evicts the accounts that are idle for @c idleTimeout seconds and
+ * forgets the evicted accounts whose lifetime ended; called by the timer wheel
+ * every @c IDLE_EVICTION_INTERVAL seconds while there is something to do
+ */
+static void _sweep(void* arg) {
+  (void)arg;
+  time_t now = time(NULL);
+  _forgetDead(now);
+  sweeping = idleTimeout || (evicted && evicted->len);
+  if (sweeping) {
+    timerWheel_add(now + IDLE_EVICTION_INTERVAL, _sweep, NULL);
+  }
+  if (idleTimeout) {
+    idleEviction_evictIdle(idleTimeout);
+  }
+}
+
+/**
+ * @brief starts sweeping for idle accounts
+ * @param idle_timeout the seconds after which an account is idle; @c 0 if
+ * idle accounts are not evicted
+ */
+void idleEviction_start(time_t idle_timeout) {
+  idleTimeout = idle_timeout;
+  if (idleTimeout && !sweeping) {
+    sweeping = 1;
+    timerWheel_add(time(NULL) + IDLE_EVICTION_INTERVAL, _sweep, NULL);
+  }
+}
+
+/**
+ * @brief returns the evicted account with @p shortname
+ * @return a pointer to the entry or @c NULL if the account was not evicted; it
+ * is owned by the module and MUST NOT be freed
+ */
+const struct evictedAccount* idleEviction_find(const char* shortname) {
+  list_node_t* node = shortname ? findInList(evicted, shortname) : NULL;
+  return node ? node->val : NULL;
+}
+
+/**
+ * @brief returns the evicted account that was loaded last for an issuer
+ * @return a pointer to the entry or @c NULL if there is none
+ */
+const struct evictedAccount* idleEviction_findByIssuer(const char* issuer_url) {
+  if (evicted == NULL || issuer_url == NULL) {
+    return NULL;
+  }
+  const struct evictedAccount* found = NULL;
+  list_node_t*                 node;
+  list_iterator_t*             it = list_iterator_new(evicted, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct evictedAccount* e = node->val;
+    if (compIssuerUrls(issuer_url, e->issuer_url)) {
+      found = e;
+    }
+  }
+  list_iterator_destroy(it);
+  return found;
+}
+
+/**
+ * @brief forgets an evicted account, e.g. because it was restored or removed
+ */
+void idleEviction_forget(const char* shortname) {
+  list_node_t* node = shortname ? findInList(evicted, shortname) : NULL;
+  if (node) {
+    list_remove(evicted, node);
+    generation++;
+  }
+}
+
+void idleEviction_clear() {
+  secFreeList(evicted);
+  evicted = NULL;
+  generation++;
+}
+
+/**
+ * @brief returns a counter that changes whenever accounts are evicted or
+ * forgotten
+ */
+unsigned long idleEviction_getGeneration() { return generation; }
+
+/**
+ * @brief adds the short names of the evicted accounts to @p names
+ * The names are still owned by the module.
+ */
+void idleEviction_addNames(vector_t* names) {
+  if (evicted == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(evicted, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    vector_push(names, ((struct evictedAccount*)node->val)->shortname);
+  }
+  list_iterator_destroy(it);
+}
@@ -0,0 +1,29 @@
+#ifndef OIDCD_IDLE_EVICTION_H
+#define OIDCD_IDLE_EVICTION_H
+
+#include "utils/vector.h"
+
+#include <time.h>
+
+/**
+ * An account that was dropped from the account db because it was idle; what
+ * is needed to load it again as it was
+ */
+struct evictedAccount {
+  char*         shortname;
+  char*         issuer_url;
+  time_t        death;
+  unsigned char confirm;
+  unsigned char always_allow_id;
+};
+
+void   idleEviction_start(time_t idle_timeout);
+size_t idleEviction_evictIdle(time_t idle_for);
+const struct evictedAccount* idleEviction_find(const char* shortname);
+const struct evictedAccount* idleEviction_findByIssuer(const char* issuer_url);
+void   idleEviction_forget(const char* shortname);
+void   idleEviction_clear();
+void   idleEviction_addNames(vector_t* names);
+unsigned long idleEviction_getGeneration();
+
+#endif  // OIDCD_IDLE_EVICTION_H
@@ -1,18 +1,65 @@
 #include "internal_request_handler.h"
+#include "account/accountCodec.h"
+#include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "ipc/pipe.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidcd/issuerChoice.h"
+#include "oidc-agent/oidcd/parse_internal.h"
+#include "oidc-agent/oidcd/refreshTokenPool.h"
+#include "oidc-agent/oidcd/snapshot.h"
 #include "utils/agentLogger.h"
+#include "utils/file_io/oidcDirCache.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
 #include "utils/memory.h"
+#include "utils/negativeCache.h"
 #include "utils/parseJson.h"
+#include "utils/stringUtils.h"
 
+static const struct oidcd_inProcessHandlers* inProcess = NULL;
+
+/**
+ * @brief sets the handlers that are used instead of oidcp
+ * @param handlers the handlers; @c NULL if there is an oidcp
+ */
+void oidcd_setInProcessHandlers(
+    const struct oidcd_inProcessHandlers* handlers) {
+  inProcess = handlers;
+}
+
+/**
+ * @brief passes a new refresh token of an account to oidcp, that writes it
+ * to the config file
+ * @param slot the slot of the refresh token in the refresh token pool of the
+ * account; @c 0 for the refresh token itself
+ */
 void oidcd_handleUpdateRefreshToken(const struct ipcPipe pipes,
                                     const char*          short_name,
+                                    size_t               slot,
                                     const char*          refresh_token) {
+  if (pipes.tx < 0 && inProcess) {
+    inProcess->updateRefreshToken(short_name, slot, refresh_token);
+    return;
+  }
+  snapshot_markChanged();
+  if (agent_state.multi_user) {
+    // the config file is owned by the user who loaded the account
+    agent_log(NOTICE,
+              "Received a new refresh token for '%s'. It is not written to "
+              "the config file in multi-user mode; the user may pass it to "
+              "oidc-gen --rt",
+              short_name);
+    return;
+  }
   char* res   = ipc_communicateThroughPipe(pipes, INT_REQUEST_UPD_REFRESH,
-                                         short_name, refresh_token);
+                                         short_name, slot, refresh_token);
   char* error = parseForError(res);
   if (error == NULL) {
-    agent_log(DEBUG, "Successfully updated refresh token for '%s'", short_name);
+    agent_log(DEBUG, "Passed updated refresh token %lu for '%s' to oidcp",
+              slot, short_name);
     return;
   }
   secFree(error);
@@ -23,3 +70,185 @@ void oidcd_handleUpdateRefreshToken(const struct ipcPipe pipes,
       "file failed. You may want to revoke the new refresh token or pass it "
       "to oidc-gen --rt");
 }
+
+/**
+ * @brief tells oidcp that the default access token of @p account changed, so
+ * that it can be pushed to the subscribed clients
+ * This is a notification; oidcp does not answer it.
+ */
+void oidcd_notifyTokenRefreshed(const struct ipcPipe      pipes,
+                                const struct oidc_account* account) {
+  if (!strValid(account_getAccessToken(account))) {
+    return;
+  }
+  if (pipes.tx < 0) {
+    if (inProcess) {
+      inProcess->tokenRefreshed(account);
+    }
+    return;
+  }
+  if (ipc_writeToPipe(ipc_tagPipe(pipes, IPC_TAG_NOTIFY), INT_NOTIFY_TOKEN,
+                      account_getName(account), account_getAccessToken(account),
+                      account_getIssuerUrl(account) ?: "",
+                      account_getTokenExpiresAt(account)) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not notify oidcp about new access token: %s",
+              oidc_serror());
+  }
+}
+
+// accounts whose config file changed on disk since they were used
+static list_t* changedAccounts = NULL;
+
+/**
+ * @brief handles a notification of oidcp; notifications are not answered
+ */
+void oidcd_handleNotification(const char* msg) {
+  char* request   = getJSONValueFromString(msg, IPC_KEY_REQUEST);
+  char* shortname = getJSONValueFromString(msg, IPC_KEY_SHORTNAME);
+  if (strequal(request, INT_NOTIFY_VALUE_CONFIG_CHANGED)) {
+    negativeCache_clear();
+    oidcDirCache_clear();
+    issuerChoice_clear();  // the default account of an issuer might change
+  } else if (strequal(request, INT_NOTIFY_VALUE_ACCOUNT_CHANGED) &&
+             strValid(shortname)) {
+    negativeCache_clear();  // it might be a new account
+    char* path = concatToOidcDir(shortname);
+    oidcDirCache_invalidate(path);
+    secFree(path);
+    if (changedAccounts == NULL) {
+      changedAccounts        = list_new();
+      changedAccounts->free  = _secFree;
+      changedAccounts->match = (matchFunction)strequal;
+    }
+    if (findInList(changedAccounts, shortname) == NULL) {
+      list_rpush(changedAccounts, list_node_new(shortname));
+      shortname = NULL;
+    }
+  } else if (strequal(request, INT_NOTIFY_VALUE_RTPOOL_LANE) ||
+             strequal(request, INT_NOTIFY_VALUE_RTPOOL_DROP)) {
+    rtPool_queue(msg);
+  } else {
+    agent_log(ERROR, "Unknown notification from oidcp: %s", request ?: "");
+  }
+  secFree(request);
+  secFree(shortname);
+}
+
+/**
+ * @brief takes the refresh token and the client credentials from the config
+ * file, if the config of @p account changed on disk since it was loaded
+ * This is done lazily before the refresh token is used, so that a refresh
+ * token that was rotated by another process is not used. oidcp only decrypts
+ * the file if it has a stored password for it; otherwise the loaded values are
+ * kept.
+ */
+void oidcd_reloadIfAccountChanged(const struct ipcPipe pipes,
+                                  struct oidc_account* account) {
+  list_node_t* node = findInList(changedAccounts, account_getName(account));
+  if (node == NULL) {
+    return;
+  }
+  list_remove(changedAccounts, node);
+  agent_log(DEBUG, "Reloading changed config of '%s'",
+            account_getName(account));
+  char* res = ipc_communicateThroughPipe(pipes, INT_REQUEST_RELOAD,
+                                         account_getName(account));
+  char* data = res ? parseForAccountData(res) : NULL;
+  if (data == NULL) {
+    agent_log(NOTICE, "Could not reload the changed config of '%s': %s",
+              account_getName(account), oidc_serror());
+    return;
+  }
+  struct oidc_account* changed = getAccountFromCompactString(data);
+  secFree(data);
+  if (changed == NULL) {
+    return;
+  }
+  // a lane uses its refresh token of the pool
+  const size_t slot          = account_getRefreshTokenSlot(account);
+  list_t*      pool          = account_getRefreshTokenPool(changed);
+  list_node_t* pooled        = slot && pool ? list_at(pool, slot - 1) : NULL;
+  const char*  refresh_token = slot ? (pooled ? pooled->val : NULL)
+                                    : account_getRefreshToken(changed);
+  if (strValid(refresh_token)) {
+    account_setRefreshToken(account, oidc_strcopy(refresh_token));
+  }
+  if (strValid(account_getClientId(changed))) {
+    account_setClientId(account, oidc_strcopy(account_getClientId(changed)));
+    account_setClientSecret(account,
+                            oidc_strcopy(account_getClientSecret(changed)));
+    account_setRefreshTemplate(account, NULL);
+  }
+  secFreeAccount(changed);
+}
+
+/**
+ * @brief takes the tokens a peer agent replicated for @p account
+ * The access token is only taken if it is valid longer than the current one.
+ * A new refresh token is passed to oidcp like a rotated one, so that the
+ * config file is updated.
+ */
+void oidcd_applyReplicatedTokens(const struct ipcPipe pipes,
+                                 struct oidc_account* account,
+                                 const char*          access_token,
+                                 unsigned long        expires_at,
+                                 const char*          refresh_token) {
+  if (strValid(access_token) && expires_at > (unsigned long)time(NULL) &&
+      expires_at > account_getTokenExpiresAt(account)) {
+    agent_log(DEBUG, "Taking access token of '%s' from a peer",
+              account_getName(account));
+    account_setTokenIssuedAt(account, time(NULL));
+    account_setTokenExpiresAt(account, expires_at);
+    account_setAccessToken(account, oidc_strcopy(access_token));
+    oidcd_notifyTokenRefreshed(pipes, account);
+  }
+  if (strValid(refresh_token) &&
+      !strequal(refresh_token, account_getRefreshToken(account))) {
+    agent_log(DEBUG, "Taking refresh token of '%s' from a peer",
+              account_getName(account));
+    account_setRefreshToken(account, oidc_strcopy(refresh_token));
+    oidcd_handleUpdateRefreshToken(pipes, account_getName(account),
+                                   account_getRefreshTokenSlot(account),
+                                   refresh_token);
+  }
+}
+
+/**
+ * @brief waits until this agent may refresh the tokens of @p account
+ * With --peer only one agent refreshes an account at a time. While a peer
+ * holds the refresh lease, oidcp answers once the peer replicated its tokens,
+ * which are then applied to @p account, or once the lease expired.
+ * @return @c 1 if tokens of a peer were applied, so that the cache should be
+ * checked before asking again; @c 0 if this agent may refresh
+ */
+int oidcd_waitForRefreshLease(const struct ipcPipe pipes,
+                              struct oidc_account* account) {
+  if (!agent_state.peers || pipes.tx < 0 ||
+      account_getRefreshTokenSlot(account)) {  // lanes are not replicated
+    return 0;
+  }
+  char* res = ipc_communicateThroughPipe(pipes, INT_REQUEST_LEASE,
+                                         account_getName(account));
+  if (res == NULL) {
+    agent_log(ERROR, "Could not get the refresh lease of '%s': %s",
+              account_getName(account), oidc_serror());
+    return 0;
+  }
+  INIT_KEY_VALUE(OIDC_KEY_ACCESSTOKEN, AGENT_KEY_EXPIRESAT,
+                 OIDC_KEY_REFRESHTOKEN);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    secFree(res);
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  secFree(res);
+  KEY_VALUE_VARS(access_token, expires_at, refresh_token);
+  int applied = strValid(_access_token);
+  if (applied) {
+    oidcd_applyReplicatedTokens(pipes, account, _access_token,
+                                _expires_at ? strToULong(_expires_at) : 0,
+                                _refresh_token);
+  }
+  SEC_FREE_KEY_VALUES();
+  return applied;
+}
@@ -1,9 +1,31 @@
 #ifndef OIDCD_INTERNAL_REQUEST_HANDLER_H
 #define OIDCD_INTERNAL_REQUEST_HANDLER_H
 
+#include "account/account.h"
 #include "ipc/pipe.h"
 
+/**
+ * Handles what would be passed to oidcp, when the flows run without oidcp,
+ * i.e. in liboidc-agent-core. They are used for pipes without a file
+ * descriptor.
+ */
+struct oidcd_inProcessHandlers {
+  void (*updateRefreshToken)(const char* short_name, size_t slot,
+                             const char* refresh_token);
+  void (*tokenRefreshed)(const struct oidc_account* account);
+};
+
+void oidcd_setInProcessHandlers(const struct oidcd_inProcessHandlers*);
 void oidcd_handleUpdateRefreshToken(const struct ipcPipe, const char*,
-                                    const char*);
+                                    size_t slot, const char*);
+void oidcd_notifyTokenRefreshed(const struct ipcPipe,
+                                const struct oidc_account*);
+void oidcd_handleNotification(const char* msg);
+void oidcd_reloadIfAccountChanged(const struct ipcPipe, struct oidc_account*);
+void oidcd_applyReplicatedTokens(const struct ipcPipe, struct oidc_account*,
+                                 const char* access_token,
+                                 unsigned long expires_at,
+                                 const char*   refresh_token);
+int  oidcd_waitForRefreshLease(const struct ipcPipe, struct oidc_account*);
 
 #endif  // OIDCD_INTERNAL_REQUEST_HANDLER_H
@@ -0,0 +1,80 @@
+#include "issuerChoice.h"
+#include "account/issuer_helper.h"
+#include "oidc-agent/agent_state.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * Remembers which loaded account answers token requests for an issuer, so
+ * that repeated requests neither collect the loaded accounts of the issuer
+ * nor ask oidcp for the default account. The choices are only valid for the
+ * accounts that were loaded when they were made: they are dropped when the
+ * generation of the account db changes, i.e. when an account is added or
+ * removed, and when oidcp reports a changed issuer.config. In multi-user mode
+ * the choice depends on the user and nothing is remembered.
+ */
+
+struct issuerChoice {
+  char*                issuer_url;
+  struct oidc_account* account;  // owned by the account db
+};
+
+static list_t*       choices    = NULL;
+static unsigned long generation = 0;  // of the account db
+
+static void _secFreeIssuerChoice(struct issuerChoice* c) {
+  secFree(c->issuer_url);
+  secFree(c);
+}
+
+static int _matchIssuerChoice(const char*                issuer_url,
+                              const struct issuerChoice* c) {
+  return compIssuerUrls(issuer_url, c->issuer_url);
+}
+
+/**
+ * @brief returns the account that was chosen for @p issuer_url before
+ * @return a pointer to the loaded account or @c NULL if there is no valid
+ * choice; the account is still memory encrypted
+ */
+struct oidc_account* issuerChoice_find(const char* issuer_url) {
+  if (choices == NULL || issuer_url == NULL) {
+    return NULL;
+  }
+  if (generation != accountDB_getGeneration()) {
+    issuerChoice_clear();
+    return NULL;
+  }
+  list_node_t* node = findInList(choices, issuer_url);
+  return node ? ((struct issuerChoice*)node->val)->account : NULL;
+}
+
+void issuerChoice_remember(const char*          issuer_url,
+                           struct oidc_account* account) {
+  if (issuer_url == NULL || account == NULL || agent_state.multi_user) {
+    return;
+  }
+  if (choices == NULL || generation != accountDB_getGeneration()) {
+    issuerChoice_clear();
+    choices        = list_new();
+    choices->free  = (void (*)(void*))_secFreeIssuerChoice;
+    choices->match = (matchFunction)_matchIssuerChoice;
+    generation     = accountDB_getGeneration();
+  }
+  list_node_t* node = findInList(choices, issuer_url);
+  if (node) {
+    ((struct issuerChoice*)node->val)->account = account;
+    return;
+  }
+  struct issuerChoice* c = secAlloc(sizeof(struct issuerChoice));
+  c->issuer_url          = oidc_strcopy(issuer_url);
+  c->account             = account;
+  list_rpush(choices, list_node_new(c));
+}
+
+void issuerChoice_clear() {
+  secFreeList(choices);
+  choices = NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDCD_ISSUER_CHOICE_H
+#define OIDCD_ISSUER_CHOICE_H
+
+#include "account/account.h"
+
+struct oidc_account* issuerChoice_find(const char* issuer_url);
+void                 issuerChoice_remember(const char*          issuer_url,
+                                           struct oidc_account* account);
+void                 issuerChoice_clear();
+
+#endif  // OIDCD_ISSUER_CHOICE_H
@@ -0,0 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
+#include "memoryPressure.h"
+#include "account/tokenCache.h"
+#include "oidc-agent/oidcd/idleEviction.h"
+#include "utils/agentLogger.h"
+#include "utils/db/account_db.h"
+#include "utils/db/issuerConfig_db.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * On shared hosts the agent often runs in a cgroup with a memory limit. To
+ * give memory back before it is OOM-killed, the memory pressure is checked
+ * every @c MEMORY_PRESSURE_INTERVAL seconds and the caches are trimmed in the
+ * order in which their entries are cheapest to get back:
+ * 1. expired access and id tokens, which cannot be used anyway
+ * 2. the cached openid configurations of the issuers
+ * 3. accounts idle for @c MEMORY_PRESSURE_IDLE seconds; they are restored
+ *    from their config file when they are used again, see idleEviction.c
+ * 4. all access tokens with non-default scope or audience and all id tokens
+ *
+ * The pressure is taken from the stall information (PSI) of the agent's
+ * cgroup, or of the whole host if the cgroup has none, and from the events
+ * of the cgroup's memory controller: if the cgroup exceeded @c memory.high
+ * the first two levels are trimmed, if it hit @c memory.max everything.
+ * Without either source nothing is checked. The trimmed entries are counted
+ * in the metrics.
+ */
+
+#define MEMORY_PRESSURE_PROC_PSI "/proc/pressure/memory"
+#define MEMORY_PRESSURE_CGROUP_ROOT "/sys/fs/cgroup"
+
+// Share of time (percent, average of the last 10 seconds) in which at least
+// one task waited for memory, from which on a level is trimmed
+static const double levelThresholds[] = {1, 5, 10, 25};
+#define MEMORY_PRESSURE_MAX_LEVEL \
+  (int)(sizeof(levelThresholds) / sizeof(*levelThresholds))
+
+static char*         psiPath    = NULL;
+static char*         eventsPath = NULL;
+static unsigned long lastHigh   = 0;
+static unsigned long lastMax    = 0;
+static int           lastLevel  = 0;
+
+/**
+ * @brief reads a small file from procfs or sysfs, whose size is not known in
+ * advance
+ * @return a pointer to the content or @c NULL; has to be freed after usage
+ */
+static char* _readSmallFile(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  char    buf[1024];
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return NULL;
+  }
+  buf[n] = '\0';
+  return oidc_strcopy(buf);
+}
+
+/**
+ * @brief returns the value of @p key in a file of lines @c key @c value or of
+ * @p key in @c key=value pairs
+ */
+static const char* _findValue(const char* content, const char* key) {
+  size_t      key_len = strlen(key);
+  const char* s       = content;
+  while ((s = strstr(s, key)) != NULL) {
+    const unsigned char start = s == content || s[-1] == '\n' || s[-1] == ' ';
+    if (start && (s[key_len] == ' ' || s[key_len] == '=')) {
+      return s + key_len + 1;
+    }
+    s += key_len;
+  }
+  return NULL;
+}
+
+static char* _getCgroupFile(const char* name) {
+  char* cgroup = _readSmallFile("/proc/self/cgroup");
+  char* line   = cgroup ? strstr(cgroup, "0::") : NULL;
+  if (line == NULL || (line != cgroup && line[-1] != '\n')) {
+    secFree(cgroup);
+    return NULL;
+  }
+  line += strlen("0::");
+  line[strcspn(line, "\n")] = '\0';
+  char* path = oidc_sprintf("%s%s/%s", MEMORY_PRESSURE_CGROUP_ROOT,
+                            strequal(line, "/") ? "" : line, name);
+  secFree(cgroup);
+  if (access(path, R_OK) != 0) {
+    secFree(path);
+    return NULL;
+  }
+  return path;
+}
+
+static int _levelFromStall() {
+  char* psi = psiPath ? _readSmallFile(psiPath) : NULL;
+  if (psi == NULL) {
+    return 0;
+  }
+  const char* some  = strstr(psi, "some ");
+  const char* avg10 = some ? _findValue(some, "avg10") : NULL;
+  double      stall = avg10 ? strtod(avg10, NULL) : 0;
+  secFree(psi);
+  int level = 0;
+  while (level < MEMORY_PRESSURE_MAX_LEVEL &&
+         stall >= levelThresholds[level]) {
+    level++;
+  }
+  return level;
+}
+
+static int _levelFromEvents() {
+  char* events = eventsPath ? _readSmallFile(eventsPath) : NULL;
+  if (events == NULL) {
+    return 0;
+  }
+  const char*   high_str = _findValue(events, "high");
+  const char*   max_str  = _findValue(events, "max");
+  const char*   oom_str  = _findValue(events, "oom");
+  unsigned long high     = high_str ? strtoul(high_str, NULL, 10) : 0;
+  unsigned long max      = (max_str ? strtoul(max_str, NULL, 10) : 0) +
+                      (oom_str ? strtoul(oom_str, NULL, 10) : 0);
+  secFree(events);
+  int level = 0;
+  if (max > lastMax) {
+    level = MEMORY_PRESSURE_MAX_LEVEL;
+  } else if (high > lastHigh) {
+    level = 2;
+  }
+  lastHigh = high;
+  lastMax  = max;
+  return level;
+}
+
+static size_t _trimTokenCaches(unsigned char expired_only) {
+  size_t          trimmed  = 0;
+  const vector_t* accounts = accountDB_getList();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    trimmed += account_trimTokenCache(vector_at(accounts, i), expired_only);
+  }
+  return trimmed;
+}
+
+static void _trim(int level) {
+  size_t n = _trimTokenCaches(1);
+  metrics_add(METRIC_MEMORY_TRIMMED, "expired_tokens", n);
+  if (level >= 2) {
+    n = issuerConfigDB_getSize();
+    issuerConfigDB_reset();
+    metrics_add(METRIC_MEMORY_TRIMMED, "discovery", n);
+  }
+  if (level >= 3) {
+    n = idleEviction_evictIdle(MEMORY_PRESSURE_IDLE);
+    metrics_add(METRIC_MEMORY_TRIMMED, "idle_accounts", n);
+  }
+  if (level >= 4) {
+    n = _trimTokenCaches(0);
+    metrics_add(METRIC_MEMORY_TRIMMED, "scoped_tokens", n);
+  }
+}
+
+/**
+ * @brief checks the memory pressure and trims the caches accordingly; called
+ * by the timer wheel every @c MEMORY_PRESSURE_INTERVAL seconds
+ */
+static void _check(void* arg) {
+  (void)arg;
+  timerWheel_add(time(NULL) + MEMORY_PRESSURE_INTERVAL, _check, NULL);
+  int level        = _levelFromStall();
+  int events_level = _levelFromEvents();
+  if (events_level > level) {
+    level = events_level;
+  }
+  if (level != lastLevel) {
+    agent_log(level ? NOTICE : INFO, "Memory pressure level %d", level);
+  }
+  lastLevel = level;
+  metrics_set(METRIC_MEMORY_PRESSURE, NULL, level);
+  if (level > 0) {
+    _trim(level);
+  }
+}
+
+/**
+ * @brief starts checking the memory pressure, if the host provides the
+ * information
+ */
+void memoryPressure_start() {
+  if (psiPath || eventsPath) {
+    return;
+  }
+  psiPath    = _getCgroupFile("memory.pressure");
+  eventsPath = _getCgroupFile("memory.events");
+  if (psiPath == NULL && access(MEMORY_PRESSURE_PROC_PSI, R_OK) == 0) {
+    psiPath = oidc_strcopy(MEMORY_PRESSURE_PROC_PSI);
+  }
+  if (psiPath == NULL && eventsPath == NULL) {
+    agent_log(DEBUG, "No memory pressure information available");
+    return;
+  }
+  _levelFromEvents();  // the events before the start do not count
+  timerWheel_add(time(NULL) + MEMORY_PRESSURE_INTERVAL, _check, NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef OIDCD_MEMORY_PRESSURE_H
+#define OIDCD_MEMORY_PRESSURE_H
+
+// Seconds between two checks of the memory pressure
+#define MEMORY_PRESSURE_INTERVAL 10
+// Seconds after which an account counts as idle under memory pressure
+#define MEMORY_PRESSURE_IDLE 300
+
+void memoryPressure_start();
+
+#endif  // OIDCD_MEMORY_PRESSURE_H
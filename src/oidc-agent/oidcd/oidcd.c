@@ -1,173 +1,1030 @@
 #include "oidcd.h"
 #include "account/account.h"
+#include "account/tokenIndex.h"
+#include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "oidc-agent/agent_state.h"
+#include "oidc-agent/http/http_worker.h"
+#include "oidc-agent/httpserver/termHttpserver.h"
+#include "oidc-agent/oidc/issuerRateLimit.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/addValidation.h"
 #include "oidc-agent/oidcd/codeExchangeEntry.h"
+#include "oidc-agent/oidcd/hotTokens.h"
+#include "oidc-agent/oidcd/idleEviction.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
+#include "oidc-agent/oidcd/memoryPressure.h"
 #include "oidc-agent/oidcd/oidcd_handler.h"
+#include "oidc-agent/oidcd/prefetch.h"
+#include "oidc-agent/oidcd/prefetchHints.h"
+#include "oidc-agent/oidcd/refreshKeepalive.h"
+#include "oidc-agent/oidcd/refreshTokenPool.h"
+#include "oidc-agent/oidcd/snapshot.h"
+#include "oidc-agent/oidcd/warmup.h"
 #include "utils/accountUtils.h"
 #include "utils/agentLogger.h"
+#include "utils/clockWatch.h"
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/memoryCrypt.h"
 #include "utils/db/account_db.h"
 #include "utils/db/codeVerifier_db.h"
 #include "utils/db/file_db.h"
+#include "utils/db/issuerConfig_db.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
+#include "utils/loopLag.h"
+#include "utils/matcher.h"
+#include "utils/memoryArena.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/oidc_error.h"
+#include "utils/probes.h"
+#include "utils/profiler.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
 
-int oidcd_main(struct ipcPipe pipes, const struct arguments* arguments) {
-  logger_open("oidc-agent.d");
-  initCrypt();
-  initMemoryCrypt();
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * A request that arrived while another request was handled and that could not
+ * be answered directly
+ */
+struct deferredRequest {
+  unsigned long tag;
+  char*         msg;
+};
+
+/**
+ * Requests that arrive while another request is handled take one of three
+ * lanes: Health requests and token requests that can be answered from the
+ * token cache take the fast lane and are answered at once. Other token
+ * requests wait in the refresh lane and all remaining requests, e.g. loading
+ * or generating an account, in the management lane. The refresh lane is
+ * served first, so that a slow management request does not hold up token
+ * requests; a waiting management request is still taken after at most
+ * LANE_REFRESH_BURST refreshes.
+ */
+enum lane { LANE_REFRESH, LANE_MANAGEMENT, LANE_COUNT };
+
+#define LANE_REFRESH_BURST 8
+
+static list_t*                 deferredRequests[LANE_COUNT] = {NULL};
+static size_t                  refreshesInRow               = 0;
+static const struct arguments* oidcd_arguments              = NULL;
+
+static struct ipcPipe oidcd_pipes = {.rx = -1, .tx = -1};
+
+static void _secFreeDeferredRequest(struct deferredRequest* r) {
+  secFree(r->msg);
+  secFree(r);
+}
+
+static int _hasDeferredRequests(enum lane lane) {
+  return deferredRequests[lane] && deferredRequests[lane]->len > 0;
+}
+
+static char* _popDeferredRequest(unsigned long* tag) {
+  enum lane lane;
+  if (_hasDeferredRequests(LANE_REFRESH) &&
+      (refreshesInRow < LANE_REFRESH_BURST ||
+       !_hasDeferredRequests(LANE_MANAGEMENT))) {
+    lane = LANE_REFRESH;
+    refreshesInRow++;
+  } else if (_hasDeferredRequests(LANE_MANAGEMENT)) {
+    lane           = LANE_MANAGEMENT;
+    refreshesInRow = 0;
+  } else {
+    return NULL;
+  }
+  list_node_t*            node = list_at(deferredRequests[lane], 0);
+  struct deferredRequest* r    = node->val;
+  char*                   msg  = r->msg;
+  *tag                         = r->tag;
+  r->msg                       = NULL;
+  list_remove(deferredRequests[lane], node);
+  return msg;
+}
+
+static size_t _countDeferredRequests() {
+  size_t count = 0;
+  for (int lane = 0; lane < LANE_COUNT; lane++) {
+    count += deferredRequests[lane] ? deferredRequests[lane]->len : 0;
+  }
+  return count;
+}
+
+/**
+ * @brief returns the lane a request that cannot be answered at once waits in
+ * Token requests from a background socket (see --listen) wait with the
+ * management requests.
+ */
+static enum lane _laneFor(const char* request_type, const char* background) {
+  return (strequal(request_type, REQUEST_VALUE_ACCESSTOKEN) ||
+          strequal(request_type, REQUEST_VALUE_IDTOKEN) ||
+          strequal(request_type, REQUEST_VALUE_TOKENREJECTED)) &&
+                 !strToInt(background)
+             ? LANE_REFRESH
+             : LANE_MANAGEMENT;
+}
+
+/**
+ * @brief returns the user a request of oidcp is made for
+ * The tenant is only set by oidcp in multi-user mode; otherwise all accounts
+ * belong to the tenant @c 0.
+ */
+static uid_t _tenantOf(const char* msg) {
+  if (!agent_state.multi_user) {
+    return 0;
+  }
+  char* tenant_str = getJSONValueFromString(msg, IPC_KEY_TENANT);
+  uid_t tenant     = (uid_t)strToULong(tenant_str);
+  secFree(tenant_str);
+  return tenant;
+}
+
+/**
+ * @brief handles a request that arrived while another request is in progress
+ * Health requests and requests that can be answered from the token cache are
+ * answered directly, all others are deferred to their lane until the current
+ * request is done.
+ */
+static void _handleConcurrentRequest(unsigned long tag, char* msg) {
+  if (tag == IPC_TAG_NOTIFY) {
+    oidcd_handleNotification(msg);
+    secFree(msg);
+    return;
+  }
+  char* request_type = getJSONValueFromString(msg, IPC_KEY_REQUEST);
+  if (strequal(request_type, REQUEST_VALUE_HEALTH)) {
+    oidcd_handleHealth(ipc_tagPipe(oidcd_pipes, tag),
+                       _countDeferredRequests());
+    secFree(request_type);
+    secFree(msg);
+    return;
+  }
+  // the request in progress might be for another user
+  const uid_t tenant = accounts_getTenant();
+  accounts_setTenant(_tenantOf(msg));
+  const int fromCache = oidcd_handleTokenFromCache(
+      ipc_tagPipe(oidcd_pipes, tag), msg, oidcd_arguments);
+  accounts_setTenant(tenant);
+  if (fromCache) {
+    secFree(request_type);
+    secFree(msg);
+    return;
+  }
+  char*           background = getJSONValueFromString(msg, IPC_KEY_BACKGROUND);
+  const enum lane lane       = _laneFor(request_type, background);
+  secFree(background);
+  secFree(request_type);
+  agent_log(DEBUG, "Deferring request %lu to the %s lane", tag,
+            lane == LANE_REFRESH ? "refresh" : "management");
+  if (deferredRequests[lane] == NULL) {
+    deferredRequests[lane]       = list_new();
+    deferredRequests[lane]->free = (void (*)(void*))_secFreeDeferredRequest;
+  }
+  struct deferredRequest* r = secAlloc(sizeof(struct deferredRequest));
+  r->tag                    = tag;
+  r->msg                    = msg;
+  list_rpush(deferredRequests[lane], list_node_new(r));
+}
+
+/**
+ * @brief answers all deferred requests that can now be answered from the token
+ * cache
+ * Only one refresh is in flight at a time and requests for the same account,
+ * scope, and audience that arrive meanwhile are deferred. Once the refresh is
+ * done, they are all answered with its result instead of doing a refresh each.
+ */
+static void _answerDeferredRequestsFromCache() {
+  list_t* deferred = deferredRequests[LANE_REFRESH];
+  if (deferred == NULL || deferred->len == 0) {
+    return;
+  }
+  const uid_t      tenant = accounts_getTenant();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(deferred, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct deferredRequest* r = node->val;
+    accounts_setTenant(_tenantOf(r->msg));
+    const int fromCache = oidcd_handleTokenFromCache(
+        ipc_tagPipe(oidcd_pipes, r->tag), r->msg, oidcd_arguments);
+    if (fromCache) {
+      agent_log(DEBUG, "Answered deferred request %lu from cache", r->tag);
+      list_remove(deferred, node);
+    }
+  }
+  list_iterator_destroy(it);
+  accounts_setTenant(tenant);
+}
+
+/**
+ * @brief reads a single request from oidcp and handles it concurrently; called
+ * while waiting for a https response
+ */
+static void _readConcurrentRequest() {
+  unsigned long tag = 0;
+  char* msg = ipc_readTaggedFromPipeWithTimeout(oidcd_pipes, 0, &tag);
+  if (msg == NULL) {
+    agent_log(ERROR, "%s", oidc_serror());
+    if (oidc_errno == OIDC_EIPCDIS || oidc_errno == OIDC_EIPCTAG) {
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+  _handleConcurrentRequest(tag, msg);
+}
+
+/**
+ * The values of a request to oidcd; each field is the value of the ipc key
+ * with the same name
+ */
+struct oidcd_request {
+  char* shortname;
+  char* minvalid;
+  char* config;
+  char* flow;
+  char* nowebserver;
+  char* redirectedUri;
+  char* state;
+  char* authorization;
+  char* scope;
+  char* device;
+  char* fromGen;
+  char* lifetime;
+  char* password;
+  char* applicationHint;
+  char* confirm;
+  char* issuer;
+  char* noscheme;
+  char* cert_path;
+  char* audience;
+  char* alwaysallowid;
+  char* filename;
+  char* data;
+  char* registration_client_uri;
+  char* registration_access_token;
+  char* only_at;
+  char* metrics;
+  char* stale_ok;
+  char* revoke;
+  char* duration;
+  char* heap;
+  char* access_token;
+  char* expires_at;
+  char* refresh_token;
+  char* when;
+  char* token_hash;
+};
+
+typedef void (*oidcd_requestHandler)(struct ipcPipe,
+                                     const struct oidcd_request*,
+                                     const struct arguments*);
+
+struct oidcd_requestType {
+  const char*          name;
+  oidcd_requestHandler handle;
+  unsigned char        whenLocked;  // if the request is allowed when locked
+};
+
+static void _handleCheck(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments __attribute__((unused))) {
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
+}
+
+static void _handleGen(struct ipcPipe pipes, const struct oidcd_request* r,
+                       const struct arguments* arguments) {
+  oidcd_handleGen(pipes, r->config, r->flow, r->nowebserver, r->noscheme,
+                  r->only_at, arguments);
+}
+
+static void _handleCodeExchange(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleCodeExchange(pipes, r->redirectedUri, r->fromGen);
+}
+
+static void _handleStateLookUp(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleStateLookUp(pipes, r->state);
+}
+
+static void _handleDeviceLookup(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleDeviceLookup(pipes, r->config, r->device, r->only_at);
+}
+
+static void _handleDevicePoll(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleDevicePoll(pipes, r->config, r->device, r->only_at);
+}
+
+static void _handleAdd(struct ipcPipe pipes, const struct oidcd_request* r,
+                       const struct arguments* arguments) {
+  oidcd_handleAdd(pipes, r->config, r->lifetime, r->confirm, r->alwaysallowid,
+                  arguments);
+}
+
+static void _handleRm(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleRm(pipes, r->shortname);
+}
+
+static void _handleRemoveAll(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleRemoveAll(pipes, r->revoke);
+}
+
+static void _handleDelete(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleDelete(pipes, r->config);
+}
+
+static void _handleDeleteClient(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleDeleteClient(pipes, r->registration_client_uri,
+                           r->registration_access_token, r->cert_path);
+}
+
+static void _handleStatus(struct ipcPipe              pipes,
+                          const struct oidcd_request* r __attribute__((unused)),
+                          const struct arguments*     arguments) {
+  oidcd_handleAgentStatus(pipes, arguments);
+}
+
+static void _handleStatusJSON(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments) {
+  oidcd_handleAgentStatusJSON(pipes, arguments);
+}
+
+/**
+ * @brief returns the arguments a token request is handled with
+ * oidcp sets @c confirm on requests from a socket that requires confirmation.
+ */
+static const struct arguments* _tokenArguments(
+    const struct oidcd_request* r, const struct arguments* arguments,
+    struct arguments* buffer) {
+  if (!strToInt(r->confirm) || arguments->confirm) {
+    return arguments;
+  }
+  *buffer         = *arguments;
+  buffer->confirm = 1;
+  return buffer;
+}
+
+static void _handleToken(struct ipcPipe pipes, const struct oidcd_request* r,
+                         const struct arguments* arguments) {
+  struct arguments confirming;
+  arguments = _tokenArguments(r, arguments, &confirming);
+  if (r->shortname) {
+    oidcd_handleToken(pipes, r->shortname, r->minvalid, r->scope,
+                      r->applicationHint, r->audience, r->stale_ok, arguments);
+  } else if (r->issuer) {
+    oidcd_handleTokenIssuer(pipes, r->issuer, r->minvalid, r->scope,
+                            r->applicationHint, r->audience, arguments);
+  } else {
+    // global default
+    oidc_errno = OIDC_NOTIMPL;  // TODO
+    ipc_writeOidcErrnoToPipe(pipes);
+  }
+}
+
+static void _handleIdToken(struct ipcPipe pipes, const struct oidcd_request* r,
+                           const struct arguments* arguments) {
+  struct arguments confirming;
+  arguments = _tokenArguments(r, arguments, &confirming);
+  if (r->shortname || r->issuer) {
+    oidcd_handleIdToken(pipes, r->shortname, r->issuer, r->scope,
+                        r->applicationHint, arguments);
+  } else {
+    // global default
+    oidc_errno = OIDC_NOTIMPL;  // TODO
+    ipc_writeOidcErrnoToPipe(pipes);
+  }
+}
+
+static void _handleUserinfo(struct ipcPipe pipes, const struct oidcd_request* r,
+                            const struct arguments* arguments) {
+  struct arguments confirming;
+  arguments = _tokenArguments(r, arguments, &confirming);
+  oidcd_handleUserinfo(pipes, r->shortname, r->applicationHint, arguments);
+}
+
+static void _handleValidateToken(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleValidateToken(pipes, r->access_token, r->audience);
+}
+
+static void _handleTokenRejected(struct ipcPipe              pipes,
+                                 const struct oidcd_request* r,
+                                 const struct arguments*     arguments) {
+  struct arguments confirming;
+  arguments = _tokenArguments(r, arguments, &confirming);
+  oidcd_handleTokenRejected(pipes, r->shortname, r->token_hash, r->scope,
+                            r->applicationHint, r->audience, arguments);
+}
+
+static void _handlePrefetch(struct ipcPipe pipes, const struct oidcd_request* r,
+                            const struct arguments* arguments) {
+  oidcd_handlePrefetch(pipes, r->shortname, r->scope, r->audience, r->when,
+                       r->duration, r->applicationHint, arguments);
+}
+
+static void _handleRegister(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleRegister(pipes, r->config, r->flow, r->authorization);
+}
+
+static void _handleRegisterBatch(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleRegisterBatch(pipes, r->config, r->flow, r->authorization);
+}
+
+static void _handleTermHttp(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleTermHttp(pipes, r->state);
+}
+
+static void _handleFileWrite(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleFileWrite(pipes, r->filename, r->data);
+}
+
+static void _handleFileRead(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleFileRead(pipes, r->filename);
+}
+
+static void _handleFileRemove(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleFileRemove(pipes, r->filename);
+}
+
+static void _handleScopes(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleScopes(pipes, r->issuer, r->cert_path);
+}
 
+static void _handleListLoadedAccounts(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleListLoadedAccounts(pipes);
+}
+
+static void _handleLock(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleLock(pipes, r->password, 1);
+}
+
+static void _handleMetrics(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleMetrics(pipes, r->metrics);
+}
+
+static void _handleHealth(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleHealth(pipes, _countDeferredRequests());
+}
+
+static struct ipcPipe profilePipes;
+static unsigned char  profilePending = 0;
+
+static void _answerProfile(void* arg);
+
+/**
+ * @brief starts recording a profile of oidcd; the request is answered by
+ * @c _answerProfile when the profile is due
+ */
+static void _handleProfile(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  if (profiler_start(r->duration ? strToULong(r->duration) : 0,
+                     r->heap ? strToInt(r->heap) : 0) != OIDC_SUCCESS) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  profilePipes   = pipes;
+  profilePending = 1;
+  timerWheel_add(profiler_getEnd(), _answerProfile, NULL);
+}
+
+static void _answerProfile(void* arg) {
+  (void)arg;
+  if (!profilePending) {
+    return;
+  }
+  char* process = agent_state.worker
+                      ? oidc_sprintf("oidcd-%u", agent_state.worker)
+                      : oidc_strcopy("oidcd");
+  char* profile = profiler_stop(process);
+  secFree(process);
+  profilePending = 0;
+  cJSON* json    = generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                      STATUS_SUCCESS, IPC_KEY_INFO,
+                                      cJSON_String, profile ?: "", NULL);
+  secFree(profile);
+  char* res = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(profilePipes, "%s", res);
+  secFree(res);
+}
+
+static void _handleStats(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleStats(pipes);
+}
+
+static void _handleReplicate(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  oidcd_handleReplicate(pipes, r->shortname, r->issuer, r->access_token,
+                        r->expires_at, r->refresh_token);
+}
+
+static void _handleUnlock(
+    struct ipcPipe pipes, const struct oidcd_request* r,
+    const struct arguments* arguments __attribute__((unused))) {
+  if (agent_state.lock_state.locked) {
+    oidcd_handleLock(pipes, r->password, 0);
+    snapshot_markChanged();  // oidcp dropped its copy when it was locked
+    return;
+  }
+  oidc_errno = OIDC_ENOTLOCKED;
+  ipc_writeOidcErrnoToPipe(pipes);
+}
+
+// set while the loaded accounts were handed over and no request followed
+static unsigned char handedOver = 0;
+
+/**
+ * @brief answers with the loaded accounts, so that oidcp can hand them over to
+ * the upgraded agent; see oidcp/upgrade.c
+ * If oidcp closes the pipes afterwards, no snapshot is written.
+ */
+static void _handleUpgrade(
+    struct ipcPipe pipes, const struct oidcd_request* r __attribute__((unused)),
+    const struct arguments* arguments __attribute__((unused))) {
+  cJSON* json = generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                   STATUS_SUCCESS, NULL);
+  jsonAddJSON(json, IPC_KEY_INFO, snapshot_export());
+  char* res = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, "%s", res);
+  secFree(res);
+  handedOver = 1;
+}
+
+/**
+ * All request types handled by oidcd. The table has to be sorted by name (in
+ * @c strcmp order), because it is searched with @c bsearch.
+ */
+static const struct oidcd_requestType requestTypes[] = {
+    {REQUEST_VALUE_ACCESSTOKEN, _handleToken, 0},
+    {REQUEST_VALUE_ADD, _handleAdd, 0},
+    {REQUEST_VALUE_CHECK, _handleCheck, 1},
+    {REQUEST_VALUE_CODEEXCHANGE, _handleCodeExchange, 0},
+    {REQUEST_VALUE_DELETE, _handleDelete, 0},
+    {REQUEST_VALUE_DELETECLIENT, _handleDeleteClient, 0},
+    {REQUEST_VALUE_DEVICELOOKUP, _handleDeviceLookup, 0},
+    {REQUEST_VALUE_DEVICEPOLL, _handleDevicePoll, 0},
+    {REQUEST_VALUE_FILEREAD, _handleFileRead, 0},
+    {REQUEST_VALUE_FILEREMOVE, _handleFileRemove, 0},
+    {REQUEST_VALUE_FILEWRITE, _handleFileWrite, 0},
+    {REQUEST_VALUE_GEN, _handleGen, 0},
+    {REQUEST_VALUE_HEALTH, _handleHealth, 1},
+    {REQUEST_VALUE_IDTOKEN, _handleIdToken, 0},
+    {REQUEST_VALUE_LOADEDACCOUNTS, _handleListLoadedAccounts, 0},
+    {REQUEST_VALUE_LOCK, _handleLock, 0},
+    {REQUEST_VALUE_METRICS, _handleMetrics, 0},
+    {REQUEST_VALUE_PREFETCH, _handlePrefetch, 0},
+    {REQUEST_VALUE_PROFILE, _handleProfile, 1},
+    {REQUEST_VALUE_REGISTER, _handleRegister, 0},
+    {REQUEST_VALUE_REGISTER_BATCH, _handleRegisterBatch, 0},
+    {REQUEST_VALUE_REMOVE, _handleRm, 0},
+    {REQUEST_VALUE_REMOVEALL, _handleRemoveAll, 0},
+    {REQUEST_VALUE_REPLICATE, _handleReplicate, 0},
+    {REQUEST_VALUE_SCOPES, _handleScopes, 0},
+    {REQUEST_VALUE_STATELOOKUP, _handleStateLookUp, 0},
+    {REQUEST_VALUE_STATS, _handleStats, 0},
+    {REQUEST_VALUE_STATUS, _handleStatus, 0},
+    {REQUEST_VALUE_STATUS_JSON, _handleStatusJSON, 0},
+    {REQUEST_VALUE_TERMHTTP, _handleTermHttp, 0},
+    {REQUEST_VALUE_TOKENREJECTED, _handleTokenRejected, 0},
+    {REQUEST_VALUE_UNLOCK, _handleUnlock, 1},
+    {REQUEST_VALUE_UPGRADE, _handleUpgrade, 0},
+    {REQUEST_VALUE_USERINFO, _handleUserinfo, 0},
+    {REQUEST_VALUE_VALIDATE, _handleValidateToken, 0},
+};
+
+static int _compareRequestType(const void* name, const void* type) {
+  return strcmp(name, ((const struct oidcd_requestType*)type)->name);
+}
+
+static const struct oidcd_requestType* _findRequestType(const char* name) {
+  return bsearch(name, requestTypes,
+                 sizeof(requestTypes) / sizeof(*requestTypes),
+                 sizeof(*requestTypes), _compareRequestType);
+}
+
+/**
+ * @brief frees the values of a request
+ * If the request arena is available the values were allocated there and are
+ * released with it; otherwise they are on the heap.
+ */
+static void _releaseRequestValues(struct key_value* pairs, size_t size,
+                                  struct secArena*           arena,
+                                  const struct secArena_mark mark) {
+  if (arena == NULL) {
+    secFreeKeyValuePairs(pairs, size);
+    return;
+  }
+  secArena_release(arena, mark);
+}
+
+/**
+ * @brief logs a request that took longer than @p threshold_ms together with
+ * the time spent in each of its stages
+ * @param start the monotonic time the request was queued for oidcd
+ */
+static void _logSlowRequest(const char* type, const struct oidcd_request* r,
+                            double start, unsigned long threshold_ms) {
+  if (threshold_ms == 0) {
+    return;
+  }
+  requestTrace_mark("oidcd_done");
+  double elapsed_ms = (metrics_now() - start) * 1e3;
+  if (elapsed_ms < threshold_ms) {
+    return;
+  }
+  char* stages = requestTrace_toSummary(start);
+  agent_log(NOTICE, "Slow %s request for '%s' from '%s' took %.3fms: %s",
+            type, r->shortname ?: r->issuer ?: "", r->applicationHint ?: "",
+            elapsed_ms, stages ?: "");
+  secFree(stages);
+}
+
+static void _handleRequest(struct ipcPipe pipes, const char* q,
+                           const struct arguments* arguments) {
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_MINVALID,
+                 IPC_KEY_CONFIG, IPC_KEY_FLOW, IPC_KEY_USECUSTOMSCHEMEURL,
+                 IPC_KEY_REDIRECTEDURI, OIDC_KEY_STATE, IPC_KEY_AUTHORIZATION,
+                 OIDC_KEY_SCOPE, IPC_KEY_DEVICE, IPC_KEY_FROMGEN,
+                 IPC_KEY_LIFETIME, IPC_KEY_PASSWORD, IPC_KEY_APPLICATIONHINT,
+                 IPC_KEY_CONFIRM, IPC_KEY_ISSUERURL, IPC_KEY_NOSCHEME,
+                 IPC_KEY_CERTPATH, IPC_KEY_AUDIENCE, IPC_KEY_ALWAYSALLOWID,
+                 IPC_KEY_FILENAME, IPC_KEY_DATA,
+                 OIDC_KEY_REGISTRATION_CLIENT_URI,
+                 OIDC_KEY_REGISTRATION_ACCESS_TOKEN, IPC_KEY_ONLYAT,
+                 IPC_KEY_METRICS, IPC_KEY_TRACE, IPC_KEY_STALEOK,
+                 IPC_KEY_REVOKE, IPC_KEY_QUEUEDAT, IPC_KEY_DURATION,
+                 IPC_KEY_HEAP, IPC_KEY_DEADLINE, OIDC_KEY_ACCESSTOKEN,
+                 AGENT_KEY_EXPIRESAT, OIDC_KEY_REFRESHTOKEN, IPC_KEY_WHEN,
+                 IPC_KEY_TOKENHASH);
+  // The request values only live until the request is handled, so they are
+  // taken from the request arena and wiped at once afterwards.
+  struct secArena*           arena = requestArena();
+  const struct secArena_mark mark  = secArena_mark(arena);
+  if (CALL_GETJSONVALUES_IN_ARENA(q, arena) < 0) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, oidc_serror());
+    _releaseRequestValues(pairs, sizeof(pairs) / sizeof(*pairs), arena, mark);
+    return;
+  }
+  KEY_VALUE_VARS(request, shortname, minvalid, config, flow, nowebserver,
+                 redirectedUri, state, authorization, scope, device, fromGen,
+                 lifetime, password, applicationHint, confirm, issuer,
+                 noscheme, cert_path, audience, alwaysallowid, filename, data,
+                 registration_client_uri, registration_access_token,
+                 only_at, metrics, trace, stale_ok, revoke,
+                 queued_at, duration, heap, deadline, access_token,
+                 expires_at, refresh_token, when,
+                 token_hash);  // Gives variables for key_value values;
+                         // e.g. _request=pairs[0].value
+  if (_request == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "No request type.");
+    _releaseRequestValues(pairs, sizeof(pairs) / sizeof(*pairs), arena, mark);
+    return;
+  }
+  const struct oidcd_requestType* type = _findRequestType(_request);
+  metrics_inc(METRIC_REQUESTS, type ? type->name : "unknown");
+  if (agent_state.lock_state.locked && (type == NULL || !type->whenLocked)) {
+    oidc_errno = OIDC_ELOCKED;
+    ipc_writeOidcErrnoToPipe(pipes);
+  } else if (_deadline && metrics_now() >= strtod(_deadline, NULL)) {
+    // The client stopped waiting, e.g. while the request was deferred
+    agent_log(DEBUG, "Dropping %s request after its deadline", _request);
+    metrics_inc(METRIC_SHED_REQUESTS, METRIC_LABEL_DEADLINE);
+    oidc_errno = OIDC_ETIMEOUT;
+    ipc_writeOidcErrnoToPipe(pipes);
+  } else if (type == NULL) {  // Unknown request type
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "Unknown request type.");
+  } else {
+    const struct oidcd_request request = {
+        .shortname                 = _shortname,
+        .minvalid                  = _minvalid,
+        .config                    = _config,
+        .flow                      = _flow,
+        .nowebserver               = _nowebserver,
+        .redirectedUri             = _redirectedUri,
+        .state                     = _state,
+        .authorization             = _authorization,
+        .scope                     = _scope,
+        .device                    = _device,
+        .fromGen                   = _fromGen,
+        .lifetime                  = _lifetime,
+        .password                  = _password,
+        .applicationHint           = _applicationHint,
+        .confirm                   = _confirm,
+        .issuer                    = _issuer,
+        .noscheme                  = _noscheme,
+        .cert_path                 = _cert_path,
+        .audience                  = _audience,
+        .alwaysallowid             = _alwaysallowid,
+        .filename                  = _filename,
+        .data                      = _data,
+        .registration_client_uri   = _registration_client_uri,
+        .registration_access_token = _registration_access_token,
+        .only_at                   = _only_at,
+        .metrics                   = _metrics,
+        .stale_ok                  = _stale_ok,
+        .revoke                    = _revoke,
+        .duration                  = _duration,
+        .heap                      = _heap,
+        .access_token              = _access_token,
+        .expires_at                = _expires_at,
+        .refresh_token             = _refresh_token,
+        .when                      = _when,
+        .token_hash                = _token_hash,
+    };
+    const double start = _queued_at ? strtod(_queued_at, NULL) : metrics_now();
+    if (_trace) {
+      requestTrace_start(_trace);
+      requestTrace_mark("oidcd_received");
+    } else if (arguments->slow_request_ms) {
+      requestTrace_startLocal();
+      requestTrace_markAt("oidcp_queued", start);
+      requestTrace_mark("oidcd_received");
+    }
+    accounts_setTenant(_tenantOf(q));
+    handedOver          = 0;
+    const char* prevTag = loopLag_setTag(type->name);
+    type->handle(pipes, &request, arguments);
+    loopLag_setTag(prevTag);  // requests can be handled while handling one
+    accounts_setTenant(0);
+    _logSlowRequest(type->name, &request, start, arguments->slow_request_ms);
+    requestTrace_stop();
+  }
+  _releaseRequestValues(pairs, sizeof(pairs) / sizeof(*pairs), arena, mark);
+}
+
+/**
+ * @brief removes auth code flows that were started but never received the
+ * redirect; their http servers are stopped as well
+ */
+static void _removeExpiredCodeExchanges() {
+  struct codeExchangeEntry* cee = NULL;
+  while ((cee = codeVerifierDB_getDeathEntry((deathFunction)cee_getDeath)) !=
+         NULL) {
+    agent_log(DEBUG, "Auth code flow for state '%s' expired", cee->state);
+    termHttpServer(cee->state);
+    secFreeCodeExchangeContent(cee);
+    codeVerifierDB_removeIfFound(cee);
+  }
+}
+
+static volatile sig_atomic_t waiting     = 0;
+static volatile sig_atomic_t terminating = 0;
+static pid_t                 oidcd_pid   = 0;
+
+/**
+ * @brief writes the snapshot before terminating
+ * The snapshot is only written directly if the signal arrived while waiting
+ * for requests; otherwise this is deferred until the current request was
+ * handled. Children forked by oidcd inherit the handler but do not write.
+ */
+static void _handleTerm(int sig) {
+  if (getpid() == oidcd_pid) {
+    if (!waiting && !terminating) {
+      terminating = sig;
+      return;
+    }
+    snapshot_save();
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/**
+ * @brief keeps the deadlines when the wall clock was set and spreads the
+ * background refreshes after a resume; see utils/clockWatch.c
+ */
+static void _checkClock() {
+  struct clockJump jump = clockWatch_check();
+  if (jump.step) {
+    timerWheel_shift(jump.step);
+    tokenIndex_shift(jump.step);
+    shiftAccountDeaths(jump.step);
+  }
+  if (jump.suspended) {
+    prefetch_staggerAfterResume();
+  }
+}
+
+/**
+ * @brief creates the databases of oidcd; also used by liboidc-agent-core
+ */
+void oidcd_initDBs() {
   codeVerifierDB_new();
   codeVerifierDB_setFreeFunction((freeFunction)_secFree);
   codeVerifierDB_setMatchFunction((matchFunction)cee_matchByState);
+  codeVerifierDB_addIndex(CODEVERIFIERDB_INDEX_STATE,
+                          (indexKeyFunction)cee_getState, matchStrings);
+  codeVerifierDB_setDeathFunction((deathFunction)cee_getDeath);
 
   accountDB_new();
   accountDB_setFreeFunction((freeFunction)_secFreeAccount);
-  accountDB_setMatchFunction((matchFunction)account_matchByName);
+  accountDB_setMatchFunction((matchFunction)account_matchByNameOfTenant);
+  accountDB_addIndex(ACCOUNTDB_INDEX_SHORTNAME,
+                     (indexKeyFunction)account_getName, matchStrings);
+  accountDB_addIndex(ACCOUNTDB_INDEX_ISSUERURL,
+                     (indexKeyFunction)account_getIssuerUrl, matchUrls);
+  accountDB_setDeathFunction((deathFunction)account_getDeath);
 
   fileDB_new();
+  issuerConfigDB_new();
+}
+
+int oidcd_main(struct ipcPipe pipes, const struct arguments* arguments) {
+  logger_open("oidc-agent.d");
+  metrics_setPrefix("oidcd");
+  timerWheel_clear();  // the timers and the timerfd belong to oidcp
+  if (httpWorker_start() != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not start http worker: %s", oidc_serror());
+  }
+  initCrypt();
+  initMemoryCrypt();
+  issuer_enableInterning();
+
+  oidcd_initDBs();
+
+  oidcd_pipes     = pipes;
+  oidcd_arguments = arguments;
+  ipc_setForeignTaggedMessageHandler(_handleConcurrentRequest);
+  httpWorker_setWaitCallback(pipes.rx, _readConcurrentRequest);
+
+  const unsigned char upgraded = agent_state.handover != NULL;
+  if (upgraded) {
+    snapshot_import(agent_state.handover);
+    agent_state.handover = NULL;  // owned by oidcp
+  }
+  if (arguments->snapshot) {
+    if (!upgraded) {  // the handed over accounts are newer
+      snapshot_restore();
+    }
+    oidcd_pid = getpid();
+    signal(SIGTERM, _handleTerm);
+    signal(SIGINT, _handleTerm);
+  }
+
+  if (arguments->memory_stats) {
+    secMemStats_enable();
+  }
+  if (arguments->warmup) {
+    warmup_enable();
+  }
+  idleEviction_start(arguments->evict_idle);
+  memoryPressure_start();
+  refreshKeepalive_start(arguments->refresh_keepalive,
+                         ipc_tagPipe(pipes, IPC_TAG_INTERNAL));
+  issuerRateLimit_set(arguments->issuer_qps, arguments->issuer_burst);
+  if (arguments->slow_request_ms) {
+    loopLag_setThreshold(arguments->slow_request_ms);
+  }
 
   time_t minDeath = 0;
 
   while (1) {
-    minDeath = getMinAccountDeath();
-    char* q  = ipc_readFromPipeWithTimeout(pipes, minDeath);
+    if (terminating) {
+      _handleTerm(terminating);
+    }
+    loopLag_setTag("timers");
+    _checkClock();
+    // Run on every iteration, so a busy agent does not starve the timers
+    timerWheel_runDue(time(NULL));
+    snapshot_pushIfChanged(pipes);
+    unsigned long tag = 0;
+    char*         q   = _popDeferredRequest(&tag);
+    if (q == NULL) {
+      minDeath            = getMinAccountDeath();
+      time_t nextPrefetch = prefetch_getNextTime(arguments->prefetch);
+      if (nextPrefetch && (minDeath == 0 || nextPrefetch < minDeath)) {
+        minDeath = nextPrefetch;
+      }
+      time_t nextHint = prefetchHints_getNextTime();
+      if (nextHint && (minDeath == 0 || nextHint < minDeath)) {
+        minDeath = nextHint;
+      }
+      time_t nextValidation = addValidation_getNextTime();
+      if (nextValidation && (minDeath == 0 || nextValidation < minDeath)) {
+        minDeath = nextValidation;
+      }
+      time_t nextCodeExchangeDeath =
+          codeVerifierDB_getMinDeath((deathFunction)cee_getDeath);
+      if (nextCodeExchangeDeath &&
+          (minDeath == 0 || nextCodeExchangeDeath < minDeath)) {
+        minDeath = nextCodeExchangeDeath;
+      }
+      time_t nextTimer = timerWheel_getNextTime();
+      if (nextTimer && (minDeath == 0 || nextTimer < minDeath)) {
+        minDeath = nextTimer;
+      }
+      waiting = 1;
+      loopLag_beforeWait(minDeath);
+      q = ipc_readTaggedFromPipeWithTimeout(pipes, minDeath, &tag);
+      loopLag_afterWait();
+      waiting = 0;
+    }
     if (q == NULL) {
       if (oidc_errno == OIDC_ETIMEOUT) {
+        loopLag_setTag("timeout");
+        _checkClock();
         struct oidc_account* death = NULL;
         while ((death = getDeathAccount()) != NULL) {
+          accountStats_remove(account_getName(death));
           accountDB_removeIfFound(death);
         }
+        _removeExpiredCodeExchanges();
+        loopLag_setTag("prefetch");
+        prefetch_refreshDueTokens(ipc_tagPipe(pipes, IPC_TAG_INTERNAL),
+                                  arguments->prefetch);
+        prefetchHints_runDue(ipc_tagPipe(pipes, IPC_TAG_INTERNAL));
+        loopLag_setTag("add_validation");
+        addValidation_runNext(ipc_tagPipe(pipes, IPC_TAG_INTERNAL));
+        loopLag_setTag("timers");
+        timerWheel_runDue(time(NULL));
+        _answerDeferredRequestsFromCache();
+        hotTokens_revalidate(pipes);
         continue;
       }  // A real error and no timeout
       agent_log(ERROR, "%s", oidc_serror());
-      if (oidc_errno == OIDC_EIPCDIS) {
+      if (oidc_errno == OIDC_EIPCDIS || oidc_errno == OIDC_EIPCTAG) {
+        // Without a tag the error cannot be communicated back
+        if (handedOver && oidc_errno == OIDC_EIPCDIS) {
+          exit(EXIT_SUCCESS);  // the upgraded agent took over the accounts
+        }
+        if (arguments->snapshot && oidc_errno == OIDC_EIPCDIS) {
+          snapshot_save();  // oidcp is gone, we might not get a SIGTERM
+        }
         exit(EXIT_FAILURE);
       }
-      if (ipc_writeOidcErrnoToPipe(pipes) ==
-          OIDC_SUCCESS) {  // Try to communicate the error back
-        continue;
-      }
-      exit(EXIT_FAILURE);
-    }
-    INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_MINVALID,
-                   IPC_KEY_CONFIG, IPC_KEY_FLOW, IPC_KEY_USECUSTOMSCHEMEURL,
-                   IPC_KEY_REDIRECTEDURI, OIDC_KEY_STATE, IPC_KEY_AUTHORIZATION,
-                   OIDC_KEY_SCOPE, IPC_KEY_DEVICE, IPC_KEY_FROMGEN,
-                   IPC_KEY_LIFETIME, IPC_KEY_PASSWORD, IPC_KEY_APPLICATIONHINT,
-                   IPC_KEY_CONFIRM, IPC_KEY_ISSUERURL, IPC_KEY_NOSCHEME,
-                   IPC_KEY_CERTPATH, IPC_KEY_AUDIENCE, IPC_KEY_ALWAYSALLOWID,
-                   IPC_KEY_FILENAME, IPC_KEY_DATA,
-                   OIDC_KEY_REGISTRATION_CLIENT_URI,
-                   OIDC_KEY_REGISTRATION_ACCESS_TOKEN, IPC_KEY_ONLYAT);
-    if (getJSONValuesFromString(q, pairs, sizeof(pairs) / sizeof(*pairs)) < 0) {
-      ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, oidc_serror());
-      secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
-      secFree(q);
-      continue;
-    }
-    secFree(q);
-    KEY_VALUE_VARS(request, shortname, minvalid, config, flow, nowebserver,
-                   redirectedUri, state, authorization, scope, device, fromGen,
-                   lifetime, password, applicationHint, confirm, issuer,
-                   noscheme, cert_path, audience, alwaysallowid, filename, data,
-                   registration_client_uri, registration_access_token,
-                   only_at);  // Gives variables for key_value values;
-                              // e.g. _request=pairs[0].value
-    if (_request == NULL) {
-      ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "No request type.");
-      secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
-      continue;
-    }
-
-    if (strequal(_request, REQUEST_VALUE_CHECK)) {  // Allow check in all cases
-      ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
-      secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
       continue;
     }
-    if (agent_state.lock_state.locked) {  // If locked allow only unlock
-      if (strequal(_request, REQUEST_VALUE_UNLOCK)) {
-        oidcd_handleLock(pipes, _password, 0);
-      } else {
-        oidc_errno = OIDC_ELOCKED;
-        ipc_writeOidcErrnoToPipe(pipes);
-      }
-      secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+    if (tag == IPC_TAG_NOTIFY) {
+      loopLag_setTag("notification");
+      oidcd_handleNotification(q);
+      secFree(q);
+      rtPool_applyQueued();
+      hotTokens_revalidate(pipes);
       continue;
     }
-    if (strequal(_request, REQUEST_VALUE_GEN)) {
-      oidcd_handleGen(pipes, _config, _flow, _nowebserver, _noscheme, _only_at,
-                      arguments);
-    } else if (strequal(_request, REQUEST_VALUE_CODEEXCHANGE)) {
-      oidcd_handleCodeExchange(pipes, _redirectedUri, _fromGen);
-    } else if (strequal(_request, REQUEST_VALUE_STATELOOKUP)) {
-      oidcd_handleStateLookUp(pipes, _state);
-    } else if (strequal(_request, REQUEST_VALUE_DEVICELOOKUP)) {
-      oidcd_handleDeviceLookup(pipes, _config, _device, _only_at);
-    } else if (strequal(_request, REQUEST_VALUE_ADD)) {
-      oidcd_handleAdd(pipes, _config, _lifetime, _confirm, _alwaysallowid);
-    } else if (strequal(_request, REQUEST_VALUE_REMOVE)) {
-      oidcd_handleRm(pipes, _shortname);
-    } else if (strequal(_request, REQUEST_VALUE_REMOVEALL)) {
-      oidcd_handleRemoveAll(pipes);
-    } else if (strequal(_request, REQUEST_VALUE_DELETE)) {
-      oidcd_handleDelete(pipes, _config);
-    } else if (strequal(_request, REQUEST_VALUE_DELETECLIENT)) {
-      oidcd_handleDeleteClient(pipes, _registration_client_uri,
-                               _registration_access_token, _cert_path);
-    } else if (strequal(_request, REQUEST_VALUE_STATUS)) {
-      oidcd_handleAgentStatus(pipes, arguments);
-    } else if (strequal(_request, REQUEST_VALUE_STATUS_JSON)) {
-      oidcd_handleAgentStatusJSON(pipes, arguments);
-    } else if (strequal(_request, REQUEST_VALUE_ACCESSTOKEN)) {
-      if (_shortname) {
-        oidcd_handleToken(pipes, _shortname, _minvalid, _scope,
-                          _applicationHint, _audience, arguments);
-      } else if (_issuer) {
-        oidcd_handleTokenIssuer(pipes, _issuer, _minvalid, _scope,
-                                _applicationHint, _audience, arguments);
-      } else {
-        // global default
-        oidc_errno = OIDC_NOTIMPL;  // TODO
-        ipc_writeOidcErrnoToPipe(pipes);
-      }
-    } else if (strequal(_request, REQUEST_VALUE_IDTOKEN)) {
-      if (_shortname || _issuer) {
-        oidcd_handleIdToken(pipes, _shortname, _issuer, _scope,
-                            _applicationHint, arguments);
-      } else {
-        // global default
-        oidc_errno = OIDC_NOTIMPL;  // TODO
-        ipc_writeOidcErrnoToPipe(pipes);
-      }
-    } else if (strequal(_request, REQUEST_VALUE_REGISTER)) {
-      oidcd_handleRegister(pipes, _config, _flow, _authorization);
-    } else if (strequal(_request, REQUEST_VALUE_TERMHTTP)) {
-      oidcd_handleTermHttp(pipes, _state);
-    } else if (strequal(_request, REQUEST_VALUE_FILEWRITE)) {
-      oidcd_handleFileWrite(pipes, _filename, _data);
-    } else if (strequal(_request, REQUEST_VALUE_FILEREAD)) {
-      oidcd_handleFileRead(pipes, _filename);
-    } else if (strequal(_request, REQUEST_VALUE_FILEREMOVE)) {
-      oidcd_handleFileRemove(pipes, _filename);
-    } else if (strequal(_request, REQUEST_VALUE_SCOPES)) {
-      oidcd_handleScopes(pipes, _issuer, _cert_path);
-    } else if (strequal(_request, REQUEST_VALUE_LOADEDACCOUNTS)) {
-      oidcd_handleListLoadedAccounts(pipes);
-    } else if (strequal(_request, REQUEST_VALUE_LOCK)) {
-      oidcd_handleLock(pipes, _password, 1);
-    } else if (strequal(_request, REQUEST_VALUE_UNLOCK)) {
-      oidc_errno = OIDC_ENOTLOCKED;
-      ipc_writeOidcErrnoToPipe(pipes);
-    } else {  // Unknown request type
-      ipc_writeToPipe(pipes, RESPONSE_BADREQUEST, "Unknown request type.");
+    OIDC_PROBE2(oidcd_request_receive, tag, q);
+    struct ipcPipe taggedPipes = ipc_tagPipe(pipes, tag);
+    accounts_setTenant(_tenantOf(q));
+    loopLag_setTag("token_cache");
+    const int fromCache = oidcd_handleTokenFromCache(taggedPipes, q, arguments);
+    accounts_setTenant(0);
+    if (!fromCache) {
+      _handleRequest(taggedPipes, q, arguments);
+      rtPool_applyQueued();  // notified while the request was handled
+      _answerDeferredRequestsFromCache();
+      hotTokens_revalidate(pipes);
     }
-    secFreeKeyValuePairs(pairs, sizeof(pairs) / sizeof(*pairs));
+    OIDC_PROBE1(oidcd_request_done, tag);
+    secFree(q);
   }
   return EXIT_FAILURE;
 }
@@ -4,6 +4,7 @@
 #include "ipc/pipe.h"
 #include "oidc-agent/oidc-agent_options.h"
 
-int oidcd_main(struct ipcPipe, const struct arguments*);
+int  oidcd_main(struct ipcPipe, const struct arguments*);
+void oidcd_initDBs();
 
 #endif  // OIDC_DAEMON_H
@@ -1,12 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
 #include "oidcd_handler.h"
+#include "account/accountCodec.h"
+#include "account/issuer_helper.h"
+#include "account/tokenCache.h"
 
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
+#include "defines/settings.h"
 #include "defines/version.h"
 #include "ipc/pipe.h"
 #include "ipc/serveripc.h"
 #include "oidc-agent/agent_state.h"
+#include "oidc-agent/http/http_transport.h"
+#include "oidc-agent/http/http_worker.h"
 #include "oidc-agent/httpserver/startHttpserver.h"
 #include "oidc-agent/httpserver/termHttpserver.h"
 #include "oidc-agent/oidc/device_code.h"
@@ -17,8 +24,25 @@
 #include "oidc-agent/oidc/flows/openid_config.h"
 #include "oidc-agent/oidc/flows/registration.h"
 #include "oidc-agent/oidc/flows/revoke.h"
+#include "oidc-agent/oidc/flows/userinfo.h"
+#include "oidc-agent/oidc/issuerHealth.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/addValidation.h"
 #include "oidc-agent/oidcd/codeExchangeEntry.h"
+#include "oidc-agent/oidcd/devicePoll.h"
+#include "oidc-agent/oidcd/hotTokens.h"
+#include "oidc-agent/oidcd/idleEviction.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
+#include "oidc-agent/oidcd/issuerChoice.h"
 #include "oidc-agent/oidcd/parse_internal.h"
+#include "oidc-agent/oidcd/prefetch.h"
+#include "oidc-agent/oidcd/prefetchHints.h"
+#include "oidc-agent/oidcd/refreshTokenPool.h"
+#include "oidc-agent/oidcd/revocationQueue.h"
+#include "oidc-agent/oidcd/tokenPredictor.h"
+#include "oidc-agent/oidcd/tokenValidation.h"
+#include "oidc-agent/oidcd/userinfoCache.h"
+#include "oidc-agent/oidcd/warmup.h"
 #include "utils/accountUtils.h"
 #include "utils/agentLogger.h"
 #include "utils/crypt/crypt.h"
@@ -26,15 +50,24 @@
 #include "utils/db/account_db.h"
 #include "utils/db/codeVerifier_db.h"
 #include "utils/db/file_db.h"
+#include "utils/file_io/file_io.h"
 #include "utils/json.h"
+#include "utils/key_value.h"
 #include "utils/listUtils.h"
+#include "utils/lazyLib.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/negativeCache.h"
 #include "utils/parseJson.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
 #include "utils/uriUtils.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
 
 void initAuthCodeFlow(struct oidc_account* account, struct ipcPipe pipes,
                       const char* info, const char* nowebserver_str,
@@ -93,6 +126,61 @@ char* removeScope(char* scopes, char* rem) {
   return scopes;
 }
 
+/**
+ * @brief writes the response to an access token request
+ * If the request is traced for the client, the trace is added to the response.
+ * Otherwise the response is written in parts, so that the token is not
+ * formatted into and copied with the response.
+ */
+static void _writeAccessTokenResponse(struct ipcPipe pipes,
+                                      const char*    access_token,
+                                      const char*    issuer,
+                                      unsigned long  expires_at) {
+  if (!requestTrace_isForClient()) {
+    char expires[24];
+    int  expires_len = snprintf(expires, sizeof(expires), "%lu", expires_at);
+    issuer           = issuer ?: "";
+    const struct iovec parts[] = {
+        {RESPONSE_ACCESS_PART_STATUS STATUS_SUCCESS
+             RESPONSE_ACCESS_PART_ACCESSTOKEN,
+         sizeof(RESPONSE_ACCESS_PART_STATUS STATUS_SUCCESS
+                    RESPONSE_ACCESS_PART_ACCESSTOKEN) -
+             1},
+        {(char*)access_token, strlen(access_token)},
+        {RESPONSE_ACCESS_PART_ISSUER, sizeof(RESPONSE_ACCESS_PART_ISSUER) - 1},
+        {(char*)issuer, strlen(issuer)},
+        {RESPONSE_ACCESS_PART_EXPIRESAT,
+         sizeof(RESPONSE_ACCESS_PART_EXPIRESAT) - 1},
+        {expires, expires_len},
+        {RESPONSE_ACCESS_PART_END, sizeof(RESPONSE_ACCESS_PART_END) - 1},
+    };
+    ipc_writePartsToPipe(pipes, parts, sizeof(parts) / sizeof(*parts));
+    return;
+  }
+  requestTrace_mark("oidcd_respond");
+  char* res    = oidc_sprintf(RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
+                              access_token, issuer, expires_at);
+  char* traced = requestTrace_attachToMessage(res);
+  ipc_writeToPipe(pipes, "%s", traced ?: res);
+  secFree(traced);
+  secFree(res);
+}
+
+/**
+ * @brief returns the config of a generated account with its refresh token pool
+ * filled
+ * The loaded account does not keep the pool; its lanes are set up when the
+ * account is loaded the next time.
+ * @return a pointer to the json string; has to be freed after usage
+ */
+static char* _generatedConfig(struct ipcPipe       pipes,
+                              struct oidc_account* account) {
+  rtPool_fill(pipes, account, 0);
+  char* json = accountToJSONStringUnformatted(account);
+  account_setRefreshTokenPool(account, NULL);
+  return json;
+}
+
 void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
                      const char* flow, const char* nowebserver_str,
                      const char* noscheme_str, const char* only_at_str,
@@ -131,12 +219,11 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
                                                pipes)) != NULL) {
         success = 1;
         if (only_at) {
-          account_setAccessToken(
-              account,
-              at);  // if only_at store the AT so we can send it back, we have
-                    // to store it manually because we provided manual scopes
-                    // (because offline_access removed). The token will be
-                    // correctly freed at the end when the account is freed.
+          // if only_at store the AT so we can send it back, we have to store
+          // it manually because we provided manual scopes (because
+          // offline_access removed). The returned token is owned by the
+          // account's token cache, so we store a copy.
+          account_setAccessToken(account, oidc_strcopy(at));
         }
         break;
       } else if (flows->len == 1) {
@@ -217,15 +304,14 @@ void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
   account_setUsername(account, NULL);
   account_setPassword(account, NULL);
   if (success && account_refreshTokenIsValid(account) && !only_at) {
-    char* json = accountToJSONString(account);
+    char* json = _generatedConfig(pipes, account);
     ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
     secFree(json);
     db_addAccountEncrypted(account);
   } else if (success && only_at && strValid(account_getAccessToken(account))) {
-    ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
-                    account_getAccessToken(account),
-                    account_getIssuerUrl(account),
-                    account_getTokenExpiresAt(account));
+    _writeAccessTokenResponse(pipes, account_getAccessToken(account),
+                              account_getIssuerUrl(account),
+                              account_getTokenExpiresAt(account));
     secFreeAccount(account);
   } else {
     ipc_writeToPipe(pipes, RESPONSE_ERROR,
@@ -255,13 +341,27 @@ oidc_error_t addAccount(struct ipcPipe pipes, struct oidc_account* account) {
                                      pipes) == NULL) {
     return oidc_errno;
   }
+  rtPool_fill(pipes, account, 1);
+  rtPool_handOver(pipes, account);
   db_addAccountEncrypted(account);
+  accountStats_recordLoad(account_getName(account));
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief loads an account without contacting the provider; it is validated
+ * later with @c addValidation
+ */
+static void _addAccountUnvalidated(struct oidc_account* account) {
+  db_addAccountEncrypted(account);
+  accountStats_recordLoad(account_getName(account));
+  addValidation_schedule(account_getName(account));
+}
+
 void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
                      const char* timeout_str, const char* confirm_str,
-                     const char* alwaysallowid) {
+                     const char* alwaysallowid,
+                     const struct arguments* arguments) {
   agent_log(DEBUG, "Handle Add request");
   struct oidc_account* account = getAccountFromJSON(account_json);
   if (account == NULL) {
@@ -281,6 +381,7 @@ void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
   if ((found = db_getAccountDecrypted(account)) != NULL) {
     if (account_getDeath(found) != account_getDeath(account)) {
       account_setDeath(found, account_getDeath(account));
+      accountDB_updateDeath(found);
       char* msg = oidc_sprintf(
           "account already loaded. Lifetime set to %lu seconds.", timeout ?: 0);
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, msg);
@@ -292,12 +393,15 @@ void oidcd_handleAdd(struct ipcPipe pipes, const char* account_json,
     secFreeAccount(account);
     return;
   }
-  if (addAccount(pipes, account) != OIDC_SUCCESS) {
+  if (arguments->async_validate) {
+    _addAccountUnvalidated(account);
+  } else if (addAccount(pipes, account) != OIDC_SUCCESS) {
     secFreeAccount(account);
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
   agent_log(DEBUG, "Loaded Account. Used timeout of %lu", timeout);
+  warmup_schedule();
   if (timeout > 0) {
     char* msg = oidc_sprintf("Lifetime set to %lu seconds", timeout);
     ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, msg);
@@ -341,6 +445,8 @@ void oidcd_handleDelete(struct ipcPipe pipes, const char* account_json) {
     return;
   }
   accountDB_removeIfFound(account);
+  accountStats_remove(account_getName(account));
+  idleEviction_forget(account_getName(account));
   secFreeAccount(account);
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
@@ -356,36 +462,89 @@ void oidcd_handleRm(struct ipcPipe pipes, char* account_name) {
   agent_log(DEBUG, "Handle Remove request for config '%s'", account_name);
   struct oidc_account key = {.shortname = account_name};
   if (accountDB_findValue(&key) == NULL) {
+    if (idleEviction_find(account_name)) {
+      idleEviction_forget(account_name);
+      accountStats_remove(account_name);
+      ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
+      return;
+    }
     ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
     return;
   }
   accountDB_removeIfFound(&key);
+  accountStats_remove(account_name);
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
 
-void oidcd_handleRemoveAll(struct ipcPipe pipes) {
+/**
+ * @brief removes all loaded accounts
+ * If @p revoke is set, their refresh tokens are revoked in the background; the
+ * accounts are removed immediately.
+ */
+void oidcd_handleRemoveAll(struct ipcPipe pipes, const char* revoke) {
+  const vector_t* accounts = accountDB_getList();
+  if (agent_state.multi_user) {  // only the accounts of the tenant
+    list_t* removed = list_new();
+    for (size_t i = 0; accounts && i < accounts->len; i++) {
+      if (account_isOfTenant(vector_at(accounts, i))) {
+        list_rpush(removed, list_node_new(vector_at(accounts, i)));
+      }
+    }
+    list_node_t* node;
+    while ((node = list_lpop(removed))) {
+      struct oidc_account* account = node->val;
+      LIST_FREE(node);
+      accountStats_remove(account_getName(account));
+      if (strToInt(revoke)) {
+        revocationQueue_add(_db_decryptFoundAccount(account));
+      }
+      accountDB_removeIfFound(account);
+    }
+    list_destroy(removed);
+    revocationQueue_run();
+    ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
+    return;
+  }
+  if (strToInt(revoke) && accounts != NULL) {
+    for (size_t i = 0; i < accounts->len; i++) {
+      revocationQueue_add(_db_decryptFoundAccount(vector_at(accounts, i)));
+    }
+  }
   accountDB_reset();
+  accountStats_clear();
+  tokenPredictor_clear();
+  prefetchHints_clear();
+  idleEviction_clear();
+  revocationQueue_run();
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
 
+// set while oidcd waits for the user to answer a prompt of oidcp
+static unsigned char promptOutstanding = 0;
+
 oidc_error_t oidcd_autoload(struct ipcPipe pipes, const char* short_name,
                             const char* issuer, const char* application_hint) {
   agent_log(DEBUG, "Send autoload request for '%s'", short_name);
+  promptOutstanding = 1;
   char* res =
       issuer ? ipc_communicateThroughPipe(
                    pipes, INT_REQUEST_AUTOLOAD_WITH_ISSUER, short_name, issuer,
                    application_hint ?: "")
              : ipc_communicateThroughPipe(pipes, INT_REQUEST_AUTOLOAD,
                                           short_name, application_hint ?: "");
+  promptOutstanding = 0;
   if (res == NULL) {
     return oidc_errno;
   }
-  char* config = parseForConfig(res);
-  if (config == NULL) {
+  char* data = parseForAccountData(res);
+  if (data == NULL) {
+    return oidc_errno;
+  }
+  struct oidc_account* account = getAccountFromCompactString(data);
+  secFree(data);
+  if (account == NULL) {
     return oidc_errno;
   }
-  struct oidc_account* account = getAccountFromJSON(config);
-  secFree(config);
   account_setDeath(account, agent_state.defaultTimeout
                                 ? time(NULL) + agent_state.defaultTimeout
                                 : 0);
@@ -401,7 +560,8 @@ oidc_error_t oidcd_autoload(struct ipcPipe pipes, const char* short_name,
 
 oidc_error_t _oidcd_getConfirmation(unsigned char mode, struct ipcPipe pipes,
                                     const char* short_name, const char* issuer,
-                                    const char* application_hint) {
+                                    const char* application_hint,
+                                    const char* scope) {
   agent_log(DEBUG, "Send confirm request for '%s'", short_name);
   const char* request_type = NULL;
   switch (mode) {
@@ -410,12 +570,15 @@ oidc_error_t _oidcd_getConfirmation(unsigned char mode, struct ipcPipe pipes,
       request_type = INT_REQUEST_VALUE_CONFIRMIDTOKEN;
       break;
   }
-  char* res = issuer ? ipc_communicateThroughPipe(
-                           pipes, INT_REQUEST_CONFIRM_WITH_ISSUER, request_type,
-                           issuer, short_name, application_hint ?: "")
-                     : ipc_communicateThroughPipe(pipes, INT_REQUEST_CONFIRM,
-                                                  request_type, short_name,
-                                                  application_hint ?: "");
+  promptOutstanding = 1;
+  char* res =
+      issuer ? ipc_communicateThroughPipe(
+                   pipes, INT_REQUEST_CONFIRM_WITH_ISSUER, request_type, issuer,
+                   short_name, application_hint ?: "", scope ?: "")
+             : ipc_communicateThroughPipe(pipes, INT_REQUEST_CONFIRM,
+                                          request_type, short_name,
+                                          application_hint ?: "", scope ?: "");
+  promptOutstanding = 0;
   if (res == NULL) {
     return oidc_errno;
   }
@@ -425,17 +588,19 @@ oidc_error_t _oidcd_getConfirmation(unsigned char mode, struct ipcPipe pipes,
 
 oidc_error_t oidcd_getConfirmation(struct ipcPipe pipes, const char* short_name,
                                    const char* issuer,
-                                   const char* application_hint) {
+                                   const char* application_hint,
+                                   const char* scope) {
   return _oidcd_getConfirmation(CONFIRMATION_MODE_AT, pipes, short_name, issuer,
-                                application_hint);
+                                application_hint, scope);
 }
 
 oidc_error_t oidcd_getIdTokenConfirmation(struct ipcPipe pipes,
                                           const char*    short_name,
                                           const char*    issuer,
-                                          const char*    application_hint) {
+                                          const char*    application_hint,
+                                          const char*    scope) {
   return _oidcd_getConfirmation(CONFIRMATION_MODE_ID, pipes, short_name, issuer,
-                                application_hint);
+                                application_hint, scope);
 }
 
 char* oidcd_queryDefaultAccountIssuer(struct ipcPipe pipes,
@@ -456,22 +621,82 @@ char* oidcd_queryDefaultAccountIssuer(struct ipcPipe pipes,
   return shortname;
 }
 
-struct oidc_account* _getLoadedUnencryptedAccount(
+/**
+ * @brief loads an account again that was evicted because it was idle
+ * The config is decrypted with the password stored in oidcp, if there is one;
+ * otherwise the user is prompted as for an autoload. The account gets the
+ * lifetime and the flags it had before it was evicted.
+ */
+static oidc_error_t _restoreIdleAccount(struct ipcPipe pipes,
+                                        const char*    short_name,
+                                        const char*    application_hint) {
+  agent_log(DEBUG, "Restoring idle account '%s'", short_name);
+  char* res =
+      ipc_communicateThroughPipe(pipes, INT_REQUEST_RELOAD, short_name);
+  char* data = res ? parseForAccountData(res) : NULL;
+  struct oidc_account* account =
+      data ? getAccountFromCompactString(data) : NULL;
+  secFree(data);
+  oidc_error_t err;
+  if (account == NULL) {  // no stored password
+    err = oidcd_autoload(pipes, short_name, NULL, application_hint);
+  } else if ((err = addAccount(pipes, account)) != OIDC_SUCCESS) {
+    secFreeAccount(account);
+  }
+  if (err != OIDC_SUCCESS) {
+    return err;
+  }
+  struct oidc_account*         loaded = db_findAccountByShortname(short_name);
+  const struct evictedAccount* e      = idleEviction_find(short_name);
+  if (loaded && e) {
+    account_setDeath(loaded, e->death);
+    accountDB_updateDeath(loaded);
+    if (e->confirm) {
+      account_setConfirmationRequired(loaded);
+    }
+    if (e->always_allow_id) {
+      account_setAlwaysAllowId(loaded);
+    }
+  }
+  idleEviction_forget(short_name);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns a loaded account, autoloading it if needed
+ * The sensitive information of the account is still memory encrypted; use
+ * @c _db_decryptFoundAccount when it is needed.
+ */
+static struct oidc_account* _getLoadedAccount(
     struct ipcPipe pipes, const char* short_name, const char* application_hint,
     const struct arguments* arguments) {
-  struct oidc_account* account = db_getAccountDecryptedByShortname(short_name);
+  addValidation_runFor(pipes, short_name);
+  if (addValidation_takeFailure(short_name) != OIDC_SUCCESS) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return NULL;
+  }
+  struct oidc_account* account = db_findAccountByShortname(short_name);
   if (account) {
     return account;
   }
-  if (arguments->no_autoload) {
+  oidc_error_t autoload_error;
+  if (idleEviction_find(short_name)) {
+    autoload_error = _restoreIdleAccount(pipes, short_name, application_hint);
+  } else if (arguments->no_autoload) {
     ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
     return NULL;
+  } else if (negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, short_name)) {
+    autoload_error = OIDC_ENOACCOUNT;
+    oidc_errno     = autoload_error;
+  } else {
+    autoload_error = oidcd_autoload(pipes, short_name, NULL, application_hint);
+    if (autoload_error == OIDC_ENOACCOUNT) {
+      negativeCache_add(NEGATIVE_CACHE_ACCOUNT, short_name);
+    }
   }
-  oidc_error_t autoload_error =
-      oidcd_autoload(pipes, short_name, NULL, application_hint);
   switch (autoload_error) {
     case OIDC_SUCCESS:
-      account = db_getAccountDecryptedByShortname(short_name);
+      account = db_findAccountByShortname(short_name);
       if (account == NULL) {
         ipc_writeOidcErrnoToPipe(pipes);
       }
@@ -483,18 +708,51 @@ struct oidc_account* _getLoadedUnencryptedAccount(
   }
 }
 
+struct oidc_account* _getLoadedUnencryptedAccount(
+    struct ipcPipe pipes, const char* short_name, const char* application_hint,
+    const struct arguments* arguments) {
+  return _db_decryptFoundAccount(
+      _getLoadedAccount(pipes, short_name, application_hint, arguments));
+}
+
 struct oidc_account* _getLoadedUnencryptedAccountForIssuer(
     struct ipcPipe pipes, const char* issuer, const char* application_hint,
-    const struct arguments* arguments) {
+    const char* scope, const struct arguments* arguments) {
+  if (addValidation_runForIssuer(pipes, issuer) != OIDC_SUCCESS &&
+      accountDB_findValueByIndex(ACCOUNTDB_INDEX_ISSUERURL, issuer) == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);  // the only account failed
+    return NULL;
+  }
   struct oidc_account* account  = NULL;
-  list_t*              accounts = db_findAccountsByIssuerUrl(issuer);
-  if (accounts == NULL) {  // no accounts loaded for this issuer
+  struct oidc_account* chosen   = issuerChoice_find(issuer);
+  list_t* accounts = chosen ? NULL : db_findAccountsByIssuerUrl(issuer);
+  const struct evictedAccount* idle =
+      chosen || accounts ? NULL : idleEviction_findByIssuer(issuer);
+  if (chosen) {  // resolved before for the same loaded accounts
+    account = _db_decryptFoundAccount(chosen);
+  } else if (idle) {
+    char*        short_name = oidc_strcopy(idle->shortname);
+    oidc_error_t err = _restoreIdleAccount(pipes, short_name, application_hint);
+    account = err == OIDC_SUCCESS
+                  ? db_getAccountDecryptedByShortname(short_name)
+                  : NULL;
+    secFree(short_name);
+    if (account == NULL) {
+      ipc_writeOidcErrnoToPipe(pipes);
+      return NULL;
+    }
+  } else if (accounts == NULL) {  // no accounts loaded for this issuer
     if (arguments->no_autoload) {
       ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
       return NULL;
     }
+    if (negativeCache_contains(NEGATIVE_CACHE_ISSUER, issuer)) {
+      ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
+      return NULL;
+    }
     char* defaultAccount = oidcd_queryDefaultAccountIssuer(pipes, issuer);
     if (defaultAccount == NULL) {
+      negativeCache_add(NEGATIVE_CACHE_ISSUER, issuer);
       ipc_writeToPipe(pipes, RESPONSE_ERROR, ACCOUNT_NOT_LOADED);
       return NULL;
     }
@@ -516,16 +774,19 @@ struct oidc_account* _getLoadedUnencryptedAccountForIssuer(
     }
   } else if (accounts->len ==
              1) {  // only one account loaded for this issuer -> use this one
+    issuerChoice_remember(issuer, list_at(accounts, 0)->val);
     account = _db_decryptFoundAccount(list_at(accounts, 0)->val);
     secFreeList(accounts);
   } else {  // more than 1 account loaded for this issuer
     char* defaultAccount = oidcd_queryDefaultAccountIssuer(pipes, issuer);
     account              = db_getAccountDecryptedByShortname(defaultAccount);
+    secFree(defaultAccount);
     if (account == NULL) {
       account = _db_decryptFoundAccount(
           list_at(accounts, accounts->len - 1)
               ->val);  // use the account that was loaded last
     }
+    issuerChoice_remember(issuer, account);
     secFreeList(accounts);
   }
 
@@ -535,7 +796,7 @@ struct oidc_account* _getLoadedUnencryptedAccountForIssuer(
   }
   if (arguments->confirm || account_getConfirmationRequired(account)) {
     if (oidcd_getConfirmation(pipes, account_getName(account), issuer,
-                              application_hint) != OIDC_SUCCESS) {
+                              application_hint, scope) != OIDC_SUCCESS) {
       db_addAccountEncrypted(account);  // reencrypting
       ipc_writeOidcErrnoToPipe(pipes);
       return NULL;
@@ -554,28 +815,71 @@ void oidcd_handleTokenIssuer(struct ipcPipe pipes, char* issuer,
   time_t min_valid_period =
       min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
   struct oidc_account* account = _getLoadedUnencryptedAccountForIssuer(
-      pipes, issuer, application_hint, arguments);
+      pipes, issuer, application_hint, scope, arguments);
   if (account == NULL) {
     return;
   }
-  char* access_token = getAccessTokenUsingRefreshFlow(account, min_valid_period,
-                                                      scope, audience, pipes);
+  requestTrace_mark("oidcd_decrypted");
+  char* access_token =
+      getValidCachedAccessToken(account, min_valid_period, scope, audience);
+  accountStats_recordRequest(account_getName(account), application_hint,
+                             access_token != NULL);
+  tokenPredictor_recordRequest(account_getName(account), application_hint,
+                               scope, audience, min_valid_period);
+  if (access_token == NULL) {
+    access_token = getAccessTokenUsingRefreshFlow(account, min_valid_period,
+                                                  scope, audience, pipes);
+  }
+  requestTrace_mark("oidcd_token_obtained");
   db_addAccountEncrypted(account);  // reencrypting
+  requestTrace_mark("oidcd_reencrypted");
   if (access_token == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, access_token,
-                  account_getIssuerUrl(account),
-                  account_getTokenExpiresAt(account));
-  if (strValid(scope)) {
-    secFree(access_token);
+  _writeAccessTokenResponse(pipes, access_token, account_getIssuerUrl(account),
+                            account_getTokenExpiresAtFor(account, scope,
+                                                         audience));
+}
+
+/**
+ * @brief returns an access token that is still valid, but not for
+ * @p min_valid_period, and schedules its refresh in the background
+ * @return the access token or @c NULL if there is none
+ */
+static char* _getStaleAccessToken(struct oidc_account* account,
+                                  time_t min_valid_period, const char* scope,
+                                  const char* audience) {
+  if (min_valid_period <= 0) {  // also FORCE_NEW_TOKEN
+    return NULL;
+  }
+  char* access_token = getValidCachedAccessToken(account, 0, scope, audience);
+  if (access_token != NULL) {
+    agent_log(DEBUG, "Returning stale access token for '%s'",
+              account_getName(account));
+    prefetch_scheduleRefresh(account_getName(account), scope, audience);
   }
+  return access_token;
+}
+
+/**
+ * @brief checks if @p access_token is the token a client reported as rejected
+ * @param token_hash the base64url encoded SHA-256 hash of the rejected token
+ */
+static int _isRejectedToken(const char* access_token, const char* token_hash) {
+  if (access_token == NULL || token_hash == NULL) {
+    return 0;
+  }
+  char*     hash     = s256(access_token);
+  const int rejected = strequal(hash, token_hash);
+  secFree(hash);
+  return rejected;
 }
 
 void oidcd_handleToken(struct ipcPipe pipes, char* short_name,
                        const char* min_valid_period_str, const char* scope,
                        const char* application_hint, const char* audience,
+                       const char*             stale_ok,
                        const struct arguments* arguments) {
   agent_log(DEBUG, "Handle Token request from %s", application_hint);
   if (short_name == NULL) {
@@ -586,32 +890,188 @@ void oidcd_handleToken(struct ipcPipe pipes, char* short_name,
   }
   time_t min_valid_period =
       min_valid_period_str != NULL ? strToInt(min_valid_period_str) : 0;
-  struct oidc_account* account = _getLoadedUnencryptedAccount(
-      pipes, short_name, application_hint, arguments);
+  // The account stays memory encrypted until the refresh flow needs it; a
+  // cached access token is returned without any decryption.
+  struct oidc_account* account =
+      _getLoadedAccount(pipes, short_name, application_hint, arguments);
   if (account == NULL) {
     return;
   }
   if (arguments->confirm || account_getConfirmationRequired(account)) {
-    if (oidcd_getConfirmation(pipes, short_name, NULL, application_hint) !=
-        OIDC_SUCCESS) {
-      db_addAccountEncrypted(account);  // reencrypting
+    if (oidcd_getConfirmation(pipes, short_name, NULL, application_hint,
+                              scope) != OIDC_SUCCESS) {
       ipc_writeOidcErrnoToPipe(pipes);
       return;
     }
   }
-  char* access_token = getAccessTokenUsingRefreshFlow(account, min_valid_period,
-                                                      scope, audience, pipes);
-  db_addAccountEncrypted(account);  // reencrypting
+  char* access_token =
+      getValidCachedAccessToken(account, min_valid_period, scope, audience);
+  if (access_token == NULL && strToInt(stale_ok)) {
+    access_token =
+        _getStaleAccessToken(account, min_valid_period, scope, audience);
+  }
+  metrics_inc(METRIC_TOKENCACHE,
+              access_token ? METRIC_LABEL_HIT : METRIC_LABEL_MISS);
+  accountStats_recordRequest(short_name, application_hint,
+                             access_token != NULL);
+  tokenPredictor_recordRequest(short_name, application_hint, scope, audience,
+                               min_valid_period);
+  requestTrace_mark("oidcd_cache_lookup");
+  if (access_token == NULL) {
+    _db_decryptFoundAccount(account);
+    requestTrace_mark("oidcd_decrypted");
+    access_token = getAccessTokenUsingRefreshFlow(account, min_valid_period,
+                                                  scope, audience, pipes);
+    requestTrace_mark("oidcd_token_obtained");
+    db_addAccountEncrypted(account);  // reencrypting
+    requestTrace_mark("oidcd_reencrypted");
+  }
   if (access_token == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, access_token,
-                  account_getIssuerUrl(account),
-                  account_getTokenExpiresAt(account));
-  if (strValid(scope)) {
-    secFree(access_token);
+  _writeAccessTokenResponse(pipes, access_token, account_getIssuerUrl(account),
+                            account_getTokenExpiresAtFor(account, scope,
+                                                         audience));
+}
+
+/**
+ * @brief handles a prefetch hint of a client, see prefetchHints.c
+ * The account is loaded like for a token request, but no token is returned.
+ * @param when the point in time from which on the token is needed
+ * @param duration the seconds for which the token is needed
+ */
+void oidcd_handlePrefetch(struct ipcPipe pipes, const char* short_name,
+                          const char* scope, const char* audience,
+                          const char* when, const char* duration,
+                          const char*             application_hint,
+                          const struct arguments* arguments) {
+  if (short_name == NULL || when == NULL || duration == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_BADREQUEST,
+                    "Required fields '" IPC_KEY_SHORTNAME "', '" IPC_KEY_WHEN
+                    "' and '" IPC_KEY_DURATION "' not present.");
+    return;
   }
+  agent_log(DEBUG, "Handle Prefetch request from %s", application_hint);
+  if (_getLoadedAccount(pipes, short_name, application_hint, arguments) ==
+      NULL) {
+    return;
+  }
+  if (prefetchHints_add(short_name, scope, audience,
+                        (time_t)strToULong(when),
+                        (time_t)strToULong(duration)) != OIDC_SUCCESS) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
+}
+
+/**
+ * @brief answers an access token request if this is possible without any
+ * network communication or user interaction
+ * This is used to answer requests while another request is still waiting for
+ * a response from the OP.
+ * @param request the json encoded request
+ * @return @c 1 if the request was answered; @c 0 if it has to be handled
+ * normally
+ */
+int oidcd_handleTokenFromCache(struct ipcPipe pipes, const char* request,
+                               const struct arguments* arguments) {
+  if (agent_state.lock_state.locked || arguments->confirm) {
+    return 0;
+  }
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_MINVALID,
+                 OIDC_KEY_SCOPE, IPC_KEY_AUDIENCE, IPC_KEY_APPLICATIONHINT,
+                 IPC_KEY_TRACE, IPC_KEY_STALEOK, IPC_KEY_CONFIRM,
+                 IPC_KEY_TOKENHASH);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  KEY_VALUE_VARS(request, shortname, minvalid, scope, audience,
+                 applicationHint, trace, stale_ok, confirm, token_hash);
+  // A token rejection can be answered from the cache once the rejected token
+  // was replaced
+  const int rejection = strequal(_request, REQUEST_VALUE_TOKENREJECTED);
+  // Traced requests take the regular path, which records the trace; requests
+  // that have to be confirmed, too
+  if (!(strequal(_request, REQUEST_VALUE_ACCESSTOKEN) || rejection) ||
+      _shortname == NULL || _trace != NULL || strToInt(_confirm)) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  struct oidc_account* account = db_findAccountByShortname(_shortname);
+  if (account == NULL || account_getConfirmationRequired(account) ||
+      (account_getDeath(account) && account_getDeath(account) < time(NULL))) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  time_t min_valid_period = _minvalid != NULL ? strToInt(_minvalid) : 0;
+  char*  access_token =
+      getValidCachedAccessToken(account, min_valid_period, _scope, _audience);
+  const int stale = access_token == NULL;
+  if (rejection && _isRejectedToken(access_token, _token_hash)) {
+    access_token = NULL;
+  } else if (access_token == NULL && strToInt(_stale_ok)) {
+    access_token =
+        _getStaleAccessToken(account, min_valid_period, _scope, _audience);
+  }
+  if (access_token == NULL) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  agent_log(DEBUG, "Answering Token request from %s from cache",
+            _applicationHint);
+  metrics_inc(METRIC_REQUESTS, _request);
+  metrics_inc(METRIC_TOKENCACHE, METRIC_LABEL_HIT);
+  accountStats_recordRequest(_shortname, _applicationHint, 1);
+  tokenPredictor_recordRequest(_shortname, _applicationHint, _scope, _audience,
+                               min_valid_period);
+  const unsigned long expires_at =
+      account_getTokenExpiresAtFor(account, _scope, _audience);
+  _writeAccessTokenResponse(pipes, access_token, account_getIssuerUrl(account),
+                            expires_at);
+  if (!stale) {
+    hotTokens_publish(pipes, account, _scope, _audience, access_token,
+                      expires_at);
+  }
+  SEC_FREE_KEY_VALUES();
+  return 1;
+}
+
+/**
+ * @brief handles a token that a resource server rejected, e.g. because it was
+ * revoked
+ * If the rejected token is still the cached token for the scope / audience
+ * combination, it is dropped, so that it is refreshed to answer the request.
+ * A rejection of a token that was already replaced only returns the current
+ * token; rejections that arrive during the refresh are deferred and answered
+ * with its result (see @c oidcd_handleTokenFromCache). So a token that many
+ * clients reject is dropped and refreshed only once.
+ * @param token_hash the base64url encoded SHA-256 hash of the rejected token
+ */
+void oidcd_handleTokenRejected(struct ipcPipe pipes, const char* short_name,
+                               const char* token_hash, const char* scope,
+                               const char*             application_hint,
+                               const char*             audience,
+                               const struct arguments* arguments) {
+  agent_log(DEBUG, "Handle token rejection from %s", application_hint);
+  if (short_name == NULL || token_hash == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "Bad request. Required field '" IPC_KEY_SHORTNAME
+                    "' or '" IPC_KEY_TOKENHASH "' not present.");
+    return;
+  }
+  struct oidc_account* account = db_findAccountByShortname(short_name);
+  if (account &&
+      _isRejectedToken(getValidCachedAccessToken(account, 0, scope, audience),
+                       token_hash)) {
+    agent_log(NOTICE, "Dropping the rejected access token of '%s'",
+              short_name);
+    account_dropToken(account, scope, audience);
+  }
+  oidcd_handleToken(pipes, (char*)short_name, NULL, scope, application_hint,
+                    audience, NULL, arguments);
 }
 
 void oidcd_handleIdToken(struct ipcPipe pipes, const char* short_name,
@@ -623,7 +1083,8 @@ void oidcd_handleIdToken(struct ipcPipe pipes, const char* short_name,
       short_name != NULL ? _getLoadedUnencryptedAccount(
                                pipes, short_name, application_hint, arguments)
                          : _getLoadedUnencryptedAccountForIssuer(
-                               pipes, issuer, application_hint, arguments);
+                               pipes, issuer, application_hint, scope,
+                               arguments);
   if (account == NULL) {
     return;
   }
@@ -631,7 +1092,8 @@ void oidcd_handleIdToken(struct ipcPipe pipes, const char* short_name,
         account_getAlwaysAllowId(
             account))) {  // TODO account based does not work yet
     if (oidcd_getIdTokenConfirmation(pipes, short_name, issuer,
-                                     application_hint) != OIDC_SUCCESS) {
+                                     application_hint,
+                                     scope) != OIDC_SUCCESS) {
       ipc_writeOidcErrnoToPipe(pipes);
       return;
     }
@@ -647,79 +1109,327 @@ void oidcd_handleIdToken(struct ipcPipe pipes, const char* short_name,
   secFree(id_token);
 }
 
-void oidcd_handleRegister(struct ipcPipe pipes, const char* account_json,
-                          const char* flows_json_str,
-                          const char* access_token) {
-  agent_log(DEBUG, "Handle Register request for flows: '%s'", flows_json_str);
-  struct oidc_account* account = getAccountFromJSON(account_json);
+/**
+ * @brief returns the claims about the user of an account from its issuer's
+ * userinfo endpoint
+ * The claims are cached per account until its access token changes, see
+ * userinfoCache.c. Like for an access token request, the account is loaded if
+ * needed and the request might have to be confirmed.
+ */
+void oidcd_handleUserinfo(struct ipcPipe pipes, const char* short_name,
+                          const char*             application_hint,
+                          const struct arguments* arguments) {
+  agent_log(DEBUG, "Handle Userinfo request from %s", application_hint);
+  if (short_name == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "Bad request. Required field '" IPC_KEY_SHORTNAME
+                    "' not present.");
+    return;
+  }
+  struct oidc_account* account =
+      _getLoadedAccount(pipes, short_name, application_hint, arguments);
   if (account == NULL) {
+    return;
+  }
+  if (arguments->confirm || account_getConfirmationRequired(account)) {
+    if (oidcd_getConfirmation(pipes, short_name, NULL, application_hint,
+                              NULL) != OIDC_SUCCESS) {
+      ipc_writeOidcErrnoToPipe(pipes);
+      return;
+    }
+  }
+  char* access_token = getValidCachedAccessToken(account, 0, NULL, NULL);
+  if (access_token == NULL) {
+    _db_decryptFoundAccount(account);
+    access_token =
+        getAccessTokenUsingRefreshFlow(account, 0, NULL, NULL, pipes);
+    db_addAccountEncrypted(account);  // reencrypting
+  }
+  if (access_token == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  agent_log(DEBUG, "daeSetByUser is: %d",
-            issuer_getDeviceAuthorizationEndpointIsSetByUser(
-                account_getIssuer(account)));
-  if (NULL != accountDB_findValue(account)) {
-    secFreeAccount(account);
-    ipc_writeToPipe(
-        pipes, RESPONSE_ERROR,
-        "An account with this shortname is already loaded. I will not "
-        "register a new one.");
+  char* userinfo = userinfoCache_get(short_name, access_token);
+  if (userinfo == NULL) {
+    userinfo = fetchUserinfo(account, access_token);
+    if (userinfo == NULL) {
+      ipc_writeOidcErrnoToPipe(pipes);
+      return;
+    }
+    userinfoCache_put(short_name, access_token, userinfo);
+  } else {
+    agent_log(DEBUG, "Returning cached userinfo for '%s'", short_name);
+  }
+  if (isJSONObject(userinfo)) {
+    ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT, userinfo);
+  } else {  // a signed or encrypted JWT
+    ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, userinfo);
+  }
+  secFree(userinfo);
+}
+
+void oidcd_handleValidateToken(struct ipcPipe pipes, const char* token,
+                               const char* audience) {
+  agent_log(DEBUG, "Handle ValidateToken request");
+  if (token == NULL) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "Bad request. Required field '" OIDC_KEY_ACCESSTOKEN
+                    "' not present.");
     return;
   }
-  if (getIssuerConfig(account) != OIDC_SUCCESS) {
-    secFreeAccount(account);
+  char* claims = tokenValidation_validate(token, audience);
+  if (claims == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     return;
   }
-  agent_log(DEBUG, "daeSetByUser is: %d",
-            issuer_getDeviceAuthorizationEndpointIsSetByUser(
-                account_getIssuer(account)));
-  list_t* flows = JSONArrayStringToList(flows_json_str);
-  if (flows == NULL) {
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT, claims);
+  secFree(claims);
+}
+
+/**
+ * @brief prepares the account of a registration request
+ * The issuer configuration is fetched and the scope 'max' is resolved.
+ * @return the account or @c NULL on failure; @c oidc_errno is set
+ */
+static struct oidc_account* _accountForRegistration(const char* account_json) {
+  struct oidc_account* account = getAccountFromJSON(account_json);
+  if (account == NULL) {
+    return NULL;
+  }
+  if (NULL != accountDB_findValue(account)) {
     secFreeAccount(account);
-    ipc_writeOidcErrnoToPipe(pipes);
-    return;
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror("An account with this shortname is already loaded. I will "
+                  "not register a new one.");
+    return NULL;
   }
+  if (getIssuerConfig(account) != OIDC_SUCCESS) {
+    secFreeAccount(account);
+    return NULL;
+  }
+  if (strequal(account_getScope(account), AGENT_SCOPE_ALL)) {
+    account_setScope(account,
+                     oidc_strcopy(account_getScopesSupported(account)));
+  }
+  return account;
+}
 
+/**
+ * @brief registers a client for @p account
+ * @return the response to the registration request; has to be freed after
+ * usage
+ */
+static char* _registerClient(struct oidc_account* account, list_t* flows,
+                             const char* access_token) {
   char* res = dynamicRegistration(account, flows, access_token);
-  secFreeList(flows);
   if (res == NULL) {
-    ipc_writeOidcErrnoToPipe(pipes);
-    secFreeAccount(account);
-    return;
+    return oidc_sprintf(RESPONSE_ERROR, oidc_serror());
   }
   if (!isJSONObject(res)) {
-    char* escaped = escapeCharInStr(res, '"');
-    ipc_writeToPipe(pipes, RESPONSE_ERROR_INFO,
-                    "Received no JSON formatted response.", escaped);
+    char* escaped  = escapeCharInStr(res, '"');
+    char* response = oidc_sprintf(
+        RESPONSE_ERROR_INFO, "Received no JSON formatted response.", escaped);
     secFree(escaped);
-    secFreeAccount(account);
-    return;
+    secFree(res);
+    return response;
   }
   cJSON* json_res = stringToJson(res);
   if (jsonHasKey(json_res, OIDC_KEY_ERROR)) {
-    char* error = parseForError(res);  // frees res
-    ipc_writeToPipe(pipes, RESPONSE_ERROR, error);
+    secFreeJson(json_res);
+    char* error    = parseForError(res);  // frees res
+    char* response = oidc_sprintf(RESPONSE_ERROR, error);
     secFree(error);
-    secFreeAccount(account);
-    return;
+    return response;
   }
   char* scopes = getJSONValue(json_res, OIDC_KEY_SCOPE);
   secFreeJson(json_res);
+  char* response;
   if (!strSubStringCase(scopes, OIDC_SCOPE_OPENID) ||
       !strSubStringCase(scopes, OIDC_SCOPE_OFFLINE_ACCESS)) {
     // did not get all scopes necessary for oidc-agent
     oidc_errno = OIDC_EUNSCOPE;
-    ipc_writeToPipe(pipes, RESPONSE_ERROR_CLIENT, oidc_serror(), res);
+    response   = oidc_sprintf(RESPONSE_ERROR_CLIENT, oidc_serror(), res);
   } else {
-    ipc_writeToPipe(pipes, RESPONSE_SUCCESS_CLIENT_MAXSCOPES, res,
-                    account_getScopesSupported(account));
+    response = oidc_sprintf(RESPONSE_SUCCESS_CLIENT_MAXSCOPES, res,
+                            account_getScopesSupported(account));
   }
   secFree(scopes);
   secFree(res);
+  return response;
+}
+
+void oidcd_handleRegister(struct ipcPipe pipes, const char* account_json,
+                          const char* flows_json_str,
+                          const char* access_token) {
+  agent_log(DEBUG, "Handle Register request for flows: '%s'", flows_json_str);
+  struct oidc_account* account = _accountForRegistration(account_json);
+  if (account == NULL) {
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  agent_log(DEBUG, "daeSetByUser is: %d",
+            issuer_getDeviceAuthorizationEndpointIsSetByUser(
+                account_getIssuer(account)));
+  list_t* flows = JSONArrayStringToList(flows_json_str);
+  if (flows == NULL) {
+    secFreeAccount(account);
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  char* response = _registerClient(account, flows, access_token);
+  secFreeList(flows);
   secFreeAccount(account);
-  return;
+  ipc_writeToPipe(pipes, "%s", response);
+  secFree(response);
+}
+
+/**
+ * @brief registers the clients of every @p n th account, starting with the
+ * @p offset th one
+ */
+static void _registerShare(struct oidc_account** accounts, char** responses,
+                           size_t len, size_t offset, size_t n, list_t* flows,
+                           const char* access_token) {
+  for (size_t i = offset; i < len; i += n) {
+    if (accounts[i] != NULL && responses[i] == NULL) {
+      responses[i] = _registerClient(accounts[i], flows, access_token);
+    }
+  }
+}
+
+/**
+ * @brief registers the clients of a batch in parallel
+ * Up to @c REGISTRATION_BATCH_CONCURRENCY processes register their share of
+ * the clients, each with its own http worker, and pass the responses back
+ * through a pipe. Shares for which no process could be started are registered
+ * by oidcd itself.
+ */
+static void _registerInParallel(struct oidc_account** accounts,
+                                char** responses, size_t len, list_t* flows,
+                                const char* access_token) {
+  size_t n = len < REGISTRATION_BATCH_CONCURRENCY
+                 ? len
+                 : REGISTRATION_BATCH_CONCURRENCY;
+  int    fds[REGISTRATION_BATCH_CONCURRENCY];
+  size_t started = 0;
+  for (; started < n; started++) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+      break;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+      agent_log(ERROR, "fork %m");
+      close(fd[0]);
+      close(fd[1]);
+      break;
+    }
+    if (pid == 0) {  // child
+      close(fd[0]);
+      httpWorker_detach();
+      _registerShare(accounts, responses, len, started, n, flows,
+                     access_token);
+      cJSON* share = cJSON_CreateArray();
+      for (size_t i = started; i < len; i += n) {
+        cJSON_AddItemToArray(share, cJSON_CreateString(responses[i] ?: ""));
+      }
+      char* share_str = jsonToStringUnformatted(share);
+      secFreeJson(share);
+      if (share_str) {
+        (void)!write(fd[1], share_str, strlen(share_str));
+      }
+      _exit(share_str ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fd[1]);
+    fds[started] = fd[0];
+  }
+  for (size_t offset = started; offset < n; offset++) {
+    _registerShare(accounts, responses, len, offset, n, flows, access_token);
+  }
+  for (size_t offset = 0; offset < started; offset++) {
+    FILE* f         = fdopen(fds[offset], "r");
+    char* share_str = f ? readFILE(f) : NULL;
+    if (f) {
+      fclose(f);
+    } else {
+      close(fds[offset]);
+    }
+    cJSON* share = stringToJson(share_str);
+    secFree(share_str);
+    size_t j = 0;
+    for (size_t i = offset; i < len; i += n, j++) {
+      if (responses[i] != NULL) {
+        continue;
+      }
+      const cJSON* res = cJSON_GetArrayItem(share, j);
+      responses[i] =
+          strValid(cJSON_GetStringValue(res))
+              ? oidc_strcopy(cJSON_GetStringValue(res))
+              : oidc_sprintf(RESPONSE_ERROR, "Registration process failed");
+    }
+    secFreeJson(share);
+  }
+}
+
+/**
+ * @brief registers clients for multiple accounts with a single request
+ * The issuer configurations are fetched one after another first, so every
+ * issuer is only asked once, before the clients are registered in parallel.
+ * The response holds the registration response of every account in the order
+ * of @p configs_json.
+ */
+void oidcd_handleRegisterBatch(struct ipcPipe pipes, const char* configs_json,
+                               const char* flows_json_str,
+                               const char* access_token) {
+  cJSON* configs = stringToJson(configs_json);
+  if (!cJSON_IsArray(configs) || cJSON_GetArraySize(configs) <= 0) {
+    secFreeJson(configs);
+    oidc_errno = OIDC_EJSONARR;
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  list_t* flows = JSONArrayStringToList(flows_json_str);
+  if (flows == NULL) {
+    secFreeJson(configs);
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  size_t len = cJSON_GetArraySize(configs);
+  agent_log(DEBUG, "Handle Register batch request for %lu accounts", len);
+  struct oidc_account** accounts =
+      secAlloc(sizeof(struct oidc_account*) * len);
+  char**       responses = secAlloc(sizeof(char*) * len);
+  size_t       i         = 0;
+  cJSON*       config;
+  cJSON_ArrayForEach(config, configs) {
+    char* config_str = jsonToStringUnformatted(config);
+    accounts[i]      = _accountForRegistration(config_str);
+    secFree(config_str);
+    if (accounts[i] == NULL) {
+      responses[i] = oidc_sprintf(RESPONSE_ERROR, oidc_serror());
+    }
+    i++;
+  }
+  secFreeJson(configs);
+  _registerInParallel(accounts, responses, len, flows, access_token);
+  secFreeList(flows);
+  cJSON* array = cJSON_CreateArray();
+  for (i = 0; i < len; i++) {
+    cJSON* res = stringToJson(responses[i]);
+    cJSON_AddItemToArray(
+        array, res ?: generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                         STATUS_FAILURE, OIDC_KEY_ERROR,
+                                         cJSON_String,
+                                         "Invalid registration response", NULL));
+    secFree(responses[i]);
+    secFreeAccount(accounts[i]);
+  }
+  secFree(responses);
+  secFree(accounts);
+  char* array_str = jsonToStringUnformatted(array);
+  secFreeJson(array);
+  ipc_writeToPipe(pipes, RESPONSE_BATCH, array_str);
+  secFree(array_str);
 }
 
 void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
@@ -746,11 +1456,11 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     secFreeCodeState(codeState);
     return;
   }
-  const unsigned char      only_at = state[2] == '1' ? 1 : 0;
-  struct codeExchangeEntry key     = {.state = state};
+  const unsigned char only_at = state[2] == '1' ? 1 : 0;
   agent_log(DEBUG, "Getting code_verifier and account info for state '%s'",
             state);
-  struct codeExchangeEntry* cee = codeVerifierDB_findValue(&key);
+  struct codeExchangeEntry* cee =
+      codeVerifierDB_findValueByIndex(CODEVERIFIERDB_INDEX_STATE, state);
   if (cee == NULL) {
     oidc_errno = OIDC_EWRONGSTATE;
     ipc_writeOidcErrnoToPipe(pipes);
@@ -784,7 +1494,7 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     return;
   }
   if (account_refreshTokenIsValid(account) && (!fromGen || !only_at)) {
-    char* json = accountToJSONString(account);
+    char* json = _generatedConfig(pipes, account);
     ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
     secFree(json);
     secFreeCodeState(codeState);
@@ -797,10 +1507,9 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
     account_setUsedState(account, cee->state);
     codeVerifierDB_removeIfFound(cee);
   } else if (only_at && strValid(account_getAccessToken(account))) {
-    ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
-                    account_getAccessToken(account),
-                    account_getIssuerUrl(account),
-                    account_getTokenExpiresAt(account));
+    _writeAccessTokenResponse(pipes, account_getAccessToken(account),
+                              account_getIssuerUrl(account),
+                              account_getTokenExpiresAt(account));
     if (fromGen) {
       termHttpServer(cee->state);
       account->usedStateChecked = 1;
@@ -816,46 +1525,50 @@ void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
   }
 }
 
-void oidcd_handleDeviceLookup(struct ipcPipe pipes, const char* account_json,
-                              const char* device_json,
-                              const char* only_at_str) {
-  agent_log(DEBUG, "Handle deviceLookup request");
+/**
+ * @brief parses the account and device code of a device lookup request
+ * On failure the error is written to @p pipes and @c NULL is returned.
+ */
+static struct oidc_account* _getDeviceLookupAccount(
+    struct ipcPipe pipes, const char* account_json, const char* device_json,
+    struct oidc_device_code** dc) {
   struct oidc_account* account = getAccountFromJSON(account_json);
   if (account == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
-    return;
+    return NULL;
   }
-  struct oidc_device_code* dc = getDeviceCodeFromJSON(device_json);
-  if (dc == NULL) {
+  *dc = getDeviceCodeFromJSON(device_json);
+  if (*dc == NULL) {
     ipc_writeOidcErrnoToPipe(pipes);
     secFreeAccount(account);
-    return;
+    return NULL;
   }
   if (getIssuerConfig(account) != OIDC_SUCCESS) {
     secFreeAccount(account);
     ipc_writeOidcErrnoToPipe(pipes);
-    secFreeDeviceCode(dc);
-    return;
-  }
-  if (getAccessTokenUsingDeviceFlow(account, oidc_device_getDeviceCode(*dc),
-                                    pipes) != OIDC_SUCCESS) {
-    secFreeAccount(account);
-    secFreeDeviceCode(dc);
-    ipc_writeOidcErrnoToPipe(pipes);
-    return;
+    secFreeDeviceCode(*dc);
+    *dc = NULL;
+    return NULL;
   }
-  secFreeDeviceCode(dc);
-  const int only_at = strToInt(only_at_str);
+  return account;
+}
+
+/**
+ * @brief answers a device lookup request after the device code was exchanged
+ * for tokens
+ * @param account the account that obtained tokens; ownership is taken
+ */
+void oidcd_answerDeviceLookup(struct ipcPipe       pipes,
+                              struct oidc_account* account, int only_at) {
   if (account_refreshTokenIsValid(account) && !only_at) {
-    char* json = accountToJSONString(account);
+    char* json = _generatedConfig(pipes, account);
     ipc_writeToPipe(pipes, RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, json);
     secFree(json);
     db_addAccountEncrypted(account);
   } else if (only_at && strValid(account_getAccessToken(account))) {
-    ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
-                    account_getAccessToken(account),
-                    account_getIssuerUrl(account),
-                    account_getTokenExpiresAt(account));
+    _writeAccessTokenResponse(pipes, account_getAccessToken(account),
+                              account_getIssuerUrl(account),
+                              account_getTokenExpiresAt(account));
     secFreeAccount(account);
   } else {
     ipc_writeToPipe(pipes, RESPONSE_ERROR, "Could not get a refresh token");
@@ -863,6 +1576,45 @@ void oidcd_handleDeviceLookup(struct ipcPipe pipes, const char* account_json,
   }
 }
 
+void oidcd_handleDeviceLookup(struct ipcPipe pipes, const char* account_json,
+                              const char* device_json,
+                              const char* only_at_str) {
+  agent_log(DEBUG, "Handle deviceLookup request");
+  struct oidc_device_code* dc = NULL;
+  struct oidc_account*     account =
+      _getDeviceLookupAccount(pipes, account_json, device_json, &dc);
+  if (account == NULL) {
+    return;
+  }
+  if (getAccessTokenUsingDeviceFlow(account, oidc_device_getDeviceCode(*dc),
+                                    pipes) != OIDC_SUCCESS) {
+    secFreeAccount(account);
+    secFreeDeviceCode(dc);
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  secFreeDeviceCode(dc);
+  oidcd_answerDeviceLookup(pipes, account, strToInt(only_at_str));
+}
+
+/**
+ * @brief handles a device lookup request that is only answered once the user
+ * authorized the device code, it expired, or the provider returned an error
+ * The token endpoint is polled in the background by oidcd, see devicePoll.c.
+ */
+void oidcd_handleDevicePoll(struct ipcPipe pipes, const char* account_json,
+                            const char* device_json, const char* only_at_str) {
+  agent_log(DEBUG, "Handle devicePoll request");
+  struct oidc_device_code* dc = NULL;
+  struct oidc_account*     account =
+      _getDeviceLookupAccount(pipes, account_json, device_json, &dc);
+  if (account == NULL) {
+    return;
+  }
+  devicePoll_add(pipes, account, dc, strToInt(only_at_str));
+  secFreeDeviceCode(dc);
+}
+
 void oidcd_handleStateLookUp(struct ipcPipe pipes, char* state) {
   agent_log(DEBUG, "Handle stateLookUp request");
   if (state == NULL || strlen(state) < 3) {
@@ -890,10 +1642,9 @@ void oidcd_handleStateLookUp(struct ipcPipe pipes, char* state) {
   }
   account->usedStateChecked = 1;
   if (only_at) {
-    ipc_writeToPipe(pipes, RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
-                    account_getAccessToken(account),
-                    account_getIssuerUrl(account),
-                    account_getTokenExpiresAt(account));
+    _writeAccessTokenResponse(pipes, account_getAccessToken(account),
+                              account_getIssuerUrl(account),
+                              account_getTokenExpiresAt(account));
     accountDB_removeIfFound(account);
   } else {
     char* config = accountToJSONString(account);
@@ -912,14 +1663,22 @@ void oidcd_handleTermHttp(struct ipcPipe pipes, const char* state) {
 void oidcd_handleLock(struct ipcPipe pipes, const char* password, int _lock) {
   if (_lock) {
     if (lock(password) == OIDC_SUCCESS) {
+      userinfoCache_clear();
+      tokenValidation_clear();
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, "Agent locked");
       return;
     }
   } else {
     if (unlock(password) == OIDC_SUCCESS) {
+      warmup_schedule();
       ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, "Agent unlocked");
       return;
     }
+    if (oidc_errno == OIDC_ETHROTTLED) {
+      ipc_writeToPipe(pipes, RESPONSE_BUSY, oidc_serror(),
+                      (int)unlock_getRetryAfter());
+      return;
+    }
   }
   ipc_writeOidcErrnoToPipe(pipes);
 }
@@ -940,25 +1699,78 @@ void oidcd_handleScopes(struct ipcPipe pipes, const char* issuer_url,
   secFree(scopes);
 }
 
-list_t* _getNameListLoadedAccounts() {
-  list_t*          accounts = accountDB_getList();
-  list_t*          names    = list_new();
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(accounts, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    char* name = account_getName(node->val);
-    list_rpush(names, list_node_new(name));
+/**
+ * @brief returns the short names of the loaded accounts, including the ones
+ * that were evicted because they were idle
+ * @return a vector of the names; they are still owned by the accounts
+ */
+vector_t* _getNameListLoadedAccounts() {
+  const vector_t* accounts = accountDB_getList();
+  vector_t*       names    = vector_new();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    // a refresh token lane is listed by the worker of the account itself
+    if (account_isOfTenant(vector_at(accounts, i)) &&
+        account_getRefreshTokenSlot(vector_at(accounts, i)) == 0) {
+      vector_push(names, account_getName(vector_at(accounts, i)));
+    }
   }
-  list_iterator_destroy(it);
+  idleEviction_addNames(names);  // they are restored when used
   return names;
 }
 
+/**
+ * The responses to status and loaded-accounts requests are polled often, e.g.
+ * by shell prompts, but only change when accounts are loaded or removed. They
+ * are cached together with the generation of the account db they were built
+ * from.
+ */
+struct cachedResponse {
+  char*         value;
+  unsigned long generation;
+};
+
+typedef char* (*responseBuilder)(const struct arguments*);
+
+static struct cachedResponse loadedAccountsResponse = {};
+static struct cachedResponse statusResponse         = {};
+static struct cachedResponse statusJSONResponse     = {};
+
+/**
+ * @brief returns the cached response or, if the loaded accounts changed since
+ * it was built, builds it again with @p build
+ * @return the response; it is owned by the cache and MUST NOT be freed
+ */
+static const char* _getCachedResponse(struct cachedResponse*  cache,
+                                      responseBuilder         build,
+                                      const struct arguments* arguments) {
+  unsigned long generation = accountDB_getGeneration() +
+                             idleEviction_getGeneration() + lazyLib_count() +
+                             addValidation_getGeneration();
+  // in multi-user mode the response depends on the tenant
+  if (agent_state.multi_user || cache->value == NULL ||
+      cache->generation != generation) {
+    secFree(cache->value);
+    cache->value      = build(arguments);
+    cache->generation = generation;
+  }
+  return cache->value;
+}
+
+static char* _buildLoadedAccountsResponse(const struct arguments* arguments) {
+  (void)arguments;
+  vector_t* names    = _getNameListLoadedAccounts();
+  cJSON*    json     = vectorToJSONArray(names);
+  char*     jsonList = jsonToString(json);
+  secFreeJson(json);
+  secFreeVector(names);
+  return jsonList;
+}
+
 void oidcd_handleListLoadedAccounts(struct ipcPipe pipes) {
-  list_t* names    = _getNameListLoadedAccounts();
-  char*   jsonList = listToJSONArrayString(names);
-  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_LOADEDACCOUNTS, jsonList);
-  secFree(jsonList);
-  secFreeList(names);
+  ipc_writeToPipe(
+      pipes, RESPONSE_SUCCESS_LOADEDACCOUNTS,
+      _getCachedResponse(&loadedAccountsResponse,
+                         _buildLoadedAccountsResponse, NULL));
 }
 
 char* _argumentsToOptionsText(const struct arguments* arguments) {
@@ -973,7 +1785,8 @@ char* _argumentsToOptionsText(const struct arguments* arguments) {
                           "Seccomp:\t\t%s\n"
                           "Daemon:\t\t\t%s\n"
                           "Log Debug:\t\t%s\n"
-                          "Log to stderr:\t\t%s\n";
+                          "Log to stderr:\t\t%s\n"
+                          "Workers:\t\t%d\n";
   char* lifetime = arguments->lifetime
                        ? oidc_sprintf("%lu seconds", arguments->lifetime)
                        : oidc_strcopy("Forever");
@@ -997,7 +1810,8 @@ char* _argumentsToOptionsText(const struct arguments* arguments) {
                    arguments->seccomp ? "true" : "false",
                    arguments->console ? "false" : "true",
                    arguments->debug ? "true" : "false",
-                   arguments->log_console ? "true" : "false");
+                   arguments->log_console ? "true" : "false",
+                   arguments->workers);
   secFree(lifetime);
   secFree(store_pw);
   return options;
@@ -1043,6 +1857,40 @@ char* _argumentsToCommandLineOptions(const struct arguments* arguments) {
     list_rpush(options,
                list_node_new(oidc_sprintf("--with-group", arguments->group)));
   }
+  if (arguments->trust_local_clients) {
+    list_rpush(options, list_node_new(oidc_strcopy("--trust-local-clients")));
+  }
+  if (arguments->upstream) {
+    list_rpush(options, list_node_new(oidc_sprintf("--upstream=%s",
+                                                   arguments->upstream)));
+  }
+  if (arguments->snapshot) {
+    list_rpush(options, list_node_new(oidc_strcopy("--snapshot")));
+  }
+  if (arguments->issuer_qps > 0) {
+    char* rate =
+        arguments->issuer_burst
+            ? oidc_sprintf("--issuer-rate=%g,%u", arguments->issuer_qps,
+                           arguments->issuer_burst)
+            : oidc_sprintf("--issuer-rate=%g", arguments->issuer_qps);
+    list_rpush(options, list_node_new(rate));
+  }
+  if (arguments->warmup) {
+    list_rpush(options, list_node_new(oidc_strcopy("--warm-up")));
+  }
+  if (arguments->async_validate) {
+    list_rpush(options, list_node_new(oidc_strcopy("--async-validate")));
+  }
+  if (arguments->attach) {
+    list_rpush(options, list_node_new(oidc_strcopy("--attach")));
+  }
+  if (arguments->memory_stats) {
+    list_rpush(options, list_node_new(oidc_strcopy("--memory-stats")));
+  }
+  if (arguments->workers > 1) {
+    list_rpush(options, list_node_new(oidc_sprintf("--workers=%d",
+                                                   arguments->workers)));
+  }
   if (arguments->seccomp) {
     list_rpush(options, list_node_new(oidc_strcopy("--seccomp")));
   }
@@ -1060,36 +1908,103 @@ char* _argumentsToCommandLineOptions(const struct arguments* arguments) {
   return opts;
 }
 
-void oidcd_handleAgentStatus(struct ipcPipe          pipes,
-                             const struct arguments* arguments) {
+static char* _buildAgentStatus(const struct arguments* arguments) {
   const char* fmt =
       "####################################\n"
       "##       oidc-agent status        ##\n"
       "####################################\n"
       "\nThis agent is running version %s.\n\nThis agent was started with the "
-      "following options:\n%s\nCurrently there are %d accounts loaded: %s\n\n";
-  list_t* names      = _getNameListLoadedAccounts();
-  int     num_loaded = 0;
-  char*   names_str  = NULL;
+      "following options:\n%s\n";
+  vector_t* names      = _getNameListLoadedAccounts();
+  int       num_loaded = 0;
+  char*     names_str  = NULL;
   if (names != NULL) {
     num_loaded = names->len;
-    names_str  = listToDelimitedString(names, ", ");
-  }
-  char* options = _argumentsToOptionsText(arguments);
-  char* status =
-      oidc_sprintf(fmt, VERSION, options, num_loaded, names_str ?: "");
-  secFree(options);
+    names_str  = vectorToDelimitedString(names, ", ");
+  }
+  char* loaded =
+      arguments->workers > 1
+          ? oidc_sprintf("Worker %d has %d accounts loaded: %s\n",
+                         agent_state.worker, num_loaded, names_str ?: "")
+          : oidc_sprintf("Currently there are %d accounts loaded: %s\n\n",
+                         num_loaded, names_str ?: "");
   secFree(names_str);
-  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO, status);
-  secFreeList(names);
-  secFree(status);
+  char* libraries = lazyLib_loadedToString();
+  if (libraries) {
+    char* tmp = oidc_sprintf("%sOptional libraries loaded: %s\n", loaded,
+                             libraries);
+    secFree(loaded);
+    secFree(libraries);
+    loaded = tmp;
+  }
+  char* validations = addValidation_toString();
+  if (validations) {
+    char* tmp = oidc_strcat(loaded, validations);
+    secFree(loaded);
+    secFree(validations);
+    loaded = tmp;
+  }
+  char* status = NULL;
+  if (agent_state.worker == 0) {
+    // the other workers only report their accounts; oidcp appends those
+    char* options = _argumentsToOptionsText(arguments);
+    char* header  = oidc_sprintf(fmt, VERSION, options);
+    secFree(options);
+    status = oidc_strcat(header, loaded);
+    secFree(header);
+  } else {
+    status = oidc_strcopy(loaded);
+  }
+  secFree(loaded);
+  secFreeVector(names);
+  return status;
 }
 
-void oidcd_handleAgentStatusJSON(struct ipcPipe          pipes,
-                                 const struct arguments* arguments) {
-  list_t* names   = _getNameListLoadedAccounts();
-  cJSON*  names_j = listToJSONArray(names);
-  secFreeList(names);
+void oidcd_handleAgentStatus(struct ipcPipe          pipes,
+                             const struct arguments* arguments) {
+  ipc_writeToPipe(
+      pipes, RESPONSE_SUCCESS_INFO,
+      _getCachedResponse(&statusResponse, _buildAgentStatus, arguments));
+}
+
+static cJSON* _memoryStatsToJSON(const struct secMemStats* s, time_t uptime) {
+  cJSON* json = cJSON_CreateObject();
+  jsonAddNumberValue(json, "live_bytes", s->live_bytes);
+  jsonAddNumberValue(json, "live_blocks", s->live_blocks);
+  jsonAddNumberValue(json, "peak_bytes", s->peak_bytes);
+  jsonAddNumberValue(json, "allocations", s->allocations);
+  jsonAddNumberValue(json, "allocations_per_second",
+                     uptime > 0 ? (double)s->allocations / uptime : 0);
+  return json;
+}
+
+/**
+ * @brief returns the allocation statistics of this oidcd process as an array
+ * with one element, so oidcp can join the arrays of all workers
+ */
+static cJSON* _memoryStatsJSON() {
+  time_t uptime = time(NULL) - secMemStats_since();
+  cJSON* stats  = cJSON_CreateObject();
+  jsonAddNumberValue(stats, "worker", agent_state.worker);
+  jsonAddNumberValue(stats, "seconds", uptime);
+  struct secMemStats total = secMemStats_get(MEMTAG_COUNT);
+  jsonAddJSON(stats, secMemStats_tagName(MEMTAG_COUNT),
+              _memoryStatsToJSON(&total, uptime));
+  cJSON* tags = cJSON_CreateObject();
+  for (unsigned char tag = 0; tag < MEMTAG_COUNT; tag++) {
+    struct secMemStats s = secMemStats_get(tag);
+    jsonAddJSON(tags, secMemStats_tagName(tag), _memoryStatsToJSON(&s, uptime));
+  }
+  jsonAddJSON(stats, "tags", tags);
+  cJSON* array = cJSON_CreateArray();
+  cJSON_AddItemToArray(array, stats);
+  return array;
+}
+
+static cJSON* _agentStatusToJSON(const struct arguments* arguments) {
+  vector_t* names   = _getNameListLoadedAccounts();
+  cJSON*    names_j = vectorToJSONArray(names);
+  secFreeVector(names);
   char*  options = _argumentsToCommandLineOptions(arguments);
   cJSON* json =
       generateJSONObject("version", cJSON_String, VERSION,
@@ -1097,15 +2012,127 @@ void oidcd_handleAgentStatusJSON(struct ipcPipe          pipes,
   secFree(options);
   cJSON_AddItemToObject(json, "loaded_accounts",
                         names_j);  // names_j will freed with json
+  jsonAddJSON(json, "optional_libraries", lazyLib_loadedToJSON());
+  jsonAddJSON(json, "account_validations", addValidation_toJSON());
+  return json;
+}
+
+static char* _buildAgentStatusJSON(const struct arguments* arguments) {
+  cJSON* json = _agentStatusToJSON(arguments);
+  char*  info = jsonToString(json);
+  secFreeJson(json);
+  return info;
+}
+
+void oidcd_handleAgentStatusJSON(struct ipcPipe          pipes,
+                                 const struct arguments* arguments) {
+  if (!secMemStats_isEnabled() && accountStats_count() == 0) {
+    ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT,
+                    _getCachedResponse(&statusJSONResponse,
+                                       _buildAgentStatusJSON, arguments));
+    return;
+  }
+  // memory and usage statistics change all the time, so this response is not
+  // cached
+  cJSON* json = _agentStatusToJSON(arguments);
+  jsonAddJSON(json, "account_stats", accountStats_toJSON());
+  if (secMemStats_isEnabled()) {
+    jsonAddJSON(json, "memory", _memoryStatsJSON());
+  }
   char* info = jsonToString(json);
   secFreeJson(json);
   ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT, info);
   secFree(info);
 }
 
+/**
+ * @brief answers a metrics request with the metrics of oidcd appended to the
+ * metrics of oidcp
+ * @param proxy_metrics the metrics of oidcp in the text format
+ */
+void oidcd_handleMetrics(struct ipcPipe pipes, const char* proxy_metrics) {
+  metrics_set(METRIC_KEY_DERIVATIONS, NULL, crypt_getKeyDerivationCount());
+  char* own    = metrics_toText();
+  char* worker = httpWorker_metrics();
+  char* text =
+      oidc_sprintf("%s%s%s", proxy_metrics ?: "", own ?: "", worker ?: "");
+  secFree(own);
+  secFree(worker);
+  cJSON* json = generateJSONObject(IPC_KEY_STATUS, cJSON_String, STATUS_SUCCESS,
+                                   IPC_KEY_INFO, cJSON_String, text, NULL);
+  secFree(text);
+  char* res = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, "%s", res);
+  secFree(res);
+}
+
+/**
+ * @brief answers a stats request with the usage statistics of the loaded
+ * accounts
+ */
+void oidcd_handleStats(struct ipcPipe pipes) {
+  cJSON* json = accountStats_toJSON();
+  char*  info = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT, info);
+  secFree(info);
+}
+
+/**
+ * @brief answers a health request with the saturation of this worker
+ * The request is also answered while another request is in progress, e.g.
+ * while waiting for a provider or for the user to answer a prompt.
+ * @param deferred the number of requests waiting for the current one
+ */
+void oidcd_handleHealth(struct ipcPipe pipes, size_t deferred) {
+  cJSON* json = cJSON_CreateObject();
+  jsonAddNumberValue(json, "worker", agent_state.worker);
+  jsonAddNumberValue(json, "deferred_requests", deferred);
+  jsonAddNumberValue(json, "loaded_accounts", accountDB_getSize());
+  cJSON_AddBoolToObject(json, "prompt_outstanding", promptOutstanding);
+  jsonAddJSON(json, "http_in_flight", httpTransport_inFlightToJSON());
+  jsonAddJSON(json, "issuers", issuerHealth_toJSON());
+  char* info = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS_INFO_OBJECT, info);
+  secFree(info);
+}
+
+/**
+ * @brief takes the tokens a peer agent replicated for a loaded account
+ */
+void oidcd_handleReplicate(struct ipcPipe pipes, const char* short_name,
+                           const char* issuer, const char* access_token,
+                           const char* expires_at_str,
+                           const char* refresh_token) {
+  struct oidc_account* account = db_findAccountByShortname(short_name);
+  if (account == NULL) {
+    oidc_errno = OIDC_ENOACCOUNT;
+    ipc_writeOidcErrnoToPipe(pipes);
+    return;
+  }
+  if (strValid(issuer) &&
+      !compIssuerUrls(issuer, account_getIssuerUrl(account))) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    "The account of the peer has another issuer");
+    return;
+  }
+  oidcd_applyReplicatedTokens(
+      pipes, account, access_token,
+      expires_at_str ? strToULong(expires_at_str) : 0, refresh_token);
+  ipc_writeToPipe(pipes, RESPONSE_SUCCESS);
+}
+
 void oidcd_handleFileWrite(struct ipcPipe pipes, const char* filename,
                            const char* data) {
-  fileDB_addValue(filename, data);
+  if (fileDB_addValue(filename, data) != OIDC_SUCCESS) {
+    ipc_writeToPipe(pipes, RESPONSE_ERROR,
+                    oidc_errno == OIDC_EMSGSIZE
+                        ? "File is too large to be stored in the agent"
+                        : oidc_serror());
+    return;
+  }
   ipc_writeToPipe(pipes, RESPONSE_STATUS_SUCCESS);
 }
 
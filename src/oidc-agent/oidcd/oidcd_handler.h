@@ -4,40 +4,61 @@
 #include "account/account.h"
 #include "ipc/pipe.h"
 #include "oidc-agent/oidc-agent_options.h"
+#include "utils/oidc_error.h"
 
+oidc_error_t addAccount(struct ipcPipe pipes, struct oidc_account* account);
 void oidcd_handleGen(struct ipcPipe pipes, const char* account_json,
                      const char* flow, const char* nowebserver_str,
                      const char* noscheme_str, const char* only_at,
                      const struct arguments* arguments);
 void oidcd_handleAdd(struct ipcPipe, const char* account_json,
                      const char* timeout_str, const char* confirm_str,
-                     const char* alwaysallowid);
+                     const char* alwaysallowid, const struct arguments*);
 void oidcd_handleDelete(struct ipcPipe, const char* account_json);
 void oidcd_handleDeleteClient(struct ipcPipe pipes, const char* client_uri,
                               const char* registration_access_token,
                               const char* cert_path);
 void oidcd_handleRm(struct ipcPipe, char* account_name);
-void oidcd_handleRemoveAll(struct ipcPipe);
+void oidcd_handleRemoveAll(struct ipcPipe, const char* revoke);
 void oidcd_handleToken(struct ipcPipe, char* short_name,
                        const char* min_valid_period_str, const char* scope,
                        const char* application_hint, const char* audience,
-                       const struct arguments*);
+                       const char* stale_ok, const struct arguments*);
+int  oidcd_handleTokenFromCache(struct ipcPipe pipes, const char* request,
+                                const struct arguments* arguments);
 void oidcd_handleTokenIssuer(struct ipcPipe pipes, char* issuer,
                              const char* min_valid_period_str,
                              const char* scope, const char* application_hint,
                              const char*             audience,
                              const struct arguments* arguments);
+void oidcd_handleTokenRejected(struct ipcPipe pipes, const char* short_name,
+                               const char* token_hash, const char* scope,
+                               const char*             application_hint,
+                               const char*             audience,
+                               const struct arguments* arguments);
 void oidcd_handleIdToken(struct ipcPipe pipes, const char* short_name,
                          const char* issuer, const char* scope,
                          const char*             application_hint,
                          const struct arguments* arguments);
+void oidcd_handleUserinfo(struct ipcPipe pipes, const char* short_name,
+                          const char*             application_hint,
+                          const struct arguments* arguments);
+void oidcd_handleValidateToken(struct ipcPipe pipes, const char* token,
+                               const char* audience);
 void oidcd_handleRegister(struct ipcPipe, const char* account_json,
                           const char* json_str, const char* access_token);
+void oidcd_handleRegisterBatch(struct ipcPipe, const char* configs_json,
+                               const char* flows_json_str,
+                               const char* access_token);
 void oidcd_handleCodeExchange(struct ipcPipe pipes, const char* redirected_uri,
                               const char* fromString);
 void oidcd_handleStateLookUp(struct ipcPipe, char* state);
 void oidcd_handleDeviceLookup(struct ipcPipe, const char* account_json,
                               const char* device_json, const char* only_at_str);
+void oidcd_handleDevicePoll(struct ipcPipe, const char* account_json,
+                            const char* device_json, const char* only_at_str);
+void oidcd_answerDeviceLookup(struct ipcPipe       pipes,
+                              struct oidc_account* account, int only_at);
 void oidcd_handleScopes(struct ipcPipe pipes, const char* issuer_url,
                         const char* cert_path);
 void oidcd_handleListLoadedAccounts(struct ipcPipe pipes);
@@ -47,6 +68,18 @@ void oidcd_handleAgentStatus(struct ipcPipe          pipes,
                              const struct arguments* arguments);
 void oidcd_handleAgentStatusJSON(struct ipcPipe          pipes,
                                  const struct arguments* arguments);
+void oidcd_handleMetrics(struct ipcPipe pipes, const char* proxy_metrics);
+void oidcd_handleStats(struct ipcPipe pipes);
+void oidcd_handleHealth(struct ipcPipe pipes, size_t deferred);
+void oidcd_handleReplicate(struct ipcPipe pipes, const char* short_name,
+                           const char* issuer, const char* access_token,
+                           const char* expires_at_str,
+                           const char* refresh_token);
+void oidcd_handlePrefetch(struct ipcPipe pipes, const char* short_name,
+                          const char* scope, const char* audience,
+                          const char* when, const char* duration,
+                          const char*             application_hint,
+                          const struct arguments* arguments);
 void oidcd_handleFileRemove(struct ipcPipe pipes, const char* filename);
 void oidcd_handleFileRead(struct ipcPipe pipes, const char* filename);
 void oidcd_handleFileWrite(struct ipcPipe pipes, const char* filename,
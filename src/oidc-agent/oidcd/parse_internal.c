@@ -6,8 +6,11 @@
 #include "utils/printer.h"
 #include "utils/stringUtils.h"
 
-char* parseForConfig(char* res) {
-  INIT_KEY_VALUE(INT_IPC_KEY_OIDCERRNO, IPC_KEY_CONFIG);
+/**
+ * @brief returns the compactly encoded account of an internal response
+ */
+char* parseForAccountData(char* res) {
+  INIT_KEY_VALUE(INT_IPC_KEY_OIDCERRNO, INT_IPC_KEY_ACCOUNT);
   if (CALL_GETJSONVALUES(res) < 0) {
     printError("Could not decode json: %s\n", res);
     printError("This seems to be a bug. Please hand in a bug report.\n");
@@ -16,12 +19,12 @@ char* parseForConfig(char* res) {
     return NULL;
   }
   secFree(res);
-  KEY_VALUE_VARS(oidc_errno, config);
+  KEY_VALUE_VARS(oidc_errno, account);
   if (_oidc_errno) {
     oidc_errno = strToInt(_oidc_errno);
     secFree(_oidc_errno);
   }
-  return _config;
+  return _account;
 }
 
 char* parseForInfo(char* res) {
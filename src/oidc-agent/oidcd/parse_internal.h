@@ -3,7 +3,7 @@
 
 #include "utils/oidc_error.h"
 
-char*        parseForConfig(char* res);
+char*        parseForAccountData(char* res);
 char*        parseForInfo(char* res);
 oidc_error_t parseForErrorCode(char* res);
 
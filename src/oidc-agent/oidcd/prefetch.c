@@ -0,0 +1,209 @@
+#include "prefetch.h"
+#include "account/account.h"
+#include "account/tokenIndex.h"
+#include "defines/agent_values.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "oidc-agent/oidcd/tokenPredictor.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <stdint.h>
+
+/**
+ * Tokens that were returned although they were not valid for the requested
+ * time (stale-ok requests); they are refreshed as soon as oidcd is idle.
+ */
+struct scheduledRefresh {
+  char* shortname;
+  char* scope;
+  char* audience;
+};
+
+static list_t* scheduled = NULL;
+
+/**
+ * After a resume the refresh time of many tokens has passed during the
+ * suspend. Instead of refreshing them all at once, each of these refreshes is
+ * delayed to a random point within @c RESUME_STAGGER_WINDOW seconds after the
+ * resume.
+ */
+static time_t   resumedAt  = 0;
+static uint64_t resumeSeed = 0;
+
+static void _secFreeScheduledRefresh(struct scheduledRefresh* r) {
+  secFree(r->shortname);
+  secFree(r->scope);
+  secFree(r->audience);
+  secFree(r);
+}
+
+static int _matchScheduledRefresh(const struct scheduledRefresh* a,
+                                  const struct scheduledRefresh* b) {
+  return strequal(a->shortname, b->shortname) && strequal(a->scope, b->scope) &&
+         strequal(a->audience, b->audience);
+}
+
+/**
+ * @brief schedules a background refresh of the access token of an account for
+ * the given @p scope and @p audience
+ */
+void prefetch_scheduleRefresh(const char* shortname, const char* scope,
+                              const char* audience) {
+  if (scheduled == NULL) {
+    scheduled        = list_new();
+    scheduled->free  = (void (*)(void*))_secFreeScheduledRefresh;
+    scheduled->match = (matchFunction)_matchScheduledRefresh;
+  }
+  struct scheduledRefresh* r = secAlloc(sizeof(struct scheduledRefresh));
+  r->shortname               = oidc_strcopy(shortname);
+  r->scope                   = strValid(scope) ? oidc_strcopy(scope) : NULL;
+  r->audience = strValid(audience) ? oidc_strcopy(audience) : NULL;
+  if (findInList(scheduled, r)) {
+    _secFreeScheduledRefresh(r);
+    return;
+  }
+  agent_log(DEBUG, "Scheduled background refresh for '%s'", shortname);
+  list_rpush(scheduled, list_node_new(r));
+}
+
+static void _refreshScheduledTokens(struct ipcPipe pipes) {
+  if (scheduled == NULL) {
+    return;
+  }
+  list_node_t* node;
+  while ((node = list_lpop(scheduled))) {
+    struct scheduledRefresh* r       = node->val;
+    struct oidc_account*     account = db_findAccountByShortname(r->shortname);
+    if (account != NULL) {
+      agent_log(DEBUG, "Refreshing stale access token for '%s'", r->shortname);
+      account            = db_getAccountDecrypted(account);
+      char* access_token = getAccessTokenUsingRefreshFlow(
+          account, FORCE_NEW_TOKEN, r->scope, r->audience, pipes);
+      db_addAccountEncrypted(account);  // reencrypting
+      if (access_token == NULL) {
+        agent_log(NOTICE, "Background refresh for '%s' failed: %s",
+                  r->shortname, oidc_serror());
+      }
+    }
+    _secFreeScheduledRefresh(r);
+    LIST_FREE(node);
+  }
+}
+
+/**
+ * @brief returns the point in time when the default access token of an account
+ * should be refreshed in the background
+ * Only the token index is read here.
+ * @param i the index of the token in @p idx
+ * @return the point in time or @c 0 if the token should not be refreshed
+ */
+static time_t _prefetchTime(const struct tokenIndex* idx, size_t i,
+                            unsigned char percent) {
+  unsigned long issued_at  = idx->issued_at[i];
+  unsigned long expires_at = idx->expires_at[i];
+  if (idx->keys[i] != TOKEN_INDEX_DEFAULT_KEY || issued_at == 0 ||
+      expires_at <= issued_at) {
+    return 0;
+  }
+  time_t t = issued_at + (expires_at - issued_at) * percent / 100;
+  if (resumedAt == 0 || t > resumedAt) {
+    return t;
+  }
+  uint64_t hash = ((uintptr_t)idx->accounts[i] ^ resumeSeed) * 1099511628211ULL;
+  return resumedAt + (time_t)((hash >> 32) % RESUME_STAGGER_WINDOW);
+}
+
+/**
+ * @brief spreads the refreshes that became due while the system was suspended
+ * over the next @c RESUME_STAGGER_WINDOW seconds
+ */
+void prefetch_staggerAfterResume() {
+  resumedAt  = time(NULL);
+  resumeSeed = ((uint64_t)randombytes_random() << 32) | randombytes_random();
+}
+
+/**
+ * @brief returns the next point in time when an access token should be
+ * refreshed in the background
+ * @param percent the percentage of the token lifetime after which a token is
+ * refreshed
+ * @return the point in time or @c 0 if there is no such token
+ */
+time_t prefetch_getNextTime(unsigned char percent) {
+  if (agent_state.lock_state.locked) {
+    return 0;
+  }
+  if (scheduled != NULL && scheduled->len > 0) {
+    return time(NULL);
+  }
+  if (percent == 0) {
+    return 0;
+  }
+  const struct tokenIndex* idx = tokenIndex_get();
+  time_t                   min = tokenPredictor_getNextTime();
+  for (size_t i = 0; i < idx->len; i++) {
+    time_t t = _prefetchTime(idx, i, percent);
+    // the account is only read for tokens that would be refreshed earlier
+    if (t > 0 && (min == 0 || t < min) &&
+        account_refreshTokenIsValid(idx->accounts[i])) {
+      min = t;
+    }
+  }
+  return min;
+}
+
+/**
+ * @brief refreshes all access tokens that passed @p percent of their lifetime
+ * If a refresh fails, the token is not refreshed in the background again; the
+ * next token request will refresh it as usual.
+ * Tokens scheduled with @c prefetch_scheduleRefresh are refreshed first, then
+ * the tokens that are likely to be requested soon, see tokenPredictor.c.
+ * @param pipes the pipes used for internal requests; they should be tagged
+ * with @c IPC_TAG_INTERNAL
+ */
+void prefetch_refreshDueTokens(struct ipcPipe pipes, unsigned char percent) {
+  if (agent_state.lock_state.locked) {
+    return;
+  }
+  _refreshScheduledTokens(pipes);
+  if (percent == 0) {
+    return;
+  }
+  tokenPredictor_prefetchDue(pipes);
+  // collected first, because a refresh changes the token index
+  const struct tokenIndex* idx = tokenIndex_get();
+  time_t                   now = time(NULL);
+  list_t*                  due = list_new();
+  for (size_t i = 0; i < idx->len; i++) {
+    time_t t = _prefetchTime(idx, i, percent);
+    if (t > 0 && t <= now && account_refreshTokenIsValid(idx->accounts[i])) {
+      list_rpush(due, list_node_new((void*)idx->accounts[i]));
+    }
+  }
+  list_node_t* node;
+  while ((node = list_lpop(due))) {
+    struct oidc_account* account = node->val;
+    LIST_FREE(node);
+    agent_log(DEBUG, "Refreshing access token for '%s' in the background",
+              account_getName(account));
+    account = db_getAccountDecrypted(account);
+    char* access_token =
+        getAccessTokenUsingRefreshFlow(account, FORCE_NEW_TOKEN, NULL, NULL,
+                                       pipes);
+    db_addAccountEncrypted(account);  // reencrypting
+    if (access_token == NULL) {
+      agent_log(NOTICE, "Background refresh for '%s' failed: %s",
+                account_getName(account), oidc_serror());
+      account_setTokenIssuedAt(account, 0);
+    }
+  }
+  secFreeList(due);
+}
@@ -0,0 +1,14 @@
+#ifndef OIDCD_PREFETCH_H
+#define OIDCD_PREFETCH_H
+
+#include "ipc/pipe.h"
+
+#include <time.h>
+
+time_t prefetch_getNextTime(unsigned char percent);
+void   prefetch_refreshDueTokens(struct ipcPipe pipes, unsigned char percent);
+void   prefetch_scheduleRefresh(const char* shortname, const char* scope,
+                                const char* audience);
+void   prefetch_staggerAfterResume();
+
+#endif  // OIDCD_PREFETCH_H
@@ -0,0 +1,208 @@
+#include "prefetchHints.h"
+#include "account/account.h"
+#include "account/tokenCache.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * Clients that know when they will need a token, e.g. a workflow manager that
+ * starts a job, send a prefetch hint with the account, scope, audience and the
+ * time window of the need. From @c PREFETCH_HINT_LEAD_TIME seconds before the
+ * window until its end the token is kept valid for at least
+ * @c PREFETCH_HINT_MIN_VALID seconds, so that the token requests of the job
+ * are answered from the cache, even if many jobs start at once.
+ * Hints are kept per user; a hint for the same token replaces the previous
+ * one.
+ */
+
+struct prefetchHint {
+  char*  shortname;
+  char*  scope;
+  char*  audience;
+  uid_t  tenant;
+  time_t from;
+  time_t until;
+  time_t not_before;  // the next refresh attempt
+};
+
+static list_t* hints = NULL;
+
+static void _secFreePrefetchHint(struct prefetchHint* h) {
+  secFree(h->shortname);
+  secFree(h->scope);
+  secFree(h->audience);
+  secFree(h);
+}
+
+static int _matchPrefetchHint(const struct prefetchHint* a,
+                              const struct prefetchHint* b) {
+  return a->tenant == b->tenant && strequal(a->shortname, b->shortname) &&
+         strequal(a->scope, b->scope) && strequal(a->audience, b->audience);
+}
+
+/**
+ * @brief adds a prefetch hint for the current tenant
+ * @param when the point in time from which on the token is needed; might be
+ * in the past
+ * @param duration the seconds for which the token is needed
+ * @return @c OIDC_SUCCESS or an error code if the hint was not accepted
+ */
+oidc_error_t prefetchHints_add(const char* shortname, const char* scope,
+                               const char* audience, time_t when,
+                               time_t duration) {
+  if (shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  time_t now = time(NULL);
+  if (duration <= 0 || when + duration <= now ||
+      when > now + PREFETCH_HINT_MAX_AHEAD) {
+    oidc_seterror("The time window of the prefetch hint is invalid");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  if (duration > PREFETCH_HINT_MAX_DURATION) {
+    duration = PREFETCH_HINT_MAX_DURATION;
+  }
+  if (hints == NULL) {
+    hints        = list_new();
+    hints->free  = (void (*)(void*))_secFreePrefetchHint;
+    hints->match = (matchFunction)_matchPrefetchHint;
+  }
+  struct prefetchHint* h = secAlloc(sizeof(struct prefetchHint));
+  h->shortname           = oidc_strcopy(shortname);
+  h->scope               = strValid(scope) ? oidc_strcopy(scope) : NULL;
+  h->audience            = strValid(audience) ? oidc_strcopy(audience) : NULL;
+  h->tenant              = accounts_getTenant();
+  h->from                = when;
+  h->until               = when + duration;
+  list_node_t* old       = findInList(hints, h);
+  if (old) {
+    list_remove(hints, old);
+  } else if (hints->len >= PREFETCH_HINTS_MAX) {
+    _secFreePrefetchHint(h);
+    oidc_seterror("Too many prefetch hints");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  agent_log(DEBUG, "Keeping a token of '%s' valid from %lu to %lu", shortname,
+            (unsigned long)h->from, (unsigned long)h->until);
+  list_rpush(hints, list_node_new(h));
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the account of a hint
+ * @return the memory encrypted account or @c NULL if it is not loaded
+ */
+static struct oidc_account* _findAccount(const struct prefetchHint* h) {
+  uid_t tenant = accounts_getTenant();
+  accounts_setTenant(h->tenant);
+  struct oidc_account* account = db_findAccountByShortname(h->shortname);
+  accounts_setTenant(tenant);
+  return account;
+}
+
+/**
+ * @brief returns when the token of a hint has to be refreshed
+ * @return the point in time or @c 0 if the token does not have to be
+ * refreshed within the window anymore
+ */
+static time_t _dueTime(const struct prefetchHint* h,
+                       const struct oidc_account* account) {
+  time_t due = h->from - PREFETCH_HINT_LEAD_TIME;
+  time_t expires_at =
+      account_getTokenExpiresAtFor(account, h->scope, h->audience);
+  if (expires_at &&
+      expires_at - PREFETCH_HINT_MIN_VALID - PREFETCH_HINT_LEAD_TIME > due) {
+    due = expires_at - PREFETCH_HINT_MIN_VALID - PREFETCH_HINT_LEAD_TIME;
+  }
+  if (h->not_before > due) {
+    due = h->not_before;
+  }
+  return due < h->until ? due : 0;
+}
+
+/**
+ * @brief returns the next point in time when a hinted token has to be
+ * refreshed
+ * @return the point in time or @c 0 if there is no such token
+ */
+time_t prefetchHints_getNextTime() {
+  if (hints == NULL || agent_state.lock_state.locked) {
+    return 0;
+  }
+  time_t           min = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(hints, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct oidc_account* account = _findAccount(node->val);
+    time_t               t       = account ? _dueTime(node->val, account) : 0;
+    if (t > 0 && (min == 0 || t < min)) {
+      min = t;
+    }
+  }
+  list_iterator_destroy(it);
+  return min;
+}
+
+static void _refresh(struct prefetchHint* h, struct oidc_account* account,
+                     struct ipcPipe pipes) {
+  agent_log(DEBUG, "Refreshing hinted access token for '%s'", h->shortname);
+  uid_t tenant = accounts_getTenant();
+  accounts_setTenant(h->tenant);
+  account            = db_getAccountDecrypted(account);
+  char* access_token = getAccessTokenUsingRefreshFlow(
+      account, PREFETCH_HINT_MIN_VALID + PREFETCH_HINT_LEAD_TIME, h->scope,
+      h->audience, pipes);
+  db_addAccountEncrypted(account);  // reencrypting
+  accounts_setTenant(tenant);
+  if (access_token == NULL) {
+    agent_log(NOTICE, "Refreshing hinted access token for '%s' failed: %s",
+              h->shortname, oidc_serror());
+  }
+}
+
+/**
+ * @brief refreshes the hinted tokens that are due
+ * Hints whose window ended or whose account is not loaded anymore are
+ * forgotten. After an attempt the token of a hint is not refreshed again for
+ * @c PREFETCH_HINT_RETRY seconds, e.g. if the refresh failed or the provider
+ * issues tokens with a short lifetime.
+ * @param pipes the pipes used for internal requests; they should be tagged
+ * with @c IPC_TAG_INTERNAL
+ */
+void prefetchHints_runDue(struct ipcPipe pipes) {
+  if (hints == NULL || agent_state.lock_state.locked) {
+    return;
+  }
+  time_t           now = time(NULL);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(hints, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct prefetchHint* h       = node->val;
+    struct oidc_account* account = _findAccount(h);
+    if (account == NULL || h->until <= now) {
+      list_remove(hints, node);
+      continue;
+    }
+    time_t due = _dueTime(h, account);
+    if (due > 0 && due <= now) {
+      h->not_before = now + PREFETCH_HINT_RETRY;
+      _refresh(h, account, pipes);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+void prefetchHints_clear() {
+  secFreeList(hints);
+  hints = NULL;
+}
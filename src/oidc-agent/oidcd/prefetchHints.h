@@ -0,0 +1,16 @@
+#ifndef OIDCD_PREFETCH_HINTS_H
+#define OIDCD_PREFETCH_HINTS_H
+
+#include "ipc/pipe.h"
+#include "utils/oidc_error.h"
+
+#include <time.h>
+
+oidc_error_t prefetchHints_add(const char* shortname, const char* scope,
+                               const char* audience, time_t when,
+                               time_t duration);
+time_t       prefetchHints_getNextTime();
+void         prefetchHints_runDue(struct ipcPipe pipes);
+void         prefetchHints_clear();
+
+#endif  // OIDCD_PREFETCH_HINTS_H
@@ -0,0 +1,182 @@
+#include "refreshKeepalive.h"
+#include "account/account.h"
+#include "defines/agent_values.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "oidc-agent/oidcd/accountStats.h"
+#include "oidc-agent/oidcd/addValidation.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+#include <sodium.h>
+#include <stdint.h>
+
+/**
+ * Many providers let refresh tokens expire when they were not used for some
+ * time (sliding lifetime). An account whose refresh token lapsed has to be
+ * re-authorized by the user, which is far more expensive than a refresh. With
+ * a keepalive interval, every loaded account whose refresh token was not used
+ * for that long is refreshed in the background. The point in time is moved
+ * forward by a random offset of up to @c KEEPALIVE_JITTER_PERCENT of the
+ * interval per account, so that accounts loaded together are not refreshed
+ * together. The refreshes are internal requests and therefore skipped by the
+ * per-issuer rate limit when the provider is busy (see issuerRateLimit.c);
+ * skipped refreshes are tried again on the next sweep. Accounts whose refresh
+ * failed otherwise are left alone for @c KEEPALIVE_RETRY seconds.
+ */
+
+struct keepaliveFailure {
+  char*  shortname;
+  time_t retry_at;
+};
+
+static time_t         interval = 0;
+static uint64_t       seed     = 0;
+static struct ipcPipe internalPipes;
+static list_t*        failures = NULL;
+
+static void _secFreeKeepaliveFailure(struct keepaliveFailure* f) {
+  secFree(f->shortname);
+  secFree(f);
+}
+
+static int _matchKeepaliveFailure(const char*                    shortname,
+                                  const struct keepaliveFailure* f) {
+  return strequal(shortname, f->shortname);
+}
+
+static void _recordFailure(const char* shortname, time_t now) {
+  if (failures == NULL) {
+    failures        = list_new();
+    failures->free  = (void (*)(void*))_secFreeKeepaliveFailure;
+    failures->match = (matchFunction)_matchKeepaliveFailure;
+  }
+  list_node_t* node = findInList(failures, shortname);
+  if (node) {
+    ((struct keepaliveFailure*)node->val)->retry_at = now + KEEPALIVE_RETRY;
+    return;
+  }
+  struct keepaliveFailure* f = secAlloc(sizeof(struct keepaliveFailure));
+  f->shortname               = oidc_strcopy(shortname);
+  f->retry_at                = now + KEEPALIVE_RETRY;
+  list_rpush(failures, list_node_new(f));
+}
+
+/**
+ * @brief forgets the failures whose retry time passed
+ */
+static void _forgetFailures(time_t now) {
+  if (failures == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(failures, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (((struct keepaliveFailure*)node->val)->retry_at <= now) {
+      list_remove(failures, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief returns the random offset by which the keepalive of an account is
+ * moved forward; it is the same for an account while the agent runs
+ */
+static time_t _jitter(const char* shortname) {
+  time_t max = interval * KEEPALIVE_JITTER_PERCENT / 100;
+  if (max == 0) {
+    return 0;
+  }
+  uint64_t hash = 14695981039346656037ULL ^ seed;
+  for (const char* c = shortname; c && *c; c++) {
+    hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+  }
+  return (time_t)((hash >> 32) % (uint64_t)max);
+}
+
+static int _isDue(const struct oidc_account* account, time_t now) {
+  const char* name  = account_getName(account);
+  time_t      since = accountStats_getRefreshIdleSince(name);
+  if (since == 0) {  // e.g. restored from a snapshot
+    accountStats_recordLoad(name);
+    return 0;
+  }
+  return now - since >= interval - _jitter(name) &&
+         findInList(failures, name) == NULL && !addValidation_isPending(name) &&
+         account_refreshTokenIsValid(account);
+}
+
+/**
+ * @brief refreshes the accounts whose refresh token was not used for the
+ * keepalive interval
+ * Nothing is refreshed while the agent is locked.
+ */
+static void _refreshDueAccounts(time_t now) {
+  if (agent_state.lock_state.locked) {
+    return;
+  }
+  // collected first, because a refresh changes the account db
+  const vector_t* accounts = accountDB_getList();
+  list_t*         due      = list_new();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    struct oidc_account* account = vector_at(accounts, i);
+    if (_isDue(account, now)) {
+      list_rpush(due, list_node_new(account));
+    }
+  }
+  list_node_t* node;
+  while ((node = list_lpop(due))) {
+    struct oidc_account* account = node->val;
+    LIST_FREE(node);
+    agent_log(DEBUG, "Keeping the refresh token of '%s' alive",
+              account_getName(account));
+    account            = db_getAccountDecrypted(account);
+    char* access_token = getAccessTokenUsingRefreshFlow(
+        account, FORCE_NEW_TOKEN, NULL, NULL, internalPipes);
+    db_addAccountEncrypted(account);  // reencrypting
+    if (access_token == NULL && oidc_errno != OIDC_EISSUERRATE) {
+      agent_log(NOTICE, "Refresh token keepalive for '%s' failed: %s",
+                account_getName(account), oidc_serror());
+      _recordFailure(account_getName(account), now);
+    }
+  }
+  secFreeList(due);
+}
+
+/**
+ * @brief refreshes the due accounts; called by the timer wheel every
+ * @c KEEPALIVE_SWEEP_INTERVAL seconds
+ */
+static void _sweep(void* arg) {
+  (void)arg;
+  time_t now = time(NULL);
+  timerWheel_add(now + KEEPALIVE_SWEEP_INTERVAL, _sweep, NULL);
+  _forgetFailures(now);
+  _refreshDueAccounts(now);
+}
+
+/**
+ * @brief starts keeping the refresh tokens of the loaded accounts alive
+ * @param keepalive_interval the seconds after which an unused refresh token is
+ * used; @c 0 if refresh tokens are not kept alive
+ * @param pipes the pipes used for internal requests; they should be tagged
+ * with @c IPC_TAG_INTERNAL
+ */
+void refreshKeepalive_start(time_t keepalive_interval, struct ipcPipe pipes) {
+  if (keepalive_interval == 0 || interval != 0) {
+    return;
+  }
+  interval      = keepalive_interval;
+  internalPipes = pipes;
+  seed = ((uint64_t)randombytes_random() << 32) | randombytes_random();
+  timerWheel_add(time(NULL) + KEEPALIVE_SWEEP_INTERVAL, _sweep, NULL);
+}
@@ -0,0 +1,10 @@
+#ifndef OIDCD_REFRESH_KEEPALIVE_H
+#define OIDCD_REFRESH_KEEPALIVE_H
+
+#include "ipc/pipe.h"
+
+#include <time.h>
+
+void refreshKeepalive_start(time_t interval, struct ipcPipe pipes);
+
+#endif  // OIDCD_REFRESH_KEEPALIVE_H
@@ -0,0 +1,232 @@
+#include "refreshTokenPool.h"
+#include "account/accountCodec.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/openid_config.h"
+#include "oidc-agent/oidc/flows/tokenExchange.h"
+#include "oidc-agent/oidcd/internal_request_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/db/account_db.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * A worker refreshes one token at a time, so all scoped tokens of an account
+ * are obtained one after the other, even with many workers. An account can
+ * therefore keep a pool of further refresh tokens, each obtained by exchanging
+ * its refresh token (RFC 8693) and thus a grant of its own that is refreshed
+ * and rotated independently. The size of the pool is set with oidc-gen
+ * --rt-pool and the tokens are kept in the config file.
+ *
+ * When the account is loaded, the pool is filled and every token of the pool
+ * is handed over to oidcp as a lane: a copy of the account that uses this
+ * token and knows its slot in the pool. oidcp loads the lanes into the other
+ * workers and spreads the requests for scoped tokens over the account and its
+ * lanes; see oidcp/refreshTokenLanes.c. The loaded account does not keep the
+ * pool. A rotated refresh token of a lane is written to its slot of the pool.
+ */
+
+static list_t* queued = NULL;  // lane notifications not yet applied
+
+/**
+ * @brief brings the refresh token pool of @p account to its size
+ * @param account the account with decrypted sensitive values
+ * @param persist if the new refresh tokens are passed to oidcp to be written
+ * to the config file; not needed while the account is generated, because
+ * oidc-gen writes the config file itself
+ */
+void rtPool_fill(struct ipcPipe pipes, struct oidc_account* account,
+                 int persist) {
+  size_t size = account_getRefreshTokenPoolSize(account);
+  if (account_getRefreshTokenSlot(account) ||
+      !strValid(account_getRefreshToken(account))) {
+    return;
+  }
+  if (size <= 1) {  // the pool was shrunk
+    account_setRefreshTokenPool(account, NULL);
+    return;
+  }
+  if (size > AGENT_MAX_WORKERS) {  // there cannot be more lanes
+    size = AGENT_MAX_WORKERS;
+  }
+  list_t* pool = account_getRefreshTokenPool(account);
+  if (pool == NULL) {
+    pool = createList(1, NULL);
+    account_setRefreshTokenPool(account, pool);
+  }
+  while (pool->len + 1 > size) {
+    list_remove(pool, pool->tail);
+  }
+  while (pool->len + 1 < size) {
+    char* refresh_token = tokenExchangeRefreshTokenFlow(account);
+    if (refresh_token == NULL) {
+      agent_log(NOTICE, "Could not fill the refresh token pool of '%s': %s",
+                account_getName(account), oidc_serror());
+      return;
+    }
+    list_rpush(pool, list_node_new(refresh_token));
+    if (persist) {
+      oidcd_handleUpdateRefreshToken(pipes, account_getName(account),
+                                     pool->len, refresh_token);
+    }
+  }
+}
+
+/**
+ * @brief returns the compact string of the lane of @p account that uses
+ * @p refresh_token
+ * @return a pointer to the string; has to be freed after usage
+ */
+static char* _laneData(const struct oidc_account* account, size_t slot,
+                       const char* refresh_token) {
+  char*                data = accountToCompactString(account);
+  struct oidc_account* lane = data ? getAccountFromCompactString(data) : NULL;
+  secFree(data);
+  if (lane == NULL) {
+    return NULL;
+  }
+  account_setRefreshToken(lane, oidc_strcopy(refresh_token));
+  account_setRefreshTokenPool(lane, NULL);
+  account_setRefreshTokenPoolSize(lane, 0);
+  account_setRefreshTokenSlot(lane, slot);
+  data = accountToCompactString(lane);
+  secFreeAccount(lane);
+  return data;
+}
+
+/**
+ * @brief passes the refresh token pool of @p account to oidcp, that loads a
+ * lane for every token into another worker, and drops the pool from
+ * @p account
+ * Nothing is passed in multi-user mode, because short names are not unique.
+ * @param account the account with decrypted sensitive values
+ */
+void rtPool_handOver(struct ipcPipe pipes, struct oidc_account* account) {
+  list_t* pool = account_getRefreshTokenPool(account);
+  if (pool == NULL) {
+    return;
+  }
+  if (!agent_state.multi_user && pipes.tx >= 0) {
+    cJSON*           lanes = cJSON_CreateArray();
+    size_t           slot  = 0;
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(pool, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      char* data = _laneData(account, ++slot, node->val);
+      if (data == NULL) {  // oidcp takes the slot from the position
+        break;
+      }
+      cJSON* lane =
+          generateJSONObject(INT_IPC_KEY_ACCOUNT, cJSON_String, data, NULL);
+      jsonAddNumberValue(lane, IPC_KEY_CONFIRM,
+                         account_getConfirmationRequired(account));
+      jsonAddNumberValue(lane, IPC_KEY_ALWAYSALLOWID,
+                         account_getAlwaysAllowId(account));
+      jsonAddNumberValue(lane, INT_IPC_KEY_DEATH, account_getDeath(account));
+      cJSON_AddItemToArray(lanes, lane);
+      secFree(data);
+    }
+    list_iterator_destroy(it);
+    cJSON* json =
+        generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                           INT_NOTIFY_VALUE_RTPOOL, IPC_KEY_SHORTNAME,
+                           cJSON_String, account_getName(account), NULL);
+    jsonAddJSON(json, INT_IPC_KEY_ACCOUNTS, lanes);
+    char* msg = jsonToStringUnformatted(json);
+    secFreeJson(json);
+    if (ipc_writeToPipe(ipc_tagPipe(pipes, IPC_TAG_NOTIFY), "%s", msg) !=
+        OIDC_SUCCESS) {
+      agent_log(ERROR, "Could not pass the refresh token pool to oidcp: %s",
+                oidc_serror());
+    }
+    secFree(msg);
+  }
+  account_setRefreshTokenPool(account, NULL);
+}
+
+/**
+ * @brief loads the lane of a notification of oidcp
+ * A lane does not replace the account itself, if that is loaded in this
+ * worker.
+ */
+static void _addLane(const char* notification) {
+  INIT_KEY_VALUE(INT_IPC_KEY_ACCOUNT, IPC_KEY_CONFIRM, IPC_KEY_ALWAYSALLOWID,
+                 INT_IPC_KEY_DEATH);
+  if (CALL_GETJSONVALUES(notification) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(account_data, confirm, always_allow_id, death);
+  struct oidc_account* lane =
+      _account_data ? getAccountFromCompactString(_account_data) : NULL;
+  if (lane == NULL || getIssuerConfig(lane) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not load a refresh token lane: %s", oidc_serror());
+    secFreeAccount(lane);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  account_setDeath(lane, _death ? strToULong(_death) : 0);
+  if (strToInt(_confirm)) {
+    account_setConfirmationRequired(lane);
+  }
+  if (strToInt(_always_allow_id)) {
+    account_setAlwaysAllowId(lane);
+  }
+  SEC_FREE_KEY_VALUES();
+  struct oidc_account* found = db_findAccountByShortname(account_getName(lane));
+  if (found && account_getRefreshTokenSlot(found) == 0) {
+    secFreeAccount(lane);
+    return;
+  }
+  agent_log(DEBUG, "Loading refresh token lane %lu of '%s'",
+            account_getRefreshTokenSlot(lane), account_getName(lane));
+  db_addAccountEncrypted(lane);
+}
+
+static void _dropLane(const char* shortname) {
+  struct oidc_account* found = db_findAccountByShortname(shortname);
+  if (found && account_getRefreshTokenSlot(found)) {
+    agent_log(DEBUG, "Dropping refresh token lane of '%s'", shortname);
+    accountDB_removeIfFound(found);
+  }
+}
+
+/**
+ * @brief keeps a lane notification of oidcp until @c rtPool_applyQueued
+ * Notifications also arrive while a request is in progress, which might use
+ * the lane that would be replaced.
+ */
+void rtPool_queue(const char* notification) {
+  if (queued == NULL) {
+    queued       = list_new();
+    queued->free = _secFree;
+  }
+  list_rpush(queued, list_node_new(oidc_strcopy(notification)));
+}
+
+/**
+ * @brief loads or drops the lanes of the queued notifications
+ */
+void rtPool_applyQueued() {
+  list_node_t* node;
+  while (queued && (node = list_lpop(queued))) {
+    char* notification = node->val;
+    LIST_FREE(node);
+    char* request   = getJSONValueFromString(notification, IPC_KEY_REQUEST);
+    char* shortname = getJSONValueFromString(notification, IPC_KEY_SHORTNAME);
+    if (strequal(request, INT_NOTIFY_VALUE_RTPOOL_LANE)) {
+      _addLane(notification);
+    } else if (strValid(shortname)) {
+      _dropLane(shortname);
+    }
+    secFree(request);
+    secFree(shortname);
+    secFree(notification);
+  }
+}
@@ -0,0 +1,13 @@
+#ifndef OIDCD_REFRESH_TOKEN_POOL_H
+#define OIDCD_REFRESH_TOKEN_POOL_H
+
+#include "account/account.h"
+#include "ipc/pipe.h"
+
+void rtPool_fill(struct ipcPipe pipes, struct oidc_account* account,
+                 int persist);
+void rtPool_handOver(struct ipcPipe pipes, struct oidc_account* account);
+void rtPool_queue(const char* notification);
+void rtPool_applyQueued();
+
+#endif  // OIDCD_REFRESH_TOKEN_POOL_H
@@ -0,0 +1,196 @@
+#include "revocationQueue.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "oidc-agent/http/http.h"
+#include "oidc-agent/oidc/flows/oidc.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/parseJson.h"
+#include "utils/stringUtils.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Refresh tokens of removed accounts are revoked in the background, so that
+ * removing many accounts does not block oidcd. The needed values are copied
+ * from the accounts, which can be removed immediately. @c revocationQueue_run
+ * starts up to @c REVOCATION_MAX_PER_ISSUER processes per issuer, each revoking
+ * its share of the tokens of that issuer one after another. Failed revocations
+ * are retried unless the provider rejected them.
+ */
+
+struct revocation {
+  char*               issuer_url;
+  char*               endpoint;
+  char*               cert_path;
+  char*               client_id;
+  char*               client_secret;
+  char*               refresh_token;
+  struct http_options options;
+};
+
+static list_t* queue = NULL;
+
+static void _secFreeRevocation(struct revocation* r) {
+  secFree(r->issuer_url);
+  secFree(r->endpoint);
+  secFree(r->cert_path);
+  secFree(r->client_id);
+  secFree(r->client_secret);
+  secFree(r->refresh_token);
+  secFree(r);
+}
+
+/**
+ * @brief queues the revocation of the refresh token of @p account
+ * @param account a decrypted account
+ */
+void revocationQueue_add(const struct oidc_account* account) {
+  if (!strValid(account_getRefreshToken(account))) {
+    return;
+  }
+  if (!strValid(account_getRevocationEndpoint(account))) {
+    agent_log(NOTICE, "Cannot revoke refresh token of '%s': %s",
+              account_getName(account), "No revocation endpoint");
+    return;
+  }
+  if (queue == NULL) {
+    queue       = list_new();
+    queue->free = (void (*)(void*))_secFreeRevocation;
+  }
+  struct revocation* r = secAlloc(sizeof(struct revocation));
+  r->issuer_url        = oidc_strcopy(account_getIssuerUrl(account));
+  r->endpoint          = oidc_strcopy(account_getRevocationEndpoint(account));
+  r->cert_path         = oidc_strcopy(account_getCertPath(account));
+  r->client_id         = oidc_strcopy(account_getClientId(account));
+  r->client_secret     = oidc_strcopy(account_getClientSecret(account));
+  r->refresh_token     = oidc_strcopy(account_getRefreshToken(account));
+  r->options           = getHttpOptions(account, 0);
+  list_rpush(queue, list_node_new(r));
+}
+
+/**
+ * @brief revokes a single refresh token
+ * @return @c OIDC_SUCCESS, or an error; @c oidc_errno is @c OIDC_EOIDC if the
+ * provider rejected the revocation, so it should not be retried
+ */
+static oidc_error_t _revoke(const struct revocation* r) {
+  char* data = generatePostData(OIDC_KEY_TOKENTYPE_HINT, OIDC_TOKENTYPE_REFRESH,
+                                OIDC_KEY_TOKEN, r->refresh_token, NULL);
+  if (data == NULL) {
+    return oidc_errno;
+  }
+  char* res = _httpsPOST(r->endpoint, data, NULL, r->cert_path, r->client_id,
+                         r->client_secret, &r->options);
+  secFree(data);
+  if (res == NULL) {
+    return oidc_errno;
+  }
+  char* error = parseForError(res);  // frees res
+  if (error) {
+    oidc_errno = OIDC_EOIDC;
+    oidc_seterror(error);
+    secFree(error);
+    return oidc_errno;
+  }
+  oidc_errno = OIDC_SUCCESS;
+  return oidc_errno;
+}
+
+static void _revokeWithRetries(const struct revocation* r) {
+  for (unsigned int attempt = 0; attempt <= REVOCATION_RETRIES; attempt++) {
+    if (attempt > 0) {
+      sleep(1 << (attempt - 1));
+    }
+    if (_revoke(r) == OIDC_SUCCESS) {
+      agent_log(DEBUG, "Revoked refresh token at %s", r->issuer_url);
+      return;
+    }
+    if (oidc_errno == OIDC_EOIDC || (oidc_errno >= 400 && oidc_errno < 500)) {
+      break;
+    }
+  }
+  agent_log(ERROR, "Could not revoke refresh token at %s: %s", r->issuer_url,
+            oidc_serror());
+}
+
+/**
+ * @brief revokes every @p n th queued token of @p issuer_url, starting with
+ * the @p offset th one; runs in a child process
+ */
+static void _revokeShare(const char* issuer_url, size_t offset, size_t n) {
+  size_t           i = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(queue, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct revocation* r = node->val;
+    if (!strequal(r->issuer_url, issuer_url)) {
+      continue;
+    }
+    if (i++ % n == offset) {
+      _revokeWithRetries(r);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+static size_t _countForIssuer(const char* issuer_url) {
+  size_t           count = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(queue, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (strequal(((struct revocation*)node->val)->issuer_url, issuer_url)) {
+      count++;
+    }
+  }
+  list_iterator_destroy(it);
+  return count;
+}
+
+/**
+ * @brief starts the revocation of all queued tokens in the background and
+ * clears the queue
+ */
+void revocationQueue_run() {
+  if (queue == NULL || queue->len == 0) {
+    return;
+  }
+  agent_log(DEBUG, "Revoking %lu refresh tokens in the background",
+            queue->len);
+  list_t* issuers  = list_new();
+  issuers->match   = (matchFunction)strequal;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(queue, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    char* issuer_url = ((struct revocation*)node->val)->issuer_url;
+    if (findInList(issuers, issuer_url) == NULL) {
+      list_rpush(issuers, list_node_new(issuer_url));
+    }
+  }
+  list_iterator_destroy(it);
+  it = list_iterator_new(issuers, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const char* issuer_url = node->val;
+    size_t      n          = _countForIssuer(issuer_url);
+    if (n > REVOCATION_MAX_PER_ISSUER) {
+      n = REVOCATION_MAX_PER_ISSUER;
+    }
+    for (size_t offset = 0; offset < n; offset++) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        agent_log(ERROR, "fork %m");
+        break;
+      }
+      if (pid == 0) {  // child
+        _revokeShare(issuer_url, offset, n);
+        _exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  list_iterator_destroy(it);
+  list_destroy(issuers);
+  secFreeList(queue);
+  queue = NULL;
+}
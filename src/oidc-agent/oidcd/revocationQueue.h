@@ -0,0 +1,9 @@
+#ifndef OIDCD_REVOCATION_QUEUE_H
+#define OIDCD_REVOCATION_QUEUE_H
+
+#include "account/account.h"
+
+void revocationQueue_add(const struct oidc_account* account);
+void revocationQueue_run();
+
+#endif  // OIDCD_REVOCATION_QUEUE_H
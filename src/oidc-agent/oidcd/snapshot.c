@@ -0,0 +1,302 @@
+#define _GNU_SOURCE  // syscall
+#include "snapshot.h"
+#include "account/account.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/openid_config.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/cryptUtils.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/crypt/kernelKeyring.h"
+#include "utils/db/account_db.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+#include <time.h>
+
+/**
+ * A snapshot holds the loaded accounts of oidcd together with their access
+ * tokens, so that a restarted agent does not have to load every account again.
+ * It is written to the oidc dir, encrypted with a random password that is only
+ * kept in the kernel keyring of the user. Both are removed when the snapshot is
+ * restored, so a snapshot is restored at most once. Every worker writes its
+ * own snapshot.
+ *
+ * The same entries are handed over to the new agent when the agent is
+ * upgraded with @c oidc-agent --upgrade; see oidcp/upgrade.c. They are also
+ * pushed to oidcp whenever the loaded accounts change, so that oidcp can
+ * restart a crashed worker with them; see oidcp/recovery.c.
+ */
+
+#define SNAPSHOT_FILENAME "agent.snapshot"
+#define SNAPSHOT_KEY_DESCRIPTION "oidc-agent:snapshot"
+#define SNAPSHOT_PASSWORD_LEN 48
+
+#define SNAPSHOT_KEY_CONFIG "config"
+#define SNAPSHOT_KEY_DEATH "death"
+#define SNAPSHOT_KEY_CONFIRM "confirm"
+#define SNAPSHOT_KEY_ALWAYSALLOWID "always_allow_id"
+#define SNAPSHOT_KEY_OWNER "owner"
+
+static char* _snapshotName(const char* base) {
+  return agent_state.worker ? oidc_sprintf("%s:%d", base, agent_state.worker)
+                            : oidc_strcopy(base);
+}
+
+/**
+ * @brief returns the snapshot entry of a loaded account
+ * The sensitive values are decrypted for the snapshot and encrypted again
+ * afterwards.
+ */
+static cJSON* _accountToSnapshotEntry(struct oidc_account* account) {
+  _db_decryptFoundAccount(account);
+  cJSON* config = accountToJSON(account);
+  db_addAccountEncrypted(account);
+  const char* at = account_getAccessToken(account);
+  if (strValid(at) &&
+      account_getTokenExpiresAt(account) > (unsigned long)time(NULL)) {
+    jsonAddStringValue(config, OIDC_KEY_ACCESSTOKEN, at);
+    jsonAddNumberValue(config, AGENT_KEY_EXPIRESAT,
+                       account_getTokenExpiresAt(account));
+  }
+  cJSON* entry = cJSON_CreateObject();
+  jsonAddNumberValue(entry, SNAPSHOT_KEY_DEATH, account_getDeath(account));
+  jsonAddNumberValue(entry, SNAPSHOT_KEY_CONFIRM,
+                     account_getConfirmationRequired(account));
+  jsonAddNumberValue(entry, SNAPSHOT_KEY_ALWAYSALLOWID,
+                     account_getAlwaysAllowId(account));
+  jsonAddNumberValue(entry, SNAPSHOT_KEY_OWNER, account_getOwner(account));
+  jsonAddJSON(entry, SNAPSHOT_KEY_CONFIG, config);
+  return entry;
+}
+
+/**
+ * @brief returns the snapshot entries of all loaded accounts
+ * @return a json array; has to be freed after usage
+ */
+cJSON* snapshot_export() {
+  cJSON*          entries  = cJSON_CreateArray();
+  const vector_t* accounts = accountDB_getList();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    cJSON_AddItemToArray(entries,
+                         _accountToSnapshotEntry(vector_at(accounts, i)));
+  }
+  return entries;
+}
+
+/**
+ * @brief writes the snapshot of the loaded accounts
+ * Only done once per process; nothing is written if the agent is locked or no
+ * account is loaded.
+ */
+void snapshot_save() {
+  static unsigned char saved = 0;
+  if (saved) {
+    return;
+  }
+  saved = 1;
+  if (agent_state.lock_state.locked) {
+    agent_log(NOTICE, "Agent is locked, not writing a snapshot");
+    return;
+  }
+  const vector_t* accounts = accountDB_getList();
+  if (accounts == NULL || accounts->len == 0) {
+    return;
+  }
+  cJSON* entries     = snapshot_export();
+  char*  entries_str = jsonToStringUnformatted(entries);
+  secFreeJson(entries);
+  char* password  = randomString(SNAPSHOT_PASSWORD_LEN);
+  char* encrypted = encryptWithVersionLine(entries_str, password);
+  secFree(entries_str);
+  char* keyName  = _snapshotName(SNAPSHOT_KEY_DESCRIPTION);
+  char* fileName = _snapshotName(SNAPSHOT_FILENAME);
+  char* path     = concatToOidcDir(fileName);
+  // written atomically, so that new files are only readable by the user
+  if (encrypted == NULL || path == NULL ||
+      kernelKeyring_store(keyName, password) != OIDC_SUCCESS ||
+      writeFileAtomic(path, encrypted) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not write snapshot: %s", oidc_serror());
+  } else {
+    agent_log(NOTICE, "Wrote snapshot of %lu accounts", accounts->len);
+  }
+  secFree(path);
+  secFree(fileName);
+  secFree(keyName);
+  secFree(encrypted);
+  secFree(password);
+}
+
+/**
+ * @brief loads an account from a snapshot entry
+ * The access token is kept if it is still valid; the account configuration is
+ * not verified with a refresh again.
+ */
+static oidc_error_t _restoreAccount(const cJSON* entry) {
+  cJSON* config = cJSON_GetObjectItemCaseSensitive(entry, SNAPSHOT_KEY_CONFIG);
+  const cJSON* death =
+      cJSON_GetObjectItemCaseSensitive(entry, SNAPSHOT_KEY_DEATH);
+  if (!cJSON_IsObject(config)) {
+    oidc_errno = OIDC_EJSONOBJ;
+    return oidc_errno;
+  }
+  if (cJSON_IsNumber(death) && death->valuedouble &&
+      death->valuedouble <= time(NULL)) {
+    return OIDC_SUCCESS;  // lifetime is over
+  }
+  char*                config_str = jsonToStringUnformatted(config);
+  struct oidc_account* account    = getAccountFromJSON(config_str);
+  secFree(config_str);
+  if (account == NULL) {
+    return oidc_errno;
+  }
+  if (cJSON_IsNumber(death)) {
+    account_setDeath(account, (time_t)death->valuedouble);
+  }
+  if (cJSON_GetNumberValue(
+          cJSON_GetObjectItemCaseSensitive(entry, SNAPSHOT_KEY_CONFIRM)) > 0) {
+    account_setConfirmationRequired(account);
+  }
+  if (cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(
+          entry, SNAPSHOT_KEY_ALWAYSALLOWID)) > 0) {
+    account_setAlwaysAllowId(account);
+  }
+  const cJSON* at =
+      cJSON_GetObjectItemCaseSensitive(config, OIDC_KEY_ACCESSTOKEN);
+  const cJSON* expires_at =
+      cJSON_GetObjectItemCaseSensitive(config, AGENT_KEY_EXPIRESAT);
+  if (cJSON_IsString(at) && cJSON_IsNumber(expires_at)) {
+    account_setAccessToken(account, oidc_strcopy(at->valuestring));
+    account_setTokenExpiresAt(account, (unsigned long)expires_at->valuedouble);
+  }
+  if (getIssuerConfig(account) != OIDC_SUCCESS) {
+    secFreeAccount(account);
+    return oidc_errno;
+  }
+  // the account is added for the user who loaded it
+  accounts_setTenant((uid_t)cJSON_GetNumberValue(
+      cJSON_GetObjectItemCaseSensitive(entry, SNAPSHOT_KEY_OWNER)));
+  db_addAccountEncrypted(account);
+  accounts_setTenant(0);
+  return OIDC_SUCCESS;
+}
+
+static size_t _restoreEntries(const cJSON* entries) {
+  size_t       restored = 0;
+  const cJSON* entry;
+  cJSON_ArrayForEach(entry, entries) {
+    if (_restoreAccount(entry) == OIDC_SUCCESS) {
+      restored++;
+    } else {
+      agent_log(ERROR, "Could not restore account from snapshot: %s",
+                oidc_serror());
+    }
+  }
+  return restored;
+}
+
+/**
+ * @brief restores the accounts of a snapshot written by @c snapshot_save
+ * The snapshot and its password are removed afterwards.
+ */
+void snapshot_restore() {
+  char* fileName = _snapshotName(SNAPSHOT_FILENAME);
+  if (!oidcFileDoesExist(fileName)) {
+    secFree(fileName);
+    return;
+  }
+  char* keyName  = _snapshotName(SNAPSHOT_KEY_DESCRIPTION);
+  char* password = kernelKeyring_take(keyName);
+  secFree(keyName);
+  char* encrypted = readOidcFile(fileName);
+  removeOidcFile(fileName);
+  secFree(fileName);
+  if (password == NULL) {
+    agent_log(NOTICE, "No password for the snapshot, not restoring it");
+    secFree(encrypted);
+    return;
+  }
+  char* entries_str =
+      encrypted ? decryptFileContent(encrypted, password) : NULL;
+  secFree(encrypted);
+  secFree(password);
+  cJSON* entries = stringToJson(entries_str);
+  secFree(entries_str);
+  if (!cJSON_IsArray(entries)) {
+    agent_log(ERROR, "Could not read snapshot: %s", oidc_serror());
+    secFreeJson(entries);
+    return;
+  }
+  size_t restored = _restoreEntries(entries);
+  secFreeJson(entries);
+  agent_log(NOTICE, "Restored %lu accounts from snapshot", restored);
+}
+
+/**
+ * @brief restores the accounts handed over by the previous agent on an upgrade
+ * or by oidcp after this worker was restarted
+ * @param handover a json array with the exported entries of every worker; this
+ * worker restores those of the worker with its index
+ */
+void snapshot_import(const char* handover) {
+  cJSON* workers = stringToJson(handover);
+  size_t restored =
+      _restoreEntries(cJSON_GetArrayItem(workers, agent_state.worker));
+  secFreeJson(workers);
+  agent_log(NOTICE, "Took over %lu accounts", restored);
+}
+
+static unsigned long  pushedGeneration = 0;
+static unsigned char  changed          = 0;
+static unsigned char  pushScheduled    = 0;
+static struct ipcPipe pushPipes;
+
+static void _push(void* arg) {
+  (void)arg;
+  pushScheduled = 0;
+  if (agent_state.lock_state.locked) {
+    return;  // oidcp dropped its copy; pushed again after unlocking
+  }
+  cJSON* entries     = snapshot_export();
+  char*  entries_str = jsonToStringUnformatted(entries);
+  secFreeJson(entries);
+  if (ipc_writeToPipe(ipc_tagPipe(pushPipes, IPC_TAG_NOTIFY),
+                      INT_NOTIFY_ACCOUNTS, entries_str) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not pass the loaded accounts to oidcp: %s",
+              oidc_serror());
+  }
+  secFree(entries_str);
+}
+
+/**
+ * @brief marks the loaded accounts as changed, e.g. because a refresh token
+ * was rotated, which does not change the account db itself
+ */
+void snapshot_markChanged() { changed = 1; }
+
+/**
+ * @brief pushes the loaded accounts to oidcp if they changed
+ * Changes within @c RECOVERY_PUSH_DELAY seconds are pushed together, so that
+ * loading many accounts does not export all of them for every single one.
+ */
+void snapshot_pushIfChanged(struct ipcPipe pipes) {
+  const unsigned long generation = accountDB_getGeneration();
+  if (!changed && generation == pushedGeneration) {
+    return;
+  }
+  changed          = 0;
+  pushedGeneration = generation;
+  if (!pushScheduled) {
+    pushScheduled = 1;
+    pushPipes     = pipes;
+    timerWheel_add(time(NULL) + RECOVERY_PUSH_DELAY, _push, NULL);
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef OIDCD_SNAPSHOT_H
+#define OIDCD_SNAPSHOT_H
+
+#include "ipc/pipe.h"
+#include "wrapper/cjson.h"
+
+cJSON* snapshot_export();
+void   snapshot_save();
+void   snapshot_restore();
+void   snapshot_import(const char* handover);
+void   snapshot_markChanged();
+void   snapshot_pushIfChanged(struct ipcPipe pipes);
+
+#endif  // OIDCD_SNAPSHOT_H
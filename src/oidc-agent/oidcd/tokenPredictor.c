@@ -0,0 +1,274 @@
+#include "tokenPredictor.h"
+#include "account/account.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidc/flows/access_token_handler.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+/**
+ * Applications often request tokens with the same scope and audience at
+ * regular intervals, e.g. an hourly sync. For every (account, application,
+ * scope, audience) the time between such requests is learned; once it was
+ * regular for @c PREDICTOR_MIN_OBSERVATIONS requests, the token is obtained
+ * @c PREDICTOR_LEAD_TIME seconds before the next request is expected, unless
+ * the cached one is still valid then. At most @c PREDICTOR_BUDGET_PER_HOUR
+ * tokens are obtained this way per hour, so that a wrong prediction cannot put
+ * load on the OpenID Provider. Requests for the default token are not
+ * recorded; it is refreshed by the fixed-fraction prefetch in prefetch.c.
+ */
+
+struct tokenPattern {
+  char*         shortname;
+  char*         application_hint;
+  char*         scope;
+  char*         audience;
+  time_t        min_valid_period;  // the largest one requested
+  time_t        last;              // when the token was requested last
+  time_t        interval;          // the learned time between requests
+  unsigned int  observations;      // regular intervals seen in a row
+  time_t        prefetched_for;    // the predicted request handled already
+};
+
+static list_t*      patterns     = NULL;
+static time_t       budget_start = 0;
+static unsigned int budget_used  = 0;
+
+static void _secFreeTokenPattern(struct tokenPattern* p) {
+  secFree(p->shortname);
+  secFree(p->application_hint);
+  secFree(p->scope);
+  secFree(p->audience);
+  secFree(p);
+}
+
+static int _matchTokenPattern(const struct tokenPattern* a,
+                              const struct tokenPattern* b) {
+  return strequal(a->shortname, b->shortname) &&
+         strequal(a->application_hint, b->application_hint) &&
+         strequal(a->scope, b->scope) && strequal(a->audience, b->audience);
+}
+
+static char* _copyIfValid(const char* str) {
+  return strValid(str) ? oidc_strcopy(str) : NULL;
+}
+
+/**
+ * @brief drops the pattern that was not requested for the longest time
+ */
+static void _dropOldest() {
+  list_node_t*     oldest = NULL;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(patterns, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (oldest == NULL || ((struct tokenPattern*)node->val)->last <
+                              ((struct tokenPattern*)oldest->val)->last) {
+      oldest = node;
+    }
+  }
+  list_iterator_destroy(it);
+  if (oldest) {
+    list_remove(patterns, oldest);
+  }
+}
+
+static void _learn(struct tokenPattern* p, time_t now) {
+  time_t gap = now - p->last;
+  p->last    = now;
+  if (gap < PREDICTOR_MIN_INTERVAL) {  // a burst of requests, not a new one
+    return;
+  }
+  if (p->observations == 0) {
+    p->interval     = gap;
+    p->observations = 1;
+    return;
+  }
+  time_t deviation = gap > p->interval ? gap - p->interval : p->interval - gap;
+  if (deviation > p->interval / 4) {  // not regular; start over
+    p->interval     = gap;
+    p->observations = 1;
+    return;
+  }
+  p->interval += (gap - p->interval) / 4;
+  p->observations++;
+}
+
+/**
+ * @brief records an access token request, so that recurring ones can be
+ * predicted
+ * @param min_valid_period the requested validity; the prefetched token is
+ * valid for at least that long after the predicted request
+ */
+void tokenPredictor_recordRequest(const char* shortname,
+                                  const char* application_hint,
+                                  const char* scope, const char* audience,
+                                  time_t min_valid_period) {
+  if (shortname == NULL || (!strValid(scope) && !strValid(audience))) {
+    return;
+  }
+  struct tokenPattern key = {.shortname        = (char*)shortname,
+                             .application_hint = (char*)application_hint,
+                             .scope            = (char*)scope,
+                             .audience         = (char*)audience};
+  if (!strValid(application_hint)) {
+    key.application_hint = NULL;
+  }
+  if (!strValid(scope)) {
+    key.scope = NULL;
+  }
+  if (!strValid(audience)) {
+    key.audience = NULL;
+  }
+  if (patterns == NULL) {
+    patterns        = list_new();
+    patterns->free  = (void (*)(void*))_secFreeTokenPattern;
+    patterns->match = (matchFunction)_matchTokenPattern;
+  }
+  time_t               now  = time(NULL);
+  list_node_t*         node = findInList(patterns, &key);
+  struct tokenPattern* p    = node ? node->val : NULL;
+  if (p == NULL) {
+    if (patterns->len >= PREDICTOR_MAX_PATTERNS) {
+      _dropOldest();
+    }
+    p                   = secAlloc(sizeof(struct tokenPattern));
+    p->shortname        = oidc_strcopy(shortname);
+    p->application_hint = _copyIfValid(application_hint);
+    p->scope            = _copyIfValid(scope);
+    p->audience         = _copyIfValid(audience);
+    p->last             = now;
+    list_rpush(patterns, list_node_new(p));
+  } else {
+    _learn(p, now);
+  }
+  if (min_valid_period > p->min_valid_period) {
+    p->min_valid_period = min_valid_period;
+  }
+}
+
+/**
+ * @brief returns the time at which the token of a pattern should be obtained
+ * @return the point in time or @c 0 if the next request is not predicted or
+ * was handled already
+ */
+static time_t _prefetchTime(const struct tokenPattern* p, time_t now) {
+  if (p->observations < PREDICTOR_MIN_OBSERVATIONS) {
+    return 0;
+  }
+  time_t predicted = p->last + p->interval;
+  if (predicted <= now || predicted == p->prefetched_for) {
+    return 0;
+  }
+  return predicted - PREDICTOR_LEAD_TIME;
+}
+
+/**
+ * @brief returns the next point in time when a token should be obtained
+ * because it is likely to be requested soon
+ * @return the point in time or @c 0 if there is no such token
+ */
+time_t tokenPredictor_getNextTime() {
+  if (patterns == NULL || agent_state.lock_state.locked) {
+    return 0;
+  }
+  time_t           now = time(NULL);
+  time_t           min = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(patterns, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    time_t t = _prefetchTime(node->val, now);
+    if (t > 0 && (min == 0 || t < min)) {
+      min = t;
+    }
+  }
+  list_iterator_destroy(it);
+  return min < now && min > 0 ? now : min;
+}
+
+static int _takeFromBudget(time_t now) {
+  if (now - budget_start >= 3600) {
+    budget_start = now;
+    budget_used  = 0;
+  }
+  if (budget_used >= PREDICTOR_BUDGET_PER_HOUR) {
+    return 0;
+  }
+  budget_used++;
+  return 1;
+}
+
+static void _prefetch(struct tokenPattern* p, time_t predicted,
+                      struct ipcPipe pipes) {
+  struct oidc_account* account = db_findAccountByShortname(p->shortname);
+  if (account == NULL) {
+    return;
+  }
+  time_t now       = time(NULL);
+  time_t min_valid = predicted - now + p->min_valid_period;
+  if (getValidCachedAccessToken(account, min_valid, p->scope, p->audience)) {
+    return;
+  }
+  if (!_takeFromBudget(now)) {
+    agent_log(DEBUG, "Prefetch budget used up, not prefetching for '%s'",
+              p->shortname);
+    return;
+  }
+  agent_log(DEBUG, "Prefetching access token for '%s' requested by '%s'",
+            p->shortname, p->application_hint);
+  account            = db_getAccountDecrypted(account);
+  char* access_token = getAccessTokenUsingRefreshFlow(
+      account, min_valid, p->scope, p->audience, pipes);
+  db_addAccountEncrypted(account);  // reencrypting
+  if (access_token == NULL) {
+    agent_log(NOTICE, "Prefetch for '%s' failed: %s", p->shortname,
+              oidc_serror());
+  }
+}
+
+/**
+ * @brief obtains the tokens that are likely to be requested within
+ * @c PREDICTOR_LEAD_TIME seconds
+ * Every predicted request is only prefetched once; patterns of accounts that
+ * are not loaded anymore are forgotten.
+ * @param pipes the pipes used for internal requests; they should be tagged
+ * with @c IPC_TAG_INTERNAL
+ */
+void tokenPredictor_prefetchDue(struct ipcPipe pipes) {
+  if (patterns == NULL || agent_state.lock_state.locked) {
+    return;
+  }
+  time_t           now = time(NULL);
+  list_t*          due = list_new();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(patterns, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct tokenPattern* p = node->val;
+    if (db_findAccountByShortname(p->shortname) == NULL) {
+      list_remove(patterns, node);
+      continue;
+    }
+    time_t t = _prefetchTime(p, now);
+    if (t > 0 && t <= now) {
+      p->prefetched_for = p->last + p->interval;
+      list_rpush(due, list_node_new(p));
+    }
+  }
+  list_iterator_destroy(it);
+  // a prefetch does not change the patterns
+  while ((node = list_lpop(due))) {
+    struct tokenPattern* p = node->val;
+    LIST_FREE(node);
+    _prefetch(p, p->prefetched_for, pipes);
+  }
+  list_destroy(due);
+}
+
+void tokenPredictor_clear() {
+  secFreeList(patterns);
+  patterns = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef OIDCD_TOKEN_PREDICTOR_H
+#define OIDCD_TOKEN_PREDICTOR_H
+
+#include "ipc/pipe.h"
+
+#include <time.h>
+
+void   tokenPredictor_recordRequest(const char* shortname,
+                                    const char* application_hint,
+                                    const char* scope, const char* audience,
+                                    time_t min_valid_period);
+time_t tokenPredictor_getNextTime();
+void   tokenPredictor_prefetchDue(struct ipcPipe pipes);
+void   tokenPredictor_clear();
+
+#endif  // OIDCD_TOKEN_PREDICTOR_H
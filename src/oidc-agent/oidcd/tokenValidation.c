@@ -0,0 +1,313 @@
+#include "tokenValidation.h"
+#include "account/account.h"
+#include "account/issuer_helper.h"
+#include "oidc-agent/oidc/flows/jwks.h"
+#include "utils/accountUtils.h"
+#include "utils/agentLogger.h"
+#include "utils/db/db_index.h"
+#include "utils/json.h"
+#include "utils/jwks.h"
+#include "utils/jwt.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <sodium.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Offline validation of JWT access and id tokens for local services. The
+ * signature is verified with the signing keys the issuer publishes at its
+ * jwks_uri; only issuers of loaded accounts are trusted. The key sets are
+ * cached per issuer for @c JWKS_CACHE_TIME seconds. Issuers rotate their keys
+ * by publishing the new key before they use it, so a token signed with a key
+ * that is not in the cached set makes the agent fetch the set again, at most
+ * every @c JWKS_MIN_REFETCH seconds; if the fetch fails, the cached keys are
+ * kept. Valid tokens are cached until they expire, identified by a keyed hash
+ * of the token and the audience, so that the agent does not keep another copy
+ * of the token. Everything is dropped when the agent is locked.
+ */
+
+#define JWKS_CACHE_TIME 3600
+#define JWKS_MIN_REFETCH 30
+#define VALIDATION_LEEWAY 30
+#define VALIDATION_CACHE_SIZE 4096
+
+struct issuerKeys {
+  char*   issuer_url;
+  list_t* keys;
+  time_t  fetched;  // the last successful fetch
+  time_t  tried;    // the last fetch
+};
+
+struct validationResult {
+  char   hash[2 * crypto_generichash_BYTES + 1];
+  char*  claims;
+  time_t exp;
+};
+
+static list_t*          issuerKeys  = NULL;
+static list_t*          resultOrder = NULL;  // oldest first; owns the results
+static struct db_index* results     = NULL;  // indexes resultOrder by hash
+static unsigned char    hashKey[crypto_generichash_KEYBYTES];
+
+static void _secFreeIssuerKeys(struct issuerKeys* k) {
+  secFree(k->issuer_url);
+  secFreeList(k->keys);
+  secFree(k);
+}
+
+static int _matchIssuerKeys(const char*              issuer_url,
+                            const struct issuerKeys* k) {
+  return compIssuerUrls(issuer_url, k->issuer_url);
+}
+
+static void _secFreeValidationResult(struct validationResult* r) {
+  secFree(r->claims);
+  secFree(r);
+}
+
+static const char* _getResultHash(const struct validationResult* r) {
+  return r->hash;
+}
+
+static void _init() {
+  if (issuerKeys != NULL) {
+    return;
+  }
+  issuerKeys        = list_new();
+  issuerKeys->free  = (void (*)(void*))_secFreeIssuerKeys;
+  issuerKeys->match = (matchFunction)_matchIssuerKeys;
+  resultOrder       = list_new();
+  resultOrder->free = (void (*)(void*))_secFreeValidationResult;
+  results = dbIndex_new((indexKeyFunction)_getResultHash, strequal);
+  randombytes_buf(hashKey, sizeof(hashKey));
+}
+
+static void _hashToken(const char* token, const char* audience, char* out) {
+  unsigned char            hash[crypto_generichash_BYTES];
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, hashKey, sizeof(hashKey), sizeof(hash));
+  crypto_generichash_update(&state, (const unsigned char*)token,
+                            strlen(token) + 1);
+  if (audience) {
+    crypto_generichash_update(&state, (const unsigned char*)audience,
+                              strlen(audience));
+  }
+  crypto_generichash_final(&state, hash, sizeof(hash));
+  sodium_bin2hex(out, 2 * sizeof(hash) + 1, hash, sizeof(hash));
+}
+
+static void _removeResult(list_node_t* node) {
+  dbIndex_remove(results, node->val);
+  list_remove(resultOrder, node);
+}
+
+static char* _getCachedResult(const char* hash, time_t now) {
+  struct validationResult* r = dbIndex_find(results, hash);
+  if (r == NULL) {
+    return NULL;
+  }
+  if (r->exp + VALIDATION_LEEWAY < now) {
+    _removeResult(list_find(resultOrder, r));
+    return NULL;
+  }
+  return oidc_strcopy(r->claims);
+}
+
+static void _cacheResult(const char* hash, const char* claims, time_t exp) {
+  while (resultOrder->len >= VALIDATION_CACHE_SIZE) {
+    _removeResult(resultOrder->head);
+  }
+  struct validationResult* r = secAlloc(sizeof(struct validationResult));
+  strcpy(r->hash, hash);
+  r->claims = oidc_strcopy(claims);
+  r->exp    = exp;
+  list_rpush(resultOrder, list_node_new(r));
+  dbIndex_add(results, r);
+}
+
+static oidc_error_t _validationError(const char* err) {
+  oidc_seterror(err);
+  oidc_errno = OIDC_EERROR;
+  return oidc_errno;
+}
+
+/**
+ * @brief checks the time and audience claims of a token
+ * @param exp is set to the expiration time of the token
+ */
+static oidc_error_t _checkClaims(const cJSON* claims, const char* audience,
+                                 time_t now, time_t* exp) {
+  const cJSON* exp_claim = cJSON_GetObjectItemCaseSensitive(claims, "exp");
+  const cJSON* nbf_claim = cJSON_GetObjectItemCaseSensitive(claims, "nbf");
+  const cJSON* aud_claim = cJSON_GetObjectItemCaseSensitive(claims, "aud");
+  if (!cJSON_IsNumber(exp_claim)) {
+    return _validationError("The token has no 'exp' claim");
+  }
+  *exp = (time_t)cJSON_GetNumberValue(exp_claim);
+  if (*exp + VALIDATION_LEEWAY < now) {
+    return _validationError("The token is expired");
+  }
+  if (cJSON_IsNumber(nbf_claim) &&
+      (time_t)cJSON_GetNumberValue(nbf_claim) - VALIDATION_LEEWAY > now) {
+    return _validationError("The token is not yet valid");
+  }
+  if (audience == NULL) {
+    return OIDC_SUCCESS;
+  }
+  if (cJSON_IsArray(aud_claim)) {
+    const cJSON* aud;
+    cJSON_ArrayForEach(aud, aud_claim) {
+      if (strequal(cJSON_GetStringValue(aud), audience)) {
+        return OIDC_SUCCESS;
+      }
+    }
+  } else if (strequal(cJSON_GetStringValue(aud_claim), audience)) {
+    return OIDC_SUCCESS;
+  }
+  char* err =
+      oidc_sprintf("The token is not intended for audience '%s'", audience);
+  _validationError(err);
+  secFree(err);
+  return oidc_errno;
+}
+
+/**
+ * @brief fetches the signing keys of an issuer and replaces the cached ones
+ * The cached keys are kept if the keys cannot be fetched.
+ */
+static void _refreshKeys(struct issuerKeys* k, struct oidc_account* account,
+                         time_t now) {
+  k->tried   = now;
+  char* jwks = fetchJwks(account);
+  if (jwks == NULL) {
+    agent_log(NOTICE, "Could not fetch signing keys of '%s': %s",
+              k->issuer_url, oidc_serror());
+    return;
+  }
+  list_t* keys = jwks_parse(jwks);
+  secFree(jwks);
+  if (keys == NULL) {
+    agent_log(NOTICE, "Could not parse signing keys of '%s': %s",
+              k->issuer_url, oidc_serror());
+    return;
+  }
+  agent_log(DEBUG, "Cached %lu signing keys of '%s'", (unsigned long)keys->len,
+            k->issuer_url);
+  secFreeList(k->keys);
+  k->keys    = keys;
+  k->fetched = now;
+}
+
+static struct issuerKeys* _getKeys(struct oidc_account* account, time_t now) {
+  const char*        issuer_url = account_getIssuerUrl(account);
+  list_node_t*       node       = findInList(issuerKeys, issuer_url);
+  struct issuerKeys* k;
+  if (node) {
+    k = node->val;
+  } else {
+    k             = secAlloc(sizeof(struct issuerKeys));
+    k->issuer_url = oidc_strcopy(issuer_url);
+    list_rpush(issuerKeys, list_node_new(k));
+  }
+  if (k->fetched + JWKS_CACHE_TIME < now &&
+      k->tried + JWKS_MIN_REFETCH < now) {
+    _refreshKeys(k, account, now);
+  }
+  return k;
+}
+
+/**
+ * @brief verifies the signature of a token with the keys of an issuer,
+ * fetching the keys again if none of them fits, e.g. after a key rotation
+ */
+static oidc_error_t _verifySignature(const char*          token,
+                                     struct oidc_account* account,
+                                     time_t               now) {
+  struct issuerKeys* k = _getKeys(account, now);
+  if (k->keys == NULL) {
+    return oidc_errno;
+  }
+  if (jwt_verify(token, k->keys) == OIDC_ENOJWK &&
+      k->tried + JWKS_MIN_REFETCH < now) {
+    agent_log(DEBUG, "Unknown signing key, refetching keys of '%s'",
+              k->issuer_url);
+    _refreshKeys(k, account, now);
+    jwt_verify(token, k->keys);
+  }
+  return oidc_errno;
+}
+
+/**
+ * @brief validates a JWT issued to one of the loaded accounts' issuers
+ * The signature, the issuer, the expiration and, if given, the audience of
+ * the token are checked.
+ * @param audience the audience the token must be intended for; @c NULL if the
+ * audience is not checked
+ * @return a pointer to the claims of the token as json object or @c NULL if
+ * the token is not valid; @c oidc_errno is set. The claims have to be freed
+ * after usage.
+ */
+char* tokenValidation_validate(const char* token, const char* audience) {
+  if (token == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!isJWT(token)) {
+    _validationError("The token is not a JWT");
+    return NULL;
+  }
+  _init();
+  time_t now = time(NULL);
+  char   hash[2 * crypto_generichash_BYTES + 1];
+  _hashToken(token, audience, hash);
+  char* payload = _getCachedResult(hash, now);
+  if (payload) {
+    agent_log(DEBUG, "Returning cached token validation");
+    return payload;
+  }
+  payload = jwt_getPayload(token);
+  if (payload == NULL) {
+    return NULL;
+  }
+  cJSON*      claims = stringToJson(payload);
+  const char* iss =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(claims, "iss"));
+  time_t       exp      = 0;
+  list_t*      accounts = iss ? db_findAccountsByIssuerUrl(iss) : NULL;
+  oidc_error_t e;
+  if (iss == NULL) {
+    e = _validationError("The token has no 'iss' claim");
+  } else if (accounts == NULL) {
+    char* err = oidc_sprintf("No account for issuer '%s' is loaded", iss);
+    e         = _validationError(err);
+    secFree(err);
+  } else {
+    e = _checkClaims(claims, audience, now, &exp);
+  }
+  if (e == OIDC_SUCCESS) {
+    e = _verifySignature(token, accounts->head->val, now);
+  }
+  secFreeList(accounts);
+  secFreeJson(claims);
+  if (e != OIDC_SUCCESS) {
+    agent_log(DEBUG, "Token validation failed: %s", oidc_serror());
+    secFree(payload);
+    return NULL;
+  }
+  _cacheResult(hash, payload, exp);
+  return payload;
+}
+
+void tokenValidation_clear() {
+  dbIndex_free(results);
+  results = NULL;
+  secFreeList(resultOrder);
+  resultOrder = NULL;
+  secFreeList(issuerKeys);
+  issuerKeys = NULL;
+  sodium_memzero(hashKey, sizeof(hashKey));
+}
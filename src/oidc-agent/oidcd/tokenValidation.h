@@ -0,0 +1,7 @@
+#ifndef OIDCD_TOKEN_VALIDATION_H
+#define OIDCD_TOKEN_VALIDATION_H
+
+char* tokenValidation_validate(const char* token, const char* audience);
+void  tokenValidation_clear();
+
+#endif  // OIDCD_TOKEN_VALIDATION_H
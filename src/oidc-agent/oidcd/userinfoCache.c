@@ -0,0 +1,114 @@
+#include "userinfoCache.h"
+#include "utils/accountUtils.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <sodium.h>
+#include <string.h>
+
+/**
+ * The userinfo cache keeps the last userinfo response of each account, so
+ * that the claims are fetched from the issuer only once per access token.
+ * An entry is valid as long as the account's access token is the one it was
+ * fetched with; it is identified by a keyed hash, so the cache does not keep
+ * another copy of the token. When the token is refreshed the next request
+ * fetches the claims again and replaces the entry. Entries of accounts that
+ * are no longer loaded are dropped when a new entry is added, and all entries
+ * when the agent is locked.
+ */
+
+struct userinfoCacheEntry {
+  char*         shortname;
+  unsigned char token_hash[crypto_generichash_BYTES];
+  char*         userinfo;
+};
+
+static list_t*       cache = NULL;
+static unsigned char tokenHashKey[crypto_generichash_KEYBYTES];
+
+static void _secFreeUserinfoCacheEntry(struct userinfoCacheEntry* e) {
+  secFree(e->shortname);
+  secFree(e->userinfo);
+  secFree(e);
+}
+
+static int _matchUserinfoCacheEntry(const char*                      shortname,
+                                    const struct userinfoCacheEntry* e) {
+  return strequal(shortname, e->shortname);
+}
+
+static void _hashToken(const char* access_token, unsigned char* out) {
+  crypto_generichash(out, crypto_generichash_BYTES,
+                     (const unsigned char*)access_token, strlen(access_token),
+                     tokenHashKey, sizeof(tokenHashKey));
+}
+
+/**
+ * @brief drops the entries of accounts that are no longer loaded
+ */
+static void _prune() {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    const struct userinfoCacheEntry* e = node->val;
+    if (db_findAccountByShortname(e->shortname) == NULL) {
+      list_remove(cache, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief returns the cached userinfo of an account
+ * @param access_token the current access token of the account
+ * @return a pointer to a copy of the userinfo response or @c NULL if none was
+ * cached for this access token; it has to be freed after usage
+ */
+char* userinfoCache_get(const char* shortname, const char* access_token) {
+  list_node_t* node = shortname ? findInList(cache, shortname) : NULL;
+  if (node == NULL || access_token == NULL) {
+    return NULL;
+  }
+  const struct userinfoCacheEntry* e = node->val;
+  unsigned char token_hash[crypto_generichash_BYTES];
+  _hashToken(access_token, token_hash);
+  if (sodium_memcmp(token_hash, e->token_hash, sizeof(token_hash)) != 0) {
+    return NULL;
+  }
+  return oidc_strcopy(e->userinfo);
+}
+
+/**
+ * @brief caches the userinfo of an account, replacing the one cached for a
+ * previous access token
+ * @param access_token the access token the userinfo was fetched with
+ */
+void userinfoCache_put(const char* shortname, const char* access_token,
+                       const char* userinfo) {
+  if (shortname == NULL || access_token == NULL || userinfo == NULL) {
+    return;
+  }
+  if (cache == NULL) {
+    cache        = list_new();
+    cache->free  = (void (*)(void*))_secFreeUserinfoCacheEntry;
+    cache->match = (matchFunction)_matchUserinfoCacheEntry;
+    randombytes_buf(tokenHashKey, sizeof(tokenHashKey));
+  }
+  _prune();
+  list_node_t* node = findInList(cache, shortname);
+  if (node) {
+    list_remove(cache, node);
+  }
+  struct userinfoCacheEntry* e = secAlloc(sizeof(struct userinfoCacheEntry));
+  e->shortname                 = oidc_strcopy(shortname);
+  e->userinfo                  = oidc_strcopy(userinfo);
+  _hashToken(access_token, e->token_hash);
+  list_rpush(cache, list_node_new(e));
+}
+
+void userinfoCache_clear() {
+  secFreeList(cache);
+  cache = NULL;
+}
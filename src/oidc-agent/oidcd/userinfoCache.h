@@ -0,0 +1,9 @@
+#ifndef OIDCD_USERINFO_CACHE_H
+#define OIDCD_USERINFO_CACHE_H
+
+char* userinfoCache_get(const char* shortname, const char* access_token);
+void  userinfoCache_put(const char* shortname, const char* access_token,
+                        const char* userinfo);
+void  userinfoCache_clear();
+
+#endif  // OIDCD_USERINFO_CACHE_H
@@ -0,0 +1,139 @@
+#include "warmup.h"
+#include "account/account.h"
+#include "account/issuer_index.h"
+#include "defines/settings.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/oidc/flows/oidc.h"
+#include "utils/agentLogger.h"
+#include "utils/db/account_db.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+
+/**
+ * With the warm-up enabled oidcd keeps connections to the token endpoints of
+ * the loaded accounts and to the issuers of the issuer.config open, so that the
+ * first token request for an issuer does not wait for DNS, TCP and TLS. A
+ * connection is opened with a HEAD request through the http worker, whose curl
+ * handle keeps it for later requests. The warm-up is repeated every
+ * @c WARMUP_INTERVAL seconds, so the connections are not closed as idle and
+ * the TLS sessions stay fresh.
+ */
+
+struct warmupTarget {
+  char*               url;
+  char*               cert_path;
+  struct http_options options;
+};
+
+static unsigned char            enabled = 0;
+static struct timerWheel_timer* timer   = NULL;
+
+static void _runWarmUp(void* arg);
+
+static void _secFreeWarmupTarget(struct warmupTarget* t) {
+  secFree(t->url);
+  secFree(t->cert_path);
+  secFree(t);
+}
+
+static int _matchWarmupTarget(const struct warmupTarget* t, const char* url) {
+  return strequal(t->url, url);
+}
+
+static void _addTarget(list_t* targets, const char* url, const char* cert_path,
+                       struct http_options options) {
+  if (!strValid(url) || findInList(targets, (void*)url)) {
+    return;
+  }
+  struct warmupTarget* t = secAlloc(sizeof(struct warmupTarget));
+  t->url                 = oidc_strcopy(url);
+  t->cert_path           = oidc_strcopy(cert_path);
+  t->options             = options;
+  list_rpush(targets, list_node_new(t));
+}
+
+/**
+ * @brief collects the urls to warm up
+ * The token endpoint is used for issuers with a loaded account, the issuer url
+ * for all other issuers from the issuer.config.
+ */
+static list_t* _collectTargets() {
+  list_t* targets = list_new();
+  targets->free   = (void (*)(void*))_secFreeWarmupTarget;
+  targets->match  = (matchFunction)_matchWarmupTarget;
+  const vector_t* accounts = accountDB_getList();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    const struct oidc_account* account = vector_at(accounts, i);
+    _addTarget(targets, account_getTokenEndpoint(account),
+               account_getCertPath(account), getHttpOptions(account, 0));
+  }
+  list_t* issuers = issuerIndex_getIssuers();
+  if (issuers) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(issuers, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      const char* issuer_url = node->val;
+      if (accountDB_findValueByIndex(ACCOUNTDB_INDEX_ISSUERURL, issuer_url)) {
+        continue;
+      }
+      _addTarget(targets, issuer_url, NULL,
+                 issuerIndex_getHttpOptions(issuer_url));
+    }
+    list_iterator_destroy(it);
+    secFreeList(issuers);
+  }
+  return targets;
+}
+
+/**
+ * @brief makes the warm-up due immediately, e.g. after an account was loaded
+ */
+void warmup_schedule() {
+  if (!enabled) {
+    return;
+  }
+  timerWheel_cancel(timer);
+  timer = timerWheel_add(time(NULL), _runWarmUp, NULL);
+}
+
+/**
+ * @brief enables the warm-up; the first one is due immediately
+ */
+void warmup_enable() {
+  enabled = 1;
+  warmup_schedule();
+}
+
+/**
+ * @brief opens or refreshes the connections; called by the timer wheel
+ * Nothing is done while the agent is locked.
+ */
+static void _runWarmUp(void* arg) {
+  (void)arg;
+  // Set before the requests, which might schedule the warm-up again
+  timer = timerWheel_add(time(NULL) + WARMUP_INTERVAL, _runWarmUp, NULL);
+  if (agent_state.lock_state.locked) {
+    return;
+  }
+  list_t*      targets = _collectTargets();
+  size_t       warm    = 0;
+  list_node_t* node;
+  while ((node = list_lpop(targets))) {
+    struct warmupTarget* t   = node->val;
+    char*                res = httpsHEAD(t->url, t->cert_path, &t->options);
+    if (res) {
+      warm++;
+      secFree(res);
+    } else {
+      agent_log(DEBUG, "Could not warm up connection to %s: %s", t->url,
+                oidc_serror());
+    }
+    _secFreeWarmupTarget(t);
+    LIST_FREE(node);
+  }
+  list_destroy(targets);
+  agent_log(DEBUG, "Warmed up %lu connections", warm);
+}
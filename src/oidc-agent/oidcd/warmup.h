@@ -0,0 +1,7 @@
+#ifndef OIDCD_WARMUP_H
+#define OIDCD_WARMUP_H
+
+void warmup_enable();
+void warmup_schedule();
+
+#endif  // OIDCD_WARMUP_H
@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200809L
+#include "attach.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "oidc-agent/oidcd/parse_internal.h"
+#include "utils/agentLogger.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/printer.h"
+#include "utils/stringUtils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * With @c --attach the agent listens on a well-known socket of the user,
+ * @c $XDG_RUNTIME_DIR/oidc-agent/agent.sock or
+ * @c /tmp/oidc-agent-<uid>/agent.sock, and a running agent is reused instead
+ * of starting another one. Looking for the agent and starting a new one
+ * happens while holding an exclusive lock on a file next to the socket; a
+ * started agent keeps the lock until its socket listens, so that concurrent
+ * logins cannot start duplicate agents. The loaded accounts of a reused agent
+ * are obtained with a single request and printed with the environment
+ * variables, so that oidc-keychain only has to add the missing accounts.
+ */
+
+static char* dir        = NULL;
+static char* socketPath = NULL;
+static int   lockFd     = -1;
+
+static char* _getDir() {
+  const char* runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime && runtime[0] == '/') {
+    return oidc_sprintf("%s/oidc-agent", runtime);
+  }
+  return oidc_sprintf("/tmp/oidc-agent-%lu", (unsigned long)geteuid());
+}
+
+/**
+ * @brief creates the directory of the well-known socket and checks that it
+ * can only be accessed by the user
+ */
+static oidc_error_t _initDir() {
+  if (dir != NULL) {
+    return OIDC_SUCCESS;
+  }
+  char* path = _getDir();
+  if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+    char* err = oidc_sprintf("Could not create '%s': %s", path,
+                             strerror(errno));
+    oidc_seterror(err);
+    secFree(err);
+    secFree(path);
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  struct stat st;
+  if (lstat(path, &st) != 0 || !S_ISDIR(st.st_mode) ||
+      st.st_uid != geteuid() || (st.st_mode & 077)) {
+    char* err = oidc_sprintf("'%s' is not a private directory of the user",
+                             path);
+    oidc_seterror(err);
+    secFree(err);
+    secFree(path);
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  dir        = path;
+  socketPath = oidc_sprintf("%s/%s", dir, ATTACH_SOCKET_NAME);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief takes the lock for looking for and starting an agent on the
+ * well-known socket; blocks while another oidc-agent holds it
+ */
+oidc_error_t attach_lock() {
+  if (_initDir() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  char* path = oidc_sprintf("%s/%s", dir, ATTACH_LOCK_NAME);
+  lockFd     = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  secFree(path);
+  if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+    char* err = oidc_sprintf("Could not lock '%s': %s", dir, strerror(errno));
+    oidc_seterror(err);
+    secFree(err);
+    attach_unlock();
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief releases the lock in this process; it is released for all processes
+ * once every process that inherited it called this or exited
+ */
+void attach_unlock() {
+  if (lockFd >= 0) {
+    close(lockFd);
+    lockFd = -1;
+  }
+}
+
+/**
+ * @brief returns the path of the well-known socket
+ * @return the path or @c NULL if @c attach_lock was not called
+ */
+const char* attach_getSocketPath() { return socketPath; }
+
+static pid_t _readPid() {
+  char* path = oidc_sprintf("%s/%s", dir, ATTACH_PID_NAME);
+  char* line = fileDoesExist(path) ? getLineFromFile(path) : NULL;
+  secFree(path);
+  pid_t pid = line ? strToInt(line) : 0;
+  secFree(line);
+  return pid;
+}
+
+/**
+ * @brief looks for an agent listening on the well-known socket; has to be
+ * called with the lock held
+ * @param loaded set to the loaded accounts of the agent as a json array; has
+ * to be freed after usage
+ * @return the pid of the agent or @c 0 if none is running
+ */
+pid_t attach_findAgent(char** loaded) {
+  pid_t pid = _readPid();
+  if (pid <= 0 || kill(pid, 0) != 0) {
+    return 0;
+  }
+  char* res = ipc_cryptCommunicateWithPath(socketPath, REQUEST_LOADEDACCOUNTS);
+  if (res == NULL) {
+    agent_log(DEBUG, "No agent listens on '%s'", socketPath);
+    return 0;
+  }
+  char* info = parseForInfo(res);
+  if (info == NULL) {
+    return 0;
+  }
+  *loaded = info;
+  return pid;
+}
+
+/**
+ * @brief records the pid of the agent that was started on the well-known
+ * socket
+ */
+void attach_writePid(pid_t pid) {
+  char* path = oidc_sprintf("%s/%s", dir, ATTACH_PID_NAME);
+  char* text = oidc_sprintf("%d\n", pid);
+  if (writeFileAtomic(path, text) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not write '%s': %s", path, oidc_serror());
+  }
+  secFree(text);
+  secFree(path);
+}
+
+/**
+ * @brief removes the recorded pid if @p socket_path is the well-known socket,
+ * e.g. because the agent was killed
+ */
+void attach_forget(const char* socket_path) {
+  if (socket_path == NULL || _initDir() != OIDC_SUCCESS ||
+      !strequal(socket_path, socketPath)) {
+    return;
+  }
+  char* path = oidc_sprintf("%s/%s", dir, ATTACH_PID_NAME);
+  removeFile(path);
+  secFree(path);
+}
+
+/**
+ * @brief prints the commands for using a reused agent and its loaded accounts
+ * @param loaded the loaded accounts as a json array
+ */
+void attach_printEnvs(pid_t pid, const char* loaded, unsigned char quiet,
+                      unsigned char json) {
+  if (json) {
+    char*  pid_str = oidc_sprintf("%d", pid);
+    cJSON* jsonP   = generateJSONObject("socket", cJSON_String, socketPath,
+                                        "dpid", cJSON_String, pid_str, NULL);
+    secFree(pid_str);
+    jsonAddArrayValue(jsonP, "loaded_accounts", loaded);
+    cJSON_AddTrueToObject(jsonP, "reused");
+    char* jsonPrint = jsonToString(jsonP);
+    secFreeJson(jsonP);
+    printStdout("%s", jsonPrint);
+    secFree(jsonPrint);
+    return;
+  }
+  char* accounts = JSONArrayStringToDelimitedString(loaded, " ");
+  printStdout("%s=%s; export %s;\n", OIDC_SOCK_ENV_NAME, socketPath,
+              OIDC_SOCK_ENV_NAME);
+  printStdout("%s=%d; export %s;\n", OIDC_PID_ENV_NAME, pid,
+              OIDC_PID_ENV_NAME);
+  printStdout("%s='%s';\n", ATTACH_LOADED_VAR_NAME, accounts ?: "");
+  if (!quiet) {
+    printStdout("echo Reusing agent pid $%s\n", OIDC_PID_ENV_NAME);
+  }
+  secFree(accounts);
+}
@@ -0,0 +1,23 @@
+#ifndef OIDC_ATTACH_H
+#define OIDC_ATTACH_H
+
+#include "utils/oidc_error.h"
+
+#include <sys/types.h>
+
+#define ATTACH_SOCKET_NAME "agent.sock"
+#define ATTACH_LOCK_NAME "attach.lock"
+#define ATTACH_PID_NAME "agent.pid"
+// The shell variable the loaded accounts of a reused agent are assigned to
+#define ATTACH_LOADED_VAR_NAME "OIDC_LOADED_ACCOUNTS"
+
+oidc_error_t attach_lock();
+void         attach_unlock();
+const char*  attach_getSocketPath();
+pid_t        attach_findAgent(char** loaded);
+void         attach_writePid(pid_t pid);
+void         attach_forget(const char* socket_path);
+void         attach_printEnvs(pid_t pid, const char* loaded,
+                              unsigned char quiet, unsigned char json);
+
+#endif  // OIDC_ATTACH_H
@@ -0,0 +1,298 @@
+#include "configWatcher.h"
+#include "account/issuer_index.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/pipe.h"
+#include "ipc/reactor.h"
+#include "oidc-agent/oidcp/workers.h"
+#include "utils/agentLogger.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/file_io/oidcDirCache.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/negativeCache.h"
+#include "utils/pubClientInfos.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define CONFIG_WATCHER_INOTIFY
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#define CONFIG_WATCHER_KQUEUE
+#endif
+
+/**
+ * Watches the oidc dir for account configs that are changed by another
+ * process, e.g. by oidc-gen or by another agent that shares the directory.
+ * The workers are notified, so that they take the refresh token from the file
+ * before they use the refresh token of a loaded account the next time. Every
+ * account file is remembered with its inode, size and mtime, so that files
+ * written by oidcp itself (see @c configWatcher_noteWrite) and events that
+ * did not change a file are ignored. Changes of the issuer.config and the
+ * pubclients.config drop the corresponding index.
+ *
+ * On Linux inotify reports the changed files; with kqueue only a change of
+ * the directory is reported and all account files are compared.
+ */
+
+struct watchedFile {
+  char*  name;
+  ino_t  ino;
+  off_t  size;
+  time_t mtime;
+};
+
+static list_t* files    = NULL;
+static char*   oidc_dir = NULL;
+
+static void _secFreeWatchedFile(struct watchedFile* f) {
+  secFree(f->name);
+  secFree(f);
+}
+
+static int _matchWatchedFileByName(const char*               name,
+                                   const struct watchedFile* f) {
+  return strequal(name, f->name);
+}
+
+/**
+ * @brief updates the remembered state of an account file
+ * @return @c 1 if the file exists and differs from the remembered state;
+ * @c 0 otherwise
+ */
+static int _update(const char* name) {
+  char*       path   = concatToOidcDir(name);
+  struct stat st;
+  int         exists = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+  secFree(path);
+  list_node_t* node = findInList(files, name);
+  if (!exists) {
+    if (node) {
+      list_remove(files, node);
+    }
+    return 0;
+  }
+  struct watchedFile* f = node ? node->val : NULL;
+  if (f && f->ino == st.st_ino && f->size == st.st_size &&
+      f->mtime == st.st_mtime) {
+    return 0;
+  }
+  if (f == NULL) {
+    f       = secAlloc(sizeof(struct watchedFile));
+    f->name = oidc_strcopy(name);
+    list_rpush(files, list_node_new(f));
+  }
+  f->ino   = st.st_ino;
+  f->size  = st.st_size;
+  f->mtime = st.st_mtime;
+  return 1;
+}
+
+static void _notifyWorkers(const char* shortname) {
+  agent_log(DEBUG, "Account config '%s' changed on disk", shortname);
+  for (size_t i = 0; i < workers_count(); i++) {
+    if (ipc_writeToPipe(ipc_tagPipe(workers_get(i), IPC_TAG_NOTIFY),
+                        INT_NOTIFY_ACCOUNT_CHANGED,
+                        shortname) != OIDC_SUCCESS) {
+      agent_log(ERROR, "Could not notify oidcd about changed account: %s",
+                oidc_serror());
+    }
+  }
+}
+
+/**
+ * @brief drops the unknown short names and issuers remembered by oidcp and
+ * the workers, because the account configs or the issuer.config changed
+ */
+static void _configChanged() {
+  negativeCache_clear();
+  for (size_t i = 0; i < workers_count(); i++) {
+    if (ipc_writeToPipe(ipc_tagPipe(workers_get(i), IPC_TAG_NOTIFY),
+                        INT_NOTIFY_CONFIG_CHANGED) != OIDC_SUCCESS) {
+      agent_log(ERROR, "Could not notify oidcd about changed configs: %s",
+                oidc_serror());
+    }
+  }
+}
+
+/**
+ * @brief drops a changed file from the oidc dir cache, which would otherwise
+ * use it until its lease ends
+ */
+static void _invalidateCached(const char* name) {
+  char* path = concatToOidcDir(name);
+  oidcDirCache_invalidate(path);
+  secFree(path);
+}
+
+static void _handleChange(const char* name) {
+  if (name == NULL || name[0] == '\0' || name[0] == '.') {
+    return;
+  }
+  if (strequal(name, ISSUER_CONFIG_FILENAME)) {
+    _invalidateCached(name);
+    issuerIndex_reset();
+    _configChanged();
+    return;
+  }
+  if (strequal(name, PUBCLIENTS_FILENAME)) {
+    _invalidateCached(name);
+    pubClientInfos_reset();
+    return;
+  }
+  if (!isAccountConfigFile(name, NULL)) {
+    return;
+  }
+  if (_update(name)) {
+    _invalidateCached(name);
+    negativeCache_clear();  // the workers clear theirs when notified
+    _notifyWorkers(name);
+  }
+}
+
+/**
+ * @brief remembers the current state of all account files
+ */
+static void _scan(unsigned char notify) {
+  list_t* names = getAccountConfigFileList();
+  if (names == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(names, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (notify) {
+      _handleChange(node->val);
+    } else {
+      _update(node->val);
+    }
+  }
+  list_iterator_destroy(it);
+  secFreeList(names);
+  // removed files
+  it = list_iterator_new(files, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    _update(((struct watchedFile*)node->val)->name);
+  }
+  list_iterator_destroy(it);
+}
+
+#ifdef CONFIG_WATCHER_INOTIFY
+
+static void _readEvents(int fd, void* arg) {
+  (void)arg;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + len;) {
+      const struct inotify_event* e = (const struct inotify_event*)p;
+      if (e->mask & IN_Q_OVERFLOW) {
+        _scan(1);
+      } else if (e->len > 0) {
+        _handleChange(e->name);
+      }
+      p += sizeof(struct inotify_event) + e->len;
+    }
+  }
+}
+
+static int _openWatch() {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (inotify_add_watch(fd, oidc_dir,
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE |
+                            IN_MOVED_FROM) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+#elif defined(CONFIG_WATCHER_KQUEUE)
+
+static void _readEvents(int fd, void* arg) {
+  (void)arg;
+  struct kevent   ev;
+  struct timespec zero    = {0};
+  unsigned char   changed = 0;
+  while (kevent(fd, NULL, 0, &ev, 1, &zero) > 0) {
+    changed = 1;
+  }
+  if (changed) {
+    issuerIndex_reset();
+    pubClientInfos_reset();
+    _configChanged();
+    _scan(1);
+  }
+}
+
+static int _openWatch() {
+#ifdef O_EVTONLY
+  int dirfd = open(oidc_dir, O_EVTONLY | O_CLOEXEC);
+#else
+  int dirfd = open(oidc_dir, O_RDONLY | O_CLOEXEC);
+#endif
+  if (dirfd < 0) {
+    return -1;
+  }
+  int fd = kqueue();
+  if (fd < 0) {
+    close(dirfd);
+    return -1;
+  }
+  struct kevent ev;
+  EV_SET(&ev, dirfd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+  if (kevent(fd, &ev, 1, NULL, 0, NULL) < 0) {
+    close(fd);
+    close(dirfd);
+    return -1;
+  }
+  return fd;  // dirfd stays open while it is watched
+}
+
+#endif
+
+/**
+ * @brief starts watching the oidc dir
+ * If the directory cannot be watched, changed account configs are not
+ * detected; everything else works as before.
+ */
+void configWatcher_start() {
+#if defined(CONFIG_WATCHER_INOTIFY) || defined(CONFIG_WATCHER_KQUEUE)
+  if (files != NULL) {
+    return;
+  }
+  oidc_dir = getOidcDir();
+  if (oidc_dir == NULL) {
+    return;
+  }
+  files        = list_new();
+  files->free  = (void (*)(void*))_secFreeWatchedFile;
+  files->match = (matchFunction)_matchWatchedFileByName;
+  int fd       = _openWatch();
+  if (fd < 0) {
+    agent_log(NOTICE, "Cannot watch the oidc dir for changed configs: %m");
+    return;
+  }
+  _scan(0);
+  reactor_watchFd(fd, _readEvents, NULL);
+#endif
+}
+
+/**
+ * @brief remembers the state of a file that oidcp wrote itself, so that the
+ * change is not reported to the workers
+ */
+void configWatcher_noteWrite(const char* filename) {
+  if (files != NULL && filename != NULL) {
+    _update(filename);
+  }
+}
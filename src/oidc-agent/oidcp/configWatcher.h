@@ -0,0 +1,7 @@
+#ifndef OIDC_CONFIG_WATCHER_H
+#define OIDC_CONFIG_WATCHER_H
+
+void configWatcher_start();
+void configWatcher_noteWrite(const char* filename);
+
+#endif  // OIDC_CONFIG_WATCHER_H
@@ -0,0 +1,136 @@
+#include "confirmGrants.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+/**
+ * With --confirm-grant a confirmed token request is remembered for the given
+ * time, so that the same client does not have to be confirmed for every
+ * token, e.g. during a build. A grant only covers requests of the same user
+ * for the same account, application hint, scope and kind of token. Grants are
+ * not bound to the process of the client, because tools like oidc-token run a
+ * new process for every token. They are dropped when the agent is locked and
+ * when their account is removed.
+ */
+
+static list_t* grants   = NULL;
+static time_t  duration = 0;
+
+/**
+ * @brief sets the seconds for which a confirmation is remembered
+ * @param seconds @c 0 if confirmations are not remembered
+ */
+void confirmGrants_setDuration(time_t seconds) { duration = seconds; }
+
+/**
+ * @brief creates a grant, e.g. to look for an existing one
+ * @return a pointer to the grant or @c NULL if confirmations are not
+ * remembered; it has to be freed with @c confirmGrants_free unless it is
+ * passed to @c confirmGrants_add
+ */
+struct confirmGrant* confirmGrants_new(unsigned char idtoken,
+                                       const char*   account,
+                                       const char*   application_hint,
+                                       const char* scope, uid_t uid) {
+  if (!duration || account == NULL) {
+    return NULL;
+  }
+  struct confirmGrant* g = secAlloc(sizeof(struct confirmGrant));
+  g->idtoken             = idtoken;
+  g->account             = oidc_strcopy(account);
+  g->application_hint    = oidc_strcopy(application_hint ?: "");
+  g->scope               = oidc_strcopy(scope ?: "");
+  g->uid                 = uid;
+  return g;
+}
+
+void confirmGrants_free(struct confirmGrant* g) {
+  if (g == NULL) {
+    return;
+  }
+  secFree(g->account);
+  secFree(g->application_hint);
+  secFree(g->scope);
+  secFree(g);
+}
+
+static int _matchGrant(const struct confirmGrant* request,
+                       const struct confirmGrant* g) {
+  return request->idtoken == g->idtoken && request->uid == g->uid &&
+         strequal(request->account, g->account) &&
+         strequal(request->application_hint, g->application_hint) &&
+         strequal(request->scope, g->scope);
+}
+
+static void _removeExpired() {
+  if (grants == NULL) {
+    return;
+  }
+  time_t           now = time(NULL);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(grants, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (((struct confirmGrant*)node->val)->until <= now) {
+      list_remove(grants, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief checks if the user confirmed a request like @p request within the
+ * grant duration
+ */
+int confirmGrants_isGranted(const struct confirmGrant* request) {
+  if (request == NULL || grants == NULL) {
+    return 0;
+  }
+  _removeExpired();
+  if (findInList(grants, request) == NULL) {
+    return 0;
+  }
+  agent_log(DEBUG, "Usage of '%s' confirmed by a grant", request->account);
+  return 1;
+}
+
+/**
+ * @brief remembers a confirmed request for the grant duration
+ * @param grant the grant; it is owned by the module afterwards
+ */
+void confirmGrants_add(struct confirmGrant* grant) {
+  if (grant == NULL) {
+    return;
+  }
+  if (grants == NULL) {
+    grants        = list_new();
+    grants->free  = (void (*)(void*))confirmGrants_free;
+    grants->match = (matchFunction)_matchGrant;
+  }
+  list_node_t* node = findInList(grants, grant);
+  if (node) {
+    list_remove(grants, node);
+  }
+  grant->until = time(NULL) + duration;
+  list_rpush(grants, list_node_new(grant));
+}
+
+void confirmGrants_removeAccount(const char* account) {
+  if (grants == NULL || account == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(grants, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (strequal(((struct confirmGrant*)node->val)->account, account)) {
+      list_remove(grants, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+void confirmGrants_clear() {
+  secFreeList(grants);
+  grants = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef OIDC_CONFIRM_GRANTS_H
+#define OIDC_CONFIRM_GRANTS_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * A confirmed usage of an account that further requests may use without
+ * asking the user again
+ */
+struct confirmGrant {
+  unsigned char idtoken;           // for id tokens instead of access tokens
+  char*         account;           // the short name or the issuer
+  char*         application_hint;  // "" if none was given
+  char*         scope;             // "" for the default scopes
+  uid_t         uid;               // of the client
+  time_t        until;
+};
+
+void confirmGrants_setDuration(time_t seconds);
+struct confirmGrant* confirmGrants_new(unsigned char idtoken,
+                                       const char*   account,
+                                       const char*   application_hint,
+                                       const char* scope, uid_t uid);
+void confirmGrants_free(struct confirmGrant* grant);
+int  confirmGrants_isGranted(const struct confirmGrant* request);
+void confirmGrants_add(struct confirmGrant* grant);
+void confirmGrants_removeAccount(const char* account);
+void confirmGrants_clear();
+
+#endif  // OIDC_CONFIRM_GRANTS_H
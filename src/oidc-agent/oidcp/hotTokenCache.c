@@ -0,0 +1,173 @@
+#include "hotTokenCache.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+/**
+ * The token responses oidcd published for hot token requests (see
+ * oidcd/hotTokens.c). oidcp answers an access token request for the same
+ * account, scope, and audience directly with the stored response, if the
+ * token is valid for the requested minimum period, without forwarding it to
+ * oidcd. oidcd tells oidcp to drop a response once its token changed; oidcp
+ * also drops the responses of an account itself when it forwards a request
+ * that removes the account or rejects its token, and all responses when the
+ * agent is locked or a worker is restarted.
+ * Requests that have to be confirmed, are traced, or are made for another user
+ * always go to oidcd.
+ */
+
+struct hotToken {
+  char*         key;
+  char*         response;
+  unsigned long valid_until;
+};
+
+static list_t* cache = NULL;  // oldest first
+
+static void _secFreeHotToken(struct hotToken* t) {
+  secFree(t->key);
+  secFree(t->response);
+  secFree(t);
+}
+
+static int _matchHotToken(const char* key, const struct hotToken* t) {
+  return strequal(key, t->key);
+}
+
+static char* _keyFor(const char* shortname, const char* scope,
+                     const char* audience) {
+  return oidc_sprintf("%s\n%s\n%s", shortname ?: "",
+                      strValid(scope) ? scope : "",
+                      strValid(audience) ? audience : "");
+}
+
+/**
+ * @brief stores a token response oidcd published
+ * @param notification the notification of oidcd
+ */
+void hotTokenCache_store(const char* notification) {
+  INIT_KEY_VALUE(IPC_KEY_SHORTNAME, OIDC_KEY_SCOPE, IPC_KEY_AUDIENCE,
+                 INT_IPC_KEY_RESPONSE, AGENT_KEY_EXPIRESAT);
+  if (CALL_GETJSONVALUES(notification) < 0) {
+    agent_log(ERROR, "Invalid hot token notification: %s", oidc_serror());
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(shortname, scope, audience, response, valid_until);
+  if (!strValid(_shortname) || !strValid(_response)) {
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  if (cache == NULL) {
+    cache        = list_new();
+    cache->free  = (void (*)(void*))_secFreeHotToken;
+    cache->match = (matchFunction)_matchHotToken;
+  }
+  struct hotToken* t = secAlloc(sizeof(struct hotToken));
+  t->key             = _keyFor(_shortname, _scope, _audience);
+  t->response        = oidc_strcopy(_response);
+  t->valid_until     = strToULong(_valid_until);
+  SEC_FREE_KEY_VALUES();
+  list_removeIfFound(cache, t->key);
+  if (cache->len >= HOTTOKENCACHE_MAX) {
+    list_remove(cache, cache->head);
+  }
+  list_rpush(cache, list_node_new(t));
+}
+
+/**
+ * @brief drops a token response because oidcd said so
+ * @param notification the notification of oidcd
+ */
+void hotTokenCache_drop(const char* notification) {
+  if (cache == NULL) {
+    return;
+  }
+  INIT_KEY_VALUE(IPC_KEY_SHORTNAME, OIDC_KEY_SCOPE, IPC_KEY_AUDIENCE);
+  if (CALL_GETJSONVALUES(notification) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(shortname, scope, audience);
+  char* key = _keyFor(_shortname, _scope, _audience);
+  SEC_FREE_KEY_VALUES();
+  list_removeIfFound(cache, key);
+  secFree(key);
+}
+
+/**
+ * @brief drops all token responses of an account
+ */
+void hotTokenCache_dropAccount(const char* shortname) {
+  if (cache == NULL || !strValid(shortname)) {
+    return;
+  }
+  char*            prefix = oidc_sprintf("%s\n", shortname);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(cache, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (strstarts(((struct hotToken*)node->val)->key, prefix)) {
+      list_remove(cache, node);
+    }
+  }
+  list_iterator_destroy(it);
+  secFree(prefix);
+}
+
+void hotTokenCache_clear() {
+  secFreeList(cache);
+  cache = NULL;
+}
+
+/**
+ * @brief looks up the token response for an access token request
+ * @param request the request of a client
+ * @return the response that can be sent to the client or @c NULL if the
+ * request has to be forwarded to oidcd; the response MUST NOT be freed
+ */
+const char* hotTokenCache_lookup(const char* request) {
+  if (cache == NULL || cache->len == 0) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, OIDC_KEY_SCOPE,
+                 IPC_KEY_AUDIENCE, IPC_KEY_MINVALID, IPC_KEY_TRACE,
+                 IPC_KEY_CONFIRM, IPC_KEY_TENANT);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  KEY_VALUE_VARS(request, shortname, scope, audience, min_valid, trace,
+                 confirm, tenant);
+  if (!strequal(_request, REQUEST_VALUE_ACCESSTOKEN) ||
+      !strValid(_shortname) || _trace != NULL || strToInt(_confirm) ||
+      _tenant != NULL) {
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  const time_t min_valid_period = _min_valid ? strToInt(_min_valid) : 0;
+  char*        key              = _keyFor(_shortname, _scope, _audience);
+  SEC_FREE_KEY_VALUES();
+  list_node_t* node = findInList(cache, key);
+  secFree(key);
+  if (node == NULL || min_valid_period == FORCE_NEW_TOKEN) {
+    return NULL;
+  }
+  const struct hotToken* t    = node->val;
+  const time_t           left = (time_t)t->valid_until - time(NULL);
+  if (left <= 0) {
+    list_remove(cache, node);
+    return NULL;
+  }
+  return left > min_valid_period ? t->response : NULL;
+}
+
+size_t hotTokenCache_count() { return cache ? cache->len : 0; }
@@ -0,0 +1,16 @@
+#ifndef OIDCP_HOT_TOKEN_CACHE_H
+#define OIDCP_HOT_TOKEN_CACHE_H
+
+#include <stddef.h>
+
+// Maximum number of token responses published by oidcd that oidcp keeps
+#define HOTTOKENCACHE_MAX 256
+
+void        hotTokenCache_store(const char* notification);
+void        hotTokenCache_drop(const char* notification);
+void        hotTokenCache_dropAccount(const char* shortname);
+void        hotTokenCache_clear();
+const char* hotTokenCache_lookup(const char* request);
+size_t      hotTokenCache_count();
+
+#endif  // OIDCP_HOT_TOKEN_CACHE_H
@@ -0,0 +1,133 @@
+#include "keyPairPool.h"
+#include "defines/settings.h"
+#include "oidc-agent/workPool.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "wrapper/list.h"
+
+#include <sodium.h>
+
+/**
+ * Every encrypted client connection starts with a key exchange, for which the
+ * server needs a fresh key pair. Generating it is a scalar multiplication on
+ * the path of every connection, so oidcp keeps up to @c KEYPAIR_POOL_SIZE key
+ * pairs ready. Each key pair is taken out of the pool and used for a single
+ * key exchange. Taken key pairs are replaced on the work pool in batches of
+ * @c KEYPAIR_POOL_BATCH; without a running work pool they are replaced while
+ * the event loop is idle. If the pool runs empty during a burst, key pairs
+ * are generated as before.
+ */
+
+struct keyPairBatch {
+  size_t                count;
+  struct pubsec_keySet* keys[KEYPAIR_POOL_BATCH];
+};
+
+static list_t*       pool      = NULL;
+static unsigned char refilling = 0;  // a batch is generated on the work pool
+
+static struct pubsec_keySet* _generate() {
+  struct pubsec_keySet* keys = secAlloc(sizeof(struct pubsec_keySet));
+  crypto_kx_keypair(keys->pk, keys->sk);
+  return keys;
+}
+
+static void* _generateBatch(void* arg) {
+  struct keyPairBatch* batch = arg;
+  for (size_t i = 0; i < batch->count; i++) { batch->keys[i] = _generate(); }
+  return batch;
+}
+
+static void _refill();
+
+static void _batchDone(void* result, void* arg) {
+  (void)arg;
+  struct keyPairBatch* batch = result;
+  refilling                  = 0;
+  for (size_t i = 0; i < batch->count; i++) {
+    if (pool && pool->len < KEYPAIR_POOL_SIZE) {
+      list_rpush(pool, list_node_new(batch->keys[i]));
+    } else {
+      secFreePubSecKeySet(batch->keys[i]);
+    }
+  }
+  secFree(batch);
+  _refill();
+}
+
+/**
+ * @brief generates the missing key pairs of the pool on the work pool
+ */
+static void _refill() {
+  if (pool == NULL || refilling || pool->len >= KEYPAIR_POOL_SIZE ||
+      !workPool_isRunning()) {
+    return;
+  }
+  struct keyPairBatch* batch = secAlloc(sizeof(struct keyPairBatch));
+  batch->count               = KEYPAIR_POOL_SIZE - pool->len;
+  if (batch->count > KEYPAIR_POOL_BATCH) {
+    batch->count = KEYPAIR_POOL_BATCH;
+  }
+  if (workPool_submit(_generateBatch, _batchDone, batch) != OIDC_SUCCESS) {
+    secFree(batch);
+    return;
+  }
+  refilling = 1;
+}
+
+/**
+ * @brief returns a key pair for a key exchange; used as key set source of the
+ * server ipc
+ * @return a key pair that is not used for anything else; has to be freed with
+ * @c secFreePubSecKeySet after usage
+ */
+struct pubsec_keySet* keyPairPool_take() {
+  list_node_t* node = pool ? list_lpop(pool) : NULL;
+  if (node == NULL) {
+    agent_log(DEBUG, "Key pair pool is empty");
+    _refill();
+    return _generate();
+  }
+  struct pubsec_keySet* keys = node->val;
+  LIST_FREE(node);
+  _refill();
+  return keys;
+}
+
+/**
+ * @brief fills the pool on the event loop thread while it is idle; only needed
+ * if the work pool is not running
+ */
+void keyPairPool_fillIdle() {
+  if (pool == NULL || workPool_isRunning()) {
+    return;
+  }
+  while (pool->len < KEYPAIR_POOL_SIZE) {
+    list_rpush(pool, list_node_new(_generate()));
+  }
+}
+
+/**
+ * @brief creates the pool and makes the server ipc take its key pairs from it
+ * Should be called after the work pool was started, so that the pool is filled
+ * there.
+ */
+void keyPairPool_start() {
+  if (pool == NULL) {
+    pool       = list_new();
+    pool->free = (void (*)(void*))secFreePubSecKeySet;
+  }
+  server_ipc_setKeySetSource(keyPairPool_take);
+  if (workPool_isRunning()) {
+    _refill();
+  } else {
+    keyPairPool_fillIdle();
+  }
+}
+
+void keyPairPool_destroy() {
+  server_ipc_setKeySetSource(NULL);
+  secFreeList(pool);
+  pool = NULL;
+}
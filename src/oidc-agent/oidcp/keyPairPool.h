@@ -0,0 +1,11 @@
+#ifndef OIDCP_KEYPAIR_POOL_H
+#define OIDCP_KEYPAIR_POOL_H
+
+#include "ipc/cryptIpc.h"
+
+void                  keyPairPool_start();
+struct pubsec_keySet* keyPairPool_take();
+void                  keyPairPool_fillIdle();
+void                  keyPairPool_destroy();
+
+#endif  // OIDCP_KEYPAIR_POOL_H
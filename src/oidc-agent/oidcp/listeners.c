@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 200809L
+#include "listeners.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/ipc.h"
+#include "ipc/reactor.h"
+#include "ipc/serveripc.h"
+#include "utils/agentLogger.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Besides its own socket the agent can listen on additional UNIX domain
+ * sockets given with --listen, e.g. one per consumer of a service account.
+ * All sockets share the workers and therefore the loaded accounts and cached
+ * tokens; every additional socket has its own policy for its clients:
+ * - @c confirm: every token request has to be confirmed by the user
+ * - @c tokens-only: only token requests are allowed, e.g. no loading,
+ *   removing or locking of accounts
+ * - @c background: token refreshes that wait in oidcd are handled after the
+ *   ones of the other sockets
+ * - @c forced-rate=N: forced token refreshes a client may do per minute
+ * - @c group=NAME: the members of the group may connect
+ *
+ * The socket a client connected to is the local address of its connection,
+ * so no state has to be kept per connection. The policy is passed on to oidcd
+ * as part of the token requests.
+ */
+
+struct listener {
+  char*                 path;
+  char*                 group;
+  struct connection*    con;
+  struct listenerPolicy policy;
+};
+
+static list_t* listeners = NULL;
+
+static void _secFreeListener(struct listener* l) {
+  if (l->con && l->con->sock) {
+    close(*(l->con->sock));
+    unlink(l->path);
+    _secFreeConnection(l->con);
+  }
+  secFree(l->path);
+  secFree(l->group);
+  secFree(l);
+}
+
+static oidc_error_t _parseOption(struct listener* l, const char* option) {
+  if (strequal(option, "confirm")) {
+    l->policy.confirm = 1;
+  } else if (strequal(option, "tokens-only")) {
+    l->policy.tokens_only = 1;
+  } else if (strequal(option, "background")) {
+    l->policy.background = 1;
+  } else if (strstarts(option, "forced-rate=") &&
+             isdigit(option[strlen("forced-rate=")])) {
+    l->policy.forced_per_minute =
+        (unsigned int)strToULong(option + strlen("forced-rate="));
+  } else if (strstarts(option, "group=") &&
+             strValid(option + strlen("group="))) {
+    secFree(l->group);
+    l->group = oidc_strcopy(option + strlen("group="));
+  } else {
+    char* err = oidc_sprintf("Unknown option '%s' for --listen", option);
+    oidc_seterror(err);
+    secFree(err);
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief adds an additional socket
+ * @param spec the absolute path of the socket, optionally followed by comma
+ * separated policy options
+ */
+oidc_error_t listeners_add(const char* spec) {
+  if (!strValid(spec)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct listener* l    = secAlloc(sizeof(struct listener));
+  char*            copy = oidc_strcopy(spec);
+  char*            save = NULL;
+  char*            path = strtok_r(copy, ",", &save);
+  oidc_error_t     e    = OIDC_SUCCESS;
+  l->policy.forced_per_minute = SCHEDULER_FORCED_PER_MINUTE;
+  if (path == NULL || path[0] != '/' ||
+      strlen(path) >= sizeof(((struct sockaddr_un*)0)->sun_path)) {
+    oidc_seterror("--listen needs an absolute socket path");
+    oidc_errno = OIDC_EERROR;
+    e          = oidc_errno;
+  }
+  for (char* option = strtok_r(NULL, ",", &save);
+       option && e == OIDC_SUCCESS; option = strtok_r(NULL, ",", &save)) {
+    e = _parseOption(l, option);
+  }
+  if (e != OIDC_SUCCESS) {
+    secFree(copy);
+    _secFreeListener(l);
+    return e;
+  }
+  l->path = oidc_strcopy(path);
+  secFree(copy);
+  if (listeners == NULL) {
+    listeners       = list_new();
+    listeners->free = (void (*)(void*))_secFreeListener;
+  }
+  list_rpush(listeners, list_node_new(l));
+  l->policy.index = listeners->len;
+  return OIDC_SUCCESS;
+}
+
+static void _acceptClient(int fd, void* arg) {
+  (void)fd;
+  ipc_acceptClient(*((struct listener*)arg)->con);
+}
+
+/**
+ * @brief binds the additional sockets and registers them with the reactor
+ * @return @c OIDC_SUCCESS or an error code if a socket could not be bound
+ */
+oidc_error_t listeners_start() {
+  if (listeners == NULL) {
+    return OIDC_SUCCESS;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(listeners, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct listener* l = node->val;
+    l->con             = secAlloc(sizeof(struct connection));
+    if (initServerConnection(l->con) != OIDC_SUCCESS) {
+      break;
+    }
+    strcpy(l->con->server->sun_path, l->path);
+    if (ipc_bindAndListen(l->con) != 0) {
+      oidc_errno = OIDC_EBIND;
+      break;
+    }
+    if (l->group && changeGroup(l->path, l->group) != OIDC_SUCCESS) {
+      break;
+    }
+    reactor_watchFd(*(l->con->sock), _acceptClient, l);
+    agent_log(DEBUG, "Listening on '%s'", l->path);
+  }
+  list_iterator_destroy(it);
+  if (node) {
+    agent_log(ERROR, "Could not listen on '%s': %s",
+              ((struct listener*)node->val)->path, oidc_serror());
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the policy of the socket a client connected to
+ * @param sock the socket of the client connection
+ * @return the policy or @c NULL if the client connected to the socket of the
+ * agent itself
+ */
+const struct listenerPolicy* listeners_policyFor(int sock) {
+  if (listeners == NULL) {
+    return NULL;
+  }
+  struct sockaddr_un addr     = {0};
+  socklen_t          addr_len = sizeof(addr);
+  if (getsockname(sock, (struct sockaddr*)&addr, &addr_len) != 0 ||
+      addr.sun_family != AF_UNIX) {
+    return NULL;
+  }
+  for (list_node_t* node = listeners->head; node; node = node->next) {
+    struct listener* l = node->val;
+    if (strequal(addr.sun_path, l->path)) {
+      return &l->policy;
+    }
+  }
+  return NULL;
+}
+
+static void _markTokenRequest(cJSON* request,
+                              const struct listenerPolicy* policy) {
+  if (!cJSON_IsObject(request)) {
+    return;
+  }
+  // Set by oidcp only, so that clients cannot lift the policy
+  cJSON_DeleteItemFromObjectCaseSensitive(request, IPC_KEY_CONFIRM);
+  cJSON_DeleteItemFromObjectCaseSensitive(request, IPC_KEY_BACKGROUND);
+  if (policy->confirm) {
+    jsonAddNumberValue(request, IPC_KEY_CONFIRM, 1);
+  }
+  if (policy->background) {
+    jsonAddNumberValue(request, IPC_KEY_BACKGROUND, 1);
+  }
+}
+
+/**
+ * @brief adds the policy of a socket to the token requests of a message, so
+ * that oidcd applies it
+ * @return a pointer to the new message or @c NULL if the message is passed on
+ * unchanged; it has to be freed after usage
+ */
+char* listeners_applyPolicy(const struct listenerPolicy* policy,
+                            const char*                  msg) {
+  if (policy == NULL || !(policy->confirm || policy->background)) {
+    return NULL;
+  }
+  cJSON* json = stringToJson(msg);
+  if (json == NULL) {
+    return NULL;
+  }
+  const cJSON* type = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_REQUEST);
+  const char*  request_type = cJSON_GetStringValue(type);
+  if (strequal(request_type, REQUEST_VALUE_ACCESSTOKEN_BATCH)) {
+    cJSON* requests = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_REQUESTS);
+    cJSON* request;
+    cJSON_ArrayForEach(request, requests) {
+      _markTokenRequest(request, policy);
+    }
+  } else if (strequal(request_type, REQUEST_VALUE_ACCESSTOKEN) ||
+             strequal(request_type, REQUEST_VALUE_IDTOKEN) ||
+             strequal(request_type, REQUEST_VALUE_SUBSCRIBE) ||
+             strequal(request_type, REQUEST_VALUE_USERINFO)) {
+    _markTokenRequest(json, policy);
+  }
+  char* marked = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return marked;
+}
+
+void listeners_destroy() {
+  secFreeList(listeners);
+  listeners = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef OIDC_LISTENERS_H
+#define OIDC_LISTENERS_H
+
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
+
+/**
+ * The policy for the clients of an additional socket given with --listen
+ */
+struct listenerPolicy {
+  size_t        index;              // 1 for the first additional socket
+  unsigned char confirm;            // every token request has to be confirmed
+  unsigned char tokens_only;        // all other requests are forbidden
+  unsigned char background;         // refreshes wait behind other requests
+  unsigned int  forced_per_minute;  // forced refreshes per client
+};
+
+oidc_error_t                 listeners_add(const char* spec);
+oidc_error_t                 listeners_start();
+const struct listenerPolicy* listeners_policyFor(int sock);
+char* listeners_applyPolicy(const struct listenerPolicy* policy,
+                            const char*                  msg);
+void  listeners_destroy();
+
+#endif  // OIDC_LISTENERS_H
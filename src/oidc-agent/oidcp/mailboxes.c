@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mailboxes.h"
+#include "ipc/tokenMailbox.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <grp.h>
+#include <string.h>
+
+/**
+ * The token mailboxes of the accounts given with --mailbox. oidcp is their
+ * only writer: it publishes every new default access token oidcd notifies it
+ * about, and empties a mailbox when its account is removed or the agent is
+ * locked.
+ */
+
+struct mailbox {
+  char*                shortname;
+  char*                name;  // name of the shared memory object
+  struct tokenMailbox* mailbox;
+};
+
+static list_t* mailboxes = NULL;
+
+static void _secFreeMailbox(struct mailbox* m) {
+  if (m == NULL) {
+    return;
+  }
+  tokenMailbox_destroy(m->mailbox, m->name);
+  secFree(m->shortname);
+  secFree(m->name);
+  secFree(m);
+}
+
+static int _matchMailbox(const char* shortname, const struct mailbox* m) {
+  return strequal(shortname, m->shortname);
+}
+
+int mailboxes_isEnabled() { return mailboxes != NULL; }
+
+/**
+ * @brief enables the mailboxes of the comma separated accounts
+ * @p shortnames; they are created by @c mailboxes_init
+ */
+oidc_error_t mailboxes_enable(const char* shortnames) {
+  if (!strValid(shortnames)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (mailboxes == NULL) {
+    mailboxes        = list_new();
+    mailboxes->free  = (void (*)(void*))_secFreeMailbox;
+    mailboxes->match = (matchFunction)_matchMailbox;
+  }
+  char* copy = oidc_strcopy(shortnames);
+  char* save = NULL;
+  for (char* s = strtok_r(copy, ",", &save); s;
+       s = strtok_r(NULL, ",", &save)) {
+    if (!strValid(s) || findInList(mailboxes, s)) {
+      continue;
+    }
+    struct mailbox* m = secAlloc(sizeof(struct mailbox));
+    m->shortname      = oidc_strcopy(s);
+    list_rpush(mailboxes, list_node_new(m));
+  }
+  secFree(copy);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief creates the enabled mailboxes for the agent listening on
+ * @p socket_path
+ * @param group the group that may access the agent or @c NULL
+ */
+void mailboxes_init(const char* socket_path, const char* group) {
+  if (mailboxes == NULL) {
+    return;
+  }
+  gid_t gid = -1;
+  if (group) {
+    struct group* grp = getgrnam(group);
+    if (grp == NULL) {
+      agent_log(ERROR, "Group '%s' not found, token mailboxes are private",
+                group);
+    } else {
+      gid = grp->gr_gid;
+    }
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(mailboxes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct mailbox* m = node->val;
+    m->name           = tokenMailbox_name(socket_path, m->shortname);
+    m->mailbox        = m->name ? tokenMailbox_create(m->name, gid) : NULL;
+    if (m->mailbox == NULL) {
+      agent_log(ERROR, "Could not create token mailbox for '%s': %s",
+                m->shortname, oidc_serror());
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+static struct tokenMailbox* _findMailbox(const char* shortname) {
+  list_node_t* node =
+      mailboxes && shortname ? findInList(mailboxes, shortname) : NULL;
+  return node ? ((struct mailbox*)node->val)->mailbox : NULL;
+}
+
+/**
+ * @brief publishes a new access token in the mailbox of its account, if that
+ * account has one
+ */
+void mailboxes_publish(const char* shortname, const char* access_token,
+                       const char* issuer, unsigned long expires_at) {
+  struct tokenMailbox* mailbox = _findMailbox(shortname);
+  if (mailbox == NULL || !strValid(access_token)) {
+    return;
+  }
+  agent_log(DEBUG, "Publishing access token for '%s' in its mailbox",
+            shortname);
+  tokenMailbox_publish(mailbox, access_token, issuer, expires_at);
+}
+
+void mailboxes_clear(const char* shortname) {
+  tokenMailbox_publish(_findMailbox(shortname), NULL, NULL, 0);
+}
+
+void mailboxes_clearAll() {
+  if (mailboxes == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(mailboxes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    tokenMailbox_publish(((struct mailbox*)node->val)->mailbox, NULL, NULL, 0);
+  }
+  list_iterator_destroy(it);
+}
+
+/**
+ * @brief closes and removes all mailboxes
+ */
+void mailboxes_destroy() {
+  if (mailboxes == NULL) {
+    return;
+  }
+  secFreeList(mailboxes);
+  mailboxes = NULL;
+}
@@ -0,0 +1,15 @@
+#ifndef OIDC_MAILBOXES_H
+#define OIDC_MAILBOXES_H
+
+#include "utils/oidc_error.h"
+
+oidc_error_t mailboxes_enable(const char* shortnames);
+int          mailboxes_isEnabled();
+void         mailboxes_init(const char* socket_path, const char* group);
+void mailboxes_publish(const char* shortname, const char* access_token,
+                       const char* issuer, unsigned long expires_at);
+void mailboxes_clear(const char* shortname);
+void mailboxes_clearAll();
+void mailboxes_destroy();
+
+#endif  // OIDC_MAILBOXES_H
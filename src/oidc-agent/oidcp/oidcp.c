@@ -1,40 +1,83 @@
 #define _XOPEN_SOURCE 500
 
 #include "oidcp.h"
+#include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
 #include "defines/settings.h"
 #include "ipc/cryptCommunicator.h"
 #include "ipc/cryptIpc.h"
 #include "ipc/pipe.h"
+#include "ipc/reactor.h"
 #include "ipc/serveripc.h"
 #include "oidc-agent/agent_state.h"
 #include "oidc-agent/daemonize.h"
 #include "oidc-agent/oidcd/parse_internal.h"
+#include "oidc-agent/oidcp/attach.h"
+#include "oidc-agent/oidcp/configWatcher.h"
+#include "oidc-agent/oidcp/confirmGrants.h"
+#include "oidc-agent/oidcp/hotTokenCache.h"
+#include "oidc-agent/oidcp/keyPairPool.h"
+#include "oidc-agent/oidcp/listeners.h"
+#include "oidc-agent/oidcp/mailboxes.h"
 #include "oidc-agent/oidcp/passwords/askpass.h"
+#include "oidc-agent/oidcp/passwords/passwordCache.h"
 #include "oidc-agent/oidcp/passwords/password_handler.h"
 #include "oidc-agent/oidcp/passwords/password_store.h"
+#include "oidc-agent/oidcp/peers.h"
 #include "oidc-agent/oidcp/proxy_handler.h"
+#include "oidc-agent/oidcp/recorder.h"
+#include "oidc-agent/oidcp/recovery.h"
+#include "oidc-agent/oidcp/refreshTokenLanes.h"
+#include "oidc-agent/oidcp/refreshTokenQueue.h"
+#include "oidc-agent/oidcp/scheduler.h"
+#include "oidc-agent/oidcp/socketActivation.h"
 #include "oidc-agent/oidcp/start_oidcd.h"
+#include "oidc-agent/oidcp/subscriptions.h"
+#include "oidc-agent/oidcp/tenants.h"
+#include "oidc-agent/oidcp/top.h"
+#include "oidc-agent/oidcp/upgrade.h"
+#include "oidc-agent/oidcp/upstream.h"
+#include "oidc-agent/oidcp/workers.h"
+#include "oidc-agent/workPool.h"
 #ifndef __APPLE__
 #include "privileges/agent_privileges.h"
 #endif
 #include "utils/agentLogger.h"
+#include "utils/clockWatch.h"
 #include "utils/crypt/crypt.h"
+#include "utils/crypt/keyCache.h"
+#include "utils/crypt/memoryCrypt.h"
 #include "utils/db/connection_db.h"
 #include "utils/disableTracing.h"
+#include "utils/file_io/oidcDirCache.h"
+#include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
+#include "utils/lazyLib.h"
 #include "utils/listUtils.h"
+#include "utils/loopLag.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/negativeCache.h"
+#include "utils/parseJson.h"
 #include "utils/printer.h"
 #include "utils/printerUtils.h"
+#include "utils/probes.h"
+#include "utils/profiler.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
 
 #include <libgen.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #ifndef __APPLE__
 #include <sys/prctl.h>
 #endif
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -49,6 +92,7 @@ int main(int argc, char** argv) {
   srandom(time(NULL));
 
   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  upgrade_setCommand(argv);
   if (arguments.debug) {
     logger_setloglevel(DEBUG);
   }
@@ -58,6 +102,7 @@ int main(int argc, char** argv) {
   }
 #endif
   initCrypt();
+  initMemoryCrypt();
   if (arguments.kill_flag) {
     char* pidstr = getenv(OIDC_PID_ENV_NAME);
     if (pidstr == NULL) {
@@ -73,6 +118,7 @@ int main(int argc, char** argv) {
       perror("kill");
       exit(EXIT_FAILURE);
     } else {
+      attach_forget(getenv(OIDC_SOCK_ENV_NAME));
       unlink(getenv(OIDC_SOCK_ENV_NAME));
       rmdir(dirname(getenv(OIDC_SOCK_ENV_NAME)));
       printStdout("unset %s;\n", OIDC_SOCK_ENV_NAME);
@@ -81,9 +127,56 @@ int main(int argc, char** argv) {
       exit(EXIT_SUCCESS);
     }
   }
-  if (arguments.status) {
+  if (arguments.health) {
+    char* res = ipc_cryptCommunicate(0, REQUEST_HEALTH);
+    if (res == NULL) {
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
+    char* info = parseForInfo(res);
+    if (info == NULL) {
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
+    printStdout("%s\n", info);
+    char* ready = getJSONValueFromString(info, "ready");
+    int   ok    = strequal(ready, "true");
+    secFree(ready);
+    secFree(info);
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  if (arguments.top) {
+    if (top_run(arguments.top) != OIDC_SUCCESS) {
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+  }
+  if (arguments.upgrade) {
+    char* res = ipc_cryptCommunicate(0, REQUEST_UPGRADE);
+    if (res == NULL) {
+      oidc_perror();
+      exit(EXIT_FAILURE);
+    }
+    char* error = parseForError(res);
+    if (error != NULL) {
+      printError("Could not upgrade the agent: %s\n", error);
+      secFree(error);
+      exit(EXIT_FAILURE);
+    }
+    printStdout("The agent is replaced with the installed binary\n");
+    exit(EXIT_SUCCESS);
+  }
+  if (arguments.status || arguments.metrics || arguments.stats ||
+      arguments.profile) {
     char* res = ipc_cryptCommunicate(
-        0, arguments.json ? REQUEST_STATUS_JSON : REQUEST_STATUS);
+        0,
+        arguments.profile   ? REQUEST_PROFILE
+        : arguments.metrics ? REQUEST_METRICS
+        : arguments.stats   ? REQUEST_STATS
+        : arguments.json    ? REQUEST_STATUS_JSON
+                            : REQUEST_STATUS,
+        arguments.profile, (int)arguments.profile_heap);
     if (res == NULL) {
       oidc_perror();
       exit(EXIT_FAILURE);
@@ -98,73 +191,1468 @@ int main(int argc, char** argv) {
     exit(EXIT_SUCCESS);
   }
 
+  if (arguments.multi_user) {
+    if (arguments.snapshot || arguments.evict_idle || arguments.prefetch ||
+        arguments.refresh_keepalive || arguments.async_validate ||
+        arguments.pw_lifetime.argProvided || arguments.upstream ||
+        arguments.config_cache || peers_isEnabled() || mailboxes_isEnabled()) {
+      printError("--multi-user cannot be combined with --pw-store, "
+                 "--snapshot, --evict-idle, --prefetch, --refresh-keepalive, "
+                 "--async-validate, --config-cache, --mailbox, --peer or "
+                 "--upstream\n");
+      exit(EXIT_FAILURE);
+    }
+    // Account configs and the web server belong to a single user
+    arguments.no_autoload  = 1;
+    arguments.no_webserver = 1;
+    arguments.no_scheme    = 1;
+  }
+  // Opened before daemonizing, so that a relative path is relative to the
+  // current directory
+  if (arguments.record && recorder_open(arguments.record) != OIDC_SUCCESS) {
+    printError("Could not open '%s': %s\n", arguments.record, oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+
   struct connection* listencon = secAlloc(sizeof(struct connection));
   signal(SIGPIPE, SIG_IGN);
-  if (ipc_server_init(listencon, arguments.group) != OIDC_SUCCESS) {
+  unsigned char activated     = 0;
+  int           inherited_sock = upgrade_takeSocket(&activated);
+  if (inherited_sock < 0) {
+    inherited_sock = socketActivation_getSocket();
+    activated      = inherited_sock >= 0;
+  }
+  if (inherited_sock < 0 && arguments.attach) {
+    // Held until the socket of a started agent listens
+    if (attach_lock() != OIDC_SUCCESS) {
+      printError("%s\n", oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+    char* loaded = NULL;
+    pid_t pid    = attach_findAgent(&loaded);
+    if (pid > 0) {
+      attach_printEnvs(pid, loaded, arguments.quiet, arguments.json);
+      secFree(loaded);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  oidc_error_t init_e;
+  if (inherited_sock >= 0) {
+    init_e =
+        ipc_server_initWithSocket(listencon, inherited_sock, arguments.group);
+  } else if (arguments.attach) {
+    init_e = ipc_server_initAtPath(listencon, attach_getSocketPath(),
+                                   arguments.group);
+  } else {
+    init_e = ipc_server_init(listencon, arguments.group);
+  }
+  if (init_e != OIDC_SUCCESS) {
     printError("%s\n", oidc_serror());
     exit(EXIT_FAILURE);
   }
+  server_ipc_setTrustLocalClients(arguments.trust_local_clients);
+  server_ipc_setTrustAllUsers(arguments.multi_user);
+  upstream_setAddress(arguments.upstream);
+  if (!activated && arguments.exit_idle) {
+    agent_log(NOTICE, "--exit-idle is ignored without socket activation");
+    arguments.exit_idle = 0;
+  }
 
-  if (!arguments.console) {
+  if (inherited_sock >= 0) {
+    // The service manager supervises the agent or it replaced a running agent
+    // and its clients already know the socket, so there is nothing to
+    // daemonize or to print
+  } else if (!arguments.console) {
     pid_t daemon_pid = daemonize();
     if (daemon_pid > 0) {
+      if (arguments.attach) {
+        attach_writePid(daemon_pid);
+      }
       // Export PID of new daemon
       printEnvs(listencon->server->sun_path, daemon_pid, arguments.quiet,
                 arguments.json);
       exit(EXIT_SUCCESS);
     }
   } else {
+    if (arguments.attach) {
+      attach_writePid(getpid());
+    }
     printEnvs(listencon->server->sun_path, getpid(), arguments.quiet,
               arguments.json);
+    fflush(stdout);  // stdout might be a pipe and we do not exit
   }
 
   agent_state.defaultTimeout = arguments.lifetime;
-  struct ipcPipe pipes       = startOidcd(&arguments);
+  agent_state.peers          = peers_isEnabled();
+  agent_state.multi_user     = arguments.multi_user;
+  if (arguments.config_cache) {  // inherited by the workers
+    char* oidc_dir = getOidcDir();
+    oidcDirCache_enable(oidc_dir, arguments.config_cache);
+    secFree(oidc_dir);
+  }
+  char* handover       = upgrade_getAccounts();
+  agent_state.handover = handover;
+  workers_start(&arguments);
+  agent_state.handover = NULL;
+  secFree(handover);
 
-  if (ipc_bindAndListen(listencon) != 0) {
+  if (inherited_sock < 0 && ipc_bindAndListen(listencon) != 0) {
+    exit(EXIT_FAILURE);
+  }
+  attach_unlock();
+  upgrade_setSocket(*(listencon->sock), activated);
+  importPasswords(upgrade_getPasswords());
+  upgrade_free();
+  if (inherited_sock < 0 && arguments.multi_user &&
+      tenants_openSocket(listencon->server->sun_path) != OIDC_SUCCESS) {
+    printError("%s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  if (listeners_start() != OIDC_SUCCESS) {
     exit(EXIT_FAILURE);
   }
 
-  handleClientComm(listencon, pipes, &arguments);
+  handleClientComm(listencon, &arguments);
 
   return EXIT_FAILURE;
 }
 
-void handleClientComm(struct connection* listencon, struct ipcPipe pipes,
+/**
+ * A batch of access token requests from a single client. Every element is
+ * forwarded to oidcd as a separate request; the client gets a single response
+ * after all of them were answered. A request that is sent to all workers is
+ * handled as a batch with one element per worker, whose responses are merged.
+ */
+struct batchRequest {
+  struct connection* con;
+  size_t             len;
+  size_t             outstanding;
+  char**             responses;
+  char*              fanout;  // request type if sent to all workers
+};
+
+/**
+ * A client request that was forwarded to oidcd and that is waiting for the
+ * response. Requests are tagged, so that oidcd can answer them in a different
+ * order than they were sent. A request either belongs to a client connection
+ * or is an element of a batch.
+ */
+struct pendingRequest {
+  unsigned long        tag;
+  struct connection*   con;
+  struct batchRequest* batch;
+  size_t               index;
+  char*                request;  // kept to send it to upstream or again
+  char*                subscription;  // account the client subscribes to
+  unsigned char        scheduled;     // a forced refresh of the scheduler
+  size_t               worker;        // the worker handling the request
+  unsigned char        resent;        // sent again to a restarted worker
+  double               received;      // metrics_now() when it was added
+};
+
+static list_t*       pendingRequests = NULL;
+static unsigned long lastTag         = 0;
+static unsigned long slowRequestMs   = 0;
+static time_t        lastActivity    = 0;
+
+/**
+ * The state of an upgrade requested with --upgrade; see upgrade.c. While
+ * @c upgrading all new requests are answered with a busy response.
+ */
+static unsigned char      upgrading       = 0;
+static struct connection* upgradeCon      = NULL;  // until workers are asked
+static time_t             upgradeDeadline = 0;
+static cJSON*             upgradeAccounts = NULL;  // handed over by workers
+
+static int _matchPendingRequestByTag(const unsigned long*         tag,
+                                     const struct pendingRequest* r) {
+  return *tag == r->tag;
+}
+
+static void _secFreePendingRequest(struct pendingRequest* r) {
+  if (r->con) {
+    server_ipc_freeKeyFor(*(r->con->msgsock));
+    _secFreeConnection(r->con);
+  }
+  secFree(r->request);
+  secFree(r->subscription);
+  secFree(r);
+}
+
+static unsigned long _nextTag() {
+  lastTag++;
+  if (lastTag == 0 || lastTag == IPC_TAG_INTERNAL ||
+      lastTag == IPC_TAG_NOTIFY) {  // reserved tags
+    lastTag = 1;
+  }
+  return lastTag;
+}
+
+/**
+ * @brief removes a client connection from the connection db without freeing
+ * it; the caller owns the connection afterwards
+ */
+static void _detachConnection(struct connection* con) {
+  reactor_unwatchConnection(con);
+  freeFunction oldFree = connectionDB_setFreeFunction(NULL);
+  connectionDB_removeIfFound(con);
+  connectionDB_setFreeFunction(oldFree);
+}
+
+static struct pendingRequest* _addPendingRequest(unsigned long tag,
+                                                 const char*   request,
+                                                 size_t        worker) {
+  if (pendingRequests == NULL) {
+    pendingRequests        = list_new();
+    pendingRequests->match = (matchFunction)_matchPendingRequestByTag;
+    pendingRequests->free  = (void (*)(void*))_secFreePendingRequest;
+  }
+  struct pendingRequest* r = secAlloc(sizeof(struct pendingRequest));
+  r->tag                   = tag;
+  r->request               = oidc_strcopy(request);
+  r->worker                = worker;
+  r->received              = metrics_now();
+  list_rpush(pendingRequests, list_node_new(r));
+  return r;
+}
+
+static void _oidcdDied() {
+  agent_log(ERROR, "oidcd died");
+  if (pendingRequests != NULL) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(pendingRequests, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      struct pendingRequest* r   = node->val;
+      struct connection*     con = r->batch ? r->batch->con : r->con;
+      server_ipc_write(*(con->msgsock), RESPONSE_ERROR, "oidcd died");
+    }
+    list_iterator_destroy(it);
+  }
+  exit(EXIT_FAILURE);
+}
+
+static void _workerDied(size_t worker);
+
+/**
+ * @brief adds the times oidcd needs to the parsed request @p json: the time
+ * it is queued, so that oidcd can include the time it waited in the log of a
+ * slow request, and the deadline after which the client stopped waiting, if
+ * the client gave a timeout
+ */
+static void _stampRequestJson(cJSON* json) {
+  const double now = metrics_now();
+  if (slowRequestMs) {
+    jsonAddNumberValue(json, IPC_KEY_QUEUEDAT, now);
+  }
+  const cJSON* timeout = cJSON_GetObjectItemCaseSensitive(json,
+                                                          IPC_KEY_TIMEOUT);
+  if (cJSON_IsNumber(timeout) && timeout->valuedouble > 0) {
+    jsonAddNumberValue(json, IPC_KEY_DEADLINE, now + timeout->valuedouble);
+  }
+}
+
+/**
+ * @brief stamps a request with @c _stampRequestJson
+ * @return a pointer to the new message or @c NULL if nothing has to be
+ * added; it has to be freed after usage
+ */
+static char* _stampRequest(const char* msg) {
+  if (slowRequestMs == 0 && strstr(msg, "\"" IPC_KEY_TIMEOUT "\"") == NULL) {
+    return NULL;
+  }
+  cJSON* json = stringToJson(msg);
+  if (json == NULL) {
+    return NULL;
+  }
+  _stampRequestJson(json);
+  char* stamped = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return stamped;
+}
+
+static struct pendingRequest* _forwardToOidcd(struct ipcPipe     pipes,
+                                              struct connection* con,
+                                              const char*        msg) {
+  unsigned long tag     = _nextTag();
+  size_t        worker  = workers_indexOf(pipes);
+  char*         stamped = _stampRequest(msg);
+  char*         traced =
+      requestTrace_markMessage(stamped ?: msg, "oidcp_forward");
+  OIDC_PROBE2(oidcp_request_dispatch, *(con->msgsock), tag);
+  oidc_error_t  e      = ipc_writeToPipe(ipc_tagPipe(pipes, tag), "%s",
+                                        traced ?: stamped ?: msg);
+  secFree(traced);
+  secFree(stamped);
+  // The connection is now owned by the pending request
+  _detachConnection(con);
+  struct pendingRequest* r = _addPendingRequest(tag, msg, worker);
+  r->con                   = con;
+  if (e != OIDC_SUCCESS) {
+    _workerDied(worker);  // the request is sent to the restarted worker
+  }
+  return r;
+}
+
+/**
+ * @brief forwards a client request to oidcd
+ * The response is handled asynchronously by @c handleOidcdComm
+ * @param pipes the pipes of the worker that handles the request
+ */
+void forwardToOidcd(struct ipcPipe pipes, struct connection* con,
+                    const char* msg) {
+  _forwardToOidcd(pipes, con, msg);
+}
+
+/**
+ * @brief returns a client connection after its request was answered
+ * Session connections are put back into the connection db, all others are
+ * closed.
+ */
+static void _releaseClientConnection(struct connection* con) {
+  if (server_ipc_getSessionKeyFor(*(con->msgsock))) {
+    // Keep the session connection for the next request
+    connectionDB_addValue(con);
+    reactor_watchConnection(con);
+    return;
+  }
+  server_ipc_freeKeyFor(*(con->msgsock));
+  _secFreeConnection(con);
+}
+
+static void _secFreeBatchRequest(struct batchRequest* batch) {
+  for (size_t i = 0; i < batch->len; i++) {
+    secFree(batch->responses[i]);
+  }
+  secFree(batch->responses);
+  secFree(batch->fanout);
+  secFree(batch);
+}
+
+/**
+ * @brief appends the elements of the json array @p src to @p dst
+ */
+static void _appendJSONArray(cJSON* dst, const cJSON* src) {
+  if (!cJSON_IsArray(dst) || !cJSON_IsArray(src)) {
+    return;
+  }
+  const cJSON* el;
+  cJSON_ArrayForEach(el, src) {
+    cJSON_AddItemToArray(dst, cJSON_Duplicate(el, 1));
+  }
+}
+
+/**
+ * @brief adds the strings of the json array @p src to @p dst that are not in
+ * it yet
+ */
+static void _mergeJSONStringArray(cJSON* dst, const cJSON* src) {
+  if (!cJSON_IsArray(dst) || !cJSON_IsArray(src)) {
+    return;
+  }
+  const cJSON* el;
+  cJSON_ArrayForEach(el, src) {
+    const cJSON* existing;
+    cJSON_ArrayForEach(existing, dst) {
+      if (strequal(cJSON_GetStringValue(existing), cJSON_GetStringValue(el))) {
+        break;
+      }
+    }
+    if (existing == NULL) {
+      cJSON_AddItemToArray(dst, cJSON_Duplicate(el, 1));
+    }
+  }
+}
+
+/**
+ * @brief merges the responses of all workers to a request that was sent to
+ * all of them
+ * If a worker failed its response is returned. Otherwise the loaded accounts,
+ * account usage statistics and memory statistics of all workers are joined
+ * into the response of worker @c 0 and the status texts and profiles
+ * concatenated; for all other requests the response of worker @c 0 is
+ * returned.
+ * @return the merged response; has to be freed after usage
+ */
+static char* _mergeFanoutResponses(const struct batchRequest* batch) {
+  for (size_t i = 0; i < batch->len; i++) {
+    char* status = getJSONValueFromString(batch->responses[i], IPC_KEY_STATUS);
+    const int failed = !strequal(status, STATUS_SUCCESS);
+    secFree(status);
+    if (failed) {
+      return oidc_strcopy(batch->responses[i]);
+    }
+  }
+  cJSON* merged = stringToJson(batch->responses[0]);
+  cJSON* info   = cJSON_GetObjectItemCaseSensitive(merged, IPC_KEY_INFO);
+  for (size_t i = 1; merged && i < batch->len; i++) {
+    cJSON*       res   = stringToJson(batch->responses[i]);
+    const cJSON* other = cJSON_GetObjectItemCaseSensitive(res, IPC_KEY_INFO);
+    if (strequal(batch->fanout, REQUEST_VALUE_LOADEDACCOUNTS) ||
+        strequal(batch->fanout, REQUEST_VALUE_STATS)) {
+      _appendJSONArray(info, other);
+    } else if (strequal(batch->fanout, REQUEST_VALUE_STATUS_JSON)) {
+      _appendJSONArray(
+          cJSON_GetObjectItemCaseSensitive(info, "loaded_accounts"),
+          cJSON_GetObjectItemCaseSensitive(other, "loaded_accounts"));
+      _appendJSONArray(
+          cJSON_GetObjectItemCaseSensitive(info, "account_stats"),
+          cJSON_GetObjectItemCaseSensitive(other, "account_stats"));
+      _appendJSONArray(cJSON_GetObjectItemCaseSensitive(info, "memory"),
+                       cJSON_GetObjectItemCaseSensitive(other, "memory"));
+      _appendJSONArray(
+          cJSON_GetObjectItemCaseSensitive(info, "account_validations"),
+          cJSON_GetObjectItemCaseSensitive(other, "account_validations"));
+      _mergeJSONStringArray(
+          cJSON_GetObjectItemCaseSensitive(info, "optional_libraries"),
+          cJSON_GetObjectItemCaseSensitive(other, "optional_libraries"));
+    } else if ((strequal(batch->fanout, REQUEST_VALUE_STATUS) ||
+                strequal(batch->fanout, REQUEST_VALUE_PROFILE)) &&
+               cJSON_IsString(info) && cJSON_IsString(other)) {
+      char* text = oidc_strcat(info->valuestring, other->valuestring);
+      cJSON_ReplaceItemInObjectCaseSensitive(merged, IPC_KEY_INFO,
+                                             cJSON_CreateString(text));
+      info = cJSON_GetObjectItemCaseSensitive(merged, IPC_KEY_INFO);
+      secFree(text);
+    }
+    secFreeJson(res);
+  }
+  char* merged_str = merged ? jsonToStringUnformatted(merged)
+                            : oidc_strcopy(batch->responses[0]);
+  secFreeJson(merged);
+  return merged_str;
+}
+
+/**
+ * @brief stops the profile of oidcp and puts it in front of the profiles of
+ * the workers in @p response
+ * @return the new response; @p response is freed
+ */
+static char* _addOwnProfile(char* response) {
+  char*  profile = profiler_stop("oidcp");
+  cJSON* json    = stringToJson(response);
+  cJSON* info    = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_INFO);
+  if (profile && cJSON_IsString(info)) {
+    char* text = oidc_strcat(profile, info->valuestring);
+    cJSON_ReplaceItemInObjectCaseSensitive(json, IPC_KEY_INFO,
+                                           cJSON_CreateString(text));
+    secFree(text);
+    secFree(response);
+    response = jsonToStringUnformatted(json);
+  }
+  secFreeJson(json);
+  secFree(profile);
+  return response;
+}
+
+/**
+ * @brief adds the optional libraries loaded by oidcp, e.g. for the keyring, to
+ * a status response of the workers
+ * @return the new response; @p response is freed
+ */
+static char* _addOwnLibraries(char* response, const char* request_type) {
+  if (lazyLib_count() == 0) {
+    return response;
+  }
+  cJSON* json = stringToJson(response);
+  cJSON* info = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_INFO);
+  if (strequal(request_type, REQUEST_VALUE_STATUS_JSON)) {
+    cJSON* own = lazyLib_loadedToJSON();
+    _mergeJSONStringArray(
+        cJSON_GetObjectItemCaseSensitive(info, "optional_libraries"), own);
+    secFreeJson(own);
+  } else if (cJSON_IsString(info)) {
+    char* libraries = lazyLib_loadedToString();
+    char* text      = oidc_sprintf("%sOptional libraries loaded by oidcp: %s\n",
+                                   info->valuestring, libraries);
+    cJSON_ReplaceItemInObjectCaseSensitive(json, IPC_KEY_INFO,
+                                           cJSON_CreateString(text));
+    secFree(text);
+    secFree(libraries);
+  }
+  if (json) {
+    secFree(response);
+    response = jsonToStringUnformatted(json);
+  }
+  secFreeJson(json);
+  return response;
+}
+
+/**
+ * @brief returns the number of client connections oidcp can have open at most
+ */
+static size_t _connectionLimit() {
+#ifdef IPC_HAVE_REACTOR
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY) {
+    return limit.rlim_cur;
+  }
+#endif
+  return FD_SETSIZE;
+}
+
+/**
+ * @brief combines the health of all workers with the saturation of oidcp
+ * The agent is not ready if a worker did not answer properly or waits for the
+ * user to answer a prompt, or if the client connections reach 90% of their
+ * limit.
+ * @return the response to the health request; has to be freed after usage
+ */
+static char* _mergeHealthResponses(const struct batchRequest* batch) {
+  unsigned char ready   = 1;
+  cJSON*        workers = cJSON_CreateArray();
+  for (size_t i = 0; i < batch->len; i++) {
+    cJSON* res  = stringToJson(batch->responses[i]);
+    cJSON* info = res ? cJSON_DetachItemFromObjectCaseSensitive(res,
+                                                                IPC_KEY_INFO)
+                      : NULL;
+    if (!cJSON_IsObject(info)) {
+      secFreeJson(info);
+      char* error = getJSONValueFromString(batch->responses[i], OIDC_KEY_ERROR);
+      info        = cJSON_CreateObject();
+      jsonAddNumberValue(info, "worker", i);
+      jsonAddStringValue(info, OIDC_KEY_ERROR, error ?: "Invalid response");
+      secFree(error);
+      ready = 0;
+    } else if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(
+                   info, "prompt_outstanding"))) {
+      ready = 0;
+    }
+    secFreeJson(res);
+    cJSON_AddItemToArray(workers, info);
+  }
+  const size_t connections = connectionDB_getSize();
+  const size_t limit       = _connectionLimit();
+  if (connections * 10 >= limit * 9) {
+    ready = 0;
+  }
+  cJSON* info = cJSON_CreateObject();
+  cJSON_AddBoolToObject(info, "ready", ready);
+  jsonAddNumberValue(info, "connections", connections);
+  jsonAddNumberValue(info, "connection_limit", limit);
+  // the request of the last worker is still pending while it is answered
+  jsonAddNumberValue(info, "pending_requests",
+                     pendingRequests ? pendingRequests->len - 1 : 0);
+  jsonAddNumberValue(info, "subscriptions", subscriptions_count());
+  jsonAddNumberValue(info, "hot_tokens", hotTokenCache_count());
+  jsonAddNumberValue(info, "scheduled_refreshes", scheduler_queued());
+  jsonAddJSON(info, "workers", workers);
+  cJSON* json = generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                   STATUS_SUCCESS, NULL);
+  jsonAddJSON(json, IPC_KEY_INFO, info);
+  char* response = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return response;
+}
+
+/**
+ * @brief keeps the accounts the workers handed over for an upgrade; they are
+ * not sent to the client
+ * @return the response for the client; has to be freed after usage
+ */
+static char* _collectUpgradeState(const struct batchRequest* batch) {
+  cJSON* accounts = cJSON_CreateArray();
+  for (size_t i = 0; i < batch->len; i++) {
+    char* status = getJSONValueFromString(batch->responses[i], IPC_KEY_STATUS);
+    cJSON* res   = stringToJson(batch->responses[i]);
+    cJSON* info  = cJSON_DetachItemFromObjectCaseSensitive(res, IPC_KEY_INFO);
+    const int failed =
+        !strequal(status, STATUS_SUCCESS) || !cJSON_IsArray(info);
+    secFree(status);
+    secFreeJson(res);
+    if (failed) {
+      secFreeJson(info);
+      secFreeJson(accounts);
+      upgrading = 0;
+      return oidc_strcopy(batch->responses[i]);
+    }
+    cJSON_AddItemToArray(accounts, info);
+  }
+  upgradeAccounts = accounts;
+  return oidc_strcopy(RESPONSE_SUCCESS);
+}
+
+static void _answerFanoutRequest(struct batchRequest* batch) {
+  char* response = strequal(batch->fanout, REQUEST_VALUE_UPGRADE)
+                       ? _collectUpgradeState(batch)
+                   : strequal(batch->fanout, REQUEST_VALUE_HEALTH)
+                       ? _mergeHealthResponses(batch)
+                       : _mergeFanoutResponses(batch);
+  if (strequal(batch->fanout, REQUEST_VALUE_PROFILE)) {
+    response = _addOwnProfile(response);
+  } else if (strequal(batch->fanout, REQUEST_VALUE_STATUS) ||
+             strequal(batch->fanout, REQUEST_VALUE_STATUS_JSON)) {
+    response = _addOwnLibraries(response, batch->fanout);
+  }
+  char* traced   = requestTrace_markMessage(response, "oidcp_respond");
+  server_ipc_writeMessage(*(batch->con->msgsock), traced ?: response);
+  secFree(traced);
+  secFree(response);
+  _releaseClientConnection(batch->con);
+  _secFreeBatchRequest(batch);
+}
+
+static void _answerBatchRequest(struct batchRequest* batch) {
+  cJSON* responses = cJSON_CreateArray();
+  for (size_t i = 0; i < batch->len; i++) {
+    cJSON* res = stringToJson(batch->responses[i]);
+    cJSON_AddItemToArray(
+        responses, res ?: generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                             STATUS_FAILURE, OIDC_KEY_ERROR,
+                                             cJSON_String,
+                                             "Invalid response from oidcd",
+                                             NULL));
+  }
+  char* responses_str = jsonToStringUnformatted(responses);
+  secFreeJson(responses);
+  server_ipc_write(*(batch->con->msgsock), RESPONSE_BATCH, responses_str);
+  secFree(responses_str);
+  _releaseClientConnection(batch->con);
+  _secFreeBatchRequest(batch);
+}
+
+/**
+ * @brief checks if a client closed its connection
+ */
+static int _clientGone(const struct connection* con) {
+  if (con == NULL) {
+    return 0;
+  }
+  struct pollfd pfd = {.fd = *(con->msgsock), .events = POLLIN};
+  if (poll(&pfd, 1, 0) <= 0) {
+    return 0;
+  }
+  if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+    return 1;
+  }
+  char c;
+  return recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/**
+ * @brief checks if the client of a pending request closed its connection
+ * Used to not prompt the user for a request nobody waits for anymore.
+ */
+static int _pendingClientGone(const struct pendingRequest* r) {
+  return _clientGone(r->batch ? r->batch->con : r->con);
+}
+
+/**
+ * @brief forwards the forced refreshes of the scheduler to oidcd as long as
+ * their workers have room for them
+ * Requests whose client already closed the connection are dropped.
+ */
+static void _dispatchScheduled() {
+  struct scheduledRequest* r;
+  while ((r = scheduler_next())) {
+    if (_clientGone(r->con)) {
+      scheduler_done(r->worker);
+      server_ipc_freeKeyFor(*(r->con->msgsock));
+      _secFreeConnection(r->con);
+    } else {
+      struct pendingRequest* p =
+          _forwardToOidcd(workers_get(r->worker), r->con, r->msg);
+      p->scheduled = 1;
+      p->worker    = r->worker;
+    }
+    scheduler_freeRequest(r);
+  }
+}
+
+/**
+ * @brief answers a client request or an element of a batch
+ */
+static void _answerClient(struct connection* con, struct batchRequest* batch,
+                          size_t index, const char* response) {
+  if (batch) {
+    batch->responses[index] = oidc_strcopy(response);
+    batch->outstanding--;
+    if (batch->outstanding == 0) {
+      if (batch->fanout) {
+        _answerFanoutRequest(batch);
+      } else {
+        _answerBatchRequest(batch);
+      }
+    }
+    return;
+  }
+  char* traced = requestTrace_markMessage(response, "oidcp_respond");
+  server_ipc_writeMessage(*(con->msgsock), traced ?: response);
+  secFree(traced);
+  _releaseClientConnection(con);
+}
+
+/**
+ * A client request that is answered by the upstream agent
+ */
+struct upstreamClient {
+  struct connection*   con;
+  struct batchRequest* batch;
+  size_t               index;
+};
+
+static void _answerFromUpstream(const char* response, void* arg) {
+  struct upstreamClient* c = arg;
+  _answerClient(c->con, c->batch, c->index, response);
+  secFree(c);
+}
+
+/**
+ * @brief hands a pending request over to the upstream agent
+ * @return @c OIDC_SUCCESS if the client is answered by the upstream agent; the
+ * client connection is then no longer owned by @p pending
+ */
+static oidc_error_t _forwardToUpstream(struct pendingRequest* pending) {
+  struct upstreamClient* c = secAlloc(sizeof(struct upstreamClient));
+  c->con                   = pending->con;
+  c->batch                 = pending->batch;
+  c->index                 = pending->index;
+  pending->con             = NULL;
+  if (upstream_getToken(pending->request, _answerFromUpstream, c) !=
+      OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not ask upstream agent: %s", oidc_serror());
+    pending->con = c->con;
+    secFree(c);
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief forwards the response of oidcd to the client of a pending request
+ * If the token is not available locally and an upstream agent is configured,
+ * the request is forwarded to that agent instead. The pending request is
+ * removed afterwards.
+ */
+static void _answerPendingRequest(list_node_t* node, const char* response) {
+  struct pendingRequest* pending = node->val;
+  if (pending->scheduled) {
+    scheduler_done(pending->worker);
+  } else if (!(pending->batch && pending->batch->fanout)) {
+    recorder_record(pending->request, response, pending->received);
+  }
+  if (pending->subscription == NULL &&
+      upstream_isMiss(pending->request, response) &&
+      _forwardToUpstream(pending) == OIDC_SUCCESS) {
+    agent_log(DEBUG, "Request %lu forwarded upstream", pending->tag);
+  } else {
+    if (pending->subscription) {
+      char* status = getJSONValueFromString(response, IPC_KEY_STATUS);
+      if (strequal(status, STATUS_SUCCESS)) {
+        subscriptions_add(*(pending->con->msgsock), pending->subscription);
+      }
+      secFree(status);
+    }
+    _answerClient(pending->con, pending->batch, pending->index, response);
+    pending->con = NULL;
+  }
+  agent_log(DEBUG, "Remove request %lu", pending->tag);
+  const unsigned char scheduled = pending->scheduled;
+  list_remove(pendingRequests, node);
+  if (scheduled) {
+    _dispatchScheduled();
+  }
+}
+
+/**
+ * @brief restarts a worker that died with the accounts it pushed last and
+ * sends it the requests it did not answer yet; see recovery.c
+ * A request that was sent again already is answered with an error instead,
+ * because it might be the one that made the worker crash. If the worker
+ * crashed too often, the agent exits.
+ */
+static void _workerDied(size_t worker) {
+  agent_log(ERROR, "oidcd worker %lu died", (unsigned long)worker);
+  if (!recovery_mayRestart(worker)) {
+    _oidcdDied();
+  }
+  hotTokenCache_clear();  // the restarted worker does not know them
+  char* handover       = recovery_handoverFor(worker);
+  agent_state.handover = handover;
+  workers_restart(worker);
+  agent_state.handover = NULL;
+  secFree(handover);
+  agent_log(NOTICE, "Restarted oidcd worker %lu", (unsigned long)worker);
+  if (pendingRequests == NULL) {
+    return;
+  }
+  struct ipcPipe   pipes  = workers_get(worker);
+  list_t*          failed = list_new();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(pendingRequests, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct pendingRequest* r = node->val;
+    if (r->worker != worker) {
+      continue;
+    }
+    // a new tag, so that late answers to the crashed worker do not match
+    r->tag = _nextTag();
+    if (r->resent || ipc_writeToPipe(ipc_tagPipe(pipes, r->tag), "%s",
+                                     r->request) != OIDC_SUCCESS) {
+      list_rpush(failed, list_node_new(node));
+    }
+    r->resent = 1;
+  }
+  list_iterator_destroy(it);
+  char* error = oidc_sprintf(RESPONSE_ERROR, "oidcd died");
+  while ((node = list_lpop(failed))) {
+    _answerPendingRequest(node->val, error);
+    LIST_FREE(node);
+  }
+  secFree(error);
+  list_destroy(failed);
+}
+
+/**
+ * @brief forwards a batch of requests to oidcd
+ * Every element is sent as its own request of type @p request_type to the
+ * worker owning its account. For access tokens this means that cached tokens
+ * are returned immediately and refreshes for the same token are coalesced; the
+ * accounts of an add batch are loaded by the workers in parallel.
+ * @return @c OIDC_SUCCESS if the batch was forwarded; the connection is then
+ * owned by the batch
+ */
+static oidc_error_t _forwardBatchToOidcd(struct connection*      con,
+                                         const char*             requests_str,
+                                         const char*             request_type,
+                                         const struct arguments* arguments) {
+  cJSON* requests = stringToJson(requests_str);
+  if (requests == NULL || !cJSON_IsArray(requests) ||
+      cJSON_GetArraySize(requests) <= 0) {
+    secFreeJson(requests);
+    oidc_errno = OIDC_EJSONARR;
+    return oidc_errno;
+  }
+  struct batchRequest* batch = secAlloc(sizeof(struct batchRequest));
+  batch->con                 = con;
+  batch->len                 = cJSON_GetArraySize(requests);
+  batch->outstanding         = batch->len;
+  batch->responses           = secAlloc(sizeof(char*) * batch->len);
+  _detachConnection(con);
+  for (size_t i = 0; i < batch->len; i++) {
+    cJSON* request = cJSON_GetArrayItem(requests, i);
+    if (cJSON_IsObject(request)) {
+      setJSONValue(request, IPC_KEY_REQUEST, request_type);
+      _stampRequestJson(request);
+    }
+    char* msg = jsonToStringUnformatted(request);
+    if (strequal(request_type, REQUEST_VALUE_ADD) && !agent_state.multi_user) {
+      char* pwe = getJSONValueFromString(msg, IPC_KEY_PASSWORDENTRY);
+      pw_handleSave(pwe, arguments->pw_lifetime);
+      secFree(pwe);
+    }
+    unsigned long tag    = _nextTag();
+    size_t        worker = workers_forRequest(msg);
+    oidc_error_t  e      =
+        ipc_writeToPipe(ipc_tagPipe(workers_get(worker), tag), "%s", msg);
+    struct pendingRequest* r = _addPendingRequest(tag, msg, worker);
+    r->batch                 = batch;
+    r->index                 = i;
+    secFree(msg);
+    if (e != OIDC_SUCCESS) {
+      _workerDied(worker);
+    }
+  }
+  secFreeJson(requests);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief sends a client request to all workers
+ * The responses are merged by @c _mergeFanoutResponses once all workers
+ * answered.
+ */
+static void _forwardToAllWorkers(struct connection* con, const char* msg,
+                                 const char* request_type) {
+  struct batchRequest* batch = secAlloc(sizeof(struct batchRequest));
+  batch->con                 = con;
+  batch->len                 = workers_count();
+  batch->outstanding         = batch->len;
+  batch->responses           = secAlloc(sizeof(char*) * batch->len);
+  batch->fanout              = oidc_strcopy(request_type);
+  _detachConnection(con);
+  for (size_t i = 0; i < batch->len; i++) {
+    unsigned long tag = _nextTag();
+    oidc_error_t  e   =
+        ipc_writeToPipe(ipc_tagPipe(workers_get(i), tag), "%s", msg);
+    struct pendingRequest* r = _addPendingRequest(tag, msg, i);
+    r->batch                 = batch;
+    r->index                 = i;
+    if (e != OIDC_SUCCESS) {
+      _workerDied(i);
+    }
+  }
+}
+
+static void _closeClientConnection(struct connection* con) {
+  agent_log(DEBUG, "Remove con from pool");
+  subscriptions_removeSocket(*(con->msgsock));
+  server_ipc_freeKeyFor(*(con->msgsock));
+  reactor_unwatchConnection(con);
+  connectionDB_removeIfFound(con);
+  agent_log(DEBUG, "Currently there are %lu connections",
+            connectionDB_getSize());
+}
+
+/**
+ * @brief checks if oidcp has to shed load, because oidcd did not answer
+ * @c AGENT_MAX_PENDING_REQUESTS requests yet
+ */
+static int _isOverloaded() {
+  return pendingRequests && pendingRequests->len >= AGENT_MAX_PENDING_REQUESTS;
+}
+
+/**
+ * @brief checks if a request is a token request
+ * These are the requests clients send automatically and in numbers; they are
+ * rejected while oidcp is overloaded, while requests of the user, e.g. to load
+ * or lock, are still forwarded. They are also the only requests allowed on a
+ * tokens-only socket.
+ */
+static int _isTokenRequest(const char* request) {
+  return strequal(request, REQUEST_VALUE_ACCESSTOKEN) ||
+         strequal(request, REQUEST_VALUE_ACCESSTOKEN_BATCH) ||
+         strequal(request, REQUEST_VALUE_IDTOKEN) ||
+         strequal(request, REQUEST_VALUE_PREFETCH) ||
+         strequal(request, REQUEST_VALUE_SUBSCRIBE) ||
+         strequal(request, REQUEST_VALUE_TOKENREJECTED) ||
+         strequal(request, REQUEST_VALUE_USERINFO) ||
+         strequal(request, REQUEST_VALUE_VALIDATE);
+}
+
+/**
+ * @brief answers an access token request with a token response oidcd
+ * published, without forwarding the request to oidcd
+ * @return @c 1 if the request was answered
+ */
+static int _answerFromHotTokenCache(struct connection* con, const char* msg) {
+  const char* response = hotTokenCache_lookup(msg);
+  if (response == NULL) {
+    return 0;
+  }
+  metrics_inc(METRIC_REQUESTS, REQUEST_VALUE_ACCESSTOKEN);
+  metrics_inc(METRIC_TOKENCACHE, METRIC_LABEL_HIT);
+  server_ipc_write(*(con->msgsock), "%s", response);
+  return 1;
+}
+
+/**
+ * @brief starts a session on a client connection
+ * The connection is not closed after a response, so that the client can send
+ * further requests encrypted with the same key.
+ */
+static void _startSession(struct connection* con) {
+  if (server_ipc_startSessionFor(*(con->msgsock)) != OIDC_SUCCESS) {
+    server_ipc_writeOidcErrno(*(con->msgsock));
+    return;
+  }
+  agent_log(DEBUG, "Started session on con %d", *(con->msgsock));
+  server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS);
+}
+
+/**
+ * @brief subscribes a client to new access tokens of an account
+ * The subscription is sent to oidcd as an ordinary access token request, so
+ * the client is only subscribed if it may obtain tokens for the account; the
+ * subscription is added when oidcd answers it successfully. Afterwards every
+ * new default access token of the account is pushed to the client. Only
+ * session connections can be subscribed, since the connection has to stay
+ * open.
+ * @return @c OIDC_SUCCESS if the request was forwarded; the connection is then
+ * owned by the pending request
+ */
+static oidc_error_t _forwardSubscriptionToOidcd(struct connection* con,
+                                                const char*        msg,
+                                                const char*        shortname) {
+  if (!strValid(shortname)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (server_ipc_getSessionKeyFor(*(con->msgsock)) == NULL) {
+    oidc_errno = OIDC_ESESSION;
+    return oidc_errno;
+  }
+  cJSON* request = stringToJson(msg);
+  if (request == NULL) {
+    return oidc_errno;
+  }
+  setJSONValue(request, IPC_KEY_REQUEST, REQUEST_VALUE_ACCESSTOKEN);
+  char* forward = jsonToStringUnformatted(request);
+  secFreeJson(request);
+  struct pendingRequest* r =
+      _forwardToOidcd(workers_get(workers_forRequest(forward)), con, forward);
+  r->subscription = oidc_strcopy(shortname);
+  secFree(forward);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief passes a forced token refresh to the scheduler, which forwards it to
+ * oidcd when it is the turn of its client
+ * @return @c OIDC_SUCCESS if the request was scheduled; the connection is then
+ * owned by the scheduler. @c OIDC_ERATELIMIT if the client exceeded its
+ * forced refreshes.
+ */
+static oidc_error_t _scheduleForcedRefresh(
+    struct connection* con, const char* msg, const char* application_hint,
+    const struct listenerPolicy* policy) {
+  uid_t uid = (uid_t)-1;
+  server_ipc_getPeerUid(*(con->msgsock), &uid);
+  if (scheduler_enqueue(uid, application_hint, policy ? policy->index : 0,
+                        policy ? policy->forced_per_minute
+                               : SCHEDULER_FORCED_PER_MINUTE,
+                        con, msg, workers_forRequest(msg)) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  _detachConnection(con);
+  _dispatchScheduled();
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief forwards a metrics request to oidcd together with the metrics of
+ * oidcp; oidcd answers with the metrics of both processes
+ */
+static void _forwardMetricsToOidcd(struct connection* con) {
+  metrics_set(METRIC_CONNECTIONS, NULL, connectionDB_getSize());
+  metrics_set(METRIC_PENDING_REQUESTS, NULL,
+              pendingRequests ? pendingRequests->len : 0);
+  metrics_set(METRIC_SUBSCRIPTIONS, NULL, subscriptions_count());
+  metrics_set(METRIC_KEY_DERIVATIONS, NULL, crypt_getKeyDerivationCount());
+  char*  text    = metrics_toText();
+  cJSON* request = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                      REQUEST_VALUE_METRICS, IPC_KEY_METRICS,
+                                      cJSON_String, text ?: "", NULL);
+  secFree(text);
+  char* msg = jsonToStringUnformatted(request);
+  secFreeJson(request);
+  forwardToOidcd(workers_get(0), con, msg);
+  secFree(msg);
+}
+
+/**
+ * @brief starts recording a profile of oidcp and all workers
+ * Only the user running the agent may do this. The request is answered by
+ * @c _answerFanoutRequest once all workers sent their profile.
+ * @return @c OIDC_SUCCESS if the request was forwarded; the connection is then
+ * owned by the pending requests
+ */
+static oidc_error_t _startProfile(struct connection* con, const char* msg,
+                                  const char* duration, const char* heap) {
+  if (!server_ipc_peerIsOwner(*(con->msgsock))) {
+    oidc_errno = OIDC_EFORBIDDEN;
+    return oidc_errno;
+  }
+  if (profiler_start(duration ? strToULong(duration) : 0,
+                     heap ? strToInt(heap) : 0) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  _forwardToAllWorkers(con, msg, REQUEST_VALUE_PROFILE);
+  return OIDC_SUCCESS;
+}
+
+static volatile sig_atomic_t waiting     = 0;
+static volatile sig_atomic_t terminating = 0;
+
+/**
+ * @brief writes queued refresh token updates before terminating
+ * The updates are only written directly if the signal arrived while waiting
+ * for clients; otherwise this is deferred until the current message was
+ * handled.
+ */
+static void _handleTerm(int sig) {
+  if (!waiting && !terminating) {
+    terminating = sig;
+    return;
+  }
+  rtQueue_flush();
+  mailboxes_destroy();
+  listeners_destroy();
+  peers_destroy();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/**
+ * @brief returns when a socket activated agent exits because it has no
+ * clients; the service manager starts it again for the next client
+ * @param exit_idle the seconds without clients; @c 0 if disabled
+ * @return the point in time or @c 0 if the agent does not exit
+ */
+static time_t _getIdleExitTime(time_t exit_idle) {
+  if (!exit_idle || connectionDB_getSize() > 0 ||
+      (pendingRequests && pendingRequests->len > 0) ||
+      subscriptions_count() > 0) {
+    return 0;
+  }
+  return lastActivity + exit_idle;
+}
+
+/**
+ * @brief keeps the timers when the wall clock was set; see utils/clockWatch.c
+ */
+static void _checkClock() {
+  struct clockJump jump = clockWatch_check();
+  if (jump.step) {
+    timerWheel_shift(jump.step);
+  }
+}
+
+static void _runTimers(int fd, void* arg) {
+  (void)fd;
+  (void)arg;
+  loopLag_setTag("timers");
+  _checkClock();  // setting the wall clock forward fires the timerfd
+  timerWheel_runDue(time(NULL));
+}
+
+static void _runCompletedWork(int fd, void* arg) {
+  (void)fd;
+  (void)arg;
+  loopLag_setTag("completed_work");
+  workPool_runCompleted();
+}
+
+/**
+ * @brief starts an upgrade; the client is answered once the workers handed
+ * over their accounts
+ * @return @c OIDC_SUCCESS if the upgrade was started; the connection is then
+ * owned by the upgrade
+ */
+static oidc_error_t _startUpgrade(struct connection* con) {
+  if (upgrade_canExec() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  _detachConnection(con);
+  upgrading       = 1;
+  upgradeCon      = con;
+  upgradeDeadline = time(NULL) + UPGRADE_DRAIN_TIMEOUT;
+  agent_log(NOTICE, "Upgrade requested; waiting for pending requests");
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief replaces the agent with the new binary; if that fails the workers
+ * are started again with the accounts they handed over
+ */
+static void _upgrade(const struct arguments* arguments) {
+  rtQueue_flush();
+  hotTokenCache_clear();
+  workers_stop();
+  upgrade_exec(upgradeAccounts);  // only returns on failure
+  agent_log(ERROR, "Could not upgrade the agent: %s", oidc_serror());
+  char* handover       = jsonToStringUnformatted(upgradeAccounts);
+  agent_state.handover = handover;
+  workers_start(arguments);
+  agent_state.handover = NULL;
+  secFree(handover);
+  secFreeJson(upgradeAccounts);
+  upgradeAccounts = NULL;
+  upgrading       = 0;
+}
+
+/**
+ * @brief continues an upgrade once no requests are pending anymore: first the
+ * workers are asked to hand over their accounts, then the agent is replaced
+ * If requests are still pending after @c UPGRADE_DRAIN_TIMEOUT seconds, the
+ * upgrade is cancelled.
+ */
+static void _continueUpgrade(const struct arguments* arguments) {
+  if (!upgrading || (pendingRequests && pendingRequests->len > 0)) {
+    if (upgradeCon && upgradeDeadline <= time(NULL)) {
+      agent_log(NOTICE, "Upgrade cancelled: requests are still pending");
+      server_ipc_write(*(upgradeCon->msgsock), RESPONSE_ERROR,
+                       "Requests are still pending; try again later");
+      _releaseClientConnection(upgradeCon);
+      upgradeCon = NULL;
+      upgrading  = 0;
+    }
+    return;
+  }
+  if (upgradeCon) {
+    _forwardToAllWorkers(upgradeCon, REQUEST_UPGRADE, REQUEST_VALUE_UPGRADE);
+    upgradeCon = NULL;  // owned by the batch
+  } else if (upgradeAccounts) {
+    _upgrade(arguments);
+  }
+}
+
+void handleClientComm(struct connection*      listencon,
                       const struct arguments* arguments) {
   connectionDB_new();
   connectionDB_setFreeFunction((void (*)(void*)) & _secFreeConnection);
   connectionDB_setMatchFunction((matchFunction)connection_comparator);
 
+  keyCache_setLifetime(arguments->pw_lifetime);
+  confirmGrants_setDuration(arguments->confirm_grant);
+  passwordCache_setLifetime(arguments->pw_lifetime);
+  slowRequestMs = arguments->slow_request_ms;
+  if (slowRequestMs) {
+    loopLag_setThreshold(slowRequestMs);
+  }
+  metrics_setPrefix("oidcp");
+  atexit(rtQueue_flush);
+  if (!agent_state.multi_user) {  // the account configs of which user?
+    configWatcher_start();
+  }
+  mailboxes_init(listencon->server->sun_path, arguments->group);
+  atexit(mailboxes_destroy);
+  atexit(listeners_destroy);
+  atexit(peers_destroy);
+  atexit(recorder_close);
+  // Without a timerfd the next timer is the timeout of the wait
+  int timerFd = timerWheel_getFd();
+  if (timerFd >= 0) {
+    reactor_watchFd(timerFd, _runTimers, NULL);
+  }
+  // Started after oidcd was forked, so that the workers have no threads
+  if (workPool_start() == OIDC_SUCCESS) {
+    reactor_watchFd(workPool_getFd(), _runCompletedWork, NULL);
+  } else {
+    agent_log(ERROR, "Could not start the work pool: %s", oidc_serror());
+  }
+  keyPairPool_start();
+  atexit(keyPairPool_destroy);
+  signal(SIGTERM, _handleTerm);
+  signal(SIGINT, _handleTerm);
   time_t minDeath = 0;
+  lastActivity    = time(NULL);
   while (1) {
-    minDeath = getMinPasswordDeath();
+    if (terminating) {
+      _handleTerm(terminating);
+    }
+    time_t idleExitTime = _getIdleExitTime(arguments->exit_idle);
+    if (idleExitTime && idleExitTime <= time(NULL)) {
+      agent_log(NOTICE, "Exiting after %lu seconds without clients",
+                (unsigned long)arguments->exit_idle);
+      exit(EXIT_SUCCESS);
+    }
+    loopLag_setTag("timers");
+    _continueUpgrade(arguments);
+    _checkClock();
+    timerWheel_runDue(time(NULL));
+    peers_runDue();
+    minDeath         = getMinPasswordDeath();
+    time_t timerTime = timerFd < 0 ? timerWheel_getNextTime() : 0;
+    if (timerTime && (minDeath == 0 || timerTime < minDeath)) {
+      minDeath = timerTime;
+    }
+    time_t leaseTime = peers_getNextTime();
+    if (leaseTime && (minDeath == 0 || leaseTime < minDeath)) {
+      minDeath = leaseTime;
+    }
+    if (idleExitTime && (minDeath == 0 || idleExitTime < minDeath)) {
+      minDeath = idleExitTime;
+    }
+    if (upgradeCon && (minDeath == 0 || upgradeDeadline < minDeath)) {
+      minDeath = upgradeDeadline;
+    }
+    int ready_worker = -1;
+    waiting          = 1;
+    loopLag_beforeWait(minDeath);
     struct connection* con =
-        ipc_readAsyncFromMultipleConnectionsWithTimeout(*listencon, minDeath);
+        ipc_readAsyncFromMultipleConnectionsAndFdsWithTimeout(
+            *listencon, minDeath, workers_getRxFds(), workers_count(),
+            &ready_worker);
+    loopLag_afterWait();
+    waiting = 0;
+    if (con != NULL || ready_worker >= 0) {
+      lastActivity = time(NULL);
+    }
+    if (ready_worker >= 0) {
+      loopLag_setTag("oidcd_response");
+      handleOidcdComm(workers_get(ready_worker));
+      continue;
+    }
     if (con == NULL) {  // timeout reached
+      loopLag_setTag("timeout");
       removeDeathPasswords();
+      keyPairPool_fillIdle();
       continue;
     }
+    loopLag_setTag("client");  // the key exchange and decryption
     char* q = server_ipc_read(*(con->msgsock));
+    if (q == NULL && oidc_errno == OIDC_EENCREQ) {
+      continue;  // already answered; the key exchange is the next message
+    }
+    char* traced = requestTrace_markMessage(q, "oidcp_received");
+    if (traced) {
+      secFree(q);
+      q = traced;
+    }
+    OIDC_PROBE2(oidcp_request_receive, *(con->msgsock), q);
     if (q == NULL) {
       server_ipc_writeOidcErrnoPlain(*(con->msgsock));
+      _closeClientConnection(con);
+      continue;
     } else {  // NULL != q
-      INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_PASSWORDENTRY, IPC_KEY_SHORTNAME);
+      const struct listenerPolicy* policy =
+          listeners_policyFor(*(con->msgsock));
+      char* marked = listeners_applyPolicy(policy, q);
+      if (marked) {
+        secFree(q);
+        q = marked;
+      }
+      marked = tenants_markRequest(*(con->msgsock), q);
+      if (marked) {
+        secFree(q);
+        q = marked;
+      }
+      INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_PASSWORDENTRY, IPC_KEY_SHORTNAME,
+                     IPC_KEY_REQUESTS, IPC_KEY_DURATION, IPC_KEY_HEAP,
+                     IPC_KEY_MINVALID, IPC_KEY_APPLICATIONHINT);
       if (CALL_GETJSONVALUES(q) < 0) {
         server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST, oidc_serror());
       } else {
-        KEY_VALUE_VARS(request, passwordentry, shortname);
+        KEY_VALUE_VARS(request, passwordentry, shortname, requests, duration,
+                       heap, min_valid_period, application_hint);
         if (_request) {
+          loopLag_setTag(_request);
+        }
+        if (strequal(_request, REQUEST_VALUE_SESSION)) {
+          _startSession(con);
+        } else if (!tenants_isAllowed(*(con->msgsock), _request)) {
+          oidc_errno = OIDC_EFORBIDDEN;
+          server_ipc_writeOidcErrno(*(con->msgsock));
+        } else if (policy && policy->tokens_only &&
+                   !_isTokenRequest(_request)) {
+          oidc_errno = OIDC_EFORBIDDEN;
+          server_ipc_writeOidcErrno(*(con->msgsock));
+        } else if (upgrading) {
+          server_ipc_write(*(con->msgsock), RESPONSE_BUSY,
+                           "The agent is being upgraded",
+                           AGENT_BUSY_RETRY_AFTER);
+        } else if (strequal(_request, REQUEST_VALUE_UPGRADE)) {
+          if (!server_ipc_peerIsOwner(*(con->msgsock))) {
+            oidc_errno = OIDC_EFORBIDDEN;
+            server_ipc_writeOidcErrno(*(con->msgsock));
+          } else if (_startUpgrade(con) == OIDC_SUCCESS) {
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;  // the connection is closed when the workers answered
+          } else {
+            server_ipc_writeOidcErrno(*(con->msgsock));
+          }
+        } else if (_answerFromHotTokenCache(con, q)) {
+          agent_log(DEBUG, "Answered %s request from the hot token cache",
+                    _request);
+        } else if (_isTokenRequest(_request) && _isOverloaded()) {
+          agent_log(NOTICE, "Rejecting %s request: %lu requests pending",
+                    _request, (unsigned long)pendingRequests->len);
+          metrics_inc(METRIC_SHED_REQUESTS, METRIC_LABEL_BUSY);
+          server_ipc_write(*(con->msgsock), RESPONSE_BUSY,
+                           oidc_serrorFor(OIDC_EBUSY), AGENT_BUSY_RETRY_AFTER);
+        } else if (strequal(_request, REQUEST_VALUE_ACCESSTOKEN_BATCH) ||
+                   strequal(_request, REQUEST_VALUE_ADD_BATCH)) {
+          const char* element_type =
+              strequal(_request, REQUEST_VALUE_ADD_BATCH)
+                  ? REQUEST_VALUE_ADD
+                  : REQUEST_VALUE_ACCESSTOKEN;
+          if (_forwardBatchToOidcd(con, _requests, element_type, arguments) ==
+              OIDC_SUCCESS) {
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;  // the connection is closed when all were answered
+          }
+          server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST,
+                           oidc_serror());
+        } else if (strequal(_request, REQUEST_VALUE_PROFILE)) {
+          if (_startProfile(con, q, _duration, _heap) == OIDC_SUCCESS) {
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;  // the connection is closed when all workers answered
+          }
+          server_ipc_writeOidcErrno(*(con->msgsock));
+        } else if (strequal(_request, REQUEST_VALUE_HEALTH)) {
+          // always sent to all workers, so that oidcp can add its own state
+          _forwardToAllWorkers(con, q, REQUEST_VALUE_HEALTH);
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;  // the connection is closed when all workers answered
+        } else if (strequal(_request, REQUEST_VALUE_SUBSCRIBE)) {
+          if (_forwardSubscriptionToOidcd(con, q, _shortname) ==
+              OIDC_SUCCESS) {
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;  // the connection is released when oidcd responded
+          }
+          server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST,
+                           oidc_serror());
+        } else if (strequal(_request, REQUEST_VALUE_ACCESSTOKEN) &&
+                   _min_valid_period &&
+                   strToInt(_min_valid_period) == FORCE_NEW_TOKEN) {
+          if (_scheduleForcedRefresh(con, q, _application_hint, policy) ==
+              OIDC_SUCCESS) {
+            SEC_FREE_KEY_VALUES();
+            secFree(q);
+            continue;  // the connection is closed when oidcd responded
+          }
+          server_ipc_writeOidcErrno(*(con->msgsock));
+        } else if (strequal(_request, REQUEST_VALUE_STAGE)) {
+          if (!server_ipc_peerIsOwner(*(con->msgsock))) {
+            oidc_errno = OIDC_EFORBIDDEN;
+            server_ipc_writeOidcErrno(*(con->msgsock));
+          } else if (upstream_stage(q) != OIDC_SUCCESS) {
+            server_ipc_writeOidcErrno(*(con->msgsock));
+          } else {
+            server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS);
+          }
+        } else if (strequal(_request, REQUEST_VALUE_REPLICATE) &&
+                   !server_ipc_peerIsOwner(*(con->msgsock))) {
+          oidc_errno = OIDC_EFORBIDDEN;
+          server_ipc_writeOidcErrno(*(con->msgsock));
+        } else if (strequal(_request, REQUEST_VALUE_REPLICATE) &&
+                   !peers_rememberReplicated(q)) {
+          // only a refresh lease was announced; nothing for oidcd to apply
+          server_ipc_write(*(con->msgsock), RESPONSE_SUCCESS);
+        } else if (_request) {
           if (strequal(_request, REQUEST_VALUE_ADD) ||
               strequal(_request, REQUEST_VALUE_GEN)) {
-            pw_handleSave(_passwordentry, arguments->pw_lifetime);
+            if (!agent_state.multi_user) {  // short names are not unique
+              pw_handleSave(_passwordentry, arguments->pw_lifetime);
+            }
+            negativeCache_clear();
           } else if (strequal(_request, REQUEST_VALUE_REMOVE)) {
             removePasswordFor(_shortname);
+            hotTokenCache_dropAccount(_shortname);
+            subscriptions_cancelAccount(_shortname, ACCOUNT_NOT_LOADED);
+            mailboxes_clear(_shortname);
+            confirmGrants_removeAccount(_shortname);
+            rtLanes_drop(_shortname);
           } else if (strequal(_request, REQUEST_VALUE_REMOVEALL)) {
             removeAllPasswords();
+            hotTokenCache_clear();
+            upstream_clearCache();
+            subscriptions_cancelAll(ACCOUNT_NOT_LOADED);
+            mailboxes_clearAll();
+            confirmGrants_clear();
+            rtLanes_clear();
+          } else if (strequal(_request, REQUEST_VALUE_LOCK)) {
+            recovery_clear();
+            hotTokenCache_clear();
+            keyCache_clear();
+            passwordCache_clear();
+            upstream_clearCache();
+            subscriptions_cancelAll(oidc_serrorFor(OIDC_ELOCKED));
+            mailboxes_clearAll();
+            confirmGrants_clear();
+          } else if (strequal(_request, REQUEST_VALUE_TOKENREJECTED)) {
+            hotTokenCache_dropAccount(_shortname);
+          }
+          if (strequal(_request, REQUEST_VALUE_METRICS)) {
+            _forwardMetricsToOidcd(con);
+          } else if (workers_isFanout(_request) ||
+                     strequal(_request, REQUEST_VALUE_STATUS) ||
+                     strequal(_request, REQUEST_VALUE_STATUS_JSON)) {
+            // status requests always, so that oidcp can add its own state
+            _forwardToAllWorkers(con, q, _request);
+          } else {
+            forwardToOidcd(workers_get(workers_forRequest(q)), con, q);
           }
-          handleOidcdComm(pipes, *(con->msgsock), q);
-        } else {  //  no request type
+          SEC_FREE_KEY_VALUES();
+          secFree(q);
+          continue;  // the connection is closed when oidcd responded
+        } else {     //  no request type
           server_ipc_write(*(con->msgsock), RESPONSE_BADREQUEST,
                            "No request type.");
         }
@@ -172,96 +1660,297 @@ void handleClientComm(struct connection* listencon, struct ipcPipe pipes,
       SEC_FREE_KEY_VALUES();
       secFree(q);
     }
-    agent_log(DEBUG, "Remove con from pool");
-    connectionDB_removeIfFound(con);
-    agent_log(DEBUG, "Currently there are %lu connections",
-              connectionDB_getSize());
+    if (server_ipc_getSessionKeyFor(*(con->msgsock)) == NULL) {
+      _closeClientConnection(con);
+    }  // session connections stay open until the client disconnects
   }
 }
 
-void handleOidcdComm(struct ipcPipe pipes, int sock, const char* msg) {
-  char* send = oidc_strcopy(msg);
-  INIT_KEY_VALUE(IPC_KEY_REQUEST, OIDC_KEY_REFRESHTOKEN, IPC_KEY_SHORTNAME,
-                 IPC_KEY_APPLICATIONHINT, IPC_KEY_ISSUERURL);
-  while (1) {
-    // RESET_KEY_VALUE_VALUES_TO_NULL();
-    char* oidcd_res = ipc_communicateThroughPipe(pipes, send);
-    secFree(send);
-    if (oidcd_res == NULL) {
-      if (oidc_errno == OIDC_EIPCDIS || oidc_errno == OIDC_EWRITE) {
-        agent_log(ERROR, "oidcd died");
-        server_ipc_write(sock, RESPONSE_ERROR, "oidcd died");
-        exit(EXIT_FAILURE);
-      }
-      agent_log(ERROR, "no response from oidcd");
-      server_ipc_writeOidcErrno(sock);
-      return;
-    }  // oidcd_res!=NULL
-       // check response, it might be an internal request
-    if (CALL_GETJSONVALUES(oidcd_res) < 0) {
-      server_ipc_write(sock, RESPONSE_BADREQUEST, oidc_serror());
-      secFree(oidcd_res);
-      SEC_FREE_KEY_VALUES();
+/**
+ * An internal request of oidcd that is answered later, e.g. after the user
+ * answered a confirmation prompt
+ */
+struct pendingConfirmation {
+  struct ipcPipe       pipes;
+  unsigned long        tag;
+  struct confirmGrant* grant;  // remembered if the user confirms
+};
+
+/**
+ * @brief asks the user for confirmation and blocks until answered
+ * Only used if the prompt cannot be run asynchronously.
+ */
+static oidc_error_t _getConfirmation(unsigned char idtoken, const char* issuer,
+                                     const char* shortname,
+                                     const char* application_hint) {
+  if (idtoken) {
+    return issuer ? askpass_getIdTokenConfirmationWithIssuer(issuer, shortname,
+                                                             application_hint)
+                  : askpass_getIdTokenConfirmation(shortname, application_hint);
+  }
+  return issuer ? askpass_getConfirmationWithIssuer(issuer, shortname,
+                                                    application_hint)
+                : askpass_getConfirmation(shortname, application_hint);
+}
+
+/**
+ * @brief answers an internal confirmation request of oidcd once the user
+ * answered the prompt
+ */
+static void _answerConfirmation(int consent, void* arg) {
+  struct pendingConfirmation* c    = arg;
+  char*                       send = consent
+                                         ? oidc_strcopy(RESPONSE_SUCCESS)
+                                         : oidc_sprintf(INT_RESPONSE_ERROR,
+                                                        OIDC_EFORBIDDEN);
+  if (consent) {
+    confirmGrants_add(c->grant);
+  } else {
+    confirmGrants_free(c->grant);
+  }
+  oidc_error_t e = ipc_writeToPipe(ipc_tagPipe(c->pipes, c->tag), "%s", send);
+  secFree(send);
+  secFree(c);
+  if (e != OIDC_SUCCESS) {  // the worker is restarted when its pipe closes
+    agent_log(ERROR, "Could not answer oidcd: %s", oidc_serror());
+  }
+}
+
+/**
+ * @brief creates the grant a confirmation of the user would give to the client
+ * of a pending request
+ * @return the grant or @c NULL if grants are disabled or the client is not
+ * known, e.g. for refreshes in the background
+ */
+static struct confirmGrant* _confirmGrantFor(list_node_t*  node,
+                                             unsigned char idtoken,
+                                             const char*   account,
+                                             const char*   application_hint,
+                                             const char*   scope) {
+  if (node == NULL) {
+    return NULL;
+  }
+  const struct pendingRequest* r   = node->val;
+  const struct connection*     con = r->batch ? r->batch->con : r->con;
+  uid_t                        uid;
+  if (con == NULL || con->msgsock == NULL ||
+      server_ipc_getPeerUid(*(con->msgsock), &uid) != 0) {
+    return NULL;
+  }
+  return confirmGrants_new(idtoken, account, application_hint, scope, uid);
+}
+
+/**
+ * @brief answers an internal request of oidcd that waited for another event,
+ * e.g. the refresh lease of a peer agent
+ */
+static void _answerInternalRequest(const char* response, void* arg) {
+  struct pendingConfirmation* c = arg;
+  oidc_error_t e = ipc_writeToPipe(ipc_tagPipe(c->pipes, c->tag), "%s",
+                                   response);
+  secFree(c);
+  if (e != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not answer oidcd: %s", oidc_serror());
+  }
+}
+
+/**
+ * @brief answers an autoload or reload request of oidcd once the account
+ * config was decrypted on the work pool
+ */
+static void _answerAccountRequest(const char* account, void* arg) {
+  char* send = account ? oidc_sprintf(INT_RESPONSE_ACCOUNT, account)
+                       : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+  _answerInternalRequest(send, arg);
+  secFree(send);
+}
+
+/**
+ * @brief passes a new access token oidcd notified about to the subscribed
+ * clients, the token mailbox of its account and the peers
+ */
+static void _handleNotification(const char* notification, size_t worker) {
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, OIDC_KEY_ACCESSTOKEN,
+                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT, INT_IPC_KEY_ACCOUNTS);
+  if (CALL_GETJSONVALUES(notification) < 0) {
+    agent_log(ERROR, "Invalid notification from oidcd: %s", oidc_serror());
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(request, shortname, access_token, issuer, expires_at,
+                 accounts);
+  if (strequal(_request, INT_NOTIFY_VALUE_TOKEN)) {
+    unsigned long expires_at = _expires_at ? strToULong(_expires_at) : 0;
+    subscriptions_notify(_shortname, _access_token, _issuer, expires_at);
+    mailboxes_publish(_shortname, _access_token, _issuer, expires_at);
+    peers_replicateToken(_shortname, _access_token, _issuer, expires_at);
+  } else if (strequal(_request, INT_NOTIFY_VALUE_HOTTOKEN)) {
+    hotTokenCache_store(notification);
+  } else if (strequal(_request, INT_NOTIFY_VALUE_HOTTOKEN_DROP)) {
+    hotTokenCache_drop(notification);
+  } else if (strequal(_request, INT_NOTIFY_VALUE_ACCOUNTS)) {
+    recovery_store(worker, _accounts);
+    rtLanes_store(worker, _accounts);
+  } else if (strequal(_request, INT_NOTIFY_VALUE_RTPOOL)) {
+    rtLanes_handOver(notification, worker);
+  }
+  SEC_FREE_KEY_VALUES();
+}
+
+/**
+ * @brief handles a single message from oidcd
+ * The message is either the final response to a client request, that is
+ * forwarded to the client, or an internal request that is answered. Internal
+ * requests do not necessarily belong to a client request, e.g. when oidcd
+ * refreshes a token in the background.
+ */
+void handleOidcdComm(struct ipcPipe pipes) {
+  unsigned long tag       = 0;
+  char*         oidcd_res = ipc_readTaggedFromPipeWithTimeout(pipes, 0, &tag);
+  if (oidcd_res == NULL) {
+    if (oidc_errno == OIDC_EIPCDIS || oidc_errno == OIDC_EIPCTAG) {
+      _workerDied(workers_indexOf(pipes));
       return;
     }
-    KEY_VALUE_VARS(request, refresh_token, shortname, application_hint, issuer);
-    if (_request == NULL) {  // if the response is the final response, forward
-                             // it to the client
-      server_ipc_write(sock,
-                       oidcd_res);  // Forward oidcd response to client
-      secFree(oidcd_res);
-      SEC_FREE_KEY_VALUES();
-      return;
+    agent_log(ERROR, "no response from oidcd: %s", oidc_serror());
+    return;
+  }
+  OIDC_PROBE1(oidcp_response_receive, tag);
+  if (tag == IPC_TAG_NOTIFY) {
+    loopLag_setTag("oidcd_notification");
+    _handleNotification(oidcd_res, workers_indexOf(pipes));
+    secFree(oidcd_res);
+    return;
+  }
+  list_node_t* node =
+      pendingRequests ? findInList(pendingRequests, &tag) : NULL;
+  // check response, it might be an internal request
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, OIDC_KEY_REFRESHTOKEN, IPC_KEY_SHORTNAME,
+                 IPC_KEY_APPLICATIONHINT, IPC_KEY_ISSUERURL, OIDC_KEY_SCOPE,
+                 AGENT_KEY_REFRESHTOKENSLOT);
+  if (CALL_GETJSONVALUES(oidcd_res) < 0) {
+    if (node) {
+      char* error = oidc_sprintf(RESPONSE_BADREQUEST, oidc_serror());
+      _answerPendingRequest(node, error);
+      secFree(error);
     }
     secFree(oidcd_res);
-    if (strequal(_request, INT_REQUEST_VALUE_UPD_REFRESH)) {
-      oidc_error_t e = updateRefreshToken(_shortname, _refresh_token);
-      send           = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
-                               : oidc_sprintf(RESPONSE_ERROR, oidc_serror());
-      SEC_FREE_KEY_VALUES();
-      continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_AUTOLOAD)) {
-      char* config = getAutoloadConfig(_shortname, _issuer, _application_hint);
-      send         = config
-                 ? oidc_sprintf(RESPONSE_STATUS_CONFIG, STATUS_SUCCESS, config)
-                 : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
-      secFree(config);
-      SEC_FREE_KEY_VALUES();
-      continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_CONFIRM)) {
-      oidc_error_t e =
-          _issuer ? askpass_getConfirmationWithIssuer(_issuer, _shortname,
-                                                      _application_hint)
-                  : askpass_getConfirmation(_shortname, _application_hint);
-      send = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
-                               : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  KEY_VALUE_VARS(request, refresh_token, shortname, application_hint, issuer,
+                 scope, refresh_token_slot);
+  if (_request == NULL) {  // if the response is the final response, forward
+                           // it to the client
+    if (node) {
+      _answerPendingRequest(node, oidcd_res);
+    } else {
+      agent_log(ERROR, "Received oidcd response for unknown request %lu", tag);
+    }
+    secFree(oidcd_res);
+    SEC_FREE_KEY_VALUES();
+    return;
+  }
+  secFree(oidcd_res);
+  loopLag_setTag(_request);  // an internal request of oidcd
+  char* send = NULL;
+  const unsigned char prompts =
+      strequal(_request, INT_REQUEST_VALUE_AUTOLOAD) ||
+      strequal(_request, INT_REQUEST_VALUE_CONFIRM) ||
+      strequal(_request, INT_REQUEST_VALUE_CONFIRMIDTOKEN);
+  if (prompts && node && _pendingClientGone(node->val)) {
+    agent_log(DEBUG, "Client of request %lu is gone, not prompting", tag);
+    send = oidc_sprintf(INT_RESPONSE_ERROR, OIDC_EUSRPWCNCL);
+  } else if (strequal(_request, INT_REQUEST_VALUE_UPD_REFRESH)) {
+    // Written in the background; failures are logged when it is written
+    const size_t slot =
+        _refresh_token_slot ? strToULong(_refresh_token_slot) : 0;
+    rtQueue_add(_shortname, slot, _refresh_token);
+    if (slot == 0) {  // the tokens of the pool are not replicated
+      peers_replicateRefreshToken(_shortname, _refresh_token);
+    }
+    send = oidc_strcopy(RESPONSE_SUCCESS);
+  } else if (strequal(_request, INT_REQUEST_VALUE_LEASE)) {
+    struct pendingConfirmation* c =
+        secAlloc(sizeof(struct pendingConfirmation));
+    c->pipes = pipes;
+    c->tag   = tag;
+    if (peers_acquireLease(_shortname, _answerInternalRequest, c) ==
+        OIDC_SUCCESS) {
       SEC_FREE_KEY_VALUES();
-      continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_CONFIRMIDTOKEN)) {
-      oidc_error_t e = _issuer ? askpass_getIdTokenConfirmationWithIssuer(
-                                     _issuer, _shortname, _application_hint)
-                               : askpass_getIdTokenConfirmation(
-                                     _shortname, _application_hint);
-      send = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
-                               : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+      return;  // answered by _answerInternalRequest
+    }
+    secFree(c);
+    send = oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+  } else if (strequal(_request, INT_REQUEST_VALUE_AUTOLOAD) ||
+             strequal(_request, INT_REQUEST_VALUE_RELOAD)) {
+    struct pendingConfirmation* c =
+        secAlloc(sizeof(struct pendingConfirmation));
+    c->pipes = pipes;
+    c->tag   = tag;
+    if (strequal(_request, INT_REQUEST_VALUE_AUTOLOAD)) {
+      getAutoloadAccountAsync(_shortname, _issuer, _application_hint,
+                              _answerAccountRequest, c);
+    } else {
+      getReloadAccountAsync(_shortname, _answerAccountRequest, c);
+    }
+    SEC_FREE_KEY_VALUES();
+    return;  // answered by _answerAccountRequest
+  } else if (strequal(_request, INT_REQUEST_VALUE_CONFIRM) ||
+             strequal(_request, INT_REQUEST_VALUE_CONFIRMIDTOKEN)) {
+    const unsigned char idtoken =
+        strequal(_request, INT_REQUEST_VALUE_CONFIRMIDTOKEN);
+    struct confirmGrant* grant =
+        _confirmGrantFor(node, idtoken, strValid(_shortname) ? _shortname
+                                                             : _issuer,
+                         _application_hint, _scope);
+    if (confirmGrants_isGranted(grant)) {
+      confirmGrants_free(grant);
       SEC_FREE_KEY_VALUES();
-      continue;
-    } else if (strequal(_request, INT_REQUEST_VALUE_QUERY_ACCDEFAULT)) {
-      char* account = NULL;
-      if (strValid(_issuer)) {  // default for this issuer
-        account = getDefaultAccountConfigForIssuer(_issuer);
-      } else {                      // global default
-        oidc_errno = OIDC_NOTIMPL;  // TODO
+      if (ipc_writeToPipe(ipc_tagPipe(pipes, tag), RESPONSE_SUCCESS) !=
+          OIDC_SUCCESS) {
+        agent_log(ERROR, "Could not answer oidcd: %s", oidc_serror());
       }
-      send = oidc_sprintf(INT_RESPONSE_ACCDEFAULT, account ?: "");
-      secFree(account);
+      return;
+    }
+    struct pendingConfirmation* c =
+        secAlloc(sizeof(struct pendingConfirmation));
+    c->pipes = pipes;
+    c->tag   = tag;
+    c->grant = grant;
+    if (askpass_getConfirmationAsync(_issuer, _shortname, _application_hint,
+                                     idtoken, _answerConfirmation,
+                                     c) == OIDC_SUCCESS) {
       SEC_FREE_KEY_VALUES();
-      continue;
+      return;  // answered by _answerConfirmation
+    }
+    secFree(c);
+    oidc_error_t e =
+        _getConfirmation(idtoken, _issuer, _shortname, _application_hint);
+    if (e == OIDC_SUCCESS) {
+      confirmGrants_add(grant);
     } else {
-      server_ipc_write(
-          sock, "Internal communication error: unknown internal request");
-      SEC_FREE_KEY_VALUES();
-      return;
+      confirmGrants_free(grant);
+    }
+    send = e == OIDC_SUCCESS ? oidc_strcopy(RESPONSE_SUCCESS)
+                             : oidc_sprintf(INT_RESPONSE_ERROR, oidc_errno);
+  } else if (strequal(_request, INT_REQUEST_VALUE_QUERY_ACCDEFAULT)) {
+    char* account = NULL;
+    if (strValid(_issuer)) {  // default for this issuer
+      account = getDefaultAccountConfigForIssuer(_issuer);
+    } else {                      // global default
+      oidc_errno = OIDC_NOTIMPL;  // TODO
     }
+    send = oidc_sprintf(INT_RESPONSE_ACCDEFAULT, account ?: "");
+    secFree(account);
+  } else {
+    send = oidc_sprintf(RESPONSE_ERROR,
+                        "Internal communication error: unknown internal "
+                        "request");
+  }
+  SEC_FREE_KEY_VALUES();
+  if (ipc_writeToPipe(ipc_tagPipe(pipes, tag), "%s", send) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not answer oidcd: %s", oidc_serror());
   }
+  secFree(send);
 }
@@ -10,8 +10,10 @@ const char* argp_program_version = AGENT_VERSION;
 
 const char* argp_program_bug_address = BUG_ADDRESS;
 
-void handleOidcdComm(struct ipcPipe pipes, int sock, const char* msg);
-void handleClientComm(struct connection* listencon, struct ipcPipe pipes,
+void handleOidcdComm(struct ipcPipe pipes);
+void forwardToOidcd(struct ipcPipe pipes, struct connection* con,
+                    const char* msg);
+void handleClientComm(struct connection*      listencon,
                       const struct arguments* arguments);
 
 #endif  // OIDC_PROXY_DAEMON_H
@@ -1,7 +1,17 @@
 #include "agent_prompt.h"
+#include "ipc/reactor.h"
+#include "oidc-agent/oidcp/passwords/promptServer.h"
+#include "utils/agentLogger.h"
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
 #include "utils/prompt.h"
+#include "utils/stringUtils.h"
+#include "utils/system_runner.h"
 
+#include <errno.h>
 #include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 typedef void (*sighandler_t)(int);
 
@@ -18,3 +28,90 @@ char* agent_promptPassword(const char* text, const char* label,
 int agent_promptConsentDefaultYes(const char* text) {
   return _promptConsentGUIDefaultYes(text);
 }
+
+/**
+ * A consent prompt that runs while oidcp keeps serving other clients
+ */
+struct asyncConsent {
+  pid_t                pid;
+  struct string        out;
+  asyncConsentCallback callback;
+  void*                arg;
+};
+
+static void _finishAsyncConsent(int fd, struct asyncConsent* prompt) {
+  reactor_unwatchFd(fd);
+  close(fd);
+  waitpid(prompt->pid, NULL, 0);
+  if (prompt->out.len > 0 && prompt->out.ptr[prompt->out.len - 1] == '\n') {
+    prompt->out.ptr[--prompt->out.len] = '\0';
+  }
+  int consent = strcaseequal(prompt->out.ptr, "yes");
+  agent_log(DEBUG, "Async consent prompt %d finished: %d", prompt->pid,
+            consent);
+  prompt->callback(consent, prompt->arg);
+  secFree(prompt->out.ptr);
+  secFree(prompt);
+}
+
+static void _readAsyncConsent(int fd, void* arg) {
+  struct asyncConsent* prompt = arg;
+  char                 buf[64];
+  ssize_t              n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    string_append(&prompt->out, buf, n);
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;  // wait for more output
+  }
+  // EOF or error: the prompt is done
+  _finishAsyncConsent(fd, prompt);
+}
+
+/**
+ * @brief starts oidc-prompt for a single consent dialog without blocking
+ * @param callback is called with @c 1 if the user consented and @c 0 if not,
+ * once the prompt finished
+ * @return @c OIDC_SUCCESS if the prompt was started; @p callback is not called
+ * otherwise
+ */
+oidc_error_t agent_startConsentPrompt(const char*          text,
+                                      asyncConsentCallback callback,
+                                      void*                arg) {
+  struct asyncConsent* prompt = secAlloc(sizeof(struct asyncConsent));
+  if (prompt == NULL || init_string(&prompt->out) != OIDC_SUCCESS) {
+    secFree(prompt);
+    return oidc_errno;
+  }
+  char* cmd   = _consentGUIDefaultYesCommand(text);
+  int   fd    = -1;
+  prompt->pid = startCommand(cmd, &fd);
+  secFree(cmd);
+  if (prompt->pid < 0) {
+    secFree(prompt->out.ptr);
+    secFree(prompt);
+    return oidc_errno;
+  }
+  prompt->callback = callback;
+  prompt->arg      = arg;
+  reactor_watchFd(fd, _readAsyncConsent, prompt);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief prompts the user for consent without blocking
+ * The dialog is shown by the prompt helper, see promptServer.c, or by
+ * starting oidc-prompt if there is no working helper.
+ * @param callback is called with @c 1 if the user consented and @c 0 if not,
+ * once the prompt finished
+ * @return @c OIDC_SUCCESS if the prompt was started; @p callback is not called
+ * otherwise
+ */
+oidc_error_t agent_promptConsentDefaultYesAsync(const char*          text,
+                                                asyncConsentCallback callback,
+                                                void*                arg) {
+  if (promptServer_consentDefaultYes(text, callback, arg) == OIDC_SUCCESS) {
+    return OIDC_SUCCESS;
+  }
+  return agent_startConsentPrompt(text, callback, arg);
+}
@@ -1,8 +1,18 @@
 #ifndef OIDCP_AGENT_PROMPT_H
 #define OIDCP_AGENT_PROMPT_H
 
-char* agent_promptPassword(const char* text, const char* label,
-                           const char* init);
-int   agent_promptConsentDefaultYes(const char* text);
+#include "utils/oidc_error.h"
+
+typedef void (*asyncConsentCallback)(int consent, void* arg);
+
+char*        agent_promptPassword(const char* text, const char* label,
+                                  const char* init);
+int          agent_promptConsentDefaultYes(const char* text);
+oidc_error_t agent_promptConsentDefaultYesAsync(const char*          text,
+                                                asyncConsentCallback callback,
+                                                void*                arg);
+oidc_error_t agent_startConsentPrompt(const char*          text,
+                                      asyncConsentCallback callback,
+                                      void*                arg);
 
 #endif /* OIDCP_AGENT_PROMPT_H */
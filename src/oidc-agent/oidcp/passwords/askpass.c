@@ -84,6 +84,51 @@ char* askpass_getPasswordForAutoloadWithIssuer(const char* issuer,
   return ret;
 }
 
+static char* _applicationStr(const char* application_hint) {
+  return strValid(application_hint) ? oidc_sprintf("(%s) ", application_hint)
+                                    : NULL;
+}
+
+static char* _confirmationMessage(const char* issuer, const char* shortname,
+                                  const char* application_hint) {
+  char* application_str = _applicationStr(application_hint);
+  char* msg =
+      issuer ? oidc_sprintf("An application %srequests an access token for "
+                            "'%s'.\nDo you want to allow the usage of '%s'?",
+                            application_str ?: "", issuer, shortname)
+             : oidc_sprintf("An application %srequests an access token for "
+                            "'%s'.\nDo you want to allow this usage?",
+                            application_str ?: "", shortname);
+  secFree(application_str);
+  return msg;
+}
+
+static char* _idTokenConfirmationMessage(const char* issuer,
+                                         const char* shortname,
+                                         const char* application_hint) {
+  const char* const warning =
+      "id tokens should not be passed to other applications as authorization.";
+  char* application_str = _applicationStr(application_hint);
+  char* msg =
+      issuer ? oidc_sprintf("An application %srequests an id token for "
+                            "'%s'.\n%s\nDo you want to allow the usage of "
+                            "'%s'?",
+                            application_str ?: "", issuer, warning,
+                            shortname ?: issuer)
+             : oidc_sprintf("An application %srequests an id token for "
+                            "'%s'.\n%s\nDo you want to allow this usage?",
+                            application_str ?: "", shortname, warning);
+  secFree(application_str);
+  return msg;
+}
+
+static oidc_error_t _getConsent(char* msg) {
+  oidc_errno =
+      agent_promptConsentDefaultYes(msg) ? OIDC_SUCCESS : OIDC_EFORBIDDEN;
+  secFree(msg);
+  return oidc_errno;
+}
+
 oidc_error_t askpass_getConfirmation(const char* shortname,
                                      const char* application_hint) {
   if (shortname == NULL) {
@@ -92,18 +137,7 @@ oidc_error_t askpass_getConfirmation(const char* shortname,
   }
   agent_log(DEBUG, "Prompting user for confirmation of using config '%s'",
             shortname);
-  const char* const fmt =
-      "An application %srequests an access token for '%s'.\n"
-      "Do you want to allow this usage?";
-  char* application_str = strValid(application_hint)
-                              ? oidc_sprintf("(%s) ", application_hint)
-                              : NULL;
-  char* msg = oidc_sprintf(fmt, application_str ?: "", shortname);
-  secFree(application_str);
-  oidc_errno =
-      agent_promptConsentDefaultYes(msg) ? OIDC_SUCCESS : OIDC_EFORBIDDEN;
-  secFree(msg);
-  return oidc_errno;
+  return _getConsent(_confirmationMessage(NULL, shortname, application_hint));
 }
 
 oidc_error_t askpass_getConfirmationWithIssuer(const char* issuer,
@@ -117,18 +151,7 @@ oidc_error_t askpass_getConfirmationWithIssuer(const char* issuer,
       DEBUG,
       "Prompting user for confirmation of using config '%s' for issuer '%s'",
       shortname, issuer);
-  const char* const fmt =
-      "An application %srequests an access token for '%s'.\n"
-      "Do you want to allow the usage of '%s'?";
-  char* application_str = strValid(application_hint)
-                              ? oidc_sprintf("(%s) ", application_hint)
-                              : NULL;
-  char* msg = oidc_sprintf(fmt, application_str ?: "", issuer, shortname);
-  secFree(application_str);
-  oidc_errno =
-      agent_promptConsentDefaultYes(msg) ? OIDC_SUCCESS : OIDC_EFORBIDDEN;
-  secFree(msg);
-  return oidc_errno;
+  return _getConsent(_confirmationMessage(issuer, shortname, application_hint));
 }
 
 oidc_error_t askpass_getIdTokenConfirmation(const char* shortname,
@@ -139,19 +162,8 @@ oidc_error_t askpass_getIdTokenConfirmation(const char* shortname,
   }
   agent_log(DEBUG, "Prompting user for id-token confirmation for config '%s'",
             shortname);
-  const char* const fmt =
-      "An application %srequests an id token for '%s'.\n"
-      "id tokens should not be passed to other applications as authorization.\n"
-      "Do you want to allow this usage?";
-  char* application_str = strValid(application_hint)
-                              ? oidc_sprintf("(%s) ", application_hint)
-                              : NULL;
-  char* msg = oidc_sprintf(fmt, application_str ?: "", shortname);
-  secFree(application_str);
-  oidc_errno =
-      agent_promptConsentDefaultYes(msg) ? OIDC_SUCCESS : OIDC_EFORBIDDEN;
-  secFree(msg);
-  return oidc_errno;
+  return _getConsent(
+      _idTokenConfirmationMessage(NULL, shortname, application_hint));
 }
 
 oidc_error_t askpass_getIdTokenConfirmationWithIssuer(
@@ -160,18 +172,35 @@ oidc_error_t askpass_getIdTokenConfirmationWithIssuer(
             "Prompting user for id-token confirmation for "
             "issuer '%s'",
             issuer);
-  const char* const fmt =
-      "An application %srequests an id token for '%s'.\n"
-      "id tokens should not be passed to other applications as authorization.\n"
-      "Do you want to allow the usage of '%s'?";
-  char* application_str = strValid(application_hint)
-                              ? oidc_sprintf("(%s) ", application_hint)
-                              : NULL;
+  return _getConsent(
+      _idTokenConfirmationMessage(issuer, shortname, application_hint));
+}
+
+/**
+ * @brief asks the user for confirmation without blocking
+ * Works like @c askpass_getConfirmationWithIssuer (or
+ * @c askpass_getIdTokenConfirmationWithIssuer if @p idtoken is set), but
+ * returns immediately; @p callback is called when the user answered.
+ * @param issuer the issuer; might be @c NULL
+ * @return @c OIDC_SUCCESS if the prompt was started; otherwise @p callback is
+ * not called
+ */
+oidc_error_t askpass_getConfirmationAsync(const char* issuer,
+                                          const char* shortname,
+                                          const char* application_hint,
+                                          unsigned char        idtoken,
+                                          asyncConsentCallback callback,
+                                          void*                arg) {
+  if (shortname == NULL && !(idtoken && issuer)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  agent_log(DEBUG, "Prompting user asynchronously for %sconfirmation of '%s'",
+            idtoken ? "id-token " : "", shortname ?: issuer);
   char* msg =
-      oidc_sprintf(fmt, application_str ?: "", issuer, shortname ?: issuer);
-  secFree(application_str);
-  oidc_errno =
-      agent_promptConsentDefaultYes(msg) ? OIDC_SUCCESS : OIDC_EFORBIDDEN;
+      idtoken ? _idTokenConfirmationMessage(issuer, shortname, application_hint)
+              : _confirmationMessage(issuer, shortname, application_hint);
+  oidc_error_t e = agent_promptConsentDefaultYesAsync(msg, callback, arg);
   secFree(msg);
-  return oidc_errno;
+  return e;
 }
@@ -1,6 +1,7 @@
 #ifndef OIDC_ASKPASS_RUNNER_H
 #define OIDC_ASKPASS_RUNNER_H
 
+#include "oidc-agent/oidcp/passwords/agent_prompt.h"
 #include "utils/oidc_error.h"
 
 char*        askpass_getPasswordForUpdate(const char* shortname);
@@ -18,5 +19,11 @@ oidc_error_t askpass_getIdTokenConfirmation(const char* shortname,
                                             const char* application_hint);
 oidc_error_t askpass_getIdTokenConfirmationWithIssuer(
     const char* issuer, const char* shortname, const char* application_hint);
+oidc_error_t askpass_getConfirmationAsync(const char* issuer,
+                                          const char* shortname,
+                                          const char* application_hint,
+                                          unsigned char        idtoken,
+                                          asyncConsentCallback callback,
+                                          void*                arg);
 
 #endif  // OIDC_ASKPASS_RUNNER_H
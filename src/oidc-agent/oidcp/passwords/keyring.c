@@ -1,11 +1,42 @@
 #ifndef __APPLE__
 #include "keyring.h"
 #include "utils/agentLogger.h"
+#include "utils/lazyLib.h"
 #include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
 
 #include <libsecret/secret.h>
 
+/**
+ * libsecret (and with it glib) is only loaded when the keyring is used for the
+ * first time, see lazyLib.c
+ */
+static gchar* (*lookup_sync)(const SecretSchema*, GCancellable*, GError**,
+                             ...);
+static gboolean (*store_sync)(const SecretSchema*, const gchar*, const gchar*,
+                              const gchar*, GCancellable*, GError**, ...);
+static gboolean (*clear_sync)(const SecretSchema*, GCancellable*, GError**,
+                              ...);
+static void (*password_free)(gchar*);
+static void (*error_free)(GError*);
+
+static oidc_error_t _loadLibsecret() {
+  static const char* const sonames[] = {"libsecret-1.so.0", "libsecret-1.so",
+                                        NULL};
+  const struct lazySymbol symbols[] = {
+      {"secret_password_lookup_sync", (void**)&lookup_sync},
+      {"secret_password_store_sync", (void**)&store_sync},
+      {"secret_password_clear_sync", (void**)&clear_sync},
+      {"secret_password_free", (void**)&password_free},
+      {"g_error_free", (void**)&error_free},
+      {NULL, NULL}};
+  oidc_error_t e = lazyLib_load("libsecret-1", sonames, symbols);
+  if (e != OIDC_SUCCESS) {
+    agent_log(ERROR, "%s", oidc_serror());
+  }
+  return e;
+}
+
 const SecretSchema* agent_get_schema(void) G_GNUC_CONST;
 
 #define AGENT_SCHEMA agent_get_schema()
@@ -44,13 +75,16 @@ char* keyring_getPasswordFor(const char* shortname) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  if (_loadLibsecret() != OIDC_SUCCESS) {
+    return NULL;
+  }
   agent_log(DEBUG, "Looking up password for '%s' in keyring", shortname);
   GError* error = NULL;
-  gchar*  pw    = secret_password_lookup_sync(AGENT_SCHEMA, NULL, &error,
-                                          "shortname", shortname, NULL);
+  gchar*  pw =
+      lookup_sync(AGENT_SCHEMA, NULL, &error, "shortname", shortname, NULL);
   if (error != NULL) {
     oidc_setGerror(error);
-    g_error_free(error);
+    error_free(error);
     return NULL;
   }
   if (pw == NULL) {
@@ -59,7 +93,7 @@ char* keyring_getPasswordFor(const char* shortname) {
     return NULL;
   }
   char* ret = oidc_strcopy(pw);
-  secret_password_free(pw);
+  password_free(pw);
   return ret;
 }
 
@@ -69,18 +103,20 @@ oidc_error_t keyring_savePasswordFor(const char* shortname,
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (_loadLibsecret() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
   agent_log(DEBUG, "Saving password for '%s' in keyring", shortname);
   GError* error = NULL;
-  secret_password_store_sync(AGENT_SCHEMA, SECRET_COLLECTION_DEFAULT, shortname,
-                             password, NULL, &error, "shortname", shortname,
-                             NULL);
+  store_sync(AGENT_SCHEMA, SECRET_COLLECTION_DEFAULT, shortname, password,
+             NULL, &error, "shortname", shortname, NULL);
 
   if (error == NULL) {
     agent_log(DEBUG, "Password for '%s' saved in keyring", shortname);
     return OIDC_SUCCESS;
   }
   oidc_setGerror(error);
-  g_error_free(error);
+  error_free(error);
   return oidc_errno;
 }
 
@@ -89,14 +125,17 @@ oidc_error_t keyring_removePasswordFor(const char* shortname) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (_loadLibsecret() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
   agent_log(DEBUG, "Removing password for '%s' from keyring", shortname);
-  GError*  error   = NULL;
-  gboolean removed = secret_password_clear_sync(AGENT_SCHEMA, NULL, &error,
-                                                "shortname", shortname, NULL);
+  GError*  error = NULL;
+  gboolean removed =
+      clear_sync(AGENT_SCHEMA, NULL, &error, "shortname", shortname, NULL);
 
   if (error != NULL) {
     oidc_setGerror(error);
-    g_error_free(error);
+    error_free(error);
     return oidc_errno;
   }
   if (removed) {
@@ -0,0 +1,229 @@
+#include "passwordCache.h"
+#include "utils/agentLogger.h"
+#include "utils/crypt/passwordCrypt.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+/**
+ * The password cache keeps passwords that were obtained from a password
+ * command or the keyring, so that they do not have to be obtained again for
+ * every update of an account config, e.g. on each refresh token rotation.
+ * Passwords are kept encrypted like the ones stored in memory. The cache is
+ * disabled unless @c passwordCache_setLifetime enables it; entries then
+ * expire after the configured lifetime, but never outlive the password entry
+ * they belong to.
+ *
+ * If a source fails, this is remembered for a short time, so that e.g. a
+ * failing command is not run again for every request. The agent handles
+ * these requests one after another, so concurrent requests for the same
+ * password are answered from the cache once the first lookup finished.
+ */
+
+#define PASSWORD_CACHE_NEGATIVE_TTL 30
+
+struct passwordCacheEntry {
+  char*         shortname;
+  char*         password;  // encrypted, NULL if only failures are cached
+  time_t        expires_at;
+  unsigned char failed_types;
+  time_t        failed_until;
+};
+
+static list_t*            cache    = NULL;
+static struct lifetimeArg lifetime = {0, 0};
+
+static void _secFreePasswordCacheEntry(struct passwordCacheEntry* e) {
+  if (e == NULL) {
+    return;
+  }
+  secFree(e->shortname);
+  secFree(e->password);
+  secFree(e);
+}
+
+static int _matchPasswordCacheEntry(const char*                      shortname,
+                                    const struct passwordCacheEntry* e) {
+  return strequal(shortname, e->shortname);
+}
+
+static time_t _deathOf(const struct passwordCacheEntry* e) {
+  time_t t = e->password ? e->expires_at : 0;
+  return e->failed_types && e->failed_until > t ? e->failed_until : t;
+}
+
+static int _isExpired(const struct passwordCacheEntry* e, time_t now) {
+  int pwExpired =
+      e->password == NULL || (e->expires_at && e->expires_at <= now);
+  int hasFailure = e->failed_types && e->failed_until > now;
+  return pwExpired && !hasFailure;
+}
+
+/**
+ * @brief enables the password cache with the given lifetime
+ * @param lt the password lifetime of the agent; if it was not provided
+ * the cache is disabled and cleared, a lifetime of @c 0 keeps passwords until
+ * the cache is cleared
+ */
+void passwordCache_setLifetime(struct lifetimeArg lt) {
+  if (!lt.argProvided) {
+    passwordCache_clear();
+  }
+  lifetime = lt;
+}
+
+static struct passwordCacheEntry* _findEntry(const char* shortname) {
+  if (cache == NULL || shortname == NULL) {
+    return NULL;
+  }
+  passwordCache_removeExpired();
+  list_node_t* node = findInList(cache, shortname);
+  return node ? node->val : NULL;
+}
+
+static struct passwordCacheEntry* _findOrAddEntry(const char* shortname) {
+  struct passwordCacheEntry* e = _findEntry(shortname);
+  if (e) {
+    return e;
+  }
+  if (cache == NULL) {
+    cache        = list_new();
+    cache->free  = (void (*)(void*))_secFreePasswordCacheEntry;
+    cache->match = (matchFunction)_matchPasswordCacheEntry;
+  }
+  e            = secAlloc(sizeof(struct passwordCacheEntry));
+  e->shortname = oidc_strcopy(shortname);
+  list_rpush(cache, list_node_new(e));
+  return e;
+}
+
+/**
+ * @brief returns the cached password for @p shortname
+ * @return a pointer to the password or @c NULL if none is cached. Has to be
+ * freed after usage.
+ */
+char* passwordCache_get(const char* shortname) {
+  struct passwordCacheEntry* e = _findEntry(shortname);
+  if (e == NULL || e->password == NULL ||
+      (e->expires_at && e->expires_at <= time(NULL))) {
+    return NULL;
+  }
+  agent_log(DEBUG, "Using cached password for '%s'", shortname);
+  return decryptPassword(e->password, shortname);
+}
+
+/**
+ * @brief returns the password types that recently failed for @p shortname
+ */
+unsigned char passwordCache_getFailedTypes(const char* shortname) {
+  struct passwordCacheEntry* e = _findEntry(shortname);
+  return e && e->failed_until > time(NULL) ? e->failed_types : 0;
+}
+
+/**
+ * @brief caches @p password for @p shortname
+ * Does nothing if the cache is disabled.
+ * @param pw_expires_at the time the password entry expires or @c 0
+ */
+void passwordCache_add(const char* shortname, const char* password,
+                       time_t pw_expires_at) {
+  if (!lifetime.argProvided || shortname == NULL || password == NULL) {
+    return;
+  }
+  char* crypt = encryptPassword(password, shortname);
+  if (crypt == NULL) {
+    return;
+  }
+  time_t expires_at = lifetime.lifetime ? time(NULL) + lifetime.lifetime : 0;
+  if (pw_expires_at && (expires_at == 0 || pw_expires_at < expires_at)) {
+    expires_at = pw_expires_at;
+  }
+  struct passwordCacheEntry* e = _findOrAddEntry(shortname);
+  secFree(e->password);
+  e->password     = crypt;
+  e->expires_at   = expires_at;
+  e->failed_types = 0;
+  e->failed_until = 0;
+}
+
+/**
+ * @brief remembers that obtaining the password for @p shortname from a source
+ * of @p type failed
+ * Does nothing if the cache is disabled.
+ */
+void passwordCache_addFailure(const char* shortname, unsigned char type) {
+  if (!lifetime.argProvided || shortname == NULL) {
+    return;
+  }
+  time_t ttl = PASSWORD_CACHE_NEGATIVE_TTL;
+  if (lifetime.lifetime && lifetime.lifetime < ttl) {
+    ttl = lifetime.lifetime;
+  }
+  time_t                     now = time(NULL);
+  struct passwordCacheEntry* e   = _findOrAddEntry(shortname);
+  if (e->failed_until <= now) {
+    e->failed_types = 0;
+  }
+  e->failed_types |= type;
+  e->failed_until = now + ttl;
+}
+
+/**
+ * @brief removes the cached password and failures for @p shortname
+ */
+void passwordCache_remove(const char* shortname) {
+  list_node_t* node =
+      cache && shortname ? findInList(cache, shortname) : NULL;
+  if (node) {
+    list_remove(cache, node);
+  }
+}
+
+/**
+ * @brief removes all expired entries from the password cache
+ */
+void passwordCache_removeExpired() {
+  if (cache == NULL) {
+    return;
+  }
+  time_t       now  = time(NULL);
+  list_node_t* node = cache->head;
+  while (node) {
+    list_node_t* next = node->next;
+    if (_isExpired(node->val, now)) {
+      list_remove(cache, node);
+    }
+    node = next;
+  }
+}
+
+/**
+ * @brief removes all entries from the password cache
+ */
+void passwordCache_clear() {
+  if (cache == NULL) {
+    return;
+  }
+  agent_log(DEBUG, "Clearing password cache");
+  secFreeList(cache);
+  cache = NULL;
+}
+
+/**
+ * @brief returns the earliest expiration time of the cached passwords
+ * @return the expiration time or @c 0 if no cached password expires
+ */
+time_t passwordCache_getMinDeath() {
+  if (cache == NULL) {
+    return 0;
+  }
+  time_t min = 0;
+  for (list_node_t* node = cache->head; node; node = node->next) {
+    time_t t = _deathOf(node->val);
+    if (t && (min == 0 || t < min)) {
+      min = t;
+    }
+  }
+  return min;
+}
@@ -0,0 +1,19 @@
+#ifndef OIDC_PASSWORD_CACHE_H
+#define OIDC_PASSWORD_CACHE_H
+
+#include "utils/lifetimeArg.h"
+
+#include <time.h>
+
+void          passwordCache_setLifetime(struct lifetimeArg lifetime);
+char*         passwordCache_get(const char* shortname);
+unsigned char passwordCache_getFailedTypes(const char* shortname);
+void          passwordCache_add(const char* shortname, const char* password,
+                                time_t pw_expires_at);
+void          passwordCache_addFailure(const char* shortname, unsigned char type);
+void          passwordCache_remove(const char* shortname);
+void          passwordCache_removeExpired();
+void          passwordCache_clear();
+time_t        passwordCache_getMinDeath();
+
+#endif  // OIDC_PASSWORD_CACHE_H
@@ -4,12 +4,15 @@
 #include "oidc-agent/oidcp/passwords/keyring.h"
 #endif
 #include <time.h>
+#include "oidc-agent/oidcp/passwords/passwordCache.h"
 #include "oidc-agent/oidcp/passwords/password_handler.h"
 #include "utils/agentLogger.h"
+#include "utils/crypt/keyCache.h"
 #include "utils/crypt/passwordCrypt.h"
 #include "utils/db/password_db.h"
 #include "utils/deathUtils.h"
 #include "utils/file_io/file_io.h"
+#include "utils/json.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/password_entry.h"
@@ -51,6 +54,7 @@ void initPasswordStore() {
   passwordDB_new();
   passwordDB_setMatchFunction((matchFunction)matchPasswordEntryByShortname);
   passwordDB_setFreeFunction((void (*)(void*))_secFreePasswordEntry);
+  passwordDB_setDeathFunction((deathFunction)pwe_getExpiresAt);
 }
 
 oidc_error_t savePassword(struct password_entry* pw) {
@@ -90,6 +94,7 @@ oidc_error_t savePassword(struct password_entry* pw) {
   }
   passwordDB_removeIfFound(
       pw);  // Removing an existing (old) entry for the same shortname -> update
+  passwordCache_remove(pw->shortname);
   passwordDB_addValue(pw);
   agent_log(DEBUG, "Now there are %lu passwords saved", passwordDB_getSize());
   return OIDC_SUCCESS;
@@ -117,6 +122,9 @@ oidc_error_t removeOrExpirePasswordFor(const char* shortname, int remove) {
     agent_log(WARNING, "keyring currently not supported for MACOS");
 #endif
   }
+  // Keys derived from the password must not outlive it
+  keyCache_clear();
+  passwordCache_remove(shortname);
   if (remove) {
     passwordDB_removeIfFound(pw);
   } else {
@@ -138,10 +146,26 @@ oidc_error_t expirePasswordFor(const char* shortname) {
 oidc_error_t removeAllPasswords() {
   agent_log(DEBUG, "Removing all passwords");
   passwordDB_reset();
+  keyCache_clear();
+  passwordCache_clear();
   return OIDC_SUCCESS;
 }
 
-char* getPasswordFor(const char* shortname) {
+static void _cacheLookup(const struct password_entry* pw, const char* res,
+                         unsigned char type) {
+  if (res) {
+    passwordCache_add(pw->shortname, res, pw->expires_at);
+  } else {
+    passwordCache_addFailure(pw->shortname, type);
+  }
+}
+
+/**
+ * @brief returns the password for an account
+ * @param prompt if the user may be prompted for the password
+ * @return the password or @c NULL; has to be freed after usage
+ */
+static char* _getPasswordFor(const char* shortname, unsigned char prompt) {
   if (shortname == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
@@ -152,6 +176,10 @@ char* getPasswordFor(const char* shortname) {
   secFree(key.shortname);
   if (pw == NULL) {
     agent_log(DEBUG, "No password found for '%s'", shortname);
+    if (!prompt) {
+      oidc_errno = OIDC_EPWNOTFOUND;
+      return NULL;
+    }
     agent_log(DEBUG, "Try getting password from user prompt");
     return askpass_getPasswordForUpdate(shortname);
   }
@@ -164,21 +192,28 @@ char* getPasswordFor(const char* shortname) {
     res         = decryptPassword(crypt, shortname);
     secFree(crypt);
   }
-  if (!res && type & PW_TYPE_MNG) {
+  // Keyring and command are slow, so their passwords are cached
+  if (!res && type & (PW_TYPE_MNG | PW_TYPE_CMD)) {
+    res = passwordCache_get(shortname);
+  }
+  unsigned char failed = res ? 0 : passwordCache_getFailedTypes(shortname);
+  if (!res && type & PW_TYPE_MNG && !(failed & PW_TYPE_MNG)) {
 #ifndef __APPLE__
     agent_log(DEBUG, "Try getting password from keyring");
     char* crypt = keyring_getPasswordFor(shortname);
     res         = decryptPassword(crypt, shortname);
     secFree(crypt);
+    _cacheLookup(pw, res, PW_TYPE_MNG);
 #else
     agent_log(WARNING, "keyring currently not supported for MACOS");
 #endif
   }
-  if (!res && type & PW_TYPE_CMD) {
+  if (!res && type & PW_TYPE_CMD && !(failed & PW_TYPE_CMD)) {
     agent_log(DEBUG, "Try getting password from command");
     char* cmd = decryptPassword(pw->command, shortname);
     res       = getOutputFromCommand(cmd);
     secFree(cmd);
+    _cacheLookup(pw, res, PW_TYPE_CMD);
   }
   if (!res && type & PW_TYPE_FILE) {
     agent_log(DEBUG, "Try getting password from file");
@@ -186,7 +221,7 @@ char* getPasswordFor(const char* shortname) {
     res        = getLineFromFile(file);
     secFree(file);
   }
-  if (!res && type & PW_TYPE_PRMT) {
+  if (!res && type & PW_TYPE_PRMT && prompt) {
     agent_log(DEBUG, "Try getting password from user prompt");
     res = askpass_getPasswordForUpdate(shortname);
     if (res && type & PW_TYPE_MEM) {
@@ -196,9 +231,91 @@ char* getPasswordFor(const char* shortname) {
   return res;
 }
 
+char* getPasswordFor(const char* shortname) {
+  return _getPasswordFor(shortname, 1);
+}
+
+/**
+ * @brief like @c getPasswordFor, but never prompts the user
+ */
+char* getStoredPasswordFor(const char* shortname) {
+  return _getPasswordFor(shortname, 0);
+}
+
 time_t getMinPasswordDeath() {
   agent_log(DEBUG, "Getting min death time for passwords");
-  return passwordDB_getMinDeath((time_t(*)(void*))pwe_getExpiresAt);
+  time_t pwDeath =
+      passwordDB_getMinDeath((time_t(*)(void*))pwe_getExpiresAt);
+  time_t keyDeath   = keyCache_getMinDeath();
+  time_t cacheDeath = passwordCache_getMinDeath();
+  if (cacheDeath && (keyDeath == 0 || cacheDeath < keyDeath)) {
+    keyDeath = cacheDeath;
+  }
+  if (pwDeath == 0 || (keyDeath && keyDeath < pwDeath)) {
+    return keyDeath;
+  }
+  return pwDeath;
+}
+
+/**
+ * @brief returns all stored password entries with their secrets decrypted, so
+ * that they can be handed over to the upgraded agent, which encrypts them with
+ * its own key; see upgrade.c
+ * @return a json array; has to be freed after usage
+ */
+cJSON* exportPasswords() {
+  cJSON*          entries = cJSON_CreateArray();
+  const vector_t* pws     = db_getDB(OIDC_DB_PASSWORDS);
+  for (size_t i = 0; pws && i < pws->len; i++) {
+    const struct password_entry* pw    = vector_at(pws, i);
+    struct password_entry        plain = {.shortname     = pw->shortname,
+                                          .type          = pw->type,
+                                          .expires_at    = pw->expires_at,
+                                          .expires_after = pw->expires_after};
+    plain.password = decryptPassword(pw->password, pw->shortname);
+#ifndef __APPLE__
+    if (plain.password == NULL && pw->type & PW_TYPE_MNG) {
+      char* crypt    = keyring_getPasswordFor(pw->shortname);
+      plain.password = decryptPassword(crypt, pw->shortname);
+      secFree(crypt);
+    }
+#endif
+    plain.command = decryptPassword(pw->command, pw->shortname);
+    char*  file   = decryptPassword(pw->filepath, pw->shortname);
+    cJSON* entry  = passwordEntryToJSON(&plain);
+    if (file) {
+      jsonAddStringValue(entry, PW_KEY_PWFILE, file);
+    }
+    cJSON_AddItemToArray(entries, entry);
+    secFree(plain.password);
+    secFree(plain.command);
+    secFree(file);
+  }
+  return entries;
+}
+
+/**
+ * @brief stores the password entries exported by @c exportPasswords
+ */
+void importPasswords(cJSON* entries) {
+  cJSON* entry;
+  cJSON_ArrayForEach(entry, entries) {
+    char*                  json = jsonToStringUnformatted(entry);
+    struct password_entry* pw   = JSONStringToPasswordEntry(json);
+    secFree(json);
+    if (pw == NULL) {
+      continue;
+    }
+    const cJSON* file = cJSON_GetObjectItemCaseSensitive(entry, PW_KEY_PWFILE);
+    if (cJSON_IsString(file)) {
+      pwe_setFile(pw, oidc_strcopy(file->valuestring));
+    }
+    if (savePassword(pw) != OIDC_SUCCESS) {
+      agent_log(ERROR, "Could not take over the password for '%s': %s",
+                pw->shortname, oidc_serror());
+      secFreePasswordEntry(pw);
+    }
+  }
 }
 
 struct password_entry* getDeathPasswordEntry() {
@@ -211,4 +328,6 @@ void removeDeathPasswords() {
   while ((death_pwe = getDeathPasswordEntry()) != NULL) {
     expirePasswordFor(death_pwe->shortname);
   }
+  keyCache_removeExpired();
+  passwordCache_removeExpired();
 }
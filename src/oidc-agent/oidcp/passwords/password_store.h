@@ -3,14 +3,18 @@
 
 #include "utils/oidc_error.h"
 #include "utils/password_entry.h"
+#include "wrapper/cjson.h"
 
 #include <time.h>
 
 oidc_error_t savePassword(struct password_entry* pw);
 char*        getPasswordFor(const char* shortname);
+char*        getStoredPasswordFor(const char* shortname);
 oidc_error_t removePasswordFor(const char* shortname);
 oidc_error_t removeAllPasswords();
 void         removeDeathPasswords();
 time_t       getMinPasswordDeath();
+cJSON*       exportPasswords();
+void         importPasswords(cJSON* entries);
 
 #endif  // OIDC_PASSWORD_STORE_H
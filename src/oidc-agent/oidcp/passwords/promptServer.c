@@ -0,0 +1,272 @@
+#include "promptServer.h"
+#include "ipc/reactor.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Instead of starting oidc-prompt for every consent dialog, oidcp keeps one
+ * 'oidc-prompt --server' running and sends it the dialogs over a pipe. A
+ * request consists of the NUL terminated type, title and text; the helper
+ * answers every request with one line, "yes" if the user consented. The
+ * helper shows one dialog at a time; further requests are queued in oidcp,
+ * and a request with the same text as a queued or shown one waits for the
+ * answer to that dialog instead of showing another one.
+ *
+ * If the helper dies, the pending requests are shown by starting oidc-prompt
+ * for each of them and the next request starts a new helper. A helper that
+ * exits before it answered anything, e.g. an oidc-prompt without --server, is
+ * not started again.
+ */
+
+#define PROMPT_SERVER_TITLE "oidc-agent prompt confirm"
+
+struct promptWaiter {
+  asyncConsentCallback callback;
+  void*                arg;
+};
+
+struct promptRequest {
+  char*   text;
+  list_t* waiters;
+};
+
+static pid_t         helper   = -1;
+static int           toFd     = -1;
+static int           fromFd   = -1;
+static struct string answers  = {0};
+static list_t*       requests = NULL;  // the head is shown by the helper
+static unsigned char answered = 0;     // the helper answered a request
+static unsigned char disabled = 0;     // the helper does not work
+
+static void _secFreePromptRequest(struct promptRequest* r) {
+  secFree(r->text);
+  secFreeList(r->waiters);
+  secFree(r);
+}
+
+static int _matchPromptRequest(const char*                 text,
+                               const struct promptRequest* r) {
+  return strequal(text, r->text);
+}
+
+static void _answer(struct promptRequest* r, int consent) {
+  list_node_t* node;
+  while ((node = list_lpop(r->waiters))) {
+    struct promptWaiter* w = node->val;
+    LIST_FREE(node);
+    w->callback(consent, w->arg);
+    secFree(w);
+  }
+  _secFreePromptRequest(r);
+}
+
+static oidc_error_t _send(const struct promptRequest* r) {
+  const char* fields[] = {"confirm-default-yes", PROMPT_SERVER_TITLE, r->text};
+  for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+    size_t len = strlen(fields[i]) + 1;  // with the NUL
+    for (size_t off = 0; off < len;) {
+      ssize_t n = write(toFd, fields[i] + off, len - off);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        oidc_setErrnoError();
+        return oidc_errno;
+      }
+      off += n;
+    }
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief shows the dialogs of a dead helper by starting oidc-prompt for them
+ */
+static void _fallBack(struct promptRequest* r) {
+  list_node_t* node;
+  while ((node = list_lpop(r->waiters))) {
+    struct promptWaiter* w = node->val;
+    LIST_FREE(node);
+    if (agent_startConsentPrompt(r->text, w->callback, w->arg) !=
+        OIDC_SUCCESS) {
+      w->callback(0, w->arg);
+    }
+    secFree(w);
+  }
+  _secFreePromptRequest(r);
+}
+
+static void _stop() {
+  if (fromFd >= 0) {
+    reactor_unwatchFd(fromFd);
+    close(fromFd);
+  }
+  if (toFd >= 0) {
+    close(toFd);  // the helper exits at EOF
+  }
+  if (helper > 0) {
+    waitpid(helper, NULL, 0);
+  }
+  helper = toFd = fromFd = -1;
+  secFree(answers.ptr);
+  answers = (struct string){0};
+  if (!answered) {
+    disabled = 1;
+  }
+  list_t* pending = requests;
+  requests        = NULL;
+  list_node_t* node;
+  while (pending && (node = list_lpop(pending))) {
+    struct promptRequest* r = node->val;
+    LIST_FREE(node);
+    _fallBack(r);
+  }
+  list_destroy(pending);
+}
+
+static void _readAnswers(int fd, void* arg) {
+  (void)arg;
+  char    buf[64];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    string_append(&answers, buf, n);
+  }
+  char* eol;
+  while (answers.ptr && (eol = memchr(answers.ptr, '\n', answers.len))) {
+    *eol            = '\0';
+    int    consent  = strcaseequal(answers.ptr, "yes");
+    size_t consumed = eol - answers.ptr + 1;
+    answers.len -= consumed;
+    memmove(answers.ptr, eol + 1, answers.len);
+    answers.ptr[answers.len] = '\0';
+    list_node_t* node        = requests ? list_lpop(requests) : NULL;
+    if (node == NULL) {
+      agent_log(ERROR, "Unexpected answer from the prompt helper");
+      continue;
+    }
+    struct promptRequest* r = node->val;
+    LIST_FREE(node);
+    answered = 1;
+    if (requests->head && _send(requests->head->val) != OIDC_SUCCESS) {
+      n = 0;  // treated like a dead helper below
+    }
+    _answer(r, consent);
+  }
+  if (n == 0 ||
+      (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    agent_log(NOTICE, "The prompt helper exited");
+    _stop();
+  }
+}
+
+static oidc_error_t _start() {
+  int in[2];
+  int out[2];
+  if (pipe(in) != 0) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  if (pipe(out) != 0) {
+    oidc_setErrnoError();
+    close(in[0]);
+    close(in[1]);
+    return oidc_errno;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    oidc_setErrnoError();
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    return oidc_errno;
+  }
+  if (pid == 0) {  // child
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    signal(SIGPIPE, SIG_DFL);
+    execlp("oidc-prompt", "oidc-prompt", "--server", (char*)NULL);
+    _exit(127);
+  }
+  close(in[0]);
+  close(out[1]);
+  fcntl(in[1], F_SETFD, FD_CLOEXEC);
+  fcntl(out[0], F_SETFD, FD_CLOEXEC);
+  fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL, 0) | O_NONBLOCK);
+  if (init_string(&answers) != OIDC_SUCCESS) {
+    close(in[1]);
+    close(out[0]);
+    waitpid(pid, NULL, 0);
+    return oidc_errno;
+  }
+  helper = pid;
+  toFd   = in[1];
+  fromFd = out[0];
+  reactor_watchFd(fromFd, _readAnswers, NULL);
+  agent_log(DEBUG, "Started prompt helper %d", helper);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief asks the user for consent through the prompt helper
+ * @param callback is called with @c 1 if the user consented and @c 0 if not
+ * @return @c OIDC_SUCCESS if the request was queued; @p callback is not called
+ * otherwise
+ */
+oidc_error_t promptServer_consentDefaultYes(const char*          text,
+                                            asyncConsentCallback callback,
+                                            void*                arg) {
+  if (text == NULL || callback == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (disabled) {
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  if (helper < 0 && _start() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  if (requests == NULL) {
+    requests        = list_new();
+    requests->match = (matchFunction)_matchPromptRequest;
+  }
+  struct promptWaiter* w = secAlloc(sizeof(struct promptWaiter));
+  w->callback            = callback;
+  w->arg                 = arg;
+  list_node_t* node      = findInList(requests, text);
+  if (node) {
+    agent_log(DEBUG, "Combining consent prompt with a pending one");
+    list_rpush(((struct promptRequest*)node->val)->waiters, list_node_new(w));
+    return OIDC_SUCCESS;
+  }
+  struct promptRequest* r = secAlloc(sizeof(struct promptRequest));
+  r->text                 = oidc_strcopy(text);
+  r->waiters              = list_new();
+  r->waiters->free        = _secFree;
+  list_rpush(r->waiters, list_node_new(w));
+  list_rpush(requests, list_node_new(r));
+  if (requests->len == 1 && _send(r) != OIDC_SUCCESS) {
+    list_node_t* own = list_rpop(requests);
+    LIST_FREE(own);
+    _secFreePromptRequest(r);  // not answered; the caller falls back
+    _stop();
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDCP_PROMPT_SERVER_H
+#define OIDCP_PROMPT_SERVER_H
+
+#include "oidc-agent/oidcp/passwords/agent_prompt.h"
+#include "utils/oidc_error.h"
+
+oidc_error_t promptServer_consentDefaultYes(const char*          text,
+                                            asyncConsentCallback callback,
+                                            void*                arg);
+
+#endif  // OIDCP_PROMPT_SERVER_H
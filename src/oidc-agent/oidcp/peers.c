@@ -0,0 +1,494 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "peers.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "ipc/reactor.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/parseJson.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Agents given with --peer share the tokens they obtain: every new default
+ * access token and every rotated refresh token is sent to all peers with a
+ * replicate request. A peer takes the tokens for the accounts it has loaded,
+ * so it serves the access token refreshed by another agent from its cache and
+ * keeps using the refresh token the provider issued last.
+ *
+ * Only one agent refreshes an account at a time. Before oidcd refreshes, it
+ * asks oidcp for the refresh lease of the account. oidcp grants it if no peer
+ * holds it and announces it to the peers with a replicate request that only
+ * has a @c lease. While a peer holds the lease, the request waits until the
+ * peer replicated its tokens, which ends the lease and are passed to oidcd
+ * instead, or until the lease expired. Two agents only refresh an account
+ * together if both take the lease before the announcement of the other one
+ * arrived. Within an agent every account is owned by a single worker anyway.
+ *
+ * Peers are the UNIX sockets of the other agents, e.g. forwarded with ssh.
+ * Replicate requests are only accepted from the user running the agent. The
+ * tokens a peer sent are remembered, so that they are not sent back when the
+ * agent applies them.
+ *
+ * The requests are sent in order by a child process, so that oidcp does not
+ * wait for the peers.
+ */
+
+struct replicatedTokens {
+  char*         shortname;
+  char*         access_token;
+  unsigned long expires_at;
+  char*         refresh_token;
+};
+
+struct refreshLease {
+  char*         shortname;
+  time_t        until;
+  unsigned char own;      // if this agent holds the lease; otherwise a peer
+  list_t*       waiters;  // of struct leaseWaiter*
+};
+
+struct leaseWaiter {
+  peersCallback callback;
+  void*         arg;
+};
+
+static list_t* peers    = NULL;  // of socket paths
+static list_t* received = NULL;  // oldest first
+static list_t* leases   = NULL;
+static list_t* outgoing = NULL;  // requests waiting for the running child
+static pid_t   sender   = 0;     // the child sending to the peers
+
+static void _secFreeReplicatedTokens(struct replicatedTokens* t) {
+  secFree(t->shortname);
+  secFree(t->access_token);
+  secFree(t->refresh_token);
+  secFree(t);
+}
+
+static int _matchReplicatedTokens(const char*                    shortname,
+                                  const struct replicatedTokens* t) {
+  return strequal(shortname, t->shortname);
+}
+
+static void _secFreeRefreshLease(struct refreshLease* l) {
+  secFree(l->shortname);
+  secFreeList(l->waiters);
+  secFree(l);
+}
+
+static int _matchRefreshLease(const char*                shortname,
+                              const struct refreshLease* l) {
+  return strequal(shortname, l->shortname);
+}
+
+/**
+ * @brief adds the comma separated socket paths @p addresses as peers
+ */
+oidc_error_t peers_add(const char* addresses) {
+  if (!strValid(addresses)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (peers == NULL) {
+    peers        = list_new();
+    peers->free  = _secFree;
+    peers->match = (matchFunction)strequal;
+  }
+  char*        copy = oidc_strcopy(addresses);
+  char*        save = NULL;
+  oidc_error_t e    = OIDC_SUCCESS;
+  for (char* path = strtok_r(copy, ",", &save); path && e == OIDC_SUCCESS;
+       path       = strtok_r(NULL, ",", &save)) {
+    if (path[0] != '/' ||
+        strlen(path) >= sizeof(((struct sockaddr_un*)0)->sun_path)) {
+      oidc_seterror("--peer needs the absolute socket path of an agent");
+      oidc_errno = OIDC_EERROR;
+      e          = oidc_errno;
+    } else if (findInList(peers, path) == NULL) {
+      list_rpush(peers, list_node_new(oidc_strcopy(path)));
+    }
+  }
+  secFree(copy);
+  return e;
+}
+
+int peers_isEnabled() { return peers != NULL && peers->len > 0; }
+
+static void _startSender();
+
+static void _reapSender(int fd, void* arg __attribute__((unused))) {
+  char    buf[64];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;  // the child is still running
+  }
+  reactor_unwatchFd(fd);
+  close(fd);
+  waitpid(sender, NULL, 0);
+  sender = 0;
+  _startSender();
+}
+
+/**
+ * @brief starts a child process that sends all outgoing requests to all peers
+ * in the order they were queued
+ */
+static void _startSender() {
+  if (sender || outgoing == NULL || outgoing->len == 0) {
+    return;
+  }
+  int fds[2];
+  if (pipe(fds) != 0) {
+    agent_log(ERROR, "Could not replicate tokens: %m");
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    agent_log(ERROR, "Could not replicate tokens: %m");
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  if (pid == 0) {  // child; the parent notices its exit on the pipe
+    close(fds[0]);
+    ipc_setResponseTimeout(PEERS_TIMEOUT);
+    for (list_node_t* r = outgoing->head; r; r = r->next) {
+      for (list_node_t* peer = peers->head; peer; peer = peer->next) {
+        setenv(OIDC_SOCK_ENV_NAME, peer->val, 1);
+        char* res   = ipc_cryptCommunicate(0, "%s", (char*)r->val);
+        char* error = res ? parseForError(res) : oidc_strcopy(oidc_serror());
+        if (error) {
+          agent_log(NOTICE, "Could not replicate to peer '%s': %s",
+                    (char*)peer->val, error);
+          secFree(error);
+        }
+      }
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[1]);
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  sender = pid;
+  list_node_t* node;
+  while ((node = list_lpop(outgoing))) {  // the child has its own copy
+    secFree(node->val);
+    LIST_FREE(node);
+  }
+  reactor_watchFd(fds[0], _reapSender, NULL);
+}
+
+/**
+ * @brief sends @p json to all peers after the requests queued before
+ */
+static void _sendToPeers(cJSON* json) {
+  if (outgoing == NULL) {
+    outgoing       = list_new();
+    outgoing->free = _secFree;
+  }
+  list_rpush(outgoing, list_node_new(jsonToStringUnformatted(json)));
+  secFreeJson(json);
+  _startSender();
+}
+
+static const struct replicatedTokens* _findReceived(const char* shortname) {
+  list_node_t* node = received ? findInList(received, shortname) : NULL;
+  return node ? node->val : NULL;
+}
+
+static struct refreshLease* _findLease(const char* shortname) {
+  list_node_t* node = leases ? findInList(leases, shortname) : NULL;
+  return node ? node->val : NULL;
+}
+
+/**
+ * @brief removes the lease of @p shortname and calls its waiters with
+ * @p response
+ */
+static void _endLease(const char* shortname, const char* response) {
+  list_node_t* node = leases ? findInList(leases, shortname) : NULL;
+  if (node == NULL) {
+    return;
+  }
+  struct refreshLease* l       = node->val;
+  list_t*              waiters = l->waiters;
+  l->waiters                   = NULL;
+  list_remove(leases, node);
+  list_node_t* wnode;
+  while (waiters && (wnode = list_lpop(waiters))) {
+    struct leaseWaiter* w = wnode->val;
+    w->callback(response, w->arg);
+    secFree(w);
+    LIST_FREE(wnode);
+  }
+  secFreeList(waiters);
+}
+
+/**
+ * @brief sets the lease of @p shortname for @p seconds
+ * @param own if the lease is taken by this agent; then it is announced to the
+ * peers
+ */
+static struct refreshLease* _setLease(const char* shortname, time_t seconds,
+                                      unsigned char own) {
+  if (leases == NULL) {
+    leases        = list_new();
+    leases->free  = (void (*)(void*))_secFreeRefreshLease;
+    leases->match = (matchFunction)_matchRefreshLease;
+  }
+  struct refreshLease* l = _findLease(shortname);
+  if (l == NULL) {
+    l            = secAlloc(sizeof(struct refreshLease));
+    l->shortname = oidc_strcopy(shortname);
+    list_rpush(leases, list_node_new(l));
+  }
+  l->until = time(NULL) + seconds;
+  l->own   = own;
+  if (own) {
+    cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                     REQUEST_VALUE_REPLICATE, IPC_KEY_SHORTNAME,
+                                     cJSON_String, shortname, NULL);
+    jsonAddNumberValue(json, IPC_KEY_LEASE, seconds);
+    _sendToPeers(json);
+  }
+  return l;
+}
+
+/**
+ * @brief sends a new default access token of an account to the peers
+ * This ends the refresh lease of this agent. Tokens that were replicated from
+ * a peer are not sent again.
+ */
+void peers_replicateToken(const char* shortname, const char* access_token,
+                          const char* issuer, unsigned long expires_at) {
+  if (!peers_isEnabled() || !strValid(shortname) || !strValid(access_token)) {
+    return;
+  }
+  const struct replicatedTokens* t = _findReceived(shortname);
+  if (t && strequal(t->access_token, access_token)) {
+    return;
+  }
+  const struct refreshLease* l = _findLease(shortname);
+  if (l && l->own) {
+    _endLease(shortname, RESPONSE_SUCCESS);
+  }
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_REPLICATE,
+      IPC_KEY_SHORTNAME, cJSON_String, shortname, IPC_KEY_ISSUERURL,
+      cJSON_String, issuer ?: "", OIDC_KEY_ACCESSTOKEN, cJSON_String,
+      access_token, NULL);
+  jsonAddNumberValue(json, AGENT_KEY_EXPIRESAT, expires_at);
+  agent_log(DEBUG, "Replicating access token of '%s' to %lu peer(s)",
+            shortname, (unsigned long)peers->len);
+  _sendToPeers(json);
+}
+
+/**
+ * @brief sends a rotated refresh token of an account to the peers
+ * Refresh tokens that were replicated from a peer are not sent again.
+ */
+void peers_replicateRefreshToken(const char* shortname,
+                                 const char* refresh_token) {
+  if (!peers_isEnabled() || !strValid(shortname) ||
+      !strValid(refresh_token)) {
+    return;
+  }
+  const struct replicatedTokens* t = _findReceived(shortname);
+  if (t && strequal(t->refresh_token, refresh_token)) {
+    return;
+  }
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_REPLICATE,
+      IPC_KEY_SHORTNAME, cJSON_String, shortname, OIDC_KEY_REFRESHTOKEN,
+      cJSON_String, refresh_token, NULL);
+  agent_log(DEBUG, "Replicating refresh token of '%s' to %lu peer(s)",
+            shortname, (unsigned long)peers->len);
+  _sendToPeers(json);
+}
+
+/**
+ * @brief builds the answer to a waiting lease request from the tokens a peer
+ * replicated
+ */
+static char* _leaseResponse(const struct replicatedTokens* t) {
+  cJSON* json = generateJSONObject(IPC_KEY_STATUS, cJSON_String,
+                                   STATUS_SUCCESS, OIDC_KEY_ACCESSTOKEN,
+                                   cJSON_String, t->access_token, NULL);
+  jsonAddNumberValue(json, AGENT_KEY_EXPIRESAT, t->expires_at);
+  if (t->refresh_token) {
+    jsonAddStringValue(json, OIDC_KEY_REFRESHTOKEN, t->refresh_token);
+  }
+  char* response = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return response;
+}
+
+/**
+ * @brief remembers a replicate request of a peer
+ * The tokens are remembered, so that they are not replicated back when oidcd
+ * applies them. An announced lease is recorded; an access token ends the
+ * lease of the peer and is passed to the requests waiting for it.
+ * @return @c 1 if the request has tokens that oidcd has to apply; @c 0 if it
+ * only announced a lease
+ */
+int peers_rememberReplicated(const char* request) {
+  INIT_KEY_VALUE(IPC_KEY_SHORTNAME, OIDC_KEY_ACCESSTOKEN, AGENT_KEY_EXPIRESAT,
+                 OIDC_KEY_REFRESHTOKEN, IPC_KEY_LEASE);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  KEY_VALUE_VARS(shortname, access_token, expires_at, refresh_token, lease);
+  if (!strValid(_shortname)) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  if (_lease) {
+    agent_log(DEBUG, "A peer refreshes '%s'", _shortname);
+    _setLease(_shortname, strToULong(_lease), 0);
+  }
+  if (!strValid(_access_token) && !strValid(_refresh_token)) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  if (received == NULL) {
+    received        = list_new();
+    received->free  = (void (*)(void*))_secFreeReplicatedTokens;
+    received->match = (matchFunction)_matchReplicatedTokens;
+  }
+  list_node_t*             node = findInList(received, _shortname);
+  struct replicatedTokens* t    = node ? node->val : NULL;
+  if (t == NULL) {
+    if (received->len >= PEERS_RECEIVED_MAX) {
+      list_remove(received, received->head);
+    }
+    t            = secAlloc(sizeof(struct replicatedTokens));
+    t->shortname = oidc_strcopy(_shortname);
+    list_rpush(received, list_node_new(t));
+  }
+  if (strValid(_refresh_token)) {
+    secFree(t->refresh_token);
+    t->refresh_token = oidc_strcopy(_refresh_token);
+  }
+  if (strValid(_access_token)) {
+    secFree(t->access_token);
+    t->access_token = oidc_strcopy(_access_token);
+    t->expires_at   = _expires_at ? strToULong(_expires_at) : 0;
+    const struct refreshLease* l = _findLease(_shortname);
+    if (l && !l->own) {
+      char* response = _leaseResponse(t);
+      _endLease(_shortname, response);
+      secFree(response);
+    }
+  }
+  SEC_FREE_KEY_VALUES();
+  return 1;
+}
+
+/**
+ * @brief acquires the refresh lease of an account for this agent
+ * @param callback is called with the answer for oidcd once the lease was
+ * granted or a peer replicated new tokens; it might be called before this
+ * function returns
+ * @return @c OIDC_SUCCESS if @p callback will be called
+ */
+oidc_error_t peers_acquireLease(const char* shortname, peersCallback callback,
+                                void* arg) {
+  if (!strValid(shortname) || callback == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct refreshLease* l = _findLease(shortname);
+  if (l && !l->own && l->until > time(NULL)) {
+    agent_log(DEBUG, "Waiting for a peer to refresh '%s'", shortname);
+    if (l->waiters == NULL) {
+      l->waiters       = list_new();
+      l->waiters->free = _secFree;
+    }
+    struct leaseWaiter* w = secAlloc(sizeof(struct leaseWaiter));
+    w->callback           = callback;
+    w->arg                = arg;
+    list_rpush(l->waiters, list_node_new(w));
+    return OIDC_SUCCESS;
+  }
+  if (peers_isEnabled()) {
+    _setLease(shortname, PEERS_LEASE_TIME, 1);
+  }
+  callback(RESPONSE_SUCCESS, arg);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns when the next lease a request waits for expires
+ * @return the point in time or @c 0 if no request waits
+ */
+time_t peers_getNextTime() {
+  time_t next = 0;
+  for (list_node_t* node = leases ? leases->head : NULL; node;
+       node              = node->next) {
+    const struct refreshLease* l = node->val;
+    if (l->waiters && l->waiters->len && (next == 0 || l->until < next)) {
+      next = l->until;
+    }
+  }
+  return next;
+}
+
+/**
+ * @brief removes expired leases; the requests waiting for an expired lease of
+ * a peer take it over
+ */
+void peers_runDue() {
+  if (leases == NULL) {
+    return;
+  }
+  time_t           now = time(NULL);
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(leases, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct refreshLease* l = node->val;
+    if (l->until > now) {
+      continue;
+    }
+    if (l->waiters && l->waiters->len) {
+      agent_log(NOTICE, "The refresh lease of a peer for '%s' expired",
+                l->shortname);
+      char* name = oidc_strcopy(l->shortname);
+      _endLease(name, RESPONSE_SUCCESS);
+      _setLease(name, PEERS_LEASE_TIME, 1);
+      secFree(name);
+    } else {
+      list_remove(leases, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+void peers_destroy() {
+  secFreeList(peers);
+  peers = NULL;
+  secFreeList(received);
+  received = NULL;
+  secFreeList(leases);
+  leases = NULL;
+  secFreeList(outgoing);
+  outgoing = NULL;
+}
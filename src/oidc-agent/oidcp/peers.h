@@ -0,0 +1,31 @@
+#ifndef OIDC_PEERS_H
+#define OIDC_PEERS_H
+
+#include "utils/oidc_error.h"
+
+#include <time.h>
+
+// Maximum number of accounts for which the last replicated tokens are kept
+#define PEERS_RECEIVED_MAX 256
+// Seconds a peer has to answer a replicate request
+#define PEERS_TIMEOUT 10
+// Seconds an agent may refresh an account before its peers take over
+#define PEERS_LEASE_TIME 30
+
+typedef void (*peersCallback)(const char* response, void* arg);
+
+oidc_error_t peers_add(const char* addresses);
+int          peers_isEnabled();
+void         peers_replicateToken(const char* shortname,
+                                  const char* access_token, const char* issuer,
+                                  unsigned long expires_at);
+void         peers_replicateRefreshToken(const char* shortname,
+                                         const char* refresh_token);
+int          peers_rememberReplicated(const char* request);
+oidc_error_t peers_acquireLease(const char* shortname, peersCallback callback,
+                                void* arg);
+time_t       peers_getNextTime();
+void         peers_runDue();
+void         peers_destroy();
+
+#endif  // OIDC_PEERS_H
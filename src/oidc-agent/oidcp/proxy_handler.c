@@ -1,26 +1,67 @@
 #include "proxy_handler.h"
-#include "account/issuer_helper.h"
+#include "account/account.h"
+#include "account/accountCodec.h"
+#include "account/issuer_index.h"
 #include "defines/settings.h"
 #include "oidc-agent/oidcp/passwords/askpass.h"
 #include "oidc-agent/oidcp/passwords/password_store.h"
+#include "oidc-agent/workPool.h"
+#include "utils/agentLogger.h"
+#include "defines/oidc_values.h"
 #include "utils/crypt/cryptUtils.h"
 #include "utils/file_io/cryptFileUtils.h"
 #include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
 #include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/negativeCache.h"
 #include "utils/stringUtils.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-oidc_error_t updateRefreshToken(const char* shortname,
+/**
+ * @brief updates the refresh token in a config file that is sealed to this
+ * host, without the password
+ * @return an oidc_error code; @c OIDC_ENOSEAL if the file is not sealed
+ */
+static oidc_error_t _updateRefreshTokenSealed(const char* shortname,
+                                              size_t      slot,
+                                              const char* refresh_token) {
+  char* file_content = decryptOidcFileSealed(shortname);
+  if (file_content == NULL) {
+    return oidc_errno;
+  }
+  cJSON* cjson = stringToJson(file_content);
+  secFree(file_content);
+  setRefreshTokenInConfig(cjson, slot, refresh_token);
+  char* updated_content = jsonToString(cjson);
+  secFreeJson(cjson);
+  oidc_error_t e = reencryptAndWriteSealedOidcFile(updated_content, shortname);
+  secFree(updated_content);
+  return e;
+}
+
+/**
+ * @brief writes a rotated refresh token to the config file of an account
+ * @param slot the slot of the refresh token in the refresh token pool of the
+ * account; @c 0 for the refresh token itself
+ */
+oidc_error_t updateRefreshToken(const char* shortname, size_t slot,
                                 const char* refresh_token) {
   if (shortname == NULL || refresh_token == NULL) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (oidcFileIsSealed(shortname) &&
+      _updateRefreshTokenSealed(shortname, slot, refresh_token) ==
+          OIDC_SUCCESS) {
+    return OIDC_SUCCESS;
+  }
   char*        password = getPasswordFor(shortname);
-  oidc_error_t e =
-      updateRefreshTokenUsingPassword(shortname, refresh_token, password);
+  oidc_error_t e = updateRefreshTokenUsingPassword(shortname, slot,
+                                                   refresh_token, password);
   secFree(password);
   return e;
 }
@@ -31,10 +72,14 @@ char* getAutoloadConfig(const char* shortname, const char* issuer,
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  if (!oidcFileDoesExist(shortname)) {
+  if (!accountConfigExists(shortname)) {
     oidc_errno = OIDC_ENOACCOUNT;
     return NULL;
   }
+  char* sealed = decryptOidcFileSealed(shortname);
+  if (sealed) {
+    return sealed;
+  }
   for (size_t i = 0; i < MAX_PASS_TRIES; i++) {
     char* password =
         issuer ? askpass_getPasswordForAutoloadWithIssuer(issuer, shortname,
@@ -44,6 +89,9 @@ char* getAutoloadConfig(const char* shortname, const char* issuer,
       return NULL;
     }
     char* config = decryptOidcFile(shortname, password);
+    if (config != NULL) {
+      upgradeOidcFileInBackground(shortname, password);
+    }
     secFree(password);
     if (config != NULL) {
       return config;
@@ -52,30 +100,367 @@ char* getAutoloadConfig(const char* shortname, const char* issuer,
   return NULL;
 }
 
-char* getDefaultAccountConfigForIssuer(const char* issuer_url) {
-  if (issuer_url == NULL) {
+/**
+ * @brief like @c getAutoloadConfig, but returns the account in the compact
+ * encoding that is sent to oidcd
+ */
+static char* _configToCompactAccount(char* config) {
+  if (config == NULL) {
+    return NULL;
+  }
+  struct oidc_account* account = getAccountFromJSON(config);
+  secFree(config);
+  if (account == NULL) {
+    return NULL;
+  }
+  char* encoded = accountToCompactString(account);
+  secFreeAccount(account);
+  return encoded;
+}
+
+char* getAutoloadAccount(const char* shortname, const char* issuer,
+                         const char* application_hint) {
+  return _configToCompactAccount(
+      getAutoloadConfig(shortname, issuer, application_hint));
+}
+
+/**
+ * @brief returns the account config of a loaded account that changed on disk,
+ * in the compact encoding that is sent to oidcd
+ * Only a sealed key or a stored password is used; the user is not prompted.
+ * @return the encoded account or @c NULL if the config could not be decrypted
+ */
+char* getReloadAccount(const char* shortname) {
+  if (shortname == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  list_t* issuers = getLinesFromOidcFile(ISSUER_CONFIG_FILENAME);
-  if (issuers == NULL) {
+  char* sealed = decryptOidcFileSealed(shortname);
+  if (sealed) {
+    return _configToCompactAccount(sealed);
+  }
+  char* password = getStoredPasswordFor(shortname);
+  if (password == NULL) {
     return NULL;
   }
-  char*            shortname = NULL;
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(issuers, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    char* line = node->val;
-    char* iss  = strtok(line, " ");
-    char* acc  = strtok(NULL, " ");
-    if (compIssuerUrls(issuer_url, iss)) {
-      if (strValid(acc)) {
-        shortname = oidc_strcopy(acc);
-      }
-      break;
+  char* config = decryptOidcFile(shortname, password);
+  secFree(password);
+  return _configToCompactAccount(config);
+}
+
+/**
+ * An account config that is decrypted on the work pool, so that oidcp keeps
+ * serving requests during the key derivation
+ */
+struct decryptJob {
+  char*           shortname;
+  char*           issuer;
+  char*           application_hint;
+  char*           password;  // NULL while the sealed key is tried
+  char*           filepath;
+  oidc_error_t    error;
+  size_t          tries;  // 0 if the password is not prompted for
+  unsigned char   sealed;  // prompt for the password if unsealing fails
+  accountCallback callback;
+  void*           arg;
+};
+
+static void _secFreeDecryptJob(struct decryptJob* job) {
+  secFree(job->shortname);
+  secFree(job->issuer);
+  secFree(job->application_hint);
+  secFree(job->password);
+  secFree(job->filepath);
+  secFree(job);
+}
+
+static void* _decryptWork(void* arg) {
+  struct decryptJob* job    = arg;
+  char*              config = job->password
+                                  ? decryptFile(job->filepath, job->password)
+                                  : decryptFileSealed(job->filepath);
+  job->error                = config ? OIDC_SUCCESS : oidc_errno;
+  return config;
+}
+
+static void _decryptJob(struct decryptJob* job);
+
+static void _decryptDone(void* result, void* arg) {
+  struct decryptJob* job    = arg;
+  char*              config = result;
+  if (config == NULL &&
+      (job->sealed || (job->tries && job->tries < MAX_PASS_TRIES))) {
+    if (job->sealed) {
+      agent_log(NOTICE, "Could not unseal '%s': %s", job->shortname,
+                oidc_serrorFor(job->error));
+      job->sealed = 0;
+    }
+    secFree(job->password);
+    job->password =
+        job->issuer ? askpass_getPasswordForAutoloadWithIssuer(
+                          job->issuer, job->shortname, job->application_hint)
+                    : askpass_getPasswordForAutoload(job->shortname,
+                                                     job->application_hint);
+    if (job->password) {
+      job->tries++;
+      _decryptJob(job);
+      return;
+    }
+    job->error = oidc_errno;
+  }
+  if (config && job->tries) {
+    upgradeOidcFileInBackground(job->shortname, job->password);
+  }
+  if (config == NULL) {
+    oidc_errno = job->error;
+  }
+  char* account = _configToCompactAccount(config);
+  job->callback(account, job->arg);
+  secFree(account);
+  _secFreeDecryptJob(job);
+}
+
+/**
+ * @brief decrypts the config of a job on the work pool; configs in the
+ * keystore and configs without a running pool are decrypted right away
+ */
+static void _decryptJob(struct decryptJob* job) {
+  if (workPool_isRunning() && oidcFileDoesExist(job->shortname)) {
+    secFree(job->filepath);
+    job->filepath = concatToOidcDir(job->shortname);
+    if (workPool_submit(_decryptWork, _decryptDone, job) == OIDC_SUCCESS) {
+      return;
     }
   }
-  list_iterator_destroy(it);
-  secFreeList(issuers);
+  char* config = job->password
+                     ? decryptOidcFile(job->shortname, job->password)
+                     : decryptOidcFileSealed(job->shortname);
+  job->error   = config ? OIDC_SUCCESS : oidc_errno;
+  _decryptDone(config, job);
+}
+
+static void _autoload(const char* shortname, const char* issuer,
+                      const char* application_hint, accountCallback callback,
+                      void* arg) {
+  if (!accountConfigExists(shortname)) {
+    negativeCache_add(NEGATIVE_CACHE_ACCOUNT, shortname);
+    oidc_errno = OIDC_ENOACCOUNT;
+    callback(NULL, arg);
+    return;
+  }
+  // a config sealed to this host is unsealed without the password prompt and
+  // the key derivation
+  unsigned char sealed   = oidcFileIsSealed(shortname);
+  char*         password = NULL;
+  if (!sealed) {
+    password =
+        issuer ? askpass_getPasswordForAutoloadWithIssuer(issuer, shortname,
+                                                          application_hint)
+               : askpass_getPasswordForAutoload(shortname, application_hint);
+    if (password == NULL) {
+      callback(NULL, arg);
+      return;
+    }
+  }
+  struct decryptJob* job = secAlloc(sizeof(struct decryptJob));
+  job->shortname         = oidc_strcopy(shortname);
+  job->issuer            = issuer ? oidc_strcopy(issuer) : NULL;
+  job->application_hint =
+      application_hint ? oidc_strcopy(application_hint) : NULL;
+  job->password          = password;
+  job->tries             = sealed ? 0 : 1;
+  job->sealed            = sealed;
+  job->callback          = callback;
+  job->arg               = arg;
+  _decryptJob(job);
+}
+
+/**
+ * Autoloads are single-flight per account: while the user is prompted and the
+ * config is decrypted, further autoloads of the same account wait for that
+ * outcome instead of prompting again. Declined or failed autoloads are
+ * remembered for AUTOLOAD_NEGATIVE_CACHE_TIME seconds and answered with the
+ * same error right away.
+ */
+struct autoloadWaiter {
+  accountCallback callback;
+  void*           arg;
+};
+
+struct autoloadFlight {
+  char*   shortname;
+  list_t* waiters;
+};
+
+struct failedAutoload {
+  char*        shortname;
+  oidc_error_t error;
+  time_t       until;
+};
+
+static list_t* autoloadFlights = NULL;
+static list_t* failedAutoloads = NULL;
+
+static void _secFreeAutoloadFlight(struct autoloadFlight* f) {
+  secFree(f->shortname);
+  secFreeList(f->waiters);
+  secFree(f);
+}
+
+static void _secFreeFailedAutoload(struct failedAutoload* f) {
+  secFree(f->shortname);
+  secFree(f);
+}
+
+static int _matchAutoloadFlight(const char*                  shortname,
+                                const struct autoloadFlight* f) {
+  return strequal(shortname, f->shortname);
+}
+
+static int _matchFailedAutoload(const char*                  shortname,
+                                const struct failedAutoload* f) {
+  return strequal(shortname, f->shortname);
+}
+
+/**
+ * @brief returns the error of a recently failed autoload of @p shortname
+ * @return the error or @c OIDC_SUCCESS if there is none
+ */
+static oidc_error_t _recentAutoloadError(const char* shortname) {
+  list_node_t* node =
+      failedAutoloads ? findInList(failedAutoloads, shortname) : NULL;
+  if (node == NULL) {
+    return OIDC_SUCCESS;
+  }
+  const struct failedAutoload* f = node->val;
+  if (f->until <= time(NULL)) {
+    list_remove(failedAutoloads, node);
+    return OIDC_SUCCESS;
+  }
+  return f->error;
+}
+
+static void _rememberFailedAutoload(const char* shortname, oidc_error_t error) {
+  if (failedAutoloads == NULL) {
+    failedAutoloads        = list_new();
+    failedAutoloads->free  = (void (*)(void*))_secFreeFailedAutoload;
+    failedAutoloads->match = (matchFunction)_matchFailedAutoload;
+  }
+  list_node_t* node = findInList(failedAutoloads, shortname);
+  if (node) {
+    list_remove(failedAutoloads, node);
+  }
+  struct failedAutoload* f = secAlloc(sizeof(struct failedAutoload));
+  f->shortname             = oidc_strcopy(shortname);
+  f->error                 = error;
+  f->until                 = time(NULL) + AUTOLOAD_NEGATIVE_CACHE_TIME;
+  list_rpush(failedAutoloads, list_node_new(f));
+}
+
+/**
+ * @brief answers all autoloads that waited for the same account
+ */
+static void _finishAutoload(const char* account, void* arg) {
+  struct autoloadFlight* flight = arg;
+  oidc_error_t           error  = account ? OIDC_SUCCESS : oidc_errno;
+  list_remove(autoloadFlights, findInList(autoloadFlights, flight->shortname));
+  // The flight is not freed by list_remove, see getAutoloadAccountAsync
+  if (error != OIDC_SUCCESS && error != OIDC_ENOACCOUNT) {
+    _rememberFailedAutoload(flight->shortname, error);
+  }
+  list_node_t* node;
+  while ((node = list_lpop(flight->waiters))) {
+    struct autoloadWaiter* w = node->val;
+    LIST_FREE(node);
+    oidc_errno = error;
+    w->callback(account, w->arg);
+    secFree(w);
+  }
+  _secFreeAutoloadFlight(flight);
+}
+
+/**
+ * @brief like @c getAutoloadAccount, but the key derivation does not block
+ * the event loop
+ * The user is still prompted for the password on the calling thread.
+ * Concurrent autoloads of the same account are answered with one outcome.
+ * @param callback called with the encoded account, or with @c NULL and
+ * @c oidc_errno set; possibly before this function returns
+ */
+void getAutoloadAccountAsync(const char* shortname, const char* issuer,
+                             const char*     application_hint,
+                             accountCallback callback, void* arg) {
+  if (shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    callback(NULL, arg);
+    return;
+  }
+  oidc_error_t recent =
+      negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, shortname)
+          ? OIDC_ENOACCOUNT
+          : _recentAutoloadError(shortname);
+  if (recent != OIDC_SUCCESS) {
+    oidc_errno = recent;
+    callback(NULL, arg);
+    return;
+  }
+  if (autoloadFlights == NULL) {
+    autoloadFlights = list_new();
+    // No free function; a flight is freed once all waiters are answered
+    autoloadFlights->match = (matchFunction)_matchAutoloadFlight;
+  }
+  struct autoloadWaiter* w = secAlloc(sizeof(struct autoloadWaiter));
+  w->callback              = callback;
+  w->arg                   = arg;
+  list_node_t* node        = findInList(autoloadFlights, shortname);
+  if (node) {
+    agent_log(DEBUG, "Autoload of '%s' waits for the one in flight",
+              shortname);
+    list_rpush(((struct autoloadFlight*)node->val)->waiters, list_node_new(w));
+    return;
+  }
+  struct autoloadFlight* flight = secAlloc(sizeof(struct autoloadFlight));
+  flight->shortname             = oidc_strcopy(shortname);
+  flight->waiters               = list_new();
+  list_rpush(flight->waiters, list_node_new(w));
+  list_rpush(autoloadFlights, list_node_new(flight));
+  _autoload(shortname, issuer, application_hint, _finishAutoload, flight);
+}
+
+/**
+ * @brief like @c getReloadAccount, but the key derivation does not block the
+ * event loop
+ * @param callback called with the encoded account, or with @c NULL and
+ * @c oidc_errno set; possibly before this function returns
+ */
+void getReloadAccountAsync(const char* shortname, accountCallback callback,
+                           void* arg) {
+  unsigned char sealed   = shortname ? oidcFileIsSealed(shortname) : 0;
+  char*         password = shortname && !sealed
+                               ? getStoredPasswordFor(shortname)
+                               : NULL;
+  if (password == NULL && !sealed) {
+    if (shortname == NULL) {
+      oidc_setArgNullFuncError(__func__);
+    }
+    callback(NULL, arg);
+    return;
+  }
+  struct decryptJob* job = secAlloc(sizeof(struct decryptJob));
+  job->shortname         = oidc_strcopy(shortname);
+  job->password          = password;
+  job->callback          = callback;
+  job->arg               = arg;
+  _decryptJob(job);
+}
+
+char* getDefaultAccountConfigForIssuer(const char* issuer_url) {
+  if (negativeCache_contains(NEGATIVE_CACHE_ISSUER, issuer_url)) {
+    return NULL;
+  }
+  char* shortname = issuerIndex_getDefaultAccount(issuer_url);
+  if (shortname == NULL) {
+    negativeCache_add(NEGATIVE_CACHE_ISSUER, issuer_url);
+  }
   return shortname;
 }
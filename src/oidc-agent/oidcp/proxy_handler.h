@@ -1,15 +1,31 @@
 #ifndef OIDC_PROXY_HANDLER_H
 #define OIDC_PROXY_HANDLER_H
 
+#include "utils/json.h"
 #include "utils/oidc_error.h"
 
-oidc_error_t updateRefreshToken(const char* shortname,
+#include <stddef.h>
+
+typedef void (*accountCallback)(const char* account, void* arg);
+
+oidc_error_t updateRefreshToken(const char* shortname, size_t slot,
                                 const char* refresh_token);
 oidc_error_t updateRefreshTokenUsingPassword(const char* shortname,
+                                             size_t      slot,
                                              const char* refresh_token,
                                              const char* password);
+void         setRefreshTokenInConfig(cJSON* config, size_t slot,
+                                     const char* refresh_token);
 char*        getAutoloadConfig(const char* shortname, const char* issuer,
                                const char* application_hint);
+char*        getAutoloadAccount(const char* shortname, const char* issuer,
+                                const char* application_hint);
+char*        getReloadAccount(const char* shortname);
+void         getAutoloadAccountAsync(const char* shortname, const char* issuer,
+                                     const char*     application_hint,
+                                     accountCallback callback, void* arg);
+void         getReloadAccountAsync(const char* shortname,
+                                   accountCallback callback, void* arg);
 char*        getDefaultAccountConfigForIssuer(const char* issuer_url);
 
 #endif  // OIDC_PROXY_HANDLER_H
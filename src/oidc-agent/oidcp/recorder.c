@@ -0,0 +1,116 @@
+#include "recorder.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * With --record the agent appends one JSON line for every request answered by
+ * oidcd to a file, so that the shape of real traffic can be replayed against
+ * a test agent with test/bench/replay.c. A line holds the request type, the
+ * time since the recording started, the sizes of request and response, the
+ * latency and the status. No secrets are recorded: account short names,
+ * issuers and scopes are replaced by hashes keyed with a random key that is
+ * never written, so equal values can be recognized within a recording, but
+ * the values cannot be guessed from it.
+ */
+
+static FILE*         recording = NULL;
+static double        start     = 0;
+static unsigned char hashKey[crypto_shorthash_KEYBYTES];
+
+/**
+ * @brief opens the file @p path for appending records
+ */
+oidc_error_t recorder_open(const char* path) {
+  if (!strValid(path)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  recording = fopen(path, "a");
+  if (recording == NULL) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  randombytes_buf(hashKey, sizeof(hashKey));
+  start = metrics_now();
+  return OIDC_SUCCESS;
+}
+
+int recorder_isEnabled() { return recording != NULL; }
+
+static void _addHash(cJSON* record, const char* key, const char* value) {
+  if (!strValid(value)) {
+    return;
+  }
+  unsigned char hash[crypto_shorthash_BYTES];
+  char          hex[2 * crypto_shorthash_BYTES + 1];
+  crypto_shorthash(hash, (const unsigned char*)value, strlen(value), hashKey);
+  sodium_bin2hex(hex, sizeof(hex), hash, sizeof(hash));
+  jsonAddStringValue(record, key, hex);
+}
+
+/**
+ * @brief records a request that was answered by oidcd
+ * @param request the request as sent by the client
+ * @param response the response of oidcd
+ * @param received the time the request was received as given by
+ * @c metrics_now
+ */
+void recorder_record(const char* request, const char* response,
+                     double received) {
+  if (recording == NULL || request == NULL) {
+    return;
+  }
+  const double now  = metrics_now();
+  cJSON*       json = stringToJson(request);
+  if (json == NULL) {
+    return;
+  }
+  const char* type = cJSON_GetStringValue(
+      cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_REQUEST));
+  const cJSON* min_valid =
+      cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_MINVALID);
+  cJSON* record = cJSON_CreateObject();
+  jsonAddNumberValue(record, "t", (long)((received - start) * 1e3) / 1e3);
+  jsonAddStringValue(record, "type", type ?: "unknown");
+  _addHash(record, "account",
+           cJSON_GetStringValue(
+               cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_SHORTNAME)));
+  _addHash(record, "issuer",
+           cJSON_GetStringValue(
+               cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_ISSUERURL)));
+  _addHash(record, "scope",
+           cJSON_GetStringValue(
+               cJSON_GetObjectItemCaseSensitive(json, OIDC_KEY_SCOPE)));
+  if (cJSON_IsNumber(min_valid)) {
+    jsonAddNumberValue(record, "min_valid", min_valid->valuedouble);
+  }
+  jsonAddNumberValue(record, "size", strlen(request));
+  jsonAddNumberValue(record, "response_size", response ? strlen(response) : 0);
+  jsonAddNumberValue(record, "latency_ms",
+                     (long)((now - received) * 1e6) / 1e3);
+  char* status = response ? getJSONValueFromString(response, IPC_KEY_STATUS)
+                          : NULL;
+  jsonAddStringValue(record, "status", status ?: "none");
+  secFree(status);
+  secFreeJson(json);
+  char* line = jsonToStringUnformatted(record);
+  secFreeJson(record);
+  fprintf(recording, "%s\n", line);
+  fflush(recording);
+  secFree(line);
+}
+
+void recorder_close() {
+  if (recording != NULL) {
+    fclose(recording);
+    recording = NULL;
+  }
+}
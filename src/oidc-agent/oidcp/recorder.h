@@ -0,0 +1,12 @@
+#ifndef OIDC_RECORDER_H
+#define OIDC_RECORDER_H
+
+#include "utils/oidc_error.h"
+
+oidc_error_t recorder_open(const char* path);
+int          recorder_isEnabled();
+void         recorder_record(const char* request, const char* response,
+                             double received);
+void         recorder_close();
+
+#endif  // OIDC_RECORDER_H
@@ -0,0 +1,88 @@
+#include "recovery.h"
+#include "defines/agent_values.h"
+#include "defines/settings.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+
+#include <time.h>
+
+/**
+ * If an oidcd worker dies, oidcp starts it again instead of exiting. The
+ * restarted worker takes over the accounts that were loaded in the crashed
+ * one: every worker pushes its loaded accounts to oidcp whenever they change
+ * (see oidcd/snapshot.c) and oidcp keeps the last copy memory encrypted. The
+ * copies are dropped when the agent is locked. A worker that crashes more
+ * than @c RECOVERY_MAX_RESTARTS times within @c RECOVERY_RESTART_WINDOW
+ * seconds is not restarted again.
+ */
+
+static char*  sealed[AGENT_MAX_WORKERS];
+static time_t restarts[AGENT_MAX_WORKERS][RECOVERY_MAX_RESTARTS];
+
+/**
+ * @brief keeps the accounts pushed by a worker
+ * @param accounts the json array of the exported accounts
+ */
+void recovery_store(size_t worker, const char* accounts) {
+  if (worker >= AGENT_MAX_WORKERS) {
+    return;
+  }
+  secFree(sealed[worker]);
+  sealed[worker] = memoryEncrypt(accounts);
+}
+
+void recovery_clear() {
+  for (size_t i = 0; i < AGENT_MAX_WORKERS; i++) {
+    secFree(sealed[i]);
+    sealed[i] = NULL;
+  }
+}
+
+/**
+ * @brief returns the handover for a restarted worker in the format of
+ * @c snapshot_import
+ * @return a pointer to the json string or @c NULL if the worker had no
+ * accounts; has to be freed after usage
+ */
+char* recovery_handoverFor(size_t worker) {
+  if (worker >= AGENT_MAX_WORKERS || sealed[worker] == NULL) {
+    return NULL;
+  }
+  char*  accounts_str = memoryDecrypt(sealed[worker]);
+  cJSON* accounts     = stringToJson(accounts_str);
+  secFree(accounts_str);
+  if (accounts == NULL) {
+    return NULL;
+  }
+  cJSON* workers = cJSON_CreateArray();
+  for (size_t i = 0; i < worker; i++) {
+    cJSON_AddItemToArray(workers, cJSON_CreateArray());
+  }
+  cJSON_AddItemToArray(workers, accounts);
+  char* handover = jsonToStringUnformatted(workers);
+  secFreeJson(workers);
+  return handover;
+}
+
+/**
+ * @brief checks if a crashed worker may be restarted and counts the restart
+ * @return @c 1 if it may be restarted, @c 0 if it crashed too often
+ */
+int recovery_mayRestart(size_t worker) {
+  if (worker >= AGENT_MAX_WORKERS) {
+    return 0;
+  }
+  time_t  now    = time(NULL);
+  time_t* oldest = &restarts[worker][0];
+  for (size_t i = 1; i < RECOVERY_MAX_RESTARTS; i++) {
+    if (restarts[worker][i] < *oldest) {
+      oldest = &restarts[worker][i];
+    }
+  }
+  if (*oldest && now - *oldest < RECOVERY_RESTART_WINDOW) {
+    return 0;
+  }
+  *oldest = now;
+  return 1;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDC_RECOVERY_H
+#define OIDC_RECOVERY_H
+
+#include <stddef.h>
+
+void  recovery_store(size_t worker, const char* accounts);
+void  recovery_clear();
+char* recovery_handoverFor(size_t worker);
+int   recovery_mayRestart(size_t worker);
+
+#endif  // OIDC_RECOVERY_H
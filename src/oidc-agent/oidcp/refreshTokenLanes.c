@@ -0,0 +1,241 @@
+#include "refreshTokenLanes.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "oidc-agent/oidcp/workers.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+/**
+ * The lanes of the accounts with a refresh token pool (see
+ * oidcd/refreshTokenPool.c). When the owner of an account loads it, it hands
+ * over its pool and oidcp loads lane k into worker (owner + k) % workers, so
+ * there is at most one lane per worker. Requests for scoped tokens are
+ * spread over the account and its lanes by their scope and audience, so that
+ * the same scopes always use the same refresh token; all other requests go
+ * to the owner. A lane only gets requests once its worker pushed it with its
+ * loaded accounts, and all lanes are dropped as soon as the account is not
+ * loaded in its owner anymore. After an upgrade the lanes are learned from
+ * the pushed accounts.
+ */
+
+struct rtLanes {
+  char*         shortname;
+  size_t        owner;
+  size_t        count;  // the lanes have the slots 1 to count
+  unsigned char loaded[AGENT_MAX_WORKERS];  // by slot
+};
+
+static list_t* lanes = NULL;
+
+static void _secFreeLanes(struct rtLanes* l) {
+  secFree(l->shortname);
+  secFree(l);
+}
+
+static int _matchLanes(const char* shortname, const struct rtLanes* l) {
+  return strequal(shortname, l->shortname);
+}
+
+static struct rtLanes* _find(const char* shortname) {
+  list_node_t* node = shortname ? findInList(lanes, shortname) : NULL;
+  return node ? node->val : NULL;
+}
+
+static struct rtLanes* _add(const char* shortname, size_t owner) {
+  if (lanes == NULL) {
+    lanes        = list_new();
+    lanes->free  = (void (*)(void*))_secFreeLanes;
+    lanes->match = (matchFunction)_matchLanes;
+  }
+  struct rtLanes* l = _find(shortname);
+  if (l == NULL) {
+    l            = secAlloc(sizeof(struct rtLanes));
+    l->shortname = oidc_strcopy(shortname);
+    list_rpush(lanes, list_node_new(l));
+  }
+  l->owner = owner;
+  return l;
+}
+
+static size_t _workerOf(const struct rtLanes* l, size_t slot) {
+  return (l->owner + slot) % workers_count();
+}
+
+static void _notify(size_t worker, const char* msg) {
+  if (ipc_writeToPipe(ipc_tagPipe(workers_get(worker), IPC_TAG_NOTIFY), "%s",
+                      msg) != OIDC_SUCCESS) {
+    agent_log(ERROR, "Could not notify oidcd about refresh token lanes: %s",
+              oidc_serror());
+  }
+}
+
+/**
+ * @brief tells the workers of the lanes of @p l to drop them
+ */
+static void _dropLanes(struct rtLanes* l) {
+  char* msg = oidc_sprintf(INT_NOTIFY_RTPOOL_DROP, l->shortname);
+  for (size_t slot = 1; slot <= l->count; slot++) {
+    _notify(_workerOf(l, slot), msg);
+  }
+  secFree(msg);
+  l->count = 0;
+  memset(l->loaded, 0, sizeof(l->loaded));
+}
+
+/**
+ * @brief loads the lanes a worker handed over into the other workers
+ * Lanes that were loaded before for the account are dropped. Lanes beyond the
+ * number of workers are not loaded.
+ * @param notification the notification of the owner with the lanes
+ * @param worker the index of the owner
+ */
+void rtLanes_handOver(const char* notification, size_t worker) {
+  cJSON*       json = stringToJson(notification);
+  const cJSON* name = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_SHORTNAME);
+  const cJSON* accounts =
+      cJSON_GetObjectItemCaseSensitive(json, INT_IPC_KEY_ACCOUNTS);
+  // lanes are placed relative to the worker requests are routed to
+  if (!cJSON_IsString(name) || !cJSON_IsArray(accounts) ||
+      workers_count() <= 1 ||
+      worker != workers_forShortname(name->valuestring)) {
+    secFreeJson(json);
+    return;
+  }
+  struct rtLanes* l = _find(name->valuestring);
+  if (l) {
+    _dropLanes(l);
+  }
+  l           = _add(name->valuestring, worker);
+  size_t slot = 0;
+  cJSON* lane;
+  cJSON_ArrayForEach(lane, accounts) {
+    if (++slot >= workers_count()) {
+      break;
+    }
+    jsonAddStringValue(lane, IPC_KEY_REQUEST, INT_NOTIFY_VALUE_RTPOOL_LANE);
+    char* msg = jsonToStringUnformatted(lane);
+    _notify(_workerOf(l, slot), msg);
+    secFree(msg);
+    l->count = slot;
+  }
+  agent_log(DEBUG, "Handed over %lu refresh token lanes of '%s'", l->count,
+            l->shortname);
+  secFreeJson(json);
+}
+
+static size_t _slotOf(const cJSON* entry, const char** shortname) {
+  const cJSON* config = cJSON_GetObjectItemCaseSensitive(entry, IPC_KEY_CONFIG);
+  const cJSON* name =
+      cJSON_GetObjectItemCaseSensitive(config, AGENT_KEY_SHORTNAME);
+  const cJSON* slot =
+      cJSON_GetObjectItemCaseSensitive(config, AGENT_KEY_REFRESHTOKENSLOT);
+  *shortname = cJSON_IsString(name) ? name->valuestring : NULL;
+  return cJSON_IsNumber(slot) && slot->valuedouble > 0
+             ? (size_t)slot->valuedouble
+             : 0;
+}
+
+static int _contains(const cJSON* entries, const char* shortname,
+                     size_t slot) {
+  const cJSON* entry;
+  cJSON_ArrayForEach(entry, entries) {
+    const char* name;
+    if (_slotOf(entry, &name) == slot && strequal(name, shortname)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief updates the lanes from the accounts a worker pushed
+ * A lane a worker loaded is used from now on; if the owner does not have the
+ * account loaded anymore, all lanes of the account are dropped.
+ * @param accounts the json array of the entries the worker pushed; see
+ * oidcd/snapshot.c
+ */
+void rtLanes_store(size_t worker, const char* accounts) {
+  if (workers_count() <= 1) {
+    return;
+  }
+  cJSON* entries = stringToJson(accounts);
+  if (!cJSON_IsArray(entries)) {
+    secFreeJson(entries);
+    return;
+  }
+  const cJSON* entry;
+  cJSON_ArrayForEach(entry, entries) {  // e.g. handed over by an upgrade
+    const char*  name;
+    const size_t slot = _slotOf(entry, &name);
+    if (slot == 0 || name == NULL || slot >= workers_count()) {
+      continue;
+    }
+    struct rtLanes* l = _find(name) ?: _add(name, workers_forShortname(name));
+    if (_workerOf(l, slot) == worker && slot > l->count) {
+      l->count = slot;
+    }
+  }
+  if (lanes == NULL) {
+    secFreeJson(entries);
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(lanes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct rtLanes* l = node->val;
+    if (l->owner == worker && !_contains(entries, l->shortname, 0)) {
+      agent_log(DEBUG, "Dropping refresh token lanes of '%s'", l->shortname);
+      _dropLanes(l);
+      list_remove(lanes, node);
+      continue;
+    }
+    for (size_t slot = 1; slot <= l->count; slot++) {
+      if (_workerOf(l, slot) == worker) {
+        l->loaded[slot] = _contains(entries, l->shortname, slot);
+      }
+    }
+  }
+  list_iterator_destroy(it);
+  secFreeJson(entries);
+}
+
+/**
+ * @brief returns the worker of the lane a request for scoped tokens is sent to
+ * @param key a hash of the scope and audience of the request
+ * @param owner the worker that owns the account
+ * @return the index of the worker; @p owner if the account has no lanes or
+ * the request is handled by the account itself
+ */
+size_t rtLanes_workerFor(const char* shortname, unsigned long key,
+                         size_t owner) {
+  const struct rtLanes* l = _find(shortname);
+  if (l == NULL || l->owner != owner || l->count == 0) {
+    return owner;
+  }
+  const size_t slot = key % (l->count + 1);
+  return slot && l->loaded[slot] ? _workerOf(l, slot) : owner;
+}
+
+/**
+ * @brief drops the lanes of an account, because it is removed
+ */
+void rtLanes_drop(const char* shortname) {
+  list_node_t* node = shortname ? findInList(lanes, shortname) : NULL;
+  if (node) {
+    _dropLanes(node->val);
+    list_remove(lanes, node);
+  }
+}
+
+/**
+ * @brief forgets all lanes, because all accounts are removed
+ */
+void rtLanes_clear() {
+  secFreeList(lanes);
+  lanes = NULL;
+}
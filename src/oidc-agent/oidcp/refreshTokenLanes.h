@@ -0,0 +1,13 @@
+#ifndef OIDCP_REFRESH_TOKEN_LANES_H
+#define OIDCP_REFRESH_TOKEN_LANES_H
+
+#include <stddef.h>
+
+void   rtLanes_handOver(const char* notification, size_t worker);
+void   rtLanes_store(size_t worker, const char* accounts);
+size_t rtLanes_workerFor(const char* shortname, unsigned long key,
+                         size_t owner);
+void   rtLanes_drop(const char* shortname);
+void   rtLanes_clear();
+
+#endif  // OIDCP_REFRESH_TOKEN_LANES_H
@@ -0,0 +1,166 @@
+#include "refreshTokenQueue.h"
+#include "configWatcher.h"
+#include "proxy_handler.h"
+#include "utils/agentLogger.h"
+#include "utils/file_io/file_io.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/timerWheel.h"
+#include "wrapper/list.h"
+
+/**
+ * Refresh tokens rotated by the OpenID Provider are not written to the account
+ * file immediately. They are queued per account and written after
+ * @c RT_QUEUE_DELAY seconds, so the client gets its access token first and
+ * several rotations for the same account result in a single write. The
+ * tokens of the refresh token pool of an account are queued per slot.
+ */
+
+struct rtUpdate {
+  char*  shortname;
+  size_t slot;
+  char*  refresh_token;
+  time_t due;
+};
+
+static list_t*                  queue      = NULL;
+static struct timerWheel_timer* flushTimer = NULL;
+
+static void _flushDue(void* arg);
+
+/**
+ * @brief sets the timer for the first queued update, which is due first,
+ * since updates are appended
+ */
+static void _scheduleFlush() {
+  if (flushTimer == NULL && queue && queue->head) {
+    flushTimer = timerWheel_add(((struct rtUpdate*)queue->head->val)->due,
+                                _flushDue, NULL);
+  }
+}
+
+static void _secFreeRtUpdate(struct rtUpdate* u) {
+  if (u == NULL) {
+    return;
+  }
+  secFree(u->shortname);
+  secFree(u->refresh_token);
+  secFree(u);
+}
+
+static int _matchRtUpdate(const struct rtUpdate* key,
+                          const struct rtUpdate* u) {
+  return strequal(key->shortname, u->shortname) && key->slot == u->slot;
+}
+
+/**
+ * @brief queues a refresh token update for an account
+ * If an update for this account and slot is already queued, its refresh token
+ * is replaced; the update is still written at the original time.
+ * @param slot the slot in the refresh token pool; @c 0 for the refresh token
+ * itself
+ */
+void rtQueue_add(const char* shortname, size_t slot,
+                 const char* refresh_token) {
+  if (shortname == NULL || refresh_token == NULL) {
+    return;
+  }
+  if (queue == NULL) {
+    queue        = list_new();
+    queue->free  = (void (*)(void*))_secFreeRtUpdate;
+    queue->match = (matchFunction)_matchRtUpdate;
+  }
+  struct rtUpdate key  = {.shortname = (char*)shortname, .slot = slot};
+  list_node_t*    node = findInList(queue, &key);
+  if (node) {
+    struct rtUpdate* u = node->val;
+    agent_log(DEBUG, "Coalescing refresh token update for '%s'", shortname);
+    secFree(u->refresh_token);
+    u->refresh_token = oidc_strcopy(refresh_token);
+    return;
+  }
+  struct rtUpdate* u = secAlloc(sizeof(struct rtUpdate));
+  u->shortname       = oidc_strcopy(shortname);
+  u->slot            = slot;
+  u->refresh_token   = oidc_strcopy(refresh_token);
+  u->due             = time(NULL) + RT_QUEUE_DELAY;
+  list_rpush(queue, list_node_new(u));
+  _scheduleFlush();
+}
+
+static int _write(const struct rtUpdate* u) {
+  if (updateRefreshToken(u->shortname, u->slot, u->refresh_token) ==
+      OIDC_SUCCESS) {
+    agent_log(DEBUG, "Successfully updated refresh token for '%s'",
+              u->shortname);
+    return 1;
+  }
+  agent_log(
+      WARNING,
+      "WARNING: Received new refresh token from OIDC Provider. It's most "
+      "likely that the old one was therefore revoked. Updating the config "
+      "file for '%s' failed. You may want to revoke the new refresh token or "
+      "pass it to oidc-gen --rt",
+      u->shortname);
+  return 0;
+}
+
+static void _commitBatch() {
+  if (fileIO_commitBatch() != OIDC_SUCCESS) {
+    agent_log(WARNING, "Could not write all updated refresh tokens: %s",
+              oidc_serror());
+  }
+}
+
+static void _flush(time_t until) {
+  // The account files written by one flush are synced together
+  fileIO_beginBatch();
+  list_t* written = list_new();
+  written->free   = _secFree;
+  written->match  = (matchFunction)strequal;
+  while (queue && queue->head) {
+    struct rtUpdate* u = queue->head->val;
+    if (until && u->due > until) {
+      break;
+    }
+    if (findInList(written, u->shortname)) {
+      // another slot of the same account; within a batch the file would still
+      // be read without the pending write, which this write then replaces
+      _commitBatch();
+      fileIO_beginBatch();
+    }
+    // Detach before writing; the password lookup might prompt and the queue
+    // might be flushed again meanwhile
+    list_node_t* node = list_lpop(queue);
+    if (_write(u)) {
+      list_addStringIfNotFound(written, u->shortname);
+    }
+    _secFreeRtUpdate(u);
+    LIST_FREE(node);
+  }
+  _commitBatch();
+  // Our own writes must not be reported as changed configs
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(written, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    configWatcher_noteWrite(node->val);
+  }
+  list_iterator_destroy(it);
+  secFreeList(written);
+}
+
+/**
+ * @brief writes all queued updates that are due; called by the timer wheel
+ */
+static void _flushDue(void* arg) {
+  (void)arg;
+  flushTimer = NULL;
+  _flush(time(NULL));
+  _scheduleFlush();
+}
+
+/**
+ * @brief writes all queued updates
+ */
+void rtQueue_flush() { _flush(0); }
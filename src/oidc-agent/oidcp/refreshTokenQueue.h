@@ -0,0 +1,15 @@
+#ifndef OIDC_REFRESHTOKEN_QUEUE_H
+#define OIDC_REFRESHTOKEN_QUEUE_H
+
+#include <stddef.h>
+#include <time.h>
+
+// Seconds a rotated refresh token is kept before it is written, so that
+// further rotations for the same account are coalesced into one write
+#define RT_QUEUE_DELAY 2
+
+void rtQueue_add(const char* shortname, size_t slot,
+                 const char* refresh_token);
+void rtQueue_flush();
+
+#endif  // OIDC_REFRESHTOKEN_QUEUE_H
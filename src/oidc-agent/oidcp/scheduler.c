@@ -0,0 +1,211 @@
+#include "scheduler.h"
+#include "defines/agent_values.h"
+#include "defines/settings.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <time.h>
+
+/**
+ * Forced token refreshes (@c min_valid_period of @c FORCE_NEW_TOKEN) always
+ * reach the provider, so oidcp schedules them per client, i.e. per peer uid
+ * and application hint and the socket it connected to: Every client has a
+ * token bucket of @c SCHEDULER_FORCED_BURST refreshes that is refilled with
+ * @c SCHEDULER_FORCED_PER_MINUTE, or with the rate of its socket given with
+ * --listen; requests beyond it are rejected. A worker
+ * gets at most @c SCHEDULER_MAX_FORCED_INFLIGHT forced refreshes at a time;
+ * the others wait in a queue per client and the queues are served in round
+ * robin, so a client looping over forced refreshes cannot starve the others.
+ * All other requests, including the ones answered from the token cache, are
+ * not scheduled and pass immediately.
+ */
+
+#define SCHEDULER_MAX_CLIENTS 256
+
+struct clientClass {
+  uid_t        uid;
+  char*        application_hint;
+  size_t       listener;  // 0 for the socket of the agent itself
+  unsigned int per_minute;
+  double       burst;
+  double       tokens;
+  time_t       refilled;
+  list_t*      queue;  // of struct scheduledRequest*
+};
+
+static list_t* classes                     = NULL;
+static size_t  nextClass                   = 0;  // round robin position
+static size_t  inflight[AGENT_MAX_WORKERS] = {0};
+static size_t  queued                      = 0;
+
+void scheduler_freeRequest(struct scheduledRequest* r) {
+  if (r == NULL) {
+    return;
+  }
+  secFree(r->msg);
+  secFree(r);
+}
+
+static void _secFreeClientClass(struct clientClass* c) {
+  secFree(c->application_hint);
+  secFreeList(c->queue);
+  secFree(c);
+}
+
+static int _isIdle(const struct clientClass* c, time_t now) {
+  return c->queue->len == 0 &&
+         c->tokens + (now - c->refilled) * c->per_minute / 60.0 >= c->burst;
+}
+
+/**
+ * @brief removes clients that have nothing queued and a full bucket, so that
+ * the number of clients stays bounded
+ */
+static void _pruneIdleClasses(time_t now) {
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(classes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (_isIdle(node->val, now)) {
+      list_remove(classes, node);
+    }
+  }
+  list_iterator_destroy(it);
+  nextClass = 0;
+}
+
+static struct clientClass* _findOrAddClass(uid_t        uid,
+                                           const char*  application_hint,
+                                           size_t       listener,
+                                           unsigned int per_minute,
+                                           time_t       now) {
+  if (classes == NULL) {
+    classes       = list_new();
+    classes->free = (void (*)(void*))_secFreeClientClass;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(classes, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct clientClass* c = node->val;
+    if (c->uid == uid && c->listener == listener &&
+        strequal(c->application_hint, application_hint)) {
+      break;
+    }
+  }
+  list_iterator_destroy(it);
+  if (node) {
+    return node->val;
+  }
+  if (classes->len >= SCHEDULER_MAX_CLIENTS) {
+    _pruneIdleClasses(now);
+  }
+  struct clientClass* c = secAlloc(sizeof(struct clientClass));
+  c->uid                = uid;
+  c->application_hint   = oidc_strcopy(application_hint);
+  c->listener           = listener;
+  c->per_minute         = per_minute;
+  c->burst              = per_minute < SCHEDULER_FORCED_BURST
+                              ? per_minute
+                              : SCHEDULER_FORCED_BURST;
+  c->tokens             = c->burst;
+  c->refilled           = now;
+  c->queue              = list_new();
+  c->queue->free        = (void (*)(void*))scheduler_freeRequest;
+  list_rpush(classes, list_node_new(c));
+  return c;
+}
+
+static int _takeToken(struct clientClass* c, time_t now) {
+  c->tokens += (now - c->refilled) * c->per_minute / 60.0;
+  if (c->tokens > c->burst) {
+    c->tokens = c->burst;
+  }
+  c->refilled = now;
+  if (c->tokens < 1) {
+    return 0;
+  }
+  c->tokens -= 1;
+  return 1;
+}
+
+/**
+ * @brief queues a forced token refresh of a client
+ * @param uid the user id of the client, @c -1 if it is unknown
+ * @param listener the socket the client connected to, @c 0 for the socket of
+ * the agent itself
+ * @param per_minute the forced refreshes per minute allowed on that socket
+ * @param worker the worker that handles the request
+ * @return @c OIDC_SUCCESS if the request was queued; the connection is then
+ * owned by the queue until it is returned by @c scheduler_next. Otherwise
+ * @c OIDC_ERATELIMIT if the client exceeded its forced refreshes.
+ */
+oidc_error_t scheduler_enqueue(uid_t uid, const char* application_hint,
+                               size_t listener, unsigned int per_minute,
+                               struct connection* con, const char* msg,
+                               size_t worker) {
+  time_t              now = time(NULL);
+  const char*         hint = strValid(application_hint) ? application_hint
+                                                        : NULL;
+  struct clientClass* c =
+      _findOrAddClass(uid, hint, listener, per_minute, now);
+  if (!_takeToken(c, now)) {
+    agent_log(NOTICE, "Rejecting forced refresh of uid %ld (%s): rate limit",
+              (long)uid, hint ?: "unknown application");
+    oidc_errno = OIDC_ERATELIMIT;
+    return oidc_errno;
+  }
+  struct scheduledRequest* r = secAlloc(sizeof(struct scheduledRequest));
+  r->con                     = con;
+  r->msg                     = oidc_strcopy(msg);
+  r->worker                  = worker;
+  list_rpush(c->queue, list_node_new(r));
+  queued++;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the next queued request whose worker has room for it, taking
+ * the clients in round robin
+ * @return the request or @c NULL if none can be sent now; it has to be freed
+ * with @c scheduler_freeRequest after it was sent
+ */
+struct scheduledRequest* scheduler_next() {
+  if (queued == 0) {
+    return NULL;
+  }
+  for (size_t i = 0; i < classes->len; i++) {
+    size_t pos = (nextClass + i) % classes->len;
+    struct clientClass* c = list_at(classes, pos)->val;
+    if (c->queue->len == 0) {
+      continue;
+    }
+    struct scheduledRequest* r = c->queue->head->val;
+    if (inflight[r->worker] >= SCHEDULER_MAX_FORCED_INFLIGHT) {
+      continue;
+    }
+    list_node_t* node = list_lpop(c->queue);
+    LIST_FREE(node);
+    queued--;
+    inflight[r->worker]++;
+    nextClass = (pos + 1) % classes->len;
+    return r;
+  }
+  return NULL;
+}
+
+/**
+ * @brief frees the place of a forced refresh of @p worker after it was
+ * answered
+ */
+void scheduler_done(size_t worker) {
+  if (worker < AGENT_MAX_WORKERS && inflight[worker] > 0) {
+    inflight[worker]--;
+  }
+}
+
+/**
+ * @brief returns the number of queued requests
+ */
+size_t scheduler_queued() { return queued; }
@@ -0,0 +1,28 @@
+#ifndef OIDC_SCHEDULER_H
+#define OIDC_SCHEDULER_H
+
+#include "ipc/connection.h"
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * A forced token refresh that waits in oidcp until its worker has room for it
+ */
+struct scheduledRequest {
+  struct connection* con;
+  char*              msg;
+  size_t             worker;
+};
+
+oidc_error_t scheduler_enqueue(uid_t uid, const char* application_hint,
+                               size_t listener, unsigned int per_minute,
+                               struct connection* con, const char* msg,
+                               size_t worker);
+struct scheduledRequest* scheduler_next();
+void                     scheduler_done(size_t worker);
+void   scheduler_freeRequest(struct scheduledRequest* r);
+size_t scheduler_queued();
+
+#endif  // OIDC_SCHEDULER_H
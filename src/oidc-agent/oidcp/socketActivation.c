@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200112L
+#include "socketActivation.h"
+#include "utils/agentLogger.h"
+#include "utils/stringUtils.h"
+
+#ifdef __APPLE__
+#include <launch.h>
+#endif
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * The agent can be started by the service manager when the first client
+ * connects to its socket, instead of being started with the session. The
+ * socket is then created by systemd (see oidc-agent.socket) or launchd (see
+ * the launchd job of the agent) and passed to oidcp, which does not create its
+ * own socket and does not daemonize.
+ */
+
+#ifdef __APPLE__
+static int _getLaunchdSocket() {
+  int*   fds = NULL;
+  size_t cnt = 0;
+  if (launch_activate_socket(LAUNCHD_SOCKET_NAME, &fds, &cnt) != 0 ||
+      cnt == 0) {
+    free(fds);
+    return -1;  // not started by launchd
+  }
+  int sock = fds[0];
+  for (size_t i = 1; i < cnt; i++) {
+    close(fds[i]);
+  }
+  free(fds);
+  return sock;
+}
+#endif
+
+static int _getSystemdSocket() {
+  const char* pid_str = getenv("LISTEN_PID");
+  const char* fds_str = getenv("LISTEN_FDS");
+  if (pid_str == NULL || fds_str == NULL ||
+      strToULong(pid_str) != (unsigned long)getpid()) {
+    return -1;
+  }
+  unsigned long fds = strToULong(fds_str);
+  // the variables must not be passed on to oidcd
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  unsetenv("LISTEN_FDNAMES");
+  if (fds == 0) {
+    return -1;
+  }
+  if (fds > 1) {
+    agent_log(NOTICE, "Using only the first of %lu sockets passed by systemd",
+              fds);
+    for (unsigned long i = 1; i < fds; i++) {
+      close(SD_LISTEN_FDS_START + (int)i);
+    }
+  }
+  return SD_LISTEN_FDS_START;
+}
+
+/**
+ * @brief returns the listening socket passed by the service manager
+ * @return the file descriptor of the socket or @c -1 if the agent was not
+ * started through socket activation
+ */
+int socketActivation_getSocket() {
+  int sock = _getSystemdSocket();
+#ifdef __APPLE__
+  if (sock < 0) {
+    sock = _getLaunchdSocket();
+  }
+#endif
+  if (sock >= 0) {
+    agent_log(DEBUG, "Started through socket activation on fd %d", sock);
+  }
+  return sock;
+}
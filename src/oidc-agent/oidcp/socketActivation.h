@@ -0,0 +1,11 @@
+#ifndef OIDC_SOCKET_ACTIVATION_H
+#define OIDC_SOCKET_ACTIVATION_H
+
+// The first file descriptor passed by systemd
+#define SD_LISTEN_FDS_START 3
+// The name of the socket in the launchd job of the agent
+#define LAUNCHD_SOCKET_NAME "Listeners"
+
+int socketActivation_getSocket();
+
+#endif  // OIDC_SOCKET_ACTIVATION_H
@@ -2,6 +2,8 @@
 #include "start_oidcd.h"
 
 #include "ipc/pipe.h"
+#include "oidc-agent/agent_state.h"
+#include "oidc-agent/oidcp/attach.h"
 #include "oidc-agent/oidcd/oidcd.h"
 #include "utils/agentLogger.h"
 
@@ -12,12 +14,28 @@
 #endif
 #include <unistd.h>
 
-struct ipcPipe startOidcd(const struct arguments* arguments) {
+/**
+ * @brief forks an oidcd process
+ * @param worker the index of the worker, used if multiple oidcd are started
+ * @param started the pipes of the other workers that were started; they are
+ * closed in the new process
+ * @param started_count the number of elements in @p started
+ * @param oidcd_pid set to the pid of the new oidcd
+ * @return the pipes to communicate with the new oidcd
+ */
+struct ipcPipe startOidcd(const struct arguments* arguments,
+                          unsigned char           worker,
+                          const struct ipcPipe* started, size_t started_count,
+                          pid_t* oidcd_pid) {
   struct pipeSet pipes = ipc_pipe_init();
   if (pipes.pipe1.rx == -1) {
     agent_log(ERROR, "could not create pipes");
     exit(EXIT_FAILURE);
   }
+  if (arguments->shm_ipc && ipc_pipe_addRings(&pipes) != OIDC_SUCCESS) {
+    agent_log(ERROR, "could not map shared memory, using pipes: %s",
+              oidc_serror());
+  }
   pid_t ppid_before_fork = getpid();
   pid_t pid              = fork();
   if (pid == -1) {
@@ -38,10 +56,16 @@ struct ipcPipe startOidcd(const struct arguments* arguments) {
       agent_log(ERROR, "Parent died shortly after fork");
       exit(EXIT_FAILURE);
     }
+    for (size_t i = 0; started && i < started_count; i++) {
+      ipc_closePipes(started[i]);
+    }
+    attach_unlock();  // oidcp releases it once its socket listens
     struct ipcPipe childPipes = toClientPipes(pipes);
+    agent_state.worker        = worker;
     oidcd_main(childPipes, arguments);
     exit(EXIT_FAILURE);
   } else {  // parent
+    *oidcd_pid                 = pid;
     struct ipcPipe parentPipes = toServerPipes(pipes);
     return parentPipes;
   }
@@ -3,6 +3,11 @@
 
 #include "oidc-agent/oidc-agent_options.h"
 
-struct ipcPipe startOidcd(const struct arguments* arguments);
+#include <sys/types.h>
+
+struct ipcPipe startOidcd(const struct arguments* arguments,
+                          unsigned char           worker,
+                          const struct ipcPipe* started, size_t started_count,
+                          pid_t* oidcd_pid);
 
 #endif /* OIDCP_START_OIDCD_H */
@@ -0,0 +1,154 @@
+#include "subscriptions.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "ipc/serveripc.h"
+#include "utils/agentLogger.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+/**
+ * Clients that subscribed to an account keep their session connection open;
+ * whenever oidcd obtains a new default access token for that account, it is
+ * pushed to all of them as an access token response. This way a refresh is
+ * distributed once to all waiting clients instead of every client polling the
+ * agent.
+ */
+
+struct subscription {
+  int   sock;
+  char* shortname;
+};
+
+static list_t* subscriptions = NULL;
+
+static void _secFreeSubscription(struct subscription* s) {
+  if (s == NULL) {
+    return;
+  }
+  secFree(s->shortname);
+  secFree(s);
+}
+
+static int _matchSubscription(const struct subscription* a,
+                              const struct subscription* b) {
+  return a->sock == b->sock && strequal(a->shortname, b->shortname);
+}
+
+/**
+ * @brief subscribes the client on session socket @p sock to new access tokens
+ * of the account @p shortname
+ */
+void subscriptions_add(int sock, const char* shortname) {
+  if (subscriptions == NULL) {
+    subscriptions        = list_new();
+    subscriptions->free  = (void (*)(void*))_secFreeSubscription;
+    subscriptions->match = (matchFunction)_matchSubscription;
+  }
+  struct subscription* s = secAlloc(sizeof(struct subscription));
+  s->sock                = sock;
+  s->shortname           = oidc_strcopy(shortname);
+  if (findInList(subscriptions, s)) {
+    _secFreeSubscription(s);
+    return;
+  }
+  agent_log(DEBUG, "Con %d subscribed to '%s'", sock, shortname);
+  list_rpush(subscriptions, list_node_new(s));
+}
+
+/**
+ * @brief writes @p msg to all clients subscribed to @p shortname, or to all
+ * subscribed clients if @p shortname is @c NULL
+ * @param remove whether the subscriptions are removed afterwards; they are
+ * always removed if the client cannot be written to anymore
+ * @return the number of clients @p msg was written to
+ */
+static size_t _push(const char* shortname, const char* msg,
+                    unsigned char remove) {
+  if (subscriptions == NULL) {
+    return 0;
+  }
+  size_t           pushed = 0;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(subscriptions, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    struct subscription* s = node->val;
+    if (shortname != NULL && !strequal(s->shortname, shortname)) {
+      continue;
+    }
+    if (server_ipc_writeMessage(s->sock, msg) == OIDC_SUCCESS) {
+      pushed++;
+    } else {
+      agent_log(DEBUG, "Con %d is gone, removing its subscription", s->sock);
+      remove = 1;
+    }
+    if (remove) {
+      list_remove(subscriptions, node);
+    }
+  }
+  list_iterator_destroy(it);
+  return pushed;
+}
+
+/**
+ * @brief pushes a new access token to the clients subscribed to its account
+ */
+void subscriptions_notify(const char* shortname, const char* access_token,
+                          const char* issuer, unsigned long expires_at) {
+  if (subscriptions == NULL || subscriptions->len == 0 ||
+      !strValid(shortname) || !strValid(access_token)) {
+    return;
+  }
+  char* res = oidc_sprintf(RESPONSE_STATUS_ACCESS, STATUS_SUCCESS,
+                           access_token, issuer ?: "", expires_at);
+  size_t pushed = _push(shortname, res, 0);
+  secFree(res);
+  if (pushed) {
+    agent_log(DEBUG, "Pushed new access token for '%s' to %lu clients",
+              shortname, (unsigned long)pushed);
+  }
+}
+
+/**
+ * @brief ends all subscriptions to @p shortname, e.g. because the account was
+ * removed; the clients receive an error with @p reason
+ */
+void subscriptions_cancelAccount(const char* shortname, const char* reason) {
+  if (shortname == NULL) {
+    return;
+  }
+  char* res = oidc_sprintf(RESPONSE_ERROR, reason);
+  _push(shortname, res, 1);
+  secFree(res);
+}
+
+/**
+ * @brief ends all subscriptions; the clients receive an error with @p reason
+ */
+void subscriptions_cancelAll(const char* reason) {
+  char* res = oidc_sprintf(RESPONSE_ERROR, reason);
+  _push(NULL, res, 1);
+  secFree(res);
+}
+
+/**
+ * @brief removes the subscriptions of a client whose connection was closed
+ */
+void subscriptions_removeSocket(int sock) {
+  if (subscriptions == NULL) {
+    return;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(subscriptions, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (((struct subscription*)node->val)->sock == sock) {
+      list_remove(subscriptions, node);
+    }
+  }
+  list_iterator_destroy(it);
+}
+
+size_t subscriptions_count() {
+  return subscriptions ? subscriptions->len : 0;
+}
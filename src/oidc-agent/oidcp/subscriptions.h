@@ -0,0 +1,14 @@
+#ifndef OIDC_SUBSCRIPTIONS_H
+#define OIDC_SUBSCRIPTIONS_H
+
+#include <stddef.h>
+
+void   subscriptions_add(int sock, const char* shortname);
+void   subscriptions_notify(const char* shortname, const char* access_token,
+                            const char* issuer, unsigned long expires_at);
+void   subscriptions_cancelAccount(const char* shortname, const char* reason);
+void   subscriptions_cancelAll(const char* reason);
+void   subscriptions_removeSocket(int sock);
+size_t subscriptions_count();
+
+#endif  // OIDC_SUBSCRIPTIONS_H
@@ -0,0 +1,119 @@
+#include "tenants.h"
+#include "defines/ipc_values.h"
+#include "ipc/serveripc.h"
+#include "oidc-agent/agent_state.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <libgen.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * With --multi-user a single agent serves all users of a host instead of one
+ * agent per login. Every local user may connect; the user is identified by the
+ * peer credentials of the connection, never by the request. oidcp passes the
+ * user id on to oidcd as the tenant of every request, where every user only
+ * sees the accounts they loaded (see @c accounts_setTenant), while the
+ * connections, the issuer configurations and the https caches of oidcd are
+ * shared. Account configs are still decrypted by oidc-add with the password of
+ * the user, so the agent never gets the keys of the config files.
+ *
+ * Requests that concern the whole agent, e.g. locking it or reading its
+ * metrics, are only allowed for the user running the agent.
+ */
+
+/**
+ * Request types only the user running the agent may send
+ */
+static const char* const ownerRequests[] = {
+    REQUEST_VALUE_FILEREAD, REQUEST_VALUE_FILEREMOVE, REQUEST_VALUE_FILEWRITE,
+    REQUEST_VALUE_LOCK,     REQUEST_VALUE_METRICS,    REQUEST_VALUE_PROFILE,
+    REQUEST_VALUE_REPLICATE, REQUEST_VALUE_STAGE,     REQUEST_VALUE_STATS,
+    REQUEST_VALUE_STATUS,    REQUEST_VALUE_STATUS_JSON, REQUEST_VALUE_UNLOCK,
+    REQUEST_VALUE_UPGRADE,
+};
+
+/**
+ * @brief allows all local users to connect to the socket of the agent
+ * Not needed if the socket was passed by the service manager, which sets its
+ * permissions.
+ */
+oidc_error_t tenants_openSocket(const char* socket_path) {
+  if (!agent_state.multi_user) {
+    return OIDC_SUCCESS;
+  }
+  char* dir = oidc_strcopy(socket_path);
+  int   res = chmod(dirname(dir), 0711) | chmod(socket_path, 0666);
+  secFree(dir);
+  if (res != 0) {
+    agent_log(ERROR, "Could not open the socket to all users: %m");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief checks if the client on @p sock may send a request
+ * @return @c 1 if allowed, @c 0 if the user of the client is unknown, e.g. for
+ * tcp connections, or if the request is only allowed for the user running the
+ * agent
+ */
+int tenants_isAllowed(int sock, const char* request_type) {
+  if (!agent_state.multi_user) {
+    return 1;
+  }
+  uid_t uid;
+  if (server_ipc_getPeerUid(sock, &uid) != 0) {
+    return 0;
+  }
+  if (strequal(request_type, REQUEST_VALUE_SUBSCRIBE)) {
+    return 0;  // subscriptions are not separated by user
+  }
+  if (uid == geteuid()) {
+    return 1;
+  }
+  for (size_t i = 0; i < sizeof(ownerRequests) / sizeof(*ownerRequests);
+       i++) {
+    if (strequal(request_type, ownerRequests[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void _markElement(cJSON* request, uid_t uid) {
+  if (!cJSON_IsObject(request)) {
+    return;
+  }
+  // Set by oidcp only, so that clients cannot act as another user
+  cJSON_DeleteItemFromObjectCaseSensitive(request, IPC_KEY_TENANT);
+  jsonAddNumberValue(request, IPC_KEY_TENANT, uid);
+}
+
+/**
+ * @brief adds the user of the client on @p sock to a request and to the
+ * elements of a batch request, so that oidcd handles it for that user
+ * @return a pointer to the new message or @c NULL if the message is passed on
+ * unchanged; it has to be freed after usage
+ */
+char* tenants_markRequest(int sock, const char* msg) {
+  uid_t uid;
+  if (!agent_state.multi_user || server_ipc_getPeerUid(sock, &uid) != 0) {
+    return NULL;  // rejected by tenants_isAllowed
+  }
+  cJSON* json = stringToJson(msg);
+  if (json == NULL) {
+    return NULL;
+  }
+  _markElement(json, uid);
+  cJSON* requests = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_REQUESTS);
+  cJSON* request;
+  cJSON_ArrayForEach(request, requests) { _markElement(request, uid); }
+  char* marked = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return marked;
+}
@@ -0,0 +1,10 @@
+#ifndef OIDC_TENANTS_H
+#define OIDC_TENANTS_H
+
+#include "utils/oidc_error.h"
+
+oidc_error_t tenants_openSocket(const char* socket_path);
+int          tenants_isAllowed(int sock, const char* request_type);
+char*        tenants_markRequest(int sock, const char* msg);
+
+#endif  // OIDC_TENANTS_H
@@ -0,0 +1,420 @@
+#define _POSIX_C_SOURCE 200809L
+#include "top.h"
+#include "defines/ipc_values.h"
+#include "ipc/cryptCommunicator.h"
+#include "oidc-agent/oidcd/parse_internal.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include "utils/printer.h"
+#include "utils/stringUtils.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * oidc-agent --top connects to the running agent and shows live what it is
+ * doing, similar to top(1). Every interval the metrics, health and status
+ * requests are sent over one session; counters are shown as rates per second
+ * since the previous update. The memory by tag is only known if the agent
+ * was started with --memory-stats.
+ */
+
+#define TOP_CACHE_SERIES(result) \
+  "oidcd_token_cache_total{result=\"" result "\"}"
+
+struct topValue {
+  char*  name;  // a metric series, an account or an application
+  double value;
+};
+
+struct topSample {
+  double  time;
+  list_t* metrics;   // of struct topValue
+  list_t* accounts;  // requests per account, of struct topValue
+  list_t* apps;      // requests per application, of struct topValue
+  cJSON*  health;
+  cJSON*  status;
+};
+
+static volatile sig_atomic_t stopped = 0;
+
+static void _stop(int signo) {
+  (void)signo;
+  stopped = 1;
+}
+
+static void _secFreeTopValue(struct topValue* v) {
+  secFree(v->name);
+  secFree(v);
+}
+
+static int _matchTopValue(const char* name, const struct topValue* v) {
+  return strequal(name, v->name);
+}
+
+static list_t* _newValueList() {
+  list_t* list = list_new();
+  list->free   = (void (*)(void*))_secFreeTopValue;
+  list->match  = (matchFunction)_matchTopValue;
+  return list;
+}
+
+static double _valueOf(list_t* values, const char* name) {
+  list_node_t* node = values ? findInList(values, name) : NULL;
+  return node ? ((struct topValue*)node->val)->value : 0;
+}
+
+/**
+ * @brief adds @p value to the value named @p name
+ */
+static void _addValue(list_t* values, const char* name, double value) {
+  list_node_t* node = findInList(values, name);
+  if (node) {
+    ((struct topValue*)node->val)->value += value;
+    return;
+  }
+  struct topValue* v = secAlloc(sizeof(struct topValue));
+  v->name            = oidc_strcopy(name);
+  v->value           = value;
+  list_rpush(values, list_node_new(v));
+}
+
+/**
+ * @brief parses the Prometheus text format into one value per series
+ */
+static list_t* _parseMetrics(const char* text) {
+  list_t* values = _newValueList();
+  char*   copy   = oidc_strcopy(text);
+  char*   save   = NULL;
+  for (char* line = strtok_r(copy, "\n", &save); line;
+       line       = strtok_r(NULL, "\n", &save)) {
+    char* space = strrchr(line, ' ');
+    if (line[0] == '#' || space == NULL) {
+      continue;
+    }
+    *space = '\0';
+    _addValue(values, line, strtod(space + 1, NULL));
+  }
+  secFree(copy);
+  return values;
+}
+
+/**
+ * @brief returns the label value of a series, e.g. @c x for
+ * <tt>name{label="x"}</tt>
+ * @return a pointer to the value; has to be freed after usage
+ */
+static char* _labelOf(const char* series) {
+  const char* start = strchr(series, '"');
+  const char* end   = strrchr(series, '"');
+  if (start == NULL || end <= start) {
+    return oidc_strcopy("");
+  }
+  return oidc_strncopy(start + 1, end - start - 1);
+}
+
+/**
+ * @brief sums the requests of the account statistics per account and per
+ * application
+ */
+static void _parseAccountStats(struct topSample* sample) {
+  sample->accounts   = _newValueList();
+  sample->apps       = _newValueList();
+  const cJSON* stats = cJSON_GetObjectItemCaseSensitive(sample->status,
+                                                        "account_stats");
+  const cJSON* account;
+  cJSON_ArrayForEach(account, stats) {
+    const char* name = cJSON_GetStringValue(
+        cJSON_GetObjectItemCaseSensitive(account, "account"));
+    const cJSON* requests =
+        cJSON_GetObjectItemCaseSensitive(account, "requests");
+    if (name && cJSON_IsNumber(requests)) {
+      _addValue(sample->accounts, name, requests->valuedouble);
+    }
+    const cJSON* app;
+    cJSON_ArrayForEach(app, cJSON_GetObjectItemCaseSensitive(account,
+                                                             "applications")) {
+      const char* hint = cJSON_GetStringValue(
+          cJSON_GetObjectItemCaseSensitive(app, "application_hint"));
+      requests = cJSON_GetObjectItemCaseSensitive(app, "requests");
+      if (hint && cJSON_IsNumber(requests)) {
+        _addValue(sample->apps, hint, requests->valuedouble);
+      }
+    }
+  }
+}
+
+static void _secFreeSample(struct topSample* sample) {
+  secFreeList(sample->metrics);
+  secFreeList(sample->accounts);
+  secFreeList(sample->apps);
+  secFreeJson(sample->health);
+  secFreeJson(sample->status);
+  *sample = (struct topSample){0};
+}
+
+static char* _request(struct ipc_session* session, const char* request) {
+  char* res = ipc_cryptCommunicateInSession(session, request);
+  return res ? parseForInfo(res) : NULL;
+}
+
+static oidc_error_t _fetch(struct ipc_session* session,
+                           struct topSample*   sample) {
+  char* metrics = _request(session, REQUEST_METRICS);
+  char* health  = metrics ? _request(session, REQUEST_HEALTH) : NULL;
+  char* status  = health ? _request(session, REQUEST_STATUS_JSON) : NULL;
+  if (status == NULL) {
+    secFree(metrics);
+    secFree(health);
+    return oidc_errno;
+  }
+  sample->time    = metrics_now();
+  sample->metrics = _parseMetrics(metrics);
+  sample->health  = stringToJson(health);
+  sample->status  = stringToJson(status);
+  _parseAccountStats(sample);
+  secFree(metrics);
+  secFree(health);
+  secFree(status);
+  return OIDC_SUCCESS;
+}
+
+static double _rate(const struct topSample* cur, const struct topSample* prev,
+                    const char* series) {
+  double delta = _valueOf(cur->metrics, series) -
+                 _valueOf(prev->metrics, series);
+  return delta > 0 ? delta / (cur->time - prev->time) : 0;
+}
+
+static void _printRequests(const struct topSample* cur,
+                           const struct topSample* prev) {
+  const char* prefix = "oidcd_requests_total{";
+  double      total  = 0;
+  for (list_node_t* node = cur->metrics->head; node; node = node->next) {
+    const struct topValue* v = node->val;
+    if (strstarts(v->name, prefix)) {
+      total += _rate(cur, prev, v->name);
+    }
+  }
+  printStdout("Requests/s: %.1f\n", total);
+  for (list_node_t* node = cur->metrics->head; node; node = node->next) {
+    const struct topValue* v = node->val;
+    double rate = strstarts(v->name, prefix) ? _rate(cur, prev, v->name) : 0;
+    if (rate > 0) {
+      char* type = _labelOf(v->name);
+      printStdout("  %-24s %8.1f\n", type, rate);
+      secFree(type);
+    }
+  }
+  double hits = _rate(cur, prev, TOP_CACHE_SERIES(METRIC_LABEL_HIT));
+  double all  = hits + _rate(cur, prev, TOP_CACHE_SERIES(METRIC_LABEL_MISS));
+  if (all > 0) {
+    printStdout("Token cache hit ratio: %.1f%% (%.1f misses/s)\n",
+                100 * hits / all, all - hits);
+  } else {
+    printStdout("Token cache hit ratio: -\n");
+  }
+}
+
+static void _printRefreshLatency(const struct topSample* cur,
+                                 const struct topSample* prev) {
+  printStdout("\nRefreshes per issuer:\n");
+  const char* count = "_refresh_duration_seconds_count{";
+  for (list_node_t* node = cur->metrics->head; node; node = node->next) {
+    const struct topValue* v = node->val;
+    const char*            c = strstr(v->name, count);
+    if (c == NULL) {
+      continue;
+    }
+    char* sum = oidc_sprintf("%.*s_refresh_duration_seconds_sum%s",
+                             (int)(c - v->name), v->name,
+                             c + strlen(count) - 1);
+    double refreshes = v->value - _valueOf(prev->metrics, v->name);
+    double seconds   = _valueOf(cur->metrics, sum) -
+                     _valueOf(prev->metrics, sum);
+    char* issuer = _labelOf(v->name);
+    if (refreshes > 0) {
+      printStdout("  %-50s %6.1f/s %8.0f ms\n", issuer,
+                  refreshes / (cur->time - prev->time),
+                  1000 * seconds / refreshes);
+    } else {
+      printStdout("  %-50s %6.1f/s %8s\n", issuer, 0.0, "-");
+    }
+    secFree(issuer);
+    secFree(sum);
+  }
+}
+
+static double _number(const cJSON* json, const char* key) {
+  const cJSON* item = cJSON_GetObjectItemCaseSensitive(json, key);
+  return cJSON_IsNumber(item) ? item->valuedouble : 0;
+}
+
+static void _printHealth(const struct topSample* cur) {
+  const cJSON* workers =
+      cJSON_GetObjectItemCaseSensitive(cur->health, "workers");
+  double       deferred = 0;
+  const cJSON* worker;
+  cJSON_ArrayForEach(worker, workers) {
+    deferred += _number(worker, "deferred_requests");
+  }
+  printStdout("\nConnections: %.0f of %.0f   Pending: %.0f   Deferred: %.0f"
+              "   Scheduled refreshes: %.0f\n",
+              _number(cur->health, "connections"),
+              _number(cur->health, "connection_limit"),
+              _number(cur->health, "pending_requests"), deferred,
+              _number(cur->health, "scheduled_refreshes"));
+  printStdout("Http requests in flight:");
+  size_t hosts = 0;
+  cJSON_ArrayForEach(worker, workers) {
+    const cJSON* host;
+    cJSON_ArrayForEach(host, cJSON_GetObjectItemCaseSensitive(
+                                 worker, "http_in_flight")) {
+      if (cJSON_IsNumber(host) && host->valuedouble > 0) {
+        printStdout(" %s: %.0f (worker %.0f)", host->string,
+                    host->valuedouble, _number(worker, "worker"));
+        hosts++;
+      }
+    }
+  }
+  printStdout(hosts ? "\n" : " 0\n");
+}
+
+static void _printMemory(const struct topSample* cur) {
+  const cJSON* memory = cJSON_GetObjectItemCaseSensitive(cur->status, "memory");
+  if (!cJSON_IsArray(memory)) {
+    printStdout("\nMemory: start the agent with --memory-stats\n");
+    return;
+  }
+  list_t*      tags = _newValueList();
+  const cJSON* worker;
+  cJSON_ArrayForEach(worker, memory) {
+    const cJSON* tag;
+    cJSON_ArrayForEach(tag, cJSON_GetObjectItemCaseSensitive(worker, "tags")) {
+      _addValue(tags, tag->string, _number(tag, "live_bytes"));
+    }
+  }
+  printStdout("\nMemory (KiB live):");
+  for (list_node_t* node = tags->head; node; node = node->next) {
+    const struct topValue* v = node->val;
+    printStdout(" %s %.0f", v->name, v->value / 1024);
+  }
+  printStdout("\n");
+  secFreeList(tags);
+}
+
+static int _compareTopValues(const void* a, const void* b) {
+  double x = (*(const struct topValue* const*)a)->value;
+  double y = (*(const struct topValue* const*)b)->value;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/**
+ * @brief prints the @c TOP_HOTTEST entries with the most requests per second
+ */
+static void _printHottest(const char* title, list_t* cur, list_t* prev,
+                          double seconds) {
+  printStdout("\n%s (requests/s):\n", title);
+  if (cur->len == 0) {
+    return;
+  }
+  struct topValue* rates = secAlloc(sizeof(struct topValue) * cur->len);
+  struct topValue** sorted =
+      secAlloc(sizeof(struct topValue*) * cur->len);
+  size_t i = 0;
+  for (list_node_t* node = cur->head; node; node = node->next, i++) {
+    const struct topValue* v = node->val;
+    rates[i].name            = v->name;
+    rates[i].value           = (v->value - _valueOf(prev, v->name)) / seconds;
+    sorted[i]                = &rates[i];
+  }
+  qsort(sorted, cur->len, sizeof(*sorted), _compareTopValues);
+  for (i = 0; i < cur->len && i < TOP_HOTTEST && sorted[i]->value > 0; i++) {
+    printStdout("  %-40s %8.1f\n", sorted[i]->name, sorted[i]->value);
+  }
+  secFree(sorted);
+  secFree(rates);
+}
+
+static void _print(const struct topSample* cur, const struct topSample* prev,
+                   unsigned long interval) {
+  if (isatty(STDOUT_FILENO)) {
+    printStdout("\033[H\033[2J");
+  }
+  printStdout("oidc-agent --top: every %lu s, q to quit\n\n", interval);
+  _printRequests(cur, prev);
+  _printRefreshLatency(cur, prev);
+  _printHealth(cur);
+  _printMemory(cur);
+  double seconds = cur->time - prev->time;
+  _printHottest("Hottest accounts", cur->accounts, prev->accounts, seconds);
+  _printHottest("Hottest applications", cur->apps, prev->apps, seconds);
+  fflush(stdout);
+}
+
+/**
+ * @brief waits @p interval seconds or until q is pressed or a signal arrives
+ */
+static void _wait(unsigned long interval) {
+  struct pollfd fd      = {STDIN_FILENO, POLLIN, 0};
+  const int     keys    = isatty(STDIN_FILENO);
+  const double  wake_at = metrics_now() + interval;
+  double        left    = interval;
+  while (!stopped && left > 0) {
+    if (poll(&fd, keys ? 1 : 0, (int)(left * 1000)) > 0) {
+      char c = 0;
+      if (read(STDIN_FILENO, &c, 1) != 1 || c == 'q' || c == 'Q') {
+        stopped = 1;
+      }
+    }
+    left = wake_at - metrics_now();
+  }
+}
+
+/**
+ * @brief shows the live view until q is pressed or the agent is gone
+ * @param interval the seconds between two updates
+ * @return @c OIDC_SUCCESS or the error of a failed request
+ */
+oidc_error_t top_run(unsigned long interval) {
+  struct ipc_session* session = ipc_cryptOpenSession(0);
+  if (session == NULL) {
+    return oidc_errno;
+  }
+  struct termios saved;
+  const int      keys = isatty(STDIN_FILENO) &&
+                   tcgetattr(STDIN_FILENO, &saved) == 0;
+  if (keys) {  // single key presses without echo
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+  }
+  signal(SIGINT, _stop);
+  signal(SIGTERM, _stop);
+  struct topSample prev = {0};
+  struct topSample cur  = {0};
+  oidc_error_t     e    = _fetch(session, &prev);
+  while (e == OIDC_SUCCESS && !stopped) {
+    _wait(interval);
+    if (stopped || (e = _fetch(session, &cur)) != OIDC_SUCCESS) {
+      break;
+    }
+    _print(&cur, &prev, interval);
+    _secFreeSample(&prev);
+    prev = cur;
+    cur  = (struct topSample){0};
+  }
+  _secFreeSample(&prev);
+  if (keys) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+  }
+  ipc_cryptCloseSession(session);
+  oidc_errno = e;
+  return e;
+}
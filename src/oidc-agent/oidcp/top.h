@@ -0,0 +1,13 @@
+#ifndef OIDC_TOP_H
+#define OIDC_TOP_H
+
+#include "utils/oidc_error.h"
+
+// Default seconds between two updates of --top
+#define TOP_DEFAULT_INTERVAL 2
+// Number of accounts and applications shown as the hottest ones
+#define TOP_HOTTEST 5
+
+oidc_error_t top_run(unsigned long interval);
+
+#endif  // OIDC_TOP_H
@@ -1,11 +1,39 @@
 #include "proxy_handler.h"
 
+#include "defines/agent_values.h"
 #include "defines/oidc_values.h"
 #include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
 
+/**
+ * @brief sets a refresh token in an account config
+ * @param slot @c 0 for the refresh token itself, otherwise its slot in the
+ * refresh token pool; a slot beyond the pool is appended to it
+ */
+void setRefreshTokenInConfig(cJSON* config, size_t slot,
+                             const char* refresh_token) {
+  if (slot == 0) {
+    setJSONValue(config, OIDC_KEY_REFRESHTOKEN, refresh_token);
+    return;
+  }
+  cJSON* pool =
+      cJSON_GetObjectItemCaseSensitive(config, AGENT_KEY_REFRESHTOKENPOOL);
+  if (!cJSON_IsArray(pool)) {
+    cJSON_DeleteItemFromObjectCaseSensitive(config,
+                                            AGENT_KEY_REFRESHTOKENPOOL);
+    pool = cJSON_AddArrayToObject(config, AGENT_KEY_REFRESHTOKENPOOL);
+  }
+  if (slot <= (size_t)cJSON_GetArraySize(pool)) {
+    cJSON_ReplaceItemInArray(pool, slot - 1, cJSON_CreateString(refresh_token));
+  } else {
+    cJSON_AddItemToArray(pool, cJSON_CreateString(refresh_token));
+  }
+}
+
 oidc_error_t updateRefreshTokenUsingPassword(const char* shortname,
+                                             size_t      slot,
                                              const char* refresh_token,
                                              const char* password) {
   if (shortname == NULL || password == NULL || refresh_token == NULL) {
@@ -18,11 +46,13 @@ oidc_error_t updateRefreshTokenUsingPassword(const char* shortname,
   }
   cJSON* cjson = stringToJson(file_content);
   secFree(file_content);
-  setJSONValue(cjson, OIDC_KEY_REFRESHTOKEN, refresh_token);
+  setRefreshTokenInConfig(cjson, slot, refresh_token);
   char* updated_content = jsonToString(cjson);
   secFreeJson(cjson);
   oidc_error_t e =
-      encryptAndWriteToOidcFile(updated_content, shortname, password);
+      !oidcFileDoesExist(shortname) && keystore_exists()
+          ? keystore_updateAccount(shortname, updated_content, password)
+          : encryptAndWriteToOidcFile(updated_content, shortname, password);
   secFree(updated_content);
   return e;
 }
@@ -0,0 +1,248 @@
+#define _XOPEN_SOURCE 700
+#include "upgrade.h"
+#include "oidc-agent/oidcp/passwords/password_store.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * With --upgrade the running agent replaces itself with the installed binary
+ * without closing its socket, so that clients do not notice the upgrade. oidcp
+ * waits until no requests are pending, the workers hand over their accounts
+ * (see oidcd/snapshot.c) and exit, and oidcp executes the binary it was
+ * started from with the same arguments. The listening socket and an anonymous
+ * socket, from which the new process reads the accounts and the stored
+ * passwords, are kept open across the exec and announced in
+ * @c UPGRADE_ENV_NAME. The state is not written to disk and only the new
+ * process can read it, so it is passed on unencrypted.
+ */
+
+static char**        command   = NULL;
+static int           listenFd  = -1;
+static unsigned char activated = 0;
+static cJSON*        handover  = NULL;  // the state read by the new process
+
+/**
+ * @brief remembers how the agent was started, so that it can execute itself
+ * again; a relative path is resolved, because the daemon changes its working
+ * directory
+ */
+void upgrade_setCommand(char* const argv[]) {
+  size_t argc = 0;
+  while (argv[argc]) {
+    argc++;
+  }
+  command = secAlloc(sizeof(char*) * (argc + 1));
+  for (size_t i = 0; i < argc; i++) {
+    command[i] = oidc_strcopy(argv[i]);
+  }
+  char resolved[PATH_MAX];
+  if (strchr(command[0], '/') && realpath(command[0], resolved)) {
+    secFree(command[0]);
+    command[0] = oidc_strcopy(resolved);
+  }
+}
+
+/**
+ * @brief sets the listening socket that is passed on to the new binary
+ * @param act if the socket was passed by the service manager
+ */
+void upgrade_setSocket(int sock, unsigned char act) {
+  listenFd  = sock;
+  activated = act;
+}
+
+/**
+ * @brief checks if the binary the agent was started from can be executed
+ */
+oidc_error_t upgrade_canExec() {
+  if (command == NULL || listenFd < 0) {
+    oidc_seterror("the agent does not know how it was started");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  if (strchr(command[0], '/') && access(command[0], X_OK) != 0) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+static void _writeAll(int fd, const char* data) {
+  size_t len = strlen(data);
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief writes @p state to @p fd in a grandchild, so that the new process
+ * can read it while it starts; the grandchild is not a zombie of the new
+ * process
+ */
+static oidc_error_t _writeInBackground(int fd, const char* state) {
+  pid_t pid = fork();
+  if (pid == -1) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  if (pid == 0) {
+    if (fork() == 0) {
+      _writeAll(fd, state);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  waitpid(pid, NULL, 0);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief closes all file descriptors on the exec except @p keep1 and
+ * @p keep2
+ */
+static void _closeOnExec(int keep1, int keep2) {
+  long max = sysconf(_SC_OPEN_MAX);
+  for (int fd = 3; fd < (max > 0 ? max : 1024); fd++) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags == -1) {
+      continue;
+    }
+    flags = fd == keep1 || fd == keep2 ? flags & ~FD_CLOEXEC
+                                       : flags | FD_CLOEXEC;
+    fcntl(fd, F_SETFD, flags);
+  }
+}
+
+/**
+ * @brief replaces the agent with the binary it was started from
+ * The workers have to be stopped already.
+ * @param accounts an array with the accounts handed over by every worker
+ * @return only returns on failure with an error code
+ */
+oidc_error_t upgrade_exec(const cJSON* accounts) {
+  if (upgrade_canExec() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  cJSON* state = cJSON_CreateObject();
+  cJSON_AddItemToObject(state, "accounts", cJSON_Duplicate(accounts, 1));
+  cJSON_AddItemToObject(state, "passwords", exportPasswords());
+  char* state_str = jsonToStringUnformatted(state);
+  secFreeJson(state);
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    oidc_setErrnoError();
+    secFree(state_str);
+    return oidc_errno;
+  }
+  oidc_error_t e = _writeInBackground(fds[1], state_str);
+  secFree(state_str);
+  close(fds[1]);
+  if (e != OIDC_SUCCESS) {
+    close(fds[0]);
+    return e;
+  }
+  _closeOnExec(listenFd, fds[0]);
+  char* env = oidc_sprintf("%d,%d,%d", listenFd, fds[0], activated);
+  setenv(UPGRADE_ENV_NAME, env, 1);
+  secFree(env);
+  agent_log(NOTICE, "Replacing the agent with '%s'", command[0]);
+  execvp(command[0], command);
+  oidc_setErrnoError();
+  unsetenv(UPGRADE_ENV_NAME);
+  close(fds[0]);
+  fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+  return oidc_errno;
+}
+
+static char* _readAll(int fd) {
+  size_t size = 4096;
+  size_t len  = 0;
+  char*  buf  = secAlloc(size + 1);
+  while (1) {
+    ssize_t n = read(fd, buf + len, size - len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    len += n;
+    if (len == size) {
+      char* bigger = secAlloc(2 * size + 1);
+      memcpy(bigger, buf, len);
+      secFree(buf);
+      buf = bigger;
+      size *= 2;
+    }
+  }
+  return buf;
+}
+
+/**
+ * @brief takes over the socket and the state of the agent this process
+ * replaced
+ * @param act set to @c 1 if the socket was passed by the service manager
+ * @return the listening socket or @c -1 if the agent was not started by an
+ * upgrade
+ */
+int upgrade_takeSocket(unsigned char* act) {
+  const char* env = getenv(UPGRADE_ENV_NAME);
+  int         sock, fd, was_activated;
+  if (env == NULL ||
+      sscanf(env, "%d,%d,%d", &sock, &fd, &was_activated) != 3) {
+    return -1;
+  }
+  unsetenv(UPGRADE_ENV_NAME);  // must not be passed on to oidcd
+  char* state = _readAll(fd);
+  close(fd);
+  handover = stringToJson(state);
+  secFree(state);
+  if (handover == NULL) {
+    agent_log(ERROR, "Could not read the state of the previous agent");
+  }
+  *act = was_activated ? 1 : 0;
+  agent_log(DEBUG, "Took over socket %d from the previous agent", sock);
+  return sock;
+}
+
+/**
+ * @brief returns the accounts handed over by the previous agent as a json
+ * array with one element per worker
+ * @return a pointer to the json string or @c NULL; has to be freed after usage
+ */
+char* upgrade_getAccounts() {
+  cJSON* accounts = cJSON_GetObjectItemCaseSensitive(handover, "accounts");
+  return cJSON_IsArray(accounts) ? jsonToStringUnformatted(accounts) : NULL;
+}
+
+/**
+ * @brief returns the passwords the previous agent stored
+ * @return a pointer to the json array or @c NULL; it is owned by the module
+ */
+cJSON* upgrade_getPasswords() {
+  return cJSON_GetObjectItemCaseSensitive(handover, "passwords");
+}
+
+void upgrade_free() {
+  secFreeJson(handover);
+  handover = NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef OIDC_UPGRADE_H
+#define OIDC_UPGRADE_H
+
+#include "utils/oidc_error.h"
+#include "wrapper/cjson.h"
+
+// Passes the socket and the state to the new binary: "socket,state,activated"
+#define UPGRADE_ENV_NAME "OIDC_AGENT_UPGRADE"
+
+void         upgrade_setCommand(char* const argv[]);
+void         upgrade_setSocket(int sock, unsigned char activated);
+oidc_error_t upgrade_canExec();
+oidc_error_t upgrade_exec(const cJSON* accounts);
+int          upgrade_takeSocket(unsigned char* activated);
+char*        upgrade_getAccounts();
+cJSON*       upgrade_getPasswords();
+void         upgrade_free();
+
+#endif  // OIDC_UPGRADE_H
@@ -0,0 +1,391 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "upstream.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "ipc/reactor.h"
+#include "utils/agentLogger.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Access token requests for accounts or issuers that are not available in
+ * this agent can be forwarded to an upstream agent. Its responses are cached
+ * until the token expires, so that a node only asks the upstream agent about
+ * once per token lifetime. Identical requests that arrive while an upstream
+ * request is running wait for that request instead of starting another one.
+ *
+ * The upstream request is done in a child process, so that oidcp keeps
+ * serving other clients in the meantime.
+ *
+ * Tokens can also be staged into the cache, e.g. by a batch job launcher that
+ * obtained them once for all nodes of the job (see oidc-token --stage-in), so
+ * that the ranks starting at the same time do not ask the upstream agent.
+ */
+
+struct upstreamToken {
+  char*         key;
+  char*         response;
+  unsigned long expires_at;
+};
+
+struct upstreamWaiter {
+  upstreamCallback callback;
+  void*            arg;
+};
+
+struct upstreamRequest {
+  char*         key;
+  pid_t         pid;
+  struct string out;
+  list_t*       waiters;
+};
+
+static char*   upstreamAddress = NULL;
+static list_t* cache           = NULL;  // oldest first
+static list_t* running         = NULL;
+
+static void _secFreeUpstreamToken(struct upstreamToken* t) {
+  secFree(t->key);
+  secFree(t->response);
+  secFree(t);
+}
+
+static int _matchUpstreamToken(const char* key, const struct upstreamToken* t) {
+  return strequal(key, t->key);
+}
+
+static int _matchUpstreamRequest(const char*                   key,
+                                 const struct upstreamRequest* r) {
+  return strequal(key, r->key);
+}
+
+/**
+ * @brief sets the address of the upstream agent
+ * @param address the address as it would be given in @c OIDC_REMOTE_SOCK;
+ * @c NULL disables forwarding
+ */
+void upstream_setAddress(const char* address) {
+  secFree(upstreamAddress);
+  upstreamAddress = strValid(address) ? oidc_strcopy(address) : NULL;
+  if (upstreamAddress == NULL) {
+    upstream_clearCache();
+  }
+}
+
+int upstream_isEnabled() { return upstreamAddress != NULL; }
+
+/**
+ * @brief builds the cache key of an access token request
+ * @param min_valid_period is set to the requested minimum validity
+ * @return the key or @c NULL if @p request is not an access token request; has
+ * to be freed after usage
+ */
+static char* _keyFor(const char* request, time_t* min_valid_period) {
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_ISSUERURL,
+                 OIDC_KEY_SCOPE, IPC_KEY_AUDIENCE, IPC_KEY_MINVALID);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  KEY_VALUE_VARS(request, shortname, issuer, scope, audience, min_valid);
+  char* key = NULL;
+  if (strequal(_request, REQUEST_VALUE_ACCESSTOKEN) &&
+      (strValid(_shortname) || strValid(_issuer))) {
+    key = oidc_sprintf("%s\n%s\n%s\n%s", _shortname ?: "", _issuer ?: "",
+                       _scope ?: "", _audience ?: "");
+    *min_valid_period = _min_valid ? strToInt(_min_valid) : 0;
+  }
+  SEC_FREE_KEY_VALUES();
+  return key;
+}
+
+/**
+ * @brief checks if oidcd's response to @p request means that the token is not
+ * available locally and has to be requested from the upstream agent
+ */
+int upstream_isMiss(const char* request, const char* response) {
+  if (!upstream_isEnabled() || request == NULL || response == NULL) {
+    return 0;
+  }
+  // successful responses, e.g. access tokens, are passed on without parsing
+  if (strstr(response, "\"" OIDC_KEY_ERROR "\"") == NULL) {
+    return 0;
+  }
+  char* error = getJSONValueFromString(response, OIDC_KEY_ERROR);
+  int   miss  = strequal(error, oidc_serrorFor(OIDC_ENOACCOUNT)) ||
+             strequal(error, ACCOUNT_NOT_LOADED);
+  secFree(error);
+  if (!miss) {
+    return 0;
+  }
+  time_t min_valid_period = 0;
+  char*  key              = _keyFor(request, &min_valid_period);
+  int    isTokenRequest   = key != NULL;
+  secFree(key);
+  return isTokenRequest;
+}
+
+static const char* _getCachedResponse(const char* key,
+                                      time_t      min_valid_period) {
+  list_node_t* node = cache ? findInList(cache, key) : NULL;
+  if (node == NULL || min_valid_period == FORCE_NEW_TOKEN) {
+    return NULL;
+  }
+  const struct upstreamToken* t = node->val;
+  if ((time_t)t->expires_at - time(NULL) < min_valid_period) {
+    if ((time_t)t->expires_at <= time(NULL)) {
+      list_remove(cache, node);
+    }
+    return NULL;
+  }
+  return t->response;
+}
+
+/**
+ * @return @c 1 if the response was cached; @c 0 if it is not a valid token
+ * response
+ */
+static int _cacheResponse(const char* key, const char* response) {
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ACCESSTOKEN, AGENT_KEY_EXPIRESAT);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  KEY_VALUE_VARS(status, access_token, expires_at);
+  unsigned long expires_at = _expires_at ? strToULong(_expires_at) : 0;
+  if (!strequal(_status, STATUS_SUCCESS) || !strValid(_access_token) ||
+      expires_at <= (unsigned long)time(NULL)) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  SEC_FREE_KEY_VALUES();
+  if (cache == NULL) {
+    cache        = list_new();
+    cache->free  = (void (*)(void*))_secFreeUpstreamToken;
+    cache->match = (matchFunction)_matchUpstreamToken;
+  }
+  list_removeIfFound(cache, (void*)key);
+  if (cache->len >= UPSTREAM_CACHE_MAX) {
+    list_remove(cache, cache->head);
+  }
+  struct upstreamToken* t = secAlloc(sizeof(struct upstreamToken));
+  t->key                  = oidc_strcopy(key);
+  t->response             = oidc_strcopy(response);
+  t->expires_at           = expires_at;
+  list_rpush(cache, list_node_new(t));
+  return 1;
+}
+
+static void _finishUpstreamRequest(int fd, struct upstreamRequest* r) {
+  reactor_unwatchFd(fd);
+  close(fd);
+  waitpid(r->pid, NULL, 0);
+  list_node_t* node = findInList(running, r->key);
+  if (node) {
+    list_remove(running, node);  // does not free r
+  }
+  char* response = r->out.len > 0
+                       ? oidc_strcopy(r->out.ptr)
+                       : oidc_sprintf(RESPONSE_ERROR,
+                                      "No response from upstream agent");
+  agent_log(DEBUG, "Upstream request %d finished for %lu client(s)", r->pid,
+            r->waiters->len);
+  _cacheResponse(r->key, response);
+  list_node_t*     wnode;
+  list_iterator_t* it = list_iterator_new(r->waiters, LIST_HEAD);
+  while ((wnode = list_iterator_next(it))) {
+    struct upstreamWaiter* w = wnode->val;
+    w->callback(response, w->arg);
+  }
+  list_iterator_destroy(it);
+  secFree(response);
+  secFreeList(r->waiters);
+  secFree(r->out.ptr);
+  secFree(r->key);
+  secFree(r);
+}
+
+static void _readUpstreamResponse(int fd, void* arg) {
+  struct upstreamRequest* r = arg;
+  char                    buf[4096];
+  ssize_t                 n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    string_append(&r->out, buf, n);
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;  // wait for more output
+  }
+  _finishUpstreamRequest(fd, r);
+}
+
+static void _writeAll(int fd, const char* msg) {
+  size_t len = strlen(msg);
+  while (len > 0) {
+    ssize_t n = write(fd, msg, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    msg += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief starts a child process that sends @p request to the upstream agent
+ */
+static struct upstreamRequest* _startUpstreamRequest(const char* key,
+                                                     const char* request) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    oidc_setErrnoError();
+    close(fds[0]);
+    close(fds[1]);
+    return NULL;
+  }
+  if (pid == 0) {  // child
+    close(fds[0]);
+    setenv(OIDC_REMOTE_SOCK_ENV_NAME, upstreamAddress, 1);
+    char* res = ipc_cryptCommunicate(1, "%s", request);
+    if (res == NULL) {
+      res = oidc_sprintf(RESPONSE_ERROR, oidc_serror());
+    }
+    _writeAll(fds[1], res);
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[1]);
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  struct upstreamRequest* r = secAlloc(sizeof(struct upstreamRequest));
+  if (init_string(&r->out) != OIDC_SUCCESS) {
+    close(fds[0]);
+    secFree(r);
+    return NULL;
+  }
+  r->key           = oidc_strcopy(key);
+  r->pid           = pid;
+  r->waiters       = list_new();
+  r->waiters->free = (void (*)(void*))_secFree;
+  if (running == NULL) {
+    running        = list_new();
+    running->match = (matchFunction)_matchUpstreamRequest;
+  }
+  list_rpush(running, list_node_new(r));
+  agent_log(DEBUG, "Started upstream request %d", pid);
+  reactor_watchFd(fds[0], _readUpstreamResponse, r);
+  return r;
+}
+
+/**
+ * @brief gets an access token from the upstream agent
+ * A cached response is used if it is still valid for the requested minimum
+ * period; if the same token is already requested, @p callback is called with
+ * the response of that request.
+ * @param callback is called with the response once it is available; it might
+ * be called before this function returns
+ * @return @c OIDC_SUCCESS if @p callback will be called
+ */
+oidc_error_t upstream_getToken(const char* request, upstreamCallback callback,
+                               void* arg) {
+  if (request == NULL || callback == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (!upstream_isEnabled()) {
+    oidc_errno = OIDC_NOTIMPL;
+    return oidc_errno;
+  }
+  time_t min_valid_period = 0;
+  char*  key              = _keyFor(request, &min_valid_period);
+  if (key == NULL) {
+    oidc_seterror("Only access token requests can be sent upstream");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  const char* cached = _getCachedResponse(key, min_valid_period);
+  if (cached) {
+    agent_log(DEBUG, "Using cached upstream token");
+    secFree(key);
+    callback(cached, arg);
+    return OIDC_SUCCESS;
+  }
+  list_node_t*            node = running ? findInList(running, key) : NULL;
+  struct upstreamRequest* r    = node ? node->val : NULL;
+  if (r) {
+    agent_log(DEBUG, "Waiting for running upstream request %d", r->pid);
+  } else {
+    r = _startUpstreamRequest(key, request);
+  }
+  secFree(key);
+  if (r == NULL) {
+    return oidc_errno;
+  }
+  struct upstreamWaiter* w = secAlloc(sizeof(struct upstreamWaiter));
+  w->callback              = callback;
+  w->arg                   = arg;
+  list_rpush(r->waiters, list_node_new(w));
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief stages a token into the cache
+ * @param request the json encoded stage request with the access token request
+ * the token is for and the response to it
+ * @return @c OIDC_SUCCESS or an error code if the token was not staged
+ */
+oidc_error_t upstream_stage(const char* request) {
+  if (!upstream_isEnabled()) {
+    oidc_seterror("Staged tokens are only used by an agent with --upstream");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  INIT_KEY_VALUE(IPC_KEY_TOKENREQUEST, IPC_KEY_TOKENRESPONSE);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return oidc_errno;
+  }
+  KEY_VALUE_VARS(token_request, token_response);
+  time_t min_valid_period = 0;
+  char*  key =
+      _token_request ? _keyFor(_token_request, &min_valid_period) : NULL;
+  int staged =
+      key != NULL && _token_response && _cacheResponse(key, _token_response);
+  SEC_FREE_KEY_VALUES();
+  secFree(key);
+  if (!staged) {
+    oidc_seterror("The staged token is invalid or expired");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  agent_log(DEBUG, "Staged an access token");
+  return OIDC_SUCCESS;
+}
+
+void upstream_clearCache() {
+  secFreeList(cache);
+  cache = NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef OIDC_UPSTREAM_H
+#define OIDC_UPSTREAM_H
+
+#include "utils/oidc_error.h"
+
+// Maximum number of token responses of the upstream agent that are cached
+#define UPSTREAM_CACHE_MAX 256
+
+typedef void (*upstreamCallback)(const char* response, void* arg);
+
+void         upstream_setAddress(const char* address);
+int          upstream_isEnabled();
+int          upstream_isMiss(const char* request, const char* response);
+oidc_error_t upstream_getToken(const char* request, upstreamCallback callback,
+                               void* arg);
+oidc_error_t upstream_stage(const char* request);
+void         upstream_clearCache();
+
+#endif  // OIDC_UPSTREAM_H
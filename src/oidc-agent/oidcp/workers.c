@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+#include "workers.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "oidc-agent/oidcp/refreshTokenLanes.h"
+#include "oidc-agent/oidcp/start_oidcd.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+/**
+ * oidcp can run multiple oidcd processes (workers). Every account is owned by
+ * one worker, determined by the hash of its short name, so that requests for
+ * different accounts are handled in parallel while every worker keeps its
+ * accounts in its own memory. Requests that do not name an account, e.g. the
+ * steps of the account generation that are keyed by a state, are handled by
+ * worker @c 0. Requests that concern all accounts are sent to every worker and
+ * the responses merged by oidcp. Requests for scoped tokens of an account with
+ * a refresh token pool can be handled by the workers of its lanes; see
+ * refreshTokenLanes.c.
+ */
+
+static struct ipcPipe workers[AGENT_MAX_WORKERS];
+static int            rxFds[AGENT_MAX_WORKERS];
+static pid_t          pids[AGENT_MAX_WORKERS];
+static size_t         count = 0;
+
+static const struct arguments* startArguments = NULL;  // for restarts
+
+/**
+ * Request types that are sent to all workers
+ */
+static const char* const fanoutRequests[] = {
+    REQUEST_VALUE_LOADEDACCOUNTS, REQUEST_VALUE_LOCK,
+    REQUEST_VALUE_REMOVEALL,      REQUEST_VALUE_STATS,
+    REQUEST_VALUE_STATUS,         REQUEST_VALUE_STATUS_JSON,
+    REQUEST_VALUE_UNLOCK,
+};
+
+/**
+ * @brief starts the oidcd workers
+ * The number of workers is given by @c arguments->workers
+ */
+void workers_start(const struct arguments* arguments) {
+  startArguments = arguments;
+  count          = arguments->workers ?: 1;
+  for (size_t i = 0; i < count; i++) {
+    workers[i] = startOidcd(arguments, i, workers, i, &pids[i]);
+    rxFds[i]   = workers[i].rx;
+  }
+}
+
+/**
+ * @brief replaces a worker that died, or that has to be killed because it
+ * does not follow the protocol anymore, with a new one
+ */
+void workers_restart(size_t worker) {
+  ipc_closePipes(workers[worker]);
+  workers[worker] = (struct ipcPipe){.rx = -1, .tx = -1};
+  kill(pids[worker], SIGKILL);
+  waitpid(pids[worker], NULL, 0);
+  workers[worker] =
+      startOidcd(startArguments, worker, workers, count, &pids[worker]);
+  rxFds[worker] = workers[worker].rx;
+}
+
+/**
+ * @brief returns the index of the worker that uses @p pipes
+ */
+size_t workers_indexOf(struct ipcPipe pipes) {
+  for (size_t i = 0; i < count; i++) {
+    if (workers[i].rx == pipes.rx) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief closes the pipes to the workers and waits until they exited
+ */
+void workers_stop() {
+  for (size_t i = 0; i < count; i++) {
+    ipc_closePipes(workers[i]);
+  }
+  for (size_t i = 0; i < count; i++) {
+    waitpid(pids[i], NULL, 0);
+  }
+  count = 0;
+}
+
+size_t workers_count() { return count; }
+
+struct ipcPipe workers_get(size_t worker) { return workers[worker]; }
+
+/**
+ * @brief returns the fds on which the workers send their messages to oidcp;
+ * the index of an fd is the index of the worker
+ */
+const int* workers_getRxFds() { return rxFds; }
+
+/**
+ * @brief FNV-1a hash of a string, continuing @p hash
+ */
+static unsigned long _hashString(unsigned long hash, const char* s) {
+  for (; *s; s++) {
+    hash ^= (unsigned char)*s;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static unsigned long _hashShortname(const char* shortname) {
+  return _hashString(2166136261UL, shortname);
+}
+
+/**
+ * @brief returns the index of the worker that owns the account @p shortname
+ */
+size_t workers_forShortname(const char* shortname) {
+  if (count <= 1 || !strValid(shortname)) {
+    return 0;
+  }
+  return _hashShortname(shortname) % count;
+}
+
+/**
+ * @brief returns the index of the worker that handles a client request
+ * The account is taken from the shortname of the request or, for requests
+ * that pass an account configuration, from the configuration.
+ */
+size_t workers_forRequest(const char* request) {
+  if (count <= 1) {
+    return 0;
+  }
+  INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_CONFIG,
+                 OIDC_KEY_SCOPE, IPC_KEY_AUDIENCE);
+  if (CALL_GETJSONVALUES(request) < 0) {
+    SEC_FREE_KEY_VALUES();
+    return 0;
+  }
+  KEY_VALUE_VARS(request_type, shortname, config, scope, audience);
+  size_t worker = 0;
+  if (strValid(_shortname)) {
+    worker = workers_forShortname(_shortname);
+    if (strequal(_request_type, REQUEST_VALUE_ACCESSTOKEN) &&
+        (strValid(_scope) || strValid(_audience))) {
+      unsigned long key = _hashString(2166136261UL, _scope ?: "");
+      key    = _hashString(_hashString(key, "\n"), _audience ?: "");
+      worker = rtLanes_workerFor(_shortname, key, worker);
+    }
+  } else if (_config && (strequal(_request_type, REQUEST_VALUE_ADD) ||
+                         strequal(_request_type, REQUEST_VALUE_DELETE))) {
+    char* name = getJSONValueFromString(_config, AGENT_KEY_SHORTNAME);
+    worker     = workers_forShortname(name);
+    secFree(name);
+  }
+  SEC_FREE_KEY_VALUES();
+  return worker;
+}
+
+/**
+ * @brief checks if requests of type @p request_type are sent to all workers
+ */
+int workers_isFanout(const char* request_type) {
+  if (count <= 1 || request_type == NULL) {
+    return 0;
+  }
+  for (size_t i = 0; i < sizeof(fanoutRequests) / sizeof(*fanoutRequests);
+       i++) {
+    if (strequal(request_type, fanoutRequests[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef OIDC_WORKERS_H
+#define OIDC_WORKERS_H
+
+#include "ipc/pipe.h"
+#include "oidc-agent/oidc-agent_options.h"
+
+#include <stddef.h>
+
+void           workers_start(const struct arguments* arguments);
+void           workers_stop();
+void           workers_restart(size_t worker);
+size_t         workers_indexOf(struct ipcPipe pipes);
+size_t         workers_count();
+struct ipcPipe workers_get(size_t worker);
+const int*     workers_getRxFds();
+size_t         workers_forShortname(const char* shortname);
+size_t         workers_forRequest(const char* request);
+int            workers_isFanout(const char* request_type);
+
+#endif  // OIDC_WORKERS_H
@@ -0,0 +1,223 @@
+#include "workPool.h"
+#include "defines/settings.h"
+#include "utils/agentLogger.h"
+#include "utils/memory.h"
+#include "wrapper/list.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/**
+ * The work pool runs CPU-heavy work, e.g. the key derivation for an encrypted
+ * account config, on other cores, so that the event loop keeps serving
+ * requests meanwhile. Every thread has its own queue; work is distributed
+ * round-robin and a thread whose queue is empty steals from the end of the
+ * others' queues, so a long key derivation does not hold up the work queued
+ * behind it.
+ *
+ * The work function runs on a pool thread and must only use thread-safe
+ * functions: memory allocation, the crypto functions and the key cache are,
+ * most other agent state is not. The completion callback is called on the
+ * event loop thread from @c workPool_runCompleted, once the fd returned by
+ * @c workPool_getFd (an eventfd on Linux, a pipe elsewhere) is readable.
+ */
+
+struct workItem {
+  workFunction work;
+  workCallback done;
+  void*        arg;
+  void*        result;
+};
+
+struct workQueue {
+  pthread_mutex_t lock;
+  list_t*         items;
+};
+
+static struct workQueue queues[WORKPOOL_MAX_THREADS];
+static pthread_t        threads[WORKPOOL_MAX_THREADS];
+static size_t           threadCount = 0;
+static size_t           nextQueue   = 0;
+
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wakeUp    = PTHREAD_COND_INITIALIZER;
+static size_t          queued    = 0;  // guarded by sleepLock
+
+static pthread_mutex_t doneLock  = PTHREAD_MUTEX_INITIALIZER;
+static list_t*         completed = NULL;
+static int             notifyFds[2] = {-1, -1};  // the same fd on Linux
+
+static struct workItem* _take(size_t queue, int steal) {
+  struct workQueue* q = &queues[queue];
+  pthread_mutex_lock(&q->lock);
+  list_node_t* node = steal ? list_rpop(q->items) : list_lpop(q->items);
+  pthread_mutex_unlock(&q->lock);
+  if (node == NULL) {
+    return NULL;
+  }
+  struct workItem* item = node->val;
+  LIST_FREE(node);
+  return item;
+}
+
+static struct workItem* _next(size_t own) {
+  struct workItem* item = _take(own, 0);
+  for (size_t i = 1; item == NULL && i < threadCount; i++) {
+    item = _take((own + i) % threadCount, 1);
+  }
+  return item;
+}
+
+static void _complete(struct workItem* item) {
+  pthread_mutex_lock(&doneLock);
+  list_rpush(completed, list_node_new(item));
+  pthread_mutex_unlock(&doneLock);
+  const unsigned long long one = 1;
+  // An eventfd needs 8 bytes; a single byte is enough for the pipe
+  if (write(notifyFds[1], &one,
+            notifyFds[0] == notifyFds[1] ? sizeof(one) : 1) < 0) {
+    agent_log(ERROR, "Could not notify about completed work: %m");
+  }
+}
+
+static void* _run(void* arg) {
+  const size_t own = (size_t)arg;
+  while (1) {
+    pthread_mutex_lock(&sleepLock);
+    while (queued == 0) {
+      pthread_cond_wait(&wakeUp, &sleepLock);
+    }
+    queued--;
+    pthread_mutex_unlock(&sleepLock);
+    // Some queue holds an item for this thread, it might be stolen meanwhile
+    // but then another item is counted in queued
+    struct workItem* item = NULL;
+    while ((item = _next(own)) == NULL) {}
+    item->result = item->work(item->arg);
+    _complete(item);
+  }
+  return NULL;
+}
+
+static int _createNotifyFds() {
+#ifdef __linux__
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  notifyFds[0] = notifyFds[1] = fd;
+  return 0;
+#else
+  if (pipe(notifyFds) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(notifyFds[i], F_SETFL, fcntl(notifyFds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(notifyFds[i], F_SETFD, FD_CLOEXEC);
+  }
+  return 0;
+#endif
+}
+
+/**
+ * @brief starts the threads of the pool; one less than the number of CPUs,
+ * but at least one and at most @c WORKPOOL_MAX_THREADS
+ */
+oidc_error_t workPool_start() {
+  if (threadCount) {
+    return OIDC_SUCCESS;
+  }
+  if (_createNotifyFds() != 0) {
+    agent_log(ERROR, "Could not create work pool notification: %m");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  completed = list_new();
+  // A child forked while a pool thread allocates must not inherit the lock
+  pthread_atfork(secMem_lockForFork, secMem_unlockAfterFork,
+                 secMem_unlockAfterFork);
+  long   cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t count = cpus > 2 ? (size_t)cpus - 1 : 1;
+  if (count > WORKPOOL_MAX_THREADS) {
+    count = WORKPOOL_MAX_THREADS;
+  }
+  for (size_t i = 0; i < count; i++) {
+    pthread_mutex_init(&queues[i].lock, NULL);
+    queues[i].items = list_new();
+    if (pthread_create(&threads[i], NULL, _run, (void*)i) != 0) {
+      list_destroy(queues[i].items);
+      break;
+    }
+    pthread_detach(threads[i]);
+    threadCount++;
+  }
+  if (threadCount == 0) {
+    agent_log(ERROR, "Could not start work pool threads");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  agent_log(DEBUG, "Started work pool with %lu threads",
+            (unsigned long)threadCount);
+  return OIDC_SUCCESS;
+}
+
+int workPool_isRunning() { return threadCount > 0; }
+
+/**
+ * @brief runs @p work with @p arg on a pool thread; its result is passed to
+ * @p done on the event loop thread
+ * @return @c OIDC_SUCCESS or an error code if the pool is not running; then
+ * the caller has to do the work itself
+ */
+oidc_error_t workPool_submit(workFunction work, workCallback done, void* arg) {
+  if (!threadCount) {
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  struct workItem* item = secAlloc(sizeof(struct workItem));
+  item->work            = work;
+  item->done            = done;
+  item->arg             = arg;
+  struct workQueue* q   = &queues[nextQueue++ % threadCount];
+  pthread_mutex_lock(&q->lock);
+  list_rpush(q->items, list_node_new(item));
+  pthread_mutex_unlock(&q->lock);
+  pthread_mutex_lock(&sleepLock);
+  queued++;
+  pthread_cond_signal(&wakeUp);
+  pthread_mutex_unlock(&sleepLock);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the fd that becomes readable when work completed
+ * @return the fd or @c -1 if the pool is not running
+ */
+int workPool_getFd() { return notifyFds[0]; }
+
+/**
+ * @brief calls the completion callbacks of all completed work
+ */
+void workPool_runCompleted() {
+  if (!threadCount) {
+    return;
+  }
+  unsigned long long count;
+  while (read(notifyFds[0], &count, sizeof(count)) > 0) {}
+  pthread_mutex_lock(&doneLock);
+  list_t* done = completed;
+  completed    = list_new();
+  pthread_mutex_unlock(&doneLock);
+  list_node_t* node;
+  while ((node = list_lpop(done))) {
+    struct workItem* item = node->val;
+    LIST_FREE(node);
+    item->done(item->result, item->arg);
+    secFree(item);
+  }
+  list_destroy(done);
+}
@@ -0,0 +1,15 @@
+#ifndef OIDC_AGENT_WORKPOOL_H
+#define OIDC_AGENT_WORKPOOL_H
+
+#include "utils/oidc_error.h"
+
+typedef void* (*workFunction)(void* arg);
+typedef void (*workCallback)(void* result, void* arg);
+
+oidc_error_t workPool_start();
+int          workPool_isRunning();
+oidc_error_t workPool_submit(workFunction work, workCallback done, void* arg);
+int          workPool_getFd();
+void         workPool_runCompleted();
+
+#endif  // OIDC_AGENT_WORKPOOL_H
@@ -1,6 +1,7 @@
 #include "gen_handler.h"
 #include "account/account.h"
 #include "account/issuer_helper.h"
+#include "account/issuer_index.h"
 #include "defines/agent_values.h"
 #include "defines/ipc_values.h"
 #include "defines/oidc_values.h"
@@ -16,10 +17,14 @@
 #include "utils/accountUtils.h"
 #include "utils/crypt/crypt.h"
 #include "utils/crypt/cryptUtils.h"
+#include "utils/crypt/kdfConfig.h"
+#include "utils/crypt/keyCache.h"
 #include "utils/errorUtils.h"
 #include "utils/file_io/cryptFileUtils.h"
 #include "utils/file_io/fileUtils.h"
+#include "utils/file_io/promptCryptFileUtils.h"
 #include "utils/file_io/file_io.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/json.h"
 #include "utils/listUtils.h"
@@ -36,6 +41,7 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,6 +60,9 @@ char* _gen_response(struct oidc_account*    account,
                     const struct arguments* arguments) {
   readDeviceAuthEndpoint(account, arguments);
   readAudience(account, arguments);
+  if (arguments->rt_pool) {
+    account_setRefreshTokenPoolSize(account, arguments->rt_pool);
+  }
   cJSON* flow_json = listToJSONArray(arguments->flows);
   char*  log_tmp   = jsonToString(flow_json);
   logger(DEBUG, "arguments flows in handleGen are '%s'", log_tmp);
@@ -123,7 +132,9 @@ void handleGen(struct oidc_account* account, const struct arguments* arguments,
   char* issuer = getJSONValueFromString(json, AGENT_KEY_ISSUERURL);
   char* name   = getJSONValueFromString(json, AGENT_KEY_SHORTNAME);
   if (!arguments->noSave) {
-    updateIssuerConfig(issuer, name);
+    if (issuerIndex_addIssuer(issuer, name) != OIDC_SUCCESS) {
+      logger(ERROR, "Could not update issuer.config: %s", oidc_serror());
+    }
   }
   secFree(issuer);
   char* hint = oidc_sprintf("account configuration '%s'", name);
@@ -403,7 +414,9 @@ void stateLookUpWithConfigSave(const char*             state,
   char* issuer     = getJSONValueFromString(config, AGENT_KEY_ISSUERURL);
   char* short_name = getJSONValueFromString(config, AGENT_KEY_SHORTNAME);
   if (!arguments->noSave) {
-    updateIssuerConfig(issuer, short_name);
+    if (issuerIndex_addIssuer(issuer, short_name) != OIDC_SUCCESS) {
+      logger(ERROR, "Could not update issuer.config: %s", oidc_serror());
+    }
   }
   secFree(issuer);
   char* hint = oidc_sprintf("account configuration '%s'", short_name);
@@ -414,19 +427,15 @@ void stateLookUpWithConfigSave(const char*             state,
   exit(EXIT_SUCCESS);
 }
 
-char* gen_handleDeviceFlow(char* json_device, char* json_account,
-                           const struct arguments* arguments) {
-  if (arguments == NULL) {
-    oidc_setArgNullFuncError(__func__);
-    oidc_perror();
-    exit(EXIT_FAILURE);
-  }
-  struct oidc_device_code* dc = getDeviceCodeFromJSON(json_device);
-  printDeviceCode(*dc);
-  size_t interval   = oidc_device_getInterval(*dc);
-  size_t expires_in = oidc_device_getExpiresIn(*dc);
-  long   expires_at = time(NULL) + expires_in;
-  secFreeDeviceCode(dc);
+/**
+ * @brief polls the agent with a lookup request every @p interval seconds
+ * Only used for agents that do not support the @c device_poll request.
+ */
+static char* _pollAgentForDeviceCode(const char* json_device,
+                                     const char* json_account,
+                                     const struct arguments* arguments,
+                                     size_t interval, size_t expires_in,
+                                     long expires_at) {
   while (expires_in ? expires_at > time(NULL) : 1) {
     sleep(interval);
     char* res = ipc_cryptCommunicate(remote, REQUEST_DEVICE, json_device,
@@ -468,6 +477,61 @@ char* gen_handleDeviceFlow(char* json_device, char* json_account,
   exit(EXIT_FAILURE);
 }
 
+/**
+ * @brief waits until the device code is authorized
+ * The agent polls the token endpoint and answers a single request once the
+ * user authorized the device; agents that do not support this are polled with
+ * one request per interval instead.
+ */
+char* gen_handleDeviceFlow(char* json_device, char* json_account,
+                           const struct arguments* arguments) {
+  if (arguments == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  struct oidc_device_code* dc = getDeviceCodeFromJSON(json_device);
+  printDeviceCode(*dc);
+  size_t interval   = oidc_device_getInterval(*dc);
+  size_t expires_in = oidc_device_getExpiresIn(*dc);
+  long   expires_at = time(NULL) + expires_in;
+  secFreeDeviceCode(dc);
+  char* res = ipc_cryptCommunicate(remote, REQUEST_DEVICE_POLL, json_device,
+                                   json_account, arguments->only_at);
+  if (res == NULL) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, IPC_KEY_CONFIG,
+                 OIDC_KEY_ACCESSTOKEN);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    printError("Could not decode json: %s\n", res);
+    printError("This seems to be a bug. Please hand in a bug report.\n");
+    SEC_FREE_KEY_VALUES();
+    secFree(res);
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  KEY_VALUE_VARS(status, error, config, at);
+  if (_error) {
+    if (strstarts(_error, "Bad Request: Unknown request type")) {
+      SEC_FREE_KEY_VALUES();
+      return _pollAgentForDeviceCode(json_device, json_account, arguments,
+                                     interval, expires_in, expires_at);
+    }
+    printError("%s\n", _error);
+    SEC_FREE_KEY_VALUES();
+    exit(EXIT_FAILURE);
+  }
+  secFree(_status);
+  if (arguments->only_at) {
+    secFree(_config);
+  } else {
+    secFree(_at);
+  }
+  return arguments->only_at ? _at : _config;
+}
+
 struct oidc_account* manual_genNewAccount(struct oidc_account*    account,
                                           const struct arguments* arguments,
                                           char** cryptPassPtr) {
@@ -573,7 +637,14 @@ struct oidc_account* registerClient(struct arguments* arguments) {
   readCertPath(account, arguments);
   needIssuer(account, arguments);
   readDeviceAuthEndpoint(account, arguments);
-  needScope(account, arguments);
+  if (!arguments->usePublicClient &&
+      strequal(arguments->scope, AGENT_SCOPE_ALL)) {
+    // the agent resolves 'max' with the discovery document it fetches for the
+    // registration anyway; this saves a separate scope lookup
+    account_setScopeExact(account, oidc_strcopy(AGENT_SCOPE_ALL));
+  } else {
+    needScope(account, arguments);
+  }
 
   if (arguments->usePublicClient) {
     oidc_error_t pubError = gen_handlePublicClient(account, arguments);
@@ -654,6 +725,9 @@ struct oidc_account* registerClient(struct arguments* arguments) {
       }
       printStdout("Try using a public client ...\n");
     }
+    if (strequal(account_getScope(account), AGENT_SCOPE_ALL)) {
+      account_setScope(account, getSupportedScopes(account, arguments));
+    }
     oidc_error_t pubError = gen_handlePublicClient(account, arguments);
     switch (pubError) {
       case OIDC_SUCCESS:
@@ -737,6 +811,223 @@ struct oidc_account* registerClient(struct arguments* arguments) {
   return NULL;
 }
 
+/**
+ * @brief creates the account for an entry of a registration manifest
+ * Values that are not given in @p spec are taken from the command line.
+ * @return the account or @c NULL if @p spec is not usable
+ */
+static struct oidc_account* _accountFromBatchSpec(
+    const cJSON* spec, const struct arguments* arguments) {
+  if (!cJSON_IsObject(spec)) {
+    printError("Manifest entries have to be json objects\n");
+    return NULL;
+  }
+  cJSON* config = cJSON_Duplicate(spec, 1);
+  if (!jsonHasKey(config, AGENT_KEY_ISSUERURL) && arguments->issuer) {
+    jsonAddStringValue(config, AGENT_KEY_ISSUERURL, arguments->issuer);
+  }
+  if (!jsonHasKey(config, AGENT_KEY_CERTPATH) && arguments->cert_path) {
+    jsonAddStringValue(config, AGENT_KEY_CERTPATH, arguments->cert_path);
+  }
+  if (!jsonHasKey(config, OIDC_KEY_SCOPE)) {
+    jsonAddStringValue(config, OIDC_KEY_SCOPE,
+                       arguments->scope ?: DEFAULT_SCOPE);
+  }
+  char* config_str = jsonToStringUnformatted(config);
+  secFreeJson(config);
+  struct oidc_account* account = getAccountFromJSON(config_str);
+  secFree(config_str);
+  if (account == NULL) {
+    oidc_perror();
+    return NULL;
+  }
+  const char* shortname = account_getName(account);
+  if (!strValid(shortname)) {
+    printError("Manifest entry without a short name\n");
+    secFreeAccount(account);
+    return NULL;
+  }
+  if (!strValid(account_getIssuerUrl(account))) {
+    printError("%s: No issuer given\n", shortname);
+    secFreeAccount(account);
+    return NULL;
+  }
+  if (oidcFileDoesExist(shortname)) {
+    printError("%s: An account with that shortname is already configured\n",
+               shortname);
+    secFreeAccount(account);
+    return NULL;
+  }
+  if (!strValid(account_getClientName(account))) {
+    account_setName(account, oidc_strcopy(shortname), arguments->cnid);
+  }
+  if (!strValid(account_getCertPath(account))) {
+    account_setOSDefaultCertPath(account);
+  }
+  if (!strequal(account_getScope(account), AGENT_SCOPE_ALL)) {
+    account_setScope(account, oidc_strcopy(account_getScope(account)));
+  }
+  return account;
+}
+
+/**
+ * @brief saves the client registered for @p account
+ * @param response the registration response for @p account
+ * @return an oidc_error code
+ */
+static oidc_error_t _saveBatchClient(const struct oidc_account* account,
+                                     const char*                response,
+                                     const char*                password) {
+  const char* shortname = account_getName(account);
+  INIT_KEY_VALUE(OIDC_KEY_ERROR, IPC_KEY_CLIENT, IPC_KEY_MAXSCOPES);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    printError("%s: Could not decode json: %s\n", shortname, response);
+    SEC_FREE_KEY_VALUES();
+    return oidc_errno;
+  }
+  KEY_VALUE_VARS(error, client, max_scopes);
+  if (_error || !strValid(_client)) {
+    printError("%s: Error: %s\n", shortname,
+               _error ?: "Did not receive a client config");
+    SEC_FREE_KEY_VALUES();
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  cJSON* client_config_json  = stringToJson(_client);
+  cJSON* account_config_json = accountToJSONWithoutCredentials(account);
+  cJSON* merged_json = mergeJSONObjects(client_config_json, account_config_json);
+  secFreeJson(account_config_json);
+  secFreeJson(client_config_json);
+  char*       new_scope_value = getJSONValue(merged_json, OIDC_KEY_SCOPE);
+  const char* requested_scope = account_getScope(account);
+  if (strequal(requested_scope, AGENT_SCOPE_ALL) && _max_scopes) {
+    requested_scope = _max_scopes;
+  }
+  char* scope_diff = subtractListStrings(requested_scope, new_scope_value, ' ');
+  secFree(new_scope_value);
+  if (scope_diff) {
+    printImportant("%s: Warning: The registered client does not have all the "
+                   "requested scopes. The following are missing: %s\n",
+                   shortname, scope_diff);
+    secFree(scope_diff);
+  }
+  SEC_FREE_KEY_VALUES();
+  char* text = jsonToString(merged_json);
+  secFreeJson(merged_json);
+  oidc_error_t e = text ? encryptAndWriteToOidcFile(text, shortname, password)
+                        : oidc_errno;
+  secFree(text);
+  if (e != OIDC_SUCCESS) {
+    printError("%s: Error: %s\n", shortname, oidc_serror());
+    return e;
+  }
+  printStdout("%s: Client registered\n", shortname);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief registers the clients for all accounts of a manifest with a single
+ * request
+ * The manifest is a json array of account configurations. All account configs
+ * are encrypted with the same password, for which the key is only derived
+ * once. The accounts are not authorized; this is done with @c
+ * --reauthenticate when they are first used.
+ */
+void gen_handleRegisterBatch(const struct arguments* arguments) {
+  char*  manifest_str = readFile(arguments->batch);
+  cJSON* manifest     = stringToJson(manifest_str);
+  secFree(manifest_str);
+  if (!cJSON_IsArray(manifest) || cJSON_GetArraySize(manifest) <= 0) {
+    printError("Manifest '%s' is not a non-empty json array\n",
+               arguments->batch);
+    secFreeJson(manifest);
+    exit(EXIT_FAILURE);
+  }
+  list_t* accounts = list_new();
+  accounts->free   = (void (*)(void*))_secFreeAccount;
+  cJSON*       configs = cJSON_CreateArray();
+  const cJSON* spec;
+  cJSON_ArrayForEach(spec, manifest) {
+    struct oidc_account* account = _accountFromBatchSpec(spec, arguments);
+    if (account == NULL) {
+      secFreeJson(manifest);
+      exit(EXIT_FAILURE);
+    }
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(accounts, LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      if (strequal(account_getName(node->val), account_getName(account))) {
+        printError("%s: Short name is used more than once\n",
+                   account_getName(account));
+        exit(EXIT_FAILURE);
+      }
+    }
+    list_iterator_destroy(it);
+    list_rpush(accounts, list_node_new(account));
+    cJSON_AddItemToArray(configs, accountToJSON(account));
+  }
+  secFreeJson(manifest);
+  char* password = getEncryptionPasswordFor(
+      "the account configs", NULL, arguments->pw_cmd, arguments->pw_file,
+      arguments->pw_env);
+  if (password == NULL) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  char* configs_str = jsonToStringUnformatted(configs);
+  secFreeJson(configs);
+  char* flows = listToJSONArrayString(arguments->flows);
+  printStdout("Registering %lu clients ...\n", accounts->len);
+  char* res = ipc_cryptCommunicate(remote, REQUEST_REGISTER_BATCH, configs_str,
+                                   flows, arguments->dynRegToken ?: "");
+  secFree(flows);
+  secFree(configs_str);
+  if (res == NULL) {
+    printError("Error: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  if (arguments->verbose) {
+    printStdout("%s\n", res);
+  }
+  INIT_KEY_VALUE(OIDC_KEY_ERROR, IPC_KEY_RESPONSES);
+  if (CALL_GETJSONVALUES(res) < 0) {
+    printError("Could not decode json: %s\n", res);
+    printError("This seems to be a bug. Please hand in a bug report.\n");
+    secFree(res);
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  KEY_VALUE_VARS(error, responses);
+  if (_error) {
+    printError("Error: %s\n", _error);
+    SEC_FREE_KEY_VALUES();
+    exit(EXIT_FAILURE);
+  }
+  list_t* responses = JSONArrayStringToList(_responses);
+  SEC_FREE_KEY_VALUES();
+  if (responses == NULL || responses->len != accounts->len) {
+    printError("Error: Received wrong number of responses\n");
+    exit(EXIT_FAILURE);
+  }
+  // all configs are encrypted with the same password, so the key is derived
+  // only once
+  keyCache_setLifetime((struct lifetimeArg){.lifetime = 0, .argProvided = 1});
+  int failed = 0;
+  for (size_t i = 0; i < accounts->len; i++) {
+    if (_saveBatchClient(list_at(accounts, i)->val, list_at(responses, i)->val,
+                         password) != OIDC_SUCCESS) {
+      failed = 1;
+    }
+  }
+  keyCache_setLifetime((struct lifetimeArg){0});
+  secFree(password);
+  secFreeList(responses);
+  secFreeList(accounts);
+  if (failed) {
+    exit(EXIT_FAILURE);
+  }
+}
+
 void deleteAccount(char* short_name, char* file_json, int revoke,
                    const struct arguments* arguments) {
   char* refresh_token = NULL;
@@ -947,6 +1238,415 @@ void gen_handlePrint(const char* file, const struct arguments* arguments) {
   printStdout("%s\n", fileContent);
   secFree(fileContent);
 }
+/**
+ * @brief the memory a calibrated key derivation may use: 1/16 of the physical
+ * memory, but at least 8 MiB and at most 1 GiB
+ */
+static size_t _kdfMemoryBudget() {
+  const size_t min   = 8UL * 1024 * 1024;
+  const size_t max   = 1024UL * 1024 * 1024;
+  long         pages = sysconf(_SC_PHYS_PAGES);
+  long         size  = sysconf(_SC_PAGESIZE);
+  if (pages <= 0 || size <= 0) {
+    return min;
+  }
+  size_t budget = (size_t)pages / 16 * (size_t)size;
+  return budget < min ? min : budget > max ? max : budget;
+}
+
+void gen_handleCalibrateKdf(unsigned long target_ms) {
+  printStdout("Calibrating key derivation for %lu ms ...\n", target_ms);
+  struct cryptParameter params =
+      crypt_calibrateKdf(target_ms / 1000.0, _kdfMemoryBudget());
+  if (params.hash_ops_limit == 0) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  if (kdfConfig_save(params) != OIDC_SUCCESS) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  printStdout("Stored key derivation limits: %d passes over %d MiB\n",
+              params.hash_ops_limit, params.hash_mem_limit / (1024 * 1024));
+  printStdout("They are used for files encrypted from now on. Use "
+              "'oidc-gen -u <shortname>' to re-encrypt existing files.\n");
+}
+
+/**
+ * @brief opens the keystore of the oidc dir or creates a new one
+ * @param password is set to the keystore password
+ */
+static struct keystore* _openOrCreateKeystore(
+    char** password, const struct arguments* arguments) {
+  char* path = concatToOidcDir(KEYSTORE_FILENAME);
+  if (!keystore_exists()) {
+    *password =
+        getEncryptionPasswordFor("the keystore", NULL, arguments->pw_cmd,
+                                 arguments->pw_file, arguments->pw_env);
+    struct keystore* keystore =
+        *password ? keystore_create(path, *password) : NULL;
+    secFree(path);
+    return keystore;
+  }
+  struct keystore* keystore = NULL;
+  unsigned int     i        = 0;
+  while (keystore == NULL) {
+    secFree(*password);
+    *password = getDecryptionPasswordFor("the keystore", arguments->pw_cmd,
+                                         arguments->pw_file, arguments->pw_env,
+                                         0, &i);
+    if (*password == NULL && oidc_errno == OIDC_EMAXTRIES) {
+      break;
+    }
+    keystore = keystore_open(path, *password);
+  }
+  secFree(path);
+  return keystore;
+}
+
+/**
+ * @brief moves all account configuration files into the keystore
+ * Accounts that can be decrypted with the keystore password are moved without
+ * asking for their own password. The files are only removed after the
+ * keystore was written.
+ */
+void gen_handleToKeystore(const struct arguments* arguments) {
+  list_t* files = getAccountConfigFileList();
+  if (files == NULL || files->len == 0) {
+    secFreeList(files);
+    printError("There are no account configuration files\n");
+    exit(EXIT_FAILURE);
+  }
+  char*            password = NULL;
+  struct keystore* keystore = _openOrCreateKeystore(&password, arguments);
+  if (keystore == NULL) {
+    secFree(password);
+    secFreeList(files);
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  list_t* moved = list_new();
+  for (list_node_t* node = files->head; node; node = node->next) {
+    const char* shortname = node->val;
+    char*       config    = decryptOidcFile(shortname, password);
+    if (config == NULL) {
+      config = getDecryptedOidcFileFor(shortname, arguments->pw_cmd,
+                                       arguments->pw_file, arguments->pw_env);
+    }
+    if (config == NULL) {
+      printError("Skipping '%s': %s\n", shortname, oidc_serror());
+      continue;
+    }
+    keystore_putAccount(keystore, shortname, config);
+    secFree(config);
+    list_rpush(moved, list_node_new(node->val));
+  }
+  secFree(password);
+  oidc_error_t e = moved->len ? keystore_save(keystore) : OIDC_SUCCESS;
+  keystore_close(keystore);
+  if (e != OIDC_SUCCESS) {
+    list_destroy(moved);
+    secFreeList(files);
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  for (list_node_t* node = moved->head; node; node = node->next) {
+    removeOidcFile(node->val);
+  }
+  printStdout("Moved %lu account configuration(s) into the keystore\n",
+              (unsigned long)moved->len);
+  list_destroy(moved);
+  secFreeList(files);
+}
+
+/**
+ * A bulk re-encryption decrypts and encrypts the account configuration files
+ * on multiple threads: every file has its own salt, so decrypting it costs a
+ * key derivation of its own. While encrypting, the keys derived from a
+ * password are cached and reused for all files with this password, so one
+ * file per distinct password is encrypted first and the others after that.
+ * Nothing is written before all files were encrypted.
+ */
+struct reencryption {
+  char*          shortname;
+  char*          config;    // the decrypted config; NULL if not decrypted
+  char*          password;  // the old password
+  unsigned char* data;      // the encrypted config
+  size_t         len;
+  char*          error;
+};
+
+struct reencryptionWork {
+  struct reencryption** items;
+  size_t                n;
+  size_t                next;      // the next item; taken atomically
+  const char*           password;  // passed to @c fnc
+  void (*fnc)(struct reencryption*, const char*);
+};
+
+static void _secFreeReencryption(struct reencryption* r) {
+  secFree(r->shortname);
+  secFree(r->config);
+  secFree(r->password);
+  secFree(r->data);
+  secFree(r->error);
+  secFree(r);
+}
+
+static void _decryptForReencryption(struct reencryption* r,
+                                    const char*          password) {
+  char* config = decryptOidcFile(r->shortname, password);
+  if (config) {
+    r->config   = config;
+    r->password = oidc_strcopy(password);
+  }
+}
+
+/**
+ * @param password the new password; @c NULL to keep the old one
+ */
+static void _encryptForReencryption(struct reencryption* r,
+                                    const char*          password) {
+  r->data =
+      encryptForOidcFile(r->config, r->shortname, password ?: r->password,
+                         &r->len);
+  if (r->data == NULL) {
+    r->error = oidc_strcopy(oidc_serror());
+  }
+}
+
+static void* _reencryptionWorker(void* arg) {
+  struct reencryptionWork* work = arg;
+  size_t                   i;
+  while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) <
+         work->n) {
+    work->fnc(work->items[i], work->password);
+  }
+  return NULL;
+}
+
+/**
+ * @brief the number of threads for @p jobs key derivations: one per core, but
+ * only as many as fit into half of the physical memory
+ */
+static size_t _reencryptionThreads(size_t jobs) {
+  long   cores   = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = cores > 0 ? (size_t)cores : 1;
+  size_t mem     = kdfConfig_getParameters().hash_mem_limit;
+  long   pages   = sysconf(_SC_PHYS_PAGES);
+  long   size    = sysconf(_SC_PAGESIZE);
+  if (mem > 0 && pages > 0 && size > 0) {
+    size_t fitting = (size_t)pages / 2 * (size_t)size / mem;
+    if (fitting < threads) {
+      threads = fitting ?: 1;
+    }
+  }
+  return threads < jobs ? threads : jobs;
+}
+
+/**
+ * @brief calls @c work->fnc for all items of @p work on multiple threads,
+ * including the calling one
+ */
+static void _runReencryptionWork(struct reencryptionWork* work) {
+  if (work->n == 0) {
+    return;
+  }
+  size_t     threads = _reencryptionThreads(work->n);
+  pthread_t* tids    = secAlloc(sizeof(pthread_t) * threads);
+  size_t     started = 0;
+  while (started + 1 < threads &&
+         pthread_create(&tids[started], NULL, _reencryptionWorker, work) == 0) {
+    started++;
+  }
+  _reencryptionWorker(work);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  secFree(tids);
+}
+
+/**
+ * @brief the new encryption password for all account configs
+ * @return the password or @c NULL if the files keep their passwords
+ */
+static char* _getNewPasswordForReencryption(const struct arguments* arguments) {
+  if (arguments->new_pw_env) {
+    const char* pass = getenv(arguments->new_pw_env);
+    if (pass == NULL) {
+      printError("Environment variable '%s' is not set\n",
+                 arguments->new_pw_env);
+      exit(EXIT_FAILURE);
+    }
+    return oidc_strcopy(pass);
+  }
+  if (arguments->pw_cmd || arguments->pw_file || arguments->pw_env) {
+    return NULL;  // not interactive
+  }
+  char* password = promptPassword(
+      "Enter new encryption password for all account configurations (leave "
+      "empty to keep their passwords)",
+      "New encryption password", NULL, CLI_PROMPT_VERBOSE);
+  if (!strValid(password)) {
+    secFree(password);
+    return NULL;
+  }
+  char* confirm = promptPassword("Confirm encryption Password",
+                                 "Encryption password", NULL,
+                                 CLI_PROMPT_VERBOSE);
+  if (!strequal(password, confirm)) {
+    printError("Encryption passwords did not match.\n");
+    secFree(password);
+    secFree(confirm);
+    exit(EXIT_FAILURE);
+  }
+  secFree(confirm);
+  return password;
+}
+
+/**
+ * @brief decrypts all account config files and encrypts them again in the
+ * current format, with the current key derivation limits, and optionally with
+ * a new password
+ * The user is asked for further passwords as long as files could not be
+ * decrypted; files that cannot be decrypted are left unchanged. The files are
+ * written in one batch.
+ */
+void gen_handleReencryptAll(const struct arguments* arguments) {
+  list_t* files = getAccountConfigFileList();
+  list_t* items = list_new();
+  items->free   = (void (*)(void*))_secFreeReencryption;
+  for (list_node_t* node = files ? files->head : NULL; node;
+       node              = node->next) {
+    if (!oidcFileDoesExist(node->val)) {  // in the keystore
+      continue;
+    }
+    struct reencryption* r = secAlloc(sizeof(struct reencryption));
+    r->shortname           = oidc_strcopy(node->val);
+    list_rpush(items, list_node_new(r));
+  }
+  secFreeList(files);
+  if (items->len == 0) {
+    secFreeList(items);
+    printError("There are no account configuration files\n");
+    exit(EXIT_FAILURE);
+  }
+  // cached before the threads use them
+  char* oidcDir = getOidcDir();
+  secFree(oidcDir);
+  kdfConfig_getParameters();
+  keyCache_setLifetime((struct lifetimeArg){.lifetime = 0, .argProvided = 1});
+
+  const size_t          n         = items->len;
+  struct reencryption** all       = secAlloc(sizeof(struct reencryption*) * n);
+  struct reencryption** pending   = secAlloc(sizeof(struct reencryption*) * n);
+  size_t                decrypted = 0;
+  for (size_t i = 0; i < n; i++) {
+    all[i] = list_at(items, i)->val;
+  }
+  unsigned int tries = 0;
+  while (decrypted < n) {
+    char* password = getDecryptionPasswordFor(
+        decrypted ? "the remaining account configurations"
+                  : "the account configurations",
+        arguments->pw_cmd, arguments->pw_file, arguments->pw_env, n, &tries);
+    if (!strValid(password)) {
+      secFree(password);
+      break;
+    }
+    struct reencryptionWork work = {pending, 0, 0, password,
+                                    _decryptForReencryption};
+    for (size_t i = 0; i < n; i++) {
+      if (all[i]->config == NULL) {
+        pending[work.n++] = all[i];
+      }
+    }
+    _runReencryptionWork(&work);
+    secFree(password);
+    size_t now = 0;
+    for (size_t i = 0; i < work.n; i++) {
+      now += pending[i]->config != NULL;
+    }
+    decrypted += now;
+    printStdout("Decrypted %lu of %lu account configuration(s)\n",
+                (unsigned long)decrypted, (unsigned long)n);
+  }
+  if (decrypted == 0) {
+    secFree(all);
+    secFree(pending);
+    secFreeList(items);
+    keyCache_setLifetime((struct lifetimeArg){0});
+    printError("Could not decrypt any account configuration\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char* newPassword = _getNewPasswordForReencryption(arguments);
+  // first one file per distinct password, so that its keys are derived once
+  struct reencryption**   others = secAlloc(sizeof(struct reencryption*) * n);
+  struct reencryptionWork first  = {pending, 0, 0, newPassword,
+                                    _encryptForReencryption};
+  struct reencryptionWork rest   = {others, 0, 0, newPassword,
+                                    _encryptForReencryption};
+  for (size_t i = 0; i < n; i++) {
+    struct reencryption* r = all[i];
+    if (r->config == NULL) {
+      printError("Skipping '%s': could not decrypt it\n", r->shortname);
+      continue;
+    }
+    int seen = 0;
+    for (size_t j = 0; j < first.n && !seen; j++) {
+      seen = newPassword || strequal(first.items[j]->password, r->password);
+    }
+    if (seen) {
+      rest.items[rest.n++] = r;
+    } else {
+      first.items[first.n++] = r;
+    }
+  }
+  _runReencryptionWork(&first);
+  _runReencryptionWork(&rest);
+  secFree(others);
+  secFree(newPassword);
+  keyCache_setLifetime((struct lifetimeArg){0});
+
+  int failed = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (all[i]->config && all[i]->data == NULL) {
+      printError("Could not encrypt '%s': %s\n", all[i]->shortname,
+                 all[i]->error);
+      failed = 1;
+    }
+  }
+  oidc_error_t e = OIDC_SUCCESS;
+  if (!failed) {
+    fileIO_beginBatch();
+    for (size_t i = 0; i < n; i++) {
+      if (all[i]->data) {
+        char*        path = concatToOidcDir(all[i]->shortname);
+        oidc_error_t w = writeBinaryFileAtomic(path, all[i]->data, all[i]->len);
+        secFree(path);
+        e = e == OIDC_SUCCESS ? w : e;
+      }
+    }
+    oidc_error_t c = fileIO_commitBatch();
+    e              = e == OIDC_SUCCESS ? c : e;
+  }
+  secFree(all);
+  secFree(pending);
+  secFreeList(items);
+  if (failed) {
+    printError("No account configuration was changed\n");
+    exit(EXIT_FAILURE);
+  }
+  if (e != OIDC_SUCCESS) {
+    oidc_errno = e;
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  printStdout("Re-encrypted %lu account configuration(s)\n",
+              (unsigned long)decrypted);
+}
+
 void gen_handleUpdateConfigFile(const char*             file,
                                 const struct arguments* arguments) {
   if (file == NULL) {
@@ -974,11 +1674,12 @@ void gen_handleUpdateConfigFile(const char*             file,
     }
     exit(write_e);
   }
+  secFree(fileContent);
+  // decrypted from the file, since binary files cannot be read as text
   struct resultWithEncryptionPassword result =
       _getDecryptedTextAndPasswordWithPromptFor(
-          fileContent, file, decryptFileContent, isShortname, arguments->pw_cmd,
-          arguments->pw_file, arguments->pw_env);
-  secFree(fileContent);
+          file, file, isShortname ? decryptOidcFile : decryptFile, isShortname,
+          arguments->pw_cmd, arguments->pw_file, arguments->pw_env);
   if (result.result == NULL) {
     secFree(result.password);
     oidc_perror();
@@ -998,6 +1699,41 @@ void gen_handleUpdateConfigFile(const char*             file,
   exit(write_e);
 }
 
+/**
+ * @brief re-encrypts an encrypted file with its key sealed to this host (TPM2
+ * or Secure Enclave), so that oidc-add and autoloading decrypt it without the
+ * password and without the key derivation; the password keeps working
+ */
+void gen_handleSeal(const char* file, const struct arguments* arguments) {
+  int   isShortname = file[0] != '/' && file[0] != '~';
+  char* filepath    = isShortname ? concatToOidcDir(file) : oidc_strcopy(file);
+  if (!fileDoesExist(filepath)) {
+    printError("No such file: '%s'\n", filepath);
+    secFree(filepath);
+    exit(EXIT_FAILURE);
+  }
+  struct resultWithEncryptionPassword result =
+      _getDecryptedTextAndPasswordWithPromptFor(
+          file, file, isShortname ? decryptOidcFile : decryptFile, isShortname,
+          arguments->pw_cmd, arguments->pw_file, arguments->pw_env);
+  if (result.result == NULL) {
+    secFree(result.password);
+    secFree(filepath);
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  oidc_error_t e =
+      encryptAndWriteToFileSealed(result.result, filepath, result.password);
+  secFree(result.password);
+  secFree(result.result);
+  secFree(filepath);
+  if (e != OIDC_SUCCESS) {
+    oidc_perror();
+    exit(EXIT_FAILURE);
+  }
+  printStdout("Sealed '%s' to this host\n", file);
+}
+
 oidc_error_t gen_handlePublicClient(struct oidc_account* account,
                                     struct arguments*    arguments) {
   arguments->usePublicClient       = 1;
@@ -13,6 +13,7 @@ struct oidc_account* manual_genNewAccount(struct oidc_account*    account,
                                           const struct arguments* arguments,
                                           char**                  cryptPassPtr);
 struct oidc_account* registerClient(struct arguments* arguments);
+void gen_handleRegisterBatch(const struct arguments* arguments);
 void                 handleDelete(const struct arguments*);
 oidc_error_t gen_saveAccountConfig(const char* config, const char* shortname,
                                    const char*             hint,
@@ -34,6 +35,10 @@ void         gen_handleUpdateConfigFile(const char*             file,
                                         const struct arguments* arguments);
 char* gen_handleScopeLookup(const char* issuer_url, const char* cert_path);
 void gen_handleRename(const char* shortname, const struct arguments* arguments);
+void gen_handleCalibrateKdf(unsigned long target_ms);
+void gen_handleToKeystore(const struct arguments* arguments);
+void gen_handleReencryptAll(const struct arguments* arguments);
+void gen_handleSeal(const char* file, const struct arguments* arguments);
 
 void  removeFileFromAgent(const char* filename);
 void  writeFileToAgent(const char* filename, const char* data);
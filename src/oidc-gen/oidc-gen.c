@@ -41,6 +41,22 @@ int main(int argc, char** argv) {
     gen_handlePrint(arguments.print, &arguments);
     exit(EXIT_SUCCESS);
   }
+  if (arguments.calibrate_kdf) {
+    gen_handleCalibrateKdf(arguments.calibrate_kdf);
+    exit(EXIT_SUCCESS);
+  }
+  if (arguments.toKeystore) {
+    gen_handleToKeystore(&arguments);
+    exit(EXIT_SUCCESS);
+  }
+  if (arguments.reencryptAll) {
+    gen_handleReencryptAll(&arguments);
+    exit(EXIT_SUCCESS);
+  }
+  if (arguments.seal) {
+    gen_handleSeal(arguments.seal, &arguments);
+    exit(EXIT_SUCCESS);
+  }
   if (arguments.updateConfigFile) {
     gen_handleUpdateConfigFile(arguments.updateConfigFile, &arguments);
     exit(EXIT_SUCCESS);
@@ -55,6 +71,11 @@ int main(int argc, char** argv) {
   }
   common_assertAgent(0);
 
+  if (arguments.batch) {
+    gen_handleRegisterBatch(&arguments);
+    secFreeList(arguments.flows);
+    exit(EXIT_SUCCESS);
+  }
   if (arguments.state) {
     stateLookUpWithConfigSave(arguments.state, &arguments);
     exit(EXIT_SUCCESS);
@@ -42,6 +42,7 @@
 #define OPT_USERNAME 28
 #define OPT_PASSWORD 29
 #define OPT_PW_FILE 30
+#define OPT_BATCH 31
 // Leave space for Ascii characters
 #define OPT_CONFIRM_YES 128
 #define OPT_CONFIRM_NO 129
@@ -50,6 +51,12 @@
 #define OPT_REFRESHTOKEN_ENV 132
 #define OPT_PW_ENV 133
 #define OPT_NO_SAVE 134
+#define OPT_CALIBRATE_KDF 135
+#define OPT_TO_KEYSTORE 136
+#define OPT_SEAL 137
+#define OPT_RT_POOL 138
+#define OPT_REENCRYPT_ALL 139
+#define OPT_NEW_PW_ENV 140
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "Managing account configurations", 1},
@@ -75,6 +82,30 @@ static struct argp_option options[] = {
      "configuration short name).",
      1},
     {"delete", 'd', 0, 0, "Delete configuration for the given account", 1},
+    {"calibrate-kdf", OPT_CALIBRATE_KDF, "MS", OPTION_ARG_OPTIONAL,
+     "Benchmarks the key derivation on this host and stores key derivation "
+     "limits that take about MS milliseconds (default 500). They are used for "
+     "all files encrypted from now on; existing files can be updated with "
+     "--update.",
+     1},
+    {"to-keystore", OPT_TO_KEYSTORE, 0, 0,
+     "Moves all account configuration files into the keystore, a single file "
+     "encrypted with one password. oidc-add --all and autoloading decrypt the "
+     "accounts of the keystore with a single key derivation.",
+     1},
+    {"seal", OPT_SEAL, "FILE", 0,
+     "Seals the key of the encrypted FILE to this host (TPM2 or Secure "
+     "Enclave), so that it is decrypted without the password and the key "
+     "derivation. The password still decrypts FILE. FILE can be an absolute "
+     "path or the name of a file placed in oidc-dir.",
+     1},
+    {"reencrypt-all", OPT_REENCRYPT_ALL, 0, 0,
+     "Decrypts all account configuration files and encrypts them again in "
+     "parallel, in the current file format and with the current key derivation "
+     "limits. The files are only written after all of them were encrypted. "
+     "Asks for a new encryption password for all of them; see also "
+     "--new-pw-env.",
+     1},
 
     {0, 0, 0, 0, "Generating a new account configuration:", 2},
     {"file", 'f', "FILE", 0,
@@ -83,6 +114,12 @@ static struct argp_option options[] = {
      "Does not use Dynamic Client Registration. Client has to be manually "
      "registered beforehand",
      2},
+    {"batch", OPT_BATCH, "MANIFEST", 0,
+     "Registers clients for all account configurations in MANIFEST, a json "
+     "array of account configurations. Values not given in MANIFEST are taken "
+     "from the command line. The account configurations are saved with one "
+     "encryption password, but not authorized.",
+     2},
     {"no-save", OPT_NO_SAVE, 0, 0,
      "Do not save any configuration files (meaning as soon as the agent stops, "
      "nothing will be saved)",
@@ -160,6 +197,11 @@ static struct argp_option options[] = {
      "variable (default: " OIDC_REFRESHTOKEN_ENV_NAME ")",
      3},
     {"refresh-token-env", OPT_REFRESHTOKEN_ENV, 0, OPTION_ALIAS, NULL, 3},
+    {"rt-pool", OPT_RT_POOL, "N", 0,
+     "Keep N refresh tokens for the account, each obtained by exchanging the "
+     "refresh token (RFC 8693). An agent with multiple workers refreshes "
+     "differently scoped tokens with different refresh tokens in parallel.",
+     3},
     {OPT_LONG_DEVICE, OPT_DEVICE, "ENDPOINT_URI", 0,
      "Use this uri as device authorization endpoint", 3},
     {"device-authorization-endpoint", OPT_DEVICE, 0, OPTION_ALIAS, NULL, 3},
@@ -191,6 +233,11 @@ static struct argp_option options[] = {
      "Reads the encryption password from the passed environment variable "
      "(default: " OIDC_PASSWORD_ENV_NAME "), instead of prompting the user",
      4},
+    {"new-pw-env", OPT_NEW_PW_ENV, OIDC_NEW_PASSWORD_ENV_NAME,
+     OPTION_ARG_OPTIONAL,
+     "Reads the new encryption password for --reencrypt-all from the passed "
+     "environment variable (default: " OIDC_NEW_PASSWORD_ENV_NAME ")",
+     4},
     {"pw-file", OPT_PW_FILE, "FILE", 0,
      "Uses the first line of FILE as the encryption password.", 4},
     {"pw-prompt", OPT_PW_PROMPT_MODE, "cli|gui", 0,
@@ -252,7 +299,10 @@ void initArguments(struct arguments* arguments) {
   arguments->pw_env                        = NULL;
   arguments->pw_cmd                        = NULL;
   arguments->pw_file                       = NULL;
+  arguments->new_pw_env                    = NULL;
   arguments->file                          = NULL;
+  arguments->batch                         = NULL;
+  arguments->seal                          = NULL;
 
   arguments->client_id     = NULL;
   arguments->client_secret = NULL;
@@ -287,6 +337,10 @@ void initArguments(struct arguments* arguments) {
   arguments->confirm_default = 0;
   arguments->only_at         = 0;
   arguments->noSave          = 0;
+  arguments->calibrate_kdf   = 0;
+  arguments->toKeystore      = 0;
+  arguments->reencryptAll    = 0;
+  arguments->rt_pool         = 0;
 
   arguments->pw_prompt_mode = 0;
   set_pw_prompt_mode(arguments->pw_prompt_mode);
@@ -347,6 +401,28 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
     case OPT_PW_ENV: arguments->pw_env = arg ?: OIDC_PASSWORD_ENV_NAME; break;
     case OPT_PW_CMD: arguments->pw_cmd = arg; break;
     case OPT_PW_FILE: arguments->pw_file = arg; break;
+    case OPT_NEW_PW_ENV:
+      arguments->new_pw_env = arg ?: OIDC_NEW_PASSWORD_ENV_NAME;
+      break;
+    case OPT_CALIBRATE_KDF:
+      arguments->calibrate_kdf =
+          arg ? strToULong(arg) : DEFAULT_KDF_CALIBRATION_MS;
+      if (arguments->calibrate_kdf == 0) {
+        printError("MS must be a positive number\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_TO_KEYSTORE: arguments->toKeystore = 1; break;
+    case OPT_REENCRYPT_ALL: arguments->reencryptAll = 1; break;
+    case OPT_SEAL: arguments->seal = arg; break;
+    case OPT_RT_POOL:
+      arguments->rt_pool = strToULong(arg);
+      if (arguments->rt_pool == 0 || arguments->rt_pool > AGENT_MAX_WORKERS) {
+        printError("N must be a number between 1 and %d\n", AGENT_MAX_WORKERS);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_BATCH: arguments->batch = arg; break;
     case OPT_DEVICE: arguments->device_authorization_endpoint = arg; break;
     case OPT_codeExchange: arguments->codeExchange = arg; break;
     case OPT_state: arguments->state = arg; break;
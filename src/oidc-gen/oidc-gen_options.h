@@ -34,7 +34,10 @@ struct arguments {
   char* pw_cmd;
   char* pw_file;
   char* pw_env;
+  char* new_pw_env;
   char* file;
+  char* batch;
+  char* seal;
 
   char* client_id;
   char* client_secret;
@@ -71,6 +74,11 @@ struct arguments {
   unsigned char confirm_default;
   unsigned char only_at;
   unsigned char noSave;
+  unsigned char toKeystore;
+  unsigned char reencryptAll;
+
+  unsigned long calibrate_kdf;
+  unsigned long rt_pool;
 };
 
 void initArguments(struct arguments* arguments);
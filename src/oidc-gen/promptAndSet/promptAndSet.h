@@ -48,10 +48,11 @@ void askName(struct oidc_account*, const struct arguments*);
 void needName(struct oidc_account*, const struct arguments*);
 void askOrNeedName(struct oidc_account*, const struct arguments*, int);
 
-int  readScope(struct oidc_account*, const struct arguments*);
-void askScope(struct oidc_account*, const struct arguments*);
-void needScope(struct oidc_account*, const struct arguments*);
-void askOrNeedScope(struct oidc_account*, const struct arguments*, int);
+int   readScope(struct oidc_account*, const struct arguments*);
+void  askScope(struct oidc_account*, const struct arguments*);
+void  needScope(struct oidc_account*, const struct arguments*);
+void  askOrNeedScope(struct oidc_account*, const struct arguments*, int);
+char* getSupportedScopes(struct oidc_account*, const struct arguments*);
 
 int  readRedirectUris(struct oidc_account*, const struct arguments*);
 void askRedirectUris(struct oidc_account*, const struct arguments*);
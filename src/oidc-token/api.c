@@ -1,29 +1,46 @@
 #include "api.h"
+#include "defines/agent_values.h"
 #include "defines/ipc_values.h"
+#include "defines/settings.h"
 #include "ipc/cryptCommunicator.h"
+#include "ipc/tokenMailbox.h"
 #include "parse.h"
+#include "utils/crypt/crypt.h"
 #include "utils/json.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
 
+#include <poll.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #ifndef API_LOGLEVEL
 #define API_LOGLEVEL NOTICE
 #endif  // API_LOGLEVEL
 
+// The log level is only changed for the calling thread, so that the library
+// can be used from multiple threads
 #ifndef START_APILOGLEVEL
-#define START_APILOGLEVEL int oldLogMask = logger_setloglevel(API_LOGLEVEL);
+#define START_APILOGLEVEL \
+  int oldLogMask = logger_setThreadLoglevel(API_LOGLEVEL);
 #endif
 #ifndef END_APILOGLEVEL
-#define END_APILOGLEVEL logger_setlogmask(oldLogMask);
+#define END_APILOGLEVEL logger_setThreadLogmask(oldLogMask);
 #endif  // END_APILOGLEVEL
 
 #define LOCAL_COMM 0
 #define REMOTE_COMM 1
 
+static unsigned char staleOk        = 0;
+static time_t        requestTimeout = 0;
+
 char* communicate(unsigned char remote, const char* fmt, ...) {
   START_APILOGLEVEL
   if (fmt == NULL) {
@@ -52,9 +69,13 @@ unsigned char _checkLocalResponseForRemote(struct token_response res) {
   return LOCAL_COMM;
 }
 
+/**
+ * @param timeout the seconds the agent has to answer; @c 0 for no timeout
+ */
 char* _getAccessTokenRequest(const char* accountname, const char* issuer,
                              time_t min_valid_period, const char* scope,
-                             const char* hint, const char* audience) {
+                             const char* hint, const char* audience,
+                             time_t timeout) {
   START_APILOGLEVEL
   cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
                                    REQUEST_VALUE_ACCESSTOKEN, IPC_KEY_MINVALID,
@@ -73,6 +94,15 @@ char* _getAccessTokenRequest(const char* accountname, const char* issuer,
   if (strValid(audience)) {
     jsonAddStringValue(json, IPC_KEY_AUDIENCE, audience);
   }
+  if (staleOk && min_valid_period != FORCE_NEW_TOKEN) {
+    jsonAddNumberValue(json, IPC_KEY_STALEOK, 1);
+  }
+  if (timeout) {
+    jsonAddNumberValue(json, IPC_KEY_TIMEOUT, timeout);
+  }
+  if (requestTrace_isActive()) {
+    jsonAddJSON(json, IPC_KEY_TRACE, cJSON_CreateArray());
+  }
   char* ret = jsonToStringUnformatted(json);
   secFreeJson(json);
   logger(DEBUG, "%s", ret);
@@ -84,22 +114,394 @@ char* getAccessTokenRequest(const char* accountname, time_t min_valid_period,
                             const char* scope, const char* hint,
                             const char* audience) {
   return _getAccessTokenRequest(accountname, NULL, min_valid_period, scope,
-                                hint, audience);
+                                hint, audience, requestTimeout);
 }
 
 char* getAccessTokenRequestIssuer(const char* issuer, time_t min_valid_period,
                                   const char* scope, const char* hint,
                                   const char* audience) {
   return _getAccessTokenRequest(NULL, issuer, min_valid_period, scope, hint,
-                                audience);
+                                audience, requestTimeout);
 }
 
+/**
+ * @param death when to give up; @c 0 for the timeout of
+ * @c oidcagent_setTimeout
+ */
 struct token_response _getTokenResponseFromRequest(unsigned char remote,
-                                                   const char*   ipc_request) {
-  char* response = communicate(remote, ipc_request);
+                                                   const char*   ipc_request,
+                                                   time_t        death) {
+  char* response =
+      death ? ipc_cryptCommunicateUntil(remote, death, "%s", ipc_request)
+            : communicate(remote, ipc_request);
   return parseForTokenResponse(response);
 }
 
+/**
+ * The optional in-process token cache. Entries are keyed by everything that
+ * determines the token (account or issuer, scope, audience); the application
+ * hint does not. An entry is only used if it is still valid for the requested
+ * @c min_valid_period, so callers get the same guarantees as from the agent.
+ */
+#define API_TOKENCACHE_MAX 32
+
+struct cachedToken {
+  char*                 key;
+  struct token_response response;
+};
+
+static unsigned char tokenCacheEnabled    = 0;
+static list_t*       tokenCache           = NULL;
+static char          tokenCacheLock       = 0;
+// incremented when the cache is cleared; tokens kept with prepared requests
+// are only used if they were cached in the same generation
+static unsigned long tokenCacheGeneration = 0;
+
+// The cache is shared by all threads of the application
+static void _lockTokenCache() {
+  while (__atomic_test_and_set(&tokenCacheLock, __ATOMIC_ACQUIRE)) {}
+}
+
+static void _unlockTokenCache() {
+  __atomic_clear(&tokenCacheLock, __ATOMIC_RELEASE);
+}
+
+static void _secFreeCachedToken(struct cachedToken* c) {
+  secFree(c->key);
+  secFreeTokenResponse(c->response);
+  secFree(c);
+}
+
+static int _matchCachedToken(const char* key, const struct cachedToken* c) {
+  return strequal(key, c->key);
+}
+
+static char* _tokenKey(const char* accountname, const char* issuer,
+                       const char* scope, const char* audience) {
+  return oidc_sprintf("%s\n%s\n%s\n%s", accountname ?: "", issuer ?: "",
+                      scope ?: "", audience ?: "");
+}
+
+static char* _tokenCacheKey(const char* accountname, const char* issuer,
+                            const char* scope, const char* audience) {
+  if (!tokenCacheEnabled) {
+    return NULL;
+  }
+  return _tokenKey(accountname, issuer, scope, audience);
+}
+
+static struct token_response _getCachedTokenResponse(const char* key,
+                                                     time_t min_valid_period) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (key == NULL || min_valid_period == FORCE_NEW_TOKEN) {
+    return ret;
+  }
+  _lockTokenCache();
+  list_node_t* node = tokenCache ? findInList(tokenCache, key) : NULL;
+  if (node == NULL) {
+    _unlockTokenCache();
+    return ret;
+  }
+  const struct cachedToken* c = node->val;
+  if (c->response.expires_at - time(NULL) < min_valid_period) {
+    list_remove(tokenCache, node);
+    _unlockTokenCache();
+    return ret;
+  }
+  ret.token      = oidc_strcopy(c->response.token);
+  ret.issuer     = oidc_strcopy(c->response.issuer);
+  ret.expires_at = c->response.expires_at;
+  _unlockTokenCache();
+  return ret;
+}
+
+static void _cacheTokenResponse(const char* key, struct token_response res) {
+  if (key == NULL || res.token == NULL || res.expires_at == 0) {
+    return;
+  }
+  struct cachedToken* c  = secAlloc(sizeof(struct cachedToken));
+  c->key                 = oidc_strcopy(key);
+  c->response.token      = oidc_strcopy(res.token);
+  c->response.issuer     = oidc_strcopy(res.issuer);
+  c->response.expires_at = res.expires_at;
+  _lockTokenCache();
+  if (tokenCache == NULL) {
+    tokenCache        = list_new();
+    tokenCache->free  = (void (*)(void*))_secFreeCachedToken;
+    tokenCache->match = (matchFunction)_matchCachedToken;
+  }
+  list_removeIfFound(tokenCache, key);
+  if (tokenCache->len >= API_TOKENCACHE_MAX) {
+    list_remove(tokenCache, tokenCache->head);  // the oldest entry
+  }
+  list_rpush(tokenCache, list_node_new(c));
+  _unlockTokenCache();
+}
+
+/**
+ * @brief removes a cached token, if it is still cached under @p key
+ */
+static void _uncacheToken(const char* key, const char* token) {
+  if (key == NULL) {
+    return;
+  }
+  _lockTokenCache();
+  list_node_t* node = tokenCache ? findInList(tokenCache, key) : NULL;
+  if (node && strequal(((struct cachedToken*)node->val)->response.token,
+                       token)) {
+    list_remove(tokenCache, node);
+  }
+  _unlockTokenCache();
+}
+
+void oidcagent_clearTokenCache() {
+  START_APILOGLEVEL
+  _lockTokenCache();
+  list_t* cache = tokenCache;
+  tokenCache    = NULL;
+  tokenCacheGeneration++;
+  _unlockTokenCache();
+  secFreeList(cache);
+  END_APILOGLEVEL
+}
+
+void oidcagent_setTokenCache(unsigned char enabled) {
+  tokenCacheEnabled = enabled;
+  if (!enabled) {
+    oidcagent_clearTokenCache();
+  }
+}
+
+void oidcagent_setStaleOk(unsigned char enabled) { staleOk = enabled; }
+
+void oidcagent_setTimeout(time_t seconds) {
+  requestTimeout = seconds;
+  ipc_setResponseTimeout(seconds);
+}
+
+/**
+ * @return when a request started now times out; @c 0 if there is no timeout
+ */
+static time_t _requestDeath() {
+  return requestTimeout ? time(NULL) + requestTimeout : 0;
+}
+
+/**
+ * Where requests are sent is set with @c oidcagent_setResolution. Except for
+ * @c OIDCAGENT_RESOLVE_LOCAL and @c OIDCAGENT_RESOLVE_REMOTE the agent that
+ * answered a request for an account or issuer is remembered, so that further
+ * requests for it go straight to that agent; if it does not answer them
+ * anymore, the location is forgotten and the policy is applied again.
+ */
+#define API_LOCATIONS_MAX 32
+
+static enum oidcagent_resolution resolution = OIDCAGENT_RESOLVE_FALLBACK;
+
+struct agentLocation {
+  char*         name;
+  unsigned char remote;
+};
+
+static list_t* locations    = NULL;
+static char    locationLock = 0;
+
+static void _lockLocations() {
+  while (__atomic_test_and_set(&locationLock, __ATOMIC_ACQUIRE)) {}
+}
+
+static void _unlockLocations() {
+  __atomic_clear(&locationLock, __ATOMIC_RELEASE);
+}
+
+static void _secFreeAgentLocation(struct agentLocation* l) {
+  if (l == NULL) {
+    return;
+  }
+  secFree(l->name);
+  secFree(l);
+}
+
+static int _matchAgentLocation(const char*                 name,
+                               const struct agentLocation* l) {
+  return strequal(name, l->name);
+}
+
+static char* _locationName(const char* accountname, const char* issuer) {
+  return strValid(accountname) ? oidc_sprintf("a:%s", accountname)
+                               : oidc_sprintf("i:%s", issuer ?: "");
+}
+
+/**
+ * @return @c LOCAL_COMM or @c REMOTE_COMM if the agent of @p name is known,
+ * otherwise @c -1
+ */
+static int _getAgentLocation(const char* name) {
+  int remote = -1;
+  _lockLocations();
+  list_node_t* node = locations ? findInList(locations, name) : NULL;
+  if (node) {
+    remote = ((struct agentLocation*)node->val)->remote;
+  }
+  _unlockLocations();
+  return remote;
+}
+
+static void _setAgentLocation(const char* name, unsigned char remote) {
+  _lockLocations();
+  if (locations == NULL) {
+    locations        = list_new();
+    locations->free  = (void (*)(void*))_secFreeAgentLocation;
+    locations->match = (matchFunction)_matchAgentLocation;
+  }
+  list_removeIfFound(locations, name);
+  if (locations->len >= API_LOCATIONS_MAX) {
+    list_remove(locations, locations->head);  // the oldest entry
+  }
+  struct agentLocation* l = secAlloc(sizeof(struct agentLocation));
+  l->name                 = oidc_strcopy(name);
+  l->remote               = remote;
+  list_rpush(locations, list_node_new(l));
+  _unlockLocations();
+}
+
+static void _forgetAgentLocation(const char* name) {
+  _lockLocations();
+  if (locations) {
+    list_removeIfFound(locations, name);
+  }
+  _unlockLocations();
+}
+
+void oidcagent_setResolution(enum oidcagent_resolution policy) {
+  resolution = policy;
+  _lockLocations();
+  list_t* l = locations;
+  locations = NULL;
+  _unlockLocations();
+  secFreeList(l);
+}
+
+/**
+ * @brief sends an access token request to the local and the remote agent at
+ * the same time and returns the first successful response
+ * If both fail, the error of the local agent is kept.
+ * @param from is set to the agent that answered
+ * @param death when to give up; @c 0 to wait as long as it takes
+ */
+static struct token_response _raceTokenResponse(const char*    request,
+                                                unsigned char* from,
+                                                time_t         death) {
+  struct ipc_request* requests[2] = {
+      ipc_cryptStartRequest(LOCAL_COMM, request, death), NULL};
+  struct oidc_error_state* localError =
+      requests[LOCAL_COMM] ? NULL : saveErrorState();
+  requests[REMOTE_COMM] = ipc_cryptStartRequest(REMOTE_COMM, request, death);
+  struct token_response ret      = {NULL, NULL, 0};
+  unsigned char         timedOut = 0;
+  while (ret.token == NULL &&
+         (requests[LOCAL_COMM] != NULL || requests[REMOTE_COMM] != NULL)) {
+    struct pollfd pfds[2];
+    nfds_t        n = 0;
+    for (int i = 0; i < 2; i++) {
+      if (requests[i]) {
+        pfds[n++] = (struct pollfd){ipc_requestFd(requests[i]), POLLIN, 0};
+      }
+    }
+    int timeout = -1;
+    if (death) {
+      const time_t left = death - time(NULL);
+      timeout           = left > 0 ? left * 1000 : 0;
+    }
+    if (poll(pfds, n, timeout) == 0) {
+      oidc_errno = OIDC_ETIMEOUT;
+      timedOut   = 1;
+      break;
+    }
+    for (int i = 0; i < 2 && ret.token == NULL; i++) {
+      if (requests[i] == NULL || !ipc_cryptAdvanceRequest(requests[i])) {
+        continue;
+      }
+      struct token_response res =
+          parseForTokenResponse(ipc_cryptFinishRequest(requests[i]));
+      requests[i] = NULL;
+      if (res.token != NULL) {
+        ret   = res;
+        *from = i;
+      } else if (i == LOCAL_COMM) {
+        secFreeErrorState(localError);
+        localError = saveErrorState();
+      }
+    }
+  }
+  ipc_cryptCancelRequest(requests[LOCAL_COMM]);
+  ipc_cryptCancelRequest(requests[REMOTE_COMM]);
+  if (ret.token == NULL && localError && !timedOut) {
+    restoreErrorState(localError);
+  }
+  secFreeErrorState(localError);
+  return ret;
+}
+
+/**
+ * @brief sends an access token request to the local agent and, if the account
+ * is not known there, to the remote agent
+ * @param from is set to the agent that answered
+ * @param death when to give up; @c 0 for the timeout of
+ * @c oidcagent_setTimeout
+ */
+static struct token_response _fallbackTokenResponse(const char*    request,
+                                                    unsigned char* from,
+                                                    time_t         death) {
+  struct token_response ret =
+      _getTokenResponseFromRequest(LOCAL_COMM, request, death);
+  struct oidc_error_state* localError = saveErrorState();
+  *from                               = _checkLocalResponseForRemote(ret);
+  if (*from == REMOTE_COMM) {
+    ret = _getTokenResponseFromRequest(REMOTE_COMM, request, death);
+    if (ret.token == NULL) {
+      restoreErrorState(localError);
+    }
+  }
+  secFreeErrorState(localError);
+  return ret;
+}
+
+/**
+ * @brief sends an access token request for the account or issuer @p location
+ * to the agent chosen by @p policy
+ * @param death when to give up; @c 0 for the timeout of
+ * @c oidcagent_setTimeout
+ */
+static struct token_response _resolveTokenResponse(
+    enum oidcagent_resolution policy, const char* location, const char* request,
+    time_t death) {
+  switch (policy) {
+    case OIDCAGENT_RESOLVE_LOCAL:
+      return _getTokenResponseFromRequest(LOCAL_COMM, request, death);
+    case OIDCAGENT_RESOLVE_REMOTE:
+      return _getTokenResponseFromRequest(REMOTE_COMM, request, death);
+    default: break;
+  }
+  int known = _getAgentLocation(location);
+  if (known >= 0) {
+    struct token_response ret =
+        _getTokenResponseFromRequest(known, request, death);
+    if (ret.token != NULL || !_checkLocalResponseForRemote(ret)) {
+      return ret;
+    }
+    _forgetAgentLocation(location);
+  }
+  unsigned char         from = LOCAL_COMM;
+  struct token_response ret =
+      policy == OIDCAGENT_RESOLVE_RACE
+          ? _raceTokenResponse(request, &from, death ?: _requestDeath())
+          : _fallbackTokenResponse(request, &from, death);
+  if (ret.token != NULL) {
+    _setAgentLocation(location, from);
+  }
+  return ret;
+}
+
 struct token_response getTokenResponse(const char* accountname,
                                        time_t      min_valid_period,
                                        const char* scope,
@@ -114,19 +516,21 @@ struct token_response getTokenResponse3(const char* accountname,
                                         const char* application_hint,
                                         const char* audience) {
   START_APILOGLEVEL
+  char* key = _tokenCacheKey(accountname, NULL, scope, audience);
+  struct token_response ret = _getCachedTokenResponse(key, min_valid_period);
+  if (ret.token != NULL) {
+    secFree(key);
+    END_APILOGLEVEL
+    return ret;
+  }
   char* request = getAccessTokenRequest(accountname, min_valid_period, scope,
                                         application_hint, audience);
-  struct token_response ret = _getTokenResponseFromRequest(LOCAL_COMM, request);
-  struct oidc_error_state* localError = saveErrorState();
-  const unsigned char      remote     = _checkLocalResponseForRemote(ret);
-  if (remote) {
-    ret = _getTokenResponseFromRequest(remote, request);
-    if (ret.token == NULL) {
-      restoreErrorState(localError);
-    }
-  }
-  secFreeErrorState(localError);
+  char* location = _locationName(accountname, NULL);
+  ret            = _resolveTokenResponse(resolution, location, request, 0);
+  secFree(location);
   secFree(request);
+  _cacheTokenResponse(key, ret);
+  secFree(key);
   END_APILOGLEVEL
   return ret;
 }
@@ -145,10 +549,105 @@ struct token_response getTokenResponseForIssuer3(const char* issuer_url,
                                                  const char* application_hint,
                                                  const char* audience) {
   START_APILOGLEVEL
-  char* request = getAccessTokenRequestIssuer(
-      issuer_url, min_valid_period, scope, application_hint, audience);
-  struct token_response ret = _getTokenResponseFromRequest(LOCAL_COMM, request);
-  secFree(request);
+  char* key = _tokenCacheKey(NULL, issuer_url, scope, audience);
+  struct token_response ret = _getCachedTokenResponse(key, min_valid_period);
+  if (ret.token == NULL) {
+    char* request = getAccessTokenRequestIssuer(
+        issuer_url, min_valid_period, scope, application_hint, audience);
+    char* location = _locationName(NULL, issuer_url);
+    ret = _resolveTokenResponse(resolution, location, request, 0);
+    secFree(location);
+    secFree(request);
+    _cacheTokenResponse(key, ret);
+  }
+  secFree(key);
+  END_APILOGLEVEL
+  return ret;
+}
+
+/**
+ * @brief gets an access token for an account or issuer, giving up at
+ * @p deadline
+ * With @c OIDCAGENT_FALLBACK_STALE every token is kept under its key, even if
+ * the token cache is disabled, so that it can be returned if a later request
+ * fails; it is only used that way unless the cache is enabled.
+ */
+static struct token_response _getTokenResponseWithDeadline(
+    const char* accountname, const char* issuer, time_t min_valid_period,
+    const char* scope, const char* application_hint, const char* audience,
+    time_t deadline, unsigned int fallback) {
+  char* key = _tokenKey(accountname, issuer, scope, audience);
+  struct token_response ret = {NULL, NULL, 0};
+  if (tokenCacheEnabled) {
+    ret = _getCachedTokenResponse(key, min_valid_period);
+    if (ret.token != NULL) {
+      secFree(key);
+      return ret;
+    }
+  }
+  const time_t left = deadline ? deadline - time(NULL) : requestTimeout;
+  if (deadline && left <= 0) {
+    oidc_errno = OIDC_ETIMEOUT;
+  } else {
+    char* request =
+        _getAccessTokenRequest(accountname, issuer, min_valid_period, scope,
+                               application_hint, audience, left);
+    char*                     location = _locationName(accountname, issuer);
+    enum oidcagent_resolution policy   = resolution;
+    if (fallback & OIDCAGENT_FALLBACK_REMOTE &&
+        policy == OIDCAGENT_RESOLVE_FALLBACK) {
+      policy = OIDCAGENT_RESOLVE_RACE;
+    }
+    ret = _resolveTokenResponse(policy, location, request, deadline);
+    secFree(location);
+    secFree(request);
+  }
+  if (ret.token != NULL) {
+    if (tokenCacheEnabled || fallback & OIDCAGENT_FALLBACK_STALE) {
+      _cacheTokenResponse(key, ret);
+    }
+  } else if (fallback & OIDCAGENT_FALLBACK_STALE) {
+    struct oidc_error_state* error = saveErrorState();
+    ret                            = _getCachedTokenResponse(key, 0);
+    if (ret.token != NULL) {
+      logger(DEBUG, "Returning a cached access token: %s", oidc_serror());
+    } else {
+      restoreErrorState(error);
+    }
+    secFreeErrorState(error);
+  }
+  secFree(key);
+  return ret;
+}
+
+struct token_response getTokenResponseWithDeadline(
+    const char* accountname, time_t min_valid_period, const char* scope,
+    const char* application_hint, const char* audience, time_t deadline,
+    unsigned int fallback) {
+  if (!strValid(accountname)) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  START_APILOGLEVEL
+  struct token_response ret = _getTokenResponseWithDeadline(
+      accountname, NULL, min_valid_period, scope, application_hint, audience,
+      deadline, fallback);
+  END_APILOGLEVEL
+  return ret;
+}
+
+struct token_response getTokenResponseForIssuerWithDeadline(
+    const char* issuer_url, time_t min_valid_period, const char* scope,
+    const char* application_hint, const char* audience, time_t deadline,
+    unsigned int fallback) {
+  if (!strValid(issuer_url)) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  START_APILOGLEVEL
+  struct token_response ret = _getTokenResponseWithDeadline(
+      NULL, issuer_url, min_valid_period, scope, application_hint, audience,
+      deadline, fallback);
   END_APILOGLEVEL
   return ret;
 }
@@ -196,6 +695,657 @@ char* getAccessTokenForIssuer3(const char* issuer_url, time_t min_valid_period,
   return response.token;
 }
 
+struct token_response* getTokenResponses(const struct token_request* requests,
+                                         size_t                      count,
+                                         const char* application_hint) {
+  if (requests == NULL || count == 0) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  cJSON* array = cJSON_CreateArray();
+  for (size_t i = 0; i < count; i++) {
+    char* request = _getAccessTokenRequest(
+        requests[i].accountname, requests[i].issuer_url,
+        requests[i].min_valid_period, requests[i].scope, application_hint,
+        requests[i].audience, requestTimeout);
+    cJSON_AddItemToArray(array, stringToJson(request));
+    secFree(request);
+  }
+  cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                   REQUEST_VALUE_ACCESSTOKEN_BATCH, NULL);
+  jsonAddJSON(json, IPC_KEY_REQUESTS, array);
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  char* response = communicate(LOCAL_COMM, "%s", request);
+  secFree(request);
+  struct token_response* ret = parseForTokenResponses(response, count);
+  END_APILOGLEVEL
+  return ret;
+}
+
+static void _reportError(struct oidcagent_error* error, unsigned char failed) {
+  if (error == NULL) {
+    return;
+  }
+  *error = (struct oidcagent_error){0};
+  if (failed) {
+    error->code = oidc_errno ?: OIDC_EERROR;
+    strncpy(error->message, oidc_serror(), sizeof(error->message) - 1);
+  }
+}
+
+struct token_response getTokenResponseWithError(
+    const struct token_request* request, const char* application_hint,
+    struct oidcagent_error* error) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    _reportError(error, 1);
+    return ret;
+  }
+  if (strValid(request->accountname)) {
+    ret = getTokenResponse3(request->accountname, request->min_valid_period,
+                            request->scope, application_hint,
+                            request->audience);
+  } else {
+    ret = getTokenResponseForIssuer3(request->issuer_url,
+                                     request->min_valid_period, request->scope,
+                                     application_hint, request->audience);
+  }
+  _reportError(error, ret.token == NULL);
+  return ret;
+}
+
+void secFreeTokenResponses(struct token_response* responses, size_t count) {
+  if (responses == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    secFreeTokenResponse(responses[i]);
+  }
+  secFree(responses);
+}
+
+struct agent_session {
+  struct ipc_session* ipc;
+};
+
+struct agent_session* openAgentSession() {
+  START_APILOGLEVEL
+  struct ipc_session* ipc = ipc_cryptOpenSession(LOCAL_COMM);
+  if (ipc == NULL) {
+    END_APILOGLEVEL
+    return NULL;
+  }
+  struct agent_session* session = secAlloc(sizeof(struct agent_session));
+  session->ipc                  = ipc;
+  END_APILOGLEVEL
+  return session;
+}
+
+struct token_response _getTokenResponseFromSession(
+    struct agent_session* session, const char* ipc_request) {
+  if (session == NULL || ipc_request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  char* response = ipc_cryptCommunicateInSession(session->ipc, ipc_request);
+  return parseForTokenResponse(response);
+}
+
+struct token_response getTokenResponseFromSession(
+    struct agent_session* session, const char* accountname,
+    time_t min_valid_period, const char* scope, const char* application_hint,
+    const char* audience) {
+  START_APILOGLEVEL
+  char* key = _tokenCacheKey(accountname, NULL, scope, audience);
+  struct token_response ret = _getCachedTokenResponse(key, min_valid_period);
+  if (ret.token == NULL) {
+    char* request = getAccessTokenRequest(accountname, min_valid_period, scope,
+                                          application_hint, audience);
+    ret = _getTokenResponseFromSession(session, request);
+    secFree(request);
+    _cacheTokenResponse(key, ret);
+  }
+  secFree(key);
+  END_APILOGLEVEL
+  return ret;
+}
+
+struct token_response getTokenResponseForIssuerFromSession(
+    struct agent_session* session, const char* issuer_url,
+    time_t min_valid_period, const char* scope, const char* application_hint,
+    const char* audience) {
+  START_APILOGLEVEL
+  char* key = _tokenCacheKey(NULL, issuer_url, scope, audience);
+  struct token_response ret = _getCachedTokenResponse(key, min_valid_period);
+  if (ret.token == NULL) {
+    char* request = getAccessTokenRequestIssuer(
+        issuer_url, min_valid_period, scope, application_hint, audience);
+    ret = _getTokenResponseFromSession(session, request);
+    secFree(request);
+    _cacheTokenResponse(key, ret);
+  }
+  secFree(key);
+  END_APILOGLEVEL
+  return ret;
+}
+
+char* getAccessTokenFromSession(struct agent_session* session,
+                                const char* accountname,
+                                time_t min_valid_period, const char* scope,
+                                const char* application_hint,
+                                const char* audience) {
+  START_APILOGLEVEL
+  struct token_response response = getTokenResponseFromSession(
+      session, accountname, min_valid_period, scope, application_hint,
+      audience);
+  secFree(response.issuer);
+  END_APILOGLEVEL
+  return response.token;
+}
+
+void closeAgentSession(struct agent_session* session) {
+  if (session == NULL) {
+    return;
+  }
+  START_APILOGLEVEL
+  ipc_cryptCloseSession(session->ipc);
+  secFree(session);
+  END_APILOGLEVEL
+}
+
+struct oidcagent_prepared {
+  char*                 request;
+  char*                 location;
+  time_t                min_valid_period;
+  struct token_response cached;
+  unsigned long         cached_generation;
+};
+
+struct oidcagent_prepared* oidcagent_prepare(const char* accountname,
+                                             const char* scope,
+                                             const char* audience,
+                                             const char* application_hint,
+                                             time_t      min_valid_period) {
+  if (accountname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  struct oidcagent_prepared* prepared =
+      secAlloc(sizeof(struct oidcagent_prepared));
+  prepared->min_valid_period = min_valid_period;
+  prepared->location         = _locationName(accountname, NULL);
+  prepared->request          = getAccessTokenRequest(
+      accountname, min_valid_period, scope, application_hint, audience);
+  if (prepared->request == NULL) {
+    secFree(prepared->location);
+    secFree(prepared);
+    END_APILOGLEVEL
+    return NULL;
+  }
+  END_APILOGLEVEL
+  return prepared;
+}
+
+/**
+ * @brief returns the cached token of @p prepared if it is still valid for the
+ * requested period
+ */
+static struct token_response _getPreparedCachedToken(
+    const struct oidcagent_prepared* prepared) {
+  const struct token_response* c = &prepared->cached;
+  if (!tokenCacheEnabled || c->token == NULL ||
+      prepared->cached_generation !=
+          __atomic_load_n(&tokenCacheGeneration, __ATOMIC_RELAXED) ||
+      prepared->min_valid_period == FORCE_NEW_TOKEN ||
+      c->expires_at - time(NULL) < prepared->min_valid_period) {
+    return (struct token_response){NULL, NULL, 0};
+  }
+  return (struct token_response){oidc_strcopy(c->token),
+                                 oidc_strcopy(c->issuer), c->expires_at};
+}
+
+struct token_response oidcagent_fetch(struct oidcagent_prepared* prepared) {
+  if (prepared == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  START_APILOGLEVEL
+  struct token_response ret = _getPreparedCachedToken(prepared);
+  if (ret.token != NULL) {
+    END_APILOGLEVEL
+    return ret;
+  }
+  ret = _resolveTokenResponse(resolution, prepared->location,
+                              prepared->request, 0);
+  if (tokenCacheEnabled && ret.token != NULL && ret.expires_at != 0) {
+    secFreeTokenResponse(prepared->cached);
+    prepared->cached = (struct token_response){
+        oidc_strcopy(ret.token), oidc_strcopy(ret.issuer), ret.expires_at};
+    prepared->cached_generation =
+        __atomic_load_n(&tokenCacheGeneration, __ATOMIC_RELAXED);
+  }
+  END_APILOGLEVEL
+  return ret;
+}
+
+void oidcagent_freePrepared(struct oidcagent_prepared* prepared) {
+  if (prepared == NULL) {
+    return;
+  }
+  START_APILOGLEVEL
+  secFree(prepared->request);
+  secFree(prepared->location);
+  secFreeTokenResponse(prepared->cached);
+  secFree(prepared);
+  END_APILOGLEVEL
+}
+
+struct oidcagent_request {
+  struct ipc_request*   ipc;
+  char*                 key;
+  struct token_response cached;
+};
+
+struct oidcagent_request* oidcagent_request_start(
+    const struct token_request* request, const char* application_hint) {
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  char* key = _tokenCacheKey(request->accountname, request->issuer_url,
+                             request->scope, request->audience);
+  struct token_response cached =
+      _getCachedTokenResponse(key, request->min_valid_period);
+  struct ipc_request* ipc = NULL;
+  if (cached.token == NULL) {
+    char* ipc_request = _getAccessTokenRequest(
+        request->accountname, request->issuer_url, request->min_valid_period,
+        request->scope, application_hint, request->audience, requestTimeout);
+    ipc = ipc_cryptStartRequest(LOCAL_COMM, ipc_request, _requestDeath());
+    secFree(ipc_request);
+    if (ipc == NULL) {
+      secFree(key);
+      END_APILOGLEVEL
+      return NULL;
+    }
+  }
+  struct oidcagent_request* ret = secAlloc(sizeof(struct oidcagent_request));
+  ret->ipc                      = ipc;
+  ret->key                      = key;
+  ret->cached                   = cached;
+  END_APILOGLEVEL
+  return ret;
+}
+
+int oidcagent_request_fd(const struct oidcagent_request* request) {
+  return request ? ipc_requestFd(request->ipc) : -1;
+}
+
+int oidcagent_request_poll(struct oidcagent_request* request) {
+  if (request == NULL || request->ipc == NULL) {
+    return 1;
+  }
+  START_APILOGLEVEL
+  int done = ipc_cryptAdvanceRequest(request->ipc);
+  END_APILOGLEVEL
+  return done;
+}
+
+struct token_response oidcagent_request_finish(
+    struct oidcagent_request* request) {
+  if (request == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  START_APILOGLEVEL
+  struct token_response ret = request->cached;
+  if (request->ipc != NULL) {
+    ret = parseForTokenResponse(ipc_cryptFinishRequest(request->ipc));
+    _cacheTokenResponse(request->key, ret);
+  }
+  secFree(request->key);
+  secFree(request);
+  END_APILOGLEVEL
+  return ret;
+}
+
+void oidcagent_request_cancel(struct oidcagent_request* request) {
+  if (request == NULL) {
+    return;
+  }
+  START_APILOGLEVEL
+  ipc_cryptCancelRequest(request->ipc);
+  secFreeTokenResponse(request->cached);
+  secFree(request->key);
+  secFree(request);
+  END_APILOGLEVEL
+}
+
+int oidcagent_hint_need(const char* accountname, const char* scope,
+                        const char* audience, time_t when, time_t duration) {
+  if (!strValid(accountname)) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  START_APILOGLEVEL
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_PREFETCH, IPC_KEY_SHORTNAME,
+      cJSON_String, accountname, IPC_KEY_WHEN, cJSON_Number, (long)when,
+      IPC_KEY_DURATION, cJSON_Number, (long)duration, NULL);
+  if (strValid(scope)) {
+    jsonAddStringValue(json, OIDC_KEY_SCOPE, scope);
+  }
+  if (strValid(audience)) {
+    jsonAddStringValue(json, IPC_KEY_AUDIENCE, audience);
+  }
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  int ret = parseForStatus(communicate(LOCAL_COMM, "%s", request));
+  secFree(request);
+  END_APILOGLEVEL
+  return ret;
+}
+
+int oidcagent_stageToken(const struct token_request* request,
+                         struct token_response       response) {
+  if (request == NULL || response.token == NULL ||
+      (!strValid(request->accountname) && !strValid(request->issuer_url))) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  START_APILOGLEVEL
+  char* token_request = _getAccessTokenRequest(
+      request->accountname, request->issuer_url, request->min_valid_period,
+      request->scope, NULL, request->audience, requestTimeout);
+  char* token_response =
+      oidc_sprintf(RESPONSE_STATUS_ACCESS, STATUS_SUCCESS, response.token,
+                   response.issuer ?: "", (unsigned long)response.expires_at);
+  cJSON* json = generateJSONObject(IPC_KEY_REQUEST, cJSON_String,
+                                   REQUEST_VALUE_STAGE, NULL);
+  jsonAddJSON(json, IPC_KEY_TOKENREQUEST, stringToJson(token_request));
+  jsonAddJSON(json, IPC_KEY_TOKENRESPONSE, stringToJson(token_response));
+  secFree(token_request);
+  secFree(token_response);
+  char* stage = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  int ret = parseForStatus(communicate(LOCAL_COMM, "%s", stage));
+  secFree(stage);
+  END_APILOGLEVEL
+  return ret;
+}
+
+char* getUserinfo(const char* accountname, const char* application_hint) {
+  if (!strValid(accountname)) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_USERINFO, IPC_KEY_SHORTNAME,
+      cJSON_String, accountname, NULL);
+  if (strValid(application_hint)) {
+    jsonAddStringValue(json, IPC_KEY_APPLICATIONHINT, application_hint);
+  }
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  char* userinfo = parseForInfo(communicate(LOCAL_COMM, "%s", request));
+  secFree(request);
+  END_APILOGLEVEL
+  return userinfo;
+}
+
+char* oidcagent_validate(const char* token, const char* audience) {
+  if (!strValid(token)) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_VALIDATE,
+      OIDC_KEY_ACCESSTOKEN, cJSON_String, token, NULL);
+  if (strValid(audience)) {
+    jsonAddStringValue(json, IPC_KEY_AUDIENCE, audience);
+  }
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  char* claims = parseForInfo(communicate(LOCAL_COMM, "%s", request));
+  secFree(request);
+  END_APILOGLEVEL
+  return claims;
+}
+
+struct token_response oidcagent_tokenRejected(const char* accountname,
+                                              const char* token,
+                                              const char* scope,
+                                              const char* application_hint,
+                                              const char* audience) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (!strValid(accountname) || !strValid(token)) {
+    oidc_setArgNullFuncError(__func__);
+    return ret;
+  }
+  START_APILOGLEVEL
+  char* token_hash = s256(token);
+  if (token_hash == NULL) {
+    END_APILOGLEVEL
+    return ret;
+  }
+  char* key = _tokenCacheKey(accountname, NULL, scope, audience);
+  _uncacheToken(key, token);
+  cJSON* json = generateJSONObject(
+      IPC_KEY_REQUEST, cJSON_String, REQUEST_VALUE_TOKENREJECTED,
+      IPC_KEY_SHORTNAME, cJSON_String, accountname, IPC_KEY_TOKENHASH,
+      cJSON_String, token_hash, NULL);
+  secFree(token_hash);
+  if (strValid(scope)) {
+    jsonAddStringValue(json, OIDC_KEY_SCOPE, scope);
+  }
+  if (strValid(audience)) {
+    jsonAddStringValue(json, IPC_KEY_AUDIENCE, audience);
+  }
+  if (strValid(application_hint)) {
+    jsonAddStringValue(json, IPC_KEY_APPLICATIONHINT, application_hint);
+  }
+  char* request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  char* location = _locationName(accountname, NULL);
+  ret            = _resolveTokenResponse(resolution, location, request, 0);
+  secFree(location);
+  secFree(request);
+  _cacheTokenResponse(key, ret);
+  secFree(key);
+  END_APILOGLEVEL
+  return ret;
+}
+
+struct oidcagent_subscription {
+  struct ipc_session* ipc;
+  char*               key;  // key of the account in the token cache
+};
+
+struct oidcagent_subscription* oidcagent_subscribe(
+    const char* accountname, time_t min_valid_period,
+    const char* application_hint, struct token_response* current) {
+  if (!strValid(accountname)) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  START_APILOGLEVEL
+  struct ipc_session* ipc = ipc_cryptOpenSession(LOCAL_COMM);
+  if (ipc == NULL) {
+    END_APILOGLEVEL
+    return NULL;
+  }
+  char*  request = getAccessTokenRequest(accountname, min_valid_period, NULL,
+                                         application_hint, NULL);
+  cJSON* json    = stringToJson(request);
+  secFree(request);
+  setJSONValue(json, IPC_KEY_REQUEST, REQUEST_VALUE_SUBSCRIBE);
+  request = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  struct token_response ret =
+      parseForTokenResponse(ipc_cryptCommunicateInSession(ipc, "%s", request));
+  secFree(request);
+  if (ret.token == NULL) {
+    ipc_cryptCloseSession(ipc);
+    END_APILOGLEVEL
+    return NULL;
+  }
+  struct oidcagent_subscription* subscription =
+      secAlloc(sizeof(struct oidcagent_subscription));
+  subscription->ipc = ipc;
+  subscription->key = _tokenCacheKey(accountname, NULL, NULL, NULL);
+  _cacheTokenResponse(subscription->key, ret);
+  if (current) {
+    *current = ret;
+  } else {
+    secFreeTokenResponse(ret);
+  }
+  END_APILOGLEVEL
+  return subscription;
+}
+
+int oidcagent_subscription_fd(
+    const struct oidcagent_subscription* subscription) {
+  return subscription ? *(subscription->ipc->con.sock) : -1;
+}
+
+struct token_response oidcagent_subscription_next(
+    struct oidcagent_subscription* subscription) {
+  if (subscription == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return (struct token_response){NULL, NULL, 0};
+  }
+  START_APILOGLEVEL
+  struct token_response ret =
+      parseForTokenResponse(ipc_cryptReadInSession(subscription->ipc));
+  _cacheTokenResponse(subscription->key, ret);
+  END_APILOGLEVEL
+  return ret;
+}
+
+void oidcagent_unsubscribe(struct oidcagent_subscription* subscription) {
+  if (subscription == NULL) {
+    return;
+  }
+  START_APILOGLEVEL
+  ipc_cryptCloseSession(subscription->ipc);
+  secFree(subscription->key);
+  secFree(subscription);
+  END_APILOGLEVEL
+}
+
+/**
+ * The mapped token mailboxes; a mailbox is mapped on its first read and kept,
+ * so that further reads do not need any system call. The mailboxes are named
+ * after the socket of the agent, so a different agent uses different ones.
+ */
+struct mappedMailbox {
+  char*                      name;
+  const struct tokenMailbox* mailbox;
+};
+
+static list_t* mappedMailboxes = NULL;
+static char    mailboxLock     = 0;
+
+static void _lockMailboxes() {
+  while (__atomic_test_and_set(&mailboxLock, __ATOMIC_ACQUIRE)) {}
+}
+
+static void _unlockMailboxes() {
+  __atomic_clear(&mailboxLock, __ATOMIC_RELEASE);
+}
+
+static void _secFreeMappedMailbox(struct mappedMailbox* m) {
+  tokenMailbox_close(m->mailbox);
+  secFree(m->name);
+  secFree(m);
+}
+
+static int _matchMappedMailbox(const char*                 name,
+                               const struct mappedMailbox* m) {
+  return strequal(name, m->name);
+}
+
+/**
+ * @brief maps the mailbox @p name of the agent listening on @p socket_path
+ * Must be called with the mailbox lock held.
+ */
+static struct mappedMailbox* _mapMailbox(const char* name,
+                                         const char* socket_path) {
+  struct stat st;
+  if (stat(socket_path, &st) != 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  const struct tokenMailbox* mailbox = tokenMailbox_open(name, st.st_uid);
+  if (mailbox == NULL) {
+    return NULL;
+  }
+  if (mappedMailboxes == NULL) {
+    mappedMailboxes        = list_new();
+    mappedMailboxes->free  = (void (*)(void*))_secFreeMappedMailbox;
+    mappedMailboxes->match = (matchFunction)_matchMappedMailbox;
+  }
+  struct mappedMailbox* m = secAlloc(sizeof(struct mappedMailbox));
+  m->name                 = oidc_strcopy(name);
+  m->mailbox              = mailbox;
+  list_rpush(mappedMailboxes, list_node_new(m));
+  return m;
+}
+
+struct token_response oidcagent_mailbox_read(const char* accountname,
+                                             time_t      min_valid_period) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (accountname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return ret;
+  }
+  const char* socket_path = getenv(OIDC_SOCK_ENV_NAME);
+  if (!strValid(socket_path)) {
+    oidc_errno = OIDC_EMAILBOX;
+    return ret;
+  }
+  char* name = tokenMailbox_name(socket_path, accountname);
+  if (name == NULL) {
+    return ret;
+  }
+  START_APILOGLEVEL
+  _lockMailboxes();
+  list_node_t* node =
+      mappedMailboxes ? findInList(mappedMailboxes, name) : NULL;
+  struct mappedMailbox* m = node ? node->val : _mapMailbox(name, socket_path);
+  unsigned long expires_at = 0;
+  int rc = m ? tokenMailbox_read(m->mailbox, min_valid_period, &ret.token,
+                                 &ret.issuer, &expires_at)
+             : oidc_errno;
+  if (rc != OIDC_SUCCESS && node != NULL &&
+      __atomic_load_n(&m->mailbox->closed, __ATOMIC_RELAXED)) {
+    // the agent was restarted; map its new mailbox once
+    list_remove(mappedMailboxes, node);
+    m  = _mapMailbox(name, socket_path);
+    rc = m ? tokenMailbox_read(m->mailbox, min_valid_period, &ret.token,
+                               &ret.issuer, &expires_at)
+           : oidc_errno;
+  }
+  _unlockMailboxes();
+  if (rc == OIDC_SUCCESS) {
+    ret.expires_at = expires_at;
+  } else if (oidc_errno != OIDC_EMAILBOX) {
+    logger(DEBUG, "No token mailbox for '%s': %s", accountname,
+           oidc_serror());
+    oidc_errno = OIDC_EMAILBOX;
+  }
+  END_APILOGLEVEL
+  secFree(name);
+  return ret;
+}
+
 char* oidcagent_serror() { return oidc_serror(); }
 
 void oidcagent_perror() { oidc_perror(); }
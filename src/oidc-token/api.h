@@ -3,6 +3,7 @@
 
 #include "export_symbols.h"
 
+#include <stddef.h>
 #include <time.h>
 
 /**
@@ -214,6 +215,582 @@ LIB_PUBLIC struct token_response getTokenResponseForIssuer3(
     const char* issuer_url, time_t min_valid_period, const char* scope,
     const char* application_hint, const char* audience);
 
+/**
+ * @struct token_request api.h
+ * @brief a struct describing one access token request of a batch
+ * Either @c accountname or @c issuer_url has to be set; @c scope and
+ * @c audience might be @c NULL.
+ */
+LIB_PUBLIC struct token_request {
+  const char* accountname;
+  const char* issuer_url;
+  time_t      min_valid_period;
+  const char* scope;
+  const char* audience;
+};
+
+/**
+ * @brief gets valid access tokens for multiple account configs or providers in
+ * a single request to oidc-agent
+ * Tokens that are cached by the agent are returned immediately, refreshes for
+ * the other ones are done by the agent.
+ * @param requests an array of token requests
+ * @param count the number of elements in @p requests
+ * @param application_hint a hint indicating what application requests the
+ * access tokens. This string might be displayed to the user.
+ * @return an array of @p count token_response structs in the same order as
+ * @p requests. The token of a failed request is @c NULL; in that case
+ * @c oidc_errno is set to the error of the first failed request. Has to be
+ * freed after usage using the @c secFreeTokenResponses function. If the whole
+ * batch failed @c NULL is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response* getTokenResponses(
+    const struct token_request* requests, size_t count,
+    const char* application_hint);
+
+/**
+ * @struct oidcagent_error api.h
+ * @brief the error of a single call
+ * Filled by the functions that report their error to the caller directly; the
+ * other functions report it with @c oidcagent_serror, which is also kept per
+ * thread.
+ */
+LIB_PUBLIC struct oidcagent_error {
+  int  code;  // @c 0 on success
+  char message[1024];
+};
+
+/**
+ * @brief gets a valid access token for an account config or a provider as
+ * well as related information and reports the error of this call in @p error
+ * @param request the token request; either @c accountname or @c issuer_url
+ * has to be set
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param error is set to the error of this call; might be @c NULL
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned.
+ */
+LIB_PUBLIC struct token_response getTokenResponseWithError(
+    const struct token_request* request, const char* application_hint,
+    struct oidcagent_error* error);
+
+/**
+ * @brief clears and frees an array of token_response structs as returned by
+ * @c getTokenResponses
+ * @param responses the array to be freed
+ * @param count the number of elements in @p responses
+ */
+LIB_PUBLIC void secFreeTokenResponses(struct token_response* responses,
+                                      size_t                 count);
+
+/**
+ * @struct agent_session api.h
+ * @brief an opaque handle for a connection to oidc-agent that stays open for
+ * multiple requests
+ */
+struct agent_session;
+
+/**
+ * @brief opens a session with oidc-agent
+ * A session keeps one encrypted connection open, so that multiple requests do
+ * not have to connect and exchange keys again. This is useful for long running
+ * applications that request many access tokens.
+ * @return a pointer to the session. Has to be closed after usage using
+ * @c closeAgentSession function. On failure @c NULL is returned and
+ * @c oidc_errno is set.
+ */
+LIB_PUBLIC struct agent_session* openAgentSession();
+
+/**
+ * @brief gets a valid access token for an account config as well as related
+ * information using an open session
+ * @param session the session opened with @c openAgentSession
+ * @param accountname the short name of the account config for which an access
+ * token should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration should
+ * be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param audience Use this parameter to request an access token with this
+ * specific audience. Can be a space separated list. @c NULL if no special
+ * audience should be requested.
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response getTokenResponseFromSession(
+    struct agent_session* session, const char* accountname,
+    time_t min_valid_period, const char* scope, const char* application_hint,
+    const char* audience);
+
+/**
+ * @brief gets a valid access token for a specific provider as well as related
+ * information using an open session
+ * @param session the session opened with @c openAgentSession
+ * @param issuer_url the issuer url of the provider for which an access token
+ * should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for the used account configuration
+ * should be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param audience Use this parameter to request an access token with this
+ * specific audience. Can be a space separated list. @c NULL if no special
+ * audience should be requested.
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response getTokenResponseForIssuerFromSession(
+    struct agent_session* session, const char* issuer_url,
+    time_t min_valid_period, const char* scope, const char* application_hint,
+    const char* audience);
+
+/**
+ * @brief gets a valid access token for an account config using an open
+ * session
+ * @param session the session opened with @c openAgentSession
+ * @param accountname the short name of the account config for which an access
+ * token should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration should
+ * be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param audience Use this parameter to request an access token with this
+ * specific audience. Can be a space separated list. @c NULL if no special
+ * audience should be requested.
+ * @return a pointer to the access token. Has to be freed after usage using
+ * @c secFree function. On failure @c NULL is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC char* getAccessTokenFromSession(struct agent_session* session,
+                                           const char*           accountname,
+                                           time_t      min_valid_period,
+                                           const char* scope,
+                                           const char* application_hint,
+                                           const char* audience);
+
+/**
+ * @brief closes a session with oidc-agent and frees it
+ * @param session the session to be closed; might be @c NULL
+ */
+LIB_PUBLIC void closeAgentSession(struct agent_session* session);
+
+/**
+ * @struct oidcagent_prepared api.h
+ * @brief an opaque handle for an access token request that is sent repeatedly
+ */
+struct oidcagent_prepared;
+
+/**
+ * @brief prepares an access token request for an account config
+ * The request is built once and sent as is by every @c oidcagent_fetch. If the
+ * in-process token cache is enabled, the last token is kept with the handle.
+ * The setting of @c oidcagent_setStaleOk at the time of preparing applies. A
+ * handle must not be used by multiple threads at the same time.
+ * @param accountname the short name of the account config for which access
+ * tokens should be returned
+ * @param scope a space delimited list of scope values for the to be issued
+ * access tokens. @c NULL if default value for that account configuration
+ * should be used.
+ * @param audience Use this parameter to request access tokens with this
+ * specific audience. Can be a space separated list. @c NULL if no special
+ * audience should be requested.
+ * @param application_hint a hint indicating what application requests the
+ * access tokens. This string might be displayed to the user.
+ * @param min_valid_period the minium period of time the access tokens have to
+ * be valid in seconds
+ * @return a pointer to the handle. Has to be freed after usage using
+ * @c oidcagent_freePrepared. On failure @c NULL is returned and @c oidc_errno
+ * is set.
+ */
+LIB_PUBLIC struct oidcagent_prepared* oidcagent_prepare(
+    const char* accountname, const char* scope, const char* audience,
+    const char* application_hint, time_t min_valid_period);
+
+/**
+ * @brief gets a valid access token for a prepared request
+ * @param prepared the handle returned by @c oidcagent_prepare
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response oidcagent_fetch(
+    struct oidcagent_prepared* prepared);
+
+/**
+ * @brief frees a prepared request
+ * @param prepared the handle to be freed; might be @c NULL
+ */
+LIB_PUBLIC void oidcagent_freePrepared(struct oidcagent_prepared* prepared);
+
+/**
+ * @struct oidcagent_request api.h
+ * @brief an opaque handle for an access token request that is done without
+ * blocking
+ */
+struct oidcagent_request;
+
+/**
+ * @brief starts an access token request to the local agent without waiting
+ * for the response
+ * The request is advanced with @c oidcagent_request_poll whenever the file
+ * descriptor returned by @c oidcagent_request_fd is readable, so many requests
+ * can be done on a single thread of an event loop.
+ * @param request the token request; either @c accountname or @c issuer_url
+ * has to be set
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @return a pointer to the request. Has to be freed using
+ * @c oidcagent_request_finish or @c oidcagent_request_cancel. If the agent
+ * cannot be reached @c NULL is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct oidcagent_request* oidcagent_request_start(
+    const struct token_request* request, const char* application_hint);
+
+/**
+ * @brief returns the file descriptor to wait on for readability
+ * The file descriptor stays valid until the request is finished or cancelled.
+ * @param request the request returned by @c oidcagent_request_start
+ * @return the file descriptor or @c -1 if the request does not have to wait,
+ * e.g. because it was answered from the in-process token cache
+ */
+LIB_PUBLIC int oidcagent_request_fd(const struct oidcagent_request* request);
+
+/**
+ * @brief advances a request if its file descriptor is readable; never blocks
+ * @param request the request returned by @c oidcagent_request_start
+ * @return @c 1 if the request is done and @c oidcagent_request_finish returns
+ * its result without waiting; @c 0 if it still waits for the agent
+ */
+LIB_PUBLIC int oidcagent_request_poll(struct oidcagent_request* request);
+
+/**
+ * @brief returns the result of a request and frees the request
+ * If the request is not done yet, this waits for it.
+ * @param request the request returned by @c oidcagent_request_start
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response oidcagent_request_finish(
+    struct oidcagent_request* request);
+
+/**
+ * @brief aborts a request and frees it
+ * @param request the request to be aborted; might be @c NULL
+ */
+LIB_PUBLIC void oidcagent_request_cancel(struct oidcagent_request* request);
+
+/**
+ * @brief tells the agent that an access token will be needed at a certain time
+ * The agent keeps the token valid from shortly before @p when until
+ * @p duration seconds later, so that requests for it in that window, e.g. by
+ * many jobs starting at once, are answered from its cache. The account config
+ * is loaded if necessary. Only the local agent is used.
+ * @param accountname the short name of the account config
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for that account configuration should
+ * be used.
+ * @param audience Use this parameter to request an access token with this
+ * specific audience. Can be a space separated list. @c NULL if no special
+ * audience should be requested.
+ * @param when the point in time from which on the access token is needed
+ * @param duration the number of seconds for which the access token is needed
+ * @return @c 0 if the agent accepted the hint; otherwise an error code and
+ * @c oidc_errno is set
+ */
+LIB_PUBLIC int oidcagent_hint_need(const char* accountname, const char* scope,
+                                   const char* audience, time_t when,
+                                   time_t duration);
+
+/**
+ * @brief stages an access token into the local agent
+ * A batch job launcher can obtain the tokens of a job once and stage them into
+ * the agents of all nodes of the job before its processes start. An agent that
+ * forwards token requests to an upstream agent then answers requests matching
+ * @p request from the staged token instead of asking the upstream agent. Only
+ * the user running the agent may stage tokens.
+ * @param request the token request the processes of the job will make; its
+ * account or issuer, scope and audience have to match exactly
+ * @param response the token obtained for @p request, e.g. by
+ * @c getTokenResponse3 on the launching node
+ * @return @c 0 if the token was staged; otherwise an error code and
+ * @c oidc_errno is set
+ */
+LIB_PUBLIC int oidcagent_stageToken(const struct token_request* request,
+                                    struct token_response       response);
+
+/**
+ * @brief gets the claims about the user of an account config from the
+ * userinfo endpoint of its provider
+ * The agent fetches the claims with the current access token of the account
+ * config and caches them until the access token changes, so calling this
+ * function repeatedly does not add load on the provider. The account config is
+ * loaded if necessary. Only the local agent is used.
+ * @param accountname the short name of the account config
+ * @param application_hint a hint indicating what application requests the
+ * claims. This string might be displayed to the user.
+ * @return a pointer to a json object with the claims or, if the provider signs
+ * or encrypts them, to the JWT returned by the provider. Has to be freed after
+ * usage using the @c secFree function. On failure @c NULL is returned and
+ * @c oidc_errno is set.
+ */
+LIB_PUBLIC char* getUserinfo(const char* accountname,
+                             const char* application_hint);
+
+/**
+ * @brief validates a JWT access or id token without asking the provider
+ * The agent verifies the signature of the token with the signing keys its
+ * provider publishes and checks that the token is not expired. Only tokens of
+ * providers of loaded account configs are accepted. Validated tokens are
+ * cached until they expire. Only the local agent is used.
+ * @param token the JWT to validate
+ * @param audience the audience the token must be intended for; @c NULL if the
+ * audience should not be checked
+ * @return a pointer to a json object with the claims of the token or @c NULL
+ * if the token is not valid; then @c oidc_errno is set. Has to be freed after
+ * usage using the @c secFree function.
+ */
+LIB_PUBLIC char* oidcagent_validate(const char* token, const char* audience);
+
+/**
+ * @brief reports an access token that a resource server rejected, e.g.
+ * because it was revoked at the provider, and gets a new one
+ * The agent drops the token from its cache if it is still cached and obtains a
+ * new token once; concurrent reports of the same token by other clients are
+ * answered with that new token. Use this instead of repeating a request with
+ * @c FORCE_NEW_TOKEN, which refreshes the token for every client. Only a hash
+ * of @p token is sent to the agent. The token is also removed from the
+ * in-process token cache.
+ * @param accountname the short name of the account config the token was
+ * obtained for
+ * @param token the rejected access token
+ * @param scope the scope the token was requested with; @c NULL for the
+ * default scope
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param audience the audience the token was requested for; @c NULL for the
+ * default audience
+ * @return a token_response struct with the new access token as for
+ * @c getTokenResponse3. Has to be freed after usage using the
+ * @c secFreeTokenResponse function.
+ */
+LIB_PUBLIC struct token_response oidcagent_tokenRejected(
+    const char* accountname, const char* token, const char* scope,
+    const char* application_hint, const char* audience);
+
+/**
+ * @struct oidcagent_subscription api.h
+ * @brief an opaque handle for a subscription to new access tokens of an
+ * account config
+ */
+struct oidcagent_subscription;
+
+/**
+ * @brief subscribes to new access tokens of an account config
+ * Instead of polling for a new token, the agent pushes every new default
+ * access token of the account config to the subscriber, no matter if it was
+ * refreshed in the background or for another client. Only the local agent is
+ * used.
+ * @param accountname the short name of the account config
+ * @param min_valid_period the minimum period of time the current access token
+ * has to be valid in seconds
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param current if not @c NULL the current access token is stored there; it
+ * has to be freed after usage using the @c secFreeTokenResponse function
+ * @return a pointer to the subscription. Has to be freed using
+ * @c oidcagent_unsubscribe. On failure @c NULL is returned and @c oidc_errno
+ * is set.
+ */
+LIB_PUBLIC struct oidcagent_subscription* oidcagent_subscribe(
+    const char* accountname, time_t min_valid_period,
+    const char* application_hint, struct token_response* current);
+
+/**
+ * @brief returns the file descriptor that is readable when a new access token
+ * was pushed
+ * @param subscription the subscription returned by @c oidcagent_subscribe
+ * @return the file descriptor or @c -1
+ */
+LIB_PUBLIC int oidcagent_subscription_fd(
+    const struct oidcagent_subscription* subscription);
+
+/**
+ * @brief waits for the next access token pushed by the agent
+ * @param subscription the subscription returned by @c oidcagent_subscribe
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure, e.g. if the account config was removed, a zeroed struct is
+ * returned and @c oidc_errno is set; the subscription has ended then.
+ */
+LIB_PUBLIC struct token_response oidcagent_subscription_next(
+    struct oidcagent_subscription* subscription);
+
+/**
+ * @brief ends a subscription and frees it
+ * @param subscription the subscription to be ended; might be @c NULL
+ */
+LIB_PUBLIC void oidcagent_unsubscribe(
+    struct oidcagent_subscription* subscription);
+
+/**
+ * @brief reads the access token of an account config from its token mailbox
+ * If the agent was started with @c --mailbox for the account config, it
+ * publishes every new access token in a shared memory mailbox. Reading it
+ * does not contact the agent; after the first call no system call is made.
+ * If there is no mailbox or it does not hold a suitable token, applications
+ * should fall back to @c getTokenResponse3.
+ * @param accountname the short name of the account config
+ * @param min_valid_period the minimum period of time the access token has to
+ * be valid in seconds
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. If
+ * there is no valid token in the mailbox, a zeroed struct is returned and
+ * @c oidc_errno is set to @c OIDC_EMAILBOX.
+ */
+LIB_PUBLIC struct token_response oidcagent_mailbox_read(
+    const char* accountname, time_t min_valid_period);
+
+/**
+ * @brief enables or disables the in-process token cache
+ * If enabled, access tokens returned by the agent are cached by the library.
+ * Further requests for the same account config or provider, scope and audience
+ * are answered from the cache as long as the cached token is valid for
+ * @c min_valid_period; no connection to the agent is made then. Requests with
+ * @c FORCE_NEW_TOKEN always go to the agent. The cache is disabled by default.
+ * Disabling it clears it.
+ * @param enabled @c 1 to enable the cache, @c 0 to disable it
+ */
+LIB_PUBLIC void oidcagent_setTokenCache(unsigned char enabled);
+
+/**
+ * @brief removes all tokens from the in-process token cache
+ */
+LIB_PUBLIC void oidcagent_clearTokenCache();
+
+/**
+ * @brief allows the agent to return access tokens that are still valid, but
+ * not for the requested @c min_valid_period
+ * If enabled and the agent has such a token, it is returned immediately and
+ * the agent refreshes it in the background, so a following request gets a new
+ * one. Requests with @c FORCE_NEW_TOKEN are not affected. Disabled by default.
+ * @param enabled @c 1 to enable, @c 0 to disable
+ */
+LIB_PUBLIC void oidcagent_setStaleOk(unsigned char enabled);
+
+/**
+ * @brief limits how long the library waits for the agent to answer a request
+ * The timeout covers connecting to the agent, the key exchange, and waiting
+ * for the response. It is passed to the agent with access token requests, so
+ * that the agent drops a request that it could not start before the caller
+ * gave up, instead of refreshing a token nobody waits for. Requests in a
+ * session and asynchronous requests are not aborted by the library. Disabled
+ * by default.
+ * @param seconds the timeout in seconds; @c 0 to wait as long as it takes
+ */
+LIB_PUBLIC void oidcagent_setTimeout(time_t seconds);
+
+/**
+ * @brief what @c getTokenResponseWithDeadline does if the agent cannot answer
+ * in time; the values can be combined
+ */
+LIB_PUBLIC enum oidcagent_fallback {
+  /** the request fails */
+  OIDCAGENT_FALLBACK_NONE = 0,
+  /** the request is sent to the local and the remote agent at the same time;
+     only with @c OIDCAGENT_RESOLVE_FALLBACK */
+  OIDCAGENT_FALLBACK_REMOTE = 1,
+  /** a token returned earlier for the same request is returned, if it has not
+     expired yet, even if it is not valid for @c min_valid_period */
+  OIDCAGENT_FALLBACK_STALE = 2,
+};
+
+/**
+ * @brief gets a valid access token for an account config, giving up at a
+ * deadline
+ * Like @c getTokenResponse3, but connecting to the agent, the key exchange, and
+ * waiting for the response fail with @c OIDC_ETIMEOUT at @p deadline. The time
+ * left is passed to the agent, so that it drops the request if it cannot start
+ * it in time.
+ * @param accountname the short name of the account config for which an access
+ * token should be returned
+ * @param min_valid_period the minium period of time the access token has to be
+ * valid in seconds
+ * @param scope a space delimited list of scope values for the to be issued
+ * access token. @c NULL if default value for the used account configuration
+ * should be used.
+ * @param application_hint a hint indicating what application requests the
+ * access token. This string might be displayed to the user.
+ * @param audience the audience of the access token; might be @c NULL
+ * @param deadline the point in time at which the request fails, in seconds
+ * since the epoch; @c 0 for the timeout of @c oidcagent_setTimeout
+ * @param fallback a combination of @c oidcagent_fallback values
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response getTokenResponseWithDeadline(
+    const char* accountname, time_t min_valid_period, const char* scope,
+    const char* application_hint, const char* audience, time_t deadline,
+    unsigned int fallback);
+
+/**
+ * @brief gets a valid access token for a provider, giving up at a deadline
+ * Like @c getTokenResponseWithDeadline, but for the provider @p issuer_url.
+ * @return a token_response struct containing the access token, issuer_url, and
+ * expiration time.
+ * Has to be freed after usage using the @c secFreeTokenResponse function. On
+ * failure a zeroed struct is returned and @c oidc_errno is set.
+ */
+LIB_PUBLIC struct token_response getTokenResponseForIssuerWithDeadline(
+    const char* issuer_url, time_t min_valid_period, const char* scope,
+    const char* application_hint, const char* audience, time_t deadline,
+    unsigned int fallback);
+
+/**
+ * @brief the agents access token requests are sent to
+ */
+LIB_PUBLIC enum oidcagent_resolution {
+  /** the local agent; the remote agent if the account is not known locally */
+  OIDCAGENT_RESOLVE_FALLBACK = 0,
+  /** only the local agent */
+  OIDCAGENT_RESOLVE_LOCAL,
+  /** only the remote agent */
+  OIDCAGENT_RESOLVE_REMOTE,
+  /** both agents at the same time; the first successful response is used */
+  OIDCAGENT_RESOLVE_RACE,
+};
+
+/**
+ * @brief sets the agents access token requests are sent to
+ * With @c OIDCAGENT_RESOLVE_FALLBACK and @c OIDCAGENT_RESOLVE_RACE the agent
+ * that answered for an account config or provider is remembered and further
+ * requests for it are only sent to that agent. The default is
+ * @c OIDCAGENT_RESOLVE_FALLBACK. Setting the policy forgets all remembered
+ * agents.
+ * @param policy the resolution policy
+ */
+LIB_PUBLIC void oidcagent_setResolution(enum oidcagent_resolution policy);
+
 /**
  * @brief gets an error string detailing the last occurred error
  * @return the error string. MUST NOT be freed.
@@ -0,0 +1,600 @@
+#include "api.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "utils/memzero.h"
+#include "utils/oidc_error.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * liboidc-agent-lite implements the access token functions of api.h with
+ * nothing but the C library, for applications that only need tokens from an
+ * agent on the same host. Requests are written with a fixed layout and sent
+ * unencrypted in framed mode over the UNIX domain socket of @c OIDC_SOCK; the
+ * agent answers them because the kernel tells it the peer credentials of the
+ * caller. There is no key exchange, so nothing of libsodium or cJSON is
+ * needed. If the agent requires encryption (it was not started with
+ * @c --trust-local-clients or the client runs as another user) or the agent is
+ * remote, the request fails and the full liboidc-agent has to be used. Memory returned by this library has to be
+ * freed with its own @c secFree.
+ */
+
+__thread int  oidc_errno;
+__thread char oidc_error[1024];
+
+// must match the framing in ipc/ipc.c
+#define LITE_FRAME_MARKER '\x02'
+#define LITE_FRAME_HEADER_FMT "\x02%020lu:"
+#define LITE_FRAME_HEADER_LEN 22
+#define LITE_MAX_RESPONSE (1024 * 1024)
+
+static time_t requestTimeout = 0;
+
+static void _setError(int err, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  moresecure_memzero(oidc_error, sizeof(oidc_error));
+  vsnprintf(oidc_error, sizeof(oidc_error), fmt, args);
+  va_end(args);
+  oidc_errno = err;
+}
+
+static void* _alloc(size_t size) {
+  size_t* p = calloc(1, sizeof(size_t) + size);
+  if (p == NULL) {
+    _setError(OIDC_EALLOC, "memory alloc failed");
+    return NULL;
+  }
+  *p = size;
+  return p + 1;
+}
+
+void _secFree(void* p) {
+  if (p == NULL) {
+    return;
+  }
+  size_t* fp = (size_t*)p - 1;
+  moresecure_memzero(fp, sizeof(size_t) + *fp);
+  free(fp);
+}
+
+/**
+ * A growing string the request is written to
+ */
+struct liteBuffer {
+  char*  data;
+  size_t len;
+  size_t cap;
+};
+
+static int _append(struct liteBuffer* b, const char* s, size_t len) {
+  if (b->data == NULL) {
+    return -1;
+  }
+  if (b->len + len + 1 > b->cap) {
+    size_t cap  = (b->len + len + 1) * 2;
+    char*  data = _alloc(cap);
+    if (data == NULL) {
+      secFree(b->data);
+      return -1;
+    }
+    memcpy(data, b->data, b->len);
+    secFree(b->data);
+    b->data = data;
+    b->cap  = cap;
+  }
+  memcpy(b->data + b->len, s, len);
+  b->len += len;
+  b->data[b->len] = '\0';
+  return 0;
+}
+
+static int _appendString(struct liteBuffer* b, const char* s) {
+  return _append(b, s, strlen(s));
+}
+
+/**
+ * @brief appends @c ,"key":"value" with the value escaped for json; nothing
+ * is appended if @p value is @c NULL or empty
+ */
+static int _appendStringMember(struct liteBuffer* b, const char* key,
+                               const char* value) {
+  if (value == NULL || *value == '\0') {
+    return 0;
+  }
+  if (_appendString(b, ",\"") || _appendString(b, key) ||
+      _appendString(b, "\":\"")) {
+    return -1;
+  }
+  for (const unsigned char* c = (const unsigned char*)value; *c; c++) {
+    char esc[7];
+    if (*c == '"' || *c == '\\') {
+      snprintf(esc, sizeof(esc), "\\%c", *c);
+    } else if (*c < 0x20) {
+      snprintf(esc, sizeof(esc), "\\u%04x", *c);
+    } else {
+      esc[0] = *c;
+      esc[1] = '\0';
+    }
+    if (_appendString(b, esc)) {
+      return -1;
+    }
+  }
+  return _appendString(b, "\"");
+}
+
+static int _appendNumberMember(struct liteBuffer* b, const char* key,
+                               long value) {
+  char num[32];
+  snprintf(num, sizeof(num), "%ld", value);
+  return _appendString(b, ",\"") || _appendString(b, key) ||
+         _appendString(b, "\":") || _appendString(b, num);
+}
+
+static char* _accessTokenRequest(const char* accountname, const char* issuer,
+                                 time_t min_valid_period, const char* scope,
+                                 const char* hint, const char* audience) {
+  struct liteBuffer b = {_alloc(256), 0, 256};
+  if (_appendString(&b, "{\"" IPC_KEY_REQUEST
+                        "\":\"" REQUEST_VALUE_ACCESSTOKEN "\"") ||
+      _appendNumberMember(&b, IPC_KEY_MINVALID, min_valid_period) ||
+      _appendStringMember(&b, IPC_KEY_SHORTNAME, accountname) ||
+      _appendStringMember(&b, IPC_KEY_ISSUERURL,
+                          accountname && *accountname ? NULL : issuer) ||
+      _appendStringMember(&b, OIDC_KEY_SCOPE, scope) ||
+      _appendStringMember(&b, IPC_KEY_APPLICATIONHINT, hint) ||
+      _appendStringMember(&b, IPC_KEY_AUDIENCE, audience) ||
+      (requestTimeout &&
+       _appendNumberMember(&b, IPC_KEY_TIMEOUT, requestTimeout)) ||
+      _appendString(&b, "}")) {
+    secFree(b.data);
+    return NULL;
+  }
+  return b.data;
+}
+
+/**
+ * @brief scans a json string
+ * @param p points to the opening quote
+ * @param out if not @c NULL the decoded string is written to it; it has to be
+ * as long as the encoded string
+ * @return a pointer behind the closing quote or @c NULL if the string is
+ * malformed
+ */
+static const char* _scanString(const char* p, char* out) {
+  p++;
+  while (*p != '"') {
+    if (*p == '\0') {
+      return NULL;
+    }
+    if (*p != '\\') {
+      if (out) {
+        *out++ = *p;
+      }
+      p++;
+      continue;
+    }
+    p++;
+    char c;
+    switch (*p) {
+      case 'b': c = '\b'; break;
+      case 'f': c = '\f'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 't': c = '\t'; break;
+      case '"':
+      case '\\':
+      case '/': c = *p; break;
+      case 'u': {
+        char          hex[5] = {0};
+        char*         end    = NULL;
+        unsigned long cp     = 0;
+        if (strlen(p + 1) < 4) {
+          return NULL;
+        }
+        memcpy(hex, p + 1, 4);
+        cp = strtoul(hex, &end, 16);
+        if (end != hex + 4) {
+          return NULL;
+        }
+        p += 5;
+        if (out) {  // surrogates are not combined; the values are ascii
+          if (cp < 0x80) {
+            *out++ = cp;
+          } else if (cp < 0x800) {
+            *out++ = 0xC0 | (cp >> 6);
+            *out++ = 0x80 | (cp & 0x3F);
+          } else {
+            *out++ = 0xE0 | (cp >> 12);
+            *out++ = 0x80 | ((cp >> 6) & 0x3F);
+            *out++ = 0x80 | (cp & 0x3F);
+          }
+        }
+        continue;
+      }
+      default: return NULL;
+    }
+    if (out) {
+      *out++ = c;
+    }
+    p++;
+  }
+  if (out) {
+    *out = '\0';
+  }
+  return p + 1;
+}
+
+static const char* _skipWhitespace(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') { p++; }
+  return p;
+}
+
+/**
+ * @return a pointer behind the json value at @p p or @c NULL if it is
+ * malformed
+ */
+static const char* _skipValue(const char* p) {
+  if (*p == '"') {
+    return _scanString(p, NULL);
+  }
+  if (*p != '{' && *p != '[') {
+    while (*p && strchr(",}] \t\n\r", *p) == NULL) { p++; }
+    return p;
+  }
+  size_t depth = 0;
+  do {
+    if (*p == '"') {
+      p = _scanString(p, NULL);
+      if (p == NULL) {
+        return NULL;
+      }
+      continue;
+    }
+    if (*p == '{' || *p == '[') {
+      depth++;
+    } else if (*p == '}' || *p == ']') {
+      depth--;
+    } else if (*p == '\0') {
+      return NULL;
+    }
+    p++;
+  } while (depth > 0);
+  return p;
+}
+
+/**
+ * @brief gets a value of the top level json object @p json
+ * @return the decoded string, the text of any other value, or @c NULL if the
+ * key is not present. Has to be freed after usage.
+ */
+static char* _getValue(const char* json, const char* key) {
+  const char* p = _skipWhitespace(json);
+  if (*p != '{') {
+    return NULL;
+  }
+  p = _skipWhitespace(p + 1);
+  while (*p == '"') {
+    const char* keyStart = p + 1;
+    p                    = _scanString(p, NULL);
+    if (p == NULL) {
+      return NULL;
+    }
+    unsigned char match = (size_t)(p - 1 - keyStart) == strlen(key) &&
+                          strncmp(keyStart, key, strlen(key)) == 0;
+    p = _skipWhitespace(p);
+    if (*p != ':') {
+      return NULL;
+    }
+    p                  = _skipWhitespace(p + 1);
+    const char* valEnd = _skipValue(p);
+    if (valEnd == NULL) {
+      return NULL;
+    }
+    if (match) {
+      char* value = _alloc(valEnd - p + 1);
+      if (value == NULL) {
+        return NULL;
+      }
+      if (*p == '"') {
+        _scanString(p, value);
+      } else {
+        memcpy(value, p, valEnd - p);
+      }
+      return value;
+    }
+    p = _skipWhitespace(valEnd);
+    if (*p != ',') {
+      return NULL;
+    }
+    p = _skipWhitespace(p + 1);
+  }
+  return NULL;
+}
+
+static int _wait(int sock, time_t death) {
+  int timeout = -1;
+  if (death) {
+    time_t left = death - time(NULL);
+    if (left <= 0) {
+      _setError(OIDC_ETIMEOUT, "reached timeout");
+      return -1;
+    }
+    timeout = left * 1000;
+  }
+  struct pollfd pfd = {.fd = sock, .events = POLLIN};
+  int           ret;
+  while ((ret = poll(&pfd, 1, timeout)) < 0 && errno == EINTR) {}
+  if (ret == 0) {
+    _setError(OIDC_ETIMEOUT, "reached timeout");
+    return -1;
+  }
+  if (ret < 0) {
+    _setError(OIDC_EERROR, "%s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static int _readExactly(int sock, char* buf, size_t len, time_t death) {
+  size_t done = 0;
+  while (done < len) {
+    if (_wait(sock, death)) {
+      return -1;
+    }
+    ssize_t r = read(sock, buf + done, len - done);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      _setError(OIDC_EIPCDIS, "the other party disconnected");
+      return -1;
+    }
+    done += r;
+  }
+  return 0;
+}
+
+static int _writeFrame(int sock, const char* msg) {
+  size_t len                               = strlen(msg);
+  char   header[LITE_FRAME_HEADER_LEN + 1] = {0};
+  snprintf(header, sizeof(header), LITE_FRAME_HEADER_FMT, len);
+  const char* parts[2]    = {header, msg};
+  size_t      partLens[2] = {LITE_FRAME_HEADER_LEN, len};
+  for (int i = 0; i < 2; i++) {
+    size_t done = 0;
+    while (done < partLens[i]) {
+      ssize_t w =
+          send(sock, parts[i] + done, partLens[i] - done, MSG_NOSIGNAL);
+      if (w < 0 && errno == EINTR) {
+        continue;
+      }
+      if (w < 0) {
+        _setError(OIDC_EWRITE, "could not write");
+        return -1;
+      }
+      done += w;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief reads a framed message; keepalives are skipped
+ */
+static char* _readFrame(int sock, time_t death) {
+  while (1) {
+    char header[LITE_FRAME_HEADER_LEN + 1] = {0};
+    if (_readExactly(sock, header, LITE_FRAME_HEADER_LEN, death)) {
+      return NULL;
+    }
+    char*         end = NULL;
+    unsigned long len = strtoul(header + 1, &end, 10);
+    if (header[0] != LITE_FRAME_MARKER || end == NULL || *end != ':' ||
+        len > LITE_MAX_RESPONSE) {
+      _setError(OIDC_EIPCTAG, "Received malformed response from oidc-agent");
+      return NULL;
+    }
+    if (len == 0) {
+      continue;
+    }
+    char* buf = _alloc(len + 1);
+    if (buf == NULL) {
+      return NULL;
+    }
+    if (_readExactly(sock, buf, len, death)) {
+      secFree(buf);
+      return NULL;
+    }
+    return buf;
+  }
+}
+
+static char* _communicate(const char* request) {
+  const char* path = getenv(OIDC_SOCK_ENV_NAME);
+  if (path == NULL) {
+    _setError(OIDC_EENVVAR,
+              "Could not get the socket path from env var '%s'. Have you set "
+              "the env var?\n",
+              OIDC_SOCK_ENV_NAME);
+    return NULL;
+  }
+  struct sockaddr_un server = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(server.sun_path)) {
+    _setError(OIDC_ECONSOCK, "Could not connect to oidc-agent: %s",
+              "socket path too long");
+    return NULL;
+  }
+  strcpy(server.sun_path, path);
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    _setError(OIDC_ECRSOCK, "Could not create ipc-socket");
+    return NULL;
+  }
+  if (connect(sock, (struct sockaddr*)&server, sizeof(server)) < 0) {
+    _setError(OIDC_ECONSOCK, "Could not connect to oidc-agent: %s",
+              strerror(errno));
+    close(sock);
+    return NULL;
+  }
+  const time_t death    = requestTimeout ? time(NULL) + requestTimeout : 0;
+  char*        response = NULL;
+  if (_writeFrame(sock, request) == 0) {
+    response = _readFrame(sock, death);
+  }
+  close(sock);
+  return response;
+}
+
+static struct token_response _parseTokenResponse(char* response) {
+  struct token_response ret = {NULL, NULL, 0};
+  if (response == NULL) {
+    return ret;
+  }
+  char* status = _getValue(response, IPC_KEY_STATUS);
+  char* error  = _getValue(response, OIDC_KEY_ERROR);
+  if (status == NULL) {
+    _setError(OIDC_EJSONPARS, "Received malformed response from oidc-agent");
+  } else if (strcmp(status, STATUS_ENCRYPTIONREQUIRED) == 0) {
+    _setError(OIDC_EERROR,
+              "oidc-agent requires an encrypted connection, which "
+              "liboidc-agent-lite does not support; use liboidc-agent");
+  } else if (strcmp(status, STATUS_BUSY) == 0) {
+    _setError(OIDC_EBUSY, "The agent is busy; try again later");
+  } else if (error != NULL || strcmp(status, STATUS_SUCCESS) != 0) {
+    _setError(OIDC_EERROR, "%s", error ?: status);
+  } else {
+    ret.token      = _getValue(response, OIDC_KEY_ACCESSTOKEN);
+    ret.issuer     = _getValue(response, OIDC_KEY_ISSUER);
+    char* expires  = _getValue(response, AGENT_KEY_EXPIRESAT);
+    ret.expires_at = expires ? strtoul(expires, NULL, 10) : 0;
+    secFree(expires);
+    if (ret.token == NULL) {
+      secFreeTokenResponse(ret);
+      ret = (struct token_response){NULL, NULL, 0};
+      _setError(OIDC_EJSONPARS,
+                "Received malformed response from oidc-agent");
+    } else {
+      oidc_errno = OIDC_SUCCESS;
+    }
+  }
+  secFree(status);
+  secFree(error);
+  secFree(response);
+  return ret;
+}
+
+static struct token_response _getTokenResponse(const char* accountname,
+                                               const char* issuer,
+                                               time_t      min_valid_period,
+                                               const char* scope,
+                                               const char* hint,
+                                               const char* audience) {
+  if ((accountname == NULL || *accountname == '\0') &&
+      (issuer == NULL || *issuer == '\0')) {
+    _setError(OIDC_EARGNULLFUNC, "Argument is NULL in function %s",
+              "getTokenResponse");
+    return (struct token_response){NULL, NULL, 0};
+  }
+  char* request = _accessTokenRequest(accountname, issuer, min_valid_period,
+                                      scope, hint, audience);
+  if (request == NULL) {
+    return (struct token_response){NULL, NULL, 0};
+  }
+  char* response = _communicate(request);
+  secFree(request);
+  return _parseTokenResponse(response);
+}
+
+static char* _onlyToken(struct token_response response) {
+  secFree(response.issuer);
+  return response.token;
+}
+
+struct token_response getTokenResponse(const char* accountname,
+                                       time_t      min_valid_period,
+                                       const char* scope,
+                                       const char* application_hint) {
+  return getTokenResponse3(accountname, min_valid_period, scope,
+                           application_hint, NULL);
+}
+
+struct token_response getTokenResponse3(const char* accountname,
+                                        time_t      min_valid_period,
+                                        const char* scope,
+                                        const char* application_hint,
+                                        const char* audience) {
+  return _getTokenResponse(accountname, NULL, min_valid_period, scope,
+                           application_hint, audience);
+}
+
+struct token_response getTokenResponseForIssuer(const char* issuer_url,
+                                                time_t      min_valid_period,
+                                                const char* scope,
+                                                const char* application_hint) {
+  return getTokenResponseForIssuer3(issuer_url, min_valid_period, scope,
+                                    application_hint, NULL);
+}
+
+struct token_response getTokenResponseForIssuer3(const char* issuer_url,
+                                                 time_t      min_valid_period,
+                                                 const char* scope,
+                                                 const char* application_hint,
+                                                 const char* audience) {
+  return _getTokenResponse(NULL, issuer_url, min_valid_period, scope,
+                           application_hint, audience);
+}
+
+char* getAccessToken(const char* accountname, time_t min_valid_period,
+                     const char* scope) {
+  return getAccessToken2(accountname, min_valid_period, scope, NULL);
+}
+
+char* getAccessToken2(const char* accountname, time_t min_valid_period,
+                      const char* scope, const char* application_hint) {
+  return getAccessToken3(accountname, min_valid_period, scope, application_hint,
+                         NULL);
+}
+
+char* getAccessToken3(const char* accountname, time_t min_valid_period,
+                      const char* scope, const char* application_hint,
+                      const char* audience) {
+  return _onlyToken(getTokenResponse3(accountname, min_valid_period, scope,
+                                      application_hint, audience));
+}
+
+char* getAccessTokenForIssuer(const char* issuer_url, time_t min_valid_period,
+                              const char* scope,
+                              const char* application_hint) {
+  return getAccessTokenForIssuer3(issuer_url, min_valid_period, scope,
+                                  application_hint, NULL);
+}
+
+char* getAccessTokenForIssuer3(const char* issuer_url, time_t min_valid_period,
+                               const char* scope, const char* application_hint,
+                               const char* audience) {
+  return _onlyToken(getTokenResponseForIssuer3(
+      issuer_url, min_valid_period, scope, application_hint, audience));
+}
+
+void oidcagent_setTimeout(time_t seconds) { requestTimeout = seconds; }
+
+char* oidcagent_serror() {
+  return oidc_errno == OIDC_SUCCESS ? "success" : oidc_error;
+}
+
+void oidcagent_perror() { fprintf(stderr, "%s\n", oidcagent_serror()); }
+
+void secFreeTokenResponse(struct token_response token_response) {
+  secFree(token_response.token);
+  secFree(token_response.issuer);
+}
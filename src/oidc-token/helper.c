@@ -0,0 +1,167 @@
+#include "helper.h"
+#include "defines/agent_values.h"
+#include "sharedTokenCache.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The helper modes let oidc-token be used directly as a git credential
+ * helper, a docker credential helper, and a kubectl exec plugin. Tokens are
+ * taken from the shared token cache if possible, since these tools start the
+ * helper for (almost) every command.
+ */
+
+#define HELPER_USERNAME "oauth2"
+#define HELPER_MIN_VALID_PERIOD 60
+
+#define HELPER_ACTION_GET "get"
+#define HELPER_ACTION_LIST "list"
+
+#define KUBECTL_ENV_EXEC_INFO "KUBERNETES_EXEC_INFO"
+#define KUBECTL_DEFAULT_API_VERSION "client.authentication.k8s.io/v1beta1"
+
+static struct token_response _getToken(const struct arguments* arguments,
+                                       tokenResponseFnc getTokenResponseFnc,
+                                       const char*      scope,
+                                       const char*      application_name) {
+  time_t min_valid_period = arguments->min_valid_period;
+  if (arguments->forceNewToken) {
+    min_valid_period = FORCE_NEW_TOKEN;
+  } else if (min_valid_period < HELPER_MIN_VALID_PERIOD) {
+    min_valid_period = HELPER_MIN_VALID_PERIOD;
+  }
+  struct token_response response = sharedTokenCache_get(
+      arguments->args[0], scope, arguments->audience, min_valid_period);
+  if (response.token != NULL) {
+    return response;
+  }
+  secFreeTokenResponse(response);
+  response = getTokenResponseFnc(arguments->args[0], min_valid_period, scope,
+                                 application_name, arguments->audience);
+  sharedTokenCache_put(arguments->args[0], scope, arguments->audience,
+                       response);
+  return response;
+}
+
+/**
+ * @brief reads the attributes git passes to a credential helper up to the
+ * first empty line
+ * @return the username given by git or @c NULL. Has to be freed after usage.
+ */
+static char* _readGitInput() {
+  char* username = NULL;
+  char* line;
+  while ((line = getLineFromFILE(stdin)) != NULL && strValid(line)) {
+    if (strstarts(line, "username=")) {
+      secFree(username);
+      username = oidc_strcopy(line + strlen("username="));
+    }
+    secFree(line);
+  }
+  secFree(line);
+  return username;
+}
+
+static void _discardInput() {
+  char* line;
+  while ((line = getLineFromFILE(stdin)) != NULL) { secFree(line); }
+}
+
+static void _printGitCredential(struct token_response response,
+                                const char*           username) {
+  printf("username=%s\npassword=%s\n", username ?: HELPER_USERNAME,
+         response.token);
+  if (response.expires_at > 0) {
+    printf("password_expiry_utc=%lu\n", (unsigned long)response.expires_at);
+  }
+}
+
+static void _printDockerCredential(struct token_response response,
+                                   const char*           serverURL) {
+  cJSON* json = generateJSONObject(
+      "ServerURL", cJSON_String, serverURL ?: "", "Username", cJSON_String,
+      HELPER_USERNAME, "Secret", cJSON_String, response.token, NULL);
+  char* str = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  printf("%s\n", str);
+  secFree(str);
+}
+
+/**
+ * @brief prints an @c ExecCredential for kubectl
+ * The api version is taken from the exec info kubectl passes, so that the
+ * credential matches the version kubectl expects.
+ */
+static void _printKubectlCredential(struct token_response response) {
+  const char* execInfo   = getenv(KUBECTL_ENV_EXEC_INFO);
+  char*       apiVersion =
+      strValid(execInfo) ? getJSONValueFromString(execInfo, "apiVersion")
+                         : NULL;
+  cJSON* status =
+      generateJSONObject("token", cJSON_String, response.token, NULL);
+  if (response.expires_at > 0) {
+    char timestamp[sizeof("YYYY-MM-DDThh:mm:ssZ")];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ",
+             gmtime(&response.expires_at));
+    jsonAddStringValue(status, "expirationTimestamp", timestamp);
+  }
+  cJSON* json = generateJSONObject(
+      "apiVersion", cJSON_String, apiVersion ?: KUBECTL_DEFAULT_API_VERSION,
+      "kind", cJSON_String, "ExecCredential", NULL);
+  jsonAddJSON(json, "status", status);
+  secFree(apiVersion);
+  char* str = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  printf("%s\n", str);
+  secFree(str);
+}
+
+/**
+ * @brief answers a request of the tool given with --helper
+ * Only the @c get action of git and docker returns a token; storing and
+ * erasing credentials is accepted but ignored, since the tokens are managed
+ * by oidc-agent.
+ * @return the exit status
+ */
+int token_runHelper(const struct arguments* arguments,
+                    tokenResponseFnc getTokenResponseFnc, const char* scope,
+                    const char* application_name) {
+  const char* action = arguments->args[1];
+  char*       input  = NULL;
+  if (arguments->helper != HELPER_KUBECTL) {
+    if (!strequal(action, HELPER_ACTION_GET)) {
+      if (arguments->helper == HELPER_DOCKER &&
+          strequal(action, HELPER_ACTION_LIST)) {
+        printf("{}\n");
+      }
+      _discardInput();
+      return EXIT_SUCCESS;
+    }
+    input = arguments->helper == HELPER_GIT ? _readGitInput()
+                                            : getLineFromFILE(stdin);
+  }
+  struct token_response response =
+      _getToken(arguments, getTokenResponseFnc, scope, application_name);
+  if (response.token == NULL) {
+    oidcagent_perror();
+    secFreeTokenResponse(response);
+    secFree(input);
+    return EXIT_FAILURE;
+  }
+  switch (arguments->helper) {
+    case HELPER_GIT: _printGitCredential(response, input); break;
+    case HELPER_DOCKER: _printDockerCredential(response, input); break;
+    case HELPER_KUBECTL: _printKubectlCredential(response); break;
+    default: break;
+  }
+  secFreeTokenResponse(response);
+  secFree(input);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDC_TOKEN_HELPER_H
+#define OIDC_TOKEN_HELPER_H
+
+#include "oidc-token_options.h"
+#include "watch.h"
+
+int token_runHelper(const struct arguments* arguments,
+                    tokenResponseFnc getTokenResponseFnc, const char* scope,
+                    const char* application_name);
+
+#endif  // OIDC_TOKEN_HELPER_H
@@ -1,12 +1,16 @@
 #include "oidc-token.h"
 #include "defines/agent_values.h"
+#include "helper.h"
+#include "stage.h"
 #include "token_handler.h"
+#include "watch.h"
 #ifndef __APPLE__
 #include "privileges/token_privileges.h"
 #endif
 #include "utils/disableTracing.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
 
 #include "api.h"
@@ -24,11 +28,12 @@ int main(int argc, char** argv) {
   }
 #endif
 
-  char* scope_str = listToDelimitedString(arguments.scopes, " ");
-  struct token_response (*getTokenResponseFnc)(const char*, time_t, const char*,
-                                               const char*, const char*) =
-      getTokenResponse3;
-  unsigned char useIssuerInsteadOfShortname = 0;
+  if (arguments.stage_in) {
+    return token_stageIn(arguments.stage_in);
+  }
+  char*            scope_str = listToDelimitedString(arguments.scopes, " ");
+  tokenResponseFnc getTokenResponseFnc         = getTokenResponse3;
+  unsigned char    useIssuerInsteadOfShortname = 0;
   if (strstarts(arguments.args[0], "https://")) {
     useIssuerInsteadOfShortname = 1;
   }
@@ -39,6 +44,30 @@ int main(int argc, char** argv) {
   if (useIssuerInsteadOfShortname) {
     getTokenResponseFnc = getTokenResponseForIssuer3;
   }
+  if (arguments.trace) {
+    requestTrace_start(NULL);
+  }
+  oidcagent_setStaleOk(arguments.staleOk);
+  oidcagent_setTimeout(arguments.timeout);
+  if (arguments.helper != HELPER_NONE || arguments.out_file ||
+      arguments.out_fd >= 0 || arguments.stage_out) {
+    const char* application_name = strValid(arguments.application_name)
+                                       ? arguments.application_name
+                                       : "oidc-token";
+    int ret = arguments.helper != HELPER_NONE
+                  ? token_runHelper(&arguments, getTokenResponseFnc, scope_str,
+                                    application_name)
+              : arguments.stage_out
+                  ? token_stageOut(&arguments, getTokenResponseFnc, scope_str,
+                                   application_name)
+                  : token_writeOutputs(&arguments, getTokenResponseFnc,
+                                       scope_str, application_name);
+    secFree(scope_str);
+    if (arguments.scopes) {
+      secFreeList(arguments.scopes);
+    }
+    return ret;
+  }
   struct token_response response = getTokenResponseFnc(
       arguments.args[0],
       arguments.forceNewToken ? FORCE_NEW_TOKEN : arguments.min_valid_period,
@@ -48,6 +77,12 @@ int main(int argc, char** argv) {
       arguments.audience);  // for getting a valid access token just call the
                             // api
   secFree(scope_str);
+  if (arguments.trace) {
+    char* trace = requestTrace_toText();
+    fprintf(stderr, "%s", trace ?: "");
+    secFree(trace);
+    requestTrace_stop();
+  }
 
   if (response.token == NULL) {
     // fprintf(stderr, "Error: %s\n", oidcagent_serror());
@@ -9,6 +9,18 @@
 #define OPT_NAME 2
 #define OPT_AUDIENCE 3
 #define OPT_IDTOKEN 4
+#define OPT_TRACE 5
+#define OPT_STALEOK 6
+#define OPT_WATCH 7
+#define OPT_OUT 8
+#define OPT_FD 9
+#define OPT_REFRESH 10
+#define OPT_HELPER 11
+#define OPT_TIMEOUT 12
+#define OPT_STAGE_OUT 13
+#define OPT_STAGE_IN 14
+
+#define DEFAULT_REFRESH_PERCENT 75
 
 static struct argp_option options[] = {
     {0, 0, 0, 0, "General:", 1},
@@ -76,6 +88,52 @@ static struct argp_option options[] = {
      "development tool. ID-tokens should not be passed as authorization to "
      "resources.",
      2},
+    {"trace", OPT_TRACE, 0, 0,
+     "Prints the time spent in each stage of the request (client, oidc-agent "
+     "proxy and daemon, http request) to stderr.",
+     2},
+    {"stale-ok", OPT_STALEOK, 0, 0,
+     "Accepts an access token that is valid for less than the requested "
+     "minimum time, if it is still valid. oidc-agent then refreshes the token "
+     "in the background.",
+     2},
+    {"timeout", OPT_TIMEOUT, "SECONDS", 0,
+     "Gives up if oidc-agent did not answer within SECONDS. oidc-agent then "
+     "also drops the request instead of refreshing a token nobody waits for.",
+     2},
+
+    {0, 0, 0, 0, "Output:", 3},
+    {"out", OPT_OUT, "FILE", 0,
+     "Writes the access token to FILE instead of stdout. The file is replaced "
+     "atomically and new files are only readable by the user.",
+     3},
+#ifdef __linux__
+    {"fd", OPT_FD, "N", 0,
+     "Keeps the access token in a sealed memory file installed as file "
+     "descriptor N. Other processes can read it from /proc/<pid>/fd/N.",
+     3},
+#endif
+    {"watch", OPT_WATCH, 0, 0,
+     "Keeps running and writes a new access token to the output given with "
+     "--out or --fd before the current one expires.",
+     3},
+    {"refresh-at", OPT_REFRESH, "PERCENT", 0,
+     "With --watch the access token is refreshed after PERCENT of its "
+     "lifetime has passed. Default is 75.",
+     3},
+    {"helper", OPT_HELPER, "TOOL", 0,
+     "Acts as a credential helper for TOOL, which is one of 'git', 'docker', "
+     "and 'kubectl'. The action passed by git and docker is given after the "
+     "account. Access tokens are cached between calls.",
+     3},
+    {"stage-out", OPT_STAGE_OUT, "FILE", 0,
+     "Appends the access token to the staging file FILE instead of printing "
+     "it, e.g. on the node launching a batch job.",
+     3},
+    {"stage-in", OPT_STAGE_IN, "FILE", 0,
+     "Stages the access tokens of the staging file FILE into the local agent, "
+     "e.g. in a prolog on every node of a batch job. No account is given.",
+     3},
 
     {0, 0, 0, 0, "Help:", -1},
     {0, 'h', 0, OPTION_HIDDEN, 0, -1},
@@ -100,6 +158,41 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
       break;
     case OPT_SECCOMP: arguments->seccomp = 1; break;
     case OPT_IDTOKEN: arguments->idtoken = 1; break;
+    case OPT_TRACE: arguments->trace = 1; break;
+    case OPT_STALEOK: arguments->staleOk = 1; break;
+    case OPT_TIMEOUT:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->timeout = strToInt(arg);
+      break;
+    case OPT_WATCH: arguments->watch = 1; break;
+    case OPT_OUT: arguments->out_file = arg; break;
+    case OPT_STAGE_OUT: arguments->stage_out = arg; break;
+    case OPT_STAGE_IN: arguments->stage_in = arg; break;
+    case OPT_FD:
+      if (!isdigit(*arg)) {
+        return ARGP_ERR_UNKNOWN;
+      }
+      arguments->out_fd = strToInt(arg);
+      break;
+    case OPT_REFRESH:
+      if (!isdigit(*arg) || strToInt(arg) < 1 || strToInt(arg) > 99) {
+        argp_error(state, "--refresh-at must be between 1 and 99");
+      }
+      arguments->refresh_percent = strToInt(arg);
+      break;
+    case OPT_HELPER:
+      if (strequal(arg, "git")) {
+        arguments->helper = HELPER_GIT;
+      } else if (strequal(arg, "docker")) {
+        arguments->helper = HELPER_DOCKER;
+      } else if (strequal(arg, "kubectl")) {
+        arguments->helper = HELPER_KUBECTL;
+      } else {
+        argp_error(state, "Unknown helper '%s'", arg);
+      }
+      break;
     case OPT_NAME: arguments->application_name = arg; break;
     case OPT_AUDIENCE: arguments->audience = arg; break;
     case 'i':
@@ -125,22 +218,48 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
       argp_state_help(state, state->out_stream, ARGP_HELP_STD_HELP);
       break;
     case ARGP_KEY_ARG:
-      if (state->arg_num >= 1) {
+      if (state->arg_num >= 2) {
         argp_usage(state);
       }
       arguments->args[state->arg_num] = arg;
       break;
     case ARGP_KEY_END:
+      if (arguments->seccomp && (arguments->stage_in || arguments->stage_out)) {
+        argp_error(state,
+                   "--seccomp cannot be combined with --stage-in or "
+                   "--stage-out");
+      }
+      if (arguments->stage_in) {
+        if (state->arg_num > 0) {
+          argp_error(state, "--stage-in does not take an account");
+        }
+        break;
+      }
       if (state->arg_num < 1) {
         argp_usage(state);
       }
+      if (state->arg_num > 1 && (arguments->helper == HELPER_NONE ||
+                                 arguments->helper == HELPER_KUBECTL)) {
+        argp_usage(state);
+      }
+      if (arguments->watch && arguments->out_file == NULL &&
+          arguments->out_fd < 0) {
+        argp_error(state, "--watch requires --out or --fd");
+      }
+      if (arguments->seccomp &&
+          (arguments->out_file != NULL || arguments->out_fd >= 0)) {
+        argp_error(state, "--seccomp cannot be combined with --out or --fd");
+      }
+      if (arguments->seccomp && arguments->helper != HELPER_NONE) {
+        argp_error(state, "--seccomp cannot be combined with --helper");
+      }
       break;
     default: return ARGP_ERR_UNKNOWN;
   }
   return 0;
 }
 
-static char args_doc[] = "ACCOUNT_SHORTNAME | ISSUER_URL";
+static char args_doc[] = "ACCOUNT_SHORTNAME | ISSUER_URL [HELPER_ACTION]";
 
 static char doc[] =
     "oidc-token -- A client for oidc-agent for getting OIDC access tokens.";
@@ -150,6 +269,7 @@ struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
 void initArguments(struct arguments* arguments) {
   arguments->min_valid_period     = 0;
   arguments->args[0]              = NULL;
+  arguments->args[1]              = NULL;
   arguments->scopes               = NULL;
   arguments->application_name     = NULL;
   arguments->audience             = NULL;
@@ -163,4 +283,14 @@ void initArguments(struct arguments* arguments) {
   arguments->printAll             = 0;
   arguments->idtoken              = 0;
   arguments->forceNewToken        = 0;
+  arguments->trace                = 0;
+  arguments->staleOk              = 0;
+  arguments->watch                = 0;
+  arguments->helper               = HELPER_NONE;
+  arguments->out_file             = NULL;
+  arguments->stage_out            = NULL;
+  arguments->stage_in             = NULL;
+  arguments->out_fd               = -1;
+  arguments->refresh_percent      = DEFAULT_REFRESH_PERCENT;
+  arguments->timeout              = 0;
 }
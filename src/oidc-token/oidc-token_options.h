@@ -10,13 +10,18 @@
 #define ENV_ISS "OIDC_ISS"
 #define ENV_EXP "OIDC_EXP"
 
+#define HELPER_NONE 0
+#define HELPER_GIT 1
+#define HELPER_DOCKER 2
+#define HELPER_KUBECTL 3
+
 struct optional_arg {
   char* str;
   short useIt;
 };
 
 struct arguments {
-  char* args[1]; /* account shortname */
+  char* args[2]; /* account shortname and helper action */
 
   list_t* scopes;
 
@@ -31,8 +36,19 @@ struct arguments {
   unsigned char printAll;
   unsigned char idtoken;
   unsigned char forceNewToken;
+  unsigned char trace;
+  unsigned char staleOk;
+  unsigned char watch;
+  unsigned char helper;
+
+  char* out_file;
+  char* stage_out;
+  char* stage_in;
+  int   out_fd;
+  int   refresh_percent;
 
   time_t min_valid_period;
+  time_t timeout;
 };
 
 void initArguments(struct arguments* arguments);
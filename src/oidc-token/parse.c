@@ -4,7 +4,10 @@
 #include "defines/oidc_values.h"
 #include "utils/json.h"
 #include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
 #include "utils/printer.h"
+#include "utils/requestTrace.h"
 #include "utils/stringUtils.h"
 
 struct token_response parseForTokenResponse(char* response) {
@@ -12,7 +15,7 @@ struct token_response parseForTokenResponse(char* response) {
     return (struct token_response){NULL, NULL, 0};
   }
   INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, OIDC_KEY_ACCESSTOKEN,
-                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT);
+                 OIDC_KEY_ISSUER, AGENT_KEY_EXPIRESAT, IPC_KEY_TRACE);
   if (CALL_GETJSONVALUES(response) < 0) {
     printError("Read malformed data. Please hand in bug report.\n");
     secFree(response);
@@ -20,10 +23,16 @@ struct token_response parseForTokenResponse(char* response) {
     return (struct token_response){NULL, NULL, 0};
   }
   secFree(response);
-  KEY_VALUE_VARS(status, error, access_token, issuer, expires_at);
+  KEY_VALUE_VARS(status, error, access_token, issuer, expires_at, trace);
+  requestTrace_merge(_trace);
+  secFree(_trace);
   if (_error) {  // error
-    oidc_errno = OIDC_EERROR;
-    oidc_seterror(_error);
+    if (strequal(_status, STATUS_BUSY)) {
+      oidc_errno = OIDC_EBUSY;
+    } else {
+      oidc_errno = OIDC_EERROR;
+      oidc_seterror(_error);
+    }
     SEC_FREE_KEY_VALUES();
     return (struct token_response){NULL, NULL, 0};
   } else {
@@ -34,3 +43,121 @@ struct token_response parseForTokenResponse(char* response) {
     return (struct token_response){_access_token, _issuer, expires_at};
   }
 }
+
+/**
+ * @brief parses the response to a batch of access token requests
+ * @return an array of @p count token responses or @c NULL if the whole batch
+ * failed. If some of the requests failed, @c oidc_errno is set to the error of
+ * the first failed request.
+ */
+struct token_response* parseForTokenResponses(char* response, size_t count) {
+  if (response == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(OIDC_KEY_ERROR, IPC_KEY_RESPONSES);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    printError("Read malformed data. Please hand in bug report.\n");
+    secFree(response);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(response);
+  KEY_VALUE_VARS(error, responses);
+  if (_error) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror(_error);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  list_t* list = _responses ? JSONArrayStringToList(_responses) : NULL;
+  SEC_FREE_KEY_VALUES();
+  if (list == NULL || list->len != count) {
+    secFreeList(list);
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror("Received wrong number of token responses");
+    return NULL;
+  }
+  struct token_response* ret =
+      secAlloc(sizeof(struct token_response) * count);
+  struct oidc_error_state* firstError = NULL;
+  for (size_t i = 0; i < count; i++) {
+    ret[i] = parseForTokenResponse(oidc_strcopy(list_at(list, i)->val));
+    if (ret[i].token == NULL && firstError == NULL) {
+      firstError = saveErrorState();
+    }
+  }
+  secFreeList(list);
+  if (firstError) {
+    restoreAndFreeErrorState(firstError);
+  } else {
+    oidc_errno = OIDC_SUCCESS;
+  }
+  return ret;
+}
+
+/**
+ * @brief parses a response that only carries a status
+ * @return @c OIDC_SUCCESS or the error code; @c oidc_errno is set as well
+ */
+int parseForStatus(char* response) {
+  if (response == NULL) {
+    return oidc_errno;
+  }
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    printError("Read malformed data. Please hand in bug report.\n");
+    secFree(response);
+    SEC_FREE_KEY_VALUES();
+    return oidc_errno;
+  }
+  secFree(response);
+  KEY_VALUE_VARS(status, error);
+  if (strequal(_status, STATUS_BUSY)) {
+    oidc_errno = OIDC_EBUSY;
+  } else if (_error) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror(_error);
+  } else {
+    oidc_errno = OIDC_SUCCESS;
+  }
+  SEC_FREE_KEY_VALUES();
+  return oidc_errno;
+}
+
+/**
+ * @brief parses the info of a successful response
+ * @param response the response; it is freed
+ * @return a pointer to the info; a json object or array is returned as json
+ * string. Has to be freed after usage. On failure @c NULL is returned and
+ * @c oidc_errno is set.
+ */
+char* parseForInfo(char* response) {
+  if (response == NULL) {
+    return NULL;
+  }
+  INIT_KEY_VALUE(IPC_KEY_STATUS, OIDC_KEY_ERROR, IPC_KEY_INFO);
+  if (CALL_GETJSONVALUES(response) < 0) {
+    printError("Read malformed data. Please hand in bug report.\n");
+    secFree(response);
+    SEC_FREE_KEY_VALUES();
+    return NULL;
+  }
+  secFree(response);
+  KEY_VALUE_VARS(status, error, info);
+  if (strequal(_status, STATUS_BUSY)) {
+    oidc_errno = OIDC_EBUSY;
+  } else if (_error) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror(_error);
+  } else if (_info == NULL) {
+    oidc_errno = OIDC_EERROR;
+    oidc_seterror("The agent's response did not contain any info");
+  } else {
+    oidc_errno = OIDC_SUCCESS;
+    char* info = oidc_strcopy(_info);
+    SEC_FREE_KEY_VALUES();
+    return info;
+  }
+  SEC_FREE_KEY_VALUES();
+  return NULL;
+}
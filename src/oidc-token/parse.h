@@ -3,6 +3,11 @@
 
 #include "api.h"
 
-struct token_response parseForTokenResponse(char* response);
+#include <stddef.h>
+
+struct token_response  parseForTokenResponse(char* response);
+struct token_response* parseForTokenResponses(char* response, size_t count);
+int                    parseForStatus(char* response);
+char*                  parseForInfo(char* response);
 
 #endif /* OIDC_TOKEN_PARSE_H */
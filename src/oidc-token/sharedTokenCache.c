@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sharedTokenCache.h"
+#include "defines/agent_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <libgen.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The shared token cache keeps access tokens obtained by the credential
+ * helper modes of oidc-token in files, so that helpers that are started for
+ * every command do not have to ask the agent each time. The files are kept in
+ * a directory next to the socket of the agent that is only accessible by the
+ * user; they belong to that agent and are not used with another one.
+ */
+
+#define SHARED_TOKEN_CACHE_DIR "tokens"
+#define SHARED_TOKEN_CACHE_KEY "key"
+
+static char* _cacheKey(const char* name, const char* scope,
+                       const char* audience) {
+  return oidc_sprintf("%s %s %s", name ?: "", scope ?: "", audience ?: "");
+}
+
+static uint64_t _hashKey(const char* key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char* c = key; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief returns the cache directory of the current agent, creating it if
+ * needed
+ * @return a pointer to the path or @c NULL if there is no agent socket or the
+ * directory is not private to the user. Has to be freed after usage.
+ */
+static char* _cacheDir() {
+  const char* sock = getenv(OIDC_SOCK_ENV_NAME);
+  if (!strValid(sock)) {
+    return NULL;
+  }
+  char* sockCopy = oidc_strcopy(sock);
+  char* dir =
+      oidc_sprintf("%s/%s", dirname(sockCopy), SHARED_TOKEN_CACHE_DIR);
+  secFree(sockCopy);
+  if (dir == NULL) {
+    return NULL;
+  }
+  mkdir(dir, 0700);
+  struct stat st;
+  if (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+      (st.st_mode & 077) != 0) {
+    secFree(dir);
+    return NULL;
+  }
+  return dir;
+}
+
+static char* _cachePath(const char* key) {
+  char* dir = _cacheDir();
+  if (dir == NULL) {
+    return NULL;
+  }
+  char* path = oidc_sprintf("%s/%016lx", dir, (unsigned long)_hashKey(key));
+  secFree(dir);
+  return path;
+}
+
+/**
+ * @brief returns a cached access token that is valid for at least
+ * @p min_valid_period seconds
+ * @return the token response; its @c token is @c NULL if no such token is
+ * cached. Has to be freed after usage using @c secFreeTokenResponse.
+ */
+struct token_response sharedTokenCache_get(const char* name, const char* scope,
+                                           const char* audience,
+                                           time_t      min_valid_period) {
+  struct token_response response = {NULL, NULL, 0};
+  if (min_valid_period == FORCE_NEW_TOKEN) {
+    return response;
+  }
+  char* key     = _cacheKey(name, scope, audience);
+  char* path    = key ? _cachePath(key) : NULL;
+  char* content = path && fileDoesExist(path) ? readFile(path) : NULL;
+  secFree(path);
+  cJSON* json = stringToJson(content);
+  secFree(content);
+  char* cachedKey = json ? getJSONValue(json, SHARED_TOKEN_CACHE_KEY) : NULL;
+  const cJSON* expires_at =
+      json ? cJSON_GetObjectItemCaseSensitive(json, AGENT_KEY_EXPIRESAT) : NULL;
+  if (strequal(key, cachedKey) && cJSON_IsNumber(expires_at) &&
+      expires_at->valuedouble >= time(NULL) + min_valid_period) {
+    response.token      = getJSONValue(json, OIDC_KEY_ACCESSTOKEN);
+    response.issuer     = getJSONValue(json, OIDC_KEY_ISSUER);
+    response.expires_at = (time_t)expires_at->valuedouble;
+  }
+  secFree(cachedKey);
+  secFreeJson(json);
+  secFree(key);
+  return response;
+}
+
+/**
+ * @brief stores the access token of @p response in the cache
+ * Tokens without an expiration time are not cached.
+ */
+void sharedTokenCache_put(const char* name, const char* scope,
+                          const char*           audience,
+                          struct token_response response) {
+  if (response.token == NULL || response.expires_at <= 0) {
+    return;
+  }
+  char* key  = _cacheKey(name, scope, audience);
+  char* path = key ? _cachePath(key) : NULL;
+  if (path == NULL) {
+    secFree(key);
+    return;
+  }
+  cJSON* json = generateJSONObject(
+      SHARED_TOKEN_CACHE_KEY, cJSON_String, key, OIDC_KEY_ACCESSTOKEN,
+      cJSON_String, response.token, OIDC_KEY_ISSUER, cJSON_String,
+      response.issuer ?: "", AGENT_KEY_EXPIRESAT, cJSON_Number,
+      (long)response.expires_at, NULL);
+  char* content = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  if (content) {
+    writeFileAtomic(path, content);
+  }
+  secFree(content);
+  secFree(path);
+  secFree(key);
+}
@@ -0,0 +1,15 @@
+#ifndef OIDC_TOKEN_SHARED_TOKEN_CACHE_H
+#define OIDC_TOKEN_SHARED_TOKEN_CACHE_H
+
+#include "api.h"
+
+#include <time.h>
+
+struct token_response sharedTokenCache_get(const char* name, const char* scope,
+                                           const char* audience,
+                                           time_t      min_valid_period);
+void sharedTokenCache_put(const char* name, const char* scope,
+                          const char*           audience,
+                          struct token_response response);
+
+#endif  // OIDC_TOKEN_SHARED_TOKEN_CACHE_H
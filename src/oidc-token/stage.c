@@ -0,0 +1,159 @@
+#include "stage.h"
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "utils/file_io/file_io.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/printer.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Token staging for batch jobs: on the launching node --stage-out obtains a
+ * token once and appends it to a staging file; on every node of the job
+ * --stage-in passes the tokens of that file to the local agent, e.g. from a
+ * Slurm prolog. An agent that forwards token requests to an upstream agent
+ * then answers the processes of the job from the staged tokens, so that the
+ * upstream agent and the provider see one request per token instead of one
+ * per process.
+ *
+ * The staging file has one json object per line with the token request and
+ * the token.
+ */
+
+static char* _stagedToken(const struct arguments* arguments,
+                          unsigned char useIssuer, const char* scope,
+                          struct token_response response) {
+  cJSON* request = cJSON_CreateObject();
+  jsonAddStringValue(request, useIssuer ? IPC_KEY_ISSUERURL : IPC_KEY_SHORTNAME,
+                     arguments->args[0]);
+  if (strValid(scope)) {
+    jsonAddStringValue(request, OIDC_KEY_SCOPE, scope);
+  }
+  if (strValid(arguments->audience)) {
+    jsonAddStringValue(request, IPC_KEY_AUDIENCE, arguments->audience);
+  }
+  cJSON* token = generateJSONObject(
+      OIDC_KEY_ACCESSTOKEN, cJSON_String, response.token, OIDC_KEY_ISSUER,
+      cJSON_String, response.issuer ?: "", AGENT_KEY_EXPIRESAT, cJSON_Number,
+      (long)response.expires_at, NULL);
+  cJSON* json = cJSON_CreateObject();
+  jsonAddJSON(json, IPC_KEY_TOKENREQUEST, request);
+  jsonAddJSON(json, IPC_KEY_TOKENRESPONSE, token);
+  char* line = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return line;
+}
+
+/**
+ * @brief obtains an access token and appends it to the staging file
+ * The file is created only readable by the user.
+ * @return the exit code
+ */
+int token_stageOut(const struct arguments* arguments,
+                   tokenResponseFnc getTokenResponseFnc, const char* scope,
+                   const char* application_name) {
+  struct token_response response = getTokenResponseFnc(
+      arguments->args[0], arguments->min_valid_period, scope,
+      application_name, arguments->audience);
+  if (response.token == NULL) {
+    oidcagent_perror();
+    return EXIT_FAILURE;
+  }
+  unsigned char useIssuer = strstarts(arguments->args[0], "https://");
+  char*         line      = _stagedToken(arguments, useIssuer, scope, response);
+  secFreeTokenResponse(response);
+  char* text = oidc_sprintf("%s\n", line);
+  secFree(line);
+  int fd = open(arguments->stage_out, O_WRONLY | O_CREAT | O_APPEND, 0600);
+  if (fd < 0) {
+    secFree(text);
+    oidc_setErrnoError();
+    oidc_perror();
+    return EXIT_FAILURE;
+  }
+  size_t  len    = strlen(text);
+  ssize_t n      = write(fd, text, len);
+  int     closed = close(fd);
+  secFree(text);
+  if (n != (ssize_t)len || closed != 0) {
+    oidc_setErrnoError();
+    oidc_perror();
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+struct stageCounts {
+  unsigned int staged;
+  unsigned int failed;
+};
+
+static const char* _stringValue(const cJSON* json, const char* key) {
+  return cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, key));
+}
+
+static int _stageLine(char* line, struct stageCounts* counts) {
+  if (!strValid(line)) {
+    return 0;
+  }
+  cJSON* json = stringToJson(line);
+  const cJSON* request =
+      cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_TOKENREQUEST);
+  const cJSON* token =
+      cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_TOKENRESPONSE);
+  const cJSON* expires_at =
+      cJSON_GetObjectItemCaseSensitive(token, AGENT_KEY_EXPIRESAT);
+  struct token_request r = {
+      .accountname = _stringValue(request, IPC_KEY_SHORTNAME),
+      .issuer_url  = _stringValue(request, IPC_KEY_ISSUERURL),
+      .scope       = _stringValue(request, OIDC_KEY_SCOPE),
+      .audience    = _stringValue(request, IPC_KEY_AUDIENCE),
+  };
+  struct token_response response = {
+      .token      = (char*)_stringValue(token, OIDC_KEY_ACCESSTOKEN),
+      .issuer     = (char*)_stringValue(token, OIDC_KEY_ISSUER),
+      .expires_at = cJSON_IsNumber(expires_at)
+                        ? (time_t)cJSON_GetNumberValue(expires_at)
+                        : 0,
+  };
+  if (response.token == NULL ||
+      (r.accountname == NULL && r.issuer_url == NULL)) {
+    printError("Skipping malformed line of the staging file\n");
+    counts->failed++;
+  } else if (response.expires_at <= time(NULL)) {
+    printError("Skipping expired token of '%s'\n",
+               r.accountname ?: r.issuer_url);
+  } else if (oidcagent_stageToken(&r, response) != 0) {
+    printError("Could not stage token of '%s': %s\n",
+               r.accountname ?: r.issuer_url, oidcagent_serror());
+    counts->failed++;
+  } else {
+    counts->staged++;
+  }
+  secFreeJson(json);
+  return 0;
+}
+
+/**
+ * @brief stages the tokens of a staging file into the local agent
+ * Expired tokens are skipped.
+ * @return the exit code; @c EXIT_FAILURE if a token could not be staged
+ */
+int token_stageIn(const char* path) {
+  struct stageCounts counts = {0};
+  if (forEachLineInFile(path, 0, (lineCallback)_stageLine, &counts) !=
+      OIDC_SUCCESS) {
+    oidc_perror();
+    return EXIT_FAILURE;
+  }
+  printStdout("Staged %u token(s)\n", counts.staged);
+  return counts.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
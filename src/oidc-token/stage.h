@@ -0,0 +1,12 @@
+#ifndef OIDC_TOKEN_STAGE_H
+#define OIDC_TOKEN_STAGE_H
+
+#include "oidc-token_options.h"
+#include "watch.h"
+
+int token_stageOut(const struct arguments* arguments,
+                   tokenResponseFnc getTokenResponseFnc, const char* scope,
+                   const char* application_name);
+int token_stageIn(const char* path);
+
+#endif  // OIDC_TOKEN_STAGE_H
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE  // memfd_create
+#include "watch.h"
+#include "defines/agent_values.h"
+#include "utils/file_io/file_io.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/printer.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * With --out and --fd the access token is written to a file or a memory file
+ * instead of stdout. With --watch oidc-token keeps running and replaces the
+ * token after a part of its lifetime has passed, so that many consumers can
+ * read the token without each of them calling oidc-token.
+ */
+
+#define WATCH_MIN_INTERVAL 5
+#define WATCH_RETRY_INTERVAL 30
+#define WATCH_UNKNOWN_EXPIRY_INTERVAL 300
+
+static volatile sig_atomic_t stopWatching = 0;
+
+static void _stopWatching(int signum) {
+  (void)signum;
+  stopWatching = 1;
+}
+
+static void _installSignalHandlers() {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = _stopWatching;
+  sigemptyset(&sa.sa_mask);
+  // no SA_RESTART, so that sleep returns early
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+}
+
+#ifdef __linux__
+/**
+ * @brief writes @p text to a new sealed memory file and installs it as file
+ * descriptor @p target
+ * Readers that open /proc/<pid>/fd/<target> always get a complete token; the
+ * previous memory file is released when it is replaced.
+ */
+static oidc_error_t _writeTokenFd(int target, const char* text) {
+  int fd = memfd_create("oidc-token", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  size_t len     = strlen(text);
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = write(fd, text + written, len - written);
+    if (n < 0) {
+      oidc_setErrnoError();
+      close(fd);
+      return oidc_errno;
+    }
+    written += n;
+  }
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0 ||
+      dup2(fd, target) < 0) {
+    oidc_setErrnoError();
+    close(fd);
+    return oidc_errno;
+  }
+  close(fd);
+  return OIDC_SUCCESS;
+}
+#endif
+
+static oidc_error_t _writeToken(const struct arguments* arguments,
+                                const char*             token) {
+  char* text = oidc_sprintf("%s\n", token);
+  if (text == NULL) {
+    return oidc_errno;
+  }
+  oidc_error_t e = OIDC_SUCCESS;
+  if (arguments->out_file) {
+    e = writeFileAtomic(arguments->out_file, text);
+  }
+#ifdef __linux__
+  if (e == OIDC_SUCCESS && arguments->out_fd >= 0) {
+    e = _writeTokenFd(arguments->out_fd, text);
+  }
+#endif
+  secFree(text);
+  return e;
+}
+
+/**
+ * @brief returns the time at which a token obtained at @p obtained_at should
+ * be replaced
+ */
+static time_t _nextRefresh(const struct arguments* arguments,
+                           time_t obtained_at, unsigned long expires_at) {
+  time_t next = obtained_at + WATCH_UNKNOWN_EXPIRY_INTERVAL;
+  if (expires_at > (unsigned long)obtained_at) {
+    next = obtained_at +
+           (expires_at - obtained_at) * arguments->refresh_percent / 100;
+  }
+  if (next < obtained_at + WATCH_MIN_INTERVAL) {
+    next = obtained_at + WATCH_MIN_INTERVAL;
+  }
+  return next;
+}
+
+static void _sleepUntil(time_t t) {
+  time_t now = time(NULL);
+  if (t <= now) {
+    return;
+  }
+  unsigned int remaining = t - now;
+  while (!stopWatching && remaining > 0) { remaining = sleep(remaining); }
+}
+
+/**
+ * @brief writes an access token to the outputs given with --out and --fd
+ * With --watch this does not return until oidc-token is terminated; the token
+ * is replaced after @c refresh_percent of its lifetime and the file given with
+ * --out is removed on termination. If a token cannot be obtained the last one
+ * is kept and the request is retried.
+ * @return the exit status
+ */
+int token_writeOutputs(const struct arguments* arguments,
+                       tokenResponseFnc getTokenResponseFnc, const char* scope,
+                       const char* application_name) {
+  if (arguments->watch) {
+    _installSignalHandlers();
+  }
+  time_t        min_valid_period = arguments->forceNewToken
+                                       ? FORCE_NEW_TOKEN
+                                       : arguments->min_valid_period;
+  unsigned long expires_at       = 0;
+  while (!stopWatching) {
+    time_t                now      = time(NULL);
+    struct token_response response = getTokenResponseFnc(
+        arguments->args[0], min_valid_period, scope, application_name,
+        arguments->audience);
+    time_t next = now + WATCH_RETRY_INTERVAL;
+    if (response.token == NULL) {
+      oidcagent_perror();
+    } else if (_writeToken(arguments, response.token) != OIDC_SUCCESS) {
+      printError("Error: %s\n", oidc_serror());
+    } else {
+      expires_at = response.expires_at;
+      next       = _nextRefresh(arguments, now, expires_at);
+      if (!arguments->watch) {
+        secFreeTokenResponse(response);
+        return EXIT_SUCCESS;
+      }
+    }
+    secFreeTokenResponse(response);
+    if (!arguments->watch) {
+      return EXIT_FAILURE;
+    }
+    _sleepUntil(next);
+    // the agent returns its cached token if that is valid long enough, so a
+    // fresh one has to be requested explicitly
+    if (min_valid_period != FORCE_NEW_TOKEN &&
+        expires_at > (unsigned long)time(NULL)) {
+      time_t remaining = expires_at - time(NULL);
+      min_valid_period = remaining >= arguments->min_valid_period
+                             ? remaining + 1
+                             : arguments->min_valid_period;
+    }
+  }
+  if (arguments->out_file) {
+    removeFile(arguments->out_file);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#ifndef OIDC_TOKEN_WATCH_H
+#define OIDC_TOKEN_WATCH_H
+
+#include "oidc-token_options.h"
+
+#include "api.h"
+
+typedef struct token_response (*tokenResponseFnc)(const char*, time_t,
+                                                  const char*, const char*,
+                                                  const char*);
+
+int token_writeOutputs(const struct arguments* arguments,
+                       tokenResponseFnc getTokenResponseFnc,
+                       const char* scope, const char* application_name);
+
+#endif  // OIDC_TOKEN_WATCH_H
@@ -18,7 +18,7 @@ void initOidcAgentPrivileges(struct arguments* arguments) {
   addGeneralSysCalls(ctx);
   addLoggingSysCalls(ctx);
   // addPrintingSysCalls(ctx);
-  if (arguments->kill_flag) {
+  if (arguments->kill_flag || arguments->attach) {
     addKillSysCall(ctx);
   }
   addSocketSysCalls(ctx);
@@ -8,8 +8,7 @@
 
 // #include <unistd.h>
 
-void initOidcGenPrivileges(
-    __attribute__((unused)) struct arguments* arguments) {
+void initOidcGenPrivileges(struct arguments* arguments) {
   int             rc  = -1;
   scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
   if (ctx == NULL) {
@@ -25,6 +24,9 @@ void initOidcGenPrivileges(
   addSignalHandlingSysCalls(
       ctx);  // needed if auth code flow is executed -> not needed if flow!=code
   addSleepSysCalls(ctx);
+  if (arguments->reencryptAll) {  // threads
+    addDaemonSysCalls(ctx);
+  }
 
   rc = seccomp_load(ctx);
   seccomp_release(ctx);
@@ -1,15 +1,166 @@
-// #define _XOPEN_SOURCE 500
+#define _POSIX_C_SOURCE 200809L
 #include "token_privileges.h"
+#include "defines/settings.h"
+#include "defines/version.h"
 #include "privileges.h"
+#include "utils/file_io/file_io.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
 
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <seccomp.h>
+#include <sodium.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // #include <unistd.h>
 
+/**
+ * Compiling the seccomp filter reads and resolves all privilege files, which
+ * takes longer than the rest of a cached oidc-token call. Therefore the
+ * compiled filter is kept in the runtime dir of the user and loaded directly
+ * as long as it was compiled by the same version from the same privilege files
+ * for the same architecture.
+ */
+
+#define TOKEN_FILTER_CACHE "oidc-token.bpf"
+#define TOKEN_FILTER_MAGIC "OIDCBPF2"
+#define TOKEN_FILTER_MAX_SIZE (64 * 1024)
+
+// the privilege files used by initOidcTokenPrivileges
+static const char* const privilegeFiles[] = {"general", "memory", "print",
+                                             "time",    "logging", "socket"};
+
+struct filterCacheHeader {
+  char          magic[8];
+  char          version[32];
+  unsigned char hash[crypto_generichash_BYTES];
+};
+
+/**
+ * @brief fills @p header with the version and a hash of everything the filter
+ * is compiled from: the architecture, the libseccomp version and the names and
+ * contents of the privilege files
+ * @return @c 0 on success, @c -1 if a file could not be read
+ */
+static int _filterStamp(struct filterCacheHeader* header) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, TOKEN_FILTER_MAGIC, sizeof(header->magic));
+  strncpy(header->version, VERSION, sizeof(header->version) - 1);
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, NULL, 0, sizeof(header->hash));
+  char* build = oidc_sprintf("%u %d.%d.%d", seccomp_arch_native(),
+                             SCMP_VER_MAJOR, SCMP_VER_MINOR, SCMP_VER_MICRO);
+  crypto_generichash_update(&state, (unsigned char*)build, strlen(build) + 1);
+  secFree(build);
+  for (size_t i = 0; i < sizeof(privilegeFiles) / sizeof(*privilegeFiles);
+       i++) {
+    char* path =
+        oidc_sprintf("%s/%s.priv", PRIVILEGES_PATH, privilegeFiles[i]);
+    char* content = readFile(path);
+    secFree(path);
+    if (content == NULL) {
+      return -1;
+    }
+    crypto_generichash_update(&state, (unsigned char*)privilegeFiles[i],
+                              strlen(privilegeFiles[i]) + 1);
+    crypto_generichash_update(&state, (unsigned char*)content,
+                              strlen(content) + 1);
+    secFree(content);
+  }
+  crypto_generichash_final(&state, header->hash, sizeof(header->hash));
+  return 0;
+}
+
+static char* _filterCachePath() {
+  const char* dir = getenv("XDG_RUNTIME_DIR");
+  return strValid(dir) ? oidc_sprintf("%s/%s", dir, TOKEN_FILTER_CACHE) : NULL;
+}
+
+/**
+ * @brief loads the cached filter if it was compiled from the current
+ * privilege files
+ * @return @c 0 if the filter was loaded, @c -1 otherwise
+ */
+static int _loadCachedFilter(const char*                     path,
+                             const struct filterCacheHeader* stamp) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_uid != getuid() ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+      st.st_size <= (off_t)sizeof(*stamp) ||
+      st.st_size > TOKEN_FILTER_MAX_SIZE) {
+    close(fd);
+    return -1;
+  }
+  char*  content = secAlloc(st.st_size);
+  size_t read_   = 0;
+  while (read_ < (size_t)st.st_size) {
+    ssize_t n = read(fd, content + read_, st.st_size - read_);
+    if (n <= 0) {
+      break;
+    }
+    read_ += n;
+  }
+  close(fd);
+  size_t filterLen = read_ - sizeof(*stamp);
+  if (read_ != (size_t)st.st_size ||
+      memcmp(content, stamp, sizeof(*stamp)) != 0 ||
+      filterLen % sizeof(struct sock_filter) != 0) {
+    secFree(content);
+    return -1;
+  }
+  struct sock_fprog prog = {
+      .len    = filterLen / sizeof(struct sock_filter),
+      .filter = (struct sock_filter*)(content + sizeof(*stamp))};
+  int rc = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+                   prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0
+               ? 0
+               : -1;
+  secFree(content);
+  return rc;
+}
+
+/**
+ * @brief writes the compiled filter of @p ctx to the cache
+ * Has to be called before the filter is loaded, since writing files is not
+ * allowed afterwards.
+ */
+static void _cacheFilter(const char* path, scmp_filter_ctx ctx,
+                         const struct filterCacheHeader* stamp) {
+  char* tmp = oidc_sprintf("%s.XXXXXX", path);
+  int   fd  = mkstemp(tmp);
+  if (fd < 0) {
+    secFree(tmp);
+    return;
+  }
+  int ok = write(fd, stamp, sizeof(*stamp)) == (ssize_t)sizeof(*stamp) &&
+           seccomp_export_bpf(ctx, fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+  secFree(tmp);
+}
+
 void initOidcTokenPrivileges(
     __attribute__((unused)) struct arguments* arguments) {
+  struct filterCacheHeader stamp;
+  char*                    cachePath =
+      _filterStamp(&stamp) == 0 ? _filterCachePath() : NULL;
+  if (cachePath && _loadCachedFilter(cachePath, &stamp) == 0) {
+    secFree(cachePath);
+    return;
+  }
   int             rc  = -1;
   scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
   if (ctx == NULL) {
@@ -20,6 +171,10 @@ void initOidcTokenPrivileges(
   addLoggingSysCalls(ctx);
   addSocketSysCalls(ctx);
 
+  if (cachePath) {
+    _cacheFilter(cachePath, ctx, &stamp);
+    secFree(cachePath);
+  }
   rc = seccomp_load(ctx);
   seccomp_release(ctx);
   checkRc(rc, "seccomp_load", "");
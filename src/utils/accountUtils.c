@@ -1,5 +1,6 @@
 #include "accountUtils.h"
 #include "account/account.h"
+#include "account/setandget.h"
 #include "deathUtils.h"
 #include "utils/crypt/cryptUtils.h"
 #include "utils/db/account_db.h"
@@ -7,6 +8,7 @@
 #include "utils/file_io/file_io.h"
 #include "utils/file_io/promptCryptFileUtils.h"
 #include "utils/json.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/promptUtils.h"
 #include "utils/stringUtils.h"
@@ -35,6 +37,21 @@ struct oidc_account* getDeathAccount() {
   return accountDB_getDeathEntry((time_t(*)(void*))account_getDeath);
 }
 
+/**
+ * @brief moves the death of all loaded accounts with a lifetime by @p delta
+ * seconds, because the wall clock was set by that much
+ */
+void shiftAccountDeaths(time_t delta) {
+  const vector_t* accounts = accountDB_getList();
+  for (size_t i = 0; accounts && i < accounts->len; i++) {
+    struct oidc_account* account = vector_at(accounts, i);
+    time_t               death   = account_getDeath(account);
+    if (death) {
+      account_setDeath(account, death + delta);
+    }
+  }
+}
+
 struct oidc_account* getAccountFromMaybeEncryptedFile(const char* filepath) {
   if (filepath == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -45,8 +62,8 @@ struct oidc_account* getAccountFromMaybeEncryptedFile(const char* filepath) {
     return NULL;
   }
   if (!isJSONObject(config)) {
-    char* tmp = getDecryptedTextWithPromptFor(
-        config, filepath, decryptFileContent, 0, NULL, NULL, NULL);
+    char* tmp = getDecryptedTextWithPromptFor(filepath, filepath, decryptFile,
+                                              0, NULL, NULL, NULL);
     if (NULL == tmp) {
       return NULL;
     }
@@ -144,6 +161,35 @@ struct oidc_account* getDecryptedAccountFromFilePrompt(const char* accountname,
   return p;
 }
 
+/**
+ * @brief decrypts the account config @p accountname with the key sealed in
+ * its file, i.e. without a password and without the key derivation
+ * @return the account config as json or @c NULL if the file is not sealed to
+ * this host. Has to be freed after usage.
+ */
+char* getDecryptedAccountAsStringSealed(const char* accountname) {
+  if (accountname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  char* config = decryptOidcFileSealed(accountname);
+  if (config == NULL) {
+    return NULL;
+  }
+  struct oidc_account* p = getAccountFromJSON(config);
+  secFree(config);
+  if (p == NULL) {
+    return NULL;
+  }
+  char* json = accountToJSONString(p);
+  secFreeAccount(p);
+  return json;
+}
+
+/**
+ * If the file is sealed to this host, it is decrypted without prompting and
+ * the returned password is @c NULL.
+ */
 struct resultWithEncryptionPassword
 getDecryptedAccountAsStringAndPasswordFromFilePrompt(const char* accountname,
                                                      const char* pw_cmd,
@@ -153,6 +199,11 @@ getDecryptedAccountAsStringAndPasswordFromFilePrompt(const char* accountname,
     oidc_setArgNullFuncError(__func__);
     return RESULT_WITH_PASSWORD_NULL;
   }
+  char* sealed = getDecryptedAccountAsStringSealed(accountname);
+  if (sealed) {
+    return (struct resultWithEncryptionPassword){.result   = sealed,
+                                                 .password = NULL};
+  }
   struct resultWithEncryptionPassword result =
       getDecryptedAccountAndPasswordFromFilePrompt(accountname, pw_cmd, pw_file,
                                                    pw_env);
@@ -180,28 +231,75 @@ char* getDecryptedAccountAsStringFromFilePrompt(const char* accountname,
   return result.result;
 }
 
+/**
+ * In multi-user mode (see --multi-user) the accounts of all users are kept in
+ * the same db, so that they share the connections and caches of the agent.
+ * Every account belongs to the user who loaded it and the lookups only find
+ * the accounts of the tenant, i.e. the user whose request is handled. With a
+ * single user all accounts belong to the tenant @c 0.
+ */
+static uid_t tenant = 0;
+
+void accounts_setTenant(uid_t uid) { tenant = uid; }
+
+uid_t accounts_getTenant() { return tenant; }
+
+int account_isOfTenant(const struct oidc_account* account) {
+  return account_getOwner(account) == tenant;
+}
+
+/**
+ * @brief match function for the account db that compares the short names and
+ * only matches accounts of the tenant
+ */
+int account_matchByNameOfTenant(const struct oidc_account* key,
+                                const struct oidc_account* account) {
+  return account_isOfTenant(account) && account_matchByName(key, account);
+}
+
 struct oidc_account* db_findAccountByShortname(const char* shortname) {
   if (shortname == NULL) {
     return NULL;
   }
-  char*                tmp     = oidc_strcopy(shortname);
-  struct oidc_account  key     = {.shortname = tmp};
-  struct oidc_account* account = accountDB_findValue(&key);
-  secFree(tmp);
-  return account;
+  struct oidc_account* found =
+      accountDB_findValueByIndex(ACCOUNTDB_INDEX_SHORTNAME, shortname);
+  if (found == NULL || account_isOfTenant(found)) {
+    return found;
+  }
+  // another user loaded an account with the same name first
+  found = NULL;
+  list_t* all =
+      accountDB_findAllValuesByIndex(ACCOUNTDB_INDEX_SHORTNAME, shortname);
+  for (list_node_t* node = all ? all->head : NULL; node && !found;
+       node = node->next) {
+    if (account_isOfTenant(node->val)) {
+      found = node->val;
+    }
+  }
+  secFreeList(all);
+  return found;
 }
 
 list_t* db_findAccountsByIssuerUrl(const char* issuer_url) {
   if (issuer_url == NULL) {
     return NULL;
   }
-  matchFunction oldMatch =
-      accountDB_setMatchFunction((matchFunction)account_matchByIssuerUrl);
-  char*               tmp      = oidc_strcopy(issuer_url);
-  struct oidc_issuer  iss      = {.issuer_url = tmp};
-  struct oidc_account key      = {.issuer = &iss};
-  list_t*             accounts = accountDB_findAllValues(&key);
-  secFree(tmp);
-  accountDB_setMatchFunction(oldMatch);
+  list_t* accounts =
+      accountDB_findAllValuesByIndex(ACCOUNTDB_INDEX_ISSUERURL, issuer_url);
+  if (accounts == NULL) {
+    return NULL;
+  }
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(accounts, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (!account_isOfTenant(node->val)) {
+      list_remove(accounts, node);
+    }
+  }
+  list_iterator_destroy(it);
+  if (!listValid(accounts)) {
+    secFreeList(accounts);
+    accounts = NULL;
+  }
   return accounts;
 }
@@ -3,10 +3,12 @@
 
 #include "account/account.h"
 
+#include <sys/types.h>
 #include <time.h>
 
 time_t               getMinAccountDeath();
 struct oidc_account* getDeathAccount();
+void                 shiftAccountDeaths(time_t delta);
 
 struct oidc_account* getAccountFromFile(const char* filepath);
 struct oidc_account* getDecryptedAccountFromFile(const char* accountname,
@@ -25,11 +27,17 @@ char* getDecryptedAccountAsStringFromFilePrompt(const char* accountname,
                                                 const char* pw_cmd,
                                                 const char* pw_file,
                                                 const char* pw_env);
+char* getDecryptedAccountAsStringSealed(const char* accountname);
 struct resultWithEncryptionPassword
                      getDecryptedAccountAsStringAndPasswordFromFilePrompt(const char* accountname,
                                                                           const char* pw_cmd,
                                                                           const char* pw_file,
                                                                           const char* pw_env);
+void                 accounts_setTenant(uid_t uid);
+uid_t                accounts_getTenant();
+int                  account_isOfTenant(const struct oidc_account* account);
+int account_matchByNameOfTenant(const struct oidc_account* key,
+                                const struct oidc_account* account);
 struct oidc_account* db_findAccountByShortname(const char* shortname);
 list_t*              db_findAccountsByIssuerUrl(const char* issuer_url);
 
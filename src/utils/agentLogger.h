@@ -9,4 +9,6 @@ void setLogWithoutTerminal();
 extern void (*agent_log)(int log_level, const char* msg, ...);
 void agent_openlog(const char* logger_name);
 
+#define agent_log(log_level, ...) LOGGER_CALL(agent_log, log_level, __VA_ARGS__)
+
 #endif /* OIDC_AGENT_LOGGER_H */
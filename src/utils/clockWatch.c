@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+#include "clockWatch.h"
+#include "defines/settings.h"
+#include "utils/logger.h"
+
+/**
+ * The deadlines of the agent, e.g. token expiry and account lifetimes, are
+ * points in wall clock time, because they are compared with times of other
+ * hosts and sent to clients. Most of them were computed from durations,
+ * though: the lifetime of an account or the @c expires_in of a token. To keep
+ * these durations when the wall clock is set, e.g. by an NTP step, the wall
+ * clock is cross-checked with @c CLOCK_BOOTTIME, which is never set. If the
+ * wall clock advanced more or less than the boot clock, the difference is
+ * reported as a step and the deadlines can be shifted by it.
+ *
+ * A suspend advances the wall and the boot clock alike, so deadlines that
+ * passed while the system was suspended really passed; only
+ * @c CLOCK_MONOTONIC stops during a suspend, which is how a resume is detected.
+ * Without @c CLOCK_BOOTTIME suspends are not detected.
+ */
+
+struct clockSample {
+  struct timespec wall;
+  struct timespec boot;
+  struct timespec mono;
+};
+
+static struct clockSample last = {};
+
+#ifdef CLOCK_BOOTTIME
+#define CLOCKWATCH_BOOTCLOCK CLOCK_BOOTTIME
+#else
+#define CLOCKWATCH_BOOTCLOCK CLOCK_MONOTONIC
+#endif
+
+static long long _diffMs(const struct timespec* a, const struct timespec* b) {
+  return (a->tv_sec - b->tv_sec) * 1000LL + (a->tv_nsec - b->tv_nsec) / 1000000;
+}
+
+static struct clockSample _sample() {
+  struct clockSample s = {};
+  clock_gettime(CLOCK_REALTIME, &s.wall);
+  clock_gettime(CLOCKWATCH_BOOTCLOCK, &s.boot);
+  clock_gettime(CLOCK_MONOTONIC, &s.mono);
+  return s;
+}
+
+/**
+ * @brief compares the clocks with their state at the last call
+ * Differences of less than @c CLOCK_JUMP_THRESHOLD seconds are ignored. The
+ * first call only takes the first sample.
+ * @return the step of the wall clock and the time the system was suspended
+ */
+struct clockJump clockWatch_check() {
+  struct clockSample now  = _sample();
+  struct clockJump   jump = {};
+  if (last.boot.tv_sec || last.boot.tv_nsec) {
+    long long boot_ms = _diffMs(&now.boot, &last.boot);
+    long long step_ms = _diffMs(&now.wall, &last.wall) - boot_ms;
+    long long susp_ms = boot_ms - _diffMs(&now.mono, &last.mono);
+    if (step_ms >= CLOCK_JUMP_THRESHOLD * 1000LL ||
+        step_ms <= -CLOCK_JUMP_THRESHOLD * 1000LL) {
+      jump.step = (time_t)(step_ms / 1000);
+      logger(NOTICE, "The wall clock was set by %ld seconds", (long)jump.step);
+    }
+    if (susp_ms >= CLOCK_JUMP_THRESHOLD * 1000LL) {
+      jump.suspended = (time_t)(susp_ms / 1000);
+      logger(NOTICE, "Resumed after a suspend of %ld seconds",
+             (long)jump.suspended);
+    }
+  }
+  last = now;
+  return jump;
+}
@@ -0,0 +1,16 @@
+#ifndef OIDC_CLOCKWATCH_H
+#define OIDC_CLOCKWATCH_H
+
+#include <time.h>
+
+/**
+ * What happened to the clocks since the last call of @c clockWatch_check
+ */
+struct clockJump {
+  time_t step;       // seconds the wall clock was set forward (or back if < 0)
+  time_t suspended;  // seconds the system was suspended
+};
+
+struct clockJump clockWatch_check();
+
+#endif  // OIDC_CLOCKWATCH_H
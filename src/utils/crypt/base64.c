@@ -0,0 +1,420 @@
+#include "base64.h"
+
+#include <errno.h>
+#include <sodium.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * Base64 is on the hot path of the agent: every ipc message, every encrypted
+ * account field in memory and every config file field is base64 encoded. This
+ * codec encodes and decodes the bulk of the data with SIMD instructions and
+ * leaves the rest - the last incomplete block, the padding, invalid input and
+ * all error handling - to libsodium. So the results are the same as with
+ * libsodium alone, also for invalid input.
+ *
+ * The instruction set is chosen at runtime: AVX2 or SSSE3 on x86, NEON on
+ * aarch64; elsewhere only libsodium is used. As with libsodium the data does
+ * not influence branches or memory accesses within a block, because the
+ * alphabet is looked up with register shuffles and compares.
+ */
+
+struct base64Codec {
+  const char* name;
+  // encodes full blocks; returns the number of consumed bytes
+  size_t (*encode)(char* dst, const unsigned char* src, size_t len,
+                   int urlsafe);
+  // decodes full blocks until an invalid character; returns the number of
+  // consumed characters
+  size_t (*decode)(unsigned char* dst, size_t dst_max, const char* src,
+                   size_t len, int urlsafe);
+};
+
+#define BASE64_CHAR62(urlsafe) ((urlsafe) ? '-' : '+')
+#define BASE64_CHAR63(urlsafe) ((urlsafe) ? '_' : '/')
+
+#ifdef BASE64_X86
+
+__attribute__((target("ssse3"))) static __m128i _encodeBlock128(__m128i in,
+                                                                 int urlsafe) {
+  // split 3 bytes into 4 indices of 6 bits
+  in = _mm_shuffle_epi8(
+      in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i indices = _mm_or_si128(t1, t3);
+  // map the indices to the offsets of their range: 0..25 -> 13, 26..51 -> 0,
+  // 52..61 -> 1..10, 62 -> 11, 63 -> 12
+  __m128i       range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  const char    c62    = BASE64_CHAR62(urlsafe) - 62;
+  const char    c63    = BASE64_CHAR63(urlsafe) - 63;
+  const __m128i shifts = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, c62, c63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(shifts, range), indices);
+}
+
+__attribute__((target("ssse3"))) static size_t _encodeSSSE3(
+    char* dst, const unsigned char* src, size_t len, int urlsafe) {
+  size_t i = 0;
+  for (; len - i >= 16; i += 12, dst += 16) {  // loads 16, consumes 12
+    __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)dst, _encodeBlock128(in, urlsafe));
+  }
+  return i;
+}
+
+/**
+ * @brief decodes 16 characters into their 6 bit values
+ * @param invalid set to a mask of the characters that are not in the alphabet
+ */
+__attribute__((target("ssse3"))) static __m128i _decodeValues128(
+    __m128i c, int urlsafe, __m128i* invalid) {
+  const __m128i upper =
+      _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+  const __m128i lower =
+      _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+  const __m128i digit =
+      _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+  const char    c62 = BASE64_CHAR62(urlsafe);
+  const char    c63 = BASE64_CHAR63(urlsafe);
+  const __m128i is62  = _mm_cmpeq_epi8(c, _mm_set1_epi8(c62));
+  const __m128i is63  = _mm_cmpeq_epi8(c, _mm_set1_epi8(c63));
+  __m128i       delta = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+  delta = _mm_or_si128(delta, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+  delta = _mm_or_si128(delta, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+  delta = _mm_or_si128(delta, _mm_and_si128(is62, _mm_set1_epi8(62 - c62)));
+  delta = _mm_or_si128(delta, _mm_and_si128(is63, _mm_set1_epi8(63 - c63)));
+  const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                     _mm_or_si128(digit, _mm_or_si128(is62,
+                                                                      is63)));
+  *invalid = _mm_cmpeq_epi8(valid, _mm_setzero_si128());
+  return _mm_add_epi8(c, delta);
+}
+
+/**
+ * @brief packs 4 values of 6 bits into 3 bytes; the result is in the lower
+ * 12 bytes
+ */
+__attribute__((target("ssse3"))) static __m128i _packValues128(__m128i v) {
+  const __m128i ab_cd = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  const __m128i abcd  = _mm_madd_epi16(ab_cd, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                              13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3"))) static size_t _decodeSSSE3(
+    unsigned char* dst, size_t dst_max, const char* src, size_t len,
+    int urlsafe) {
+  size_t i = 0;
+  size_t o = 0;
+  for (; len - i >= 16 && dst_max - o >= 16; i += 16, o += 12) {
+    __m128i invalid;
+    __m128i values = _decodeValues128(
+        _mm_loadu_si128((const __m128i*)(src + i)), urlsafe, &invalid);
+    if (_mm_movemask_epi8(invalid)) {
+      break;
+    }
+    _mm_storeu_si128((__m128i*)(dst + o), _packValues128(values));
+  }
+  return i;
+}
+
+/**
+ * @brief the same as @c _encodeBlock128 for both 128 bit lanes
+ */
+__attribute__((target("avx2"))) static __m256i _encodeBlock256(__m256i in,
+                                                                int urlsafe) {
+  in = _mm256_shuffle_epi8(
+      in, _mm256_broadcastsi128_si256(_mm_set_epi8(
+              10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1)));
+  const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  const __m256i indices = _mm256_or_si256(t1, t3);
+  __m256i       range   = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  const __m256i upper   = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+  const char    c62    = BASE64_CHAR62(urlsafe) - 62;
+  const char    c63    = BASE64_CHAR63(urlsafe) - 63;
+  const __m256i shifts = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, c62, c63, 'A', 0, 0));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shifts, range), indices);
+}
+
+__attribute__((target("avx2"))) static size_t _encodeAVX2(
+    char* dst, const unsigned char* src, size_t len, int urlsafe) {
+  size_t i = 0;
+  for (; len - i >= 28; i += 24, dst += 32) {  // loads 28, consumes 24
+    const __m128i lo = _mm_loadu_si128((const __m128i*)(src + i));
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(src + i + 12));
+    const __m256i in =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    _mm256_storeu_si256((__m256i*)dst, _encodeBlock256(in, urlsafe));
+  }
+  return i + _encodeSSSE3(dst, src + i, len - i, urlsafe);
+}
+
+__attribute__((target("avx2"))) static size_t _decodeAVX2(
+    unsigned char* dst, size_t dst_max, const char* src, size_t len,
+    int urlsafe) {
+  size_t i = 0;
+  size_t o = 0;
+  for (; len - i >= 32 && dst_max - o >= 32; i += 32, o += 24) {
+    const __m256i c = _mm256_loadu_si256((const __m256i*)(src + i));
+    const __m256i upper =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    const __m256i lower =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    const __m256i digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    const char    c62  = BASE64_CHAR62(urlsafe);
+    const char    c63  = BASE64_CHAR63(urlsafe);
+    const __m256i is62 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(c62));
+    const __m256i is63 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(c63));
+    const __m256i valid =
+        _mm256_or_si256(_mm256_or_si256(upper, lower),
+                        _mm256_or_si256(digit, _mm256_or_si256(is62, is63)));
+    if ((unsigned int)_mm256_movemask_epi8(valid) != 0xffffffffU) {
+      break;
+    }
+    __m256i delta = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+    delta         = _mm256_or_si256(
+        delta, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+    delta = _mm256_or_si256(
+        delta, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+    delta = _mm256_or_si256(delta,
+                            _mm256_and_si256(is62, _mm256_set1_epi8(62 - c62)));
+    delta = _mm256_or_si256(delta,
+                            _mm256_and_si256(is63, _mm256_set1_epi8(63 - c63)));
+    const __m256i values = _mm256_add_epi8(c, delta);
+    const __m256i ab_cd =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i abcd =
+        _mm256_madd_epi16(ab_cd, _mm256_set1_epi32(0x00011000));
+    const __m256i lanes = _mm256_shuffle_epi8(
+        abcd, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                               -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                               -1, -1, -1, -1));
+    // move the 12 bytes of the upper lane next to the ones of the lower lane
+    const __m256i packed = _mm256_permutevar8x32_epi32(
+        lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256((__m256i*)(dst + o), packed);
+  }
+  return i + _decodeSSSE3(dst + o, dst_max - o, src + i, len - i, urlsafe);
+}
+
+static const struct base64Codec avx2Codec  = {"avx2", _encodeAVX2,
+                                              _decodeAVX2};
+static const struct base64Codec ssse3Codec = {"ssse3", _encodeSSSE3,
+                                              _decodeSSSE3};
+
+#endif  // BASE64_X86
+
+#ifdef BASE64_NEON
+
+static const char* const alphabets[] = {
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"};
+
+static size_t _encodeNEON(char* dst, const unsigned char* src, size_t len,
+                          int urlsafe) {
+  const uint8_t*     alphabet = (const uint8_t*)alphabets[urlsafe ? 1 : 0];
+  const uint8x16x4_t table    = {{vld1q_u8(alphabet), vld1q_u8(alphabet + 16),
+                                  vld1q_u8(alphabet + 32),
+                                  vld1q_u8(alphabet + 48)}};
+  const uint8x16_t   mask     = vdupq_n_u8(0x3f);
+  size_t             i        = 0;
+  for (; len - i >= 48; i += 48, dst += 64) {
+    const uint8x16x3_t in = vld3q_u8(src + i);
+    uint8x16x4_t       out;
+    out.val[0] = vshrq_n_u8(in.val[0], 2);
+    out.val[1] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    out.val[2] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    out.val[3] = vandq_u8(in.val[2], mask);
+    for (int j = 0; j < 4; j++) {
+      out.val[j] = vqtbl4q_u8(table, out.val[j]);
+    }
+    vst4q_u8((uint8_t*)dst, out);
+  }
+  return i;
+}
+
+static uint8x16_t _inRange(uint8x16_t c, uint8_t lo, uint8_t hi) {
+  return vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(hi)));
+}
+
+/**
+ * @brief decodes 16 characters into their 6 bit values
+ * @param valid the mask of the characters in the alphabet is and-ed into it
+ */
+static uint8x16_t _decodeValuesNEON(uint8x16_t c, int urlsafe,
+                                    uint8x16_t* valid) {
+  const uint8_t    c62   = BASE64_CHAR62(urlsafe);
+  const uint8_t    c63   = BASE64_CHAR63(urlsafe);
+  const uint8x16_t upper = _inRange(c, 'A', 'Z');
+  const uint8x16_t lower = _inRange(c, 'a', 'z');
+  const uint8x16_t digit = _inRange(c, '0', '9');
+  const uint8x16_t is62  = vceqq_u8(c, vdupq_n_u8(c62));
+  const uint8x16_t is63  = vceqq_u8(c, vdupq_n_u8(c63));
+  uint8x16_t       delta = vandq_u8(upper, vdupq_n_u8((uint8_t)-'A'));
+  delta = vorrq_u8(delta, vandq_u8(lower, vdupq_n_u8((uint8_t)(26 - 'a'))));
+  delta = vorrq_u8(delta, vandq_u8(digit, vdupq_n_u8((uint8_t)(52 - '0'))));
+  delta = vorrq_u8(delta, vandq_u8(is62, vdupq_n_u8((uint8_t)(62 - c62))));
+  delta = vorrq_u8(delta, vandq_u8(is63, vdupq_n_u8((uint8_t)(63 - c63))));
+  *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower),
+                                     vorrq_u8(digit, vorrq_u8(is62, is63))));
+  return vaddq_u8(c, delta);
+}
+
+static size_t _decodeNEON(unsigned char* dst, size_t dst_max, const char* src,
+                          size_t len, int urlsafe) {
+  size_t i = 0;
+  size_t o = 0;
+  for (; len - i >= 64 && dst_max - o >= 48; i += 64, o += 48) {
+    uint8x16x4_t in    = vld4q_u8((const uint8_t*)(src + i));
+    uint8x16_t   valid = vdupq_n_u8(0xff);
+    for (int j = 0; j < 4; j++) {
+      in.val[j] = _decodeValuesNEON(in.val[j], urlsafe, &valid);
+    }
+    if (vminvq_u8(valid) != 0xff) {
+      break;
+    }
+    uint8x16x3_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+    vst3q_u8(dst + o, out);
+  }
+  return i;
+}
+
+static const struct base64Codec neonCodec = {"neon", _encodeNEON,
+                                             _decodeNEON};
+
+#endif  // BASE64_NEON
+
+static const struct base64Codec  scalarCodec = {"scalar", NULL, NULL};
+static const struct base64Codec* codec       = NULL;
+static unsigned char             useScalar   = 0;
+
+static const struct base64Codec* _selectCodec() {
+#if defined(BASE64_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return &avx2Codec;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return &ssse3Codec;
+  }
+#elif defined(BASE64_NEON)
+  return &neonCodec;
+#endif
+  return &scalarCodec;
+}
+
+static const struct base64Codec* _getCodec() {
+  if (useScalar) {
+    return &scalarCodec;
+  }
+  if (codec == NULL) {
+    codec = _selectCodec();
+  }
+  return codec;
+}
+
+static int _isUrlSafe(int variant) {
+  return variant == sodium_base64_VARIANT_URLSAFE ||
+         variant == sodium_base64_VARIANT_URLSAFE_NO_PADDING;
+}
+
+static int _isKnownVariant(int variant) {
+  return _isUrlSafe(variant) || variant == sodium_base64_VARIANT_ORIGINAL ||
+         variant == sodium_base64_VARIANT_ORIGINAL_NO_PADDING;
+}
+
+/**
+ * @brief base64 encodes @p bin_len bytes of @p bin; same as
+ * @c sodium_bin2base64
+ * @param b64_maxlen the size of @p b64; at least
+ * @c sodium_base64_ENCODED_LEN(bin_len,variant)
+ * @return @p b64, which is nullterminated
+ */
+char* base64_encode(char* b64, size_t b64_maxlen, const unsigned char* bin,
+                    size_t bin_len, int variant) {
+  const struct base64Codec* c    = _getCodec();
+  size_t                    done = 0;
+  if (c->encode && _isKnownVariant(variant) &&
+      b64_maxlen >= sodium_base64_ENCODED_LEN(bin_len, variant)) {
+    done = c->encode(b64, bin, bin_len, _isUrlSafe(variant));
+  }
+  size_t out = done / 3 * 4;
+  sodium_bin2base64(b64 + out, b64_maxlen - out, bin + done, bin_len - done,
+                    variant);
+  return b64;
+}
+
+/**
+ * @brief decodes @p b64_len characters of @p b64; same as
+ * @c sodium_base642bin without characters to ignore
+ * @param bin_len if not @c NULL, set to the number of decoded bytes
+ * @param b64_end if not @c NULL, set to the first character that was not
+ * decoded; otherwise it is an error if not all characters were decoded
+ * @return @c 0 on success, @c -1 otherwise
+ */
+int base64_decode(unsigned char* bin, size_t bin_maxlen, const char* b64,
+                  size_t b64_len, size_t* bin_len, const char** b64_end,
+                  int variant) {
+  const struct base64Codec* c    = _getCodec();
+  size_t                    done = 0;
+  if (c->decode && _isKnownVariant(variant)) {
+    done = c->decode(bin, bin_maxlen, b64, b64_len, _isUrlSafe(variant));
+  }
+  size_t      out      = done / 4 * 3;
+  size_t      rest_len = 0;
+  const char* end      = NULL;
+  int ret = sodium_base642bin(bin + out, bin_maxlen - out, b64 + done,
+                              b64_len - done, NULL, &rest_len, &end, variant);
+  // libsodium drops the decoded data on invalid input, but not on trailing
+  // characters
+  size_t decoded = ret == 0 ? out + rest_len : 0;
+  if (b64_end != NULL) {
+    *b64_end = end;
+  } else if (end != b64 + b64_len) {
+    errno = EINVAL;
+    ret   = -1;
+  }
+  if (bin_len != NULL) {
+    *bin_len = decoded;
+  }
+  return ret;
+}
+
+/**
+ * @brief disables the SIMD code, e.g. to compare it in benchmarks
+ */
+void base64_useScalar(unsigned char scalar) { useScalar = scalar; }
+
+/**
+ * @brief returns the name of the instruction set used for base64
+ */
+const char* base64_getImplementation() { return _getCodec()->name; }
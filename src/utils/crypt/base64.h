@@ -0,0 +1,15 @@
+#ifndef OIDC_BASE64_H
+#define OIDC_BASE64_H
+
+#include <stddef.h>
+
+char* base64_encode(char* b64, size_t b64_maxlen, const unsigned char* bin,
+                    size_t bin_len, int variant);
+int   base64_decode(unsigned char* bin, size_t bin_maxlen, const char* b64,
+                    size_t b64_len, size_t* bin_len, const char** b64_end,
+                    int variant);
+
+void        base64_useScalar(unsigned char scalar);
+const char* base64_getImplementation();
+
+#endif  // OIDC_BASE64_H
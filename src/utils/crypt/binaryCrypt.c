@@ -0,0 +1,361 @@
+#include "binaryCrypt.h"
+#include "crypt.h"
+#include "sealedKey.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#include <sodium.h>
+#include <string.h>
+
+/**
+ * The binary format of encrypted files (format version 3). All fields are raw
+ * bytes at fixed offsets, so a file can be decrypted without parsing or
+ * base64 decoding and in the buffer it was read into:
+ *   0 magic (8 bytes, the last one is the format version)
+ *   8 ops limit, mem limit and algorithm of the key derivation (3x uint32 le)
+ *  20 salt
+ *  36 nonce
+ *  60 hash key, used to verify the password
+ *  92 length of the ciphertext (uint32 le)
+ *  96 ciphertext, i.e. MAC and encrypted text
+ * The lengths of salt, nonce, key and MAC are fixed by the format version.
+ * Older files use the text format of @c crypt_encryptWithParameters.
+ * Sealed files (format version 4) have the same layout followed by
+ *   length of the sealed key (uint32 le)
+ *   the encryption key sealed to the host with @c sealedKey_seal
+ * so that they can be decrypted without the key derivation on the host that
+ * sealed them and with the password everywhere else.
+ * Versions 3 and 4 use secretbox; the versions above record the cipher, i.e.
+ * the version is 3 + 2 * cipher + 1 if sealed. A nonce that is shorter than
+ * the nonce field is stored at its start.
+ */
+
+#define BINARY_MAGIC_PREFIX "\x89OIDC\r\n"
+#define BINARY_MAGIC_LEN 8
+#define BINARY_VERSION 3
+#define BINARY_SALT_LEN 16
+#define BINARY_NONCE_LEN 24
+#define BINARY_KEY_LEN 32
+#define BINARY_MAC_LEN 16
+#define OFFSET_KDF BINARY_MAGIC_LEN
+#define OFFSET_SALT (OFFSET_KDF + 3 * 4)
+#define OFFSET_NONCE (OFFSET_SALT + BINARY_SALT_LEN)
+#define OFFSET_HASH_KEY (OFFSET_NONCE + BINARY_NONCE_LEN)
+#define OFFSET_CIPHER_LEN (OFFSET_HASH_KEY + BINARY_KEY_LEN)
+#define BINARY_HEADER_LEN (OFFSET_CIPHER_LEN + 4)
+
+static void _putU32(unsigned char* p, unsigned long v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (v >> (8 * i)) & 0xff;
+  }
+}
+
+static unsigned long _getU32(const unsigned char* p) {
+  return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+         (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static struct cryptParameter _binaryParameters(int ops, int mem, int alg) {
+  struct cryptParameter p = newCryptParameters();
+  p.nonce_len             = BINARY_NONCE_LEN;
+  p.salt_len              = BINARY_SALT_LEN;
+  p.mac_len               = BINARY_MAC_LEN;
+  p.key_len               = BINARY_KEY_LEN;
+  p.hash_ops_limit        = ops;
+  p.hash_mem_limit        = mem;
+  p.hash_alg              = alg;
+  return p;
+}
+
+static unsigned char _version(int aead, int sealed) {
+  return BINARY_VERSION + 2 * aead + (sealed ? 1 : 0);
+}
+
+/**
+ * @brief checks if @p data is in the binary format
+ */
+int binaryCrypt_isBinary(const unsigned char* data, size_t len) {
+  return data != NULL && len >= BINARY_MAGIC_LEN &&
+         memcmp(data, BINARY_MAGIC_PREFIX, BINARY_MAGIC_LEN - 1) == 0 &&
+         data[BINARY_MAGIC_LEN - 1] >= _version(CRYPT_AEAD_SECRETBOX, 0) &&
+         data[BINARY_MAGIC_LEN - 1] <= _version(CRYPT_AEAD_MAX, 1);
+}
+
+/**
+ * @brief checks if @p data is in the binary format with a sealed key
+ */
+int binaryCrypt_isSealed(const unsigned char* data, size_t len) {
+  return binaryCrypt_isBinary(data, len) &&
+         (data[BINARY_MAGIC_LEN - 1] - BINARY_VERSION) % 2 == 1;
+}
+
+/**
+ * @brief returns the cipher of binary @p data
+ */
+static int _aead(const unsigned char* data) {
+  return (data[BINARY_MAGIC_LEN - 1] - BINARY_VERSION) / 2;
+}
+
+/**
+ * @brief returns the length of the ciphertext of binary @p data after checking
+ * that the fields add up to @p len
+ * @return the length or @c 0 if @p data is malformed
+ */
+static size_t _cipherLen(const unsigned char* data, size_t len) {
+  if (!binaryCrypt_isBinary(data, len) || len < BINARY_HEADER_LEN) {
+    return 0;
+  }
+  size_t cipher_len = _getU32(data + OFFSET_CIPHER_LEN);
+  if (cipher_len < BINARY_MAC_LEN || cipher_len > len - BINARY_HEADER_LEN) {
+    return 0;
+  }
+  size_t rest = len - BINARY_HEADER_LEN - cipher_len;
+  if (!binaryCrypt_isSealed(data, len)) {
+    return rest == 0 ? cipher_len : 0;
+  }
+  if (rest < 4 ||
+      _getU32(data + BINARY_HEADER_LEN + cipher_len) != rest - 4) {
+    return 0;
+  }
+  return cipher_len;
+}
+
+/**
+ * @brief assembles the binary format and encrypts @p text with @p key
+ * @param header the header fields before the nonce, i.e. magic, key
+ * derivation and salt, and the hash key to copy
+ * @param aead the cipher to use
+ * @param sealed the sealed key to append or @c NULL
+ */
+static unsigned char* _encryptWithKey(const char* text,
+                                      const unsigned char* header,
+                                      const unsigned char* hash_key,
+                                      const unsigned char* key, int aead,
+                                      const unsigned char* sealed,
+                                      size_t sealed_len, size_t* len) {
+  size_t         text_len = strlen(text);
+  size_t         cipher_len = BINARY_MAC_LEN + text_len;
+  size_t         data_len   = BINARY_HEADER_LEN + cipher_len +
+                          (sealed ? 4 + sealed_len : 0);
+  unsigned char* data       = secAlloc(data_len);
+  memcpy(data, header, OFFSET_NONCE);
+  memcpy(data, BINARY_MAGIC_PREFIX, BINARY_MAGIC_LEN - 1);
+  data[BINARY_MAGIC_LEN - 1] = _version(aead, sealed != NULL);
+  randombytes_buf(data + OFFSET_NONCE, crypt_aeadNonceLen(aead));
+  memcpy(data + OFFSET_HASH_KEY, hash_key, BINARY_KEY_LEN);
+  _putU32(data + OFFSET_CIPHER_LEN, cipher_len);
+  if (sealed) {
+    _putU32(data + BINARY_HEADER_LEN + cipher_len, sealed_len);
+    memcpy(data + BINARY_HEADER_LEN + cipher_len + 4, sealed, sealed_len);
+  }
+  if (crypt_aeadEncrypt(aead, data + BINARY_HEADER_LEN,
+                        (const unsigned char*)text, text_len,
+                        data + OFFSET_NONCE, key) != OIDC_SUCCESS) {
+    secFree(data);
+    return NULL;
+  }
+  *len = data_len;
+  return data;
+}
+
+static unsigned char* _encrypt(const char* text, const char* password,
+                               struct cryptParameter params, size_t* len,
+                               int seal) {
+  if (text == NULL || password == NULL || len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct cryptParameter p = _binaryParameters(
+      params.hash_ops_limit, params.hash_mem_limit, params.hash_alg);
+  char salt_base64[sodium_base64_ENCODED_LEN(
+                       BINARY_SALT_LEN, sodium_base64_VARIANT_ORIGINAL) +
+                   1];
+  struct key_set keys =
+      crypt_keyDerivation_base64(password, salt_base64, 1, &p);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return NULL;
+  }
+  unsigned char* sealed     = NULL;
+  size_t         sealed_len = 0;
+  if (seal) {
+    sealed = sealedKey_seal((const unsigned char*)keys.encryption_key,
+                            BINARY_KEY_LEN, &sealed_len);
+    if (sealed == NULL) {
+      secFree(keys.hash_key);
+      secFree(keys.encryption_key);
+      return NULL;
+    }
+  }
+  unsigned char header[OFFSET_NONCE];
+  _putU32(header + OFFSET_KDF, p.hash_ops_limit);
+  _putU32(header + OFFSET_KDF + 4, p.hash_mem_limit);
+  _putU32(header + OFFSET_KDF + 8, p.hash_alg);
+  fromBase64(salt_base64, BINARY_SALT_LEN, header + OFFSET_SALT);
+  unsigned char* data = _encryptWithKey(
+      text, header, (const unsigned char*)keys.hash_key,
+      (const unsigned char*)keys.encryption_key, crypt_defaultAead(), sealed,
+      sealed_len, len);
+  secFree(keys.hash_key);
+  secFree(keys.encryption_key);
+  secFree(sealed);
+  return data;
+}
+
+/**
+ * @brief encrypts @p text with @p password into the binary format
+ * @param params the key derivation limits to use
+ * @param len is set to the length of the returned data
+ * @return the encrypted data; has to be freed after usage
+ */
+unsigned char* binaryCrypt_encrypt(const char* text, const char* password,
+                                   struct cryptParameter params, size_t* len) {
+  return _encrypt(text, password, params, len, 0);
+}
+
+/**
+ * @brief encrypts @p text like @c binaryCrypt_encrypt and additionally seals
+ * the encryption key to this host
+ * @return the encrypted data or @c NULL if the host cannot seal keys; has to
+ * be freed after usage
+ */
+unsigned char* binaryCrypt_encryptSealed(const char* text,
+                                         const char* password,
+                                         struct cryptParameter params,
+                                         size_t* len) {
+  return _encrypt(text, password, params, len, 1);
+}
+
+/**
+ * @brief unseals the encryption key of sealed @p data
+ * @param key a buffer of @c BINARY_KEY_LEN bytes
+ */
+static oidc_error_t _unsealKey(const unsigned char* data, size_t len,
+                               size_t cipher_len, unsigned char* key) {
+  if (!binaryCrypt_isSealed(data, len)) {
+    oidc_errno = OIDC_ENOSEAL;
+    return oidc_errno;
+  }
+  const unsigned char* sealed = data + BINARY_HEADER_LEN + cipher_len + 4;
+  return sealedKey_unseal(sealed, len - BINARY_HEADER_LEN - cipher_len - 4,
+                          key, BINARY_KEY_LEN);
+}
+
+static char* _decryptWithKey(unsigned char* data, size_t len,
+                             size_t cipher_len, const unsigned char* key) {
+  unsigned char* cipher = data + BINARY_HEADER_LEN;
+  if (crypt_aeadDecrypt(_aead(data), cipher, cipher, cipher_len,
+                        data + OFFSET_NONCE, key) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  size_t text_len = cipher_len - BINARY_MAC_LEN;
+  memmove(data, cipher, text_len);
+  sodium_memzero(data + text_len, len - text_len);
+  return (char*)data;
+}
+
+/**
+ * @brief decrypts sealed @p data in place with the unsealed key, i.e. without
+ * a password and without the key derivation; see
+ * @c binaryCrypt_decryptInPlace
+ * @return @p data holding the nullterminated text or @c NULL on failure;
+ * @c oidc_errno is @c OIDC_ENOSEAL if @p data is not sealed to this host
+ */
+char* binaryCrypt_decryptSealedInPlace(unsigned char* data, size_t len) {
+  if (data == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t cipher_len = _cipherLen(data, len);
+  if (cipher_len == 0) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  unsigned char* key = secAlloc(BINARY_KEY_LEN);
+  if (_unsealKey(data, len, cipher_len, key) != OIDC_SUCCESS) {
+    secFree(key);
+    return NULL;
+  }
+  char* ret = _decryptWithKey(data, len, cipher_len, key);
+  secFree(key);
+  return ret;
+}
+
+/**
+ * @brief encrypts @p text with the sealed key of @p old, so that a sealed
+ * file can be updated without the password; the key derivation parameters,
+ * salt, hash key and sealed key are kept, so the password still decrypts the
+ * result
+ * @param old the sealed data that is replaced
+ * @param len is set to the length of the returned data
+ * @return the encrypted data; has to be freed after usage
+ */
+unsigned char* binaryCrypt_reencryptSealed(const unsigned char* old,
+                                           size_t old_len, const char* text,
+                                           size_t* len) {
+  if (old == NULL || text == NULL || len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t cipher_len = _cipherLen(old, old_len);
+  if (cipher_len == 0) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  unsigned char* key = secAlloc(BINARY_KEY_LEN);
+  if (_unsealKey(old, old_len, cipher_len, key) != OIDC_SUCCESS) {
+    secFree(key);
+    return NULL;
+  }
+  const unsigned char* sealed = old + BINARY_HEADER_LEN + cipher_len + 4;
+  unsigned char*       data   = _encryptWithKey(
+      text, old, old + OFFSET_HASH_KEY, key, _aead(old), sealed,
+      old_len - BINARY_HEADER_LEN - cipher_len - 4, len);
+  secFree(key);
+  return data;
+}
+
+/**
+ * @brief decrypts binary encrypted @p data in place
+ * The decrypted text is moved to the start of @p data and the rest of the
+ * buffer is wiped, so no further copy of the text is made.
+ * @param data the encrypted data; has to be allocated with @c secAlloc
+ * @param len the length of @p data
+ * @return @p data holding the nullterminated text or @c NULL on failure; in
+ * both cases the ownership of @p data stays with the caller
+ */
+char* binaryCrypt_decryptInPlace(unsigned char* data, size_t len,
+                                 const char* password) {
+  if (data == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t cipher_len = _cipherLen(data, len);
+  if (cipher_len == 0) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  struct cryptParameter p = _binaryParameters(
+      _getU32(data + OFFSET_KDF), _getU32(data + OFFSET_KDF + 4),
+      _getU32(data + OFFSET_KDF + 8));
+  char* salt_base64 = toBase64((char*)data + OFFSET_SALT, BINARY_SALT_LEN);
+  struct key_set keys =
+      crypt_keyDerivation_base64(password, salt_base64, 0, &p);
+  secFree(salt_base64);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return NULL;
+  }
+  int match = sodium_memcmp(keys.hash_key, data + OFFSET_HASH_KEY,
+                            BINARY_KEY_LEN) == 0;
+  secFree(keys.hash_key);
+  if (!match) {
+    secFree(keys.encryption_key);
+    oidc_errno = OIDC_EPASS;
+    return NULL;
+  }
+  char* ret = _decryptWithKey(data, len, cipher_len,
+                              (const unsigned char*)keys.encryption_key);
+  secFree(keys.encryption_key);
+  return ret;
+}
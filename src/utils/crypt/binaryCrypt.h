@@ -0,0 +1,23 @@
+#ifndef BINARY_CRYPT_H
+#define BINARY_CRYPT_H
+
+#include "cryptdef.h"
+
+#include <stddef.h>
+
+int            binaryCrypt_isBinary(const unsigned char* data, size_t len);
+int            binaryCrypt_isSealed(const unsigned char* data, size_t len);
+unsigned char* binaryCrypt_encrypt(const char* text, const char* password,
+                                   struct cryptParameter params, size_t* len);
+unsigned char* binaryCrypt_encryptSealed(const char* text,
+                                         const char* password,
+                                         struct cryptParameter params,
+                                         size_t*               len);
+unsigned char* binaryCrypt_reencryptSealed(const unsigned char* old,
+                                           size_t old_len, const char* text,
+                                           size_t* len);
+char* binaryCrypt_decryptInPlace(unsigned char* data, size_t len,
+                                 const char* password);
+char* binaryCrypt_decryptSealedInPlace(unsigned char* data, size_t len);
+
+#endif  // BINARY_CRYPT_H
@@ -1,48 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
 #include "crypt.h"
+#include "base64.h"
+#include "keyCache.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
+#include "utils/probes.h"
 #include "utils/stringUtils.h"
 
 #include <sodium.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 // use these for new encryptions
 #define SODIUM_KEY_LEN crypto_secretbox_KEYBYTES
 #define SODIUM_SALT_LEN crypto_pwhash_SALTBYTES
-#define SODIUM_NONCE_LEN crypto_secretbox_NONCEBYTES
 #define SODIUM_MAC_LEN crypto_secretbox_MACBYTES
 #define SODIUM_BASE64_VARIANT sodium_base64_VARIANT_ORIGINAL
 #define SODIUM_PW_HASH_ALG crypto_pwhash_ALG_DEFAULT
 #define SODIUM_PW_HASH_OPSLIMIT crypto_pwhash_OPSLIMIT_INTERACTIVE
 #define SODIUM_PW_HASH_MEMLIMIT crypto_pwhash_MEMLIMIT_INTERACTIVE
 
+// bounds for key derivation parameters read from files or calibrated
+#define KDF_MAX_OPSLIMIT 32
+#define KDF_MIN_MEMLIMIT (8 * 1024 * 1024)
+#define KDF_MAX_MEMLIMIT crypto_pwhash_MEMLIMIT_SENSITIVE
+
+static unsigned long keyDerivationCount = 0;
+
 /**
  * @brief initializes random number generator
  */
 void initCrypt() { randombytes_stir(); }
 
+/**
+ * @brief returns the number of password based key derivations done by this
+ * process; keys taken from the key cache are not counted
+ */
+unsigned long crypt_getKeyDerivationCount() {
+  return __atomic_load_n(&keyDerivationCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief returns the cipher to use for new encryptions
+ * AES-256-GCM is used if the cpu has instructions for it, otherwise the
+ * portable XChaCha20-Poly1305.
+ */
+int crypt_defaultAead() {
+  return crypt_isAeadAvailable(CRYPT_AEAD_AES256GCM)
+             ? CRYPT_AEAD_AES256GCM
+             : CRYPT_AEAD_XCHACHA20POLY1305;
+}
+
+/**
+ * @brief checks if @p aead can be used on this host
+ * libsodium only implements AES-256-GCM with hardware support.
+ */
+int crypt_isAeadAvailable(int aead) {
+  switch (aead) {
+    case CRYPT_AEAD_SECRETBOX:
+    case CRYPT_AEAD_XCHACHA20POLY1305: return 1;
+    case CRYPT_AEAD_AES256GCM:
+      // the cpu features are detected by sodium_init
+      return sodium_init() >= 0 && crypto_aead_aes256gcm_is_available();
+    default: return 0;
+  }
+}
+
+/**
+ * @brief returns the length of the nonce of @p aead
+ */
+size_t crypt_aeadNonceLen(int aead) {
+  switch (aead) {
+    case CRYPT_AEAD_AES256GCM: return crypto_aead_aes256gcm_NPUBBYTES;
+    case CRYPT_AEAD_XCHACHA20POLY1305:
+      return crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    default: return crypto_secretbox_NONCEBYTES;
+  }
+}
+
+/**
+ * @brief encrypts @p text_len bytes of @p text with @p aead
+ * @param cipher a buffer of @p text_len + @c SODIUM_MAC_LEN bytes; secretbox
+ * puts the MAC in front of the ciphertext, the other ciphers behind it, so
+ * only for them @p cipher may be @p text
+ * @return an oidc_error code
+ */
+oidc_error_t crypt_aeadEncrypt(int aead, unsigned char* cipher,
+                               const unsigned char* text, size_t text_len,
+                               const unsigned char* nonce,
+                               const unsigned char* key) {
+  if (!crypt_isAeadAvailable(aead)) {
+    oidc_errno = OIDC_ENOAEAD;
+    return oidc_errno;
+  }
+  int ret = -1;
+  switch (aead) {
+    case CRYPT_AEAD_SECRETBOX:
+      ret = crypto_secretbox_easy(cipher, text, text_len, nonce, key);
+      break;
+    case CRYPT_AEAD_AES256GCM:
+      ret = crypto_aead_aes256gcm_encrypt(cipher, NULL, text, text_len, NULL,
+                                          0, NULL, nonce, key);
+      break;
+    case CRYPT_AEAD_XCHACHA20POLY1305:
+      ret = crypto_aead_xchacha20poly1305_ietf_encrypt(
+          cipher, NULL, text, text_len, NULL, 0, NULL, nonce, key);
+      break;
+  }
+  if (ret != 0) {
+    oidc_errno = OIDC_EENCRYPT;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief decrypts and verifies @p cipher_len bytes of @p cipher with @p aead
+ * @param text a buffer of @p cipher_len - @c SODIUM_MAC_LEN bytes; for the
+ * AEAD ciphers it may be @p cipher
+ * @return an oidc_error code
+ */
+oidc_error_t crypt_aeadDecrypt(int aead, unsigned char* text,
+                               const unsigned char* cipher, size_t cipher_len,
+                               const unsigned char* nonce,
+                               const unsigned char* key) {
+  if (!crypt_isAeadAvailable(aead)) {
+    oidc_errno = OIDC_ENOAEAD;
+    return oidc_errno;
+  }
+  int ret = -1;
+  switch (aead) {
+    case CRYPT_AEAD_SECRETBOX:
+      ret = crypto_secretbox_open_easy(text, cipher, cipher_len, nonce, key);
+      break;
+    case CRYPT_AEAD_AES256GCM:
+      ret = crypto_aead_aes256gcm_decrypt(text, NULL, NULL, cipher, cipher_len,
+                                          NULL, 0, nonce, key);
+      break;
+    case CRYPT_AEAD_XCHACHA20POLY1305:
+      ret = crypto_aead_xchacha20poly1305_ietf_decrypt(
+          text, NULL, NULL, cipher, cipher_len, NULL, 0, nonce, key);
+      break;
+  }
+  if (ret != 0) {
+    logger(NOTICE, "Decryption failed.");
+    /* If we get here, the Message was a forgery. This means someone (or the
+     * network) somehow tried to tamper with the message*/
+    oidc_errno = OIDC_EDECRYPT;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the cryptParameters for new encryptions with @p aead
+ * @return a cryptParameter struct
+ */
+struct cryptParameter newCryptParametersForAead(int aead) {
+  return (struct cryptParameter){crypt_aeadNonceLen(aead),
+                                 SODIUM_SALT_LEN,
+                                 SODIUM_MAC_LEN,
+                                 SODIUM_KEY_LEN,
+                                 SODIUM_BASE64_VARIANT,
+                                 SODIUM_PW_HASH_OPSLIMIT,
+                                 SODIUM_PW_HASH_MEMLIMIT,
+                                 SODIUM_PW_HASH_ALG,
+                                 aead};
+}
+
 /**
  * @brief returns current cryptParameters
  * @return a cryptParameter struct
  */
 struct cryptParameter newCryptParameters() {
-  return (struct cryptParameter){
-      SODIUM_NONCE_LEN,        SODIUM_SALT_LEN,       SODIUM_MAC_LEN,
-      SODIUM_KEY_LEN,          SODIUM_BASE64_VARIANT, SODIUM_PW_HASH_OPSLIMIT,
-      SODIUM_PW_HASH_MEMLIMIT, SODIUM_PW_HASH_ALG};
+  return newCryptParametersForAead(crypt_defaultAead());
+}
+
+/**
+ * @brief returns the key derivation limits to use for @p cryptParams
+ * Limits that are out of the supported bounds, e.g. from a damaged file, are
+ * replaced by the defaults.
+ */
+static void _kdfLimits(const struct cryptParameter* cryptParams,
+                       unsigned long long* opslimit, size_t* memlimit,
+                       int* alg) {
+  *opslimit = cryptParams->hash_ops_limit;
+  *memlimit = cryptParams->hash_mem_limit;
+  *alg      = cryptParams->hash_alg;
+  if (cryptParams->hash_ops_limit < 1 || *opslimit > KDF_MAX_OPSLIMIT) {
+    *opslimit = SODIUM_PW_HASH_OPSLIMIT;
+  }
+  if (cryptParams->hash_mem_limit < (int)crypto_pwhash_MEMLIMIT_MIN ||
+      *memlimit > KDF_MAX_MEMLIMIT) {
+    *memlimit = SODIUM_PW_HASH_MEMLIMIT;
+  }
+  if (*alg != crypto_pwhash_ALG_ARGON2I13 &&
+      *alg != crypto_pwhash_ALG_ARGON2ID13) {
+    *alg = SODIUM_PW_HASH_ALG;
+  }
 }
 
 /**
  * @brief encrypts a given text with the given password.
  * @param text the nullterminated text
  * @param password the nullterminated password, used for encryption
+ * @param cryptParams the parameters to use, e.g. from @c newCryptParameters
  * @return a pointer to an encryptionInfo struct; Has to be freed after usage.
  * usage using @c secFreeEncryptionInfo
  */
-struct encryptionInfo* _crypt_encrypt(const unsigned char* text,
-                                      const char*          password) {
+struct encryptionInfo* _crypt_encrypt(const unsigned char*  text,
+                                      const char*           password,
+                                      struct cryptParameter cryptParams) {
   if (text == NULL || password == NULL) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
@@ -52,8 +223,7 @@ struct encryptionInfo* _crypt_encrypt(const unsigned char* text,
       secAlloc(sodium_base64_ENCODED_LEN(SODIUM_SALT_LEN,
                                          sodium_base64_VARIANT_ORIGINAL) +
                1);
-  struct cryptParameter cryptParams = newCryptParameters();
-  struct key_set        keys =
+  struct key_set keys =
       crypt_keyDerivation_base64(password, salt_base64, 1, &cryptParams);
   if (keys.encryption_key == NULL) {
     secFree(salt_base64);
@@ -61,12 +231,18 @@ struct encryptionInfo* _crypt_encrypt(const unsigned char* text,
     return NULL;
   }
 
-  struct encryptionInfo* result =
-      crypt_encryptWithKey(text, (unsigned char*)keys.encryption_key);
+  struct encryptionInfo* result = crypt_encryptWithKeyAndAead(
+      text, (unsigned char*)keys.encryption_key, cryptParams.aead);
   secFree(keys.encryption_key);
+  if (result == NULL) {
+    secFree(salt_base64);
+    secFree(keys.hash_key);
+    return NULL;
+  }
 
   char* hash_key_base64 = toBase64(keys.hash_key, SODIUM_KEY_LEN);
   secFree(keys.hash_key);
+  cryptParams.nonce_len   = result->cryptParameter.nonce_len;
   result->salt_base64     = salt_base64;
   result->hash_key_base64 = hash_key_base64;
   result->cryptParameter  = cryptParams;
@@ -86,13 +262,25 @@ struct encryptionInfo* _crypt_encrypt(const unsigned char* text,
  */
 struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
                                             const unsigned char* key) {
-  struct cryptParameter cryptParams = newCryptParameters();
+  return crypt_encryptWithKeyAndAead(text, key, crypt_defaultAead());
+}
+
+/**
+ * @brief encrypts a given text with the given key and cipher.
+ * @param aead the cipher to use; it is recorded in the cryptParameter of the
+ * result
+ * @return a pointer to an encryptionInfo struct; Has to be freed after
+ * usage using @c secFreeEncryptionInfo
+ */
+struct encryptionInfo* crypt_encryptWithKeyAndAead(const unsigned char* text,
+                                                   const unsigned char* key,
+                                                   int                  aead) {
+  struct cryptParameter cryptParams = newCryptParametersForAead(aead);
   char                  nonce[cryptParams.nonce_len];
   randombytes_buf(nonce, cryptParams.nonce_len);
   unsigned char ciphertext[cryptParams.mac_len + strlen((char*)text)];
-  if (crypto_secretbox_easy(ciphertext, text, strlen((char*)text),
-                            (unsigned char*)nonce, key) != 0) {
-    oidc_errno = OIDC_EENCRYPT;
+  if (crypt_aeadEncrypt(aead, ciphertext, text, strlen((char*)text),
+                        (unsigned char*)nonce, key) != OIDC_SUCCESS) {
     return NULL;
   }
   char* ciphertext_base64 =
@@ -115,7 +303,21 @@ struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
  * @note before version 2.1.0 this function used hex encoding
  */
 char* crypt_encrypt(const char* text, const char* password) {
-  struct encryptionInfo* cry = _crypt_encrypt((unsigned char*)text, password);
+  return crypt_encryptWithParameters(text, password, newCryptParameters());
+}
+
+/**
+ * @brief encrypts a given text with the given password, using the key
+ * derivation limits of @p cryptParams
+ * The limits are stored with the cipher, so @c crypt_decrypt uses the same
+ * ones.
+ * @return a string containing all relevant encryption information; this string
+ * can be passed to @c crypt_decrypt for decryption
+ */
+char* crypt_encryptWithParameters(const char* text, const char* password,
+                                  struct cryptParameter cryptParams) {
+  struct encryptionInfo* cry =
+      _crypt_encrypt((unsigned char*)text, password, cryptParams);
   if (cry == NULL || cry->encrypted_base64 == NULL) {
     return NULL;
   }
@@ -123,11 +325,12 @@ char* crypt_encrypt(const char* text, const char* password) {
   // 1 cipher_len
   // 2 nonce_base64
   // 3 salt_base64
-  // 4 crypt parameters
+  // 4 crypt parameters, the cipher is only included since version 4.2.0
   // 5 cipher_base64
   // 6 hash_key_base64
   // [7 version] // Not included here
-  const char* const fmt = "%lu\n%s\n%s\n%lu:%lu:%lu:%lu:%d:%d:%d:%d\n%s\n%s";
+  const char* const fmt =
+      "%lu\n%s\n%s\n%lu:%lu:%lu:%lu:%d:%d:%d:%d:%d\n%s\n%s";
   size_t            cipher_len = strlen(text) + cry->cryptParameter.mac_len;
   char*             ret        = oidc_sprintf(
       fmt, cipher_len, cry->nonce_base64, cry->salt_base64,
@@ -135,7 +338,7 @@ char* crypt_encrypt(const char* text, const char* password) {
       cry->cryptParameter.mac_len, cry->cryptParameter.key_len,
       cry->cryptParameter.base64_variant, cry->cryptParameter.hash_ops_limit,
       cry->cryptParameter.hash_mem_limit, cry->cryptParameter.hash_alg,
-      cry->encrypted_base64, cry->hash_key_base64);
+      cry->cryptParameter.aead, cry->encrypted_base64, cry->hash_key_base64);
   secFreeEncryptionInfo(cry);
   return ret;
 }
@@ -204,19 +407,21 @@ unsigned char* crypt_decrypt_base64(struct encryptionInfo* crypt,
 unsigned char* crypt_decryptWithKey(const struct encryptionInfo* crypt,
                                     unsigned long                cipher_len,
                                     const unsigned char*         key) {
-  unsigned char nonce[crypt->cryptParameter.nonce_len];
+  const struct cryptParameter* p = &crypt->cryptParameter;
+  if (p->nonce_len != crypt_aeadNonceLen(p->aead) ||
+      p->mac_len != SODIUM_MAC_LEN || cipher_len < p->mac_len) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  unsigned char nonce[p->nonce_len];
   unsigned char ciphertext[cipher_len];
-  fromBase64(crypt->nonce_base64, crypt->cryptParameter.nonce_len, nonce);
+  fromBase64(crypt->nonce_base64, p->nonce_len, nonce);
   fromBase64(crypt->encrypted_base64, cipher_len, ciphertext);
-  unsigned char* decrypted = secAlloc(
-      sizeof(unsigned char) * (cipher_len - crypt->cryptParameter.mac_len + 1));
-  if (crypto_secretbox_open_easy(decrypted, ciphertext, cipher_len, nonce,
-                                 key) != 0) {
-    logger(NOTICE, "Decryption failed.");
+  unsigned char* decrypted =
+      secAlloc(sizeof(unsigned char) * (cipher_len - p->mac_len + 1));
+  if (crypt_aeadDecrypt(p->aead, decrypted, ciphertext, cipher_len, nonce,
+                        key) != OIDC_SUCCESS) {
     secFree(decrypted);
-    /* If we get here, the Message was a forgery. This means someone (or the
-     * network) somehow tried to tamper with the message*/
-    oidc_errno = OIDC_EDECRYPT;
     return NULL;
   }
   return decrypted;
@@ -246,13 +451,14 @@ char* crypt_decryptFromList(list_t* lines, const char* password) {
   crypt->encrypted_base64 = oidc_strcopy(list_at(lines, 4)->val);
   crypt->hash_key_base64  = oidc_strcopy(list_at(lines, 5)->val);
   char*             tmp   = list_at(lines, 3)->val;
-  const char* const fmt   = "%lu:%lu:%lu:%lu:%d:%d:%d:%d";
+  // without a cipher the text was encrypted with secretbox
+  const char* const fmt   = "%lu:%lu:%lu:%lu:%d:%d:%d:%d:%d";
   sscanf(tmp, fmt, &crypt->cryptParameter.nonce_len,
          &crypt->cryptParameter.salt_len, &crypt->cryptParameter.mac_len,
          &crypt->cryptParameter.key_len, &crypt->cryptParameter.base64_variant,
          &crypt->cryptParameter.hash_ops_limit,
          &crypt->cryptParameter.hash_mem_limit,
-         &crypt->cryptParameter.hash_alg);
+         &crypt->cryptParameter.hash_alg, &crypt->cryptParameter.aead);
   char* ret = (char*)crypt_decrypt_base64(crypt, cipher_len, password);
   secFreeEncryptionInfo(crypt);
   return ret;
@@ -306,7 +512,7 @@ char* toBase64WithVariant(const char* bin, size_t len, int variant) {
     oidc_errno = OIDC_EALLOC;
     return NULL;
   }
-  sodium_bin2base64(base64, base64len, (const unsigned char*)bin, len, variant);
+  base64_encode(base64, base64len, (const unsigned char*)bin, len, variant);
   return base64;
 }
 
@@ -355,10 +561,10 @@ int fromBase64(const char* base64, size_t bin_len, unsigned char* bin) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  return sodium_base642bin(
+  return base64_decode(
       bin, bin_len, base64,
       sodium_base64_ENCODED_LEN(bin_len, sodium_base64_VARIANT_ORIGINAL), NULL,
-      NULL, NULL, sodium_base64_VARIANT_ORIGINAL);
+      NULL, sodium_base64_VARIANT_ORIGINAL);
 }
 
 /**
@@ -373,11 +579,39 @@ int fromBase64UrlSafe(const char* base64, size_t bin_len, unsigned char* bin) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  return sodium_base642bin(
+  return base64_decode(
       bin, bin_len, base64,
       sodium_base64_ENCODED_LEN(bin_len,
                                 sodium_base64_VARIANT_URLSAFE_NO_PADDING),
-      NULL, NULL, NULL, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+      NULL, NULL, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+}
+
+/**
+ * @brief decodes an url-safe base64 encoded string of unknown decoded length
+ * @param base64 the nullterminated base64 encoded string; without padding
+ * @param bin_len if not @c NULL, set to the length of the decoded data
+ * @return a pointer to the decoded data, that is additionally nullterminated;
+ * has to be freed after usage. @c NULL if @p base64 is not valid.
+ */
+char* decodeBase64UrlSafe(const char* base64, size_t* bin_len) {
+  if (base64 == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t b64_len = strlen(base64);
+  size_t max_len = b64_len / 4 * 3 + 2;
+  char*  bin     = secAlloc(max_len + 1);
+  size_t len     = 0;
+  if (base64_decode((unsigned char*)bin, max_len, base64, b64_len, &len, NULL,
+                    sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0) {
+    secFree(bin);
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  if (bin_len) {
+    *bin_len = len;
+  }
+  return bin;
 }
 
 /**
@@ -435,18 +669,27 @@ char* s256(const char* str) {
  * freed after usage.
  * @note this function is only used to keyDerivation with base64 encoded salt
  * (since version 2.1.0) - see also @c crypt_keyDerivation_hex
+ * @note if the key cache is enabled, cached keys are used instead of deriving
+ * them again; for encryption this reuses the salt of the cached keys
  */
 struct key_set crypt_keyDerivation_base64(const char* password,
                                           char        salt_base64[],
                                           int         generateNewSalt,
                                           struct cryptParameter* cryptParams) {
   logger(DEBUG, "Derivate key using base64 encoding");
+  struct key_set cached =
+      generateNewSalt
+          ? keyCache_findForEncryption(password, salt_base64, cryptParams)
+          : keyCache_find(password, salt_base64, cryptParams);
+  if (cached.encryption_key) {
+    return cached;
+  }
   char* key = secAlloc(sizeof(unsigned char) * (2 * cryptParams->key_len + 1));
   unsigned char salt[cryptParams->key_len];
   if (generateNewSalt) {
     /* Choose a random salt */
     randombytes_buf(salt, cryptParams->salt_len);
-    sodium_bin2base64(
+    base64_encode(
         salt_base64,
         sodium_base64_ENCODED_LEN(cryptParams->salt_len,
                                   sodium_base64_VARIANT_ORIGINAL) +
@@ -455,10 +698,17 @@ struct key_set crypt_keyDerivation_base64(const char* password,
   } else {
     fromBase64(salt_base64, cryptParams->salt_len, salt);
   }
-  if (crypto_pwhash((unsigned char*)key, 2 * cryptParams->key_len, password,
-                    strlen(password), salt, crypto_pwhash_OPSLIMIT_INTERACTIVE,
-                    crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                    crypto_pwhash_ALG_DEFAULT) != 0) {
+  __atomic_add_fetch(&keyDerivationCount, 1, __ATOMIC_RELAXED);
+  unsigned long long opslimit;
+  size_t             memlimit;
+  int                alg;
+  _kdfLimits(cryptParams, &opslimit, &memlimit, &alg);
+  OIDC_PROBE(pwhash_start);
+  int rc = crypto_pwhash((unsigned char*)key, 2 * cryptParams->key_len,
+                         password, strlen(password), salt, opslimit, memlimit,
+                         alg);
+  OIDC_PROBE1(pwhash_end, rc);
+  if (rc != 0) {
     secFree(key);
     logger(ALERT,
            "Could not derivate key. Probably because system out of memory.\n");
@@ -470,9 +720,69 @@ struct key_set crypt_keyDerivation_base64(const char* password,
       oidc_memcopy(key + cryptParams->key_len, cryptParams->key_len);
   secFree(key);
   struct key_set keys = {encryption_key, hash_key};
+  keyCache_add(password, salt_base64, keys, cryptParams);
   return keys;
 }
 
+static double _monotonicNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief measures how long a key derivation with the given limits takes
+ * @return the duration in seconds or a negative value on failure
+ */
+static double _measureKdf(unsigned long long opslimit, size_t memlimit) {
+  unsigned char key[2 * SODIUM_KEY_LEN];
+  unsigned char salt[SODIUM_SALT_LEN];
+  randombytes_buf(salt, sizeof(salt));
+  double start = _monotonicNow();
+  if (crypto_pwhash(key, sizeof(key), "calibration", strlen("calibration"),
+                    salt, opslimit, memlimit, SODIUM_PW_HASH_ALG) != 0) {
+    return -1;
+  }
+  return _monotonicNow() - start;
+}
+
+/**
+ * @brief benchmarks the key derivation on this host
+ * The memory limit is the largest power-of-two fraction of @p max_mem for
+ * which a single pass fits into @p target_seconds; the remaining time is
+ * spent on additional passes.
+ * @param target_seconds how long a key derivation should take
+ * @param max_mem the memory a key derivation may use at most, in bytes
+ * @return crypt parameters with the calibrated limits; if the benchmark failed
+ * @c hash_ops_limit is @c 0 and @c oidc_errno is set
+ */
+struct cryptParameter crypt_calibrateKdf(double target_seconds,
+                                         size_t max_mem) {
+  struct cryptParameter params = newCryptParameters();
+  unsigned long long    opsMin = crypto_pwhash_OPSLIMIT_MIN;
+  size_t                mem    = max_mem;
+  mem = mem < KDF_MIN_MEMLIMIT ? KDF_MIN_MEMLIMIT : mem;
+  mem = mem > KDF_MAX_MEMLIMIT ? KDF_MAX_MEMLIMIT : mem;
+  double t = _measureKdf(opsMin, mem);
+  while (t > target_seconds && mem / 2 >= KDF_MIN_MEMLIMIT) {
+    mem /= 2;
+    t = _measureKdf(opsMin, mem);
+  }
+  if (t < 0) {
+    oidc_errno            = OIDC_EMEM;
+    params.hash_ops_limit = 0;
+    return params;
+  }
+  double             perPass = t / opsMin;
+  unsigned long long ops =
+      perPass > 0 ? (unsigned long long)(target_seconds / perPass) : opsMin;
+  ops = ops < opsMin ? opsMin : ops;
+  ops = ops > KDF_MAX_OPSLIMIT ? KDF_MAX_OPSLIMIT : ops;
+  params.hash_ops_limit = ops;
+  params.hash_mem_limit = mem;
+  return params;
+}
+
 /**
  * @brief fills a buffer with random base64 characters
  * this is done by filling a buffer with random (binary) bytes and encoding this
@@ -486,10 +796,10 @@ void randomFillBase64UrlSafe(char buffer[], size_t buffer_size) {
   randombytes_buf(bin, buffer_size);
   char base64[sodium_base64_ENCODED_LEN(
       buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING)];
-  sodium_bin2base64(base64,
-                    sodium_base64_ENCODED_LEN(
-                        buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING),
-                    bin, buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+  base64_encode(base64,
+                sodium_base64_ENCODED_LEN(
+                    buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING),
+                bin, buffer_size, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
   strncpy(buffer, base64, buffer_size);
   sodium_memzero(base64,
                  sodium_base64_ENCODED_LEN(
@@ -2,12 +2,18 @@
 #define CRYPT_H
 
 #include "cryptdef.h"
+#include "utils/oidc_error.h"
 #include "wrapper/list.h"
 
 void                   initCrypt();
 char*                  crypt_encrypt(const char* text, const char* password);
+char* crypt_encryptWithParameters(const char* text, const char* password,
+                                  struct cryptParameter cryptParams);
 struct encryptionInfo* crypt_encryptWithKey(const unsigned char* text,
                                             const unsigned char* key);
+struct encryptionInfo* crypt_encryptWithKeyAndAead(const unsigned char* text,
+                                                   const unsigned char* key,
+                                                   int                  aead);
 char*          crypt_decrypt(const char* crypt_str, const char* password);
 char*          crypt_decryptFromList(list_t* lines, const char* password);
 unsigned char* crypt_decryptWithKey(const struct encryptionInfo* crypt,
@@ -22,8 +28,23 @@ char*          toBase64(const char* bin, size_t len);
 char*          toBase64UrlSafe(const char* bin, size_t len);
 int   fromBase64(const char* base64, size_t bin_len, unsigned char* bin);
 int   fromBase64UrlSafe(const char* base64, size_t bin_len, unsigned char* bin);
+char* decodeBase64UrlSafe(const char* base64, size_t* bin_len);
 void  randomFillBase64UrlSafe(char buffer[], size_t buffer_size);
 char* s256(const char* str);
 struct cryptParameter newCryptParameters();
+struct cryptParameter newCryptParametersForAead(int aead);
+int                   crypt_defaultAead();
+int                   crypt_isAeadAvailable(int aead);
+size_t                crypt_aeadNonceLen(int aead);
+oidc_error_t crypt_aeadEncrypt(int aead, unsigned char* cipher,
+                               const unsigned char* text, size_t text_len,
+                               const unsigned char* nonce,
+                               const unsigned char* key);
+oidc_error_t crypt_aeadDecrypt(int aead, unsigned char* text,
+                               const unsigned char* cipher, size_t cipher_len,
+                               const unsigned char* nonce,
+                               const unsigned char* key);
+struct cryptParameter crypt_calibrateKdf(double target_seconds, size_t max_mem);
+unsigned long         crypt_getKeyDerivationCount();
 
 #endif  // CRYPT_H
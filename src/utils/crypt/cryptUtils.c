@@ -4,6 +4,7 @@
 #include "defines/settings.h"
 #include "defines/version.h"
 #include "hexCrypt.h"
+#include "kdfConfig.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
@@ -125,12 +126,14 @@ char* encryptText(const char* text, const char* password) {
 /**
  * @brief encrypts a given text with the given password and adds the current
  * oidc-agent version
+ * The key derivation limits are taken from the kdf config.
  * @return the encrypted text in a formatted string that holds all relevant
  * encryption information as well as the oidc-agent version. Can be passed to
  * @c decryptFileContent
  */
 char* encryptWithVersionLine(const char* text, const char* password) {
-  char* crypt        = encryptText(text, password);
+  char* crypt =
+      crypt_encryptWithParameters(text, password, kdfConfig_getParameters());
   char* version_line = simpleVersionToVersionLine(VERSION);
   char* ret          = oidc_sprintf("%s\n%s", crypt, version_line);
   secFree(crypt);
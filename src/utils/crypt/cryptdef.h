@@ -10,6 +10,16 @@ struct key_set {
   char* hash_key;
 };
 
+/**
+ * The authenticated ciphers; secretbox (XSalsa20-Poly1305) is used by older
+ * versions and for messages to them. All ciphers use 32 byte keys and 16 byte
+ * MACs, only the length of the nonce differs.
+ */
+#define CRYPT_AEAD_SECRETBOX 0
+#define CRYPT_AEAD_AES256GCM 1
+#define CRYPT_AEAD_XCHACHA20POLY1305 2
+#define CRYPT_AEAD_MAX CRYPT_AEAD_XCHACHA20POLY1305
+
 struct cryptParameter {
   size_t nonce_len;
   size_t salt_len;
@@ -19,6 +29,7 @@ struct cryptParameter {
   int    hash_ops_limit;
   int    hash_mem_limit;
   int    hash_alg;
+  int    aead;
 };
 
 struct encryptionInfo {
@@ -1,95 +1,219 @@
 #include "dbCryptUtils.h"
 
+#include "account/refreshTemplate.h"
+#include "account/setandget.h"
+#include "account/tokenCache.h"
 #include "crypt.h"
 #include "cryptUtils.h"
 #include "memoryCrypt.h"
 #include "utils/accountUtils.h"
 #include "utils/db/account_db.h"
+#include "utils/listUtils.h"
 #include "utils/logger.h"
+#include "utils/probes.h"
 #include "utils/stringUtils.h"
 
+#include <sodium.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Locking derives a single key from the lock password and seals every
+ * sensitive account value with it (XSalsa20-Poly1305 with a random nonce per
+ * value), so the password hash runs only once per lock and unlock regardless
+ * of the number of loaded accounts. A sealed value has the format
+ *   cipher_len:nonce_base64:cipher_base64
+ * The salt and the hash key of the derivation are kept until unlock.
+ */
+
+struct lockField {
+  char* (*get)(const struct oidc_account*);
+  void (*set)(struct oidc_account*, char*);
+  unsigned char memoryEncrypted;
+};
+
+static const struct lockField lockFields[] = {
+    {account_getAccessToken, account_setAccessToken, 0},
+    {account_getRefreshToken, account_setRefreshToken, 1},
+    {account_getClientId, account_setClientId, 1},
+    {account_getClientSecret, account_setClientSecret, 1},
+};
+
+static char* lock_salt_base64 = NULL;
+static char* lock_hash_key    = NULL;
+
+/**
+ * @brief memory encrypts a lock decrypted value and frees it
+ */
+static char* _memoryEncryptAndFree(char* plain) {
+  char* cipher = memoryEncrypt(plain);
+  secFree(plain);
+  return cipher;
+}
+
+static char* _lockSeal(const char* plain, const unsigned char* key) {
+  struct encryptionInfo* cry =
+      crypt_encryptWithKey((const unsigned char*)plain, key);
+  if (cry == NULL) {
+    return NULL;
+  }
+  char* sealed = oidc_sprintf(
+      "%lu:%s:%s", (unsigned long)(strlen(plain) + cry->cryptParameter.mac_len),
+      cry->nonce_base64, cry->encrypted_base64);
+  secFreeEncryptionInfo(cry);
+  return sealed;
+}
+
+static char* _lockUnseal(const char* sealed, const unsigned char* key) {
+  char*                 end        = NULL;
+  unsigned long         cipher_len = strtoul(sealed, &end, 10);
+  char*                 cipher     = *end == ':' ? strchr(end + 1, ':') : NULL;
+  struct encryptionInfo crypt      = {.cryptParameter = newCryptParameters()};
+  if (cipher == NULL || cipher_len < crypt.cryptParameter.mac_len ||
+      cipher_len > strlen(cipher + 1) / 4 * 3) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  crypt.nonce_base64     = oidc_strncopy(end + 1, cipher - end - 1);
+  crypt.encrypted_base64 = cipher + 1;
+  char* plain = (char*)crypt_decryptWithKey(&crypt, cipher_len, key);
+  secFree(crypt.nonce_base64);
+  return plain;
+}
+
+static void _clearLockKey() {
+  secFree(lock_salt_base64);
+  secFree(lock_hash_key);
+}
+
 /**
  * @brief encrypts sensitive information when the agent is locked.
- * encrypts all loaded access_token, additional encryption (on top of already in
- * place xor) for refresh_token, client_id, client_secret
- * @param loaded the list of currently loaded accounts
+ * encrypts all loaded access_token, refresh_token, client_id, client_secret
  * @param password the lock password that will be used for encryption
  * @return an oidc_error code
  */
 oidc_error_t lockEncrypt(const char* password) {
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(accountDB_getList(), LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    struct oidc_account* acc = node->val;
-    char* tmp = encryptText(account_getAccessToken(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setAccessToken(acc, tmp);
-    tmp = encryptText(account_getRefreshToken(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setRefreshToken(acc, tmp);
-    tmp = encryptText(account_getClientId(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setClientId(acc, tmp);
-    if (strValid(account_getClientSecret(acc))) {
-      tmp = encryptText(account_getClientSecret(acc), password);
-      if (tmp == NULL) {
-        return oidc_errno;
+  struct cryptParameter params = newCryptParameters();
+  _clearLockKey();
+  lock_salt_base64 = secAlloc(
+      sodium_base64_ENCODED_LEN(params.salt_len, params.base64_variant) + 1);
+  struct key_set keys =
+      crypt_keyDerivation_base64(password, lock_salt_base64, 1, &params);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    _clearLockKey();
+    return oidc_errno;
+  }
+  lock_hash_key                 = keys.hash_key;
+  const unsigned char* key      = (const unsigned char*)keys.encryption_key;
+  oidc_error_t         ret      = OIDC_SUCCESS;
+  const vector_t*      accounts = accountDB_getList();
+  for (size_t a = 0; ret == OIDC_SUCCESS && accounts && a < accounts->len;
+       a++) {
+    struct oidc_account* acc = vector_at(accounts, a);
+    account_clearTokenCache(acc);  // cached tokens are not kept while locked
+    // holds the client credentials; prepared again after unlocking
+    account_setRefreshTemplate(acc, NULL);
+    for (size_t i = 0; i < sizeof(lockFields) / sizeof(*lockFields); i++) {
+      const struct lockField* f     = &lockFields[i];
+      const char*             value = f->get(acc);
+      if (value == NULL || (f->memoryEncrypted && !strValid(value))) {
+        continue;
+      }
+      char* plain  = f->memoryEncrypted ? memoryDecrypt(value)
+                                        : oidc_strcopy(value);
+      char* sealed = plain ? _lockSeal(plain, key) : NULL;
+      secFree(plain);
+      if (sealed == NULL) {
+        ret = oidc_errno;
+        break;
       }
-      account_setClientSecret(acc, tmp);
+      f->set(acc, sealed);
     }
   }
-  list_iterator_destroy(it);
-  return OIDC_SUCCESS;
+  secFree(keys.encryption_key);
+  return ret;
 }
 
 /**
  * @brief decrypts sensitive information when the agent is unlocked.
- * After this call refresh_token, client_id, and client_secret will still be
- * xor encrypted
- * @param loaded the list of currently loaded accounts
+ * After this call refresh_token, client_id, and client_secret will be
+ * memory encrypted again
  * @param password the lock password that was used for encryption
  * @return an oidc_error code
  */
 oidc_error_t lockDecrypt(const char* password) {
+  if (lock_salt_base64 == NULL || lock_hash_key == NULL) {
+    oidc_errno = OIDC_ENOTLOCKED;
+    return oidc_errno;
+  }
+  struct cryptParameter params = newCryptParameters();
+  struct key_set        keys =
+      crypt_keyDerivation_base64(password, lock_salt_base64, 0, &params);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return oidc_errno;
+  }
+  int match = sodium_memcmp(keys.hash_key, lock_hash_key, params.key_len) == 0;
+  secFree(keys.hash_key);
+  if (!match) {
+    secFree(keys.encryption_key);
+    oidc_errno = OIDC_EPASS;
+    return oidc_errno;
+  }
+  const unsigned char* key      = (const unsigned char*)keys.encryption_key;
+  oidc_error_t         ret      = OIDC_SUCCESS;
+  const vector_t*      accounts = accountDB_getList();
+  for (size_t a = 0; ret == OIDC_SUCCESS && accounts && a < accounts->len;
+       a++) {
+    struct oidc_account* acc = vector_at(accounts, a);
+    for (size_t i = 0; i < sizeof(lockFields) / sizeof(*lockFields); i++) {
+      const struct lockField* f     = &lockFields[i];
+      const char*             value = f->get(acc);
+      if (!strValid(value)) {
+        continue;
+      }
+      char* plain = _lockUnseal(value, key);
+      if (plain == NULL) {
+        ret = oidc_errno;
+        break;
+      }
+      f->set(acc, f->memoryEncrypted ? _memoryEncryptAndFree(plain) : plain);
+    }
+  }
+  secFree(keys.encryption_key);
+  if (ret == OIDC_SUCCESS) {
+    _clearLockKey();
+  }
+  return ret;
+}
+
+/**
+ * @brief applies @p crypt to every token of the refresh token pool of
+ * @p account; the pool is only kept until the account was validated, see
+ * oidcd/refreshTokenPool.c
+ */
+static void _cryptRefreshTokenPool(struct oidc_account* account,
+                                   char* (*crypt)(const char*)) {
+  list_t* pool = account_getRefreshTokenPool(account);
+  if (pool == NULL) {
+    return;
+  }
   list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(accountDB_getList(), LIST_HEAD);
+  list_iterator_t* it = list_iterator_new(pool, LIST_HEAD);
   while ((node = list_iterator_next(it))) {
-    struct oidc_account* acc = node->val;
-    char* tmp = crypt_decrypt(account_getAccessToken(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setAccessToken(acc, tmp);
-    tmp = crypt_decrypt(account_getRefreshToken(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setRefreshToken(acc, tmp);
-    tmp = crypt_decrypt(account_getClientId(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setClientId(acc, tmp);
-    tmp = crypt_decrypt(account_getClientSecret(acc), password);
-    if (tmp == NULL) {
-      return oidc_errno;
-    }
-    account_setClientSecret(acc, tmp);
+    char* value = crypt(node->val);
+    secFree(node->val);
+    node->val = value;
   }
   list_iterator_destroy(it);
-  return OIDC_SUCCESS;
 }
 
 struct oidc_account* _db_decryptFoundAccount(struct oidc_account* account) {
   if (account == NULL) {
     return NULL;
   }
+  _cryptRefreshTokenPool(account, memoryDecrypt);
   account_setRefreshToken(account,
                           memoryDecrypt(account_getRefreshToken(account)));
   account_setClientId(account, memoryDecrypt(account_getClientId(account)));
@@ -129,16 +253,29 @@ struct oidc_account* db_getAccountDecryptedByShortname(const char* shortname) {
  */
 void db_addAccountEncrypted(struct oidc_account* account) {
   logger(DEBUG, "Adding / Reencrypting account to list");
+  OIDC_PROBE1(db_add_account_start, account_getName(account));
+  if (account_getRefreshTemplate(account) == NULL &&
+      strValid(account_getTokenEndpoint(account))) {
+    refreshTemplate_prepare(account);
+  }
   account_setRefreshToken(account,
                           memoryEncrypt(account_getRefreshToken(account)));
+  _cryptRefreshTokenPool(account, memoryEncrypt);
   account_setClientId(account, memoryEncrypt(account_getClientId(account)));
   account_setClientSecret(account,
                           memoryEncrypt(account_getClientSecret(account)));
-  struct oidc_account* found = accountDB_findValue(account);
-  if (found && found != account) {
-    accountDB_removeIfFound(account);
-  }
-  if (found != account) {
+  list_t* same = accountDB_findAllValuesByIndex(ACCOUNTDB_INDEX_SHORTNAME,
+                                                account_getName(account));
+  const int loaded = findInList(same, account) != NULL;
+  secFreeList(same);
+  if (!loaded) {  // a new account replaces the one of the tenant
+    account_setOwner(account, accounts_getTenant());
+    struct oidc_account* found =
+        db_findAccountByShortname(account_getName(account));
+    if (found) {
+      accountDB_removeIfFound(found);
+    }
     accountDB_addValue(account);
   }
+  OIDC_PROBE1(db_add_account_end, account_getName(account));
 }
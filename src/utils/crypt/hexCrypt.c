@@ -34,7 +34,8 @@ static struct cryptParameter legacy_23_cryptParams = {LEG23_NONCE_LEN,
                                                       0,
                                                       LEG23_PW_HASH_OPSLIMIT,
                                                       LEG23_PW_HASH_MEMLIMIT,
-                                                      LEG23_PW_HASH_ALG};
+                                                      LEG23_PW_HASH_ALG,
+                                                      CRYPT_AEAD_SECRETBOX};
 /**
  * Legacy crypt parameters for file encrypted before 2.1.0 on a system that used
  * libsodium28 (xenial, stretch)
@@ -46,7 +47,8 @@ static struct cryptParameter legacy_18_cryptParams = {LEG18_NONCE_LEN,
                                                       0,
                                                       LEG18_PW_HASH_OPSLIMIT,
                                                       LEG18_PW_HASH_MEMLIMIT,
-                                                      LEG18_PW_HASH_ALG};
+                                                      LEG18_PW_HASH_ALG,
+                                                      CRYPT_AEAD_SECRETBOX};
 
 /**
  * @brief decrypts a given encrypted text with the given password and
@@ -1,15 +1,22 @@
 #include "ipcCryptUtils.h"
 
 #include "utils/crypt/crypt.h"
+#include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
 
+#include <sodium.h>
 #include <string.h>
 
 char* encryptForIpc(const char* msg, const unsigned char* key) {
+  // the base64 format is only used with older versions, i.e. with secretbox
   struct encryptionInfo* cryptResult =
-      crypt_encryptWithKey((unsigned char*)msg, key);
+      crypt_encryptWithKeyAndAead((unsigned char*)msg, key,
+                                  CRYPT_AEAD_SECRETBOX);
+  if (cryptResult == NULL) {
+    return NULL;
+  }
   if (cryptResult->encrypted_base64 == NULL) {
     secFreeEncryptionInfo(cryptResult);
     return NULL;
@@ -39,9 +46,118 @@ char* decryptForIpc(const char* msg, const unsigned char* key) {
   struct encryptionInfo crypt = {};
   crypt.nonce_base64          = nonce_base64;
   crypt.encrypted_base64      = encrypted_base64;
-  crypt.cryptParameter        = newCryptParameters();
+  crypt.cryptParameter        = newCryptParametersForAead(CRYPT_AEAD_SECRETBOX);
   unsigned char* decryptedMsg =
       crypt_decryptWithKey(&crypt, msg_len + crypt.cryptParameter.mac_len, key);
   secFree(msg_tmp);
   return (char*)decryptedMsg;
 }
+
+/**
+ * @brief returns the offset of the plaintext in the ciphertext, so that
+ * encryption and decryption can be done in place
+ * secretbox puts the MAC in front of the ciphertext, the other ciphers behind
+ * it.
+ */
+static size_t _textOffset(int aead) {
+  return aead == CRYPT_AEAD_SECRETBOX ? crypto_secretbox_MACBYTES : 0;
+}
+
+/**
+ * @brief encrypts a message into the binary ipc format
+ * The plaintext is copied once into the output buffer and encrypted there.
+ * @param aead the cipher negotiated during the key exchange
+ * @param len is set to the length of the encrypted message
+ * @return a pointer to the encrypted message; has to be freed after usage
+ */
+char* encryptForIpcBinary(const char* msg, const unsigned char* key, int aead,
+                          size_t* len) {
+  if (msg == NULL || key == NULL || len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  size_t msg_len   = strlen(msg);
+  size_t nonce_len = crypt_aeadNonceLen(aead);
+  size_t buf_len   = IPC_CRYPT_BINARY_HEADER_LEN + nonce_len +
+                   crypto_secretbox_MACBYTES + msg_len;
+  unsigned char* buf = secAlloc(buf_len);
+  if (buf == NULL) {
+    return NULL;
+  }
+  buf[0]                = IPC_CRYPT_BINARY_MARKER;
+  buf[1]                = IPC_CRYPT_BINARY_VERSION + aead;
+  unsigned char* nonce  = buf + IPC_CRYPT_BINARY_HEADER_LEN;
+  unsigned char* cipher = nonce + nonce_len;
+  randombytes_buf(nonce, nonce_len);
+  memcpy(cipher + _textOffset(aead), msg, msg_len);
+  if (crypt_aeadEncrypt(aead, cipher, cipher + _textOffset(aead), msg_len,
+                        nonce, key) != OIDC_SUCCESS) {
+    secFree(buf);
+    return NULL;
+  }
+  *len = buf_len;
+  return (char*)buf;
+}
+
+/**
+ * @brief returns the cipher of a binary ipc message
+ * @return the cipher or @c -1 if @p msg is not in the binary format
+ */
+static int _binaryIpcAead(const char* msg, size_t len) {
+  if (msg == NULL || len < IPC_CRYPT_BINARY_HEADER_LEN ||
+      msg[0] != IPC_CRYPT_BINARY_MARKER) {
+    return -1;
+  }
+  int aead = msg[1] - IPC_CRYPT_BINARY_VERSION;
+  if (aead < 0 || aead > CRYPT_AEAD_MAX ||
+      len < IPC_CRYPT_BINARY_HEADER_LEN + crypt_aeadNonceLen(aead) +
+                crypto_secretbox_MACBYTES) {
+    return -1;
+  }
+  return aead;
+}
+
+int isBinaryIpcMessage(const char* msg, size_t len) {
+  return _binaryIpcAead(msg, len) >= 0;
+}
+
+/**
+ * @brief decrypts a received ipc message in either format
+ * Binary messages are decrypted in place; base64 encoded messages are decrypted
+ * with @c decryptForIpc.
+ * @param msg the received message; it is consumed, i.e. either returned or
+ * freed
+ * @param len the length of @p msg
+ * @return a pointer to the decrypted message or @c NULL on failure; has to be
+ * freed after usage
+ */
+char* decryptForIpcInPlace(char* msg, size_t len, const unsigned char* key) {
+  if (msg == NULL || key == NULL) {
+    secFree(msg);
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  int aead = _binaryIpcAead(msg, len);
+  if (aead < 0) {
+    char* decrypted = decryptForIpc(msg, key);
+    secFree(msg);
+    return decrypted;
+  }
+  size_t         nonce_len = crypt_aeadNonceLen(aead);
+  unsigned char* nonce     = (unsigned char*)msg + IPC_CRYPT_BINARY_HEADER_LEN;
+  unsigned char* cipher    = nonce + nonce_len;
+  size_t cipher_len = len - IPC_CRYPT_BINARY_HEADER_LEN - nonce_len;
+  size_t msg_len    = cipher_len - crypto_secretbox_MACBYTES;
+  // secretbox writes the plaintext to the start of the buffer and handles the
+  // overlap; the other ciphers decrypt in place and the plaintext is moved
+  unsigned char* text =
+      aead == CRYPT_AEAD_SECRETBOX ? (unsigned char*)msg : cipher;
+  if (crypt_aeadDecrypt(aead, text, cipher, cipher_len, nonce, key) !=
+      OIDC_SUCCESS) {
+    secFree(msg);
+    return NULL;
+  }
+  memmove(msg, text, msg_len);
+  memset(msg + msg_len, 0, len - msg_len);
+  return msg;
+}
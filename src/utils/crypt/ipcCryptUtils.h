@@ -1,7 +1,25 @@
 #ifndef IPC_CRYPT_UTILS_H
 #define IPC_CRYPT_UTILS_H
 
+#include <stddef.h>
+
+/**
+ * Binary format of encrypted ipc messages: a fixed two byte header (marker and
+ * version), the raw nonce and the raw ciphertext including the mac. The
+ * length of the message is given by the ipc frame. The marker cannot be the
+ * first byte of a base64 encoded message. The version is
+ * @c IPC_CRYPT_BINARY_VERSION plus the cipher negotiated during the key
+ * exchange, so version 1 is secretbox.
+ */
+#define IPC_CRYPT_BINARY_MARKER '\x03'
+#define IPC_CRYPT_BINARY_VERSION '\x01'
+#define IPC_CRYPT_BINARY_HEADER_LEN 2
+
 char* decryptForIpc(const char*, const unsigned char*);
 char* encryptForIpc(const char*, const unsigned char*);
+char* encryptForIpcBinary(const char* msg, const unsigned char* key, int aead,
+                          size_t* len);
+int   isBinaryIpcMessage(const char* msg, size_t len);
+char* decryptForIpcInPlace(char* msg, size_t len, const unsigned char* key);
 
 #endif  // IPC_CRYPT_UTILS_H
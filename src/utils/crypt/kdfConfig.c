@@ -0,0 +1,78 @@
+#include "kdfConfig.h"
+#include "crypt.h"
+#include "defines/settings.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+/**
+ * The key derivation limits used when files in the oidc dir are encrypted.
+ * They are calibrated with @c oidc-gen @c --calibrate-kdf and stored in the
+ * kdf config file; if there is none the defaults are used. The limits are
+ * written into the header of each encrypted file, so files can always be
+ * decrypted independent of the current config.
+ */
+
+#define KDF_CONFIG_KEY_OPSLIMIT "ops_limit"
+#define KDF_CONFIG_KEY_MEMLIMIT "mem_limit"
+
+static struct cryptParameter params;
+static unsigned char         loaded = 0;
+
+static struct cryptParameter _readParameters() {
+  struct cryptParameter p = newCryptParameters();
+  if (!oidcFileDoesExist(KDF_CONFIG_FILENAME)) {
+    return p;
+  }
+  char* content = readOidcFile(KDF_CONFIG_FILENAME);
+  INIT_KEY_VALUE(KDF_CONFIG_KEY_OPSLIMIT, KDF_CONFIG_KEY_MEMLIMIT);
+  if (content == NULL || CALL_GETJSONVALUES(content) < 0) {
+    logger(NOTICE, "Could not read %s, using default key derivation limits",
+           KDF_CONFIG_FILENAME);
+    secFree(content);
+    SEC_FREE_KEY_VALUES();
+    return p;
+  }
+  secFree(content);
+  KEY_VALUE_VARS(ops, mem);
+  if (_ops && _mem) {
+    p.hash_ops_limit = strToInt(_ops);
+    p.hash_mem_limit = strToInt(_mem);
+  }
+  SEC_FREE_KEY_VALUES();
+  return p;
+}
+
+/**
+ * @brief returns the crypt parameters to use for encrypting files
+ * The kdf config is only read once per process.
+ */
+struct cryptParameter kdfConfig_getParameters() {
+  if (!loaded) {
+    params = _readParameters();
+    loaded = 1;
+  }
+  return params;
+}
+
+/**
+ * @brief stores the key derivation limits of @p p in the kdf config file
+ * @return an oidc_error code
+ */
+oidc_error_t kdfConfig_save(struct cryptParameter p) {
+  cJSON* json = cJSON_CreateObject();
+  jsonAddNumberValue(json, KDF_CONFIG_KEY_OPSLIMIT, p.hash_ops_limit);
+  jsonAddNumberValue(json, KDF_CONFIG_KEY_MEMLIMIT, p.hash_mem_limit);
+  char* content = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  oidc_error_t e = writeOidcFile(KDF_CONFIG_FILENAME, content);
+  secFree(content);
+  if (e == OIDC_SUCCESS) {
+    params = p;
+    loaded = 1;
+  }
+  return e;
+}
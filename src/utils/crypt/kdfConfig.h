@@ -0,0 +1,10 @@
+#ifndef OIDC_KDF_CONFIG_H
+#define OIDC_KDF_CONFIG_H
+
+#include "cryptdef.h"
+#include "utils/oidc_error.h"
+
+struct cryptParameter kdfConfig_getParameters();
+oidc_error_t          kdfConfig_save(struct cryptParameter params);
+
+#endif  // OIDC_KDF_CONFIG_H
@@ -0,0 +1,87 @@
+#define _GNU_SOURCE  // syscall
+#include "kernelKeyring.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#ifdef __linux__
+#include <linux/keyctl.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Secrets that have to survive a restart of the agent are kept in the user
+ * keyring of the kernel. It is only readable by the same user and lives as
+ * long as the user has processes. The system calls are used directly, so that
+ * there is no dependency on libkeyutils.
+ */
+
+#define KERNEL_KEYRING_KEY_TYPE "user"
+
+/**
+ * @brief stores @p secret in the user keyring under @p description
+ * An existing key with the same description is replaced.
+ */
+oidc_error_t kernelKeyring_store(const char* description, const char* secret) {
+  if (description == NULL || secret == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+#ifdef __linux__
+  long id = syscall(SYS_add_key, KERNEL_KEYRING_KEY_TYPE, description, secret,
+                    strlen(secret), KEY_SPEC_USER_KEYRING);
+  if (id < 0) {
+    logger(ERROR, "Could not add key '%s' to the kernel keyring: %m",
+           description);
+    oidc_setErrnoError();
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+#else
+  oidc_errno = OIDC_NOTIMPL;
+  return oidc_errno;
+#endif
+}
+
+/**
+ * @brief reads the secret stored under @p description and removes it from
+ * the user keyring
+ * @return a pointer to the secret or @c NULL if there is none. Has to be
+ * freed after usage.
+ */
+char* kernelKeyring_take(const char* description) {
+  if (description == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+#ifdef __linux__
+  long id = syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING,
+                    KERNEL_KEYRING_KEY_TYPE, description, 0);
+  if (id < 0) {
+    oidc_errno = OIDC_EPWNOTFOUND;
+    return NULL;
+  }
+  long len = syscall(SYS_keyctl, KEYCTL_READ, id, NULL, 0);
+  if (len < 0) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  char* secret = secAlloc(len + 1);
+  if (syscall(SYS_keyctl, KEYCTL_READ, id, secret, len) != len) {
+    oidc_setErrnoError();
+    secFree(secret);
+    return NULL;
+  }
+  if (syscall(SYS_keyctl, KEYCTL_UNLINK, id, KEY_SPEC_USER_KEYRING) < 0) {
+    logger(NOTICE, "Could not remove key '%s' from the kernel keyring: %m",
+           description);
+  }
+  return secret;
+#else
+  oidc_errno = OIDC_NOTIMPL;
+  return NULL;
+#endif
+}
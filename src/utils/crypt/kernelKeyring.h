@@ -0,0 +1,9 @@
+#ifndef KERNEL_KEYRING_H
+#define KERNEL_KEYRING_H
+
+#include "utils/oidc_error.h"
+
+oidc_error_t kernelKeyring_store(const char* description, const char* secret);
+char*        kernelKeyring_take(const char* description);
+
+#endif  // KERNEL_KEYRING_H
@@ -0,0 +1,259 @@
+#include "keyCache.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <sodium.h>
+#include <string.h>
+
+/**
+ * The key cache keeps keys derived from a password and a salt, so a file
+ * encrypted with the same password and salt can be decrypted (and encrypted
+ * again) without running the password hash once more. The cache is disabled
+ * unless @c keyCache_setLifetime enables it; entries then expire after the
+ * configured lifetime.
+ *
+ * Entries are identified by a keyed hash of the password and the salt; the
+ * password itself is not stored. When text is encrypted with a cached password
+ * the salt and keys of the most recent entry are reused; the nonce is still
+ * randomly chosen for each encryption.
+ *
+ * The cache is guarded by a lock, since keys are also derived on the threads
+ * of the agent's work pool.
+ */
+
+#define KEYCACHE_MAX_ENTRIES 32
+
+struct keyCacheEntry {
+  unsigned char pw_hash[crypto_generichash_BYTES];
+  char*         salt_base64;
+  char*         encryption_key;
+  char*         hash_key;
+  size_t        key_len;
+  size_t        salt_len;
+  int           hash_ops_limit;
+  int           hash_mem_limit;
+  int           hash_alg;
+  time_t        expires_at;
+};
+
+static list_t*            cache    = NULL;
+static struct lifetimeArg lifetime = {0, 0};
+static unsigned char      pwHashKey[crypto_generichash_KEYBYTES];
+static char               cacheLock = 0;
+
+static void _lock() {
+  while (__atomic_test_and_set(&cacheLock, __ATOMIC_ACQUIRE)) {}
+}
+
+static void _unlock() { __atomic_clear(&cacheLock, __ATOMIC_RELEASE); }
+
+static void _secFreeKeyCacheEntry(struct keyCacheEntry* e) {
+  if (e == NULL) {
+    return;
+  }
+  secFree(e->salt_base64);
+  secFree(e->encryption_key);
+  secFree(e->hash_key);
+  secFree(e);
+}
+
+static void _hashPassword(const char* password, unsigned char* out) {
+  crypto_generichash(out, crypto_generichash_BYTES,
+                     (const unsigned char*)password, strlen(password),
+                     pwHashKey, sizeof(pwHashKey));
+}
+
+static int _sameKdf(const struct keyCacheEntry*  e,
+                    const struct cryptParameter* cryptParams) {
+  return e->key_len == cryptParams->key_len &&
+         e->hash_ops_limit == cryptParams->hash_ops_limit &&
+         e->hash_mem_limit == cryptParams->hash_mem_limit &&
+         e->hash_alg == cryptParams->hash_alg;
+}
+
+static struct key_set _copyKeys(const struct keyCacheEntry* e) {
+  return (struct key_set){oidc_memcopy(e->encryption_key, e->key_len),
+                          oidc_memcopy(e->hash_key, e->key_len)};
+}
+
+/**
+ * @brief enables the key cache with the given lifetime
+ * @param lt the password lifetime of the agent; if it was not provided
+ * the cache is disabled and cleared, a lifetime of @c 0 keeps keys until the
+ * cache is cleared
+ */
+void keyCache_setLifetime(struct lifetimeArg lt) {
+  if (!lt.argProvided) {
+    keyCache_clear();
+  } else if (!lifetime.argProvided) {
+    randombytes_buf(pwHashKey, sizeof(pwHashKey));
+  }
+  lifetime = lt;
+}
+
+static void _removeExpired() {
+  if (cache == NULL) {
+    return;
+  }
+  time_t       now  = time(NULL);
+  list_node_t* node = cache->head;
+  while (node) {
+    list_node_t*          next = node->next;
+    struct keyCacheEntry* e    = node->val;
+    if (e->expires_at && e->expires_at <= now) {
+      list_remove(cache, node);
+    }
+    node = next;
+  }
+}
+
+/**
+ * @brief removes all expired entries from the key cache
+ */
+void keyCache_removeExpired() {
+  _lock();
+  _removeExpired();
+  _unlock();
+}
+
+/**
+ * @brief removes all entries from the key cache
+ */
+void keyCache_clear() {
+  _lock();
+  if (cache) {
+    logger(DEBUG, "Clearing key cache");
+    secFreeList(cache);
+    cache = NULL;
+  }
+  _unlock();
+}
+
+/**
+ * @brief returns the earliest expiration time of the cached keys
+ * @return the expiration time or @c 0 if no cached key expires
+ */
+time_t keyCache_getMinDeath() {
+  time_t min = 0;
+  _lock();
+  for (list_node_t* node = cache ? cache->head : NULL; node;
+       node              = node->next) {
+    time_t t = ((struct keyCacheEntry*)node->val)->expires_at;
+    if (t && (min == 0 || t < min)) {
+      min = t;
+    }
+  }
+  _unlock();
+  return min;
+}
+
+static const struct keyCacheEntry* _find(
+    const char* password, const char* salt_base64,
+    const struct cryptParameter* cryptParams) {
+  if (cache == NULL) {
+    return NULL;
+  }
+  _removeExpired();
+  unsigned char pw_hash[crypto_generichash_BYTES];
+  _hashPassword(password, pw_hash);
+  for (list_node_t* node = cache->head; node; node = node->next) {
+    const struct keyCacheEntry* e = node->val;
+    if (_sameKdf(e, cryptParams) &&
+        (salt_base64 ? strequal(e->salt_base64, salt_base64)
+                     : e->salt_len == cryptParams->salt_len) &&
+        sodium_memcmp(e->pw_hash, pw_hash, sizeof(pw_hash)) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief looks up the keys derived from @p password and @p salt_base64
+ * @return a key_set with copies of the cached keys; they have to be freed after
+ * usage. If no keys are cached the pointers are @c NULL.
+ */
+struct key_set keyCache_find(const char* password, const char* salt_base64,
+                             const struct cryptParameter* cryptParams) {
+  if (password == NULL || salt_base64 == NULL) {
+    return (struct key_set){NULL, NULL};
+  }
+  _lock();
+  const struct keyCacheEntry* e = _find(password, salt_base64, cryptParams);
+  struct key_set keys = e ? _copyKeys(e) : (struct key_set){NULL, NULL};
+  _unlock();
+  if (keys.encryption_key) {
+    logger(DEBUG, "Using cached key");
+  }
+  return keys;
+}
+
+/**
+ * @brief looks up the most recent keys derived from @p password to encrypt new
+ * text with them
+ * @param salt_base64 a buffer for the base64 encoded salt; it is filled with
+ * the salt of the cached keys
+ * @return a key_set with copies of the cached keys; they have to be freed after
+ * usage. If no keys are cached the pointers are @c NULL and @p salt_base64 is
+ * not changed.
+ */
+struct key_set keyCache_findForEncryption(
+    const char* password, char salt_base64[],
+    const struct cryptParameter* cryptParams) {
+  if (password == NULL) {
+    return (struct key_set){NULL, NULL};
+  }
+  _lock();
+  const struct keyCacheEntry* e    = _find(password, NULL, cryptParams);
+  struct key_set              keys = {NULL, NULL};
+  if (e) {
+    strcpy(salt_base64, e->salt_base64);
+    keys = _copyKeys(e);
+  }
+  _unlock();
+  if (keys.encryption_key) {
+    logger(DEBUG, "Using cached key and salt for encryption");
+  }
+  return keys;
+}
+
+/**
+ * @brief adds keys derived from @p password and @p salt_base64 to the cache
+ * Does nothing if the cache is disabled. The keys are copied.
+ */
+void keyCache_add(const char* password, const char* salt_base64,
+                  struct key_set               keys,
+                  const struct cryptParameter* cryptParams) {
+  if (!lifetime.argProvided || password == NULL || salt_base64 == NULL ||
+      keys.encryption_key == NULL || keys.hash_key == NULL) {
+    return;
+  }
+  _lock();
+  if (_find(password, salt_base64, cryptParams)) {
+    _unlock();
+    return;
+  }
+  if (cache == NULL) {
+    cache       = list_new();
+    cache->free = (void (*)(void*))_secFreeKeyCacheEntry;
+  }
+  if (cache->len >= KEYCACHE_MAX_ENTRIES) {
+    list_remove(cache, cache->tail);
+  }
+  struct keyCacheEntry* e = secAlloc(sizeof(struct keyCacheEntry));
+  _hashPassword(password, e->pw_hash);
+  e->salt_base64    = oidc_strcopy(salt_base64);
+  e->encryption_key = oidc_memcopy(keys.encryption_key, cryptParams->key_len);
+  e->hash_key       = oidc_memcopy(keys.hash_key, cryptParams->key_len);
+  e->key_len        = cryptParams->key_len;
+  e->salt_len       = cryptParams->salt_len;
+  e->hash_ops_limit = cryptParams->hash_ops_limit;
+  e->hash_mem_limit = cryptParams->hash_mem_limit;
+  e->hash_alg       = cryptParams->hash_alg;
+  e->expires_at     = lifetime.lifetime ? time(NULL) + lifetime.lifetime : 0;
+  list_lpush(cache, list_node_new(e));
+  _unlock();
+}
@@ -0,0 +1,22 @@
+#ifndef OIDC_KEY_CACHE_H
+#define OIDC_KEY_CACHE_H
+
+#include "cryptdef.h"
+#include "utils/lifetimeArg.h"
+
+#include <time.h>
+
+void           keyCache_setLifetime(struct lifetimeArg lifetime);
+struct key_set keyCache_find(const char* password, const char* salt_base64,
+                             const struct cryptParameter* cryptParams);
+struct key_set keyCache_findForEncryption(
+    const char* password, char salt_base64[],
+    const struct cryptParameter* cryptParams);
+void   keyCache_add(const char* password, const char* salt_base64,
+                    struct key_set               keys,
+                    const struct cryptParameter* cryptParams);
+void   keyCache_removeExpired();
+void   keyCache_clear();
+time_t keyCache_getMinDeath();
+
+#endif  // OIDC_KEY_CACHE_H
@@ -1,5 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
 #include "memoryCrypt.h"
-#include "crypt.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
@@ -8,25 +8,48 @@
 #include <sodium.h>
 #include <string.h>
 
-static uint64_t memoryPass;
+/**
+ * Memory encrypted values are kept as binary ciphertext instead of a printable
+ * string:
+ *   MEMORYCRYPT_MARKER | length (hex) | nonce | ciphertext | '\0'
+ * The leading marker keeps the value a non-empty string for checks like
+ * @c strValid and the trailing zero terminates it for everything that treats
+ * it as a string. The header contains no zero byte, so that the decryption can
+ * check with @c strnlen that it fits into the value. The ciphertext must not be
+ * copied with string functions.
+ */
+
+#define MEMORYCRYPT_MARKER 0x01
+#define MEMORYCRYPT_LENBYTES (2 * sizeof(size_t))
+#define MEMORYCRYPT_NONCEBYTES crypto_stream_xchacha20_NONCEBYTES
+#define MEMORYCRYPT_HEADERBYTES \
+  (1 + MEMORYCRYPT_LENBYTES + MEMORYCRYPT_NONCEBYTES)
+
+static unsigned char memoryKey[crypto_stream_xchacha20_KEYBYTES];
+
+static void _writeLength(unsigned char* dst, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  for (size_t i = MEMORYCRYPT_LENBYTES; i > 0; i--, len >>= 4) {
+    dst[i - 1] = hex[len & 0xf];
+  }
+}
 
 /**
- * @brief XORs len bytes of string with key
- * @param string the string to be encrypted
- * @param key a 64bit number used as encryption key
- * @param len the nubmer of bytes to be encrypted
- * @return a pointer to the encrypted string. It has to be freed after usage.
+ * @return the length or @c 0 if @p src is not a valid length
  */
-char* xorCrypt(const char* string, uint64_t key, size_t len) {
-  size_t length = sizeof(key);
-  char*  str    = secAlloc(len + 1);
-  char*  s      = str;
-  for (size_t i = 0; i < len; i++) {
-    *str = *string ^ *((unsigned char*)&key + (i % length));
-    str++;
-    string++;
+static size_t _readLength(const unsigned char* src) {
+  size_t len = 0;
+  for (size_t i = 0; i < MEMORYCRYPT_LENBYTES; i++) {
+    unsigned char d = src[i];
+    if (d >= '0' && d <= '9') {
+      len = (len << 4) | (d - '0');
+    } else if (d >= 'a' && d <= 'f') {
+      len = (len << 4) | (d - 'a' + 10);
+    } else {
+      return 0;
+    }
   }
-  return s;
+  return len;
 }
 
 /**
@@ -40,54 +63,65 @@ char* memoryDecrypt(const char* cipher) {
     // oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  // logger(DEBUG, "memory decryption '%s'", cipher);
-  char*  tmp           = oidc_strcopy(cipher);
-  size_t len           = strToInt(strtok(tmp, ":"));
-  char*  cipher_base64 = strtok(NULL, ":");
-  if (len == 0 || cipher_base64 == NULL) {
-    secFree(tmp);
+  const unsigned char* c = (const unsigned char*)cipher;
+  if (c[0] != MEMORYCRYPT_MARKER ||
+      strnlen(cipher, MEMORYCRYPT_HEADERBYTES) < MEMORYCRYPT_HEADERBYTES) {
     oidc_errno = OIDC_ECRYPM;
     return NULL;
   }
-  unsigned char* cipher_bin = secAlloc(sizeof(char) * (len + 1));
-  fromBase64(cipher_base64, len, cipher_bin);
-  char* decrypted = xorCrypt((char*)cipher_bin, memoryPass, len);
-  secFree(cipher_bin);
-  secFree(tmp);
+  size_t len = _readLength(c + 1);
+  if (len == 0) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  char* decrypted = secAlloc(len + 1);
+  if (decrypted == NULL) {
+    return NULL;
+  }
+  crypto_stream_xchacha20_xor((unsigned char*)decrypted,
+                              c + MEMORYCRYPT_HEADERBYTES, len,
+                              c + 1 + MEMORYCRYPT_LENBYTES, memoryKey);
   return decrypted;
 }
 
 /**
  * @brief encryptes text
  * @param text the text to be encrypted
- * @return a pointer to the base64 encoded encrypted string. It has to be freed
- * after usage.
+ * @return a pointer to the encrypted value. It has to be freed after usage.
  */
 char* memoryEncrypt(const char* text) {
   if (!strValid(text)) {
     // oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  // logger(DEBUG, "memory encryption '%s'", text);
-  size_t len           = strlen(text);
-  char*  cipher        = xorCrypt(text, memoryPass, len);
-  char*  cipher_base64 = toBase64(cipher, len);
-  secFree(cipher);
-  char* fmt      = "%lu:%s";
-  char* ciphered = oidc_sprintf(fmt, len, cipher_base64);
-  secFree(cipher_base64);
-  return ciphered;
+  size_t         len    = strlen(text);
+  unsigned char* cipher = secAlloc(MEMORYCRYPT_HEADERBYTES + len + 1);
+  if (cipher == NULL) {
+    return NULL;
+  }
+  cipher[0] = MEMORYCRYPT_MARKER;
+  _writeLength(cipher + 1, len);
+  unsigned char* nonce = cipher + 1 + MEMORYCRYPT_LENBYTES;
+  randombytes_buf(nonce, MEMORYCRYPT_NONCEBYTES);
+  for (size_t i = 0; i < MEMORYCRYPT_NONCEBYTES; i++) {
+    while (nonce[i] == 0) {  // keeps the header free of zero bytes
+      nonce[i] = (unsigned char)randombytes_uniform(256);
+    }
+  }
+  crypto_stream_xchacha20_xor(cipher + MEMORYCRYPT_HEADERBYTES,
+                              (const unsigned char*)text, len, nonce,
+                              memoryKey);
+  return (char*)cipher;
 }
 
 /**
  * @brief initializes memory encryption
- * generates a random 64bit memory encryption passnumber
+ * generates a random memory encryption key
  */
-void initMemoryCrypt() {
-  uint64_t a    = randombytes_random();
-  uint32_t b    = randombytes_random();
-  uint64_t pass = (a << 32) | b;
-  memoryPass    = pass;
-}
+void initMemoryCrypt() { randombytes_buf(memoryKey, sizeof(memoryKey)); }
 
-uint64_t _getMemoryPass() { return memoryPass; }
+uint64_t _getMemoryPass() {
+  uint64_t pass;
+  memcpy(&pass, memoryKey, sizeof(pass));
+  return pass;
+}
@@ -0,0 +1,210 @@
+#include "rsa.h"
+
+#include <sodium.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Verification of RSASSA-PKCS1-v1_5 signatures (RFC 8017), as used for JWTs
+ * signed with RS256 and RS512. libsodium has no RSA, so the public key
+ * operation is done here with Montgomery multiplication on 32 bit limbs. Only
+ * public data is involved, so the code does not need to be constant time.
+ */
+
+#define RSA_MAX_LIMBS (RSA_MAX_BITS / 32)
+
+typedef uint32_t limb_t;
+
+static const unsigned char sha256DigestInfo[] = {
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+    0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20};
+static const unsigned char sha512DigestInfo[] = {
+    0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+    0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40};
+
+/**
+ * @brief converts a big-endian byte string into @p k little-endian limbs
+ */
+static void _fromBytes(limb_t* x, size_t k, const unsigned char* b,
+                       size_t len) {
+  memset(x, 0, k * sizeof(limb_t));
+  for (size_t i = 0; i < len; i++) {
+    const size_t pos = len - 1 - i;  // bytes from the least significant one
+    x[i / 4] |= (limb_t)b[pos] << (8 * (i % 4));
+  }
+}
+
+static void _toBytes(unsigned char* b, size_t len, const limb_t* x) {
+  for (size_t i = 0; i < len; i++) {
+    b[len - 1 - i] = (unsigned char)(x[i / 4] >> (8 * (i % 4)));
+  }
+}
+
+static int _compare(const limb_t* a, const limb_t* b, size_t k) {
+  for (size_t i = k; i-- > 0;) {
+    if (a[i] != b[i]) {
+      return a[i] > b[i] ? 1 : -1;
+    }
+  }
+  return 0;
+}
+
+static void _sub(limb_t* a, const limb_t* b, size_t k) {
+  uint64_t borrow = 0;
+  for (size_t i = 0; i < k; i++) {
+    const uint64_t d = (uint64_t)a[i] - b[i] - borrow;
+    a[i]             = (limb_t)d;
+    borrow           = (d >> 32) & 1;
+  }
+}
+
+/**
+ * @brief computes @p r = @p a * @p b / R mod @p n with R = 2^(32k)
+ * @param n0inv -n^-1 mod 2^32
+ */
+static void _montMul(limb_t* r, const limb_t* a, const limb_t* b,
+                     const limb_t* n, limb_t n0inv, size_t k) {
+  limb_t t[RSA_MAX_LIMBS + 2] = {0};
+  for (size_t i = 0; i < k; i++) {
+    uint64_t c = 0;
+    for (size_t j = 0; j < k; j++) {
+      c    = (uint64_t)t[j] + (uint64_t)a[j] * b[i] + (c >> 32);
+      t[j] = (limb_t)c;
+    }
+    c        = (uint64_t)t[k] + (c >> 32);
+    t[k]     = (limb_t)c;
+    t[k + 1] = (limb_t)(c >> 32);
+    const limb_t m = t[0] * n0inv;
+    c              = (uint64_t)t[0] + (uint64_t)m * n[0];
+    for (size_t j = 1; j < k; j++) {
+      c        = (uint64_t)t[j] + (uint64_t)m * n[j] + (c >> 32);
+      t[j - 1] = (limb_t)c;
+    }
+    c        = (uint64_t)t[k] + (c >> 32);
+    t[k - 1] = (limb_t)c;
+    t[k]     = t[k + 1] + (limb_t)(c >> 32);
+  }
+  if (t[k] || _compare(t, n, k) >= 0) {
+    _sub(t, n, k);
+  }
+  memcpy(r, t, k * sizeof(limb_t));
+}
+
+/**
+ * @brief computes @p s ^ @p e mod @p n
+ */
+static void _modExp(limb_t* r, const limb_t* s, const unsigned char* e,
+                    size_t e_len, const limb_t* n, size_t k) {
+  limb_t n0inv = 1;  // Newton iteration for n[0]^-1 mod 2^32
+  for (int i = 0; i < 5; i++) {
+    n0inv *= 2 - n[0] * n0inv;
+  }
+  n0inv = -n0inv;
+  // 2R mod n by doubling 2^(32(k-1)), which is less than n, 33 times
+  limb_t two[RSA_MAX_LIMBS] = {0};
+  two[k - 1]                = 1;
+  for (int i = 0; i < 33; i++) {
+    limb_t carry = 0;
+    for (size_t j = 0; j < k; j++) {
+      const limb_t next = two[j] >> 31;
+      two[j]            = (two[j] << 1) | carry;
+      carry             = next;
+    }
+    if (carry || _compare(two, n, k) >= 0) {
+      _sub(two, n, k);
+    }
+  }
+  // R^2 mod n is 2^(32k) in Montgomery form, i.e. 2R raised to 32k
+  limb_t       r2[RSA_MAX_LIMBS];
+  const size_t exp = 32 * k;
+  int          top = 0;
+  while ((exp >> (top + 1)) != 0) {
+    top++;
+  }
+  memcpy(r2, two, k * sizeof(limb_t));
+  for (int bit = top - 1; bit >= 0; bit--) {
+    _montMul(r2, r2, r2, n, n0inv, k);
+    if ((exp >> bit) & 1) {
+      _montMul(r2, r2, two, n, n0inv, k);
+    }
+  }
+  limb_t base[RSA_MAX_LIMBS];
+  limb_t acc[RSA_MAX_LIMBS];
+  _montMul(base, s, r2, n, n0inv, k);
+  memcpy(acc, base, k * sizeof(limb_t));
+  unsigned char started = 0;
+  for (size_t i = 0; i < e_len; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      const int set = (e[i] >> bit) & 1;
+      if (!started) {  // acc is base for the most significant bit
+        started = set;
+        continue;
+      }
+      _montMul(acc, acc, acc, n, n0inv, k);
+      if (set) {
+        _montMul(acc, acc, base, n, n0inv, k);
+      }
+    }
+  }
+  const limb_t one[RSA_MAX_LIMBS] = {1};
+  _montMul(r, acc, one, n, n0inv, k);
+}
+
+/**
+ * @brief verifies a RSASSA-PKCS1-v1_5 signature
+ * @param n the modulus of the public key as big-endian byte string
+ * @param e the public exponent as big-endian byte string
+ * @param hash the hash function the message was signed with
+ * @param msg the signed message
+ * @return @c 1 if @p sig is a valid signature of @p msg, @c 0 otherwise
+ */
+int rsa_verify(const unsigned char* n, size_t n_len, const unsigned char* e,
+               size_t e_len, enum rsa_hash hash, const unsigned char* msg,
+               size_t msg_len, const unsigned char* sig, size_t sig_len) {
+  while (n_len > 0 && n[0] == 0) {
+    n++;
+    n_len--;
+  }
+  while (e_len > 0 && e[0] == 0) {
+    e++;
+    e_len--;
+  }
+  if (n_len * 8 < RSA_MIN_BITS || n_len * 8 > RSA_MAX_BITS ||
+      !(n[n_len - 1] & 1) || e_len == 0 || e_len > n_len ||
+      !(e[e_len - 1] & 1) || sig_len != n_len) {
+    return 0;
+  }
+  const unsigned char* prefix =
+      hash == RSA_SHA512 ? sha512DigestInfo : sha256DigestInfo;
+  const size_t prefix_len  = hash == RSA_SHA512 ? sizeof(sha512DigestInfo)
+                                                : sizeof(sha256DigestInfo);
+  const size_t digest_len  = hash == RSA_SHA512 ? crypto_hash_sha512_BYTES
+                                                : crypto_hash_sha256_BYTES;
+  unsigned char expected[RSA_MAX_BITS / 8];
+  unsigned char* digest    = expected + n_len - digest_len;
+  // EM = 0x00 || 0x01 || 0xff... || 0x00 || DigestInfo || H(msg)
+  expected[0] = 0x00;
+  expected[1] = 0x01;
+  memset(expected + 2, 0xff, n_len - 3 - prefix_len - digest_len);
+  expected[n_len - prefix_len - digest_len - 1] = 0x00;
+  memcpy(digest - prefix_len, prefix, prefix_len);
+  if (hash == RSA_SHA512) {
+    crypto_hash_sha512(digest, msg, msg_len);
+  } else {
+    crypto_hash_sha256(digest, msg, msg_len);
+  }
+
+  const size_t k = (n_len + 3) / 4;
+  limb_t       modulus[RSA_MAX_LIMBS];
+  limb_t       s[RSA_MAX_LIMBS];
+  limb_t       m[RSA_MAX_LIMBS];
+  _fromBytes(modulus, k, n, n_len);
+  _fromBytes(s, k, sig, sig_len);
+  if (_compare(s, modulus, k) >= 0) {
+    return 0;
+  }
+  _modExp(m, s, e, e_len, modulus, k);
+  unsigned char em[RSA_MAX_BITS / 8];
+  _toBytes(em, n_len, m);
+  return memcmp(em, expected, n_len) == 0;
+}
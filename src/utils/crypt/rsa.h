@@ -0,0 +1,18 @@
+#ifndef OIDC_RSA_H
+#define OIDC_RSA_H
+
+#include <stddef.h>
+
+#define RSA_MIN_BITS 2048
+#define RSA_MAX_BITS 8192
+
+enum rsa_hash {
+  RSA_SHA256,
+  RSA_SHA512,
+};
+
+int rsa_verify(const unsigned char* n, size_t n_len, const unsigned char* e,
+               size_t e_len, enum rsa_hash hash, const unsigned char* msg,
+               size_t msg_len, const unsigned char* sig, size_t sig_len);
+
+#endif  // OIDC_RSA_H
@@ -0,0 +1,493 @@
+#include "sealedKey.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#ifdef USE_TPM2
+#include "utils/lazyLib.h"
+
+#include <tss2/tss2_esys.h>
+#include <tss2/tss2_mu.h>
+#endif
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#include <Security/Security.h>
+#endif
+#include <sodium.h>
+#include <string.h>
+
+/**
+ * The key of an encrypted file can additionally be sealed to the host, so
+ * that the file can be decrypted without the password and without the key
+ * derivation. On Linux the key is sealed by the TPM2: it is stored in a sealed
+ * data object below a primary key of the owner hierarchy, which is derived
+ * again from the same template whenever it is needed, and the sealed blob is
+ * the public and private part of that object. libtss2-esys is loaded at
+ * runtime. On macOS the key is encrypted with a key of the Secure Enclave
+ * that is created once per user. A sealed blob starts with a byte naming the
+ * backend; it can only be unsealed on the host that sealed it.
+ */
+
+static void _setSealError(const char* what, unsigned long rc) {
+  char* err = oidc_sprintf("%s failed (0x%lx)", what, rc);
+  oidc_seterror(err);
+  secFree(err);
+  oidc_errno = OIDC_EERROR;
+}
+
+#ifdef USE_TPM2
+static TSS2_RC (*esys_Initialize)(ESYS_CONTEXT**, TSS2_TCTI_CONTEXT*,
+                                  TSS2_ABI_VERSION*);
+static void (*esys_Finalize)(ESYS_CONTEXT**);
+static TSS2_RC (*esys_CreatePrimary)(
+    ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR, ESYS_TR,
+    const TPM2B_SENSITIVE_CREATE*, const TPM2B_PUBLIC*, const TPM2B_DATA*,
+    const TPML_PCR_SELECTION*, ESYS_TR*, TPM2B_PUBLIC**, TPM2B_CREATION_DATA**,
+    TPM2B_DIGEST**, TPMT_TK_CREATION**);
+static TSS2_RC (*esys_StartAuthSession)(ESYS_CONTEXT*, ESYS_TR, ESYS_TR,
+                                        ESYS_TR, ESYS_TR, ESYS_TR,
+                                        const TPM2B_NONCE*, TPM2_SE,
+                                        const TPMT_SYM_DEF*, TPMI_ALG_HASH,
+                                        ESYS_TR*);
+static TSS2_RC (*esys_TRSess_SetAttributes)(ESYS_CONTEXT*, ESYS_TR,
+                                            TPMA_SESSION, TPMA_SESSION);
+static TSS2_RC (*esys_Create)(ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR,
+                              ESYS_TR, const TPM2B_SENSITIVE_CREATE*,
+                              const TPM2B_PUBLIC*, const TPM2B_DATA*,
+                              const TPML_PCR_SELECTION*, TPM2B_PRIVATE**,
+                              TPM2B_PUBLIC**, TPM2B_CREATION_DATA**,
+                              TPM2B_DIGEST**, TPMT_TK_CREATION**);
+static TSS2_RC (*esys_Load)(ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR, ESYS_TR,
+                            const TPM2B_PRIVATE*, const TPM2B_PUBLIC*,
+                            ESYS_TR*);
+static TSS2_RC (*esys_Unseal)(ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR,
+                              ESYS_TR, TPM2B_SENSITIVE_DATA**);
+static TSS2_RC (*esys_FlushContext)(ESYS_CONTEXT*, ESYS_TR);
+static void (*esys_Free)(void*);
+static TSS2_RC (*mu_PublicMarshal)(const TPM2B_PUBLIC*, uint8_t[], size_t,
+                                   size_t*);
+static TSS2_RC (*mu_PublicUnmarshal)(const uint8_t[], size_t, size_t*,
+                                     TPM2B_PUBLIC*);
+static TSS2_RC (*mu_PrivateMarshal)(const TPM2B_PRIVATE*, uint8_t[], size_t,
+                                    size_t*);
+static TSS2_RC (*mu_PrivateUnmarshal)(const uint8_t[], size_t, size_t*,
+                                      TPM2B_PRIVATE*);
+
+static oidc_error_t _loadTss2() {
+  static const char* const esys_sonames[] = {"libtss2-esys.so.0",
+                                             "libtss2-esys.so", NULL};
+  static const char* const mu_sonames[]   = {"libtss2-mu.so.0",
+                                             "libtss2-mu.so", NULL};
+  const struct lazySymbol  esys_symbols[] = {
+      {"Esys_Initialize", (void**)&esys_Initialize},
+      {"Esys_Finalize", (void**)&esys_Finalize},
+      {"Esys_CreatePrimary", (void**)&esys_CreatePrimary},
+      {"Esys_StartAuthSession", (void**)&esys_StartAuthSession},
+      {"Esys_TRSess_SetAttributes", (void**)&esys_TRSess_SetAttributes},
+      {"Esys_Create", (void**)&esys_Create},
+      {"Esys_Load", (void**)&esys_Load},
+      {"Esys_Unseal", (void**)&esys_Unseal},
+      {"Esys_FlushContext", (void**)&esys_FlushContext},
+      {"Esys_Free", (void**)&esys_Free},
+      {NULL, NULL}};
+  const struct lazySymbol mu_symbols[] = {
+      {"Tss2_MU_TPM2B_PUBLIC_Marshal", (void**)&mu_PublicMarshal},
+      {"Tss2_MU_TPM2B_PUBLIC_Unmarshal", (void**)&mu_PublicUnmarshal},
+      {"Tss2_MU_TPM2B_PRIVATE_Marshal", (void**)&mu_PrivateMarshal},
+      {"Tss2_MU_TPM2B_PRIVATE_Unmarshal", (void**)&mu_PrivateUnmarshal},
+      {NULL, NULL}};
+  if (lazyLib_load("libtss2-esys", esys_sonames, esys_symbols) !=
+      OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  return lazyLib_load("libtss2-mu", mu_sonames, mu_symbols);
+}
+
+/**
+ * The template of the primary key; the TPM derives the same key from it every
+ * time, so it does not have to be persisted
+ */
+static const TPM2B_PUBLIC primaryTemplate = {
+    .publicArea = {
+        .type             = TPM2_ALG_ECC,
+        .nameAlg          = TPM2_ALG_SHA256,
+        .objectAttributes = TPMA_OBJECT_RESTRICTED | TPMA_OBJECT_DECRYPT |
+                            TPMA_OBJECT_FIXEDTPM | TPMA_OBJECT_FIXEDPARENT |
+                            TPMA_OBJECT_SENSITIVEDATAORIGIN |
+                            TPMA_OBJECT_USERWITHAUTH | TPMA_OBJECT_NODA,
+        .parameters.eccDetail = {
+            .symmetric = {.algorithm   = TPM2_ALG_AES,
+                          .keyBits.aes = 128,
+                          .mode.aes    = TPM2_ALG_CFB},
+            .scheme    = {.scheme = TPM2_ALG_NULL},
+            .curveID   = TPM2_ECC_NIST_P256,
+            .kdf       = {.scheme = TPM2_ALG_NULL}}}};
+
+static const TPM2B_PUBLIC sealTemplate = {
+    .publicArea = {.type             = TPM2_ALG_KEYEDHASH,
+                   .nameAlg          = TPM2_ALG_SHA256,
+                   .objectAttributes = TPMA_OBJECT_FIXEDTPM |
+                                       TPMA_OBJECT_FIXEDPARENT |
+                                       TPMA_OBJECT_USERWITHAUTH |
+                                       TPMA_OBJECT_NODA,
+                   .parameters.keyedHashDetail.scheme.scheme =
+                       TPM2_ALG_NULL}};
+
+static const TPMT_SYM_DEF sessionSymmetric = {
+    .algorithm = TPM2_ALG_AES, .keyBits.aes = 128, .mode.aes = TPM2_ALG_CFB};
+
+struct tpm {
+  ESYS_CONTEXT* ctx;
+  ESYS_TR       primary;
+  ESYS_TR       session;
+};
+
+static void _tpmClose(struct tpm* tpm) {
+  if (tpm->session != ESYS_TR_NONE) {
+    esys_FlushContext(tpm->ctx, tpm->session);
+  }
+  if (tpm->primary != ESYS_TR_NONE) {
+    esys_FlushContext(tpm->ctx, tpm->primary);
+  }
+  if (tpm->ctx) {
+    esys_Finalize(&tpm->ctx);
+  }
+}
+
+/**
+ * @brief connects to the TPM, creates the primary key and starts a session
+ * salted with it, which encrypts the key on its way to and from the TPM
+ */
+static oidc_error_t _tpmOpen(struct tpm* tpm) {
+  *tpm = (struct tpm){NULL, ESYS_TR_NONE, ESYS_TR_NONE};
+  if (_loadTss2() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  TSS2_RC rc = esys_Initialize(&tpm->ctx, NULL, NULL);
+  if (rc != TSS2_RC_SUCCESS) {
+    tpm->ctx = NULL;
+    _setSealError("Connecting to the TPM", rc);
+    return oidc_errno;
+  }
+  const TPM2B_SENSITIVE_CREATE noSensitive = {0};
+  const TPM2B_DATA             noInfo      = {0};
+  const TPML_PCR_SELECTION     noPCR       = {0};
+  rc = esys_CreatePrimary(tpm->ctx, ESYS_TR_RH_OWNER, ESYS_TR_PASSWORD,
+                          ESYS_TR_NONE, ESYS_TR_NONE, &noSensitive,
+                          &primaryTemplate, &noInfo, &noPCR, &tpm->primary,
+                          NULL, NULL, NULL, NULL);
+  if (rc != TSS2_RC_SUCCESS) {
+    tpm->primary = ESYS_TR_NONE;
+    _setSealError("Creating the TPM primary key", rc);
+    _tpmClose(tpm);
+    return oidc_errno;
+  }
+  rc = esys_StartAuthSession(tpm->ctx, tpm->primary, ESYS_TR_NONE,
+                             ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, NULL,
+                             TPM2_SE_HMAC, &sessionSymmetric, TPM2_ALG_SHA256,
+                             &tpm->session);
+  if (rc == TSS2_RC_SUCCESS) {
+    rc = esys_TRSess_SetAttributes(
+        tpm->ctx, tpm->session,
+        TPMA_SESSION_DECRYPT | TPMA_SESSION_ENCRYPT |
+            TPMA_SESSION_CONTINUESESSION,
+        0xff);
+  } else {
+    tpm->session = ESYS_TR_NONE;
+  }
+  if (rc != TSS2_RC_SUCCESS) {
+    _setSealError("Starting a TPM session", rc);
+    _tpmClose(tpm);
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+static unsigned char* _tpmSeal(const unsigned char* key, size_t key_len,
+                               size_t* sealed_len) {
+  if (key_len > sizeof(((TPM2B_SENSITIVE_CREATE*)0)->sensitive.data.buffer)) {
+    oidc_setInternalError("key too long for sealing");
+    return NULL;
+  }
+  struct tpm tpm;
+  if (_tpmOpen(&tpm) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  TPM2B_SENSITIVE_CREATE sensitive = {0};
+  sensitive.sensitive.data.size    = key_len;
+  memcpy(sensitive.sensitive.data.buffer, key, key_len);
+  const TPM2B_DATA         noInfo     = {0};
+  const TPML_PCR_SELECTION noPCR      = {0};
+  TPM2B_PRIVATE*           outPrivate = NULL;
+  TPM2B_PUBLIC*            outPublic  = NULL;
+  TSS2_RC rc = esys_Create(tpm.ctx, tpm.primary, tpm.session, ESYS_TR_NONE,
+                           ESYS_TR_NONE, &sensitive, &sealTemplate, &noInfo,
+                           &noPCR, &outPrivate, &outPublic, NULL, NULL, NULL);
+  sodium_memzero(&sensitive, sizeof(sensitive));
+  _tpmClose(&tpm);
+  if (rc != TSS2_RC_SUCCESS) {
+    _setSealError("Sealing the key with the TPM", rc);
+    return NULL;
+  }
+  size_t         max    = 1 + sizeof(TPM2B_PUBLIC) + sizeof(TPM2B_PRIVATE);
+  unsigned char* sealed = secAlloc(max);
+  size_t         offset = 1;
+  sealed[0]             = SEALED_KEY_BACKEND_TPM2;
+  rc = mu_PublicMarshal(outPublic, sealed, max, &offset);
+  if (rc == TSS2_RC_SUCCESS) {
+    rc = mu_PrivateMarshal(outPrivate, sealed, max, &offset);
+  }
+  esys_Free(outPublic);
+  esys_Free(outPrivate);
+  if (rc != TSS2_RC_SUCCESS) {
+    secFree(sealed);
+    _setSealError("Encoding the sealed key", rc);
+    return NULL;
+  }
+  *sealed_len = offset;
+  return sealed;
+}
+
+static oidc_error_t _tpmUnseal(const unsigned char* sealed, size_t sealed_len,
+                               unsigned char* key, size_t key_len) {
+  TPM2B_PUBLIC  inPublic  = {0};
+  TPM2B_PRIVATE inPrivate = {0};
+  size_t        offset    = 1;
+  if (mu_PublicUnmarshal == NULL && _loadTss2() != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  if (mu_PublicUnmarshal(sealed, sealed_len, &offset, &inPublic) !=
+          TSS2_RC_SUCCESS ||
+      mu_PrivateUnmarshal(sealed, sealed_len, &offset, &inPrivate) !=
+          TSS2_RC_SUCCESS) {
+    oidc_errno = OIDC_ECRYPM;
+    return oidc_errno;
+  }
+  struct tpm tpm;
+  if (_tpmOpen(&tpm) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  ESYS_TR object = ESYS_TR_NONE;
+  TSS2_RC rc     = esys_Load(tpm.ctx, tpm.primary, ESYS_TR_PASSWORD,
+                             ESYS_TR_NONE, ESYS_TR_NONE, &inPrivate, &inPublic,
+                             &object);
+  if (rc != TSS2_RC_SUCCESS) {
+    _tpmClose(&tpm);
+    // e.g. the blob was sealed by another TPM or the owner hierarchy changed
+    logger(NOTICE, "Could not load the sealed key into the TPM: 0x%lx",
+           (unsigned long)rc);
+    oidc_errno = OIDC_ENOSEAL;
+    return oidc_errno;
+  }
+  TPM2B_SENSITIVE_DATA* data = NULL;
+  rc = esys_Unseal(tpm.ctx, object, tpm.session, ESYS_TR_NONE, ESYS_TR_NONE,
+                   &data);
+  esys_FlushContext(tpm.ctx, object);
+  _tpmClose(&tpm);
+  if (rc != TSS2_RC_SUCCESS) {
+    _setSealError("Unsealing the key with the TPM", rc);
+    return oidc_errno;
+  }
+  oidc_error_t ret = OIDC_SUCCESS;
+  if (data->size == key_len) {
+    memcpy(key, data->buffer, key_len);
+  } else {
+    ret = oidc_errno = OIDC_ECRYPM;
+  }
+  sodium_memzero(data, sizeof(*data));
+  esys_Free(data);
+  return ret;
+}
+#endif  // USE_TPM2
+
+#ifdef __APPLE__
+#define ENCLAVE_KEY_TAG "edu.kit.oidc-agent.sealing"
+#define ENCLAVE_ALGORITHM \
+  kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM
+
+static void _setCFError(const char* what, CFErrorRef error) {
+  _setSealError(what, error ? (unsigned long)CFErrorGetCode(error) : 0);
+  if (error) {
+    CFRelease(error);
+  }
+}
+
+/**
+ * @brief returns the Secure Enclave key of the user
+ * @param create if the key does not exist yet, it is created
+ * @return the private key or @c NULL; has to be released after usage
+ */
+static SecKeyRef _copyEnclaveKey(int create) {
+  CFDataRef tag = CFDataCreate(NULL, (const UInt8*)ENCLAVE_KEY_TAG,
+                               strlen(ENCLAVE_KEY_TAG));
+  const void* query_keys[]   = {kSecClass, kSecAttrApplicationTag,
+                                kSecAttrKeyType, kSecReturnRef};
+  const void* query_values[] = {kSecClassKey, tag,
+                                kSecAttrKeyTypeECSECPrimeRandom,
+                                kCFBooleanTrue};
+  CFDictionaryRef query      = CFDictionaryCreate(
+      NULL, query_keys, query_values, 4, &kCFTypeDictionaryKeyCallBacks,
+      &kCFTypeDictionaryValueCallBacks);
+  SecKeyRef key    = NULL;
+  OSStatus  status = SecItemCopyMatching(query, (CFTypeRef*)&key);
+  CFRelease(query);
+  if (status == errSecSuccess || !create) {
+    CFRelease(tag);
+    if (status != errSecSuccess) {
+      oidc_errno = OIDC_ENOSEAL;
+      return NULL;
+    }
+    return key;
+  }
+  CFErrorRef          error  = NULL;
+  SecAccessControlRef access = SecAccessControlCreateWithFlags(
+      NULL, kSecAttrAccessibleWhenUnlockedThisDeviceOnly,
+      kSecAccessControlPrivateKeyUsage, &error);
+  if (access == NULL) {
+    CFRelease(tag);
+    _setCFError("Creating the Secure Enclave access control", error);
+    return NULL;
+  }
+  int             bits          = 256;
+  CFNumberRef     size          = CFNumberCreate(NULL, kCFNumberIntType, &bits);
+  const void*     priv_keys[]   = {kSecAttrIsPermanent, kSecAttrApplicationTag,
+                                   kSecAttrAccessControl};
+  const void*     priv_values[] = {kCFBooleanTrue, tag, access};
+  CFDictionaryRef priv          = CFDictionaryCreate(
+      NULL, priv_keys, priv_values, 3, &kCFTypeDictionaryKeyCallBacks,
+      &kCFTypeDictionaryValueCallBacks);
+  const void*     attr_keys[]   = {kSecAttrKeyType, kSecAttrKeySizeInBits,
+                                   kSecAttrTokenID, kSecPrivateKeyAttrs};
+  const void*     attr_values[] = {kSecAttrKeyTypeECSECPrimeRandom, size,
+                                   kSecAttrTokenIDSecureEnclave, priv};
+  CFDictionaryRef attrs         = CFDictionaryCreate(
+      NULL, attr_keys, attr_values, 4, &kCFTypeDictionaryKeyCallBacks,
+      &kCFTypeDictionaryValueCallBacks);
+  key = SecKeyCreateRandomKey(attrs, &error);
+  CFRelease(attrs);
+  CFRelease(priv);
+  CFRelease(size);
+  CFRelease(access);
+  CFRelease(tag);
+  if (key == NULL) {
+    _setCFError("Creating the Secure Enclave key", error);
+  }
+  return key;
+}
+
+static unsigned char* _enclaveSeal(const unsigned char* key, size_t key_len,
+                                   size_t* sealed_len) {
+  SecKeyRef priv = _copyEnclaveKey(1);
+  if (priv == NULL) {
+    return NULL;
+  }
+  SecKeyRef pub = SecKeyCopyPublicKey(priv);
+  CFRelease(priv);
+  if (pub == NULL) {
+    _setSealError("Getting the Secure Enclave public key", 0);
+    return NULL;
+  }
+  CFDataRef plain = CFDataCreateWithBytesNoCopy(NULL, key, key_len,
+                                                kCFAllocatorNull);
+  CFErrorRef error = NULL;
+  CFDataRef  enc =
+      SecKeyCreateEncryptedData(pub, ENCLAVE_ALGORITHM, plain, &error);
+  CFRelease(plain);
+  CFRelease(pub);
+  if (enc == NULL) {
+    _setCFError("Sealing the key with the Secure Enclave", error);
+    return NULL;
+  }
+  size_t         len    = CFDataGetLength(enc);
+  unsigned char* sealed = secAlloc(len + 1);
+  sealed[0]             = SEALED_KEY_BACKEND_SECURE_ENCLAVE;
+  memcpy(sealed + 1, CFDataGetBytePtr(enc), len);
+  CFRelease(enc);
+  *sealed_len = len + 1;
+  return sealed;
+}
+
+static oidc_error_t _enclaveUnseal(const unsigned char* sealed,
+                                   size_t sealed_len, unsigned char* key,
+                                   size_t key_len) {
+  SecKeyRef priv = _copyEnclaveKey(0);
+  if (priv == NULL) {
+    return oidc_errno;
+  }
+  CFDataRef  enc   = CFDataCreate(NULL, sealed + 1, sealed_len - 1);
+  CFErrorRef error = NULL;
+  CFDataRef  plain =
+      SecKeyCreateDecryptedData(priv, ENCLAVE_ALGORITHM, enc, &error);
+  CFRelease(enc);
+  CFRelease(priv);
+  if (plain == NULL) {
+    _setCFError("Unsealing the key with the Secure Enclave", error);
+    return oidc_errno;
+  }
+  oidc_error_t ret = OIDC_SUCCESS;
+  if ((size_t)CFDataGetLength(plain) == key_len) {
+    memcpy(key, CFDataGetBytePtr(plain), key_len);
+  } else {
+    ret = oidc_errno = OIDC_ECRYPM;
+  }
+  sodium_memzero((void*)CFDataGetBytePtr(plain), CFDataGetLength(plain));
+  CFRelease(plain);
+  return ret;
+}
+#endif  // __APPLE__
+
+/**
+ * @brief seals @p key to this host
+ * @param sealed_len set to the length of the returned blob
+ * @return the sealed blob or @c NULL if the host cannot seal keys; has to be
+ * freed after usage
+ */
+unsigned char* sealedKey_seal(const unsigned char* key, size_t key_len,
+                              size_t* sealed_len) {
+  if (key == NULL || sealed_len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+#if defined(USE_TPM2)
+  return _tpmSeal(key, key_len, sealed_len);
+#elif defined(__APPLE__)
+  return _enclaveSeal(key, key_len, sealed_len);
+#else
+  (void)key_len;
+  oidc_seterror("Sealing keys needs a TPM2 or the Secure Enclave, but this "
+                "build supports neither");
+  oidc_errno = OIDC_EERROR;
+  return NULL;
+#endif
+}
+
+/**
+ * @brief unseals a key sealed with @c sealedKey_seal
+ * @param key filled with the key
+ * @param key_len the expected length of the key
+ * @return @c OIDC_SUCCESS or an error code; @c OIDC_ENOSEAL if the blob was
+ * not sealed by this host or this build
+ */
+oidc_error_t sealedKey_unseal(const unsigned char* sealed, size_t sealed_len,
+                              unsigned char* key,
+                              size_t key_len __attribute__((unused))) {
+  if (sealed == NULL || key == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (sealed_len < 2) {
+    oidc_errno = OIDC_ECRYPM;
+    return oidc_errno;
+  }
+  switch (sealed[0]) {
+#ifdef USE_TPM2
+    case SEALED_KEY_BACKEND_TPM2:
+      return _tpmUnseal(sealed, sealed_len, key, key_len);
+#endif
+#ifdef __APPLE__
+    case SEALED_KEY_BACKEND_SECURE_ENCLAVE:
+      return _enclaveUnseal(sealed, sealed_len, key, key_len);
+#endif
+    default: oidc_errno = OIDC_ENOSEAL; return oidc_errno;
+  }
+}
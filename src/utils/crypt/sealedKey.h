@@ -0,0 +1,16 @@
+#ifndef OIDC_SEALED_KEY_H
+#define OIDC_SEALED_KEY_H
+
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
+
+#define SEALED_KEY_BACKEND_TPM2 1
+#define SEALED_KEY_BACKEND_SECURE_ENCLAVE 2
+
+unsigned char* sealedKey_seal(const unsigned char* key, size_t key_len,
+                              size_t* sealed_len);
+oidc_error_t   sealedKey_unseal(const unsigned char* sealed, size_t sealed_len,
+                                unsigned char* key, size_t key_len);
+
+#endif  // OIDC_SEALED_KEY_H
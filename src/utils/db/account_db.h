@@ -3,6 +3,9 @@
 
 #include "db.h"
 
+#define ACCOUNTDB_INDEX_SHORTNAME 0
+#define ACCOUNTDB_INDEX_ISSUERURL 1
+
 #define accountDB_new() \
   do { db_newDB(OIDC_DB_ACCOUNTS); } while (0)
 
@@ -27,13 +30,30 @@
 #define accountDB_findValueWithFunction(key, function) \
   db_findValueWithFunction(OIDC_DB_ACCOUNTS, (key), (function))
 
+#define accountDB_addIndex(index, getKey, matchKey) \
+  db_addIndex(OIDC_DB_ACCOUNTS, (index), (getKey), (matchKey))
+
+#define accountDB_findValueByIndex(index, key) \
+  db_findValueByIndex(OIDC_DB_ACCOUNTS, (index), (key))
+
+#define accountDB_findAllValuesByIndex(index, key) \
+  db_findAllValuesByIndex(OIDC_DB_ACCOUNTS, (index), (key))
+
 #define accountDB_getMinDeath(getter) db_getMinDeath(OIDC_DB_ACCOUNTS, (getter))
 
 #define accountDB_getDeathEntry(getter) \
   db_getDeathEntry(OIDC_DB_ACCOUNTS, (getter))
 
+#define accountDB_setDeathFunction(getter) \
+  db_setDeathFunction(OIDC_DB_ACCOUNTS, (getter))
+
+#define accountDB_updateDeath(value) \
+  do { db_updateDeath(OIDC_DB_ACCOUNTS, (value)); } while (0)
+
 #define accountDB_getSize() db_getSize(OIDC_DB_ACCOUNTS)
 
+#define accountDB_getGeneration() db_getGeneration(OIDC_DB_ACCOUNTS)
+
 #define accountDB_reset() \
   do { db_reset(OIDC_DB_ACCOUNTS); } while (0)
 
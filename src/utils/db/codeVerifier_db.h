@@ -3,6 +3,8 @@
 
 #include "db.h"
 
+#define CODEVERIFIERDB_INDEX_STATE 0
+
 #define codeVerifierDB_new() \
   do { db_newDB(OIDC_DB_CODEVERIFIERS); } while (0)
 
@@ -28,12 +30,21 @@
 #define codeVerifierDB_findValueWithFunction(key, function) \
   db_findValueWithFunction(OIDC_DB_CODEVERIFIERS, (key), (function))
 
+#define codeVerifierDB_addIndex(index, getKey, matchKey) \
+  db_addIndex(OIDC_DB_CODEVERIFIERS, (index), (getKey), (matchKey))
+
+#define codeVerifierDB_findValueByIndex(index, key) \
+  db_findValueByIndex(OIDC_DB_CODEVERIFIERS, (index), (key))
+
 #define codeVerifierDB_getMinDeath(getter) \
   db_getMinDeath(OIDC_DB_CODEVERIFIERS, (getter))
 
 #define codeVerifierDB_getDeathEntry(getter) \
   db_getDeathEntry(OIDC_DB_CODEVERIFIERS, (getter))
 
+#define codeVerifierDB_setDeathFunction(getter) \
+  db_setDeathFunction(OIDC_DB_CODEVERIFIERS, (getter))
+
 #define codeVerifierDB_getSize() db_getSize(OIDC_DB_CODEVERIFIERS)
 
 #define codeVerifierDB_reset() \
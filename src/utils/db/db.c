@@ -2,57 +2,88 @@
 #include "utils/deathUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
-#include "wrapper/list.h"
-
-static list_t* dbs = NULL;
+#include "utils/oidc_error.h"
 
 struct oidc_db {
-  db_name db;
-  list_t* list;
+  db_name              db;
+  vector_t*            values;
+  struct db_index*     indexes[DB_MAX_INDEXES];
+  struct db_deathHeap* deaths;
+  unsigned long        generation;  // changed when values are added or removed
 };
 
-int matchDBs(const struct oidc_db* a, const struct oidc_db* b) {
-  return a->db == b->db;
-}
+static struct oidc_db* dbs[OIDC_DB_MAX + 1] = {NULL};
 
-void db_init() {
-  if (dbs != NULL) {
-    return;
-  }
-  dbs        = list_new();
-  dbs->match = (matchFunction)matchDBs;
-}
-
-list_node_t* _getDBNode(const db_name db) {
-  if (dbs == NULL) {
+static struct oidc_db* _getDB(const db_name db) {
+  if (db > OIDC_DB_MAX) {
     return NULL;
   }
-  struct oidc_db key = {.db = db};
-  return findInList(dbs, &key);
+  return dbs[db];
 }
 
-list_t* db_getDB(const db_name db) {
-  list_node_t* found = _getDBNode(db);
+vector_t* db_getDB(const db_name db) {
+  struct oidc_db* found = _getDB(db);
   if (found == NULL) {
     return NULL;
   }
-  return ((struct oidc_db*)found->val)->list;
+  return found->values;
 }
 
 void db_newDB(const db_name db) {
-  db_init();
-  if (db_getDB(db) != NULL) {
+  if (db > OIDC_DB_MAX || dbs[db] != NULL) {
     return;
   }
   struct oidc_db* db_e = secAlloc(sizeof(struct oidc_db));
   db_e->db             = db;
-  db_e->list           = list_new();
-  list_rpush(dbs, list_node_new(db_e));
+  db_e->values         = vector_new();
+  dbs[db]              = db_e;
+}
+
+/**
+ * @brief adds a hash index to a db
+ * Values that are already in the db are indexed as well. Lookups through the
+ * index are done with @c db_findValueByIndex and @c db_findAllValuesByIndex.
+ * @param index the id of the index; has to be smaller than @c DB_MAX_INDEXES
+ * @param getKey a function returning the key of a value
+ * @param matchKey a function comparing two keys
+ */
+void db_addIndex(const db_name db, db_index_id index, indexKeyFunction getKey,
+                 indexMatchFunction matchKey) {
+  if (index >= DB_MAX_INDEXES) {
+    return;
+  }
+  db_newDB(db);
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL) {
+    return;
+  }
+  dbIndex_free(db_s->indexes[index]);
+  db_s->indexes[index] = dbIndex_new(getKey, matchKey);
+  for (size_t i = 0; i < db_s->values->len; i++) {
+    dbIndex_add(db_s->indexes[index], vector_at(db_s->values, i));
+  }
+}
+
+static struct db_index* _getIndex(const db_name db, db_index_id index) {
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL || index >= DB_MAX_INDEXES) {
+    return NULL;
+  }
+  return db_s->indexes[index];
+}
+
+void* db_findValueByIndex(const db_name db, db_index_id index,
+                          const char* key) {
+  return dbIndex_find(_getIndex(db, index), key);
+}
+
+list_t* db_findAllValuesByIndex(const db_name db, db_index_id index,
+                                const char* key) {
+  return dbIndex_findAll(_getIndex(db, index), key);
 }
 
 matchFunction db_setMatchFunction(const db_name db, matchFunction match) {
-  db_init();
-  list_t* db_list = db_getDB(db);
+  vector_t* db_list = db_getDB(db);
   if (db_list == NULL) {
     db_newDB(db);
     return db_setMatchFunction(db, match);
@@ -63,8 +94,7 @@ matchFunction db_setMatchFunction(const db_name db, matchFunction match) {
 }
 
 freeFunction db_setFreeFunction(const db_name db, void (*free_fn)(void*)) {
-  db_init();
-  list_t* db_list = db_getDB(db);
+  vector_t* db_list = db_getDB(db);
   if (db_list == NULL) {
     db_newDB(db);
     return db_setFreeFunction(db, free_fn);
@@ -75,27 +105,81 @@ freeFunction db_setFreeFunction(const db_name db, void (*free_fn)(void*)) {
 }
 
 void db_removeIfFound(const db_name db, void* value) {
-  list_removeIfFound(db_getDB(db), value);
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL || value == NULL) {
+    return;
+  }
+  size_t index = vector_indexOf(db_s->values, value);
+  if (index == db_s->values->len) {
+    return;
+  }
+  void* found = vector_at(db_s->values, index);
+  for (db_index_id i = 0; i < DB_MAX_INDEXES; i++) {
+    dbIndex_remove(db_s->indexes[i], found);
+  }
+  deathHeap_remove(db_s->deaths, found);
+  vector_removeAt(db_s->values, index);
+  db_s->generation++;
 }
 
 void db_addValue(const db_name db, void* value) {
-  list_rpush(db_getDB(db), list_node_new(value));
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL) {
+    return;
+  }
+  if (vector_push(db_s->values, value) != OIDC_SUCCESS) {
+    logger(ERROR, "Could not add value to db %hhu: %s", db, oidc_serror());
+    return;
+  }
+  db_s->generation++;
+  for (db_index_id i = 0; i < DB_MAX_INDEXES; i++) {
+    dbIndex_add(db_s->indexes[i], value);
+  }
+  deathHeap_add(db_s->deaths, value);
   logger(DEBUG, "Added value to db %hhu. Now there are %lu entries.", db,
          db_getSize(db));
 }
 
+/**
+ * @brief returns a number that changes whenever values are added to or removed
+ * from the db, so that data derived from the values can be cached
+ */
+unsigned long db_getGeneration(const db_name db) {
+  struct oidc_db* db_s = _getDB(db);
+  return db_s ? db_s->generation : 0;
+}
+
 size_t db_getSize(const db_name db) {
-  list_t* dbl = db_getDB(db);
-  return dbl ? dbl->len : 0;
+  vector_t* values = db_getDB(db);
+  return values ? values->len : 0;
 }
 
 void* db_findValue(const db_name db, void* key) {
-  list_node_t* node = findInList(db_getDB(db), key);
-  return node ? node->val : NULL;
+  return vector_find(db_getDB(db), key);
 }
 
+/**
+ * @brief returns a list of all values matching @p key
+ * @return the list or @c NULL if no value matches; the values are still owned
+ * by the db
+ */
 list_t* db_findAllValues(const db_name db, void* key) {
-  return findAllInList(db_getDB(db), key);
+  vector_t* values = db_getDB(db);
+  if (values == NULL || key == NULL) {
+    return NULL;
+  }
+  list_t* founds = NULL;
+  for (size_t i = 0; i < values->len; i++) {
+    void* value = vector_at(values, i);
+    if (values->match ? values->match(key, value) : key == value) {
+      if (founds == NULL) {
+        founds        = list_new();
+        founds->match = values->match;
+      }
+      list_rpush(founds, list_node_new(value));
+    }
+  }
+  return founds;
 }
 
 void* db_findValueWithFunction(const db_name db, void* key,
@@ -107,24 +191,72 @@ void* db_findValueWithFunction(const db_name db, void* key,
 }
 
 void db_reset(const db_name db) {
-  list_node_t* node = _getDBNode(db);
-  if (node == NULL) {
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL) {
     return;
   }
-  struct oidc_db* db_s   = node->val;
-  list_t*         list   = db_s->list;
-  matchFunction   match  = list->match;
-  void (*free_fn)(void*) = list->free;
-  secFreeList(list);
-  db_s->list        = list_new();
-  db_s->list->match = match;
-  db_s->list->free  = free_fn;
+  for (db_index_id i = 0; i < DB_MAX_INDEXES; i++) {
+    dbIndex_clear(db_s->indexes[i]);
+  }
+  deathHeap_clear(db_s->deaths);
+  vector_clear(db_s->values);
+  db_s->generation++;
+}
+
+/**
+ * @brief keeps the values of a db in a heap ordered by their time of death
+ * Afterwards @c db_getMinDeath and @c db_getDeathEntry with the same
+ * @p deathGetter do not have to iterate over all values.
+ */
+void db_setDeathFunction(const db_name db, deathFunction deathGetter) {
+  db_newDB(db);
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL) {
+    return;
+  }
+  if (db_s->deaths && db_s->deaths->getDeath == deathGetter) {
+    return;
+  }
+  deathHeap_free(db_s->deaths);
+  db_s->deaths = deathHeap_new(deathGetter);
+  for (size_t i = 0; i < db_s->values->len; i++) {
+    deathHeap_add(db_s->deaths, vector_at(db_s->values, i));
+  }
+}
+
+/**
+ * @brief has to be called if the time of death of a value in the db changed
+ */
+void db_updateDeath(const db_name db, void* value) {
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL) {
+    return;
+  }
+  deathHeap_update(db_s->deaths, value);
+}
+
+static struct db_deathHeap* _getDeathHeap(const db_name db,
+                                          time_t (*deathGetter)(void*)) {
+  struct oidc_db* db_s = _getDB(db);
+  if (db_s == NULL || db_s->deaths == NULL ||
+      db_s->deaths->getDeath != deathGetter) {
+    return NULL;
+  }
+  return db_s->deaths;
 }
 
 time_t db_getMinDeath(const db_name db, time_t (*deathGetter)(void*)) {
+  struct db_deathHeap* heap = _getDeathHeap(db, deathGetter);
+  if (heap) {
+    return deathHeap_getMinDeath(heap);
+  }
   return getMinDeathFrom(db_getDB(db), deathGetter);
 }
 
 void* db_getDeathEntry(const db_name db, time_t (*deathGetter)(void*)) {
+  struct db_deathHeap* heap = _getDeathHeap(db, deathGetter);
+  if (heap) {
+    return deathHeap_getDeathEntry(heap, time(NULL));
+  }
   return getDeathElementFrom(db_getDB(db), deathGetter);
 }
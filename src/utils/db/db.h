@@ -1,7 +1,10 @@
 #ifndef OIDC_DB_H
 #define OIDC_DB_H
 
+#include "utils/db/db_deathHeap.h"
+#include "utils/db/db_index.h"
 #include "utils/listUtils.h"
+#include "utils/vector.h"
 
 #include <time.h>
 
@@ -11,19 +14,33 @@ typedef unsigned short db_name;
 #define OIDC_DB_PASSWORDS 3
 #define OIDC_DB_CODEVERIFIERS 4
 #define OIDC_DB_FILES 5
+#define OIDC_DB_ISSUERCONFIGS 6
+#define OIDC_DB_MAX OIDC_DB_ISSUERCONFIGS
+
+typedef unsigned char db_index_id;
+#define DB_MAX_INDEXES 2
 
 void          db_newDB(const db_name db);
-list_t*       db_getDB(const db_name db);
+vector_t*     db_getDB(const db_name db);
 matchFunction db_setMatchFunction(const db_name db, matchFunction);
 freeFunction  db_setFreeFunction(const db_name db, freeFunction);
 void          db_removeIfFound(const db_name db, void* value);
 void          db_addValue(const db_name db, void* value);
 size_t        db_getSize(const db_name db);
+unsigned long db_getGeneration(const db_name db);
 void*         db_findValue(const db_name db, void* key);
 list_t*       db_findAllValues(const db_name db, void* key);
 void*  db_findValueWithFunction(const db_name db, void* key, matchFunction);
 void   db_reset(const db_name db);
+void   db_addIndex(const db_name db, db_index_id index, indexKeyFunction,
+                   indexMatchFunction);
+void*  db_findValueByIndex(const db_name db, db_index_id index,
+                           const char* key);
+list_t* db_findAllValuesByIndex(const db_name db, db_index_id index,
+                                const char* key);
 time_t db_getMinDeath(const db_name db, time_t (*deathGetter)(void*));
 void*  db_getDeathEntry(const db_name db, time_t (*deathGetter)(void*));
+void   db_setDeathFunction(const db_name db, deathFunction);
+void   db_updateDeath(const db_name db, void* value);
 
 #endif  // OIDC_DB_H
@@ -0,0 +1,172 @@
+#include "db_deathHeap.h"
+#include "utils/memory.h"
+
+#include <string.h>
+
+#define DEATHHEAP_INITIAL_CAP 16
+
+static void _swap(struct db_deathHeap* heap, size_t a, size_t b) {
+  struct db_deathHeapEntry tmp = heap->entries[a];
+  heap->entries[a]             = heap->entries[b];
+  heap->entries[b]             = tmp;
+}
+
+static void _siftUp(struct db_deathHeap* heap, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap->entries[parent].death <= heap->entries[i].death) {
+      return;
+    }
+    _swap(heap, parent, i);
+    i = parent;
+  }
+}
+
+static void _siftDown(struct db_deathHeap* heap, size_t i) {
+  while (1) {
+    size_t left     = 2 * i + 1;
+    size_t right    = left + 1;
+    size_t smallest = i;
+    if (left < heap->len &&
+        heap->entries[left].death < heap->entries[smallest].death) {
+      smallest = left;
+    }
+    if (right < heap->len &&
+        heap->entries[right].death < heap->entries[smallest].death) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    _swap(heap, smallest, i);
+    i = smallest;
+  }
+}
+
+static void _push(struct db_deathHeap* heap, void* value, time_t death) {
+  if (heap->len == heap->cap) {
+    size_t                    newCap = heap->cap ? heap->cap * 2
+                                                 : DEATHHEAP_INITIAL_CAP;
+    struct db_deathHeapEntry* tmp =
+        secAlloc(sizeof(struct db_deathHeapEntry) * newCap);
+    if (heap->entries) {
+      memcpy(tmp, heap->entries, sizeof(struct db_deathHeapEntry) * heap->len);
+      secFree(heap->entries);
+    }
+    heap->entries = tmp;
+    heap->cap     = newCap;
+  }
+  heap->entries[heap->len] = (struct db_deathHeapEntry){value, death};
+  _siftUp(heap, heap->len);
+  heap->len++;
+}
+
+static void _removeAt(struct db_deathHeap* heap, size_t i) {
+  heap->len--;
+  if (i == heap->len) {
+    return;
+  }
+  heap->entries[i] = heap->entries[heap->len];
+  _siftDown(heap, i);
+  _siftUp(heap, i);
+}
+
+/**
+ * @brief drops or reinserts entries at the top of the heap whose time of
+ * death changed since they were added
+ */
+static void _validateTop(struct db_deathHeap* heap) {
+  while (heap->len > 0) {
+    struct db_deathHeapEntry top   = heap->entries[0];
+    time_t                   death = heap->getDeath(top.value);
+    if (death == top.death) {
+      return;
+    }
+    _removeAt(heap, 0);
+    if (death > 0) {
+      _push(heap, top.value, death);
+    }
+  }
+}
+
+struct db_deathHeap* deathHeap_new(deathFunction getDeath) {
+  struct db_deathHeap* heap = secAlloc(sizeof(struct db_deathHeap));
+  heap->getDeath            = getDeath;
+  return heap;
+}
+
+void deathHeap_free(struct db_deathHeap* heap) {
+  if (heap == NULL) {
+    return;
+  }
+  secFree(heap->entries);
+  secFree(heap);
+}
+
+void deathHeap_clear(struct db_deathHeap* heap) {
+  if (heap == NULL) {
+    return;
+  }
+  heap->len = 0;
+}
+
+void deathHeap_add(struct db_deathHeap* heap, void* value) {
+  if (heap == NULL || value == NULL) {
+    return;
+  }
+  time_t death = heap->getDeath(value);
+  if (death > 0) {
+    _push(heap, value, death);
+  }
+}
+
+/**
+ * @brief removes a value from the heap
+ * Removing the value with the next time of death (the common case when
+ * evicting dead values) is done in O(log n); other values have to be searched.
+ */
+void deathHeap_remove(struct db_deathHeap* heap, const void* value) {
+  if (heap == NULL || value == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < heap->len; i++) {
+    if (heap->entries[i].value == value) {
+      _removeAt(heap, i);
+      return;
+    }
+  }
+}
+
+void deathHeap_update(struct db_deathHeap* heap, void* value) {
+  deathHeap_remove(heap, value);
+  deathHeap_add(heap, value);
+}
+
+/**
+ * @brief returns the next time of death
+ * @return the minimum time of death; @c 0 if no value has a time of death. The
+ * returned time might be in the past, if dead values were not yet removed.
+ */
+time_t deathHeap_getMinDeath(struct db_deathHeap* heap) {
+  if (heap == NULL) {
+    return 0;
+  }
+  _validateTop(heap);
+  return heap->len ? heap->entries[0].death : 0;
+}
+
+/**
+ * @brief returns a value whose time of death is before or at @p now
+ * The value is not removed from the heap.
+ * @return a pointer to the dead value or @c NULL
+ */
+void* deathHeap_getDeathEntry(struct db_deathHeap* heap, time_t now) {
+  if (heap == NULL) {
+    return NULL;
+  }
+  _validateTop(heap);
+  if (heap->len && heap->entries[0].death <= now) {
+    return heap->entries[0].value;
+  }
+  return NULL;
+}
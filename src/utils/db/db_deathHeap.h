@@ -0,0 +1,37 @@
+#ifndef OIDC_DB_DEATHHEAP_H
+#define OIDC_DB_DEATHHEAP_H
+
+#include <stddef.h>
+#include <time.h>
+
+typedef time_t (*deathFunction)(void*);
+
+struct db_deathHeapEntry {
+  void*  value;
+  time_t death;
+};
+
+/**
+ * A binary min-heap of the values of a db ordered by their time of death.
+ * Values without a time of death (@c 0) are not added. The time of death is
+ * cached in the heap; if it changes while the value is in the heap,
+ * @c deathHeap_update should be called. A time of death that was reset to
+ * @c 0 or postponed is also detected lazily.
+ */
+struct db_deathHeap {
+  deathFunction             getDeath;
+  struct db_deathHeapEntry* entries;
+  size_t                    len;
+  size_t                    cap;
+};
+
+struct db_deathHeap* deathHeap_new(deathFunction getDeath);
+void                 deathHeap_free(struct db_deathHeap* heap);
+void                 deathHeap_clear(struct db_deathHeap* heap);
+void                 deathHeap_add(struct db_deathHeap* heap, void* value);
+void   deathHeap_remove(struct db_deathHeap* heap, const void* value);
+void   deathHeap_update(struct db_deathHeap* heap, void* value);
+time_t deathHeap_getMinDeath(struct db_deathHeap* heap);
+void*  deathHeap_getDeathEntry(struct db_deathHeap* heap, time_t now);
+
+#endif  // OIDC_DB_DEATHHEAP_H
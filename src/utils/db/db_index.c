@@ -0,0 +1,177 @@
+#include "db_index.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+
+#include <string.h>
+
+#define DB_INDEX_INITIAL_SIZE 16
+#define DB_INDEX_MAX_LOAD 2
+
+/**
+ * @brief FNV-1a hash of a key
+ * Trailing slashes are ignored, so that urls that only differ in a trailing
+ * slash end up in the same bucket; whether two keys actually match is decided
+ * by the match function of the index.
+ */
+static size_t _hashKey(const char* key) {
+  size_t len = strlen(key);
+  while (len > 0 && key[len - 1] == '/') {
+    len--;
+  }
+  unsigned long hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static list_t** _newBuckets(size_t size) {
+  list_t** buckets = secAlloc(sizeof(list_t*) * size);
+  for (size_t i = 0; i < size; i++) {
+    buckets[i] = list_new();  // values are not owned by the index
+  }
+  return buckets;
+}
+
+static void _freeBuckets(list_t** buckets, size_t size) {
+  if (buckets == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < size; i++) {
+    list_destroy(buckets[i]);
+  }
+  secFree(buckets);
+}
+
+static list_t* _bucketFor(const struct db_index* index, const char* key) {
+  return index->buckets[_hashKey(key) % index->size];
+}
+
+static void _grow(struct db_index* index) {
+  size_t   newSize    = index->size * 2;
+  list_t** newBuckets = _newBuckets(newSize);
+  for (size_t i = 0; i < index->size; i++) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(index->buckets[i], LIST_HEAD);
+    while ((node = list_iterator_next(it))) {
+      const char* key = index->getKey(node->val);
+      list_rpush(newBuckets[_hashKey(key) % newSize],
+                 list_node_new(node->val));
+    }
+    list_iterator_destroy(it);
+  }
+  _freeBuckets(index->buckets, index->size);
+  index->buckets = newBuckets;
+  index->size    = newSize;
+}
+
+struct db_index* dbIndex_new(indexKeyFunction   getKey,
+                             indexMatchFunction matchKey) {
+  struct db_index* index = secAlloc(sizeof(struct db_index));
+  index->getKey          = getKey;
+  index->matchKey        = matchKey;
+  index->size            = DB_INDEX_INITIAL_SIZE;
+  index->buckets         = _newBuckets(index->size);
+  index->len             = 0;
+  return index;
+}
+
+void dbIndex_free(struct db_index* index) {
+  if (index == NULL) {
+    return;
+  }
+  _freeBuckets(index->buckets, index->size);
+  secFree(index);
+}
+
+void dbIndex_clear(struct db_index* index) {
+  if (index == NULL) {
+    return;
+  }
+  _freeBuckets(index->buckets, index->size);
+  index->size    = DB_INDEX_INITIAL_SIZE;
+  index->buckets = _newBuckets(index->size);
+  index->len     = 0;
+}
+
+/**
+ * @brief adds a value to the index; values without key are not indexed
+ */
+void dbIndex_add(struct db_index* index, void* value) {
+  if (index == NULL || value == NULL) {
+    return;
+  }
+  const char* key = index->getKey(value);
+  if (key == NULL) {
+    return;
+  }
+  if (index->len >= index->size * DB_INDEX_MAX_LOAD) {
+    _grow(index);
+  }
+  list_rpush(_bucketFor(index, key), list_node_new(value));
+  index->len++;
+}
+
+void dbIndex_remove(struct db_index* index, const void* value) {
+  if (index == NULL || value == NULL) {
+    return;
+  }
+  const char* key = index->getKey(value);
+  if (key == NULL) {
+    return;
+  }
+  list_t*      bucket = _bucketFor(index, key);
+  list_node_t* node   = findInList(bucket, value);
+  if (node == NULL) {
+    return;
+  }
+  list_remove(bucket, node);
+  index->len--;
+}
+
+/**
+ * @brief finds the first value with the given key
+ * @return a pointer to the value or @c NULL
+ */
+void* dbIndex_find(const struct db_index* index, const char* key) {
+  if (index == NULL || key == NULL) {
+    return NULL;
+  }
+  void*            found = NULL;
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(_bucketFor(index, key), LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (index->matchKey(key, index->getKey(node->val))) {
+      found = node->val;
+      break;
+    }
+  }
+  list_iterator_destroy(it);
+  return found;
+}
+
+/**
+ * @brief finds all values with the given key
+ * @return a list of the values or @c NULL if there are none. Only the list has
+ * to be freed after usage, not the values.
+ */
+list_t* dbIndex_findAll(const struct db_index* index, const char* key) {
+  if (index == NULL || key == NULL) {
+    return NULL;
+  }
+  list_t*          founds = list_new();
+  list_node_t*     node;
+  list_iterator_t* it = list_iterator_new(_bucketFor(index, key), LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    if (index->matchKey(key, index->getKey(node->val))) {
+      list_rpush(founds, list_node_new(node->val));
+    }
+  }
+  list_iterator_destroy(it);
+  if (!listValid(founds)) {
+    secFreeList(founds);
+    founds = NULL;
+  }
+  return founds;
+}
@@ -0,0 +1,33 @@
+#ifndef OIDC_DB_INDEX_H
+#define OIDC_DB_INDEX_H
+
+#include "wrapper/list.h"
+
+#include <stddef.h>
+
+typedef const char* (*indexKeyFunction)(const void*);
+typedef int (*indexMatchFunction)(const char*, const char*);
+
+/**
+ * A hash index over the values of a db. The key of a value is obtained with
+ * @c getKey and compared with @c matchKey. The key of a value must not change
+ * while the value is indexed.
+ */
+struct db_index {
+  indexKeyFunction   getKey;
+  indexMatchFunction matchKey;
+  list_t**           buckets;
+  size_t             size;
+  size_t             len;
+};
+
+struct db_index* dbIndex_new(indexKeyFunction getKey,
+                             indexMatchFunction matchKey);
+void             dbIndex_free(struct db_index* index);
+void             dbIndex_clear(struct db_index* index);
+void             dbIndex_add(struct db_index* index, void* value);
+void             dbIndex_remove(struct db_index* index, const void* value);
+void*            dbIndex_find(const struct db_index* index, const char* key);
+list_t*          dbIndex_findAll(const struct db_index* index, const char* key);
+
+#endif  // OIDC_DB_INDEX_H
@@ -1,54 +1,130 @@
 #include "file_db.h"
 #include "utils/crypt/memoryCrypt.h"
-#include "utils/matcher.h"
+#include "utils/logger.h"
 #include "utils/memory.h"
 #include "utils/oidc_string.h"
 #include "utils/stringUtils.h"
 
+#include <string.h>
+
+/**
+ * The files that clients store in the agent. The content of a file is kept
+ * memory encrypted; files are found through a hash index on their name. The
+ * size of a single file and of all files together is limited; if a new file
+ * does not fit, the least recently used files are evicted.
+ */
+
+#define FILEDB_INDEX_FILENAME 0
+
 struct file_dummy {
-  char* filename;
-  char* data;
+  char*         filename;
+  char*         data;  // memory encrypted
+  size_t        size;
+  unsigned long lastUsed;
 };
 
+static size_t        totalSize = 0;
+static unsigned long useClock  = 0;
+
 void secFreeFileDummy(struct file_dummy* fd) {
   if (fd == NULL) {
     return;
   }
+  totalSize -= fd->size;
   secFree(fd->filename);
   secFree(fd->data);
   secFree(fd);
 }
 
-int _fd_match(const struct file_dummy* fd1, const struct file_dummy* fd2) {
-  return matchStrings(fd1 ? fd1->filename : NULL, fd2 ? fd2->filename : NULL);
+static int _fd_match(const struct file_dummy* fd1,
+                     const struct file_dummy* fd2) {
+  return fd1 == fd2;
+}
+
+static const char* _getFilename(const struct file_dummy* fd) {
+  return fd->filename;
 }
 
 void fileDB_new() {
   db_newDB(OIDC_DB_FILES);
   db_setFreeFunction(OIDC_DB_FILES, (freeFunction)secFreeFileDummy);
   db_setMatchFunction(OIDC_DB_FILES, (matchFunction)_fd_match);
+  db_addIndex(OIDC_DB_FILES, FILEDB_INDEX_FILENAME,
+              (indexKeyFunction)_getFilename, (indexMatchFunction)strequal);
+}
+
+static struct file_dummy* _findValue(const char* filename) {
+  if (filename == NULL) {
+    return NULL;
+  }
+  return db_findValueByIndex(OIDC_DB_FILES, FILEDB_INDEX_FILENAME, filename);
+}
+
+/**
+ * @brief evicts the least recently used file
+ */
+static void _evictOne() {
+  vector_t*          files  = db_getDB(OIDC_DB_FILES);
+  struct file_dummy* oldest = NULL;
+  for (size_t i = 0; files && i < files->len; i++) {
+    struct file_dummy* fd = vector_at(files, i);
+    if (oldest == NULL || fd->lastUsed < oldest->lastUsed) {
+      oldest = fd;
+    }
+  }
+  if (oldest) {
+    logger(DEBUG, "Evicting stored file '%s'", oldest->filename);
+    db_removeIfFound(OIDC_DB_FILES, oldest);
+  }
 }
 
-void fileDB_addValue(const char* key, const char* data) {
+/**
+ * @brief stores a file; a file with the same name is replaced
+ * @return @c OIDC_SUCCESS or @c OIDC_EMSGSIZE if the file is larger than
+ * @c FILEDB_MAX_FILE_SIZE
+ */
+oidc_error_t fileDB_addValue(const char* filename, const char* data) {
+  if (filename == NULL || data == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  size_t size = strlen(data);
+  if (size > FILEDB_MAX_FILE_SIZE) {
+    oidc_errno = OIDC_EMSGSIZE;
+    return oidc_errno;
+  }
+  fileDB_removeIfFound(filename);
+  while (fileDB_getSize() > 0 && (fileDB_getSize() >= FILEDB_MAX_FILES ||
+                                  totalSize + size > FILEDB_MAX_TOTAL_SIZE)) {
+    _evictOne();
+  }
   struct file_dummy* value = secAlloc(sizeof(struct file_dummy));
-  value->filename          = oidc_strcopy(key);
+  value->filename          = oidc_strcopy(filename);
   value->data              = memoryEncrypt(data);
+  value->size              = size;
+  value->lastUsed          = ++useClock;
+  totalSize += size;
   db_addValue(OIDC_DB_FILES, value);
+  return OIDC_SUCCESS;
 }
 
-struct file_dummy* _findValue(const char* filename) {
-  char*              tmp = oidc_strcopy(filename);
-  struct file_dummy  key = {.filename = tmp};
-  struct file_dummy* fd  = db_findValue(OIDC_DB_FILES, (&key));
-  secFree(tmp);
-  return fd;
-}
-
+/**
+ * @brief returns the content of a stored file
+ * @return the content or @c NULL if there is no such file; has to be freed
+ * after usage
+ */
 char* fileDB_findValue(const char* filename) {
   struct file_dummy* fd = _findValue(filename);
-  return fd ? memoryDecrypt(fd->data) : NULL;
+  if (fd == NULL) {
+    return NULL;
+  }
+  fd->lastUsed = ++useClock;
+  return memoryDecrypt(fd->data);
 }
 
 void fileDB_removeIfFound(const char* filename) {
-  db_removeIfFound(OIDC_DB_FILES, _findValue(filename));
+  struct file_dummy* fd = _findValue(filename);
+  if (fd) {
+    db_removeIfFound(OIDC_DB_FILES, fd);
+  }
 }
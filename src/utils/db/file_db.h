@@ -2,15 +2,18 @@
 #define OIDC_DB_FILES_H
 
 #include "db.h"
+#include "utils/oidc_error.h"
 
-void fileDB_new();
+// limits for the files stored in the agent
+#define FILEDB_MAX_FILE_SIZE (1024 * 1024)
+#define FILEDB_MAX_TOTAL_SIZE (16 * 1024 * 1024)
+#define FILEDB_MAX_FILES 256
 
-#define fileDB_setMatchFunction(match) \
-  db_setMatchFunction(OIDC_DB_FILES, (match))
+void fileDB_new();
 
 void fileDB_removeIfFound(const char* key);
 
-void fileDB_addValue(const char* key, const char* data);
+oidc_error_t fileDB_addValue(const char* key, const char* data);
 
 char* fileDB_findValue(const char* key);
 
@@ -0,0 +1,52 @@
+#include "issuerConfig_db.h"
+#include "utils/matcher.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+static void _secFreeIssuerConfigEntry(struct issuerConfig_entry* entry) {
+  if (entry == NULL) {
+    return;
+  }
+  secFree(entry->configuration_endpoint);
+  secFree(entry->document);
+  secFree(entry->etag);
+  secFree(entry);
+}
+
+static int _ic_match(const struct issuerConfig_entry* e1,
+                     const struct issuerConfig_entry* e2) {
+  return matchStrings(e1 ? e1->configuration_endpoint : NULL,
+                      e2 ? e2->configuration_endpoint : NULL);
+}
+
+void issuerConfigDB_new() {
+  db_newDB(OIDC_DB_ISSUERCONFIGS);
+  db_setFreeFunction(OIDC_DB_ISSUERCONFIGS,
+                     (freeFunction)_secFreeIssuerConfigEntry);
+  db_setMatchFunction(OIDC_DB_ISSUERCONFIGS, (matchFunction)_ic_match);
+}
+
+struct issuerConfig_entry* issuerConfigDB_findValue(
+    const char* configuration_endpoint) {
+  struct issuerConfig_entry key = {
+      .configuration_endpoint = (char*)configuration_endpoint};
+  return db_findValue(OIDC_DB_ISSUERCONFIGS, &key);
+}
+
+/**
+ * @brief stores a configuration document, replacing an older one for the same
+ * configuration endpoint
+ */
+void issuerConfigDB_addValue(const char* configuration_endpoint,
+                             const char* document, const char* etag,
+                             time_t expires_at) {
+  db_removeIfFound(OIDC_DB_ISSUERCONFIGS,
+                   issuerConfigDB_findValue(configuration_endpoint));
+  struct issuerConfig_entry* entry =
+      secAlloc(sizeof(struct issuerConfig_entry));
+  entry->configuration_endpoint = oidc_strcopy(configuration_endpoint);
+  entry->document               = oidc_strcopy(document);
+  entry->etag                   = etag ? oidc_strcopy(etag) : NULL;
+  entry->expires_at             = expires_at;
+  db_addValue(OIDC_DB_ISSUERCONFIGS, entry);
+}
@@ -0,0 +1,34 @@
+#ifndef OIDC_DB_ISSUERCONFIGS_H
+#define OIDC_DB_ISSUERCONFIGS_H
+
+#include "db.h"
+
+#include <time.h>
+
+/**
+ * A cached openid configuration document. The document is shared by all
+ * accounts of the same issuer; it is fresh until @c expires_at and can be
+ * revalidated with its @c etag afterwards.
+ */
+struct issuerConfig_entry {
+  char*  configuration_endpoint;
+  char*  document;
+  char*  etag;
+  time_t expires_at;
+};
+
+void issuerConfigDB_new();
+
+struct issuerConfig_entry* issuerConfigDB_findValue(
+    const char* configuration_endpoint);
+
+void issuerConfigDB_addValue(const char* configuration_endpoint,
+                             const char* document, const char* etag,
+                             time_t expires_at);
+
+#define issuerConfigDB_getSize() db_getSize(OIDC_DB_ISSUERCONFIGS)
+
+#define issuerConfigDB_reset() \
+  do { db_reset(OIDC_DB_ISSUERCONFIGS); } while (0)
+
+#endif  // OIDC_DB_ISSUERCONFIGS_H
@@ -28,6 +28,12 @@
 #define passwordDB_getDeathEntry(getter) \
   db_getDeathEntry(OIDC_DB_PASSWORDS, (getter))
 
+#define passwordDB_setDeathFunction(getter) \
+  db_setDeathFunction(OIDC_DB_PASSWORDS, (getter))
+
+#define passwordDB_updateDeath(value) \
+  do { db_updateDeath(OIDC_DB_PASSWORDS, (value)); } while (0)
+
 #define passwordDB_getSize() db_getSize(OIDC_DB_PASSWORDS)
 
 #define passwordDB_reset() \
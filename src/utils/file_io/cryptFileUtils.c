@@ -1,14 +1,94 @@
+#define _XOPEN_SOURCE 700
 #include "cryptFileUtils.h"
+#include "utils/crypt/binaryCrypt.h"
 #include "utils/crypt/cryptUtils.h"
+#include "utils/crypt/kdfConfig.h"
 #include "utils/file_io/file_io.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
 #include "wrapper/list.h"
 
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief checks if a file is encrypted with a key sealed to a host
+ */
+int fileIsSealed(const char* filepath) {
+  if (filepath == NULL || !fileDoesExist(filepath)) {
+    return 0;
+  }
+  size_t         len  = 0;
+  unsigned char* data = readBinaryFile(filepath, &len);
+  int            ret  = binaryCrypt_isSealed(data, len);
+  secFree(data);
+  return ret;
+}
+
+int oidcFileIsSealed(const char* filename) {
+  if (filename == NULL || !oidcFileDoesExist(filename)) {
+    return 0;
+  }
+  char* filepath = concatToOidcDir(filename);
+  int   ret      = fileIsSealed(filepath);
+  secFree(filepath);
+  return ret;
+}
+
+#define SEAL_NO 0
+#define SEAL_TRY 1
+#define SEAL_MUST 2
+
+static unsigned char* _encryptForFile(const char* text, const char* filepath,
+                                      const char* password, int seal,
+                                      size_t* len) {
+  unsigned char* encrypted = NULL;
+  if (seal) {
+    encrypted = binaryCrypt_encryptSealed(text, password,
+                                          kdfConfig_getParameters(), len);
+    if (encrypted == NULL) {
+      if (seal == SEAL_MUST) {
+        return NULL;
+      }
+      logger(NOTICE, "Could not seal the key of %s, writing it unsealed: %s",
+             filepath, oidc_serror());
+    }
+  }
+  if (encrypted == NULL) {
+    encrypted =
+        binaryCrypt_encrypt(text, password, kdfConfig_getParameters(), len);
+  }
+  return encrypted;
+}
+
+static oidc_error_t _encryptAndWriteToFile(const char* text,
+                                           const char* filepath,
+                                           const char* password, int seal) {
+  if (text == NULL || password == NULL || filepath == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  size_t         len = 0;
+  unsigned char* toWrite =
+      _encryptForFile(text, filepath, password, seal, &len);
+  if (toWrite == NULL) {
+    return oidc_errno;
+  }
+  logger(DEBUG, "Write to file %s", filepath);
+  oidc_error_t e = writeBinaryFileAtomic(filepath, toWrite, len);
+  secFree(toWrite);
+  return e;
+}
+
 /**
  * @brief encrypts and writes a given text with the given password.
+ * The file is written in the binary format, so files in an older format are
+ * migrated when they are written the next time. A file that is sealed to the
+ * host stays sealed if possible.
  * @param text the text to be encrypted
  * @param filepath an absolute path to the output file
  * @param password the encryption password
@@ -16,18 +96,62 @@
  */
 oidc_error_t encryptAndWriteToFile(const char* text, const char* filepath,
                                    const char* password) {
-  if (text == NULL || password == NULL || filepath == NULL) {
+  return _encryptAndWriteToFile(text, filepath, password,
+                                fileIsSealed(filepath) ? SEAL_TRY : SEAL_NO);
+}
+
+/**
+ * @brief encrypts and writes a given text like @c encryptAndWriteToFile and
+ * additionally seals the key to this host, so that the file can be decrypted
+ * with @c decryptFileSealed; the password still decrypts it
+ * @return an oidc_error code; fails if the host cannot seal keys
+ */
+oidc_error_t encryptAndWriteToFileSealed(const char* text,
+                                         const char* filepath,
+                                         const char* password) {
+  return _encryptAndWriteToFile(text, filepath, password, SEAL_MUST);
+}
+
+/**
+ * @brief replaces the text of a sealed file without the password, by
+ * encrypting it with the unsealed key of the file
+ * @return an oidc_error code; @c OIDC_ENOSEAL if the file is not sealed to
+ * this host
+ */
+oidc_error_t reencryptAndWriteSealedFile(const char* text,
+                                         const char* filepath) {
+  if (text == NULL || filepath == NULL) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
-  char* toWrite = encryptWithVersionLine(text, password);
+  size_t         old_len = 0;
+  unsigned char* old     = readBinaryFile(filepath, &old_len);
+  if (old == NULL) {
+    return oidc_errno;
+  }
+  size_t         len     = 0;
+  unsigned char* toWrite =
+      binaryCrypt_reencryptSealed(old, old_len, text, &len);
+  secFree(old);
   if (toWrite == NULL) {
     return oidc_errno;
   }
-  logger(DEBUG, "Write to file %s", filepath);
-  writeFile(filepath, toWrite);
+  logger(DEBUG, "Write to sealed file %s", filepath);
+  oidc_error_t e = writeBinaryFileAtomic(filepath, toWrite, len);
   secFree(toWrite);
-  return OIDC_SUCCESS;
+  return e;
+}
+
+oidc_error_t reencryptAndWriteSealedOidcFile(const char* text,
+                                             const char* filename) {
+  if (text == NULL || filename == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  char*        filepath = concatToOidcDir(filename);
+  oidc_error_t ret      = reencryptAndWriteSealedFile(text, filepath);
+  secFree(filepath);
+  return ret;
 }
 
 oidc_error_t encryptAndWriteToOidcFile(const char* text, const char* filename,
@@ -43,8 +167,31 @@ oidc_error_t encryptAndWriteToOidcFile(const char* text, const char* filename,
   return ret;
 }
 
+/**
+ * @brief encrypts a given text for a file in the oidcdir like
+ * @c encryptAndWriteToOidcFile, but does not write it
+ * The file can be written later, e.g. together with other files in a batch.
+ * @param len is set to the length of the encrypted data
+ * @return the data to be written to the file; has to be freed after usage. On
+ * failure @c NULL is returned and oidc_errno is set.
+ */
+unsigned char* encryptForOidcFile(const char* text, const char* filename,
+                                  const char* password, size_t* len) {
+  if (text == NULL || password == NULL || filename == NULL || len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  char*          filepath = concatToOidcDir(filename);
+  const int      seal     = fileIsSealed(filepath) ? SEAL_TRY : SEAL_NO;
+  unsigned char* ret = _encryptForFile(text, filepath, password, seal, len);
+  secFree(filepath);
+  return ret;
+}
+
 /**
  * @brief decrypts a file in the oidcdir with the given password
+ * If there is no such file, but a keystore, the account config @p filename is
+ * decrypted from the keystore.
  * @param filename the filename of the oidc-file
  * @param password if not @c NULL @p password is used for decryption; if @c NULL
  * the user will be prompted
@@ -56,12 +203,54 @@ char* decryptOidcFile(const char* filename, const char* password) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  if (!oidcFileDoesExist(filename) && keystore_exists()) {
+    return keystore_decryptAccount(filename, password);
+  }
   char* filepath = concatToOidcDir(filename);
   char* ret      = decryptFile(filepath, password);
   secFree(filepath);
   return ret;
 }
 
+/**
+ * @brief decrypts a file with the key sealed in it, i.e. without a password
+ * and without the key derivation
+ * @return a pointer to the decrypted filecontent or @c NULL; @c oidc_errno is
+ * @c OIDC_ENOSEAL if the file is not sealed to this host. It has to be freed
+ * after usage.
+ */
+char* decryptFileSealed(const char* filepath) {
+  if (filepath == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!fileDoesExist(filepath)) {
+    oidc_errno = OIDC_ENOSEAL;
+    return NULL;
+  }
+  size_t         len  = 0;
+  unsigned char* data = readBinaryFile(filepath, &len);
+  if (data == NULL) {
+    return NULL;
+  }
+  char* ret = binaryCrypt_decryptSealedInPlace(data, len);
+  if (ret == NULL) {
+    secFree(data);
+  }
+  return ret;
+}
+
+char* decryptOidcFileSealed(const char* filename) {
+  if (filename == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  char* filepath = concatToOidcDir(filename);
+  char* ret      = decryptFileSealed(filepath);
+  secFree(filepath);
+  return ret;
+}
+
 char* decryptFile(const char* filepath, const char* password) {
   if (filepath == NULL || password == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -70,11 +259,100 @@ char* decryptFile(const char* filepath, const char* password) {
   if (!fileDoesExist(filepath)) {
     return NULL;
   }
-  list_t* lines = getLinesFromFile(filepath);
-  if (lines == NULL) {
+  size_t         len  = 0;
+  unsigned char* data = readBinaryFile(filepath, &len);
+  if (data == NULL) {
     return NULL;
   }
-  char* ret = decryptLinesList(lines, password);
-  secFreeList(lines);
+  if (binaryCrypt_isBinary(data, len)) {
+    char* ret = binaryCrypt_decryptInPlace(data, len, password);
+    if (ret == NULL) {
+      secFree(data);
+    }
+    return ret;
+  }
+  char* ret = decryptFileContent((char*)data, password);
+  secFree(data);
   return ret;
 }
+
+/**
+ * @brief checks if a file in the oidcdir is encrypted in an older format
+ * @return @c 1 if the file exists and is not in the binary format; @c 0
+ * otherwise
+ */
+int oidcFileNeedsUpgrade(const char* filename) {
+  if (filename == NULL || !oidcFileDoesExist(filename)) {
+    return 0;
+  }
+  char*          filepath = concatToOidcDir(filename);
+  size_t         len      = 0;
+  unsigned char* data     = readBinaryFile(filepath, &len);
+  secFree(filepath);
+  if (data == NULL) {
+    return 0;
+  }
+  int ret = !binaryCrypt_isBinary(data, len);
+  secFree(data);
+  return ret;
+}
+
+/**
+ * @brief re-encrypts files in the oidcdir that are encrypted in an older
+ * format in the current format
+ * The files are decrypted and written again by a detached process with a low
+ * priority, one after the other, so the caller neither waits for the key
+ * derivations nor has to reap the process. Files that are already in the
+ * current format are skipped.
+ * @param filenames the filenames of the oidc-files
+ * @param passwords the encryption password of each file
+ * @param n the number of files
+ */
+void upgradeOidcFilesInBackground(const char* const* filenames,
+                                  const char* const* passwords, size_t n) {
+  if (filenames == NULL || passwords == NULL) {
+    return;
+  }
+  unsigned char needed = 0;
+  for (size_t i = 0; i < n && !needed; i++) {
+    needed = oidcFileNeedsUpgrade(filenames[i]);
+  }
+  if (!needed) {
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    logger(NOTICE, "Could not start upgrade of encrypted files: %m");
+    return;
+  }
+  if (pid > 0) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
+  // The intermediate process exits right away, so the upgrading process is
+  // reparented and does not become a zombie of the caller
+  if (fork() != 0) {
+    _exit(EXIT_SUCCESS);
+  }
+  (void)!nice(10);
+  for (size_t i = 0; i < n; i++) {
+    if (passwords[i] == NULL || !oidcFileNeedsUpgrade(filenames[i])) {
+      continue;
+    }
+    char* text = decryptOidcFile(filenames[i], passwords[i]);
+    if (text == NULL) {
+      continue;
+    }
+    if (encryptAndWriteToOidcFile(text, filenames[i], passwords[i]) ==
+        OIDC_SUCCESS) {
+      logger(DEBUG, "Upgraded oidc file %s to the current format",
+             filenames[i]);
+    }
+    secFree(text);
+  }
+  _exit(EXIT_SUCCESS);
+}
+
+void upgradeOidcFileInBackground(const char* filename, const char* password) {
+  upgradeOidcFilesInBackground(&filename, &password, 1);
+}
@@ -3,11 +3,32 @@
 
 #include "utils/oidc_error.h"
 
+#include <stddef.h>
+
 oidc_error_t encryptAndWriteToFile(const char* text, const char* filepath,
                                    const char* password);
 oidc_error_t encryptAndWriteToOidcFile(const char* text, const char* filename,
                                        const char* password);
+oidc_error_t encryptAndWriteToFileSealed(const char* text,
+                                         const char* filepath,
+                                         const char* password);
+unsigned char* encryptForOidcFile(const char* text, const char* filename,
+                                  const char* password, size_t* len);
+oidc_error_t reencryptAndWriteSealedFile(const char* text,
+                                         const char* filepath);
+oidc_error_t reencryptAndWriteSealedOidcFile(const char* text,
+                                             const char* filename);
 char*        decryptFile(const char* filepath, const char* password);
 char*        decryptOidcFile(const char* filename, const char* password);
+char*        decryptFileSealed(const char* filepath);
+char*        decryptOidcFileSealed(const char* filename);
+int          fileIsSealed(const char* filepath);
+int          oidcFileIsSealed(const char* filename);
+int          oidcFileNeedsUpgrade(const char* filename);
+void         upgradeOidcFileInBackground(const char* filename,
+                                         const char* password);
+void         upgradeOidcFilesInBackground(const char* const* filenames,
+                                          const char* const* passwords,
+                                          size_t             n);
 
 #endif  // CRYPT_FILE_UTILS_H
@@ -1,4 +1,6 @@
+#define _XOPEN_SOURCE 700
 #include "fileUtils.h"
+#include "oidcDirCache.h"
 #include "oidc_file_io.h"
 #include "utils/crypt/crypt.h"
 #include "utils/listUtils.h"
@@ -117,12 +119,115 @@ int isAccountConfigFile(const char* filename,
   return 1;
 }
 
+void _secFreeOidcFileInfo(struct oidc_file_info* info) {
+  if (info == NULL) {
+    return;
+  }
+  secFree(info->name);
+  secFree(info);
+}
+
+/**
+ * @brief lists the regular files of a directory together with their timestamps
+ * Every file is stat'ed exactly once (relative to the opened directory), so
+ * the list can be sorted by date without any further syscalls.
+ * @return a list of @c struct oidc_file_info; has to be freed after usage
+ */
+list_t* getFileInfoListForDirIf(const char* dirname,
+                                int(match(const char*, const char*)),
+                                const char* arg) {
+  DIR* dir = opendir(dirname);
+  if (dir == NULL) {
+    oidc_setErrnoError();
+    return NULL;
+  }
+  int            fd   = dirfd(dir);
+  list_t*        list = list_new();
+  struct dirent* ent;
+  list->free = (void (*)(void*))_secFreeOidcFileInfo;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strstarts(ent->d_name, ".") || !match(ent->d_name, arg)) {
+      continue;
+    }
+    struct stat st;
+    if (fstatat(fd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    struct oidc_file_info* info = secAlloc(sizeof(struct oidc_file_info));
+    info->name                  = oidc_strcopy(ent->d_name);
+    info->mtime                 = st.st_mtime;
+    info->atime                 = st.st_atime;
+    list_rpush(list, list_node_new(info));
+  }
+  closedir(dir);
+  return list;
+}
+
+static list_t* _listAllFileInfos(const char* dirname) {
+  return getFileInfoListForDirIf(dirname, &alwaysOne, NULL);
+}
+
+/**
+ * @brief lists the files of the oidc dir from the listing of the oidc dir
+ * cache
+ * @param withInfo if a list of @c struct oidc_file_info is returned instead of
+ * a list of names
+ * @return the list or @c NULL on failure; has to be freed after usage
+ */
+static list_t* _getCachedFileListIf(const char* oidc_dir,
+                                    int(match(const char*, const char*)),
+                                    unsigned char withInfo) {
+  const list_t* files = oidcDirCache_listDir(oidc_dir, _listAllFileInfos);
+  if (files == NULL) {
+    return NULL;
+  }
+  list_t* list = list_new();
+  if (withInfo) {
+    list->free = (void (*)(void*))_secFreeOidcFileInfo;
+  } else {
+    list->free  = (void (*)(void*)) & _secFree;
+    list->match = (matchFunction)strequal;
+  }
+  for (list_node_t* node = files->head; node; node = node->next) {
+    const struct oidc_file_info* file = node->val;
+    if (!match(file->name, NULL)) {
+      continue;
+    }
+    if (!withInfo) {
+      list_rpush(list, list_node_new(oidc_strcopy(file->name)));
+      continue;
+    }
+    struct oidc_file_info* info = secAlloc(sizeof(struct oidc_file_info));
+    info->name                  = oidc_strcopy(file->name);
+    info->mtime                 = file->mtime;
+    info->atime                 = file->atime;
+    list_rpush(list, list_node_new(info));
+  }
+  return list;
+}
+
 list_t* getAccountConfigFileList() {
   char* oidc_dir = getOidcDir();
   if (oidc_dir == NULL) {
     return NULL;
   }
-  list_t* list = getFileListForDirIf(oidc_dir, &isAccountConfigFile, NULL);
+  list_t* list =
+      oidcDirCache_covers(oidc_dir)
+          ? _getCachedFileListIf(oidc_dir, &isAccountConfigFile, 0)
+          : getFileListForDirIf(oidc_dir, &isAccountConfigFile, NULL);
+  secFree(oidc_dir);
+  return list;
+}
+
+list_t* getAccountConfigFileInfoList() {
+  char* oidc_dir = getOidcDir();
+  if (oidc_dir == NULL) {
+    return NULL;
+  }
+  list_t* list =
+      oidcDirCache_covers(oidc_dir)
+          ? _getCachedFileListIf(oidc_dir, &isAccountConfigFile, 1)
+          : getFileInfoListForDirIf(oidc_dir, &isAccountConfigFile, NULL);
   secFree(oidc_dir);
   return list;
 }
@@ -132,8 +237,10 @@ list_t* getClientConfigFileList() {
   if (oidc_dir == NULL) {
     return NULL;
   }
-  list_t*      list = getFileListForDirIf(oidc_dir, &isClientConfigFile, NULL);
-  list_node_t* node;
+  list_t* list = oidcDirCache_covers(oidc_dir)
+                     ? _getCachedFileListIf(oidc_dir, &isClientConfigFile, 0)
+                     : getFileListForDirIf(oidc_dir, &isClientConfigFile, NULL);
+  list_node_t*     node;
   list_iterator_t* it = list_iterator_new(list, LIST_HEAD);
   while ((node = list_iterator_next(it))) {
     char* old = node->val;
@@ -148,44 +255,20 @@ int compareFilesByName(const char* filename1, const char* filename2) {
   return strcmp(filename1, filename2);
 }
 
-int compareOidcFilesByDateModified(const char* filename1,
-                                   const char* filename2) {
-  struct stat* stat1 = secAlloc(sizeof(struct stat));
-  struct stat* stat2 = secAlloc(sizeof(struct stat));
-  char*        path1 = concatToOidcDir(filename1);
-  char*        path2 = concatToOidcDir(filename2);
-  stat(path1, stat1);
-  stat(path2, stat2);
-  int ret = 0;
-  if (stat1->st_mtime < stat2->st_mtime) {
-    ret = -1;
-  }
-  if (stat1->st_mtime > stat2->st_mtime) {
-    ret = 1;
-  }
-  secFree(stat1);
-  secFree(stat2);
-  return ret;
-}
-
-int compareOidcFilesByDateAccessed(const char* filename1,
-                                   const char* filename2) {
-  struct stat* stat1 = secAlloc(sizeof(struct stat));
-  struct stat* stat2 = secAlloc(sizeof(struct stat));
-  char*        path1 = concatToOidcDir(filename1);
-  char*        path2 = concatToOidcDir(filename2);
-  stat(path1, stat1);
-  stat(path2, stat2);
-  int ret = 0;
-  if (stat1->st_atime < stat2->st_atime) {
-    ret = -1;
-  }
-  if (stat1->st_atime > stat2->st_atime) {
-    ret = 1;
-  }
-  secFree(stat1);
-  secFree(stat2);
-  return ret;
+int compareOidcFilesByDateModified(const struct oidc_file_info* file1,
+                                   const struct oidc_file_info* file2) {
+  if (file1->mtime < file2->mtime) {
+    return -1;
+  }
+  return file1->mtime > file2->mtime;
+}
+
+int compareOidcFilesByDateAccessed(const struct oidc_file_info* file1,
+                                   const struct oidc_file_info* file2) {
+  if (file1->atime < file2->atime) {
+    return -1;
+  }
+  return file1->atime > file2->atime;
 }
 
 char* generateClientConfigFileName(const char* issuer_url,
@@ -4,17 +4,31 @@
 #include "utils/oidc_error.h"
 #include "wrapper/list.h"
 
+#include <time.h>
+
+/**
+ * @struct oidc_file_info fileUtils.h
+ * @brief a file in the oidc dir together with its timestamps
+ */
+struct oidc_file_info {
+  char*  name;
+  time_t mtime;
+  time_t atime;
+};
+
 void assertOidcDirExists();
 void checkOidcDirExists();
 
 list_t* getAccountConfigFileList();
 list_t* getClientConfigFileList();
+list_t* getAccountConfigFileInfoList();
+int     isAccountConfigFile(const char* filename, const char* a);
 
 int compareFilesByName(const char* filename1, const char* filename2);
-int compareOidcFilesByDateModified(const char* filename1,
-                                   const char* filename2);
-int compareOidcFilesByDateAccessed(const char* filename1,
-                                   const char* filename2);
+int compareOidcFilesByDateModified(const struct oidc_file_info* file1,
+                                   const struct oidc_file_info* file2);
+int compareOidcFilesByDateAccessed(const struct oidc_file_info* file1,
+                                   const struct oidc_file_info* file2);
 
 char* generateClientConfigFileName(const char* issuer_url,
                                    const char* client_id);
@@ -1,12 +1,15 @@
 #define _XOPEN_SOURCE 700
 #include "file_io.h"
+#include "oidcDirCache.h"
 #include "utils/listUtils.h"
 #include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/oidc_string.h"
 #include "utils/stringUtils.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,32 +17,97 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+/**
+ * Writes that are done between @c fileIO_beginBatch and @c fileIO_commitBatch
+ * are group committed: The temporary files are written right away, but they
+ * are synced and renamed together at the end of the batch, and a later write
+ * to the same path in the batch replaces the pending one.
+ */
+struct pendingWrite {
+  char* path;
+  char* tmp;
+  int   fd;
+};
+
+static list_t*      pendingWrites = NULL;
+static unsigned int batchDepth    = 0;
+
+static void _secFreePendingWrite(struct pendingWrite* w) {
+  if (w->fd >= 0) {
+    close(w->fd);
+  }
+  secFree(w->path);
+  secFree(w->tmp);
+  secFree(w);
+}
+
+static int _matchPendingWriteByPath(const char*                path,
+                                    const struct pendingWrite* w) {
+  return strequal(path, w->path);
+}
+
+static oidc_error_t _commitWrite(struct pendingWrite* w) {
+  int ok = fsync(w->fd) == 0;
+  ok     = close(w->fd) == 0 && ok;
+  w->fd  = -1;
+  if (!ok || rename(w->tmp, w->path) != 0) {
+    logger(ALERT, "Error writing file '%s': %m", w->path);
+    unlink(w->tmp);
+    if (oidcDirCache_covers(w->path)) {
+      oidcDirCache_invalidate(w->path);
+    }
+    oidc_errno = OIDC_EWRITE;
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief commits a pending write to @p path, so that a read in a batch sees
+ * the content written before
+ */
+void fileIO_commitPendingWriteTo(const char* path) {
+  list_node_t* node = batchDepth ? findInList(pendingWrites, path) : NULL;
+  if (node == NULL) {
+    return;
+  }
+  _commitWrite(node->val);
+  list_remove(pendingWrites, node);
+}
+
 char* readFILE2(FILE* fp) {
   logger(DEBUG, "I'm reading a file step by step");
-  size_t bsize   = 8;
-  char*  buffer  = secAlloc(bsize + 1);
-  size_t written = 0;
+  size_t        bsize = 256;
+  struct string s;
+  if (init_string(&s) != OIDC_SUCCESS) {
+    return NULL;
+  }
   while (1) {
-    if (fread(buffer + written, bsize, 1, fp) != 1) {
-      if (feof(fp)) {
-        if (buffer[strlen(buffer) - 1] == '\n') {
-          buffer[strlen(buffer) - 1] = '\0';
-        }
-        if (buffer[0] == '\0') {
-          secFree(buffer);
-          return NULL;
-        }
-        return buffer;
-      }
+    if (string_reserve(&s, s.len + bsize) != OIDC_SUCCESS) {
+      secFree(s.ptr);
+      return NULL;
+    }
+    size_t read = fread(s.ptr + s.len, 1, bsize, fp);
+    s.len += read;
+    s.ptr[s.len] = '\0';
+    if (read < bsize) {
       if (ferror(fp)) {
         oidc_setErrnoError();
-        secFree(buffer);
+        secFree(s.ptr);
         return NULL;
       }
+      break;  // EOF
     }
-    written += bsize;
-    buffer = secRealloc(buffer, written + bsize + 1);
   }
+  size_t len = strlen(s.ptr);
+  if (len > 0 && s.ptr[len - 1] == '\n') {
+    s.ptr[len - 1] = '\0';
+  }
+  if (s.ptr[0] == '\0') {
+    secFree(s.ptr);
+    return NULL;
+  }
+  return s.ptr;
 }
 
 char* readFILE(FILE* fp) {
@@ -80,25 +148,130 @@ char* readFILE(FILE* fp) {
   return buffer;
 }
 
-/** @fn char* readFile(const char* path)
+static unsigned char* _readBinaryFile(const char* path, size_t* len) {
+  logger(DEBUG, "Reading file: %s", path);
+  fileIO_commitPendingWriteTo(path);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    logger(NOTICE, "%m\n");
+    oidc_errno = OIDC_EFOPEN;
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    oidc_setErrnoError();
+    return NULL;
+  }
+  size_t         size = st.st_size;
+  unsigned char* data = secAlloc(size + 1);
+  ssize_t        n    = data ? pread(fd, data, size, 0) : -1;
+  close(fd);
+  if (n < 0 || (size_t)n != size) {
+    secFree(data);
+    oidc_errno = OIDC_EIN;
+    return NULL;
+  }
+  *len = size;
+  return data;
+}
+
+/**
+ * @brief reads a whole file with a single @c pread into memory allocated with
+ * @c secAlloc
+ * Files in the oidc dir are read through the oidc dir cache, if it is enabled.
+ * @param len is set to the number of bytes read
+ * @return the content, followed by a null byte; has to be freed after usage
+ */
+unsigned char* readBinaryFile(const char* path, size_t* len) {
+  if (path == NULL || len == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (oidcDirCache_covers(path)) {
+    return oidcDirCache_read(path, len, _readBinaryFile);
+  }
+  return _readBinaryFile(path, len);
+}
+
+/**
  * @brief reads a file and returns a pointer to the content
+ * A regular file is read with a single @c read of its size; other files, e.g.
+ * pipes, are read step by step.
  * @param path the file to be read
  * @return a pointer to the file content. Has to be freed after usage. On
  * failure NULL is returned and oidc_errno is set.
  */
 char* readFile(const char* path) {
+  if (path == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (oidcDirCache_covers(path)) {
+    size_t len  = 0;
+    char*  data = (char*)oidcDirCache_read(path, &len, _readBinaryFile);
+    if (data && len == 0) {
+      secFree(data);
+      oidc_errno = OIDC_EEOF;
+    }
+    return data;
+  }
   logger(DEBUG, "Reading file: %s", path);
-
-  FILE* fp = fopen(path, "rb");
-  if (!fp) {
+  fileIO_commitPendingWriteTo(path);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     logger(NOTICE, "%m\n");
     oidc_errno = OIDC_EFOPEN;
     return NULL;
   }
-
-  char* ret = readFILE(fp);
-  fclose(fp);
-  return ret;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    oidc_setErrnoError();
+    return NULL;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    FILE* fp = fdopen(fd, "rb");
+    if (fp == NULL) {
+      close(fd);
+      oidc_setErrnoError();
+      return NULL;
+    }
+    char* ret = readFILE2(fp);
+    fclose(fp);
+    return ret;
+  }
+  size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    oidc_errno = OIDC_EEOF;
+    return NULL;
+  }
+  char* buffer = secAlloc(size + 1);
+  if (buffer == NULL) {
+    close(fd);
+    oidc_errno = OIDC_EALLOC;
+    return NULL;
+  }
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, buffer + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  close(fd);
+  if (done != size) {
+    secFree(buffer);
+    oidc_errno = OIDC_EFREAD;
+    logger(ERROR, "entire read failed in function %s", __func__);
+    return NULL;
+  }
+  return buffer;
 }
 
 char* getLineFromFILE(FILE* fp) {
@@ -148,6 +321,9 @@ oidc_error_t writeFile(const char* path, const char* text) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (oidcDirCache_covers(path)) {
+    oidcDirCache_invalidate(path);
+  }
   FILE* f = fopen(path, "w");
   if (f == NULL) {
     logger(ALERT, "Error opening file '%s' in function writeToFile().\n", path);
@@ -158,11 +334,163 @@ oidc_error_t writeFile(const char* path, const char* text) {
   return OIDC_SUCCESS;
 }
 
+/**
+ * @brief writes text to a file by replacing it
+ * The text is written to a temporary file in the same directory, which is
+ * synced and then renamed to @p path, so the file is never left partially
+ * written. The mode of an existing file is kept; new files are only readable
+ * by the owner.
+ * @param path the file to be written
+ * @param text the nullterminated text to be written
+ * @return OIDC_OK on success, OID_EFILE if an error occurred. The system sets
+ * errno.
+ */
+oidc_error_t writeFileAtomic(const char* path, const char* text) {
+  if (path == NULL || text == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  return writeBinaryFileAtomic(path, text, strlen(text));
+}
+
+/**
+ * @brief like @c writeFileAtomic, but writes @p len bytes of @p data
+ */
+oidc_error_t writeBinaryFileAtomic(const char* path, const void* data,
+                                   size_t len) {
+  if (path == NULL || data == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  char* tmp = oidc_sprintf("%s.XXXXXX", path);
+  int   fd  = mkstemp(tmp);
+  if (fd < 0) {
+    logger(ALERT, "Error creating temporary file for '%s': %m", path);
+    secFree(tmp);
+    return OIDC_EFOPEN;
+  }
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    fchmod(fd, st.st_mode & 07777);
+  }
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, (const char*)data + done, len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  if (oidcDirCache_covers(path)) {
+    if (done == len) {
+      oidcDirCache_written(path, data, len);
+    } else {
+      oidcDirCache_invalidate(path);
+    }
+  }
+  struct pendingWrite* w = secAlloc(sizeof(struct pendingWrite));
+  w->path                = oidc_strcopy(path);
+  w->tmp                 = tmp;
+  w->fd                  = fd;
+  if (done != len) {
+    logger(ALERT, "Error writing file '%s': %m", path);
+    unlink(tmp);
+    _secFreePendingWrite(w);
+    oidc_errno = OIDC_EWRITE;
+    return oidc_errno;
+  }
+  if (batchDepth == 0) {
+    oidc_error_t e = _commitWrite(w);
+    _secFreePendingWrite(w);
+    return e;
+  }
+  list_node_t* node = findInList(pendingWrites, path);
+  if (node) {  // superseded by this write
+    struct pendingWrite* old = node->val;
+    unlink(old->tmp);
+    _secFreePendingWrite(old);
+    node->val = w;
+  } else {
+    list_rpush(pendingWrites, list_node_new(w));
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief starts a batch of atomic writes
+ * Batches can be nested; the writes are committed when the outermost batch
+ * ends.
+ */
+void fileIO_beginBatch() {
+  if (pendingWrites == NULL) {
+    pendingWrites        = list_new();
+    pendingWrites->free  = (void (*)(void*))_secFreePendingWrite;
+    pendingWrites->match = (matchFunction)_matchPendingWriteByPath;
+  }
+  batchDepth++;
+}
+
+/**
+ * @brief ends a batch of atomic writes and commits the pending writes
+ * The files are synced one after the other, so the file system can combine
+ * the flushes, and then renamed; every directory that contains a written file
+ * is synced once at the end.
+ * @return @c OIDC_SUCCESS if all pending writes were committed; otherwise the
+ * error of the first failed write
+ */
+oidc_error_t fileIO_commitBatch() {
+  if (batchDepth == 0) {
+    return OIDC_SUCCESS;
+  }
+  if (--batchDepth > 0) {
+    return OIDC_SUCCESS;
+  }
+  oidc_error_t ret  = OIDC_SUCCESS;
+  list_t*      dirs = list_new();
+  dirs->free        = _secFree;
+  dirs->match       = (matchFunction)strequal;
+  list_node_t* node;
+  while ((node = list_lpop(pendingWrites))) {
+    struct pendingWrite* w = node->val;
+    LIST_FREE(node);
+    oidc_error_t e = _commitWrite(w);
+    if (e != OIDC_SUCCESS && ret == OIDC_SUCCESS) {
+      ret = e;
+    }
+    const char* slash = strrchr(w->path, '/');
+    char*       dir   = slash ? oidc_strncopy(w->path, slash - w->path + 1)
+                              : oidc_strcopy(".");
+    if (e == OIDC_SUCCESS && findInList(dirs, dir) == NULL) {
+      list_rpush(dirs, list_node_new(dir));
+    } else {
+      secFree(dir);
+    }
+    _secFreePendingWrite(w);
+  }
+  list_iterator_t* it = list_iterator_new(dirs, LIST_HEAD);
+  while ((node = list_iterator_next(it))) {
+    int fd = open(node->val, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+      fsync(fd);
+      close(fd);
+    }
+  }
+  list_iterator_destroy(it);
+  secFreeList(dirs);
+  return ret;
+}
+
 oidc_error_t appendFile(const char* path, const char* text) {
   if (path == NULL || text == NULL) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
+  if (oidcDirCache_covers(path)) {
+    oidcDirCache_invalidate(path);
+  }
   FILE* f = fopen(path, "a");
   if (f == NULL) {
 #ifndef __APPLE__  // logger on MAC uses this function so don't use logger if
@@ -182,6 +510,9 @@ oidc_error_t appendFile(const char* path, const char* text) {
  * @return 1 if the file does exist, 0 if not
  */
 int fileDoesExist(const char* path) {
+  if (oidcDirCache_covers(path)) {
+    return oidcDirCache_exists(path);
+  }
   return path ? access(path, F_OK) == 0 ? 1 : 0 : 0;
 }
 
@@ -223,46 +554,78 @@ oidc_error_t createDir(const char* path) {
  * @return On success, 0 is returned.  On error, -1 is returned, and errno is
  * set appropriately.
  */
-int removeFile(const char* path) { return unlink(path); }
+int removeFile(const char* path) {
+  if (oidcDirCache_covers(path)) {
+    oidcDirCache_invalidate(path);
+  }
+  return unlink(path);
+}
 
-list_t* _getLinesFromFile(const char* path, const unsigned char ignoreComments,
-                          const char commentChar) {
-  if (path == NULL) {
+/**
+ * @brief calls @p callback for every line of a file
+ * The file is read buffered and only one line is held in memory at a time;
+ * reading stops as soon as @p callback returns non-zero.
+ * @param ignoreComments if lines starting with @c DEFAULT_COMMENT_CHAR are
+ * skipped
+ * @param callback is called with every line without its newline and @p arg;
+ * the line may be modified, but is only valid during the call
+ * @return @c OIDC_SUCCESS or an error code if the file could not be opened
+ */
+oidc_error_t forEachLineInFile(const char* path, unsigned char ignoreComments,
+                               lineCallback callback, void* arg) {
+  if (path == NULL || callback == NULL) {
     oidc_setArgNullFuncError(__func__);
-    return NULL;
+    return oidc_errno;
   }
   logger(DEBUG, "Getting Lines from file: %s", path);
+  fileIO_commitPendingWriteTo(path);
   FILE* fp = fopen(path, "r");
   if (fp == NULL) {
     oidc_setErrnoError();
-    return NULL;
+    return oidc_errno;
   }
-
-  list_t* lines = list_new();
-  lines->free   = _secFree;
-  lines->match  = (matchFunction)strequal;
-
   char*   line = NULL;
-  size_t  len  = 0;
+  size_t  cap  = 0;
   ssize_t read = 0;
-  while ((read = getline(&line, &len, fp)) != -1) {
-    if (line[strlen(line) - 1] == '\n') {
-      line[strlen(line) - 1] = '\0';
+  while ((read = getline(&line, &cap, fp)) != -1) {
+    if (read > 0 && line[read - 1] == '\n') {
+      line[read - 1] = '\0';
     }
-    if (!ignoreComments || commentChar != firstNonWhiteSpaceChar(line)) {
-      list_rpush(lines, list_node_new(oidc_strcopy(line)));
+    if (ignoreComments &&
+        firstNonWhiteSpaceChar(line) == DEFAULT_COMMENT_CHAR) {
+      continue;
+    }
+    if (callback(line, arg)) {
+      break;
     }
-    secFreeN(line, len);
   }
-  secFreeN(line, len);
+  secFreeN(line, cap);  // getline allocates with malloc
   fclose(fp);
+  return OIDC_SUCCESS;
+}
+
+static int _appendLine(char* line, list_t* lines) {
+  list_rpush(lines, list_node_new(oidc_strcopy(line)));
+  return 0;
+}
+
+static list_t* _getLinesFromFile(const char*         path,
+                                 const unsigned char ignoreComments) {
+  list_t* lines = list_new();
+  lines->free   = _secFree;
+  lines->match  = (matchFunction)strequal;
+  if (forEachLineInFile(path, ignoreComments, (lineCallback)_appendLine,
+                        lines) != OIDC_SUCCESS) {
+    secFreeList(lines);
+    return NULL;
+  }
   return lines;
 }
 
 list_t* getLinesFromFile(const char* path) {
-  return _getLinesFromFile(path, 0, 0);
+  return _getLinesFromFile(path, 0);
 }
 
 list_t* getLinesFromFileWithoutComments(const char* path) {
-  return _getLinesFromFile(path, 1, DEFAULT_COMMENT_CHAR);
+  return _getLinesFromFile(path, 1);
 }
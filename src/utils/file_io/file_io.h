@@ -12,9 +12,19 @@
 
 #define DEFAULT_COMMENT_CHAR '#'
 
+// returns non-zero to stop the iteration
+typedef int (*lineCallback)(char* line, void* arg);
+
 oidc_error_t writeFile(const char* filepath, const char* text);
+oidc_error_t writeFileAtomic(const char* path, const char* text);
+oidc_error_t writeBinaryFileAtomic(const char* path, const void* data,
+                                   size_t len);
+void         fileIO_beginBatch();
+oidc_error_t fileIO_commitBatch();
+void         fileIO_commitPendingWriteTo(const char* path);
 oidc_error_t appendFile(const char* path, const char* text);
 char*        readFile(const char* path);
+unsigned char* readBinaryFile(const char* path, size_t* len);
 char*        readFILE(FILE* fp);
 char*        getLineFromFILE(FILE* fp);
 char*        getLineFromFile(const char* path);
@@ -24,5 +34,7 @@ oidc_error_t createDir(const char* path);
 int          removeFile(const char* path);
 list_t*      getLinesFromFile(const char* path);
 list_t*      getLinesFromFileWithoutComments(const char* path);
+oidc_error_t forEachLineInFile(const char* path, unsigned char ignoreComments,
+                               lineCallback callback, void* arg);
 
 #endif  // FILE_IO_H
@@ -0,0 +1,535 @@
+#include "keystore.h"
+#include "defines/agent_values.h"
+#include "defines/settings.h"
+#include "utils/crypt/base64.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/kdfConfig.h"
+#include "utils/file_io/file_io.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/**
+ * A keystore holds many account configs in a single file that is encrypted
+ * with a single password, so a single key derivation is needed for all of
+ * them. The file has one item per line:
+ *  1 the format line
+ *  2 the crypt parameters of the key derivation
+ *  3 salt_base64
+ *  4 hash_key_base64, used to verify the password
+ *  5 the sealed index
+ *  6.. one sealed record per account
+ * Sealed items are @c nonce_base64:cipher_base64, encrypted with
+ * XChaCha20-Poly1305 under the derived key and a random nonce. The index is a
+ * JSON array of the name, issuer and modification time of each account; the
+ * n-th entry describes the n-th record. Records are only decrypted when the
+ * account is requested, with the account name as associated data, so records
+ * cannot be swapped.
+ */
+
+#define KEYSTORE_FORMAT "oidc-agent-keystore:1"
+#define KEYSTORE_HEADER_LINES 5
+
+struct keystoreRecord {
+  char*  name;
+  char*  issuer;
+  time_t mtime;
+  char*  sealed;
+};
+
+struct keystore {
+  char*                 path;
+  struct cryptParameter params;
+  char*                 salt_base64;
+  char*                 hash_key_base64;
+  unsigned char*        key;
+  list_t*               records;
+};
+
+static void _secFreeRecord(struct keystoreRecord* record) {
+  if (record == NULL) {
+    return;
+  }
+  secFree(record->name);
+  secFree(record->issuer);
+  secFree(record->sealed);
+  secFree(record);
+}
+
+static char* _seal(const char* text, const char* ad, const unsigned char* key) {
+  unsigned char nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+  randombytes_buf(nonce, sizeof(nonce));
+  size_t             text_len = strlen(text);
+  unsigned long long cipher_len;
+  unsigned char*     cipher =
+      secAlloc(text_len + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+  crypto_aead_xchacha20poly1305_ietf_encrypt(
+      cipher, &cipher_len, (const unsigned char*)text, text_len,
+      (const unsigned char*)ad, strlen(ad), NULL, nonce, key);
+  char* nonce_base64  = toBase64((char*)nonce, sizeof(nonce));
+  char* cipher_base64 = toBase64((char*)cipher, cipher_len);
+  secFree(cipher);
+  char* sealed = oidc_sprintf("%s:%s", nonce_base64, cipher_base64);
+  secFree(nonce_base64);
+  secFree(cipher_base64);
+  return sealed;
+}
+
+static char* _unseal(const char* sealed, const char* ad,
+                     const unsigned char* key) {
+  const char* sep = strchr(sealed, ':');
+  unsigned char nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+  if (sep == NULL ||
+      base64_decode(nonce, sizeof(nonce), sealed, sep - sealed, NULL, NULL,
+                    sodium_base64_VARIANT_ORIGINAL) != 0) {
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  size_t         max_len = strlen(sep + 1) / 4 * 3 + 1;
+  unsigned char* cipher  = secAlloc(max_len);
+  size_t         cipher_len;
+  if (base64_decode(cipher, max_len, sep + 1, strlen(sep + 1), &cipher_len,
+                    NULL, sodium_base64_VARIANT_ORIGINAL) != 0 ||
+      cipher_len < crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+    secFree(cipher);
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  unsigned char* text =
+      secAlloc(cipher_len - crypto_aead_xchacha20poly1305_ietf_ABYTES + 1);
+  if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+          text, NULL, NULL, cipher, cipher_len, (const unsigned char*)ad,
+          strlen(ad), nonce, key) != 0) {
+    logger(NOTICE, "Decryption of keystore item failed.");
+    secFree(cipher);
+    secFree(text);
+    oidc_errno = OIDC_EDECRYPT;
+    return NULL;
+  }
+  secFree(cipher);
+  return (char*)text;
+}
+
+static struct keystoreRecord* _findRecord(const struct keystore* keystore,
+                                          const char*            shortname) {
+  for (list_node_t* node = keystore->records->head; node; node = node->next) {
+    struct keystoreRecord* record = node->val;
+    if (strequal(record->name, shortname)) {
+      return record;
+    }
+  }
+  return NULL;
+}
+
+static char* _paramsToString(const struct cryptParameter* p) {
+  return oidc_sprintf("%lu:%lu:%lu:%lu:%d:%d:%d:%d", p->nonce_len,
+                      p->salt_len, p->mac_len, p->key_len, p->base64_variant,
+                      p->hash_ops_limit, p->hash_mem_limit, p->hash_alg);
+}
+
+static struct keystore* _newKeystore(const char* filepath) {
+  struct keystore* keystore = secAlloc(sizeof(struct keystore));
+  keystore->path            = oidc_strcopy(filepath);
+  keystore->records         = list_new();
+  keystore->records->free   = (void (*)(void*))_secFreeRecord;
+  return keystore;
+}
+
+/**
+ * @brief derives the key of @p keystore from @p password
+ * @param generateNewSalt if a new salt should be generated, i.e. the keystore
+ * is new; otherwise @p password is checked against the stored hash key
+ */
+static oidc_error_t _deriveKey(struct keystore* keystore, const char* password,
+                               int generateNewSalt) {
+  if (generateNewSalt) {
+    keystore->salt_base64 = secAlloc(
+        sodium_base64_ENCODED_LEN(keystore->params.salt_len,
+                                  sodium_base64_VARIANT_ORIGINAL) +
+        1);
+  }
+  struct key_set keys = crypt_keyDerivation_base64(
+      password, keystore->salt_base64, generateNewSalt, &keystore->params);
+  if (keys.encryption_key == NULL) {
+    secFree(keys.hash_key);
+    return oidc_errno;
+  }
+  char* hash_key_base64 = toBase64(keys.hash_key, keystore->params.key_len);
+  secFree(keys.hash_key);
+  if (generateNewSalt) {
+    keystore->hash_key_base64 = hash_key_base64;
+  } else {
+    int match = strlen(hash_key_base64) ==
+                    strlen(keystore->hash_key_base64) &&
+                sodium_memcmp(hash_key_base64, keystore->hash_key_base64,
+                              strlen(hash_key_base64)) == 0;
+    secFree(hash_key_base64);
+    if (!match) {
+      secFree(keys.encryption_key);
+      oidc_errno = OIDC_EPASS;
+      return oidc_errno;
+    }
+  }
+  keystore->key = (unsigned char*)keys.encryption_key;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief creates a new empty keystore
+ * The keystore is only written with @c keystore_save.
+ * @param filepath the path of the keystore file
+ * @param password the password the keystore is encrypted with
+ * @return the keystore; has to be closed with @c keystore_close
+ */
+struct keystore* keystore_create(const char* filepath, const char* password) {
+  if (filepath == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct keystore* keystore = _newKeystore(filepath);
+  keystore->params          = kdfConfig_getParameters();
+  if (_deriveKey(keystore, password, 1) != OIDC_SUCCESS) {
+    keystore_close(keystore);
+    return NULL;
+  }
+  return keystore;
+}
+
+static oidc_error_t _readIndex(struct keystore* keystore, list_t* lines) {
+  char* index_str = _unseal(list_at(lines, KEYSTORE_HEADER_LINES - 1)->val,
+                            KEYSTORE_FORMAT, keystore->key);
+  if (index_str == NULL) {
+    return oidc_errno;
+  }
+  cJSON* index = stringToJson(index_str);
+  secFree(index_str);
+  if (index == NULL || !cJSON_IsArray(index) ||
+      (size_t)cJSON_GetArraySize(index) + KEYSTORE_HEADER_LINES !=
+          lines->len) {
+    secFreeJson(index);
+    oidc_errno = OIDC_ECRYPM;
+    return oidc_errno;
+  }
+  size_t i = KEYSTORE_HEADER_LINES;
+  cJSON* entry;
+  cJSON_ArrayForEach(entry, index) {
+    struct keystoreRecord* record = secAlloc(sizeof(struct keystoreRecord));
+    record->name   = getJSONValue(entry, KEYSTORE_KEY_NAME);
+    record->issuer = getJSONValue(entry, KEYSTORE_KEY_ISSUER);
+    char* mtime    = getJSONValue(entry, KEYSTORE_KEY_MTIME);
+    record->mtime  = mtime ? strToULong(mtime) : 0;
+    secFree(mtime);
+    record->sealed = oidc_strcopy(list_at(lines, i++)->val);
+    list_rpush(keystore->records, list_node_new(record));
+  }
+  secFreeJson(index);
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief opens a keystore file
+ * Only the index is decrypted; the records are decrypted on request.
+ * @param filepath the path of the keystore file
+ * @param password the password the keystore is encrypted with
+ * @return the keystore or @c NULL on failure; has to be closed with
+ * @c keystore_close
+ */
+struct keystore* keystore_open(const char* filepath, const char* password) {
+  if (filepath == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!fileDoesExist(filepath)) {
+    oidc_errno = OIDC_EFNEX;
+    return NULL;
+  }
+  list_t* lines = getLinesFromFile(filepath);
+  if (lines == NULL) {
+    return NULL;
+  }
+  if (lines->len < KEYSTORE_HEADER_LINES ||
+      !strequal(list_at(lines, 0)->val, KEYSTORE_FORMAT)) {
+    secFreeList(lines);
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  struct keystore*       keystore = _newKeystore(filepath);
+  struct cryptParameter* p        = &keystore->params;
+  if (sscanf(list_at(lines, 1)->val, "%lu:%lu:%lu:%lu:%d:%d:%d:%d",
+             &p->nonce_len, &p->salt_len, &p->mac_len, &p->key_len,
+             &p->base64_variant, &p->hash_ops_limit, &p->hash_mem_limit,
+             &p->hash_alg) != 8 ||
+      p->key_len != crypto_aead_xchacha20poly1305_ietf_KEYBYTES ||
+      p->salt_len != crypto_pwhash_SALTBYTES) {
+    secFreeList(lines);
+    keystore_close(keystore);
+    oidc_errno = OIDC_ECRYPM;
+    return NULL;
+  }
+  keystore->salt_base64     = oidc_strcopy(list_at(lines, 2)->val);
+  keystore->hash_key_base64 = oidc_strcopy(list_at(lines, 3)->val);
+  if (_deriveKey(keystore, password, 0) != OIDC_SUCCESS ||
+      _readIndex(keystore, lines) != OIDC_SUCCESS) {
+    secFreeList(lines);
+    keystore_close(keystore);
+    return NULL;
+  }
+  secFreeList(lines);
+  return keystore;
+}
+
+void keystore_close(struct keystore* keystore) {
+  if (keystore == NULL) {
+    return;
+  }
+  secFree(keystore->path);
+  secFree(keystore->salt_base64);
+  secFree(keystore->hash_key_base64);
+  secFree(keystore->key);
+  secFreeList(keystore->records);
+  secFree(keystore);
+}
+
+/**
+ * @brief returns the names of the accounts in @p keystore
+ * @return a list of strings; has to be freed after usage
+ */
+list_t* keystore_listAccounts(const struct keystore* keystore) {
+  if (keystore == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  list_t* names = createList(1, NULL);
+  for (list_node_t* node = keystore->records->head; node; node = node->next) {
+    struct keystoreRecord* record = node->val;
+    list_rpush(names, list_node_new(oidc_strcopy(record->name)));
+  }
+  return names;
+}
+
+/**
+ * @brief decrypts the config of an account in @p keystore
+ * @return the account config or @c NULL if it is not in the keystore; has to
+ * be freed after usage
+ */
+char* keystore_getAccount(const struct keystore* keystore,
+                          const char*            shortname) {
+  if (keystore == NULL || shortname == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct keystoreRecord* record = _findRecord(keystore, shortname);
+  if (record == NULL) {
+    oidc_errno = OIDC_ENOACCOUNT;
+    return NULL;
+  }
+  return _unseal(record->sealed, record->name, keystore->key);
+}
+
+/**
+ * @brief adds an account config to @p keystore or replaces it
+ * The keystore is only written with @c keystore_save.
+ */
+oidc_error_t keystore_putAccount(struct keystore* keystore,
+                                 const char* shortname, const char* config) {
+  if (keystore == NULL || shortname == NULL || config == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct keystoreRecord* record = _findRecord(keystore, shortname);
+  if (record == NULL) {
+    record       = secAlloc(sizeof(struct keystoreRecord));
+    record->name = oidc_strcopy(shortname);
+    list_rpush(keystore->records, list_node_new(record));
+  }
+  secFree(record->issuer);
+  secFree(record->sealed);
+  record->issuer = getJSONValueFromString(config, AGENT_KEY_ISSUERURL);
+  record->mtime  = time(NULL);
+  record->sealed = _seal(config, shortname, keystore->key);
+  return OIDC_SUCCESS;
+}
+
+static char* _indexToString(const struct keystore* keystore) {
+  cJSON* index = cJSON_CreateArray();
+  for (list_node_t* node = keystore->records->head; node; node = node->next) {
+    struct keystoreRecord* record = node->val;
+    cJSON*                 entry  = cJSON_CreateObject();
+    jsonAddStringValue(entry, KEYSTORE_KEY_NAME, record->name);
+    if (record->issuer) {
+      jsonAddStringValue(entry, KEYSTORE_KEY_ISSUER, record->issuer);
+    }
+    jsonAddNumberValue(entry, KEYSTORE_KEY_MTIME, record->mtime);
+    cJSON_AddItemToArray(index, entry);
+  }
+  char* str = jsonToStringUnformatted(index);
+  secFreeJson(index);
+  return str;
+}
+
+/**
+ * @brief writes @p keystore to its file
+ * The index is sealed with a new nonce; unchanged records are written as they
+ * are.
+ * @return an oidc_error code
+ */
+oidc_error_t keystore_save(const struct keystore* keystore) {
+  if (keystore == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  char* params    = _paramsToString(&keystore->params);
+  char* index_str = _indexToString(keystore);
+  char* index     = _seal(index_str, KEYSTORE_FORMAT, keystore->key);
+  secFree(index_str);
+  list_t* lines =
+      createList(1, KEYSTORE_FORMAT, params, keystore->salt_base64,
+                 keystore->hash_key_base64, index, NULL);
+  secFree(params);
+  secFree(index);
+  for (list_node_t* node = keystore->records->head; node; node = node->next) {
+    struct keystoreRecord* record = node->val;
+    list_rpush(lines, list_node_new(oidc_strcopy(record->sealed)));
+  }
+  char* content = listToDelimitedString(lines, "\n");
+  secFreeList(lines);
+  logger(DEBUG, "Write keystore %s", keystore->path);
+  oidc_error_t e = writeFileAtomic(keystore->path, content);
+  secFree(content);
+  return e;
+}
+
+/**
+ * @brief checks if there is a keystore in the oidc dir
+ */
+int keystore_exists() { return oidcFileDoesExist(KEYSTORE_FILENAME); }
+
+/**
+ * The keystore of the oidc dir that was opened last. It is only kept if the
+ * process asked for it with @c keystore_keepOpen, so that short lived clients
+ * can decrypt many accounts with a single key derivation; long running
+ * processes do not hold the key longer than needed.
+ */
+static unsigned char    keepOpen       = 0;
+static struct keystore* cached         = NULL;
+static char*            cachedPassword = NULL;
+static time_t           cachedMtime    = 0;
+
+static time_t _mtime(const char* path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? st.st_mtime : 0;
+}
+
+static void _dropCached() {
+  keystore_close(cached);
+  secFree(cachedPassword);
+  cached         = NULL;
+  cachedPassword = NULL;
+}
+
+/**
+ * @brief sets if the keystore of the oidc dir is kept open after usage
+ */
+void keystore_keepOpen(unsigned char keep) {
+  keepOpen = keep;
+  if (!keep) {
+    _dropCached();
+  }
+}
+
+static struct keystore* _openOidcKeystore(const char* password) {
+  char*  path  = concatToOidcDir(KEYSTORE_FILENAME);
+  time_t mtime = _mtime(path);
+  if (cached && strequal(cachedPassword, password) && cachedMtime == mtime) {
+    secFree(path);
+    return cached;
+  }
+  struct keystore* keystore = keystore_open(path, password);
+  secFree(path);
+  if (keystore && keepOpen) {
+    _dropCached();
+    cached         = keystore;
+    cachedPassword = oidc_strcopy(password);
+    cachedMtime    = mtime;
+  }
+  return keystore;
+}
+
+static void _releaseOidcKeystore(struct keystore* keystore) {
+  if (keystore != cached) {
+    keystore_close(keystore);
+  }
+}
+
+/**
+ * @brief decrypts the index of the keystore in the oidc dir
+ * Can be used as decrypt function with the password prompts.
+ * @param filename unused; the keystore is always @c KEYSTORE_FILENAME
+ * @return a JSON array of the accounts with name, issuer and mtime; has to be
+ * freed after usage
+ */
+char* keystore_decryptIndex(const char* filename __attribute__((unused)),
+                            const char* password) {
+  if (password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct keystore* keystore = _openOidcKeystore(password);
+  if (keystore == NULL) {
+    return NULL;
+  }
+  char* index = _indexToString(keystore);
+  _releaseOidcKeystore(keystore);
+  return index;
+}
+
+/**
+ * @brief decrypts the config of an account from the keystore in the oidc dir
+ * @return the account config; has to be freed after usage
+ */
+char* keystore_decryptAccount(const char* shortname, const char* password) {
+  if (shortname == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  struct keystore* keystore = _openOidcKeystore(password);
+  if (keystore == NULL) {
+    return NULL;
+  }
+  char* config = keystore_getAccount(keystore, shortname);
+  _releaseOidcKeystore(keystore);
+  return config;
+}
+
+/**
+ * @brief replaces the config of an account in the keystore in the oidc dir
+ * @return an oidc_error code
+ */
+oidc_error_t keystore_updateAccount(const char* shortname, const char* config,
+                                    const char* password) {
+  if (shortname == NULL || config == NULL || password == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  struct keystore* keystore = _openOidcKeystore(password);
+  if (keystore == NULL) {
+    return oidc_errno;
+  }
+  oidc_error_t e = keystore_putAccount(keystore, shortname, config);
+  if (e == OIDC_SUCCESS) {
+    e = keystore_save(keystore);
+  }
+  if (keystore == cached) {
+    cachedMtime = _mtime(keystore->path);
+  }
+  _releaseOidcKeystore(keystore);
+  return e;
+}
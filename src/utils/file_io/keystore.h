@@ -0,0 +1,32 @@
+#ifndef OIDC_KEYSTORE_H
+#define OIDC_KEYSTORE_H
+
+#include "utils/oidc_error.h"
+#include "wrapper/list.h"
+
+// the keys of the index entries
+#define KEYSTORE_KEY_NAME "name"
+#define KEYSTORE_KEY_ISSUER "issuer"
+#define KEYSTORE_KEY_MTIME "mtime"
+
+struct keystore;
+
+int              keystore_exists();
+struct keystore* keystore_create(const char* filepath, const char* password);
+struct keystore* keystore_open(const char* filepath, const char* password);
+void             keystore_close(struct keystore* keystore);
+list_t*          keystore_listAccounts(const struct keystore* keystore);
+char*            keystore_getAccount(const struct keystore* keystore,
+                                     const char*            shortname);
+oidc_error_t     keystore_putAccount(struct keystore* keystore,
+                                     const char* shortname, const char* config);
+oidc_error_t     keystore_save(const struct keystore* keystore);
+
+void         keystore_keepOpen(unsigned char keep);
+char*        keystore_decryptIndex(const char* filename, const char* password);
+char*        keystore_decryptAccount(const char* shortname,
+                                     const char* password);
+oidc_error_t keystore_updateAccount(const char* shortname, const char* config,
+                                    const char* password);
+
+#endif  // OIDC_KEYSTORE_H
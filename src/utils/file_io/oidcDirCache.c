@@ -0,0 +1,313 @@
+#include "oidcDirCache.h"
+#include "file_io.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * Keeps the files of the oidc dir and its listing in memory, for oidc dirs on
+ * network file systems, e.g. a home directory on NFS, where every open, read,
+ * and stat is a round trip to the file server. The files are read and written
+ * through file_io.c, which uses the cache for all files directly in the
+ * directory the cache was enabled for.
+ *
+ * An entry is used without any syscall for @c lease seconds after it was
+ * validated; then a single stat validates it again and the file is only read
+ * again if its inode, size, mtime, or ctime changed. Files are replaced
+ * atomically by a rename, so a new version also has a new inode, even if it
+ * was written within the same second. The listing is validated the same way
+ * with a stat of the directory, whose mtime changes when a file is created,
+ * renamed, or removed.
+ *
+ * Content written by this process is kept right away, even while the write is
+ * pending in a batch; it is read back once after the lease. Files changed by
+ * another process are seen at the latest after the lease, or earlier if the
+ * config watcher reports the change. The cache is disabled by default and is
+ * not shared between processes.
+ */
+
+struct fileStamp {
+  unsigned char known;
+  ino_t         ino;
+  off_t         size;
+  time_t        mtime;
+  time_t        ctime;
+};
+
+struct cachedFile {
+  char*            path;
+  unsigned char*   data;
+  size_t           len;
+  unsigned char    exists;
+  unsigned char    loaded;  // if data is the content of the file
+  struct fileStamp stamp;
+  time_t           validated;
+};
+
+struct cachedDir {
+  char*            path;
+  list_t*          files;  // as listed by the loader
+  struct fileStamp stamp;
+  time_t           validated;
+};
+
+static time_t           lease   = 0;
+static char*            scope   = NULL;  // the cached directory with a slash
+static list_t*          entries = NULL;  // of struct cachedFile
+static struct cachedDir dir     = {};
+
+static void _secFreeCachedFile(struct cachedFile* f) {
+  secFree(f->path);
+  secFree(f->data);
+  secFree(f);
+}
+
+static int _matchCachedFileByPath(const char*              path,
+                                  const struct cachedFile* f) {
+  return strequal(path, f->path);
+}
+
+static void _setStamp(struct fileStamp* stamp, const struct stat* st) {
+  stamp->known = 1;
+  stamp->ino   = st->st_ino;
+  stamp->size  = st->st_size;
+  stamp->mtime = st->st_mtime;
+  stamp->ctime = st->st_ctime;
+}
+
+static int _stampMatches(const struct fileStamp* stamp,
+                         const struct stat*      st) {
+  return stamp->known && stamp->ino == st->st_ino &&
+         stamp->size == st->st_size && stamp->mtime == st->st_mtime &&
+         stamp->ctime == st->st_ctime;
+}
+
+static int _isValid(time_t validated, time_t now) {
+  return now >= validated && now - validated < lease;
+}
+
+static void _dropData(struct cachedFile* f) {
+  secFree(f->data);
+  f->len    = 0;
+  f->loaded = 0;
+}
+
+static void _dropDir() {
+  secFree(dir.path);
+  secFreeList(dir.files);
+  dir = (struct cachedDir){};
+}
+
+static struct cachedFile* _findOrAdd(const char* path) {
+  list_node_t* node = findInList(entries, path);
+  if (node) {
+    return node->val;
+  }
+  struct cachedFile* f = secAlloc(sizeof(struct cachedFile));
+  f->path              = oidc_strcopy(path);
+  list_rpush(entries, list_node_new(f));
+  return f;
+}
+
+/**
+ * @brief enables the cache for the files directly in @p dirname
+ * @param dirname the oidc dir
+ * @param lease_time the number of seconds a validated entry is used without
+ * validating it again; @c 0 disables the cache
+ */
+void oidcDirCache_enable(const char* dirname, time_t lease_time) {
+  secFree(scope);
+  lease = dirname ? lease_time : 0;
+  oidcDirCache_clear();
+  if (lease == 0) {
+    return;
+  }
+  scope = withTrailingSlash(dirname);
+  logger(DEBUG, "Caching '%s' with a lease of %lu seconds", scope,
+         (unsigned long)lease);
+}
+
+/**
+ * @brief checks if @p path is a file directly in the cached directory or the
+ * directory itself, with a trailing slash
+ */
+int oidcDirCache_covers(const char* path) {
+  return lease > 0 && path && strstarts(path, scope) &&
+         strchr(path + strlen(scope), '/') == NULL;
+}
+
+/**
+ * @brief returns the validated entry for @p path
+ * @param load reads the file if it was not read yet; @c NULL if the content is
+ * not needed
+ * @return the entry or @c NULL if the file could not be read; @c oidc_errno
+ * is set then
+ */
+static struct cachedFile* _get(const char* path,
+                               unsigned char* (*load)(const char*, size_t*)) {
+  const time_t       now  = time(NULL);
+  list_node_t*       node = findInList(entries, path);
+  struct cachedFile* f    = node ? node->val : NULL;
+  if (f && _isValid(f->validated, now) &&
+      (f->loaded || !f->exists || load == NULL)) {
+    return f;
+  }
+  if (f == NULL) {
+    f = _findOrAdd(path);
+  }
+  if (!f->stamp.known) {  // e.g. written by this process
+    fileIO_commitPendingWriteTo(path);
+  }
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    _dropData(f);
+    f->exists      = 0;
+    f->stamp.known = 0;
+  } else if (!f->exists || !_stampMatches(&f->stamp, &st)) {
+    logger(DEBUG, "oidc dir cache: '%s' changed", path);
+    _dropData(f);
+    f->exists = 1;
+    _setStamp(&f->stamp, &st);
+  }
+  f->validated = now;
+  if (load && f->exists && !f->loaded) {
+    f->data = load(path, &f->len);
+    if (f->data == NULL) {
+      oidcDirCache_invalidate(path);
+      return NULL;
+    }
+    f->loaded = 1;
+  }
+  return f;
+}
+
+/**
+ * @brief reads a file through the cache
+ * @param len is set to the number of bytes read
+ * @param load reads the file, if it is not cached or changed
+ * @return the content, followed by a null byte; has to be freed after usage.
+ * On failure NULL is returned and oidc_errno is set.
+ */
+unsigned char* oidcDirCache_read(const char* path, size_t* len,
+                                 unsigned char* (*load)(const char*, size_t*)) {
+  if (path == NULL || len == NULL || load == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  const struct cachedFile* f = _get(path, load);
+  if (f == NULL) {
+    return NULL;
+  }
+  if (!f->exists) {
+    oidc_errno = OIDC_EFOPEN;
+    return NULL;
+  }
+  unsigned char* data = secAlloc(f->len + 1);
+  if (data == NULL) {
+    return NULL;
+  }
+  memcpy(data, f->data, f->len);
+  *len = f->len;
+  return data;
+}
+
+/**
+ * @brief checks through the cache if a file exists
+ * @return 1 if the file does exist, 0 if not
+ */
+int oidcDirCache_exists(const char* path) {
+  const struct cachedFile* f = _get(path, NULL);
+  return f ? f->exists : 0;
+}
+
+/**
+ * @brief keeps the content this process wrote to @p path
+ * The file is validated after the lease; until then the written content is
+ * used, even if the write is still pending in a batch.
+ */
+void oidcDirCache_written(const char* path, const void* data, size_t len) {
+  struct cachedFile* f = _findOrAdd(path);
+  _dropData(f);
+  f->data = secAlloc(len + 1);
+  if (f->data == NULL) {
+    oidcDirCache_invalidate(path);
+    return;
+  }
+  memcpy(f->data, data, len);
+  f->len         = len;
+  f->loaded      = 1;
+  f->exists      = 1;
+  f->stamp.known = 0;
+  f->validated   = time(NULL);
+  _dropDir();  // it might be a new file
+}
+
+/**
+ * @brief drops the entry of @p path, because the file was removed or changed
+ * by another process
+ */
+void oidcDirCache_invalidate(const char* path) {
+  list_node_t* node = path ? findInList(entries, path) : NULL;
+  if (node) {
+    list_remove(entries, node);
+  }
+  _dropDir();
+}
+
+/**
+ * @brief lists a directory through the cache
+ * @param dirname the path of the directory
+ * @param load lists the files of @p dirname; the list is kept by the cache
+ * and is freed with its @c free function
+ * @return the list of @p load; MUST NOT be freed or modified. @c NULL if the
+ * directory could not be listed; @c oidc_errno is set then
+ */
+const list_t* oidcDirCache_listDir(const char* dirname,
+                                   list_t* (*load)(const char*)) {
+  const time_t now = time(NULL);
+  if (dir.files && strequal(dirname, dir.path) &&
+      _isValid(dir.validated, now)) {
+    return dir.files;
+  }
+  struct stat st;
+  if (stat(dirname, &st) != 0) {
+    oidc_setErrnoError();
+    _dropDir();
+    return NULL;
+  }
+  if (dir.files && strequal(dirname, dir.path) &&
+      _stampMatches(&dir.stamp, &st)) {
+    dir.validated = now;
+    return dir.files;
+  }
+  _dropDir();
+  logger(DEBUG, "oidc dir cache: listing '%s'", dirname);
+  list_t* files = load(dirname);
+  if (files == NULL) {
+    return NULL;
+  }
+  dir.path      = oidc_strcopy(dirname);
+  dir.files     = files;
+  dir.validated = now;
+  _setStamp(&dir.stamp, &st);
+  return dir.files;
+}
+
+/**
+ * @brief drops all entries, e.g. because configs changed
+ */
+void oidcDirCache_clear() {
+  secFreeList(entries);
+  entries = NULL;
+  _dropDir();
+  if (lease > 0) {
+    entries        = list_new();
+    entries->free  = (void (*)(void*))_secFreeCachedFile;
+    entries->match = (matchFunction)_matchCachedFileByPath;
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef OIDC_DIR_CACHE_H
+#define OIDC_DIR_CACHE_H
+
+#include "wrapper/list.h"
+
+#include <stddef.h>
+#include <time.h>
+
+void           oidcDirCache_enable(const char* dirname, time_t lease);
+int            oidcDirCache_covers(const char* path);
+unsigned char* oidcDirCache_read(const char* path, size_t* len,
+                                 unsigned char* (*load)(const char*, size_t*));
+int            oidcDirCache_exists(const char* path);
+void oidcDirCache_written(const char* path, const void* data, size_t len);
+void oidcDirCache_invalidate(const char* path);
+void oidcDirCache_clear();
+const list_t* oidcDirCache_listDir(const char* dirname,
+                                   list_t* (*load)(const char*));
+
+#endif  // OIDC_DIR_CACHE_H
@@ -28,6 +28,7 @@ char* readOidcFile(const char* filename) {
 
 /** @fn void writeOidcFile(const char* filename, const char* text)
  * @brief writes text to a file located in the oidc directory
+ * The file is replaced atomically, see @c writeFileAtomic.
  * @note \p text has to be nullterminated and must not contain nullbytes.
  * @param filename the file to be written
  * @param text the nullterminated text to be written
@@ -36,7 +37,7 @@ char* readOidcFile(const char* filename) {
  */
 oidc_error_t writeOidcFile(const char* filename, const char* text) {
   char*        path = concatToOidcDir(filename);
-  oidc_error_t er   = writeFile(path, text);
+  oidc_error_t er   = writeFileAtomic(path, text);
   secFree(path);
   return er;
 }
@@ -95,12 +96,23 @@ list_t* getPossibleOidcDirLocations() {
   return possibleLocations;
 }
 
-/** @fn char* getOidcDir()
- * @brief get the oidc directory path
- * @return a pointer to the oidc directory path. Has to be freed after usage. If
- * no oidc dir is found, NULL is returned
+/**
+ * The resolved oidc directory is cached for the lifetime of the process. It
+ * only depends on the environment and on which of the possible directories
+ * exist; the cache is dropped if the relevant environment variables change or
+ * the directory is created by this process.
  */
-char* getOidcDir() {
+static char* cachedOidcDir = NULL;
+static char* cachedEnvDir  = NULL;
+static char* cachedHomeDir = NULL;
+
+void resetOidcDirCache() {
+  secFree(cachedOidcDir);
+  secFree(cachedEnvDir);
+  secFree(cachedHomeDir);
+}
+
+static char* _resolveOidcDir() {
   list_t* possibleLocations = getPossibleOidcDirLocations();
   if (possibleLocations == NULL) {
     return NULL;
@@ -126,6 +138,38 @@ char* getOidcDir() {
   return NULL;
 }
 
+/**
+ * @brief returns the cached oidc directory, resolving it if needed
+ * @return a pointer to the path that MUST NOT be freed or @c NULL
+ */
+static const char* _getOidcDir() {
+  const char* envDir  = getenv(OIDC_CONFIG_DIR_ENV_NAME);
+  const char* homeDir = getenv("HOME");
+  if (cachedOidcDir && strequal(envDir, cachedEnvDir) &&
+      strequal(homeDir, cachedHomeDir)) {
+    return cachedOidcDir;
+  }
+  resetOidcDirCache();
+  char* dir = _resolveOidcDir();
+  if (dir == NULL) {
+    return NULL;
+  }
+  cachedOidcDir = dir;
+  cachedEnvDir  = envDir ? oidc_strcopy(envDir) : NULL;
+  cachedHomeDir = homeDir ? oidc_strcopy(homeDir) : NULL;
+  return cachedOidcDir;
+}
+
+/** @fn char* getOidcDir()
+ * @brief get the oidc directory path
+ * @return a pointer to the oidc directory path. Has to be freed after usage. If
+ * no oidc dir is found, NULL is returned
+ */
+char* getOidcDir() {
+  const char* dir = _getOidcDir();
+  return dir ? oidc_strcopy(dir) : NULL;
+}
+
 oidc_error_t createOidcDir() {
   list_t* possibleLocations = getPossibleOidcDirLocations();
   if (possibleLocations == NULL) {
@@ -167,6 +211,7 @@ oidc_error_t createOidcDir() {
     case OIDC_DIREXIST_OK: secFreeList(possibleLocations); return OIDC_SUCCESS;
   }
   logger(DEBUG, "Creating '%s' as oidcdir.", path);
+  resetOidcDirCache();
   oidc_error_t ret        = createDir(path);
   char* issuerconfig_path = oidc_sprintf("%s/%s", path, ISSUER_CONFIG_FILENAME);
   secFreeList(possibleLocations);
@@ -190,10 +235,7 @@ int removeOidcFile(const char* filename) {
 }
 
 char* concatToOidcDir(const char* filename) {
-  char* oidc_dir = getOidcDir();
-  char* path     = oidc_strcat(oidc_dir, filename);
-  secFree(oidc_dir);
-  return path;
+  return oidc_strcat(_getOidcDir(), filename);
 }
 
 list_t* getLinesFromOidcFile(const char* filename) {
@@ -209,33 +251,3 @@ list_t* getLinesFromOidcFileWithoutComments(const char* filename) {
   secFree(path);
   return ret;
 }
-
-/**
- * @brief updates the issuer.config file.
- * If the issuer url is not already in the issuer.config file, it will be added.
- * @param issuer_url the issuer url to be added
- * @param shortname will be used as the default account config for this issuer
- */
-void updateIssuerConfig(const char* issuer_url, const char* shortname) {
-  if (issuer_url == NULL || shortname == NULL) {
-    return;
-  }
-  char* issuers = readOidcFile(ISSUER_CONFIG_FILENAME);
-  char* new_issuers;
-  if (issuers) {
-    if (strSubStringCase(issuers, issuer_url)) {
-      secFree(issuers);
-      return;
-    }
-    new_issuers = oidc_sprintf("%s\n%s %s", issuers, issuer_url, shortname);
-    secFree(issuers);
-  } else {
-    new_issuers = oidc_sprintf("%s %s", issuer_url, shortname);
-  }
-  if (new_issuers == NULL) {
-    logger(ERROR, "%s", oidc_serror());
-  } else {
-    writeOidcFile(ISSUER_CONFIG_FILENAME, new_issuers);
-    secFree(new_issuers);
-  }
-}
@@ -1,6 +1,7 @@
 #include "promptCryptFileUtils.h"
 #include "utils/file_io/cryptFileUtils.h"
 #include "utils/file_io/file_io.h"
+#include "utils/file_io/keystore.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/memory.h"
 #include "utils/promptUtils.h"
@@ -78,7 +79,7 @@ struct resultWithEncryptionPassword getDecryptedOidcFileAndPasswordFor(
     oidc_setArgNullFuncError(__func__);
     return RESULT_WITH_PASSWORD_NULL;
   }
-  if (!oidcFileDoesExist(filename)) {
+  if (!oidcFileDoesExist(filename) && !keystore_exists()) {
     oidc_errno = OIDC_EFNEX;
     return RESULT_WITH_PASSWORD_NULL;
   }
@@ -92,6 +93,11 @@ char* getDecryptedFileFor(const char* filepath, const char* pw_cmd,
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  // no password is needed for files sealed to this host
+  char* sealed = decryptFileSealed(filepath);
+  if (sealed) {
+    return sealed;
+  }
   struct resultWithEncryptionPassword res =
       getDecryptedFileAndPasswordFor(filepath, pw_cmd, pw_file, pw_env);
   secFree(res.password);
@@ -104,6 +110,10 @@ char* getDecryptedOidcFileFor(const char* filename, const char* pw_cmd,
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
+  char* sealed = decryptOidcFileSealed(filename);
+  if (sealed) {
+    return sealed;
+  }
   struct resultWithEncryptionPassword res =
       getDecryptedOidcFileAndPasswordFor(filename, pw_cmd, pw_file, pw_env);
   secFree(res.password);
@@ -0,0 +1,14 @@
+#ifndef HTTP_OPTIONS_H
+#define HTTP_OPTIONS_H
+
+/**
+ * Limits for the https requests to an issuer. A value of @c 0 means that the
+ * default is used.
+ */
+struct http_options {
+  long          connect_timeout;  // seconds
+  long          timeout;          // seconds, for the whole request
+  unsigned char hedge;            // send a second request if one is slow
+};
+
+#endif  // HTTP_OPTIONS_H
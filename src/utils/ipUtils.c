@@ -1,13 +1,17 @@
 #define _POSIX_C_SOURCE 200112L
 #include "ipUtils.h"
 
+#include "utils/listUtils.h"
+#include "utils/logger.h"
 #include "utils/memory.h"
+#include "utils/oidc_error.h"
 #include "utils/stringUtils.h"
 
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 int isValidIP(const char* ipAddress) {
   if (ipAddress == NULL) {
@@ -60,3 +64,136 @@ int isValidIPOrHostnameOptionalPort(const char* iph) {
   secFree(tmp);
   return ret;
 }
+
+/**
+ * Resolved hostnames of remote agents, so that repeated requests from the same
+ * process do not wait for the resolver each time. getaddrinfo does not tell
+ * the ttl of the dns records, so entries are kept for @c RESOLVER_CACHE_TTL
+ * seconds.
+ */
+struct resolver_entry {
+  char*                   host;
+  struct resolved_address addrs[RESOLVER_MAX_ADDRESSES];
+  size_t                  count;
+  time_t                  expires_at;
+};
+
+static list_t* resolverCache = NULL;
+
+static void _secFreeResolverEntry(struct resolver_entry* e) {
+  secFree(e->host);
+  secFree(e);
+}
+
+static int _matchResolverEntry(const char* host,
+                               const struct resolver_entry* e) {
+  return strequal(e->host, host);
+}
+
+/**
+ * @brief copies the results of getaddrinfo, alternating between the address
+ * families
+ * If a host has IPv6 and IPv4 addresses, trying them in this order means that
+ * a broken IPv6 route only costs one failed connection attempt.
+ */
+static size_t _copyInterleaved(const struct addrinfo* res,
+                               struct resolved_address* addrs, size_t max) {
+  const struct addrinfo* v6[RESOLVER_MAX_ADDRESSES];
+  const struct addrinfo* v4[RESOLVER_MAX_ADDRESSES];
+  size_t                 n6 = 0, n4 = 0;
+  for (const struct addrinfo* p = res; p != NULL; p = p->ai_next) {
+    if (p->ai_addrlen > sizeof(struct sockaddr_storage)) {
+      continue;
+    }
+    if (p->ai_family == AF_INET6 && n6 < RESOLVER_MAX_ADDRESSES) {
+      v6[n6++] = p;
+    } else if (p->ai_family == AF_INET && n4 < RESOLVER_MAX_ADDRESSES) {
+      v4[n4++] = p;
+    }
+  }
+  size_t count = 0;
+  for (size_t i = 0; count < max && (i < n6 || i < n4); i++) {
+    const struct addrinfo* pick[] = {i < n6 ? v6[i] : NULL,
+                                     i < n4 ? v4[i] : NULL};
+    for (size_t j = 0; j < 2 && count < max; j++) {
+      if (pick[j]) {
+        memcpy(&addrs[count].addr, pick[j]->ai_addr, pick[j]->ai_addrlen);
+        addrs[count].len = pick[j]->ai_addrlen;
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+static struct resolver_entry* _resolve(const char* host) {
+  time_t now = time(NULL);
+  if (resolverCache == NULL) {
+    resolverCache        = list_new();
+    resolverCache->free  = (void (*)(void*))_secFreeResolverEntry;
+    resolverCache->match = (matchFunction)_matchResolverEntry;
+  }
+  list_node_t* node = findInList(resolverCache, host);
+  if (node) {
+    struct resolver_entry* e = node->val;
+    if (e->expires_at > now) {
+      return e;
+    }
+    list_remove(resolverCache, node);
+  }
+  struct addrinfo  hints = {.ai_family   = AF_UNSPEC,
+                            .ai_socktype = SOCK_STREAM,
+                            .ai_flags    = AI_ADDRCONFIG};
+  struct addrinfo* res   = NULL;
+  int              err   = getaddrinfo(host, NULL, &hints, &res);
+  if (err != 0) {
+    logger(NOTICE, "Could not resolve '%s': %s", host, gai_strerror(err));
+    oidc_seterror(gai_strerror(err));
+    oidc_errno = OIDC_EERROR;
+    return NULL;
+  }
+  struct resolver_entry* e = secAlloc(sizeof(struct resolver_entry));
+  e->host                  = oidc_strcopy(host);
+  e->count      = _copyInterleaved(res, e->addrs, RESOLVER_MAX_ADDRESSES);
+  e->expires_at = now + RESOLVER_CACHE_TTL;
+  freeaddrinfo(res);
+  list_rpush(resolverCache, list_node_new(e));
+  return e;
+}
+
+/**
+ * @brief resolves a hostname or ip address to socket addresses
+ * Results are cached for @c RESOLVER_CACHE_TTL seconds. IPv6 and IPv4
+ * addresses are returned alternately.
+ * @param port the port to set in the returned addresses
+ * @param addrs an array where the addresses are stored
+ * @param max the size of @p addrs
+ * @return the number of addresses stored in @p addrs; @c 0 if the host could
+ * not be resolved
+ */
+size_t resolveHost(const char* host, unsigned short port,
+                   struct resolved_address* addrs, size_t max) {
+  if (host == NULL || addrs == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return 0;
+  }
+  struct resolver_entry* e = _resolve(host);
+  if (e == NULL) {
+    return 0;
+  }
+  size_t count = e->count < max ? e->count : max;
+  for (size_t i = 0; i < count; i++) {
+    addrs[i] = e->addrs[i];
+    if (addrs[i].addr.ss_family == AF_INET6) {
+      ((struct sockaddr_in6*)&addrs[i].addr)->sin6_port = htons(port);
+    } else {
+      ((struct sockaddr_in*)&addrs[i].addr)->sin_port = htons(port);
+    }
+  }
+  return count;
+}
+
+void resolver_clearCache() {
+  secFreeList(resolverCache);
+  resolverCache = NULL;
+}
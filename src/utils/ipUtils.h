@@ -1,9 +1,25 @@
 #ifndef OIDC_IP_UTILS_H
 #define OIDC_IP_UTILS_H
 
+#include <stddef.h>
+#include <sys/socket.h>
+
+/** seconds a resolved hostname is cached */
+#define RESOLVER_CACHE_TTL 60
+/** maximum number of addresses kept per hostname */
+#define RESOLVER_MAX_ADDRESSES 8
+
+struct resolved_address {
+  struct sockaddr_storage addr;
+  socklen_t               len;
+};
+
 int   isValidIP(const char* ipAddress);
 char* hostnameToIP(const char* hostname);
 int   isValidIPOrHostname(const char* iph);
 int   isValidIPOrHostnameOptionalPort(const char* iph);
+size_t resolveHost(const char* host, unsigned short port,
+                   struct resolved_address* addrs, size_t max);
+void   resolver_clearCache();
 
 #endif /* OIDC_IP_UTILS_H */
@@ -1,12 +1,17 @@
 #include "json.h"
 
+#include "jsonScanner.h"
 #include "listUtils.h"
+#include "memory.h"
+#include "memoryArena.h"
 #include "oidc_error.h"
 #include "pass.h"
 #include "stringUtils.h"
 #include "utils/logger.h"
 
+#include <limits.h>
 #include <stdarg.h>
+#include <string.h>
 
 static cJSON_Hooks hooks;
 static int         jsonInitDone = 0;
@@ -15,9 +20,13 @@ static int         jsonInitDone = 0;
  * @brief initializes the cJSON memory allocator and deallocator if not done yet
  * @internal
  */
+static void* _secAllocJson(size_t size) {
+  return secAllocTagged(size, MEMTAG_JSON);
+}
+
 void initCJSON() {
   if (!jsonInitDone) {
-    hooks.malloc_fn = secAlloc;
+    hooks.malloc_fn = _secAllocJson;
     hooks.free_fn   = _secFree;
     cJSON_InitHooks(&hooks);
     jsonInitDone = 1;
@@ -39,10 +48,77 @@ char* jsonToString(cJSON* cjson) {
   return cJSON_Print(cjson);
 }
 
+/**
+ * @brief returns the length of @p s as an escaped json string, including the
+ * quotes
+ * @internal
+ */
+static size_t _escapedLength(const char* s) {
+  size_t len = 2;
+  for (; s && *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' ||
+        c == '\r' || c == '\t') {
+      len += 2;
+    } else if (c < 32) {
+      len += 6;  // \uXXXX
+    } else {
+      len++;
+    }
+  }
+  return len;
+}
+
+/**
+ * @brief returns an upper bound for the length of the unformatted string
+ * representation of @p item; numbers are assumed to take the 26 bytes cJSON
+ * reserves for them
+ * @internal
+ */
+static size_t _unformattedLength(const cJSON* item) {
+  switch (item->type & 0xFF) {
+    case cJSON_False: return 5;
+    case cJSON_True:
+    case cJSON_NULL: return 4;
+    case cJSON_Number: return 26;
+    case cJSON_String: return _escapedLength(item->valuestring);
+    case cJSON_Raw: return item->valuestring ? strlen(item->valuestring) : 0;
+    case cJSON_Array:
+    case cJSON_Object: {
+      size_t len = 2;
+      for (const cJSON* child = item->child; child; child = child->next) {
+        len += _unformattedLength(child) + 1;  // value and comma
+        if (cJSON_IsObject(item)) {
+          len += _escapedLength(child->string) + 1;  // key and colon
+        }
+      }
+      return len;
+    }
+    default: return 0;
+  }
+}
+
+/**
+ * @brief converts a cJSON object into a compact string
+ * The string is printed directly into a buffer of the estimated size, so it is
+ * neither formatted and minified again nor reallocated while it grows.
+ * @param cjson the cJSON object to be converted
+ * @return a pointer to a string representation of @p cjson. Has to be freed
+ * after usage.
+ */
 char* jsonToStringUnformatted(cJSON* cjson) {
-  char* json = jsonToString(cjson);
-  cJSON_Minify(json);
-  return json;
+  if (cjson == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  initCJSON();
+  size_t len = _unformattedLength(cjson) + 5;  // cJSON wants some spare bytes
+  char*  json = len <= INT_MAX ? secAllocTagged(len, MEMTAG_JSON) : NULL;
+  if (json == NULL || !cJSON_PrintPreallocated(cjson, json, len, 0)) {
+    secFree(json);
+    return cJSON_PrintUnformatted(cjson);
+  }
+  return secRealloc(json, strlen(json) + 1);  // shrinks in place
 }
 
 /**
@@ -137,13 +213,13 @@ int jsonStringHasKey(const char* json, const char* key) {
     oidc_setArgNullFuncError(__func__);
     return 0;
   }
-  initCJSON();
-  cJSON* cj = stringToJson(json);
-  if (cj == NULL) {
+  INIT_KEY_VALUE(key);
+  if (CALL_GETJSONVALUES(json) < 0) {
+    SEC_FREE_KEY_VALUES();
     return 0;
   }
-  int res = jsonHasKey(cj, key);
-  secFreeJson(cj);
+  int res = strValid(pairs[0].value);
+  SEC_FREE_KEY_VALUES();
   return res;
 }
 
@@ -277,31 +353,92 @@ oidc_error_t getJSONValues(const cJSON* cjson, struct key_value* pairs,
   return i;
 }
 
+static char* _moveToArena(char* value, struct secArena* arena) {
+  if (arena == NULL || value == NULL) {
+    return value;
+  }
+  char* copy = secArena_strncopy(arena, value, strlen(value));
+  secFree(value);
+  return copy;
+}
+
 /**
- * @brief gets multiple values from a json string
- * @param json the json string to be parsed
- * @param pairs an array of key_value pairs. The keys are used as keys. A
- * pointer to the result is stored in the value field. The previous pointer is
- * not freed, thus it should be NULL.
- * @param size the number of key value pairs
- * @return the number of set values or an error code on failure
+ * @brief returns the value of a scanned json value as string
+ * Objects and arrays are printed by cJSON, so the result is the same as with
+ * @c getJSONItemValue.
+ * @internal
  */
-oidc_error_t getJSONValuesFromString(const char* json, struct key_value* pairs,
-                                     size_t size) {
+static char* _getJSONViewValue(const struct json_view* view,
+                               struct secArena*        arena) {
+  if (view->type != JSON_VIEW_OBJECT && view->type != JSON_VIEW_ARRAY) {
+    return arena ? jsonViewToArenaString(view, arena) : jsonViewToString(view);
+  }
+  cJSON* item = cJSON_ParseWithLength(view->ptr, view->len);
+  if (item == NULL) {
+    return NULL;
+  }
+  char* value = getJSONItemValue(item);
+  secFreeJson(item);
+  return _moveToArena(value, arena);
+}
+
+static oidc_error_t _getJSONValuesFromString(const char*       json,
+                                             struct key_value* pairs,
+                                             size_t            size,
+                                             struct secArena*  arena) {
   if (NULL == json || NULL == pairs || size == 0) {
     oidc_setArgNullFuncError(__func__);
     return oidc_errno;
   }
   initCJSON();
+  struct json_view views[size];
+  if (jsonScanValues(json, pairs, views, size) == OIDC_SUCCESS) {
+    for (size_t i = 0; i < size; i++) {
+      pairs[i].value = _getJSONViewValue(&views[i], arena);
+    }
+    return size;
+  }
+  // Let cJSON handle (and report) everything the scanner does not accept
   cJSON* cj = stringToJson(json);
   if (cj == NULL) {
     return oidc_errno;
   }
   oidc_error_t e = getJSONValues(cj, pairs, size);
   secFreeJson(cj);
+  for (size_t i = 0; e >= 0 && i < size; i++) {
+    pairs[i].value = _moveToArena(pairs[i].value, arena);
+  }
   return e;
 }
 
+/**
+ * @brief gets multiple values from a json string
+ * The values are read with a single pass over @p json without building a
+ * cJSON tree; only the values of @p pairs are copied.
+ * @param json the json string to be parsed
+ * @param pairs an array of key_value pairs. The keys are used as keys. A
+ * pointer to the result is stored in the value field. The previous pointer is
+ * not freed, thus it should be NULL.
+ * @param size the number of key value pairs
+ * @return the number of set values or an error code on failure
+ */
+oidc_error_t getJSONValuesFromString(const char* json, struct key_value* pairs,
+                                     size_t size) {
+  return _getJSONValuesFromString(json, pairs, size, NULL);
+}
+
+/**
+ * @brief same as @c getJSONValuesFromString, but the values are allocated in
+ * @p arena
+ * The values must not be freed; they are valid until the arena is released.
+ */
+oidc_error_t getJSONValuesFromStringInArena(const char*       json,
+                                            struct key_value* pairs,
+                                            size_t            size,
+                                            struct secArena*  arena) {
+  return _getJSONValuesFromString(json, pairs, size, arena);
+}
+
 /**
  * @brief converts a cJSON JSONArray into a list
  * @param cjson the cJSON JSONArray
@@ -484,6 +621,23 @@ cJSON* listToJSONArray(list_t* list) {
   return json;
 }
 
+cJSON* vectorToJSONArray(const vector_t* vector) {
+  if (vector == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  initCJSON();
+  cJSON* json = cJSON_CreateArray();
+  if (json == NULL) {
+    oidc_seterror("Could not create json array");
+    return NULL;
+  }
+  for (size_t i = 0; i < vector->len; i++) {
+    cJSON_AddItemToArray(json, cJSON_CreateString(vector_at(vector, i)));
+  }
+  return json;
+}
+
 /**
  * @brief Generates a cJSON JSONObject from key, type, value tuples
  * @param k1 the key for the first element
@@ -2,7 +2,9 @@
 #define OIDC_JSON_H
 
 #include "key_value.h"
+#include "memoryArena.h"
 #include "oidc_error.h"
+#include "vector.h"
 
 #include "wrapper/cjson.h"
 #include "wrapper/list.h"
@@ -15,6 +17,10 @@ oidc_error_t getJSONValues(const cJSON* cjson, struct key_value* pairs,
                            size_t size);
 oidc_error_t getJSONValuesFromString(const char* json, struct key_value* pairs,
                                      size_t size);
+oidc_error_t getJSONValuesFromStringInArena(const char*       json,
+                                            struct key_value* pairs,
+                                            size_t            size,
+                                            struct secArena*  arena);
 
 int jsonHasKey(const cJSON* cjson, const char* key);
 int jsonStringHasKey(const char* json, const char* key);
@@ -29,6 +35,7 @@ list_t* JSONArrayStringToList(const char* json);
 char*   JSONArrayToDelimitedString(const cJSON* cjson, char* delim);
 char*   JSONArrayStringToDelimitedString(const char* json, char* delim);
 cJSON*  listToJSONArray(list_t* list);
+cJSON*  vectorToJSONArray(const vector_t* vector);
 
 cJSON*       generateJSONObject(const char* k1, int type1, const char* v1, ...);
 oidc_error_t setJSONValue(cJSON* cjson, const char* key, const char* value);
@@ -0,0 +1,425 @@
+#include "jsonScanner.h"
+#include "memory.h"
+#include "memoryArena.h"
+#include "oidc_error.h"
+#include "stringUtils.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A single-pass scanner for the top level of a json object. It does not build
+ * a tree and does not allocate; the requested values are returned as views into
+ * the original buffer and are only copied (and unescaped) on demand with
+ * @c jsonViewToString.
+ */
+
+#define JSON_SCAN_NESTING_LIMIT 1000
+#define JSON_SCAN_NUMBER_MAX_LEN 63
+
+static const char* _skipWhitespace(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') { p++; }
+  return p;
+}
+
+static int _hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static long _parseHex4(const char* p) {
+  long value = 0;
+  for (int i = 0; i < 4; i++) {
+    int h = _hexValue(p[i]);
+    if (h < 0) {
+      return -1;
+    }
+    value = (value << 4) | h;
+  }
+  return value;
+}
+
+/**
+ * @brief parses a @c \\u escape sequence including an utf-16 surrogate pair
+ * @param p points at the @c u
+ * @param codepoint where the decoded codepoint is stored
+ * @return the number of consumed characters after the backslash; @c 0 if the
+ * sequence is invalid
+ */
+static size_t _parseUnicodeEscape(const char* p, unsigned long* codepoint) {
+  long first = _parseHex4(p + 1);
+  if (first < 0 || (first >= 0xDC00 && first <= 0xDFFF)) {
+    return 0;
+  }
+  if (first < 0xD800 || first > 0xDBFF) {
+    *codepoint = first;
+    return 5;
+  }
+  if (p[5] != '\\' || p[6] != 'u') {
+    return 0;
+  }
+  long second = _parseHex4(p + 7);
+  if (second < 0xDC00 || second > 0xDFFF) {
+    return 0;
+  }
+  *codepoint = 0x10000 + (((first & 0x3FF) << 10) | (second & 0x3FF));
+  return 11;
+}
+
+/**
+ * @brief skips a json string
+ * @param p points at the opening quote
+ * @param escaped set to @c 1 if the string contains escape sequences
+ * @return a pointer after the closing quote; @c NULL if the string is invalid
+ */
+static const char* _skipString(const char* p, unsigned char* escaped) {
+  p++;
+  while (*p != '"') {
+    if (*p == '\0') {
+      return NULL;
+    }
+    if (*p == '\\') {
+      *escaped = 1;
+      p++;
+      unsigned long codepoint;
+      switch (*p) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't': break;
+        case 'u': {
+          size_t n = _parseUnicodeEscape(p, &codepoint);
+          if (n == 0) {
+            return NULL;
+          }
+          p += n - 1;
+          break;
+        }
+        default: return NULL;
+      }
+    }
+    p++;
+  }
+  return p + 1;
+}
+
+static const char* _skipNumber(const char* p) {
+  size_t len = strspn(p, "0123456789+-.eE");
+  if (len == 0 || len > JSON_SCAN_NUMBER_MAX_LEN) {
+    return NULL;
+  }
+  char buf[JSON_SCAN_NUMBER_MAX_LEN + 1];
+  memcpy(buf, p, len);
+  buf[len]  = '\0';
+  char* end = NULL;
+  strtod(buf, &end);
+  if (end == buf) {
+    return NULL;
+  }
+  return p + (end - buf);
+}
+
+static const char* _skipLiteral(const char* p) {
+  const char* literals[] = {"true", "false", "null"};
+  for (size_t i = 0; i < sizeof(literals) / sizeof(*literals); i++) {
+    size_t len = strlen(literals[i]);
+    if (strncmp(p, literals[i], len) == 0) {
+      return p + len;
+    }
+  }
+  return NULL;
+}
+
+static const char* _skipValue(const char* p, struct json_view* view,
+                              unsigned int depth);
+
+static const char* _skipContainer(const char* p, unsigned int depth) {
+  if (depth > JSON_SCAN_NESTING_LIMIT) {
+    return NULL;
+  }
+  const unsigned char isObject = *p == '{';
+  const char          close    = isObject ? '}' : ']';
+  p                            = _skipWhitespace(p + 1);
+  if (*p == close) {
+    return p + 1;
+  }
+  while (1) {
+    if (isObject) {
+      unsigned char escaped = 0;
+      if (*p != '"' || (p = _skipString(p, &escaped)) == NULL) {
+        return NULL;
+      }
+      p = _skipWhitespace(p);
+      if (*p != ':') {
+        return NULL;
+      }
+      p = _skipWhitespace(p + 1);
+    }
+    if ((p = _skipValue(p, NULL, depth + 1)) == NULL) {
+      return NULL;
+    }
+    p = _skipWhitespace(p);
+    if (*p == close) {
+      return p + 1;
+    }
+    if (*p != ',') {
+      return NULL;
+    }
+    p = _skipWhitespace(p + 1);
+  }
+}
+
+static const char* _skipValue(const char* p, struct json_view* view,
+                              unsigned int depth) {
+  struct json_view v   = {p, 0, JSON_VIEW_NONE, 0};
+  const char*      end = NULL;
+  switch (*p) {
+    case '"':
+      v.type = JSON_VIEW_STRING;
+      end    = _skipString(p, &v.escaped);
+      v.ptr  = p + 1;
+      break;
+    case '{':
+      v.type = JSON_VIEW_OBJECT;
+      end    = _skipContainer(p, depth);
+      break;
+    case '[':
+      v.type = JSON_VIEW_ARRAY;
+      end    = _skipContainer(p, depth);
+      break;
+    case 't':
+    case 'f':
+    case 'n':
+      v.type = JSON_VIEW_LITERAL;
+      end    = _skipLiteral(p);
+      break;
+    default:
+      v.type = JSON_VIEW_NUMBER;
+      end    = _skipNumber(p);
+  }
+  if (end == NULL) {
+    return NULL;
+  }
+  v.len = v.type == JSON_VIEW_STRING ? (size_t)(end - v.ptr - 1)
+                                     : (size_t)(end - v.ptr);
+  if (view) {
+    *view = v;
+  }
+  return end;
+}
+
+static struct json_view* _findView(const char* key, size_t key_len,
+                                   const struct key_value* pairs,
+                                   struct json_view* views, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (views[i].type == JSON_VIEW_NONE && pairs[i].key != NULL &&
+        strlen(pairs[i].key) == key_len &&
+        strncmp(pairs[i].key, key, key_len) == 0) {
+      return &views[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief scans a json object for the values of multiple keys
+ * Only the top level of the object is inspected; nested values are skipped.
+ * If a key occurs multiple times, the first occurrence is used.
+ * @param json the json string
+ * @param pairs an array of key_value pairs; only the keys are used
+ * @param views an array of @p size views, where the view for each key of
+ * @p pairs is stored
+ * @param size the number of key value pairs
+ * @return @c OIDC_SUCCESS on success; @c OIDC_EJSONOBJ if @p json is not a json
+ * object; @c OIDC_EJSONPARS if it could not be scanned
+ */
+oidc_error_t jsonScanValues(const char* json, const struct key_value* pairs,
+                            struct json_view* views, size_t size) {
+  if (NULL == json || NULL == pairs || NULL == views) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  for (size_t i = 0; i < size; i++) {
+    views[i] = (struct json_view){NULL, 0, JSON_VIEW_NONE, 0};
+  }
+  const char* p = _skipWhitespace(json);
+  if (*p != '{') {
+    oidc_errno = OIDC_EJSONOBJ;
+    return oidc_errno;
+  }
+  p = _skipWhitespace(p + 1);
+  if (*p == '}') {
+    return OIDC_SUCCESS;
+  }
+  while (1) {
+    unsigned char escaped = 0;
+    const char*   key     = p + 1;
+    if (*p != '"' || (p = _skipString(p, &escaped)) == NULL || escaped) {
+      // Escaped keys do not occur in our messages; leave them to cJSON
+      oidc_errno = OIDC_EJSONPARS;
+      return oidc_errno;
+    }
+    struct json_view* view = _findView(key, p - key - 1, pairs, views, size);
+    p                      = _skipWhitespace(p);
+    if (*p != ':') {
+      oidc_errno = OIDC_EJSONPARS;
+      return oidc_errno;
+    }
+    p = _skipValue(_skipWhitespace(p + 1), view, 1);
+    if (p == NULL) {
+      if (view) {
+        view->type = JSON_VIEW_NONE;
+      }
+      oidc_errno = OIDC_EJSONPARS;
+      return oidc_errno;
+    }
+    p = _skipWhitespace(p);
+    if (*p == '}') {
+      return OIDC_SUCCESS;
+    }
+    if (*p != ',') {
+      oidc_errno = OIDC_EJSONPARS;
+      return oidc_errno;
+    }
+    p = _skipWhitespace(p + 1);
+  }
+}
+
+static size_t _encodeUTF8(unsigned long codepoint, char* out) {
+  if (codepoint < 0x80) {
+    out[0] = (char)codepoint;
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    out[0] = (char)(0xC0 | (codepoint >> 6));
+    out[1] = (char)(0x80 | (codepoint & 0x3F));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    out[0] = (char)(0xE0 | (codepoint >> 12));
+    out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (codepoint & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (codepoint >> 18));
+  out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (codepoint & 0x3F));
+  return 4;
+}
+
+static void _unescapeInto(const char* ptr, size_t len, char* s) {
+  size_t j = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (ptr[i] != '\\') {
+      s[j++] = ptr[i];
+      continue;
+    }
+    i++;
+    switch (ptr[i]) {
+      case 'b': s[j++] = '\b'; break;
+      case 'f': s[j++] = '\f'; break;
+      case 'n': s[j++] = '\n'; break;
+      case 'r': s[j++] = '\r'; break;
+      case 't': s[j++] = '\t'; break;
+      case 'u': {
+        unsigned long codepoint = 0;
+        // The sequence was validated by _skipString
+        i += _parseUnicodeEscape(ptr + i, &codepoint) - 1;
+        j += _encodeUTF8(codepoint, s + j);
+        break;
+      }
+      default: s[j++] = ptr[i];
+    }
+  }
+  s[j] = '\0';
+}
+
+static double _abs(double d) { return d < 0 ? -d : d; }
+
+/**
+ * @brief formats a number the same way cJSON prints it
+ */
+static void _formatNumber(const char* ptr, size_t len, char number[26]) {
+  char buf[JSON_SCAN_NUMBER_MAX_LEN + 1];
+  memcpy(buf, ptr, len);
+  buf[len]    = '\0';
+  double d    = strtod(buf, NULL);
+  double test = 0.0;
+  snprintf(number, 26, "%1.15g", d);
+  if (sscanf(number, "%lg", &test) != 1 ||
+      _abs(test - d) > (_abs(test) > _abs(d) ? _abs(test) : _abs(d)) *
+                           DBL_EPSILON) {
+    snprintf(number, 26, "%1.17g", d);
+  }
+}
+
+static char* _copy(struct secArena* arena, const char* str, size_t len) {
+  return arena ? secArena_strncopy(arena, str, len) : oidc_strncopy(str, len);
+}
+
+static char* _viewToString(const struct json_view* view,
+                           struct secArena*        arena) {
+  if (view == NULL) {
+    return NULL;
+  }
+  switch (view->type) {
+    case JSON_VIEW_NONE: return NULL;
+    case JSON_VIEW_STRING: {
+      if (view->len == 0) {
+        return NULL;
+      }
+      if (!view->escaped) {
+        return _copy(arena, view->ptr, view->len);
+      }
+      // The unescaped string is never longer than the escaped one
+      char* s = arena ? secArena_alloc(arena, view->len + 1)
+                      : secAlloc(view->len + 1);
+      if (s != NULL) {
+        _unescapeInto(view->ptr, view->len, s);
+      }
+      return s;
+    }
+    case JSON_VIEW_NUMBER: {
+      char number[26] = {0};
+      _formatNumber(view->ptr, view->len, number);
+      return _copy(arena, number, strlen(number));
+    }
+    default: return _copy(arena, view->ptr, view->len);
+  }
+}
+
+/**
+ * @brief returns the value of a json view as string
+ * Strings are unescaped, numbers are formatted the same way cJSON prints them,
+ * and literals, objects, and arrays are copied as they are.
+ * @param view the view
+ * @return a pointer to the value. Has to be freed after usage. @c NULL if the
+ * view is empty or holds an empty string.
+ */
+char* jsonViewToString(const struct json_view* view) {
+  return _viewToString(view, NULL);
+}
+
+/**
+ * @brief same as @c jsonViewToString, but the value is allocated in @p arena
+ * and must not be freed
+ */
+char* jsonViewToArenaString(const struct json_view* view,
+                            struct secArena*        arena) {
+  return _viewToString(view, arena);
+}
@@ -0,0 +1,36 @@
+#ifndef OIDC_JSON_SCANNER_H
+#define OIDC_JSON_SCANNER_H
+
+#include "key_value.h"
+#include "memoryArena.h"
+#include "oidc_error.h"
+
+#include <stddef.h>
+
+#define JSON_VIEW_NONE 0
+#define JSON_VIEW_STRING 1
+#define JSON_VIEW_NUMBER 2
+#define JSON_VIEW_LITERAL 3
+#define JSON_VIEW_OBJECT 4
+#define JSON_VIEW_ARRAY 5
+
+/**
+ * A view of a json value inside the original json buffer. For strings @c ptr
+ * points after the opening quote and @c len does not include the quotes;
+ * @c escaped is set if the string contains escape sequences. @c type is
+ * @c JSON_VIEW_NONE if the key was not found.
+ */
+struct json_view {
+  const char*   ptr;
+  size_t        len;
+  unsigned char type;
+  unsigned char escaped;
+};
+
+oidc_error_t jsonScanValues(const char* json, const struct key_value* pairs,
+                            struct json_view* views, size_t size);
+char*        jsonViewToString(const struct json_view* view);
+char*        jsonViewToArenaString(const struct json_view* view,
+                                   struct secArena*        arena);
+
+#endif  // OIDC_JSON_SCANNER_H
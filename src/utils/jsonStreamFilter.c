@@ -0,0 +1,219 @@
+#include "jsonStreamFilter.h"
+#include "memory.h"
+#include "stringUtils.h"
+
+/**
+ * A filter that is fed a json document chunk by chunk, as it arrives, and
+ * only keeps the requested top-level fields of it. The values of these fields
+ * are copied as they are, without whitespace; everything else is dropped
+ * without being stored, so the complete document never has to be held in
+ * memory. The document is not validated, that is left to the parser of the
+ * result. Documents that are not an object, e.g. an html error page, are kept
+ * completely.
+ */
+
+#define JSON_STREAM_KEY_MAX 128
+
+#define FILTER_START 0
+#define FILTER_EXPECT_KEY 1
+#define FILTER_IN_KEY 2
+#define FILTER_EXPECT_COLON 3
+#define FILTER_EXPECT_VALUE 4
+#define FILTER_IN_VALUE 5
+#define FILTER_END 6
+#define FILTER_PASSTHROUGH 7
+
+static int _isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int _isRequested(const struct jsonStreamFilter* f) {
+  if (f->key.len > JSON_STREAM_KEY_MAX) {
+    return 0;
+  }
+  for (const char* const* field = f->fields; field && *field; field++) {
+    if (strequal(f->key.ptr, *field)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static oidc_error_t _emit(struct jsonStreamFilter* f, char c) {
+  return f->capture ? string_append(&f->out, &c, 1) : OIDC_SUCCESS;
+}
+
+static oidc_error_t _startValue(struct jsonStreamFilter* f) {
+  f->state = FILTER_IN_VALUE;
+  if (!f->capture) {
+    return OIDC_SUCCESS;
+  }
+  if ((f->captured++ && string_append(&f->out, ",", 1) != OIDC_SUCCESS) ||
+      string_append(&f->out, "\"", 1) != OIDC_SUCCESS ||
+      string_append(&f->out, f->key.ptr, f->key.len) != OIDC_SUCCESS ||
+      string_append(&f->out, "\":", 2) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+static oidc_error_t _feedValue(struct jsonStreamFilter* f, char c) {
+  if (f->in_string) {
+    if (f->escaped) {
+      f->escaped = 0;
+    } else if (c == '\\') {
+      f->escaped = 1;
+    } else if (c == '"') {
+      f->in_string = 0;
+    }
+    return _emit(f, c);
+  }
+  switch (c) {
+    case '"': f->in_string = 1; break;
+    case '{':
+    case '[': f->depth++; break;
+    case '}':
+    case ']':
+      if (f->depth == 1) {  // the end of the document
+        f->depth = 0;
+        f->state = FILTER_END;
+        return OIDC_SUCCESS;
+      }
+      f->depth--;
+      break;
+    case ',':
+      if (f->depth == 1) {
+        f->state = FILTER_EXPECT_KEY;
+        return OIDC_SUCCESS;
+      }
+      break;
+    default:
+      if (_isWhitespace(c)) {
+        return OIDC_SUCCESS;
+      }
+  }
+  return _emit(f, c);
+}
+
+static oidc_error_t _feedKey(struct jsonStreamFilter* f, char c) {
+  if (f->escaped) {
+    f->escaped = 0;
+  } else if (c == '\\') {
+    f->escaped = 1;
+  } else if (c == '"') {
+    f->state = FILTER_EXPECT_COLON;
+    return OIDC_SUCCESS;
+  }
+  if (f->key.len > JSON_STREAM_KEY_MAX) {
+    return OIDC_SUCCESS;  // too long for a requested field
+  }
+  return string_append(&f->key, &c, 1);
+}
+
+/**
+ * @brief initializes a filter
+ * @param fields the top-level fields to keep, terminated by @c NULL; has to be
+ * valid until the filter is finished
+ * @return an error code
+ */
+oidc_error_t jsonStreamFilter_init(struct jsonStreamFilter* f,
+                                   const char* const*       fields) {
+  *f = (struct jsonStreamFilter){.fields = fields};
+  if (init_string(&f->out) != OIDC_SUCCESS ||
+      init_string(&f->key) != OIDC_SUCCESS) {
+    jsonStreamFilter_free(f);
+    return oidc_errno;
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief feeds the next chunk of the document to the filter
+ * A chunk can end anywhere, also within a key or an escape sequence.
+ * @return an error code
+ */
+oidc_error_t jsonStreamFilter_feed(struct jsonStreamFilter* f, const char* data,
+                                   size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    char         c   = data[i];
+    oidc_error_t err = OIDC_SUCCESS;
+    switch (f->state) {
+      case FILTER_START:
+        if (_isWhitespace(c)) {
+          break;
+        }
+        if (c != '{') {
+          f->state = FILTER_PASSTHROUGH;
+          return string_append(&f->out, data + i, len - i);
+        }
+        f->depth = 1;
+        f->state = FILTER_EXPECT_KEY;
+        err      = string_append(&f->out, "{", 1);
+        break;
+      case FILTER_EXPECT_KEY:
+        if (c == '"') {
+          f->key.len    = 0;
+          f->key.ptr[0] = '\0';
+          f->state      = FILTER_IN_KEY;
+        } else if (c == '}') {
+          f->depth = 0;
+          f->state = FILTER_END;
+        }
+        break;
+      case FILTER_IN_KEY: err = _feedKey(f, c); break;
+      case FILTER_EXPECT_COLON:
+        if (c == ':') {
+          f->capture = _isRequested(f);
+          f->state   = FILTER_EXPECT_VALUE;
+        }
+        break;
+      case FILTER_EXPECT_VALUE:
+        if (_isWhitespace(c)) {
+          break;
+        }
+        if ((err = _startValue(f)) == OIDC_SUCCESS) {
+          err = _feedValue(f, c);
+        }
+        break;
+      case FILTER_IN_VALUE: err = _feedValue(f, c); break;
+      case FILTER_PASSTHROUGH:
+        return string_append(&f->out, data + i, len - i);
+      default: return OIDC_SUCCESS;  // ignore anything after the document
+    }
+    if (err != OIDC_SUCCESS) {
+      return err;
+    }
+  }
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief finishes a filter and returns its result
+ * @return a pointer to a json object with the requested fields that were
+ * present, or the unchanged document if it was not an object; an empty string
+ * for an empty document. Has to be freed after usage. If the document ended
+ * early, NULL is returned.
+ */
+char* jsonStreamFilter_finish(struct jsonStreamFilter* f) {
+  if (f->state == FILTER_END &&
+      string_append(&f->out, "}", 1) != OIDC_SUCCESS) {
+    jsonStreamFilter_free(f);
+    return NULL;
+  }
+  if (f->state != FILTER_END && f->state != FILTER_START &&
+      f->state != FILTER_PASSTHROUGH) {
+    jsonStreamFilter_free(f);
+    oidc_errno = OIDC_EJSONPARS;
+    return NULL;
+  }
+  char* res  = f->out.ptr;
+  f->out.ptr = NULL;
+  jsonStreamFilter_free(f);
+  return res;
+}
+
+void jsonStreamFilter_free(struct jsonStreamFilter* f) {
+  secFree(f->out.ptr);
+  secFree(f->key.ptr);
+  *f = (struct jsonStreamFilter){0};
+}
@@ -0,0 +1,32 @@
+#ifndef OIDC_JSON_STREAM_FILTER_H
+#define OIDC_JSON_STREAM_FILTER_H
+
+#include "oidc_error.h"
+#include "oidc_string.h"
+
+#include <stddef.h>
+
+/**
+ * The state of an incremental filter that keeps only some top-level fields of
+ * a json object. See @c jsonStreamFilter_feed.
+ */
+struct jsonStreamFilter {
+  const char* const* fields;
+  struct string      out;
+  struct string      key;
+  size_t             captured;
+  int                depth;
+  unsigned char      state;
+  unsigned char      in_string;
+  unsigned char      escaped;
+  unsigned char      capture;
+};
+
+oidc_error_t jsonStreamFilter_init(struct jsonStreamFilter* f,
+                                   const char* const*       fields);
+oidc_error_t jsonStreamFilter_feed(struct jsonStreamFilter* f, const char* data,
+                                   size_t len);
+char*        jsonStreamFilter_finish(struct jsonStreamFilter* f);
+void         jsonStreamFilter_free(struct jsonStreamFilter* f);
+
+#endif  // OIDC_JSON_STREAM_FILTER_H
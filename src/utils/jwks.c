@@ -0,0 +1,150 @@
+#include "jwks.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/rsa.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <sodium.h>
+
+/**
+ * Parsing of the key sets published at the @c jwks_uri of an issuer and
+ * verification of signatures with their keys. Supported are RSA keys for
+ * RS256 and RS512 and Ed25519 keys for EdDSA; other keys, e.g. EC keys or
+ * keys only meant for encryption, are skipped.
+ */
+
+#define JWK_ALG_RS256 "RS256"
+#define JWK_ALG_RS512 "RS512"
+#define JWK_ALG_EDDSA "EdDSA"
+
+static void _secFreeJwk(struct jwk* key) {
+  secFree(key->kid);
+  secFree(key->alg);
+  secFree(key->n);
+  secFree(key->e);
+  secFree(key);
+}
+
+static unsigned char* _decodeMember(const cJSON* json, const char* name,
+                                    size_t* len) {
+  const char* value =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, name));
+  return value ? (unsigned char*)decodeBase64UrlSafe(value, len) : NULL;
+}
+
+static char* _copyMember(const cJSON* json, const char* name) {
+  const char* value =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, name));
+  return value ? oidc_strcopy(value) : NULL;
+}
+
+/**
+ * @brief parses a single key
+ * @return a pointer to the key or @c NULL if it is not a supported signing
+ * key; has to be freed after usage
+ */
+static struct jwk* _parseKey(const cJSON* json) {
+  const char* kty =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "kty"));
+  const char* use =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "use"));
+  const char* crv =
+      cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "crv"));
+  if (use != NULL && !strequal(use, "sig")) {
+    return NULL;
+  }
+  struct jwk* key = secAlloc(sizeof(struct jwk));
+  if (strequal(kty, "RSA")) {
+    key->type = JWK_RSA;
+    key->n    = _decodeMember(json, "n", &key->n_len);
+    key->e    = _decodeMember(json, "e", &key->e_len);
+  } else if (strequal(kty, "OKP") && strequal(crv, "Ed25519")) {
+    key->type = JWK_ED25519;
+    key->n    = _decodeMember(json, "x", &key->n_len);
+  }
+  const unsigned char valid =
+      key->type == JWK_RSA ? key->n && key->e
+                           : key->n && key->n_len == crypto_sign_PUBLICKEYBYTES;
+  if (!valid) {
+    _secFreeJwk(key);
+    return NULL;
+  }
+  key->kid = _copyMember(json, "kid");
+  key->alg = _copyMember(json, "alg");
+  return key;
+}
+
+/**
+ * @brief parses a JSON Web Key Set
+ * @return a list of the supported signing keys (@c struct @c jwk), which
+ * might be empty; or @c NULL if @p json is not a key set. Has to be freed
+ * after usage.
+ */
+list_t* jwks_parse(const char* json) {
+  if (json == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  cJSON*       cjson = stringToJson(json);
+  const cJSON* keys  = cJSON_GetObjectItemCaseSensitive(cjson, "keys");
+  if (!cJSON_IsArray(keys)) {
+    secFreeJson(cjson);
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  list_t* list = list_new();
+  list->free   = (void (*)(void*))_secFreeJwk;
+  const cJSON* item;
+  cJSON_ArrayForEach(item, keys) {
+    struct jwk* key = _parseKey(item);
+    if (key) {
+      list_rpush(list, list_node_new(key));
+    }
+  }
+  secFreeJson(cjson);
+  return list;
+}
+
+/**
+ * @brief checks if signatures with the JWS algorithm @p alg can be verified
+ */
+int jwk_supportsAlg(const char* alg) {
+  return strequal(alg, JWK_ALG_RS256) || strequal(alg, JWK_ALG_RS512) ||
+         strequal(alg, JWK_ALG_EDDSA);
+}
+
+/**
+ * @brief checks if @p key can verify signatures with the algorithm @p alg
+ */
+int jwk_matchesAlg(const struct jwk* key, const char* alg) {
+  if (key == NULL || !jwk_supportsAlg(alg) ||
+      (key->alg != NULL && !strequal(key->alg, alg))) {
+    return 0;
+  }
+  return key->type == JWK_ED25519 ? strequal(alg, JWK_ALG_EDDSA)
+                                  : !strequal(alg, JWK_ALG_EDDSA);
+}
+
+/**
+ * @brief verifies a signature
+ * @param alg the JWS algorithm of the signature
+ * @return @c 1 if @p sig is a valid signature of @p msg by @p key, @c 0
+ * otherwise
+ */
+int jwk_verify(const struct jwk* key, const char* alg,
+               const unsigned char* msg, size_t msg_len,
+               const unsigned char* sig, size_t sig_len) {
+  if (!jwk_matchesAlg(key, alg) || msg == NULL || sig == NULL) {
+    return 0;
+  }
+  if (key->type == JWK_ED25519) {
+    return sig_len == crypto_sign_BYTES &&
+           crypto_sign_verify_detached(sig, msg, msg_len, key->n) == 0;
+  }
+  const enum rsa_hash hash =
+      strequal(alg, JWK_ALG_RS512) ? RSA_SHA512 : RSA_SHA256;
+  return rsa_verify(key->n, key->n_len, key->e, key->e_len, hash, msg,
+                    msg_len, sig, sig_len);
+}
@@ -0,0 +1,33 @@
+#ifndef OIDC_JWKS_H
+#define OIDC_JWKS_H
+
+#include "wrapper/list.h"
+
+#include <stddef.h>
+
+enum jwk_type {
+  JWK_RSA,
+  JWK_ED25519,
+};
+
+/**
+ * A public key of a JSON Web Key Set (RFC 7517) that can verify signatures
+ */
+struct jwk {
+  enum jwk_type  type;
+  char*          kid;  // NULL if the key has no id
+  char*          alg;  // NULL if the key may be used with any algorithm
+  unsigned char* n;    // RSA modulus or Ed25519 public key
+  size_t         n_len;
+  unsigned char* e;  // RSA public exponent
+  size_t         e_len;
+};
+
+list_t* jwks_parse(const char* json);
+int     jwk_supportsAlg(const char* alg);
+int     jwk_matchesAlg(const struct jwk* key, const char* alg);
+int     jwk_verify(const struct jwk* key, const char* alg,
+                   const unsigned char* msg, size_t msg_len,
+                   const unsigned char* sig, size_t sig_len);
+
+#endif  // OIDC_JWKS_H
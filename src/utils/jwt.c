@@ -0,0 +1,160 @@
+#include "jwt.h"
+#include "utils/crypt/crypt.h"
+#include "utils/json.h"
+#include "utils/jwks.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Decoding of JWTs, e.g. to learn when an access token expires. The decoding
+ * functions do NOT validate the signature, so their claims must only be used
+ * as hints about tokens the agent obtained itself and never for authorization
+ * decisions; for these the signature has to be checked with @c jwt_verify.
+ */
+
+/**
+ * @brief checks if @p token has the form of a JWS in compact serialization,
+ * i.e. three parts separated by dots
+ */
+int isJWT(const char* token) {
+  return token != NULL && strCountChar(token, '.') == 2;
+}
+
+/**
+ * @brief decodes the part of a JWT between @p start and @p end as json object
+ */
+static char* _decodePart(const char* start, const char* end) {
+  char* encoded = oidc_strncopy(start, end - start);
+  char* decoded = decodeBase64UrlSafe(encoded, NULL);
+  secFree(encoded);
+  if (decoded == NULL) {
+    return NULL;
+  }
+  if (!isJSONObject(decoded)) {
+    secFree(decoded);
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  return decoded;
+}
+
+/**
+ * @brief decodes the header of a JWT
+ * @return the header as a json string or @c NULL if @p jwt is not a JWT; has
+ * to be freed after usage
+ */
+char* jwt_getHeader(const char* jwt) {
+  if (jwt == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!isJWT(jwt)) {
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  return _decodePart(jwt, strchr(jwt, '.'));
+}
+
+/**
+ * @brief decodes the payload of a JWT
+ * @return the payload as a json string or @c NULL if @p jwt is not a JWT; has
+ * to be freed after usage
+ */
+char* jwt_getPayload(const char* jwt) {
+  if (jwt == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return NULL;
+  }
+  if (!isJWT(jwt)) {
+    oidc_errno = OIDC_EFMT;
+    return NULL;
+  }
+  const char* start = strchr(jwt, '.') + 1;
+  return _decodePart(start, strchr(start, '.'));
+}
+
+/**
+ * @brief returns the @c exp claim of a JWT
+ * @return the point in time when the JWT expires or @c 0 if @p jwt is not a
+ * JWT or has no valid @c exp claim
+ */
+time_t jwt_getExpiresAt(const char* jwt) {
+  char* payload = jwt_getPayload(jwt);
+  if (payload == NULL) {
+    return 0;
+  }
+  char* exp = getJSONValueFromString(payload, "exp");
+  secFree(payload);
+  if (exp == NULL) {
+    return 0;
+  }
+  char*     endptr = NULL;
+  long long t      = strtoll(exp, &endptr, 10);
+  // a NumericDate might have a fractional part, which is dropped
+  int valid = endptr != exp && (*endptr == '\0' || *endptr == '.') && t > 0;
+  secFree(exp);
+  return valid ? (time_t)t : 0;
+}
+
+/**
+ * @brief verifies the signature of a JWT
+ * @param keys the signing keys of the issuer (@c struct @c jwk), see
+ * @c jwks_parse. If the JWT names a key id, only the key with this id is
+ * used; otherwise all keys for the algorithm of the JWT are tried.
+ * @return @c OIDC_SUCCESS if the signature is valid; @c OIDC_ENOJWK if none of
+ * @p keys fits the JWT, e.g. because the issuer rotated its keys;
+ * @c OIDC_ESIGNATURE if the signature is invalid; otherwise another error code
+ */
+oidc_error_t jwt_verify(const char* jwt, list_t* keys) {
+  char* header = jwt_getHeader(jwt);
+  if (header == NULL) {
+    return oidc_errno;
+  }
+  char* alg = getJSONValueFromString(header, "alg");
+  char* kid = getJSONValueFromString(header, "kid");
+  secFree(header);
+  if (!jwk_supportsAlg(alg)) {
+    char* err = oidc_sprintf("Unsupported signature algorithm '%s'",
+                             alg ? alg : "none");
+    oidc_seterror(err);
+    secFree(err);
+    secFree(alg);
+    secFree(kid);
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  const char* signature = strrchr(jwt, '.') + 1;
+  size_t      sig_len   = 0;
+  unsigned char* sig = (unsigned char*)decodeBase64UrlSafe(signature, &sig_len);
+  unsigned char tried = 0;
+  unsigned char valid = 0;
+  if (sig != NULL && keys != NULL) {
+    list_node_t*     node;
+    list_iterator_t* it = list_iterator_new(keys, LIST_HEAD);
+    while (!valid && (node = list_iterator_next(it))) {
+      const struct jwk* key = node->val;
+      if ((kid && !strequal(kid, key->kid)) || !jwk_matchesAlg(key, alg)) {
+        continue;
+      }
+      tried = 1;
+      valid = jwk_verify(key, alg, (const unsigned char*)jwt,
+                         signature - 1 - jwt, sig, sig_len);
+    }
+    list_iterator_destroy(it);
+  }
+  if (valid) {
+    oidc_errno = OIDC_SUCCESS;
+  } else if (sig == NULL) {
+    oidc_errno = OIDC_EFMT;
+  } else {
+    oidc_errno = tried ? OIDC_ESIGNATURE : OIDC_ENOJWK;
+  }
+  secFree(sig);
+  secFree(alg);
+  secFree(kid);
+  return oidc_errno;
+}
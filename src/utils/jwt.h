@@ -0,0 +1,15 @@
+#ifndef OIDC_JWT_H
+#define OIDC_JWT_H
+
+#include "utils/oidc_error.h"
+#include "wrapper/list.h"
+
+#include <time.h>
+
+int          isJWT(const char* token);
+char*        jwt_getHeader(const char* jwt);
+char*        jwt_getPayload(const char* jwt);
+time_t       jwt_getExpiresAt(const char* jwt);
+oidc_error_t jwt_verify(const char* jwt, list_t* keys);
+
+#endif  // OIDC_JWT_H
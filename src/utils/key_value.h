@@ -48,6 +48,10 @@ static inline void secFreeKeyValuePairs(struct key_value* pairs, size_t size) {
 #define CALL_GETJSONVALUES(json) \
   getJSONValuesFromString((json), pairs, sizeof(pairs) / sizeof(*pairs))
 
+#define CALL_GETJSONVALUES_IN_ARENA(json, arena)                    \
+  getJSONValuesFromStringInArena((json), pairs, sizeof(pairs) / sizeof(*pairs), \
+                                 (arena))
+
 #define CALL_GETJSONVALUES_FROM_CJSON(json) \
   getJSONValues((json), pairs, sizeof(pairs) / sizeof(*pairs))
 
@@ -0,0 +1,121 @@
+#include "lazyLib.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <dlfcn.h>
+
+/**
+ * Optional dependencies that are only needed for some features, e.g. the
+ * keyring or the redirect web server, are not linked but loaded with
+ * @c dlopen when the feature is used for the first time. Agents that never
+ * use such a feature do not pay for the relocation, initialization and
+ * resident memory of the library. A library stays loaded once it was loaded;
+ * the loaded libraries are reported in the agent status.
+ */
+
+#define LAZYLIB_MAX 8
+
+static const char* loaded[LAZYLIB_MAX];
+static size_t      loadedCount = 0;
+
+unsigned char lazyLib_isLoaded(const char* name) {
+  for (size_t i = 0; i < loadedCount; i++) {
+    if (strequal(name, loaded[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void* _open(const char* name, const char* const* sonames) {
+  for (const char* const* soname = sonames; *soname; soname++) {
+    void* handle = dlopen(*soname, RTLD_LAZY | RTLD_LOCAL);
+    if (handle) {
+      logger(DEBUG, "Loaded %s from '%s'", name, *soname);
+      return handle;
+    }
+  }
+  char* err = oidc_sprintf("Could not load %s: %s", name, dlerror());
+  oidc_seterror(err);
+  secFree(err);
+  oidc_errno = OIDC_EERROR;
+  return NULL;
+}
+
+/**
+ * @brief loads a library and resolves its symbols, unless it is already
+ * loaded
+ * @param name the name of the library as it is reported; a string literal
+ * @param sonames the file names of the library that are tried in order;
+ * terminated by @c NULL
+ * @param symbols the symbols to resolve; terminated by an element whose name
+ * is @c NULL
+ * @return @c OIDC_SUCCESS or an error code if the library could not be loaded
+ * or lacks a symbol; then none of the targets is changed
+ */
+oidc_error_t lazyLib_load(const char* name, const char* const* sonames,
+                          const struct lazySymbol* symbols) {
+  if (name == NULL || sonames == NULL || symbols == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (lazyLib_isLoaded(name)) {
+    return OIDC_SUCCESS;
+  }
+  if (loadedCount >= LAZYLIB_MAX) {
+    oidc_setInternalError("too many lazily loaded libraries");
+    return oidc_errno;
+  }
+  void* handle = _open(name, sonames);
+  if (handle == NULL) {
+    return oidc_errno;
+  }
+  const struct lazySymbol* s;
+  for (s = symbols; s->name; s++) {
+    if (dlsym(handle, s->name) == NULL) {
+      char* err = oidc_sprintf("Could not load %s: symbol '%s' not found",
+                               name, s->name);
+      oidc_seterror(err);
+      secFree(err);
+      oidc_errno = OIDC_EERROR;
+      dlclose(handle);
+      return oidc_errno;
+    }
+  }
+  for (s = symbols; s->name; s++) {
+    *s->target = dlsym(handle, s->name);
+  }
+  loaded[loadedCount++] = name;
+  return OIDC_SUCCESS;
+}
+
+size_t lazyLib_count() { return loadedCount; }
+
+/**
+ * @brief returns the names of the loaded libraries separated by commas
+ * @return a pointer to the string or @c NULL if none is loaded. Has to be
+ * freed after usage.
+ */
+char* lazyLib_loadedToString() {
+  char* names = NULL;
+  for (size_t i = 0; i < loadedCount; i++) {
+    char* tmp = names ? oidc_sprintf("%s, %s", names, loaded[i])
+                      : oidc_strcopy(loaded[i]);
+    secFree(names);
+    names = tmp;
+  }
+  return names;
+}
+
+/**
+ * @brief returns the names of the loaded libraries as a json array
+ * @return a pointer to the json array. Has to be freed after usage.
+ */
+cJSON* lazyLib_loadedToJSON() {
+  cJSON* json = cJSON_CreateArray();
+  for (size_t i = 0; i < loadedCount; i++) {
+    cJSON_AddItemToArray(json, cJSON_CreateString(loaded[i]));
+  }
+  return json;
+}
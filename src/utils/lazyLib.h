@@ -0,0 +1,25 @@
+#ifndef OIDC_LAZYLIB_H
+#define OIDC_LAZYLIB_H
+
+#include "utils/oidc_error.h"
+#include "wrapper/cjson.h"
+
+#include <stddef.h>
+
+/**
+ * A symbol that is resolved by @c lazyLib_load; @c target points to the
+ * function pointer that is set
+ */
+struct lazySymbol {
+  const char* name;
+  void**      target;
+};
+
+oidc_error_t lazyLib_load(const char* name, const char* const* sonames,
+                          const struct lazySymbol* symbols);
+unsigned char lazyLib_isLoaded(const char* name);
+size_t        lazyLib_count();
+char*         lazyLib_loadedToString();
+cJSON*        lazyLib_loadedToJSON();
+
+#endif  // OIDC_LAZYLIB_H
@@ -297,10 +297,17 @@ void mergeSort(void* arr[], int l, int r,
 }
 
 void list_mergeSort(list_t* l, int (*comp)(const void*, const void*)) {
-  void* arr[l->len];
-  for (size_t i = 0; i < l->len; i++) { arr[i] = list_at(l, i)->val; }
+  if (l == NULL || l->len < 2) {
+    return;
+  }
+  // list_at walks the list, so the values are copied with a single pass each
+  void**       arr = secAlloc(sizeof(void*) * l->len);
+  size_t       i   = 0;
+  list_node_t* node;
+  for (node = l->head; node; node = node->next) { arr[i++] = node->val; }
   mergeSort(arr, 0, l->len - 1, comp);
-  for (size_t i = 0; i < l->len; i++) { list_at(l, i)->val = arr[i]; }
+  for (i = 0, node = l->head; node; node = node->next) { node->val = arr[i++]; }
+  secFree(arr);
 }
 
 void secFreeList(list_t* l) {
@@ -15,6 +15,33 @@
 
 static const char* logger_name;
 
+/**
+ * @brief checks the rate limit of a call site
+ * At most @c LOGGER_RATE_LIMIT messages per second are allowed; when messages
+ * were suppressed, this is logged once the next message is allowed.
+ * @param rl the rate limit state of the call site
+ * @return @c 1 if the message should be logged, @c 0 if not
+ */
+int logger_allow(struct logger_rateLimit* rl, const char* file, int line) {
+  time_t now = time(NULL);
+  if (rl->window != now) {
+    unsigned int suppressed = rl->suppressed;
+    rl->window              = now;
+    rl->count               = 0;
+    rl->suppressed          = 0;
+    if (suppressed) {
+      (logger)(NOTICE, "Suppressed %u log messages from %s:%d", suppressed,
+               file, line);
+    }
+  }
+  if (rl->count >= LOGGER_RATE_LIMIT) {
+    rl->suppressed++;
+    return 0;
+  }
+  rl->count++;
+  return 1;
+}
+
 char* format_time() {
   char* s = secAlloc(sizeof(char) * (19 + 1));
   if (s == NULL) {
@@ -57,16 +84,18 @@ char* create_log_message(int _log_level, const char* msg, va_list args) {
 #include <syslog.h>
 
 static int _mask;
+int        logger_mask = LOG_UPTO(LOG_DEBUG);  // the default syslog mask
 
 void logger_open(const char* _logger_name) {
   openlog(_logger_name, LOG_CONS | LOG_PID, LOG_AUTHPRIV);
   logger_name = _logger_name;
 }
 
-void logger(int log_level, const char* msg, ...) {
+void(logger)(int log_level, const char* msg, ...) {
   va_list args;
   va_start(args, msg);
   vsyslog(LOG_AUTHPRIV | log_level, msg, args);
+  va_end(args);
 }
 
 void loggerTerminal(int log_level, const char* msg, ...) {
@@ -82,7 +111,8 @@ void loggerTerminal(int log_level, const char* msg, ...) {
 }
 
 int logger_setlogmask(int mask) {
-  _mask = mask;
+  _mask       = mask;
+  logger_mask = mask;
   return setlogmask(mask);
 }
 
@@ -92,7 +122,7 @@ int logger_setloglevel(int level) { return logger_setlogmask(LOG_UPTO(level)); }
 
 #include "utils/file_io/oidc_file_io.h"
 
-static int log_level = NOTICE;
+int logger_mask = NOTICE;  // the minimum log level
 
 void own_log(int terminal, int _log_level, const char* msg, va_list args) {
   char* log = create_log_message(_log_level, msg, args);
@@ -108,7 +138,7 @@ void logger_open(const char* _logger_name) {
 }
 
 void _logger(int terminal, int _log_level, const char* msg, va_list args) {
-  if (_log_level >= log_level) {
+  if (_log_level >= logger_mask) {
     own_log(terminal, _log_level, msg, args);
   }
 }
@@ -120,7 +150,7 @@ void loggerTerminal(int _log_level, const char* msg, ...) {
   va_end(args);
 }
 
-void logger(int _log_level, const char* msg, ...) {
+void(logger)(int _log_level, const char* msg, ...) {
   va_list args;
   va_start(args, msg);
   _logger(0, _log_level, msg, args);
@@ -130,8 +160,29 @@ void logger(int _log_level, const char* msg, ...) {
 int logger_setlogmask(int mask) { return logger_setloglevel(mask); }
 
 int logger_setloglevel(int level) {
-  int old   = log_level;
-  log_level = level;
+  int old     = logger_mask;
+  logger_mask = level;
   return old;
 }
 #endif
+
+/**
+ * a log mask that only applies to the calling thread and takes precedence over
+ * @c logger_mask if set; the library uses it instead of changing the log mask
+ * of the whole application
+ */
+__thread int logger_threadMask = 0;
+
+int logger_setThreadLogmask(int mask) {
+  int old           = logger_threadMask;
+  logger_threadMask = mask;
+  return old;
+}
+
+int logger_setThreadLoglevel(int level) {
+#ifdef __linux__
+  return logger_setThreadLogmask(LOG_UPTO(level));
+#else
+  return logger_setThreadLogmask(level);
+#endif
+}
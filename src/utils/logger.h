@@ -24,10 +24,56 @@
 
 #endif
 
+#include <time.h>
+
+// Maximum number of messages per second that are logged from one call site
+#define LOGGER_RATE_LIMIT 20
+
+struct logger_rateLimit {
+  time_t       window;
+  unsigned int count;
+  unsigned int suppressed;
+};
+
+extern int          logger_mask;
+extern __thread int logger_threadMask;
+
 void logger_open(const char* logger_name);
-void logger(int log_level, const char* msg, ...);
+void(logger)(int log_level, const char* msg, ...);
 void loggerTerminal(int log_level, const char* msg, ...);
 int  logger_setlogmask(int);
 int  logger_setloglevel(int);
+int  logger_setThreadLogmask(int);
+int  logger_setThreadLoglevel(int);
+int  logger_allow(struct logger_rateLimit* rl, const char* file, int line);
+
+/**
+ * @brief checks if messages with @p log_level are logged at all
+ */
+static inline int logger_isEnabled(int log_level) {
+  int mask = logger_threadMask ? logger_threadMask : logger_mask;
+#ifdef __linux__
+  return mask & LOG_MASK(log_level);
+#else
+  return log_level >= mask;
+#endif
+}
+
+/**
+ * Only calls the logger if the level is enabled, so the arguments are not
+ * formatted (and not even evaluated) for disabled levels. Every call site is
+ * limited to @c LOGGER_RATE_LIMIT messages per second.
+ */
+#define LOGGER_CALL(log_fn, log_level, ...)                       \
+  do {                                                            \
+    if (logger_isEnabled(log_level)) {                            \
+      static struct logger_rateLimit _logger_rl;                  \
+      if (logger_allow(&_logger_rl, __FILE__, __LINE__)) {        \
+        (log_fn)((log_level), __VA_ARGS__);                       \
+      }                                                           \
+    }                                                             \
+  } while (0)
+
+#define logger(log_level, ...) LOGGER_CALL(logger, log_level, __VA_ARGS__)
 
 #endif  // OIDC_LOGGER_H
@@ -0,0 +1,148 @@
+#include "loopLag.h"
+#include "utils/agentLogger.h"
+#include "utils/metrics.h"
+#include "utils/stringUtils.h"
+
+/**
+ * The main loops of oidcp and oidcd handle one event at a time; while a
+ * handler runs, e.g. a prompt, a key derivation or a file rewrite, the loop
+ * cannot wake for anything else. The lag monitor splits the time between two
+ * waits into sections, each tagged with the handler running in it, usually a
+ * request type. The duration of every section is recorded in the
+ * @c loop_blocked_seconds histogram and sections longer than the threshold
+ * are logged.
+ *
+ * Before waiting, the loop tells when it has to wake at the latest, i.e. its
+ * next deadline. How late it actually woke for that deadline is recorded in
+ * the @c loop_lag_seconds histogram: the lag of the wait itself is tagged
+ * @c LOOPLAG_TAG_WAIT; if the deadline passed while a handler was running,
+ * the lag is measured when the loop waits again and tagged with that handler.
+ * All durations are taken from the monotonic clock, so neither setting the
+ * wall clock nor a suspend are counted as lag.
+ */
+
+static unsigned long thresholdMs  = LOOPLAG_DEFAULT_THRESHOLD_MS;
+static double        sectionStart = 0;     // 0 while waiting
+static const char*   sectionTag   = NULL;  // NULL until a handler is known
+static double        wakeAt       = 0;     // 0 if the loop has no deadline
+static const char*   missedBy     = NULL;  // the handler wakeAt passed in
+
+static char*  tags[LOOPLAG_MAX_TAGS];
+static size_t tagCount = 0;
+
+/**
+ * @brief sets the duration from which stalls of the main loop are logged
+ * @param ms the threshold in milliseconds; @c 0 disables the log messages,
+ * the metrics are recorded anyway
+ */
+void loopLag_setThreshold(unsigned long ms) { thresholdMs = ms; }
+
+/**
+ * @brief returns a copy of @p tag that lives as long as the process
+ * The number of tags is bounded, because they are used as metric labels.
+ */
+static const char* _intern(const char* tag) {
+  if (tag == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < tagCount; i++) {
+    if (strequal(tags[i], tag)) {
+      return tags[i];
+    }
+  }
+  if (tagCount == LOOPLAG_MAX_TAGS) {
+    return LOOPLAG_TAG_OTHER;
+  }
+  tags[tagCount] = oidc_strcopy(tag);
+  return tags[tagCount++];
+}
+
+static void _recordBlocked(const char* tag, double blocked) {
+  metrics_observe(METRIC_LOOP_BLOCKED, tag, blocked);
+  if (thresholdMs && blocked * 1e3 >= thresholdMs) {
+    agent_log(WARNING, "The main loop was blocked for %.3fms by %s",
+              blocked * 1e3, tag);
+  }
+}
+
+static void _recordLag(const char* tag, double lag) {
+  metrics_observe(METRIC_LOOP_LAG, tag, lag);
+  if (thresholdMs && lag * 1e3 >= thresholdMs) {
+    agent_log(WARNING, "The main loop woke %.3fms late because of %s",
+              lag * 1e3, tag);
+  }
+}
+
+static void _closeSection() {
+  if (sectionStart == 0) {
+    return;
+  }
+  const double now = metrics_now();
+  const char*  tag = sectionTag ?: LOOPLAG_TAG_LOOP;
+  _recordBlocked(tag, now - sectionStart);
+  if (wakeAt && missedBy == NULL && now > wakeAt) {
+    missedBy = tag;
+  }
+  sectionStart = now;
+}
+
+/**
+ * @brief tags the handler the main loop runs from now on
+ * The time since the last tag was set is attributed to the previous handler;
+ * the time before the first tag of a wake-up is attributed to the first one.
+ * @param tag the handler, e.g. the request type, or @c NULL
+ * @return the previous tag, so that nested handlers can restore it
+ */
+const char* loopLag_setTag(const char* tag) {
+  const char* prev = sectionTag;
+  if (sectionTag) {
+    _closeSection();
+  }
+  sectionTag = _intern(tag);
+  return prev;
+}
+
+/**
+ * @brief called by the main loop before it waits for the next event
+ * @param deadline the time the wait times out or @c 0 if it does not
+ */
+void loopLag_beforeWait(time_t deadline) {
+  _closeSection();
+  if (missedBy) {
+    _recordLag(missedBy, metrics_now() - wakeAt);
+  }
+  sectionStart = 0;
+  sectionTag   = NULL;
+  missedBy     = NULL;
+  // the wait times out after deadline - time(NULL) seconds, see initTimeout
+  time_t now = time(NULL);
+  wakeAt     = deadline ? metrics_now() + (deadline > now ? deadline - now : 0)
+                        : 0;
+}
+
+/**
+ * @brief called by the main loop after the wait returned
+ */
+void loopLag_afterWait() {
+  const double now = metrics_now();
+  if (wakeAt && now >= wakeAt) {  // woke for the deadline
+    _recordLag(LOOPLAG_TAG_WAIT, now - wakeAt);
+    wakeAt = 0;
+  }
+  sectionStart = now;
+  sectionTag   = NULL;
+}
+
+/**
+ * @brief records the duration of a callback that was run from within the
+ * wait, e.g. for a watched fd
+ * The callback can tag itself with @c loopLag_setTag.
+ * @param start the value of @c metrics_now before the callback was called
+ */
+void loopLag_recordWatched(double start) {
+  if (sectionStart != 0) {  // not called from within the wait
+    return;
+  }
+  _recordBlocked(sectionTag ?: LOOPLAG_TAG_WATCHED, metrics_now() - start);
+  sectionTag = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef OIDC_LOOPLAG_H
+#define OIDC_LOOPLAG_H
+
+#include <time.h>
+
+// Stalls of the main loop longer than this are logged, unless set otherwise
+#define LOOPLAG_DEFAULT_THRESHOLD_MS 250
+// Handler tags beyond this number are recorded as LOOPLAG_TAG_OTHER
+#define LOOPLAG_MAX_TAGS 64
+
+#define LOOPLAG_TAG_LOOP "loop"
+#define LOOPLAG_TAG_WAIT "wait"
+#define LOOPLAG_TAG_WATCHED "watched_fd"
+#define LOOPLAG_TAG_OTHER "other"
+
+void        loopLag_setThreshold(unsigned long ms);
+void        loopLag_beforeWait(time_t deadline);
+void        loopLag_afterWait();
+const char* loopLag_setTag(const char* tag);
+void        loopLag_recordWatched(double start);
+
+#endif  // OIDC_LOOPLAG_H
@@ -1,29 +1,474 @@
+#define _DEFAULT_SOURCE
 #include "memory.h"
 #include "memzero.h"
 #include "oidc_error.h"
 #include "utils/logger.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
-void* secCalloc(size_t nmemb, size_t size) { return secAlloc(nmemb * size); }
+/**
+ * Small allocations are served from a slab: every size class has a free list
+ * of blocks carved from anonymous pages that are locked into memory (best
+ * effort) and excluded from core dumps, so short-lived secrets stay on a few
+ * pages that are not swapped. Blocks are wiped when they are freed and are
+ * never returned to the system. Larger allocations use the heap.
+ *
+ * Every allocation starts with a @c size_t header holding the requested size
+ * in its lower bits; the upper bits hold @c SLAB_FLAG for slab blocks,
+ * @c COUNTED_FLAG for blocks that are included in the allocation statistics,
+ * the tag of the block and, for slab blocks, the size class. Heap blocks have a
+ * second @c size_t in front of the header that holds their capacity. A block
+ * can grow up to its capacity without being moved; the bytes between size and
+ * capacity are always zero. The free lists are protected by a mutex, because
+ * curl allocates from its resolver threads.
+ *
+ * Tokens (allocations tagged @c MEMTAG_TOKEN) are served from a separate token
+ * pool: a single region of @c TOKEN_POOL_SIZE bytes that is mapped, locked and
+ * excluded from core dumps once and is then carved into blocks of up to
+ * @c TOKEN_MAX_BLOCK bytes. Its blocks carry @c TOKEN_FLAG and go back to the
+ * free lists of the pool, so the memory holding tokens is bounded and reused
+ * on every refresh. If the pool is exhausted, tokens are allocated like any
+ * other memory; @c secMemTokenPool_contains tells the owner, which can then
+ * evict other tokens.
+ */
 
-void* secAlloc(size_t size) {
-  if (size == 0) {
+#define SLAB_MIN_BLOCK 32
+#define SLAB_CLASSES 7  // 32 to 2048 bytes
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define HEADER_BITS (sizeof(size_t) * 8)
+#define SLAB_FLAG ((size_t)1 << (HEADER_BITS - 1))
+#define COUNTED_FLAG ((size_t)1 << (HEADER_BITS - 2))
+#define TAG_SHIFT (HEADER_BITS - 5)
+#define TAG_MASK ((size_t)7 << TAG_SHIFT)
+#define CLASS_SHIFT (HEADER_BITS - 8)
+#define CLASS_MASK ((size_t)7 << CLASS_SHIFT)
+#define TOKEN_FLAG ((size_t)1 << (HEADER_BITS - 9))
+#define SIZE_MASK (((size_t)1 << (HEADER_BITS - 9)) - 1)
+
+#define TOKEN_CLASSES 8  // 32 to 4096 bytes
+#define TOKEN_MAX_BLOCK (SLAB_MIN_BLOCK << (TOKEN_CLASSES - 1))
+#define TOKEN_POOL_SIZE (256 * 1024)
+#define TOKEN_POOL_CHUNK_SIZE (16 * 1024)
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+struct slabBlock {
+  struct slabBlock* next;
+};
+
+static struct slabBlock* slabFree[SLAB_CLASSES];
+static pthread_mutex_t   slabLock = PTHREAD_MUTEX_INITIALIZER;
+
+static char*             tokenPool       = NULL;
+static size_t            tokenPoolCarved = 0;
+static struct slabBlock* tokenFree[TOKEN_CLASSES];
+
+static void _slabLock() { pthread_mutex_lock(&slabLock); }
+
+static void _slabUnlock() { pthread_mutex_unlock(&slabLock); }
+
+/**
+ * @brief holds the lock of the slab across a fork, so that the child of a
+ * process with threads does not inherit it locked; see @c pthread_atfork
+ */
+void secMem_lockForFork() { _slabLock(); }
+void secMem_unlockAfterFork() { _slabUnlock(); }
+
+static size_t _slabBlockSize(int class) { return SLAB_MIN_BLOCK << class; }
+
+/**
+ * @brief returns the size class for a block of @p len bytes including the
+ * header, or @c -1 if it is too large for the slab
+ */
+static int _slabClass(size_t len) {
+  for (int class = 0; class < SLAB_CLASSES; class++) {
+    if (len <= _slabBlockSize(class)) {
+      return class;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief maps a new chunk and adds its blocks to the free list of @p class
+ * Must be called with the lock held.
+ */
+static int _slabRefill(int class) {
+  char* chunk = mmap(NULL, SLAB_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (chunk == MAP_FAILED) {
+    return -1;
+  }
+  mlock(chunk, SLAB_CHUNK_SIZE);  // might exceed RLIMIT_MEMLOCK; best effort
+#ifdef MADV_DONTDUMP
+  madvise(chunk, SLAB_CHUNK_SIZE, MADV_DONTDUMP);
+#endif
+  size_t block = _slabBlockSize(class);
+  for (size_t off = 0; off + block <= SLAB_CHUNK_SIZE; off += block) {
+    struct slabBlock* b = (struct slabBlock*)(chunk + off);
+    b->next             = slabFree[class];
+    slabFree[class]     = b;
+  }
+  return 0;
+}
+
+static void* _slabAlloc(int class) {
+  _slabLock();
+  if (slabFree[class] == NULL && _slabRefill(class) != 0) {
+    _slabUnlock();
     return NULL;
   }
+  struct slabBlock* b = slabFree[class];
+  slabFree[class]     = b->next;
+  _slabUnlock();
+  b->next = NULL;  // the rest of the block was wiped on free
+  return b;
+}
+
+static void _slabFree(void* block, int class) {
+  moresecure_memzero(block, _slabBlockSize(class));
+  struct slabBlock* b = block;
+  _slabLock();
+  b->next         = slabFree[class];
+  slabFree[class] = b;
+  _slabUnlock();
+}
+
+/**
+ * @brief returns the size class for a token block of @p len bytes including
+ * the header, or @c -1 if it is too large for the token pool
+ */
+static int _tokenClass(size_t len) {
+  for (int class = 0; class < TOKEN_CLASSES; class++) {
+    if (len <= _slabBlockSize(class)) {
+      return class;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief carves the next chunk of the token pool into blocks of @p class;
+ * maps the pool on first use
+ * Must be called with the lock held.
+ */
+static int _tokenPoolRefill(int class) {
+  if (tokenPool == NULL) {
+    char* pool = mmap(NULL, TOKEN_POOL_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED) {
+      return -1;
+    }
+    mlock(pool, TOKEN_POOL_SIZE);  // best effort, as for the slab
+#ifdef MADV_DONTDUMP
+    madvise(pool, TOKEN_POOL_SIZE, MADV_DONTDUMP);
+#endif
+    tokenPool = pool;
+  }
+  if (tokenPoolCarved + TOKEN_POOL_CHUNK_SIZE > TOKEN_POOL_SIZE) {
+    return -1;
+  }
+  char* chunk = tokenPool + tokenPoolCarved;
+  tokenPoolCarved += TOKEN_POOL_CHUNK_SIZE;
+  size_t block = _slabBlockSize(class);
+  for (size_t off = 0; off + block <= TOKEN_POOL_CHUNK_SIZE; off += block) {
+    struct slabBlock* b = (struct slabBlock*)(chunk + off);
+    b->next             = tokenFree[class];
+    tokenFree[class]    = b;
+  }
+  return 0;
+}
+
+/**
+ * @brief allocates a token block of at least @p *class; once the pool is
+ * completely carved, a free block of a larger class is used if there is none
+ * of @p *class, which is then updated
+ */
+static void* _tokenPoolAlloc(int* class) {
+  _slabLock();
+  int c = *class;
+  if (tokenFree[c] == NULL && _tokenPoolRefill(c) != 0) {
+    while (c < TOKEN_CLASSES && tokenFree[c] == NULL) { c++; }
+    if (c == TOKEN_CLASSES) {
+      _slabUnlock();
+      return NULL;
+    }
+  }
+  struct slabBlock* b = tokenFree[c];
+  tokenFree[c]        = b->next;
+  _slabUnlock();
+  b->next = NULL;
+  *class  = c;
+  return b;
+}
+
+static void _tokenPoolFree(void* block, int class) {
+  moresecure_memzero(block, _slabBlockSize(class));
+  struct slabBlock* b = block;
+  _slabLock();
+  b->next          = tokenFree[class];
+  tokenFree[class] = b;
+  _slabUnlock();
+}
+
+/**
+ * Allocation statistics per tag; only collected after @c secMemStats_enable.
+ * The counters are updated atomically, the high-water marks only
+ * approximately.
+ */
+static unsigned char      statsEnabled = 0;
+static time_t             statsSince   = 0;
+static struct secMemStats stats[MEMTAG_COUNT];
+static size_t             totalLive = 0;
+static size_t             totalPeak = 0;
+
+static void (*allocationSampler)(size_t size) = NULL;
+
+static const char* const tagNames[MEMTAG_COUNT] = {
+    "other", "account", "token", "connection", "json", "http"};
+
+static void _statsAdd(unsigned char tag, size_t bytes, int blocks,
+                      int allocation) {
+  struct secMemStats* s    = &stats[tag];
+  size_t              live = __atomic_add_fetch(&s->live_bytes, bytes,
+                                                __ATOMIC_RELAXED);
+  size_t total = __atomic_add_fetch(&totalLive, bytes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s->live_blocks, blocks, __ATOMIC_RELAXED);
+  if (allocation) {
+    __atomic_add_fetch(&s->allocations, 1, __ATOMIC_RELAXED);
+  }
+  if (live > s->peak_bytes) {
+    s->peak_bytes = live;
+  }
+  if (total > totalPeak) {
+    totalPeak = total;
+  }
+}
+
+static void _statsSub(unsigned char tag, size_t bytes, int blocks) {
+  __atomic_sub_fetch(&stats[tag].live_bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&totalLive, bytes, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&stats[tag].live_blocks, blocks, __ATOMIC_RELAXED);
+}
+
+static unsigned char _headerTag(size_t header) {
+  return (header & TAG_MASK) >> TAG_SHIFT;
+}
+
+/**
+ * @brief starts collecting allocation statistics; memory allocated before is
+ * not included
+ */
+void secMemStats_enable() {
+  if (!statsEnabled) {
+    statsSince   = time(NULL);
+    statsEnabled = 1;
+  }
+}
+
+int secMemStats_isEnabled() { return statsEnabled; }
+
+/**
+ * @brief returns the point in time since when statistics are collected
+ */
+time_t secMemStats_since() { return statsSince; }
+
+/**
+ * @brief returns the allocation statistics of a tag
+ * @param tag one of the @c MEMTAG values, or @c MEMTAG_COUNT for the totals
+ */
+struct secMemStats secMemStats_get(unsigned char tag) {
+  if (tag < MEMTAG_COUNT) {
+    return stats[tag];
+  }
+  struct secMemStats total = {.live_bytes = totalLive,
+                              .peak_bytes = totalPeak};
+  for (unsigned char t = 0; t < MEMTAG_COUNT; t++) {
+    total.live_blocks += stats[t].live_blocks;
+    total.allocations += stats[t].allocations;
+  }
+  return total;
+}
+
+/**
+ * @brief sets a function that is called with the size of every allocation,
+ * e.g. to sample the allocations; @c NULL removes it
+ */
+void secMemStats_setSampler(void (*sampler)(size_t size)) {
+  allocationSampler = sampler;
+}
+
+const char* secMemStats_tagName(unsigned char tag) {
+  return tag < MEMTAG_COUNT ? tagNames[tag] : "total";
+}
+
+void* secCalloc(size_t nmemb, size_t size) { return secAlloc(nmemb * size); }
+
+void* secAlloc(size_t size) { return secAllocTagged(size, MEMTAG_OTHER); }
+
+static int _headerClass(size_t header) {
+  return (header & CLASS_MASK) >> CLASS_SHIFT;
+}
+
+/**
+ * @brief returns the number of bytes the block @p p can hold without being
+ * moved
+ */
+static size_t _capacity(void* p) {
+  size_t header = *(size_t*)(p - sizeof(size_t));
+  if (header & SLAB_FLAG) {
+    return _slabBlockSize(_headerClass(header)) - sizeof(size_t);
+  }
+  return *(size_t*)(p - 2 * sizeof(size_t));
+}
+
+/**
+ * @brief allocates a block of @p size bytes that can hold at least
+ * @p capacity bytes
+ */
+static void* _secAllocCapacity(size_t size, size_t capacity,
+                               unsigned char tag) {
   size_t sizesize = sizeof(size);
-  void*  p        = calloc(size + sizesize, 1);
+  if (capacity > SIZE_MASK - 2 * sizesize || tag >= MEMTAG_COUNT) {
+    oidc_errno = OIDC_EALLOC;
+    return NULL;
+  }
+  int    class = _slabClass(capacity + sizesize);
+  int    tokenClass =
+      tag == MEMTAG_TOKEN ? _tokenClass(capacity + sizesize) : -1;
+  size_t flags = (size_t)tag << TAG_SHIFT;
+  void*  p     = NULL;
+  if (tokenClass >= 0 && (p = _tokenPoolAlloc(&tokenClass))) {
+    flags |= SLAB_FLAG | TOKEN_FLAG | ((size_t)tokenClass << CLASS_SHIFT);
+  } else if (class >= 0 && (p = _slabAlloc(class))) {
+    flags |= SLAB_FLAG | ((size_t)class << CLASS_SHIFT);
+  } else if ((p = calloc(capacity + 2 * sizesize, 1))) {
+    *(size_t*)p = capacity;
+    p += sizesize;
+  }
   if (p == NULL) {
     oidc_errno = OIDC_EALLOC;
     logger(ALERT, "Memory alloc failed when trying to allocate %lu bytes",
-           size);
+           capacity);
+    return NULL;
+  }
+  if (statsEnabled) {
+    flags |= COUNTED_FLAG;
+    _statsAdd(tag, size, 1, 1);
+  }
+  if (allocationSampler) {
+    allocationSampler(size);
+  }
+  *(size_t*)p = size | flags;
+  return p + sizesize;
+}
+
+/**
+ * @brief allocates zeroed memory that is wiped when it is freed with
+ * @c secFree
+ * @param tag one of the @c MEMTAG values; the allocation is counted for this
+ * tag in the allocation statistics
+ */
+void* secAllocTagged(size_t size, unsigned char tag) {
+  if (size == 0) {
+    return NULL;
+  }
+  return _secAllocCapacity(size, size, tag);
+}
+
+/**
+ * @brief changes the tag under which an allocation is counted, e.g. when a
+ * token that was parsed from a response is stored in an account
+ */
+void secMemTag(void* p, unsigned char tag) {
+  if (p == NULL || tag >= MEMTAG_COUNT) {
+    return;
+  }
+  size_t* header = p - sizeof(size_t);
+  if (*header & COUNTED_FLAG) {
+    size_t size = *header & SIZE_MASK;
+    _statsSub(_headerTag(*header), size, 1);
+    _statsAdd(tag, size, 1, 0);
+  }
+  *header = (*header & ~TAG_MASK) | ((size_t)tag << TAG_SHIFT);
+}
+
+/**
+ * @brief returns if the block @p p lies in the token pool
+ */
+int secMemTokenPool_contains(const void* p) {
+  return p != NULL && (*(const size_t*)(p - sizeof(size_t)) & TOKEN_FLAG);
+}
+
+/**
+ * @brief moves the block @p p into the token pool and tags it as token
+ * If the pool has no room for it, the block is only tagged.
+ * @return a pointer to the (possibly moved) block; @p p must not be used
+ * anymore
+ */
+void* secMemTokenPool_move(void* p) {
+  if (p == NULL || secMemTokenPool_contains(p)) {
+    return p;
+  }
+  size_t size = *(size_t*)(p - sizeof(size_t)) & SIZE_MASK;
+  void*  newp = size ? _secAllocCapacity(size, size, MEMTAG_TOKEN) : NULL;
+  if (!secMemTokenPool_contains(newp)) {
+    secFree(newp);
+    secMemTag(p, MEMTAG_TOKEN);
+    return p;
+  }
+  memcpy(newp, p, size);
+  secFree(p);
+  return newp;
+}
+
+/**
+ * @brief sets the size of the block @p p to @p size, which must not exceed its
+ * capacity; memory that is given up is wiped
+ */
+static void* _resizeInPlace(void* p, size_t size) {
+  size_t* header  = p - sizeof(size_t);
+  size_t  oldsize = *header & SIZE_MASK;
+  if (size < oldsize) {
+    moresecure_memzero(p + size, oldsize - size);
+  }
+  if (*header & COUNTED_FLAG) {
+    _statsSub(_headerTag(*header), oldsize, 0);
+    _statsAdd(_headerTag(*header), size, 0, 0);
+  }
+  *header = (*header & ~SIZE_MASK) | size;
+  return p;
+}
+
+/**
+ * @brief moves the block @p p into a new block of @p size bytes that can hold
+ * at least @p capacity bytes; the old block is wiped and freed
+ */
+static void* _move(void* p, size_t size, size_t capacity) {
+  size_t header  = *(size_t*)(p - sizeof(size_t));
+  size_t oldsize = header & SIZE_MASK;
+  void*  newp    = _secAllocCapacity(size, capacity, _headerTag(header));
+  if (newp == NULL) {
     return NULL;
   }
-  *(size_t*)p = size;
-  return p + sizeof(size);
+  memcpy(newp, p, oldsize < size ? oldsize : size);
+  secFree(p);
+  return newp;
 }
 
+/**
+ * @brief resizes memory allocated with @c secAlloc; the tag is kept
+ * The block is resized in place if the new size fits into its capacity,
+ * otherwise it is moved into a block with at least twice the capacity, so that
+ * growing a block step by step only copies it a logarithmic number of times.
+ * Memory that is given up is wiped.
+ */
 void* secRealloc(void* p, size_t size) {
   if (p == NULL) {
     return secAlloc(size);
@@ -32,15 +477,29 @@ void* secRealloc(void* p, size_t size) {
     secFree(p);
     return NULL;
   }
-  size_t oldsize = *(size_t*)(p - sizeof(size_t));
-  size_t movelen = oldsize < size ? oldsize : size;
-  void*  newp    = secAlloc(size);
-  if (newp == NULL) {
-    return NULL;
+  size_t capacity = _capacity(p);
+  if (size <= capacity) {
+    return _resizeInPlace(p, size);
   }
-  memmove(newp, p, movelen);
-  secFree(p);
-  return newp;
+  return _move(p, size, size > 2 * capacity ? size : 2 * capacity);
+}
+
+/**
+ * @brief makes sure that the block @p p can grow to @p capacity bytes without
+ * being moved; the size and content of the block are kept
+ * @param p the block, or @c NULL to allocate an empty block that can hold
+ * @p capacity bytes
+ * @return a pointer to the (possibly moved) block, or @c NULL on failure; then
+ * @p p is unchanged
+ */
+void* secReserve(void* p, size_t capacity) {
+  if (p == NULL) {
+    return capacity ? _secAllocCapacity(0, capacity, MEMTAG_OTHER) : NULL;
+  }
+  if (capacity <= _capacity(p)) {
+    return p;
+  }
+  return _move(p, *(size_t*)(p - sizeof(size_t)) & SIZE_MASK, capacity);
 }
 
 void _secFreeArray(char** arr, size_t size) {
@@ -53,9 +512,22 @@ void _secFree(void* p) {
   if (p == NULL) {
     return;
   }
-  void*  fp  = p - sizeof(size_t);
-  size_t len = *(size_t*)fp;
-  secFreeN(fp, len);
+  void*  fp     = p - sizeof(size_t);
+  size_t header = *(size_t*)fp;
+  size_t size   = header & SIZE_MASK;
+  if (header & COUNTED_FLAG) {
+    _statsSub(_headerTag(header), size, 1);
+  }
+  if (header & TOKEN_FLAG) {
+    _tokenPoolFree(fp, _headerClass(header));
+    return;
+  }
+  if (header & SLAB_FLAG) {
+    _slabFree(fp, _headerClass(header));
+    return;
+  }
+  fp -= sizeof(size_t);
+  secFreeN(fp, *(size_t*)fp + 2 * sizeof(size_t));
 }
 /** @fn void secFree(void* p, size_t len)
  * @brief clears and frees allocated memory.
@@ -4,15 +4,48 @@
 #include "oidc-token/export_symbols.h"
 
 #include <stddef.h>
+#include <time.h>
+
+#define MEMTAG_OTHER 0
+#define MEMTAG_ACCOUNT 1
+#define MEMTAG_TOKEN 2
+#define MEMTAG_CONNECTION 3
+#define MEMTAG_JSON 4
+#define MEMTAG_HTTP 5
+#define MEMTAG_COUNT 6
+
+/**
+ * Allocation statistics of a tag; see @c secMemStats_enable
+ */
+struct secMemStats {
+  size_t        live_bytes;
+  size_t        live_blocks;
+  size_t        peak_bytes;
+  unsigned long allocations;
+};
 
 void*           secAlloc(size_t size);
+void*           secAllocTagged(size_t size, unsigned char tag);
 void*           secCalloc(size_t nmemb, size_t size);
 void*           secRealloc(void* p, size_t size);
+void*           secReserve(void* p, size_t capacity);
 LIB_PUBLIC void _secFree(void* p);
 void            _secFreeN(void* p, size_t len);
 void            _secFreeArray(char** arr, size_t size);
 void*           oidc_memcopy(void* src, size_t size);
 void            oidc_memshiftr(void* src, size_t size);
+void            secMemTag(void* p, unsigned char tag);
+void*           secMemTokenPool_move(void* p);
+int             secMemTokenPool_contains(const void* p);
+void            secMem_lockForFork();
+void            secMem_unlockAfterFork();
+
+void               secMemStats_enable();
+int                secMemStats_isEnabled();
+time_t             secMemStats_since();
+struct secMemStats secMemStats_get(unsigned char tag);
+const char*        secMemStats_tagName(unsigned char tag);
+void               secMemStats_setSampler(void (*sampler)(size_t size));
 
 #ifndef secFree
 #define secFree(ptr) \
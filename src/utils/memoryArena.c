@@ -0,0 +1,192 @@
+#include "memoryArena.h"
+#include "memory.h"
+#include "memzero.h"
+#include "oidc_error.h"
+#include "utils/logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * A secure arena hands out memory for short-lived, request-scoped data from a
+ * few large chunks. The chunks are locked into memory (if allowed) so they are
+ * never swapped, and memory is not freed individually: releasing the arena to
+ * an earlier mark wipes everything allocated since then at once and keeps the
+ * chunks for the next request.
+ *
+ * Memory from an arena must not be freed with @c secFree and must not be
+ * stored beyond the scope that releases it.
+ */
+
+#define SECARENA_DEFAULT_CHUNK_SIZE 16384
+#define SECARENA_ALIGNMENT 16
+
+struct secArenaChunk {
+  struct secArenaChunk* next;
+  size_t                size;
+  size_t                used;
+  size_t                locked;  // also pads the header so data is aligned
+  unsigned char         data[];
+};
+
+struct secArena {
+  struct secArenaChunk* head;
+  struct secArenaChunk* current;
+  size_t                chunk_size;
+};
+
+static struct secArenaChunk* _newChunk(size_t size) {
+  struct secArenaChunk* chunk = calloc(1, sizeof(struct secArenaChunk) + size);
+  if (chunk == NULL) {
+    oidc_errno = OIDC_EALLOC;
+    logger(ALERT, "Memory alloc failed when trying to allocate %lu bytes",
+           size);
+    return NULL;
+  }
+  chunk->size   = size;
+  chunk->locked = mlock(chunk, sizeof(struct secArenaChunk) + size) == 0;
+  return chunk;
+}
+
+static void _freeChunk(struct secArenaChunk* chunk) {
+  size_t len = sizeof(struct secArenaChunk) + chunk->size;
+  moresecure_memzero(chunk->data, chunk->used);
+  if (chunk->locked) {
+    munlock(chunk, len);
+  }
+  free(chunk);
+}
+
+/**
+ * @brief creates a new secure arena
+ * @param chunk_size the size of the chunks; @c 0 for the default size
+ * @return a pointer to the arena. Has to be freed with @c secArena_free.
+ */
+struct secArena* secArena_new(size_t chunk_size) {
+  struct secArena* arena = secAlloc(sizeof(struct secArena));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->chunk_size = chunk_size ?: SECARENA_DEFAULT_CHUNK_SIZE;
+  return arena;
+}
+
+void _secArena_free(struct secArena* arena) {
+  if (arena == NULL) {
+    return;
+  }
+  struct secArenaChunk* chunk = arena->head;
+  while (chunk) {
+    struct secArenaChunk* next = chunk->next;
+    _freeChunk(chunk);
+    chunk = next;
+  }
+  secFree(arena);
+}
+
+/**
+ * @brief allocates zeroed memory from an arena
+ * @return a pointer to the memory; valid until the arena is released to a mark
+ * taken before this call
+ */
+void* secArena_alloc(struct secArena* arena, size_t size) {
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+  size = (size + SECARENA_ALIGNMENT - 1) & ~(size_t)(SECARENA_ALIGNMENT - 1);
+  struct secArenaChunk* chunk = arena->current;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    struct secArenaChunk* next = chunk ? chunk->next : arena->head;
+    if (next == NULL || next->size < size) {
+      // Chunks after the current one are unused; not big enough chunks are
+      // replaced
+      next = _newChunk(size > arena->chunk_size ? size : arena->chunk_size);
+      if (next == NULL) {
+        return NULL;
+      }
+      struct secArenaChunk* old = chunk ? chunk->next : arena->head;
+      next->next                = old ? old->next : NULL;
+      if (old) {
+        _freeChunk(old);
+      }
+      if (chunk) {
+        chunk->next = next;
+      } else {
+        arena->head = next;
+      }
+    }
+    arena->current = chunk = next;
+  }
+  void* p = chunk->data + chunk->used;
+  chunk->used += size;
+  return p;
+}
+
+/**
+ * @brief copies @p len bytes of @p str into an arena and null-terminates them
+ */
+char* secArena_strncopy(struct secArena* arena, const char* str, size_t len) {
+  if (str == NULL) {
+    return NULL;
+  }
+  char* copy = secArena_alloc(arena, len + 1);
+  if (copy == NULL) {
+    return NULL;
+  }
+  memcpy(copy, str, len);
+  return copy;
+}
+
+/**
+ * @brief returns the current position of an arena
+ */
+struct secArena_mark secArena_mark(const struct secArena* arena) {
+  if (arena == NULL || arena->current == NULL) {
+    return (struct secArena_mark){NULL, 0};
+  }
+  return (struct secArena_mark){arena->current, arena->current->used};
+}
+
+/**
+ * @brief wipes everything allocated after @p mark and makes it available again
+ * Marks have to be released in the reverse order they were taken.
+ */
+void secArena_release(struct secArena* arena, struct secArena_mark mark) {
+  if (arena == NULL || arena->head == NULL) {
+    return;
+  }
+  struct secArenaChunk* chunk = mark.chunk ?: arena->head;
+  size_t                used  = mark.chunk ? mark.used : 0;
+  moresecure_memzero(chunk->data + used, chunk->used - used);
+  chunk->used = used;
+  if (chunk != arena->current) {
+    for (struct secArenaChunk* c = chunk->next; c != NULL; c = c->next) {
+      moresecure_memzero(c->data, c->used);
+      c->used = 0;
+      if (c == arena->current) {
+        break;
+      }
+    }
+  }
+  arena->current = chunk;
+}
+
+/**
+ * @brief wipes all memory of an arena and makes it available again
+ */
+void secArena_reset(struct secArena* arena) {
+  secArena_release(arena, (struct secArena_mark){NULL, 0});
+}
+
+/**
+ * @brief returns the arena for request-scoped memory of this process
+ * The arena is created on first use.
+ */
+struct secArena* requestArena() {
+  static struct secArena* arena = NULL;
+  if (arena == NULL) {
+    arena = secArena_new(0);
+  }
+  return arena;
+}
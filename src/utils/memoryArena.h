@@ -0,0 +1,35 @@
+#ifndef OIDC_MEMORY_ARENA_H
+#define OIDC_MEMORY_ARENA_H
+
+#include <stddef.h>
+
+struct secArena;
+
+/**
+ * A position in a @c secArena; everything allocated after it is released with
+ * @c secArena_release
+ */
+struct secArena_mark {
+  struct secArenaChunk* chunk;
+  size_t                used;
+};
+
+struct secArena*     secArena_new(size_t chunk_size);
+void                 _secArena_free(struct secArena* arena);
+void*                secArena_alloc(struct secArena* arena, size_t size);
+char*                secArena_strncopy(struct secArena* arena, const char* str,
+                                       size_t len);
+struct secArena_mark secArena_mark(const struct secArena* arena);
+void secArena_release(struct secArena* arena, struct secArena_mark mark);
+void secArena_reset(struct secArena* arena);
+struct secArena* requestArena();
+
+#ifndef secArena_free
+#define secArena_free(ptr) \
+  do {                     \
+    _secArena_free((ptr)); \
+    (ptr) = NULL;          \
+  } while (0)
+#endif  // secArena_free
+
+#endif  // OIDC_MEMORY_ARENA_H
@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+#include "metrics.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * A small in-process metrics registry. Every metric has at most one label;
+ * a series is kept per label value. The metrics are rendered in the
+ * Prometheus text exposition format, prefixed with the name of the process,
+ * so the output of oidcp and oidcd can be concatenated.
+ *
+ * Label values must come from a bounded set (request types, issuers, status
+ * codes), because series are never removed.
+ */
+
+#define METRIC_TYPE_COUNTER 0
+#define METRIC_TYPE_GAUGE 1
+#define METRIC_TYPE_HISTOGRAM 2
+
+struct metricInfo {
+  const char*   name;
+  unsigned char type;
+  const char*   label_name;
+  const char*   help;
+};
+
+static const struct metricInfo metricInfos[METRIC_COUNT] = {
+    [METRIC_REQUESTS] = {"requests_total", METRIC_TYPE_COUNTER, "request",
+                         "Handled requests by request type"},
+    [METRIC_TOKENCACHE] = {"token_cache_total", METRIC_TYPE_COUNTER, "result",
+                           "Access token requests answered from the token "
+                           "cache (hit) or not (miss)"},
+    [METRIC_REFRESH_DURATION] = {"refresh_duration_seconds",
+                                 METRIC_TYPE_HISTOGRAM, "issuer",
+                                 "Duration of refresh flows by issuer"},
+    [METRIC_HTTP_ERRORS] = {"http_errors_total", METRIC_TYPE_COUNTER, "code",
+                            "Failed HTTP requests by status code (curl for "
+                            "connection errors)"},
+    [METRIC_KEY_DERIVATIONS] = {"key_derivations_total", METRIC_TYPE_COUNTER,
+                                NULL, "Password based key derivations"},
+    [METRIC_CONNECTIONS] = {"connections", METRIC_TYPE_GAUGE, NULL,
+                            "Open client connections"},
+    [METRIC_PENDING_REQUESTS] = {"pending_requests", METRIC_TYPE_GAUGE, NULL,
+                                 "Requests waiting for a response from oidcd"},
+    [METRIC_SUBSCRIPTIONS] = {"subscriptions", METRIC_TYPE_GAUGE, NULL,
+                              "Clients subscribed to new access tokens"},
+    [METRIC_HTTP_NAMELOOKUP] = {"http_namelookup_seconds",
+                                METRIC_TYPE_HISTOGRAM, "host",
+                                "DNS lookup time of new HTTP connections"},
+    [METRIC_HTTP_CONNECT] = {"http_connect_seconds", METRIC_TYPE_HISTOGRAM,
+                             "host",
+                             "TCP connect time of new HTTP connections"},
+    [METRIC_HTTP_TLS] = {"http_tls_seconds", METRIC_TYPE_HISTOGRAM, "host",
+                         "TLS handshake time of new HTTP connections"},
+    [METRIC_HTTP_FIRST_BYTE] = {"http_first_byte_seconds",
+                                METRIC_TYPE_HISTOGRAM, "host",
+                                "Time from the established connection to the "
+                                "first response byte (server processing)"},
+    [METRIC_HTTP_DURATION] = {"http_request_duration_seconds",
+                              METRIC_TYPE_HISTOGRAM, "host",
+                              "Total duration of HTTP requests"},
+    [METRIC_HTTP_NEW_CONNECTIONS] = {"http_new_connections_total",
+                                     METRIC_TYPE_COUNTER, "host",
+                                     "HTTP connections opened (not reused)"},
+    [METRIC_HTTP_VERSIONS] = {"http_responses_total", METRIC_TYPE_COUNTER,
+                              "version", "HTTP responses by HTTP version"},
+    [METRIC_SHED_REQUESTS] = {"shed_requests_total", METRIC_TYPE_COUNTER,
+                              "reason",
+                              "Requests rejected while the agent was busy or "
+                              "dropped after their client gave up"},
+    [METRIC_REFRESH_GOVERNED] = {"refresh_governed_total", METRIC_TYPE_COUNTER,
+                                 "action",
+                                 "Token refreshes delayed or dropped to stay "
+                                 "within the request rate of --issuer-rate"},
+    [METRIC_MEMORY_PRESSURE] = {"memory_pressure_level", METRIC_TYPE_GAUGE,
+                                NULL,
+                                "Caches trimmed at the last memory pressure "
+                                "check (0: none, 4: all)"},
+    [METRIC_MEMORY_TRIMMED] = {"memory_trimmed_total", METRIC_TYPE_COUNTER,
+                               "cache",
+                               "Entries dropped from a cache because of "
+                               "memory pressure"},
+    [METRIC_LOOP_BLOCKED] = {"loop_blocked_seconds", METRIC_TYPE_HISTOGRAM,
+                             "handler",
+                             "Time the main loop spent in a handler without "
+                             "being able to wake for other events"},
+    [METRIC_LOOP_LAG] = {"loop_lag_seconds", METRIC_TYPE_HISTOGRAM, "handler",
+                         "How late the main loop woke for its next deadline, "
+                         "by the handler that delayed it (wait if none)"},
+};
+
+static const double histogramBuckets[] = {0.001, 0.0025, 0.005, 0.01, 0.025,
+                                          0.05,  0.1,    0.25,  0.5,  1,
+                                          2.5,   5,      10,    30};
+#define METRIC_BUCKETS (sizeof(histogramBuckets) / sizeof(*histogramBuckets))
+
+struct metricSeries {
+  char*         label;
+  double        value;  // counter or gauge value; sum for histograms
+  unsigned long count;
+  unsigned long buckets[METRIC_BUCKETS];
+};
+
+static list_t*     metricSeries[METRIC_COUNT];
+static const char* metricPrefix = "oidc_agent";
+
+static void _secFreeMetricSeries(struct metricSeries* s) {
+  secFree(s->label);
+  secFree(s);
+}
+
+static int _matchMetricSeries(const char* label, const struct metricSeries* s) {
+  return label == NULL ? s->label == NULL : strequal(label, s->label);
+}
+
+static struct metricSeries* _getSeries(enum metric metric, const char* label) {
+  if (metric >= METRIC_COUNT) {
+    return NULL;
+  }
+  if (metricSeries[metric] == NULL) {
+    metricSeries[metric]        = list_new();
+    metricSeries[metric]->free  = (void (*)(void*))_secFreeMetricSeries;
+    metricSeries[metric]->match = (matchFunction)_matchMetricSeries;
+  }
+  list_node_t* node = findInList(metricSeries[metric], label);
+  if (node) {
+    return node->val;
+  }
+  struct metricSeries* s = secAlloc(sizeof(struct metricSeries));
+  s->label               = oidc_strcopy(label);
+  list_rpush(metricSeries[metric], list_node_new(s));
+  return s;
+}
+
+/**
+ * @brief sets the prefix of all metric names, e.g. the process name
+ */
+void metrics_setPrefix(const char* prefix) { metricPrefix = prefix; }
+
+/**
+ * @brief removes all series, e.g. the ones a forked process inherited from its
+ * parent
+ */
+void metrics_reset() {
+  for (size_t m = 0; m < METRIC_COUNT; m++) {
+    secFreeList(metricSeries[m]);
+    metricSeries[m] = NULL;
+  }
+}
+
+/**
+ * @brief increments a counter
+ * @param label the label value or @c NULL for metrics without label
+ */
+void metrics_inc(enum metric metric, const char* label) {
+  struct metricSeries* s = _getSeries(metric, label);
+  if (s) {
+    s->value++;
+  }
+}
+
+/**
+ * @brief adds @p value to a counter
+ */
+void metrics_add(enum metric metric, const char* label, double value) {
+  struct metricSeries* s = _getSeries(metric, label);
+  if (s) {
+    s->value += value;
+  }
+}
+
+/**
+ * @brief sets a gauge (or a counter maintained elsewhere) to @p value
+ */
+void metrics_set(enum metric metric, const char* label, double value) {
+  struct metricSeries* s = _getSeries(metric, label);
+  if (s) {
+    s->value = value;
+  }
+}
+
+/**
+ * @brief records an observation of a histogram
+ */
+void metrics_observe(enum metric metric, const char* label, double value) {
+  struct metricSeries* s = _getSeries(metric, label);
+  if (s == NULL) {
+    return;
+  }
+  s->value += value;
+  s->count++;
+  for (size_t i = 0; i < METRIC_BUCKETS; i++) {
+    if (value <= histogramBuckets[i]) {
+      s->buckets[i]++;
+    }
+  }
+}
+
+/**
+ * @brief returns the current time of a monotonic clock in seconds
+ * Only useful for durations.
+ */
+double metrics_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _appendf(struct string* str, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  char* s = oidc_vsprintf(fmt, args);
+  va_end(args);
+  if (s) {
+    string_append(str, s, strlen(s));
+    secFree(s);
+  }
+}
+
+/**
+ * @brief escapes a label value for the text format
+ */
+static char* _escapeLabel(const char* label) {
+  struct string str;
+  init_string(&str);
+  for (const char* c = label; *c; c++) {
+    const char* esc = *c == '\\' ? "\\\\"
+                      : *c == '"' ? "\\\""
+                      : *c == '\n' ? "\\n"
+                                   : NULL;
+    if (esc) {
+      string_append(&str, esc, strlen(esc));
+    } else {
+      string_append(&str, c, 1);
+    }
+  }
+  return str.ptr;
+}
+
+static void _appendSeries(struct string* str, const struct metricInfo* info,
+                          const struct metricSeries* s) {
+  char* label = s->label ? _escapeLabel(s->label) : NULL;
+  // the label selector with and without braces, e.g. {issuer="..."}
+  char* sel    = label ? oidc_sprintf("%s=\"%s\",", info->label_name, label)
+                       : oidc_strcopy("");
+  char* braces = label ? oidc_sprintf("{%s=\"%s\"}", info->label_name, label)
+                       : oidc_strcopy("");
+  secFree(label);
+  if (info->type != METRIC_TYPE_HISTOGRAM) {
+    _appendf(str, "%s_%s%s %.9g\n", metricPrefix, info->name, braces,
+             s->value);
+  } else {
+    for (size_t i = 0; i < METRIC_BUCKETS; i++) {
+      _appendf(str, "%s_%s_bucket{%sle=\"%g\"} %lu\n", metricPrefix,
+               info->name, sel, histogramBuckets[i], s->buckets[i]);
+    }
+    _appendf(str, "%s_%s_bucket{%sle=\"+Inf\"} %lu\n", metricPrefix,
+             info->name, sel, s->count);
+    _appendf(str, "%s_%s_sum%s %.9g\n", metricPrefix, info->name, braces,
+             s->value);
+    _appendf(str, "%s_%s_count%s %lu\n", metricPrefix, info->name, braces,
+             s->count);
+  }
+  secFree(sel);
+  secFree(braces);
+}
+
+/**
+ * @brief renders all metrics in the Prometheus text exposition format
+ * @return a pointer to the text; it has to be freed after usage
+ */
+char* metrics_toText() {
+  static const char* const typeNames[] = {"counter", "gauge", "histogram"};
+  struct string            str;
+  if (init_string(&str) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  for (size_t m = 0; m < METRIC_COUNT; m++) {
+    if (metricSeries[m] == NULL || metricSeries[m]->len == 0) {
+      continue;
+    }
+    const struct metricInfo* info = &metricInfos[m];
+    _appendf(&str, "# HELP %s_%s %s\n# TYPE %s_%s %s\n", metricPrefix,
+             info->name, info->help, metricPrefix, info->name,
+             typeNames[info->type]);
+    for (list_node_t* node = metricSeries[m]->head; node; node = node->next) {
+      _appendSeries(&str, info, node->val);
+    }
+  }
+  return str.ptr;
+}
@@ -0,0 +1,43 @@
+#ifndef OIDC_METRICS_H
+#define OIDC_METRICS_H
+
+enum metric {
+  METRIC_REQUESTS,
+  METRIC_TOKENCACHE,
+  METRIC_REFRESH_DURATION,
+  METRIC_HTTP_ERRORS,
+  METRIC_KEY_DERIVATIONS,
+  METRIC_CONNECTIONS,
+  METRIC_PENDING_REQUESTS,
+  METRIC_SUBSCRIPTIONS,
+  METRIC_HTTP_NAMELOOKUP,
+  METRIC_HTTP_CONNECT,
+  METRIC_HTTP_TLS,
+  METRIC_HTTP_FIRST_BYTE,
+  METRIC_HTTP_DURATION,
+  METRIC_HTTP_NEW_CONNECTIONS,
+  METRIC_HTTP_VERSIONS,
+  METRIC_SHED_REQUESTS,
+  METRIC_REFRESH_GOVERNED,
+  METRIC_MEMORY_PRESSURE,
+  METRIC_MEMORY_TRIMMED,
+  METRIC_LOOP_BLOCKED,
+  METRIC_LOOP_LAG,
+  METRIC_COUNT  // number of metrics, not a metric
+};
+
+#define METRIC_LABEL_HIT "hit"
+#define METRIC_LABEL_MISS "miss"
+#define METRIC_LABEL_BUSY "busy"
+#define METRIC_LABEL_DEADLINE "deadline"
+
+void   metrics_setPrefix(const char* prefix);
+void   metrics_reset();
+void   metrics_inc(enum metric metric, const char* label);
+void   metrics_add(enum metric metric, const char* label, double value);
+void   metrics_set(enum metric metric, const char* label, double value);
+void   metrics_observe(enum metric metric, const char* label, double value);
+double metrics_now();
+char*  metrics_toText();
+
+#endif  // OIDC_METRICS_H
@@ -0,0 +1,96 @@
+#include "negativeCache.h"
+#include "defines/settings.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <time.h>
+
+/**
+ * Remembers for NEGATIVE_CACHE_TIME seconds that a short name has no account
+ * config or that no account is loaded or configured for an issuer, so that
+ * clients that keep asking for them, e.g. misconfigured jobs, are answered
+ * without searching the account db, asking oidcp or touching the oidc dir.
+ * Entries are added in the order they expire; at most NEGATIVE_CACHE_MAX are
+ * kept. The cache is cleared when account configs change.
+ */
+
+struct negativeEntry {
+  unsigned char kind;
+  char*         name;
+  time_t        until;
+};
+
+static list_t* entries = NULL;
+
+static void _secFreeNegativeEntry(struct negativeEntry* e) {
+  secFree(e->name);
+  secFree(e);
+}
+
+static void _dropExpired(time_t now) {
+  list_node_t* node;
+  while (entries && entries->head &&
+         ((struct negativeEntry*)entries->head->val)->until <= now) {
+    node = list_lpop(entries);
+    _secFreeNegativeEntry(node->val);
+    LIST_FREE(node);
+  }
+}
+
+static list_node_t* _find(unsigned char kind, const char* name) {
+  if (entries == NULL) {
+    return NULL;
+  }
+  for (list_node_t* node = entries->head; node; node = node->next) {
+    const struct negativeEntry* e = node->val;
+    if (e->kind == kind && strequal(e->name, name)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+void negativeCache_add(unsigned char kind, const char* name) {
+  if (name == NULL) {
+    return;
+  }
+  time_t now = time(NULL);
+  _dropExpired(now);
+  if (entries == NULL) {
+    entries       = list_new();
+    entries->free = (void (*)(void*))_secFreeNegativeEntry;
+  }
+  list_node_t* node = _find(kind, name);
+  if (node) {
+    list_remove(entries, node);
+  } else if (entries->len >= NEGATIVE_CACHE_MAX) {
+    node = list_lpop(entries);
+    _secFreeNegativeEntry(node->val);
+    LIST_FREE(node);
+  }
+  struct negativeEntry* e = secAlloc(sizeof(struct negativeEntry));
+  e->kind                 = kind;
+  e->name                 = oidc_strcopy(name);
+  e->until                = now + NEGATIVE_CACHE_TIME;
+  list_rpush(entries, list_node_new(e));
+}
+
+/**
+ * @brief checks if @p name is known not to exist
+ * @return @c 1 if a lookup of @p name failed within the last
+ * NEGATIVE_CACHE_TIME seconds; @c 0 otherwise
+ */
+int negativeCache_contains(unsigned char kind, const char* name) {
+  if (entries == NULL || name == NULL) {
+    return 0;
+  }
+  _dropExpired(time(NULL));
+  return _find(kind, name) != NULL;
+}
+
+void negativeCache_clear() {
+  secFreeList(entries);
+  entries = NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef OIDC_NEGATIVECACHE_H
+#define OIDC_NEGATIVECACHE_H
+
+#define NEGATIVE_CACHE_ACCOUNT 0  // a short name without a config
+#define NEGATIVE_CACHE_ISSUER 1   // an issuer without a default account
+
+void negativeCache_add(unsigned char kind, const char* name);
+int  negativeCache_contains(unsigned char kind, const char* name);
+void negativeCache_clear();
+
+#endif  // OIDC_NEGATIVECACHE_H
@@ -9,8 +9,8 @@
 #include <stdio.h>
 #include <string.h>
 
-int  oidc_errno;
-char oidc_error[1024];
+__thread int  oidc_errno;
+__thread char oidc_error[1024];
 
 void oidc_seterror(const char* error) {
   moresecure_memzero(oidc_error, sizeof(oidc_error));
@@ -55,6 +55,8 @@ char* oidc_serrorFor(oidc_error_t err) {
     case OIDC_ECRYPM: return "encryption malformed";
     case OIDC_ECRYPMIPC:
       return "internal error: ipc encrypted message malformed";
+    case OIDC_ENOAEAD:
+      return "the cipher of the encrypted data is not supported on this host";
     case OIDC_EENCRYPT: return "encryption failed";
     case OIDC_EDECRYPT: return "decryption failed";
     case OIDC_ECRYPHASH: return "could not hash string";
@@ -92,6 +94,10 @@ char* oidc_serrorFor(oidc_error_t err) {
     case OIDC_EIPCDIS: return "the other party disconnected";
     case OIDC_ETIMEOUT: return "reached timeout";
     case OIDC_EGROUPNF: return "Group does not exist";
+    case OIDC_EIPCTAG: return "Received malformed ipc message header";
+    case OIDC_ESESSION: return "Could not establish a session with the agent";
+    case OIDC_EMAILBOX: return "No valid access token in the token mailbox";
+    case OIDC_EENCREQ: return "The request has to be encrypted";
     case OIDC_ESELECT: return "error select";
     case OIDC_EMAXTRIES: return "reached maximum number of tries";
     case OIDC_ENOACCOUNT: return "No account configured with that short name";
@@ -112,6 +118,12 @@ char* oidc_serrorFor(oidc_error_t err) {
              "flag.";
     case OIDC_ENOSUPREV:
       return "Token revocation is not supported by this issuer.";
+    case OIDC_ENOSUPUSERINFO:
+      return "The issuer does not provide a userinfo endpoint.";
+    case OIDC_ENOSUPJWKS:
+      return "The issuer does not publish its signing keys.";
+    case OIDC_ENOJWK: return "No signing key of the issuer matches the token";
+    case OIDC_ESIGNATURE: return "Invalid token signature";
     case OIDC_ENOPUBCLIENT: return "No public client found for this issuer";
     case OIDC_ELOCKED: return "Agent locked";
     case OIDC_ENOTLOCKED: return "Agent not locked";
@@ -120,6 +132,16 @@ char* oidc_serrorFor(oidc_error_t err) {
     case OIDC_EGERROR: return oidc_error;
     case OIDC_EUSRPWCNCL: return "user cancelled password prompt";
     case OIDC_EFORBIDDEN: return "operation forbidden";
+    case OIDC_EUNAVAIL:
+      return "The provider is currently unavailable; try again later";
+    case OIDC_ERATELIMIT:
+      return "Too many forced token refreshes; try again later";
+    case OIDC_EBUSY: return "The agent is busy; try again later";
+    case OIDC_ETHROTTLED:
+      return "Too many failed unlock attempts; try again later";
+    case OIDC_EISSUERRATE:
+      return "The provider limits the request rate; try again later";
+    case OIDC_ENOSEAL: return "The file is not sealed to this host";
     case OIDC_NOTIMPL: return "Not yet implemented";
     case OIDC_ENOPE: return "Computer says NO!";
     default: return "Computer says NO!";
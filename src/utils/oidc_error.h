@@ -24,6 +24,7 @@ enum _oidc_error {
   OIDC_EPASS     = -18,
   OIDC_ECRYPM    = -19,
   OIDC_ECRYPMIPC = -190,
+  OIDC_ENOAEAD   = -191,
 
   OIDC_EARGNULL     = -20,
   OIDC_EARGNULLFUNC = -21,
@@ -60,6 +61,10 @@ enum _oidc_error {
   OIDC_EIOCTL   = -69,
   OIDC_ETIMEOUT = -600,
   OIDC_EGROUPNF = -601,
+  OIDC_EIPCTAG  = -602,
+  OIDC_ESESSION = -603,
+  OIDC_EMAILBOX = -604,
+  OIDC_EENCREQ  = -605,
 
   OIDC_EMAXTRIES  = -70,
   OIDC_ENOACCOUNT = -71,
@@ -76,8 +81,12 @@ enum _oidc_error {
 
   OIDC_ENOPRIVCONF = -90,
 
-  OIDC_ENOSUPREG = -100,
-  OIDC_ENOSUPREV = -101,
+  OIDC_ENOSUPREG      = -100,
+  OIDC_ENOSUPREV      = -101,
+  OIDC_ENOSUPUSERINFO = -102,
+  OIDC_ENOSUPJWKS     = -103,
+  OIDC_ENOJWK         = -104,
+  OIDC_ESIGNATURE     = -105,
 
   OIDC_ENOPUBCLIENT = -106,
 
@@ -85,6 +94,12 @@ enum _oidc_error {
   OIDC_EGERROR     = -111,
   OIDC_EUSRPWCNCL  = -112,
   OIDC_EFORBIDDEN  = -113,
+  OIDC_EUNAVAIL    = -114,
+  OIDC_ERATELIMIT  = -115,
+  OIDC_EBUSY       = -116,
+  OIDC_ETHROTTLED  = -117,
+  OIDC_EISSUERRATE = -118,
+  OIDC_ENOSEAL     = -119,
 
   OIDC_ELOCKED    = -120,
   OIDC_ENOTLOCKED = -121,
@@ -98,8 +113,9 @@ enum _oidc_error {
 
 typedef enum _oidc_error oidc_error_t;
 
-extern int  oidc_errno;
-extern char oidc_error[1024];
+// thread local, so that the library can be used from multiple threads
+extern __thread int  oidc_errno;
+extern __thread char oidc_error[1024];
 
 struct oidc_error_state {
   int   oidc_errno;
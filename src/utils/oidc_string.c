@@ -3,10 +3,14 @@
 #include "utils/memory.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#define STRING_INITIAL_CAP 256
 
 oidc_error_t init_string(struct string* s) {
   s->len = 0;
-  s->ptr = secAlloc(s->len + 1);
+  s->cap = STRING_INITIAL_CAP;
+  s->ptr = secAlloc(s->cap + 1);
 
   if (s->ptr == NULL) {
     logger(EMERGENCY, "%s (%s:%d) alloc() failed: %m\n", __func__, __FILE__,
@@ -16,3 +20,32 @@ oidc_error_t init_string(struct string* s) {
   }
   return OIDC_SUCCESS;
 }
+
+/**
+ * @brief makes sure that the string can hold at least @p len bytes (plus the
+ * terminating null byte) without another allocation
+ */
+oidc_error_t string_reserve(struct string* s, size_t len) {
+  if (len <= s->cap) {
+    return OIDC_SUCCESS;
+  }
+  size_t cap = s->cap ? s->cap : STRING_INITIAL_CAP;
+  while (cap < len) { cap *= 2; }
+  char* tmp = secRealloc(s->ptr, cap + 1);
+  if (tmp == NULL) {
+    return oidc_errno;
+  }
+  s->ptr = tmp;
+  s->cap = cap;
+  return OIDC_SUCCESS;
+}
+
+oidc_error_t string_append(struct string* s, const char* data, size_t len) {
+  if (string_reserve(s, s->len + len) != OIDC_SUCCESS) {
+    return oidc_errno;
+  }
+  memcpy(s->ptr + s->len, data, len);
+  s->len += len;
+  s->ptr[s->len] = '\0';
+  return OIDC_SUCCESS;
+}
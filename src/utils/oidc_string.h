@@ -4,11 +4,20 @@
 #include <stddef.h>
 #include "oidc_error.h"
 
+/**
+ * A growable string buffer. @c ptr is always null-terminated and allocated with
+ * @c secAlloc, so it can be freed with @c secFree, which clears the whole
+ * capacity once. The capacity is doubled when it is exceeded, so appending is
+ * linear in the total length.
+ */
 struct string {
   char*  ptr;
   size_t len;
+  size_t cap;
 };
 
 oidc_error_t init_string(struct string* s);
+oidc_error_t string_reserve(struct string* s, size_t len);
+oidc_error_t string_append(struct string* s, const char* data, size_t len);
 
 #endif  // OIDC_STRING_H
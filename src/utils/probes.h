@@ -0,0 +1,29 @@
+#ifndef OIDC_PROBES_H
+#define OIDC_PROBES_H
+
+/**
+ * Static tracepoints (USDT probes) at the hot points of the agent, so that
+ * latencies can be measured on production builds, e.g. with
+ * @code
+ * bpftrace -e 'usdt:/usr/bin/oidc-agent:oidc_agent:http_start { ... }'
+ * @endcode
+ * The probes are compiled in if @c sys/sdt.h is available at build time
+ * (@c USE_SDT); an unused probe is a single @c nop. Otherwise the macros are
+ * empty and their arguments are not evaluated.
+ */
+
+#ifdef USE_SDT
+#include <sys/sdt.h>
+
+#define OIDC_PROBE(name) DTRACE_PROBE(oidc_agent, name)
+#define OIDC_PROBE1(name, a) DTRACE_PROBE1(oidc_agent, name, a)
+#define OIDC_PROBE2(name, a, b) DTRACE_PROBE2(oidc_agent, name, a, b)
+#define OIDC_PROBE3(name, a, b, c) DTRACE_PROBE3(oidc_agent, name, a, b, c)
+#else
+#define OIDC_PROBE(name)
+#define OIDC_PROBE1(name, a)
+#define OIDC_PROBE2(name, a, b)
+#define OIDC_PROBE3(name, a, b, c)
+#endif  // USE_SDT
+
+#endif  // OIDC_PROBES_H
@@ -0,0 +1,280 @@
+#define _DEFAULT_SOURCE
+#include "profiler.h"
+#include "utils/memory.h"
+#include "utils/oidc_string.h"
+#include "utils/stringUtils.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define PROFILER_HAVE_BACKTRACE
+#endif
+
+/**
+ * An on-demand sampling profiler. In cpu mode a @c SIGPROF timer records the
+ * stack of the running thread 100 times per second of cpu time; in heap mode
+ * the stack of an allocation is recorded every @c PROFILER_HEAP_INTERVAL bytes
+ * allocated with @c secAlloc. The samples are returned in the collapsed stack
+ * format (one line per stack, frames from the root to the leaf separated by
+ * @c ; followed by the number of samples or bytes) that flame graph tools read.
+ * Functions without a dynamic symbol are given as @c binary+offset and can be
+ * resolved with @c addr2line.
+ *
+ * The samples are written from the signal handler, so they are kept in a
+ * fixed buffer that is allocated when profiling starts; samples beyond it are
+ * only counted.
+ */
+
+#define PROFILER_HZ 100
+#define PROFILER_MAX_DEPTH 48
+#define PROFILER_MAX_SAMPLES 8192
+#define PROFILER_HEAP_INTERVAL (16 * 1024)
+
+struct profileSample {
+  void*         frames[PROFILER_MAX_DEPTH];
+  size_t        weight;
+  unsigned char depth;  // 0 while the sample is written
+};
+
+static struct profileSample* samples     = NULL;
+static size_t                usedSamples = 0;
+static size_t                dropped     = 0;
+static size_t                heapBytes   = 0;
+static unsigned char         heapMode    = 0;
+static time_t                endTime     = 0;
+
+#ifdef PROFILER_HAVE_BACKTRACE
+
+/**
+ * @brief records the current stack
+ * @param skip the number of innermost frames that belong to the profiler
+ */
+static __attribute__((noinline)) void _record(size_t weight, int skip) {
+  size_t i = __atomic_fetch_add(&usedSamples, 1, __ATOMIC_RELAXED);
+  if (samples == NULL || i >= PROFILER_MAX_SAMPLES) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  void* frames[PROFILER_MAX_DEPTH + 4];
+  int   n = backtrace(frames, PROFILER_MAX_DEPTH + skip);
+  if (n <= skip) {
+    return;
+  }
+  memcpy(samples[i].frames, frames + skip, sizeof(void*) * (n - skip));
+  samples[i].weight = weight;
+  __atomic_store_n(&samples[i].depth, n - skip, __ATOMIC_RELEASE);
+}
+
+static void _handleProfSignal(int sig) {
+  (void)sig;
+  int saved_errno = errno;
+  // _record, this handler and the signal trampoline
+  _record(1, 3);
+  errno = saved_errno;
+}
+
+static void _sampleAllocation(size_t size) {
+  size_t before = __atomic_fetch_add(&heapBytes, size, __ATOMIC_RELAXED);
+  size_t n = (before + size) / PROFILER_HEAP_INTERVAL -
+             before / PROFILER_HEAP_INTERVAL;
+  if (n > 0) {
+    // _record, this function and the allocation function of memory.c
+    _record(n * PROFILER_HEAP_INTERVAL, 3);
+  }
+}
+
+static void _setTimer(long usec) {
+  struct itimerval timer = {.it_interval = {.tv_usec = usec},
+                            .it_value    = {.tv_usec = usec}};
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+#endif  // PROFILER_HAVE_BACKTRACE
+
+/**
+ * @brief starts profiling for @p seconds
+ * The profile has to be collected with @c profiler_stop afterwards.
+ * @param heap if allocations are sampled instead of the cpu time
+ * @return @c OIDC_SUCCESS or an error code
+ */
+oidc_error_t profiler_start(unsigned long seconds, unsigned char heap) {
+#ifdef PROFILER_HAVE_BACKTRACE
+  if (samples != NULL) {
+    oidc_seterror("A profile is already being recorded");
+    oidc_errno = OIDC_EERROR;
+    return oidc_errno;
+  }
+  if (seconds == 0 || seconds > PROFILER_MAX_SECONDS) {
+    char* err = oidc_sprintf(
+        "The profile duration has to be between 1 and %d seconds",
+        PROFILER_MAX_SECONDS);
+    oidc_seterror(err);
+    oidc_errno = OIDC_EERROR;
+    secFree(err);
+    return oidc_errno;
+  }
+  samples = calloc(PROFILER_MAX_SAMPLES, sizeof(struct profileSample));
+  if (samples == NULL) {
+    oidc_errno = OIDC_EALLOC;
+    return oidc_errno;
+  }
+  void* frame;
+  backtrace(&frame, 1);  // loads the unwinder before it is used in a handler
+  usedSamples = 0;
+  dropped     = 0;
+  heapBytes   = 0;
+  heapMode    = heap;
+  endTime     = time(NULL) + seconds;
+  if (heap) {
+    secMemStats_setSampler(_sampleAllocation);
+  } else {
+    struct sigaction sa = {.sa_handler = _handleProfSignal,
+                           .sa_flags   = SA_RESTART};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+    _setTimer(1000000 / PROFILER_HZ);
+  }
+  return OIDC_SUCCESS;
+#else
+  (void)seconds;
+  (void)heap;
+  oidc_errno = OIDC_NOTIMPL;
+  return oidc_errno;
+#endif
+}
+
+int profiler_isRunning() { return samples != NULL; }
+
+/**
+ * @brief returns when the running profile is due
+ * @return the point in time or @c 0 if no profile is recorded
+ */
+time_t profiler_getEnd() { return samples ? endTime : 0; }
+
+#ifdef PROFILER_HAVE_BACKTRACE
+
+struct collapsedStack {
+  char*  stack;
+  size_t weight;
+};
+
+static int _compareStacks(const void* a, const void* b) {
+  return strcmp(((const struct collapsedStack*)a)->stack,
+                ((const struct collapsedStack*)b)->stack);
+}
+
+/**
+ * @brief returns the name of a frame as given by @c backtrace_symbols, i.e.
+ * the function name if there is one or @c binary+offset otherwise
+ */
+static char* _frameName(const char* symbol) {
+  const char* open  = strchr(symbol, '(');
+  const char* close = open ? strchr(open, ')') : NULL;
+  if (open == NULL || close == NULL) {
+    return oidc_strcopy(symbol);
+  }
+  const char* plus = memchr(open, '+', close - open);
+  if (plus && plus > open + 1) {  // function+offset
+    return oidc_strncopy(open + 1, plus - open - 1);
+  }
+  const char* path = strrchr(symbol, '/');
+  path             = path && path < open ? path + 1 : symbol;
+  char* binary     = oidc_strncopy(path, open - path);
+  char* offset     = plus ? oidc_strncopy(plus, close - plus) : NULL;
+  char* name       = oidc_sprintf("%s%s", binary, offset ?: "");
+  secFree(binary);
+  secFree(offset);
+  return name;
+}
+
+/**
+ * @brief returns the frames of a sample from the root to the leaf, separated
+ * by @c ; and prefixed with @p process
+ */
+static char* _collapseStack(const char* process,
+                            const struct profileSample* s) {
+  struct string str;
+  init_string(&str);
+  string_append(&str, process, strlen(process));
+  char** symbols = backtrace_symbols(s->frames, s->depth);
+  for (int f = s->depth - 1; f >= 0; f--) {
+    char* name = symbols ? _frameName(symbols[f])
+                         : oidc_sprintf("%p", s->frames[f]);
+    string_append(&str, ";", 1);
+    string_append(&str, name, strlen(name));
+    secFree(name);
+  }
+  free(symbols);
+  return str.ptr;
+}
+
+#endif  // PROFILER_HAVE_BACKTRACE
+
+/**
+ * @brief stops profiling and returns the profile
+ * @param process the name of the process; used as root frame of all stacks
+ * @return the profile in the collapsed stack format or @c NULL if no profile
+ * was recorded; has to be freed after usage
+ */
+char* profiler_stop(const char* process) {
+#ifdef PROFILER_HAVE_BACKTRACE
+  if (samples == NULL) {
+    return NULL;
+  }
+  if (heapMode) {
+    secMemStats_setSampler(NULL);
+  } else {
+    _setTimer(0);
+    signal(SIGPROF, SIG_IGN);
+  }
+  struct profileSample* recorded = samples;
+  samples                        = NULL;
+  size_t n = usedSamples < PROFILER_MAX_SAMPLES ? usedSamples
+                                                : PROFILER_MAX_SAMPLES;
+  // Samples with different addresses can have the same names, so they are
+  // merged by name
+  struct collapsedStack* stacks =
+      secAlloc(sizeof(struct collapsedStack) * (n ?: 1));
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (recorded[i].depth > 0) {
+      stacks[count].stack    = _collapseStack(process, &recorded[i]);
+      stacks[count++].weight = recorded[i].weight;
+    }
+  }
+  free(recorded);
+  qsort(stacks, count, sizeof(struct collapsedStack), _compareStacks);
+  struct string str;
+  init_string(&str);
+  size_t weight = 0;
+  for (size_t i = 0; i < count; i++) {
+    weight += stacks[i].weight;
+    if (i + 1 == count || _compareStacks(&stacks[i], &stacks[i + 1]) != 0) {
+      char* line = oidc_sprintf("%s %lu\n", stacks[i].stack,
+                                (unsigned long)weight);
+      string_append(&str, line, strlen(line));
+      secFree(line);
+      weight = 0;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    secFree(stacks[i].stack);
+  }
+  secFree(stacks);
+  if (dropped) {
+    char* line = oidc_sprintf("%s;[dropped] %lu\n", process,
+                              (unsigned long)dropped);
+    string_append(&str, line, strlen(line));
+    secFree(line);
+  }
+  return str.ptr;
+#else
+  (void)process;
+  return NULL;
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef OIDC_PROFILER_H
+#define OIDC_PROFILER_H
+
+#include "utils/oidc_error.h"
+
+#include <time.h>
+
+#define PROFILER_MAX_SECONDS 300
+
+oidc_error_t profiler_start(unsigned long seconds, unsigned char heap);
+int          profiler_isRunning();
+time_t       profiler_getEnd();
+char*        profiler_stop(const char* process);
+
+#endif  // OIDC_PROFILER_H
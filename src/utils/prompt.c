@@ -270,10 +270,18 @@ list_t* promptMultiple(const char* text, const char* label, list_t* init,
   return out;
 }
 
+/**
+ * @brief returns the command for a GUI consent prompt that defaults to yes
+ * The output of the command is @c yes if the user consented.
+ */
+char* _consentGUIDefaultYesCommand(const char* text) {
+  return oidc_sprintf("oidc-prompt confirm-default-yes "
+                      "\"oidc-agent prompt confirm\" \"%s\"",
+                      text);
+}
+
 int _promptConsentGUIDefaultYes(const char* text) {
-  char* cmd = oidc_sprintf("oidc-prompt confirm-default-yes "
-                           "\"oidc-agent prompt confirm\" \"%s\"",
-                           text);
+  char* cmd = _consentGUIDefaultYesCommand(text);
   char* out = getOutputFromCommand(cmd);
   secFree(cmd);
   int ret = out != NULL && strcaseequal(out, "yes") ? 1 : 0;
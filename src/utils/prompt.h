@@ -11,6 +11,7 @@ typedef char* (*promptFnc)(const char*, const char*, const char*,
 
 char* _promptPasswordGUI(const char* text, const char* label, const char* init);
 int   _promptConsentGUIDefaultYes(const char* text);
+char* _consentGUIDefaultYesCommand(const char* text);
 char* promptPassword(const char* text, const char* label, const char* init,
                      unsigned char cliVerbose);
 char* prompt(const char* text, const char* label, const char* init,
@@ -2,6 +2,7 @@
 
 #include "account/issuer_helper.h"
 #include "defines/settings.h"
+#include "utils/db/db_index.h"
 #include "utils/file_io/file_io.h"
 #include "utils/file_io/oidc_file_io.h"
 #include "utils/listUtils.h"
@@ -9,6 +10,8 @@
 #include "utils/stringUtils.h"
 
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 void secFreePubClientInfos(struct pubClientInfos* p) {
   if (p == NULL) {
@@ -20,46 +23,151 @@ void secFreePubClientInfos(struct pubClientInfos* p) {
   secFree(p);
 }
 
-struct pubClientInfos* _getPubClientInfosFromList(list_t*     lines,
-                                                  const char* issuer) {
-  if (lines == NULL) {
-    return NULL;
+/**
+ * An in-memory table of the public clients from the system wide and the
+ * user's pubclients.config. A file is parsed once and only parsed again if it
+ * changed on disk (inode, size or mtime), so a lookup only costs a @c stat and
+ * a hash lookup. Issuer urls are indexed with @c compIssuerUrls semantics; if
+ * an issuer is listed multiple times, the first line wins.
+ */
+
+struct pubClientTable_file {
+  char*            path;
+  unsigned char    loaded;
+  ino_t            ino;
+  off_t            size;
+  time_t           mtime;
+  list_t*          entries;  // owns the entries
+  struct db_index* index;
+};
+
+struct pubClientTable_entry {
+  char*                 issuer_url;
+  struct pubClientInfos infos;
+};
+
+static struct pubClientTable_file etcFile  = {0};
+static struct pubClientTable_file userFile = {0};
+
+static void _secFreePubClientTableEntry(struct pubClientTable_entry* e) {
+  secFree(e->issuer_url);
+  secFree(e->infos.client_id);
+  secFree(e->infos.client_secret);
+  secFree(e->infos.scope);
+  secFree(e);
+}
+
+static const char* _getIssuerUrl(const struct pubClientTable_entry* e) {
+  return e->issuer_url;
+}
+
+static void _clear(struct pubClientTable_file* file) {
+  if (file->index) {
+    dbIndex_clear(file->index);
+  } else {
+    file->index = dbIndex_new((indexKeyFunction)_getIssuerUrl,
+                              (indexMatchFunction)compIssuerUrls);
+  }
+  secFreeList(file->entries);
+  file->entries       = list_new();
+  file->entries->free = (void (*)(void*))_secFreePubClientTableEntry;
+}
+
+/**
+ * @brief parses a line of the format
+ * @c <client_id>[:<client_secret>]@issuer[@<scopes>] into the table
+ */
+static int _parseLine(char* line, struct pubClientTable_file* file) {
+  char* client = strtok(line, "@");
+  char* iss    = strtok(NULL, "@");
+  char* scope  = strtok(NULL, "@");
+  if (client == NULL || iss == NULL || dbIndex_find(file->index, iss)) {
+    return 0;
   }
-  list_node_t*     node;
-  list_iterator_t* it = list_iterator_new(lines, LIST_HEAD);
-  while ((node = list_iterator_next(it))) {
-    char* client = strtok(node->val, "@");
-    char* iss    = strtok(NULL, "@");
-    char* scope  = strtok(NULL, "@");
-    // logger(DEBUG, "Found public client for '%s'", iss);
-    if (compIssuerUrls(issuer, iss)) {
-      char*                  client_id     = strtok(client, ":");
-      char*                  client_secret = strtok(NULL, ":");
-      struct pubClientInfos* infos = secAlloc(sizeof(struct pubClientInfos));
-      infos->client_id             = oidc_strcopy(client_id);
-      infos->client_secret         = oidc_strcopy(client_secret);
-      infos->scope                 = oidc_strcopy(scope);
-      list_iterator_destroy(it);
-      return infos;
+  char* client_id     = strtok(client, ":");
+  char* client_secret = strtok(NULL, ":");
+  struct pubClientTable_entry* e =
+      secAlloc(sizeof(struct pubClientTable_entry));
+  e->issuer_url          = oidc_strcopy(iss);
+  e->infos.client_id     = oidc_strcopy(client_id);
+  e->infos.client_secret = oidc_strcopy(client_secret);
+  e->infos.scope         = oidc_strcopy(scope);
+  list_rpush(file->entries, list_node_new(e));
+  dbIndex_add(file->index, e);
+  return 0;
+}
+
+/**
+ * @brief makes sure the table of @p file is up to date with the file on disk
+ */
+static struct pubClientTable_file* _refresh(struct pubClientTable_file* file,
+                                            unsigned char userSpace) {
+  if (file->path == NULL) {
+    file->path = userSpace ? concatToOidcDir(PUBCLIENTS_FILENAME)
+                           : oidc_strcopy(ETC_PUBCLIENTS_CONFIG_FILE);
+  }
+  struct stat st;
+  int         exists = file->path && stat(file->path, &st) == 0;
+  if (file->loaded && (exists ? file->ino == st.st_ino &&
+                                    file->size == st.st_size &&
+                                    file->mtime == st.st_mtime
+                              : file->size == 0 && file->ino == 0)) {
+    return file;
+  }
+  _clear(file);
+  file->loaded = 1;
+  file->ino    = exists ? st.st_ino : 0;
+  file->size   = exists ? st.st_size : 0;
+  file->mtime  = exists ? st.st_mtime : 0;
+  if (!exists) {
+    if (userSpace) {
+      secFree(file->path);  // the oidc dir might be created later
     }
+    return file;
   }
-  list_iterator_destroy(it);
-  return NULL;
+  forEachLineInFile(file->path, 1, (lineCallback)_parseLine, file);
+  return file;
 }
 
+/**
+ * @brief returns the public client for an issuer
+ * The system wide pubclients.config takes precedence over the user's file.
+ * @return the client infos or @c NULL if there is no public client for
+ * @p issuer; have to be freed after usage
+ */
 struct pubClientInfos* getPubClientInfos(const char* issuer) {
-  list_t* pubClientLines =
-      getLinesFromFileWithoutComments(ETC_PUBCLIENTS_CONFIG_FILE);
-  struct pubClientInfos* infos =
-      _getPubClientInfosFromList(pubClientLines, issuer);
-  secFreeList(pubClientLines);
-  if (infos != NULL) {
+  if (issuer == NULL) {
+    return NULL;
+  }
+  struct pubClientTable_file* files[] = {_refresh(&etcFile, 0),
+                                         _refresh(&userFile, 1)};
+  for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+    const struct pubClientTable_entry* e =
+        dbIndex_find(files[i]->index, issuer);
+    if (e == NULL) {
+      continue;
+    }
+    struct pubClientInfos* infos = secAlloc(sizeof(struct pubClientInfos));
+    infos->client_id             = oidc_strcopy(e->infos.client_id);
+    infos->client_secret         = oidc_strcopy(e->infos.client_secret);
+    infos->scope                 = oidc_strcopy(e->infos.scope);
     return infos;
   }
-  pubClientLines = getLinesFromOidcFileWithoutComments(PUBCLIENTS_FILENAME);
-  infos          = _getPubClientInfosFromList(pubClientLines, issuer);
-  secFreeList(pubClientLines);
-  return infos;
+  return NULL;
+}
+
+/**
+ * @brief drops the table, so that the files are parsed again on the next
+ * lookup
+ */
+void pubClientInfos_reset() {
+  struct pubClientTable_file* files[] = {&etcFile, &userFile};
+  for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+    secFreeList(files[i]->entries);
+    dbIndex_free(files[i]->index);
+    secFree(files[i]->path);
+    *files[i] = (struct pubClientTable_file){0};
+  }
 }
 
 list_t* defaultRedirectURIs() {
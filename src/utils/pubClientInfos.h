@@ -11,6 +11,7 @@ struct pubClientInfos {
 
 void                   secFreePubClientInfos(struct pubClientInfos* p);
 struct pubClientInfos* getPubClientInfos(const char* issuer);
+void                   pubClientInfos_reset();
 list_t*                defaultRedirectURIs();
 
 #endif /* PUBCLIENT_INFOS_H */
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+#include "requestTrace.h"
+#include "defines/ipc_values.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "wrapper/list.h"
+
+#include <string.h>
+#include <time.h>
+
+/**
+ * A request trace records monotonic timestamps at the stage boundaries of a
+ * single request. The marks travel with the request as the @c IPC_KEY_TRACE
+ * array: every process adds its marks, and the response carries all of them
+ * back to the client. @c CLOCK_MONOTONIC is shared by all processes of a host,
+ * so the marks of different processes can be compared.
+ *
+ * A thread traces at most one request at a time. oidcp, which handles
+ * several requests concurrently, adds its marks directly to the messages with
+ * @c requestTrace_markMessage.
+ *
+ * A process can also trace a request for itself, e.g. to log the stages of
+ * slow requests; such a trace is not returned to the client.
+ */
+
+struct traceMark {
+  char*  stage;
+  double t;
+};
+
+static __thread list_t*       marks     = NULL;
+static __thread unsigned char forClient = 0;
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _secFreeTraceMark(struct traceMark* m) {
+  secFree(m->stage);
+  secFree(m);
+}
+
+static int _compareTraceMarks(const struct traceMark* a,
+                              const struct traceMark* b) {
+  return a->t < b->t ? -1 : a->t > b->t;
+}
+
+static void _addMark(const char* stage, double t) {
+  struct traceMark* m = secAlloc(sizeof(struct traceMark));
+  m->stage            = oidc_strcopy(stage);
+  m->t                = t;
+  list_rpush(marks, list_node_new(m));
+}
+
+static void _addMarksFromJSON(const char* trace_json) {
+  cJSON* trace = stringToJson(trace_json);
+  if (trace == NULL || !cJSON_IsArray(trace)) {
+    secFreeJson(trace);
+    return;
+  }
+  cJSON* mark;
+  cJSON_ArrayForEach(mark, trace) {
+    cJSON* stage = cJSON_GetObjectItemCaseSensitive(mark, "stage");
+    cJSON* t     = cJSON_GetObjectItemCaseSensitive(mark, "t");
+    if (cJSON_IsString(stage) && cJSON_IsNumber(t)) {
+      _addMark(stage->valuestring, t->valuedouble);
+    }
+  }
+  secFreeJson(trace);
+}
+
+static cJSON* _marksToJSON() {
+  cJSON* trace = cJSON_CreateArray();
+  for (list_node_t* node = marks->head; node; node = node->next) {
+    const struct traceMark* m    = node->val;
+    cJSON*                  mark = cJSON_CreateObject();
+    jsonAddStringValue(mark, "stage", m->stage);
+    jsonAddNumberValue(mark, "t", m->t);
+    cJSON_AddItemToArray(trace, mark);
+  }
+  return trace;
+}
+
+/**
+ * @brief starts tracing the current request
+ * @param trace_json the marks of the processes the request already passed as a
+ * json array; may be @c NULL
+ */
+void requestTrace_start(const char* trace_json) {
+  requestTrace_stop();
+  marks       = list_new();
+  marks->free = (void (*)(void*))_secFreeTraceMark;
+  if (trace_json) {
+    _addMarksFromJSON(trace_json);
+  }
+  forClient = 1;
+}
+
+/**
+ * @brief starts tracing the current request without returning the trace to
+ * the client
+ */
+void requestTrace_startLocal() {
+  requestTrace_start(NULL);
+  forClient = 0;
+}
+
+/**
+ * @brief checks if a request is traced
+ */
+unsigned char requestTrace_isActive() { return marks != NULL; }
+
+/**
+ * @brief checks if the trace of the current request is returned to the client
+ */
+unsigned char requestTrace_isForClient() { return marks != NULL && forClient; }
+
+/**
+ * @brief records that the traced request reached @p stage
+ * Does nothing if no request is traced.
+ */
+void requestTrace_mark(const char* stage) {
+  if (marks == NULL) {
+    return;
+  }
+  _addMark(stage, _now());
+}
+
+/**
+ * @brief records that the traced request reached @p stage at the monotonic
+ * time @p t
+ * This can be used for stages that were measured by someone else, e.g. by
+ * curl. Does nothing if no request is traced.
+ */
+void requestTrace_markAt(const char* stage, double t) {
+  if (marks == NULL) {
+    return;
+  }
+  _addMark(stage, t);
+  if (marks->len > 1) {
+    list_mergeSort(marks,
+                   (int (*)(const void*, const void*))_compareTraceMarks);
+  }
+}
+
+/**
+ * @brief adds the marks returned by another process to the current trace
+ * @param trace_json the marks as a json array
+ */
+void requestTrace_merge(const char* trace_json) {
+  if (marks == NULL || trace_json == NULL) {
+    return;
+  }
+  _addMarksFromJSON(trace_json);
+  if (marks->len < 2) {
+    return;
+  }
+  list_mergeSort(marks, (int (*)(const void*, const void*))_compareTraceMarks);
+}
+
+/**
+ * @brief stops tracing and discards all marks
+ */
+void requestTrace_stop() {
+  secFreeList(marks);
+  marks     = NULL;
+  forClient = 0;
+}
+
+/**
+ * @brief renders the current trace with the time of every stage since the
+ * first mark and since the previous mark
+ * @return a pointer to the text or @c NULL if no request is traced; it has to
+ * be freed after usage
+ */
+char* requestTrace_toText() {
+  if (marks == NULL) {
+    return NULL;
+  }
+  char*  text  = oidc_sprintf("%-32s %12s %12s\n", "stage", "total ms",
+                              "delta ms");
+  double first = marks->head ? ((struct traceMark*)marks->head->val)->t : 0;
+  double prev  = first;
+  for (list_node_t* node = marks->head; node; node = node->next) {
+    const struct traceMark* m   = node->val;
+    char*                   tmp = oidc_sprintf(
+        "%s%-32s %12.3f %12.3f\n", text, m->stage, (m->t - first) * 1e3,
+        (m->t - prev) * 1e3);
+    secFree(text);
+    text = tmp;
+    prev = m->t;
+  }
+  return text;
+}
+
+/**
+ * @brief renders the marks since @p since on a single line, each with the
+ * time since the previous mark, e.g. for a log message
+ * @param since a monotonic time; earlier marks are skipped
+ * @return a pointer to the text or @c NULL if no request is traced; it has to
+ * be freed after usage
+ */
+char* requestTrace_toSummary(double since) {
+  if (marks == NULL) {
+    return NULL;
+  }
+  char*  text = oidc_strcopy("");
+  double prev = since;
+  for (list_node_t* node = marks->head; node; node = node->next) {
+    const struct traceMark* m = node->val;
+    if (m->t < since) {
+      continue;
+    }
+    char* tmp = oidc_sprintf("%s%s%s=%.3fms", text, *text ? " " : "", m->stage,
+                             (m->t - prev) * 1e3);
+    secFree(text);
+    text = tmp;
+    prev = m->t;
+  }
+  return text;
+}
+
+/**
+ * @brief adds the current trace to a (response) message
+ * @param msg the json encoded message
+ * @return a pointer to the new message or @c NULL if no request is traced for
+ * the client; it has to be freed after usage
+ */
+char* requestTrace_attachToMessage(const char* msg) {
+  if (!requestTrace_isForClient()) {
+    return NULL;
+  }
+  cJSON* json = stringToJson(msg);
+  if (json == NULL) {
+    return NULL;
+  }
+  jsonAddJSON(json, IPC_KEY_TRACE, _marksToJSON());
+  char* ret = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return ret;
+}
+
+/**
+ * @brief adds a mark to the trace contained in @p msg
+ * This does not use the trace of the current process and can be used for
+ * messages of different requests.
+ * @param msg the json encoded message
+ * @param stage the name of the reached stage
+ * @return a pointer to the new message or @c NULL if @p msg is not traced;
+ * it has to be freed after usage
+ */
+char* requestTrace_markMessage(const char* msg, const char* stage) {
+  // cheap check first, most messages are not traced
+  if (msg == NULL || strstr(msg, "\"" IPC_KEY_TRACE "\"") == NULL) {
+    return NULL;
+  }
+  cJSON* json = stringToJson(msg);
+  if (json == NULL) {
+    return NULL;
+  }
+  cJSON* trace = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_TRACE);
+  if (!cJSON_IsArray(trace)) {
+    secFreeJson(json);
+    return NULL;
+  }
+  cJSON* mark = cJSON_CreateObject();
+  jsonAddStringValue(mark, "stage", stage);
+  jsonAddNumberValue(mark, "t", _now());
+  cJSON_AddItemToArray(trace, mark);
+  char* ret = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return ret;
+}
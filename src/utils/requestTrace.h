@@ -0,0 +1,17 @@
+#ifndef OIDC_REQUEST_TRACE_H
+#define OIDC_REQUEST_TRACE_H
+
+void          requestTrace_start(const char* trace_json);
+void          requestTrace_startLocal();
+unsigned char requestTrace_isActive();
+unsigned char requestTrace_isForClient();
+void          requestTrace_mark(const char* stage);
+void          requestTrace_markAt(const char* stage, double t);
+void          requestTrace_merge(const char* trace_json);
+char*         requestTrace_toText();
+char*         requestTrace_toSummary(double since);
+void          requestTrace_stop();
+char*         requestTrace_attachToMessage(const char* msg);
+char*         requestTrace_markMessage(const char* msg, const char* stage);
+
+#endif  // OIDC_REQUEST_TRACE_H
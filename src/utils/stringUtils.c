@@ -235,17 +235,22 @@ char* escapeCharInStr(const char* str, char c) {
     oidc_setArgNullFuncError(__func__);
     return NULL;
   }
-  char*        s   = oidc_strcopy(str);
+  char* s = oidc_strcopy(str);
+  if (s == NULL) {
+    return NULL;
+  }
+  // every escape grows the string by one byte
+  char* tmp = secReserve(s, strlen(s) + 1 + strCountChar(s, c));
+  if (tmp == NULL) {
+    secFree(s);
+    return NULL;
+  }
+  s                = tmp;
   const char*  pos = s;
   unsigned int rel = pos - s;
   while (rel < strlen(s) && (pos = strchr(s + rel, c)) != NULL) {
-    rel       = pos - s;
-    char* tmp = secRealloc(s, strlen(s) + 1 + 1);
-    if (tmp == NULL) {
-      secFree(s);
-      return NULL;
-    }
-    s = tmp;
+    rel = pos - s;
+    s   = secRealloc(s, strlen(s) + 1 + 1);  // within the reserved capacity
     memmove(s + rel + 1, s + rel, strlen(s + rel) + 1);
     s[rel] = '\\';
     rel += 2;
@@ -4,8 +4,10 @@
 #include "utils/logger.h"
 #include "utils/oidc_error.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 char* getOutputFromCommand(const char* cmd) {
   if (cmd == NULL) {
@@ -25,3 +27,45 @@ char* getOutputFromCommand(const char* cmd) {
   pclose(fp);
   return ret;
 }
+
+/**
+ * @brief starts a command without waiting for it
+ * @param cmd the command; it is run by @c /bin/sh like with @c popen
+ * @param out_fd is set to a non-blocking fd from which the output of the
+ * command can be read
+ * @return the pid of the command or @c -1 on failure. The caller has to close
+ * @p out_fd and reap the process with @c waitpid.
+ */
+pid_t startCommand(const char* cmd, int* out_fd) {
+  if (cmd == NULL || out_fd == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return -1;
+  }
+  int fds[2];
+  if (pipe(fds) != 0) {
+    oidc_setErrnoError();
+    return -1;
+  }
+  logger(DEBUG, "Starting command: %s", cmd);
+  pid_t pid = fork();
+  if (pid == -1) {
+    oidc_setErrnoError();
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0) {  // child
+    close(fds[0]);
+    if (fds[1] != STDOUT_FILENO) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[1]);
+    }
+    execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  *out_fd = fds[0];
+  return pid;
+}
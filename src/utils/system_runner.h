@@ -1,6 +1,9 @@
 #ifndef OIDC_SYSTEM_RUNNER_H
 #define OIDC_SYSTEM_RUNNER_H
 
+#include <sys/types.h>
+
 char* getOutputFromCommand(const char* cmd);
+pid_t startCommand(const char* cmd, int* out_fd);
 
 #endif  // OIDC_SYSTEM_RUNNER_H
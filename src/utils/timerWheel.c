@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+#include "timerWheel.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "wrapper/list.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+/**
+ * The deadlines of the agent's subsystems, e.g. device polling or the periodic
+ * warm-up, are kept in a single hierarchical timer wheel with a resolution of
+ * one second. Each level has @c TIMERWHEEL_SLOTS slots; a slot of level @c n
+ * covers @c TIMERWHEEL_SLOTS^n seconds. A timer is put into the lowest level
+ * whose range reaches its expiry, so adding and cancelling a timer is O(1).
+ * When the wheel advances over the start of a slot of a higher level, the
+ * timers of that slot are moved down (cascaded). Timers further away than the
+ * highest level reaches are kept in its last slot and cascaded again.
+ *
+ * All timers that are due when the wheel advances are detached first and
+ * their callbacks are called in one batch; callbacks may add or cancel timers.
+ *
+ * On Linux the next expiry is also armed on a timerfd (see
+ * @c timerWheel_getFd), so an event loop can watch it like any other fd.
+ * Otherwise the event loop uses @c timerWheel_getNextTime as its timeout.
+ */
+
+#define TIMERWHEEL_BITS 6
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_MASK (TIMERWHEEL_SLOTS - 1)
+#define TIMERWHEEL_LEVELS 4
+
+struct timerWheel_timer {
+  time_t        expires;
+  timerCallback callback;
+  void*         arg;
+  list_t*       slot;  // the slot or batch the timer is currently in
+  list_node_t*  node;
+};
+
+static list_t*       wheel[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+static list_t*       expiring = NULL;  // the batch whose callbacks are called
+static time_t        current  = 0;     // the second the wheel advanced to
+static size_t        count    = 0;
+static time_t        armed    = 0;  // the expiry the timerfd is armed for
+static int           fd       = -1;
+static unsigned char running  = 0;
+
+static time_t _slotStart(size_t level, time_t t) {
+  return (t >> (level * TIMERWHEEL_BITS)) << (level * TIMERWHEEL_BITS);
+}
+
+static void _insert(struct timerWheel_timer* timer) {
+  if (timer->expires <= current) {  // due, e.g. cascaded in its second
+    if (expiring == NULL) {
+      expiring = list_new();
+    }
+    timer->slot = expiring;
+    timer->node = list_rpush(expiring, list_node_new(timer));
+    return;
+  }
+  time_t expires = timer->expires;
+  size_t level   = 0;
+  while (level < TIMERWHEEL_LEVELS - 1 &&
+         (expires >> (level * TIMERWHEEL_BITS)) -
+                 (current >> (level * TIMERWHEEL_BITS)) >=
+             TIMERWHEEL_SLOTS) {
+    level++;
+  }
+  time_t distance = (expires >> (level * TIMERWHEEL_BITS)) -
+                    (current >> (level * TIMERWHEEL_BITS));
+  if (distance >= TIMERWHEEL_SLOTS) {  // beyond the highest level
+    expires = current + ((time_t)TIMERWHEEL_MASK
+                         << (level * TIMERWHEEL_BITS));
+  }
+  size_t   index = (expires >> (level * TIMERWHEEL_BITS)) & TIMERWHEEL_MASK;
+  list_t** slot  = &wheel[level][index];
+  if (*slot == NULL) {
+    *slot = list_new();
+  }
+  timer->slot = *slot;
+  timer->node = list_rpush(*slot, list_node_new(timer));
+}
+
+static void _arm(time_t expires) {
+#ifdef __linux__
+  if (fd < 0) {
+    return;
+  }
+  // A zero time would disarm the timerfd; any time in the past fires at once
+  struct itimerspec spec = {.it_value = {.tv_sec = expires > 0 ? expires : 1}};
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+    logger(ERROR, "Could not arm timerfd: %m");
+    return;
+  }
+  armed = expires;
+#else
+  (void)expires;
+#endif
+}
+
+/**
+ * @brief adds a timer
+ * @param expires the point in time when @p callback is called with @p arg; if
+ * it is not in the future, the callback is called by the next
+ * @c timerWheel_runDue
+ * @return a handle to cancel the timer; it is invalid once the callback was
+ * called
+ */
+struct timerWheel_timer* timerWheel_add(time_t expires, timerCallback callback,
+                                        void* arg) {
+  if (count == 0 && !running) {
+    current = time(NULL);
+  }
+  struct timerWheel_timer* timer = secAlloc(sizeof(struct timerWheel_timer));
+  timer->expires                 = expires;
+  timer->callback                = callback;
+  timer->arg                     = arg;
+  _insert(timer);
+  count++;
+  if (armed == 0 || expires < armed) {
+    _arm(expires);  // fires at once if it is in the past
+  }
+  return timer;
+}
+
+/**
+ * @brief cancels a timer whose callback was not called yet
+ * The timerfd is not disarmed; it might wake up the event loop once for
+ * nothing.
+ */
+void timerWheel_cancel(struct timerWheel_timer* timer) {
+  if (timer == NULL) {
+    return;
+  }
+  list_remove(timer->slot, timer->node);
+  secFree(timer);
+  count--;
+}
+
+static void _expire(list_t* slot) {
+  list_node_t* node;
+  while ((node = list_lpop(slot))) {
+    struct timerWheel_timer* timer = node->val;
+    LIST_FREE(node);
+    timer->slot = expiring;
+    timer->node = list_rpush(expiring, list_node_new(timer));
+  }
+}
+
+static void _cascade(size_t level) {
+  size_t  index = (current >> (level * TIMERWHEEL_BITS)) & TIMERWHEEL_MASK;
+  list_t* slot  = wheel[level][index];
+  if (slot == NULL || slot->len == 0) {
+    return;
+  }
+  list_node_t* node;
+  while ((node = list_lpop(slot))) {
+    struct timerWheel_timer* timer = node->val;
+    LIST_FREE(node);
+    _insert(timer);
+  }
+}
+
+static void _advance(time_t now) {
+  while (current < now) {
+    if (count == 0) {
+      current = now;
+      return;
+    }
+    current++;
+    for (size_t level = TIMERWHEEL_LEVELS - 1; level > 0; level--) {
+      if (_slotStart(level, current) == current) {
+        _cascade(level);
+      }
+    }
+    if (wheel[0][current & TIMERWHEEL_MASK]) {
+      _expire(wheel[0][current & TIMERWHEEL_MASK]);
+    }
+  }
+}
+
+/**
+ * @brief returns the earliest expiry of all timers
+ * @return the point in time or @c 0 if there is no timer
+ */
+time_t timerWheel_getNextTime() {
+  if (count == 0) {
+    return 0;
+  }
+  if (expiring && expiring->len) {
+    return current;
+  }
+  for (size_t level = 0; level < TIMERWHEEL_LEVELS; level++) {
+    size_t shift = level * TIMERWHEEL_BITS;
+    // Timers of a lower level expire before those of a higher one, and the
+    // slot of the current second was already run or cascaded
+    for (time_t i = 1; i < TIMERWHEEL_SLOTS; i++) {
+      list_t* slot = wheel[level][((current >> shift) + i) & TIMERWHEEL_MASK];
+      if (slot == NULL || slot->len == 0) {
+        continue;
+      }
+      time_t next = 0;
+      for (list_node_t* node = slot->head; node; node = node->next) {
+        const struct timerWheel_timer* timer = node->val;
+        if (next == 0 || timer->expires < next) {
+          next = timer->expires;
+        }
+      }
+      return next > current ? next : current + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief advances the wheel to @p now and calls the callbacks of all timers
+ * that are due
+ * @param now the current time, usually @c time(NULL)
+ */
+void timerWheel_runDue(time_t now) {
+#ifdef __linux__
+  if (fd >= 0) {
+    unsigned long long expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+      // nothing to drain, e.g. called before the timerfd fired
+    }
+  }
+#endif
+  if (running) {  // called from a callback
+    return;
+  }
+  running = 1;
+  if (expiring == NULL) {
+    expiring = list_new();
+  }
+  _advance(now);  // timers that were due already are expiring as well
+  list_node_t* node;
+  while ((node = list_lpop(expiring))) {
+    struct timerWheel_timer* timer = node->val;
+    LIST_FREE(node);
+    count--;
+    timerCallback callback = timer->callback;
+    void*         arg      = timer->arg;
+    secFree(timer);
+    callback(arg);
+  }
+  running = 0;
+  armed   = 0;
+  time_t next = timerWheel_getNextTime();
+  if (next) {
+    _arm(next);
+  }
+}
+
+/**
+ * @brief moves all timers that are not due yet by @p delta seconds, e.g.
+ * because the wall clock was set by that much, so that they still expire after
+ * the duration they were added with
+ */
+void timerWheel_shift(time_t delta) {
+  if (delta == 0 || count == 0) {
+    return;
+  }
+  list_t* timers = list_new();
+  for (size_t level = 0; level < TIMERWHEEL_LEVELS; level++) {
+    for (size_t i = 0; i < TIMERWHEEL_SLOTS; i++) {
+      list_node_t* node;
+      while (wheel[level][i] && (node = list_lpop(wheel[level][i]))) {
+        list_rpush(timers, node);
+      }
+    }
+  }
+  current += delta;
+  list_node_t* node;
+  while ((node = list_lpop(timers))) {
+    struct timerWheel_timer* timer = node->val;
+    LIST_FREE(node);
+    timer->expires += delta;
+    _insert(timer);
+  }
+  list_destroy(timers);
+  armed       = 0;
+  time_t next = timerWheel_getNextTime();
+  if (next) {
+    _arm(next);
+  }
+}
+
+/**
+ * @brief returns a timerfd that becomes readable when a timer is due
+ * The fd is created on first use. Once it is readable, @c timerWheel_runDue
+ * has to be called.
+ * @return the fd or @c -1 if timerfds are not supported
+ */
+int timerWheel_getFd() {
+#ifdef __linux__
+  if (fd < 0) {
+    fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+      logger(ERROR, "Could not create timerfd: %m");
+      return -1;
+    }
+    armed       = 0;
+    time_t next = timerWheel_getNextTime();
+    if (next) {
+      _arm(next);
+    }
+  }
+#endif
+  return fd;
+}
+
+size_t timerWheel_count() { return count; }
+
+/**
+ * @brief removes all timers without calling their callbacks and closes the
+ * timerfd, e.g. in a child process that inherited the wheel
+ */
+void timerWheel_clear() {
+  for (size_t level = 0; level < TIMERWHEEL_LEVELS; level++) {
+    for (size_t i = 0; i < TIMERWHEEL_SLOTS; i++) {
+      if (wheel[level][i]) {
+        wheel[level][i]->free = _secFree;
+        list_destroy(wheel[level][i]);
+        wheel[level][i] = NULL;
+      }
+    }
+  }
+  if (expiring) {
+    expiring->free = _secFree;
+    list_destroy(expiring);
+    expiring = NULL;
+  }
+  count = 0;
+  armed = 0;
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef OIDC_TIMERWHEEL_H
+#define OIDC_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <time.h>
+
+typedef void (*timerCallback)(void* arg);
+
+struct timerWheel_timer;
+
+struct timerWheel_timer* timerWheel_add(time_t expires, timerCallback callback,
+                                        void* arg);
+void                     timerWheel_cancel(struct timerWheel_timer* timer);
+time_t                   timerWheel_getNextTime();
+void                     timerWheel_runDue(time_t now);
+void                     timerWheel_shift(time_t delta);
+int                      timerWheel_getFd();
+size_t                   timerWheel_count();
+void                     timerWheel_clear();
+
+#endif  // OIDC_TIMERWHEEL_H
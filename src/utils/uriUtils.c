@@ -45,6 +45,42 @@ oidc_error_t urldecode(char* dst, const char* src) {
   return OIDC_SUCCESS;
 }
 
+static int _isUnreserved(unsigned char c) {
+  return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/**
+ * @brief returns the length of @p src after percent-encoding it
+ */
+size_t urlencodedLength(const char* src) {
+  size_t len = 0;
+  for (; src && *src; src++) {
+    len += _isUnreserved(*src) ? 1 : 3;
+  }
+  return len;
+}
+
+/**
+ * @brief percent-encodes @p src into @p dst
+ * @param dst has to hold at least @c urlencodedLength(src) bytes; it is not
+ * null-terminated
+ * @return a pointer after the last written character
+ */
+char* urlencodeInto(char* dst, const char* src) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (; src && *src; src++) {
+    unsigned char c = *src;
+    if (_isUnreserved(c)) {
+      *dst++ = c;
+    } else {
+      *dst++ = '%';
+      *dst++ = hex[c >> 4];
+      *dst++ = hex[c & 0x0F];
+    }
+  }
+  return dst;
+}
+
 char* getBaseUri(const char* uri) {
   if (uri == NULL) {
     oidc_setArgNullFuncError(__func__);
@@ -4,6 +4,8 @@
 #include "utils/oidc_error.h"
 #include "wrapper/list.h"
 
+#include <stddef.h>
+
 struct codeState {
   char* code;
   char* state;
@@ -16,5 +18,7 @@ char*            findCustomSchemeUri(list_t* uris);
 char* extractParameterValueFromUri(const char* uri, const char* parameter);
 char* getBaseUri(const char* uri);
 oidc_error_t checkRedirectUrisForErrors(list_t* redirect_uris);
+size_t       urlencodedLength(const char* src);
+char*        urlencodeInto(char* dst, const char* src);
 
 #endif  // OIDC_URIUTILS_H
@@ -0,0 +1,153 @@
+#include "vector.h"
+
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/oidc_string.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#define VECTOR_MIN_CAP 8
+
+vector_t* vector_new() { return secAlloc(sizeof(vector_t)); }
+
+/**
+ * @brief creates a vector of the given values; the values are not copied
+ * The last argument has to be @c NULL
+ */
+vector_t* createVector(void* first, ...) {
+  vector_t* vector = vector_new();
+  if (vector == NULL) {
+    return NULL;
+  }
+  va_list args;
+  va_start(args, first);
+  for (void* v = first; v != NULL; v = va_arg(args, void*)) {
+    vector_push(vector, v);
+  }
+  va_end(args);
+  return vector;
+}
+
+/**
+ * @brief frees a vector and, if a free function is set, all its values
+ */
+void secFreeVector(vector_t* vector) {
+  if (vector == NULL) {
+    return;
+  }
+  vector_clear(vector);
+  secFree(vector->items);
+  secFree(vector);
+}
+
+/**
+ * @brief appends @p value to @p vector; @c NULL values are allowed
+ * @return @c OIDC_SUCCESS or an error code if the vector could not be grown
+ */
+oidc_error_t vector_push(vector_t* vector, void* value) {
+  if (vector == NULL) {
+    oidc_setArgNullFuncError(__func__);
+    return oidc_errno;
+  }
+  if (vector->len == vector->cap) {
+    size_t cap   = vector->cap ? 2 * vector->cap : VECTOR_MIN_CAP;
+    void** items = secRealloc(vector->items, cap * sizeof(void*));
+    if (items == NULL) {
+      return oidc_errno;
+    }
+    vector->items = items;
+    vector->cap   = cap;
+  }
+  vector->items[vector->len++] = value;
+  return OIDC_SUCCESS;
+}
+
+/**
+ * @brief returns the index of the first value matching @p key
+ * Values are compared with the match function of the vector or, if none is
+ * set, by pointer.
+ * @return the index or @c vector->len if no value matches
+ */
+size_t vector_indexOf(const vector_t* vector, const void* key) {
+  if (vector == NULL) {
+    return 0;
+  }
+  for (size_t i = 0; i < vector->len; i++) {
+    if (vector->match ? vector->match(key, vector->items[i])
+                      : key == vector->items[i]) {
+      return i;
+    }
+  }
+  return vector->len;
+}
+
+/**
+ * @brief returns the first value matching @p key or @c NULL
+ */
+void* vector_find(const vector_t* vector, const void* key) {
+  size_t i = vector_indexOf(vector, key);
+  return vector && i < vector->len ? vector->items[i] : NULL;
+}
+
+/**
+ * @brief removes the value at @p index, freeing it with the free function of
+ * the vector; the order of the other values is kept
+ */
+void vector_removeAt(vector_t* vector, size_t index) {
+  if (vector == NULL || index >= vector->len) {
+    return;
+  }
+  void* value = vector->items[index];
+  memmove(vector->items + index, vector->items + index + 1,
+          (vector->len - index - 1) * sizeof(void*));
+  vector->items[--vector->len] = NULL;
+  if (vector->free) {
+    vector->free(value);
+  }
+}
+
+void vector_removeIfFound(vector_t* vector, const void* key) {
+  vector_removeAt(vector, vector_indexOf(vector, key));
+}
+
+/**
+ * @brief removes all values; the capacity is kept
+ */
+void vector_clear(vector_t* vector) {
+  if (vector == NULL) {
+    return;
+  }
+  size_t len  = vector->len;
+  vector->len = 0;
+  if (vector->free) {
+    for (size_t i = 0; i < len; i++) { vector->free(vector->items[i]); }
+  }
+  if (vector->items) {
+    memset(vector->items, 0, len * sizeof(void*));
+  }
+}
+
+/**
+ * @brief joins the string values of @p vector with @p delimiter
+ * @return a pointer to the string. Has to be freed after usage.
+ */
+char* vectorToDelimitedString(const vector_t* vector, const char* delimiter) {
+  if (vector == NULL) {
+    return NULL;
+  }
+  struct string s;
+  if (init_string(&s) != OIDC_SUCCESS) {
+    return NULL;
+  }
+  size_t delim_len = strlen(delimiter);
+  for (size_t i = 0; i < vector->len; i++) {
+    const char* value = vector->items[i] ?: "";
+    if ((i > 0 && string_append(&s, delimiter, delim_len) != OIDC_SUCCESS) ||
+        string_append(&s, value, strlen(value)) != OIDC_SUCCESS) {
+      secFree(s.ptr);
+      return NULL;
+    }
+  }
+  return s.ptr;
+}
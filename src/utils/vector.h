@@ -0,0 +1,41 @@
+#ifndef OIDC_VECTOR_H
+#define OIDC_VECTOR_H
+
+#include "utils/listUtils.h"
+#include "utils/oidc_error.h"
+
+#include <stddef.h>
+
+/**
+ * A growable array of pointers with the same @c match and @c free semantics as
+ * @c list_t. Values are kept in insertion order and iterated by index:
+ * @code
+ * for (size_t i = 0; i < vector->len; i++) { use(vector_at(vector, i)); }
+ * @endcode
+ * so no iterator has to be allocated.
+ */
+typedef struct {
+  void** items;
+  size_t len;
+  size_t cap;
+  void (*free)(void* val);
+  int (*match)(const void* a, const void* b);
+} vector_t;
+
+vector_t*    vector_new();
+vector_t*    createVector(void* first, ...);
+void         secFreeVector(vector_t* vector);
+oidc_error_t vector_push(vector_t* vector, void* value);
+size_t       vector_indexOf(const vector_t* vector, const void* key);
+void*        vector_find(const vector_t* vector, const void* key);
+void         vector_removeAt(vector_t* vector, size_t index);
+void         vector_removeIfFound(vector_t* vector, const void* key);
+void         vector_clear(vector_t* vector);
+char*        vectorToDelimitedString(const vector_t* vector,
+                                     const char*     delimiter);
+
+inline static void* vector_at(const vector_t* vector, size_t index) {
+  return index < vector->len ? vector->items[index] : NULL;
+}
+
+#endif  // OIDC_VECTOR_H
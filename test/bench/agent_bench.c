@@ -0,0 +1,375 @@
+#define _DEFAULT_SOURCE
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "oidc-token/api.h"
+#include "test/mock/mockProvider.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/password_entry.h"
+#include "utils/stringUtils.h"
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * End-to-end load generator for oidc-agent. It starts the mock OpenID provider
+ * on localhost and an oidc-agent in console mode, loads an account for the
+ * mock provider and then drives concurrent clients through liboidc-agent.
+ * Every client is a separate process, like the applications that use the
+ * agent. The throughput and the latency percentiles are reported per request
+ * kind.
+ * With -t the startup of the oidc-token binary is measured as well, by running
+ * it sequentially for cached tokens with and without its seccomp filter.
+ *
+ * usage: agent_bench [-a agent] [-c clients] [-n requests] [-d delay_ms]
+ *                    [-m cache,refresh,scope,issuer] [-t oidc-token]
+ */
+
+#define BENCH_ACCOUNT "bench"
+#define BENCH_APPLICATION "agent_bench"
+#define BENCH_SCOPE "openid profile email offline_access"
+#define BENCH_REDUCED_SCOPE "openid profile"
+#define BENCH_MIN_VALID 60
+#define BENCH_TOKEN_RUNS 200
+
+enum requestKind { KIND_CACHE, KIND_REFRESH, KIND_SCOPE, KIND_ISSUER, KINDS };
+
+static const char* const kindNames[KINDS] = {"cache-hit", "forced refresh",
+                                             "scoped", "issuer lookup"};
+
+static pid_t mock_pid  = 0;
+static pid_t agent_pid = 0;
+
+struct sample {
+  double        latency;
+  unsigned char kind;
+  unsigned char failed;
+};
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _sleepMs(long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief starts oidc-agent in console mode and exports its socket
+ */
+static void _startAgent(const char* agent) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  agent_pid = fork();
+  if (agent_pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(agent, agent, "--console", "--no-autoload", "--no-webserver",
+          "--quiet", (char*)NULL);
+    perror(agent);
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  FILE* out = fdopen(fds[0], "r");
+  char  line[4096];
+  while (fgets(line, sizeof(line), out)) {
+    if (strncmp(line, OIDC_SOCK_ENV_NAME "=", strlen(OIDC_SOCK_ENV_NAME) + 1) ==
+        0) {
+      char* path = line + strlen(OIDC_SOCK_ENV_NAME) + 1;
+      path[strcspn(path, ";")] = '\0';
+      setenv(OIDC_SOCK_ENV_NAME, path, 1);
+      // the pipe stays open, so the agent can still write to stdout
+      return;
+    }
+  }
+  fprintf(stderr, "could not start %s\n", agent);
+  exit(EXIT_FAILURE);
+}
+
+static unsigned char _isSuccess(const char* res) {
+  char* status = res ? getJSONValueFromString(res, IPC_KEY_STATUS) : NULL;
+  unsigned char ok = strequal(status, STATUS_SUCCESS);
+  secFree(status);
+  return ok;
+}
+
+/**
+ * @brief waits for the agent and loads an account for the mock provider
+ */
+static void _loadAccount(const char* issuer_url) {
+  char* res = NULL;
+  for (int i = 0; i < 100 && !_isSuccess(res); i++) {
+    secFree(res);
+    _sleepMs(50);
+    res = ipc_cryptCommunicate(0, REQUEST_STATUS);
+  }
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "agent did not start\n");
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  cJSON* config = generateJSONObject(
+      AGENT_KEY_SHORTNAME, cJSON_String, BENCH_ACCOUNT, AGENT_KEY_ISSUERURL,
+      cJSON_String, issuer_url, OIDC_KEY_CLIENTID, cJSON_String, "bench",
+      OIDC_KEY_CLIENTSECRET, cJSON_String, "secret", OIDC_KEY_REFRESHTOKEN,
+      cJSON_String, "bench-rt", OIDC_KEY_SCOPE, cJSON_String, BENCH_SCOPE,
+      NULL);
+  cJSON* pw     = generateJSONObject(PW_KEY_SHORTNAME, cJSON_String,
+                                     BENCH_ACCOUNT, PW_KEY_TYPE, cJSON_Number,
+                                     (long)PW_TYPE_PRMT, NULL);
+  char*  config_str = jsonToStringUnformatted(config);
+  char*  pw_str     = jsonToStringUnformatted(pw);
+  secFreeJson(config);
+  secFreeJson(pw);
+  res = ipc_cryptCommunicate(0, REQUEST_ADD, config_str, pw_str, 0, 0);
+  secFree(config_str);
+  secFree(pw_str);
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "could not load account: %s\n", res ?: oidcagent_serror());
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+static enum requestKind _pickKind(const unsigned int mix[KINDS],
+                                  unsigned int*      seed) {
+  unsigned int total = 0;
+  for (int k = 0; k < KINDS; k++) {
+    total += mix[k];
+  }
+  unsigned int r = rand_r(seed) % total;
+  for (int k = 0; k < KINDS; k++) {
+    if (r < mix[k]) {
+      return k;
+    }
+    r -= mix[k];
+  }
+  return KIND_CACHE;
+}
+
+static void _runClient(struct sample* samples, unsigned long n,
+                       const unsigned int mix[KINDS], const char* issuer_url,
+                       unsigned int seed) {
+  for (unsigned long i = 0; i < n; i++) {
+    enum requestKind      kind  = _pickKind(mix, &seed);
+    double                start = _now();
+    struct token_response res   = {0};
+    switch (kind) {
+      case KIND_REFRESH:
+        res = getTokenResponse3(BENCH_ACCOUNT, FORCE_NEW_TOKEN, NULL,
+                                BENCH_APPLICATION, NULL);
+        break;
+      case KIND_SCOPE:
+        res = getTokenResponse3(BENCH_ACCOUNT, BENCH_MIN_VALID,
+                                BENCH_REDUCED_SCOPE, BENCH_APPLICATION, NULL);
+        break;
+      case KIND_ISSUER:
+        res = getTokenResponseForIssuer3(issuer_url, BENCH_MIN_VALID, NULL,
+                                         BENCH_APPLICATION, NULL);
+        break;
+      default:
+        res = getTokenResponse3(BENCH_ACCOUNT, BENCH_MIN_VALID, NULL,
+                                BENCH_APPLICATION, NULL);
+    }
+    samples[i].latency = _now() - start;
+    samples[i].kind    = kind;
+    samples[i].failed  = res.token == NULL;
+    secFreeTokenResponse(res);
+  }
+}
+
+static int _compareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double _percentile(const double* sorted, size_t n, double p) {
+  size_t i = (size_t)ceil(p * n);
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+static void _report(const char* name, const struct sample* samples,
+                    size_t total, int kind, double elapsed) {
+  double* latencies = secAlloc(sizeof(double) * (total ?: 1));
+  size_t  n = 0, failed = 0;
+  for (size_t i = 0; i < total; i++) {
+    if (kind >= 0 && samples[i].kind != kind) {
+      continue;
+    }
+    if (samples[i].failed) {
+      failed++;
+      continue;
+    }
+    latencies[n++] = samples[i].latency;
+  }
+  if (n == 0) {
+    if (failed) {
+      printf("%-16s %8s %8lu\n", name, "0", (unsigned long)failed);
+    }
+    secFree(latencies);
+    return;
+  }
+  qsort(latencies, n, sizeof(double), _compareDouble);
+  printf("%-16s %8lu %8lu %10.1f %10.3f %10.3f %10.3f\n", name,
+         (unsigned long)n, (unsigned long)failed, n / elapsed,
+         _percentile(latencies, n, 0.5) * 1e3,
+         _percentile(latencies, n, 0.99) * 1e3,
+         _percentile(latencies, n, 0.999) * 1e3);
+  secFree(latencies);
+}
+
+/**
+ * @brief runs @p token @p n times one after the other and records how long
+ * each call took from fork to exit
+ */
+static void _runTokenCli(const char* token, int seccomp, struct sample* samples,
+                         unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    double start = _now();
+    pid_t  pid   = fork();
+    if (pid == 0) {
+      if (freopen("/dev/null", "w", stdout) == NULL) {
+        _exit(EXIT_FAILURE);
+      }
+      if (seccomp) {
+        execl(token, token, "--seccomp", BENCH_ACCOUNT, (char*)NULL);
+      } else {
+        execl(token, token, BENCH_ACCOUNT, (char*)NULL);
+      }
+      _exit(EXIT_FAILURE);
+    }
+    int status = -1;
+    if (pid > 0) {
+      waitpid(pid, &status, 0);
+    }
+    samples[i].latency = _now() - start;
+    samples[i].kind    = 0;
+    samples[i].failed  = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+}
+
+/**
+ * @brief stops the agent and the mock provider, also if the benchmark fails
+ */
+static void _stopChildren() {
+  if (agent_pid > 0) {
+    kill(agent_pid, SIGTERM);
+    waitpid(agent_pid, NULL, 0);
+  }
+  if (mock_pid > 0) {
+    kill(mock_pid, SIGTERM);
+    waitpid(mock_pid, NULL, 0);
+  }
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-a agent] [-c clients] [-n requests] [-d delay_ms] "
+          "[-m cache,refresh,scope,issuer] [-t oidc-token]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  const char*   agent    = "bin/oidc-agent";
+  const char*   token    = NULL;
+  unsigned long clients  = 8;
+  unsigned long requests = 1000;
+  long          delay_ms = 0;
+  unsigned int  mix[KINDS] = {70, 10, 10, 10};
+  int           opt;
+  while ((opt = getopt(argc, argv, "a:c:n:d:m:t:")) != -1) {
+    switch (opt) {
+      case 'a': agent = optarg; break;
+      case 'c': clients = strtoul(optarg, NULL, 10); break;
+      case 'n': requests = strtoul(optarg, NULL, 10); break;
+      case 't': token = optarg; break;
+      case 'd': delay_ms = strtol(optarg, NULL, 10); break;
+      case 'm':
+        if (sscanf(optarg, "%u,%u,%u,%u", &mix[KIND_CACHE], &mix[KIND_REFRESH],
+                   &mix[KIND_SCOPE], &mix[KIND_ISSUER]) != KINDS ||
+            mix[KIND_CACHE] + mix[KIND_REFRESH] + mix[KIND_SCOPE] +
+                    mix[KIND_ISSUER] ==
+                0) {
+          _usage(argv[0]);
+        }
+        break;
+      default: _usage(argv[0]);
+    }
+  }
+  if (clients == 0 || requests == 0) {
+    _usage(argv[0]);
+  }
+
+  struct mockProvider_options mock = {.latency_ms = delay_ms};
+  atexit(_stopChildren);
+  mock_pid = mockProvider_start(&mock);
+  if (mock_pid < 0) {
+    return EXIT_FAILURE;
+  }
+  char* issuer_url = mockProvider_getIssuer(&mock);
+  _startAgent(agent);
+  _loadAccount(issuer_url);
+
+  size_t         total   = clients * requests;
+  struct sample* samples = mmap(NULL, sizeof(struct sample) * total,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (samples == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  double start = _now();
+  for (unsigned long c = 0; c < clients; c++) {
+    if (fork() == 0) {
+      _runClient(samples + c * requests, requests, mix, issuer_url, c + 1);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  for (unsigned long c = 0; c < clients; c++) {
+    wait(NULL);
+  }
+  double elapsed = _now() - start;
+
+  printf("%lu clients, %lu requests each, %.3f s\n", clients, requests,
+         elapsed);
+  printf("%-16s %8s %8s %10s %10s %10s %10s\n", "kind", "ok", "failed",
+         "req/s", "p50 ms", "p99 ms", "p999 ms");
+  for (int k = 0; k < KINDS; k++) {
+    _report(kindNames[k], samples, total, k, elapsed);
+  }
+  _report("all", samples, total, -1, elapsed);
+  munmap(samples, sizeof(struct sample) * total);
+
+  if (token != NULL) {
+    struct sample* runs = secAlloc(sizeof(struct sample) * BENCH_TOKEN_RUNS);
+    const char* const names[] = {"oidc-token", "oidc-token seccomp"};
+    for (int seccomp = 0; seccomp <= 1; seccomp++) {
+      // the first call fills the caches, e.g. the compiled seccomp filter
+      _runTokenCli(token, seccomp, runs, 1);
+      start = _now();
+      _runTokenCli(token, seccomp, runs, BENCH_TOKEN_RUNS);
+      _report(names[seccomp], runs, BENCH_TOKEN_RUNS, -1, _now() - start);
+    }
+    secFree(runs);
+  }
+  secFree(issuer_url);
+  return EXIT_SUCCESS;
+}
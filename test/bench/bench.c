@@ -0,0 +1,266 @@
+#define _POSIX_C_SOURCE 200809L
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "ipc/cryptIpc.h"
+#include "ipc/ipc.h"
+#include "oidc-agent/oidc/flows/oidc.h"
+#include "utils/crypt/base64.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Micro-benchmarks for the hot primitives of oidc-agent. Every benchmark runs
+ * a fixed number of operations after a short warm-up and reports the time and
+ * the number of heap allocations per operation. The number of operations can
+ * be scaled with the first argument, e.g. `make bench BENCH_SCALE=10`.
+ *
+ * Allocations are counted by wrapping calloc and malloc at link time; where
+ * this is not supported they are reported as 0.
+ */
+
+static unsigned long allocations = 0;
+
+#ifdef BENCH_COUNT_ALLOCS
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_malloc(size_t size);
+
+void* __wrap_calloc(size_t nmemb, size_t size) {
+  allocations++;
+  return __real_calloc(nmemb, size);
+}
+
+void* __wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+#endif  // BENCH_COUNT_ALLOCS
+
+#define BENCH_SECRET \
+  "9c1c9b0ae3cf4c6f8c3b6b7d1d2e4f5a6b7c8d9e0f1a2b3c4d5e6f7a8b9c0d1e"
+#define BENCH_PASSWORD "benchmark password"
+#define BENCH_REQUEST                                                        \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCESSTOKEN "\",\""          \
+  IPC_KEY_SHORTNAME "\":\"bench\",\"" IPC_KEY_MINVALID "\":60,\""          \
+  OIDC_KEY_SCOPE "\":\"openid profile email offline_access\",\""           \
+  IPC_KEY_APPLICATIONHINT "\":\"oidc-token\",\"" IPC_KEY_AUDIENCE          \
+  "\":\"https://api.example.com\"}"
+
+static char* encrypted_memory = NULL;
+static char* encrypted_file   = NULL;
+
+static void bench_memoryEncrypt(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    char* c = memoryEncrypt(BENCH_SECRET);
+    secFree(c);
+  }
+}
+
+static void bench_memoryDecrypt(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    char* p = memoryDecrypt(encrypted_memory);
+    secFree(p);
+  }
+}
+
+static void bench_cryptEncrypt(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    char* c = crypt_encrypt(BENCH_SECRET, BENCH_PASSWORD);
+    secFree(c);
+  }
+}
+
+static void bench_cryptDecrypt(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    char* p = crypt_decrypt(encrypted_file, BENCH_PASSWORD);
+    secFree(p);
+  }
+}
+
+static void bench_getJSONValues(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    // The key set of oidcd's request handling
+    INIT_KEY_VALUE(IPC_KEY_REQUEST, IPC_KEY_SHORTNAME, IPC_KEY_MINVALID,
+                   IPC_KEY_CONFIG, IPC_KEY_FLOW, IPC_KEY_USECUSTOMSCHEMEURL,
+                   IPC_KEY_REDIRECTEDURI, OIDC_KEY_STATE, IPC_KEY_AUTHORIZATION,
+                   OIDC_KEY_SCOPE, IPC_KEY_DEVICE, IPC_KEY_FROMGEN,
+                   IPC_KEY_LIFETIME, IPC_KEY_PASSWORD, IPC_KEY_APPLICATIONHINT,
+                   IPC_KEY_CONFIRM, IPC_KEY_ISSUERURL, IPC_KEY_NOSCHEME,
+                   IPC_KEY_CERTPATH, IPC_KEY_AUDIENCE, IPC_KEY_ALWAYSALLOWID,
+                   IPC_KEY_FILENAME, IPC_KEY_DATA,
+                   OIDC_KEY_REGISTRATION_CLIENT_URI,
+                   OIDC_KEY_REGISTRATION_ACCESS_TOKEN, IPC_KEY_ONLYAT,
+                   IPC_KEY_METRICS, IPC_KEY_TRACE);
+    CALL_GETJSONVALUES(BENCH_REQUEST);
+    SEC_FREE_KEY_VALUES();
+  }
+}
+
+static void bench_generatePostData(unsigned long n) {
+  vector_t* vector = createVector(
+      OIDC_KEY_CLIENTID, "bench-client", OIDC_KEY_CLIENTSECRET,
+      "a secret with spaces & symbols", OIDC_KEY_GRANTTYPE,
+      OIDC_GRANTTYPE_REFRESH, OIDC_KEY_REFRESHTOKEN, BENCH_SECRET,
+      OIDC_KEY_SCOPE, "openid profile email offline_access", NULL);
+  for (unsigned long i = 0; i < n; i++) {
+    char* data = generatePostDataFromVector(vector);
+    secFree(data);
+  }
+  secFreeVector(vector);
+}
+
+static void bench_secAlloc(unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) {
+    char* p = secAlloc(64);
+    secFree(p);
+  }
+}
+
+static void bench_base64(unsigned long n) {
+  unsigned char bin[48];
+  for (unsigned long i = 0; i < n; i++) {
+    char* b64 = toBase64(BENCH_SECRET, sizeof(bin));
+    fromBase64(b64, sizeof(bin), bin);
+    secFree(b64);
+  }
+}
+
+// About the size of an encrypted ipc message with an access token
+#define BENCH_BASE64_LARGE 1536
+
+static void bench_base64Large(unsigned long n) {
+  static char   data[BENCH_BASE64_LARGE];
+  unsigned char bin[BENCH_BASE64_LARGE];
+  for (unsigned long i = 0; i < n; i++) {
+    char* b64 = toBase64(data, sizeof(data));
+    fromBase64(b64, sizeof(bin), bin);
+    secFree(b64);
+  }
+}
+
+static void bench_base64Scalar(unsigned long n) {
+  base64_useScalar(1);
+  bench_base64(n);
+  base64_useScalar(0);
+}
+
+static void bench_base64LargeScalar(unsigned long n) {
+  base64_useScalar(1);
+  bench_base64Large(n);
+  base64_useScalar(0);
+}
+
+/**
+ * A full encrypted ipc request: key exchange, encryption, transfer and
+ * decryption. The client runs in a child process over a socket pair.
+ */
+static void bench_ipcRoundTrip(unsigned long n) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    perror("socketpair");
+    exit(EXIT_FAILURE);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(sv[0]);
+    for (unsigned long i = 0; i < n; i++) {
+      unsigned char* key = client_keyExchange(sv[1], 0);
+      if (key == NULL || ipc_cryptWrite(sv[1], key, "%s", BENCH_REQUEST) !=
+                             OIDC_SUCCESS) {
+        _exit(EXIT_FAILURE);
+      }
+      secFree(key);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  close(sv[1]);
+  for (unsigned long i = 0; i < n; i++) {
+    char* client_pk = ipc_read(sv[0]);
+    char* request   = server_ipc_cryptRead(sv[0], client_pk);
+    if (request == NULL) {
+      fprintf(stderr, "ipc round trip failed: %s\n", oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+    server_ipc_freeKeyFor(sv[0]);
+    secFree(request);
+    secFree(client_pk);
+  }
+  close(sv[0]);
+  waitpid(pid, NULL, 0);
+}
+
+struct benchmark {
+  const char* name;
+  void (*run)(unsigned long n);
+  unsigned long ops;
+};
+
+static const struct benchmark benchmarks[] = {
+    {"memoryEncrypt", bench_memoryEncrypt, 100000},
+    {"memoryDecrypt", bench_memoryDecrypt, 100000},
+    {"crypt_encrypt", bench_cryptEncrypt, 10},
+    {"crypt_decrypt", bench_cryptDecrypt, 10},
+    {"getJSONValuesFromString (oidcd keys)", bench_getJSONValues, 100000},
+    {"generatePostDataFromVector", bench_generatePostData, 100000},
+    {"secAlloc/secFree", bench_secAlloc, 1000000},
+    {"toBase64/fromBase64", bench_base64, 100000},
+    {"toBase64/fromBase64 (scalar)", bench_base64Scalar, 100000},
+    {"toBase64/fromBase64 1.5KiB", bench_base64Large, 20000},
+    {"toBase64/fromBase64 1.5KiB (scalar)", bench_base64LargeScalar, 20000},
+    {"ipc_cryptWrite/server_ipc_cryptRead", bench_ipcRoundTrip, 2000},
+};
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _runBenchmark(const struct benchmark* b, double scale) {
+  unsigned long ops = b->ops * scale;
+  if (ops == 0) {
+    ops = 1;
+  }
+  b->run(ops / 10 ?: 1);  // warm-up
+  unsigned long allocs = allocations;
+  double        start  = _now();
+  b->run(ops);
+  double elapsed = _now() - start;
+  printf("%-40s %10lu %14.1f %12.2f\n", b->name, ops, elapsed * 1e9 / ops,
+         (double)(allocations - allocs) / ops);
+}
+
+int main(int argc, char** argv) {
+  logger_setloglevel(NOTICE);
+  double scale = argc > 1 ? strtod(argv[1], NULL) : 1;
+  if (scale <= 0) {
+    fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  initCrypt();
+  initMemoryCrypt();
+  encrypted_memory = memoryEncrypt(BENCH_SECRET);
+  encrypted_file   = crypt_encrypt(BENCH_SECRET, BENCH_PASSWORD);
+
+  printf("base64: %s\n", base64_getImplementation());
+  printf("%-40s %10s %14s %12s\n", "benchmark", "ops", "ns/op", "allocs/op");
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(*benchmarks); i++) {
+    _runBenchmark(&benchmarks[i], scale);
+  }
+  secFree(encrypted_memory);
+  secFree(encrypted_file);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,451 @@
+#define _DEFAULT_SOURCE
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "oidc-token/api.h"
+#include "test/mock/mockProvider.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/password_entry.h"
+#include "utils/stringUtils.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Memory footprint benchmark for sizing agents, e.g. on login nodes. For each
+ * number of accounts N it starts a fresh oidc-agent with --memory-stats,
+ * loads N synthetic accounts spread over several mock providers (so over
+ * several issuers) with varied scopes and then opens an increasing number of
+ * idle client connections. At every step it reports:
+ * - the RSS of oidcp and of all oidcd processes
+ * - the live secAlloc bytes of oidcd by tag, as reported by --status --json
+ * - the latency of access token requests for random loaded accounts
+ * The differences between the steps give the memory needed per account and
+ * per connection.
+ *
+ * usage: footprint_bench [-a agent] [-n 10,100,1000,10000]
+ *                        [-c 1,50,500,5000] [-i issuers] [-r requests]
+ */
+
+#define BENCH_APPLICATION "footprint_bench"
+#define BENCH_DEFAULT_ACCOUNTS "10,100,1000,10000"
+#define BENCH_DEFAULT_CONNECTIONS "1,50,500,5000"
+#define BENCH_MAX_ISSUERS 64
+#define BENCH_MIN_VALID 60
+
+static const char* const benchScopes[] = {
+    "openid profile email offline_access", "openid offline_access",
+    "openid profile offline_access", "openid email offline_access"};
+#define BENCH_SCOPES (sizeof(benchScopes) / sizeof(benchScopes[0]))
+
+static pid_t mock_pids[BENCH_MAX_ISSUERS];
+static char* issuer_urls[BENCH_MAX_ISSUERS];
+static int   issuers   = 4;
+static pid_t agent_pid = 0;
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _sleepMs(long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+static void _report(unsigned long accounts, unsigned long connections,
+                    const char* metric, double value) {
+  printf("%8lu %11lu %-32s %14.3f\n", accounts, connections, metric, value);
+  fflush(stdout);
+}
+
+static char* _shortname(unsigned long i) {
+  return oidc_sprintf("footprint-%05lu", i);
+}
+
+/**
+ * @brief starts oidc-agent in console mode and exports its socket
+ */
+static void _startAgent(const char* agent) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  agent_pid = fork();
+  if (agent_pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(agent, agent, "--console", "--no-autoload", "--no-webserver",
+          "--quiet", "--memory-stats", (char*)NULL);
+    perror(agent);
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  FILE* out = fdopen(fds[0], "r");
+  char  line[4096];
+  while (fgets(line, sizeof(line), out)) {
+    if (strncmp(line, OIDC_SOCK_ENV_NAME "=", strlen(OIDC_SOCK_ENV_NAME) + 1) ==
+        0) {
+      char* path = line + strlen(OIDC_SOCK_ENV_NAME) + 1;
+      path[strcspn(path, ";")] = '\0';
+      setenv(OIDC_SOCK_ENV_NAME, path, 1);
+      // the pipe stays open, so the agent can still write to stdout
+      return;
+    }
+  }
+  fprintf(stderr, "could not start %s\n", agent);
+  exit(EXIT_FAILURE);
+}
+
+static void _stopAgent() {
+  if (agent_pid > 0) {
+    kill(agent_pid, SIGTERM);
+    waitpid(agent_pid, NULL, 0);
+    agent_pid = 0;
+  }
+}
+
+/**
+ * @brief stops the agent and the mock providers, also if the benchmark fails
+ */
+static void _stopChildren() {
+  _stopAgent();
+  for (int i = 0; i < issuers; i++) {
+    if (mock_pids[i] > 0) {
+      kill(mock_pids[i], SIGTERM);
+      waitpid(mock_pids[i], NULL, 0);
+    }
+  }
+}
+
+static unsigned char _isSuccess(const char* res) {
+  char* status = res ? getJSONValueFromString(res, IPC_KEY_STATUS) : NULL;
+  unsigned char ok = strequal(status, STATUS_SUCCESS);
+  secFree(status);
+  return ok;
+}
+
+static void _waitForAgent() {
+  char* res = NULL;
+  for (int i = 0; i < 100 && !_isSuccess(res); i++) {
+    secFree(res);
+    _sleepMs(50);
+    res = ipc_cryptCommunicate(0, REQUEST_STATUS);
+  }
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "agent did not start\n");
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+static void _loadAccount(unsigned long i) {
+  char*  shortname = _shortname(i);
+  char*  rt        = oidc_sprintf("footprint-rt-%lu", i);
+  cJSON* config    = generateJSONObject(
+      AGENT_KEY_SHORTNAME, cJSON_String, shortname, AGENT_KEY_ISSUERURL,
+      cJSON_String, issuer_urls[i % issuers], OIDC_KEY_CLIENTID, cJSON_String,
+      "footprint", OIDC_KEY_CLIENTSECRET, cJSON_String, "secret",
+      OIDC_KEY_REFRESHTOKEN, cJSON_String, rt, OIDC_KEY_SCOPE, cJSON_String,
+      benchScopes[i % BENCH_SCOPES], NULL);
+  cJSON* pw = generateJSONObject(PW_KEY_SHORTNAME, cJSON_String, shortname,
+                                 PW_KEY_TYPE, cJSON_Number,
+                                 (long)PW_TYPE_PRMT, NULL);
+  char*  config_str = jsonToStringUnformatted(config);
+  char*  pw_str     = jsonToStringUnformatted(pw);
+  secFreeJson(config);
+  secFreeJson(pw);
+  char* res = ipc_cryptCommunicate(0, REQUEST_ADD, config_str, pw_str, 0, 0);
+  secFree(config_str);
+  secFree(pw_str);
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "could not load %s: %s\n", shortname,
+            res ?: oidcagent_serror());
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  secFree(rt);
+  secFree(shortname);
+}
+
+static long _rss(pid_t pid) {
+  char* path = oidc_sprintf("/proc/%d/status", (int)pid);
+  FILE* f    = fopen(path, "r");
+  secFree(path);
+  if (f == NULL) {
+    return 0;
+  }
+  char line[256];
+  long kib = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "VmRSS: %ld kB", &kib) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return kib;
+}
+
+static pid_t _parentOf(pid_t pid) {
+  char* path = oidc_sprintf("/proc/%d/stat", (int)pid);
+  FILE* f    = fopen(path, "r");
+  secFree(path);
+  if (f == NULL) {
+    return 0;
+  }
+  int ppid = 0;
+  // the process name is in parentheses and might contain spaces
+  if (fscanf(f, "%*d (%*[^)]) %*c %d", &ppid) != 1) {
+    ppid = 0;
+  }
+  fclose(f);
+  return ppid;
+}
+
+/**
+ * @brief returns the summed RSS in KiB of the oidcd processes, i.e. of the
+ * children of the agent
+ */
+static long _oidcdRss() {
+  DIR* proc = opendir("/proc");
+  if (proc == NULL) {
+    return 0;
+  }
+  long           kib = 0;
+  struct dirent* entry;
+  while ((entry = readdir(proc))) {
+    pid_t pid = (pid_t)strtol(entry->d_name, NULL, 10);
+    if (pid > 0 && _parentOf(pid) == agent_pid) {
+      kib += _rss(pid);
+    }
+  }
+  closedir(proc);
+  return kib;
+}
+
+/**
+ * @brief reports the live bytes of all oidcd processes by allocation tag
+ */
+static void _reportMemoryStats(unsigned long accounts,
+                               unsigned long connections) {
+  char*  res    = ipc_cryptCommunicate(0, REQUEST_STATUS_JSON);
+  cJSON* json   = res ? stringToJson(res) : NULL;
+  cJSON* info   = cJSON_GetObjectItemCaseSensitive(json, IPC_KEY_INFO);
+  cJSON* memory = cJSON_GetObjectItemCaseSensitive(info, "memory");
+  secFree(res);
+  if (!cJSON_IsArray(memory)) {
+    fprintf(stderr, "agent did not report memory statistics\n");
+    secFreeJson(json);
+    return;
+  }
+  const cJSON* first = cJSON_GetArrayItem(memory, 0);
+  const cJSON* tag;
+  cJSON_ArrayForEach(tag, cJSON_GetObjectItemCaseSensitive(first, "tags")) {
+    double       live = 0;
+    const cJSON* worker;
+    cJSON_ArrayForEach(worker, memory) {
+      const cJSON* stats = cJSON_GetObjectItemCaseSensitive(
+          cJSON_GetObjectItemCaseSensitive(worker, "tags"), tag->string);
+      const cJSON* bytes =
+          cJSON_GetObjectItemCaseSensitive(stats, "live_bytes");
+      live += cJSON_IsNumber(bytes) ? bytes->valuedouble : 0;
+    }
+    char* metric = oidc_sprintf("oidcd live KiB %s", tag->string);
+    _report(accounts, connections, metric, live / 1024);
+    secFree(metric);
+  }
+  secFreeJson(json);
+}
+
+static int _compareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double _percentile(const double* sorted, size_t n, double p) {
+  size_t i = (size_t)ceil(p * n);
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+/**
+ * @brief requests access tokens for random loaded accounts one after the other
+ * and reports the latency percentiles
+ */
+static void _benchRequests(unsigned long accounts, unsigned long connections,
+                           unsigned long requests, unsigned int* seed) {
+  double* latencies = secAlloc(sizeof(double) * requests);
+  size_t  n = 0, failed = 0;
+  for (unsigned long i = 0; i < requests; i++) {
+    char*                 shortname = _shortname(rand_r(seed) % accounts);
+    double                start     = _now();
+    struct token_response res       = getTokenResponse3(
+        shortname, BENCH_MIN_VALID, NULL, BENCH_APPLICATION, NULL);
+    if (res.token == NULL) {
+      failed++;
+    } else {
+      latencies[n++] = _now() - start;
+    }
+    secFreeTokenResponse(res);
+    secFree(shortname);
+  }
+  if (n > 0) {
+    qsort(latencies, n, sizeof(double), _compareDouble);
+    _report(accounts, connections, "token request p50 ms",
+            _percentile(latencies, n, 0.5) * 1e3);
+    _report(accounts, connections, "token request p99 ms",
+            _percentile(latencies, n, 0.99) * 1e3);
+  }
+  if (failed) {
+    _report(accounts, connections, "token requests failed", failed);
+  }
+  secFree(latencies);
+}
+
+static void _measure(unsigned long accounts, unsigned long connections,
+                     unsigned long requests, unsigned int* seed) {
+  _benchRequests(accounts, connections, requests, seed);
+  _report(accounts, connections, "oidcp RSS KiB", _rss(agent_pid));
+  _report(accounts, connections, "oidcd RSS KiB", _oidcdRss());
+  _reportMemoryStats(accounts, connections);
+}
+
+/**
+ * @brief opens idle connections to the agent until @p fds holds @p n of them
+ * @return the number of open connections
+ */
+static size_t _openConnections(int* fds, size_t open, size_t n) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, getenv(OIDC_SOCK_ENV_NAME),
+          sizeof(addr.sun_path) - 1);
+  for (; open < n; open++) {
+    fds[open] = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fds[open] < 0 ||
+        connect(fds[open], (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      perror("connect");
+      if (fds[open] >= 0) {
+        close(fds[open]);
+      }
+      break;
+    }
+  }
+  // give the agent the time to accept them
+  _sleepMs(200);
+  return open;
+}
+
+static void _runAccounts(const char* agent, unsigned long accounts,
+                         list_t* connection_counts, unsigned long requests) {
+  _startAgent(agent);
+  _waitForAgent();
+  double start = _now();
+  for (unsigned long i = 0; i < accounts; i++) {
+    _loadAccount(i);
+  }
+  _report(accounts, 0, "load ms per account",
+          (_now() - start) * 1e3 / accounts);
+  unsigned int seed = accounts;
+  _measure(accounts, 0, requests, &seed);
+
+  size_t max = 0;
+  for (size_t i = 0; i < connection_counts->len; i++) {
+    size_t c = strtoul(list_at(connection_counts, i)->val, NULL, 10);
+    max      = c > max ? c : max;
+  }
+  int*   fds  = secAlloc(sizeof(int) * (max ?: 1));
+  size_t open = 0;
+  for (size_t i = 0; i < connection_counts->len; i++) {
+    size_t c = strtoul(list_at(connection_counts, i)->val, NULL, 10);
+    if (c <= open) {
+      continue;
+    }
+    open = _openConnections(fds, open, c);
+    _measure(accounts, open, requests, &seed);
+    if (open < c) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < open; i++) {
+    close(fds[i]);
+  }
+  secFree(fds);
+  _stopAgent();
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-a agent] [-n 10,100,1000,10000] [-c 1,50,500,5000] "
+          "[-i issuers] [-r requests]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  const char*   agent       = "bin/oidc-agent";
+  const char*   counts      = BENCH_DEFAULT_ACCOUNTS;
+  const char*   connections = BENCH_DEFAULT_CONNECTIONS;
+  unsigned long requests    = 200;
+  int           opt;
+  while ((opt = getopt(argc, argv, "a:n:c:i:r:")) != -1) {
+    switch (opt) {
+      case 'a': agent = optarg; break;
+      case 'n': counts = optarg; break;
+      case 'c': connections = optarg; break;
+      case 'i': issuers = strToInt(optarg); break;
+      case 'r': requests = strtoul(optarg, NULL, 10); break;
+      default: _usage(argv[0]);
+    }
+  }
+  if (issuers <= 0 || issuers > BENCH_MAX_ISSUERS || requests == 0) {
+    _usage(argv[0]);
+  }
+  // the agent inherits the limit and needs a descriptor per connection
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  atexit(_stopChildren);
+  for (int i = 0; i < issuers; i++) {
+    struct mockProvider_options mock = {0};
+    mock_pids[i] = mockProvider_start(&mock);
+    if (mock_pids[i] < 0) {
+      return EXIT_FAILURE;
+    }
+    issuer_urls[i] = mockProvider_getIssuer(&mock);
+  }
+
+  printf("%8s %11s %-32s %14s\n", "accounts", "connections", "metric",
+         "value");
+  list_t* ns = delimitedStringToList(counts, ',');
+  list_t* cs = delimitedStringToList(connections, ',');
+  for (size_t i = 0; ns && cs && i < ns->len; i++) {
+    unsigned long n = strtoul(list_at(ns, i)->val, NULL, 10);
+    if (n > 0) {
+      _runAccounts(agent, n, cs, requests);
+    }
+  }
+  secFreeList(ns);
+  secFreeList(cs);
+  for (int i = 0; i < issuers; i++) {
+    secFree(issuer_urls[i]);
+  }
+  return EXIT_SUCCESS;
+}
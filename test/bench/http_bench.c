@@ -0,0 +1,265 @@
+#define _DEFAULT_SOURCE
+#include "defines/settings.h"
+#include "ipc/pipe.h"
+#include "oidc-agent/http/http_handler.h"
+#include "oidc-agent/http/http_ipc.h"
+#include "oidc-agent/http/http_transport.h"
+#include "oidc-agent/http/http_worker.h"
+#include "test/mock/mockProvider.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <curl/curl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Benchmark of the ways oidcd can send http requests. It compares a fork per
+ * request (fork, O_DIRECT pipes and ipc_readFromPipe around an in-process
+ * request, as httpsPOST did before the http worker) with the in-process
+ * transport and the persistent http worker, all against the local mock
+ * provider. The fork cost grows with the address space of the forking
+ * process, so these stages are repeated after the process grew by the given
+ * amounts of memory (-m).
+ * The cost of curl_global_init_mem, which a forked child pays for every
+ * request, is measured on its own. With -u the TLS handshake is measured
+ * against the given https url, with and without reusing the TLS session; -c
+ * sets the CA bundle for it.
+ *
+ * usage: http_bench [-n requests] [-m 0,64,256,1024] [-u https_url [-c ca]]
+ */
+
+#define BENCH_DEFAULT_MEMORY "0,64,256,1024"
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(unsigned long mib, const char* stage, unsigned long n,
+                    double elapsed) {
+  printf("%8lu %-40s %8lu %12.1f\n", mib, stage, n, elapsed * 1e6 / n);
+  fflush(stdout);
+}
+
+/**
+ * @brief forks a child that answers through a pipe, like a request in the
+ * fork model
+ * @param url the url the child requests; if @c NULL the child answers
+ * immediately, which isolates the fork and pipe overhead
+ */
+static void _forkedRequest(const char* url) {
+  struct pipeSet pipes = ipc_pipe_init();
+  if (pipes.pipe1.rx == -1) {
+    fprintf(stderr, "pipe2: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    struct ipcPipe p   = toClientPipes(pipes);
+    char*          res = url ? httpsGET(url, NULL, NULL) : NULL;
+    ipc_writeToPipe(p, "%s", res ?: "ok");
+    _exit(EXIT_SUCCESS);
+  }
+  struct ipcPipe p   = toServerPipes(pipes);
+  char*          res = ipc_readFromPipe(p);
+  ipc_closePipes(p);
+  waitpid(pid, NULL, 0);
+  if (res == NULL) {
+    fprintf(stderr, "forked request failed\n");
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+static void _request(const char* url) {
+  char* res = httpsGET(url, NULL, NULL);
+  if (res == NULL) {
+    fprintf(stderr, "request failed: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+/**
+ * @brief runs the transport stages after growing the process by @p mib MiB
+ * Runs in its own process, because the http worker cannot be stopped without
+ * leaving the signal disposition changed.
+ */
+static void _runTransports(unsigned long mib, const char* url,
+                           unsigned long n) {
+  size_t size    = mib * 1024 * 1024;
+  char*  ballast = size ? malloc(size) : NULL;
+  if (size && ballast == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  if (ballast) {
+    memset(ballast, 1, size);  // the pages have to be mapped
+  }
+  httpTransport_use(&httpTransport_inProcess);
+
+  double start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    _forkedRequest(NULL);
+  }
+  _report(mib, "fork + pipe2(O_DIRECT) + ipc_readFromPipe", n,
+          _now() - start);
+
+  start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    _forkedRequest(url);
+  }
+  _report(mib, "fork per request", n, _now() - start);
+
+  start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    _request(url);
+  }
+  _report(mib, "in-process", n, _now() - start);
+
+  start = _now();
+  httpTransport_use(&httpTransport_forked);
+  if (httpWorker_start() != OIDC_SUCCESS) {
+    fprintf(stderr, "could not start the http worker\n");
+    exit(EXIT_FAILURE);
+  }
+  _report(mib, "http worker start", 1, _now() - start);
+  start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    _request(url);
+  }
+  _report(mib, "http worker", n, _now() - start);
+  httpWorker_stop();
+  free(ballast);
+}
+
+static void _benchGlobalInit(unsigned long n) {
+  double start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    curl_global_init_mem(CURL_GLOBAL_ALL, malloc, free, realloc, strdup,
+                         calloc);
+    curl_global_cleanup();
+  }
+  _report(0, "curl_global_init_mem + cleanup", n, _now() - start);
+}
+
+/**
+ * @brief measures new TLS connections to @p url; every request opens a new
+ * connection; with @p reuseSession the TLS session of the previous one is
+ * resumed
+ */
+static void _benchTls(const char* url, const char* ca, unsigned long n,
+                      unsigned char reuseSession) {
+  curl_global_init(CURL_GLOBAL_ALL);
+  CURLSH* share = NULL;
+  if (reuseSession) {
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  }
+  double handshake = 0;
+  double start     = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    CURL* curl = curl_easy_init();
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    setSSLOpts(curl, ca);
+    CURLcode res = curl_easy_perform(curl);
+    if (res != CURLE_OK) {
+      fprintf(stderr, "%s: %s\n", url, curl_easy_strerror(res));
+      exit(EXIT_FAILURE);
+    }
+    double connected = 0, tls = 0;
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connected);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls);
+    handshake += tls - connected;
+    curl_easy_cleanup(curl);
+  }
+  double elapsed = _now() - start;
+  _report(0,
+          reuseSession ? "TLS request, session reused"
+                       : "TLS request, full handshake",
+          n, elapsed);
+  _report(0,
+          reuseSession ? "  of which TLS handshake (resumed)"
+                       : "  of which TLS handshake",
+          n, handshake);
+  if (share) {
+    curl_share_cleanup(share);
+  }
+  curl_global_cleanup();
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-n requests] [-m 0,64,256,1024] [-u https_url [-c ca]]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  unsigned long n       = 200;
+  const char*   memory  = BENCH_DEFAULT_MEMORY;
+  const char*   tls_url = NULL;
+  const char*   ca      = NULL;
+  int           opt;
+  while ((opt = getopt(argc, argv, "n:m:u:c:")) != -1) {
+    switch (opt) {
+      case 'n': n = strtoul(optarg, NULL, 10); break;
+      case 'm': memory = optarg; break;
+      case 'u': tls_url = optarg; break;
+      case 'c': ca = optarg; break;
+      default: _usage(argv[0]);
+    }
+  }
+  if (n == 0) {
+    _usage(argv[0]);
+  }
+  logger_setloglevel(NOTICE);
+
+  struct mockProvider_options mock     = {0};
+  pid_t                       mock_pid = mockProvider_start(&mock);
+  if (mock_pid < 0) {
+    return EXIT_FAILURE;
+  }
+  char* issuer = mockProvider_getIssuer(&mock);
+  char* url    = oidc_strcat(issuer, CONF_ENDPOINT_SUFFIX);
+  secFree(issuer);
+
+  printf("%8s %-40s %8s %12s\n", "+MiB", "stage", "ops", "us/op");
+  _benchGlobalInit(n);
+  if (tls_url) {
+    _benchTls(tls_url, ca, n, 0);
+    _benchTls(tls_url, ca, n, 1);
+  }
+  list_t* sizes = delimitedStringToList(memory, ',');
+  for (size_t i = 0; sizes && i < sizes->len; i++) {
+    unsigned long mib = strtoul(list_at(sizes, i)->val, NULL, 10);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      _runTransports(mib, url, n);
+      _exit(EXIT_SUCCESS);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "run with %lu MiB failed\n", mib);
+    }
+  }
+  secFreeList(sizes);
+  secFree(url);
+  kill(mock_pid, SIGTERM);
+  waitpid(mock_pid, NULL, 0);
+  return EXIT_SUCCESS;
+}
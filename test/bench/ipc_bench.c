@@ -0,0 +1,337 @@
+#define _DEFAULT_SOURCE
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "ipc/cryptIpc.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Throughput benchmark of the ipc between clients and oidcp. The agent is
+ * built with a stub oidcd (stub_oidcd.c) that answers every request with the
+ * same token, so only the ipc and oidcp are measured. Concurrent clients,
+ * each a separate process, send access token requests in these modes:
+ *  - one-shot requests over the peer credential fast path (unencrypted, agent
+ *    started with --trust-local-clients),
+ *  - one-shot encrypted requests,
+ *  - requests in a session (one key exchange per client),
+ * the encrypted ones with the binary format and with the base64 format.
+ * If an agent built without the epoll reactor is given (-s), all modes are
+ * repeated with it. With -i the modes are repeated while the given numbers of
+ * idle connections are open, which shows the cost of the connection scans;
+ * the select loop cannot handle descriptors beyond FD_SETSIZE at all.
+ *
+ * usage: ipc_bench [-a agent] [-s select_agent] [-c clients] [-n requests]
+ *                  [-i 0,100,1000]
+ */
+
+#define BENCH_IDLE_DEFAULT "0"
+#define BENCH_REQUEST                                            \
+  "{\"" IPC_KEY_REQUEST "\":\"" REQUEST_VALUE_ACCESSTOKEN "\",\"" \
+  IPC_KEY_SHORTNAME "\":\"bench\"}"
+
+struct mode {
+  const char*   name;
+  unsigned char trust_local_clients;
+  unsigned char session;
+  unsigned char binary;
+};
+
+static const struct mode modes[] = {
+    {"one-shot, peer-cred plain", 1, 0, 1},
+    {"session, binary", 1, 1, 1},
+    {"session, base64", 1, 1, 0},
+    {"one-shot, encrypted binary", 0, 0, 1},
+    {"one-shot, encrypted base64", 1, 0, 0},
+};
+
+struct sample {
+  double        latency;
+  unsigned char failed;
+};
+
+static pid_t agent_pid = 0;
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _sleepMs(long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+static unsigned char _isSuccess(const char* res) {
+  char* status = res ? getJSONValueFromString(res, IPC_KEY_STATUS) : NULL;
+  unsigned char ok = strequal(status, STATUS_SUCCESS);
+  secFree(status);
+  return ok;
+}
+
+static void _stopAgent() {
+  if (agent_pid > 0) {
+    kill(agent_pid, SIGTERM);
+    waitpid(agent_pid, NULL, 0);
+    agent_pid = 0;
+  }
+}
+
+/**
+ * @brief starts the stub agent in console mode, exports its socket and waits
+ * until it answers
+ */
+static void _startAgent(const char* agent, unsigned char trust_local_clients) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  agent_pid = fork();
+  if (agent_pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(agent, agent, "--console", "--no-autoload", "--no-webserver",
+          "--quiet", trust_local_clients ? "--trust-local-clients" : NULL,
+          (char*)NULL);
+    perror(agent);
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  FILE* out   = fdopen(fds[0], "r");
+  char  line[4096];
+  int   found = 0;
+  while (!found && fgets(line, sizeof(line), out)) {
+    if (strncmp(line, OIDC_SOCK_ENV_NAME "=", strlen(OIDC_SOCK_ENV_NAME) + 1) ==
+        0) {
+      char* path = line + strlen(OIDC_SOCK_ENV_NAME) + 1;
+      path[strcspn(path, ";")] = '\0';
+      setenv(OIDC_SOCK_ENV_NAME, path, 1);
+      // the pipe stays open, so the agent can still write to stdout
+      found = 1;
+    }
+  }
+  char* res = NULL;
+  for (int i = 0; found && i < 100 && !_isSuccess(res); i++) {
+    secFree(res);
+    _sleepMs(50);
+    res = ipc_cryptCommunicate(0, BENCH_REQUEST);
+  }
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "could not start %s\n", agent);
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+/**
+ * @brief opens @p n connections to the agent that never send a request
+ * @return the number of connections that could be opened
+ */
+static size_t _openIdleConnections(int* socks, size_t n) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, getenv(OIDC_SOCK_ENV_NAME),
+          sizeof(addr.sun_path) - 1);
+  for (size_t i = 0; i < n; i++) {
+    socks[i] = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socks[i] < 0 ||
+        connect(socks[i], (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      perror("idle connection");
+      if (socks[i] >= 0) {
+        close(socks[i]);
+      }
+      return i;
+    }
+  }
+  return n;
+}
+
+static void _closeIdleConnections(int* socks, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    close(socks[i]);
+  }
+}
+
+static void _runClient(const struct mode* mode, struct sample* samples,
+                       unsigned long n) {
+  client_ipc_setBinary(mode->binary);
+  struct ipc_session* session = NULL;
+  if (mode->session && (session = ipc_cryptOpenSession(0)) == NULL) {
+    for (unsigned long i = 0; i < n; i++) {
+      samples[i].failed = 1;
+    }
+    return;
+  }
+  for (unsigned long i = 0; i < n; i++) {
+    double start = _now();
+    char*  res   = session
+                       ? ipc_cryptCommunicateInSession(session, BENCH_REQUEST)
+                       : ipc_cryptCommunicate(0, BENCH_REQUEST);
+    samples[i].latency = _now() - start;
+    samples[i].failed  = !_isSuccess(res);
+    secFree(res);
+  }
+  ipc_cryptCloseSession(session);
+}
+
+static int _compareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double _percentile(const double* sorted, size_t n, double p) {
+  size_t i = (size_t)ceil(p * n);
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+static void _report(const char* loop, size_t idle, const char* name,
+                    const struct sample* samples, size_t total,
+                    double elapsed) {
+  double* latencies = secAlloc(sizeof(double) * (total ?: 1));
+  size_t  n = 0, failed = 0;
+  for (size_t i = 0; i < total; i++) {
+    if (samples[i].failed) {
+      failed++;
+    } else {
+      latencies[n++] = samples[i].latency;
+    }
+  }
+  if (n == 0) {
+    printf("%-7s %6lu %-28s %8s %8lu\n", loop, (unsigned long)idle, name, "0",
+           (unsigned long)failed);
+    secFree(latencies);
+    return;
+  }
+  qsort(latencies, n, sizeof(double), _compareDouble);
+  printf("%-7s %6lu %-28s %8lu %8lu %10.1f %9.3f %9.3f %9.3f\n", loop,
+         (unsigned long)idle, name, (unsigned long)n, (unsigned long)failed,
+         n / elapsed, _percentile(latencies, n, 0.5) * 1e3,
+         _percentile(latencies, n, 0.99) * 1e3,
+         _percentile(latencies, n, 0.999) * 1e3);
+  fflush(stdout);
+  secFree(latencies);
+}
+
+static void _runMode(const char* loop, size_t idle, const struct mode* mode,
+                     unsigned long clients, unsigned long requests) {
+  size_t         total   = clients * requests;
+  struct sample* samples = mmap(NULL, sizeof(struct sample) * total,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (samples == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);
+  double start = _now();
+  for (unsigned long c = 0; c < clients; c++) {
+    if (fork() == 0) {
+      _runClient(mode, samples + c * requests, requests);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  for (unsigned long c = 0; c < clients; c++) {
+    wait(NULL);
+  }
+  _report(loop, idle, mode->name, samples, total, _now() - start);
+  munmap(samples, sizeof(struct sample) * total);
+}
+
+/**
+ * @brief runs all modes against @p agent, once per number of idle connections
+ */
+static void _runAgent(const char* loop, const char* agent, list_t* idle,
+                      unsigned long clients, unsigned long requests) {
+  for (int trust = 1; trust >= 0; trust--) {
+    _startAgent(agent, trust);
+    for (size_t i = 0; i < idle->len; i++) {
+      size_t wanted = strtoul(list_at(idle, i)->val, NULL, 10);
+      int*   socks  = secAlloc(sizeof(int) * (wanted ?: 1));
+      size_t opened = _openIdleConnections(socks, wanted);
+      _sleepMs(100);  // let the agent accept them
+      for (size_t m = 0; m < sizeof(modes) / sizeof(*modes); m++) {
+        if (modes[m].trust_local_clients == trust) {
+          _runMode(loop, opened, &modes[m], clients, requests);
+        }
+      }
+      _closeIdleConnections(socks, opened);
+      secFree(socks);
+    }
+    _stopAgent();
+  }
+}
+
+/**
+ * @brief raises the limit of open files, so that many idle connections can be
+ * opened; the agents inherit it
+ */
+static void _raiseFileLimit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-a agent] [-s select_agent] [-c clients] [-n requests] "
+          "[-i 0,100,1000]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  const char*   agent        = "test/bin/stub_agent";
+  const char*   select_agent = NULL;
+  const char*   idle_str     = BENCH_IDLE_DEFAULT;
+  unsigned long clients      = 8;
+  unsigned long requests     = 1000;
+  int           opt;
+  while ((opt = getopt(argc, argv, "a:s:c:n:i:")) != -1) {
+    switch (opt) {
+      case 'a': agent = optarg; break;
+      case 's': select_agent = optarg; break;
+      case 'c': clients = strtoul(optarg, NULL, 10); break;
+      case 'n': requests = strtoul(optarg, NULL, 10); break;
+      case 'i': idle_str = optarg; break;
+      default: _usage(argv[0]);
+    }
+  }
+  list_t* idle = delimitedStringToList(idle_str, ',');
+  if (clients == 0 || requests == 0 || idle == NULL) {
+    _usage(argv[0]);
+  }
+  _raiseFileLimit();
+  atexit(_stopAgent);
+
+  printf("%lu clients, %lu requests each, FD_SETSIZE %d\n", clients, requests,
+         FD_SETSIZE);
+  printf("%-7s %6s %-28s %8s %8s %10s %9s %9s %9s\n", "loop", "idle", "mode",
+         "ok", "failed", "req/s", "p50 ms", "p99 ms", "p999 ms");
+  _runAgent("reactor", agent, idle, clients, requests);
+  if (select_agent) {
+    _runAgent("select", select_agent, idle, clients, requests);
+  }
+  secFreeList(idle);
+  return EXIT_SUCCESS;
+}
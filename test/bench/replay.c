@@ -0,0 +1,442 @@
+#define _DEFAULT_SOURCE
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "ipc/cryptCommunicator.h"
+#include "oidc-token/api.h"
+#include "test/mock/mockProvider.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/password_entry.h"
+#include "utils/stringUtils.h"
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Replays a recording written by oidc-agent --record against a test agent. It
+ * starts the mock OpenID provider and an oidc-agent in console mode, loads one
+ * account for every account hash of the recording and then sends the recorded
+ * access token requests at their recorded times (divided by the speed-up
+ * given with -s) from concurrent client processes. Every scope hash is mapped
+ * to one of a few scopes of the mock provider, so that requests for the same
+ * scope hit the same cached token. Other request types are counted, but not
+ * replayed, since they change the loaded accounts.
+ * The latency percentiles of the replay are reported next to the recorded
+ * ones, as well as how late the requests could be sent.
+ *
+ * usage: replay [-a agent] [-c clients] [-s speed] [-d delay_ms] RECORDING
+ */
+
+#define REPLAY_ACCOUNT "replay%lu"
+#define REPLAY_APPLICATION "replay"
+#define REPLAY_SCOPE "openid profile email offline_access"
+#define REPLAY_MAX_ACCOUNTS 1024
+#define REPLAY_MAX_SCOPES 64
+
+static const char* const replayScopes[] = {
+    "openid profile", "openid email", "openid", "openid profile email",
+    "profile", "email"};
+#define REPLAY_SCOPES (sizeof(replayScopes) / sizeof(replayScopes[0]))
+
+static pid_t mock_pid  = 0;
+static pid_t agent_pid = 0;
+
+struct event {
+  double        t;
+  double        recorded_latency;
+  long          min_valid;
+  long          account;  // -1 for a request by issuer
+  long          scope;    // -1 for the scope of the account
+  unsigned char recorded_failed;
+};
+
+struct sample {
+  double        latency;
+  double        lateness;
+  unsigned char failed;
+};
+
+struct hashes {
+  char*  values[REPLAY_MAX_ACCOUNTS];
+  size_t len;
+  size_t max;  // at most REPLAY_MAX_ACCOUNTS
+};
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _sleepUntil(double t) {
+  double d = t - _now();
+  if (d <= 0) {
+    return;
+  }
+  struct timespec ts = {.tv_sec  = (time_t)d,
+                        .tv_nsec = (long)((d - (time_t)d) * 1e9)};
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief returns the index of a hash, adding it if it is new
+ * @return the index or @c -1 if @p hash is @c NULL or there are too many
+ * different hashes
+ */
+static long _indexOf(struct hashes* hashes, const char* hash) {
+  if (hash == NULL) {
+    return -1;
+  }
+  for (size_t i = 0; i < hashes->len; i++) {
+    if (strequal(hashes->values[i], hash)) {
+      return i;
+    }
+  }
+  if (hashes->len >= hashes->max) {
+    return -1;
+  }
+  hashes->values[hashes->len] = oidc_strcopy(hash);
+  return hashes->len++;
+}
+
+static int _compareEvents(const void* a, const void* b) {
+  double x = ((const struct event*)a)->t;
+  double y = ((const struct event*)b)->t;
+  return x < y ? -1 : x > y;
+}
+
+static const char* _getString(const cJSON* json, const char* key) {
+  return cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, key));
+}
+
+static double _getNumber(const cJSON* json, const char* key, double def) {
+  const cJSON* item = cJSON_GetObjectItemCaseSensitive(json, key);
+  return cJSON_IsNumber(item) ? item->valuedouble : def;
+}
+
+/**
+ * @brief reads the access token requests of a recording
+ * @param skipped set to the number of requests of other types
+ * @return the events sorted by time; has to be freed after usage
+ */
+static struct event* _readRecording(const char* path, size_t* len,
+                                    struct hashes* accounts,
+                                    struct hashes* scopes, size_t* skipped) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  size_t        cap    = 1024;
+  struct event* events = secAlloc(sizeof(struct event) * cap);
+  char*         line   = NULL;
+  size_t        n      = 0;
+  *len                 = 0;
+  *skipped             = 0;
+  while (getline(&line, &n, f) > 0) {
+    cJSON* json = stringToJson(line);
+    if (json == NULL) {
+      continue;
+    }
+    if (!strequal(_getString(json, "type"), REQUEST_VALUE_ACCESSTOKEN)) {
+      (*skipped)++;
+      secFreeJson(json);
+      continue;
+    }
+    if (*len == cap) {
+      cap *= 2;
+      events = secRealloc(events, sizeof(struct event) * cap);
+    }
+    struct event* e     = &events[(*len)++];
+    e->t                = _getNumber(json, "t", 0);
+    e->recorded_latency = _getNumber(json, "latency_ms", 0) / 1e3;
+    e->min_valid        = (long)_getNumber(json, "min_valid", 0);
+    e->account          = _indexOf(accounts, _getString(json, "account"));
+    e->scope            = _indexOf(scopes, _getString(json, "scope"));
+    e->recorded_failed =
+        !strequal(_getString(json, "status"), STATUS_SUCCESS);
+    secFreeJson(json);
+  }
+  free(line);
+  fclose(f);
+  // requests are recorded when they are answered
+  qsort(events, *len, sizeof(struct event), _compareEvents);
+  return events;
+}
+
+/**
+ * @brief starts oidc-agent in console mode and exports its socket
+ */
+static void _startAgent(const char* agent) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  agent_pid = fork();
+  if (agent_pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(agent, agent, "--console", "--no-autoload", "--no-webserver",
+          "--quiet", (char*)NULL);
+    perror(agent);
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  FILE* out = fdopen(fds[0], "r");
+  char  line[4096];
+  while (fgets(line, sizeof(line), out)) {
+    if (strncmp(line, OIDC_SOCK_ENV_NAME "=", strlen(OIDC_SOCK_ENV_NAME) + 1) ==
+        0) {
+      char* path = line + strlen(OIDC_SOCK_ENV_NAME) + 1;
+      path[strcspn(path, ";")] = '\0';
+      setenv(OIDC_SOCK_ENV_NAME, path, 1);
+      // the pipe stays open, so the agent can still write to stdout
+      return;
+    }
+  }
+  fprintf(stderr, "could not start %s\n", agent);
+  exit(EXIT_FAILURE);
+}
+
+static unsigned char _isSuccess(const char* res) {
+  char* status = res ? getJSONValueFromString(res, IPC_KEY_STATUS) : NULL;
+  unsigned char ok = strequal(status, STATUS_SUCCESS);
+  secFree(status);
+  return ok;
+}
+
+static void _waitForAgent() {
+  char* res = NULL;
+  for (int i = 0; i < 100 && !_isSuccess(res); i++) {
+    secFree(res);
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 50 * 1000000};
+    nanosleep(&ts, NULL);
+    res = ipc_cryptCommunicate(0, REQUEST_STATUS);
+  }
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "agent did not start\n");
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+}
+
+/**
+ * @brief loads an account for the mock provider that stands in for the
+ * account with index @p i of the recording
+ */
+static void _loadAccount(const char* issuer_url, size_t i) {
+  char*  shortname = oidc_sprintf(REPLAY_ACCOUNT, (unsigned long)i);
+  cJSON* config    = generateJSONObject(
+      AGENT_KEY_SHORTNAME, cJSON_String, shortname, AGENT_KEY_ISSUERURL,
+      cJSON_String, issuer_url, OIDC_KEY_CLIENTID, cJSON_String, "replay",
+      OIDC_KEY_CLIENTSECRET, cJSON_String, "secret", OIDC_KEY_REFRESHTOKEN,
+      cJSON_String, "replay-rt", OIDC_KEY_SCOPE, cJSON_String, REPLAY_SCOPE,
+      NULL);
+  cJSON* pw = generateJSONObject(PW_KEY_SHORTNAME, cJSON_String, shortname,
+                                 PW_KEY_TYPE, cJSON_Number,
+                                 (long)PW_TYPE_PRMT, NULL);
+  char*  config_str = jsonToStringUnformatted(config);
+  char*  pw_str     = jsonToStringUnformatted(pw);
+  secFreeJson(config);
+  secFreeJson(pw);
+  char* res = ipc_cryptCommunicate(0, REQUEST_ADD, config_str, pw_str, 0, 0);
+  secFree(config_str);
+  secFree(pw_str);
+  if (!_isSuccess(res)) {
+    fprintf(stderr, "could not load account %s: %s\n", shortname,
+            res ?: oidcagent_serror());
+    exit(EXIT_FAILURE);
+  }
+  secFree(res);
+  secFree(shortname);
+}
+
+static void _runClient(const struct event* events, struct sample* samples,
+                       size_t len, size_t client, size_t clients,
+                       double start, double speed, const char* issuer_url) {
+  for (size_t i = client; i < len; i += clients) {
+    const struct event* e   = &events[i];
+    const double        due = start + e->t / speed;
+    _sleepUntil(due);
+    const char* scope =
+        e->scope >= 0 ? replayScopes[e->scope % REPLAY_SCOPES] : NULL;
+    double                sent = _now();
+    struct token_response res  = {0};
+    if (e->account >= 0) {
+      char* shortname = oidc_sprintf(REPLAY_ACCOUNT, (unsigned long)e->account);
+      res             = getTokenResponse3(shortname, e->min_valid, scope,
+                                          REPLAY_APPLICATION, NULL);
+      secFree(shortname);
+    } else {
+      res = getTokenResponseForIssuer3(issuer_url, e->min_valid, scope,
+                                       REPLAY_APPLICATION, NULL);
+    }
+    samples[i].latency  = _now() - sent;
+    samples[i].lateness = sent - due;
+    samples[i].failed   = res.token == NULL;
+    secFreeTokenResponse(res);
+  }
+}
+
+static int _compareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double _percentile(const double* sorted, size_t n, double p) {
+  size_t i = (size_t)ceil(p * n);
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+static void _report(const char* name, double* values, size_t n,
+                    size_t failed) {
+  if (n == 0) {
+    printf("%-10s %8s %8lu\n", name, "0", (unsigned long)failed);
+    return;
+  }
+  qsort(values, n, sizeof(double), _compareDouble);
+  printf("%-10s %8lu %8lu %10.3f %10.3f %10.3f\n", name, (unsigned long)n,
+         (unsigned long)failed, _percentile(values, n, 0.5) * 1e3,
+         _percentile(values, n, 0.99) * 1e3,
+         _percentile(values, n, 0.999) * 1e3);
+}
+
+/**
+ * @brief stops the agent and the mock provider, also if the replay fails
+ */
+static void _stopChildren() {
+  if (agent_pid > 0) {
+    kill(agent_pid, SIGTERM);
+    waitpid(agent_pid, NULL, 0);
+  }
+  if (mock_pid > 0) {
+    kill(mock_pid, SIGTERM);
+    waitpid(mock_pid, NULL, 0);
+  }
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-a agent] [-c clients] [-s speed] [-d delay_ms] "
+          "RECORDING\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  const char*   agent    = "bin/oidc-agent";
+  unsigned long clients  = 16;
+  double        speed    = 1;
+  long          delay_ms = 0;
+  int           opt;
+  while ((opt = getopt(argc, argv, "a:c:s:d:")) != -1) {
+    switch (opt) {
+      case 'a': agent = optarg; break;
+      case 'c': clients = strtoul(optarg, NULL, 10); break;
+      case 's': speed = strtod(optarg, NULL); break;
+      case 'd': delay_ms = strtol(optarg, NULL, 10); break;
+      default: _usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || clients == 0 || speed <= 0) {
+    _usage(argv[0]);
+  }
+
+  struct hashes accounts = {.max = REPLAY_MAX_ACCOUNTS};
+  struct hashes scopes   = {.max = REPLAY_MAX_SCOPES};
+  size_t        len = 0, skipped = 0;
+  struct event* events =
+      _readRecording(argv[optind], &len, &accounts, &scopes, &skipped);
+  if (len == 0) {
+    fprintf(stderr, "no access token requests in %s\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  // requests by issuer are answered by the first account
+  if (accounts.len == 0) {
+    accounts.len = 1;
+  }
+
+  struct mockProvider_options mock = {.latency_ms = delay_ms};
+  atexit(_stopChildren);
+  mock_pid = mockProvider_start(&mock);
+  if (mock_pid < 0) {
+    return EXIT_FAILURE;
+  }
+  char* issuer_url = mockProvider_getIssuer(&mock);
+  _startAgent(agent);
+  _waitForAgent();
+  for (size_t i = 0; i < accounts.len; i++) {
+    _loadAccount(issuer_url, i);
+  }
+
+  struct sample* samples = mmap(NULL, sizeof(struct sample) * len,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (samples == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  // the first request of the recording is sent right away
+  double start = _now() - events[0].t / speed;
+  for (unsigned long c = 0; c < clients; c++) {
+    if (fork() == 0) {
+      _runClient(events, samples, len, c, clients, start, speed, issuer_url);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  for (unsigned long c = 0; c < clients; c++) {
+    wait(NULL);
+  }
+  double elapsed = _now() - start - events[0].t / speed;
+
+  printf("%lu requests for %lu accounts and %lu scopes in %.3f s, %lu other "
+         "requests skipped\n",
+         (unsigned long)len, (unsigned long)accounts.len,
+         (unsigned long)scopes.len, elapsed, (unsigned long)skipped);
+  printf("%-10s %8s %8s %10s %10s %10s\n", "", "ok", "failed", "p50 ms",
+         "p99 ms", "p999 ms");
+  double* recorded = secAlloc(sizeof(double) * len);
+  double* replayed = secAlloc(sizeof(double) * len);
+  double* lateness = secAlloc(sizeof(double) * len);
+  size_t  n_rec = 0, n_rep = 0, failed_rec = 0, failed_rep = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (events[i].recorded_failed) {
+      failed_rec++;
+    } else {
+      recorded[n_rec++] = events[i].recorded_latency;
+    }
+    if (samples[i].failed) {
+      failed_rep++;
+    } else {
+      replayed[n_rep++] = samples[i].latency;
+    }
+    lateness[i] = samples[i].lateness;
+  }
+  _report("recorded", recorded, n_rec, failed_rec);
+  _report("replayed", replayed, n_rep, failed_rep);
+  _report("late", lateness, len, 0);
+  secFree(recorded);
+  secFree(replayed);
+  secFree(lateness);
+  munmap(samples, sizeof(struct sample) * len);
+  secFree(events);
+  for (size_t i = 0; i < accounts.len; i++) {
+    secFree(accounts.values[i]);
+  }
+  for (size_t i = 0; i < scopes.len; i++) {
+    secFree(scopes.values[i]);
+  }
+  secFree(issuer_url);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+#define _DEFAULT_SOURCE
+#include "account/account.h"
+#include "defines/agent_values.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "test/mock/mockProvider.h"
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/dbCryptUtils.h"
+#include "utils/crypt/keyCache.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/db/account_db.h"
+#include "utils/file_io/cryptFileUtils.h"
+#include "utils/file_io/fileUtils.h"
+#include "utils/file_io/oidc_file_io.h"
+#include "utils/json.h"
+#include "utils/listUtils.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Scaling benchmark for the paths that touch every account configuration.
+ * For each number of accounts N it creates N synthetic encrypted account
+ * configurations in a temporary oidc dir (@c OIDC_CONFIG_DIR) and measures:
+ * - listing and sorting the account configuration files
+ * - decrypting all files, as autoload does once the password is known
+ * - loading all accounts into the account db
+ * - locking and unlocking the loaded accounts
+ * - with -a and -o: loading all accounts with @c oidc-add @c --all into an
+ *   agent that uses the mock provider as issuer
+ * Each N runs in its own process, so the reported peak RSS belongs to that run.
+ *
+ * usage: scale_bench [-n 1,10,100,1000] [-a oidc-agent -o oidc-add]
+ */
+
+#define BENCH_PASSWORD "benchmark password"
+#define BENCH_LOCK_PASSWORD "benchmark lock password"
+#define BENCH_SCOPE "openid profile email offline_access"
+#define BENCH_DEFAULT_ISSUER "https://issuer.example.com/"
+#define BENCH_DEFAULT_COUNTS "1,10,100,1000"
+
+static pid_t agent_pid = 0;
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(unsigned long n, const char* stage, double seconds) {
+  printf("%8lu %-36s %12.3f\n", n, stage, seconds * 1e3);
+  fflush(stdout);
+}
+
+static char* _shortname(unsigned long i) {
+  return oidc_sprintf("bench-%05lu", i);
+}
+
+/**
+ * @brief creates @p n encrypted account configurations in the oidc dir
+ * The key cache is enabled while writing, so the setup does not run the
+ * password hash for every file; it is disabled again before measuring.
+ */
+static void _createConfigs(unsigned long n, const char* issuer_url) {
+  keyCache_setLifetime((struct lifetimeArg){.lifetime = 0, .argProvided = 1});
+  for (unsigned long i = 0; i < n; i++) {
+    char*  shortname = _shortname(i);
+    char*  rt        = oidc_sprintf("bench-rt-%lu", i);
+    cJSON* config    = generateJSONObject(
+        AGENT_KEY_SHORTNAME, cJSON_String, shortname, AGENT_KEY_ISSUERURL,
+        cJSON_String, issuer_url, OIDC_KEY_CLIENTID, cJSON_String, "bench",
+        OIDC_KEY_CLIENTSECRET, cJSON_String, "secret", OIDC_KEY_REFRESHTOKEN,
+        cJSON_String, rt, OIDC_KEY_SCOPE, cJSON_String, BENCH_SCOPE, NULL);
+    char* config_str = jsonToStringUnformatted(config);
+    secFreeJson(config);
+    if (encryptAndWriteToOidcFile(config_str, shortname, BENCH_PASSWORD) !=
+        OIDC_SUCCESS) {
+      fprintf(stderr, "could not write %s: %s\n", shortname, oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+    secFree(config_str);
+    secFree(rt);
+    secFree(shortname);
+  }
+  keyCache_setLifetime((struct lifetimeArg){0, 0});
+}
+
+static void _removeConfigs(const char* dir) {
+  list_t* files = getAccountConfigFileList();
+  for (size_t i = 0; files && i < files->len; i++) {
+    removeOidcFile(list_at(files, i)->val);
+  }
+  secFreeList(files);
+  rmdir(dir);
+}
+
+static void _benchFileList(unsigned long n) {
+  double  start = _now();
+  list_t* list  = getAccountConfigFileList();
+  if (list == NULL || list->len != n) {
+    fprintf(stderr, "listing the account configurations failed\n");
+    exit(EXIT_FAILURE);
+  }
+  list_mergeSort(list, (int (*)(const void*, const void*))compareFilesByName);
+  _report(n, "getAccountConfigFileList + sort", _now() - start);
+  secFreeList(list);
+}
+
+/**
+ * @brief decrypts all account configurations and loads them into the account
+ * db; the two stages are reported separately
+ */
+static void _benchDecryptAndLoad(unsigned long n) {
+  char** configs = secAlloc(sizeof(char*) * n);
+  double start   = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    char* shortname = _shortname(i);
+    configs[i]      = decryptOidcFile(shortname, BENCH_PASSWORD);
+    secFree(shortname);
+    if (configs[i] == NULL) {
+      fprintf(stderr, "decryption failed: %s\n", oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+  }
+  _report(n, "decryptOidcFile (autoload)", _now() - start);
+
+  start = _now();
+  for (unsigned long i = 0; i < n; i++) {
+    struct oidc_account* account = getAccountFromJSON(configs[i]);
+    secFree(configs[i]);
+    if (account == NULL) {
+      fprintf(stderr, "parsing an account failed: %s\n", oidc_serror());
+      exit(EXIT_FAILURE);
+    }
+    db_addAccountEncrypted(account);
+  }
+  _report(n, "getAccountFromJSON + db add", _now() - start);
+  secFree(configs);
+}
+
+static void _benchLock(unsigned long n) {
+  double start = _now();
+  if (lockEncrypt(BENCH_LOCK_PASSWORD) != OIDC_SUCCESS) {
+    fprintf(stderr, "lock failed: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  _report(n, "lockEncrypt", _now() - start);
+  start = _now();
+  if (lockDecrypt(BENCH_LOCK_PASSWORD) != OIDC_SUCCESS) {
+    fprintf(stderr, "unlock failed: %s\n", oidc_serror());
+    exit(EXIT_FAILURE);
+  }
+  _report(n, "lockDecrypt", _now() - start);
+}
+
+/**
+ * @brief starts oidc-agent in console mode and exports its socket
+ */
+static void _startAgent(const char* agent) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  agent_pid = fork();
+  if (agent_pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    execl(agent, agent, "--console", "--no-autoload", "--no-webserver",
+          "--quiet", (char*)NULL);
+    perror(agent);
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  FILE* out = fdopen(fds[0], "r");
+  char  line[4096];
+  while (fgets(line, sizeof(line), out)) {
+    if (strncmp(line, OIDC_SOCK_ENV_NAME "=", strlen(OIDC_SOCK_ENV_NAME) + 1) ==
+        0) {
+      char* path = line + strlen(OIDC_SOCK_ENV_NAME) + 1;
+      path[strcspn(path, ";")] = '\0';
+      setenv(OIDC_SOCK_ENV_NAME, path, 1);
+      return;
+    }
+  }
+  fprintf(stderr, "could not start %s\n", agent);
+  exit(EXIT_FAILURE);
+}
+
+static void _stopAgent() {
+  if (agent_pid > 0) {
+    kill(agent_pid, SIGTERM);
+    waitpid(agent_pid, NULL, 0);
+    agent_pid = 0;
+  }
+}
+
+/**
+ * @brief returns the peak RSS of a running process in KiB
+ */
+static long _peakRss(pid_t pid) {
+  char* path = oidc_sprintf("/proc/%d/status", (int)pid);
+  FILE* f    = fopen(path, "r");
+  secFree(path);
+  if (f == NULL) {
+    return -1;
+  }
+  char line[256];
+  long kib = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "VmHWM: %ld kB", &kib) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return kib;
+}
+
+static void _benchOidcAdd(unsigned long n, const char* agent, const char* add) {
+  _startAgent(agent);
+  setenv(OIDC_PASSWORD_ENV_NAME, BENCH_PASSWORD, 1);
+  double start = _now();
+  pid_t  pid   = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+      _exit(EXIT_FAILURE);
+    }
+    execl(add, add, "--all", "--pw-env", (char*)NULL);
+    perror(add);
+    _exit(EXIT_FAILURE);
+  }
+  int status = -1;
+  waitpid(pid, &status, 0);
+  double elapsed = _now() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "oidc-add --all failed\n");
+  }
+  _report(n, "oidc-add --all", elapsed);
+  printf("%8lu %-36s %12ld\n", n, "oidc-agent peak RSS (KiB)",
+         _peakRss(agent_pid));
+  _stopAgent();
+}
+
+static void _runScale(unsigned long n, const char* issuer_url,
+                      const char* agent, const char* add) {
+  char dir[] = "/tmp/oidc-scale-bench-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    exit(EXIT_FAILURE);
+  }
+  setenv(OIDC_CONFIG_DIR_ENV_NAME, dir, 1);
+  resetOidcDirCache();
+  double start = _now();
+  _createConfigs(n, issuer_url);
+  _report(n, "setup (write configs, key cached)", _now() - start);
+
+  _benchFileList(n);
+  _benchDecryptAndLoad(n);
+  _benchLock(n);
+  if (agent && add) {
+    _benchOidcAdd(n, agent, add);
+  }
+  _removeConfigs(dir);
+}
+
+static void _usage(const char* prog) {
+  fprintf(stderr, "usage: %s [-n 1,10,100,1000] [-a oidc-agent -o oidc-add]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  const char* counts = BENCH_DEFAULT_COUNTS;
+  const char* agent  = NULL;
+  const char* add    = NULL;
+  int         opt;
+  while ((opt = getopt(argc, argv, "n:a:o:")) != -1) {
+    switch (opt) {
+      case 'n': counts = optarg; break;
+      case 'a': agent = optarg; break;
+      case 'o': add = optarg; break;
+      default: _usage(argv[0]);
+    }
+  }
+  if ((agent == NULL) != (add == NULL)) {
+    _usage(argv[0]);
+  }
+  logger_setloglevel(NOTICE);
+  initCrypt();
+  initMemoryCrypt();
+
+  pid_t mock_pid   = 0;
+  char* issuer_url = oidc_strcopy(BENCH_DEFAULT_ISSUER);
+  if (agent) {
+    struct mockProvider_options mock = {0};
+    mock_pid = mockProvider_start(&mock);
+    if (mock_pid < 0) {
+      return EXIT_FAILURE;
+    }
+    secFree(issuer_url);
+    issuer_url = mockProvider_getIssuer(&mock);
+  }
+
+  printf("%8s %-36s %12s\n", "accounts", "stage", "ms");
+  list_t* ns = delimitedStringToList(counts, ',');
+  for (size_t i = 0; ns && i < ns->len; i++) {
+    unsigned long n = strtoul(list_at(ns, i)->val, NULL, 10);
+    if (n == 0) {
+      continue;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      accountDB_new();
+      accountDB_setFreeFunction((freeFunction)_secFreeAccount);
+      accountDB_setMatchFunction((matchFunction)account_matchByName);
+      _runScale(n, issuer_url, agent, add);
+      _exit(EXIT_SUCCESS);
+    }
+    int           status = -1;
+    struct rusage usage  = {0};
+    wait4(pid, &status, 0, &usage);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "run with %lu accounts failed\n", n);
+    }
+    printf("%8lu %-36s %12ld\n", n, "peak RSS (KiB)", usage.ru_maxrss);
+  }
+  secFreeList(ns);
+  secFree(issuer_url);
+  if (mock_pid > 0) {
+    kill(mock_pid, SIGTERM);
+    waitpid(mock_pid, NULL, 0);
+  }
+  return EXIT_SUCCESS;
+}
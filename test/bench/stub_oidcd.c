@@ -0,0 +1,39 @@
+#include "defines/agent_values.h"
+#include "defines/ipc_values.h"
+#include "defines/oidc_values.h"
+#include "ipc/pipe.h"
+#include "oidc-agent/oidcd/oidcd.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Replaces oidcd in the agent used by ipc_bench. It answers every request
+ * with the same access token response, so that the benchmark measures oidcp
+ * and the ipc between the clients and oidcp, but not the handling of the
+ * requests.
+ */
+
+#define STUB_ACCESSTOKEN "stub-access-token"
+#define STUB_ISSUER "https://stub.example.org/"
+
+int oidcd_main(struct ipcPipe pipes, const struct arguments* arguments) {
+  (void)arguments;
+  unsigned long expires_at = time(NULL) + 3600;
+  while (1) {
+    unsigned long tag = 0;
+    char*         q   = ipc_readTaggedFromPipeWithTimeout(pipes, 0, &tag);
+    if (q == NULL) {
+      if (oidc_errno == OIDC_EIPCDIS || oidc_errno == OIDC_EIPCTAG) {
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+    secFree(q);
+    ipc_writeToPipe(ipc_tagPipe(pipes, tag), RESPONSE_STATUS_ACCESS,
+                    STATUS_SUCCESS, STUB_ACCESSTOKEN, STUB_ISSUER, expires_at);
+  }
+  return EXIT_FAILURE;
+}
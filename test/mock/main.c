@@ -0,0 +1,59 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mockProvider.h"
+#include "utils/memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Runs the mock provider in the foreground, e.g. to run oidc-agent, oidc-gen
+ * or the flows against it by hand. The issuer url is printed on startup.
+ *
+ * usage: mock_provider [-p port] [-l latency_ms] [-e error_rate] [-r]
+ *                      [-k pending_polls] [-i interval]
+ */
+
+static void _usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [-p port] [-l latency_ms] [-e error_rate] [-r] "
+          "[-k pending_polls] [-i interval]\n"
+          "  -p  port to listen on; default is an ephemeral port\n"
+          "  -l  latency added to every response in milliseconds\n"
+          "  -e  percentage of requests that fail with 500\n"
+          "  -r  rotate the refresh token on every refresh\n"
+          "  -k  polls before a device code is authorized; default 1\n"
+          "  -i  device polling interval in seconds; default 1\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  struct mockProvider_options opts = {.device_pending_polls = 1,
+                                      .device_interval      = 1};
+  int                         opt;
+  while ((opt = getopt(argc, argv, "p:l:e:rk:i:")) != -1) {
+    switch (opt) {
+      case 'p': opts.port = strtoul(optarg, NULL, 10); break;
+      case 'l': opts.latency_ms = strtol(optarg, NULL, 10); break;
+      case 'e': opts.error_rate = strtoul(optarg, NULL, 10); break;
+      case 'r': opts.rotate_refresh_tokens = 1; break;
+      case 'k': opts.device_pending_polls = strtoul(optarg, NULL, 10); break;
+      case 'i': opts.device_interval = strtoul(optarg, NULL, 10); break;
+      default: _usage(argv[0]);
+    }
+  }
+  if (opts.error_rate > 100) {
+    _usage(argv[0]);
+  }
+  int sock = mockProvider_listen(&opts);
+  if (sock < 0) {
+    return EXIT_FAILURE;
+  }
+  char* issuer = mockProvider_getIssuer(&opts);
+  printf("%s\n", issuer);
+  fflush(stdout);
+  secFree(issuer);
+  mockProvider_serve(sock, &opts);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,348 @@
+#define _DEFAULT_SOURCE
+#include "mockProvider.h"
+#include "defines/oidc_values.h"
+#include "defines/settings.h"
+#include "utils/json.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * A minimal OpenID provider for deterministic performance tests. It serves
+ * the configuration document, a token endpoint (refresh, password and device
+ * grants), a device authorization endpoint, a revocation endpoint and a
+ * dynamic client registration endpoint over plain http on localhost.
+ *
+ * Every connection is handled by its own process, so slow responses do not
+ * serialize concurrent requests. The counters are shared between these
+ * processes. Tokens are never validated.
+ */
+
+#define MOCK_MAX_REQUEST 65536
+#define MOCK_MAX_DEVICE_CODES 4096
+
+struct mockState {
+  unsigned long requests;
+  unsigned long access_tokens;
+  unsigned long refresh_tokens;
+  unsigned long device_codes;
+  unsigned long clients;
+  unsigned int  polls[MOCK_MAX_DEVICE_CODES];
+};
+
+static struct mockState* state = NULL;
+
+static void _sleepMs(long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief returns the value of @p key in urlencoded form data
+ * The value is not decoded.
+ * @return a pointer to the value; it has to be freed after usage
+ */
+static char* _formValue(const char* body, const char* key) {
+  size_t      keylen = strlen(key);
+  const char* p      = body;
+  while (p && *p) {
+    if (strncmp(p, key, keylen) == 0 && p[keylen] == '=') {
+      p += keylen + 1;
+      return oidc_strncopy(p, strcspn(p, "&"));
+    }
+    p = strchr(p, '&');
+    p = p ? p + 1 : NULL;
+  }
+  return NULL;
+}
+
+static char* _tokenResponse(unsigned char with_refresh_token) {
+  unsigned long at = __sync_add_and_fetch(&state->access_tokens, 1);
+  if (!with_refresh_token) {
+    return oidc_sprintf("{\"" OIDC_KEY_ACCESSTOKEN "\":\"mock-at-%lu\","
+                        "\"token_type\":\"Bearer\",\"" OIDC_KEY_EXPIRESIN
+                        "\":3600}",
+                        at);
+  }
+  unsigned long rt = __sync_add_and_fetch(&state->refresh_tokens, 1);
+  return oidc_sprintf("{\"" OIDC_KEY_ACCESSTOKEN "\":\"mock-at-%lu\","
+                      "\"token_type\":\"Bearer\",\"" OIDC_KEY_EXPIRESIN
+                      "\":3600,\"" OIDC_KEY_REFRESHTOKEN "\":\"mock-rt-%lu\"}",
+                      at, rt);
+}
+
+/**
+ * @brief handles a request to the token endpoint
+ * @param status is set to the http status of the response
+ */
+static char* _handleToken(const struct mockProvider_options* opts,
+                          const char* body, int* status) {
+  char* grant_type = _formValue(body, OIDC_KEY_GRANTTYPE);
+  char* ret        = NULL;
+  if (strequal(grant_type, OIDC_GRANTTYPE_REFRESH)) {
+    ret = _tokenResponse(opts->rotate_refresh_tokens);
+  } else if (strequal(grant_type, OIDC_GRANTTYPE_PASSWORD)) {
+    ret = _tokenResponse(1);
+  } else if (grant_type && strstr(grant_type, OIDC_KEY_DEVICECODE)) {
+    char*         device_code = _formValue(body, OIDC_KEY_DEVICECODE);
+    unsigned long n = device_code ? strtoul(device_code + strlen("mock-dc-"),
+                                            NULL, 10)
+                                  : 0;
+    secFree(device_code);
+    unsigned int polls =
+        n < MOCK_MAX_DEVICE_CODES ? __sync_add_and_fetch(&state->polls[n], 1)
+                                  : opts->device_pending_polls + 1;
+    if (polls <= opts->device_pending_polls) {
+      *status = 400;
+      ret     = oidc_strcopy("{\"" OIDC_KEY_ERROR
+                             "\":\"authorization_pending\"}");
+    } else {
+      ret = _tokenResponse(1);
+    }
+  } else {
+    *status = 400;
+    ret     = oidc_strcopy("{\"" OIDC_KEY_ERROR
+                           "\":\"unsupported_grant_type\"}");
+  }
+  secFree(grant_type);
+  return ret;
+}
+
+static char* _handleDevice(const struct mockProvider_options* opts) {
+  unsigned long n = __sync_add_and_fetch(&state->device_codes, 1);
+  return oidc_sprintf(
+      "{\"" OIDC_KEY_DEVICECODE "\":\"mock-dc-%lu\",\"" OIDC_KEY_USERCODE
+      "\":\"MOCK-%lu\",\"" OIDC_KEY_VERIFICATIONURI
+      "\":\"http://127.0.0.1:%hu/device\",\"" OIDC_KEY_EXPIRESIN
+      "\":600,\"" OIDC_KEY_INTERVAL "\":%u}",
+      n, n, opts->port, opts->device_interval);
+}
+
+/**
+ * @brief handles a dynamic client registration
+ * The registration request is echoed with client credentials added.
+ */
+static char* _handleRegistration(const struct mockProvider_options* opts,
+                                 const char* body) {
+  cJSON* json = stringToJson(body);
+  if (json == NULL) {
+    json = cJSON_CreateObject();
+  }
+  unsigned long n         = __sync_add_and_fetch(&state->clients, 1);
+  char*         client_id = oidc_sprintf("mock-client-%lu", n);
+  char*         uri =
+      oidc_sprintf("http://127.0.0.1:%hu/register/%s", opts->port, client_id);
+  jsonAddStringValue(json, OIDC_KEY_CLIENTID, client_id);
+  jsonAddStringValue(json, OIDC_KEY_CLIENTSECRET, "mock-secret");
+  jsonAddStringValue(json, OIDC_KEY_REGISTRATION_ACCESS_TOKEN, "mock-rat");
+  jsonAddStringValue(json, OIDC_KEY_REGISTRATION_CLIENT_URI, uri);
+  secFree(client_id);
+  secFree(uri);
+  char* ret = jsonToStringUnformatted(json);
+  secFreeJson(json);
+  return ret;
+}
+
+static char* _configuration(const struct mockProvider_options* opts) {
+  char* issuer = mockProvider_getIssuer(opts);
+  char* ret    = oidc_sprintf(
+      "{\"" OIDC_KEY_ISSUER "\":\"%s\",\"" OIDC_KEY_TOKEN_ENDPOINT
+      "\":\"%stoken\",\"" OIDC_KEY_AUTHORIZATION_ENDPOINT
+      "\":\"%sauthorize\",\"" OIDC_KEY_DEVICE_AUTHORIZATION_ENDPOINT
+      "\":\"%sdevice\",\"" OIDC_KEY_REVOCATION_ENDPOINT
+      "\":\"%srevoke\",\"" OIDC_KEY_REGISTRATION_ENDPOINT
+      "\":\"%sregister\",\"" OIDC_KEY_SCOPES_SUPPORTED
+      "\":[\"openid\",\"profile\",\"email\",\"offline_access\"],\""
+      OIDC_KEY_GRANT_TYPES_SUPPORTED "\":[\"" OIDC_GRANTTYPE_REFRESH
+      "\",\"" OIDC_GRANTTYPE_PASSWORD "\",\"" OIDC_GRANTTYPE_AUTHCODE
+      "\",\"" OIDC_GRANTTYPE_DEVICE "\"],\"" OIDC_KEY_RESPONSE_TYPES_SUPPORTED
+      "\":[\"code\"],\"" OIDC_KEY_CODE_CHALLENGE_METHODS_SUPPORTED
+      "\":[\"S256\"]}",
+      issuer, issuer, issuer, issuer, issuer, issuer);
+  secFree(issuer);
+  return ret;
+}
+
+/**
+ * @brief reads a complete http request
+ * @param body is set to the start of the body inside the returned buffer
+ * @return a pointer to the request; it has to be freed after usage
+ */
+static char* _readRequest(int sock, char** body) {
+  char*  buf = secAlloc(MOCK_MAX_REQUEST + 1);
+  size_t len = 0;
+  char*  end = NULL;
+  while (end == NULL && len < MOCK_MAX_REQUEST) {
+    ssize_t r = read(sock, buf + len, MOCK_MAX_REQUEST - len);
+    if (r <= 0) {
+      secFree(buf);
+      return NULL;
+    }
+    len += r;
+    end = strstr(buf, "\r\n\r\n");
+  }
+  if (end == NULL) {
+    secFree(buf);
+    return NULL;
+  }
+  *body         = end + 4;
+  const char* c = strstr(buf, "Content-Length:");
+  size_t content_length =
+      c && c < end ? strtoul(c + strlen("Content-Length:"), NULL, 10) : 0;
+  size_t header_length = *body - buf;
+  if (header_length + content_length > MOCK_MAX_REQUEST) {
+    secFree(buf);
+    return NULL;
+  }
+  while (len < header_length + content_length) {
+    ssize_t r = read(sock, buf + len, header_length + content_length - len);
+    if (r <= 0) {
+      secFree(buf);
+      return NULL;
+    }
+    len += r;
+  }
+  return buf;
+}
+
+static void _handleConnection(int sock,
+                              const struct mockProvider_options* opts) {
+  char* body    = NULL;
+  char* request = _readRequest(sock, &body);
+  if (request == NULL) {
+    return;
+  }
+  __sync_add_and_fetch(&state->requests, 1);
+  if (opts->latency_ms > 0) {
+    _sleepMs(opts->latency_ms);
+  }
+  char  method[8] = {0};
+  char  path[256] = {0};
+  int   status    = 200;
+  char* content   = NULL;
+  sscanf(request, "%7s %255s", method, path);
+  if (opts->error_rate && (unsigned int)(rand() % 100) < opts->error_rate) {
+    status  = 500;
+    content = oidc_strcopy("{\"" OIDC_KEY_ERROR "\":\"server_error\"}");
+  } else if (strEnds(path, CONF_ENDPOINT_SUFFIX)) {
+    content = _configuration(opts);
+  } else if (strequal(path, "/token")) {
+    content = _handleToken(opts, body, &status);
+  } else if (strequal(path, "/device")) {
+    content = _handleDevice(opts);
+  } else if (strequal(path, "/revoke")) {
+    content = oidc_strcopy("");
+  } else if (strequal(path, "/register") && strequal(method, "POST")) {
+    content = _handleRegistration(opts, body);
+    status  = 201;
+  } else if (strstarts(path, "/register/") && strequal(method, "DELETE")) {
+    status  = 204;
+    content = oidc_strcopy("");
+  } else {
+    status  = 404;
+    content = oidc_strcopy("{\"" OIDC_KEY_ERROR "\":\"not_found\"}");
+  }
+  secFree(request);
+  char* response = oidc_sprintf(
+      "HTTP/1.1 %d Mock\r\nContent-Type: application/json\r\nContent-Length: "
+      "%lu\r\nConnection: close\r\n\r\n%s",
+      status, (unsigned long)strlen(content), content);
+  if (write(sock, response, strlen(response)) < 0) {
+    perror("write");
+  }
+  secFree(response);
+  secFree(content);
+}
+
+/**
+ * @brief creates the listening socket of the mock provider on localhost
+ * @param opts the options; the port is set to the actual port
+ * @return the socket or -1 on failure
+ */
+int mockProvider_listen(struct mockProvider_options* opts) {
+  int                sock = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port   = htons(opts->port)};
+  addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen       = sizeof(addr);
+  int       one           = 1;
+  if (sock < 0 ||
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+      bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 128) != 0 ||
+      getsockname(sock, (struct sockaddr*)&addr, &addrlen) != 0) {
+    perror("mock provider");
+    if (sock >= 0) {
+      close(sock);
+    }
+    return -1;
+  }
+  opts->port = ntohs(addr.sin_port);
+  return sock;
+}
+
+/**
+ * @brief serves requests on @p sock; does not return
+ */
+void mockProvider_serve(int sock, const struct mockProvider_options* opts) {
+  state = mmap(NULL, sizeof(struct mockState), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (state == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  memset(state, 0, sizeof(struct mockState));
+  signal(SIGCHLD, SIG_IGN);  // no zombies
+  unsigned int seed = 0;
+  while (1) {
+    int con = accept(sock, NULL, NULL);
+    if (con < 0) {
+      continue;
+    }
+    seed++;
+    if (fork() == 0) {
+      close(sock);
+      srand(seed);
+      _handleConnection(con, opts);
+      close(con);
+      _exit(EXIT_SUCCESS);
+    }
+    close(con);
+  }
+}
+
+/**
+ * @brief starts the mock provider in a child process
+ * @param opts the options; the port is set to the actual port
+ * @return the pid of the mock provider or -1 on failure
+ */
+pid_t mockProvider_start(struct mockProvider_options* opts) {
+  int sock = mockProvider_listen(opts);
+  if (sock < 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    mockProvider_serve(sock, opts);
+  }
+  close(sock);
+  return pid;
+}
+
+/**
+ * @brief returns the issuer url of the mock provider
+ * @return a pointer to the url; it has to be freed after usage
+ */
+char* mockProvider_getIssuer(const struct mockProvider_options* opts) {
+  return oidc_sprintf("http://127.0.0.1:%hu/", opts->port);
+}
@@ -0,0 +1,24 @@
+#ifndef OIDC_TEST_MOCK_PROVIDER_H
+#define OIDC_TEST_MOCK_PROVIDER_H
+
+#include <sys/types.h>
+
+/**
+ * @struct mockProvider_options mockProvider.h
+ * @brief the behavior of the mock provider
+ */
+struct mockProvider_options {
+  unsigned short port;        // 0 for an ephemeral port; set when listening
+  long           latency_ms;  // added to every response
+  unsigned int   error_rate;  // percentage of requests answered with 500
+  unsigned char  rotate_refresh_tokens;
+  unsigned int   device_pending_polls;  // polls before a device code is valid
+  unsigned int   device_interval;
+};
+
+int   mockProvider_listen(struct mockProvider_options* opts);
+void  mockProvider_serve(int sock, const struct mockProvider_options* opts);
+pid_t mockProvider_start(struct mockProvider_options* opts);
+char* mockProvider_getIssuer(const struct mockProvider_options* opts);
+
+#endif  // OIDC_TEST_MOCK_PROVIDER_H
@@ -1,8 +1,12 @@
 #include "suite.h"
+#include "tc_accountCodec.h"
 #include "tc_defineUsableScopes.h"
+#include "tc_refreshTemplate.h"
 
 Suite* test_suite_account() {
   Suite* ts_account = suite_create("account");
   suite_add_tcase(ts_account, test_case_defineUsableScopes());
+  suite_add_tcase(ts_account, test_case_accountCodec());
+  suite_add_tcase(ts_account, test_case_refreshTemplate());
   return ts_account;
 }
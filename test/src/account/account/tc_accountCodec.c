@@ -0,0 +1,71 @@
+#include "tc_accountCodec.h"
+
+#include "account/accountCodec.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+START_TEST(test_roundtrip) {
+  const char* json =
+      "{\"name\":\"short\",\"issuer_url\":\"https://example.com/\","
+      "\"client_id\":\"id\\\"with quote\",\"client_secret\":\"secret\","
+      "\"refresh_token\":\"rt\",\"scope\":\"openid profile\","
+      "\"redirect_uris\":[\"http://localhost:4242\",\"http://localhost:8080\"]"
+      "}";
+  struct oidc_account* a = getAccountFromJSON(json);
+  ck_assert_ptr_ne(a, NULL);
+  char* encoded = accountToCompactString(a);
+  ck_assert_ptr_ne(encoded, NULL);
+  struct oidc_account* b = getAccountFromCompactString(encoded);
+  ck_assert_ptr_ne(b, NULL);
+  char* ja = accountToJSONString(a);
+  char* jb = accountToJSONString(b);
+  ck_assert_str_eq(ja, jb);
+  secFree(ja);
+  secFree(jb);
+  secFree(encoded);
+  secFreeAccount(a);
+  secFreeAccount(b);
+}
+END_TEST
+
+START_TEST(test_roundtripPool) {
+  const char* json =
+      "{\"name\":\"short\",\"issuer_url\":\"https://example.com/\","
+      "\"client_id\":\"id\",\"refresh_token\":\"rt\","
+      "\"refresh_token_pool\":[\"rt1\",\"rt2\"],"
+      "\"refresh_token_pool_size\":3,\"refresh_token_slot\":2}";
+  struct oidc_account* a = getAccountFromJSON(json);
+  ck_assert_ptr_ne(a, NULL);
+  ck_assert_uint_eq(account_getRefreshTokenPool(a)->len, 2);
+  ck_assert_uint_eq(account_getRefreshTokenPoolSize(a), 3);
+  ck_assert_uint_eq(account_getRefreshTokenSlot(a), 2);
+  char* encoded = accountToCompactString(a);
+  ck_assert_ptr_ne(encoded, NULL);
+  struct oidc_account* b = getAccountFromCompactString(encoded);
+  ck_assert_ptr_ne(b, NULL);
+  char* ja = accountToJSONString(a);
+  char* jb = accountToJSONString(b);
+  ck_assert_str_eq(ja, jb);
+  ck_assert_ptr_ne(strstr(jb, "\"rt2\""), NULL);
+  secFree(ja);
+  secFree(jb);
+  secFree(encoded);
+  secFreeAccount(a);
+  secFreeAccount(b);
+}
+END_TEST
+
+START_TEST(test_invalid) {
+  ck_assert_ptr_eq(getAccountFromCompactString("not base64!"), NULL);
+  ck_assert_ptr_eq(getAccountFromCompactString("AQUAAABzaG9y"), NULL);
+}
+END_TEST
+
+TCase* test_case_accountCodec() {
+  TCase* tc = tcase_create("accountCodec");
+  tcase_add_test(tc, test_roundtrip);
+  tcase_add_test(tc, test_roundtripPool);
+  tcase_add_test(tc, test_invalid);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_ACCOUNTCODEC_H
+#define TEST_ACCOUNT_ACCOUNTCODEC_H
+
+#include <check.h>
+
+TCase* test_case_accountCodec();
+
+#endif  // TEST_ACCOUNT_ACCOUNTCODEC_H
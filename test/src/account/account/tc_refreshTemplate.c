@@ -0,0 +1,69 @@
+#include "tc_refreshTemplate.h"
+
+#include "account/account.h"
+#include "account/refreshTemplate.h"
+#include "utils/crypt/memoryCrypt.h"
+#include "utils/stringUtils.h"
+
+START_TEST(test_default) {
+  initMemoryCrypt();
+  struct oidc_account account = {};
+  account_setClientId(&account, oidc_strcopy("id"));
+  account_setClientSecret(&account, oidc_strcopy("se:c"));
+  account_setScopeExact(&account, oidc_strcopy("openid profile"));
+  account_setRefreshToken(&account, oidc_strcopy("r/t"));
+  ck_assert_int_eq(refreshTemplate_prepare(&account), OIDC_SUCCESS);
+  ck_assert_ptr_ne(account_getRefreshTemplate(&account), NULL);
+  struct refreshRequest request =
+      refreshTemplate_request(&account, NULL, NULL);
+  ck_assert_str_eq(request.auth_header, "Authorization: Basic aWQ6c2U6Yw==");
+  ck_assert_str_eq(request.data,
+                   "grant_type=refresh_token&refresh_token=r%2Ft"
+                   "&scope=openid%20profile");
+  secFreeRefreshRequest(&request);
+  secFreeAccountContent(&account);
+}
+END_TEST
+
+START_TEST(test_scopeAndAudience) {
+  initMemoryCrypt();
+  struct oidc_account account = {};
+  account_setClientId(&account, oidc_strcopy("id"));
+  account_setScopeExact(&account, oidc_strcopy("openid profile"));
+  account_setRefreshToken(&account, oidc_strcopy("rt"));
+  struct refreshRequest request =
+      refreshTemplate_request(&account, "openid", "https://aud");
+  ck_assert_str_eq(request.auth_header, "Authorization: Basic aWQ6");
+  ck_assert_str_eq(request.data,
+                   "grant_type=refresh_token&refresh_token=rt&scope=openid"
+                   "&audience=https%3A%2F%2Faud");
+  secFreeRefreshRequest(&request);
+  secFreeAccountContent(&account);
+}
+END_TEST
+
+START_TEST(test_scopeChanged) {
+  initMemoryCrypt();
+  struct oidc_account account = {};
+  account_setScopeExact(&account, oidc_strcopy("openid"));
+  account_setRefreshToken(&account, oidc_strcopy("rt"));
+  ck_assert_int_eq(refreshTemplate_prepare(&account), OIDC_SUCCESS);
+  account_setScopeExact(&account, oidc_strcopy("email"));
+  ck_assert_ptr_eq(account_getRefreshTemplate(&account), NULL);
+  struct refreshRequest request =
+      refreshTemplate_request(&account, NULL, NULL);
+  ck_assert_ptr_eq(request.auth_header, NULL);
+  ck_assert_str_eq(request.data,
+                   "grant_type=refresh_token&refresh_token=rt&scope=email");
+  secFreeRefreshRequest(&request);
+  secFreeAccountContent(&account);
+}
+END_TEST
+
+TCase* test_case_refreshTemplate() {
+  TCase* tc = tcase_create("refreshTemplate");
+  tcase_add_test(tc, test_default);
+  tcase_add_test(tc, test_scopeAndAudience);
+  tcase_add_test(tc, test_scopeChanged);
+  return tc;
+}
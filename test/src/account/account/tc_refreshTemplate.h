@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_REFRESHTEMPLATE_H
+#define TEST_ACCOUNT_REFRESHTEMPLATE_H
+
+#include <check.h>
+
+TCase* test_case_refreshTemplate();
+
+#endif  // TEST_ACCOUNT_REFRESHTEMPLATE_H
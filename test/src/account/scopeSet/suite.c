@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_scopeSet_fromString.h"
+
+Suite* test_suite_scopeSet() {
+  Suite* ts_scopeSet = suite_create("scopeSet");
+  suite_add_tcase(ts_scopeSet, test_case_scopeSet_fromString());
+  return ts_scopeSet;
+}
@@ -0,0 +1,103 @@
+#include "tc_scopeSet_fromString.h"
+
+#include "account/scopeSet.h"
+#include "utils/memory.h"
+
+#include <stdio.h>
+
+START_TEST(test_empty) {
+  struct scopeDict* dict = scopeDict_new(NULL);
+  struct scopeSet   set;
+  ck_assert_int_eq(scopeSet_fromString(dict, NULL, &set), 0);
+  ck_assert(scopeSet_isEmpty(&set));
+  char* str = scopeSet_toString(dict, &set);
+  ck_assert_str_eq(str, "");
+  secFree(str);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+START_TEST(test_order) {
+  struct scopeDict* dict = scopeDict_new("openid profile storage.read");
+  struct scopeSet   a, b;
+  ck_assert_int_eq(
+      scopeSet_fromString(dict, "storage.read openid profile", &a), 0);
+  ck_assert_int_eq(scopeSet_fromString(dict, "profile openid storage.read", &b),
+                   0);
+  ck_assert(scopeSet_equal(&a, &b));
+  char* str = scopeSet_toString(dict, &a);
+  ck_assert_str_eq(str, "openid profile storage.read");
+  secFree(str);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+START_TEST(test_duplicates) {
+  struct scopeDict* dict = scopeDict_new(NULL);
+  struct scopeSet   set;
+  ck_assert_int_eq(scopeSet_fromString(dict, "openid  openid profile", &set),
+                   0);
+  char* str = scopeSet_toString(dict, &set);
+  ck_assert_str_eq(str, "openid profile");
+  secFree(str);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+START_TEST(test_lookup) {
+  struct scopeDict* dict = scopeDict_new("openid");
+  struct scopeSet   set;
+  ck_assert_int_eq(scopeSet_lookup(dict, "openid", &set), 0);
+  ck_assert_int_eq(scopeSet_lookup(dict, "openid profile", &set), -1);
+  ck_assert_int_eq(scopeSet_fromString(dict, "profile", &set), 0);
+  ck_assert_int_eq(scopeSet_lookup(dict, "openid profile", &set), 0);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+START_TEST(test_operations) {
+  struct scopeDict* dict = scopeDict_new(NULL);
+  struct scopeSet   a, b;
+  scopeSet_fromString(dict, "openid profile email", &a);
+  scopeSet_fromString(dict, "profile offline_access", &b);
+  struct scopeSet i = a;
+  scopeSet_intersect(&i, &b);
+  char* str = scopeSet_toString(dict, &i);
+  ck_assert_str_eq(str, "profile");
+  secFree(str);
+  scopeSet_subtract(&a, &b);
+  str = scopeSet_toString(dict, &a);
+  ck_assert_str_eq(str, "openid email");
+  secFree(str);
+  scopeSet_union(&a, &b);
+  str = scopeSet_toString(dict, &a);
+  ck_assert_str_eq(str, "openid profile email offline_access");
+  secFree(str);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+START_TEST(test_full) {
+  struct scopeDict* dict = scopeDict_new(NULL);
+  struct scopeSet   set;
+  char              scope[16];
+  for (int i = 0; i < SCOPESET_MAX_SCOPES; i++) {
+    snprintf(scope, sizeof(scope), "scope%d", i);
+    ck_assert_int_eq(scopeSet_fromString(dict, scope, &set), 0);
+  }
+  ck_assert_int_eq(scopeSet_fromString(dict, "another", &set), -1);
+  ck_assert_int_eq(scopeSet_fromString(dict, "scope0 scope255", &set), 0);
+  secFreeScopeDict(dict);
+}
+END_TEST
+
+TCase* test_case_scopeSet_fromString() {
+  TCase* tc = tcase_create("scopeSet_fromString");
+  tcase_add_test(tc, test_empty);
+  tcase_add_test(tc, test_order);
+  tcase_add_test(tc, test_duplicates);
+  tcase_add_test(tc, test_lookup);
+  tcase_add_test(tc, test_operations);
+  tcase_add_test(tc, test_full);
+  return tc;
+}
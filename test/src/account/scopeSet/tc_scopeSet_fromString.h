@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_SCOPESET_FROMSTRING_H
+#define TEST_ACCOUNT_SCOPESET_FROMSTRING_H
+
+#include <check.h>
+
+TCase* test_case_scopeSet_fromString();
+
+#endif  // TEST_ACCOUNT_SCOPESET_FROMSTRING_H
@@ -0,0 +1,14 @@
+#include "suite.h"
+#include "tc_account_cacheToken.h"
+#include "tc_account_dropToken.h"
+#include "tc_account_trimTokenCache.h"
+#include "tc_tokenIndex.h"
+
+Suite* test_suite_tokenCache() {
+  Suite* ts_tokenCache = suite_create("tokenCache");
+  suite_add_tcase(ts_tokenCache, test_case_account_cacheToken());
+  suite_add_tcase(ts_tokenCache, test_case_account_dropToken());
+  suite_add_tcase(ts_tokenCache, test_case_account_trimTokenCache());
+  suite_add_tcase(ts_tokenCache, test_case_tokenIndex());
+  return ts_tokenCache;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_TOKENCACHE_SUITE_H
+#define TEST_ACCOUNT_TOKENCACHE_SUITE_H
+
+#include <check.h>
+
+Suite* test_suite_tokenCache();
+
+#endif  // TEST_ACCOUNT_TOKENCACHE_SUITE_H
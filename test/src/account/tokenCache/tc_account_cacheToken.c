@@ -0,0 +1,57 @@
+#include "tc_account_cacheToken.h"
+
+#include "account/tokenCache.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+START_TEST(test_findAfterCache) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_cacheToken(&account, "storage.read openid", NULL,
+                     oidc_strcopy("token"), exp);
+  struct token* t = account_findCachedToken(&account, "openid storage.read",
+                                            NULL);
+  ck_assert_ptr_ne(t, NULL);
+  ck_assert_str_eq(t->access_token, "token");
+  ck_assert_uint_eq(t->token_expires_at, exp);
+  ck_assert_ptr_eq(account_findCachedToken(&account, "openid", NULL), NULL);
+  account_clearTokenCache(&account);
+}
+END_TEST
+
+START_TEST(test_replace) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_cacheToken(&account, "openid", "aud", oidc_strcopy("old"), exp);
+  account_cacheToken(&account, "openid", "aud", oidc_strcopy("new"), exp + 1);
+  ck_assert_uint_eq(account.token_cache->len, 1);
+  struct token* t = account_findCachedToken(&account, "openid", "aud");
+  ck_assert_str_eq(t->access_token, "new");
+  ck_assert_uint_eq(account_getTokenExpiresAtFor(&account, "openid", "aud"),
+                    exp + 1);
+  account_clearTokenCache(&account);
+}
+END_TEST
+
+START_TEST(test_limit) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  for (int i = 0; i < TOKEN_CACHE_MAX_ENTRIES + 4; i++) {
+    char* scope = oidc_sprintf("scope%d", i);
+    account_cacheToken(&account, scope, NULL, oidc_strcopy("token"), exp + i);
+    secFree(scope);
+  }
+  ck_assert_uint_eq(account.token_cache->len, TOKEN_CACHE_MAX_ENTRIES);
+  ck_assert_ptr_eq(account_findCachedToken(&account, "scope0", NULL), NULL);
+  account_clearTokenCache(&account);
+}
+END_TEST
+
+TCase* test_case_account_cacheToken() {
+  TCase* tc = tcase_create("account_cacheToken");
+  tcase_add_test(tc, test_findAfterCache);
+  tcase_add_test(tc, test_replace);
+  tcase_add_test(tc, test_limit);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_TOKENCACHE_ACCOUNT_CACHETOKEN_H
+#define TEST_ACCOUNT_TOKENCACHE_ACCOUNT_CACHETOKEN_H
+
+#include <check.h>
+
+TCase* test_case_account_cacheToken();
+
+#endif  // TEST_ACCOUNT_TOKENCACHE_ACCOUNT_CACHETOKEN_H
@@ -0,0 +1,39 @@
+#include "tc_account_dropToken.h"
+
+#include "account/setandget.h"
+#include "account/tokenCache.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+START_TEST(test_default) {
+  struct oidc_account account = {};
+  account_setAccessToken(&account, oidc_strcopy("default"));
+  account_setTokenExpiresAt(&account, time(NULL) + 300);
+  ck_assert_int_eq(account_dropToken(&account, NULL, NULL), 1);
+  ck_assert_ptr_eq(account_getAccessToken(&account), NULL);
+  ck_assert_uint_eq(account_getTokenExpiresAt(&account), 0);
+  ck_assert_int_eq(account_dropToken(&account, NULL, NULL), 0);
+}
+END_TEST
+
+START_TEST(test_cached) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_cacheToken(&account, "openid", NULL, oidc_strcopy("a"), exp);
+  account_cacheToken(&account, "openid", "aud", oidc_strcopy("b"), exp);
+  ck_assert_int_eq(account_dropToken(&account, "openid", "aud"), 1);
+  ck_assert_ptr_eq(account_findCachedToken(&account, "openid", "aud"), NULL);
+  ck_assert_ptr_ne(account_findCachedToken(&account, "openid", NULL), NULL);
+  ck_assert_int_eq(account_dropToken(&account, "openid", "aud"), 0);
+  ck_assert_int_eq(account_dropToken(&account, "unknown", NULL), 0);
+  account_clearTokenCache(&account);
+}
+END_TEST
+
+TCase* test_case_account_dropToken() {
+  TCase* tc = tcase_create("account_dropToken");
+  tcase_add_test(tc, test_default);
+  tcase_add_test(tc, test_cached);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_TOKENCACHE_ACCOUNT_DROPTOKEN_H
+#define TEST_ACCOUNT_TOKENCACHE_ACCOUNT_DROPTOKEN_H
+
+#include <check.h>
+
+TCase* test_case_account_dropToken();
+
+#endif  // TEST_ACCOUNT_TOKENCACHE_ACCOUNT_DROPTOKEN_H
@@ -0,0 +1,42 @@
+#include "tc_account_trimTokenCache.h"
+
+#include "account/tokenCache.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+START_TEST(test_expiredOnly) {
+  struct oidc_account account = {};
+  unsigned long       now     = time(NULL);
+  account_cacheToken(&account, "openid", NULL, oidc_strcopy("valid"),
+                     now + 300);
+  account_cacheToken(&account, "storage.read", NULL, oidc_strcopy("expired"),
+                     now - 1);
+  ck_assert_uint_eq(account_trimTokenCache(&account, 1), 1);
+  ck_assert_uint_eq(account.token_cache->len, 1);
+  ck_assert_ptr_ne(account_findCachedToken(&account, "openid", NULL), NULL);
+  ck_assert_ptr_eq(account_findCachedToken(&account, "storage.read", NULL),
+                   NULL);
+  account_clearTokenCache(&account);
+}
+END_TEST
+
+START_TEST(test_all) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_cacheToken(&account, "openid", NULL, oidc_strcopy("a"), exp);
+  account_cacheToken(&account, "openid", "aud", oidc_strcopy("b"), exp);
+  account_cacheIdToken(&account, "openid", oidc_strcopy("id"), exp);
+  ck_assert_uint_eq(account_trimTokenCache(&account, 0), 3);
+  ck_assert_ptr_eq(account.token_cache, NULL);
+  ck_assert_ptr_eq(account.id_token_cache, NULL);
+  ck_assert_uint_eq(account_trimTokenCache(&account, 0), 0);
+}
+END_TEST
+
+TCase* test_case_account_trimTokenCache() {
+  TCase* tc = tcase_create("account_trimTokenCache");
+  tcase_add_test(tc, test_expiredOnly);
+  tcase_add_test(tc, test_all);
+  return tc;
+}
@@ -0,0 +1,63 @@
+#include "tc_tokenIndex.h"
+
+#include "account/setandget.h"
+#include "account/tokenCache.h"
+#include "account/tokenIndex.h"
+#include "utils/stringUtils.h"
+
+#include <time.h>
+
+START_TEST(test_defaultToken) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_setAccessToken(&account, oidc_strcopy("token"));
+  account_setTokenExpiresAt(&account, exp);
+  struct token* t = tokenIndex_find(&account, TOKEN_INDEX_DEFAULT_KEY);
+  ck_assert_ptr_eq(t, &account.token);
+  const struct tokenIndex* idx = tokenIndex_get();
+  ck_assert_uint_eq(idx->len, 1);
+  ck_assert_uint_eq(idx->expires_at[0], exp);
+  account_setAccessToken(&account, NULL);
+  ck_assert_ptr_eq(tokenIndex_find(&account, TOKEN_INDEX_DEFAULT_KEY), NULL);
+  ck_assert_uint_eq(tokenIndex_get()->len, 0);
+}
+END_TEST
+
+START_TEST(test_cachedTokens) {
+  struct oidc_account account = {};
+  unsigned long       exp     = time(NULL) + 300;
+  account_cacheToken(&account, "openid", NULL, oidc_strcopy("a"), exp);
+  account_cacheToken(&account, "openid", "aud", oidc_strcopy("b"), exp + 1);
+  account_cacheIdToken(&account, "openid", oidc_strcopy("id"), exp);
+  ck_assert_uint_eq(tokenIndex_get()->len, 2);
+  ck_assert_str_eq(account_findCachedToken(&account, "openid", "aud")
+                       ->access_token,
+                   "b");
+  account_clearTokenCache(&account);
+  ck_assert_uint_eq(tokenIndex_get()->len, 0);
+}
+END_TEST
+
+START_TEST(test_accountsAreSeparate) {
+  struct oidc_account a   = {};
+  struct oidc_account b   = {};
+  unsigned long       exp = time(NULL) + 300;
+  account_cacheToken(&a, "openid", NULL, oidc_strcopy("a"), exp);
+  account_cacheToken(&b, "profile", NULL, oidc_strcopy("b"), exp);
+  ck_assert_ptr_eq(account_findCachedToken(&b, "openid", NULL), NULL);
+  ck_assert_str_eq(account_findCachedToken(&b, "profile", NULL)->access_token,
+                   "b");
+  account_clearTokenCache(&a);
+  ck_assert_str_eq(account_findCachedToken(&b, "profile", NULL)->access_token,
+                   "b");
+  account_clearTokenCache(&b);
+}
+END_TEST
+
+TCase* test_case_tokenIndex() {
+  TCase* tc = tcase_create("tokenIndex");
+  tcase_add_test(tc, test_defaultToken);
+  tcase_add_test(tc, test_cachedTokens);
+  tcase_add_test(tc, test_accountsAreSeparate);
+  return tc;
+}
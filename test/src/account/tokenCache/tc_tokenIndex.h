@@ -0,0 +1,8 @@
+#ifndef TEST_ACCOUNT_TOKENCACHE_TOKENINDEX_H
+#define TEST_ACCOUNT_TOKENCACHE_TOKENINDEX_H
+
+#include <check.h>
+
+TCase* test_case_tokenIndex();
+
+#endif  // TEST_ACCOUNT_TOKENCACHE_TOKENINDEX_H
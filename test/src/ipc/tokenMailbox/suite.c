@@ -0,0 +1,10 @@
+#include "suite.h"
+#include "tc_tokenMailbox_open.h"
+#include "tc_tokenMailbox_read.h"
+
+Suite* test_suite_tokenMailbox() {
+  Suite* ts_tokenMailbox = suite_create("tokenMailbox");
+  suite_add_tcase(ts_tokenMailbox, test_case_tokenMailbox_read());
+  suite_add_tcase(ts_tokenMailbox, test_case_tokenMailbox_open());
+  return ts_tokenMailbox;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_IPC_TOKENMAILBOX_SUITE_H
+#define TEST_IPC_TOKENMAILBOX_SUITE_H
+
+#include <check.h>
+
+Suite* test_suite_tokenMailbox();
+
+#endif  // TEST_IPC_TOKENMAILBOX_SUITE_H
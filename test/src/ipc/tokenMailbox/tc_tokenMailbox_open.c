@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tc_tokenMailbox_open.h"
+
+#include "ipc/tokenMailbox.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char* _name(const char* shortname) {
+  char* path = oidc_sprintf("/tmp/oidc-agent-test-%d", (int)getpid());
+  char* name = tokenMailbox_name(path, shortname);
+  secFree(path);
+  return name;
+}
+
+START_TEST(test_missing) {
+  char* name = _name("missing");
+  shm_unlink(name);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid()), NULL);
+  secFree(name);
+}
+END_TEST
+
+START_TEST(test_owner) {
+  char*                name    = _name("owner");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid() + 1), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EMAILBOX);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+  tokenMailbox_close(reader);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+START_TEST(test_mode) {
+  char*                name    = _name("mode");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  int fd = shm_open(name, O_RDWR, 0);
+  ck_assert_int_ge(fd, 0);
+  // a mailbox that others could write must not be trusted
+  ck_assert_int_eq(fchmod(fd, 0620), 0);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid()), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EMAILBOX);
+  ck_assert_int_eq(fchmod(fd, 0602), 0);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid()), NULL);
+  ck_assert_int_eq(fchmod(fd, 0640), 0);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+  tokenMailbox_close(reader);
+  close(fd);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+START_TEST(test_foreignObject) {
+  char* name = _name("foreignObject");
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  ck_assert_int_ge(fd, 0);
+  // the right size, but not created by the agent
+  ck_assert_int_eq(ftruncate(fd, TOKEN_MAILBOX_SIZE), 0);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid()), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EMAILBOX);
+  // the wrong size
+  ck_assert_int_eq(ftruncate(fd, TOKEN_MAILBOX_SIZE / 2), 0);
+  ck_assert_ptr_eq(tokenMailbox_open(name, getuid()), NULL);
+  close(fd);
+  shm_unlink(name);
+  secFree(name);
+}
+END_TEST
+
+TCase* test_case_tokenMailbox_open() {
+  TCase* tc = tcase_create("tokenMailbox_open");
+  tcase_add_test(tc, test_missing);
+  tcase_add_test(tc, test_owner);
+  tcase_add_test(tc, test_mode);
+  tcase_add_test(tc, test_foreignObject);
+  return tc;
+}
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tc_tokenMailbox_read.h"
+
+#include "ipc/tokenMailbox.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+static char* _name(const char* shortname) {
+  char* path = oidc_sprintf("/tmp/oidc-agent-test-%d", (int)getpid());
+  char* name = tokenMailbox_name(path, shortname);
+  secFree(path);
+  return name;
+}
+
+START_TEST(test_publishRead) {
+  char*                name    = _name("publishRead");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+
+  char*         token  = NULL;
+  char*         issuer = NULL;
+  unsigned long exp    = 0;
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_EMAILBOX);
+
+  unsigned long expires_at = time(NULL) + 300;
+  tokenMailbox_publish(mailbox, "access_token", "https://issuer.example/",
+                       expires_at);
+  ck_assert_int_eq(tokenMailbox_read(reader, 60, &token, &issuer, &exp),
+                   OIDC_SUCCESS);
+  ck_assert_str_eq(token, "access_token");
+  ck_assert_str_eq(issuer, "https://issuer.example/");
+  ck_assert_uint_eq(exp, expires_at);
+  secFree(token);
+  secFree(issuer);
+
+  // not valid for long enough
+  ck_assert_int_eq(tokenMailbox_read(reader, 600, &token, &issuer, &exp),
+                   OIDC_EMAILBOX);
+
+  tokenMailbox_publish(mailbox, NULL, NULL, 0);
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_EMAILBOX);
+
+  tokenMailbox_close(reader);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+START_TEST(test_oversize) {
+  char*                name    = _name("oversize");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+
+  char*         token      = NULL;
+  char*         issuer     = NULL;
+  unsigned long exp        = 0;
+  unsigned long expires_at = time(NULL) + 300;
+  char*         big        = secAlloc(TOKEN_MAILBOX_DATA_SIZE + 1);
+  memset(big, 'x', TOKEN_MAILBOX_DATA_SIZE - 1);
+  tokenMailbox_publish(mailbox, big, "i", expires_at);
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_SUCCESS);
+  ck_assert_uint_eq(strlen(token), TOKEN_MAILBOX_DATA_SIZE - 1);
+  ck_assert_str_eq(issuer, "i");
+  secFree(token);
+  secFree(issuer);
+
+  // one byte too much: the mailbox is emptied instead of truncating the token
+  big[TOKEN_MAILBOX_DATA_SIZE - 1] = 'x';
+  tokenMailbox_publish(mailbox, big, "i", expires_at);
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_EMAILBOX);
+  ck_assert_uint_eq(mailbox->token_len, 0);
+
+  secFree(big);
+  tokenMailbox_close(reader);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+START_TEST(test_writeInProgress) {
+  char*                name    = _name("writeInProgress");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+  tokenMailbox_publish(mailbox, "token", "issuer", time(NULL) + 300);
+
+  char*         token  = NULL;
+  char*         issuer = NULL;
+  unsigned long exp    = 0;
+  // a writer that never finishes: the reader gives up instead of copying
+  mailbox->seq++;
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_EMAILBOX);
+  ck_assert_ptr_eq(token, NULL);
+  mailbox->seq++;
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_SUCCESS);
+  ck_assert_str_eq(token, "token");
+  secFree(token);
+  secFree(issuer);
+
+  tokenMailbox_close(reader);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+#define TORN_TOKEN_LEN_A 100
+#define TORN_TOKEN_LEN_B 3000
+
+static int writerDone;
+
+static void* _publishAlternating(void* arg) {
+  struct tokenMailbox* mailbox = arg;
+  char*                a       = secAlloc(TORN_TOKEN_LEN_A + 1);
+  char*                b       = secAlloc(TORN_TOKEN_LEN_B + 1);
+  memset(a, 'a', TORN_TOKEN_LEN_A);
+  memset(b, 'b', TORN_TOKEN_LEN_B);
+  for (int i = 0; i < 20000; i++) {
+    tokenMailbox_publish(mailbox, i % 2 ? b : a, i % 2 ? "B" : "A",
+                         time(NULL) + 300);
+  }
+  __atomic_store_n(&writerDone, 1, __ATOMIC_RELEASE);
+  secFree(a);
+  secFree(b);
+  return NULL;
+}
+
+START_TEST(test_tornRead) {
+  char*                name    = _name("tornRead");
+  struct tokenMailbox* mailbox = tokenMailbox_create(name, -1);
+  ck_assert_ptr_ne(mailbox, NULL);
+  const struct tokenMailbox* reader = tokenMailbox_open(name, getuid());
+  ck_assert_ptr_ne(reader, NULL);
+  tokenMailbox_publish(mailbox, "a", "A", time(NULL) + 300);
+
+  writerDone = 0;
+  pthread_t writer;
+  ck_assert_int_eq(
+      pthread_create(&writer, NULL, _publishAlternating, mailbox), 0);
+  while (!__atomic_load_n(&writerDone, __ATOMIC_ACQUIRE)) {
+    char*         token  = NULL;
+    char*         issuer = NULL;
+    unsigned long exp    = 0;
+    if (tokenMailbox_read(reader, 0, &token, &issuer, &exp) != OIDC_SUCCESS) {
+      continue;  // the writer was too busy; that is allowed, mixing is not
+    }
+    // every copy is one of the published tokens with its own issuer
+    size_t len = strlen(token);
+    ck_assert(len == 1 || len == TORN_TOKEN_LEN_A ||
+              len == TORN_TOKEN_LEN_B);
+    ck_assert(len == 1 || (len == TORN_TOKEN_LEN_A) == (token[0] == 'a'));
+    for (size_t i = 1; i < len; i++) { ck_assert_int_eq(token[i], token[0]); }
+    ck_assert_int_eq(issuer[0], token[0] - 'a' + 'A');
+    ck_assert_int_eq(issuer[1], 0);
+    secFree(token);
+    secFree(issuer);
+  }
+  pthread_join(writer, NULL);
+  char*         token  = NULL;
+  char*         issuer = NULL;
+  unsigned long exp    = 0;
+  ck_assert_int_eq(tokenMailbox_read(reader, 0, &token, &issuer, &exp),
+                   OIDC_SUCCESS);
+  ck_assert_uint_eq(strlen(token), TORN_TOKEN_LEN_B);
+  ck_assert_str_eq(issuer, "B");
+  secFree(token);
+  secFree(issuer);
+
+  tokenMailbox_close(reader);
+  tokenMailbox_destroy(mailbox, name);
+  secFree(name);
+}
+END_TEST
+
+TCase* test_case_tokenMailbox_read() {
+  TCase* tc = tcase_create("tokenMailbox_read");
+  tcase_add_test(tc, test_publishRead);
+  tcase_add_test(tc, test_oversize);
+  tcase_add_test(tc, test_writeInProgress);
+  tcase_add_test(tc, test_tornRead);
+  return tc;
+}
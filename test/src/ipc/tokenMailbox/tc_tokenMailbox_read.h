@@ -0,0 +1,8 @@
+#ifndef TEST_IPC_TOKENMAILBOX_TOKENMAILBOX_READ_H
+#define TEST_IPC_TOKENMAILBOX_TOKENMAILBOX_READ_H
+
+#include <check.h>
+
+TCase* test_case_tokenMailbox_read();
+
+#endif  // TEST_IPC_TOKENMAILBOX_TOKENMAILBOX_READ_H
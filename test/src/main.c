@@ -1,10 +1,21 @@
 #include "test/src/account/account/suite.h"
+#include "test/src/account/scopeSet/suite.h"
+#include "test/src/account/tokenCache/suite.h"
+#include "test/src/ipc/tokenMailbox/suite.h"
 #include "test/src/utils/crypt/crypt/suite.h"
 #include "test/src/utils/crypt/memoryCrypt/suite.h"
+#include "test/src/utils/db/db_deathHeap/suite.h"
+#include "test/src/utils/db/db_index/suite.h"
 #include "test/src/utils/json/suite.h"
+#include "test/src/utils/jwt/suite.h"
+#include "test/src/utils/memory/suite.h"
+#include "test/src/utils/memoryArena/suite.h"
+#include "test/src/utils/negativeCache/suite.h"
 #include "test/src/utils/portUtils/suite.h"
 #include "test/src/utils/stringUtils/suite.h"
+#include "test/src/utils/timerWheel/suite.h"
 #include "test/src/utils/uriUtils/suite.h"
+#include "test/src/utils/vector/suite.h"
 
 #include <check.h>
 #include <stdlib.h>
@@ -23,11 +34,22 @@ int main() {
   setlogmask(LOG_UPTO(LOG_ERR));
   int number_failed = 0;
   number_failed |= runSuite(test_suite_json());
+  number_failed |= runSuite(test_suite_jwt());
+  number_failed |= runSuite(test_suite_memory());
+  number_failed |= runSuite(test_suite_memoryArena());
   number_failed |= runSuite(test_suite_portUtils());
   number_failed |= runSuite(test_suite_stringUtils());
   number_failed |= runSuite(test_suite_memoryCrypt());
   number_failed |= runSuite(test_suite_crypt());
   number_failed |= runSuite(test_suite_account());
+  number_failed |= runSuite(test_suite_scopeSet());
+  number_failed |= runSuite(test_suite_tokenCache());
   number_failed |= runSuite(test_suite_uriUtils());
+  number_failed |= runSuite(test_suite_dbIndex());
+  number_failed |= runSuite(test_suite_dbDeathHeap());
+  number_failed |= runSuite(test_suite_vector());
+  number_failed |= runSuite(test_suite_timerWheel());
+  number_failed |= runSuite(test_suite_negativeCache());
+  number_failed |= runSuite(test_suite_tokenMailbox());
   return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
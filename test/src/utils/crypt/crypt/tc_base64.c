@@ -0,0 +1,122 @@
+#include "tc_base64.h"
+
+#include "utils/crypt/base64.h"
+
+#include <sodium.h>
+#include <string.h>
+
+#define TEST_BASE64_MAX 300
+
+static const int variants[] = {sodium_base64_VARIANT_ORIGINAL,
+                               sodium_base64_VARIANT_ORIGINAL_NO_PADDING,
+                               sodium_base64_VARIANT_URLSAFE,
+                               sodium_base64_VARIANT_URLSAFE_NO_PADDING};
+
+static void _encode(char* b64, size_t b64_maxlen, const unsigned char* bin,
+                    size_t bin_len, int variant, unsigned char scalar) {
+  base64_useScalar(scalar);
+  base64_encode(b64, b64_maxlen, bin, bin_len, variant);
+  base64_useScalar(0);
+}
+
+static int _decode(unsigned char* bin, size_t bin_maxlen, const char* b64,
+                   size_t b64_len, size_t* bin_len, int variant,
+                   unsigned char scalar) {
+  base64_useScalar(scalar);
+  int ret = base64_decode(bin, bin_maxlen, b64, b64_len, bin_len, NULL,
+                          variant);
+  base64_useScalar(0);
+  return ret;
+}
+
+START_TEST(test_encode) {
+  unsigned char bin[TEST_BASE64_MAX];
+  char          simd[2 * TEST_BASE64_MAX];
+  char          scalar[2 * TEST_BASE64_MAX];
+  randombytes_buf(bin, sizeof(bin));
+  for (size_t v = 0; v < sizeof(variants) / sizeof(*variants); v++) {
+    for (size_t len = 0; len <= TEST_BASE64_MAX; len++) {
+      size_t b64_len = sodium_base64_ENCODED_LEN(len, variants[v]);
+      _encode(simd, b64_len, bin, len, variants[v], 0);
+      _encode(scalar, b64_len, bin, len, variants[v], 1);
+      ck_assert_str_eq(simd, scalar);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_decode) {
+  unsigned char bin[TEST_BASE64_MAX];
+  unsigned char simd[TEST_BASE64_MAX];
+  unsigned char scalar[TEST_BASE64_MAX];
+  char          b64[2 * TEST_BASE64_MAX];
+  randombytes_buf(bin, sizeof(bin));
+  for (size_t v = 0; v < sizeof(variants) / sizeof(*variants); v++) {
+    for (size_t len = 0; len <= TEST_BASE64_MAX; len++) {
+      base64_encode(b64, sodium_base64_ENCODED_LEN(len, variants[v]), bin, len,
+                    variants[v]);
+      size_t simd_len   = 0;
+      size_t scalar_len = 0;
+      ck_assert_int_eq(_decode(simd, sizeof(simd), b64, strlen(b64), &simd_len,
+                               variants[v], 0),
+                       0);
+      ck_assert_int_eq(_decode(scalar, sizeof(scalar), b64, strlen(b64),
+                               &scalar_len, variants[v], 1),
+                       0);
+      ck_assert_uint_eq(simd_len, len);
+      ck_assert_uint_eq(scalar_len, len);
+      ck_assert_int_eq(memcmp(simd, bin, len), 0);
+      ck_assert_int_eq(memcmp(scalar, bin, len), 0);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_decodeInvalid) {
+  unsigned char bin[TEST_BASE64_MAX];
+  unsigned char out[TEST_BASE64_MAX];
+  char          b64[2 * TEST_BASE64_MAX];
+  randombytes_buf(bin, sizeof(bin));
+  base64_encode(b64, sizeof(b64), bin, sizeof(bin),
+                sodium_base64_VARIANT_ORIGINAL);
+  size_t b64_len = strlen(b64);
+  for (size_t pos = 0; pos < b64_len; pos += 7) {
+    const char saved = b64[pos];
+    b64[pos]         = pos % 2 ? '-' : '\x80';
+    size_t simd_len   = 1;
+    size_t scalar_len = 1;
+    int    simd       = _decode(out, sizeof(out), b64, b64_len, &simd_len,
+                                sodium_base64_VARIANT_ORIGINAL, 0);
+    int    scalar     = _decode(out, sizeof(out), b64, b64_len, &scalar_len,
+                                sodium_base64_VARIANT_ORIGINAL, 1);
+    ck_assert_int_eq(simd, scalar);
+    ck_assert_int_ne(simd, 0);
+    ck_assert_uint_eq(simd_len, scalar_len);
+    b64[pos] = saved;
+  }
+}
+END_TEST
+
+START_TEST(test_decodeTooSmall) {
+  unsigned char bin[TEST_BASE64_MAX];
+  unsigned char out[TEST_BASE64_MAX];
+  char          b64[2 * TEST_BASE64_MAX];
+  randombytes_buf(bin, sizeof(bin));
+  base64_encode(b64, sizeof(b64), bin, sizeof(bin),
+                sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+  for (size_t bin_maxlen = 0; bin_maxlen < sizeof(bin); bin_maxlen += 5) {
+    ck_assert_int_ne(_decode(out, bin_maxlen, b64, strlen(b64), NULL,
+                             sodium_base64_VARIANT_URLSAFE_NO_PADDING, 0),
+                     0);
+  }
+}
+END_TEST
+
+TCase* test_case_base64() {
+  TCase* tc = tcase_create("base64");
+  tcase_add_test(tc, test_encode);
+  tcase_add_test(tc, test_decode);
+  tcase_add_test(tc, test_decodeInvalid);
+  tcase_add_test(tc, test_decodeTooSmall);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_CRYPT_CRYPT_BASE64_H
+#define TEST_UTILS_CRYPT_CRYPT_BASE64_H
+
+#include <check.h>
+
+TCase* test_case_base64();
+
+#endif  // TEST_UTILS_CRYPT_CRYPT_BASE64_H
@@ -0,0 +1,87 @@
+#include "tc_binaryCrypt.h"
+
+#include "utils/crypt/binaryCrypt.h"
+#include "utils/crypt/crypt.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#include <string.h>
+
+static struct cryptParameter _fastParameters() {
+  struct cryptParameter params = newCryptParameters();
+  params.hash_ops_limit        = 1;
+  params.hash_mem_limit        = 8 * 1024 * 1024;
+  return params;
+}
+
+START_TEST(test_roundtrip) {
+  size_t         len = 0;
+  unsigned char* data =
+      binaryCrypt_encrypt("test", "password", _fastParameters(), &len);
+  ck_assert_ptr_ne(data, NULL);
+  ck_assert(binaryCrypt_isBinary(data, len));
+  char* plain = binaryCrypt_decryptInPlace(data, len, "password");
+  ck_assert_ptr_eq(plain, data);
+  ck_assert_str_eq(plain, "test");
+  secFree(data);
+}
+END_TEST
+
+START_TEST(test_wrongPassword) {
+  size_t         len = 0;
+  unsigned char* data =
+      binaryCrypt_encrypt("test", "password", _fastParameters(), &len);
+  ck_assert_ptr_ne(data, NULL);
+  ck_assert_ptr_eq(binaryCrypt_decryptInPlace(data, len, "wrong"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EPASS);
+  secFree(data);
+}
+END_TEST
+
+START_TEST(test_tampered) {
+  size_t         len = 0;
+  unsigned char* data =
+      binaryCrypt_encrypt("test", "password", _fastParameters(), &len);
+  ck_assert_ptr_ne(data, NULL);
+  data[len - 1] ^= 1;
+  ck_assert_ptr_eq(binaryCrypt_decryptInPlace(data, len, "password"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EDECRYPT);
+  ck_assert_ptr_eq(binaryCrypt_decryptInPlace(data, len - 1, "password"),
+                   NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECRYPM);
+  secFree(data);
+}
+END_TEST
+
+START_TEST(test_notSealed) {
+  size_t         len = 0;
+  unsigned char* data =
+      binaryCrypt_encrypt("test", "password", _fastParameters(), &len);
+  ck_assert_ptr_ne(data, NULL);
+  ck_assert(!binaryCrypt_isSealed(data, len));
+  size_t new_len = 0;
+  ck_assert_ptr_eq(binaryCrypt_reencryptSealed(data, len, "new", &new_len),
+                   NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ENOSEAL);
+  ck_assert_ptr_eq(binaryCrypt_decryptSealedInPlace(data, len), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ENOSEAL);
+  ck_assert_str_eq(binaryCrypt_decryptInPlace(data, len, "password"), "test");
+  secFree(data);
+}
+END_TEST
+
+START_TEST(test_textFormat) {
+  const char* text = "20\nnonce\nsalt\n24:16:16:32:1:2:67108864:2\n";
+  ck_assert(!binaryCrypt_isBinary((const unsigned char*)text, strlen(text)));
+}
+END_TEST
+
+TCase* test_case_binaryCrypt() {
+  TCase* tc = tcase_create("binaryCrypt");
+  tcase_add_test(tc, test_roundtrip);
+  tcase_add_test(tc, test_wrongPassword);
+  tcase_add_test(tc, test_tampered);
+  tcase_add_test(tc, test_notSealed);
+  tcase_add_test(tc, test_textFormat);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_CRYPT_CRYPT_BINARYCRYPT_H
+#define TEST_UTILS_CRYPT_CRYPT_BINARYCRYPT_H
+
+#include <check.h>
+
+TCase* test_case_binaryCrypt();
+
+#endif  // TEST_UTILS_CRYPT_CRYPT_BINARYCRYPT_H
@@ -4,6 +4,8 @@
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 
+#include <string.h>
+
 START_TEST(test_NULL) {
   char* buffer = "buffer";
   ck_assert_ptr_eq(crypt_encrypt(NULL, buffer), NULL);
@@ -21,9 +23,45 @@ START_TEST(test_encrypt) {
 }
 END_TEST
 
+START_TEST(test_encryptWithParameters) {
+  struct cryptParameter params = newCryptParameters();
+  params.hash_ops_limit        = 1;
+  params.hash_mem_limit        = 8 * 1024 * 1024;
+  char* cipher = crypt_encryptWithParameters("test", "password", params);
+  ck_assert_ptr_ne(cipher, NULL);
+  ck_assert_ptr_ne(strstr(cipher, ":1:8388608:"), NULL);
+  char* plain = crypt_decrypt(cipher, "password");
+  ck_assert_ptr_ne(plain, NULL);
+  ck_assert_str_eq(plain, "test");
+  secFree(plain);
+  secFree(cipher);
+}
+END_TEST
+
+START_TEST(test_encryptWithAead) {
+  for (int aead = CRYPT_AEAD_SECRETBOX; aead <= CRYPT_AEAD_MAX; aead++) {
+    if (!crypt_isAeadAvailable(aead)) {
+      continue;
+    }
+    struct cryptParameter params = newCryptParametersForAead(aead);
+    params.hash_ops_limit        = 1;
+    params.hash_mem_limit        = 8 * 1024 * 1024;
+    char* cipher = crypt_encryptWithParameters("test", "password", params);
+    ck_assert_ptr_ne(cipher, NULL);
+    char* plain = crypt_decrypt(cipher, "password");
+    ck_assert_ptr_ne(plain, NULL);
+    ck_assert_str_eq(plain, "test");
+    secFree(plain);
+    secFree(cipher);
+  }
+}
+END_TEST
+
 TCase* test_case_crypt_encrypt() {
   TCase* tc = tcase_create("crypt_encrypt");
   tcase_add_test(tc, test_NULL);
   tcase_add_test(tc, test_encrypt);
+  tcase_add_test(tc, test_encryptWithParameters);
+  tcase_add_test(tc, test_encryptWithAead);
   return tc;
 }
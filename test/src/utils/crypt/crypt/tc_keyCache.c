@@ -0,0 +1,79 @@
+#include "tc_keyCache.h"
+
+#include "utils/crypt/crypt.h"
+#include "utils/crypt/keyCache.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+// The salt is the third line of an encrypted string
+static char* _salt(const char* cipher) {
+  const char* s = strchr(strchr(cipher, '\n') + 1, '\n') + 1;
+  return oidc_strncopy(s, strchr(s, '\n') - s);
+}
+
+static void _enable() {
+  keyCache_setLifetime((struct lifetimeArg){0, 1});
+}
+
+static void _disable() {
+  keyCache_setLifetime((struct lifetimeArg){0, 0});
+}
+
+START_TEST(test_reuseSalt) {
+  _enable();
+  char* a = crypt_encrypt("first", "password");
+  char* b = crypt_encrypt("second", "password");
+  ck_assert_ptr_ne(a, NULL);
+  ck_assert_ptr_ne(b, NULL);
+  char* salt_a = _salt(a);
+  char* salt_b = _salt(b);
+  ck_assert_str_eq(salt_a, salt_b);
+  ck_assert_str_ne(a, b);
+  char* plain = crypt_decrypt(b, "password");
+  ck_assert_ptr_ne(plain, NULL);
+  ck_assert_str_eq(plain, "second");
+  secFree(plain);
+  secFree(salt_a);
+  secFree(salt_b);
+  secFree(a);
+  secFree(b);
+  _disable();
+}
+END_TEST
+
+START_TEST(test_wrongPassword) {
+  _enable();
+  char* cipher = crypt_encrypt("text", "password");
+  ck_assert_ptr_ne(cipher, NULL);
+  ck_assert_ptr_eq(crypt_decrypt(cipher, "wrong"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EPASS);
+  secFree(cipher);
+  _disable();
+}
+END_TEST
+
+START_TEST(test_disabled) {
+  _disable();
+  char* a      = crypt_encrypt("text", "password");
+  char* b      = crypt_encrypt("text", "password");
+  char* salt_a = _salt(a);
+  char* salt_b = _salt(b);
+  ck_assert_str_ne(salt_a, salt_b);
+  ck_assert_int_eq(keyCache_getMinDeath(), 0);
+  secFree(salt_a);
+  secFree(salt_b);
+  secFree(a);
+  secFree(b);
+}
+END_TEST
+
+TCase* test_case_keyCache() {
+  TCase* tc = tcase_create("keyCache");
+  tcase_add_test(tc, test_reuseSalt);
+  tcase_add_test(tc, test_wrongPassword);
+  tcase_add_test(tc, test_disabled);
+  return tc;
+}
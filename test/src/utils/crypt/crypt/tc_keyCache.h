@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_CRYPT_CRYPT_KEYCACHE_H
+#define TEST_UTILS_CRYPT_CRYPT_KEYCACHE_H
+
+#include <check.h>
+
+TCase* test_case_keyCache();
+
+#endif  // TEST_UTILS_CRYPT_CRYPT_KEYCACHE_H
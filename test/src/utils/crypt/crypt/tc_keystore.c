@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tc_keystore.h"
+
+#include "utils/crypt/crypt.h"
+#include "utils/file_io/keystore.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CONFIG_A "{\"name\":\"a\",\"issuer_url\":\"https://a.example.org/\"}"
+#define CONFIG_B "{\"name\":\"b\",\"issuer_url\":\"https://b.example.org/\"}"
+
+#define PATH_TEMPLATE "/tmp/oidc-agent-test-keystore.XXXXXX"
+
+static void _setup(char* path) {
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  struct keystore* keystore = keystore_create(path, "password");
+  ck_assert_ptr_ne(keystore, NULL);
+  ck_assert_int_eq(keystore_putAccount(keystore, "a", CONFIG_A), OIDC_SUCCESS);
+  ck_assert_int_eq(keystore_putAccount(keystore, "b", CONFIG_B), OIDC_SUCCESS);
+  ck_assert_int_eq(keystore_save(keystore), OIDC_SUCCESS);
+  keystore_close(keystore);
+}
+
+START_TEST(test_roundtrip) {
+  char path[] = PATH_TEMPLATE;
+  _setup(path);
+  struct keystore* keystore = keystore_open(path, "password");
+  ck_assert_ptr_ne(keystore, NULL);
+  list_t* names = keystore_listAccounts(keystore);
+  ck_assert_int_eq(names->len, 2);
+  ck_assert_str_eq(list_at(names, 0)->val, "a");
+  ck_assert_str_eq(list_at(names, 1)->val, "b");
+  secFreeList(names);
+  char* config = keystore_getAccount(keystore, "b");
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_str_eq(config, CONFIG_B);
+  secFree(config);
+  ck_assert_ptr_eq(keystore_getAccount(keystore, "c"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ENOACCOUNT);
+  keystore_close(keystore);
+  unlink(path);
+}
+END_TEST
+
+START_TEST(test_wrongPassword) {
+  char path[] = PATH_TEMPLATE;
+  _setup(path);
+  ck_assert_ptr_eq(keystore_open(path, "wrong"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EPASS);
+  unlink(path);
+}
+END_TEST
+
+START_TEST(test_update) {
+  char path[] = PATH_TEMPLATE;
+  _setup(path);
+  struct keystore* keystore = keystore_open(path, "password");
+  ck_assert_ptr_ne(keystore, NULL);
+  ck_assert_int_eq(keystore_putAccount(keystore, "a", CONFIG_B), OIDC_SUCCESS);
+  ck_assert_int_eq(keystore_save(keystore), OIDC_SUCCESS);
+  keystore_close(keystore);
+  keystore = keystore_open(path, "password");
+  ck_assert_ptr_ne(keystore, NULL);
+  char* config = keystore_getAccount(keystore, "a");
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_str_eq(config, CONFIG_B);
+  secFree(config);
+  keystore_close(keystore);
+  unlink(path);
+}
+END_TEST
+
+TCase* test_case_keystore() {
+  TCase* tc = tcase_create("keystore");
+  tcase_add_test(tc, test_roundtrip);
+  tcase_add_test(tc, test_wrongPassword);
+  tcase_add_test(tc, test_update);
+  return tc;
+}
@@ -4,6 +4,8 @@
 #include "utils/memory.h"
 #include "utils/oidc_error.h"
 
+#include <string.h>
+
 START_TEST(test_NULL) {
   ck_assert_ptr_eq(memoryDecrypt(NULL), NULL);
   ck_assert_int_eq(oidc_errno, OIDC_SUCCESS);
@@ -20,9 +22,35 @@ START_TEST(test_decrypt) {
 }
 END_TEST
 
+START_TEST(test_freshNonce) {
+  const char* text    = "a somewhat longer refresh token value";
+  char*       cipher1 = memoryEncrypt(text);
+  char*       cipher2 = memoryEncrypt(text);
+  ck_assert_int_ne(memcmp(cipher1, cipher2, 64), 0);
+  char* plain1 = memoryDecrypt(cipher1);
+  char* plain2 = memoryDecrypt(cipher2);
+  ck_assert_str_eq(plain1, text);
+  ck_assert_str_eq(plain2, text);
+  secFree(cipher1);
+  secFree(cipher2);
+  secFree(plain1);
+  secFree(plain2);
+}
+END_TEST
+
+START_TEST(test_truncated) {
+  ck_assert_ptr_eq(memoryDecrypt("\x01" "0000"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECRYPM);
+  ck_assert_ptr_eq(memoryDecrypt("not memory encrypted"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_ECRYPM);
+}
+END_TEST
+
 TCase* test_case_memoryDecrypt() {
   TCase* tc = tcase_create("memoryDecrypt");
   tcase_add_test(tc, test_NULL);
   tcase_add_test(tc, test_decrypt);
+  tcase_add_test(tc, test_freshNonce);
+  tcase_add_test(tc, test_truncated);
   return tc;
 }
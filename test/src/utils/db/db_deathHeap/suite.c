@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_deathHeap_getDeathEntry.h"
+
+Suite* test_suite_dbDeathHeap() {
+  Suite* ts_dbDeathHeap = suite_create("dbDeathHeap");
+  suite_add_tcase(ts_dbDeathHeap, test_case_deathHeap_getDeathEntry());
+  return ts_dbDeathHeap;
+}
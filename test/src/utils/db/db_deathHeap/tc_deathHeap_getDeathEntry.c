@@ -0,0 +1,66 @@
+#include "tc_deathHeap_getDeathEntry.h"
+
+#include "utils/db/db_deathHeap.h"
+
+struct entry {
+  time_t death;
+};
+
+static time_t _getDeath(const struct entry* e) { return e->death; }
+
+START_TEST(test_order) {
+  struct db_deathHeap* heap = deathHeap_new((deathFunction)_getDeath);
+  struct entry         entries[100];
+  for (int i = 0; i < 100; i++) {
+    entries[i].death = 1000 + (i * 37) % 100;
+    deathHeap_add(heap, &entries[i]);
+  }
+  for (time_t now = 1000; now < 1100; now++) {
+    ck_assert_int_eq(deathHeap_getMinDeath(heap), now);
+    struct entry* e = deathHeap_getDeathEntry(heap, now);
+    ck_assert_ptr_ne(e, NULL);
+    ck_assert_int_eq(e->death, now);
+    deathHeap_remove(heap, e);
+  }
+  ck_assert_int_eq(deathHeap_getMinDeath(heap), 0);
+  deathHeap_free(heap);
+}
+END_TEST
+
+START_TEST(test_notDead) {
+  struct db_deathHeap* heap = deathHeap_new((deathFunction)_getDeath);
+  struct entry         a    = {2000};
+  struct entry         b    = {0};
+  deathHeap_add(heap, &a);
+  deathHeap_add(heap, &b);
+  ck_assert_int_eq(heap->len, 1);
+  ck_assert_ptr_eq(deathHeap_getDeathEntry(heap, 1999), NULL);
+  ck_assert_ptr_eq(deathHeap_getDeathEntry(heap, 2000), &a);
+  deathHeap_free(heap);
+}
+END_TEST
+
+START_TEST(test_changedDeath) {
+  struct db_deathHeap* heap = deathHeap_new((deathFunction)_getDeath);
+  struct entry         a    = {1000};
+  struct entry         b    = {2000};
+  deathHeap_add(heap, &a);
+  deathHeap_add(heap, &b);
+  a.death = 3000;
+  ck_assert_int_eq(deathHeap_getMinDeath(heap), 2000);
+  b.death = 0;
+  ck_assert_int_eq(deathHeap_getMinDeath(heap), 3000);
+  a.death = 500;
+  deathHeap_update(heap, &a);
+  ck_assert_ptr_eq(deathHeap_getDeathEntry(heap, 500), &a);
+  deathHeap_free(heap);
+}
+END_TEST
+
+TCase* test_case_deathHeap_getDeathEntry() {
+  TCase* tc = tcase_create("deathHeap_getDeathEntry");
+  tcase_add_test(tc, test_order);
+  tcase_add_test(tc, test_notDead);
+  tcase_add_test(tc, test_changedDeath);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_DB_DBDEATHHEAP_DEATHHEAP_GETDEATHENTRY_H
+#define TEST_UTILS_DB_DBDEATHHEAP_DEATHHEAP_GETDEATHENTRY_H
+
+#include <check.h>
+
+TCase* test_case_deathHeap_getDeathEntry();
+
+#endif  // TEST_UTILS_DB_DBDEATHHEAP_DEATHHEAP_GETDEATHENTRY_H
@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_dbIndex_find.h"
+
+Suite* test_suite_dbIndex() {
+  Suite* ts_dbIndex = suite_create("dbIndex");
+  suite_add_tcase(ts_dbIndex, test_case_dbIndex_find());
+  return ts_dbIndex;
+}
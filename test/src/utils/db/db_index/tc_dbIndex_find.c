@@ -0,0 +1,90 @@
+#include "tc_dbIndex_find.h"
+
+#include "utils/db/db_index.h"
+#include "utils/listUtils.h"
+#include "utils/matcher.h"
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+struct entry {
+  char* name;
+  char* url;
+};
+
+static const char* _getName(const struct entry* e) { return e->name; }
+static const char* _getUrl(const struct entry* e) { return e->url; }
+
+START_TEST(test_find) {
+  struct db_index* index =
+      dbIndex_new((indexKeyFunction)_getName, matchStrings);
+  struct entry a = {"a", "https://a.example.com"};
+  struct entry b = {"b", "https://b.example.com"};
+  dbIndex_add(index, &a);
+  dbIndex_add(index, &b);
+  ck_assert_ptr_eq(dbIndex_find(index, "a"), &a);
+  ck_assert_ptr_eq(dbIndex_find(index, "b"), &b);
+  ck_assert_ptr_eq(dbIndex_find(index, "c"), NULL);
+  ck_assert_ptr_eq(dbIndex_find(index, NULL), NULL);
+  dbIndex_free(index);
+}
+END_TEST
+
+START_TEST(test_remove) {
+  struct db_index* index =
+      dbIndex_new((indexKeyFunction)_getName, matchStrings);
+  struct entry a = {"a", NULL};
+  dbIndex_add(index, &a);
+  dbIndex_remove(index, &a);
+  ck_assert_ptr_eq(dbIndex_find(index, "a"), NULL);
+  ck_assert_int_eq(index->len, 0);
+  dbIndex_free(index);
+}
+END_TEST
+
+START_TEST(test_grow) {
+  struct db_index* index =
+      dbIndex_new((indexKeyFunction)_getName, matchStrings);
+  struct entry entries[200];
+  for (int i = 0; i < 200; i++) {
+    entries[i].name = oidc_sprintf("account%d", i);
+    entries[i].url  = NULL;
+    dbIndex_add(index, &entries[i]);
+  }
+  ck_assert_int_gt(index->size, 16);
+  for (int i = 0; i < 200; i++) {
+    ck_assert_ptr_eq(dbIndex_find(index, entries[i].name), &entries[i]);
+  }
+  dbIndex_free(index);
+  for (int i = 0; i < 200; i++) {
+    secFree(entries[i].name);
+  }
+}
+END_TEST
+
+START_TEST(test_findAllUrls) {
+  struct db_index* index = dbIndex_new((indexKeyFunction)_getUrl, matchUrls);
+  struct entry     a     = {"a", "https://example.com/"};
+  struct entry     b     = {"b", "https://example.com"};
+  struct entry     c     = {"c", "https://other.example.com"};
+  dbIndex_add(index, &a);
+  dbIndex_add(index, &b);
+  dbIndex_add(index, &c);
+  list_t* found = dbIndex_findAll(index, "https://example.com");
+  ck_assert_ptr_ne(found, NULL);
+  ck_assert_int_eq(found->len, 2);
+  ck_assert_ptr_eq(list_at(found, 0)->val, &a);
+  ck_assert_ptr_eq(list_at(found, 1)->val, &b);
+  secFreeList(found);
+  ck_assert_ptr_eq(dbIndex_findAll(index, "https://none.example.com"), NULL);
+  dbIndex_free(index);
+}
+END_TEST
+
+TCase* test_case_dbIndex_find() {
+  TCase* tc = tcase_create("dbIndex_find");
+  tcase_add_test(tc, test_find);
+  tcase_add_test(tc, test_remove);
+  tcase_add_test(tc, test_grow);
+  tcase_add_test(tc, test_findAllUrls);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_DB_DBINDEX_DBINDEX_FIND_H
+#define TEST_UTILS_DB_DBINDEX_DBINDEX_FIND_H
+
+#include <check.h>
+
+TCase* test_case_dbIndex_find();
+
+#endif  // TEST_UTILS_DB_DBINDEX_DBINDEX_FIND_H
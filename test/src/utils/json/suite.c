@@ -1,10 +1,14 @@
 #include "suite.h"
+#include "tc_getJSONValuesFromString.h"
 #include "tc_isJSONObject.h"
+#include "tc_jsonStreamFilter.h"
 #include "tc_setJSONValue.h"
 
 Suite* test_suite_json() {
   Suite* ts_json = suite_create("json");
+  suite_add_tcase(ts_json, test_case_getJSONValuesFromString());
   suite_add_tcase(ts_json, test_case_isJSONObject());
+  suite_add_tcase(ts_json, test_case_jsonStreamFilter());
   suite_add_tcase(ts_json, test_case_setJSONValue());
   return ts_json;
 }
@@ -0,0 +1,71 @@
+#include "tc_getJSONValuesFromString.h"
+#include "utils/json.h"
+#include "utils/key_value.h"
+
+START_TEST(test_strings) {
+  const char* json =
+      "{\"request\":\"access_token\", \"account\" : \"test\",\"scope\":\"\"}";
+  INIT_KEY_VALUE("request", "account", "scope", "missing");
+  ck_assert_int_eq(CALL_GETJSONVALUES(json), 4);
+  KEY_VALUE_VARS(request, account, scope, missing);
+  ck_assert_str_eq(_request, "access_token");
+  ck_assert_str_eq(_account, "test");
+  ck_assert_ptr_eq(_scope, NULL);
+  ck_assert_ptr_eq(_missing, NULL);
+  SEC_FREE_KEY_VALUES();
+}
+END_TEST
+
+START_TEST(test_escapedString) {
+  const char* json = "{\"a\":\"x\\\"y\\\\z\\/\\n\\u00e4\\ud83d\\ude00\"}";
+  INIT_KEY_VALUE("a");
+  ck_assert_int_eq(CALL_GETJSONVALUES(json), 1);
+  ck_assert_str_eq(pairs[0].value, "x\"y\\z/\n\xc3\xa4\xf0\x9f\x98\x80");
+  SEC_FREE_KEY_VALUES();
+}
+END_TEST
+
+START_TEST(test_otherTypes) {
+  const char* json =
+      "{\"n\":60,\"f\":1.5e1,\"b\":true,\"z\":null,\"arr\":[1, "
+      "\"x\"],\"obj\":{\"key\":{\"n\":[]}}}";
+  INIT_KEY_VALUE("n", "f", "b", "z", "arr", "obj");
+  ck_assert_int_eq(CALL_GETJSONVALUES(json), 6);
+  KEY_VALUE_VARS(n, f, b, z, arr, obj);
+  ck_assert_str_eq(_n, "60");
+  ck_assert_str_eq(_f, "15");
+  ck_assert_str_eq(_b, "true");
+  ck_assert_str_eq(_z, "null");
+  ck_assert_str_eq(_arr, "[1, \"x\"]");
+  ck_assert_str_eq(_obj, "{\n\t\"key\":\t{\n\t\t\"n\":\t[]\n\t}\n}");
+  SEC_FREE_KEY_VALUES();
+}
+END_TEST
+
+START_TEST(test_nestedKeysAreIgnored) {
+  const char* json = "{\"outer\":{\"key\":\"inner\"},\"key\":\"top\"}";
+  INIT_KEY_VALUE("key");
+  ck_assert_int_eq(CALL_GETJSONVALUES(json), 1);
+  ck_assert_str_eq(pairs[0].value, "top");
+  SEC_FREE_KEY_VALUES();
+}
+END_TEST
+
+START_TEST(test_invalid) {
+  INIT_KEY_VALUE("key");
+  ck_assert_int_lt(CALL_GETJSONVALUES("{\"key\":\"value\""), 0);
+  ck_assert_int_lt(CALL_GETJSONVALUES("{\"key\" \"value\"}"), 0);
+  ck_assert_int_lt(CALL_GETJSONVALUES("[\"key\"]"), 0);
+  ck_assert_ptr_eq(pairs[0].value, NULL);
+}
+END_TEST
+
+TCase* test_case_getJSONValuesFromString() {
+  TCase* tc = tcase_create("getJSONValuesFromString");
+  tcase_add_test(tc, test_strings);
+  tcase_add_test(tc, test_escapedString);
+  tcase_add_test(tc, test_otherTypes);
+  tcase_add_test(tc, test_nestedKeysAreIgnored);
+  tcase_add_test(tc, test_invalid);
+  return tc;
+}
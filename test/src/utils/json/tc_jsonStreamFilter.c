@@ -0,0 +1,75 @@
+#include "tc_jsonStreamFilter.h"
+#include "utils/jsonStreamFilter.h"
+#include "utils/memory.h"
+
+#include <string.h>
+
+static const char* const fields[] = {"token_endpoint", "scopes_supported",
+                                     NULL};
+
+static char* _filterInChunks(const char* json, size_t chunk) {
+  struct jsonStreamFilter f;
+  ck_assert_int_eq(jsonStreamFilter_init(&f, fields), OIDC_SUCCESS);
+  size_t len = strlen(json);
+  for (size_t i = 0; i < len; i += chunk) {
+    size_t n = len - i < chunk ? len - i : chunk;
+    ck_assert_int_eq(jsonStreamFilter_feed(&f, json + i, n), OIDC_SUCCESS);
+  }
+  return jsonStreamFilter_finish(&f);
+}
+
+START_TEST(test_keepsRequestedFields) {
+  const char* json =
+      "{\"issuer\": \"https://example.com\",\n \"token_endpoint\" : "
+      "\"https://example.com/token\", \"claims\": {\"a\": [1, 2]},"
+      "\"scopes_supported\": [\"openid\", \"profile\"]}";
+  for (size_t chunk = 1; chunk <= strlen(json); chunk++) {
+    char* res = _filterInChunks(json, chunk);
+    ck_assert_str_eq(res,
+                     "{\"token_endpoint\":\"https://example.com/token\","
+                     "\"scopes_supported\":[\"openid\",\"profile\"]}");
+    secFree(res);
+  }
+}
+END_TEST
+
+START_TEST(test_keepsWhitespaceAndEscapesInStrings) {
+  char* res = _filterInChunks(
+      "{\"token_endpoint\":\"a \\\"b\\\" } ,c\",\"x\":\"{[\"}", 3);
+  ck_assert_str_eq(res, "{\"token_endpoint\":\"a \\\"b\\\" } ,c\"}");
+  secFree(res);
+}
+END_TEST
+
+START_TEST(test_noRequestedFields) {
+  char* res = _filterInChunks("{\"issuer\":\"https://example.com\"}", 4);
+  ck_assert_str_eq(res, "{}");
+  secFree(res);
+}
+END_TEST
+
+START_TEST(test_noObject) {
+  char* res = _filterInChunks("<html>Bad Gateway</html>", 5);
+  ck_assert_str_eq(res, "<html>Bad Gateway</html>");
+  secFree(res);
+  res = _filterInChunks("", 1);
+  ck_assert_str_eq(res, "");
+  secFree(res);
+}
+END_TEST
+
+START_TEST(test_truncated) {
+  char* res = _filterInChunks("{\"token_endpoint\":\"https://exa", 4);
+  ck_assert_ptr_eq(res, NULL);
+}
+END_TEST
+
+TCase* test_case_jsonStreamFilter() {
+  TCase* tc = tcase_create("jsonStreamFilter");
+  tcase_add_test(tc, test_keepsRequestedFields);
+  tcase_add_test(tc, test_keepsWhitespaceAndEscapesInStrings);
+  tcase_add_test(tc, test_noRequestedFields);
+  tcase_add_test(tc, test_noObject);
+  tcase_add_test(tc, test_truncated);
+  return tc;
+}
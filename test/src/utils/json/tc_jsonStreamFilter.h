@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_JSON_JSONSTREAMFILTER_H
+#define TEST_UTILS_JSON_JSONSTREAMFILTER_H
+
+#include <check.h>
+
+TCase* test_case_jsonStreamFilter();
+
+#endif  // TEST_UTILS_JSON_JSONSTREAMFILTER_H
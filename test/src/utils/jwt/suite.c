@@ -0,0 +1,10 @@
+#include "suite.h"
+#include "tc_jwt_getExpiresAt.h"
+#include "tc_jwt_verify.h"
+
+Suite* test_suite_jwt() {
+  Suite* ts_jwt = suite_create("jwt");
+  suite_add_tcase(ts_jwt, test_case_jwt_getExpiresAt());
+  suite_add_tcase(ts_jwt, test_case_jwt_verify());
+  return ts_jwt;
+}
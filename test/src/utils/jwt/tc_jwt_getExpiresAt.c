@@ -0,0 +1,67 @@
+#include "tc_jwt_getExpiresAt.h"
+
+#include "utils/jwt.h"
+#include "utils/oidc_error.h"
+
+#define JWT_HEADER "eyJhbGciOiJub25lIn0"
+
+START_TEST(test_NULL) {
+  ck_assert_int_eq(jwt_getExpiresAt(NULL), 0);
+  ck_assert_int_eq(oidc_errno, OIDC_EARGNULLFUNC);
+}
+END_TEST
+
+START_TEST(test_opaque) {
+  ck_assert_int_eq(jwt_getExpiresAt("2YotnFZFEjr1zCsicMWpAA"), 0);
+  ck_assert_int_eq(oidc_errno, OIDC_EFMT);
+}
+END_TEST
+
+START_TEST(test_exp) {
+  // {"sub":"a","exp":1700000000}
+  ck_assert_int_eq(
+      jwt_getExpiresAt(JWT_HEADER ".eyJzdWIiOiJhIiwiZXhwIjoxNzAwMDAwMDAwfQ"
+                                  ".sig"),
+      1700000000);
+}
+END_TEST
+
+START_TEST(test_fractionalExp) {
+  // {"sub":"a","exp":1700000000.5}
+  ck_assert_int_eq(
+      jwt_getExpiresAt(JWT_HEADER
+                       ".eyJzdWIiOiJhIiwiZXhwIjoxNzAwMDAwMDAwLjV9.sig"),
+      1700000000);
+}
+END_TEST
+
+START_TEST(test_noExp) {
+  // {"sub":"ab"}
+  ck_assert_int_eq(jwt_getExpiresAt(JWT_HEADER ".eyJzdWIiOiJhYiJ9."), 0);
+}
+END_TEST
+
+START_TEST(test_noObject) {
+  // [1]
+  ck_assert_int_eq(jwt_getExpiresAt(JWT_HEADER ".WzFd.sig"), 0);
+  ck_assert_int_eq(oidc_errno, OIDC_EFMT);
+}
+END_TEST
+
+START_TEST(test_invalidBase64) {
+  ck_assert_int_eq(jwt_getExpiresAt(JWT_HEADER ".e$J9.sig"), 0);
+  ck_assert_int_eq(oidc_errno, OIDC_EFMT);
+}
+END_TEST
+
+TCase* test_case_jwt_getExpiresAt() {
+  TCase* tc = tcase_create("jwt_getExpiresAt");
+  tcase_add_test(tc, test_NULL);
+  tcase_add_test(tc, test_opaque);
+  tcase_add_test(tc, test_exp);
+  tcase_add_test(tc, test_fractionalExp);
+  tcase_add_test(tc, test_noExp);
+  tcase_add_test(tc, test_noObject);
+  tcase_add_test(tc, test_invalidBase64);
+  return tc;
+}
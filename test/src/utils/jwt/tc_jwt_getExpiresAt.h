@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_JWT_GETEXPIRESAT_H
+#define TEST_UTILS_JWT_GETEXPIRESAT_H
+
+#include <check.h>
+
+TCase* test_case_jwt_getExpiresAt();
+
+#endif  // TEST_UTILS_JWT_GETEXPIRESAT_H
@@ -0,0 +1,149 @@
+#include "tc_jwt_verify.h"
+
+#include "utils/jwks.h"
+#include "utils/jwt.h"
+#include "utils/listUtils.h"
+#include "utils/memory.h"
+#include "utils/oidc_error.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+// {"iss":"https://op.example","sub":"a","aud":["svc","other"],"exp":4102444800}
+#define PAYLOAD                                                               \
+  "eyJpc3MiOiJodHRwczovL29wLmV4YW1wbGUiLCJzdWIiOiJhIiwiYXVkIjpbInN2YyIsIm90" \
+  "aGVyIl0sImV4cCI6NDEwMjQ0NDgwMH0"
+
+// {"alg":"RS256","kid":"r1"}
+#define RS256_JWT                                                             \
+  "eyJhbGciOiJSUzI1NiIsImtpZCI6InIxIn0." PAYLOAD                              \
+  ".avqqPBXf6ue14zSzHQ_8sLdV72DCbU26dM3sHjFvh9pobNQpVOA0_-HMNMOzbYPWmE_8lj-"  \
+  "dlWr7XwbQwSDupMcq92hP7n7iRcbU8ARrcTdIk5rMIfqntkC3zh41N4ngXpbwFZldjhTAkAFN" \
+  "zKsUCJgXn2irgA6_-D7x_3dMLVd5ELootYhOOqCtvFxz6VDYKz4tCry_-6iwhcAXGahPh-imm" \
+  "XVQUkcq8yfWNws1I9OcLn7pLo-ypfbIdidXjIcrJu-Hx5rW6RG8sa4pDvwffQWXlZmyh7e1Zy" \
+  "BfsyGBCXrlAoM2OBgJV8mFIlKeZkrFRyyeqk9IZtmWe5j0fM-HuQ"
+
+// {"alg":"RS256"}
+#define RS256_NOKID_JWT                                                       \
+  "eyJhbGciOiJSUzI1NiJ9." PAYLOAD                                             \
+  ".YrJ_zBU6_8Y5hNnoRDDte34egzswXYxgF6ZV05M2RKQn-QjGWWgwcpuNN_eM8-vAIVi-"     \
+  "Zgq0k561LMycwqgnmvS9QAjzGFwBURauOxl0izKxkDkw09NoupBcbyte4V-pR6Tg_GKLmo7X" \
+  "q7310PbuP6e_K--7acMg9coqX6d8YEWCh9cVaMR0gskKLB0dPYRHtLqq2WmVYoOIEp5Khgwi" \
+  "sDODDJynG4ud-9ySJtA-fXOFSe5e5SFS0cxrmtcIM48DPQRxVz_gLkiRYNmEzouuocDPbLOI" \
+  "cVZXieUaxA90jbEDWC1RHTvxkeYTG6goF7W70rHT7apkwK_VAxAGeCuNgA"
+
+// {"alg":"EdDSA","kid":"e1"}
+#define EDDSA_JWT                                                             \
+  "eyJhbGciOiJFZERTQSIsImtpZCI6ImUxIn0." PAYLOAD                              \
+  ".FWK48S83GxWsL3gRWxm66EqVk3mL0aZtmkP4kWaNn_ApLJzrCy_rzVlwUiu-"             \
+  "eHhED8l3RJkUQVaPmydLAk4HAw"
+
+#define RSA_N                                                                 \
+  "tcWdJMZEmwwgtl4M7m78GGFPZj0sYWqvgBF3ND67jgQvJl4boDYtvt75OVWnssWtWnuXPFu8j" \
+  "SEB_jcQQMY5FK3aQoJo1RxOfrRpApsL7LH-Gpqzhjd3Ask49XqexFNJsZHh8Y5NBUHcpW2_f" \
+  "pStkSSnD_xId1Gp5vuN70ZdlUV77J_orgYCiwbgM7jM44VOl9sbjOcofB8HXrsZ80qxv1B5S" \
+  "7ptxfqdQR3pL7rLNq2NczVgpSg8DhyqB-gANXApoS5jn6nux0ZmpMiHdiSVgGo2kbzZFxeLR" \
+  "6zq6VO_CyFVekHM4UMMFNLOc3pDfgtfhu6YokdVUjE8N_7f-QA8dw"
+
+#define RSA_JWK(kid) \
+  "{\"kty\":\"RSA\",\"kid\":\"" kid "\",\"use\":\"sig\",\"n\":\"" RSA_N \
+  "\",\"e\":\"AQAB\"}"
+
+#define ED25519_JWK(kid)                                                 \
+  "{\"kty\":\"OKP\",\"crv\":\"Ed25519\",\"kid\":\"" kid "\",\"x\":\"" \
+  "KZ-_EFRg_ULAj8rK96HN4OrEfZdiPGk5wLj4XJe5ax8\"}"
+
+#define JWKS "{\"keys\":[" RSA_JWK("r1") "," ED25519_JWK("e1") "]}"
+
+static oidc_error_t _verify(const char* jwt, const char* jwks) {
+  list_t*      keys = jwks_parse(jwks);
+  oidc_error_t e    = jwt_verify(jwt, keys);
+  secFreeList(keys);
+  return e;
+}
+
+/**
+ * @brief changes one character of the signature of a JWT
+ */
+static char* _tamperSignature(const char* jwt) {
+  char* tampered = oidc_strcopy(jwt);
+  char* last     = tampered + strlen(tampered) - 4;
+  *last          = *last == 'A' ? 'B' : 'A';
+  return tampered;
+}
+
+START_TEST(test_RS256) {
+  ck_assert_int_eq(_verify(RS256_JWT, JWKS), OIDC_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_RS256NoKid) {
+  ck_assert_int_eq(_verify(RS256_NOKID_JWT, JWKS), OIDC_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_EdDSA) {
+  ck_assert_int_eq(_verify(EDDSA_JWT, JWKS), OIDC_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_tamperedSignature) {
+  char* rs256 = _tamperSignature(RS256_JWT);
+  char* eddsa = _tamperSignature(EDDSA_JWT);
+  ck_assert_int_eq(_verify(rs256, JWKS), OIDC_ESIGNATURE);
+  ck_assert_int_eq(_verify(eddsa, JWKS), OIDC_ESIGNATURE);
+  secFree(rs256);
+  secFree(eddsa);
+}
+END_TEST
+
+START_TEST(test_tamperedPayload) {
+  // {"iss":"https://op.example","sub":"b",...}
+  char* jwt = oidc_strcopy(RS256_JWT);
+  char* sub = strstr(jwt, "LCJzdWIiOiJh") + strlen("LCJzdWIiOiJ");
+  *sub      = 'i';
+  ck_assert_int_eq(_verify(jwt, JWKS), OIDC_ESIGNATURE);
+  secFree(jwt);
+}
+END_TEST
+
+START_TEST(test_rotatedKey) {
+  ck_assert_int_eq(
+      _verify(RS256_JWT, "{\"keys\":[" RSA_JWK("r2") "]}"), OIDC_ENOJWK);
+}
+END_TEST
+
+START_TEST(test_wrongKeyType) {
+  // the key id of the Ed25519 key with an RS256 token
+  ck_assert_int_eq(
+      _verify(RS256_JWT, "{\"keys\":[" ED25519_JWK("r1") "]}"), OIDC_ENOJWK);
+}
+END_TEST
+
+START_TEST(test_algNone) {
+  // {"alg":"none"}
+  ck_assert_int_eq(_verify("eyJhbGciOiJub25lIn0." PAYLOAD ".", JWKS),
+                   OIDC_EERROR);
+}
+END_TEST
+
+START_TEST(test_noKeys) {
+  ck_assert_ptr_eq(jwks_parse("{\"issuer\":\"https://op.example\"}"), NULL);
+  ck_assert_int_eq(oidc_errno, OIDC_EFMT);
+  ck_assert_int_eq(jwt_verify(RS256_JWT, NULL), OIDC_ENOJWK);
+}
+END_TEST
+
+TCase* test_case_jwt_verify() {
+  TCase* tc = tcase_create("jwt_verify");
+  tcase_add_test(tc, test_RS256);
+  tcase_add_test(tc, test_RS256NoKid);
+  tcase_add_test(tc, test_EdDSA);
+  tcase_add_test(tc, test_tamperedSignature);
+  tcase_add_test(tc, test_tamperedPayload);
+  tcase_add_test(tc, test_rotatedKey);
+  tcase_add_test(tc, test_wrongKeyType);
+  tcase_add_test(tc, test_algNone);
+  tcase_add_test(tc, test_noKeys);
+  return tc;
+}
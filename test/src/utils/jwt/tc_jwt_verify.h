@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_JWT_VERIFY_H
+#define TEST_UTILS_JWT_VERIFY_H
+
+#include <check.h>
+
+TCase* test_case_jwt_verify();
+
+#endif  // TEST_UTILS_JWT_VERIFY_H
@@ -0,0 +1,10 @@
+#include "suite.h"
+#include "tc_secMemTokenPool.h"
+#include "tc_secRealloc.h"
+
+Suite* test_suite_memory() {
+  Suite* ts_memory = suite_create("memory");
+  suite_add_tcase(ts_memory, test_case_secRealloc());
+  suite_add_tcase(ts_memory, test_case_secMemTokenPool());
+  return ts_memory;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_MEMORY_SUITE_H
+#define TEST_UTILS_MEMORY_SUITE_H
+
+#include <check.h>
+
+Suite* test_suite_memory();
+
+#endif  // TEST_UTILS_MEMORY_SUITE_H
@@ -0,0 +1,58 @@
+#include "tc_secMemTokenPool.h"
+
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+
+#include <string.h>
+
+START_TEST(test_move) {
+  char* token = oidc_strcopy("eyJhbGciOiJSUzI1NiJ9.payload.signature");
+  ck_assert(!secMemTokenPool_contains(token));
+  token = secMemTokenPool_move(token);
+  ck_assert(secMemTokenPool_contains(token));
+  ck_assert_str_eq(token, "eyJhbGciOiJSUzI1NiJ9.payload.signature");
+  ck_assert_ptr_eq(secMemTokenPool_move(token), token);
+  secFree(token);
+}
+END_TEST
+
+START_TEST(test_reuse) {
+  char* token = secAllocTagged(1000, MEMTAG_TOKEN);
+  ck_assert(secMemTokenPool_contains(token));
+  char* freed = token;
+  secFree(token);
+  token = secAllocTagged(1000, MEMTAG_TOKEN);
+  ck_assert_ptr_eq(token, freed);
+  ck_assert_int_eq(token[999], 0);
+  secFree(token);
+}
+END_TEST
+
+START_TEST(test_bounded) {
+  char*  tokens[512];
+  size_t n = 0;
+  while (n < 512) {
+    tokens[n] = secMemTokenPool_move(secAlloc(3000));
+    if (!secMemTokenPool_contains(tokens[n])) {
+      break;
+    }
+    n++;
+  }
+  ck_assert_uint_lt(n, 512);
+  ck_assert_uint_gt(n, 0);
+  ck_assert_str_eq(tokens[n], "");
+  secFree(tokens[n]);
+  secFree(tokens[n - 1]);
+  tokens[n - 1] = secMemTokenPool_move(secAlloc(3000));
+  ck_assert(secMemTokenPool_contains(tokens[n - 1]));
+  for (size_t i = 0; i < n; i++) { secFree(tokens[i]); }
+}
+END_TEST
+
+TCase* test_case_secMemTokenPool() {
+  TCase* tc = tcase_create("secMemTokenPool");
+  tcase_add_test(tc, test_move);
+  tcase_add_test(tc, test_reuse);
+  tcase_add_test(tc, test_bounded);
+  return tc;
+}
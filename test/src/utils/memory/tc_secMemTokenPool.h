@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_MEMORY_SECMEMTOKENPOOL_H
+#define TEST_UTILS_MEMORY_SECMEMTOKENPOOL_H
+
+#include <check.h>
+
+TCase* test_case_secMemTokenPool();
+
+#endif  // TEST_UTILS_MEMORY_SECMEMTOKENPOOL_H
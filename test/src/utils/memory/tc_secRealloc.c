@@ -0,0 +1,56 @@
+#include "tc_secRealloc.h"
+
+#include "utils/memory.h"
+
+#include <string.h>
+
+START_TEST(test_grow) {
+  char* p = secAlloc(1);
+  p[0]    = 'x';
+  for (size_t i = 2; i <= 100000; i++) {
+    p = secRealloc(p, i);
+    ck_assert_ptr_ne(p, NULL);
+    ck_assert_int_eq(p[i - 1], 0);
+    p[i - 1] = 'x';
+  }
+  for (size_t i = 0; i < 100000; i++) { ck_assert_int_eq(p[i], 'x'); }
+  secFree(p);
+}
+END_TEST
+
+START_TEST(test_shrink) {
+  char* p = secAlloc(5000);
+  memset(p, 'x', 5000);
+  char* s = secRealloc(p, 10);
+  ck_assert_ptr_eq(s, p);
+  ck_assert_int_eq(s[9], 'x');
+  s = secRealloc(s, 20);
+  ck_assert_ptr_eq(s, p);
+  ck_assert_int_eq(s[10], 0);
+  secFree(s);
+}
+END_TEST
+
+START_TEST(test_reserve) {
+  char* p = secReserve(NULL, 10000);
+  ck_assert_ptr_ne(p, NULL);
+  char* s = p;
+  for (size_t i = 1; i <= 10000; i++) {
+    s = secRealloc(s, i);
+    ck_assert_ptr_eq(s, p);
+  }
+  s[0] = 'x';
+  s    = secReserve(s, 20000);
+  ck_assert_int_eq(s[0], 'x');
+  ck_assert_ptr_eq(secRealloc(s, 20000), s);
+  secFree(s);
+}
+END_TEST
+
+TCase* test_case_secRealloc() {
+  TCase* tc = tcase_create("secRealloc");
+  tcase_add_test(tc, test_grow);
+  tcase_add_test(tc, test_shrink);
+  tcase_add_test(tc, test_reserve);
+  return tc;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_MEMORY_SECREALLOC_H
+#define TEST_UTILS_MEMORY_SECREALLOC_H
+
+#include <check.h>
+
+TCase* test_case_secRealloc();
+
+#endif  // TEST_UTILS_MEMORY_SECREALLOC_H
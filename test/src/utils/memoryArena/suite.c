@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_secArena_release.h"
+
+Suite* test_suite_memoryArena() {
+  Suite* ts_memoryArena = suite_create("memoryArena");
+  suite_add_tcase(ts_memoryArena, test_case_secArena_release());
+  return ts_memoryArena;
+}
@@ -0,0 +1,58 @@
+#include "tc_secArena_release.h"
+
+#include "utils/memoryArena.h"
+
+#include <string.h>
+
+START_TEST(test_reuse) {
+  struct secArena*     arena = secArena_new(64);
+  struct secArena_mark mark  = secArena_mark(arena);
+  char*                a     = secArena_strncopy(arena, "secret", 6);
+  ck_assert_str_eq(a, "secret");
+  secArena_release(arena, mark);
+  ck_assert_int_eq(a[0], 0);
+  char* b = secArena_strncopy(arena, "other", 5);
+  ck_assert_ptr_eq(a, b);
+  ck_assert_str_eq(b, "other");
+  secArena_free(arena);
+}
+END_TEST
+
+START_TEST(test_nested) {
+  struct secArena*     arena = secArena_new(64);
+  struct secArena_mark outer = secArena_mark(arena);
+  char*                a     = secArena_strncopy(arena, "outer", 5);
+  struct secArena_mark inner = secArena_mark(arena);
+  // Spans several chunks
+  for (int i = 0; i < 20; i++) {
+    ck_assert_ptr_ne(secArena_alloc(arena, 40), NULL);
+  }
+  char* big = secArena_alloc(arena, 1000);
+  ck_assert_ptr_ne(big, NULL);
+  memset(big, 'x', 1000);
+  secArena_release(arena, inner);
+  ck_assert_str_eq(a, "outer");
+  ck_assert_int_eq(big[0], 0);
+  secArena_release(arena, outer);
+  ck_assert_int_eq(a[0], 0);
+  secArena_free(arena);
+}
+END_TEST
+
+START_TEST(test_alignment) {
+  struct secArena* arena = secArena_new(0);
+  for (size_t i = 1; i < 50; i++) {
+    void* p = secArena_alloc(arena, i);
+    ck_assert_int_eq((size_t)p % 16, 0);
+  }
+  secArena_free(arena);
+}
+END_TEST
+
+TCase* test_case_secArena_release() {
+  TCase* tc = tcase_create("secArena_release");
+  tcase_add_test(tc, test_reuse);
+  tcase_add_test(tc, test_nested);
+  tcase_add_test(tc, test_alignment);
+  return tc;
+}
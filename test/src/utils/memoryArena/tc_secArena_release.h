@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_MEMORYARENA_SECARENA_RELEASE_H
+#define TEST_UTILS_MEMORYARENA_SECARENA_RELEASE_H
+
+#include <check.h>
+
+TCase* test_case_secArena_release();
+
+#endif  // TEST_UTILS_MEMORYARENA_SECARENA_RELEASE_H
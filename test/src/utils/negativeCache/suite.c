@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_negativeCache_contains.h"
+
+Suite* test_suite_negativeCache() {
+  Suite* ts_negativeCache = suite_create("negativeCache");
+  suite_add_tcase(ts_negativeCache, test_case_negativeCache_contains());
+  return ts_negativeCache;
+}
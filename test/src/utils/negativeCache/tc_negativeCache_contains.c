@@ -0,0 +1,50 @@
+#include "tc_negativeCache_contains.h"
+
+#include "defines/settings.h"
+#include "utils/negativeCache.h"
+
+#include <stdio.h>
+
+START_TEST(test_kinds) {
+  negativeCache_clear();
+  negativeCache_add(NEGATIVE_CACHE_ACCOUNT, "unknown");
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, "unknown"),
+                   1);
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ISSUER, "unknown"),
+                   0);
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, "other"), 0);
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, NULL), 0);
+}
+END_TEST
+
+START_TEST(test_clear) {
+  negativeCache_clear();
+  negativeCache_add(NEGATIVE_CACHE_ISSUER, "https://example.com/");
+  negativeCache_clear();
+  ck_assert_int_eq(
+      negativeCache_contains(NEGATIVE_CACHE_ISSUER, "https://example.com/"), 0);
+}
+END_TEST
+
+START_TEST(test_max) {
+  negativeCache_clear();
+  char name[16];
+  for (int i = 0; i <= NEGATIVE_CACHE_MAX; i++) {
+    snprintf(name, sizeof(name), "name%d", i);
+    negativeCache_add(NEGATIVE_CACHE_ACCOUNT, name);
+  }
+  // the oldest entry was dropped
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, "name0"), 0);
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, "name1"), 1);
+  ck_assert_int_eq(negativeCache_contains(NEGATIVE_CACHE_ACCOUNT, name), 1);
+  negativeCache_clear();
+}
+END_TEST
+
+TCase* test_case_negativeCache_contains() {
+  TCase* tc = tcase_create("negativeCache_contains");
+  tcase_add_test(tc, test_kinds);
+  tcase_add_test(tc, test_clear);
+  tcase_add_test(tc, test_max);
+  return tc;
+}
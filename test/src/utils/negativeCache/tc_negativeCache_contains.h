@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_NEGATIVECACHE_NEGATIVECACHE_CONTAINS_H
+#define TEST_UTILS_NEGATIVECACHE_NEGATIVECACHE_CONTAINS_H
+
+#include <check.h>
+
+TCase* test_case_negativeCache_contains();
+
+#endif  // TEST_UTILS_NEGATIVECACHE_NEGATIVECACHE_CONTAINS_H
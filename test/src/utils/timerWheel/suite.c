@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_timerWheel_runDue.h"
+
+Suite* test_suite_timerWheel() {
+  Suite* ts_timerWheel = suite_create("timerWheel");
+  suite_add_tcase(ts_timerWheel, test_case_timerWheel_runDue());
+  return ts_timerWheel;
+}
@@ -0,0 +1,105 @@
+#include "tc_timerWheel_runDue.h"
+
+#include "utils/timerWheel.h"
+
+static time_t now;
+static time_t fired[8];
+
+static void _record(void* arg) { fired[(long)arg] = now; }
+
+static void _rearm(void* arg) {
+  fired[(long)arg] = now;
+  timerWheel_add(now + 10, _record, (void*)((long)arg + 1));
+}
+
+static void _reset() {
+  timerWheel_clear();
+  for (size_t i = 0; i < sizeof(fired) / sizeof(*fired); i++) {
+    fired[i] = 0;
+  }
+}
+
+START_TEST(test_order) {
+  _reset();
+  time_t start = time(NULL);
+  // one timer on each level of the wheel
+  time_t expires[] = {start + 5, start + 100, start + 5000, start + 300000,
+                      start + 30000000};
+  for (long i = 4; i >= 0; i--) {
+    timerWheel_add(expires[i], _record, (void*)i);
+  }
+  ck_assert_int_eq(timerWheel_count(), 5);
+  for (long i = 0; i < 5; i++) {
+    ck_assert_int_eq(timerWheel_getNextTime(), expires[i]);
+    now = expires[i] - 1;
+    timerWheel_runDue(now);
+    ck_assert_int_eq(fired[i], 0);
+    now = expires[i];
+    timerWheel_runDue(now);
+    ck_assert_int_eq(fired[i], expires[i]);
+  }
+  ck_assert_int_eq(timerWheel_count(), 0);
+  ck_assert_int_eq(timerWheel_getNextTime(), 0);
+}
+END_TEST
+
+START_TEST(test_cancel) {
+  _reset();
+  time_t                   start = time(NULL);
+  struct timerWheel_timer* a     = timerWheel_add(start + 3, _record, (void*)0);
+  timerWheel_add(start + 7, _record, (void*)1);
+  timerWheel_cancel(a);
+  ck_assert_int_eq(timerWheel_count(), 1);
+  ck_assert_int_eq(timerWheel_getNextTime(), start + 7);
+  now = start + 10;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[0], 0);
+  ck_assert_int_eq(fired[1], start + 10);
+}
+END_TEST
+
+START_TEST(test_addFromCallback) {
+  _reset();
+  time_t start = time(NULL);
+  timerWheel_add(start - 1, _rearm, (void*)0);  // already due
+  now = start;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[0], start);
+  ck_assert_int_eq(timerWheel_getNextTime(), start + 10);
+  now = start + 10;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[1], start + 10);
+}
+END_TEST
+
+START_TEST(test_shift) {
+  _reset();
+  time_t start = time(NULL);
+  timerWheel_add(start + 5, _record, (void*)0);
+  timerWheel_add(start + 5000, _record, (void*)1);
+  // the wall clock is set one hour ahead
+  timerWheel_shift(3600);
+  ck_assert_int_eq(timerWheel_getNextTime(), start + 3605);
+  now = start + 3604;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[0], 0);
+  now = start + 3605;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[0], start + 3605);
+  // and back again
+  timerWheel_shift(-3600);
+  ck_assert_int_eq(timerWheel_getNextTime(), start + 5000);
+  now = start + 5000;
+  timerWheel_runDue(now);
+  ck_assert_int_eq(fired[1], start + 5000);
+}
+END_TEST
+
+TCase* test_case_timerWheel_runDue() {
+  TCase* tc = tcase_create("timerWheel_runDue");
+  tcase_add_test(tc, test_order);
+  tcase_add_test(tc, test_cancel);
+  tcase_add_test(tc, test_addFromCallback);
+  tcase_add_test(tc, test_shift);
+  return tc;
+}
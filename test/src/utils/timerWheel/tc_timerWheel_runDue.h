@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_TIMERWHEEL_TIMERWHEEL_RUNDUE_H
+#define TEST_UTILS_TIMERWHEEL_TIMERWHEEL_RUNDUE_H
+
+#include <check.h>
+
+TCase* test_case_timerWheel_runDue();
+
+#endif  // TEST_UTILS_TIMERWHEEL_TIMERWHEEL_RUNDUE_H
@@ -0,0 +1,45 @@
+#include "tc_urlencodeInto.h"
+
+#include "utils/uriUtils.h"
+
+#include <string.h>
+
+static void _checkEncoding(const char* src, const char* expected) {
+  char   buf[256] = {0};
+  size_t len      = urlencodedLength(src);
+  ck_assert_uint_eq(len, strlen(expected));
+  char* end = urlencodeInto(buf, src);
+  ck_assert_ptr_eq(end, buf + len);
+  ck_assert_str_eq(buf, expected);
+}
+
+START_TEST(test_unreserved) {
+  _checkEncoding("abcXYZ019-._~", "abcXYZ019-._~");
+}
+END_TEST
+
+START_TEST(test_reserved) {
+  _checkEncoding("openid profile", "openid%20profile");
+  _checkEncoding("http://localhost:4242/?a=b&c",
+                 "http%3A%2F%2Flocalhost%3A4242%2F%3Fa%3Db%26c");
+  _checkEncoding("+%", "%2B%25");
+}
+END_TEST
+
+START_TEST(test_nonAscii) { _checkEncoding("\xc3\xa4", "%C3%A4"); }
+END_TEST
+
+START_TEST(test_empty) {
+  _checkEncoding("", "");
+  ck_assert_uint_eq(urlencodedLength(NULL), 0);
+}
+END_TEST
+
+TCase* test_case_urlencodeInto() {
+  TCase* tc = tcase_create("urlencodeInto");
+  tcase_add_test(tc, test_unreserved);
+  tcase_add_test(tc, test_reserved);
+  tcase_add_test(tc, test_nonAscii);
+  tcase_add_test(tc, test_empty);
+  return tc;
+}
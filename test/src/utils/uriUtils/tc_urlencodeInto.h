@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_URIUTILS_URLENCODEINTO_H
+#define TEST_UTILS_URIUTILS_URLENCODEINTO_H
+
+#include <check.h>
+
+TCase* test_case_urlencodeInto();
+
+#endif  // TEST_UTILS_URIUTILS_URLENCODEINTO_H
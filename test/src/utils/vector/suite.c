@@ -0,0 +1,8 @@
+#include "suite.h"
+#include "tc_vector.h"
+
+Suite* test_suite_vector() {
+  Suite* ts_vector = suite_create("vector");
+  suite_add_tcase(ts_vector, test_case_vector());
+  return ts_vector;
+}
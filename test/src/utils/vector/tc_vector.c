@@ -0,0 +1,59 @@
+#include "tc_vector.h"
+
+#include "utils/memory.h"
+#include "utils/stringUtils.h"
+#include "utils/vector.h"
+
+START_TEST(test_pushAndGrow) {
+  vector_t* v = vector_new();
+  for (size_t i = 0; i < 100; i++) {
+    ck_assert_int_eq(vector_push(v, (void*)(i + 1)), OIDC_SUCCESS);
+  }
+  ck_assert_uint_eq(v->len, 100);
+  for (size_t i = 0; i < 100; i++) {
+    ck_assert_ptr_eq(vector_at(v, i), (void*)(i + 1));
+  }
+  ck_assert_ptr_eq(vector_at(v, 100), NULL);
+  secFreeVector(v);
+}
+END_TEST
+
+START_TEST(test_removeKeepsOrder) {
+  vector_t* v = createVector("a", "b", "c", "d", NULL);
+  v->match    = (matchFunction)strequal;
+  vector_removeIfFound(v, "b");
+  ck_assert_uint_eq(v->len, 3);
+  ck_assert_str_eq(vector_at(v, 0), "a");
+  ck_assert_str_eq(vector_at(v, 1), "c");
+  ck_assert_str_eq(vector_at(v, 2), "d");
+  ck_assert_uint_eq(vector_indexOf(v, "x"), v->len);
+  ck_assert_ptr_eq(vector_find(v, "x"), NULL);
+  char* joined = vectorToDelimitedString(v, ", ");
+  ck_assert_str_eq(joined, "a, c, d");
+  secFree(joined);
+  secFreeVector(v);
+}
+END_TEST
+
+START_TEST(test_freeFunction) {
+  vector_t* v = vector_new();
+  v->free     = (void (*)(void*))_secFree;
+  v->match    = (matchFunction)strequal;
+  vector_push(v, oidc_strcopy("one"));
+  vector_push(v, oidc_strcopy("two"));
+  vector_removeIfFound(v, "one");
+  ck_assert_str_eq(vector_find(v, "two"), "two");
+  vector_clear(v);
+  ck_assert_uint_eq(v->len, 0);
+  vector_push(v, oidc_strcopy("three"));
+  secFreeVector(v);
+}
+END_TEST
+
+TCase* test_case_vector() {
+  TCase* tc = tcase_create("vector");
+  tcase_add_test(tc, test_pushAndGrow);
+  tcase_add_test(tc, test_removeKeepsOrder);
+  tcase_add_test(tc, test_freeFunction);
+  return tc;
+}
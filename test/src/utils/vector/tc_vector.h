@@ -0,0 +1,8 @@
+#ifndef TEST_UTILS_VECTOR_VECTOR_H
+#define TEST_UTILS_VECTOR_VECTOR_H
+
+#include <check.h>
+
+TCase* test_case_vector();
+
+#endif  // TEST_UTILS_VECTOR_VECTOR_H